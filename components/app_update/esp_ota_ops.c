@@ -0,0 +1,650 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "rom/crc.h"
+#include "hwcrypto/sha.h"
+#include "esp_spi_flash.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+
+/*
+    OTA updates
+
+    esp_ota_begin starts ota_erase_task, which erases sectors of the target
+    partition in order, staying at most OTA_ERASE_AHEAD bytes ahead of the
+    data written so far. esp_ota_write waits until the sectors it is going to
+    write are erased, writes data and updates the SHA-256 of the image.
+
+    The two tasks share ota_state_t. 'erased' is only changed by the erase
+    task and 'written' only by the writer; each side gives a semaphore after
+    changing its counter, and waits on the other's semaphore when it can't
+    proceed.
+
+    Compressed updates (esp_ota_begin_compressed) pass the data through
+    ota_inflate, which decodes it into a window of the last
+    2^OTA_COMPRESS_WINDOW_BITS image bytes, as the back-references need,
+    and writes the window to flash each time it is full.
+
+    Delta updates (esp_ota_begin_delta) are compressed the same way. The
+    decoded data is a patch, which ota_delta_apply applies to the base
+    partition: a header (ota_delta_header_t), then control entries of
+    OTA_DELTA_CTRL_SIZE bytes, each followed by its diff and extra bytes.
+    An entry first copies bytes of the base image at the current base
+    position, then adds the diff bytes to the following bytes of the base
+    image, then copies the extra bytes as they are; the base position then
+    moves by the adjustment of the entry (as in bsdiff, with the copy
+    instead of long runs of zero diff bytes, which the heatshrink format
+    doesn't compress to less than a bit per byte). The resulting
+    image goes through a buffer of OTA_DELTA_OUT_SIZE bytes to
+    ota_write_image, and its SHA-256 has to match the one of the header.
+    app_update/ota_delta.py writes such patches.
+
+    Partition table layout and the OTA selection structure (ota_select) are
+    shared with the bootloader, see bootloader_config.h. The bootloader
+    starts app partition ota_N, N = (seq - 1) % number_of_ota_apps, where seq
+    is the largest valid sequence number of the two copies of ota_select.
+*/
+
+#define OTA_ERASE_AHEAD         (16 * SPI_FLASH_SEC_SIZE)
+#define OTA_DELTA_OUT_SIZE      1024
+#define OTA_DELTA_CTRL_SIZE     16      // copy, diff and extra length, adjustment
+#define OTA_ERASE_TASK_STACK    2048
+
+typedef struct {
+    uint32_t ota_seq;
+    uint8_t  seq_label[24];
+    uint32_t crc;   /* CRC32 of ota_seq field only */
+} ota_select;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} ota_partition_pos_t;
+
+/* Decoder of a compressed image, see esp_ota_begin_compressed */
+typedef struct {
+    uint8_t window[1 << OTA_COMPRESS_WINDOW_BITS];
+    uint32_t head;              // image bytes decoded
+    uint32_t bits;              // input bits not decoded yet, in the low bit_count bits
+    uint32_t bit_count;
+    uint32_t flushed;           // decoded bytes passed on to ota_output
+    esp_err_t err;              // error of a write of the window
+} ota_inflate_t;
+
+typedef struct {
+    uint32_t magic;             // OTA_DELTA_MAGIC
+    uint32_t image_size;
+    uint32_t base_size;         // bytes of the base partition the patch refers to
+    uint8_t  sha256[32];        // of the new image
+} ota_delta_header_t;
+
+typedef enum {
+    OTA_DELTA_HEADER,
+    OTA_DELTA_CTRL,
+    OTA_DELTA_COPY,
+    OTA_DELTA_DIFF,
+    OTA_DELTA_EXTRA,
+} ota_delta_state_t;
+
+/* Patch decoder of a delta update, see esp_ota_begin_delta */
+typedef struct {
+    ota_partition_pos_t base;
+    ota_delta_state_t state;
+    uint8_t field[sizeof(ota_delta_header_t)];  // header or control entry being received
+    uint32_t field_len;
+    uint32_t remaining;         // bytes left of the copy, diff or extra block
+    uint32_t diff_len;          // of the current control entry
+    uint32_t extra_len;
+    int32_t adjust;
+    uint32_t base_size;
+    uint32_t base_pos;
+    uint8_t sha256[32];
+    uint32_t out_len;
+    uint32_t out[OTA_DELTA_OUT_SIZE / sizeof(uint32_t)];    // image bytes not written yet
+} ota_delta_t;
+
+#define OTA_WINDOW_SIZE         (1 << OTA_COMPRESS_WINDOW_BITS)
+#define OTA_WINDOW_MASK         (OTA_WINDOW_SIZE - 1)
+#define OTA_LITERAL_BITS        (1 + 8)
+#define OTA_BACKREF_BITS        (1 + OTA_COMPRESS_WINDOW_BITS + OTA_COMPRESS_LOOKAHEAD_BITS)
+
+typedef struct {
+    esp_ota_handle_t handle;
+    ota_partition_pos_t part;
+    uint32_t image_size;        // OTA_SIZE_UNKNOWN if not known
+    volatile uint32_t erase_end;    // the erase task stops here, lowered by a delta header
+    volatile uint32_t erased;   // erased bytes, from the start of the partition
+    volatile uint32_t written;  // written bytes
+    volatile esp_err_t erase_err;
+    volatile bool stop;
+    SemaphoreHandle_t erased_sem;
+    SemaphoreHandle_t written_sem;
+    SemaphoreHandle_t done_sem;
+    esp_sha_context sha;
+    ota_inflate_t* inflate;     // NULL unless the update is compressed
+    ota_delta_t* delta;         // NULL unless the update is a delta update
+} ota_state_t;
+
+static ota_state_t* s_ota = NULL;
+static esp_ota_handle_t s_ota_last_handle = 0;
+
+static esp_err_t ota_find_partitions(uint32_t ota_index, ota_partition_pos_t* app,
+                                     ota_partition_pos_t* otadata, uint32_t* app_count)
+{
+    bool app_found = false;
+    uint32_t count = 0;
+    for (const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+            ESP_PARTITION_SUBTYPE_ANY, NULL); part != NULL;
+            part = esp_partition_find_next(part, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL)) {
+        if (part->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MIN || part->subtype > ESP_PARTITION_SUBTYPE_APP_OTA_MAX) {
+            continue;
+        }
+        ++count;
+        if (part->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_MIN == ota_index && app) {
+            app->offset = part->address;
+            app->size = part->size;
+            app_found = true;
+        }
+    }
+    const esp_partition_t* data = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_DATA_OTA, NULL);
+    if (data && otadata) {
+        otadata->offset = data->address;
+        otadata->size = data->size;
+    }
+    if (app_count) {
+        *app_count = count;
+    }
+    if ((app && !app_found) || (otadata && !data)) {
+        return ESP_ERR_OTA_PARTITION_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+static void ota_erase_task(void* arg)
+{
+    ota_state_t* ota = (ota_state_t*) arg;
+    while (!ota->stop && ota->erased < ota->erase_end) {
+        if (ota->erased >= ota->written + OTA_ERASE_AHEAD) {
+            xSemaphoreTake(ota->written_sem, portMAX_DELAY);
+            continue;
+        }
+        esp_err_t err = spi_flash_erase_sector((ota->part.offset + ota->erased) / SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK) {
+            ota->erase_err = err;
+            xSemaphoreGive(ota->erased_sem);
+            break;
+        }
+        ota->erased += SPI_FLASH_SEC_SIZE;
+        xSemaphoreGive(ota->erased_sem);
+    }
+    xSemaphoreGive(ota->done_sem);
+    vTaskDelete(NULL);
+}
+
+static void ota_free(ota_state_t* ota)
+{
+    if (ota->erased_sem) {
+        vSemaphoreDelete(ota->erased_sem);
+    }
+    if (ota->written_sem) {
+        vSemaphoreDelete(ota->written_sem);
+    }
+    if (ota->done_sem) {
+        vSemaphoreDelete(ota->done_sem);
+    }
+    free(ota->inflate);
+    free(ota->delta);
+    free(ota);
+}
+
+static esp_err_t ota_begin(uint32_t ota_index, uint32_t image_size, bool compressed,
+                           const esp_partition_t* base, esp_ota_handle_t* out_handle)
+{
+    if (out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_ota != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ota_partition_pos_t part;
+    esp_err_t err = ota_find_partitions(ota_index, &part, NULL, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (image_size != OTA_SIZE_UNKNOWN && image_size > part.size) {
+        return ESP_ERR_OTA_IMAGE_TOO_LARGE;
+    }
+    if (base && (base->type != ESP_PARTITION_TYPE_APP || base->address == part.offset)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ota_state_t* ota = (ota_state_t*) calloc(1, sizeof(ota_state_t));
+    if (ota == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ota->part = part;
+    ota->image_size = image_size;
+    ota->erase_end = (image_size == OTA_SIZE_UNKNOWN) ? part.size :
+                     (image_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    ota->erase_err = ESP_OK;
+    if (compressed) {
+        ota->inflate = (ota_inflate_t*) calloc(1, sizeof(ota_inflate_t));
+        if (ota->inflate == NULL) {
+            ota_free(ota);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (base) {
+        ota->delta = (ota_delta_t*) calloc(1, sizeof(ota_delta_t));
+        if (ota->delta == NULL) {
+            ota_free(ota);
+            return ESP_ERR_NO_MEM;
+        }
+        ota->delta->base.offset = base->address;
+        ota->delta->base.size = base->size;
+        ota->delta->state = OTA_DELTA_HEADER;
+    }
+    ota->erased_sem = xSemaphoreCreateBinary();
+    ota->written_sem = xSemaphoreCreateBinary();
+    ota->done_sem = xSemaphoreCreateBinary();
+    if (!ota->erased_sem || !ota->written_sem || !ota->done_sem) {
+        ota_free(ota);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_sha256_init(&ota->sha);
+    esp_sha256_start(&ota->sha, 0);
+
+    ota->handle = ++s_ota_last_handle;
+    if (xTaskCreate(ota_erase_task, "ota_erase", OTA_ERASE_TASK_STACK, ota,
+                    uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        esp_sha256_free(&ota->sha);
+        ota_free(ota);
+        return ESP_ERR_NO_MEM;
+    }
+    s_ota = ota;
+    *out_handle = ota->handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(uint32_t ota_index, uint32_t image_size, esp_ota_handle_t* out_handle)
+{
+    return ota_begin(ota_index, image_size, false, NULL, out_handle);
+}
+
+esp_err_t esp_ota_begin_compressed(uint32_t ota_index, uint32_t image_size, esp_ota_handle_t* out_handle)
+{
+    return ota_begin(ota_index, image_size, true, NULL, out_handle);
+}
+
+esp_err_t esp_ota_begin_delta(uint32_t ota_index, const esp_partition_t* base, esp_ota_handle_t* out_handle)
+{
+    if (base == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ota_begin(ota_index, OTA_SIZE_UNKNOWN, true, base, out_handle);
+}
+
+static esp_err_t ota_write_image(ota_state_t* ota, const void* data, size_t size)
+{
+    const uint32_t limit = (ota->image_size == OTA_SIZE_UNKNOWN) ? ota->part.size : ota->image_size;
+    if (size > limit - ota->written) {
+        return ESP_ERR_OTA_IMAGE_TOO_LARGE;
+    }
+    const uint32_t end = ota->written + size;
+    while (ota->erased < end) {
+        if (ota->erase_err != ESP_OK) {
+            return ota->erase_err;
+        }
+        xSemaphoreTake(ota->erased_sem, portMAX_DELAY);
+    }
+    esp_err_t err = spi_flash_write_bytes(ota->part.offset + ota->written, data, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    esp_sha256_update(&ota->sha, (const unsigned char*) data, size);
+    ota->written = end;
+    xSemaphoreGive(ota->written_sem);
+    return ESP_OK;
+}
+
+static esp_err_t ota_delta_flush(ota_state_t* ota)
+{
+    ota_delta_t* d = ota->delta;
+    if (d->out_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = ota_write_image(ota, d->out, d->out_len);
+    d->out_len = 0;
+    return err;
+}
+
+static esp_err_t ota_delta_start(ota_state_t* ota)
+{
+    ota_delta_t* d = ota->delta;
+    ota_delta_header_t header;
+    memcpy(&header, d->field, sizeof(header));
+    if (header.magic != OTA_DELTA_MAGIC || header.base_size > d->base.size) {
+        return ESP_ERR_OTA_DATA_INVALID;
+    }
+    if (header.image_size > ota->part.size) {
+        return ESP_ERR_OTA_IMAGE_TOO_LARGE;
+    }
+    d->base_size = header.base_size;
+    memcpy(d->sha256, header.sha256, sizeof(d->sha256));
+    ota->image_size = header.image_size;
+    // the erase task doesn't need to go beyond the image
+    ota->erase_end = (header.image_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    d->state = OTA_DELTA_CTRL;
+    return ESP_OK;
+}
+
+static esp_err_t ota_delta_entry(ota_delta_t* d)
+{
+    uint32_t copy_len;
+    memcpy(&copy_len, d->field, sizeof(copy_len));
+    memcpy(&d->diff_len, d->field + 4, sizeof(d->diff_len));
+    memcpy(&d->extra_len, d->field + 8, sizeof(d->extra_len));
+    memcpy(&d->adjust, d->field + 12, sizeof(d->adjust));
+    const uint32_t avail = d->base_size - d->base_pos;
+    if (copy_len > avail || d->diff_len > avail - copy_len) {
+        return ESP_ERR_OTA_DATA_INVALID;
+    }
+    d->state = OTA_DELTA_COPY;
+    d->remaining = copy_len;
+    return ESP_OK;
+}
+
+/* Move on to the next block or entry once a block is complete */
+static esp_err_t ota_delta_advance(ota_delta_t* d)
+{
+    while (d->remaining == 0 && d->state >= OTA_DELTA_COPY) {
+        if (d->state == OTA_DELTA_COPY) {
+            d->state = OTA_DELTA_DIFF;
+            d->remaining = d->diff_len;
+            continue;
+        }
+        if (d->state == OTA_DELTA_DIFF) {
+            d->state = OTA_DELTA_EXTRA;
+            d->remaining = d->extra_len;
+            continue;
+        }
+        int64_t pos = (int64_t) d->base_pos + d->adjust;
+        if (pos < 0 || pos > d->base_size) {
+            return ESP_ERR_OTA_DATA_INVALID;
+        }
+        d->base_pos = (uint32_t) pos;
+        d->state = OTA_DELTA_CTRL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_delta_apply(ota_state_t* ota, const uint8_t* data, size_t size)
+{
+    ota_delta_t* d = ota->delta;
+    uint8_t* out = (uint8_t*) d->out;
+    esp_err_t err = ESP_OK;
+    // copies don't consume data, so they are done even without more data
+    while ((size > 0 || d->state == OTA_DELTA_COPY) && err == ESP_OK) {
+        if (d->state == OTA_DELTA_HEADER || d->state == OTA_DELTA_CTRL) {
+            const size_t field_size = (d->state == OTA_DELTA_HEADER) ? sizeof(ota_delta_header_t) : OTA_DELTA_CTRL_SIZE;
+            size_t n = field_size - d->field_len;
+            if (n > size) {
+                n = size;
+            }
+            memcpy(d->field + d->field_len, data, n);
+            d->field_len += n;
+            data += n;
+            size -= n;
+            if (d->field_len == field_size) {
+                d->field_len = 0;
+                err = (d->state == OTA_DELTA_HEADER) ? ota_delta_start(ota) : ota_delta_entry(d);
+                if (err == ESP_OK) {
+                    err = ota_delta_advance(d);
+                }
+            }
+            continue;
+        }
+        size_t n = d->remaining;
+        if (n > size && d->state != OTA_DELTA_COPY) {
+            n = size;
+        }
+        if (n > OTA_DELTA_OUT_SIZE - d->out_len) {
+            n = OTA_DELTA_OUT_SIZE - d->out_len;
+        }
+        uint8_t* dst = out + d->out_len;
+        if (d->state == OTA_DELTA_EXTRA) {
+            memcpy(dst, data, n);
+        } else {
+            err = spi_flash_read_bytes(d->base.offset + d->base_pos, dst, n);
+            d->base_pos += n;
+        }
+        if (d->state != OTA_DELTA_COPY) {
+            if (d->state == OTA_DELTA_DIFF) {
+                for (size_t i = 0; i < n; ++i) {
+                    dst[i] += data[i];
+                }
+            }
+            data += n;
+            size -= n;
+        }
+        d->out_len += n;
+        d->remaining -= n;
+        if (err == ESP_OK && d->out_len == OTA_DELTA_OUT_SIZE) {
+            err = ota_delta_flush(ota);
+        }
+        if (err == ESP_OK) {
+            err = ota_delta_advance(d);
+        }
+    }
+    return err;
+}
+
+/* Pass decoded data on, to flash or to the patch decoder */
+static esp_err_t ota_output(ota_state_t* ota, const uint8_t* data, size_t size)
+{
+    if (ota->delta) {
+        return ota_delta_apply(ota, data, size);
+    }
+    return ota_write_image(ota, data, size);
+}
+
+/* Write the decoded bytes which aren't written yet; they start at the
+   beginning of the window, as it is only written when full and at the end */
+static esp_err_t ota_inflate_flush(ota_state_t* ota)
+{
+    ota_inflate_t* inf = ota->inflate;
+    size_t size = inf->head - inf->flushed;
+    if (size == 0 || inf->err != ESP_OK) {
+        return inf->err;
+    }
+    inf->err = ota_output(ota, inf->window, size);
+    inf->flushed = inf->head;
+    return inf->err;
+}
+
+static inline esp_err_t ota_inflate_put(ota_state_t* ota, uint8_t c)
+{
+    ota_inflate_t* inf = ota->inflate;
+    inf->window[inf->head & OTA_WINDOW_MASK] = c;
+    if ((++inf->head & OTA_WINDOW_MASK) == 0) {
+        return ota_inflate_flush(ota);
+    }
+    return ESP_OK;
+}
+
+/*
+   Decode compressed data, in the heatshrink format with a window of
+   OTA_COMPRESS_WINDOW_BITS and a lookahead of OTA_COMPRESS_LOOKAHEAD_BITS:
+   a bit stream, most significant bit first, of a 1 followed by a literal
+   byte, or a 0 followed by the distance - 1 and the length - 1 of a copy of
+   earlier bytes.
+*/
+static esp_err_t ota_inflate(ota_state_t* ota, const uint8_t* data, size_t size)
+{
+    ota_inflate_t* inf = ota->inflate;
+    esp_err_t err = inf->err;
+    while (err == ESP_OK) {
+        while (inf->bit_count <= 24 && size > 0) {
+            inf->bits = (inf->bits << 8) | *data++;
+            inf->bit_count += 8;
+            --size;
+        }
+        if (inf->bit_count < OTA_LITERAL_BITS) {
+            break;
+        }
+        uint32_t tag = (inf->bits >> (inf->bit_count - 1)) & 1;
+        if (tag) {
+            inf->bit_count -= OTA_LITERAL_BITS;
+            err = ota_inflate_put(ota, (inf->bits >> inf->bit_count) & 0xff);
+            continue;
+        }
+        if (inf->bit_count < OTA_BACKREF_BITS) {
+            break;
+        }
+        inf->bit_count -= OTA_BACKREF_BITS;
+        uint32_t token = inf->bits >> inf->bit_count;
+        uint32_t count = (token & ((1 << OTA_COMPRESS_LOOKAHEAD_BITS) - 1)) + 1;
+        uint32_t distance = ((token >> OTA_COMPRESS_LOOKAHEAD_BITS) & OTA_WINDOW_MASK) + 1;
+        if (distance > inf->head) {
+            // refers to data before the start of the image
+            err = ESP_ERR_OTA_DATA_INVALID;
+            break;
+        }
+        while (count-- > 0 && err == ESP_OK) {
+            err = ota_inflate_put(ota, inf->window[(inf->head - distance) & OTA_WINDOW_MASK]);
+        }
+    }
+    inf->bits &= (1 << inf->bit_count) - 1;
+    inf->err = err;
+    return err;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+{
+    ota_state_t* ota = s_ota;
+    if (ota == NULL || ota->handle != handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota->inflate) {
+        return ota_inflate(ota, (const uint8_t*) data, size);
+    }
+    return ota_write_image(ota, data, size);
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle, uint8_t out_sha256[32])
+{
+    ota_state_t* ota = s_ota;
+    if (ota == NULL || ota->handle != handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    if (ota->inflate) {
+        err = ota_inflate_flush(ota);
+    }
+    if (err == ESP_OK && ota->delta) {
+        err = ota_delta_flush(ota);
+        if (err == ESP_OK && ota->delta->state != OTA_DELTA_CTRL) {
+            // patch ends within the header or a block
+            err = ESP_ERR_OTA_DATA_INVALID;
+        }
+    }
+    ota->stop = true;
+    xSemaphoreGive(ota->written_sem);
+    xSemaphoreTake(ota->done_sem, portMAX_DELAY);
+
+    uint8_t sha256[32];
+    esp_sha256_finish(&ota->sha, sha256);
+    esp_sha256_free(&ota->sha);
+    if (out_sha256) {
+        memcpy(out_sha256, sha256, sizeof(sha256));
+    }
+
+    if (err == ESP_OK && ota->image_size != OTA_SIZE_UNKNOWN && ota->written != ota->image_size) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (err == ESP_OK && ota->written == 0) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (err == ESP_OK && ota->delta && memcmp(sha256, ota->delta->sha256, sizeof(sha256)) != 0) {
+        err = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    s_ota = NULL;
+    ota_free(ota);
+    return err;
+}
+
+static uint32_t ota_select_crc(const ota_select* s)
+{
+    return crc32_le(UINT32_MAX, (const uint8_t*) &s->ota_seq, sizeof(s->ota_seq));
+}
+
+static bool ota_select_valid(const ota_select* s)
+{
+    return s->ota_seq != UINT32_MAX && s->crc == ota_select_crc(s);
+}
+
+esp_err_t esp_ota_set_boot_partition(uint32_t ota_index)
+{
+    ota_partition_pos_t app;
+    ota_partition_pos_t otadata;
+    uint32_t app_count;
+    esp_err_t err = ota_find_partitions(ota_index, &app, &otadata, &app_count);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (ota_index >= app_count) {
+        // the bootloader only selects between ota_0 .. ota_<app_count - 1>
+        return ESP_ERR_OTA_PARTITION_NOT_FOUND;
+    }
+
+    ota_select s[2];
+    for (int i = 0; i < 2; ++i) {
+        err = spi_flash_read(otadata.offset + i * SPI_FLASH_SEC_SIZE, (uint32_t*) &s[i], sizeof(s[i]));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    const bool valid0 = ota_select_valid(&s[0]);
+    const bool valid1 = ota_select_valid(&s[1]);
+    uint32_t seq = 0;
+    if (valid0 && s[0].ota_seq > seq) {
+        seq = s[0].ota_seq;
+    }
+    if (valid1 && s[1].ota_seq > seq) {
+        seq = s[1].ota_seq;
+    }
+    // keep the copy which the bootloader currently uses intact
+    const int target = (valid0 && (!valid1 || s[0].ota_seq >= s[1].ota_seq)) ? 1 : 0;
+
+    ota_select sel;
+    memset(&sel, 0xff, sizeof(sel));
+    sel.ota_seq = seq + 1;
+    while ((sel.ota_seq - 1) % app_count != ota_index) {
+        ++sel.ota_seq;
+    }
+    sel.crc = ota_select_crc(&sel);
+
+    const uint32_t addr = otadata.offset + target * SPI_FLASH_SEC_SIZE;
+    err = spi_flash_erase_sector(addr / SPI_FLASH_SEC_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return spi_flash_write(addr, (const uint32_t*) &sel, sizeof(sel));
+}
@@ -0,0 +1,174 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ESP_OTA_OPS_H
+#define ESP_OTA_OPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_OTA_BASE                0x1500
+#define ESP_ERR_OTA_PARTITION_NOT_FOUND (ESP_ERR_OTA_BASE + 0x01)  /*!< OTA app or OTA data partition not found in the partition table */
+#define ESP_ERR_OTA_IMAGE_TOO_LARGE     (ESP_ERR_OTA_BASE + 0x02)  /*!< Image doesn't fit into the OTA partition */
+#define ESP_ERR_OTA_DATA_INVALID        (ESP_ERR_OTA_BASE + 0x03)  /*!< Compressed data or patch can't be decoded */
+#define ESP_ERR_OTA_VALIDATE_FAILED     (ESP_ERR_OTA_BASE + 0x04)  /*!< SHA-256 of the patched image differs from the one of the patch */
+
+#define OTA_SIZE_UNKNOWN    0xffffffff  /*!< image_size value if the size of the image isn't known in advance */
+
+#define OTA_COMPRESS_WINDOW_BITS    11  /*!< heatshrink window of compressed images, 2 kB */
+#define OTA_COMPRESS_LOOKAHEAD_BITS 4   /*!< heatshrink lookahead of compressed images */
+
+#define OTA_DELTA_MAGIC     0xe5de17a0  /*!< first word of the patch of a delta update */
+
+/**
+ * Opaque handle of an update in progress
+ */
+typedef uint32_t esp_ota_handle_t;
+
+/**
+ * @brief      Start writing an image into an OTA app partition
+ *
+ * Sectors of the partition are erased by a background task, ahead of the
+ * data passed to esp_ota_write, so that writes don't have to wait for
+ * erase operations as long as the data arrives slower than flash can be
+ * erased. Only one update can be in progress at a time.
+ *
+ * @param      ota_index   index of the partition, i.e. N for subtype ota_N
+ * @param      image_size  size of the image if known, or OTA_SIZE_UNKNOWN.
+ *                         If known, only the sectors the image occupies are
+ *                         erased.
+ * @param[out] out_handle  handle to be passed to esp_ota_write and esp_ota_end
+ *
+ * @return
+ *             - ESP_OK if the update has been started
+ *             - ESP_ERR_OTA_PARTITION_NOT_FOUND if there is no such partition
+ *             - ESP_ERR_OTA_IMAGE_TOO_LARGE if image_size exceeds the partition size
+ *             - ESP_ERR_INVALID_STATE if another update is in progress
+ *             - ESP_ERR_NO_MEM if the erase task can't be created
+ *             - other error codes from the underlying flash driver
+ */
+esp_err_t esp_ota_begin(uint32_t ota_index, uint32_t image_size, esp_ota_handle_t* out_handle);
+
+/**
+ * @brief      Start writing a compressed image into an OTA app partition
+ *
+ * Like esp_ota_begin, but the data passed to esp_ota_write is compressed in
+ * the heatshrink format, with OTA_COMPRESS_WINDOW_BITS and
+ * OTA_COMPRESS_LOOKAHEAD_BITS, as written by app_update/ota_compress.py.
+ * It is decompressed as it arrives, with a buffer of the size of the window.
+ * The SHA-256 from esp_ota_end is the one of the decompressed image.
+ *
+ * @param      ota_index   index of the partition, i.e. N for subtype ota_N
+ * @param      image_size  size of the decompressed image if known, or
+ *                         OTA_SIZE_UNKNOWN
+ * @param[out] out_handle  handle to be passed to esp_ota_write and esp_ota_end
+ *
+ * @return     as esp_ota_begin
+ */
+esp_err_t esp_ota_begin_compressed(uint32_t ota_index, uint32_t image_size, esp_ota_handle_t* out_handle);
+
+/**
+ * @brief      Start a delta update of an OTA app partition
+ *
+ * Like esp_ota_begin_compressed, but the decompressed data passed to
+ * esp_ota_write is a patch, as written by app_update/ota_delta.py from the
+ * image in the base partition and the new image. The patch is applied as
+ * it arrives, reading from the base partition, with buffers of a few kB.
+ * Its header holds the size and the SHA-256 of the new image; esp_ota_end
+ * fails with ESP_ERR_OTA_VALIDATE_FAILED if the SHA-256 of the written image
+ * differs, e.g. because the base partition doesn't hold the image the patch
+ * was made for.
+ *
+ * @param      ota_index   index of the partition to write, i.e. N for subtype ota_N
+ * @param      base        app partition holding the base image, usually the
+ *                         running one; must not be the partition to write
+ * @param[out] out_handle  handle to be passed to esp_ota_write and esp_ota_end
+ *
+ * @return     as esp_ota_begin, or ESP_ERR_INVALID_ARG if base isn't a
+ *             usable app partition
+ */
+esp_err_t esp_ota_begin_delta(uint32_t ota_index, const esp_partition_t* base, esp_ota_handle_t* out_handle);
+
+/**
+ * @brief      Append data to the image
+ *
+ * SHA-256 of the image is updated as data is written, so the image doesn't
+ * have to be read back for verification.
+ *
+ * @param      handle  handle returned by esp_ota_begin
+ * @param      data    image data, must not be located in Flash
+ * @param      size    length of data, in bytes
+ *
+ * @return
+ *             - ESP_OK if data has been written
+ *             - ESP_ERR_INVALID_ARG if handle isn't the update in progress
+ *             - ESP_ERR_OTA_IMAGE_TOO_LARGE if data exceeds image_size or
+ *               the partition size
+ *             - ESP_ERR_OTA_DATA_INVALID if compressed data or the patch
+ *               can't be decoded
+ *             - other error codes from the underlying flash driver
+ */
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
+
+/**
+ * @brief      Finish writing the image
+ *
+ * The erase task is stopped and the update is finished, whether or not an
+ * error occurred. The partition is not selected for booting, see
+ * esp_ota_set_boot_partition.
+ *
+ * @param      handle      handle returned by esp_ota_begin
+ * @param[out] out_sha256  SHA-256 of all data passed to esp_ota_write, may be NULL
+ *
+ * @return
+ *             - ESP_OK if the whole image has been written
+ *             - ESP_ERR_INVALID_ARG if handle isn't the update in progress
+ *             - ESP_ERR_INVALID_STATE if image_size was given and less data has been written
+ *             - ESP_ERR_OTA_DATA_INVALID if the patch of a delta update is incomplete
+ *             - ESP_ERR_OTA_VALIDATE_FAILED if the SHA-256 of the image
+ *               written by a delta update differs from the one of the patch
+ *             - error code of a failed erase of a sector of the image, or of
+ *               the write of the end of a compressed image
+ */
+esp_err_t esp_ota_end(esp_ota_handle_t handle, uint8_t out_sha256[32]);
+
+/**
+ * @brief      Select the OTA app partition which the bootloader starts
+ *
+ * Writes the copy of the OTA selection structure in the OTA data partition
+ * which the bootloader doesn't currently use, with a sequence number which
+ * makes the bootloader choose the given partition. If power is lost while
+ * writing, the bootloader keeps starting the previously selected app.
+ *
+ * @param      ota_index  index of the partition, i.e. N for subtype ota_N
+ *
+ * @return
+ *             - ESP_OK
+ *             - ESP_ERR_OTA_PARTITION_NOT_FOUND if there is no such app
+ *               partition or no OTA data partition
+ *             - other error codes from the underlying flash driver
+ */
+esp_err_t esp_ota_set_boot_partition(uint32_t ota_index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESP_OTA_OPS_H */
@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+#
+# Compresses an app image for esp_ota_begin_compressed, in the heatshrink
+# format with the window and lookahead of esp_ota_ops.h
+# (OTA_COMPRESS_WINDOW_BITS, OTA_COMPRESS_LOOKAHEAD_BITS).
+#
+# The stream is a sequence of bits, most significant bit first: a 1 and a
+# literal byte, or a 0, the distance - 1 and the length - 1 of a copy of
+# earlier bytes. The last byte is padded with zero bits.
+import argparse
+import sys
+
+__version__ = '1.0'
+
+WINDOW_BITS = 11
+LOOKAHEAD_BITS = 4
+
+WINDOW = 1 << WINDOW_BITS
+MAX_MATCH = 1 << LOOKAHEAD_BITS
+# a copy takes 1 + WINDOW_BITS + LOOKAHEAD_BITS bits, a literal 9
+MIN_MATCH = 2
+MAX_CHAIN = 32
+
+
+class BitWriter(object):
+    def __init__(self):
+        self.out = bytearray()
+        self.bits = 0
+        self.count = 0
+
+    def put(self, value, count):
+        self.bits = (self.bits << count) | value
+        self.count += count
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.bits >> self.count) & 0xff)
+        self.bits &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count > 0:
+            self.out.append((self.bits << (8 - self.count)) & 0xff)
+        return bytes(self.out)
+
+
+def compress(data):
+    data = bytearray(data)
+    writer = BitWriter()
+    chains = {}     # 2 byte prefix -> positions, most recent last
+    pos = 0
+
+    def insert(i):
+        if i + MIN_MATCH <= len(data):
+            chains.setdefault(bytes(data[i:i + MIN_MATCH]), []).append(i)
+
+    while pos < len(data):
+        best_len = 0
+        best_dist = 0
+        limit = min(MAX_MATCH, len(data) - pos)
+        candidates = chains.get(bytes(data[pos:pos + MIN_MATCH]), [])
+        for cand in reversed(candidates[-MAX_CHAIN:]):
+            dist = pos - cand
+            if dist > WINDOW:
+                break
+            length = MIN_MATCH
+            while length < limit and data[cand + length] == data[pos + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, dist
+                if length == limit:
+                    break
+        if best_len >= MIN_MATCH:
+            writer.put(((best_dist - 1) << LOOKAHEAD_BITS) | (best_len - 1), 1 + WINDOW_BITS + LOOKAHEAD_BITS)
+            step = best_len
+        else:
+            writer.put(0x100 | data[pos], 9)
+            step = 1
+        for i in range(pos, pos + step):
+            insert(i)
+        pos += step
+    return writer.finish()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ota_compress.py v%s - compress an app image for '
+                                     'esp_ota_begin_compressed' % __version__)
+    parser.add_argument('image', help='app image (.bin)')
+    parser.add_argument('output', help='compressed image')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        data = f.read()
+    compressed = compress(data)
+    with open(args.output, 'wb') as f:
+        f.write(compressed)
+    sys.stdout.write('%s: %d bytes, compressed to %d bytes (%d%%)\n' %
+                     (args.image, len(data), len(compressed), 100 * len(compressed) // max(len(data), 1)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,217 @@
+#!/usr/bin/env python
+#
+# Writes the patch of a delta update for esp_ota_begin_delta, which turns the
+# base app image (the one running on the device) into the new one.
+#
+# The patch is compressed like an image for esp_ota_begin_compressed, see
+# ota_compress.py. Decompressed, it starts with a header:
+#
+#   uint32 OTA_DELTA_MAGIC, uint32 size of the new image,
+#   uint32 size of the base image, SHA-256 of the new image
+#
+# followed by entries of a control part, uint32 copy length, uint32 diff
+# length, uint32 extra length and int32 adjustment (little endian), the diff
+# bytes and the extra bytes. Copied bytes are taken from the base image at
+# the current base position, which then advances; diff bytes are added to
+# the following bytes of the base image; extra bytes are new data. The base
+# position then moves by the adjustment. As in bsdiff, code which only moved
+# differs in a few bytes of each instruction referring to other code or
+# data, so most diff bytes are zero and compress well. Long runs of zero
+# diff bytes are written as copies, as the compression takes a bit per
+# byte for them.
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ota_compress  # noqa
+
+__version__ = '1.0'
+
+OTA_DELTA_MAGIC = 0xe5de17a0
+
+# bytes of the base image indexed per position, and the shortest exact match
+# which starts a new entry
+KEY_SIZE = 8
+MIN_MATCH = 24
+# an approximate match is extended until it has this many more bytes which
+# differ than bytes which are equal since its best point
+EXTEND_SLACK = 32
+# zero diff bytes from which on a copy is written, instead of diff bytes
+ZERO_RUN = 32
+
+
+def build_index(old):
+    old = bytes(old)
+    index = {}
+    for i in range(len(old) - KEY_SIZE + 1):
+        index.setdefault(old[i:i + KEY_SIZE], i)
+    return index
+
+
+def match_length(old, o, new, n):
+    length = 0
+    limit = min(len(old) - o, len(new) - n)
+    while length < limit and old[o + length] == new[n + length]:
+        length += 1
+    return length
+
+
+def extend_approximate(old, o, new, n):
+    """ Length of the match of old[o:] and new[n:] which maximizes
+    2 * equal bytes - length, as bsdiff does """
+    best_len = 0
+    best_score = 0
+    score = 0
+    length = 0
+    limit = min(len(old) - o, len(new) - n)
+    while length < limit:
+        score += 1 if old[o + length] == new[n + length] else -1
+        length += 1
+        if score > best_score:
+            best_score, best_len = score, length
+        elif score < best_score - EXTEND_SLACK:
+            break
+    return best_len
+
+
+def diff(old, new):
+    """ Returns a list of (base offset, diff length, new offset of the extra
+    bytes, extra length) """
+    index = build_index(old)
+    entries = []
+    o_start = 0     # base offset of the current entry's diff
+    n_start = 0     # its start in the new image
+    diff_len = 0
+    pos = 0
+    while pos < len(new):
+        # where the current diff would continue, if the new bytes match there
+        expected = o_start + diff_len + (pos - n_start - diff_len)
+        found = None
+        if 0 <= expected < len(old) and match_length(old, expected, new, pos) >= MIN_MATCH:
+            found = expected
+        else:
+            cand = index.get(bytes(new[pos:pos + KEY_SIZE]))
+            if cand is not None and match_length(old, cand, new, pos) >= MIN_MATCH:
+                found = cand
+        if found is None:
+            pos += 1
+            continue
+        if found == expected and pos == n_start + diff_len:
+            # continues the diff of the current entry
+            diff_len += extend_approximate(old, found, new, pos)
+            pos = n_start + diff_len
+            continue
+        extra_start = n_start + diff_len
+        entries.append((o_start, diff_len, extra_start, pos - extra_start))
+        o_start, n_start = found, pos
+        diff_len = extend_approximate(old, found, new, pos)
+        pos += max(diff_len, 1)
+    extra_start = n_start + diff_len
+    entries.append((o_start, diff_len, extra_start, len(new) - extra_start))
+    return entries
+
+
+def split_copies(diff_bytes):
+    """ Splits diff bytes into (copy length, start, length) of diff bytes,
+    with the runs of at least ZERO_RUN zeros as copies """
+    parts = []
+    i = 0
+    while i < len(diff_bytes):
+        j = i
+        while j < len(diff_bytes) and diff_bytes[j] == 0:
+            j += 1
+        k = j
+        while k < len(diff_bytes):
+            if diff_bytes[k] != 0:
+                k += 1
+                continue
+            z = k
+            while z < len(diff_bytes) and diff_bytes[z] == 0:
+                z += 1
+            if z - k >= ZERO_RUN or z == len(diff_bytes):
+                break
+            k = z
+        parts.append((j - i, j, k - j))
+        i = k
+    return parts or [(0, 0, 0)]
+
+
+def make_patch(old, new):
+    old = bytearray(old)
+    new = bytearray(new)
+    out = bytearray(struct.pack('<III', OTA_DELTA_MAGIC, len(new), len(old)))
+    out += hashlib.sha256(bytes(new)).digest()
+    entries = diff(old, new)
+    count = 0
+    for i, (o, dlen, e, elen) in enumerate(entries):
+        if i + 1 < len(entries):
+            adjust = entries[i + 1][0] - (o + dlen)
+        else:
+            adjust = 0
+        n = e - dlen
+        diff_bytes = bytearray((new[n + k] - old[o + k]) & 0xff for k in range(dlen))
+        parts = split_copies(diff_bytes)
+        for p, (copy_len, start, length) in enumerate(parts):
+            last = p + 1 == len(parts)
+            out += struct.pack('<IIIi', copy_len, length, elen if last else 0, adjust if last else 0)
+            out += diff_bytes[start:start + length]
+        out += new[e:e + elen]
+        count += len(parts)
+    return bytes(out), count
+
+
+def apply_patch(old, patch):
+    """ Applies an uncompressed patch, as esp_ota_begin_delta does """
+    old = bytearray(old)
+    patch = bytearray(patch)
+    magic, size, base_size = struct.unpack_from('<III', patch, 0)
+    sha256 = bytes(patch[12:44])
+    if magic != OTA_DELTA_MAGIC or base_size > len(old):
+        raise ValueError('not a patch for this base image')
+    new = bytearray()
+    pos = 44
+    base_pos = 0
+    while pos < len(patch):
+        clen, dlen, elen, adjust = struct.unpack_from('<IIIi', patch, pos)
+        pos += 16
+        new += old[base_pos:base_pos + clen]
+        base_pos += clen
+        new += bytearray((old[base_pos + k] + patch[pos + k]) & 0xff for k in range(dlen))
+        base_pos += dlen
+        pos += dlen
+        new += patch[pos:pos + elen]
+        pos += elen
+        base_pos += adjust
+    if len(new) != size or hashlib.sha256(bytes(new)).digest() != sha256:
+        raise ValueError('patched image differs')
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ota_delta.py v%s - write the patch of a delta update '
+                                     'for esp_ota_begin_delta' % __version__)
+    parser.add_argument('base', help='app image running on the device (.bin)')
+    parser.add_argument('image', help='new app image (.bin)')
+    parser.add_argument('output', help='compressed patch')
+    parser.add_argument('--verify', action='store_true', help='apply the patch to the base image and compare')
+    args = parser.parse_args()
+
+    with open(args.base, 'rb') as f:
+        old = f.read()
+    with open(args.image, 'rb') as f:
+        new = f.read()
+    patch, count = make_patch(old, new)
+    if args.verify:
+        apply_patch(old, patch)
+    compressed = ota_compress.compress(patch)
+    with open(args.output, 'wb') as f:
+        f.write(compressed)
+    sys.stdout.write('%s: %d bytes, patch of %d entries, %d bytes compressed (%d%% of the image)\n' %
+                     (args.image, len(new), count, len(compressed), 100 * len(compressed) // max(len(new), 1)))
+
+
+if __name__ == '__main__':
+    main()
@@ -15,6 +15,10 @@
 #define __BOOT_CONFIG_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "rom/sha.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -31,6 +35,9 @@ extern "C"
 #define DROM_LOW    0x3F400000
 #define DROM_HIGH   0x3F800000
 
+/* WP pad of the flash when the default (strapping) pads are used */
+#define FLASH_WP_GPIO   10
+
 /*spi mode,saved in third byte in flash */
 enum {
     SPI_MODE_QIO,
@@ -85,6 +92,13 @@ typedef struct {
     uint32_t crc; /* CRC32 of ota_seq field only */
 } ota_select;
 
+/* Once the app selected by an ota_select entry has passed verification, the
+   bootloader writes this value to the last word of seq_label, which is left
+   erased by esp_ota_set_boot_partition. Bits can be cleared without erasing
+   the sector, and a new selection erases the marker again. */
+#define OTA_SELECT_VERIFIED_OFFSET  (offsetof(ota_select, seq_label) + 20)
+#define OTA_SELECT_VERIFIED_MAGIC(s)    ((s)->ota_seq ^ 0x56455249) /* "VERI" */
+
 typedef struct {
     uint32_t offset;
     uint32_t size;
@@ -109,6 +123,8 @@ typedef struct {
 #define PART_SUBTYPE_DATA_OTA 0x00
 #define PART_SUBTYPE_DATA_RF  0x01
 #define PART_SUBTYPE_DATA_WIFI 0x02
+#define PART_SUBTYPE_DATA_COREDUMP 0x03
+#define PART_SUBTYPE_DATA_NVS_KEYS 0x04
 
 #define PART_TYPE_END 0xff
 #define PART_SUBTYPE_END 0xff
@@ -120,14 +136,65 @@ typedef struct {
     partition_pos_t factory;
     partition_pos_t test;
     partition_pos_t ota[16];
+    partition_pos_t nvs_keys;
     uint32_t app_count;
     uint32_t selected_subtype;
 } bootloader_state_t;
 
+#define RTC_FAST_LOW    0x400C0000
+#define RTC_FAST_HIGH   0x400C2000
+#define RTC_DATA_LOW    0x3FF80000
+#define RTC_DATA_HIGH   0x3FF82000
+#define RTC_SLOW_LOW    0x50000000
+#define RTC_SLOW_HIGH   0x50002000
+
+/* Layout of the app loaded by the last full boot, kept in RTC slow memory
+   (below the boot timeline) so that a wake from deep sleep can load the app
+   without reading the partition table and walking the image again. */
+#define FAST_BOOT_CACHE_ADDR    0x50001c00
+#define FAST_BOOT_CACHE_MAGIC   0x4b425346  /* "FSBK" */
+#define FAST_BOOT_MAX_SECTIONS  16
+
+typedef struct {
+    uint32_t flash_offset;  /* offset of the section data in the app partition */
+    uint32_t load_addr;
+    uint32_t size;
+} fast_boot_section_t;
+
+typedef struct {
+    uint32_t magic;
+    partition_pos_t app;
+    partition_pos_t ota_info;
+    uint32_t ota_seq[2];
+    struct flash_hdr image_header;
+    uint32_t section_count;
+    fast_boot_section_t sections[FAST_BOOT_MAX_SECTIONS];
+    uint32_t drom_addr;
+    uint32_t drom_load_addr;
+    uint32_t drom_size;
+    uint32_t irom_addr;
+    uint32_t irom_load_addr;
+    uint32_t irom_size;
+    uint32_t crc;           /* CRC32 of all the fields above */
+} fast_boot_cache_t;
+
 void boot_cache_redirect( uint32_t pos, size_t size );
 uint32_t get_bin_len(uint32_t pos);
 
 bool flash_encrypt(bootloader_state_t *bs);
+
+/* SHA-256 of an app image, computed with the hardware SHA engine. The image
+   digest is appended to the image by the build, after the checksum byte. */
+typedef struct {
+    SHA_CTX ctx;
+    uint32_t fill;          /* bytes in block */
+    uint32_t block[16];
+} image_sha_t;
+
+void image_sha_start(image_sha_t *sha);
+void image_sha_update(image_sha_t *sha, const void *data, uint32_t len);
+void image_sha_update_words(image_sha_t *sha, const uint32_t *data, uint32_t words);
+void image_sha_finish(image_sha_t *sha, uint8_t digest[32]);
 bool secure_boot(void);
 
 
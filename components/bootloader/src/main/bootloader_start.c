@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <stddef.h>
 
 #include "esp_attr.h"
 #include "esp_log.h"
@@ -22,6 +23,8 @@
 #include "rom/ets_sys.h"
 #include "rom/spi_flash.h"
 #include "rom/crc.h"
+#include "rom/rtc.h"
+#include "rom/efuse.h"
 
 #include "soc/soc.h"
 #include "soc/cpu.h"
@@ -32,6 +35,7 @@
 #include "soc/timer_group_reg.h"
 
 #include "sdkconfig.h"
+#include "esp_boot_timeline.h"
 
 #include "bootloader_config.h"
 
@@ -47,9 +51,18 @@ flash cache is down and the app CPU is in reset. We do have a stack, so we can d
 // TODO: make a nice header file for ROM functions instead of adding externs all over the place
 extern void Cache_Flush(int);
 
+/* ota_select entry through which the app being loaded was chosen */
+typedef struct {
+    uint32_t addr;          /* flash address of the entry, 0 if there is none */
+    ota_select entry;
+} ota_choice_t;
+
 void bootloader_main();
-void unpack_load_app(const partition_pos_t *app_node);
+void unpack_load_app(const partition_pos_t *app_node, const ota_choice_t* choice);
 void print_flash_info(struct flash_hdr* pfhdr);
+static void update_flash_config(const struct flash_hdr* pfhdr);
+static void load_section(const partition_pos_t* partition, uint32_t pos, void* dest, uint32_t size, image_sha_t* sha);
+static bool is_rtc_addr(uint32_t addr);
 void IRAM_ATTR set_cache_and_start_app(uint32_t drom_addr,
     uint32_t drom_load_addr,
     uint32_t drom_size,
@@ -58,9 +71,25 @@ void IRAM_ATTR set_cache_and_start_app(uint32_t drom_addr,
     uint32_t irom_size,
     uint32_t entry_addr);
 
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+static void fast_boot_load_app();
+static void fast_boot_save(const partition_pos_t* partition, const struct flash_hdr* image_header);
+
+/* filled in by the full boot, stored to RTC memory just before starting the app */
+static fast_boot_cache_t s_fast_boot;
+static bool s_fast_boot_cacheable;
+#endif
+
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+/* the verified marker is written in plain text, which encrypted flash can't take */
+static bool s_mark_verified;
+#endif
 
 void IRAM_ATTR call_start_cpu0()
 {
+    esp_boot_timeline_start();
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_BOOTLOADER_START);
+
     cpu_configure_region_protection();
 
     //Clear bss
@@ -203,6 +232,10 @@ bool load_partition_table(bootloader_state_t* bs, uint32_t addr)
                 case PART_SUBTYPE_DATA_WIFI:
                     partition_usage = "WiFi data";
                     break;
+                case PART_SUBTYPE_DATA_NVS_KEYS:
+                    bs->nvs_keys = partition.pos;
+                    partition_usage = "NVS keys";
+                    break;
                 default:
                     partition_usage = "Unknown data";
                     break;
@@ -266,14 +299,28 @@ void bootloader_main()
 
     memcpy((unsigned int *) &fhdr, MEM_CACHE(0x1000), sizeof(struct flash_hdr) );
 
+    update_flash_config(&fhdr);
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+    if (rtc_get_reset_reason(0) == DEEPSLEEP_RESET) {
+        fast_boot_load_app();   // only returns if the cached layout can't be used
+        boot_cache_redirect( 0, 0x5000 );
+    }
+#endif
+
     print_flash_info(&fhdr);
 
     if (!load_partition_table(&bs, PARTITION_ADD)) {
         ESP_LOGE(TAG, "load partition table error!");
         return;
     }
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_PARTITION_TABLE);
 
     partition_pos_t load_part_pos;
+    ota_choice_t choice = { 0 };
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+    partition_pos_t fallback_pos = { 0 };
+    ota_choice_t fallback = { 0 };
+#endif
 
     if (bs.ota_info.offset != 0) {              // check if partition table has OTA info partition
         //ESP_LOGE("OTA info sector handling is not implemented");
@@ -315,6 +362,18 @@ void bootloader_main()
                 return;
             }
         }
+        /* remember the entry which chose the app, and the app the other one chose */
+        const bool sa_newer = ota_select_valid(&sa) && (!ota_select_valid(&sb) || sa.ota_seq > sb.ota_seq);
+        choice.addr = bs.ota_info.offset + (sa_newer ? 0 : 0x1000);
+        choice.entry = sa_newer ? sa : sb;
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+        const ota_select* older = sa_newer ? &sb : &sa;
+        if (ota_select_valid(older) && older->ota_seq != 0) {
+            fallback.addr = bs.ota_info.offset + (sa_newer ? 0x1000 : 0);
+            fallback.entry = *older;
+            fallback_pos = bs.ota[(older->ota_seq - 1) % bs.app_count];
+        }
+#endif
     } else if (bs.factory.offset != 0) {        // otherwise, look for factory app partition
         load_part_pos = bs.factory;
     } else if (bs.test.offset != 0) {           // otherwise, look for test app parition
@@ -325,6 +384,18 @@ void bootloader_main()
     }
 
     ESP_LOGI(TAG, "Loading app partition at offset %08x", load_part_pos);
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+    s_fast_boot.ota_info = bs.ota_info;
+    if (bs.ota_info.offset != 0) {
+        s_fast_boot.ota_seq[0] = sa.ota_seq;
+        s_fast_boot.ota_seq[1] = sb.ota_seq;
+    }
+    /* with secure boot or flash encryption the full boot path has to run every time */
+    s_fast_boot_cacheable = fhdr.secury_boot_flag != 0x01 && fhdr.encrypt_flag != 0x01;
+#endif
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+    s_mark_verified = fhdr.encrypt_flag != 0x01;
+#endif
     if(fhdr.secury_boot_flag == 0x01) {
         /* protect the 2nd_boot  */    
         if(false == secure_boot()){
@@ -342,12 +413,120 @@ void bootloader_main()
     }
 
     // copy sections to RAM, set up caches, and start application
-    unpack_load_app(&load_part_pos);
+    unpack_load_app(&load_part_pos, &choice);
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+    /* only get here if the image failed verification: try the app selected
+       before the last OTA update, then the factory app */
+    if (fallback.addr != 0 && fallback_pos.offset != load_part_pos.offset) {
+        ESP_LOGW(TAG, "falling back to app partition at offset %08x", fallback_pos.offset);
+        unpack_load_app(&fallback_pos, &fallback);
+    }
+    if (bs.factory.offset != 0 && bs.factory.offset != load_part_pos.offset) {
+        ESP_LOGW(TAG, "falling back to factory app");
+        unpack_load_app(&bs.factory, NULL);
+    }
+    ESP_LOGE(TAG, "no valid app image");
+#endif
+}
+
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+static bool ota_choice_verified(const ota_choice_t* choice)
+{
+    uint32_t marker;
+    if (choice == NULL || choice->addr == 0) {
+        return false;
+    }
+    memcpy(&marker, (const uint8_t*) &choice->entry + OTA_SELECT_VERIFIED_OFFSET, sizeof(marker));
+    return marker == OTA_SELECT_VERIFIED_MAGIC(&choice->entry);
+}
+
+static void ota_choice_mark_verified(const ota_choice_t* choice)
+{
+    uint32_t marker;
+    if (choice == NULL || choice->addr == 0 || !s_mark_verified) {
+        return;
+    }
+    memcpy(&marker, (const uint8_t*) &choice->entry + OTA_SELECT_VERIFIED_OFFSET, sizeof(marker));
+    if (marker != UINT32_MAX) {
+        return;     // seq_label is in use
+    }
+    marker = OTA_SELECT_VERIFIED_MAGIC(&choice->entry);
+    Cache_Read_Disable(0);
+    SpiFlashOpResult rc = SPIWrite(choice->addr + OTA_SELECT_VERIFIED_OFFSET, &marker, sizeof(marker));
+    Cache_Read_Enable(0);
+    if (rc != SPI_FLASH_RESULT_OK) {
+        ESP_LOGW(TAG, "failed to mark app as verified (%d)", rc);
+    }
+}
+
+/**
+ *  @function :     verify_image_digest
+ *  @description:   Hash the padding and checksum which end the image at
+ *                  `pos` of the partition mapped at MEM_CACHE(0), and compare
+ *                  the digest with the one appended to the image.
+ *
+ *  @return:        true if the image is intact
+ */
+static bool verify_image_digest(const partition_pos_t* partition, uint32_t pos, image_sha_t* sha)
+{
+    uint8_t digest[32];
+    const uint32_t image_len = (pos | 15) + 1;    // checksum is the last byte of a 16 byte block
+    if (image_len + sizeof(digest) > partition->size) {
+        image_sha_finish(sha, digest);
+        return false;
+    }
+    image_sha_update(sha, MEM_CACHE(pos), image_len - pos);
+    image_sha_finish(sha, digest);
+    return memcmp(digest, MEM_CACHE(image_len), sizeof(digest)) == 0;
 }
+#endif
+
 
+/**
+ *  @function :     load_section
+ *  @description:   Copy `size` bytes at offset `pos` of the app partition
+ *                  to `dest`. Word aligned sections are read with SPIRead,
+ *                  which streams them from flash in large sequential reads
+ *                  instead of taking a cache miss every 32 bytes. Others are
+ *                  copied through the cache, which must map the partition.
+ *                  If `sha` isn't NULL, the section is added to it from the
+ *                  loaded copy, so flash isn't read again for hashing.
+ */
+static void load_section(const partition_pos_t* partition, uint32_t pos, void* dest, uint32_t size, image_sha_t* sha)
+{
+    uint32_t flash_addr = partition->offset + pos;
+    if ((((uint32_t) dest | flash_addr | size) & 3) == 0) {
+        Cache_Read_Disable(0);
+        SpiFlashOpResult rc = SPIRead(flash_addr, (uint32_t*) dest, size);
+        Cache_Read_Enable(0);
+        if (rc == SPI_FLASH_RESULT_OK) {
+            if (sha) {
+                image_sha_update_words(sha, (const uint32_t*) dest, size / 4);
+            }
+            return;
+        }
+        ESP_LOGW(TAG, "SPIRead at %08x failed (%d), copying through cache", flash_addr, rc);
+    }
+    memcpy(dest, MEM_CACHE(pos), size);
+    if (sha) {
+        image_sha_update(sha, MEM_CACHE(pos), size);
+    }
+}
 
-void unpack_load_app(const partition_pos_t* partition)
+/**
+ *  @function :     unpack_load_app
+ *  @description:   Load the app in `partition` and start it. With
+ *                  CONFIG_BOOTLOADER_VERIFY_APP_IMAGE, the SHA-256 of the
+ *                  image is computed while it is loaded, unless `choice` has
+ *                  been marked as verified before, and the function returns
+ *                  if it doesn't match the digest appended to the image.
+ *
+ *  @inputs:        partition   app partition
+ *                  choice      ota_select entry which chose the app, may be NULL
+ */
+void unpack_load_app(const partition_pos_t* partition, const ota_choice_t* choice)
 {
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_LOAD_APP);
     boot_cache_redirect(partition->offset, partition->size);
 
     uint32_t pos = 0;
@@ -361,6 +540,8 @@ void unpack_load_app(const partition_pos_t* partition)
     uint32_t irom_addr = 0;
     uint32_t irom_load_addr = 0;
     uint32_t irom_size = 0;
+    /* RTC memory kept its contents in deep sleep */
+    const bool deep_sleep_wake = rtc_get_reset_reason(0) == DEEPSLEEP_RESET;
 
     ESP_LOGD(TAG, "bin_header: %u %u %u %u %08x", image_header.magic,
               image_header.blocks,
@@ -368,12 +549,32 @@ void unpack_load_app(const partition_pos_t* partition)
               image_header.spi_size,
               (unsigned)image_header.entry_addr);
 
+    image_sha_t* sha = NULL;
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+    image_sha_t image_sha;
+    if (image_header.magic != 0xE9) {
+        ESP_LOGE(TAG, "no app image at offset %08x", partition->offset);
+        return;
+    }
+    if (!ota_choice_verified(choice)) {
+        sha = &image_sha;
+        image_sha_start(sha);
+        image_sha_update(sha, &image_header, sizeof(image_header));
+    }
+#endif
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+    s_fast_boot.section_count = 0;
+#endif
+
     for (uint32_t section_index = 0;
             section_index < image_header.blocks;
             ++section_index) {
         struct block_hdr section_header = {0};
         memcpy(&section_header, MEM_CACHE(pos), sizeof(section_header));
         pos += sizeof(section_header);
+        if (sha) {
+            image_sha_update(sha, &section_header, sizeof(section_header));
+        }
 
         const uint32_t address = section_header.load_addr;
         bool load = true;
@@ -385,6 +586,9 @@ void unpack_load_app(const partition_pos_t* partition)
             load = false;                   // md5 checksum block
             // TODO: actually check md5
         }
+        if (deep_sleep_wake && is_rtc_addr(address)) {
+            load = false;                   // keep the RTC_DATA_ATTR variables of the app
+        }
 
         if (address >= DROM_LOW && address < DROM_HIGH) {
             ESP_LOGD(TAG, "found drom section, map from %08x to %08x", pos,
@@ -409,14 +613,51 @@ void unpack_load_app(const partition_pos_t* partition)
         ESP_LOGI(TAG, "section %d: paddr=0x%08x vaddr=0x%08x size=0x%05x (%6d) %s", section_index, pos, section_header.load_addr, section_header.data_len, section_header.data_len, (load)?"load":(map)?"map":"");
 
         if (!load) {
+            if (sha) {
+                image_sha_update(sha, MEM_CACHE(pos), section_header.data_len);
+            }
             pos += section_header.data_len;
             continue;
         }
 
-        memcpy((void*) section_header.load_addr, MEM_CACHE(pos), section_header.data_len);
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+        if (s_fast_boot.section_count < FAST_BOOT_MAX_SECTIONS) {
+            fast_boot_section_t* section = &s_fast_boot.sections[s_fast_boot.section_count];
+            section->flash_offset = pos;
+            section->load_addr = section_header.load_addr;
+            section->size = section_header.data_len;
+        } else {
+            s_fast_boot_cacheable = false;
+        }
+        ++s_fast_boot.section_count;
+#endif
+        load_section(partition, pos, (void*) section_header.load_addr, section_header.data_len, sha);
         pos += section_header.data_len;
     }
-    
+
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+    s_fast_boot.drom_addr = drom_addr;
+    s_fast_boot.drom_load_addr = drom_load_addr;
+    s_fast_boot.drom_size = drom_size;
+    s_fast_boot.irom_addr = irom_addr;
+    s_fast_boot.irom_load_addr = irom_load_addr;
+    s_fast_boot.irom_size = irom_size;
+#endif
+
+#if CONFIG_BOOTLOADER_VERIFY_APP_IMAGE
+    if (sha) {
+        if (!verify_image_digest(partition, pos, sha)) {
+            ESP_LOGE(TAG, "app image at offset %08x failed verification", partition->offset);
+            return;
+        }
+        ESP_LOGI(TAG, "app image verified");
+        ota_choice_mark_verified(choice);
+    }
+#endif
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+    fast_boot_save(partition, &image_header);
+#endif
+
     set_cache_and_start_app(drom_addr,
         drom_load_addr,
         drom_size,
@@ -426,6 +667,98 @@ void unpack_load_app(const partition_pos_t* partition)
         image_header.entry_addr);
 }
 
+static bool is_rtc_addr(uint32_t addr)
+{
+    return (addr >= RTC_FAST_LOW && addr < RTC_FAST_HIGH) ||
+           (addr >= RTC_DATA_LOW && addr < RTC_DATA_HIGH) ||
+           (addr >= RTC_SLOW_LOW && addr < RTC_SLOW_HIGH);
+}
+
+#if CONFIG_BOOTLOADER_FAST_BOOT_DEEP_SLEEP
+static uint32_t fast_boot_crc(const fast_boot_cache_t* cache)
+{
+    return crc32_le(UINT32_MAX, (const uint8_t*) cache, offsetof(fast_boot_cache_t, crc));
+}
+
+/**
+ *  @function :     fast_boot_save
+ *  @description:   Store the layout of the app which is about to be started
+ *                  in RTC slow memory, for the next wake from deep sleep.
+ *                  Any stale copy is invalidated if the layout can't be cached.
+ */
+static void fast_boot_save(const partition_pos_t* partition, const struct flash_hdr* image_header)
+{
+    fast_boot_cache_t* cache = (fast_boot_cache_t*) FAST_BOOT_CACHE_ADDR;
+    if (!s_fast_boot_cacheable) {
+        cache->magic = 0;
+        return;
+    }
+    s_fast_boot.magic = FAST_BOOT_CACHE_MAGIC;
+    s_fast_boot.app = *partition;
+    s_fast_boot.image_header = *image_header;
+    s_fast_boot.crc = fast_boot_crc(&s_fast_boot);
+    memcpy(cache, &s_fast_boot, sizeof(s_fast_boot));
+}
+
+/**
+ *  @function :     fast_boot_load_app
+ *  @description:   Load and start the app using the layout stored by the last
+ *                  full boot. Deep sleep powers down the internal SRAM, so the
+ *                  IRAM and DRAM sections are still copied from flash, but the
+ *                  partition table, the OTA selection logic and the walk
+ *                  through the image headers are skipped, and so are sections
+ *                  in RTC memory, which keeps its contents in deep sleep.
+ *                  Returns if the cached layout is missing or out of date.
+ */
+static void fast_boot_load_app()
+{
+    fast_boot_cache_t cache;
+    memcpy(&cache, (const void*) FAST_BOOT_CACHE_ADDR, sizeof(cache));
+    if (cache.magic != FAST_BOOT_CACHE_MAGIC || cache.crc != fast_boot_crc(&cache)
+            || cache.section_count > FAST_BOOT_MAX_SECTIONS) {
+        ESP_LOGD(TAG, "no fast boot layout");
+        return;
+    }
+
+    /* the app to boot may have changed since: a new OTA selection or a new image */
+    if (cache.ota_info.offset != 0) {
+        ota_select sa, sb;
+        boot_cache_redirect(cache.ota_info.offset, cache.ota_info.size);
+        memcpy(&sa, MEM_CACHE(cache.ota_info.offset & 0x0000ffff), sizeof(sa));
+        memcpy(&sb, MEM_CACHE((cache.ota_info.offset + 0x1000) & 0x0000ffff), sizeof(sb));
+        if (sa.ota_seq != cache.ota_seq[0] || sb.ota_seq != cache.ota_seq[1]) {
+            ESP_LOGI(TAG, "OTA data changed, full boot");
+            return;
+        }
+    }
+    boot_cache_redirect(cache.app.offset, cache.app.size);
+    struct flash_hdr image_header;
+    memcpy(&image_header, MEM_CACHE(0), sizeof(image_header));
+    if (memcmp(&image_header, &cache.image_header, sizeof(image_header)) != 0) {
+        ESP_LOGI(TAG, "app image changed, full boot");
+        return;
+    }
+
+    ESP_LOGI(TAG, "fast boot from deep sleep, app at offset %08x", cache.app.offset);
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_LOAD_APP);
+    for (uint32_t i = 0; i < cache.section_count; ++i) {
+        const fast_boot_section_t* section = &cache.sections[i];
+        if (is_rtc_addr(section->load_addr)) {
+            continue;
+        }
+        load_section(&cache.app, section->flash_offset, (void*) section->load_addr, section->size, NULL);
+    }
+
+    set_cache_and_start_app(cache.drom_addr,
+        cache.drom_load_addr,
+        cache.drom_size,
+        cache.irom_addr,
+        cache.irom_load_addr,
+        cache.irom_size,
+        cache.image_header.entry_addr);
+}
+#endif
+
 void IRAM_ATTR set_cache_and_start_app(
     uint32_t drom_addr,
     uint32_t drom_load_addr,
@@ -460,6 +793,7 @@ void IRAM_ATTR set_cache_and_start_app(
     ESP_LOGD(TAG, "start: 0x%08x", entry_addr);
     typedef void (*entry_t)(void);
     entry_t entry = ((entry_t) entry_addr);
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_START_APP);
 
     // TODO: we have used quite a bit of stack at this point.
     // use "movsp" instruction to reset stack back to where ROM stack starts.
@@ -565,3 +899,53 @@ void print_flash_info(struct flash_hdr* pfhdr)
     ESP_LOGI(TAG, "SPI Flash Size : %s", str );
 #endif
 }
+
+/**
+ *  @function :     update_flash_config
+ *  @description:   Switch the flash to the read mode and clock given in the
+ *                  bootloader image header before the app is loaded. The ROM
+ *                  only boots in DIO/DOUT at most, so QIO and QOUT are
+ *                  enabled here, and the extra dummy cycle needed at 80 MHz
+ *                  is set up for both the cache (SPI0) and SPIRead (SPI1).
+ *                  The app keeps running with this configuration.
+ *
+ *  @inputs:        pfhdr   header of the bootloader image
+ */
+static void update_flash_config(const struct flash_hdr* pfhdr)
+{
+    uint8_t freqdiv;
+    switch ((uint8_t) pfhdr->spi_speed & 0x0f) {
+    case SPI_SPEED_80M:
+        freqdiv = 1;
+        break;
+    case SPI_SPEED_40M:
+        freqdiv = 2;
+        break;
+    case SPI_SPEED_26M:
+        freqdiv = 3;
+        break;
+    default:
+        freqdiv = 4;
+        break;
+    }
+
+    Cache_Read_Disable(0);
+    if (pfhdr->spi_mode == SPI_MODE_QIO || pfhdr->spi_mode == SPI_MODE_QOUT) {
+        /* custom flash pads set in efuse don't have a known WP pin */
+        if (ets_efuse_get_spiconfig() == 0) {
+            SelectSpiQIO(FLASH_WP_GPIO, 0);
+            if (SPIReadModeCnfig((SpiFlashRdMode) pfhdr->spi_mode, false) != SPI_FLASH_RESULT_OK) {
+                ESP_LOGW(TAG, "can't enable quad mode, using DIO");
+                SPIMasterReadModeCnfig(SPI_FLASH_DIO_MODE);
+            }
+        }
+    } else if (pfhdr->spi_mode <= SPI_MODE_SLOW_READ) {
+        SPIMasterReadModeCnfig((SpiFlashRdMode) pfhdr->spi_mode);
+    }
+    SPIClkConfig(freqdiv, 0);
+    SPIClkConfig(freqdiv, 1);
+    spi_dummy_len_fix(0, freqdiv);
+    spi_dummy_len_fix(1, freqdiv);
+    Cache_Flush(0);
+    Cache_Read_Enable(0);
+}
@@ -176,6 +176,13 @@ bool flash_encrypt(bootloader_state_t *bs)
            ESP_LOGE(TAG, "encrypt ota info error");
            return false;
        }  
+        /* encrypt the key of NVS encryption, it's only read through the cache */
+       if (bs->nvs_keys.offset != 0x00) {
+           if (false == flash_encrypt_write(bs->nvs_keys.offset, bs->nvs_keys.size)) {
+               ESP_LOGE(TAG, "encrypt nvs keys error");
+               return false;
+           }
+       }
        REG_SET_FIELD(EFUSE_BLK0_WDATA0_REG, EFUSE_FLASH_CRYPT_CNT, 0x04);   
        REG_WRITE(EFUSE_CONF_REG, 0x5A5A);  /* efuse_pgm_op_ena, force no rd/wr disable */     
        REG_WRITE(EFUSE_CMD_REG,  0x02);    /* efuse_pgm_cmd */     
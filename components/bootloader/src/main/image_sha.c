@@ -0,0 +1,81 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdint.h>
+
+#include "rom/sha.h"
+
+#include "bootloader_config.h"
+
+/* Data is fed to the SHA engine in whole 64 byte blocks, except for the
+   last partial block, so the caller can pass sections of any length. */
+
+void image_sha_start(image_sha_t *sha)
+{
+    memset(sha, 0, sizeof(*sha));
+    ets_sha_enable();
+    ets_sha_init(&sha->ctx);
+}
+
+static void image_sha_flush(image_sha_t *sha)
+{
+    ets_sha_update(&sha->ctx, SHA2_256, (const uint8_t *) sha->block, sha->fill * 8);
+    sha->fill = 0;
+}
+
+void image_sha_update(image_sha_t *sha, const void *data, uint32_t len)
+{
+    const uint8_t *src = (const uint8_t *) data;
+    while (len > 0) {
+        uint32_t n = sizeof(sha->block) - sha->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy((uint8_t *) sha->block + sha->fill, src, n);
+        sha->fill += n;
+        src += n;
+        len -= n;
+        if (sha->fill == sizeof(sha->block)) {
+            image_sha_flush(sha);
+        }
+    }
+}
+
+/* IRAM only allows 32-bit loads, so sections loaded there are read back one
+   word at a time */
+void image_sha_update_words(image_sha_t *sha, const uint32_t *data, uint32_t words)
+{
+    for (uint32_t i = 0; i < words; ++i) {
+        uint32_t word = data[i];
+        if ((sha->fill & 3) == 0) {
+            sha->block[sha->fill / 4] = word;
+            sha->fill += 4;
+            if (sha->fill == sizeof(sha->block)) {
+                image_sha_flush(sha);
+            }
+        } else {
+            image_sha_update(sha, &word, sizeof(word));
+        }
+    }
+}
+
+void image_sha_finish(image_sha_t *sha, uint8_t digest[32])
+{
+    if (sha->fill > 0) {
+        image_sha_flush(sha);
+    }
+    ets_sha_finish(&sha->ctx, SHA2_256, digest);
+    ets_sha_disable();
+}
@@ -0,0 +1,227 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_arena.h"
+#include "heap_alloc_caps.h"
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define ARENA_ALIGN     4   // Alignment of all allocations, same as the heap
+
+#if CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS > CONFIG_ESP32_ARENA_TLS_INDEX
+#define ARENA_HAVE_TLS  1
+#else
+#define ARENA_HAVE_TLS  0
+#endif
+
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;                // Number of bytes in data
+    uint8_t data[];
+} arena_chunk_t;
+
+struct esp_arena {
+    arena_chunk_t* chunks;      // All chunks, the one allocations are taken from first
+    arena_chunk_t* first;       // Chunk allocated on creation, kept on reset
+    uint8_t* ptr;               // Next free byte in the current chunk
+    uint8_t* end;               // End of the current chunk
+    size_t chunk_size;
+    uint32_t caps;
+};
+
+static arena_chunk_t* arena_chunk_alloc(esp_arena_handle_t arena, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(arena_chunk_t)) {
+        return NULL;
+    }
+    arena_chunk_t* chunk = pvPortMallocCaps(sizeof(arena_chunk_t) + size, arena->caps);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    return chunk;
+}
+
+static void arena_use_chunk(esp_arena_handle_t arena, arena_chunk_t* chunk)
+{
+    arena->ptr = chunk->data;
+    arena->end = chunk->data + chunk->size;
+}
+
+esp_err_t esp_arena_create(size_t chunk_size, uint32_t caps, esp_arena_handle_t* out_arena)
+{
+    if (chunk_size == 0 || out_arena == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_arena_handle_t arena = malloc(sizeof(struct esp_arena));
+    if (arena == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    arena->chunk_size = (chunk_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    arena->caps = caps;
+    arena->first = arena_chunk_alloc(arena, arena->chunk_size);
+    if (arena->first == NULL) {
+        free(arena);
+        return ESP_ERR_NO_MEM;
+    }
+    arena->chunks = arena->first;
+    arena_use_chunk(arena, arena->first);
+    *out_arena = arena;
+    return ESP_OK;
+}
+
+static void arena_free_chunks(arena_chunk_t* chunk, const arena_chunk_t* keep)
+{
+    while (chunk != NULL) {
+        arena_chunk_t* next = chunk->next;
+        if (chunk != keep) {
+            vPortFree(chunk);
+        }
+        chunk = next;
+    }
+}
+
+void esp_arena_delete(esp_arena_handle_t arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+    arena_free_chunks(arena->chunks, NULL);
+    free(arena);
+}
+
+void* esp_arena_alloc(esp_arena_handle_t arena, size_t size)
+{
+    if (size > SIZE_MAX - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size == 0) {
+        size = ARENA_ALIGN;
+    }
+    if ((size_t) (arena->end - arena->ptr) >= size) {
+        void* result = arena->ptr;
+        arena->ptr += size;
+        return result;
+    }
+    if (size > arena->chunk_size / 4) {
+        // Large allocations get a chunk of their own. It's linked behind the
+        // current chunk, so that the space left in the current chunk can
+        // still be used by later allocations.
+        arena_chunk_t* chunk = arena_chunk_alloc(arena, size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+        return chunk->data;
+    }
+    arena_chunk_t* chunk = arena_chunk_alloc(arena, arena->chunk_size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena_use_chunk(arena, chunk);
+    arena->ptr += size;
+    return chunk->data;
+}
+
+void* esp_arena_calloc(esp_arena_handle_t arena, size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* result = esp_arena_alloc(arena, n * size);
+    if (result != NULL) {
+        memset(result, 0, n * size);
+    }
+    return result;
+}
+
+void esp_arena_reset(esp_arena_handle_t arena)
+{
+    arena_free_chunks(arena->chunks, arena->first);
+    arena->first->next = NULL;
+    arena->chunks = arena->first;
+    arena_use_chunk(arena, arena->first);
+}
+
+bool esp_arena_contains(esp_arena_handle_t arena, const void* ptr)
+{
+    const uint8_t* p = (const uint8_t*) ptr;
+    for (const arena_chunk_t* chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        if (p >= chunk->data && p < chunk->data + chunk->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t esp_arena_set_current(esp_arena_handle_t arena)
+{
+#if ARENA_HAVE_TLS
+    vTaskSetThreadLocalStoragePointer(NULL, CONFIG_ESP32_ARENA_TLS_INDEX, arena);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_arena_handle_t esp_arena_get_current(void)
+{
+#if ARENA_HAVE_TLS
+    return (esp_arena_handle_t) pvTaskGetThreadLocalStoragePointer(NULL, CONFIG_ESP32_ARENA_TLS_INDEX);
+#else
+    return NULL;
+#endif
+}
+
+void* esp_arena_hook_malloc(size_t size)
+{
+    esp_arena_handle_t arena = esp_arena_get_current();
+    if (arena == NULL) {
+        return malloc(size);
+    }
+    return esp_arena_alloc(arena, size);
+}
+
+void* esp_arena_hook_calloc(size_t n, size_t size)
+{
+    esp_arena_handle_t arena = esp_arena_get_current();
+    if (arena == NULL) {
+        return calloc(n, size);
+    }
+    return esp_arena_calloc(arena, n, size);
+}
+
+void esp_arena_hook_free(void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    esp_arena_handle_t arena = esp_arena_get_current();
+    if (arena != NULL && esp_arena_contains(arena, ptr)) {
+        return;
+    }
+    free(ptr);
+}
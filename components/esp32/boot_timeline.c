@@ -0,0 +1,74 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include "esp_boot_timeline.h"
+#include "freertos/FreeRTOS.h"
+
+static portMUX_TYPE s_timeline_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* s_stage_names[] = {
+    [ESP_BOOT_STAGE_BOOTLOADER_START] = "bootloader start",
+    [ESP_BOOT_STAGE_PARTITION_TABLE] = "partition table",
+    [ESP_BOOT_STAGE_LOAD_APP] = "load app",
+    [ESP_BOOT_STAGE_START_APP] = "start app",
+    [ESP_BOOT_STAGE_APP_START] = "app start",
+    [ESP_BOOT_STAGE_HEAP_INIT] = "heap init",
+    [ESP_BOOT_STAGE_APP_CPU_UP] = "app cpu up",
+    [ESP_BOOT_STAGE_CPU_FREQ] = "cpu freq",
+    [ESP_BOOT_STAGE_GLOBAL_CTORS] = "global ctors",
+    [ESP_BOOT_STAGE_SYSTEM_INIT] = "system init",
+    [ESP_BOOT_STAGE_COMPONENTS_INIT] = "components init",
+    [ESP_BOOT_STAGE_APP_MAIN] = "app_main",
+    [ESP_BOOT_STAGE_SCHEDULER_START] = "scheduler start",
+    [ESP_BOOT_STAGE_APP_MARK] = "mark",
+};
+
+void esp_boot_timeline_mark_name(const char* name)
+{
+    portENTER_CRITICAL(&s_timeline_lock);
+    esp_boot_timeline_add(ESP_BOOT_STAGE_APP_MARK, name);
+    portEXIT_CRITICAL(&s_timeline_lock);
+}
+
+const esp_boot_timeline_t* esp_boot_timeline_get(void)
+{
+#if CONFIG_ESP32_BOOT_TIMELINE
+    return ESP_BOOT_TIMELINE;
+#else
+    return NULL;
+#endif
+}
+
+void esp_boot_timeline_print(void)
+{
+    const esp_boot_timeline_t* timeline = esp_boot_timeline_get();
+    if (timeline == NULL || timeline->magic != ESP_BOOT_TIMELINE_MAGIC) {
+        printf("Boot timeline not available\n");
+        return;
+    }
+    printf("Boot timeline (us since reset):\n");
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < timeline->count; ++i) {
+        const esp_boot_timeline_entry_t* entry = &timeline->entries[i];
+        const char* name = entry->name;
+        if (name == NULL) {
+            name = (entry->stage < sizeof(s_stage_names) / sizeof(s_stage_names[0]))
+                   ? s_stage_names[entry->stage] : "?";
+        }
+        printf("%-20s %10u %+10d\n", name, entry->time_us, (int) (entry->time_us - prev));
+        prev = entry->time_us;
+    }
+}
@@ -28,6 +28,16 @@ endif
 
 LINKER_SCRIPTS += -T esp32.common.ld -T esp32.rom.ld -T esp32.peripherals.ld
 
+# Functions listed in the IRAM placement file are placed in IRAM by
+# esp32.common.ld, which includes the linker fragment generated here from the
+# list. The fragment is empty without a placement file.
+IRAM_PLACEMENT_FILE := $(subst ",,$(CONFIG_ESP32_IRAM_PLACEMENT_FILE))
+ifneq ("$(IRAM_PLACEMENT_FILE)","")
+IRAM_PLACEMENT_PATH := $(abspath $(PROJECT_PATH)/$(IRAM_PLACEMENT_FILE))
+endif
+
+COMPONENT_EXTRA_CLEAN := esp32.iram_hot.ld
+
 COMPONENT_ADD_LDFLAGS := -lesp32 \
                            $(abspath libhal.a) \
                            -L$(abspath lib) \
@@ -51,3 +61,17 @@ $(eval $(call SubmoduleRequiredForFiles,$(ALL_LIB_FILES)))
 # It would be better for components to be able to expose any of these
 # non-standard dependencies via get_variable, but this will do for now.
 $(COMPONENT_LIBRARY): $(ALL_LIB_FILES)
+
+# The library is rebuilt when the placement changes, so that the app is
+# re-linked, as for the binary libraries above
+$(COMPONENT_LIBRARY): esp32.iram_hot.ld
+
+# Each line of the placement file is a function name or a wildcard pattern
+# (C++ functions by their mangled names), # starts a comment
+esp32.iram_hot.ld: $(IRAM_PLACEMENT_PATH) $(PROJECT_PATH)/build/include/config/auto.conf
+	$(summary) GEN $@
+	$(Q) echo "/* Generated from CONFIG_ESP32_IRAM_PLACEMENT_FILE, don't edit */" > $@
+ifneq ("$(IRAM_PLACEMENT_PATH)","")
+	$(Q) sed -e 's/#.*//' -e 's/[[:space:]]//g' -e '/^$$/d' \
+		-e 's/.*/*(.literal.& .text.&)/' $(IRAM_PLACEMENT_PATH) >> $@
+endif
@@ -0,0 +1,227 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "esp_console.h"
+#include "heap_alloc_caps.h"
+#include "soc/soc.h"
+#include "soc/uart_reg.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#if CONFIG_CONSOLE_UART_BUFFERED
+
+#define CONSOLE_UART        0
+#define TX_FIFO_SIZE        128
+/* The FIFO is refilled when it holds fewer bytes than this, which leaves
+   the interrupt about 3 ms to run at 115200 baud */
+#define TX_FIFO_THRESHOLD   32
+#define BUF_SIZE            CONFIG_CONSOLE_UART_TX_BUFFER_SIZE
+
+extern unsigned port_interruptNesting[portNUM_PROCESSORS];
+
+/* The buffer and its state are protected by s_lock */
+static uint8_t *s_buf;
+static size_t s_head;               /* next byte to send */
+static size_t s_len;                /* bytes queued */
+static bool s_waiting;              /* a writer waits on s_space */
+static uint32_t s_dropped;
+static SemaphoreHandle_t s_space;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline IRAM_ATTR size_t fifo_count(void)
+{
+    return (READ_PERI_REG(UART_STATUS_REG(CONSOLE_UART)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+}
+
+/* Move as many queued bytes to the FIFO as it has room for */
+static IRAM_ATTR void fill_fifo(void)
+{
+    size_t n = TX_FIFO_SIZE - fifo_count();
+    if (n > s_len) {
+        n = s_len;
+    }
+    s_len -= n;
+    while (n--) {
+        WRITE_PERI_REG(UART_FIFO_REG(CONSOLE_UART), s_buf[s_head]);
+        if (++s_head == BUF_SIZE) {
+            s_head = 0;
+        }
+    }
+}
+
+static IRAM_ATTR void console_isr(void *arg)
+{
+    portENTER_CRITICAL_ISR(&s_lock);
+    fill_fifo();
+    WRITE_PERI_REG(UART_INT_CLR_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_CLR);
+    if (s_len == 0) {
+        CLEAR_PERI_REG_MASK(UART_INT_ENA_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_ENA);
+    }
+    bool wake = s_waiting;
+    s_waiting = false;
+    portEXIT_CRITICAL_ISR(&s_lock);
+
+    if (wake) {
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(s_space, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+static bool can_block(void)
+{
+    return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+           port_interruptNesting[xPortGetCoreID()] == 0;
+}
+
+esp_err_t esp_console_init(void)
+{
+    if (s_buf != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Accessed by the interrupt, which runs while the flash cache is disabled
+    uint8_t *buf = pvPortMallocCaps(BUF_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_DMA);
+    s_space = xSemaphoreCreateBinary();
+    if (buf == NULL || s_space == NULL) {
+        free(buf);
+        if (s_space) {
+            vSemaphoreDelete(s_space);
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    REG_SET_FIELD(UART_CONF1_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_THRHD, TX_FIFO_THRESHOLD);
+    CLEAR_PERI_REG_MASK(UART_INT_ENA_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_ENA);
+    WRITE_PERI_REG(UART_INT_CLR_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_CLR);
+    esp_err_t err = esp_intr_alloc(ETS_UART0_INTR_SOURCE, ESP_INTR_FLAG_LEVEL1 | ESP_INTR_FLAG_IRAM,
+                                   &console_isr, NULL, NULL);
+    if (err != ESP_OK) {
+        free(buf);
+        vSemaphoreDelete(s_space);
+        return err;
+    }
+    s_buf = buf;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_write(const char *data, size_t size)
+{
+    if (s_buf == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const char *end = data + size;
+#if CONFIG_NEWLIB_STDOUT_ADDCR
+    bool cr_queued = false;     /* the CR before *data is queued */
+#endif
+
+#if CONFIG_CONSOLE_UART_FULL_DROP
+    size_t needed = size;
+#if CONFIG_NEWLIB_STDOUT_ADDCR
+    for (const char *p = data; p < end; p++) {
+        needed += (*p == '\n');
+    }
+#endif
+#endif
+
+    portENTER_CRITICAL(&s_lock);
+#if CONFIG_CONSOLE_UART_FULL_DROP
+    if (BUF_SIZE - s_len < needed) {
+        fill_fifo();
+    }
+    if (BUF_SIZE - s_len < needed) {
+        // Drop the whole write rather than the end of it
+        s_dropped += needed;
+        data = end;
+    }
+#endif
+    while (data < end) {
+        if (s_len == BUF_SIZE) {
+            fill_fifo();
+        }
+        if (s_len == BUF_SIZE) {
+            SET_PERI_REG_MASK(UART_INT_ENA_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_ENA);
+            if (can_block()) {
+                s_waiting = true;
+                portEXIT_CRITICAL(&s_lock);
+                xSemaphoreTake(s_space, portMAX_DELAY);
+                portENTER_CRITICAL(&s_lock);
+            }
+            // otherwise, poll the FIFO
+            continue;
+        }
+        size_t tail = s_head + s_len;
+        if (tail >= BUF_SIZE) {
+            tail -= BUF_SIZE;
+        }
+#if CONFIG_NEWLIB_STDOUT_ADDCR
+        if (*data == '\n' && !cr_queued) {
+            s_buf[tail] = '\r';
+            s_len++;
+            cr_queued = true;
+            continue;
+        }
+        cr_queued = false;
+#endif
+        s_buf[tail] = *data++;
+        s_len++;
+    }
+    fill_fifo();
+    if (s_len) {
+        SET_PERI_REG_MASK(UART_INT_ENA_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_ENA);
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+void esp_console_flush(void)
+{
+    if (s_buf == NULL) {
+        return;
+    }
+    size_t len;
+    do {
+        portENTER_CRITICAL(&s_lock);
+        fill_fifo();
+        len = s_len;
+        portEXIT_CRITICAL(&s_lock);
+    } while (len);
+    while (fifo_count()) {
+        ;
+    }
+}
+
+void esp_console_panic_flush(void)
+{
+    if (s_buf == NULL) {
+        return;
+    }
+    CLEAR_PERI_REG_MASK(UART_INT_ENA_REG(CONSOLE_UART), UART_TXFIFO_EMPTY_INT_ENA);
+    while (s_len) {
+        fill_fifo();
+    }
+}
+
+uint32_t esp_console_get_dropped(void)
+{
+    return s_dropped;
+}
+
+#endif // CONFIG_CONSOLE_UART_BUFFERED
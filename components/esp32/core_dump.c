@@ -0,0 +1,303 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_core_dump.h"
+#include "esp_spi_flash.h"
+#include "esp_partition.h"
+#include "rom/crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/xtensa_context.h"
+#include "sdkconfig.h"
+
+/* TCBs and stacks are only dumped from internal DRAM, where FreeRTOS
+   allocates them, so that corrupted task lists don't make the dump fault */
+#define CORE_DUMP_DRAM_LOW          0x3ffae000
+#define CORE_DUMP_DRAM_HIGH         0x40000000
+#define CORE_DUMP_MAX_STACK         0x10000
+
+#define CORE_DUMP_ALIGN(x)          (((x) + 3) & ~3)
+
+static const char* TAG = "core_dump";
+
+/* Set by esp_core_dump_init, size is 0 without a partition */
+static uint32_t s_part_offset;
+static uint32_t s_part_size;
+static bool s_dump_present;
+
+/* State of the panic handler while it writes a dump */
+static TaskSnapshot_t s_tasks[CONFIG_ESP32_CORE_DUMP_MAX_TASKS];
+static uint32_t s_page[SPI_FLASH_PAGE_SIZE / sizeof(uint32_t)];
+static size_t s_page_used;
+static uint32_t s_write_addr;
+static uint32_t s_crc;
+static esp_err_t s_write_err;
+
+static esp_err_t core_dump_find_partition(void)
+{
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_DATA_COREDUMP, NULL);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_part_offset = part->address;
+    s_part_size = part->size & ~(SPI_FLASH_SEC_SIZE - 1);
+    return ESP_OK;
+}
+
+static esp_err_t core_dump_sector_erased(uint32_t addr, bool* out_erased)
+{
+    uint32_t buf[64];
+    for (uint32_t end = addr + SPI_FLASH_SEC_SIZE; addr < end; addr += sizeof(buf)) {
+        esp_err_t err = spi_flash_read(addr, buf, sizeof(buf));
+        if (err != ESP_OK) {
+            return err;
+        }
+        for (int i = 0; i < sizeof(buf) / sizeof(buf[0]); i++) {
+            if (buf[i] != UINT32_MAX) {
+                *out_erased = false;
+                return ESP_OK;
+            }
+        }
+    }
+    *out_erased = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_core_dump_init(void)
+{
+    esp_err_t err = core_dump_find_partition();
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t size;
+    if (esp_core_dump_get(&size) == ESP_OK) {
+        ESP_LOGW(TAG, "Core dump of %u bytes in flash", (unsigned) size);
+        return ESP_OK;
+    }
+    // Erase what an incomplete dump, or other data, left in the partition
+    for (uint32_t addr = s_part_offset; addr < s_part_offset + s_part_size; addr += SPI_FLASH_SEC_SIZE) {
+        bool erased;
+        err = core_dump_sector_erased(addr, &erased);
+        if (err == ESP_OK && !erased) {
+            err = spi_flash_erase_sector(addr / SPI_FLASH_SEC_SIZE);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_core_dump_get(size_t* out_size)
+{
+    if (s_part_size == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    core_dump_header_t header;
+    esp_err_t err = spi_flash_read(s_part_offset, (uint32_t*) &header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_dump_present = false;
+    if (header.magic != ESP_CORE_DUMP_MAGIC || header.version != ESP_CORE_DUMP_VERSION
+            || header.length < sizeof(header) + sizeof(uint32_t) || header.length > s_part_size
+            || header.length % sizeof(uint32_t) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // The CRC covers everything from the version to the CRC
+    uint32_t buf[64];
+    uint32_t crc = 0;
+    uint32_t addr = s_part_offset + sizeof(uint32_t);
+    uint32_t end = s_part_offset + header.length - sizeof(uint32_t);
+    while (addr < end) {
+        uint32_t len = (end - addr < sizeof(buf)) ? end - addr : sizeof(buf);
+        err = spi_flash_read(addr, buf, len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        crc = crc32_le(crc, (const uint8_t*) buf, len);
+        addr += len;
+    }
+    uint32_t dump_crc;
+    err = spi_flash_read(end, &dump_crc, sizeof(dump_crc));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (crc != dump_crc) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_dump_present = true;
+    *out_size = header.length;
+    return ESP_OK;
+}
+
+esp_err_t esp_core_dump_read(size_t offset, void* buf, size_t size)
+{
+    if (s_part_size == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (offset > s_part_size || size > s_part_size - offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return spi_flash_read_bytes(s_part_offset + offset, buf, size);
+}
+
+esp_err_t esp_core_dump_erase(void)
+{
+    if (s_part_size == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (uint32_t addr = s_part_offset; addr < s_part_offset + s_part_size; addr += SPI_FLASH_SEC_SIZE) {
+        esp_err_t err = spi_flash_erase_sector(addr / SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    s_dump_present = false;
+    return ESP_OK;
+}
+
+static void IRAM_ATTR core_dump_flush(void)
+{
+    if (s_page_used == 0) {
+        return;
+    }
+    if (s_write_err == ESP_OK) {
+        s_write_err = spi_flash_write_panic(s_write_addr, s_page, s_page_used);
+    }
+    s_write_addr += s_page_used;
+    s_page_used = 0;
+}
+
+static void IRAM_ATTR core_dump_put(const void* data, size_t size)
+{
+    const uint8_t* src = (const uint8_t*) data;
+    s_crc = crc32_le(s_crc, src, size);
+    while (size > 0) {
+        size_t chunk = sizeof(s_page) - s_page_used;
+        if (chunk > size) {
+            chunk = size;
+        }
+        memcpy((uint8_t*) s_page + s_page_used, src, chunk);
+        s_page_used += chunk;
+        src += chunk;
+        size -= chunk;
+        if (s_page_used == sizeof(s_page)) {
+            core_dump_flush();
+        }
+    }
+}
+
+static inline bool IRAM_ATTR core_dump_in_dram(uint32_t start, uint32_t end)
+{
+    return start >= CORE_DUMP_DRAM_LOW && start <= end && end <= CORE_DUMP_DRAM_HIGH;
+}
+
+/* Addresses of the stack to dump, or an empty range if the task looks corrupted */
+static void IRAM_ATTR core_dump_task_stack(const TaskSnapshot_t* task, const XtExcFrame* frame,
+        bool crashed, core_dump_task_t* out)
+{
+    uint32_t low = (uint32_t) task->pxStack;
+    uint32_t top = (uint32_t) task->pxTopOfStack;
+    uint32_t end = CORE_DUMP_ALIGN((uint32_t) (task->pxEndOfStack + 1));
+    // The exception frame, below the saved stack pointer, is where the task
+    // which panicked was stopped, unless it was in an interrupt handler
+    if (crashed && (uint32_t) frame >= low && (uint32_t) frame < end) {
+        top = (uint32_t) frame;
+    }
+    top &= ~3;
+    out->tcb = (uint32_t) task->xHandle;
+    if (core_dump_in_dram(low, end) && top >= low && top < end && end - top <= CORE_DUMP_MAX_STACK) {
+        out->stack_start = top;
+        out->stack_end = end;
+    } else {
+        out->stack_start = 0;
+        out->stack_end = 0;
+    }
+}
+
+esp_err_t IRAM_ATTR esp_core_dump_to_flash(XtExcFrame* frame)
+{
+    if (s_part_size == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s_dump_present) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // A panic while writing the dump leaves an incomplete dump
+    s_dump_present = true;
+
+    UBaseType_t tcb_size;
+    UBaseType_t count = uxTaskGetSnapshotAll(s_tasks, CONFIG_ESP32_CORE_DUMP_MAX_TASKS, &tcb_size);
+    tcb_size = CORE_DUMP_ALIGN(tcb_size);
+    uint32_t crashed_task = (uint32_t) xTaskGetCurrentTaskHandle();
+
+    // Leave out the tasks which don't fit or whose TCB isn't valid
+    uint32_t length = sizeof(core_dump_header_t) + sizeof(XtExcFrame) + sizeof(uint32_t);
+    UBaseType_t task_count = 0;
+    for (UBaseType_t i = 0; i < count; i++) {
+        core_dump_task_t task;
+        uint32_t tcb = (uint32_t) s_tasks[i].xHandle;
+        core_dump_task_stack(&s_tasks[i], frame, tcb == crashed_task, &task);
+        uint32_t task_length = sizeof(task) + tcb_size + (task.stack_end - task.stack_start);
+        if (!core_dump_in_dram(tcb, tcb + tcb_size) || length + task_length > s_part_size) {
+            continue;
+        }
+        s_tasks[task_count++] = s_tasks[i];
+        length += task_length;
+    }
+
+    s_write_addr = s_part_offset;
+    s_write_err = ESP_OK;
+    s_page_used = 0;
+    s_crc = 0;
+    // The magic word stays erased until the rest has been written
+    s_page[0] = UINT32_MAX;
+    s_page_used = sizeof(uint32_t);
+    // Filled in field by field: an initializer could be copied from flash
+    core_dump_header_t header;
+    header.magic = UINT32_MAX;
+    header.version = ESP_CORE_DUMP_VERSION;
+    header.length = length;
+    header.task_count = task_count;
+    header.tcb_size = tcb_size;
+    header.crashed_task = crashed_task;
+    header.crashed_cpu = xPortGetCoreID();
+    header.frame_size = sizeof(XtExcFrame);
+    core_dump_put(&header.version, sizeof(header) - sizeof(header.magic));
+    core_dump_put(frame, sizeof(XtExcFrame));
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        core_dump_task_t task;
+        uint32_t tcb = (uint32_t) s_tasks[i].xHandle;
+        core_dump_task_stack(&s_tasks[i], frame, tcb == crashed_task, &task);
+        core_dump_put(&task, sizeof(task));
+        core_dump_put((const void*) tcb, tcb_size);
+        core_dump_put((const void*) task.stack_start, task.stack_end - task.stack_start);
+    }
+    uint32_t crc = s_crc;
+    core_dump_put(&crc, sizeof(crc));
+    core_dump_flush();
+
+    if (s_write_err == ESP_OK) {
+        uint32_t magic = ESP_CORE_DUMP_MAGIC;
+        s_write_err = spi_flash_write_panic(s_part_offset, &magic, sizeof(magic));
+    }
+    return s_write_err;
+}
@@ -15,6 +15,8 @@
 #include <stdint.h>
 #include "rom/ets_sys.h"
 #include "sdkconfig.h"
+#include "esp_boot_timeline.h"
+#include "esp_attr.h"
 
 typedef enum{
     XTAL_40M = 40,
@@ -35,19 +37,13 @@ extern void phy_get_romfunc_addr();
 extern void rtc_init_lite();
 extern void rtc_set_cpu_freq(xtal_freq_t xtal_freq, cpu_freq_t cpu_freq);
 
-/*
- * This function is not exposed as an API at this point,
- * because FreeRTOS doesn't yet support dynamic changing of
- * CPU frequency. Also we need to implement hooks for
- * components which want to be notified of CPU frequency
- * changes.
- */
-void esp_set_cpu_freq()
+/* Switch the clock of both CPUs to 80, 160 or 240 MHz. Other frequencies
+ * select 80 MHz. Nothing depending on the frequency is updated. In IRAM as
+ * librtc, as the power management switches with the flash cache possibly
+ * disabled on the other CPU. */
+void IRAM_ATTR esp_cpu_freq_switch(uint32_t freq_mhz)
 {
-    uint32_t freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
-    phy_get_romfunc_addr();
-    rtc_init_lite();
-    cpu_freq_t freq = CPU_80M;
+    cpu_freq_t freq;
     switch(freq_mhz) {
         case 240:
             freq = CPU_240M;
@@ -56,13 +52,25 @@ void esp_set_cpu_freq()
             freq = CPU_160M;
             break;
         default:
-            freq_mhz = 80;
-            /* no break */
-        case 80:
             freq = CPU_80M;
             break;
     }
     rtc_set_cpu_freq(XTAL_AUTO, freq);
-    ets_update_cpu_frequency(freq_mhz);
 }
 
+/*
+ * Sets the startup frequency. Changes at run time are made by the power
+ * management (esp_pm.h), which also updates the FreeRTOS tick.
+ */
+void esp_set_cpu_freq()
+{
+    uint32_t freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    phy_get_romfunc_addr();
+    rtc_init_lite();
+    if (freq_mhz != 240 && freq_mhz != 160) {
+        freq_mhz = 80;
+    }
+    esp_cpu_freq_switch(freq_mhz);
+    ets_update_cpu_frequency(freq_mhz);
+    esp_boot_timeline_set_cpu_freq(freq_mhz);
+}
@@ -37,11 +37,23 @@
 #include "sdkconfig.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
+#include "esp_partition.h"
 #include "nvs_flash.h"
 #include "esp_event.h"
 #include "esp_spi_flash.h"
 #include "esp_ipc.h"
+#include "esp_timer.h"
+#include "esp_time.h"
+#include "esp_console.h"
+#include "esp_vfs_dev.h"
+#include "esp_init.h"
+#include "esp_task.h"
 #include "esp_log.h"
+#include "esp_boot_timeline.h"
+#include "esp_core_dump.h"
+#if CONFIG_WIFI_ENABLED && CONFIG_WIFI_AUTO_STARTUP
+#include "esp_wifi.h"
+#endif
 
 static void IRAM_ATTR user_start_cpu0(void);
 static void IRAM_ATTR call_user_start_cpu1();
@@ -72,6 +84,14 @@ void IRAM_ATTR call_user_start_cpu0()
 
     cpu_configure_region_protection();
 
+    // Continue the timeline started by the bootloader, unless it is left over from an earlier boot
+    const esp_boot_timeline_t* timeline = ESP_BOOT_TIMELINE;
+    if (timeline->magic != ESP_BOOT_TIMELINE_MAGIC || timeline->count == 0 ||
+            timeline->entries[timeline->count - 1].stage != ESP_BOOT_STAGE_START_APP) {
+        esp_boot_timeline_start();
+    }
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_APP_START);
+
     //Move exception vectors to IRAM
     asm volatile (\
                   "wsr    %0, vecbase\n" \
@@ -84,6 +104,7 @@ void IRAM_ATTR call_user_start_cpu0()
 
     // Initialize heap allocator
     heap_alloc_caps_init();
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_HEAP_INIT);
 
     ESP_EARLY_LOGI(TAG, "Pro cpu up.");
 
@@ -99,6 +120,7 @@ void IRAM_ATTR call_user_start_cpu0()
     while (!app_cpu_started) {
         ets_delay_us(100);
     }
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_APP_CPU_UP);
 #else
     ESP_EARLY_LOGI(TAG, "Single core mode");
     CLEAR_PERI_REG_MASK(DPORT_APPCPU_CTRL_B_REG, DPORT_APPCPU_CLKGATE_EN);
@@ -131,6 +153,23 @@ void IRAM_ATTR user_start_cpu1(void)
     xPortStartScheduler();
 }
 
+/*
+ * Both CPUs run on stacks set up by the ROM until the scheduler starts on them. These stacks are given to the
+ * heap from a task, once the scheduler runs everywhere.
+ */
+static void reclaim_startup_memory_task(void *arg)
+{
+#ifndef CONFIG_FREERTOS_UNICORE
+    while (port_xSchedulerRunning[1] == 0) {
+        vTaskDelay(1);
+    }
+#endif
+    // The scheduler flag is set right before the first task is switched to; give the APP CPU time to get there.
+    vTaskDelay(1);
+    heap_alloc_caps_enable_startup_regions();
+    vTaskDelete(NULL);
+}
+
 static void do_global_ctors(void)
 {
     void (**p)(void);
@@ -139,34 +178,108 @@ static void do_global_ctors(void)
     }
 }
 
-void user_start_cpu0(void)
-{
-    esp_set_cpu_freq();     // set CPU frequency configured in menuconfig
-    uart_div_modify(0, (APB_CLK_FREQ << 4) / 115200);
-    ets_setup_syscalls();
-    do_global_ctors();
-    esp_ipc_init();
-    spi_flash_init();
-
 #if CONFIG_WIFI_ENABLED
-    esp_err_t ret = nvs_flash_init(5, 3);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "nvs_flash_init failed, ret=%d", ret);
+static esp_err_t startup_nvs_init(void)
+{
+    // Partition tables without an "nvs" partition keep NVS in sectors 5 to 7
+    esp_err_t err = nvs_flash_init_partition("nvs");
+    if (err == ESP_ERR_NOT_FOUND) {
+        err = nvs_flash_init(5, 3);
     }
+    return err;
+}
 
+static esp_err_t startup_system_init(void)
+{
     system_init();
-    esp_event_init(NULL, NULL);
+    return ESP_OK;
+}
+
+static esp_err_t startup_event_init(void)
+{
+    return esp_event_init(NULL, NULL);
+}
+
+static esp_err_t startup_tcpip_init(void)
+{
     tcpip_adapter_init();
+    return ESP_OK;
+}
+
+/*
+ * System components initialized before the application. system_init comes from the WiFi libraries and may use the
+ * flash, so it is kept after NVS mount rather than run at the same time; event and TCP/IP initialization only create
+ * tasks and queues and have no ordering requirements.
+ */
+static const esp_init_step_t s_startup_steps[] = {
+    { "nvs", &startup_nvs_init, NULL, ESP_INIT_ANY_CPU },
+    { "system", &startup_system_init, ESP_INIT_DEPS("nvs"), ESP_INIT_ANY_CPU },
+    { "event", &startup_event_init, NULL, ESP_INIT_ANY_CPU },
+    { "tcpip", &startup_tcpip_init, NULL, ESP_INIT_ANY_CPU },
+};
+#endif
+
+static void start_app(void)
+{
+#if CONFIG_WIFI_ENABLED
+    esp_init_run(s_startup_steps, sizeof(s_startup_steps) / sizeof(s_startup_steps[0]));
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_COMPONENTS_INIT);
 #endif
 
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_APP_MAIN);
+
 #if CONFIG_WIFI_ENABLED && CONFIG_WIFI_AUTO_STARTUP
-#include "esp_wifi.h"
     esp_wifi_startup(app_main, NULL);
 #else
     app_main(NULL);
 #endif
+}
+
+#if CONFIG_ESP32_PARALLEL_STARTUP
+/*
+ * Runs the startup steps once the scheduler runs on both CPUs, so that independent steps can run in parallel, then
+ * the application.
+ */
+static void main_task(void *arg)
+{
+    start_app();
+    vTaskDelete(NULL);
+}
+#endif
+
+void user_start_cpu0(void)
+{
+    esp_set_cpu_freq();     // set CPU frequency configured in menuconfig
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_CPU_FREQ);
+    uart_div_modify(0, (APB_CLK_FREQ << 4) / 115200);
+    ets_setup_syscalls();
+    esp_vfs_dev_uart_register();
+    esp_vfs_lwip_sockets_register();
+    do_global_ctors();
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_GLOBAL_CTORS);
+    esp_ipc_init();
+    esp_timer_init();
+#if CONFIG_CONSOLE_UART_BUFFERED
+    esp_console_init();
+#endif
+    esp_time_init();
+    spi_flash_init();
+    esp_partition_init();
+#if CONFIG_ESP32_ENABLE_COREDUMP
+    esp_core_dump_init();
+#endif
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_SYSTEM_INIT);
+
+#if CONFIG_ESP32_PARALLEL_STARTUP
+    xTaskCreatePinnedToCore(main_task, "main", ESP_TASK_MAIN_STACK, NULL, ESP_TASK_MAIN_PRIO, NULL, ESP_TASK_APP_CORE);
+#else
+    start_app();
+#endif
+
+    xTaskCreatePinnedToCore(reclaim_startup_memory_task, "reclaim", 2048, NULL, configMAX_PRIORITIES - 1, NULL, 0);
 
     ESP_LOGI(TAG, "Starting scheduler on PRO CPU.");
+    esp_boot_timeline_mark(ESP_BOOT_STAGE_SCHEDULER_START);
     vTaskStartScheduler();
 }
 
@@ -0,0 +1,329 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_deep_sleep.h"
+#include "esp_console.h"
+#include "esp_time.h"
+#include "esp_timer_impl.h"
+#include "esp_pm.h"
+#include "rom/ets_sys.h"
+#include "rom/gpio.h"
+#include "rom/rtc.h"
+#include "rom/uart.h"
+#include "soc/soc.h"
+#include "soc/cpu.h"
+#include "soc/dport_reg.h"
+#include "soc/gpio_struct.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+/* Slow clock cycles measured, about 1 ms with the 150 kHz RC oscillator */
+#define SLOWCK_CALI_CYCLES      128
+
+/* GPIO interrupt types waking up from light sleep */
+#define GPIO_INTR_LOW_LEVEL     4
+#define GPIO_INTR_HIGH_LEVEL    5
+
+typedef struct {
+    uint8_t gpio_num;
+    uint32_t reg;       // pad register
+    uint32_t mux;       // routes the pad to the RTC IO mux
+    uint32_t ie;        // input enable
+} rtc_io_desc_t;
+
+/* Indexed by RTC IO number */
+static const rtc_io_desc_t s_rtc_io[] = {
+    { 36, RTC_IO_SENSOR_PADS_REG, RTC_IO_SENSE1_MUX_SEL, RTC_IO_SENSE1_FUN_IE },
+    { 37, RTC_IO_SENSOR_PADS_REG, RTC_IO_SENSE2_MUX_SEL, RTC_IO_SENSE2_FUN_IE },
+    { 38, RTC_IO_SENSOR_PADS_REG, RTC_IO_SENSE3_MUX_SEL, RTC_IO_SENSE3_FUN_IE },
+    { 39, RTC_IO_SENSOR_PADS_REG, RTC_IO_SENSE4_MUX_SEL, RTC_IO_SENSE4_FUN_IE },
+    { 34, RTC_IO_ADC_PAD_REG, RTC_IO_ADC1_MUX_SEL, RTC_IO_ADC1_FUN_IE },
+    { 35, RTC_IO_ADC_PAD_REG, RTC_IO_ADC2_MUX_SEL, RTC_IO_ADC2_FUN_IE },
+    { 25, RTC_IO_PAD_DAC1_REG, RTC_IO_PDAC1_MUX_SEL, RTC_IO_PDAC1_FUN_IE },
+    { 26, RTC_IO_PAD_DAC2_REG, RTC_IO_PDAC2_MUX_SEL, RTC_IO_PDAC2_FUN_IE },
+    { 33, RTC_IO_XTAL_32K_PAD_REG, RTC_IO_X32N_MUX_SEL, RTC_IO_X32N_FUN_IE },
+    { 32, RTC_IO_XTAL_32K_PAD_REG, RTC_IO_X32P_MUX_SEL, RTC_IO_X32P_FUN_IE },
+    { 4, RTC_IO_TOUCH_PAD0_REG, RTC_IO_TOUCH_PAD0_MUX_SEL, RTC_IO_TOUCH_PAD0_FUN_IE },
+    { 0, RTC_IO_TOUCH_PAD1_REG, RTC_IO_TOUCH_PAD1_MUX_SEL, RTC_IO_TOUCH_PAD1_FUN_IE },
+    { 2, RTC_IO_TOUCH_PAD2_REG, RTC_IO_TOUCH_PAD2_MUX_SEL, RTC_IO_TOUCH_PAD2_FUN_IE },
+    { 15, RTC_IO_TOUCH_PAD3_REG, RTC_IO_TOUCH_PAD3_MUX_SEL, RTC_IO_TOUCH_PAD3_FUN_IE },
+    { 13, RTC_IO_TOUCH_PAD4_REG, RTC_IO_TOUCH_PAD4_MUX_SEL, RTC_IO_TOUCH_PAD4_FUN_IE },
+    { 12, RTC_IO_TOUCH_PAD5_REG, RTC_IO_TOUCH_PAD5_MUX_SEL, RTC_IO_TOUCH_PAD5_FUN_IE },
+    { 14, RTC_IO_TOUCH_PAD6_REG, RTC_IO_TOUCH_PAD6_MUX_SEL, RTC_IO_TOUCH_PAD6_FUN_IE },
+    { 27, RTC_IO_TOUCH_PAD7_REG, RTC_IO_TOUCH_PAD7_MUX_SEL, RTC_IO_TOUCH_PAD7_FUN_IE },
+};
+
+#define RTC_IO_COUNT    (sizeof(s_rtc_io) / sizeof(s_rtc_io[0]))
+
+static portMUX_TYPE s_sleep_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_wakeup_triggers;          // WAKEUP_ENABLE bits of the enabled sources
+static uint64_t s_sleep_duration_us;        // for TIMER_EXPIRE_EN
+static uint64_t s_gpio_wakeup_mask;         // pins set up by esp_sleep_enable_gpio_wakeup
+static esp_deep_sleep_wake_stub_fn_t s_wake_stub;
+static bool s_light_slept;
+
+/* Sleep parameters of the last esp_deep_sleep_start, for esp_wake_stub_sleep_again */
+static RTC_DATA_ATTR uint64_t s_stub_sleep_cycles;
+
+static uint64_t rtc_timer_read(void)
+{
+    SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+    while ((READ_PERI_REG(RTC_CNTL_TIME_UPDATE_REG) & RTC_CNTL_TIME_VALID) == 0) {
+        ;
+    }
+    return READ_PERI_REG(RTC_CNTL_TIME0_REG) |
+            ((uint64_t) (READ_PERI_REG(RTC_CNTL_TIME1_REG) & RTC_CNTL_TIME_HI) << 32);
+}
+
+/* Stall the other CPU, as in the panic handler, so that it can't touch the
+ * RTC memories or the peripherals while this one sleeps */
+static void other_cpu_stall(bool stall)
+{
+#ifndef CONFIG_FREERTOS_UNICORE
+    bool app_cpu = xPortGetCoreID() == 0;
+    uint32_t c1_mask = app_cpu ? RTC_CNTL_SW_STALL_APPCPU_C1 << RTC_CNTL_SW_STALL_APPCPU_C1_S
+                               : RTC_CNTL_SW_STALL_PROCPU_C1 << RTC_CNTL_SW_STALL_PROCPU_C1_S;
+    uint32_t c0_mask = app_cpu ? RTC_CNTL_SW_STALL_APPCPU_C0 << RTC_CNTL_SW_STALL_APPCPU_C0_S
+                               : RTC_CNTL_SW_STALL_PROCPU_C0 << RTC_CNTL_SW_STALL_PROCPU_C0_S;
+    CLEAR_PERI_REG_MASK(RTC_CNTL_OPTIONS0_REG, c1_mask);
+    CLEAR_PERI_REG_MASK(RTC_CNTL_SW_CPU_STALL_REG, c0_mask);
+    if (stall) {
+        SET_PERI_REG_MASK(RTC_CNTL_OPTIONS0_REG, 0x21 << (app_cpu ? RTC_CNTL_SW_STALL_APPCPU_C1_S
+                                                                  : RTC_CNTL_SW_STALL_PROCPU_C1_S));
+        SET_PERI_REG_MASK(RTC_CNTL_SW_CPU_STALL_REG, 2 << (app_cpu ? RTC_CNTL_SW_STALL_APPCPU_C0_S
+                                                                   : RTC_CNTL_SW_STALL_PROCPU_C0_S));
+    }
+#endif
+}
+
+/* Keep the RTC memories powered, and the RTC peripherals if an RTC IO wakes
+ * up. Called after rtc_slp_prep_lite, which sets up the power domains. */
+static void rtc_power_configure(void)
+{
+    CLEAR_PERI_REG_MASK(RTC_CNTL_PWC_REG, RTC_CNTL_SLOWMEM_PD_EN | RTC_CNTL_SLOWMEM_FORCE_PD |
+                        RTC_CNTL_SLOWMEM_FORCE_ISO | RTC_CNTL_FASTMEM_PD_EN |
+                        RTC_CNTL_FASTMEM_FORCE_PD | RTC_CNTL_FASTMEM_FORCE_ISO);
+    SET_PERI_REG_MASK(RTC_CNTL_PWC_REG, RTC_CNTL_SLOWMEM_FORCE_PU | RTC_CNTL_SLOWMEM_FORCE_NOISO |
+                      RTC_CNTL_FASTMEM_FORCE_PU | RTC_CNTL_FASTMEM_FORCE_NOISO);
+    if (s_wakeup_triggers & EXT_EVENT0_TRIG_EN) {
+        CLEAR_PERI_REG_MASK(RTC_CNTL_PWC_REG, RTC_CNTL_PD_EN | RTC_CNTL_PWC_FORCE_PD);
+        SET_PERI_REG_MASK(RTC_CNTL_PWC_REG, RTC_CNTL_PWC_FORCE_PU);
+    }
+}
+
+/* Sleep time in slow clock cycles, 0 without timer wakeup */
+static uint64_t sleep_cycles(uint32_t period)
+{
+    if ((s_wakeup_triggers & TIMER_EXPIRE_EN) == 0) {
+        return 0;
+    }
+    uint32_t cycles_h, cycles_l;
+    rtc_usec2rtc((uint32_t) (s_sleep_duration_us >> 32), (uint32_t) s_sleep_duration_us, period,
+                 &cycles_h, &cycles_l);
+    return ((uint64_t) cycles_h << 32) | cycles_l;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    if (time_in_us == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_sleep_lock);
+    s_sleep_duration_us = time_in_us;
+    s_wakeup_triggers |= TIMER_EXPIRE_EN;
+    portEXIT_CRITICAL(&s_sleep_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(int gpio_num, int level)
+{
+    if (level != 0 && level != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t rtc_io;
+    for (rtc_io = 0; rtc_io < RTC_IO_COUNT; ++rtc_io) {
+        if (s_rtc_io[rtc_io].gpio_num == gpio_num) {
+            break;
+        }
+    }
+    if (rtc_io == RTC_IO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const rtc_io_desc_t* desc = &s_rtc_io[rtc_io];
+    portENTER_CRITICAL(&s_sleep_lock);
+    SET_PERI_REG_MASK(desc->reg, desc->mux | desc->ie);
+    REG_SET_FIELD(RTC_IO_EXT_WAKEUP0_REG, RTC_IO_EXT_WAKEUP0_SEL, rtc_io);
+    if (level) {
+        SET_PERI_REG_MASK(RTC_CNTL_EXT_WAKEUP_CONF_REG, RTC_CNTL_EXT_WAKEUP0_LV);
+    } else {
+        CLEAR_PERI_REG_MASK(RTC_CNTL_EXT_WAKEUP_CONF_REG, RTC_CNTL_EXT_WAKEUP0_LV);
+    }
+    s_wakeup_triggers |= EXT_EVENT0_TRIG_EN;
+    portEXIT_CRITICAL(&s_sleep_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(int gpio_num, int level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_PIN_COUNT || (level != 0 && level != 1)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_sleep_lock);
+    GPIO.pin[gpio_num].int_type = level ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL;
+    GPIO.pin[gpio_num].wakeup_enable = 1;
+    s_gpio_wakeup_mask |= 1ULL << gpio_num;
+    s_wakeup_triggers |= GPIO_TRIG_EN;
+    portEXIT_CRITICAL(&s_sleep_lock);
+    return ESP_OK;
+}
+
+void esp_sleep_disable_wakeup_sources(void)
+{
+    portENTER_CRITICAL(&s_sleep_lock);
+    for (int i = 0; i < GPIO_PIN_COUNT; ++i) {
+        if (s_gpio_wakeup_mask & (1ULL << i)) {
+            GPIO.pin[i].wakeup_enable = 0;
+            GPIO.pin[i].int_type = 0;
+        }
+    }
+    s_gpio_wakeup_mask = 0;
+    s_wakeup_triggers = 0;
+    portEXIT_CRITICAL(&s_sleep_lock);
+}
+
+void esp_deep_sleep_start(void)
+{
+    esp_time_save();
+    esp_console_flush();
+    uart_tx_wait_idle(0);
+
+    // Calibration takes about a millisecond, do it before disabling interrupts
+    uint64_t cycles = sleep_cycles(rtc_slowck_cali(CALI_RTC_MUX, SLOWCK_CALI_CYCLES));
+
+    portENTER_CRITICAL(&s_sleep_lock);
+    other_cpu_stall(true);
+    s_stub_sleep_cycles = cycles;
+    REG_WRITE(RTC_CNTL_STORE6_REG, (uint32_t) esp_get_deep_sleep_wake_stub());
+    // The ROM calls the stub only if RTC fast memory still has this CRC
+    set_rtc_memory_crc();
+    rtc_slp_prep_lite(1, 0);
+    rtc_power_configure();
+    rtc_sleep((uint32_t) (cycles >> 32), (uint32_t) cycles, s_wakeup_triggers & ~GPIO_TRIG_EN, 0);
+    while (true) {
+        ;
+    }
+}
+
+esp_err_t esp_light_sleep_start(void)
+{
+    if (s_wakeup_triggers == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_console_flush();
+    uart_tx_wait_idle(0);
+
+    uint32_t period = rtc_slowck_cali(CALI_RTC_MUX, SLOWCK_CALI_CYCLES);
+    uint64_t cycles = sleep_cycles(period);
+    int freq_mhz = esp_pm_get_cpu_freq_mhz();
+
+    portENTER_CRITICAL(&s_sleep_lock);
+    other_cpu_stall(true);
+    uint64_t start = rtc_timer_read();
+    rtc_slp_prep_lite(0, 0);
+    rtc_power_configure();
+    rtc_sleep((uint32_t) (cycles >> 32), (uint32_t) cycles, s_wakeup_triggers, 0);
+    // librtc leaves the CPU running from the crystal
+    esp_cpu_freq_switch(freq_mhz);
+    uint64_t slept = rtc_timer_read() - start;
+    other_cpu_stall(false);
+    s_light_slept = true;
+    portEXIT_CRITICAL(&s_sleep_lock);
+
+    // Only now that the other CPU runs again: it may have held the esp_timer locks
+    esp_timer_impl_advance((int64_t) ((slept * period) >> RTC_SLOWCK_PERIOD_FRACT));
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    if (!s_light_slept && rtc_get_reset_reason(0) != DEEPSLEEP_RESET) {
+        return ESP_SLEEP_WAKEUP_UNDEFINED;
+    }
+    uint32_t cause = rtc_get_wakeup_cause();
+    if (cause & EXT_EVENT0_TRIG) {
+        return ESP_SLEEP_WAKEUP_EXT0;
+    } else if (cause & GPIO_TRIG) {
+        return ESP_SLEEP_WAKEUP_GPIO;
+    } else if (cause & TIMER_EXPIRE) {
+        return ESP_SLEEP_WAKEUP_TIMER;
+    }
+    return ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+void esp_set_deep_sleep_wake_stub(esp_deep_sleep_wake_stub_fn_t new_stub)
+{
+    s_wake_stub = new_stub;
+}
+
+esp_deep_sleep_wake_stub_fn_t esp_get_deep_sleep_wake_stub(void)
+{
+    return s_wake_stub ? s_wake_stub : &esp_wake_deep_sleep;
+}
+
+void RTC_IRAM_ATTR esp_default_wake_deep_sleep(void)
+{
+    // The ROM loads the bootloader through the flash cache: start with an empty MMU
+    SET_PERI_REG_MASK(DPORT_PRO_CACHE_CTRL1_REG, DPORT_PRO_CACHE_MMU_IA_CLR);
+    CLEAR_PERI_REG_MASK(DPORT_PRO_CACHE_CTRL1_REG, DPORT_PRO_CACHE_MMU_IA_CLR);
+}
+
+void __attribute__((weak, alias("esp_default_wake_deep_sleep"))) esp_wake_deep_sleep(void);
+
+/* Only runs from the wake stub, so it can't call rtc_sleep or anything else
+ * outside of ROM and RTC fast memory. The RTC domain kept the wakeup sources
+ * and the power configuration, only the timer needs to be set again. */
+void RTC_IRAM_ATTR esp_wake_stub_sleep_again(void)
+{
+    // The ROM started the RTC watchdog in flash boot mode, which the bootloader would stop
+    CLEAR_PERI_REG_MASK(RTC_CNTL_WDTCONFIG0_REG, RTC_CNTL_WDT_FLASHBOOT_MOD_EN);
+    uart_tx_wait_idle(0);
+
+    if (s_stub_sleep_cycles) {
+        SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+        while ((READ_PERI_REG(RTC_CNTL_TIME_UPDATE_REG) & RTC_CNTL_TIME_VALID) == 0) {
+            ;
+        }
+        uint64_t alarm = (READ_PERI_REG(RTC_CNTL_TIME0_REG) |
+                ((uint64_t) (READ_PERI_REG(RTC_CNTL_TIME1_REG) & RTC_CNTL_TIME_HI) << 32)) +
+                s_stub_sleep_cycles;
+        WRITE_PERI_REG(RTC_CNTL_SLP_TIMER0_REG, (uint32_t) alarm);
+        WRITE_PERI_REG(RTC_CNTL_SLP_TIMER1_REG,
+                       ((uint32_t) (alarm >> 32) & RTC_CNTL_SLP_VAL_HI) | RTC_CNTL_MAIN_TIMER_ALARM_EN);
+    }
+
+    // The stub may have changed RTC fast memory; STORE6 still points to it
+    set_rtc_memory_crc();
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    while (true) {
+        ;
+    }
+}
@@ -0,0 +1,250 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/queue.h>
+#include "esp_err.h"
+#include "esp_coro.h"
+#include "esp_task.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#define ESP_CORO_POLL_TICKS     (CONFIG_ESP_CORO_POLL_PERIOD_MS / portTICK_PERIOD_MS > 0 ? \
+                                 CONFIG_ESP_CORO_POLL_PERIOD_MS / portTICK_PERIOD_MS : 1)
+
+typedef enum {
+    CORO_READY,         // In the ready list, or in the batch being run
+    CORO_RUNNING,
+    CORO_WAITING,       // In the waiting list
+    CORO_DONE,
+} coro_state_t;
+
+struct esp_coro_executor {
+    TaskHandle_t task;
+    portMUX_TYPE lock;                      // Protects the lists and the state of the coroutines
+    TAILQ_HEAD(, esp_coro) ready;           // Coroutines to run, in order
+    TAILQ_HEAD(, esp_coro) waiting;         // Waiting coroutines, unsorted
+    size_t ready_count;
+    TickType_t next_poll;                   // Time at which polling waiters are run again
+};
+
+static inline bool deadline_passed(TickType_t now, TickType_t deadline)
+{
+    return (int32_t) (now - deadline) >= 0;
+}
+
+// Called with the executor lock held
+static void make_ready(esp_coro_executor_handle_t executor, esp_coro_t* coro)
+{
+    coro->state = CORO_READY;
+    TAILQ_INSERT_TAIL(&executor->ready, coro, entry);
+    ++executor->ready_count;
+}
+
+// Called with the executor lock held. Moves waiting coroutines whose wait is
+// over to the ready list, returns the time the executor can sleep.
+static TickType_t wake_waiters(esp_coro_executor_handle_t executor)
+{
+    const TickType_t now = xTaskGetTickCount();
+    const bool poll = deadline_passed(now, executor->next_poll);
+    if (poll) {
+        executor->next_poll = now + ESP_CORO_POLL_TICKS;
+    }
+    TickType_t sleep = portMAX_DELAY;
+    esp_coro_t* next;
+    for (esp_coro_t* coro = TAILQ_FIRST(&executor->waiting); coro != NULL; coro = next) {
+        next = TAILQ_NEXT(coro, entry);
+        if ((coro->has_deadline && deadline_passed(now, coro->deadline)) ||
+            (poll && coro->wait == ESP_CORO_WAIT_POLL)) {
+            TAILQ_REMOVE(&executor->waiting, coro, entry);
+            make_ready(executor, coro);
+            continue;
+        }
+        if (coro->has_deadline && coro->deadline - now < sleep) {
+            sleep = coro->deadline - now;
+        }
+        if (coro->wait == ESP_CORO_WAIT_POLL && executor->next_poll - now < sleep) {
+            sleep = executor->next_poll - now;
+        }
+    }
+    return sleep;
+}
+
+static void executor_task(void* arg)
+{
+    esp_coro_executor_handle_t executor = (esp_coro_executor_handle_t) arg;
+    while (true) {
+        portENTER_CRITICAL(&executor->lock);
+        TickType_t sleep = wake_waiters(executor);
+        // Run the coroutines which are ready now; the ones made ready while
+        // they run wait for the next pass, after the waiters have been checked.
+        size_t batch = executor->ready_count;
+        portEXIT_CRITICAL(&executor->lock);
+
+        if (batch == 0) {
+            ulTaskNotifyTake(pdTRUE, sleep);
+            continue;
+        }
+
+        while (batch-- > 0) {
+            portENTER_CRITICAL(&executor->lock);
+            esp_coro_t* coro = TAILQ_FIRST(&executor->ready);
+            TAILQ_REMOVE(&executor->ready, coro, entry);
+            --executor->ready_count;
+            coro->state = CORO_RUNNING;
+            portEXIT_CRITICAL(&executor->lock);
+
+            esp_coro_status_t status = (*coro->func)(coro, coro->arg);
+
+            portENTER_CRITICAL(&executor->lock);
+            if (status == ESP_CORO_DONE) {
+                coro->state = CORO_DONE;
+            } else if (coro->wait == ESP_CORO_WAIT_NONE ||
+                       (coro->notified && coro->wait == ESP_CORO_WAIT_NOTIFY)) {
+                make_ready(executor, coro);
+            } else if (coro->notified && coro->wait == ESP_CORO_WAIT_POLL) {
+                // Notified while running: check the condition once more
+                coro->notified = false;
+                make_ready(executor, coro);
+            } else {
+                coro->state = CORO_WAITING;
+                TAILQ_INSERT_TAIL(&executor->waiting, coro, entry);
+            }
+            portEXIT_CRITICAL(&executor->lock);
+        }
+    }
+}
+
+esp_err_t esp_coro_executor_create(int core_id, UBaseType_t priority, esp_coro_executor_handle_t* out_handle)
+{
+    if (core_id < 0 || core_id >= portNUM_PROCESSORS || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_coro_executor_handle_t executor = (esp_coro_executor_handle_t) pvPortMalloc(sizeof(*executor));
+    if (executor == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(executor, 0, sizeof(*executor));
+    vPortCPUInitializeMutex(&executor->lock);
+    TAILQ_INIT(&executor->ready);
+    TAILQ_INIT(&executor->waiting);
+    executor->next_poll = xTaskGetTickCount();
+    if (xTaskCreatePinnedToCore(executor_task, "coro", ESP_TASK_CORO_EXECUTOR_STACK, executor,
+                                priority, &executor->task, core_id) != pdPASS) {
+        vPortFree(executor);
+        return ESP_ERR_NO_MEM;
+    }
+    *out_handle = executor;
+    return ESP_OK;
+}
+
+esp_err_t esp_coro_start(esp_coro_executor_handle_t executor, esp_coro_t* coro, esp_coro_func_t func, void* arg)
+{
+    if (executor == NULL || coro == NULL || func == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    coro->func = func;
+    coro->arg = arg;
+    coro->executor = executor;
+    coro->resume = 0;
+    coro->wait = ESP_CORO_WAIT_NONE;
+    coro->has_deadline = false;
+    coro->notified = false;
+    portENTER_CRITICAL(&executor->lock);
+    make_ready(executor, coro);
+    portEXIT_CRITICAL(&executor->lock);
+    xTaskNotifyGive(executor->task);
+    return ESP_OK;
+}
+
+// Called with the executor lock held, returns true if the executor task has
+// to be woken up.
+static bool notify_locked(esp_coro_t* coro)
+{
+    esp_coro_executor_handle_t executor = coro->executor;
+    if (coro->state == CORO_DONE) {
+        return false;
+    }
+    // A poll is answered by the condition, not by the notification
+    if (coro->wait != ESP_CORO_WAIT_POLL || coro->state != CORO_WAITING) {
+        coro->notified = true;
+    }
+    if (coro->state != CORO_WAITING || coro->wait == ESP_CORO_WAIT_DELAY) {
+        return false;
+    }
+    TAILQ_REMOVE(&executor->waiting, coro, entry);
+    make_ready(executor, coro);
+    return true;
+}
+
+void esp_coro_notify(esp_coro_t* coro)
+{
+    esp_coro_executor_handle_t executor = coro->executor;
+    portENTER_CRITICAL(&executor->lock);
+    bool wake = notify_locked(coro);
+    portEXIT_CRITICAL(&executor->lock);
+    if (wake) {
+        xTaskNotifyGive(executor->task);
+    }
+}
+
+void esp_coro_notify_from_isr(esp_coro_t* coro, BaseType_t* higher_priority_task_woken)
+{
+    esp_coro_executor_handle_t executor = coro->executor;
+    portENTER_CRITICAL_ISR(&executor->lock);
+    bool wake = notify_locked(coro);
+    portEXIT_CRITICAL_ISR(&executor->lock);
+    if (wake) {
+        vTaskNotifyGiveFromISR(executor->task, higher_priority_task_woken);
+    }
+}
+
+void esp_coro_prepare_wait(esp_coro_t* coro, esp_coro_wait_t wait, TickType_t ticks_to_wait)
+{
+    coro->wait = wait;
+    coro->has_deadline = (ticks_to_wait != portMAX_DELAY);
+    coro->deadline = xTaskGetTickCount() + ticks_to_wait;
+}
+
+bool esp_coro_timed_out(esp_coro_t* coro)
+{
+    return coro->has_deadline && deadline_passed(xTaskGetTickCount(), coro->deadline);
+}
+
+bool esp_coro_take_notify(esp_coro_t* coro)
+{
+    esp_coro_executor_handle_t executor = coro->executor;
+    portENTER_CRITICAL(&executor->lock);
+    bool notified = coro->notified;
+    coro->notified = false;
+    portEXIT_CRITICAL(&executor->lock);
+    return notified;
+}
+
+bool esp_coro_socket_ready(int fd, bool write)
+{
+    fd_set set;
+    fd_set err_set;
+    struct timeval timeout = { 0 };
+    FD_ZERO(&set);
+    FD_ZERO(&err_set);
+    FD_SET(fd, &set);
+    FD_SET(fd, &err_set);
+    return lwip_select(fd + 1, write ? NULL : &set, write ? &set : NULL, &err_set, &timeout) != 0;
+}
@@ -0,0 +1,213 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_init.h"
+#include "esp_log.h"
+#include "esp_task.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef enum {
+    STEP_PENDING,
+    STEP_RUNNING,
+    STEP_DONE,
+} step_state_t;
+
+typedef struct {
+    const esp_init_step_t* steps;
+    size_t count;
+    uint8_t* state;                                 // step_state_t of each step
+    size_t remaining;                               // Steps not done yet
+    esp_err_t result;                               // First error returned by a step
+    portMUX_TYPE lock;                              // Protects state, remaining and result
+    TaskHandle_t workers[portNUM_PROCESSORS];       // Tasks running steps, NULL if unused
+    SemaphoreHandle_t helper_done;                  // Given when the helper task has finished
+} init_run_t;
+
+static const char* TAG = "init";
+
+static int find_step(const init_run_t* run, const char* name)
+{
+    for (size_t i = 0; i < run->count; ++i) {
+        if (strcmp(run->steps[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool deps_done(const init_run_t* run, size_t index)
+{
+    const char* const* deps = run->steps[index].deps;
+    for (; deps != NULL && *deps != NULL; ++deps) {
+        if (run->state[find_step(run, *deps)] != STEP_DONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the index of a step which can run on cpu and marks it running,
+// or -1 if no step is ready. cpu < 0 accepts steps for any CPU.
+static int take_ready_step(init_run_t* run, int cpu)
+{
+    for (size_t i = 0; i < run->count; ++i) {
+        const int step_cpu = run->steps[i].cpu;
+        if (run->state[i] == STEP_PENDING && deps_done(run, i) &&
+                (cpu < 0 || step_cpu == ESP_INIT_ANY_CPU || step_cpu == cpu)) {
+            run->state[i] = STEP_RUNNING;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Checks that all dependencies exist and that the steps can be ordered
+static esp_err_t validate(init_run_t* run)
+{
+    for (size_t i = 0; i < run->count; ++i) {
+        const char* const* deps = run->steps[i].deps;
+        for (; deps != NULL && *deps != NULL; ++deps) {
+            if (find_step(run, *deps) < 0) {
+                ESP_LOGE(TAG, "%s depends on unknown step %s", run->steps[i].name, *deps);
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+    }
+    for (size_t done = 0; done < run->count; ++done) {
+        int index = take_ready_step(run, -1);
+        if (index < 0) {
+            ESP_LOGE(TAG, "dependency cycle");
+            return ESP_ERR_INVALID_ARG;
+        }
+        run->state[index] = STEP_DONE;
+    }
+    memset(run->state, STEP_PENDING, run->count);
+    return ESP_OK;
+}
+
+static void run_step(init_run_t* run, size_t index)
+{
+    const esp_init_step_t* step = &run->steps[index];
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = (*step->func)();
+    ESP_LOGD(TAG, "%s: %d us on CPU %d", step->name,
+             (int) (esp_timer_get_time() - start), xPortGetCoreID());
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s failed, ret=%d", step->name, err);
+    }
+
+    portENTER_CRITICAL(&run->lock);
+    run->state[index] = STEP_DONE;
+    --run->remaining;
+    if (err != ESP_OK && run->result == ESP_OK) {
+        run->result = err;
+    }
+    portEXIT_CRITICAL(&run->lock);
+}
+
+// Runs steps until all are done. cpu < 0 when running alone.
+static void run_steps(init_run_t* run, int cpu)
+{
+    while (true) {
+        portENTER_CRITICAL(&run->lock);
+        int index = (run->remaining == 0) ? -1 : take_ready_step(run, cpu);
+        bool finished = (run->remaining == 0);
+        portEXIT_CRITICAL(&run->lock);
+
+        if (finished) {
+            return;
+        }
+        if (index < 0) {
+            // Wait for the other CPU to finish a step this one depends on
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        run_step(run, index);
+        // Steps may have become ready, or everything may be done
+        for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+            if (i != cpu && run->workers[i] != NULL) {
+                xTaskNotifyGive(run->workers[i]);
+            }
+        }
+    }
+}
+
+static void helper_task(void* arg)
+{
+    init_run_t* run = (init_run_t*) arg;
+    run_steps(run, xPortGetCoreID());
+    xSemaphoreGive(run->helper_done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_init_run(const esp_init_step_t* steps, size_t count)
+{
+    init_run_t run = {
+        .steps = steps,
+        .count = count,
+        .remaining = count,
+        .result = ESP_OK,
+    };
+    run.state = (uint8_t*) pvPortMalloc(count);
+    if (run.state == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(run.state, STEP_PENDING, count);
+    vPortCPUInitializeMutex(&run.lock);
+
+    esp_err_t err = validate(&run);
+    if (err != ESP_OK) {
+        vPortFree(run.state);
+        return err;
+    }
+
+    bool parallel = portNUM_PROCESSORS > 1 &&
+                    xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+    if (parallel) {
+        const int cpu = xPortGetCoreID();
+        const int other_cpu = (cpu == 0) ? 1 : 0;
+        // Registered before the helper exists, so that it can notify this task
+        run.workers[cpu] = xTaskGetCurrentTaskHandle();
+        run.helper_done = xSemaphoreCreateBinary();
+        if (run.helper_done != NULL &&
+                xTaskCreatePinnedToCore(helper_task, "init_helper", ESP_TASK_INIT_HELPER_STACK, &run,
+                                        uxTaskPriorityGet(NULL), &run.workers[other_cpu], other_cpu) == pdPASS) {
+            run_steps(&run, cpu);
+            xSemaphoreTake(run.helper_done, portMAX_DELAY);
+        } else {
+            ESP_LOGW(TAG, "can't start helper task, running steps on one CPU");
+            run.workers[cpu] = NULL;
+            parallel = false;
+        }
+        if (run.helper_done != NULL) {
+            vSemaphoreDelete(run.helper_done);
+        }
+    }
+    if (!parallel) {
+        // Steps pinned to another CPU run here as well: before the scheduler
+        // starts, everything runs on the PRO CPU.
+        run_steps(&run, -1);
+    }
+    vPortFree(run.state);
+    return run.result;
+}
@@ -0,0 +1,174 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <sys/reent.h>
+#include "esp_err.h"
+#include "esp_time.h"
+#include "esp_timer.h"
+#include "soc/soc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "freertos/FreeRTOS.h"
+
+#define ESP_TIME_MAGIC              0x454d4954  // "TIME"
+
+/* RTC timer frequency assumed until it is measured: the internal 150 kHz
+ * RC oscillator, in mHz */
+#define ESP_TIME_RTC_FREQ_DEFAULT   150000000
+/* Plausible range of measured frequencies, in mHz */
+#define ESP_TIME_RTC_FREQ_MIN       10000000
+#define ESP_TIME_RTC_FREQ_MAX       1000000000
+/* Measure the RTC timer frequency over at least this time */
+#define ESP_TIME_CAL_MIN_US         10000000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rtc_freq;          // RTC timer frequency, in mHz
+    uint64_t time_us;           // Time of day when the RTC timer was rtc_ticks
+    uint64_t rtc_ticks;
+    uint64_t sync_us;           // Time of day set by the last settimeofday()
+    uint32_t checksum;
+} esp_time_rtc_t;
+
+#define ESP_TIME_RTC    ((esp_time_rtc_t*) ESP_TIME_RTC_ADDR)
+
+static portMUX_TYPE s_time_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_time_set;             // Time set, by settimeofday or from RTC memory
+static int64_t s_boot_time_us;      // Time of day when esp_timer was 0
+static int64_t s_sync_us;           // Time of day set by the last settimeofday
+static uint32_t s_rtc_freq = ESP_TIME_RTC_FREQ_DEFAULT;
+static int64_t s_cal_start_us;      // esp_timer and RTC timer at the start of the
+static uint64_t s_cal_start_ticks;  // frequency measurement
+
+static uint64_t rtc_timer_read(void)
+{
+    SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+    while ((READ_PERI_REG(RTC_CNTL_TIME_UPDATE_REG) & RTC_CNTL_TIME_VALID) == 0) {
+        ;
+    }
+    return READ_PERI_REG(RTC_CNTL_TIME0_REG) |
+            ((uint64_t) (READ_PERI_REG(RTC_CNTL_TIME1_REG) & RTC_CNTL_TIME_HI) << 32);
+}
+
+/* ticks * 1e9 / freq overflows 64 bits after a few hours, so handle whole
+ * multiples of the frequency (kiloseconds) separately */
+static uint64_t rtc_ticks_to_us(uint64_t ticks, uint32_t freq)
+{
+    return (ticks / freq) * 1000000000ULL + (ticks % freq) * 1000000000ULL / freq;
+}
+
+static uint32_t esp_time_rtc_checksum(const esp_time_rtc_t* rec)
+{
+    const uint32_t* p = (const uint32_t*) rec;
+    const uint32_t* end = (const uint32_t*) &rec->checksum;
+    uint32_t sum = 0;
+    while (p < end) {
+        sum = ((sum << 5) | (sum >> 27)) ^ *p++;
+    }
+    return sum;
+}
+
+static int64_t esp_time_now_us(void)
+{
+    int64_t t;
+    portENTER_CRITICAL(&s_time_lock);
+    t = s_boot_time_us + esp_timer_get_time();
+    portEXIT_CRITICAL(&s_time_lock);
+    return t;
+}
+
+void esp_time_init(void)
+{
+    const esp_time_rtc_t* rec = ESP_TIME_RTC;
+
+    portENTER_CRITICAL(&s_time_lock);
+    s_cal_start_us = esp_timer_get_time();
+    s_cal_start_ticks = rtc_timer_read();
+    if (rec->magic == ESP_TIME_MAGIC && rec->checksum == esp_time_rtc_checksum(rec) &&
+            rec->rtc_freq >= ESP_TIME_RTC_FREQ_MIN && rec->rtc_freq <= ESP_TIME_RTC_FREQ_MAX &&
+            s_cal_start_ticks >= rec->rtc_ticks) {
+        // RTC timer kept running since the time was saved
+        s_rtc_freq = rec->rtc_freq;
+        s_boot_time_us = rec->time_us + rtc_ticks_to_us(s_cal_start_ticks - rec->rtc_ticks, s_rtc_freq)
+                - s_cal_start_us;
+        s_sync_us = rec->sync_us;
+        s_time_set = true;
+    }
+    portEXIT_CRITICAL(&s_time_lock);
+}
+
+void esp_time_save(void)
+{
+    esp_time_rtc_t rec;
+
+    portENTER_CRITICAL(&s_time_lock);
+    if (!s_time_set) {
+        portEXIT_CRITICAL(&s_time_lock);
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    uint64_t ticks = rtc_timer_read();
+    if (now - s_cal_start_us >= ESP_TIME_CAL_MIN_US) {
+        // Rarely done, and the range of the values is wide: double is fine
+        double freq = (double) (ticks - s_cal_start_ticks) * 1e9 / (double) (now - s_cal_start_us);
+        if (freq >= ESP_TIME_RTC_FREQ_MIN && freq <= ESP_TIME_RTC_FREQ_MAX) {
+            s_rtc_freq = (uint32_t) freq;
+        }
+    }
+    rec.magic = ESP_TIME_MAGIC;
+    rec.rtc_freq = s_rtc_freq;
+    rec.time_us = s_boot_time_us + now;
+    rec.rtc_ticks = ticks;
+    rec.sync_us = s_sync_us;
+    rec.checksum = esp_time_rtc_checksum(&rec);
+    *ESP_TIME_RTC = rec;
+    portEXIT_CRITICAL(&s_time_lock);
+}
+
+esp_err_t esp_time_get_sync_age(uint32_t* age_s)
+{
+    if (!s_time_set) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int64_t age = esp_time_now_us() - s_sync_us;
+    *age_s = (age > 0) ? (uint32_t) (age / 1000000) : 0;
+    return ESP_OK;
+}
+
+int _gettimeofday_r(struct _reent *r, struct timeval *tv, void *tz)
+{
+    if (tv) {
+        int64_t t = esp_time_now_us();
+        tv->tv_sec = t / 1000000;
+        tv->tv_usec = t % 1000000;
+    }
+    return 0;
+}
+
+int settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+    if (tv) {
+        int64_t t = (int64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+        portENTER_CRITICAL(&s_time_lock);
+        s_boot_time_us = t - esp_timer_get_time();
+        s_sync_us = t;
+        s_time_set = true;
+        portEXIT_CRITICAL(&s_time_lock);
+        esp_time_save();
+    }
+    return 0;
+}
@@ -0,0 +1,323 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/queue.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_timer_impl.h"
+#include "esp_task.h"
+#include "esp_intr_alloc.h"
+#include "heap_alloc_caps.h"
+#include "rom/ets_sys.h"
+#include "soc/soc.h"
+#include "soc/dport_reg.h"
+#include "soc/timer_group_struct.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+/* Counter runs at APB_CLK / ESP_TIMER_DIVIDER = 1 MHz */
+#define ESP_TIMER_DIVIDER       (APB_CLK_FREQ / 1000000)
+/* An alarm closer than this to the current time may be missed by the
+ * hardware, so it is moved this far into the future instead */
+#define ESP_TIMER_MIN_LEAD_US   2
+
+struct esp_timer {
+    int64_t alarm;                          // Time of the next expiry
+    uint64_t period;                        // 0 for one-shot timers
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool armed;                             // Linked into s_timers
+    bool pending;                           // Linked into s_pending, waiting for the esp_timer task
+    LIST_ENTRY(esp_timer) list_entry;
+    STAILQ_ENTRY(esp_timer) pending_entry;
+};
+
+static LIST_HEAD(esp_timer_list, esp_timer) s_timers =
+        LIST_HEAD_INITIALIZER(s_timers);             // Armed timers, sorted by alarm
+static STAILQ_HEAD(esp_timer_pending, esp_timer) s_pending =
+        STAILQ_HEAD_INITIALIZER(s_pending);          // Task dispatched timers which have expired
+static portMUX_TYPE s_timer_lock = portMUX_INITIALIZER_UNLOCKED;   // Protects the lists and the alarm
+static portMUX_TYPE s_counter_lock = portMUX_INITIALIZER_UNLOCKED; // Serializes counter latch and read
+static TaskHandle_t s_timer_task;
+
+int64_t IRAM_ATTR esp_timer_get_time(void)
+{
+    // Latching the counter and reading both halves must not be interleaved
+    // with a latch from the other CPU or from an interrupt on this one.
+    unsigned state = portENTER_CRITICAL_NESTED();
+    portENTER_CRITICAL_ISR(&s_counter_lock);
+    TIMERG0.hw_timer[0].update = 1;
+    uint32_t lo = TIMERG0.hw_timer[0].cnt_low;
+    uint32_t hi = TIMERG0.hw_timer[0].cnt_high;
+    portEXIT_CRITICAL_ISR(&s_counter_lock);
+    portEXIT_CRITICAL_NESTED(state);
+    return ((int64_t) hi << 32) | lo;
+}
+
+// Program the hardware alarm for the first armed timer. Called with s_timer_lock held.
+static void IRAM_ATTR timer_set_alarm()
+{
+    struct esp_timer* first = LIST_FIRST(&s_timers);
+    if (first == NULL) {
+        TIMERG0.hw_timer[0].config.alarm_en = 0;
+        return;
+    }
+    int64_t alarm = first->alarm;
+    int64_t earliest = esp_timer_get_time() + ESP_TIMER_MIN_LEAD_US;
+    if (alarm < earliest) {
+        alarm = earliest;
+    }
+    TIMERG0.hw_timer[0].alarm_high = (uint32_t) (alarm >> 32);
+    TIMERG0.hw_timer[0].alarm_low = (uint32_t) alarm;
+    TIMERG0.hw_timer[0].config.alarm_en = 1;
+}
+
+void esp_timer_impl_advance(int64_t time_us)
+{
+    portENTER_CRITICAL(&s_timer_lock);
+    portENTER_CRITICAL_ISR(&s_counter_lock);
+    TIMERG0.hw_timer[0].update = 1;
+    uint64_t now = ((uint64_t) TIMERG0.hw_timer[0].cnt_high << 32) | TIMERG0.hw_timer[0].cnt_low;
+    now += time_us;
+    TIMERG0.hw_timer[0].load_high = (uint32_t) (now >> 32);
+    TIMERG0.hw_timer[0].load_low = (uint32_t) now;
+    TIMERG0.hw_timer[0].reload = 1;
+    portEXIT_CRITICAL_ISR(&s_counter_lock);
+    // The alarm may have been passed, timer_set_alarm moves it right ahead
+    timer_set_alarm();
+    portEXIT_CRITICAL(&s_timer_lock);
+}
+
+// Insert into s_timers, keeping it sorted. Called with s_timer_lock held.
+static void IRAM_ATTR timer_insert(struct esp_timer* timer)
+{
+    struct esp_timer* it;
+    struct esp_timer* last = NULL;
+    LIST_FOREACH(it, &s_timers, list_entry) {
+        if (timer->alarm < it->alarm) {
+            break;
+        }
+        last = it;
+    }
+    if (last == NULL) {
+        LIST_INSERT_HEAD(&s_timers, timer, list_entry);
+        timer_set_alarm();
+    } else {
+        LIST_INSERT_AFTER(last, timer, list_entry);
+    }
+    timer->armed = true;
+}
+
+// Take a timer out of both lists. Called with s_timer_lock held.
+static void IRAM_ATTR timer_remove(struct esp_timer* timer)
+{
+    if (timer->armed) {
+        bool was_first = (LIST_FIRST(&s_timers) == timer);
+        LIST_REMOVE(timer, list_entry);
+        timer->armed = false;
+        if (was_first) {
+            timer_set_alarm();
+        }
+    }
+    if (timer->pending) {
+        STAILQ_REMOVE(&s_pending, timer, esp_timer, pending_entry);
+        timer->pending = false;
+    }
+}
+
+static void IRAM_ATTR timer_alarm_isr(void* arg)
+{
+    bool notify = false;
+    portENTER_CRITICAL_ISR(&s_timer_lock);
+    TIMERG0.int_clr_timers.t0 = 1;
+    for (;;) {
+        struct esp_timer* timer = LIST_FIRST(&s_timers);
+        int64_t now = esp_timer_get_time();
+        if (timer == NULL || timer->alarm > now) {
+            break;
+        }
+        LIST_REMOVE(timer, list_entry);
+        timer->armed = false;
+        if (timer->period > 0) {
+            timer->alarm += timer->period;
+            if (timer->alarm <= now) {
+                // Fell more than a period behind, don't try to catch up
+                timer->alarm = now + timer->period;
+            }
+            timer_insert(timer);
+        }
+        if (timer->dispatch_method == ESP_TIMER_ISR) {
+            esp_timer_cb_t callback = timer->callback;
+            void* cb_arg = timer->arg;
+            // The callback may start or stop timers, so release the lock
+            // and look at the list again afterwards.
+            portEXIT_CRITICAL_ISR(&s_timer_lock);
+            (*callback)(cb_arg);
+            portENTER_CRITICAL_ISR(&s_timer_lock);
+        } else if (!timer->pending) {
+            STAILQ_INSERT_TAIL(&s_pending, timer, pending_entry);
+            timer->pending = true;
+            notify = true;
+        }
+    }
+    timer_set_alarm();
+    portEXIT_CRITICAL_ISR(&s_timer_lock);
+
+    if (notify) {
+        BaseType_t task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_timer_task, &task_woken);
+        if (task_woken == pdTRUE) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+static void timer_task(void* arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (true) {
+            portENTER_CRITICAL(&s_timer_lock);
+            struct esp_timer* timer = STAILQ_FIRST(&s_pending);
+            if (timer == NULL) {
+                portEXIT_CRITICAL(&s_timer_lock);
+                break;
+            }
+            STAILQ_REMOVE_HEAD(&s_pending, pending_entry);
+            timer->pending = false;
+            // Copy the callback while the lock is held: once it is released
+            // the timer may be deleted.
+            esp_timer_cb_t callback = timer->callback;
+            void* cb_arg = timer->arg;
+            portEXIT_CRITICAL(&s_timer_lock);
+            (*callback)(cb_arg);
+        }
+    }
+}
+
+esp_err_t esp_timer_init(void)
+{
+    if (s_timer_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreatePinnedToCore(timer_task, "esp_timer", ESP_TASKD_ESP_TIMER_STACK, NULL,
+                                ESP_TASKD_ESP_TIMER_PRIO, &s_timer_task, ESP_TASK_PROTOCOL_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_TIMERGROUP_CLK_EN);
+    CLEAR_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_TIMERGROUP_RST);
+
+    TIMERG0.hw_timer[0].config.enable = 0;
+    TIMERG0.hw_timer[0].config.divider = ESP_TIMER_DIVIDER;
+    TIMERG0.hw_timer[0].config.increase = 1;
+    TIMERG0.hw_timer[0].config.autoreload = 0;
+    TIMERG0.hw_timer[0].config.alarm_en = 0;
+    TIMERG0.hw_timer[0].config.edge_int_en = 0;
+    TIMERG0.hw_timer[0].config.level_int_en = 1;
+    TIMERG0.hw_timer[0].load_high = 0;
+    TIMERG0.hw_timer[0].load_low = 0;
+    TIMERG0.hw_timer[0].reload = 1;
+    TIMERG0.int_clr_timers.t0 = 1;
+    TIMERG0.int_ena.t0 = 1;
+    TIMERG0.hw_timer[0].config.enable = 1;
+
+    // The alarm interrupt only runs IRAM code: ISR callbacks are required to be in IRAM
+    return esp_intr_alloc_pinned_to_core(ETS_TG0_T0_LEVEL_INTR_SOURCE,
+            ESP_INTR_FLAG_LEVEL1 | ESP_INTR_FLAG_IRAM, &timer_alarm_isr, NULL, 0, NULL);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle)
+{
+    if (args == NULL || args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // The timer is accessed from the alarm interrupt, keep it in internal RAM
+    struct esp_timer* timer = pvPortMallocCaps(sizeof(*timer), MALLOC_CAP_8BIT | MALLOC_CAP_DMA);
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(timer, 0, sizeof(*timer));
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->dispatch_method = args->dispatch_method;
+    timer->name = args->name;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_timer_lock);
+    if (timer->armed) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->alarm = esp_timer_get_time() + timeout_us;
+        timer->period = period_us;
+        timer_insert(timer);
+    }
+    portEXIT_CRITICAL(&s_timer_lock);
+    return err;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (period_us == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_timer_lock);
+    if (!timer->armed && !timer->pending) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        timer_remove(timer);
+    }
+    portEXIT_CRITICAL(&s_timer_lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_timer_lock);
+    timer_remove(timer);
+    portEXIT_CRITICAL(&s_timer_lock);
+    vPortFree(timer);
+    return ESP_OK;
+}
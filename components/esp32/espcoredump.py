@@ -0,0 +1,236 @@
+#!/usr/bin/env python
+#
+# Reads a core dump written to flash by the panic handler (see
+# esp_core_dump.h), as uploaded by the app or read from the "coredump"
+# partition with esptool.py read_flash.
+#
+#   espcoredump.py info dump.bin            prints the registers and tasks
+#   espcoredump.py elf dump.bin core.elf    writes an ELF core file, for
+#                                           xtensa-esp32-elf-gdb app.elf core.elf
+#
+# In gdb, each task is a thread ("info threads", "thread N", "bt"). The task
+# which panicked has the registers of the exception frame. Tasks switched
+# out by an interrupt have all their registers, tasks which blocked or
+# yielded only pc, ps and a0-a3.
+import argparse
+import struct
+import sys
+import zlib
+
+__version__ = '1.0'
+
+CORE_DUMP_MAGIC = 0xe5c0d0e1
+CORE_DUMP_VERSION = 1
+HEADER_FORMAT = '<8I'
+TASK_FORMAT = '<3I'
+
+# XtExcFrame and XtSolFrame in xtensa_context.h, word indexes
+XT_STK_EXIT = 0
+XT_STK_PC = 1
+XT_STK_PS = 2
+XT_STK_A0 = 3
+XT_STK_SAR = 19
+XT_STK_EXCCAUSE = 20
+XT_STK_EXCVADDR = 21
+XT_STK_LBEG = 22
+XT_STK_LEND = 23
+XT_STK_LCOUNT = 24
+XT_SOL_PC = 1
+XT_SOL_PS = 2
+XT_SOL_A0 = 4
+
+# TCB_t in tasks.c: pxTopOfStack, two ListItem_t, uxPriority, pxStack, pcTaskName
+TCB_PRIORITY_OFFSET = 44
+TCB_NAME_OFFSET = 52
+TCB_NAME_LEN = 16
+
+# xtensa_elf_gregset_t in gdb's xtensa-tdep.h, word indexes
+REG_PC = 0
+REG_PS = 1
+REG_LBEG = 2
+REG_LEND = 3
+REG_LCOUNT = 4
+REG_SAR = 5
+REG_WINDOWSTART = 6
+REG_WINDOWBASE = 7
+REG_AR = 64
+REG_COUNT = 128
+
+EXCCAUSES = [
+    'IllegalInstruction', 'Syscall', 'InstructionFetchError', 'LoadStoreError',
+    'Level1Interrupt', 'Alloca', 'IntegerDivideByZero', 'PCValue',
+    'Privileged', 'LoadStoreAlignment', 'res', 'res',
+    'InstrPDAddrError', 'LoadStorePIFDataError', 'InstrPIFAddrError', 'LoadStorePIFAddrError',
+    'InstTLBMiss', 'InstTLBMultiHit', 'InstFetchPrivilege', 'res',
+    'InstrFetchProhibited', 'res', 'res', 'res',
+    'LoadStoreTLBMiss', 'LoadStoreTLBMultihit', 'LoadStorePrivilege', 'res',
+    'LoadProhibited', 'StoreProhibited', 'res', 'res',
+]
+
+
+class CoreDumpError(Exception):
+    pass
+
+
+class Task(object):
+    def __init__(self, tcb_addr, tcb, stack_start, stack):
+        self.tcb_addr = tcb_addr
+        self.tcb = tcb
+        self.stack_start = stack_start
+        self.stack = stack
+        self.name = tcb[TCB_NAME_OFFSET:TCB_NAME_OFFSET + TCB_NAME_LEN].split(b'\0')[0].decode('ascii', 'replace')
+        self.priority = struct.unpack_from('<I', tcb, TCB_PRIORITY_OFFSET)[0]
+        self.regs = None    # gdb register set, set by CoreDump
+
+
+class CoreDump(object):
+    def __init__(self, data):
+        if len(data) < struct.calcsize(HEADER_FORMAT):
+            raise CoreDumpError('Too short for a core dump')
+        (magic, version, length, task_count, tcb_size, self.crashed_task, self.crashed_cpu,
+         frame_size) = struct.unpack_from(HEADER_FORMAT, data)
+        if magic != CORE_DUMP_MAGIC:
+            raise CoreDumpError('No core dump (magic 0x%08x)' % magic)
+        if version != CORE_DUMP_VERSION:
+            raise CoreDumpError('Unsupported core dump version %d' % version)
+        if length > len(data):
+            raise CoreDumpError('Core dump of %d bytes, only %d given' % (length, len(data)))
+        crc = struct.unpack_from('<I', data, length - 4)[0]
+        if zlib.crc32(data[4:length - 4]) & 0xffffffff != crc:
+            raise CoreDumpError('Core dump CRC mismatch')
+
+        pos = struct.calcsize(HEADER_FORMAT)
+        self.frame = struct.unpack_from('<%dI' % (frame_size // 4), data, pos)
+        pos += frame_size
+        self.tasks = []
+        for _ in range(task_count):
+            tcb_addr, stack_start, stack_end = struct.unpack_from(TASK_FORMAT, data, pos)
+            pos += struct.calcsize(TASK_FORMAT)
+            tcb = data[pos:pos + tcb_size]
+            pos += tcb_size
+            stack = data[pos:pos + stack_end - stack_start]
+            pos += stack_end - stack_start
+            task = Task(tcb_addr, tcb, stack_start, stack)
+            task.regs = self._task_regs(task)
+            self.tasks.append(task)
+
+    def _task_regs(self, task):
+        regs = [0] * REG_COUNT
+        if task.tcb_addr == self.crashed_task:
+            frame = self.frame
+        elif len(task.stack) >= 16:
+            frame = struct.unpack_from('<%dI' % min(len(task.stack) // 4, XT_STK_LCOUNT + 1), task.stack)
+        else:
+            return regs
+        regs[REG_WINDOWSTART] = 1
+        regs[REG_WINDOWBASE] = 0
+        if frame[XT_STK_EXIT] != 0 and len(frame) > XT_STK_LCOUNT:
+            # Interrupt or exception frame: all registers
+            regs[REG_PC] = frame[XT_STK_PC]
+            regs[REG_PS] = frame[XT_STK_PS]
+            regs[REG_SAR] = frame[XT_STK_SAR]
+            regs[REG_LBEG] = frame[XT_STK_LBEG]
+            regs[REG_LEND] = frame[XT_STK_LEND]
+            regs[REG_LCOUNT] = frame[XT_STK_LCOUNT]
+            for i in range(16):
+                regs[REG_AR + i] = frame[XT_STK_A0 + i]
+        else:
+            # Solicited frame: the task yielded, pc is a return address
+            regs[REG_PC] = (frame[XT_SOL_PC] & 0x3fffffff) | 0x40000000
+            regs[REG_PS] = frame[XT_SOL_PS]
+            for i in range(4):
+                regs[REG_AR + i] = frame[XT_SOL_A0 + i]
+        return regs
+
+
+def print_info(dump):
+    crashed = [t for t in dump.tasks if t.tcb_addr == dump.crashed_task]
+    print('Panic on CPU %d in task %s' % (dump.crashed_cpu,
+                                          crashed[0].name if crashed else '0x%08x' % dump.crashed_task))
+    frame = dump.frame
+    cause = frame[XT_STK_EXCCAUSE]
+    print('EXCCAUSE %d (%s), EXCVADDR 0x%08x' % (cause, EXCCAUSES[cause] if cause < len(EXCCAUSES) else 'Unknown',
+                                                 frame[XT_STK_EXCVADDR]))
+    print('PC 0x%08x  PS 0x%08x  SAR 0x%08x' % (frame[XT_STK_PC], frame[XT_STK_PS], frame[XT_STK_SAR]))
+    for i in range(0, 16, 4):
+        print('  '.join('A%-2d 0x%08x' % (i + j, frame[XT_STK_A0 + i + j]) for j in range(4)))
+    print('\n%-10s %-16s %4s %-10s %6s %s' % ('TCB', 'Name', 'Prio', 'Stack', 'Bytes', 'PC'))
+    for task in dump.tasks:
+        print('0x%08x %-16s %4d 0x%08x %6d 0x%08x%s' % (task.tcb_addr, task.name, task.priority, task.stack_start,
+                                                         len(task.stack), task.regs[REG_PC],
+                                                         ' (crashed)' if task.tcb_addr == dump.crashed_task else ''))
+
+
+def note(name, note_type, desc):
+    name = name.encode() + b'\0'
+    pad = lambda b: b + b'\0' * (-len(b) % 4)
+    return struct.pack('<3I', len(name), len(desc), note_type) + pad(name) + pad(desc)
+
+
+def write_elf(dump, output):
+    NT_PRSTATUS = 1
+    notes = b''
+    # The crashed task first, so that it is the current thread in gdb
+    tasks = sorted(dump.tasks, key=lambda t: t.tcb_addr != dump.crashed_task)
+    for task in tasks:
+        # elf_prstatus: 72 bytes up to pr_reg, pr_pid at offset 24, pr_fpvalid after pr_reg
+        prstatus = bytearray(72)
+        struct.pack_into('<I', prstatus, 24, task.tcb_addr)
+        if task.tcb_addr == dump.crashed_task:
+            struct.pack_into('<H', prstatus, 12, 11)    # SIGSEGV
+        notes += note('CORE', NT_PRSTATUS, bytes(prstatus) + struct.pack('<%dI' % REG_COUNT, *task.regs) +
+                      struct.pack('<I', 0))
+
+    segments = []
+    for task in dump.tasks:
+        segments.append((task.tcb_addr, task.tcb))
+        if task.stack:
+            segments.append((task.stack_start, task.stack))
+
+    PT_LOAD = 1
+    PT_NOTE = 4
+    phnum = 1 + len(segments)
+    offset = 52 + 32 * phnum
+    headers = [struct.pack('<8I', PT_NOTE, offset, 0, 0, len(notes), 0, 0, 4)]
+    offset += len(notes)
+    for addr, data in segments:
+        headers.append(struct.pack('<8I', PT_LOAD, offset, addr, addr, len(data), len(data), 6, 4))
+        offset += len(data)
+
+    EM_XTENSA = 94
+    ET_CORE = 4
+    ident = b'\x7fELF' + bytes(bytearray([1, 1, 1, 0])) + b'\0' * 8
+    elf_header = ident + struct.pack('<2H5I6H', ET_CORE, EM_XTENSA, 1, 0, 52, 0, 0, 52, 32, phnum, 40, 0, 0)
+    output.write(elf_header)
+    for header in headers:
+        output.write(header)
+    output.write(notes)
+    for _, data in segments:
+        output.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='espcoredump.py v%s - read ESP32 core dumps' % __version__)
+    subparsers = parser.add_subparsers(dest='command')
+    info = subparsers.add_parser('info', help='print the registers and tasks of a dump')
+    info.add_argument('dump', type=argparse.FileType('rb'), help='core dump')
+    elf = subparsers.add_parser('elf', help='convert a dump to an ELF core file for gdb')
+    elf.add_argument('dump', type=argparse.FileType('rb'), help='core dump')
+    elf.add_argument('output', type=argparse.FileType('wb'), help='ELF core file')
+    args = parser.parse_args()
+    if args.command is None:
+        parser.print_help()
+        sys.exit(1)
+
+    try:
+        dump = CoreDump(args.dump.read())
+    except CoreDumpError as e:
+        sys.exit(str(e))
+    if args.command == 'info':
+        print_info(dump)
+    else:
+        write_elf(dump, args.output)
+
+
+if __name__ == '__main__':
+    main()
@@ -20,22 +20,80 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_task.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_wifi_fast_connect.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "freertos/portmacro.h"
 
 #include "tcpip_adapter.h"
 
 #define ESP32_WORKAROUND 1
 
+ESP_EVENT_DEFINE_BASE(SYSTEM_EVENT);
+
 #if CONFIG_WIFI_ENABLED
 static bool event_init_flag = false;
 static xQueueHandle g_event_handler = NULL;
 
+/* The event queue and task live as long as the application, keep them out of the heap. */
+static StaticQueue_t s_event_queue_buf;
+static uint8_t s_event_queue_storage[CONFIG_SYSTEM_EVENT_QUEUE_SIZE * sizeof(system_event_t)];
+static StaticTask_t s_event_task_buf;
+static StackType_t s_event_task_stack[ESP_TASKD_EVENT_STACK];
+
+/* esp_event_send copies each event once, into a slot of this pool, and queues a pointer to the slot. A slot is
+   free again once the event task and every esp_event_retain caller have released it. Bit n of s_event_pool_free
+   is set while slot n is free. Refs and free bits are protected by s_event_lock. */
+#define EVENT_POOL_ALL_FREE ((uint32_t)((1ULL << CONFIG_SYSTEM_EVENT_POOL_SIZE) - 1))
+static system_event_t s_event_pool[CONFIG_SYSTEM_EVENT_POOL_SIZE];
+static uint8_t s_event_pool_refs[CONFIG_SYSTEM_EVENT_POOL_SIZE];
+static uint32_t s_event_pool_free = EVENT_POOL_ALL_FREE;
+
+/* Pool slots queued by esp_event_send. Holds every slot, so it never fills up. */
+static xQueueHandle s_event_pool_queue = NULL;
+static StaticQueue_t s_event_pool_queue_buf;
+static uint8_t s_event_pool_queue_storage[CONFIG_SYSTEM_EVENT_POOL_SIZE * sizeof(system_event_t *)];
+
+/* Pool slots of events with ESP_EVENT_POLICY_PRIORITY are queued here, and handled first */
+static xQueueHandle s_event_prio_queue = NULL;
+static StaticQueue_t s_event_prio_queue_buf;
+static uint8_t s_event_prio_queue_storage[CONFIG_SYSTEM_EVENT_PRIO_QUEUE_SIZE * sizeof(system_event_t *)];
+static QueueSetHandle_t s_event_queue_set = NULL;
+
+static uint8_t s_event_policy[SYSTEM_EVENT_MAX] = {
+    [SYSTEM_EVENT_SCAN_DONE]           = ESP_EVENT_POLICY_COALESCE,
+    [SYSTEM_EVENT_STA_START]           = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_STA_STOP]            = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_STA_CONNECTED]       = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_STA_DISCONNECTED]    = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_STA_AUTHMODE_CHANGE] = ESP_EVENT_POLICY_COALESCE,
+    [SYSTEM_EVENT_STA_GOT_IP]          = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_AP_START]            = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_AP_STOP]             = ESP_EVENT_POLICY_PRIORITY,
+    [SYSTEM_EVENT_AP_PROBEREQRECVED]   = ESP_EVENT_POLICY_COALESCE,
+};
+
+/* Queued pool slot of each coalesced ID, valid while its bit in s_event_coalesce_pending is set. Newer events
+   of the ID are copied into it until the event task takes it. */
+static system_event_t *s_event_coalesced[SYSTEM_EVENT_MAX];
+static uint32_t s_event_coalesce_pending;
+static portMUX_TYPE s_event_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_event_stats_t s_event_stats;
+
+/* All protected by s_event_lock. s_event_sent holds the esp_event_send time of the oldest queued event of each
+   ID, the event task moves it to s_event_timing */
+static int64_t s_event_sent[SYSTEM_EVENT_MAX];
+static esp_event_timing_t s_event_timing[SYSTEM_EVENT_MAX];
+static esp_event_connect_timeline_t s_connect_timeline;
+
 static system_event_cb_t g_event_handler_cb;
 static void *g_event_ctx;
+static esp_event_loop_handle_t s_system_loop = NULL;
 
 #define WIFI_DEBUG(...)
 #define WIFI_API_CALL_CHECK(info, api_call, ret) \
@@ -54,6 +112,9 @@ typedef struct {
     system_event_handle_fn_t event_handle;
 } system_event_handle_t;
 
+/* Held from the start to the stop event of each interface, WiFi needs the
+ * CPU at full speed while it is started */
+static esp_pm_lock_t s_wifi_pm_lock = ESP_PM_LOCK_INITIALIZER(ESP_PM_CPU_FREQ_MAX, "wifi");
 
 static esp_err_t system_event_ap_start_handle_default(system_event_t *event);
 static esp_err_t system_event_ap_stop_handle_default(system_event_t *event);
@@ -80,6 +141,16 @@ static system_event_handle_t g_system_event_handle_table[] = {
     {SYSTEM_EVENT_MAX,                 NULL},
 };
 
+/* Record that the current connection reached phase, once per connection */
+static void esp_event_connect_mark(esp_event_connect_phase_t phase, int64_t now)
+{
+    portENTER_CRITICAL(&s_event_lock);
+    if (s_connect_timeline.time[ESP_EVENT_CONNECT_START] != 0 && s_connect_timeline.time[phase] == 0) {
+        s_connect_timeline.time[phase] = now;
+    }
+    portEXIT_CRITICAL(&s_event_lock);
+}
+
 static esp_err_t system_event_sta_got_ip_default(system_event_t *event)
 {
     extern esp_err_t esp_wifi_set_sta_ip(void);
@@ -98,6 +169,8 @@ esp_err_t system_event_ap_start_handle_default(system_event_t *event)
     tcpip_adapter_ip_info_t ap_ip;
     uint8_t ap_mac[6];
 
+    esp_pm_lock_acquire(&s_wifi_pm_lock);
+
     WIFI_API_CALL_CHECK("esp_wifi_reg_rxcb", esp_wifi_reg_rxcb(WIFI_IF_AP, (wifi_rxcb_t)tcpip_adapter_ap_input), ESP_OK);
     WIFI_API_CALL_CHECK("esp_wifi_mac_get",  esp_wifi_get_mac(WIFI_IF_AP, ap_mac), ESP_OK);
 
@@ -112,6 +185,7 @@ esp_err_t system_event_ap_stop_handle_default(system_event_t *event)
     WIFI_API_CALL_CHECK("esp_wifi_reg_rxcb", esp_wifi_reg_rxcb(WIFI_IF_AP, NULL), ESP_OK);
 
     tcpip_adapter_stop(TCPIP_ADAPTER_IF_AP);
+    esp_pm_lock_release(&s_wifi_pm_lock);
 
     return ESP_OK;
 }
@@ -121,6 +195,8 @@ esp_err_t system_event_sta_start_handle_default(system_event_t *event)
     tcpip_adapter_ip_info_t sta_ip;
     uint8_t sta_mac[6];
 
+    esp_pm_lock_acquire(&s_wifi_pm_lock);
+
     WIFI_API_CALL_CHECK("esp_wifi_mac_get",  esp_wifi_get_mac(WIFI_IF_STA, sta_mac), ESP_OK);
     tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &sta_ip);
     tcpip_adapter_start(TCPIP_ADAPTER_IF_STA, sta_mac, &sta_ip);
@@ -131,6 +207,7 @@ esp_err_t system_event_sta_start_handle_default(system_event_t *event)
 esp_err_t system_event_sta_stop_handle_default(system_event_t *event)
 {
     tcpip_adapter_stop(TCPIP_ADAPTER_IF_STA);
+    esp_pm_lock_release(&s_wifi_pm_lock);
 
     return ESP_OK;
 }
@@ -142,10 +219,14 @@ esp_err_t system_event_sta_connected_handle_default(system_event_t *event)
     WIFI_API_CALL_CHECK("esp_wifi_reg_rxcb", esp_wifi_reg_rxcb(WIFI_IF_STA, (wifi_rxcb_t)tcpip_adapter_sta_input), ESP_OK);
 
     tcpip_adapter_up(TCPIP_ADAPTER_IF_STA);
+#if CONFIG_WIFI_FAST_CONNECT
+    esp_wifi_fast_connect_connected(&event->event_info.connected);
+#endif
 
     tcpip_adapter_dhcpc_get_status(TCPIP_ADAPTER_IF_STA, &status);
 
     if (status == TCPIP_ADAPTER_DHCP_INIT) {
+        esp_event_connect_mark(ESP_EVENT_CONNECT_DHCP_START, esp_timer_get_time());
         tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
     } else if (status == TCPIP_ADAPTER_DHCP_STOPPED) {
         tcpip_adapter_ip_info_t sta_ip;
@@ -172,6 +253,11 @@ esp_err_t system_event_sta_disconnected_handle_default(system_event_t *event)
 {
     tcpip_adapter_down(TCPIP_ADAPTER_IF_STA);
     WIFI_API_CALL_CHECK("esp_wifi_reg_rxcb", esp_wifi_reg_rxcb(WIFI_IF_STA, NULL), ESP_OK);
+#if CONFIG_WIFI_FAST_CONNECT
+    esp_wifi_fast_connect_disconnected();
+#endif
+    /* Applications connect again from this event */
+    esp_event_connect_timeline_start();
     return ESP_OK;
 }
 
@@ -184,6 +270,22 @@ static esp_err_t esp_wifi_post_event_to_user(system_event_t *event)
     return ESP_OK;
 }
 
+static const char* const s_system_event_names[SYSTEM_EVENT_MAX] = {
+    [SYSTEM_EVENT_WIFI_READY]          = "SYSTEM_EVENT_WIFI_READY",
+    [SYSTEM_EVENT_SCAN_DONE]           = "SYSTEM_EVENT_SCAN_DONE",
+    [SYSTEM_EVENT_STA_START]           = "SYSTEM_EVENT_STA_START",
+    [SYSTEM_EVENT_STA_STOP]            = "SYSTEM_EVENT_STA_STOP",
+    [SYSTEM_EVENT_STA_CONNECTED]       = "SYSTEM_EVENT_STA_CONNECTED",
+    [SYSTEM_EVENT_STA_DISCONNECTED]    = "SYSTEM_EVENT_STA_DISCONNECTED",
+    [SYSTEM_EVENT_STA_AUTHMODE_CHANGE] = "SYSTEM_EVENT_STA_AUTHMODE_CHANGE",
+    [SYSTEM_EVENT_STA_GOT_IP]          = "SYSTEM_EVENT_STA_GOT_IP",
+    [SYSTEM_EVENT_AP_START]            = "SYSTEM_EVENT_AP_START",
+    [SYSTEM_EVENT_AP_STOP]             = "SYSTEM_EVENT_AP_STOP",
+    [SYSTEM_EVENT_AP_STACONNECTED]     = "SYSTEM_EVENT_AP_STACONNECTED",
+    [SYSTEM_EVENT_AP_STADISCONNECTED]  = "SYSTEM_EVENT_AP_STADISCONNECTED",
+    [SYSTEM_EVENT_AP_PROBEREQRECVED]   = "SYSTEM_EVENT_AP_PROBEREQRECVED",
+};
+
 static esp_err_t esp_system_event_debug(system_event_t *event)
 {
     if (event == NULL) {
@@ -191,91 +293,11 @@ static esp_err_t esp_system_event_debug(system_event_t *event)
         return ESP_FAIL;
     }
 
-    WIFI_DEBUG("received event: ");
-    switch (event->event_id) {
-    case SYSTEM_EVENT_WIFI_READY: {
-        WIFI_DEBUG("SYSTEM_EVENT_WIFI_READY\n");
-        break;
-    }
-    case SYSTEM_EVENT_SCAN_DONE: {
-        system_event_sta_scan_done_t *scan_done;
-        scan_done = &event->event_info.scan_done;
-        WIFI_DEBUG("SYSTEM_EVENT_SCAN_DONE\nstatus:%d, number:%d\n",  scan_done->status, scan_done->number);
-        break;
-    }
-    case SYSTEM_EVENT_STA_START: {
-        WIFI_DEBUG("SYSTEM_EVENT_STA_START\n");
-        break;
-    }
-    case SYSTEM_EVENT_STA_STOP: {
-        WIFI_DEBUG("SYSTEM_EVENT_STA_STOP\n");
-        break;
-    }
-    case SYSTEM_EVENT_STA_CONNECTED: {
-        system_event_sta_connected_t *connected;
-        connected = &event->event_info.connected;
-        WIFI_DEBUG("SYSTEM_EVENT_STA_CONNECTED\nssid:%s, ssid_len:%d, bssid:%02x:%02x:%02x:%02x:%02x:%02x, channel:%d, authmode:%d\n", \
-                   connected->ssid, connected->ssid_len, connected->bssid[0], connected->bssid[0], connected->bssid[1], \
-                   connected->bssid[3], connected->bssid[4], connected->bssid[5], connected->channel, connected->authmode);
-        break;
-    }
-    case SYSTEM_EVENT_STA_DISCONNECTED: {
-        system_event_sta_disconnected_t *disconnected;
-        disconnected = &event->event_info.disconnected;
-        WIFI_DEBUG("SYSTEM_EVENT_STA_DISCONNECTED\nssid:%s, ssid_len:%d, bssid:%02x:%02x:%02x:%02x:%02x:%02x, reason:%d\n", \
-                   disconnected->ssid, disconnected->ssid_len, disconnected->bssid[0], disconnected->bssid[0], disconnected->bssid[1], \
-                   disconnected->bssid[3], disconnected->bssid[4], disconnected->bssid[5], disconnected->reason);
-        break;
-    }
-    case SYSTEM_EVENT_STA_AUTHMODE_CHANGE: {
-        system_event_sta_authmode_change_t *auth_change;
-        auth_change = &event->event_info.auth_change;
-        WIFI_DEBUG("SYSTEM_EVENT_STA_AUTHMODE_CHNAGE\nold_mode:%d, new_mode:%d\n", auth_change->old_mode, auth_change->new_mode);
-        break;
-    }
-    case SYSTEM_EVENT_STA_GOT_IP: {
-        system_event_sta_got_ip_t *got_ip;
-        got_ip = &event->event_info.got_ip;
-        WIFI_DEBUG("SYSTEM_EVENT_STA_GOTIP\n");
-        break;
-    }
-    case SYSTEM_EVENT_AP_START: {
-        WIFI_DEBUG("SYSTEM_EVENT_AP_START\n");
-        break;
-    }
-    case SYSTEM_EVENT_AP_STOP: {
-        WIFI_DEBUG("SYSTEM_EVENT_AP_STOP\n");
-        break;
-    }
-    case SYSTEM_EVENT_AP_STACONNECTED: {
-        system_event_ap_staconnected_t *staconnected;
-        staconnected = &event->event_info.sta_connected;
-        WIFI_DEBUG("SYSTEM_EVENT_AP_STACONNECTED\nmac:%02x:%02x:%02x:%02x:%02x:%02x, aid:%d\n", \
-                   staconnected->mac[0], staconnected->mac[0], staconnected->mac[1], \
-                   staconnected->mac[3], staconnected->mac[4], staconnected->mac[5], staconnected->aid);
-        break;
-    }
-    case SYSTEM_EVENT_AP_STADISCONNECTED: {
-        system_event_ap_stadisconnected_t *stadisconnected;
-        stadisconnected = &event->event_info.sta_disconnected;
-        WIFI_DEBUG("SYSTEM_EVENT_AP_STADISCONNECTED\nmac:%02x:%02x:%02x:%02x:%02x:%02x, aid:%d\n", \
-                   stadisconnected->mac[0], stadisconnected->mac[0], stadisconnected->mac[1], \
-                   stadisconnected->mac[3], stadisconnected->mac[4], stadisconnected->mac[5], stadisconnected->aid);
-        break;
-    }
-    case SYSTEM_EVENT_AP_PROBEREQRECVED: {
-        system_event_ap_probe_req_rx_t *ap_probereqrecved;
-        ap_probereqrecved = &event->event_info.ap_probereqrecved;
-        WIFI_DEBUG("SYSTEM_EVENT_AP_PROBEREQRECVED\nrssi:%d, mac:%02x:%02x:%02x:%02x:%02x:%02x\n", \
-                   ap_probereqrecved->rssi, ap_probereqrecved->mac[0], ap_probereqrecved->mac[0], ap_probereqrecved->mac[1], \
-                   ap_probereqrecved->mac[3], ap_probereqrecved->mac[4], ap_probereqrecved->mac[5]);
-        break;
-    }
-    default: {
+    if (event->event_id >= SYSTEM_EVENT_MAX) {
         printf("Error: no such kind of event!\n");
-        break;
-    }
+        return ESP_OK;
     }
+    WIFI_DEBUG("received event: %s\n", s_system_event_names[event->event_id]);
 
     return ESP_OK;
 }
@@ -287,6 +309,12 @@ static esp_err_t esp_system_event_handler(system_event_t *event)
         return ESP_FAIL;
     }
 
+    if (event->event_id == SYSTEM_EVENT_STA_CONNECTED) {
+        esp_event_connect_mark(ESP_EVENT_CONNECT_CONNECTED, s_event_timing[event->event_id].dispatched);
+    } else if (event->event_id == SYSTEM_EVENT_STA_GOT_IP) {
+        esp_event_connect_mark(ESP_EVENT_CONNECT_GOT_IP_DISPATCHED, s_event_timing[event->event_id].dispatched);
+    }
+
     esp_system_event_debug(event);
     if ((event->event_id < SYSTEM_EVENT_MAX) && (event->event_id == g_system_event_handle_table[event->event_id].event_id)) {
         if (g_system_event_handle_table[event->event_id].event_handle) {
@@ -298,21 +326,139 @@ static esp_err_t esp_system_event_handler(system_event_t *event)
         printf("mismatch or invalid event, id=%d\n", event->event_id);
     }
 
-    return esp_wifi_post_event_to_user(event);
+    esp_err_t ret = esp_wifi_post_event_to_user(event);
+    if (event->event_id < SYSTEM_EVENT_MAX) {
+        esp_event_dispatch_to(s_system_loop, SYSTEM_EVENT, event->event_id, event);
+
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&s_event_lock);
+        s_event_timing[event->event_id].handled = now;
+        portEXIT_CRITICAL(&s_event_lock);
+        if (event->event_id == SYSTEM_EVENT_STA_GOT_IP) {
+            esp_event_connect_mark(ESP_EVENT_CONNECT_GOT_IP_HANDLED, now);
+        }
+    }
+    return ret;
+}
+
+/* Record that the event task took an event of this ID, call with s_event_lock held */
+static void esp_event_update_timing(system_event_id_t event_id, int64_t now)
+{
+    esp_event_timing_t *timing = &s_event_timing[event_id];
+
+    timing->sent = s_event_sent[event_id];
+    timing->dispatched = now;
+    timing->handled = 0;
+    s_event_sent[event_id] = 0;
+    if (timing->sent != 0 && now - timing->sent > s_event_stats.latency_max_us) {
+        s_event_stats.latency_max_us = now - timing->sent;
+    }
+}
+
+static void esp_event_update_high_water(xQueueHandle queue, uint32_t *high_water)
+{
+    uint32_t waiting = uxQueueMessagesWaiting(queue);
+    portENTER_CRITICAL(&s_event_lock);
+    if (waiting > *high_water) {
+        *high_water = waiting;
+    }
+    portEXIT_CRITICAL(&s_event_lock);
+}
+
+/* Take a free pool slot with one reference, call with s_event_lock held */
+static system_event_t *esp_event_pool_take(void)
+{
+    if (s_event_pool_free == 0) {
+        ++s_event_stats.pool_exhausted;
+        return NULL;
+    }
+    int index = __builtin_ctz(s_event_pool_free);
+    s_event_pool_free &= ~(1U << index);
+    s_event_pool_refs[index] = 1;
+    uint32_t used = CONFIG_SYSTEM_EVENT_POOL_SIZE - __builtin_popcount(s_event_pool_free);
+    if (used > s_event_stats.pool_high_water) {
+        s_event_stats.pool_high_water = used;
+    }
+    return &s_event_pool[index];
+}
+
+/* Index of the pool slot holding this event, or -1 if the event isn't in the pool */
+static int esp_event_pool_index(const system_event_t *event)
+{
+    if (event < s_event_pool || event >= s_event_pool + CONFIG_SYSTEM_EVENT_POOL_SIZE) {
+        return -1;
+    }
+    return event - s_event_pool;
+}
+
+esp_err_t esp_event_retain(system_event_t *event)
+{
+    int index = esp_event_pool_index(event);
+    if (index < 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_event_lock);
+    if (s_event_pool_refs[index] == 0 || s_event_pool_refs[index] == UINT8_MAX) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        ++s_event_pool_refs[index];
+    }
+    portEXIT_CRITICAL(&s_event_lock);
+    return err;
+}
+
+void esp_event_release(system_event_t *event)
+{
+    int index = esp_event_pool_index(event);
+    if (index < 0) {
+        return;
+    }
+    portENTER_CRITICAL(&s_event_lock);
+    if (s_event_pool_refs[index] != 0 && --s_event_pool_refs[index] == 0) {
+        s_event_pool_free |= 1U << index;
+    }
+    portEXIT_CRITICAL(&s_event_lock);
 }
 
 static void esp_system_event_task(void *pvParameters)
 {
     system_event_t evt;
+    system_event_t *event;
     esp_err_t ret;
 
     while (1) {
-        if (xQueueReceive(g_event_handler, &evt, portMAX_DELAY) == pdPASS) {
-            ret = esp_system_event_handler(&evt);
-            if (ret == ESP_FAIL) {
-                printf("esp wifi post event to user fail!\n");
+        /* The set has one entry per queued event, in either queue. The WiFi
+           library posts to g_event_handler directly, so its high-water mark is
+           also tracked here. */
+        if (xQueueSelectFromSet(s_event_queue_set, portMAX_DELAY) == NULL) {
+            continue;
+        }
+        esp_event_update_high_water(g_event_handler, &s_event_stats.queue_high_water);
+        if (xQueueReceive(s_event_prio_queue, &event, 0) != pdPASS &&
+                xQueueReceive(s_event_pool_queue, &event, 0) != pdPASS) {
+            if (xQueueReceive(g_event_handler, &evt, 0) != pdPASS) {
+                continue;
+            }
+            event = &evt;
+        }
+        if (event->event_id < SYSTEM_EVENT_MAX) {
+            /* An esp_event_send of a coalesced ID queues its first event only,
+               later ones are copied over it until the event task gets here. */
+            uint32_t bit = 1 << event->event_id;
+            int64_t now = esp_timer_get_time();
+            portENTER_CRITICAL(&s_event_lock);
+            if ((s_event_coalesce_pending & bit) && s_event_coalesced[event->event_id] == event) {
+                s_event_coalesce_pending &= ~bit;
             }
+            esp_event_update_timing(event->event_id, now);
+            portEXIT_CRITICAL(&s_event_lock);
+        }
+        ret = esp_system_event_handler(event);
+        if (ret == ESP_FAIL) {
+            printf("esp wifi post event to user fail!\n");
         }
+        esp_event_release(event);
     }
 }
 
@@ -330,20 +476,162 @@ esp_err_t esp_event_send(system_event_t *event)
 {
     portBASE_TYPE ret;
 
-    ret = xQueueSendToBack((xQueueHandle)g_event_handler, event, 0);
+    if (event == NULL) {
+        printf("e null\n");
+        return ESP_FAIL;
+    }
+
+    /* Only IDs below SYSTEM_EVENT_MAX have a policy, so bit and s_event_coalesced are only used for valid IDs */
+    uint8_t policy = (event->event_id < SYSTEM_EVENT_MAX) ? s_event_policy[event->event_id] : 0;
+    uint32_t bit = (policy & ESP_EVENT_POLICY_COALESCE) ? 1 << event->event_id : 0;
+
+    if (event->event_id < SYSTEM_EVENT_MAX) {
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&s_event_lock);
+        if (s_event_sent[event->event_id] == 0) {
+            s_event_sent[event->event_id] = now;
+        }
+        portEXIT_CRITICAL(&s_event_lock);
+        if (event->event_id == SYSTEM_EVENT_STA_GOT_IP) {
+            esp_event_connect_mark(ESP_EVENT_CONNECT_GOT_IP_SENT, now);
+        }
+    }
+
+    /* Events of a coalesced ID are copied inside the lock, as a newer one may be copied over the slot at
+       any time until the event task takes it. */
+    system_event_t *slot;
+    portENTER_CRITICAL(&s_event_lock);
+    if ((policy & ESP_EVENT_POLICY_COALESCE) && (s_event_coalesce_pending & bit)) {
+        *s_event_coalesced[event->event_id] = *event;
+        ++s_event_stats.coalesced;
+        portEXIT_CRITICAL(&s_event_lock);
+        return ESP_OK;
+    }
+    slot = esp_event_pool_take();
+    if (slot != NULL && (policy & ESP_EVENT_POLICY_COALESCE)) {
+        *slot = *event;
+        s_event_coalesced[event->event_id] = slot;
+        s_event_coalesce_pending |= bit;
+    }
+    portEXIT_CRITICAL(&s_event_lock);
+
+    ret = pdFAIL;
+    if (slot != NULL) {
+        if (!(policy & ESP_EVENT_POLICY_COALESCE)) {
+            *slot = *event;
+        }
+        if (policy & ESP_EVENT_POLICY_PRIORITY) {
+            ret = xQueueSendToBack(s_event_prio_queue, &slot, 0);
+            if (ret == pdPASS) {
+                esp_event_update_high_water(s_event_prio_queue, &s_event_stats.prio_queue_high_water);
+            }
+        }
+        if (ret != pdPASS) {
+            ret = xQueueSendToBack(s_event_pool_queue, &slot, 0);
+        }
+    } else {
+        /* Pool exhausted, queue a copy of the event */
+        ret = xQueueSendToBack((xQueueHandle)g_event_handler, event, 0);
+        if (ret == pdPASS) {
+            esp_event_update_high_water(g_event_handler, &s_event_stats.queue_high_water);
+        }
+    }
 
     if (pdPASS != ret) {
-        if (event) {
-            printf("e=%d f\n", event->event_id);
-        } else {
-            printf("e null\n");
+        portENTER_CRITICAL(&s_event_lock);
+        ++s_event_stats.dropped;
+        if (slot != NULL && (policy & ESP_EVENT_POLICY_COALESCE) && s_event_coalesced[event->event_id] == slot) {
+            s_event_coalesce_pending &= ~bit;
         }
+        portEXIT_CRITICAL(&s_event_lock);
+        esp_event_release(slot);
+        printf("e=%d f\n", event->event_id);
         return ESP_FAIL;
     }
 
     return ESP_OK;
 }
 
+esp_err_t esp_event_set_policy(system_event_id_t event_id, uint32_t policy)
+{
+    if (event_id >= SYSTEM_EVENT_MAX || (policy & ~(ESP_EVENT_POLICY_PRIORITY | ESP_EVENT_POLICY_COALESCE))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_event_policy[event_id] = policy;
+    return ESP_OK;
+}
+
+void esp_event_get_stats(esp_event_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_event_lock);
+    *stats = s_event_stats;
+    portEXIT_CRITICAL(&s_event_lock);
+}
+
+esp_err_t esp_event_get_timing(system_event_id_t event_id, esp_event_timing_t *timing)
+{
+    if (event_id >= SYSTEM_EVENT_MAX || timing == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_event_lock);
+    *timing = s_event_timing[event_id];
+    portEXIT_CRITICAL(&s_event_lock);
+    return ESP_OK;
+}
+
+void esp_event_connect_timeline_start(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_event_lock);
+    memset(&s_connect_timeline, 0, sizeof(s_connect_timeline));
+    s_connect_timeline.time[ESP_EVENT_CONNECT_START] = now;
+    portEXIT_CRITICAL(&s_event_lock);
+}
+
+void esp_event_get_connect_timeline(esp_event_connect_timeline_t *timeline)
+{
+    portENTER_CRITICAL(&s_event_lock);
+    *timeline = s_connect_timeline;
+    portEXIT_CRITICAL(&s_event_lock);
+}
+
+static const char* const s_connect_phase_names[ESP_EVENT_CONNECT_PHASE_MAX] = {
+    [ESP_EVENT_CONNECT_START]             = "connect start",
+    [ESP_EVENT_CONNECT_CONNECTED]         = "connected",
+    [ESP_EVENT_CONNECT_DHCP_START]        = "dhcp start",
+    [ESP_EVENT_CONNECT_GOT_IP_SENT]       = "got ip sent",
+    [ESP_EVENT_CONNECT_GOT_IP_DISPATCHED] = "got ip dispatched",
+    [ESP_EVENT_CONNECT_GOT_IP_HANDLED]    = "got ip handled",
+};
+
+void esp_event_connect_timeline_print(void)
+{
+    esp_event_connect_timeline_t timeline;
+
+    esp_event_get_connect_timeline(&timeline);
+    int64_t start = timeline.time[ESP_EVENT_CONNECT_START];
+    if (start == 0) {
+        printf("Connect timeline not available\n");
+        return;
+    }
+    printf("Connect timeline (us since connect start):\n");
+    int64_t prev = start;
+    for (int i = 0; i < ESP_EVENT_CONNECT_PHASE_MAX; ++i) {
+        if (timeline.time[i] == 0) {
+            continue;
+        }
+        printf("%-20s %10d %+10d\n", s_connect_phase_names[i],
+               (int) (timeline.time[i] - start), (int) (timeline.time[i] - prev));
+        prev = timeline.time[i];
+    }
+}
+
+esp_event_loop_handle_t esp_event_get_system_loop(void)
+{
+    return s_system_loop;
+}
+
 void *esp_event_get_handler(void)
 {
     return (void *)g_event_handler;
@@ -358,9 +646,34 @@ esp_err_t esp_event_init(system_event_cb_t cb, void *ctx)
     g_event_handler_cb = cb;
     g_event_ctx = ctx;
 
-    g_event_handler = xQueueCreate(CONFIG_SYSTEM_EVENT_QUEUE_SIZE, sizeof(system_event_t));
+    // dispatch-only loop, the event task calls its handlers
+    const esp_event_loop_args_t system_loop_args = {
+        .queue_size = 0,
+        .task_name = NULL,
+    };
+    esp_err_t err = esp_event_loop_create(&system_loop_args, &s_system_loop);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    g_event_handler = xQueueCreateStatic(CONFIG_SYSTEM_EVENT_QUEUE_SIZE, sizeof(system_event_t),
+                                         s_event_queue_storage, &s_event_queue_buf);
+    s_event_pool_queue = xQueueCreateStatic(CONFIG_SYSTEM_EVENT_POOL_SIZE, sizeof(system_event_t *),
+                                            s_event_pool_queue_storage, &s_event_pool_queue_buf);
+    s_event_prio_queue = xQueueCreateStatic(CONFIG_SYSTEM_EVENT_PRIO_QUEUE_SIZE, sizeof(system_event_t *),
+                                            s_event_prio_queue_storage, &s_event_prio_queue_buf);
+    s_event_queue_set = xQueueCreateSet(CONFIG_SYSTEM_EVENT_QUEUE_SIZE + CONFIG_SYSTEM_EVENT_POOL_SIZE +
+                                        CONFIG_SYSTEM_EVENT_PRIO_QUEUE_SIZE);
+    if (s_event_queue_set == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xQueueAddToSet(g_event_handler, s_event_queue_set);
+    xQueueAddToSet(s_event_pool_queue, s_event_queue_set);
+    xQueueAddToSet(s_event_prio_queue, s_event_queue_set);
 
-    xTaskCreatePinnedToCore(esp_system_event_task, "eventTask", ESP_TASKD_EVENT_STACK, NULL, ESP_TASKD_EVENT_PRIO, NULL, 0);
+    xTaskCreateStaticPinnedToCore(esp_system_event_task, "eventTask", ESP_TASKD_EVENT_STACK, NULL, ESP_TASKD_EVENT_PRIO,
+                                  s_event_task_stack, &s_event_task_buf, NULL, ESP_TASK_PROTOCOL_CORE);
+    event_init_flag = true;
     return ESP_OK;
 }
 
@@ -0,0 +1,383 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/queue.h>
+#include "esp_event_loop.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+typedef struct handler_node {
+    esp_event_handler_t handler;
+    void* arg;
+    STAILQ_ENTRY(handler_node) next;
+} handler_node_t;
+
+typedef STAILQ_HEAD(handler_list, handler_node) handler_list_t;
+
+typedef struct id_node {
+    int32_t id;
+    handler_list_t handlers;
+    SLIST_ENTRY(id_node) next;
+} id_node_t;
+
+typedef struct base_node {
+    esp_event_base_t base;
+    handler_list_t any_id_handlers;
+    SLIST_HEAD(id_list, id_node) ids;
+    SLIST_ENTRY(base_node) next;
+} base_node_t;
+
+/*
+ * Base and ID nodes are only freed along with the loop, so that a handler
+ * unregistering itself never frees a node which the dispatch still uses.
+ */
+struct esp_event_loop {
+    QueueHandle_t queue;            // NULL for dispatch-only loops
+    SemaphoreHandle_t mutex;        // recursive, held while handlers run
+    TaskHandle_t task;
+    handler_list_t any_base_handlers;
+    SLIST_HEAD(base_list, base_node) bases;
+};
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void* data;
+    void (*free_fn)(void*);
+    bool data_inline;               // data is in inline_data rather than at data
+    uint8_t inline_data[ESP_EVENT_INLINE_DATA_SIZE];
+} event_item_t;
+
+static base_node_t* find_base(esp_event_loop_handle_t loop, esp_event_base_t base)
+{
+    base_node_t* it;
+    SLIST_FOREACH(it, &loop->bases, next) {
+        if (it->base == base) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+static id_node_t* find_id(base_node_t* base_node, int32_t id)
+{
+    id_node_t* it;
+    SLIST_FOREACH(it, &base_node->ids, next) {
+        if (it->id == id) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+static handler_list_t* get_handler_list(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, bool create)
+{
+    if (base == ESP_EVENT_ANY_BASE) {
+        return &loop->any_base_handlers;
+    }
+    base_node_t* base_node = find_base(loop, base);
+    if (!base_node) {
+        if (!create) {
+            return NULL;
+        }
+        base_node = (base_node_t*) calloc(1, sizeof(base_node_t));
+        if (!base_node) {
+            return NULL;
+        }
+        base_node->base = base;
+        STAILQ_INIT(&base_node->any_id_handlers);
+        SLIST_INIT(&base_node->ids);
+        SLIST_INSERT_HEAD(&loop->bases, base_node, next);
+    }
+    if (id == ESP_EVENT_ANY_ID) {
+        return &base_node->any_id_handlers;
+    }
+    id_node_t* id_node = find_id(base_node, id);
+    if (!id_node) {
+        if (!create) {
+            return NULL;
+        }
+        id_node = (id_node_t*) calloc(1, sizeof(id_node_t));
+        if (!id_node) {
+            return NULL;
+        }
+        id_node->id = id;
+        STAILQ_INIT(&id_node->handlers);
+        SLIST_INSERT_HEAD(&base_node->ids, id_node, next);
+    }
+    return &id_node->handlers;
+}
+
+static void call_handlers(handler_list_t* list, esp_event_base_t base, int32_t id, void* data)
+{
+    handler_node_t* it;
+    handler_node_t* tmp;
+    for (it = STAILQ_FIRST(list); it != NULL; it = tmp) {
+        // the handler may unregister itself
+        tmp = STAILQ_NEXT(it, next);
+        (*it->handler)(it->arg, base, id, data);
+    }
+}
+
+static void free_handler_list(handler_list_t* list)
+{
+    while (!STAILQ_EMPTY(list)) {
+        handler_node_t* it = STAILQ_FIRST(list);
+        STAILQ_REMOVE_HEAD(list, next);
+        free(it);
+    }
+}
+
+esp_err_t esp_event_dispatch_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, void* event_data)
+{
+    if (base == ESP_EVENT_ANY_BASE || id == ESP_EVENT_ANY_ID) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTakeRecursive(loop->mutex, portMAX_DELAY);
+    call_handlers(&loop->any_base_handlers, base, id, event_data);
+    base_node_t* base_node = find_base(loop, base);
+    if (base_node) {
+        call_handlers(&base_node->any_id_handlers, base, id, event_data);
+        id_node_t* id_node = find_id(base_node, id);
+        if (id_node) {
+            call_handlers(&id_node->handlers, base, id, event_data);
+        }
+    }
+    xSemaphoreGiveRecursive(loop->mutex);
+    return ESP_OK;
+}
+
+static void process_item(esp_event_loop_handle_t loop, event_item_t* item)
+{
+    void* data = item->data_inline ? item->inline_data : item->data;
+    esp_event_dispatch_to(loop, item->base, item->id, data);
+    if (item->free_fn) {
+        (*item->free_fn)(item->data);
+    }
+}
+
+static void event_loop_task(void* arg)
+{
+    esp_event_loop_handle_t loop = (esp_event_loop_handle_t) arg;
+    event_item_t item;
+    while (true) {
+        if (xQueueReceive(loop->queue, &item, portMAX_DELAY) == pdTRUE) {
+            process_item(loop, &item);
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t* args, esp_event_loop_handle_t* out_loop)
+{
+    if (args->queue_size == 0 && args->task_name) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_event_loop_handle_t loop = (esp_event_loop_handle_t) calloc(1, sizeof(struct esp_event_loop));
+    if (!loop) {
+        return ESP_ERR_NO_MEM;
+    }
+    STAILQ_INIT(&loop->any_base_handlers);
+    SLIST_INIT(&loop->bases);
+    loop->mutex = xSemaphoreCreateRecursiveMutex();
+    if (!loop->mutex) {
+        goto fail;
+    }
+    if (args->queue_size) {
+        loop->queue = xQueueCreate(args->queue_size, sizeof(event_item_t));
+        if (!loop->queue) {
+            goto fail;
+        }
+    }
+    if (args->task_name) {
+        if (xTaskCreatePinnedToCore(&event_loop_task, args->task_name, args->task_stack_size, loop,
+                                    args->task_priority, &loop->task, args->task_core_id) != pdPASS) {
+            goto fail;
+        }
+    }
+    *out_loop = loop;
+    return ESP_OK;
+
+fail:
+    if (loop->queue) {
+        vQueueDelete(loop->queue);
+    }
+    if (loop->mutex) {
+        vSemaphoreDelete(loop->mutex);
+    }
+    free(loop);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t loop)
+{
+    // The task only holds the mutex while handlers run
+    xSemaphoreTakeRecursive(loop->mutex, portMAX_DELAY);
+    if (loop->task) {
+        vTaskDelete(loop->task);
+    }
+    if (loop->queue) {
+        event_item_t item;
+        while (xQueueReceive(loop->queue, &item, 0) == pdTRUE) {
+            if (item.free_fn) {
+                (*item.free_fn)(item.data);
+            }
+        }
+        vQueueDelete(loop->queue);
+    }
+    free_handler_list(&loop->any_base_handlers);
+    while (!SLIST_EMPTY(&loop->bases)) {
+        base_node_t* base_node = SLIST_FIRST(&loop->bases);
+        SLIST_REMOVE_HEAD(&loop->bases, next);
+        free_handler_list(&base_node->any_id_handlers);
+        while (!SLIST_EMPTY(&base_node->ids)) {
+            id_node_t* id_node = SLIST_FIRST(&base_node->ids);
+            SLIST_REMOVE_HEAD(&base_node->ids, next);
+            free_handler_list(&id_node->handlers);
+            free(id_node);
+        }
+        free(base_node);
+    }
+    xSemaphoreGiveRecursive(loop->mutex);
+    vSemaphoreDelete(loop->mutex);
+    free(loop);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_run(esp_event_loop_handle_t loop, TickType_t ticks_to_run)
+{
+    if (loop->task || !loop->queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const TickType_t start = xTaskGetTickCount();
+    TickType_t remaining = ticks_to_run;
+    event_item_t item;
+    while (xQueueReceive(loop->queue, &item, remaining) == pdTRUE) {
+        process_item(loop, &item);
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        remaining = (elapsed < ticks_to_run) ? ticks_to_run - elapsed : 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register_with(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                                          esp_event_handler_t handler, void* handler_arg)
+{
+    if (base == ESP_EVENT_ANY_BASE && id != ESP_EVENT_ANY_ID) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handler_node_t* node = (handler_node_t*) malloc(sizeof(handler_node_t));
+    if (!node) {
+        return ESP_ERR_NO_MEM;
+    }
+    node->handler = handler;
+    node->arg = handler_arg;
+    xSemaphoreTakeRecursive(loop->mutex, portMAX_DELAY);
+    handler_list_t* list = get_handler_list(loop, base, id, true);
+    if (list) {
+        STAILQ_INSERT_TAIL(list, node, next);
+    }
+    xSemaphoreGiveRecursive(loop->mutex);
+    if (!list) {
+        free(node);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                                            esp_event_handler_t handler)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTakeRecursive(loop->mutex, portMAX_DELAY);
+    handler_list_t* list = get_handler_list(loop, base, id, false);
+    if (list) {
+        handler_node_t* it;
+        STAILQ_FOREACH(it, list, next) {
+            if (it->handler == handler) {
+                STAILQ_REMOVE(list, it, handler_node, next);
+                free(it);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    xSemaphoreGiveRecursive(loop->mutex);
+    return err;
+}
+
+static esp_err_t post_item(esp_event_loop_handle_t loop, event_item_t* item, TickType_t ticks_to_wait)
+{
+    if (!loop->queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xQueueSendToBack(loop->queue, item, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                            const void* event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (base == ESP_EVENT_ANY_BASE || id == ESP_EVENT_ANY_ID) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    event_item_t item = {
+        .base = base,
+        .id = id,
+    };
+    if (event_data_size <= ESP_EVENT_INLINE_DATA_SIZE) {
+        if (event_data) {
+            memcpy(item.inline_data, event_data, event_data_size);
+            item.data_inline = true;
+        }
+    } else {
+        item.data = malloc(event_data_size);
+        if (!item.data) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(item.data, event_data, event_data_size);
+        item.free_fn = &free;
+    }
+    esp_err_t err = post_item(loop, &item, ticks_to_wait);
+    if (err != ESP_OK) {
+        free(item.data);
+    }
+    return err;
+}
+
+esp_err_t esp_event_post_ptr_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                                void* event_data, void (*free_fn)(void*), TickType_t ticks_to_wait)
+{
+    if (base == ESP_EVENT_ANY_BASE || id == ESP_EVENT_ANY_ID) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    event_item_t item = {
+        .base = base,
+        .id = id,
+        .data = event_data,
+        .free_fn = free_fn,
+    };
+    esp_err_t err = post_item(loop, &item, ticks_to_wait);
+    if (err != ESP_OK && free_fn) {
+        (*free_fn)(event_data);
+    }
+    return err;
+}
@@ -11,6 +11,8 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <string.h>
+
 #include <rom/ets_sys.h>
 
 #include <freertos/heap_regions.h>
@@ -55,10 +57,44 @@ static const uint32_t tagDesc[][NO_PRIOS]={
 	{ MALLOC_CAP_PID5, MALLOC_CAP_8BIT, MALLOC_CAP_32BIT },						//
 	{ MALLOC_CAP_PID6, MALLOC_CAP_8BIT, MALLOC_CAP_32BIT },						//
 	{ MALLOC_CAP_PID7, MALLOC_CAP_8BIT, MALLOC_CAP_32BIT },						//
-	{ MALLOC_CAP_SPISRAM, 0, MALLOC_CAP_DMA|MALLOC_CAP_8BIT|MALLOC_CAP_32BIT}, //Tag 15: SPI SRAM data
+	{ MALLOC_CAP_SPISRAM, 0, MALLOC_CAP_8BIT|MALLOC_CAP_32BIT},				//Tag 15: SPI SRAM data, not reachable by DMA
 	{ MALLOC_CAP_INVALID, MALLOC_CAP_INVALID, MALLOC_CAP_INVALID } //End
 };
 
+//Amount of tags in tagDesc, not counting the end marker.
+#define NO_TAGS ((sizeof(tagDesc)/sizeof(tagDesc[0]))-1)
+
+/*
+Ordered list of the tags that can fulfill a caps mask. Resolving a mask against tagDesc takes a fair few
+loops, so the lists for the masks that get requested all the time are worked out once, when the heap is
+initialized; the first one is what a plain malloc() uses.
+*/
+typedef struct {
+	uint32_t caps;
+	int count;
+	uint8_t tags[NO_TAGS];
+} caps_tag_list_t;
+
+static caps_tag_list_t capsTagLists[]={
+	{ MALLOC_CAP_8BIT },
+#if CONFIG_SPIRAM_SUPPORT
+	{ MALLOC_CAP_SPISRAM|MALLOC_CAP_8BIT },
+#endif
+	{ MALLOC_CAP_32BIT },
+	{ MALLOC_CAP_DMA },
+	{ MALLOC_CAP_DMA|MALLOC_CAP_8BIT },
+	{ MALLOC_CAP_EXEC },
+};
+
+#if CONFIG_SPIRAM_SUPPORT
+#define SPIRAM_REGION_SIZE CONFIG_SPIRAM_SIZE
+#else
+#define SPIRAM_REGION_SIZE 0x20000
+#endif
+
+//Bitmask of the tags that have at least one memory region.
+static uint32_t usedTags=0;
+
 /*
 Region descriptors. These describe all regions of memory available, and tag them according to the
 capabilities the hardware has. This array is not marked constant; the initialization code may want to
@@ -79,7 +115,7 @@ be sorted from low to high start address.
 This array is *NOT* const because it gets modified depending on what pools are/aren't available.
 */
 static HeapRegionTagged_t regions[]={
-	{ (uint8_t *)0x3F800000, 0x20000, 15, 0}, //SPI SRAM, if available
+	{ (uint8_t *)0x3F800000, SPIRAM_REGION_SIZE, 15, 0}, //SPI SRAM, if available
 	{ (uint8_t *)0x3FFAE000, 0x2000, 0, 0}, //pool 16 <- used for rom code
 	{ (uint8_t *)0x3FFB0000, 0x8000, 0, 0}, //pool 15 <- can be used for BT
 	{ (uint8_t *)0x3FFB8000, 0x8000, 0, 0}, //pool 14 <- can be used for BT
@@ -161,7 +197,48 @@ static void disable_mem_region(void *from, void *to) {
 ToDo: These are very dependent on the linker script, and the logic involving this works only
 because we're not using the SPI flash yet! If we enable that, this will break. ToDo: Rewrite by then.
 */
-extern int _bss_start, _heap_start;
+extern int _bss_start, _heap_start, _iram_text_end;
+
+/*
+Stacks the ROM sets up for both CPUs, in pool 9. They're only used until the scheduler runs, and are given
+to the heap afterwards by heap_alloc_caps_enable_startup_regions().
+*/
+extern int _stack_sentry, __stack, _stack_sentry_app, __stack_app;
+
+/*
+Work out which tags can satisfy all of the capabilities in caps, in the order they should be tried, and
+write them to tags. Returns the amount of tags found.
+*/
+static int get_caps_tags(uint32_t caps, uint8_t *tags)
+{
+	int prio;
+	int tag, j;
+	int count=0;
+	uint32_t remCaps;
+	uint32_t seenTags=0;
+	for (prio=0; prio<NO_PRIOS; prio++) {
+		//Iterate over tag descriptors for this priority
+		for (tag=0; tagDesc[tag][prio]!=MALLOC_CAP_INVALID; tag++) {
+			if ((usedTags&(1<<tag))==0 || (seenTags&(1<<tag))!=0) continue;
+			if ((tagDesc[tag][prio]&caps)!=0) {
+				//Tag has at least one of the caps requested. If caps has other bits set that this prio
+				//doesn't cover, see if they're available in other prios.
+				remCaps=caps&(~tagDesc[tag][prio]); //Remaining caps to be fulfilled
+				j=prio+1;
+				while (remCaps!=0 && j<NO_PRIOS) {
+					remCaps=remCaps&(~tagDesc[tag][j]);
+					j++;
+				}
+				if (remCaps==0) {
+					//This tag can satisfy all the requested capabilities.
+					tags[count++]=tag;
+					seenTags|=(1<<tag);
+				}
+			}
+		}
+	}
+	return count;
+}
 
 /*
 Initialize the heap allocator. We pass it a bunch of region descriptors, but we need to modify those first to accommodate for 
@@ -176,9 +253,16 @@ void heap_alloc_caps_init() {
 	disable_mem_region((void*)0x3ffae000, (void*)0x3ffb0000); //knock out ROM data region
 	disable_mem_region((void*)0x40070000, (void*)0x40078000); //CPU0 cache region
 	disable_mem_region((void*)0x40078000, (void*)0x40080000); //CPU1 cache region
+#if CONFIG_ENABLE_MEMORY_DEBUG
+	//The memory debug code writes the task name into each block a byte at a time, which IRAM doesn't allow.
 	disable_mem_region((void*)0x40080000, (void*)0x400a0000); //pool 2-5
+#else
+	//The part of pool 2-5 behind the code loaded into IRAM is free. It's tagged IRAM, so it's handed out
+	//for MALLOC_CAP_32BIT and MALLOC_CAP_EXEC allocations.
+	disable_mem_region((void*)0x40080000, &_iram_text_end); //pool 2-5, up to the end of IRAM code
+#endif
 
-	// TODO: this region should be checked, since we don't need to knock out all region finally
+	//Pool 9 holds ROM data and the startup stacks; the stacks are added to the heap later.
 	disable_mem_region((void*)0x3ffe0000, (void*)0x3ffe8000); //knock out ROM data region
 
 #if CONFIG_MEMMAP_BT
@@ -189,10 +273,13 @@ void heap_alloc_caps_init() {
 	disable_mem_region((void*)0x3fff8000, (void*)0x40000000); //knock out trace mem region
 #endif
 
-#if 0
-	enable_spi_sram();
+#if CONFIG_SPIRAM_SUPPORT
+	if (enable_spi_sram()!=ESP_OK) {
+		ESP_EARLY_LOGE(TAG, "SPI SRAM could not be enabled, not using it");
+		disable_mem_region((void*)0x3f800000, (void*)(0x3f800000+SPIRAM_REGION_SIZE));
+	}
 #else
-	disable_mem_region((void*)0x3f800000, (void*)0x3f820000); //SPI SRAM not installed
+	disable_mem_region((void*)0x3f800000, (void*)(0x3f800000+SPIRAM_REGION_SIZE)); //SPI SRAM not installed
 #endif
 
 	//The heap allocator will treat every region given to it as separate. In order to get bigger ranges of contiguous memory,
@@ -216,6 +303,35 @@ void heap_alloc_caps_init() {
 	}
 	//Initialize the malloc implementation.
 	vPortDefineHeapRegionsTagged( regions );
+
+	//Tags without regions never have memory to give out; leave them out of the lookups.
+	for (i=0; regions[i].xSizeInBytes!=0; i++) {
+		if (regions[i].xTag != -1) usedTags|=(1<<regions[i].xTag);
+	}
+	for (i=0; i<sizeof(capsTagLists)/sizeof(capsTagLists[0]); i++) {
+		capsTagLists[i].count=get_caps_tags(capsTagLists[i].caps, capsTagLists[i].tags);
+	}
+}
+
+/*
+Give the startup stacks of both CPUs to the heap. Only call this once the scheduler runs on both CPUs, as
+until then they are running on these stacks. The stacks lie in pool 9, which shares tag 1 with pools 6-8; that
+tag always has memory already, so the precomputed tag lists stay valid.
+*/
+void heap_alloc_caps_enable_startup_regions()
+{
+	HeapRegionTagged_t stacks[]={
+		{ (uint8_t *)&_stack_sentry, (uint8_t *)&__stack-(uint8_t *)&_stack_sentry, 1, 0x400BC000 }, //pool 9 blk 1, PRO CPU
+		{ (uint8_t *)&_stack_sentry_app, (uint8_t *)&__stack_app-(uint8_t *)&_stack_sentry_app, 1, 0x400B8000 }, //pool 9 blk 0, APP CPU
+	};
+	int i;
+	//Exec addresses are the I-port aliases of the start of each pool 9 block; move them along with the start.
+	stacks[0].xExecAddr+=(uint32_t)stacks[0].pucStartAddress-0x3FFE0000;
+	stacks[1].xExecAddr+=(uint32_t)stacks[1].pucStartAddress-0x3FFE4000;
+	for (i=0; i<sizeof(stacks)/sizeof(stacks[0]); i++) {
+		ESP_LOGI(TAG, "Adding startup stack at %08X len %08X to the heap", (int)stacks[i].pucStartAddress, stacks[i].xSizeInBytes);
+		vPortAddHeapRegionTagged(&stacks[i]);
+	}
 }
 
 /*
@@ -226,35 +342,170 @@ void *pvPortMalloc( size_t xWantedSize )
 	return pvPortMallocCaps( xWantedSize, MALLOC_CAP_8BIT );
 }
 
+/*
+Return the tags that can satisfy caps, in the order they should be tried, and set *count to the amount of them.
+capsTags is used to work out the list if it isn't one of the precomputed ones.
+*/
+static const uint8_t *find_caps_tags(uint32_t caps, uint8_t *capsTags, int *count)
+{
+	int i;
+	for (i=0; i<sizeof(capsTagLists)/sizeof(capsTagLists[0]); i++) {
+		if (capsTagLists[i].caps==caps) {
+			*count=capsTagLists[i].count;
+			return capsTagLists[i].tags;
+		}
+	}
+	//Not a mask we have a list for; work it out now.
+	*count=get_caps_tags(caps, capsTags);
+	return capsTags;
+}
+
 /*
 Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
 */
 void *pvPortMallocCaps( size_t xWantedSize, uint32_t caps ) 
 {
-	int prio;
-	int tag, j;
+	int i, count;
+	const uint8_t *tags;
+	uint8_t capsTags[NO_TAGS];
 	void *ret=NULL;
-	uint32_t remCaps;
-	for (prio=0; prio<NO_PRIOS; prio++) {
-		//Iterate over tag descriptors for this priority
-		for (tag=0; tagDesc[tag][prio]!=MALLOC_CAP_INVALID; tag++) {
-			if ((tagDesc[tag][prio]&caps)!=0) {
-				//Tag has at least one of the caps requested. If caps has other bits set that this prio
-				//doesn't cover, see if they're available in other prios.
-				remCaps=caps&(~tagDesc[tag][prio]); //Remaining caps to be fulfilled
-				j=prio+1;
-				while (remCaps!=0 && j<NO_PRIOS) {
-					remCaps=remCaps&(~tagDesc[tag][j]);
-					j++;
-				}
-				if (remCaps==0) {
-					//This tag can satisfy all the requested capabilities. See if we can grab some memory using it.
-					ret=pvPortMallocTagged(xWantedSize, tag);
-					if (ret!=NULL) return ret;
-				}
-			}
-		}
+	tags=find_caps_tags(caps, capsTags, &count);
+	for (i=0; i<count; i++) {
+		ret=pvPortMallocTagged(xWantedSize, tags[i]);
+		if (ret!=NULL) return ret;
 	}
 	//Nothing usable found.
 	return NULL;
 }
+
+/*
+Routine to allocate a bit of memory with certain capabilities, starting at a multiple of alignment. alignment must
+be a power of two. The memory before the aligned start stays available to other allocations, so there's no need to
+allocate more than needed and pad.
+*/
+void *pvPortMallocCapsAligned( size_t xWantedSize, size_t alignment, uint32_t caps )
+{
+	int i, count;
+	const uint8_t *tags;
+	uint8_t capsTags[NO_TAGS];
+	void *ret=NULL;
+	tags=find_caps_tags(caps, capsTags, &count);
+	for (i=0; i<count; i++) {
+		ret=pvPortMallocTaggedAligned(xWantedSize, alignment, tags[i]);
+		if (ret!=NULL) return ret;
+	}
+	//Nothing usable found.
+	return NULL;
+}
+
+/*
+Allocation routine used by malloc(). With SPI SRAM, requests of at least CONFIG_SPIRAM_MALLOC_THRESHOLD bytes go
+there first, and smaller ones to internal memory first. This keeps the internal memory for small, frequently used
+objects. FreeRTOS itself uses pvPortMalloc, which always prefers internal memory, as task stacks can't live in
+SPI SRAM.
+*/
+void *pvPortMallocDefault( size_t xWantedSize )
+{
+#if CONFIG_SPIRAM_SUPPORT
+	if (xWantedSize>=CONFIG_SPIRAM_MALLOC_THRESHOLD) {
+		void *ret=pvPortMallocCaps(xWantedSize, MALLOC_CAP_SPISRAM|MALLOC_CAP_8BIT);
+		if (ret!=NULL) return ret;
+	}
+#endif
+	//Tag 15 comes last for MALLOC_CAP_8BIT, so this only uses SPI SRAM once internal memory runs out.
+	return pvPortMallocCaps(xWantedSize, MALLOC_CAP_8BIT);
+}
+
+/*
+Allocate memory in SPI SRAM if possible, internal memory otherwise. For large buffers that aren't accessed all
+the time and don't need DMA, eg TLS record buffers or JSON documents. The signature fits the allocation hooks of
+cJSON; free the memory with free() or vPortFree().
+*/
+void *pvPortMallocPreferExternal( size_t xWantedSize )
+{
+	void *ret=pvPortMallocCaps(xWantedSize, MALLOC_CAP_SPISRAM|MALLOC_CAP_8BIT);
+	if (ret==NULL) ret=pvPortMallocCaps(xWantedSize, MALLOC_CAP_8BIT);
+	return ret;
+}
+
+/*
+calloc() counterpart of pvPortMallocPreferExternal, for mbedtls_platform_set_calloc_free().
+*/
+void *pvPortCallocPreferExternal( size_t n, size_t size )
+{
+	void *ret;
+	if (size!=0 && n>SIZE_MAX/size) return NULL;
+	ret=pvPortMallocPreferExternal(n*size);
+	if (ret!=NULL) memset(ret, 0, n*size);
+	return ret;
+}
+
+/*
+Move the memory at ptr into a new allocation of xWantedSize bytes, with capabilities caps or, if caps is 0, placed
+like malloc() places it.
+*/
+static void *realloc_internal( void *ptr, size_t xWantedSize, uint32_t caps )
+{
+	void *ret;
+	size_t oldSize;
+	if (ptr==NULL) return (caps==0)?pvPortMallocDefault(xWantedSize):pvPortMallocCaps(xWantedSize, caps);
+	if (xWantedSize==0) {
+		vPortFree(ptr);
+		return NULL;
+	}
+	if (xPortReallocInPlace(ptr, xWantedSize)) return ptr;
+
+	ret=(caps==0)?pvPortMallocDefault(xWantedSize):pvPortMallocCaps(xWantedSize, caps);
+	if (ret!=NULL) {
+		//Only copy what the old block holds; it is smaller than xWantedSize here.
+		oldSize=xPortGetAllocatedSize(ptr);
+		memcpy(ret, ptr, (oldSize<xWantedSize)?oldSize:xWantedSize);
+		vPortFree(ptr);
+	}
+	return ret;
+}
+
+/*
+Routine to resize a bit of memory. The memory is grown or shrunk in place if possible; otherwise its contents
+are moved to a new bit of memory with capabilities caps. Like realloc(), this leaves the original memory alone
+if no new memory can be found, and frees it if xWantedSize is 0.
+*/
+void *pvPortReallocCaps( void *ptr, size_t xWantedSize, uint32_t caps )
+{
+	return realloc_internal(ptr, xWantedSize, caps);
+}
+
+/*
+Resize routine used by realloc(). Memory that has to move is placed like pvPortMallocDefault places it.
+*/
+void *pvPortReallocDefault( void *ptr, size_t xWantedSize )
+{
+	return realloc_internal(ptr, xWantedSize, 0);
+}
+
+/*
+Fill in the heap statistics of all memory with capabilities caps. Byte and block counts and the allocation counters
+are summed over all tags that can satisfy caps; the largest free block is the largest one of any of these tags.
+*/
+void vPortGetHeapStatsCaps( uint32_t caps, HeapStats_t *stats )
+{
+	int i, j, count;
+	const uint8_t *tags;
+	uint8_t capsTags[NO_TAGS];
+	HeapStats_t tagStats;
+	memset(stats, 0, sizeof(*stats));
+	tags=find_caps_tags(caps, capsTags, &count);
+	for (i=0; i<count; i++) {
+		if (!xPortGetHeapStatsTagged(tags[i], &tagStats)) continue;
+		stats->xFreeBytes+=tagStats.xFreeBytes;
+		stats->xFreeBlocks+=tagStats.xFreeBlocks;
+		for (j=0; j<heapSTATS_HISTOGRAM_COUNT; j++) {
+			stats->xFreeBlockHistogram[j]+=tagStats.xFreeBlockHistogram[j];
+		}
+		if (tagStats.xLargestFreeBlock>stats->xLargestFreeBlock) stats->xLargestFreeBlock=tagStats.xLargestFreeBlock;
+		stats->ulAllocations+=tagStats.ulAllocations;
+		stats->ulFrees+=tagStats.ulFrees;
+		stats->ulFailures+=tagStats.ulFailures;
+		stats->xTickCount=tagStats.xTickCount;
+	}
+}
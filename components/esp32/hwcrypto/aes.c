@@ -28,15 +28,90 @@
 #include <string.h>
 #include "hwcrypto/aes.h"
 #include "rom/aes.h"
+#include "hwcrypto/fallback.h"
+#include "soc/hwcrypto_reg.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
 #include <sys/lock.h>
 
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+/* Software AES of mbedTLS, see mbedtls/port/esp_aes_soft.c */
+extern int esp_aes_software_crypt_ecb_blocks( const unsigned char *key, unsigned int keybits, int mode,
+                                              size_t blocks, const unsigned char *input, unsigned char *output );
+extern int esp_aes_software_crypt_cbc( const unsigned char *key, unsigned int keybits, int mode, size_t length,
+                                       unsigned char iv[16], const unsigned char *input, unsigned char *output );
+extern int esp_aes_software_crypt_cfb128( const unsigned char *key, unsigned int keybits, int mode, size_t length,
+                                          size_t *iv_off, unsigned char iv[16],
+                                          const unsigned char *input, unsigned char *output );
+extern int esp_aes_software_crypt_cfb8( const unsigned char *key, unsigned int keybits, int mode, size_t length,
+                                        unsigned char iv[16], const unsigned char *input, unsigned char *output );
+extern int esp_aes_software_crypt_ctr( const unsigned char *key, unsigned int keybits, size_t length,
+                                       size_t *nc_off, unsigned char nonce_counter[16], unsigned char stream_block[16],
+                                       const unsigned char *input, unsigned char *output );
+#endif
+
 static _lock_t aes_lock;
+/* Keeps the CPU at full speed while the unit is locked */
+static esp_pm_lock_t aes_pm_lock = ESP_PM_LOCK_INITIALIZER(ESP_PM_CPU_FREQ_MAX, "aes");
+
+/* The AES unit is left enabled with the key of the last context used by the
+ * esp_aes_xxx functions, so that a sequence of calls with the same context
+ * (such as the records of a TLS connection) doesn't load the key every time.
+ * aes_loaded_ctx is NULL if the key registers don't hold a context's key.
+ * Protected by aes_lock.
+ */
+static bool aes_enabled;
+static const esp_aes_context *aes_loaded_ctx;
+static int aes_loaded_mode;
 
-void esp_aes_acquire_hardware( void )
+static void esp_aes_enable( void )
+{
+    if (!aes_enabled) {
+        ets_aes_enable();
+        aes_enabled = true;
+        aes_loaded_ctx = NULL;
+    }
+}
+
+/*
+ * Lock the AES unit for the esp_aes_xxx functions, keeping a loaded key.
+ *
+ * With CONFIG_MBEDTLS_HARDWARE_FALLBACK, returns false instead of
+ * waiting if another task uses the unit, or if the operation on length
+ * bytes is shorter than CONFIG_MBEDTLS_AES_HARDWARE_MIN_BYTES, and the
+ * caller does the operation in software.
+ */
+static bool esp_aes_lock( size_t length )
 {
     /* newlib locks lazy initialize on ESP-IDF */
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+    if (length < CONFIG_MBEDTLS_AES_HARDWARE_MIN_BYTES || esp_crypto_software_only(ESP_CRYPTO_AES) ||
+            _lock_try_acquire(&aes_lock) != 0) {
+        esp_crypto_fallback_count(ESP_CRYPTO_AES, true);
+        return false;
+    }
+#else
+    _lock_acquire(&aes_lock);
+#endif
+    esp_crypto_fallback_count(ESP_CRYPTO_AES, false);
+    esp_pm_lock_acquire(&aes_pm_lock);
+    esp_aes_enable();
+    return true;
+}
+
+static void esp_aes_unlock( void )
+{
+    esp_pm_lock_release(&aes_pm_lock);
+    _lock_release(&aes_lock);
+}
+
+void esp_aes_acquire_hardware( void )
+{
     _lock_acquire(&aes_lock);
-    ets_aes_enable();
+    esp_pm_lock_acquire(&aes_pm_lock);
+    esp_aes_enable();
+    /* The caller loads its own key with ets_aes_setkey_xxx */
+    aes_loaded_ctx = NULL;
 }
 
 void esp_aes_release_hardware( void )
@@ -44,6 +119,19 @@ void esp_aes_release_hardware( void )
     uint8_t zero[256/8] = { 0 };
     ets_aes_setkey_enc(zero, AES256);
     ets_aes_disable();
+    aes_enabled = false;
+    aes_loaded_ctx = NULL;
+    esp_pm_lock_release(&aes_pm_lock);
+    _lock_release(&aes_lock);
+}
+
+/* The key of ctx changes, don't keep using the copy in the key registers */
+static void esp_aes_forget_key( const esp_aes_context *ctx )
+{
+    _lock_acquire(&aes_lock);
+    if (aes_loaded_ctx == ctx) {
+        aes_loaded_ctx = NULL;
+    }
     _lock_release(&aes_lock);
 }
 
@@ -58,6 +146,7 @@ void esp_aes_free( esp_aes_context *ctx )
         return;
     }
 
+    esp_aes_forget_key(ctx);
     bzero( ctx, sizeof( esp_aes_context ) );
 }
 
@@ -89,6 +178,7 @@ int esp_aes_setkey_enc( esp_aes_context *ctx, const unsigned char *key,
     if (aesbits < 0) {
         return aesbits;
     }
+    esp_aes_forget_key(ctx);
     ctx->enc.aesbits = aesbits;
     bzero(ctx->enc.key, sizeof(ctx->enc.key));
     memcpy(ctx->enc.key, key, keybytes);
@@ -107,6 +197,7 @@ int esp_aes_setkey_dec( esp_aes_context *ctx, const unsigned char *key,
     if (aesbits < 0) {
         return aesbits;
     }
+    esp_aes_forget_key(ctx);
     ctx->dec.aesbits = aesbits;
     bzero(ctx->dec.key, sizeof(ctx->dec.key));
     memcpy(ctx->dec.key, key, keybytes);
@@ -115,20 +206,66 @@ int esp_aes_setkey_dec( esp_aes_context *ctx, const unsigned char *key,
 
 /*
  * Helper function to copy key from esp_aes_context buffer
- * to hardware key registers.
+ * to hardware key registers, unless they hold it already.
  *
- * Only call when protected by esp_aes_acquire_hardware().
+ * Only call when protected by esp_aes_lock().
  */
 static inline int esp_aes_setkey_hardware( esp_aes_context *ctx, int mode)
 {
-    if ( mode == ESP_AES_ENCRYPT ) {
-        ets_aes_setkey_enc(ctx->enc.key, ctx->enc.aesbits);
-    } else {
-        ets_aes_setkey_dec(ctx->dec.key, ctx->dec.aesbits);
+    const KEY_CTX *key = ( mode == ESP_AES_ENCRYPT ) ? &ctx->enc : &ctx->dec;
+    uint32_t key_words[8];
+
+    if ( aes_loaded_ctx == ctx && aes_loaded_mode == mode ) {
+        return 0;
+    }
+
+    memcpy(key_words, key->key, sizeof(key_words));
+    for (int i = 0; i < 8; i++) {
+        REG_WRITE(AES_KEY_BASE + i * 4, key_words[i]);
     }
+    REG_WRITE(AES_MODE_REG, key->aesbits + (( mode == ESP_AES_DECRYPT ) ? AES_MODE_DECRYPT : 0));
+
+    aes_loaded_ctx = ctx;
+    aes_loaded_mode = mode;
     return 0;
 }
 
+/*
+ * Run one block through the AES unit, with the key loaded by
+ * esp_aes_setkey_hardware(). Input and output are 32-bit words in
+ * memory byte order, as ets_aes_crypt takes them.
+ */
+static inline void esp_aes_block( const uint32_t input[4], uint32_t output[4] )
+{
+    REG_WRITE(AES_TEXT_BASE, input[0]);
+    REG_WRITE(AES_TEXT_BASE + 4, input[1]);
+    REG_WRITE(AES_TEXT_BASE + 8, input[2]);
+    REG_WRITE(AES_TEXT_BASE + 12, input[3]);
+    REG_WRITE(AES_START_REG, 1);
+    while (REG_READ(AES_IDLE_REG) != 1) {
+    }
+    output[0] = REG_READ(AES_TEXT_BASE);
+    output[1] = REG_READ(AES_TEXT_BASE + 4);
+    output[2] = REG_READ(AES_TEXT_BASE + 8);
+    output[3] = REG_READ(AES_TEXT_BASE + 12);
+}
+
+/* Same for unaligned byte buffers, input and output may be the same */
+static inline void esp_aes_block_bytes( const unsigned char input[16], unsigned char output[16] )
+{
+    uint32_t words[4];
+
+    memcpy(words, input, 16);
+    esp_aes_block(words, words);
+    memcpy(output, words, 16);
+}
+
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+/* Key and key length for the software implementation */
+#define SOFTWARE_KEY(ctx, mode)     ((( mode ) == ESP_AES_ENCRYPT) ? ( ctx )->enc.key : ( ctx )->dec.key)
+#define SOFTWARE_KEYBITS(ctx, mode) (128 + 64 * ((( mode ) == ESP_AES_ENCRYPT) ? ( ctx )->enc.aesbits : ( ctx )->dec.aesbits))
+#endif
+
 /*
  * AES-ECB block encryption
  */
@@ -136,10 +273,16 @@ void esp_aes_encrypt( esp_aes_context *ctx,
                       const unsigned char input[16],
                       unsigned char output[16] )
 {
-    esp_aes_acquire_hardware();
+    if (!esp_aes_lock(16)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        esp_aes_software_crypt_ecb_blocks(SOFTWARE_KEY(ctx, ESP_AES_ENCRYPT), SOFTWARE_KEYBITS(ctx, ESP_AES_ENCRYPT),
+                                          ESP_AES_ENCRYPT, 1, input, output);
+#endif
+        return;
+    }
     esp_aes_setkey_hardware(ctx, ESP_AES_ENCRYPT);
-    ets_aes_crypt(input, output);
-    esp_aes_release_hardware();
+    esp_aes_block_bytes(input, output);
+    esp_aes_unlock();
 }
 
 /*
@@ -150,10 +293,16 @@ void esp_aes_decrypt( esp_aes_context *ctx,
                       const unsigned char input[16],
                       unsigned char output[16] )
 {
-    esp_aes_acquire_hardware();
+    if (!esp_aes_lock(16)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        esp_aes_software_crypt_ecb_blocks(SOFTWARE_KEY(ctx, ESP_AES_DECRYPT), SOFTWARE_KEYBITS(ctx, ESP_AES_DECRYPT),
+                                          ESP_AES_DECRYPT, 1, input, output);
+#endif
+        return;
+    }
     esp_aes_setkey_hardware(ctx, ESP_AES_DECRYPT);
-    ets_aes_crypt(input, output);
-    esp_aes_release_hardware();
+    esp_aes_block_bytes(input, output);
+    esp_aes_unlock();
 }
 
 
@@ -165,10 +314,40 @@ int esp_aes_crypt_ecb( esp_aes_context *ctx,
                        const unsigned char input[16],
                        unsigned char output[16] )
 {
-    esp_aes_acquire_hardware();
+    if (!esp_aes_lock(16)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        return esp_aes_software_crypt_ecb_blocks(SOFTWARE_KEY(ctx, mode), SOFTWARE_KEYBITS(ctx, mode),
+                                                 mode, 1, input, output);
+#endif
+    }
+    esp_aes_setkey_hardware(ctx, mode);
+    esp_aes_block_bytes(input, output);
+    esp_aes_unlock();
+    return 0;
+}
+
+/*
+ * AES-ECB encryption/decryption of consecutive blocks
+ */
+int esp_aes_crypt_ecb_blocks( esp_aes_context *ctx,
+                              int mode,
+                              size_t blocks,
+                              const unsigned char *input,
+                              unsigned char *output )
+{
+    if (!esp_aes_lock(blocks * 16)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        return esp_aes_software_crypt_ecb_blocks(SOFTWARE_KEY(ctx, mode), SOFTWARE_KEYBITS(ctx, mode),
+                                                 mode, blocks, input, output);
+#endif
+    }
     esp_aes_setkey_hardware(ctx, mode);
-    ets_aes_crypt(input, output);
-    esp_aes_release_hardware();
+    while ( blocks-- ) {
+        esp_aes_block_bytes(input, output);
+        input  += 16;
+        output += 16;
+    }
+    esp_aes_unlock();
     return 0;
 }
 
@@ -183,26 +362,42 @@ int esp_aes_crypt_cbc( esp_aes_context *ctx,
                        const unsigned char *input,
                        unsigned char *output )
 {
-    int i;
-    unsigned char temp[16];
+    uint32_t iv_words[4];
+    uint32_t words[4];
 
     if ( length % 16 ) {
         return ( ERR_ESP_AES_INVALID_INPUT_LENGTH );
     }
 
-    esp_aes_acquire_hardware();
+    if (!esp_aes_lock(length)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        return esp_aes_software_crypt_cbc(SOFTWARE_KEY(ctx, mode), SOFTWARE_KEYBITS(ctx, mode),
+                                          mode, length, iv, input, output);
+#endif
+    }
+
+    memcpy( iv_words, iv, 16 );
+
     esp_aes_setkey_hardware(ctx, mode);
 
     if ( mode == ESP_AES_DECRYPT ) {
+        uint32_t in_words[4];
+
         while ( length > 0 ) {
-            memcpy( temp, input, 16 );
-            ets_aes_crypt(input, output);
+            /* Copy the ciphertext first, output may overwrite input */
+            memcpy( in_words, input, 16 );
+            esp_aes_block(in_words, words);
 
-            for ( i = 0; i < 16; i++ ) {
-                output[i] = (unsigned char)( output[i] ^ iv[i] );
-            }
+            words[0] ^= iv_words[0];
+            words[1] ^= iv_words[1];
+            words[2] ^= iv_words[2];
+            words[3] ^= iv_words[3];
+            memcpy( output, words, 16 );
 
-            memcpy( iv, temp, 16 );
+            iv_words[0] = in_words[0];
+            iv_words[1] = in_words[1];
+            iv_words[2] = in_words[2];
+            iv_words[3] = in_words[3];
 
             input  += 16;
             output += 16;
@@ -210,12 +405,15 @@ int esp_aes_crypt_cbc( esp_aes_context *ctx,
         }
     } else {
         while ( length > 0 ) {
-            for ( i = 0; i < 16; i++ ) {
-                output[i] = (unsigned char)( input[i] ^ iv[i] );
-            }
+            memcpy( words, input, 16 );
+            words[0] ^= iv_words[0];
+            words[1] ^= iv_words[1];
+            words[2] ^= iv_words[2];
+            words[3] ^= iv_words[3];
 
-            ets_aes_crypt(output, output);
-            memcpy( iv, output, 16 );
+            /* The ciphertext is the IV of the next block */
+            esp_aes_block(words, iv_words);
+            memcpy( output, iv_words, 16 );
 
             input  += 16;
             output += 16;
@@ -223,7 +421,9 @@ int esp_aes_crypt_cbc( esp_aes_context *ctx,
         }
     }
 
-    esp_aes_release_hardware();
+    esp_aes_unlock();
+
+    memcpy( iv, iv_words, 16 );
 
     return 0;
 }
@@ -242,13 +442,18 @@ int esp_aes_crypt_cfb128( esp_aes_context *ctx,
     int c;
     size_t n = *iv_off;
 
-    esp_aes_acquire_hardware();
+    if (!esp_aes_lock(length)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        return esp_aes_software_crypt_cfb128(SOFTWARE_KEY(ctx, ESP_AES_ENCRYPT), SOFTWARE_KEYBITS(ctx, ESP_AES_ENCRYPT),
+                                             mode, length, iv_off, iv, input, output);
+#endif
+    }
     esp_aes_setkey_hardware(ctx, ESP_AES_ENCRYPT);
 
     if ( mode == ESP_AES_DECRYPT ) {
         while ( length-- ) {
             if ( n == 0 ) {
-                ets_aes_crypt(iv, iv );
+                esp_aes_block_bytes(iv, iv);
             }
 
             c = *input++;
@@ -260,7 +465,7 @@ int esp_aes_crypt_cfb128( esp_aes_context *ctx,
     } else {
         while ( length-- ) {
             if ( n == 0 ) {
-                ets_aes_crypt(iv, iv );
+                esp_aes_block_bytes(iv, iv);
             }
 
             iv[n] = *output++ = (unsigned char)( iv[n] ^ *input++ );
@@ -271,7 +476,7 @@ int esp_aes_crypt_cfb128( esp_aes_context *ctx,
 
     *iv_off = n;
 
-    esp_aes_release_hardware();
+    esp_aes_unlock();
 
     return 0;
 }
@@ -289,12 +494,17 @@ int esp_aes_crypt_cfb8( esp_aes_context *ctx,
     unsigned char c;
     unsigned char ov[17];
 
-    esp_aes_acquire_hardware();
+    if (!esp_aes_lock(length)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        return esp_aes_software_crypt_cfb8(SOFTWARE_KEY(ctx, ESP_AES_ENCRYPT), SOFTWARE_KEYBITS(ctx, ESP_AES_ENCRYPT),
+                                           mode, length, iv, input, output);
+#endif
+    }
     esp_aes_setkey_hardware(ctx, ESP_AES_ENCRYPT);
 
     while ( length-- ) {
         memcpy( ov, iv, 16 );
-        ets_aes_crypt(iv, iv);
+        esp_aes_block_bytes(iv, iv);
 
         if ( mode == ESP_AES_DECRYPT ) {
             ov[16] = *input;
@@ -309,7 +519,7 @@ int esp_aes_crypt_cfb8( esp_aes_context *ctx,
         memcpy( iv, ov + 1, 16 );
     }
 
-    esp_aes_release_hardware();
+    esp_aes_unlock();
 
     return 0;
 }
@@ -327,13 +537,48 @@ int esp_aes_crypt_ctr( esp_aes_context *ctx,
 {
     int c, i;
     size_t n = *nc_off;
-
-    esp_aes_acquire_hardware();
+    uint32_t counter[4];
+    uint32_t stream[4];
+    uint32_t words[4];
+
+    if (!esp_aes_lock(length)) {
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+        return esp_aes_software_crypt_ctr(SOFTWARE_KEY(ctx, ESP_AES_ENCRYPT), SOFTWARE_KEYBITS(ctx, ESP_AES_ENCRYPT),
+                                          length, nc_off, nonce_counter, stream_block, input, output);
+#endif
+    }
     esp_aes_setkey_hardware(ctx, ESP_AES_ENCRYPT);
 
+    /* Whole blocks, word by word */
+    if ( n == 0 && length >= 16 ) {
+        memcpy( counter, nonce_counter, 16 );
+        while ( length >= 16 ) {
+            esp_aes_block(counter, stream);
+
+            for ( i = 16; i > 0; i-- )
+                if ( ++nonce_counter[i - 1] != 0 ) {
+                    break;
+                }
+            memcpy( counter, nonce_counter, 16 );
+
+            memcpy( words, input, 16 );
+            words[0] ^= stream[0];
+            words[1] ^= stream[1];
+            words[2] ^= stream[2];
+            words[3] ^= stream[3];
+            memcpy( output, words, 16 );
+
+            input  += 16;
+            output += 16;
+            length -= 16;
+        }
+        memcpy( stream_block, stream, 16 );
+    }
+
+    /* Partial blocks */
     while ( length-- ) {
         if ( n == 0 ) {
-            ets_aes_crypt(nonce_counter, stream_block);
+            esp_aes_block_bytes(nonce_counter, stream_block);
 
             for ( i = 16; i > 0; i-- )
                 if ( ++nonce_counter[i - 1] != 0 ) {
@@ -348,7 +593,7 @@ int esp_aes_crypt_ctr( esp_aes_context *ctx,
 
     *nc_off = n;
 
-    esp_aes_release_hardware();
+    esp_aes_unlock();
 
     return 0;
 }
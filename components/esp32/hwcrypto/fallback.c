@@ -0,0 +1,45 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "hwcrypto/fallback.h"
+
+static uint32_t s_counts[ESP_CRYPTO_ENGINE_MAX][2];
+static bool s_software_only[ESP_CRYPTO_ENGINE_MAX];
+
+void esp_crypto_fallback_count(esp_crypto_engine_t engine, bool software)
+{
+    __atomic_add_fetch(&s_counts[engine][software ? 1 : 0], 1, __ATOMIC_RELAXED);
+}
+
+void esp_crypto_get_fallback_stats(esp_crypto_engine_t engine, esp_crypto_fallback_stats_t *stats)
+{
+    if (engine >= ESP_CRYPTO_ENGINE_MAX) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    stats->hardware = __atomic_load_n(&s_counts[engine][0], __ATOMIC_RELAXED);
+    stats->software = __atomic_load_n(&s_counts[engine][1], __ATOMIC_RELAXED);
+}
+
+void esp_crypto_set_software_only(esp_crypto_engine_t engine, bool software_only)
+{
+    if (engine < ESP_CRYPTO_ENGINE_MAX) {
+        __atomic_store_n(&s_software_only[engine], software_only, __ATOMIC_RELAXED);
+    }
+}
+
+bool esp_crypto_software_only(esp_crypto_engine_t engine)
+{
+    return __atomic_load_n(&s_software_only[engine], __ATOMIC_RELAXED);
+}
@@ -28,38 +28,398 @@
 #include <string.h>
 #include <sys/lock.h>
 #include "hwcrypto/sha.h"
+#include "hwcrypto/fallback.h"
 #include "rom/ets_sys.h"
+#include "soc/hwcrypto_reg.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+
+/* Software SHA of mbedTLS, see mbedtls/port/esp_sha_soft.c */
+extern void *esp_sha_software_start( enum SHA_TYPE type, int is224 );
+extern void *esp_sha_software_resume( enum SHA_TYPE type, const unsigned char *state, uint64_t processed,
+                                      const unsigned char *input, size_t ilen );
+extern void esp_sha_software_update( void *ctx, enum SHA_TYPE type, const unsigned char *input, size_t ilen );
+extern void esp_sha_software_finish( void *ctx, enum SHA_TYPE type, unsigned char *output );
+extern void *esp_sha_software_clone( const void *ctx, enum SHA_TYPE type );
+extern void esp_sha_software_free( void *ctx, enum SHA_TYPE type );
+
+/* The SHA unit has one engine keeping a digest state for SHA-1, one for
+   SHA-256 and one for SHA-384/512. They share the text registers. */
+#define SHA_ENGINES 3
+
+/* Protects engine_in_use, engines_enabled, sha_enabled and the SHA registers */
+static _lock_t sha_lock;
+static bool engine_in_use[SHA_ENGINES];
+static int engines_enabled;
+static bool sha_enabled;
+/* Held once for each engine in use, keeps the CPU at full speed */
+static esp_pm_lock_t sha_pm_lock = ESP_PM_LOCK_INITIALIZER(ESP_PM_CPU_FREQ_MAX, "sha");
 
+static int engine_index(enum SHA_TYPE type)
+{
+    switch (type) {
+    case SHA1:
+        return 0;
+    case SHA2_256:
+        return 1;
+    default:
+        return 2;
+    }
+}
 
-static _lock_t sha_lock;
+static uint32_t start_reg(enum SHA_TYPE type)
+{
+    switch (type) {
+    case SHA1:
+        return SHA_1_START_REG;
+    case SHA2_256:
+        return SHA_256_START_REG;
+    case SHA2_384:
+        return SHA_384_START_REG;
+    default:
+        return SHA_512_START_REG;
+    }
+}
 
-void esp_sha_acquire_hardware( void )
+static size_t block_length(enum SHA_TYPE type)
+{
+    return (type == SHA2_384 || type == SHA2_512) ? 128 : 64;
+}
+
+/* Length of the digest state of the engine, SHA-384 runs on 8 words */
+static size_t state_length(enum SHA_TYPE type)
+{
+    return (type == SHA1) ? 20 : (type == SHA2_256) ? 32 : 64;
+}
+
+static size_t digest_length(enum SHA_TYPE type)
+{
+    return (type == SHA2_384) ? 48 : state_length(type);
+}
+
+/* Take the engine for type, call with sha_lock held */
+static bool esp_sha_take_engine(enum SHA_TYPE type)
+{
+    int engine = engine_index(type);
+
+    if (engine_in_use[engine]) {
+        return false;
+    }
+    engine_in_use[engine] = true;
+    engines_enabled++;
+    esp_pm_lock_acquire(&sha_pm_lock);
+    if (!sha_enabled) {
+        ets_sha_enable();
+        sha_enabled = true;
+    }
+    return true;
+}
+
+/* Give back the engine for type, call with sha_lock held */
+static void esp_sha_give_engine(enum SHA_TYPE type)
+{
+    engine_in_use[engine_index(type)] = false;
+    engines_enabled--;
+    esp_pm_lock_release(&sha_pm_lock);
+#if !CONFIG_MBEDTLS_HARDWARE_KEEP_ENABLED
+    if (engines_enabled == 0) {
+        ets_sha_disable();
+        sha_enabled = false;
+    }
+#endif
+}
+
+static bool esp_sha_try_lock_engine(enum SHA_TYPE type)
 {
+    bool taken;
+
     /* newlib locks lazy initialize on ESP-IDF */
     _lock_acquire(&sha_lock);
-    ets_sha_enable();
+    taken = esp_sha_take_engine(type);
+    _lock_release(&sha_lock);
+    return taken;
+}
+
+/* Only for the rare cases without memory for a software context */
+static void esp_sha_lock_engine(enum SHA_TYPE type)
+{
+    while (!esp_sha_try_lock_engine(type)) {
+        vTaskDelay(1);
+    }
+}
+
+static void esp_sha_unlock_engine(enum SHA_TYPE type)
+{
+    _lock_acquire(&sha_lock);
+    esp_sha_give_engine(type);
+    _lock_release(&sha_lock);
+}
+
+void esp_sha_acquire_hardware( void )
+{
+    const enum SHA_TYPE types[SHA_ENGINES] = { SHA1, SHA2_256, SHA2_512 };
+
+    for (int i = 0; i < SHA_ENGINES; i++) {
+        esp_sha_lock_engine(types[i]);
+    }
 }
 
 void esp_sha_release_hardware( void )
 {
+    const enum SHA_TYPE types[SHA_ENGINES] = { SHA1, SHA2_256, SHA2_512 };
+
     /* Want to empty internal SHA buffers where possible,
        need to check if this is sufficient for this. */
     SHA_CTX zero = { 0 };
     ets_sha_init(&zero);
-    ets_sha_disable();
+    for (int i = 0; i < SHA_ENGINES; i++) {
+        esp_sha_unlock_engine(types[i]);
+    }
+}
+
+/* Feed whole blocks to the engine held by ctx */
+static void esp_sha_blocks( esp_sha_context *ctx, const unsigned char *input, size_t blocks )
+{
+    uint32_t reg = start_reg(ctx->context_type);
+    size_t words = block_length(ctx->context_type) / 4;
+
+    _lock_acquire(&sha_lock);
+    while (blocks-- > 0) {
+        for (size_t i = 0; i < words; i++) {
+            uint32_t word;
+            memcpy(&word, input + i * 4, 4);
+            REG_WRITE(SHA_TEXT_BASE + i * 4, __builtin_bswap32(word));
+        }
+        REG_WRITE(ctx->first_block ? reg : reg + SHA_CONTINUE_OFFSET, 1);
+        while (REG_READ(reg + SHA_BUSY_OFFSET) != 0) {
+        }
+        ctx->first_block = false;
+        input += words * 4;
+    }
     _lock_release(&sha_lock);
 }
 
+/* Read the digest state of the engine held by ctx, the engine goes on
+   with the hash afterwards */
+static void esp_sha_read_state( const esp_sha_context *ctx, unsigned char *state )
+{
+    uint32_t reg = start_reg(ctx->context_type);
+    size_t words = state_length(ctx->context_type) / 4;
+    uint32_t word;
+
+    _lock_acquire(&sha_lock);
+    REG_WRITE(reg + SHA_LOAD_OFFSET, 1);
+    while (REG_READ(reg + SHA_BUSY_OFFSET) != 0) {
+    }
+    for (size_t i = 0; i < words; i++) {
+        /* the 64-bit state words of SHA-384/512 have their halves swapped */
+        size_t reg_word = (words == 16) ? (i ^ 1) : i;
+        word = REG_READ(SHA_TEXT_BASE + reg_word * 4);
+        memcpy(state + i * 4, &word, 4);
+    }
+    _lock_release(&sha_lock);
+}
+
+/* Give back the resources of ctx, keeps context_type */
+static void esp_sha_release( esp_sha_context *ctx )
+{
+    ctx->pending = false;
+    if (ctx->software != NULL) {
+        esp_sha_software_free(ctx->software, ctx->context_type);
+        ctx->software = NULL;
+    }
+    if (ctx->hardware) {
+        esp_sha_unlock_engine(ctx->context_type);
+        ctx->hardware = false;
+    }
+}
+
+/* Choose the engine or software for a started ctx, the engine if
+   use_engine is set and it is free */
+static void esp_sha_begin( esp_sha_context *ctx, int is224, bool use_engine )
+{
+    if (!is224 && (ctx->hardware || (use_engine && !esp_crypto_software_only(ESP_CRYPTO_SHA) &&
+                                     esp_sha_try_lock_engine(ctx->context_type)))) {
+        ctx->hardware = true;
+        esp_crypto_fallback_count(ESP_CRYPTO_SHA, false);
+        return;
+    }
+
+    ctx->software = esp_sha_software_start(ctx->context_type, is224);
+    if (ctx->software != NULL) {
+        esp_crypto_fallback_count(ESP_CRYPTO_SHA, true);
+    } else if (is224) {
+        ctx->context_type = SHA_INVALID;
+    } else {
+        /* No memory for the software context, wait for the engine */
+        esp_sha_lock_engine(ctx->context_type);
+        ctx->hardware = true;
+        esp_crypto_fallback_count(ESP_CRYPTO_SHA, false);
+    }
+}
+
+/* Generic esp_shaX_start implementation, ctx->context_type is set */
+static void esp_sha_start( esp_sha_context *ctx, int is224 )
+{
+    /* Restarting a context keeps the engine it holds */
+    bool hardware = ctx->hardware && !is224;
+
+    if (!hardware) {
+        esp_sha_release(ctx);
+    }
+    ctx->total = 0;
+    ctx->first_block = true;
+
+    if (CONFIG_MBEDTLS_SHA_HARDWARE_MIN_BYTES > 0 && !hardware && !is224) {
+        /* The length of the first update chooses the path */
+        ctx->pending = true;
+        return;
+    }
+    esp_sha_begin(ctx, is224, true);
+}
+
+/* Pad the message of ctx, which holds the engine, and read its digest state */
+static void esp_sha_pad( esp_sha_context *ctx, unsigned char *state )
+{
+    size_t block, fill, i;
+    uint64_t total;
+
+    /* Padding: 0x80, zeros and the length in bits, 64 bits (128 bits for
+       SHA-384/512) big endian at the end of the last block */
+    block = block_length(ctx->context_type);
+    total = ctx->total;
+    fill = total % block;
+    ctx->buffer[fill++] = 0x80;
+    if (fill > block - block / 8) {
+        bzero(ctx->buffer + fill, block - fill);
+        esp_sha_blocks(ctx, ctx->buffer, 1);
+        fill = 0;
+    }
+    bzero(ctx->buffer + fill, block - fill);
+    for (i = 0; i < 8; i++) {
+        ctx->buffer[block - 1 - i] = (unsigned char) ((total << 3) >> (i * 8));
+    }
+    if (block == 128) {
+        ctx->buffer[block - 9] = (unsigned char) (total >> 61);
+    }
+    esp_sha_blocks(ctx, ctx->buffer, 1);
+
+    esp_sha_read_state(ctx, state);
+}
+
+/* Generic esp_shaX_finish implementation */
+static void esp_sha_finish( esp_sha_context *ctx, unsigned char *output, size_t output_len )
+{
+    unsigned char state[64];
+
+    if (ctx->pending) {
+        /* Empty message */
+        ctx->pending = false;
+        esp_sha_begin(ctx, 0, false);
+    }
+    if (ctx->software != NULL) {
+        esp_sha_software_finish(ctx->software, ctx->context_type, output);
+        ctx->software = NULL;
+        return;
+    }
+    if (!ctx->hardware) {
+        /* Invalid or already finished context, no memory for the software
+           context of SHA-224 or a clone */
+        bzero(output, output_len);
+        return;
+    }
+
+    esp_sha_pad(ctx, state);
+    memcpy(output, state, digest_length(ctx->context_type));
+    esp_sha_release(ctx);
+}
+
+/* Generic esp_shaX_clone implementation */
+static void esp_sha_clone( esp_sha_context *dst, const esp_sha_context *src )
+{
+    unsigned char state[64];
+    size_t fill;
+
+    if (dst == src) {
+        return;
+    }
+    esp_sha_release(dst);
+    *dst = *src;
+    dst->hardware = false;
+    dst->software = NULL;
+
+    if (src->software != NULL) {
+        dst->software = esp_sha_software_clone(src->software, src->context_type);
+    } else if (src->hardware) {
+        /* The engine keeps one state, so the clone goes on in software */
+        fill = src->total % block_length(src->context_type);
+        if (src->first_block) {
+            dst->software = esp_sha_software_start(src->context_type, 0);
+            if (dst->software != NULL) {
+                esp_sha_software_update(dst->software, src->context_type, src->buffer, fill);
+            }
+        } else {
+            esp_sha_read_state(src, state);
+            dst->software = esp_sha_software_resume(src->context_type, state, src->total - fill,
+                                                    src->buffer, fill);
+        }
+        esp_crypto_fallback_count(ESP_CRYPTO_SHA, true);
+    } else {
+        return;
+    }
+    if (dst->software == NULL) {
+        dst->context_type = SHA_INVALID;
+    }
+}
+
+/* Generic esp_shaX_free implementation */
+static void esp_sha_free( esp_sha_context *ctx )
+{
+    esp_sha_release(ctx);
+    bzero( ctx, sizeof( esp_sha_context ) );
+}
+
 /* Generic esp_shaX_update implementation */
-static void esp_sha_update( esp_sha_context *ctx, const unsigned char *input, size_t ilen, size_t block_size)
+static void esp_sha_update( esp_sha_context *ctx, const unsigned char *input, size_t ilen )
 {
-    /* Feed the SHA engine one block at a time */
-    while(ilen > 0) {
-        size_t chunk_len = (ilen > block_size) ? block_size : ilen;
-        ets_sha_update(&ctx->context, ctx->context_type, input, chunk_len * 8);
-        input += chunk_len;
-        ilen -= chunk_len;
+    size_t block, fill, left;
+
+    if (ctx->pending && ilen > 0) {
+        ctx->pending = false;
+        esp_sha_begin(ctx, 0, ilen >= CONFIG_MBEDTLS_SHA_HARDWARE_MIN_BYTES);
     }
+    if (ctx->software != NULL) {
+        esp_sha_software_update(ctx->software, ctx->context_type, input, ilen);
+        return;
+    }
+    if (!ctx->hardware || ilen == 0) {
+        return;
+    }
+
+    block = block_length(ctx->context_type);
+    fill = ctx->total % block;
+    ctx->total += ilen;
+
+    /* Complete the buffered block, then feed whole blocks from input */
+    if (fill > 0) {
+        left = block - fill;
+        if (ilen < left) {
+            memcpy(ctx->buffer + fill, input, ilen);
+            return;
+        }
+        memcpy(ctx->buffer + fill, input, left);
+        esp_sha_blocks(ctx, ctx->buffer, 1);
+        input += left;
+        ilen -= left;
+    }
+    if (ilen >= block) {
+        esp_sha_blocks(ctx, input, ilen / block);
+        input += ilen - ilen % block;
+        ilen %= block;
+    }
+    memcpy(ctx->buffer, input, ilen);
 }
 
 void esp_sha1_init( esp_sha_context *ctx )
@@ -73,12 +433,12 @@ void esp_sha1_free( esp_sha_context *ctx )
         return;
     }
 
-    bzero( ctx, sizeof( esp_sha_context ) );
+    esp_sha_free( ctx );
 }
 
 void esp_sha1_clone( esp_sha_context *dst, const esp_sha_context *src )
 {
-    *dst = *src;
+    esp_sha_clone( dst, src );
 }
 
 /*
@@ -87,8 +447,7 @@ void esp_sha1_clone( esp_sha_context *dst, const esp_sha_context *src )
 void esp_sha1_start( esp_sha_context *ctx )
 {
     ctx->context_type = SHA1;
-    esp_sha_acquire_hardware();
-    ets_sha_init(&ctx->context);
+    esp_sha_start(ctx, 0);
 }
 
 /*
@@ -96,7 +455,7 @@ void esp_sha1_start( esp_sha_context *ctx )
  */
 void esp_sha1_update( esp_sha_context *ctx, const unsigned char *input, size_t ilen )
 {
-    esp_sha_update(ctx, input, ilen, 64);
+    esp_sha_update(ctx, input, ilen);
 }
 
 /*
@@ -104,8 +463,7 @@ void esp_sha1_update( esp_sha_context *ctx, const unsigned char *input, size_t i
  */
 void esp_sha1_finish( esp_sha_context *ctx, unsigned char output[20] )
 {
-    ets_sha_finish(&ctx->context, ctx->context_type, output);
-    esp_sha_release_hardware();
+    esp_sha_finish(ctx, output, 20);
 }
 
 /* Full SHA-1 calculation */
@@ -120,6 +478,149 @@ void esp_sha1( const unsigned char *input, size_t ilen, unsigned char output[20]
     esp_sha1_free( &ctx );
 }
 
+/* Write a block of 16 words, in register order, to the text registers */
+static inline void esp_sha1_write_block( const uint32_t *words )
+{
+    for (int i = 0; i < 16; i++) {
+        REG_WRITE(SHA_TEXT_BASE + i * 4, words[i]);
+    }
+}
+
+static inline void esp_sha1_wait( void )
+{
+    while (REG_READ(SHA_1_START_REG + SHA_BUSY_OFFSET) != 0) {
+    }
+}
+
+/* HMAC-SHA-1 of salt || counter with the key of the pad blocks, on the
+   engine held by the caller */
+static void esp_sha1_hmac_first( const unsigned char *ipad, const unsigned char *opad,
+                                 const unsigned char *salt, size_t slen,
+                                 const unsigned char counter[4], unsigned char output[20] )
+{
+    esp_sha_context ctx;
+    unsigned char state[64];
+
+    bzero(&ctx, sizeof(ctx));
+    ctx.context_type = SHA1;
+    ctx.hardware = true;
+    ctx.first_block = true;
+    esp_sha_update(&ctx, ipad, 64);
+    esp_sha_update(&ctx, salt, slen);
+    esp_sha_update(&ctx, counter, 4);
+    esp_sha_pad(&ctx, state);
+
+    ctx.total = 0;
+    ctx.first_block = true;
+    esp_sha_update(&ctx, opad, 64);
+    esp_sha_update(&ctx, state, 20);
+    esp_sha_pad(&ctx, output);
+}
+
+int esp_sha1_pbkdf2( const unsigned char *password, size_t plen,
+                     const unsigned char *salt, size_t slen,
+                     unsigned int iterations, uint32_t key_length, unsigned char *output )
+{
+    unsigned char key[20];
+    unsigned char ipad[64], opad[64];
+    unsigned char counter[4] = { 0, 0, 0, 1 };
+    unsigned char u[20];
+    uint32_t ipad_words[16], opad_words[16], msg[16];
+    uint32_t t[5];
+    size_t use_len;
+
+    if (iterations == 0) {
+        return -1;
+    }
+    if (plen > 64) {
+        esp_sha1(password, plen, key);
+        password = key;
+        plen = 20;
+    }
+    if (esp_crypto_software_only(ESP_CRYPTO_SHA) || !esp_sha_try_lock_engine(SHA1)) {
+        return -1;
+    }
+    esp_crypto_fallback_count(ESP_CRYPTO_SHA, false);
+
+    memset(ipad, 0x36, 64);
+    memset(opad, 0x5C, 64);
+    for (size_t i = 0; i < plen; i++) {
+        ipad[i] ^= password[i];
+        opad[i] ^= password[i];
+    }
+    for (int i = 0; i < 16; i++) {
+        uint32_t word;
+        memcpy(&word, ipad + i * 4, 4);
+        ipad_words[i] = __builtin_bswap32(word);
+        memcpy(&word, opad + i * 4, 4);
+        opad_words[i] = __builtin_bswap32(word);
+    }
+    /* A 20 byte message after a pad block fits into one padded block */
+    bzero(msg, sizeof(msg));
+    msg[5] = 0x80000000;
+    msg[15] = (64 + 20) * 8;
+
+    while (key_length > 0) {
+        esp_sha1_hmac_first(ipad, opad, salt, slen, counter, u);
+        memcpy(t, u, 20);
+        for (int i = 0; i < 5; i++) {
+            msg[i] = __builtin_bswap32(t[i]);
+        }
+
+        for (unsigned int n = 1; n < iterations; n++) {
+            /* Four blocks per iteration; the pads are whole blocks, so the
+               inner and outer hashes start by hashing them again, the
+               engine can't be loaded with their precomputed states */
+            _lock_acquire(&sha_lock);
+            esp_sha1_write_block(ipad_words);
+            REG_WRITE(SHA_1_START_REG, 1);
+            esp_sha1_wait();
+            esp_sha1_write_block(msg);
+            REG_WRITE(SHA_1_START_REG + SHA_CONTINUE_OFFSET, 1);
+            esp_sha1_wait();
+            REG_WRITE(SHA_1_START_REG + SHA_LOAD_OFFSET, 1);
+            esp_sha1_wait();
+            for (int i = 0; i < 5; i++) {
+                msg[i] = __builtin_bswap32(REG_READ(SHA_TEXT_BASE + i * 4));
+            }
+
+            esp_sha1_write_block(opad_words);
+            REG_WRITE(SHA_1_START_REG, 1);
+            esp_sha1_wait();
+            esp_sha1_write_block(msg);
+            REG_WRITE(SHA_1_START_REG + SHA_CONTINUE_OFFSET, 1);
+            esp_sha1_wait();
+            REG_WRITE(SHA_1_START_REG + SHA_LOAD_OFFSET, 1);
+            esp_sha1_wait();
+            for (int i = 0; i < 5; i++) {
+                uint32_t word = REG_READ(SHA_TEXT_BASE + i * 4);
+                msg[i] = __builtin_bswap32(word);
+                t[i] ^= word;
+            }
+            _lock_release(&sha_lock);
+        }
+
+        use_len = (key_length < 20) ? key_length : 20;
+        memcpy(output, t, use_len);
+        output += use_len;
+        key_length -= use_len;
+
+        for (int i = 3; i >= 0; i--) {
+            if (++counter[i] != 0) {
+                break;
+            }
+        }
+    }
+
+    esp_sha_unlock_engine(SHA1);
+    bzero(ipad, sizeof(ipad));
+    bzero(opad, sizeof(opad));
+    bzero(ipad_words, sizeof(ipad_words));
+    bzero(opad_words, sizeof(opad_words));
+    bzero(key, sizeof(key));
+    return 0;
+}
+
 void esp_sha256_init( esp_sha_context *ctx )
 {
     bzero( ctx, sizeof( esp_sha_context ) );
@@ -131,12 +632,12 @@ void esp_sha256_free( esp_sha_context *ctx )
         return;
     }
 
-    bzero( ctx, sizeof( esp_sha_context ) );
+    esp_sha_free( ctx );
 }
 
 void esp_sha256_clone( esp_sha_context *dst, const esp_sha_context *src )
 {
-    *dst = *src;
+    esp_sha_clone( dst, src );
 }
 
 /*
@@ -144,15 +645,9 @@ void esp_sha256_clone( esp_sha_context *dst, const esp_sha_context *src )
  */
 void esp_sha256_start( esp_sha_context *ctx, int is224 )
 {
-    if ( is224 == 0 ) {
-        /* SHA-256 */
-        ctx->context_type = SHA2_256;
-        esp_sha_acquire_hardware();
-        ets_sha_init(&ctx->context);
-    } else {
-        /* SHA-224 is not supported! */
-        ctx->context_type = SHA_INVALID;
-    }
+    /* SHA-224 is not supported by the hardware, calculated in software */
+    ctx->context_type = SHA2_256;
+    esp_sha_start(ctx, is224);
 }
 
 /*
@@ -160,10 +655,7 @@ void esp_sha256_start( esp_sha_context *ctx, int is224 )
  */
 void esp_sha256_update( esp_sha_context *ctx, const unsigned char *input, size_t ilen )
 {
-    if( ctx->context_type == SHA2_256 ) {
-        esp_sha_update(ctx, input, ilen, 64);
-    }
-    /* SHA-224 is a no-op */
+    esp_sha_update(ctx, input, ilen);
 }
 
 /*
@@ -171,14 +663,7 @@ void esp_sha256_update( esp_sha_context *ctx, const unsigned char *input, size_t
  */
 void esp_sha256_finish( esp_sha_context *ctx, unsigned char output[32] )
 {
-    if ( ctx->context_type == SHA2_256 ) {
-        ets_sha_finish(&ctx->context, ctx->context_type, output);
-        esp_sha_release_hardware();
-    } else {
-        /* No hardware SHA-224 support, but mbedTLS API doesn't allow failure.
-           For now, zero the output to make it clear it's not valid. */
-        bzero( output, 28 );
-    }
+    esp_sha_finish(ctx, output, 32);
 }
 
 /*
@@ -208,12 +693,12 @@ void esp_sha512_free( esp_sha_context *ctx )
         return;
     }
 
-    bzero( ctx, sizeof( esp_sha_context ) );
+    esp_sha_free( ctx );
 }
 
 void esp_sha512_clone( esp_sha_context *dst, const esp_sha_context *src )
 {
-    *dst = *src;
+    esp_sha_clone( dst, src );
 }
 
 /*
@@ -228,8 +713,7 @@ void esp_sha512_start( esp_sha_context *ctx, int is384 )
         /* SHA-384 */
         ctx->context_type = SHA2_384;
     }
-    esp_sha_acquire_hardware();
-    ets_sha_init(&ctx->context);
+    esp_sha_start(ctx, 0);
 }
 
 /*
@@ -237,7 +721,7 @@ void esp_sha512_start( esp_sha_context *ctx, int is384 )
  */
 void esp_sha512_update( esp_sha_context *ctx, const unsigned char *input, size_t ilen )
 {
-    esp_sha_update(ctx, input, ilen, 128);
+    esp_sha_update(ctx, input, ilen);
 }
 
 /*
@@ -245,8 +729,7 @@ void esp_sha512_update( esp_sha_context *ctx, const unsigned char *input, size_t
  */
 void esp_sha512_finish( esp_sha_context *ctx, unsigned char output[64] )
 {
-    ets_sha_finish(&ctx->context, ctx->context_type, output);
-    esp_sha_release_hardware();
+    esp_sha_finish(ctx, output, 64);
 }
 
 /*
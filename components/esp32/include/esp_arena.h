@@ -0,0 +1,166 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_ARENA_H__
+#define __ESP_ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Arena allocator
+ *
+ * An arena hands out memory from a list of large chunks by advancing a
+ * pointer. Individual allocations are never freed; instead all of them are
+ * released at once with esp_arena_reset or esp_arena_delete. This suits
+ * request-scoped processing, such as parsing a JSON document or running a
+ * TLS handshake, where many small objects share one lifetime.
+ *
+ * An arena isn't protected by a lock and must only be used by one task at
+ * a time.
+ */
+
+typedef struct esp_arena* esp_arena_handle_t;
+
+/**
+ * @brief Create an arena
+ *
+ * The first chunk is allocated right away and is kept across
+ * esp_arena_reset calls.
+ *
+ * @param chunk_size  size of each chunk, in bytes. Allocations larger than
+ *                    a quarter of this size get a chunk of their own.
+ * @param caps        capabilities of the memory chunks are allocated from,
+ *                    a bitfield of MALLOC_CAP_* bits (see heap_alloc_caps.h)
+ * @param out_arena   pointer to the arena handle, set on success
+ *
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if chunk_size is zero,
+ *         ESP_ERR_NO_MEM if memory for the arena can't be allocated
+ */
+esp_err_t esp_arena_create(size_t chunk_size, uint32_t caps, esp_arena_handle_t* out_arena);
+
+/**
+ * @brief Delete an arena, releasing all memory allocated from it
+ *
+ * @param arena  arena handle
+ */
+void esp_arena_delete(esp_arena_handle_t arena);
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * @param arena  arena handle
+ * @param size   number of bytes. The returned pointer is 4-byte aligned.
+ *
+ * @return pointer to the memory, NULL if a new chunk can't be allocated
+ */
+void* esp_arena_alloc(esp_arena_handle_t arena, size_t size);
+
+/**
+ * @brief Allocate zero-initialized memory for an array from an arena
+ *
+ * @param arena  arena handle
+ * @param n      number of elements
+ * @param size   size of each element, in bytes
+ *
+ * @return pointer to the memory, NULL on overflow or if a new chunk can't
+ *         be allocated
+ */
+void* esp_arena_calloc(esp_arena_handle_t arena, size_t n, size_t size);
+
+/**
+ * @brief Release all memory allocated from an arena
+ *
+ * The first chunk is kept, all other chunks are returned to the heap.
+ *
+ * @param arena  arena handle
+ */
+void esp_arena_reset(esp_arena_handle_t arena);
+
+/**
+ * @brief Check if memory was allocated from an arena
+ *
+ * @param arena  arena handle
+ * @param ptr    pointer to check
+ *
+ * @return true if ptr points into one of the chunks of the arena
+ */
+bool esp_arena_contains(esp_arena_handle_t arena, const void* ptr);
+
+/**
+ * @brief Set the arena used by the allocator hooks for the calling task
+ *
+ * The arena is remembered in a FreeRTOS thread local storage pointer of the
+ * calling task (CONFIG_ESP32_ARENA_TLS_INDEX).
+ *
+ * @param arena  arena handle, or NULL to make the hooks use the heap again
+ *
+ * @return ESP_OK on success,
+ *         ESP_ERR_NOT_SUPPORTED if FREERTOS_THREAD_LOCAL_STORAGE_POINTERS
+ *         isn't larger than ESP32_ARENA_TLS_INDEX
+ */
+esp_err_t esp_arena_set_current(esp_arena_handle_t arena);
+
+/**
+ * @brief Get the arena used by the allocator hooks for the calling task
+ *
+ * @return arena handle, NULL if none is set
+ */
+esp_arena_handle_t esp_arena_get_current(void);
+
+/**
+ * @brief Allocator hooks for libraries with replaceable malloc and free
+ *
+ * These functions allocate from the arena set with esp_arena_set_current,
+ * or from the heap if the calling task has none. esp_arena_hook_free
+ * ignores memory that belongs to the current arena and passes everything
+ * else to free(), so memory allocated before the arena was set can still be
+ * released.
+ *
+ * For cJSON:
+ *
+ *     cJSON_Hooks hooks = {
+ *         .malloc_fn = esp_arena_hook_malloc,
+ *         .free_fn = esp_arena_hook_free,
+ *     };
+ *     cJSON_InitHooks(&hooks);
+ *
+ * For mbedtls:
+ *
+ *     mbedtls_platform_set_calloc_free(esp_arena_hook_calloc, esp_arena_hook_free);
+ *
+ * Objects allocated while an arena is current must not be used after the
+ * arena is reset or deleted, and must not be freed after it stops being
+ * current.
+ */
+void* esp_arena_hook_malloc(size_t size);
+
+/** @brief calloc() counterpart of esp_arena_hook_malloc */
+void* esp_arena_hook_calloc(size_t n, size_t size);
+
+/** @brief free() counterpart of esp_arena_hook_malloc */
+void esp_arena_hook_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ESP_ARENA_H__
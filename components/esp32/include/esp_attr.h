@@ -26,4 +26,14 @@
 // Forces data into DRAM instead of flash
 #define DRAM_ATTR __attribute__((section(".dram1")))
 
+// Forces code into RTC fast memory. Used for the deep sleep wake stub, see esp_deep_sleep.h
+#define RTC_IRAM_ATTR __attribute__((section(".rtc.text")))
+
+// Forces data into RTC slow memory, which keeps its contents in deep sleep.
+// Initialized on power up, but not when waking from deep sleep.
+#define RTC_DATA_ATTR __attribute__((section(".rtc.data")))
+
+// Forces read-only data into RTC slow memory, for constants used by the wake stub
+#define RTC_RODATA_ATTR __attribute__((section(".rtc.rodata")))
+
 #endif /* __ESP_ATTR_H__ */
@@ -0,0 +1,185 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_BOOT_TIMELINE_H__
+#define __ESP_BOOT_TIMELINE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "soc/cpu.h"
+#include "rom/ets_sys.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Boot timeline
+ *
+ * Records the time at which each boot stage is reached, from the start of the
+ * 2nd stage bootloader to the start of the scheduler, plus marks added by the
+ * application. Times are derived from CCOUNT, which counts CPU cycles since
+ * the CPU came out of reset, so the first entry also tells how long the ROM
+ * loader took.
+ *
+ * The timeline is kept at a fixed address in RTC slow memory: the bootloader
+ * starts it, and the application continues it, so a single report covers
+ * both. The marking functions are inline because the bootloader can't link
+ * against this component.
+ *
+ * CCOUNT is 32 bits wide and wraps after about 18 s at 240 MHz; marks made
+ * later than this after reset have wrong times.
+ */
+
+typedef enum {
+    ESP_BOOT_STAGE_BOOTLOADER_START,    ///< Bootloader entry point; the time spent in the ROM loader
+    ESP_BOOT_STAGE_PARTITION_TABLE,     ///< Bootloader has read the partition table
+    ESP_BOOT_STAGE_LOAD_APP,            ///< Bootloader starts copying the app to RAM
+    ESP_BOOT_STAGE_START_APP,           ///< Bootloader has set up the flash cache and jumps to the app
+    ESP_BOOT_STAGE_APP_START,           ///< App entry point on the PRO CPU
+    ESP_BOOT_STAGE_HEAP_INIT,           ///< Heap allocator initialized
+    ESP_BOOT_STAGE_APP_CPU_UP,          ///< APP CPU started
+    ESP_BOOT_STAGE_CPU_FREQ,            ///< CPU frequency set
+    ESP_BOOT_STAGE_GLOBAL_CTORS,        ///< C++ global constructors done
+    ESP_BOOT_STAGE_SYSTEM_INIT,         ///< IPC, esp_timer and flash driver initialized
+    ESP_BOOT_STAGE_COMPONENTS_INIT,     ///< NVS, event loop, TCP/IP, etc. initialized
+    ESP_BOOT_STAGE_APP_MAIN,            ///< app_main is called
+    ESP_BOOT_STAGE_SCHEDULER_START,     ///< Scheduler starts on the PRO CPU
+    ESP_BOOT_STAGE_APP_MARK,            ///< Mark added with esp_boot_timeline_mark_name
+} esp_boot_stage_t;
+
+#define ESP_BOOT_TIMELINE_MAX_ENTRIES   24
+#define ESP_BOOT_TIMELINE_MAGIC         0x544c4e42  // "BNLT"
+
+/* End of the 8 kB of RTC slow memory; only the esp_time record is below it */
+#define ESP_BOOT_TIMELINE_ADDR          0x50001e00
+
+typedef struct {
+    uint32_t stage;             ///< esp_boot_stage_t
+    uint32_t time_us;           ///< Time since the CPU came out of reset
+    const char* name;           ///< Name of an ESP_BOOT_STAGE_APP_MARK entry, NULL otherwise
+} esp_boot_timeline_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;             ///< Number of valid entries
+    uint32_t base_us;           ///< Time at which CCOUNT was base_ccount
+    uint32_t base_ccount;
+    uint32_t cpu_mhz;           ///< CPU frequency since base_ccount
+    esp_boot_timeline_entry_t entries[ESP_BOOT_TIMELINE_MAX_ENTRIES];
+} esp_boot_timeline_t;
+
+#define ESP_BOOT_TIMELINE   ((esp_boot_timeline_t*) ESP_BOOT_TIMELINE_ADDR)
+
+static inline uint32_t esp_boot_timeline_now_us(void)
+{
+    uint32_t ccount;
+    RSR(CCOUNT, ccount);
+    esp_boot_timeline_t* timeline = ESP_BOOT_TIMELINE;
+    return timeline->base_us + (ccount - timeline->base_ccount) / timeline->cpu_mhz;
+}
+
+/**
+ * @brief Start a new timeline
+ *
+ * Called by the bootloader, and by the app if the bootloader didn't start
+ * the timeline.
+ */
+static inline void esp_boot_timeline_start(void)
+{
+#if CONFIG_ESP32_BOOT_TIMELINE
+    esp_boot_timeline_t* timeline = ESP_BOOT_TIMELINE;
+    timeline->count = 0;
+    timeline->base_us = 0;
+    timeline->base_ccount = 0;
+    timeline->cpu_mhz = ets_get_cpu_frequency();
+    if (timeline->cpu_mhz == 0) {
+        timeline->cpu_mhz = 1;
+    }
+    timeline->magic = ESP_BOOT_TIMELINE_MAGIC;
+#endif
+}
+
+static inline void esp_boot_timeline_add(esp_boot_stage_t stage, const char* name)
+{
+#if CONFIG_ESP32_BOOT_TIMELINE
+    esp_boot_timeline_t* timeline = ESP_BOOT_TIMELINE;
+    if (timeline->magic != ESP_BOOT_TIMELINE_MAGIC ||
+            timeline->count >= ESP_BOOT_TIMELINE_MAX_ENTRIES) {
+        return;
+    }
+    esp_boot_timeline_entry_t* entry = &timeline->entries[timeline->count];
+    entry->stage = stage;
+    entry->time_us = esp_boot_timeline_now_us();
+    entry->name = name;
+    ++timeline->count;
+#endif
+}
+
+/** Record that a boot stage has been reached */
+static inline void esp_boot_timeline_mark(esp_boot_stage_t stage)
+{
+    esp_boot_timeline_add(stage, NULL);
+}
+
+/**
+ * @brief Continue counting time at a new CPU frequency
+ *
+ * To be called right after the CPU frequency has been changed. The cycles
+ * spent switching are counted at the old frequency.
+ */
+static inline void esp_boot_timeline_set_cpu_freq(uint32_t cpu_mhz)
+{
+#if CONFIG_ESP32_BOOT_TIMELINE
+    esp_boot_timeline_t* timeline = ESP_BOOT_TIMELINE;
+    if (timeline->magic != ESP_BOOT_TIMELINE_MAGIC) {
+        return;
+    }
+    uint32_t ccount;
+    RSR(CCOUNT, ccount);
+    timeline->base_us += (ccount - timeline->base_ccount) / timeline->cpu_mhz;
+    timeline->base_ccount = ccount;
+    timeline->cpu_mhz = cpu_mhz;
+#endif
+}
+
+/**
+ * @brief Add a mark to the boot timeline from the application
+ *
+ * @param name name of the mark, must be a string literal or otherwise stay valid
+ */
+void esp_boot_timeline_mark_name(const char* name);
+
+/**
+ * @brief Get the boot timeline
+ *
+ * @return the timeline, or NULL if CONFIG_ESP32_BOOT_TIMELINE is disabled
+ */
+const esp_boot_timeline_t* esp_boot_timeline_get(void);
+
+/**
+ * @brief Print the boot timeline
+ *
+ * Prints one line per entry with the time since reset and the time since the
+ * previous entry, in microseconds.
+ */
+void esp_boot_timeline_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_BOOT_TIMELINE_H__ */
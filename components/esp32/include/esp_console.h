@@ -0,0 +1,81 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_CONSOLE_H__
+#define __ESP_CONSOLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Buffered console output on UART0.
+ *
+ * With CONFIG_CONSOLE_UART_BUFFERED, stdout is queued in a ring buffer of
+ * CONFIG_CONSOLE_UART_TX_BUFFER_SIZE bytes, which the UART interrupt moves
+ * to the transmit FIFO whenever it runs low. A printf then only takes as
+ * long as copying its output, instead of the time to send it at the baud
+ * rate. When the buffer is full, the writer waits for room, or the output
+ * is dropped, depending on CONFIG_CONSOLE_UART_FULL_POLICY.
+ *
+ * Output written directly to the UART, such as with ets_printf, is not
+ * queued, and can appear ahead of stdout output queued before it.
+ */
+
+/**
+ * @brief Start the buffered console
+ *
+ * Called at startup when CONFIG_CONSOLE_UART_BUFFERED is set. Until then,
+ * stdout is written to the UART directly.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the console is started already,
+ *         ESP_ERR_NO_MEM, or an error of esp_intr_alloc
+ */
+esp_err_t esp_console_init(void);
+
+/**
+ * @brief Queue output, used by the stdout implementation
+ *
+ * Callers must serialize their calls.
+ *
+ * @return ESP_OK if the data has been queued or dropped,
+ *         ESP_ERR_INVALID_STATE if the console isn't started
+ */
+esp_err_t esp_console_write(const char *data, size_t size);
+
+/**
+ * @brief Wait until all queued output has been moved to the UART
+ */
+void esp_console_flush(void);
+
+/**
+ * @brief Send the queued output by polling, for the panic handler
+ *
+ * Doesn't take any locks or wait for interrupts.
+ */
+void esp_console_panic_flush(void);
+
+/**
+ * @brief Get the number of bytes dropped because the buffer was full
+ */
+uint32_t esp_console_get_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_CONSOLE_H__ */
@@ -0,0 +1,144 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_CORE_DUMP_H__
+#define __ESP_CORE_DUMP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/xtensa_context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Core dump to flash
+ *
+ * With CONFIG_ESP32_ENABLE_COREDUMP, the panic handler writes the registers
+ * of the CPU which panicked and the TCB and stack of each task to the data
+ * partition of subtype "coredump" in the partition table. The partition is
+ * kept erased while it holds no dump, so that the panic handler only
+ * programs the flash, at about 3 ms per kB, instead of erasing it as well,
+ * which takes about 50 ms per 4 kB sector. The partition is added to a
+ * custom partition table with a line such as:
+ *
+ *     coredump, data, coredump, , 64K
+ *
+ * On the next boot, the application can read the dump with
+ * esp_core_dump_read, e.g. to upload it to a server, then erase it with
+ * esp_core_dump_erase. espcoredump.py, in this component, prints the tasks
+ * and registers of a dump and converts it to an ELF core file for gdb:
+ *
+ *     espcoredump.py elf dump.bin core.elf
+ *     xtensa-esp32-elf-gdb app.elf core.elf
+ *
+ * Dump layout, in little endian words: a core_dump_header_t, the exception
+ * frame of the CPU which panicked (XtExcFrame, frame_size bytes), then for
+ * each task a core_dump_task_t, the TCB (tcb_size bytes) and the stack from
+ * stack_start to stack_end, and at last the CRC32 of the dump after the
+ * magic word. The magic word is written last, so an incomplete dump has none.
+ */
+
+#define ESP_CORE_DUMP_MAGIC     0xe5c0d0e1
+#define ESP_CORE_DUMP_VERSION   1
+
+typedef struct {
+    uint32_t magic;         /*!< ESP_CORE_DUMP_MAGIC */
+    uint32_t version;       /*!< ESP_CORE_DUMP_VERSION */
+    uint32_t length;        /*!< size of the dump in bytes, including header and CRC */
+    uint32_t task_count;    /*!< number of tasks in the dump */
+    uint32_t tcb_size;      /*!< size of a TCB in bytes, multiple of 4 */
+    uint32_t crashed_task;  /*!< TCB address of the task running on the CPU which panicked */
+    uint32_t crashed_cpu;   /*!< CPU which panicked */
+    uint32_t frame_size;    /*!< size of the exception frame which follows */
+} core_dump_header_t;
+
+typedef struct {
+    uint32_t tcb;           /*!< TCB address */
+    uint32_t stack_start;   /*!< lowest stack address in the dump, the saved stack pointer */
+    uint32_t stack_end;     /*!< highest stack address, exclusive */
+} core_dump_task_t;
+
+/**
+ * @brief Find the core dump partition and keep it ready for a dump
+ *
+ * Called from the startup code. If the partition holds no complete dump,
+ * the sectors which aren't erased, after an incomplete dump, are erased.
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NOT_FOUND if there is no core dump partition
+ *         flash errors
+ */
+esp_err_t esp_core_dump_init(void);
+
+/**
+ * @brief Check for a dump written on an earlier panic
+ *
+ * @param[out] out_size  size of the dump, in bytes
+ *
+ * @return ESP_OK if the partition holds a dump with a valid CRC
+ *         ESP_ERR_NOT_FOUND if it doesn't, or there is no core dump partition
+ *         flash errors
+ */
+esp_err_t esp_core_dump_get(size_t* out_size);
+
+/**
+ * @brief Read part of the dump
+ *
+ * @param offset  from the start of the dump, in bytes
+ * @param buf  buffer for the data
+ * @param size  number of bytes to read
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NOT_FOUND if there is no core dump partition
+ *         ESP_ERR_INVALID_ARG if the range is outside the partition
+ *         flash errors
+ */
+esp_err_t esp_core_dump_read(size_t offset, void* buf, size_t size);
+
+/**
+ * @brief Erase the dump, so that the next panic can write one
+ *
+ * Erases the whole partition, which takes tens of milliseconds per 4 kB
+ * sector.
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NOT_FOUND if there is no core dump partition
+ *         flash errors
+ */
+esp_err_t esp_core_dump_erase(void);
+
+/**
+ * @brief Write a core dump to flash
+ *
+ * Called by the panic handler, with the other CPU stalled. A dump already
+ * in the partition is kept, so the partition holds the first panic since
+ * esp_core_dump_erase. Tasks which don't fit into the partition are left
+ * out.
+ *
+ * @param frame  exception frame of the panic
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NOT_FOUND if esp_core_dump_init found no partition
+ *         ESP_ERR_INVALID_STATE if the partition holds a dump already
+ *         ESP_ERR_FLASH_OP_FAIL if writing to flash failed
+ */
+esp_err_t esp_core_dump_to_flash(XtExcFrame* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_CORE_DUMP_H__ */
@@ -0,0 +1,243 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_CORO_H__
+#define __ESP_CORO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/queue.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Stackless coroutines
+ *
+ * A coroutine is a function which returns to its executor whenever it has to
+ * wait, and continues where it left off the next time it is run. Coroutines
+ * don't have stacks of their own: all coroutines of an executor run on the
+ * stack of its task, and each one costs only its esp_coro_t. This makes it
+ * possible to run hundreds of small state machines, for example one per
+ * polled device, in the RAM one task would take.
+ *
+ * Each executor is a task pinned to one CPU, running its coroutines in turn.
+ * A coroutine runs until it waits, it is never preempted by another coroutine
+ * of the same executor.
+ *
+ * The body of a coroutine is written between ESP_CORO_BEGIN and ESP_CORO_END,
+ * and waits using the ESP_CORO_* macros below. They are implemented with a
+ * switch statement, so local variables are not preserved across a wait (keep
+ * state in the structure passed as arg), a wait can't be used inside another
+ * switch statement, and a coroutine can only wait in its own function.
+ *
+ * Example:
+ * @code
+ * static esp_coro_status_t poll_device(esp_coro_t* coro, void* arg)
+ * {
+ *     device_t* dev = (device_t*) arg;
+ *     esp_err_t err;
+ *     ESP_CORO_BEGIN(coro);
+ *     while (true) {
+ *         ESP_CORO_QUEUE_RECEIVE(coro, dev->requests, &dev->request, portMAX_DELAY, err);
+ *         device_send(dev);
+ *         ESP_CORO_DELAY(coro, 10 / portTICK_PERIOD_MS);
+ *     }
+ *     ESP_CORO_END(coro);
+ * }
+ * @endcode
+ */
+
+typedef struct esp_coro_executor* esp_coro_executor_handle_t;
+
+typedef struct esp_coro esp_coro_t;
+
+/** Value returned by a coroutine function, returned by the ESP_CORO_* macros */
+typedef enum {
+    ESP_CORO_WAITING,   ///< The coroutine waits and is run again later
+    ESP_CORO_DONE,      ///< The coroutine returned from ESP_CORO_END and is removed from its executor
+} esp_coro_status_t;
+
+typedef esp_coro_status_t (*esp_coro_func_t)(esp_coro_t* coro, void* arg);
+
+/** What a waiting coroutine is waiting for, private */
+typedef enum {
+    ESP_CORO_WAIT_NONE,     ///< Run again after the other ready coroutines
+    ESP_CORO_WAIT_DELAY,    ///< Run again when the deadline has passed
+    ESP_CORO_WAIT_NOTIFY,   ///< Run again when notified or the deadline has passed
+    ESP_CORO_WAIT_POLL,     ///< Run again when notified, the deadline has passed or every poll period
+} esp_coro_wait_t;
+
+/**
+ * @brief Coroutine, allocated by the application
+ *
+ * All fields are private. The structure must remain valid until the
+ * coroutine is done.
+ */
+struct esp_coro {
+    esp_coro_func_t func;
+    void* arg;
+    esp_coro_executor_handle_t executor;
+    TickType_t deadline;
+    uint16_t resume;                    // Line the coroutine continues at, 0 at the beginning
+    uint8_t state;
+    uint8_t wait;                       // esp_coro_wait_t
+    bool has_deadline;
+    bool notified;
+    TAILQ_ENTRY(esp_coro) entry;        // Link in the ready or waiting list of the executor
+};
+
+/**
+ * @brief Create an executor
+ *
+ * Starts a task running coroutines, pinned to core_id, with a stack of
+ * CONFIG_ESP_CORO_EXECUTOR_STACK_SIZE bytes. The coroutines all share this
+ * stack.
+ *
+ * @param core_id CPU the executor runs on
+ * @param priority priority of the executor task
+ * @param[out] out_handle handle of the new executor
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if core_id or out_handle
+ *         is invalid, ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_coro_executor_create(int core_id, UBaseType_t priority, esp_coro_executor_handle_t* out_handle);
+
+/**
+ * @brief Start a coroutine
+ *
+ * The coroutine is run by the executor from the beginning of func. It may
+ * not be started again before it is done. Can be called from any task,
+ * including coroutines.
+ *
+ * @param executor executor to run the coroutine
+ * @param coro coroutine
+ * @param func coroutine function
+ * @param arg argument to pass into func each time it is run
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if an argument is NULL
+ */
+esp_err_t esp_coro_start(esp_coro_executor_handle_t executor, esp_coro_t* coro, esp_coro_func_t func, void* arg);
+
+/**
+ * @brief Notify a coroutine
+ *
+ * Makes a coroutine waiting in ESP_CORO_WAIT_NOTIFY continue, or remembers
+ * the notification if it isn't waiting yet. Also makes a coroutine waiting in
+ * ESP_CORO_WAIT_UNTIL or one of the queue and socket waits check its
+ * condition right away rather than at the next poll, so tasks feeding a
+ * queue, software timer callbacks, etc. can wake their coroutine without
+ * latency.
+ *
+ * @param coro coroutine
+ */
+void esp_coro_notify(esp_coro_t* coro);
+
+/**
+ * @brief Notify a coroutine from an ISR
+ *
+ * @param coro coroutine
+ * @param[out] higher_priority_task_woken set to pdTRUE if the executor task
+ *             has a priority above the interrupted task, must be initialized
+ *             to pdFALSE by the caller
+ */
+void esp_coro_notify_from_isr(esp_coro_t* coro, BaseType_t* higher_priority_task_woken);
+
+/**
+ * @brief Check if a socket is readable or writable, without blocking
+ *
+ * Used by ESP_CORO_WAIT_READABLE and ESP_CORO_WAIT_WRITABLE.
+ *
+ * @param fd lwIP socket
+ * @param write true to check for writability, false for readability
+ *
+ * @return true if ready, or if the socket has an error
+ */
+bool esp_coro_socket_ready(int fd, bool write);
+
+/* Used by the macros below, not to be called directly. */
+void esp_coro_prepare_wait(esp_coro_t* coro, esp_coro_wait_t wait, TickType_t ticks_to_wait);
+bool esp_coro_timed_out(esp_coro_t* coro);
+bool esp_coro_take_notify(esp_coro_t* coro);
+
+/** Start of the body of a coroutine function */
+#define ESP_CORO_BEGIN(coro) \
+    switch ((coro)->resume) { case 0:
+
+/** End of the body of a coroutine function, returns ESP_CORO_DONE */
+#define ESP_CORO_END(coro) \
+    } (coro)->resume = 0; return ESP_CORO_DONE
+
+/** Let the other ready coroutines of the executor run */
+#define ESP_CORO_YIELD(coro) do { \
+        esp_coro_prepare_wait((coro), ESP_CORO_WAIT_NONE, portMAX_DELAY); \
+        (coro)->resume = __LINE__; return ESP_CORO_WAITING; case __LINE__:; \
+    } while (0)
+
+/** Wait for ticks ticks */
+#define ESP_CORO_DELAY(coro, ticks) do { \
+        esp_coro_prepare_wait((coro), ESP_CORO_WAIT_DELAY, (ticks)); \
+        (coro)->resume = __LINE__; return ESP_CORO_WAITING; case __LINE__:; \
+    } while (0)
+
+/**
+ * Wait for esp_coro_notify, for at most ticks ticks. Sets err to ESP_OK if
+ * notified, ESP_ERR_TIMEOUT otherwise.
+ */
+#define ESP_CORO_WAIT_NOTIFY(coro, ticks, err) do { \
+        esp_coro_prepare_wait((coro), ESP_CORO_WAIT_NOTIFY, (ticks)); \
+        (coro)->resume = __LINE__; case __LINE__: \
+        if (esp_coro_take_notify(coro)) { (err) = ESP_OK; } \
+        else if (esp_coro_timed_out(coro)) { (err) = ESP_ERR_TIMEOUT; } \
+        else { return ESP_CORO_WAITING; } \
+    } while (0)
+
+/**
+ * Wait until cond is true, for at most ticks ticks. cond is evaluated each
+ * time the coroutine is notified and every CONFIG_ESP_CORO_POLL_PERIOD_MS.
+ * Sets err to ESP_OK if cond became true, ESP_ERR_TIMEOUT otherwise.
+ */
+#define ESP_CORO_WAIT_UNTIL(coro, cond, ticks, err) do { \
+        esp_coro_prepare_wait((coro), ESP_CORO_WAIT_POLL, (ticks)); \
+        (coro)->resume = __LINE__; case __LINE__: \
+        if (cond) { (err) = ESP_OK; } \
+        else if (esp_coro_timed_out(coro)) { (err) = ESP_ERR_TIMEOUT; } \
+        else { return ESP_CORO_WAITING; } \
+    } while (0)
+
+/** Receive an item from a FreeRTOS queue, see ESP_CORO_WAIT_UNTIL */
+#define ESP_CORO_QUEUE_RECEIVE(coro, queue, item, ticks, err) \
+    ESP_CORO_WAIT_UNTIL(coro, xQueueReceive((queue), (item), 0) == pdTRUE, ticks, err)
+
+/** Send an item to the back of a FreeRTOS queue, see ESP_CORO_WAIT_UNTIL */
+#define ESP_CORO_QUEUE_SEND(coro, queue, item, ticks, err) \
+    ESP_CORO_WAIT_UNTIL(coro, xQueueSend((queue), (item), 0) == pdTRUE, ticks, err)
+
+/** Wait for an lwIP socket to be readable, see ESP_CORO_WAIT_UNTIL */
+#define ESP_CORO_WAIT_READABLE(coro, fd, ticks, err) \
+    ESP_CORO_WAIT_UNTIL(coro, esp_coro_socket_ready((fd), false), ticks, err)
+
+/** Wait for an lwIP socket to be writable, see ESP_CORO_WAIT_UNTIL */
+#define ESP_CORO_WAIT_WRITABLE(coro, fd, ticks, err) \
+    ESP_CORO_WAIT_UNTIL(coro, esp_coro_socket_ready((fd), true), ticks, err)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_CORO_H__ */
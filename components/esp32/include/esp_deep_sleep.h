@@ -0,0 +1,185 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_DEEP_SLEEP_H__
+#define __ESP_DEEP_SLEEP_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Deep sleep and light sleep
+ *
+ * In deep sleep, the CPUs, most of the RAM and the digital peripherals are
+ * powered off. Only the RTC domain stays on: the RTC timer, the RTC IOs and
+ * the RTC memories. Waking up resets the chip. Variables marked with
+ * RTC_DATA_ATTR are kept in RTC slow memory; the bootloader doesn't load
+ * their initial values again when waking from deep sleep.
+ *
+ * Before the bootloader is even loaded, the ROM calls the deep sleep wake
+ * stub, a function in RTC fast memory (RTC_IRAM_ATTR). The stub can check a
+ * sensor, count wakeups in RTC_DATA_ATTR variables and go back to deep sleep
+ * with esp_wake_stub_sleep_again, so that most wakeups take microseconds
+ * instead of a full boot. When the stub returns, the chip boots normally.
+ *
+ * In light sleep, the CPUs and the digital peripherals are clock gated and
+ * keep their state; esp_light_sleep_start returns once a wakeup source
+ * triggers. esp_timer is moved forward by the time spent sleeping, the
+ * FreeRTOS tick count is not.
+ *
+ * Wakeup sources are enabled with the esp_sleep_enable_... functions and stay
+ * enabled until esp_sleep_disable_wakeup_sources is called.
+ */
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED,     ///< Not a wakeup from sleep, or woken by another source
+    ESP_SLEEP_WAKEUP_EXT0,          ///< RTC IO selected by esp_sleep_enable_ext0_wakeup
+    ESP_SLEEP_WAKEUP_GPIO,          ///< GPIO selected by esp_sleep_enable_gpio_wakeup (light sleep only)
+    ESP_SLEEP_WAKEUP_TIMER,         ///< Timer set by esp_sleep_enable_timer_wakeup
+} esp_sleep_wakeup_cause_t;
+
+/**
+ * @brief Wake up after some time
+ *
+ * @param time_in_us  time to sleep, in microseconds
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if time_in_us is 0
+ */
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+
+/**
+ * @brief Wake up when an RTC IO has the given level
+ *
+ * Works in deep sleep and light sleep. Only one pin can be selected, and
+ * only GPIOs which are also RTC IOs: 0, 2, 4, 12-15, 25-27 and 32-39. The
+ * pin is routed to the RTC IO mux and stays there after waking up, and the
+ * RTC peripherals are kept powered during deep sleep.
+ *
+ * @param gpio_num  GPIO number
+ * @param level     0 to wake up on low level, 1 on high level
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the pin is not an RTC IO
+ *         or the level isn't 0 or 1
+ */
+esp_err_t esp_sleep_enable_ext0_wakeup(int gpio_num, int level);
+
+/**
+ * @brief Wake up from light sleep when a GPIO has the given level
+ *
+ * Any number of pins can be selected. The GPIO interrupt type of the pins is
+ * set to the level; this doesn't enable their interrupt.
+ *
+ * @param gpio_num  GPIO number, 0 to 39
+ * @param level     0 to wake up on low level, 1 on high level
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for invalid arguments
+ */
+esp_err_t esp_sleep_enable_gpio_wakeup(int gpio_num, int level);
+
+/**
+ * @brief Disable all wakeup sources
+ */
+void esp_sleep_disable_wakeup_sources(void);
+
+/**
+ * @brief Enter deep sleep
+ *
+ * Saves the time with esp_time_save, sends the console output, sets the wake
+ * stub and powers down everything but the RTC domain. Without a wakeup
+ * source, only a reset wakes the chip up.
+ */
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+
+/**
+ * @brief Enter light sleep
+ *
+ * Stalls the other CPU and sleeps until one of the enabled wakeup sources
+ * triggers. Interrupts are disabled while sleeping, so pending interrupts
+ * are handled once this returns.
+ *
+ * @return ESP_OK after waking up,
+ *         ESP_ERR_INVALID_STATE if no wakeup source is enabled
+ */
+esp_err_t esp_light_sleep_start(void);
+
+/**
+ * @brief Get the source which ended the last sleep
+ *
+ * After a reset, the source which woke the chip from deep sleep.
+ *
+ * @return wakeup cause, ESP_SLEEP_WAKEUP_UNDEFINED if the last reset wasn't
+ *         a wakeup from deep sleep and there was no light sleep since
+ */
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
+
+/**
+ * @brief Deep sleep wake stub
+ *
+ * Called by the ROM right after waking from deep sleep, from RTC fast
+ * memory, before the bootloader is loaded. The flash cache isn't set up yet:
+ * the stub and all it calls have to be in RTC_IRAM_ATTR, its constants in
+ * RTC_RODATA_ATTR and its variables in RTC_DATA_ATTR. Only ROM functions can be
+ * used. The ROM only calls the stub if the first 2 kB of RTC fast memory are
+ * unchanged since entering deep sleep.
+ */
+typedef void (*esp_deep_sleep_wake_stub_fn_t)(void);
+
+/**
+ * @brief Default wake stub, clears the flash MMU of the PRO CPU and returns
+ *
+ * Wake stubs provided by the application should call it before returning.
+ */
+void esp_default_wake_deep_sleep(void);
+
+/**
+ * @brief Wake stub used unless another one is set
+ *
+ * A weak alias of esp_default_wake_deep_sleep, applications can provide
+ * their own esp_wake_deep_sleep, placed with RTC_IRAM_ATTR.
+ */
+void esp_wake_deep_sleep(void);
+
+/**
+ * @brief Set the wake stub for the next deep sleep
+ *
+ * @param new_stub  wake stub, placed with RTC_IRAM_ATTR; NULL selects
+ *                  esp_wake_deep_sleep
+ */
+void esp_set_deep_sleep_wake_stub(esp_deep_sleep_wake_stub_fn_t new_stub);
+
+/**
+ * @brief Get the wake stub set for the next deep sleep
+ *
+ * @return wake stub, esp_wake_deep_sleep unless another one has been set
+ */
+esp_deep_sleep_wake_stub_fn_t esp_get_deep_sleep_wake_stub(void);
+
+/**
+ * @brief Go back to deep sleep from a wake stub
+ *
+ * Only to be called from a wake stub. Sleeps for the time set with
+ * esp_sleep_enable_timer_wakeup before the last esp_deep_sleep_start, or
+ * until another enabled source triggers, and runs the same wake stub again
+ * when waking up. Doesn't return.
+ */
+void esp_wake_stub_sleep_again(void) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_DEEP_SLEEP_H__ */
@@ -20,6 +20,7 @@
 
 #include "esp_err.h"
 #include "esp_wifi.h"
+#include "esp_event_loop.h"
 
 #include "tcpip_adapter.h"
 
@@ -129,10 +130,52 @@ typedef esp_err_t (*system_event_cb_t)(void *ctx, system_event_t *event);
   */
 system_event_cb_t esp_event_set_cb(system_event_cb_t cb, void *ctx);
 
+/** The event is queued ahead of other events, see esp_event_set_policy */
+#define ESP_EVENT_POLICY_PRIORITY   (1 << 0)
+/** A queued event is replaced by a newer one of the same ID, see esp_event_set_policy */
+#define ESP_EVENT_POLICY_COALESCE   (1 << 1)
+
+typedef struct {
+    uint32_t dropped;                /**< events dropped by esp_event_send because the queues were full */
+    uint32_t coalesced;              /**< events replaced by a newer event of the same ID */
+    uint32_t queue_high_water;       /**< largest number of events seen waiting in the event queue */
+    uint32_t prio_queue_high_water;  /**< largest number of events seen waiting in the priority queue */
+    uint32_t latency_max_us;         /**< longest time from esp_event_send until the event task took the event */
+    uint32_t pool_high_water;        /**< largest number of event pool slots seen in use */
+    uint32_t pool_exhausted;         /**< events queued by copy because the event pool was empty */
+} esp_event_stats_t;
+
+typedef struct {
+    int64_t sent;        /**< esp_event_send of the event, 0 if unknown */
+    int64_t dispatched;  /**< the event task took the event from the queue */
+    int64_t handled;     /**< the default handler, the callback and the system loop handlers returned */
+} esp_event_timing_t;
+
+/** Phases of a station connection, see esp_event_get_connect_timeline */
+typedef enum {
+    ESP_EVENT_CONNECT_START,            /**< connection started, see esp_event_connect_timeline_start */
+    ESP_EVENT_CONNECT_CONNECTED,        /**< SYSTEM_EVENT_STA_CONNECTED taken by the event task: scanned, authenticated and associated */
+    ESP_EVENT_CONNECT_DHCP_START,       /**< DHCP client started, not reached with a static IP */
+    ESP_EVENT_CONNECT_GOT_IP_SENT,      /**< SYSTEM_EVENT_STA_GOT_IP sent: DHCP lease bound, or static IP set */
+    ESP_EVENT_CONNECT_GOT_IP_DISPATCHED,/**< SYSTEM_EVENT_STA_GOT_IP taken by the event task */
+    ESP_EVENT_CONNECT_GOT_IP_HANDLED,   /**< SYSTEM_EVENT_STA_GOT_IP handled by the callback and the system loop handlers */
+    ESP_EVENT_CONNECT_PHASE_MAX
+} esp_event_connect_phase_t;
+
+typedef struct {
+    int64_t time[ESP_EVENT_CONNECT_PHASE_MAX];  /**< esp_timer_get_time when each phase was reached, 0 if not reached */
+} esp_event_connect_timeline_t;
+
 /**
   * @brief  Send a event to event task
   *
   * @attention 1. Other task/modules, such as the TCPIP module, can call this API to send an event to event task
+  * @attention 2. This API doesn't block. Events with ESP_EVENT_POLICY_PRIORITY go to a separate queue, which the
+  *               event task empties first, and to the normal queue when that one is full. Events with
+  *               ESP_EVENT_POLICY_COALESCE replace a queued event of the same ID instead of taking another entry.
+  * @attention 3. The event is copied once, into a slot of a pool of CONFIG_SYSTEM_EVENT_POOL_SIZE events, and the
+  *               queues only hold pointers to the slots. Handlers get a pointer to the slot. When the pool is
+  *               empty, the event is copied into the queue returned by esp_event_get_handler instead.
   *
   * @param  system_event_t * event : event
   *
@@ -141,6 +184,95 @@ system_event_cb_t esp_event_set_cb(system_event_cb_t cb, void *ctx);
   */
 esp_err_t esp_event_send(system_event_t *event);
 
+/**
+  * @brief  Keep the event passed to a handler valid after the handler returns
+  *
+  * Handlers, including the callback set with esp_event_set_cb, get a pointer to the event which is only
+  * valid until they return. A handler which passes the event on to another task can call this function
+  * instead of copying the event, and the other task calls esp_event_release when it is done with it.
+  *
+  * @param  system_event_t *event : event passed to the handler
+  *
+  * @return ESP_OK : succeed, call esp_event_release later
+  * @return ESP_ERR_NOT_SUPPORTED : the event isn't held by the event pool, copy it
+  * @return ESP_ERR_INVALID_STATE : the event was already released, or has too many references
+  */
+esp_err_t esp_event_retain(system_event_t *event);
+
+/**
+  * @brief  Release an event kept with esp_event_retain
+  *
+  * @param  system_event_t *event : event
+  */
+void esp_event_release(system_event_t *event);
+
+/**
+  * @brief  Set how esp_event_send queues events of the given ID
+  *
+  * By default, station and soft-AP start, stop, connection, disconnection and got IP events have
+  * ESP_EVENT_POLICY_PRIORITY, and scan done, auth mode change and probe request events have
+  * ESP_EVENT_POLICY_COALESCE.
+  *
+  * Events which the WiFi library puts directly into the queue returned by esp_event_get_handler are never
+  * coalesced or prioritized.
+  *
+  * @param  system_event_id_t event_id : event ID
+  * @param  uint32_t policy : combination of ESP_EVENT_POLICY_PRIORITY and ESP_EVENT_POLICY_COALESCE, or 0
+  *
+  * @return ESP_OK : succeed
+  * @return ESP_ERR_INVALID_ARG : invalid ID or policy
+  */
+esp_err_t esp_event_set_policy(system_event_id_t event_id, uint32_t policy);
+
+/**
+  * @brief  Get the event queue statistics
+  *
+  * @param  esp_event_stats_t *stats : filled with the counters since startup
+  */
+void esp_event_get_stats(esp_event_stats_t *stats);
+
+/**
+  * @brief  Get the times at which the last event of an ID was sent, dispatched and handled
+  *
+  * @attention 1. system_event_t is shared with the WiFi library, so the times are kept per event ID instead of in the
+  *               events. When several events of an ID are queued, sent is the time of the oldest one, and is 0 for
+  *               the others.
+  * @attention 2. Events which the WiFi library puts directly into the queue have no sent time.
+  *
+  * @param  system_event_id_t event_id : event ID
+  * @param  esp_event_timing_t *timing : filled with esp_timer_get_time values, 0 for times not known
+  *
+  * @return ESP_OK : succeed
+  * @return ESP_ERR_INVALID_ARG : invalid ID
+  */
+esp_err_t esp_event_get_timing(system_event_id_t event_id, esp_event_timing_t *timing);
+
+/**
+  * @brief  Start a new station connection timeline
+  *
+  * The timeline records when a connection reaches each esp_event_connect_phase_t. It is started by the
+  * automatic connection at WiFi startup and by each SYSTEM_EVENT_STA_DISCONNECTED; applications which call
+  * esp_wifi_connect themselves call this right before. Scan, authentication and association happen inside
+  * the WiFi library and are reported as one phase.
+  */
+void esp_event_connect_timeline_start(void);
+
+/**
+  * @brief  Get the timeline of the last station connection
+  *
+  * @param  esp_event_connect_timeline_t *timeline : filled with the times of the phases reached since the
+  *                                                  last start
+  */
+void esp_event_get_connect_timeline(esp_event_connect_timeline_t *timeline);
+
+/**
+  * @brief  Print the timeline of the last station connection
+  *
+  * Prints one line per phase reached with the time since the start of the connection and the time since the
+  * previous phase, in microseconds.
+  */
+void esp_event_connect_timeline_print(void);
+
 /**
   * @brief  Get the event handler
   *
@@ -153,6 +285,23 @@ esp_err_t esp_event_send(system_event_t *event);
   */
 void *esp_event_get_handler(void);
 
+/** Base of the system events, with system_event_id_t IDs and system_event_t data */
+ESP_EVENT_DECLARE_BASE(SYSTEM_EVENT);
+
+/**
+  * @brief  Get the loop which dispatches system events
+  *
+  * Handlers registered on this loop with esp_event_handler_register_with are
+  * called from the event task, after the default handling of the event and
+  * after the callback set with esp_event_set_cb. Any number of components can
+  * register handlers this way instead of chaining esp_event_set_cb callbacks.
+  *
+  * Events can't be posted to this loop, use esp_event_send.
+  *
+  * @return the system event loop, or NULL before esp_event_init
+  */
+esp_event_loop_handle_t esp_event_get_system_loop(void);
+
 /**
   * @brief  Init the event module
   *         Create the event handler and task
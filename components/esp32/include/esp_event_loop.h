@@ -0,0 +1,178 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_EVENT_LOOP_H__
+#define __ESP_EVENT_LOOP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Event loop library
+ *
+ * An event loop has a queue of events and calls the handlers registered for
+ * each event, either from its own task or from a task which calls
+ * esp_event_loop_run. Any number of loops can be created, and any number of
+ * handlers registered on each.
+ *
+ * Events are identified by a base, which names a family of events such as
+ * those of one driver, and an ID within that base. Bases are compared by
+ * address, so each is defined once with ESP_EVENT_DEFINE_BASE and declared
+ * with ESP_EVENT_DECLARE_BASE where it is used.
+ *
+ * Handlers are registered for one (base, ID) pair, for all IDs of a base
+ * (ESP_EVENT_ANY_ID) or for all events (ESP_EVENT_ANY_BASE). All handlers
+ * of an event get a pointer to the same copy of the event data: data of up
+ * to ESP_EVENT_INLINE_DATA_SIZE bytes travels in the queue item, larger
+ * data is copied once into the heap, and esp_event_post_ptr_to passes the
+ * caller's buffer without any copy.
+ */
+
+typedef const char* esp_event_base_t;
+
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t id
+#define ESP_EVENT_DEFINE_BASE(id) esp_event_base_t id = #id
+
+#define ESP_EVENT_ANY_BASE      NULL    ///< Register for events of all bases
+#define ESP_EVENT_ANY_ID        -1      ///< Register for all events of a base
+
+/** Event data up to this size is stored in the queue item */
+#define ESP_EVENT_INLINE_DATA_SIZE  16
+
+typedef struct esp_event_loop* esp_event_loop_handle_t;
+
+/**
+ * @brief Event handler
+ *
+ * @param handler_arg argument given when the handler was registered
+ * @param base base of the event
+ * @param id ID of the event
+ * @param event_data data of the event, only valid during the call; shared
+ *                   with the other handlers of the event, so must not be modified
+ */
+typedef void (*esp_event_handler_t)(void* handler_arg, esp_event_base_t base, int32_t id, void* event_data);
+
+typedef struct {
+    uint32_t queue_size;            ///< Number of events which can be queued
+    const char* task_name;          ///< Name of the loop task, NULL to create no task
+    UBaseType_t task_priority;      ///< Priority of the loop task
+    uint32_t task_stack_size;       ///< Stack size of the loop task
+    BaseType_t task_core_id;        ///< CPU the loop task is pinned to, or tskNO_AFFINITY
+} esp_event_loop_args_t;
+
+/**
+ * @brief Create an event loop
+ *
+ * @param args parameters of the loop; if task_name is NULL, events are
+ *             dispatched by calling esp_event_loop_run
+ * @param[out] loop handle of the new loop
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if queue_size is 0, or ESP_ERR_NO_MEM
+ */
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t* args, esp_event_loop_handle_t* loop);
+
+/**
+ * @brief Delete an event loop, its task, its handlers and the queued events
+ *
+ * Must not be called from a handler of the loop.
+ */
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t loop);
+
+/**
+ * @brief Dispatch the events of a loop without task
+ *
+ * Waits up to ticks_to_run for events and dispatches all events which arrive
+ * meanwhile.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if the loop has its own task
+ */
+esp_err_t esp_event_loop_run(esp_event_loop_handle_t loop, TickType_t ticks_to_run);
+
+/**
+ * @brief Register a handler
+ *
+ * A handler can be registered several times, for different events. Handlers of
+ * a loop may register more handlers, and may unregister themselves, but not
+ * other handlers.
+ *
+ * @param loop event loop
+ * @param base base of the events, or ESP_EVENT_ANY_BASE
+ * @param id ID of the events, or ESP_EVENT_ANY_ID
+ * @param handler function to call
+ * @param handler_arg argument to pass to the handler
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for an ID without base, or ESP_ERR_NO_MEM
+ */
+esp_err_t esp_event_handler_register_with(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                                          esp_event_handler_t handler, void* handler_arg);
+
+/**
+ * @brief Unregister a handler
+ *
+ * Arguments must be the same as when the handler was registered.
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if the handler isn't registered
+ */
+esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                                            esp_event_handler_t handler);
+
+/**
+ * @brief Post an event to a loop
+ *
+ * The event data is copied, so the caller's buffer may be reused when this
+ * returns.
+ *
+ * @param loop event loop
+ * @param base base of the event, not ESP_EVENT_ANY_BASE
+ * @param id ID of the event, not ESP_EVENT_ANY_ID
+ * @param event_data data to pass to the handlers, may be NULL
+ * @param event_data_size size of the data
+ * @param ticks_to_wait time to wait for room in the queue
+ *
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the queue stayed full, or ESP_ERR_NO_MEM
+ */
+esp_err_t esp_event_post_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                            const void* event_data, size_t event_data_size, TickType_t ticks_to_wait);
+
+/**
+ * @brief Post an event to a loop, passing the caller's buffer as event data
+ *
+ * The buffer is handed over to the loop, which calls free_fn on it once all
+ * handlers have been called, or if the event can't be queued.
+ *
+ * @param free_fn function to free event_data, or NULL if it doesn't need to be freed
+ *
+ * @return ESP_OK, or ESP_ERR_TIMEOUT if the queue stayed full
+ */
+esp_err_t esp_event_post_ptr_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                                void* event_data, void (*free_fn)(void*), TickType_t ticks_to_wait);
+
+/**
+ * @brief Call the handlers of an event right away, from the calling task
+ *
+ * For event sources which already run in a task of their own.
+ */
+esp_err_t esp_event_dispatch_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, void* event_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_EVENT_LOOP_H__ */
@@ -0,0 +1,78 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_INIT_H__
+#define __ESP_INIT_H__
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialization steps with dependencies
+ *
+ * A set of initialization steps is described as a table of esp_init_step_t.
+ * Each step names the steps which have to be done before it; steps which
+ * don't depend on each other can run at the same time on both CPUs.
+ *
+ * The startup code uses this to initialize the system components, see
+ * CONFIG_ESP32_PARALLEL_STARTUP. Components and applications can use it for
+ * their own initialization as well.
+ */
+
+#define ESP_INIT_ANY_CPU    (-1)
+
+/** NULL terminated list of dependencies, for esp_init_step_t::deps */
+#define ESP_INIT_DEPS(...)  ((const char* const[]) { __VA_ARGS__, NULL })
+
+typedef struct {
+    const char* name;           ///< Name of the step, used in deps and in logs
+    esp_err_t (*func)(void);    ///< Function doing the initialization
+    const char* const* deps;    ///< Names of the steps to run first, NULL terminated; NULL if none
+    int cpu;                    ///< CPU the step has to run on, or ESP_INIT_ANY_CPU
+} esp_init_step_t;
+
+/**
+ * @brief Run initialization steps
+ *
+ * Runs all steps, each one after the steps it depends on. When called from
+ * a task on a dual core system, a helper task is started on the other CPU
+ * and both CPUs run steps. Otherwise, including before the scheduler is
+ * started, the steps are run one after the other on the calling CPU, in an
+ * order respecting the dependencies.
+ *
+ * A step which fails is logged; the steps depending on it are still run.
+ *
+ * If some steps are pinned to a CPU, the calling task has to be pinned to
+ * the CPU it runs on.
+ *
+ * @param steps table of steps
+ * @param count number of entries in steps
+ *
+ * @return ESP_OK if all steps succeeded,
+ *         ESP_ERR_INVALID_ARG if a dependency is unknown or there is a
+ *         dependency cycle, in which case no step is run,
+ *         ESP_ERR_NO_MEM if out of memory,
+ *         otherwise the error returned by the first step which failed
+ */
+esp_err_t esp_init_run(const esp_init_step_t* steps, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_INIT_H__ */
@@ -0,0 +1,144 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef __ESP_INTR_ALLOC_H__
+#define __ESP_INTR_ALLOC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Interrupt allocator
+ *
+ * Each CPU has 32 interrupt lines. Peripheral interrupt sources are routed to
+ * them through the interrupt matrix, separately for each CPU. The allocator
+ * picks a free line of a suitable level and type on the chosen CPU, routes the
+ * source to it and installs the handler in the handler table of that CPU only,
+ * so the handler runs on that CPU and nowhere else.
+ *
+ * Each line carries one source; interrupt lines are not shared.
+ *
+ * Lines used by the system (see the table in soc/soc.h) and lines set up
+ * directly with xt_set_interrupt_handler are never handed out.
+ */
+
+/* Acceptable interrupt levels. If none are given, any of levels 1 to 3 may be
+ * used; the lowest free level is preferred. Only levels up to 3 can have C
+ * handlers. */
+#define ESP_INTR_FLAG_LEVEL1        (1<<1)
+#define ESP_INTR_FLAG_LEVEL2        (1<<2)
+#define ESP_INTR_FLAG_LEVEL3        (1<<3)
+#define ESP_INTR_FLAG_LOWMED        (ESP_INTR_FLAG_LEVEL1|ESP_INTR_FLAG_LEVEL2|ESP_INTR_FLAG_LEVEL3)
+/* Use an edge triggered line, for edge type interrupt sources */
+#define ESP_INTR_FLAG_EDGE          (1<<9)
+/* The handler and everything it uses is in IRAM or DRAM. Such interrupts keep
+ * running while the flash cache is disabled, all others are masked then. */
+#define ESP_INTR_FLAG_IRAM          (1<<10)
+/* Allocate the interrupt disabled, enable it later with esp_intr_enable */
+#define ESP_INTR_FLAG_INTRDISABLED  (1<<11)
+
+typedef void (*intr_handler_t)(void* arg);
+
+typedef struct intr_handle_data_t* intr_handle_t;
+
+/**
+ * @brief Allocate an interrupt line on the calling CPU
+ *
+ * Same as esp_intr_alloc_pinned_to_core with the CPU the caller is running on.
+ * Call it from a task pinned to that CPU, or use esp_intr_alloc_pinned_to_core.
+ */
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void* arg, intr_handle_t* ret_handle);
+
+/**
+ * @brief Allocate an interrupt line on the given CPU
+ *
+ * Finds a free interrupt line of the CPU matching the flags, routes the
+ * interrupt source to it, installs the handler and enables the line.
+ * When cpu is not the calling CPU, the handler is installed by the IPC task of
+ * that CPU, and the call blocks until that is done.
+ *
+ * @param source  Peripheral interrupt source, one of ETS_*_INTR_SOURCE
+ * @param flags   ESP_INTR_FLAG_* values
+ * @param handler Interrupt handler, runs on the given CPU
+ * @param arg     Argument passed to the handler
+ * @param cpu     CPU the interrupt is bound to
+ * @param[out] ret_handle  Handle of the interrupt, may be NULL if the interrupt
+ *                         is never freed, enabled or disabled
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if an argument is invalid
+ *         ESP_ERR_NOT_FOUND if the CPU has no free line matching the flags
+ *         ESP_ERR_NO_MEM if the handle can't be allocated
+ *         ESP_ERR_INVALID_STATE if cpu is another CPU and the scheduler isn't running
+ */
+esp_err_t esp_intr_alloc_pinned_to_core(int source, int flags, intr_handler_t handler, void* arg,
+                                        int cpu, intr_handle_t* ret_handle);
+
+/**
+ * @brief Disconnect the source, uninstall the handler and free the line
+ *
+ * Must be called from a task.
+ */
+esp_err_t esp_intr_free(intr_handle_t handle);
+
+/**
+ * @brief Enable an interrupt
+ *
+ * The source is routed to the interrupt line again. Can be called from any CPU,
+ * and from an interrupt handler.
+ */
+esp_err_t esp_intr_enable(intr_handle_t handle);
+
+/**
+ * @brief Disable an interrupt
+ *
+ * The source is disconnected from the interrupt line in the interrupt matrix.
+ * Can be called from any CPU, and from an interrupt handler.
+ */
+esp_err_t esp_intr_disable(intr_handle_t handle);
+
+/**
+ * @brief Get the CPU an interrupt is bound to
+ */
+int esp_intr_get_cpu(intr_handle_t handle);
+
+/**
+ * @brief Get the interrupt line number of an interrupt
+ */
+int esp_intr_get_intno(intr_handle_t handle);
+
+/**
+ * @brief Mask all interrupts not allocated with ESP_INTR_FLAG_IRAM on the calling CPU
+ *
+ * Used by the flash driver while the cache is disabled. Calls don't nest;
+ * each call must be followed by esp_intr_noniram_enable on the same CPU.
+ */
+void esp_intr_noniram_disable();
+
+/**
+ * @brief Unmask the interrupts masked by esp_intr_noniram_disable on the calling CPU
+ */
+void esp_intr_noniram_enable();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_INTR_ALLOC_H__ */
@@ -16,9 +16,22 @@
 #define __ESP_IPC_H__
 
 #include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 typedef void (*esp_ipc_func_t)(void* arg);
 
+/**
+ * @brief Completion of a call made with esp_ipc_call_future
+ *
+ * Contents are private; the structure is provided by the caller so that
+ * no memory has to be allocated for each call.
+ */
+typedef struct {
+    SemaphoreHandle_t done;     /*!< Given by the IPC task once the function has returned */
+    StaticQueue_t done_buf;     /*!< Storage of the done semaphore */
+} esp_ipc_future_t;
+
 /**
  * @brief Inter-processor call APIs
  *
@@ -38,6 +51,13 @@ typedef void (*esp_ipc_func_t)(void* arg);
  * the esp_ipc_call_* functions to be used. One of these tasks will be
  * woken up to execute the callback provided to esp_ipc_call_nonblocking or
  * esp_ipc_call_blocking.
+ *
+ * Each CPU has a queue of CONFIG_ESP_IPC_QUEUE_SIZE requests, which the task
+ * of that CPU runs in order, as many as are queued each time it wakes up.
+ * esp_ipc_call uses a separate slot which is served before the queue.
+ *
+ * The tasks are IRAM-safe, so the functions and completion callbacks passed
+ * to the esp_ipc_call_* functions must be placed in IRAM.
  */
 void esp_ipc_init();
 
@@ -51,6 +71,10 @@ void esp_ipc_init();
  * If another IPC call is already being executed, this function will also wait
  * for it to complete.
  *
+ * The call doesn't wait behind requests in the queue of the CPU: it is run as
+ * soon as the function the task is running, if any, returns. This is the call
+ * used by the flash driver to stop the other CPU.
+ *
  * In single-core mode, returns ESP_ERR_INVALID_ARG for cpu_id 1.
  *
  * @param cpu_id CPU where function should be executed (0 or 1)
@@ -84,5 +108,64 @@ esp_err_t esp_ipc_call(uint32_t cpu_id, esp_ipc_func_t func, void* arg);
 esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void* arg);
 
 
+/**
+ * @brief Queue a function to be executed on the given CPU
+ *
+ * Adds func(arg) to the queue of the CPU indicated by cpu_id and returns
+ * without waiting for it to run. If done_cb is not NULL, done_cb(done_arg) is
+ * called on that CPU once func has returned. Calls queued for the same CPU
+ * are run in the order they were queued.
+ *
+ * If the queue is full, this function waits for an entry to become free.
+ *
+ * In single-core mode, returns ESP_ERR_INVALID_ARG for cpu_id 1.
+ *
+ * @param cpu_id CPU where function should be executed (0 or 1)
+ * @param func pointer to a function which should be executed
+ * @param arg arbitrary argument to be passed into function
+ * @param done_cb function to call when func has finished, or NULL
+ * @param done_arg argument to be passed into done_cb
+ *
+ * @return ESP_ERR_INVALID_ARG if cpu_id is invalid
+ *         ESP_ERR_INVALID_STATE if FreeRTOS scheduler is not running
+ *         ESP_OK otherwise
+ */
+esp_err_t esp_ipc_call_async(uint32_t cpu_id, esp_ipc_func_t func, void* arg,
+                             esp_ipc_func_t done_cb, void* done_arg);
+
+
+/**
+ * @brief Queue a function to be executed on the given CPU, with a future
+ *
+ * Like esp_ipc_call_async, but completion is reported through future, which
+ * can be waited for with esp_ipc_future_wait. The future must remain valid
+ * until esp_ipc_future_wait has returned ESP_OK, and can then be reused.
+ *
+ * @param cpu_id CPU where function should be executed (0 or 1)
+ * @param func pointer to a function which should be executed
+ * @param arg arbitrary argument to be passed into function
+ * @param future future to be completed when func has returned
+ *
+ * @return ESP_ERR_INVALID_ARG if cpu_id is invalid
+ *         ESP_ERR_INVALID_STATE if FreeRTOS scheduler is not running
+ *         ESP_OK otherwise
+ */
+esp_err_t esp_ipc_call_future(uint32_t cpu_id, esp_ipc_func_t func, void* arg,
+                              esp_ipc_future_t* future);
+
+
+/**
+ * @brief Wait for a call made with esp_ipc_call_future to finish
+ *
+ * @param future future passed to esp_ipc_call_future
+ * @param ticks_to_wait maximum time to wait, portMAX_DELAY to wait forever
+ *
+ * @return ESP_OK if the function has returned
+ *         ESP_ERR_TIMEOUT if it hasn't returned within ticks_to_wait; the
+ *         future is still in use and has to be waited for again
+ */
+esp_err_t esp_ipc_future_wait(esp_ipc_future_t* future, TickType_t ticks_to_wait);
+
+
 
 #endif /* __ESP_IPC_H__ */
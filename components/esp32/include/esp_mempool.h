@@ -0,0 +1,103 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_MEMPOOL_H__
+#define __ESP_MEMPOOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Fixed-size memory pools
+ *
+ * A pool holds a fixed number of objects of one size, taken from the heap
+ * in a single allocation when the pool is created. Allocating and freeing
+ * objects takes constant time and doesn't fragment the general heap.
+ *
+ * Each CPU keeps a small list of free objects of its own, and only touches
+ * it with interrupts masked, so most allocations and frees take no lock.
+ * Objects move between these lists and a list shared by both CPUs in
+ * batches. A few free objects can therefore sit in the list of the other
+ * CPU while an allocation fails.
+ *
+ * All functions except esp_mempool_create and esp_mempool_delete can be
+ * called from both tasks and interrupt handlers.
+ */
+
+typedef struct esp_mempool* esp_mempool_handle_t;
+
+/**
+ * @brief Create a memory pool
+ *
+ * @param obj_size  size of each object, in bytes. Rounded up to a multiple of 4.
+ * @param obj_count number of objects in the pool
+ * @param caps      capabilities of the memory the objects are allocated from,
+ *                  a bitfield of MALLOC_CAP_* bits (see heap_alloc_caps.h)
+ * @param out_pool  pointer to the pool handle, set on success
+ *
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if obj_size or obj_count is zero,
+ *         ESP_ERR_NO_MEM if memory for the pool can't be allocated
+ */
+esp_err_t esp_mempool_create(size_t obj_size, size_t obj_count, uint32_t caps, esp_mempool_handle_t* out_pool);
+
+/**
+ * @brief Delete a memory pool and release its memory
+ *
+ * All objects must have been returned to the pool.
+ *
+ * @param pool  pool handle
+ */
+void esp_mempool_delete(esp_mempool_handle_t pool);
+
+/**
+ * @brief Allocate an object from a pool
+ *
+ * @param pool  pool handle
+ *
+ * @return pointer to the object, NULL if no free object is available
+ */
+void* esp_mempool_alloc(esp_mempool_handle_t pool);
+
+/**
+ * @brief Return an object to its pool
+ *
+ * @param pool  pool handle
+ * @param obj   object allocated from this pool using esp_mempool_alloc, or NULL
+ */
+void esp_mempool_free(esp_mempool_handle_t pool, void* obj);
+
+/**
+ * @brief Check if a pointer points to an object of a pool
+ *
+ * Useful when objects may come either from a pool or from malloc.
+ *
+ * @param pool  pool handle
+ * @param ptr   pointer to check
+ *
+ * @return true if ptr is inside the memory of the pool
+ */
+bool esp_mempool_contains(esp_mempool_handle_t pool, const void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ESP_MEMPOOL_H__
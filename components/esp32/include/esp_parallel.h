@@ -0,0 +1,113 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_PARALLEL_H__
+#define __ESP_PARALLEL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Data parallel work on both CPUs
+ *
+ * This module keeps one worker task pinned to each CPU. A job is run by all
+ * the workers at the same time, and the caller blocks until every worker has
+ * finished it (fork/join). esp_parallel_for splits an index range into
+ * chunks which the workers claim one after the other, so a CPU which is
+ * slowed down by interrupts or other tasks simply processes fewer chunks.
+ *
+ * Each worker has its own scratch buffer, passed to every job it runs, so
+ * jobs don't need to allocate memory or synchronize access to temporaries.
+ *
+ * Only one job runs at a time; concurrent callers are serialized. Jobs must
+ * not call esp_parallel_run or esp_parallel_for themselves.
+ */
+
+/**
+ * @brief Job run by each worker, see esp_parallel_run
+ *
+ * @param core CPU the worker runs on
+ * @param scratch scratch buffer of this worker
+ * @param arg argument passed to esp_parallel_run
+ */
+typedef void (*esp_parallel_job_t)(uint32_t core, void* scratch, void* arg);
+
+/**
+ * @brief Loop body of esp_parallel_for, called for a chunk of indices
+ *
+ * @param begin first index of the chunk
+ * @param end index after the last index of the chunk
+ * @param scratch scratch buffer of the worker processing the chunk
+ * @param arg argument passed to esp_parallel_for
+ */
+typedef void (*esp_parallel_for_func_t)(uint32_t begin, uint32_t end, void* scratch, void* arg);
+
+/**
+ * @brief Start the worker tasks
+ *
+ * @param priority priority of the worker tasks. Workers inherit nothing from
+ *                 the caller of a job, so this is the priority jobs run at.
+ * @param scratch_size size of the scratch buffer of each worker, may be 0
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the tasks or buffers can not
+ *         be allocated, ESP_ERR_INVALID_STATE if already initialized
+ */
+esp_err_t esp_parallel_init(UBaseType_t priority, size_t scratch_size);
+
+/**
+ * @brief Run a job on all CPUs and wait for it to finish
+ *
+ * Calls job(core, scratch, arg) once from the worker of each CPU.
+ *
+ * @param job function to run
+ * @param arg argument to pass into job
+ *
+ * @return ESP_OK when all workers have returned from job,
+ *         ESP_ERR_INVALID_ARG if job is NULL,
+ *         ESP_ERR_INVALID_STATE if not initialized or called from a job
+ */
+esp_err_t esp_parallel_run(esp_parallel_job_t job, void* arg);
+
+/**
+ * @brief Run a loop over an index range on all CPUs
+ *
+ * Calls func(chunk_begin, chunk_end, scratch, arg) for consecutive chunks of
+ * at most chunk indices covering [begin, end). Chunks are claimed by the
+ * workers in increasing order, but may complete in any order.
+ *
+ * @param begin first index
+ * @param end index after the last index
+ * @param chunk number of indices per call; 0 to split the range into one
+ *              chunk per CPU
+ * @param func loop body
+ * @param arg argument to pass into func
+ *
+ * @return ESP_OK when the whole range has been processed,
+ *         ESP_ERR_INVALID_ARG if func is NULL,
+ *         ESP_ERR_INVALID_STATE if not initialized or called from a job
+ */
+esp_err_t esp_parallel_for(uint32_t begin, uint32_t end, uint32_t chunk,
+                           esp_parallel_for_func_t func, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_PARALLEL_H__ */
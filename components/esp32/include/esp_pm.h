@@ -0,0 +1,143 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_PM_H__
+#define __ESP_PM_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief CPU frequency scaling
+ *
+ * With CONFIG_PM_ENABLE and once esp_pm_configure has been called, the CPU
+ * runs at min_freq_mhz while the idle tasks run on all CPUs, and at
+ * max_freq_mhz as soon as one CPU switches to another task. The switch
+ * happens in the context switch, so a task woken by an interrupt runs at
+ * full speed from its first instruction on.
+ *
+ * Components which need a minimum frequency even while the CPUs are idle
+ * hold a lock for it. WiFi holds one while it is started, the AES, SHA and
+ * RSA units while they are in use and the flash functions during flash
+ * operations, which stall the other CPU.
+ *
+ * The FreeRTOS tick and ets_delay_us follow the frequency; esp_log_timestamp
+ * and esp_timer don't depend on it. The UART and other peripherals run from
+ * the 80 MHz APB clock, which stays the same at all CPU frequencies.
+ * Components depending on the CPU frequency otherwise, such as code timing
+ * with CCOUNT, register a callback with esp_pm_register_freq_cb.
+ */
+
+#define ESP_PM_CPU_FREQ_MAX     0   ///< Lock frequency meaning the configured max_freq_mhz
+
+typedef struct {
+    int max_freq_mhz;   ///< Frequency while a task runs: 80, 160 or 240
+    int min_freq_mhz;   ///< Frequency while all CPUs are idle: 80, 160 or 240
+} esp_pm_config_t;
+
+/**
+ * @brief Lock holding a minimum CPU frequency
+ *
+ * Statically initialized with ESP_PM_LOCK_INITIALIZER. The lock counts, each
+ * esp_pm_lock_acquire has to be matched by an esp_pm_lock_release.
+ */
+typedef struct {
+    int freq_mhz;       ///< Minimum frequency, or ESP_PM_CPU_FREQ_MAX
+    const char* name;   ///< Lock name, used for debugging
+    uint32_t count;     ///< Number of times the lock is held
+    int held_mhz;       ///< Frequency held, resolved when first acquired
+} esp_pm_lock_t;
+
+#define ESP_PM_LOCK_INITIALIZER(freq_mhz, name)     { (freq_mhz), (name), 0, 0 }
+
+/**
+ * @brief Function called when the CPU frequency changes
+ *
+ * Called on the CPU which changes the frequency, with interrupts disabled
+ * and possibly with the flash cache disabled on the other CPU. It must be
+ * placed in IRAM, must return quickly and must not call FreeRTOS functions.
+ */
+typedef void (*esp_pm_freq_cb_t)(int old_freq_mhz, int new_freq_mhz, void* arg);
+
+#if CONFIG_PM_ENABLE
+
+/**
+ * @brief Configure and start frequency scaling
+ *
+ * Can be called again to change the frequencies. With max_freq_mhz equal to
+ * min_freq_mhz the CPU runs at a fixed frequency. Must be called from a task.
+ *
+ * @param config  frequencies to use
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if a frequency is not supported, or min_freq_mhz
+ *                             is above max_freq_mhz
+ *         ESP_ERR_NOT_FOUND if no interrupt is free for notifying the other CPU
+ */
+esp_err_t esp_pm_configure(const esp_pm_config_t* config);
+
+/**
+ * @brief Hold the minimum frequency of a lock
+ *
+ * Raises the frequency before returning, if it is lower. A lock frequency
+ * above max_freq_mhz holds max_freq_mhz. Can be called from an interrupt.
+ */
+void esp_pm_lock_acquire(esp_pm_lock_t* lock);
+
+/**
+ * @brief Release a lock
+ *
+ * The frequency is lowered the next time all CPUs are idle.
+ */
+void esp_pm_lock_release(esp_pm_lock_t* lock);
+
+/**
+ * @brief Register a function to call when the CPU frequency changes
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NO_MEM if CONFIG_PM_MAX_FREQ_CALLBACKS are registered already
+ */
+esp_err_t esp_pm_register_freq_cb(esp_pm_freq_cb_t cb, void* arg);
+
+/**
+ * @brief Get the current CPU frequency, in MHz
+ */
+int esp_pm_get_cpu_freq_mhz(void);
+
+#else // CONFIG_PM_ENABLE
+
+static inline void esp_pm_lock_acquire(esp_pm_lock_t* lock)
+{
+}
+
+static inline void esp_pm_lock_release(esp_pm_lock_t* lock)
+{
+}
+
+static inline int esp_pm_get_cpu_freq_mhz(void)
+{
+    return CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+}
+
+#endif // CONFIG_PM_ENABLE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_PM_H__ */
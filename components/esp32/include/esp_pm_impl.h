@@ -0,0 +1,31 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_PM_IMPL_H__
+#define __ESP_PM_IMPL_H__
+
+#include <stdbool.h>
+
+/*
+ * Hooks of the power management into FreeRTOS, not to be called by
+ * applications.
+ */
+
+/**
+ * @brief Called by vTaskSwitchContext once the next task of this CPU is chosen
+ *
+ * @param idle  true if the task is the idle task of this CPU
+ */
+void esp_pm_impl_switched_in(bool idle);
+
+#endif /* __ESP_PM_IMPL_H__ */
@@ -0,0 +1,158 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_PROFILER_H__
+#define __ESP_PROFILER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief PC sampling profiler
+ *
+ * Samples the program counter of the tasks running on each CPU with a
+ * fixed period, using the timers of timer group 1 (timer 0 for the PRO
+ * CPU, timer 1 for the APP CPU). esp_profiler_start counts the samples per
+ * PC in a table, esp_profiler_start_stacks records the call stack of each
+ * sample in a buffer, which can be read while sampling. Both are kept in
+ * internal RAM. The sampling interrupt runs from IRAM, so code running
+ * while the flash cache is disabled is sampled as well.
+ *
+ * Samples taken while another interrupt handler runs can't be attributed to
+ * a task PC and are only counted. Code running in critical sections, with
+ * interrupts disabled, is sampled once the critical section ends.
+ *
+ * esp_profiler_print writes the samples to the console. iram_profile.py, in
+ * this component, maps them to functions with the application ELF file and
+ * writes the list of the hottest functions running from flash, which can be
+ * moved to IRAM with CONFIG_ESP32_IRAM_PLACEMENT_FILE. profiler_report.py
+ * prints the functions taking the most time, by themselves and with the
+ * functions they call, from the call stacks.
+ */
+
+/** Largest call stack depth recorded by esp_profiler_start_stacks */
+#define ESP_PROFILER_MAX_DEPTH          32
+
+/**
+ * Records read by esp_profiler_read are a 32-bit header word followed by
+ * the PCs of the call stack, innermost first, in the byte order of the
+ * ESP32 (little endian). The header holds the number of PCs and the CPU the
+ * sample was taken on. A record without PCs is a sample taken while an
+ * interrupt handler ran.
+ */
+#define ESP_PROFILER_RECORD_COUNT_M     0xff
+#define ESP_PROFILER_RECORD_CPU_S       8
+
+/**
+ * @brief Start counting samples per PC
+ *
+ * Clears the samples of an earlier run.
+ *
+ * @param period_us  sampling period, in microseconds (at least 10)
+ * @param max_pcs  number of distinct PCs which can be counted; samples at
+ *                 other PCs are dropped once the table is full
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if period_us or max_pcs is 0 or period_us
+ *                             is below 10
+ *         ESP_ERR_INVALID_STATE if the profiler is running already
+ *         ESP_ERR_NO_MEM if the table can't be allocated
+ *         other errors from esp_intr_alloc_pinned_to_core
+ */
+esp_err_t esp_profiler_start(uint32_t period_us, size_t max_pcs);
+
+/**
+ * @brief Start recording the call stacks of the samples
+ *
+ * Clears the samples of an earlier run. Stacks are followed through the
+ * saved return addresses, up to depth functions or the first frame which
+ * doesn't look valid, such as the task entry function.
+ *
+ * Samples are dropped while the buffer is full, so it has to be read
+ * often enough with esp_profiler_read or esp_profiler_print. For example,
+ * to stream the samples to a host over TCP:
+ *
+ *     uint32_t buf[256];
+ *     while (streaming) {
+ *         size_t len = esp_profiler_read(buf, sizeof(buf));
+ *         if (len == 0) {
+ *             vTaskDelay(10 / portTICK_PERIOD_MS);
+ *         } else if (send(sock, buf, len, 0) < 0) {
+ *             break;
+ *         }
+ *     }
+ *
+ * @param period_us  sampling period, in microseconds (at least 10)
+ * @param depth  largest number of PCs recorded per sample, from 1 to
+ *               ESP_PROFILER_MAX_DEPTH
+ * @param buffer_size  size of the sample buffer, in bytes; it has to hold
+ *                     ESP_PROFILER_MAX_DEPTH + 1 words at least
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if an argument is out of range
+ *         ESP_ERR_INVALID_STATE if the profiler is running already
+ *         ESP_ERR_NO_MEM if the buffer can't be allocated
+ *         other errors from esp_intr_alloc_pinned_to_core
+ */
+esp_err_t esp_profiler_start_stacks(uint32_t period_us, int depth, size_t buffer_size);
+
+/**
+ * @brief Stop sampling
+ *
+ * The samples are kept until the next esp_profiler_start.
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_STATE if the profiler isn't running
+ */
+esp_err_t esp_profiler_stop(void);
+
+/**
+ * @brief Read recorded call stacks
+ *
+ * Takes whole records (see ESP_PROFILER_RECORD_COUNT_M) out of the buffer
+ * of esp_profiler_start_stacks, as many as fit. Can be called while the
+ * profiler runs, but not together with esp_profiler_start or
+ * esp_profiler_start_stacks.
+ *
+ * @param buf  buffer for the records, 32-bit aligned
+ * @param size  size of buf, in bytes
+ *
+ * @return number of bytes written to buf, 0 if there are no records
+ */
+size_t esp_profiler_read(void* buf, size_t size);
+
+/**
+ * @brief Print the samples
+ *
+ * Prints a "profile:" summary line. For esp_profiler_start, then prints a
+ * "pc 0x<address> <count>" line for each PC sampled, and the profiler has to
+ * be stopped. For esp_profiler_start_stacks, prints and takes the recorded
+ * stacks out of the buffer, as "st <cpu> 0x<pc> ..." lines, and the profiler
+ * can be running. iram_profile.py and profiler_report.py read both formats.
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_STATE if the profiler is counting PCs and
+ *                               running, or has no samples
+ */
+esp_err_t esp_profiler_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_PROFILER_H__ */
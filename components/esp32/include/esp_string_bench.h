@@ -0,0 +1,47 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_STRING_BENCH_H__
+#define __ESP_STRING_BENCH_H__
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Benchmark of memcpy, memmove, memset, memcmp, strlen, strcmp and strcpy,
+ * comparing the functions linked into the application (see
+ * CONFIG_NEWLIB_FAST_STRING_FUNCTIONS) with the ones in ROM.
+ *
+ * Each function is called with sizes from 4 bytes to 4 kB, once with word
+ * aligned arguments and once with unaligned ones, and the results of both
+ * versions are checked against each other. Times are the fewest CCOUNT
+ * cycles out of several calls, so interrupts in between don't count.
+ */
+
+/**
+ * @brief  Run the benchmark and print the results
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NO_MEM if the buffers can't be allocated
+ *         ESP_FAIL if a function returns a different result than its ROM version
+ */
+esp_err_t esp_string_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_STRING_BENCH_H__ */
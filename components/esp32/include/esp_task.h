@@ -31,6 +31,14 @@
 #define ESP_TASK_PRIO_MAX (configMAX_PRIORITIES)
 #define ESP_TASK_PRIO_MIN (0)
 
+/* CPU of the system and protocol tasks, and the CPU left to the application */
+#define ESP_TASK_PROTOCOL_CORE        CONFIG_ESP32_PROTOCOL_CPU_ID
+#if CONFIG_FREERTOS_UNICORE
+#define ESP_TASK_APP_CORE             0
+#else
+#define ESP_TASK_APP_CORE             (1 - ESP_TASK_PROTOCOL_CORE)
+#endif
+
 /* Wifi library task */
 #define ESP_TASKD_WATCHDOG_PRIO       (ESP_TASK_PRIO_MAX - 1)
 #define ESP_TASKD_WATCHDOG_STACK      2048
@@ -44,11 +52,29 @@
 #define ESP_TASK_WPS_STACK            2048
 
 /* idf task */
-#define ESP_TASKD_EVENT_PRIO          (ESP_TASK_PRIO_MAX - 5)
+#define ESP_TASKD_EVENT_PRIO          CONFIG_SYSTEM_EVENT_TASK_PRIO
 #define ESP_TASKD_EVENT_STACK         CONFIG_SYSTEM_EVENT_TASK_STACK_SIZE
 #define ESP_TASK_WIFI_STARTUP_PRIO    (ESP_TASK_PRIO_MAX - 7)
 #define ESP_TASK_WIFI_STARTUP_STACK   4096
-#define ESP_TASK_TCPIP_PRIO           (ESP_TASK_PRIO_MAX - 7)
+#define ESP_TASK_TCPIP_PRIO           CONFIG_LWIP_TCPIP_TASK_PRIO
 #define ESP_TASK_TCPIP_STACK          2048
+#define ESP_TASKD_NVS_GC_PRIO         (ESP_TASK_PRIO_MIN + 1)
+#define ESP_TASKD_NVS_GC_STACK        2048
+#define ESP_TASKD_ENTROPY_PRIO        (ESP_TASK_PRIO_MIN + 1)
+#define ESP_TASKD_ENTROPY_STACK       3072
+#define ESP_TASK_CRYPTO_BENCH_STACK   8192
+#define ESP_TASKD_ESP_TIMER_PRIO      CONFIG_ESP_TIMER_TASK_PRIO
+#define ESP_TASKD_ESP_TIMER_STACK     CONFIG_ESP_TIMER_TASK_STACK_SIZE
+#define ESP_TASKD_PARALLEL_STACK      CONFIG_ESP_PARALLEL_TASK_STACK_SIZE
+#define ESP_TASK_CORO_EXECUTOR_STACK  CONFIG_ESP_CORO_EXECUTOR_STACK_SIZE
+#define ESP_TASK_MAIN_PRIO            (ESP_TASK_PRIO_MIN + 1)
+#define ESP_TASK_MAIN_STACK           4096
+#define ESP_TASK_INIT_HELPER_STACK    3072
+#define ESP_TASKD_LOG_PRIO            (ESP_TASK_PRIO_MIN + 1)
+#define ESP_TASKD_LOG_STACK           CONFIG_LOG_ASYNC_TASK_STACK_SIZE
+#define ESP_TASK_NETLOG_PRIO          (ESP_TASK_PRIO_MIN + 1)
+#define ESP_TASK_NETLOG_STACK         2560
+#define ESP_TASK_IPERF_PRIO           (ESP_TASK_PRIO_MIN + 4)
+#define ESP_TASK_IPERF_STACK          3072
 
 #endif
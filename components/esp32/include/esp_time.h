@@ -0,0 +1,83 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_TIME_H__
+#define __ESP_TIME_H__
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Time of day
+ *
+ * gettimeofday() and time() return the time set with settimeofday(), usually
+ * by the SNTP client, advanced by the high resolution timer (esp_timer). Until
+ * the time is set, they return the time since startup.
+ *
+ * The time is also kept in RTC slow memory, together with the value of the
+ * RTC timer at that moment. The RTC timer keeps running during deep sleep and
+ * across resets other than power-on, so at startup the time is restored from
+ * it and doesn't need to be synchronized again. The RTC timer runs from the
+ * internal slow clock, whose frequency is only known to a few percent, so it
+ * is measured against esp_timer while the application runs; the longer the
+ * application ran before the time is saved, the more accurate the restored
+ * time is.
+ *
+ * The time is saved by settimeofday() and by esp_time_save(). Call the
+ * latter right before system_deep_sleep() to keep the calibration of the
+ * wakeup as good as possible.
+ */
+
+/* Kept right below the boot timeline in RTC slow memory */
+#define ESP_TIME_RTC_ADDR       0x50001dc0
+
+/**
+ * @brief Restore the time from RTC memory
+ *
+ * Called by the startup code after esp_timer_init, applications don't need to
+ * call it.
+ */
+void esp_time_init(void);
+
+/**
+ * @brief Save the current time and the RTC timer calibration to RTC memory
+ *
+ * Does nothing if the time was never set.
+ */
+void esp_time_save(void);
+
+/**
+ * @brief Get the time since settimeofday() was last called
+ *
+ * This includes time spent in deep sleep, and settimeofday() calls made
+ * before the last reset, as long as the time could be restored from RTC
+ * memory.
+ *
+ * @param age_s  set to the number of seconds since the time was set
+ *
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_STATE if the time was never set
+ */
+esp_err_t esp_time_get_sync_age(uint32_t* age_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ESP_TIME_H__
@@ -0,0 +1,143 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef __ESP_TIMER_H__
+#define __ESP_TIMER_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief High resolution timer
+ *
+ * This module provides a 64-bit microsecond clock, and one-shot and periodic
+ * timers with microsecond resolution, independent of the FreeRTOS tick.
+ * It runs on timer 0 of timer group 0, clocked from APB at 1 MHz.
+ *
+ * Timer callbacks are either called from the timer interrupt on the PRO CPU
+ * (ESP_TIMER_ISR) or from a dedicated high priority "esp_timer" task
+ * (ESP_TIMER_TASK). ISR callbacks must be placed in IRAM and may only use
+ * ...FromISR FreeRTOS APIs. Task callbacks should return quickly, a slow
+ * callback delays all other task dispatched timers.
+ */
+
+typedef struct esp_timer* esp_timer_handle_t;
+
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,     ///< Callback is called from the esp_timer task
+    ESP_TIMER_ISR,      ///< Callback is called from the timer interrupt
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;                ///< Function to call when the timer expires
+    void* arg;                              ///< Argument to pass to the callback
+    esp_timer_dispatch_t dispatch_method;   ///< Context the callback is called from
+    const char* name;                       ///< Timer name, used for debugging
+} esp_timer_create_args_t;
+
+/**
+ * @brief Initialize the high resolution timer
+ *
+ * Starts the hardware counter and the esp_timer task. Called from the
+ * startup code, applications don't need to call it.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task can not be created,
+ *         ESP_ERR_INVALID_STATE if already initialized
+ */
+esp_err_t esp_timer_init(void);
+
+/**
+ * @brief Get time since esp_timer_init, in microseconds
+ *
+ * Can be called from tasks and ISRs on either CPU.
+ *
+ * @return microseconds since the counter was started
+ */
+int64_t esp_timer_get_time(void);
+
+/**
+ * @brief Create a timer
+ *
+ * The timer is created stopped.
+ *
+ * @param args timer callback, argument, dispatch method and name
+ * @param[out] out_handle handle of the new timer
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if args or out_handle is
+ *         NULL or there is no callback, ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle);
+
+/**
+ * @brief Start a one-shot timer
+ *
+ * The callback is called once, timeout_us microseconds from now.
+ *
+ * @param timer timer handle
+ * @param timeout_us timeout in microseconds
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the timer is running
+ */
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+
+/**
+ * @brief Start a periodic timer
+ *
+ * The callback is called every period_us microseconds, starting period_us
+ * microseconds from now. Expiry times are advanced by exactly one period
+ * each time, so the period does not drift. If the callback of a task
+ * dispatched timer is still pending when the timer expires again, the
+ * expiries are coalesced into a single call.
+ *
+ * @param timer timer handle
+ * @param period_us period in microseconds
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if period_us is 0,
+ *         ESP_ERR_INVALID_STATE if the timer is running
+ */
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+
+/**
+ * @brief Stop a timer
+ *
+ * A pending callback of a task dispatched timer is cancelled as well.
+ * A callback which has already started will still complete.
+ *
+ * @param timer timer handle
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the timer is not running
+ */
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+/**
+ * @brief Delete a timer, stopping it first if it is running
+ *
+ * @param timer timer handle
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if timer is NULL
+ */
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_TIMER_H__ */
@@ -0,0 +1,34 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_TIMER_IMPL_H__
+#define __ESP_TIMER_IMPL_H__
+
+#include <stdint.h>
+
+/*
+ * Hooks of esp_timer for other system components, not to be called by
+ * applications.
+ */
+
+/**
+ * @brief Move the esp_timer counter forward
+ *
+ * Used by light sleep, which stops the counter along with the APB clock.
+ * Timers which expired in the meantime run right away.
+ *
+ * @param time_us  time the counter didn't count, in microseconds
+ */
+void esp_timer_impl_advance(int64_t time_us);
+
+#endif /* __ESP_TIMER_IMPL_H__ */
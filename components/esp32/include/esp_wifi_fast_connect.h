@@ -0,0 +1,74 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_WIFI_FAST_CONNECT_H__
+#define __ESP_WIFI_FAST_CONNECT_H__
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Fast reconnection to the last AP
+ *
+ * With CONFIG_WIFI_FAST_CONNECT, the automatic connection made by
+ * esp_wifi_startup goes straight to the BSSID and channel the station was
+ * last connected to, and passes the PMK instead of the passphrase, so that
+ * neither the scan nor the PBKDF2 derivation of the PMK (hundreds of ms) is
+ * repeated. The PMK is derived once per station configuration; the BSSID and
+ * channel are saved on each connection. All of it is kept in RTC memory, for
+ * wakeups from deep sleep, and in NVS.
+ *
+ * Until the station disconnects, esp_wifi_get_config returns the BSSID and
+ * the PMK (as 64 hex digits) of the fast connection. If the fast connection
+ * fails, the original configuration is restored and the station connects
+ * again with a full scan. If that works while the PMK didn't, the PMK isn't
+ * used again for this configuration.
+ */
+
+/**
+ * @brief Forget the saved AP and PMK
+ *
+ * The next automatic connection does a full scan.
+ *
+ * @return ESP_OK on success, or an error from NVS
+ */
+esp_err_t esp_wifi_fast_connect_clear(void);
+
+/*
+ * Hooks for the automatic connection and the default event handlers, not to
+ * be called by applications.
+ */
+
+/** @brief Set the fast connection configuration, before esp_wifi_connect */
+void esp_wifi_fast_connect_prepare(void);
+
+/** @brief Save the AP the station connected to */
+void esp_wifi_fast_connect_connected(const system_event_sta_connected_t *info);
+
+/**
+ * @brief Restore the original configuration after a disconnection
+ *
+ * @return true if the fast connection failed and a full connection was started
+ */
+bool esp_wifi_fast_connect_disconnected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_WIFI_FAST_CONNECT_H__ */
@@ -14,6 +14,10 @@
 #ifndef HEAP_ALLOC_CAPS_H
 #define HEAP_ALLOC_CAPS_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/heap_regions.h"
+
 #define MALLOC_CAP_EXEC				(1<<0)	//Memory must be able to run executable code
 #define MALLOC_CAP_32BIT			(1<<1)	//Memory must allow for aligned 32-bit data accesses
 #define MALLOC_CAP_8BIT				(1<<2)	//Memory must allow for 8/16/...-bit data accesses
@@ -29,6 +33,14 @@
 
 
 void heap_alloc_caps_init();
+void heap_alloc_caps_enable_startup_regions();
 void *pvPortMallocCaps(size_t xWantedSize, uint32_t caps);
+void *pvPortMallocCapsAligned(size_t xWantedSize, size_t alignment, uint32_t caps);
+void *pvPortReallocCaps(void *ptr, size_t xWantedSize, uint32_t caps);
+void *pvPortMallocDefault(size_t xWantedSize);
+void *pvPortReallocDefault(void *ptr, size_t xWantedSize);
+void *pvPortMallocPreferExternal(size_t xWantedSize);
+void *pvPortCallocPreferExternal(size_t n, size_t size);
+void vPortGetHeapStatsCaps(uint32_t caps, HeapStats_t *stats);
 
 #endif
\ No newline at end of file
@@ -67,6 +67,10 @@ typedef struct {
  * esp_aes_xxx API calls automatically manage locking & unlocking of
  * hardware, this function is only needed if you want to call
  * ets_aes_xxx functions directly.
+ *
+ * Between calls, the esp_aes_xxx functions leave the AES unit enabled with
+ * the key of the last context used, to save loading the key again.
+ * esp_aes_release_hardware() clears the key and disables the unit.
  */
 void esp_aes_acquire_hardware( void );
 
@@ -127,6 +131,22 @@ int esp_aes_setkey_dec( esp_aes_context *ctx, const unsigned char *key, unsigned
  */
 int esp_aes_crypt_ecb( esp_aes_context *ctx, int mode, const unsigned char input[16], unsigned char output[16] );
 
+/**
+ * \brief          AES-ECB encryption/decryption of consecutive blocks
+ *
+ *                 Same as calling esp_aes_crypt_ecb for each block, but
+ *                 locks the AES unit only once.
+ *
+ * \param ctx      AES context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param blocks   number of 16-byte blocks
+ * \param input    input blocks
+ * \param output   output blocks, may be the same as input
+ *
+ * \return         0 if successful
+ */
+int esp_aes_crypt_ecb_blocks( esp_aes_context *ctx, int mode, size_t blocks, const unsigned char *input, unsigned char *output );
+
 /**
  * \brief          AES-CBC buffer encryption/decryption
  *                 Length should be a multiple of the block
@@ -0,0 +1,79 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _ESP_CRYPTO_FALLBACK_H_
+#define _ESP_CRYPTO_FALLBACK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * With CONFIG_MBEDTLS_HARDWARE_FALLBACK, an operation which finds its
+ * hardware unit in use by another task runs the mbedTLS software
+ * implementation instead of waiting for the unit. These counters tell how
+ * many operations ran on each path.
+ */
+
+typedef enum {
+    ESP_CRYPTO_AES,     /*!< esp_aes_xxx calls */
+    ESP_CRYPTO_SHA,     /*!< esp_shaX_start to esp_shaX_finish */
+    ESP_CRYPTO_MPI,     /*!< bignum multiplications */
+    ESP_CRYPTO_ENGINE_MAX,
+} esp_crypto_engine_t;
+
+typedef struct {
+    uint32_t hardware;  /*!< Operations done by the hardware unit */
+    uint32_t software;  /*!< Operations done in software as the unit was busy */
+} esp_crypto_fallback_stats_t;
+
+/**
+ * @brief  Get the number of operations done in hardware and in software
+ *
+ * @param  engine  hardware unit
+ * @param  stats   set to the counts since startup
+ */
+void esp_crypto_get_fallback_stats(esp_crypto_engine_t engine, esp_crypto_fallback_stats_t *stats);
+
+/**
+ * @brief  Count an operation, for the hardware crypto drivers
+ *
+ * @param  engine    hardware unit
+ * @param  software  true if the operation falls back to software
+ */
+void esp_crypto_fallback_count(esp_crypto_engine_t engine, bool software);
+
+/**
+ * @brief  Run all operations of an engine in software, as if it was busy
+ *
+ * For benchmarks comparing the two paths; affects all tasks. AES and MPI
+ * operations only have a software path with CONFIG_MBEDTLS_HARDWARE_FALLBACK.
+ *
+ * @param  engine         hardware unit
+ * @param  software_only  true to stop using the unit, false to use it again
+ */
+void esp_crypto_set_software_only(esp_crypto_engine_t engine, bool software_only);
+
+/**
+ * @brief  Whether esp_crypto_set_software_only is in effect, for the drivers
+ */
+bool esp_crypto_software_only(esp_crypto_engine_t engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP_CRYPTO_FALLBACK_H_ */
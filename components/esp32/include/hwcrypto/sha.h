@@ -33,11 +33,24 @@ extern "C" {
 
 /**
  * \brief          SHA-1 context structure
+ *
+ * A context holds the SHA engine of its algorithm (SHA-1, SHA-256 or
+ * SHA-384/512) from esp_shaX_start to esp_shaX_finish, the engine keeps the
+ * digest state between calls. Contexts started while the engine of their
+ * algorithm is held by another context, SHA-224 contexts and clones of
+ * contexts using the engine are calculated in software. With
+ * CONFIG_MBEDTLS_SHA_HARDWARE_MIN_BYTES, the engine is taken at the first
+ * update instead, and contexts whose first update is shorter than that are
+ * calculated in software as well.
  */
 typedef struct {
-    /* both types defined in rom/sha.h */
-    SHA_CTX context;
-    enum SHA_TYPE context_type;
+    enum SHA_TYPE context_type;     /* defined in rom/sha.h */
+    bool hardware;                  /* holds the SHA engine of context_type */
+    bool pending;                   /* started, engine or software not chosen yet */
+    bool first_block;               /* no block processed by the engine yet */
+    uint64_t total;                 /* bytes hashed */
+    unsigned char buffer[128];      /* partial block not yet processed */
+    void *software;                 /* mbedTLS context when calculated in software */
 } esp_sha_context;
 
 /**
@@ -49,6 +62,9 @@ typedef struct {
  * esp_sha_xxx API calls automatically manage locking & unlocking of
  * hardware, this function is only needed if you want to call
  * ets_sha_xxx functions directly.
+ *
+ * Waits until no esp_sha_context uses any of the SHA engines, and keeps
+ * new contexts on software until esp_sha_release_hardware.
  */
 void esp_sha_acquire_hardware( void );
 
@@ -116,6 +132,29 @@ void esp_sha1_finish( esp_sha_context *ctx, unsigned char output[20] );
  */
 void esp_sha1( const unsigned char *input, size_t ilen, unsigned char output[20] );
 
+/**
+ * \brief          PBKDF2 with HMAC-SHA-1 on the SHA-1 engine, such as for
+ *                 the WPA2 PMK from a passphrase
+ *
+ * Holds the SHA-1 engine for the whole derivation; each iteration hashes
+ * four blocks prepared before the first one. Returns without output if the
+ * engine is in use by another context, the caller then derives the key
+ * in software. mbedtls_pkcs5_pbkdf2_hmac calls it for SHA-1.
+ *
+ * \param password     password
+ * \param plen         length of the password
+ * \param salt         salt
+ * \param slen         length of the salt
+ * \param iterations   iteration count
+ * \param key_length   length of the derived key
+ * \param output       derived key
+ *
+ * \return         0 if the key is derived, -1 if the engine is in use
+ */
+int esp_sha1_pbkdf2( const unsigned char *password, size_t plen,
+                     const unsigned char *salt, size_t slen,
+                     unsigned int iterations, uint32_t key_length, unsigned char *output );
+
 /**
  * \brief          SHA-256 context structure
  */
@@ -15,6 +15,7 @@
 #ifndef _SOC_CPU_H
 #define _SOC_CPU_H
 
+#include <stdint.h>
 #include "xtensa/corebits.h"
 
 /* C macros for xtensa special register read/write/exchange */
@@ -73,9 +74,16 @@ static inline void cpu_configure_region_protection()
  * @brief Set CPU frequency to the value defined in menuconfig
  *
  * Called from cpu_start.c, not intended to be called from other places.
- * This is a temporary function which will be replaced once dynamic
- * CPU frequency changing is implemented.
+ * The power management (esp_pm.h) changes the frequency at run time.
  */
 void esp_set_cpu_freq();
 
+/*
+ * @brief Switch the CPU clock to 80, 160 or 240 MHz
+ *
+ * Only changes the clock of both CPUs, nothing depending on it. Used by
+ * esp_set_cpu_freq and the power management.
+ */
+void esp_cpu_freq_switch(uint32_t freq_mhz);
+
 #endif
@@ -0,0 +1,59 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _SOC_HWCRYPTO_REG_H_
+#define _SOC_HWCRYPTO_REG_H_
+
+#include "soc.h"
+
+/* AES accelerator */
+#define AES_START_REG           ((DR_REG_AES_BASE) + 0x000)
+#define AES_IDLE_REG            ((DR_REG_AES_BASE) + 0x004)
+#define AES_MODE_REG            ((DR_REG_AES_BASE) + 0x008)
+#define AES_KEY_BASE            ((DR_REG_AES_BASE) + 0x010)   /* 8 words */
+#define AES_TEXT_BASE           ((DR_REG_AES_BASE) + 0x030)   /* 4 words */
+#define AES_ENDIAN_REG          ((DR_REG_AES_BASE) + 0x040)
+
+/* AES_MODE_REG values: key length (0: 128, 1: 192, 2: 256 bits),
+   plus AES_MODE_DECRYPT to decrypt */
+#define AES_MODE_DECRYPT        4
+
+/* SHA accelerator */
+#define SHA_TEXT_BASE           ((DR_REG_SHA_BASE) + 0x00)    /* 32 words */
+#define SHA_1_START_REG         ((DR_REG_SHA_BASE) + 0x80)
+#define SHA_256_START_REG       ((DR_REG_SHA_BASE) + 0x90)
+#define SHA_384_START_REG       ((DR_REG_SHA_BASE) + 0xa0)
+#define SHA_512_START_REG       ((DR_REG_SHA_BASE) + 0xb0)
+
+/* Offsets from SHA_x_START_REG of the other registers of each algorithm */
+#define SHA_CONTINUE_OFFSET     0x4
+#define SHA_LOAD_OFFSET         0x8
+#define SHA_BUSY_OFFSET         0xc
+
+/* RSA accelerator (MPI), memory blocks of 128 words. Z is read from the
+   same memory as RB. */
+#define RSA_MEM_M_BLOCK_BASE    ((DR_REG_RSA_BASE) + 0x000)
+#define RSA_MEM_RB_BLOCK_BASE   ((DR_REG_RSA_BASE) + 0x200)
+#define RSA_MEM_Z_BLOCK_BASE    ((DR_REG_RSA_BASE) + 0x200)
+#define RSA_MEM_Y_BLOCK_BASE    ((DR_REG_RSA_BASE) + 0x400)
+#define RSA_MEM_X_BLOCK_BASE    ((DR_REG_RSA_BASE) + 0x600)
+
+#define RSA_M_DASH_REG          ((DR_REG_RSA_BASE) + 0x800)
+#define RSA_MODEXP_MODE_REG     ((DR_REG_RSA_BASE) + 0x804)
+#define RSA_MODEXP_START_REG    ((DR_REG_RSA_BASE) + 0x808)
+#define RSA_MULT_MODE_REG       ((DR_REG_RSA_BASE) + 0x80c)
+#define RSA_MULT_START_REG      ((DR_REG_RSA_BASE) + 0x810)
+#define RSA_INTERRUPT_REG       ((DR_REG_RSA_BASE) + 0x814)
+#define RSA_CLEAN_REG           ((DR_REG_RSA_BASE) + 0x818)
+
+#endif /* _SOC_HWCRYPTO_REG_H_ */
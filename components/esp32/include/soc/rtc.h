@@ -0,0 +1,58 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SOC_RTC_H
+#define _SOC_RTC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sleep and slow clock functions of the RTC controller, implemented in librtc */
+
+/* Number of fractional bits in the period returned by rtc_slowck_cali */
+#define RTC_SLOWCK_PERIOD_FRACT     19
+
+/* Clock measured by rtc_slowck_cali */
+typedef enum {
+    CALI_RTC_MUX = 0,       // RTC slow clock, as selected in RTC_CNTL_CLK_CONF_REG
+    CALI_8MD256 = 1,        // 8 MHz RC oscillator divided by 256
+    CALI_32K_XTAL = 2       // 32 kHz crystal
+} cali_clk_t;
+
+/* Set up the RTC power domains for sleep: deep_slp is 1 for deep sleep and 0
+   for light sleep. */
+void rtc_slp_prep_lite(uint32_t deep_slp, uint32_t cpu_lp_mode);
+
+/* Enter sleep for cycles_h:cycles_l slow clock cycles, or until one of the
+   wakeup_opt sources (RTC_CNTL_WAKEUP_ENA bits) triggers. Sources in
+   reject_opt abort entering sleep. */
+uint32_t rtc_sleep(uint32_t cycles_h, uint32_t cycles_l, uint32_t wakeup_opt, uint32_t reject_opt);
+
+/* Measure the period of cali_clk over cali_num cycles. Returns the period in
+   microseconds, with RTC_SLOWCK_PERIOD_FRACT fractional bits. */
+uint32_t rtc_slowck_cali(cali_clk_t cali_clk, uint32_t cali_num);
+
+/* Convert usec_h:usec_l microseconds to cycles_h:cycles_l slow clock cycles,
+   for a period as returned by rtc_slowck_cali. */
+void rtc_usec2rtc(uint32_t usec_h, uint32_t usec_l, uint32_t slowclk_period,
+                  uint32_t* cycles_h, uint32_t* cycles_l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SOC_RTC_H */
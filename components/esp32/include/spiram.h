@@ -0,0 +1,27 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SPI_RAM_H
+#define SPI_RAM_H
+
+#include "esp_err.h"
+
+/*
+Sets up the external SPI RAM chip and maps CONFIG_SPIRAM_SIZE bytes of it at 0x3F800000, so the heap can use it.
+Called once, before the heap allocator is initialized. There is no driver for the chip in this tree; boards with
+SPI RAM provide this function. The default one returns ESP_ERR_NOT_SUPPORTED, and the SPI RAM region is left
+out of the heap.
+*/
+esp_err_t enable_spi_sram();
+
+#endif
\ No newline at end of file
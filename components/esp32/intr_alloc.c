@@ -0,0 +1,268 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
+#include "esp_ipc.h"
+#include "rom/ets_sys.h"
+#include "soc/soc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/xtensa_api.h"
+
+/* Number of peripheral interrupt sources of the interrupt matrix */
+#define INTR_SOURCE_COUNT       (ETS_CACHE_IA_INTR_SOURCE + 1)
+/* Internal interrupt lines ignore the interrupt matrix, so routing a source
+ * to one of them disconnects the source */
+#define INT_MUX_DISABLED_INTNO  6
+
+typedef enum {
+    INTTP_LEVEL,
+    INTTP_EDGE,
+    INTTP_NA,           // Internal: timer, software, profiling or NMI
+} int_type_t;
+
+typedef struct {
+    uint8_t level;
+    uint8_t type;
+    bool reserved[2];   // Used by the system on PRO CPU, APP CPU
+} int_desc_t;
+
+/* Interrupt lines of each CPU, see the table in soc/soc.h */
+static const int_desc_t s_int_desc[32] = {
+    { 1, INTTP_LEVEL, { true,  true  } },  // 0  WMAC
+    { 1, INTTP_LEVEL, { true,  true  } },  // 1  BT/BLE host
+    { 1, INTTP_LEVEL, { true,  true  } },  // 2  FROM_CPU
+    { 1, INTTP_LEVEL, { true,  true  } },  // 3  TG0_WDT
+    { 1, INTTP_LEVEL, { true,  false } },  // 4  WBB
+    { 1, INTTP_LEVEL, { true,  false } },  // 5  UART0 in ROM
+    { 1, INTTP_NA,    { true,  true  } },  // 6  FreeRTOS tick
+    { 1, INTTP_NA,    { true,  true  } },  // 7  software
+    { 1, INTTP_LEVEL, { true,  false } },  // 8
+    { 1, INTTP_LEVEL, { false, false } },  // 9
+    { 1, INTTP_EDGE,  { true,  false } },  // 10 TG0_T1
+    { 3, INTTP_NA,    { true,  true  } },  // 11 profiling
+    { 1, INTTP_LEVEL, { false, false } },  // 12
+    { 1, INTTP_LEVEL, { false, false } },  // 13
+    { 7, INTTP_NA,    { true,  true  } },  // 14 NMI
+    { 3, INTTP_NA,    { true,  true  } },  // 15 timer
+    { 5, INTTP_NA,    { true,  true  } },  // 16 timer
+    { 1, INTTP_LEVEL, { false, false } },  // 17
+    { 1, INTTP_LEVEL, { false, false } },  // 18
+    { 2, INTTP_LEVEL, { false, false } },  // 19
+    { 2, INTTP_LEVEL, { false, false } },  // 20
+    { 2, INTTP_LEVEL, { false, false } },  // 21
+    { 3, INTTP_EDGE,  { false, false } },  // 22
+    { 3, INTTP_LEVEL, { false, false } },  // 23
+    { 4, INTTP_LEVEL, { false, false } },  // 24
+    { 4, INTTP_LEVEL, { true,  true  } },  // 25
+    { 5, INTTP_LEVEL, { true,  true  } },  // 26
+    { 3, INTTP_LEVEL, { true,  true  } },  // 27
+    { 4, INTTP_EDGE,  { false, false } },  // 28
+    { 3, INTTP_NA,    { true,  true  } },  // 29 software
+    { 4, INTTP_EDGE,  { true,  true  } },  // 30
+    { 5, INTTP_LEVEL, { true,  true  } },  // 31
+};
+
+struct intr_handle_data_t {
+    int cpu;
+    int intno;
+    int source;
+    int flags;
+    intr_handler_t handler;
+    void* arg;
+};
+
+static portMUX_TYPE s_intr_lock = portMUX_INITIALIZER_UNLOCKED;  // Protects s_allocated and s_non_iram
+static uint32_t s_allocated[portNUM_PROCESSORS];        // Lines handed out, per CPU
+static uint32_t s_non_iram[portNUM_PROCESSORS];         // Allocated lines without ESP_INTR_FLAG_IRAM
+static uint32_t s_noniram_masked[portNUM_PROCESSORS];   // Lines masked by esp_intr_noniram_disable
+
+static int find_free_line(int cpu, int flags)
+{
+    int levels = flags & ESP_INTR_FLAG_LOWMED;
+    if (levels == 0) {
+        levels = ESP_INTR_FLAG_LOWMED;
+    }
+    const int type = (flags & ESP_INTR_FLAG_EDGE) ? INTTP_EDGE : INTTP_LEVEL;
+    // ESP_INTR_FLAG_LEVELn is (1 << n); only levels up to XCHAL_EXCM_LEVEL
+    // can have C handlers
+    for (int level = 1; level <= XCHAL_EXCM_LEVEL; level++) {
+        if ((levels & (1 << level)) == 0) {
+            continue;
+        }
+        for (int intno = 0; intno < 32; intno++) {
+            const int_desc_t* desc = &s_int_desc[intno];
+            if (desc->level != level || desc->type != type || desc->reserved[cpu]) {
+                continue;
+            }
+            if ((s_allocated[cpu] & (1 << intno)) || xt_int_has_handler(intno, cpu)) {
+                continue;
+            }
+            return intno;
+        }
+    }
+    return -1;
+}
+
+static void intr_install(void* arg)
+{
+    struct intr_handle_data_t* handle = (struct intr_handle_data_t*) arg;
+    xt_set_interrupt_handler(handle->intno, handle->handler, handle->arg);
+    intr_matrix_set(handle->cpu, handle->source,
+            (handle->flags & ESP_INTR_FLAG_INTRDISABLED) ? INT_MUX_DISABLED_INTNO : handle->intno);
+    xt_ints_on(1 << handle->intno);
+}
+
+static void intr_uninstall(void* arg)
+{
+    struct intr_handle_data_t* handle = (struct intr_handle_data_t*) arg;
+    xt_ints_off(1 << handle->intno);
+    xt_set_interrupt_handler(handle->intno, NULL, NULL);
+}
+
+/* Handler tables and INTENABLE can only be changed by the CPU they belong to */
+static esp_err_t call_on_cpu(int cpu, esp_ipc_func_t func, void* arg)
+{
+    // With interrupts masked the caller can't move to the other CPU between
+    // the check and the call
+    unsigned state = portENTER_CRITICAL_NESTED();
+    const bool local = (cpu == xPortGetCoreID());
+    if (local) {
+        (*func)(arg);
+    }
+    portEXIT_CRITICAL_NESTED(state);
+    if (local) {
+        return ESP_OK;
+    }
+    return esp_ipc_call_blocking(cpu, func, arg);
+}
+
+static void release_line(int cpu, int intno)
+{
+    portENTER_CRITICAL(&s_intr_lock);
+    s_allocated[cpu] &= ~(1 << intno);
+    s_non_iram[cpu] &= ~(1 << intno);
+    portEXIT_CRITICAL(&s_intr_lock);
+}
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void* arg, intr_handle_t* ret_handle)
+{
+    return esp_intr_alloc_pinned_to_core(source, flags, handler, arg, xPortGetCoreID(), ret_handle);
+}
+
+esp_err_t esp_intr_alloc_pinned_to_core(int source, int flags, intr_handler_t handler, void* arg,
+                                        int cpu, intr_handle_t* ret_handle)
+{
+    if (handler == NULL || source < 0 || source >= INTR_SOURCE_COUNT ||
+            cpu < 0 || cpu >= portNUM_PROCESSORS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct intr_handle_data_t* handle = calloc(1, sizeof(*handle));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_intr_lock);
+    const int intno = find_free_line(cpu, flags);
+    if (intno >= 0) {
+        s_allocated[cpu] |= (1 << intno);
+        if ((flags & ESP_INTR_FLAG_IRAM) == 0) {
+            s_non_iram[cpu] |= (1 << intno);
+        }
+    }
+    portEXIT_CRITICAL(&s_intr_lock);
+    if (intno < 0) {
+        free(handle);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    handle->cpu = cpu;
+    handle->intno = intno;
+    handle->source = source;
+    handle->flags = flags;
+    handle->handler = handler;
+    handle->arg = arg;
+    esp_err_t err = call_on_cpu(cpu, &intr_install, handle);
+    if (err != ESP_OK) {
+        release_line(cpu, intno);
+        free(handle);
+        return err;
+    }
+    if (ret_handle != NULL) {
+        *ret_handle = handle;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_intr_free(intr_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    intr_matrix_set(handle->cpu, handle->source, INT_MUX_DISABLED_INTNO);
+    esp_err_t err = call_on_cpu(handle->cpu, &intr_uninstall, handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    release_line(handle->cpu, handle->intno);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR esp_intr_enable(intr_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    intr_matrix_set(handle->cpu, handle->source, handle->intno);
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR esp_intr_disable(intr_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    intr_matrix_set(handle->cpu, handle->source, INT_MUX_DISABLED_INTNO);
+    return ESP_OK;
+}
+
+int esp_intr_get_cpu(intr_handle_t handle)
+{
+    return handle->cpu;
+}
+
+int esp_intr_get_intno(intr_handle_t handle)
+{
+    return handle->intno;
+}
+
+void IRAM_ATTR esp_intr_noniram_disable()
+{
+    const int cpu = xPortGetCoreID();
+    s_noniram_masked[cpu] = xt_ints_off(s_non_iram[cpu]) & s_non_iram[cpu];
+}
+
+void IRAM_ATTR esp_intr_noniram_enable()
+{
+    const int cpu = xPortGetCoreID();
+    xt_ints_on(s_noniram_masked[cpu]);
+    s_noniram_masked[cpu] = 0;
+}
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -25,67 +26,111 @@
 #include "freertos/semphr.h"
 
 
+typedef struct {
+    esp_ipc_func_t func;            // Function to call
+    void* arg;                      // Argument to pass into func
+    esp_ipc_func_t done_cb;         // Called after func, unless NULL
+    void* done_arg;                 // Argument to pass into done_cb
+    esp_ipc_future_t* future;       // Completed after done_cb, unless NULL
+} ipc_request_t;
+
+typedef struct {
+    ipc_request_t req[CONFIG_ESP_IPC_QUEUE_SIZE];
+    uint32_t head;                  // Next request to run, written by the IPC task only
+    uint32_t tail;                  // Next free entry, written by callers under lock
+    portMUX_TYPE lock;              // Serializes callers queueing requests against each other
+    SemaphoreHandle_t free_slots;   // Counts free entries, so that head and tail don't have to be compared
+} ipc_queue_t;
+
 static TaskHandle_t s_ipc_tasks[portNUM_PROCESSORS];         // Two high priority tasks, one for each CPU
-static SemaphoreHandle_t s_ipc_mutex;                        // This mutex is used as a global lock for esp_ipc_* APIs
-static SemaphoreHandle_t s_ipc_sem[portNUM_PROCESSORS];      // Two semaphores used to wake each of s_ipc_tasks
-static SemaphoreHandle_t s_ipc_ack;                          // Semaphore used to acknowledge that task was woken up,
-                                                             //   or function has finished running
-static volatile esp_ipc_func_t s_func;                       // Function which should be called by high priority task
-static void * volatile s_func_arg;                           // Argument to pass into s_func
-typedef enum {
-    IPC_WAIT_FOR_START,
-    IPC_WAIT_FOR_END
-} esp_ipc_wait_t;
-
-static volatile esp_ipc_wait_t s_ipc_wait;                   // This variable tells high priority task when it should give
-                                                             //   s_ipc_ack semaphore: before s_func is called, or
-                                                             //   after it returns
+static StaticTask_t s_ipc_task_buf[portNUM_PROCESSORS];      // TCBs and stacks of the IPC tasks, these are never deleted
+static StackType_t s_ipc_task_stack[portNUM_PROCESSORS][XT_STACK_MIN_SIZE];
+static ipc_queue_t s_ipc_queue[portNUM_PROCESSORS];          // Requests of esp_ipc_call_async and esp_ipc_call_blocking
+
+// esp_ipc_call doesn't go through the queue: it has a single slot for each
+// CPU, which the IPC task checks before each queued request.
+static SemaphoreHandle_t s_ipc_mutex[portNUM_PROCESSORS];    // Held by the caller of esp_ipc_call until the call has started
+static SemaphoreHandle_t s_ipc_ack[portNUM_PROCESSORS];      // Semaphore used to acknowledge that task was woken up
+static volatile esp_ipc_func_t s_func[portNUM_PROCESSORS];   // Function which should be called by high priority task
+static void * volatile s_func_arg[portNUM_PROCESSORS];       // Argument to pass into s_func
+
+static bool IRAM_ATTR ipc_queue_pop(ipc_queue_t* queue, ipc_request_t* req)
+{
+    bool found = false;
+    portENTER_CRITICAL(&queue->lock);
+    if (queue->head != queue->tail) {
+        *req = queue->req[queue->head];
+        queue->head = (queue->head + 1) % CONFIG_ESP_IPC_QUEUE_SIZE;
+        found = true;
+    }
+    portEXIT_CRITICAL(&queue->lock);
+    return found;
+}
 
 static void IRAM_ATTR ipc_task(void* arg)
 {
     const uint32_t cpuid = (uint32_t) arg;
     assert(cpuid == xPortGetCoreID());
+    ipc_queue_t* queue = &s_ipc_queue[cpuid];
     while (true) {
         // Wait for IPC to be initiated.
-        // This will be indicated by giving the semaphore corresponding to
-        // this CPU.
-        if (xSemaphoreTake(s_ipc_sem[cpuid], portMAX_DELAY) != pdTRUE) {
+        // This will be indicated by a notification to the task of this CPU.
+        if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) == 0) {
             // TODO: when can this happen?
             abort();
         }
 
-        esp_ipc_func_t func = s_func;
-        void* arg = s_func_arg;
-
-        if (s_ipc_wait == IPC_WAIT_FOR_START) {
-            xSemaphoreGive(s_ipc_ack);
-        }
-        (*func)(arg);
-        if (s_ipc_wait == IPC_WAIT_FOR_END) {
-            xSemaphoreGive(s_ipc_ack);
+        // Several requests may have been made since the task was last woken
+        // up, run all of them before waiting again.
+        while (true) {
+            esp_ipc_func_t func = s_func[cpuid];
+            if (func != NULL) {
+                void* arg = s_func_arg[cpuid];
+                s_func[cpuid] = NULL;
+                xSemaphoreGive(s_ipc_ack[cpuid]);
+                (*func)(arg);
+                continue;
+            }
+
+            ipc_request_t req;
+            if (!ipc_queue_pop(queue, &req)) {
+                break;
+            }
+            xSemaphoreGive(queue->free_slots);
+            (*req.func)(req.arg);
+            if (req.done_cb) {
+                (*req.done_cb)(req.done_arg);
+            }
+            if (req.future) {
+                xSemaphoreGive(req.future->done);
+            }
         }
     }
     // TODO: currently this is unreachable code. Introduce esp_ipc_uninit
     // function which will signal to both tasks that they can shut down.
     // Not critical at this point, we don't have a use case for stopping
     // IPC yet.
-    // Also need to delete the semaphore here.
     vTaskDelete(NULL);
 }
 
 void esp_ipc_init()
 {
-    s_ipc_mutex = xSemaphoreCreateMutex();
-    s_ipc_ack = xSemaphoreCreateBinary();
     const char* task_names[2] = {"ipc0", "ipc1"};
     for (int i = 0; i < portNUM_PROCESSORS; ++i) {
-        s_ipc_sem[i] = xSemaphoreCreateBinary();
-        xTaskCreatePinnedToCore(ipc_task, task_names[i], XT_STACK_MIN_SIZE, (void*) i,
-                                configMAX_PRIORITIES - 1, &s_ipc_tasks[i], i);
+        s_ipc_mutex[i] = xSemaphoreCreateMutex();
+        s_ipc_ack[i] = xSemaphoreCreateBinary();
+        vPortCPUInitializeMutex(&s_ipc_queue[i].lock);
+        s_ipc_queue[i].free_slots = xSemaphoreCreateCounting(CONFIG_ESP_IPC_QUEUE_SIZE, CONFIG_ESP_IPC_QUEUE_SIZE);
+        xTaskCreateStaticPinnedToCore(ipc_task, task_names[i], XT_STACK_MIN_SIZE, (void*) i,
+                                configMAX_PRIORITIES - 1, s_ipc_task_stack[i], &s_ipc_task_buf[i],
+                                &s_ipc_tasks[i], i);
+        // ipc_task runs from IRAM; functions it is asked to call must be in
+        // IRAM as well. This lets the flash driver use it while the cache is off.
+        vTaskSetIramSafe(s_ipc_tasks[i], pdTRUE);
     }
 }
 
-static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, void* arg, esp_ipc_wait_t wait_for)
+static esp_err_t ipc_check_args(uint32_t cpu_id)
 {
     if (cpu_id >= portNUM_PROCESSORS) {
         return ESP_ERR_INVALID_ARG;
@@ -93,25 +138,83 @@ static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, voi
     if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
         return ESP_ERR_INVALID_STATE;
     }
+    return ESP_OK;
+}
 
-    xSemaphoreTake(s_ipc_mutex, portMAX_DELAY);
-
-    s_func = func;
-    s_func_arg = arg;
-    s_ipc_wait = IPC_WAIT_FOR_START;
-    xSemaphoreGive(s_ipc_sem[cpu_id]);
-    xSemaphoreTake(s_ipc_ack, portMAX_DELAY);
-    xSemaphoreGive(s_ipc_mutex);
+static esp_err_t ipc_queue_push(uint32_t cpu_id, const ipc_request_t* req)
+{
+    esp_err_t err = ipc_check_args(cpu_id);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ipc_queue_t* queue = &s_ipc_queue[cpu_id];
+    xSemaphoreTake(queue->free_slots, portMAX_DELAY);
+    portENTER_CRITICAL(&queue->lock);
+    queue->req[queue->tail] = *req;
+    queue->tail = (queue->tail + 1) % CONFIG_ESP_IPC_QUEUE_SIZE;
+    portEXIT_CRITICAL(&queue->lock);
+    xTaskNotifyGive(s_ipc_tasks[cpu_id]);
     return ESP_OK;
 }
 
 esp_err_t esp_ipc_call(uint32_t cpu_id, esp_ipc_func_t func, void* arg)
 {
-    return esp_ipc_call_and_wait(cpu_id, func, arg, IPC_WAIT_FOR_START);
+    esp_err_t err = ipc_check_args(cpu_id);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(s_ipc_mutex[cpu_id], portMAX_DELAY);
+
+    s_func_arg[cpu_id] = arg;
+    s_func[cpu_id] = func;
+    xTaskNotifyGive(s_ipc_tasks[cpu_id]);
+    xSemaphoreTake(s_ipc_ack[cpu_id], portMAX_DELAY);
+    xSemaphoreGive(s_ipc_mutex[cpu_id]);
+    return ESP_OK;
 }
 
-esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void* arg)
+esp_err_t esp_ipc_call_async(uint32_t cpu_id, esp_ipc_func_t func, void* arg,
+                             esp_ipc_func_t done_cb, void* done_arg)
+{
+    const ipc_request_t req = {
+        .func = func,
+        .arg = arg,
+        .done_cb = done_cb,
+        .done_arg = done_arg,
+        .future = NULL
+    };
+    return ipc_queue_push(cpu_id, &req);
+}
+
+esp_err_t esp_ipc_call_future(uint32_t cpu_id, esp_ipc_func_t func, void* arg,
+                              esp_ipc_future_t* future)
+{
+    future->done = xSemaphoreCreateBinaryStatic(&future->done_buf);
+    const ipc_request_t req = {
+        .func = func,
+        .arg = arg,
+        .done_cb = NULL,
+        .done_arg = NULL,
+        .future = future
+    };
+    return ipc_queue_push(cpu_id, &req);
+}
+
+esp_err_t esp_ipc_future_wait(esp_ipc_future_t* future, TickType_t ticks_to_wait)
 {
-    return esp_ipc_call_and_wait(cpu_id, func, arg, IPC_WAIT_FOR_END);
+    if (xSemaphoreTake(future->done, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
 }
 
+esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void* arg)
+{
+    esp_ipc_future_t future;
+    esp_err_t err = esp_ipc_call_future(cpu_id, func, arg, &future);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_ipc_future_wait(&future, portMAX_DELAY);
+}
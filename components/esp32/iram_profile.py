@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+#
+# Writes an IRAM placement file (see CONFIG_ESP32_IRAM_PLACEMENT_FILE) from
+# the samples printed by esp_profiler_print, either counted per PC or as
+# call stacks, of which the innermost PC is used.
+#
+# The sampled PCs are mapped to functions with the symbol table of the app
+# ELF file. Functions running from flash are listed, the most sampled first,
+# until they account for the requested share of the samples in flash or
+# their size reaches the IRAM budget.
+import argparse
+import bisect
+import re
+import subprocess
+import sys
+
+__version__ = '1.0'
+
+IRAM_START = 0x40080000
+IRAM_END = 0x400a0000
+IROM_START = 0x400d0000
+IROM_END = 0x40400000
+
+SAMPLE_RE = re.compile(r'pc 0x([0-9a-fA-F]+) (\d+)')
+STACK_RE = re.compile(r'st \d+ 0x([0-9a-fA-F]+)')
+
+
+def read_functions(nm, elf):
+    output = subprocess.check_output([nm, '--defined-only', '-S', '-n', elf])
+    functions = []
+    for line in output.decode().splitlines():
+        fields = line.split()
+        if len(fields) != 4 or fields[2] not in 'tTwW':
+            continue
+        functions.append((int(fields[0], 16), int(fields[1], 16), fields[3]))
+    return functions
+
+
+def read_samples(log):
+    samples = {}
+    for line in log:
+        match = SAMPLE_RE.search(line)
+        if match:
+            pc = int(match.group(1), 16)
+            samples[pc] = samples.get(pc, 0) + int(match.group(2))
+            continue
+        match = STACK_RE.search(line)
+        if match:
+            pc = int(match.group(1), 16)
+            samples[pc] = samples.get(pc, 0) + 1
+    return samples
+
+
+def region(address):
+    if IRAM_START <= address < IRAM_END:
+        return 'iram'
+    if IROM_START <= address < IROM_END:
+        return 'flash'
+    return 'other'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='iram_profile.py v%s - write an IRAM placement file from '
+                                     'esp_profiler samples' % __version__)
+    parser.add_argument('elf', help='app ELF file the samples were taken with')
+    parser.add_argument('log', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+                        help='console output with the esp_profiler_print lines (default: stdin)')
+    parser.add_argument('--output', '-o', type=argparse.FileType('w'), default=sys.stdout,
+                        help='placement file (default: stdout)')
+    parser.add_argument('--nm', default='xtensa-esp32-elf-nm', help='nm of the toolchain')
+    parser.add_argument('--coverage', type=float, default=90,
+                        help='percentage of the samples in flash to cover (default: 90)')
+    parser.add_argument('--max-size', type=int, default=16384,
+                        help='IRAM budget for the functions, in bytes (default: 16384)')
+    parser.add_argument('--min-samples', type=int, default=2,
+                        help='leave out functions with fewer samples (default: 2)')
+    args = parser.parse_args()
+
+    functions = read_functions(args.nm, args.elf)
+    starts = [f[0] for f in functions]
+    samples = read_samples(args.log)
+    if not samples:
+        sys.exit('No samples from esp_profiler_print found')
+
+    counts = {}
+    totals = {'iram': 0, 'flash': 0, 'other': 0}
+    for pc, count in samples.items():
+        totals[region(pc)] += count
+        i = bisect.bisect_right(starts, pc) - 1
+        if i < 0 or pc >= functions[i][0] + max(functions[i][1], 1):
+            continue
+        counts[functions[i]] = counts.get(functions[i], 0) + count
+
+    total = sum(totals.values())
+    sys.stderr.write('%d samples: %d in IRAM, %d in flash, %d elsewhere\n' %
+                     (total, totals['iram'], totals['flash'], totals['other']))
+
+    hot = sorted((f for f in counts if region(f[0]) == 'flash'), key=lambda f: -counts[f])
+    covered = 0
+    size = 0
+    args.output.write('# Generated by iram_profile.py from %d samples\n' % total)
+    for function in hot:
+        count = counts[function]
+        if count < args.min_samples or covered * 100 >= args.coverage * totals['flash']:
+            break
+        if size + function[1] > args.max_size:
+            continue
+        covered += count
+        size += function[1]
+        args.output.write('%s  # %d samples, %d bytes\n' % (function[2], count, function[1]))
+    sys.stderr.write('Listed functions cover %d of the samples in flash, %d bytes\n' % (covered, size))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,157 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "esp_err.h"
+#include "esp_mempool.h"
+#include "heap_alloc_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define MEMPOOL_MAX_BATCH   8   // Maximum number of objects moved between per-CPU and shared lists at once
+
+typedef struct mempool_obj {
+    struct mempool_obj* next;
+} mempool_obj_t;
+
+typedef struct {
+    mempool_obj_t* head;
+    size_t count;
+} mempool_list_t;
+
+struct esp_mempool {
+    uint8_t* storage;                           // Memory holding all objects
+    size_t obj_size;
+    size_t obj_count;
+    size_t batch;                               // Number of objects moved between lists at once
+    portMUX_TYPE lock;                          // Protects shared
+    mempool_list_t shared;                      // Free objects not owned by any CPU
+    mempool_list_t local[portNUM_PROCESSORS];   // Free objects of each CPU, only used by that CPU
+};
+
+// Move up to count objects from the head of one list to another
+static void mempool_move(mempool_list_t* from, mempool_list_t* to, size_t count)
+{
+    while (count-- > 0 && from->head != NULL) {
+        mempool_obj_t* obj = from->head;
+        from->head = obj->next;
+        from->count--;
+        obj->next = to->head;
+        to->head = obj;
+        to->count++;
+    }
+}
+
+esp_err_t esp_mempool_create(size_t obj_size, size_t obj_count, uint32_t caps, esp_mempool_handle_t* out_pool)
+{
+    if (obj_size == 0 || obj_count == 0 || out_pool == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    obj_size = (obj_size + sizeof(mempool_obj_t) - 1) & ~(sizeof(mempool_obj_t) - 1);
+    if (obj_count > SIZE_MAX / obj_size) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_mempool_handle_t pool = calloc(1, sizeof(struct esp_mempool));
+    if (pool == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pool->storage = pvPortMallocCaps(obj_size * obj_count, caps);
+    if (pool->storage == NULL) {
+        free(pool);
+        return ESP_ERR_NO_MEM;
+    }
+    pool->obj_size = obj_size;
+    pool->obj_count = obj_count;
+    vPortCPUInitializeMutex(&pool->lock);
+
+    // Keep per-CPU lists short compared to the pool, so that few objects
+    // can get stuck in the list of a CPU which doesn't need them.
+    pool->batch = obj_count / (4 * portNUM_PROCESSORS);
+    if (pool->batch == 0) {
+        pool->batch = 1;
+    } else if (pool->batch > MEMPOOL_MAX_BATCH) {
+        pool->batch = MEMPOOL_MAX_BATCH;
+    }
+
+    // Link all objects into the shared list, lowest address first
+    for (size_t i = obj_count; i > 0; --i) {
+        mempool_obj_t* obj = (mempool_obj_t*) (pool->storage + (i - 1) * obj_size);
+        obj->next = pool->shared.head;
+        pool->shared.head = obj;
+    }
+    pool->shared.count = obj_count;
+
+    *out_pool = pool;
+    return ESP_OK;
+}
+
+void esp_mempool_delete(esp_mempool_handle_t pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    vPortFree(pool->storage);
+    free(pool);
+}
+
+void* esp_mempool_alloc(esp_mempool_handle_t pool)
+{
+    unsigned state = portENTER_CRITICAL_NESTED();
+    mempool_list_t* local = &pool->local[xPortGetCoreID()];
+    if (local->head == NULL) {
+        taskENTER_CRITICAL(&pool->lock);
+        mempool_move(&pool->shared, local, pool->batch);
+        taskEXIT_CRITICAL(&pool->lock);
+    }
+    mempool_obj_t* obj = local->head;
+    if (obj != NULL) {
+        local->head = obj->next;
+        local->count--;
+    }
+    portEXIT_CRITICAL_NESTED(state);
+    return obj;
+}
+
+void esp_mempool_free(esp_mempool_handle_t pool, void* obj)
+{
+    if (obj == NULL) {
+        return;
+    }
+    assert(esp_mempool_contains(pool, obj));
+    assert(((uint8_t*) obj - pool->storage) % pool->obj_size == 0);
+
+    unsigned state = portENTER_CRITICAL_NESTED();
+    mempool_list_t* local = &pool->local[xPortGetCoreID()];
+    mempool_obj_t* o = (mempool_obj_t*) obj;
+    o->next = local->head;
+    local->head = o;
+    local->count++;
+    if (local->count >= 2 * pool->batch) {
+        taskENTER_CRITICAL(&pool->lock);
+        mempool_move(local, &pool->shared, pool->batch);
+        taskEXIT_CRITICAL(&pool->lock);
+    }
+    portEXIT_CRITICAL_NESTED(state);
+}
+
+bool esp_mempool_contains(esp_mempool_handle_t pool, const void* ptr)
+{
+    const uint8_t* p = (const uint8_t*) ptr;
+    return p >= pool->storage && p < pool->storage + pool->obj_size * pool->obj_count;
+}
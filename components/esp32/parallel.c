@@ -0,0 +1,173 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_parallel.h"
+#include "esp_task.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef struct {
+    esp_parallel_for_func_t func;
+    void* arg;
+    uint32_t next;                  // First index not claimed by a worker yet
+    uint32_t end;
+    uint32_t chunk;
+    portMUX_TYPE lock;              // Protects next
+} parallel_for_t;
+
+static TaskHandle_t s_workers[portNUM_PROCESSORS];          // One worker task pinned to each CPU
+static void* s_scratch[portNUM_PROCESSORS];                 // Scratch buffer of each worker
+static SemaphoreHandle_t s_run_mutex;                       // Serializes callers of esp_parallel_run
+static SemaphoreHandle_t s_join;                            // Given by the last worker to finish a job
+static portMUX_TYPE s_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_pending;                                  // Workers which haven't finished the current job
+static esp_parallel_job_t s_job;                            // Current job and its argument, set before the
+static void* s_job_arg;                                     //   workers are notified
+
+static void parallel_task(void* arg)
+{
+    const uint32_t core = (uint32_t) arg;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        (*s_job)(core, s_scratch[core], s_job_arg);
+
+        portENTER_CRITICAL(&s_pending_lock);
+        bool last = (--s_pending == 0);
+        portEXIT_CRITICAL(&s_pending_lock);
+        if (last) {
+            xSemaphoreGive(s_join);
+        }
+    }
+}
+
+static bool is_worker(TaskHandle_t task)
+{
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        if (s_workers[i] == task) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t esp_parallel_init(UBaseType_t priority, size_t scratch_size)
+{
+    if (s_run_mutex != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_run_mutex = xSemaphoreCreateMutex();
+    s_join = xSemaphoreCreateBinary();
+    if (s_run_mutex == NULL || s_join == NULL) {
+        goto fail;
+    }
+    const char* task_names[2] = {"parallel0", "parallel1"};
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        if (scratch_size > 0) {
+            s_scratch[i] = pvPortMalloc(scratch_size);
+            if (s_scratch[i] == NULL) {
+                goto fail;
+            }
+        }
+        if (xTaskCreatePinnedToCore(parallel_task, task_names[i], ESP_TASKD_PARALLEL_STACK,
+                                    (void*) i, priority, &s_workers[i], i) != pdPASS) {
+            goto fail;
+        }
+    }
+    return ESP_OK;
+
+fail:
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        if (s_workers[i] != NULL) {
+            vTaskDelete(s_workers[i]);
+            s_workers[i] = NULL;
+        }
+        vPortFree(s_scratch[i]);
+        s_scratch[i] = NULL;
+    }
+    if (s_join != NULL) {
+        vSemaphoreDelete(s_join);
+        s_join = NULL;
+    }
+    if (s_run_mutex != NULL) {
+        vSemaphoreDelete(s_run_mutex);
+        s_run_mutex = NULL;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_parallel_run(esp_parallel_job_t job, void* arg)
+{
+    if (job == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_run_mutex == NULL || is_worker(xTaskGetCurrentTaskHandle())) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_run_mutex, portMAX_DELAY);
+    s_job = job;
+    s_job_arg = arg;
+    s_pending = portNUM_PROCESSORS;
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        xTaskNotifyGive(s_workers[i]);
+    }
+    xSemaphoreTake(s_join, portMAX_DELAY);
+    xSemaphoreGive(s_run_mutex);
+    return ESP_OK;
+}
+
+static void parallel_for_job(uint32_t core, void* scratch, void* arg)
+{
+    parallel_for_t* loop = (parallel_for_t*) arg;
+    while (true) {
+        portENTER_CRITICAL(&loop->lock);
+        uint32_t begin = loop->next;
+        uint32_t end = (loop->end - begin > loop->chunk) ? begin + loop->chunk : loop->end;
+        loop->next = end;
+        portEXIT_CRITICAL(&loop->lock);
+        if (begin == end) {
+            break;
+        }
+        (*loop->func)(begin, end, scratch, loop->arg);
+    }
+}
+
+esp_err_t esp_parallel_for(uint32_t begin, uint32_t end, uint32_t chunk,
+                           esp_parallel_for_func_t func, void* arg)
+{
+    if (func == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (begin >= end) {
+        return ESP_OK;
+    }
+    if (chunk == 0) {
+        chunk = (end - begin + portNUM_PROCESSORS - 1) / portNUM_PROCESSORS;
+    }
+    parallel_for_t loop = {
+        .func = func,
+        .arg = arg,
+        .next = begin,
+        .end = end,
+        .chunk = chunk,
+    };
+    vPortCPUInitializeMutex(&loop.lock);
+    return esp_parallel_run(&parallel_for_job, &loop);
+}
@@ -0,0 +1,237 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "esp_pm.h"
+#include "esp_pm_impl.h"
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
+#include "rom/ets_sys.h"
+#include "soc/cpu.h"
+#include "soc/soc.h"
+#include "soc/dport_reg.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/xtensa_timer.h"
+#include "xtensa/hal.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PM_ENABLE
+
+/* Frequencies are handled as levels: 80, 160 and 240 MHz are 0, 1 and 2 */
+#define PM_LEVELS           3
+#define PM_LEVEL_MHZ(l)     (((l) + 1) * 80)
+
+typedef struct {
+    esp_pm_freq_cb_t cb;
+    void* arg;
+} pm_freq_cb_t;
+
+/* Everything below is protected by s_pm_mux. It is used with the flash
+ * cache possibly disabled, so it stays in DRAM and the code in IRAM. */
+static portMUX_TYPE s_pm_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool s_configured;
+static int s_max_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+static int s_min_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+static int s_cpu_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+static bool s_cpu_busy[portNUM_PROCESSORS];
+static uint32_t s_lock_count[PM_LEVELS];        // Locks held at each level
+static pm_freq_cb_t s_freq_cbs[CONFIG_PM_MAX_FREQ_CALLBACKS];
+static int s_freq_cb_count;
+
+/* Frequency the tick timer and ets_delay_us of each CPU are set up for. A
+ * CPU other than the one switching the frequency catches up in its
+ * interrupt, by which time the new frequency has been in effect for a few
+ * cycles. */
+static int s_cpu_setup_mhz[portNUM_PROCESSORS];
+static intr_handle_t s_intr[portNUM_PROCESSORS];
+
+static inline int IRAM_ATTR pm_level(int mhz)
+{
+    int level = (mhz + 79) / 80 - 1;
+    return (level < 0) ? 0 : (level >= PM_LEVELS) ? PM_LEVELS - 1 : level;
+}
+
+static bool pm_freq_valid(int mhz)
+{
+    return mhz == 80 || mhz == 160 || mhz == 240;
+}
+
+static int IRAM_ATTR pm_target_mhz()
+{
+    int mhz = s_min_mhz;
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; ++cpu) {
+        if (s_cpu_busy[cpu]) {
+            mhz = s_max_mhz;
+        }
+    }
+    for (int level = PM_LEVELS - 1; level >= 0; --level) {
+        if (s_lock_count[level] != 0) {
+            int lock_mhz = PM_LEVEL_MHZ(level);
+            if (lock_mhz > s_max_mhz) {
+                lock_mhz = s_max_mhz;
+            }
+            if (lock_mhz > mhz) {
+                mhz = lock_mhz;
+            }
+            break;
+        }
+    }
+    return mhz;
+}
+
+/* Bring the tick timer and ets_delay_us of this CPU to the current
+ * frequency. CCOMPARE holds the time of the next tick in cycles at the old
+ * frequency, the cycles left until then are scaled. A tick which is due
+ * already is handled by the tick interrupt as usual. */
+static void IRAM_ATTR pm_update_this_cpu()
+{
+    int cpu = xPortGetCoreID();
+    int old_mhz = s_cpu_setup_mhz[cpu];
+    int new_mhz = s_cpu_freq_mhz;
+    if (old_mhz == new_mhz) {
+        return;
+    }
+    uint32_t ccount = xthal_get_ccount();
+    int32_t left = (int32_t) (xthal_get_ccompare(XT_TIMER_INDEX) - ccount);
+    if (left > 0) {
+        uint32_t scaled = (left / old_mhz) * new_mhz + (left % old_mhz) * new_mhz / old_mhz;
+        xthal_set_ccompare(XT_TIMER_INDEX, ccount + scaled);
+    }
+    ets_update_cpu_frequency(new_mhz);
+    s_cpu_setup_mhz[cpu] = new_mhz;
+}
+
+static void IRAM_ATTR pm_intr(void* arg)
+{
+    WRITE_PERI_REG(DPORT_CPU_INTR_FROM_CPU_2_REG + 4 * xPortGetCoreID(), 0);
+    portENTER_CRITICAL_ISR(&s_pm_mux);
+    pm_update_this_cpu();
+    portEXIT_CRITICAL_ISR(&s_pm_mux);
+}
+
+/* Called with s_pm_mux held */
+static void IRAM_ATTR pm_switch(int mhz)
+{
+    int old_mhz = s_cpu_freq_mhz;
+    if (mhz == old_mhz) {
+        return;
+    }
+    esp_cpu_freq_switch(mhz);
+    s_cpu_freq_mhz = mhz;
+    _xt_tick_divisor = mhz * 1000000 / XT_TICK_PER_SEC;
+    pm_update_this_cpu();
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; ++cpu) {
+        if (cpu != xPortGetCoreID() && s_intr[cpu] != NULL) {
+            WRITE_PERI_REG(DPORT_CPU_INTR_FROM_CPU_2_REG + 4 * cpu, DPORT_CPU_INTR_FROM_CPU_2);
+        }
+    }
+    for (int i = 0; i < s_freq_cb_count; ++i) {
+        (*s_freq_cbs[i].cb)(old_mhz, mhz, s_freq_cbs[i].arg);
+    }
+}
+
+esp_err_t esp_pm_configure(const esp_pm_config_t* config)
+{
+    if (!pm_freq_valid(config->max_freq_mhz) || !pm_freq_valid(config->min_freq_mhz) ||
+            config->min_freq_mhz > config->max_freq_mhz) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; ++cpu) {
+        if (s_intr[cpu] != NULL) {
+            continue;
+        }
+        s_cpu_setup_mhz[cpu] = s_cpu_freq_mhz;
+        esp_err_t err = esp_intr_alloc_pinned_to_core(ETS_FROM_CPU_INTR2_SOURCE + cpu, ESP_INTR_FLAG_IRAM,
+                                                      &pm_intr, NULL, cpu, &s_intr[cpu]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    portENTER_CRITICAL(&s_pm_mux);
+    s_max_mhz = config->max_freq_mhz;
+    s_min_mhz = config->min_freq_mhz;
+    if (!s_configured) {
+        // The other CPUs are marked idle at their next context switch
+        for (int cpu = 0; cpu < portNUM_PROCESSORS; ++cpu) {
+            s_cpu_busy[cpu] = true;
+        }
+        s_configured = true;
+    }
+    pm_switch(pm_target_mhz());
+    portEXIT_CRITICAL(&s_pm_mux);
+    return ESP_OK;
+}
+
+void IRAM_ATTR esp_pm_impl_switched_in(bool idle)
+{
+    int cpu = xPortGetCoreID();
+    if (!s_configured || s_cpu_busy[cpu] == !idle) {
+        return;
+    }
+    portENTER_CRITICAL_ISR(&s_pm_mux);
+    s_cpu_busy[cpu] = !idle;
+    pm_switch(pm_target_mhz());
+    portEXIT_CRITICAL_ISR(&s_pm_mux);
+}
+
+void IRAM_ATTR esp_pm_lock_acquire(esp_pm_lock_t* lock)
+{
+    portENTER_CRITICAL(&s_pm_mux);
+    if (lock->count++ == 0) {
+        int mhz = lock->freq_mhz;
+        if (mhz == ESP_PM_CPU_FREQ_MAX || mhz > s_max_mhz) {
+            mhz = s_max_mhz;
+        }
+        int level = pm_level(mhz);
+        lock->held_mhz = PM_LEVEL_MHZ(level);
+        ++s_lock_count[level];
+        if (s_configured && s_cpu_freq_mhz < lock->held_mhz) {
+            pm_switch(pm_target_mhz());
+        }
+    }
+    portEXIT_CRITICAL(&s_pm_mux);
+}
+
+void IRAM_ATTR esp_pm_lock_release(esp_pm_lock_t* lock)
+{
+    portENTER_CRITICAL(&s_pm_mux);
+    configASSERT(lock->count > 0);
+    if (--lock->count == 0) {
+        --s_lock_count[pm_level(lock->held_mhz)];
+    }
+    portEXIT_CRITICAL(&s_pm_mux);
+}
+
+esp_err_t esp_pm_register_freq_cb(esp_pm_freq_cb_t cb, void* arg)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_pm_mux);
+    if (s_freq_cb_count < CONFIG_PM_MAX_FREQ_CALLBACKS) {
+        s_freq_cbs[s_freq_cb_count].cb = cb;
+        s_freq_cbs[s_freq_cb_count].arg = arg;
+        ++s_freq_cb_count;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_pm_mux);
+    return err;
+}
+
+int IRAM_ATTR esp_pm_get_cpu_freq_mhz(void)
+{
+    return s_cpu_freq_mhz;
+}
+
+#endif // CONFIG_PM_ENABLE
@@ -0,0 +1,369 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
+#include "esp_profiler.h"
+#include "heap_alloc_caps.h"
+#include "soc/soc.h"
+#include "soc/dport_reg.h"
+#include "soc/timer_group_struct.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/xtensa_context.h"
+
+/* Timers count at APB_CLK / PROFILER_DIVIDER = 1 MHz */
+#define PROFILER_DIVIDER        (APB_CLK_FREQ / 1000000)
+#define PROFILER_MIN_PERIOD_US  10
+/* Number of table slots tried for a PC before its sample is dropped */
+#define PROFILER_MAX_PROBES     16
+/* Stack frames are only followed within internal DRAM, where task stacks
+   are, and to code addresses (ROM, IRAM and flash) */
+#define PROFILER_STACK_LOW      0x3ffae000
+#define PROFILER_STACK_HIGH     0x40000000
+#define PROFILER_CODE_LOW       0x40000000
+#define PROFILER_CODE_HIGH      0x40400000
+
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+} profiler_entry_t;
+
+extern unsigned port_interruptNesting[portNUM_PROCESSORS];
+
+/* The table and the counters are updated by the sampling interrupts of both
+   CPUs, under s_lock */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static profiler_entry_t* s_table;
+static size_t s_table_size;     // power of 2
+static int s_depth;             // 0 when counting PCs in the table
+static uint32_t* s_buf;         // stack records, see esp_profiler.h
+static size_t s_buf_words;
+static size_t s_buf_head;       // next word to write
+static size_t s_buf_used;       // words not read yet
+static uint32_t s_samples;
+static uint32_t s_in_isr;
+static uint32_t s_dropped;
+static bool s_running;
+static intr_handle_t s_intr[portNUM_PROCESSORS];
+
+static void IRAM_ATTR profiler_count(uint32_t pc)
+{
+    size_t mask = s_table_size - 1;
+    size_t i = ((pc >> 1) * 2654435761u) & mask;
+    for (int n = 0; n < PROFILER_MAX_PROBES; n++) {
+        profiler_entry_t* entry = &s_table[i];
+        if (entry->pc == pc) {
+            entry->count++;
+            return;
+        }
+        if (entry->pc == 0) {
+            entry->pc = pc;
+            entry->count = 1;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    s_dropped++;
+}
+
+static inline void IRAM_ATTR profiler_put(uint32_t word)
+{
+    s_buf[s_buf_head] = word;
+    s_buf_head = (s_buf_head + 1) % s_buf_words;
+    s_buf_used++;
+}
+
+static void IRAM_ATTR profiler_record(int cpu, const uint32_t* pcs, int count)
+{
+    if (s_buf_used + count + 1 > s_buf_words) {
+        s_dropped++;
+        return;
+    }
+    profiler_put(((uint32_t) cpu << ESP_PROFILER_RECORD_CPU_S) | count);
+    for (int i = 0; i < count; i++) {
+        profiler_put(pcs[i]);
+    }
+}
+
+static int IRAM_ATTR profiler_walk(const XtExcFrame* frame, uint32_t* pcs, int depth)
+{
+    // The interrupt entry has spilled the register windows to the stack, so
+    // the base save area below each stack pointer holds a0 (the return
+    // address) and a1 (the stack pointer) of the caller
+    int count = 0;
+    pcs[count++] = frame->pc;
+    uint32_t ra = frame->a0;
+    uint32_t sp = frame->a1;
+    while (count < depth && sp >= PROFILER_STACK_LOW + 16 && sp < PROFILER_STACK_HIGH
+            && (sp & 0xf) == 0) {
+        // The top bits of a return address hold the window size of the call
+        // instead of the address bits; point to the call instruction
+        uint32_t pc = ((ra & 0x3fffffff) | 0x40000000) - 3;
+        if ((ra & 0xc0000000) == 0 || pc < PROFILER_CODE_LOW || pc >= PROFILER_CODE_HIGH) {
+            break;
+        }
+        pcs[count++] = pc;
+        ra = ((uint32_t*) sp)[-4];
+        sp = ((uint32_t*) sp)[-3];
+    }
+    return count;
+}
+
+static void IRAM_ATTR profiler_isr(void* arg)
+{
+    int cpu = xPortGetCoreID();
+    if (cpu == 0) {
+        TIMERG1.int_clr_timers.t0 = 1;
+    } else {
+        TIMERG1.int_clr_timers.t1 = 1;
+    }
+    // The alarm is disabled each time it fires
+    TIMERG1.hw_timer[cpu].config.alarm_en = 1;
+
+    // Unless this interrupt is nested in another one, the interrupted task
+    // context has been saved on the task stack, which pxTopOfStack (the first
+    // member of the TCB) points to
+    uint32_t pcs[ESP_PROFILER_MAX_DEPTH];
+    int count = 0;
+    if (port_interruptNesting[cpu] == 1) {
+        XtExcFrame* frame = *(XtExcFrame**) xTaskGetCurrentTaskHandle();
+        if (s_depth == 0) {
+            pcs[0] = frame->pc;
+            count = 1;
+        } else {
+            count = profiler_walk(frame, pcs, s_depth);
+        }
+    } else if (port_interruptNesting[cpu] == 0) {
+        return;     // scheduler isn't running
+    }
+
+    portENTER_CRITICAL_ISR(&s_lock);
+    s_samples++;
+    if (count == 0) {
+        s_in_isr++;
+    }
+    if (s_depth > 0) {
+        profiler_record(cpu, pcs, count);
+    } else if (count > 0) {
+        profiler_count(pcs[0]);
+    }
+    portEXIT_CRITICAL_ISR(&s_lock);
+}
+
+static void profiler_timer_stop(int cpu)
+{
+    TIMERG1.hw_timer[cpu].config.enable = 0;
+    if (cpu == 0) {
+        TIMERG1.int_ena.t0 = 0;
+        TIMERG1.int_clr_timers.t0 = 1;
+    } else {
+        TIMERG1.int_ena.t1 = 0;
+        TIMERG1.int_clr_timers.t1 = 1;
+    }
+    if (s_intr[cpu] != NULL) {
+        esp_intr_free(s_intr[cpu]);
+        s_intr[cpu] = NULL;
+    }
+}
+
+static esp_err_t profiler_timer_start(int cpu, uint32_t period_us)
+{
+    TIMERG1.hw_timer[cpu].config.enable = 0;
+    TIMERG1.hw_timer[cpu].config.divider = PROFILER_DIVIDER;
+    TIMERG1.hw_timer[cpu].config.increase = 1;
+    TIMERG1.hw_timer[cpu].config.autoreload = 1;
+    TIMERG1.hw_timer[cpu].config.edge_int_en = 0;
+    TIMERG1.hw_timer[cpu].config.level_int_en = 1;
+    // Start the APP CPU half a period later, so the CPUs don't wait for
+    // each other's samples; the alarm reloads the counter with 0
+    TIMERG1.hw_timer[cpu].load_high = 0;
+    TIMERG1.hw_timer[cpu].load_low = (cpu == 0) ? 0 : period_us / 2;
+    TIMERG1.hw_timer[cpu].reload = 1;
+    TIMERG1.hw_timer[cpu].load_low = 0;
+    TIMERG1.hw_timer[cpu].alarm_high = 0;
+    TIMERG1.hw_timer[cpu].alarm_low = period_us;
+    TIMERG1.hw_timer[cpu].config.alarm_en = 1;
+
+    int source = (cpu == 0) ? ETS_TG1_T0_LEVEL_INTR_SOURCE : ETS_TG1_T1_LEVEL_INTR_SOURCE;
+    esp_err_t err = esp_intr_alloc_pinned_to_core(source, ESP_INTR_FLAG_LEVEL1 | ESP_INTR_FLAG_IRAM,
+            &profiler_isr, NULL, cpu, &s_intr[cpu]);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (cpu == 0) {
+        TIMERG1.int_clr_timers.t0 = 1;
+        TIMERG1.int_ena.t0 = 1;
+    } else {
+        TIMERG1.int_clr_timers.t1 = 1;
+        TIMERG1.int_ena.t1 = 1;
+    }
+    TIMERG1.hw_timer[cpu].config.enable = 1;
+    return ESP_OK;
+}
+
+static void profiler_free(void)
+{
+    if (s_table != NULL) {
+        vPortFree(s_table);
+        s_table = NULL;
+    }
+    if (s_buf != NULL) {
+        vPortFree(s_buf);
+        s_buf = NULL;
+    }
+    s_samples = 0;
+    s_in_isr = 0;
+    s_dropped = 0;
+}
+
+static esp_err_t profiler_start(uint32_t period_us)
+{
+    SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_TIMERGROUP1_CLK_EN);
+    CLEAR_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_TIMERGROUP1_RST);
+
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        esp_err_t err = profiler_timer_start(cpu, period_us);
+        if (err != ESP_OK) {
+            for (int i = 0; i <= cpu; i++) {
+                profiler_timer_stop(i);
+            }
+            return err;
+        }
+    }
+    s_running = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_profiler_start(uint32_t period_us, size_t max_pcs)
+{
+    if (period_us < PROFILER_MIN_PERIOD_US || max_pcs == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t size = 1;
+    while (size < max_pcs) {
+        size <<= 1;
+    }
+    profiler_free();
+    // The table is accessed from the sampling interrupt, keep it in internal RAM
+    s_table = pvPortMallocCaps(size * sizeof(*s_table), MALLOC_CAP_8BIT | MALLOC_CAP_DMA);
+    if (s_table == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_table, 0, size * sizeof(*s_table));
+    s_table_size = size;
+    s_depth = 0;
+    return profiler_start(period_us);
+}
+
+esp_err_t esp_profiler_start_stacks(uint32_t period_us, int depth, size_t buffer_size)
+{
+    if (period_us < PROFILER_MIN_PERIOD_US || depth < 1 || depth > ESP_PROFILER_MAX_DEPTH
+            || buffer_size < (ESP_PROFILER_MAX_DEPTH + 1) * sizeof(uint32_t)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    profiler_free();
+    s_buf = pvPortMallocCaps(buffer_size, MALLOC_CAP_8BIT | MALLOC_CAP_DMA);
+    if (s_buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_buf_words = buffer_size / sizeof(uint32_t);
+    s_buf_head = 0;
+    s_buf_used = 0;
+    s_depth = depth;
+    return profiler_start(period_us);
+}
+
+esp_err_t esp_profiler_stop(void)
+{
+    if (!s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        profiler_timer_stop(cpu);
+    }
+    s_running = false;
+    return ESP_OK;
+}
+
+size_t esp_profiler_read(void* buf, size_t size)
+{
+    uint32_t* out = (uint32_t*) buf;
+    size_t words = size / sizeof(uint32_t);
+    size_t n = 0;
+    if (s_buf == NULL) {
+        return 0;
+    }
+    portENTER_CRITICAL(&s_lock);
+    size_t tail = (s_buf_head + s_buf_words - s_buf_used) % s_buf_words;
+    while (s_buf_used > 0) {
+        size_t len = (s_buf[tail] & ESP_PROFILER_RECORD_COUNT_M) + 1;
+        if (n + len > words) {
+            break;
+        }
+        for (size_t i = 0; i < len; i++) {
+            out[n++] = s_buf[tail];
+            tail = (tail + 1) % s_buf_words;
+        }
+        s_buf_used -= len;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return n * sizeof(uint32_t);
+}
+
+static void profiler_print_stacks(void)
+{
+    uint32_t buf[4 * (ESP_PROFILER_MAX_DEPTH + 1)];
+    size_t len;
+    while ((len = esp_profiler_read(buf, sizeof(buf))) > 0) {
+        for (size_t i = 0; i < len / sizeof(uint32_t); ) {
+            int count = buf[i] & ESP_PROFILER_RECORD_COUNT_M;
+            printf("st %u", (unsigned) (buf[i] >> ESP_PROFILER_RECORD_CPU_S));
+            for (int j = 1; j <= count; j++) {
+                printf(" 0x%08x", (unsigned) buf[i + j]);
+            }
+            printf("\n");
+            i += count + 1;
+        }
+    }
+}
+
+esp_err_t esp_profiler_print(void)
+{
+    if ((s_running && s_depth == 0) || (s_table == NULL && s_buf == NULL)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    printf("profile: %u samples, %u in interrupts, %u dropped\n",
+            (unsigned) s_samples, (unsigned) s_in_isr, (unsigned) s_dropped);
+    if (s_depth > 0) {
+        profiler_print_stacks();
+        return ESP_OK;
+    }
+    for (size_t i = 0; i < s_table_size; i++) {
+        if (s_table[i].pc != 0) {
+            printf("pc 0x%08x %u\n", (unsigned) s_table[i].pc, (unsigned) s_table[i].count);
+        }
+    }
+    return ESP_OK;
+}
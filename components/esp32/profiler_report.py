@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+#
+# Prints a profile of an app from the call stacks recorded by
+# esp_profiler_start_stacks: the functions where the samples were taken
+# (self), the functions on the call stacks of the samples (total), and the
+# most frequent call stacks. PCs are symbolized with addr2line and the app
+# ELF file.
+#
+# The samples are read from the console output of esp_profiler_print ("st"
+# lines), or with --binary from the records of esp_profiler_read, as
+# streamed to a file by the app. --folded also writes the stacks in the
+# folded format of flamegraph.pl.
+import argparse
+import re
+import struct
+import subprocess
+import sys
+
+__version__ = '1.0'
+
+RECORD_COUNT_M = 0xff
+RECORD_CPU_S = 8
+
+STACK_RE = re.compile(r'st (\d+)((?: 0x[0-9a-fA-F]+)*)\s*$')
+
+
+def read_text(log):
+    for line in log:
+        match = STACK_RE.search(line)
+        if match:
+            yield int(match.group(1)), tuple(int(pc, 16) for pc in match.group(2).split())
+
+
+def read_binary(data):
+    words = struct.unpack('<%dI' % (len(data) // 4), data[:len(data) & ~3])
+    i = 0
+    while i < len(words):
+        count = words[i] & RECORD_COUNT_M
+        if i + 1 + count > len(words):
+            sys.stderr.write('Incomplete record at the end of the input\n')
+            break
+        yield words[i] >> RECORD_CPU_S, words[i + 1:i + 1 + count]
+        i += 1 + count
+
+
+def symbolize(addr2line, elf, pcs):
+    pcs = sorted(pcs)
+    if not pcs:
+        return {}
+    proc = subprocess.Popen([addr2line, '-f', '-e', elf], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    output, _ = proc.communicate(''.join('0x%08x\n' % pc for pc in pcs).encode())
+    lines = output.decode().splitlines()
+    names = {}
+    for i, pc in enumerate(pcs):
+        name = lines[2 * i] if 2 * i < len(lines) else '??'
+        names[pc] = name if name != '??' else '0x%08x' % pc
+    return names
+
+
+def print_table(title, counts, total, top):
+    print('\n%s' % title)
+    for name, count in sorted(counts.items(), key=lambda item: -item[1])[:top]:
+        print('%7d %5.1f%%  %s' % (count, 100.0 * count / total, name))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='profiler_report.py v%s - print a profile from '
+                                     'esp_profiler call stacks' % __version__)
+    parser.add_argument('elf', help='app ELF file the samples were taken with')
+    parser.add_argument('input', nargs='?', help='console output, or records with --binary (default: stdin)')
+    parser.add_argument('--binary', action='store_true', help='input holds the records of esp_profiler_read')
+    parser.add_argument('--addr2line', default='xtensa-esp32-elf-addr2line', help='addr2line of the toolchain')
+    parser.add_argument('--top', type=int, default=25, help='number of lines in each table (default: 25)')
+    parser.add_argument('--folded', type=argparse.FileType('w'), help='write the stacks for flamegraph.pl')
+    args = parser.parse_args()
+
+    if args.binary:
+        if args.input:
+            with open(args.input, 'rb') as f:
+                data = f.read()
+        else:
+            data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+        samples = list(read_binary(data))
+    else:
+        log = open(args.input) if args.input else sys.stdin
+        samples = list(read_text(log))
+    if not samples:
+        sys.exit('No call stacks from esp_profiler found')
+
+    names = symbolize(args.addr2line, args.elf, set(pc for _, stack in samples for pc in stack))
+
+    total = len(samples)
+    per_cpu = {}
+    in_isr = 0
+    self_counts = {}
+    total_counts = {}
+    stacks = {}
+    for cpu, stack in samples:
+        per_cpu[cpu] = per_cpu.get(cpu, 0) + 1
+        functions = tuple(names[pc] for pc in stack) if stack else ('(interrupt)',)
+        if not stack:
+            in_isr += 1
+        self_counts[functions[0]] = self_counts.get(functions[0], 0) + 1
+        for name in set(functions):
+            total_counts[name] = total_counts.get(name, 0) + 1
+        key = (cpu, functions)
+        stacks[key] = stacks.get(key, 0) + 1
+
+    print('%d samples, %d in interrupts, %s' % (total, in_isr, ', '.join(
+        '%d on CPU %d' % (count, cpu) for cpu, count in sorted(per_cpu.items()))))
+    print_table('Self (samples in the function)', self_counts, total, args.top)
+    print_table('Total (samples in the function and the functions it calls)', total_counts, total, args.top)
+    print('\nCall stacks')
+    for (cpu, functions), count in sorted(stacks.items(), key=lambda item: -item[1])[:args.top]:
+        print('%7d %5.1f%%  CPU %d: %s' % (count, 100.0 * count / total, cpu, ' <- '.join(functions)))
+
+    if args.folded:
+        for (cpu, functions), count in stacks.items():
+            args.folded.write('cpu%d;%s %d\n' % (cpu, ';'.join(reversed(functions)), count))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,24 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp_err.h"
+#include "spiram.h"
+
+/*
+Default for boards without SPI RAM, or whose support code doesn't provide enable_spi_sram().
+*/
+esp_err_t __attribute__((weak)) enable_spi_sram()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
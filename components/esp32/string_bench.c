@@ -0,0 +1,187 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_string_bench.h"
+#include "xtensa/hal.h"
+
+#define BENCH_MAX_SIZE  4096
+#define BENCH_SLACK     16
+#define BENCH_REPEATS   8
+
+typedef struct {
+    void *(*memcpy)(void *, const void *, size_t);
+    void *(*memmove)(void *, const void *, size_t);
+    void *(*memset)(void *, int, size_t);
+    int (*memcmp)(const void *, const void *, size_t);
+    size_t (*strlen)(const char *);
+    int (*strcmp)(const char *, const char *);
+    char *(*strcpy)(char *, const char *);
+} bench_funcs_t;
+
+/* The ROM versions, at the addresses esp32.rom.ld PROVIDEs for them. Their
+ * symbols are taken by the versions linked into the application. */
+static const bench_funcs_t s_rom_funcs = {
+    .memcpy = (void *) 0x4000c2c8,
+    .memmove = (void *) 0x4000c3c0,
+    .memset = (void *) 0x4000c44c,
+    .memcmp = (void *) 0x4000c260,
+    .strlen = (void *) 0x400014c0,
+    .strcmp = (void *) 0x40001274,
+    .strcpy = (void *) 0x400013ac,
+};
+
+static const bench_funcs_t s_app_funcs = {
+    .memcpy = memcpy,
+    .memmove = memmove,
+    .memset = memset,
+    .memcmp = memcmp,
+    .strlen = strlen,
+    .strcmp = strcmp,
+    .strcpy = strcpy,
+};
+
+/* Each test calls one function on dst and src, n bytes long, and returns
+ * its result in a form comparable between both versions */
+typedef struct {
+    const char *name;
+    int (*run)(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n);
+} bench_test_t;
+
+static int run_memcpy(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    return (uint8_t *) f->memcpy(dst, src, n) - dst;
+}
+
+/* Overlapping, so that it copies backwards */
+static int run_memmove(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    return (uint8_t *) f->memmove(src + 4, src, n) - src;
+}
+
+static int run_memset(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    return (uint8_t *) f->memset(dst, 0x5a, n) - dst;
+}
+
+static int run_memcmp(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    int ret = f->memcmp(dst, src, n);
+    return (ret > 0) - (ret < 0);
+}
+
+static int run_strlen(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    return f->strlen((const char *) src);
+}
+
+static int run_strcmp(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    int ret = f->strcmp((const char *) dst, (const char *) src);
+    return (ret > 0) - (ret < 0);
+}
+
+static int run_strcpy(const bench_funcs_t *f, uint8_t *dst, uint8_t *src, size_t n)
+{
+    return (uint8_t *) f->strcpy((char *) dst, (const char *) src) - dst;
+}
+
+static const bench_test_t s_tests[] = {
+    { "memcpy", run_memcpy },
+    { "memmove", run_memmove },
+    { "memset", run_memset },
+    { "memcmp", run_memcmp },
+    { "strlen", run_strlen },
+    { "strcmp", run_strcmp },
+    { "strcpy", run_strcpy },
+};
+
+static const size_t s_sizes[] = { 4, 16, 64, 256, 1024, BENCH_MAX_SIZE };
+
+/* Fill src with n non-zero bytes and a terminator, and dst with the same
+ * n bytes, so that the compare functions have to go through all of them */
+static void bench_prepare(uint8_t *buf, uint8_t *dst, uint8_t *src, size_t n)
+{
+    memset(buf, 0xff, 2 * (BENCH_MAX_SIZE + BENCH_SLACK));
+    for (size_t i = 0; i < n; ++i) {
+        src[i] = dst[i] = 1 + i % 251;
+    }
+    src[n] = dst[n] = 0;
+}
+
+static uint32_t bench_measure(const bench_test_t *t, const bench_funcs_t *f,
+                              uint8_t *dst, uint8_t *src, size_t n)
+{
+    uint32_t best = UINT32_MAX;
+    for (int i = 0; i < BENCH_REPEATS; ++i) {
+        uint32_t start = xthal_get_ccount();
+        t->run(f, dst, src, n);
+        uint32_t cycles = xthal_get_ccount() - start;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+esp_err_t esp_string_bench_run(void)
+{
+    const size_t buf_size = 2 * (BENCH_MAX_SIZE + BENCH_SLACK);
+    uint8_t *buf = malloc(buf_size);
+    uint8_t *check = malloc(buf_size);
+    if (buf == NULL || check == NULL) {
+        free(buf);
+        free(check);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = ESP_OK;
+
+    printf("%-8s %6s %9s %10s %10s %7s\n", "func", "size", "align", "rom", "app", "speedup");
+    for (size_t i = 0; i < sizeof(s_tests) / sizeof(s_tests[0]); ++i) {
+        const bench_test_t *t = &s_tests[i];
+        for (size_t j = 0; j < sizeof(s_sizes) / sizeof(s_sizes[0]); ++j) {
+            size_t n = s_sizes[j];
+            for (int unaligned = 0; unaligned < 2; ++unaligned) {
+                uint8_t *src = buf + (unaligned ? 3 : 0);
+                uint8_t *dst = buf + BENCH_MAX_SIZE + BENCH_SLACK + (unaligned ? 1 : 0);
+
+                bench_prepare(buf, dst, src, n);
+                int rom_ret = t->run(&s_rom_funcs, dst, src, n);
+                memcpy(check, buf, buf_size);
+                bench_prepare(buf, dst, src, n);
+                int app_ret = t->run(&s_app_funcs, dst, src, n);
+                if (app_ret != rom_ret || memcmp(check, buf, buf_size) != 0) {
+                    printf("%-8s %6u %9s differs from ROM\n", t->name, (unsigned) n,
+                           unaligned ? "unaligned" : "aligned");
+                    err = ESP_FAIL;
+                    continue;
+                }
+
+                bench_prepare(buf, dst, src, n);
+                uint32_t rom = bench_measure(t, &s_rom_funcs, dst, src, n);
+                bench_prepare(buf, dst, src, n);
+                uint32_t app = bench_measure(t, &s_app_funcs, dst, src, n);
+                unsigned tenths = app ? (rom * 10 + app / 2) / app : 0;
+                printf("%-8s %6u %9s %10u %10u %4u.%ux\n", t->name, (unsigned) n,
+                       unaligned ? "unaligned" : "aligned", rom, app, tenths / 10, tenths % 10);
+            }
+        }
+    }
+
+    free(buf);
+    free(check);
+    return err;
+}
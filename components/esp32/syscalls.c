@@ -15,18 +15,24 @@
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/reent.h>
+#include <reent.h>
 #include <stdlib.h>
 #include "esp_attr.h"
 #include "rom/libc_stubs.h"
-#include "rom/uart.h"
 #include "soc/cpu.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/portmacro.h"
 #include "freertos/task.h"
+#include "heap_alloc_caps.h"
+#include "esp_timer.h"
+#include "esp_vfs.h"
 
 void abort() {
     do
@@ -37,7 +43,7 @@ void abort() {
 }
 
 void* _malloc_r(struct _reent *r, size_t size) {
-    return pvPortMalloc(size);
+    return pvPortMallocDefault(size);
 }
 
 void _free_r(struct _reent *r, void* ptr) {
@@ -45,25 +51,15 @@ void _free_r(struct _reent *r, void* ptr) {
 }
 
 void* _realloc_r(struct _reent *r, void* ptr, size_t size) {
-	void* new_chunk;
-	if (size == 0) {
-		if (ptr) {
-			vPortFree(ptr);
-		}
-		return NULL;
-	}
-
-	new_chunk = pvPortMalloc(size);
-	if (new_chunk && ptr) {
-		memcpy(new_chunk, ptr, size);
-		vPortFree(ptr);
-	}
-	// realloc behaviour: don't free original chunk if alloc failed
-	return new_chunk;
+	return pvPortReallocDefault(ptr, size);
+}
+
+void* _memalign_r(struct _reent *r, size_t alignment, size_t size) {
+    return pvPortMallocCapsAligned(size, alignment, MALLOC_CAP_8BIT);
 }
 
 void* _calloc_r(struct _reent *r, size_t count, size_t size) {
-    void* result = pvPortMalloc(count * size);
+    void* result = pvPortMallocDefault(count * size);
     if (result)
     {
     	memset(result, 0, count * size);
@@ -77,19 +73,19 @@ int _system_r(struct _reent *r, const char *str) {
 }
 
 int _rename_r(struct _reent *r, const char *src, const char *dst) {
-    abort();
-    return 0;
+    return esp_vfs_rename(r, src, dst);
 }
 
 clock_t _times_r(struct _reent *r, struct tms *ptms) {
-    abort();
-    return 0;
-}
-
-// TODO: read time from RTC
-int _gettimeofday_r(struct _reent *r, struct timeval *tv, void *tz) {
-    abort();
-    return 0;
+    clock_t t = (clock_t) (esp_timer_get_time() / (1000000 / CLOCKS_PER_SEC));
+    if (ptms) {
+        // There is no per-process accounting, report all time as user time
+        ptms->tms_utime = t;
+        ptms->tms_stime = 0;
+        ptms->tms_cutime = 0;
+        ptms->tms_cstime = 0;
+    }
+    return t;
 }
 
 void _raise_r(struct _reent *r) {
@@ -97,8 +93,7 @@ void _raise_r(struct _reent *r) {
 }
 
 int _unlink_r(struct _reent *r, const char *path) {
-    abort();
-    return 0;
+    return esp_vfs_unlink(r, path);
 }
 
 int _link_r(struct _reent *r, const char* n1, const char* n2) {
@@ -107,12 +102,11 @@ int _link_r(struct _reent *r, const char* n1, const char* n2) {
 }
 
 int _stat_r(struct _reent *r, const char * path, struct stat * st) {
-    return 0;
+    return esp_vfs_stat(r, path, st);
 }
 
 int _fstat_r(struct _reent *r, int fd, struct stat * st) {
-	st->st_mode = S_IFCHR;
-    return 0;
+    return esp_vfs_fstat(r, fd, st);
 }
 
 void* _sbrk_r(struct _reent *r, ptrdiff_t sz) {
@@ -135,52 +129,23 @@ void _exit_r(struct _reent *r, int e) {
 }
 
 int _close_r(struct _reent *r, int fd) {
-    return 0;
+    return esp_vfs_close(r, fd);
 }
 
 int _open_r(struct _reent *r, const char * path, int flags, int mode) {
-    return 0;
+    return esp_vfs_open(r, path, flags, mode);
 }
 
 ssize_t _write_r(struct _reent *r, int fd, const void * data, size_t size) {
-    const char* p = (const char*) data;
-    if (fd == STDOUT_FILENO) {
-        static _lock_t stdout_lock; /* lazily initialised */
-        /* Even though newlib does stream locking on stdout, we need
-           a dedicated stdout UART lock...
-
-           This is because each task has its own _reent structure with
-           unique FILEs for stdin/stdout/stderr, so these are
-           per-thread (lazily initialised by __sinit the first time a
-           stdio function is used, see findfp.c:235.
-
-           It seems like overkill to allocate a FILE-per-task and lock
-           a thread-local stream, but I see no easy way to fix this
-           (pre-__sinit_, tasks have "fake" FILEs ie __sf_fake_stdout
-           which aren't fully valid.)
-        */
-        _lock_acquire_recursive(&stdout_lock);
-        while(size--) {
-#if CONFIG_NEWLIB_STDOUT_ADDCR
-            if (*p=='\n') {
-                uart_tx_one_char('\r');
-            }
-#endif
-            uart_tx_one_char(*p);
-            ++p;
-        }
-        _lock_release_recursive(&stdout_lock);
-    }
-    return size;
+    return esp_vfs_write(r, fd, data, size);
 }
 
 _off_t _lseek_r(struct _reent *r, int fd, _off_t size, int mode) {
-    return 0;
+    return esp_vfs_lseek(r, fd, size, mode);
 }
 
-// TODO: implement reading from UART
 ssize_t _read_r(struct _reent *r, int fd, void * dst, size_t size) {
-    return 0;
+    return esp_vfs_read(r, fd, dst, size);
 }
 
 /* Notes on our newlib lock implementation:
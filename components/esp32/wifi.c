@@ -20,6 +20,7 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_task.h"
+#include "esp_wifi_fast_connect.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -82,6 +83,10 @@ static void esp_wifi_task(void *pvParameters)
 
         err = esp_wifi_get_auto_connect(&auto_connect);
         if ((mode == WIFI_MODE_STA || mode == WIFI_MODE_APSTA) && auto_connect) {
+            esp_event_connect_timeline_start();
+#if CONFIG_WIFI_FAST_CONNECT
+            esp_wifi_fast_connect_prepare();
+#endif
             err = esp_wifi_connect();
             if (err != ESP_OK) {
                 WIFI_DEBUG("esp_wifi_connect fail, ret=%d\n", err);
@@ -108,7 +113,7 @@ esp_err_t esp_wifi_startup(wifi_startup_cb_t cb, void *ctx)
     startup_cb = cb;
     startup_ctx = ctx;
 
-    xTaskCreatePinnedToCore(esp_wifi_task, "wifiTask", ESP_TASK_WIFI_STARTUP_STACK, NULL, ESP_TASK_WIFI_STARTUP_PRIO, NULL, 0);
+    xTaskCreatePinnedToCore(esp_wifi_task, "wifiTask", ESP_TASK_WIFI_STARTUP_STACK, NULL, ESP_TASK_WIFI_STARTUP_PRIO, NULL, ESP_TASK_PROTOCOL_CORE);
 
     return ESP_OK;
 }
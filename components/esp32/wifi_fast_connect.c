@@ -0,0 +1,280 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_wifi.h"
+#include "esp_wifi_fast_connect.h"
+#include "nvs.h"
+#include "rom/crc.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+#include "mbedtls/sha256.h"
+
+#if CONFIG_WIFI_ENABLED && CONFIG_WIFI_FAST_CONNECT
+
+#define WIFI_FAST_CONNECT_NVS_NAMESPACE "wifi_fc"
+#define WIFI_FAST_CONNECT_NVS_KEY       "ap"
+#define WIFI_FAST_CONNECT_MAGIC         0x43464957  // "WIFC"
+
+/* WPA2 personal: PMK = PBKDF2-HMAC-SHA1(passphrase, SSID, 4096 iterations, 256 bits) */
+#define WIFI_PMK_ITERATIONS             4096
+#define WIFI_PMK_LEN                    32
+
+#define WIFI_FAST_CONNECT_AP_VALID      0x01    // bssid and channel set
+#define WIFI_FAST_CONNECT_PMK_VALID     0x02    // pmk derived from the passphrase
+#define WIFI_FAST_CONNECT_PMK_UNUSABLE  0x04    // a full connection worked where the pmk didn't
+
+#define WIFI_DEBUG(...)
+
+typedef struct {
+    uint32_t magic;
+    uint8_t config_hash[32];    // SHA-256 of the SSID and passphrase this is for
+    uint8_t flags;
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint8_t pmk[WIFI_PMK_LEN];
+    uint32_t crc;               // of the fields above, checked for the RTC copy
+} wifi_fast_connect_t;
+
+typedef enum {
+    WIFI_FAST_CONNECT_IDLE,
+    WIFI_FAST_CONNECT_ATTEMPT,      // fast configuration set, not connected yet
+    WIFI_FAST_CONNECT_CONNECTED,    // connected with the fast configuration
+    WIFI_FAST_CONNECT_FALLBACK,     // fast connection failed, full connection started
+} wifi_fast_connect_state_t;
+
+/* Only used from the WiFi startup task, before the connection is started,
+ * and from the event task afterwards */
+static RTC_DATA_ATTR wifi_fast_connect_t s_fc_rtc;
+static wifi_fast_connect_t s_fc;            // record of the current configuration
+static wifi_fast_connect_t s_fc_stored;     // as in NVS
+static wifi_config_t s_fc_orig_config;      // configuration replaced by the fast one
+static wifi_fast_connect_state_t s_fc_state;
+static bool s_fc_used_pmk;
+
+static uint32_t wifi_fast_connect_crc(const wifi_fast_connect_t *fc)
+{
+    return crc32_le(UINT32_MAX, (const uint8_t *) fc, offsetof(wifi_fast_connect_t, crc));
+}
+
+static void wifi_fast_connect_config_hash(const wifi_sta_config_t *sta, uint8_t hash[32])
+{
+    mbedtls_sha256((const unsigned char *) sta, offsetof(wifi_sta_config_t, bssid_set), hash, 0);
+}
+
+static void wifi_fast_connect_load(const uint8_t hash[32])
+{
+    nvs_handle handle;
+    size_t len = sizeof(s_fc);
+
+    if (s_fc_rtc.magic == WIFI_FAST_CONNECT_MAGIC && s_fc_rtc.crc == wifi_fast_connect_crc(&s_fc_rtc) &&
+            memcmp(s_fc_rtc.config_hash, hash, sizeof(s_fc_rtc.config_hash)) == 0) {
+        // Woken up from deep sleep, NVS has the same record
+        s_fc = s_fc_rtc;
+        s_fc_stored = s_fc_rtc;
+        return;
+    }
+
+    memset(&s_fc_stored, 0, sizeof(s_fc_stored));
+    if (nvs_open(WIFI_FAST_CONNECT_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        if (nvs_get_blob(handle, WIFI_FAST_CONNECT_NVS_KEY, &s_fc_stored, &len) != ESP_OK ||
+                len != sizeof(s_fc_stored)) {
+            memset(&s_fc_stored, 0, sizeof(s_fc_stored));
+        }
+        nvs_close(handle);
+    }
+    s_fc = s_fc_stored;
+    if (s_fc.magic != WIFI_FAST_CONNECT_MAGIC || memcmp(s_fc.config_hash, hash, sizeof(s_fc.config_hash)) != 0) {
+        WIFI_DEBUG("no fast connect record for this configuration\n");
+        memset(&s_fc, 0, sizeof(s_fc));
+        s_fc.magic = WIFI_FAST_CONNECT_MAGIC;
+        memcpy(s_fc.config_hash, hash, sizeof(s_fc.config_hash));
+    }
+}
+
+/* Writes to flash only if the record changed */
+static void wifi_fast_connect_save(void)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    s_fc.crc = wifi_fast_connect_crc(&s_fc);
+    s_fc_rtc = s_fc;
+    if (memcmp(&s_fc, &s_fc_stored, sizeof(s_fc)) == 0) {
+        return;
+    }
+    err = nvs_open(WIFI_FAST_CONNECT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return;
+    }
+    err = nvs_set_blob(handle, WIFI_FAST_CONNECT_NVS_KEY, &s_fc, sizeof(s_fc));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (err == ESP_OK) {
+        s_fc_stored = s_fc;
+    } else {
+        WIFI_DEBUG("fast connect record save failed, ret=%d\n", err);
+    }
+}
+
+static int wifi_fast_connect_derive_pmk(const wifi_sta_config_t *sta, size_t password_len, uint8_t pmk[WIFI_PMK_LEN])
+{
+    mbedtls_md_context_t ctx;
+    int ret;
+
+    mbedtls_md_init(&ctx);
+    ret = mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1);
+    if (ret == 0) {
+        ret = mbedtls_pkcs5_pbkdf2_hmac(&ctx, (const unsigned char *) sta->password, password_len,
+                                        (const unsigned char *) sta->ssid, strnlen(sta->ssid, sizeof(sta->ssid)),
+                                        WIFI_PMK_ITERATIONS, WIFI_PMK_LEN, pmk);
+    }
+    mbedtls_md_free(&ctx);
+    return ret;
+}
+
+/* Set in RAM only, the configuration in flash stays the one of the application */
+static esp_err_t wifi_fast_connect_set_config(wifi_config_t *config)
+{
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, config);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+    return err;
+}
+
+void esp_wifi_fast_connect_prepare(void)
+{
+    static const char hex[] = "0123456789abcdef";
+    wifi_config_t config;
+    uint8_t hash[32];
+
+    s_fc_state = WIFI_FAST_CONNECT_IDLE;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || config.sta.bssid_set || config.sta.ssid[0] == 0) {
+        return;
+    }
+    wifi_fast_connect_config_hash(&config.sta, hash);
+    wifi_fast_connect_load(hash);
+
+    // A password of 64 characters is a PSK already, shorter ones than 8 aren't WPA passphrases
+    size_t password_len = strnlen(config.sta.password, sizeof(config.sta.password));
+    if ((s_fc.flags & (WIFI_FAST_CONNECT_PMK_VALID | WIFI_FAST_CONNECT_PMK_UNUSABLE)) == 0 &&
+            password_len >= 8 && password_len < sizeof(config.sta.password)) {
+        // Costs the same as the derivation in the WiFi library, but only once
+        if (wifi_fast_connect_derive_pmk(&config.sta, password_len, s_fc.pmk) == 0) {
+            s_fc.flags |= WIFI_FAST_CONNECT_PMK_VALID;
+        }
+    }
+    bool use_pmk = (s_fc.flags & (WIFI_FAST_CONNECT_PMK_VALID | WIFI_FAST_CONNECT_PMK_UNUSABLE)) ==
+            WIFI_FAST_CONNECT_PMK_VALID;
+    if (!use_pmk && (s_fc.flags & WIFI_FAST_CONNECT_AP_VALID) == 0) {
+        return;
+    }
+
+    wifi_config_t fast = config;
+    if (s_fc.flags & WIFI_FAST_CONNECT_AP_VALID) {
+        fast.sta.bssid_set = true;
+        memcpy(fast.sta.bssid, s_fc.bssid, sizeof(fast.sta.bssid));
+        esp_wifi_set_channel(s_fc.channel, WIFI_SECOND_CHAN_NONE);
+    }
+    if (use_pmk) {
+        for (int i = 0; i < WIFI_PMK_LEN; ++i) {
+            fast.sta.password[2 * i] = hex[s_fc.pmk[i] >> 4];
+            fast.sta.password[2 * i + 1] = hex[s_fc.pmk[i] & 0xf];
+        }
+    }
+    if (wifi_fast_connect_set_config(&fast) != ESP_OK) {
+        WIFI_DEBUG("fast connect config not accepted\n");
+        return;
+    }
+    s_fc_orig_config = config;
+    s_fc_used_pmk = use_pmk;
+    s_fc_state = WIFI_FAST_CONNECT_ATTEMPT;
+}
+
+void esp_wifi_fast_connect_connected(const system_event_sta_connected_t *info)
+{
+    if (s_fc.magic != WIFI_FAST_CONNECT_MAGIC) {
+        return;
+    }
+    if (s_fc_state == WIFI_FAST_CONNECT_IDLE) {
+        // A later connection made by the application, save it if it's for the same configuration
+        wifi_config_t config;
+        uint8_t hash[32];
+        if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || config.sta.bssid_set) {
+            return;
+        }
+        wifi_fast_connect_config_hash(&config.sta, hash);
+        if (memcmp(hash, s_fc.config_hash, sizeof(hash)) != 0) {
+            return;
+        }
+    } else if (s_fc_state == WIFI_FAST_CONNECT_FALLBACK && s_fc_used_pmk) {
+        s_fc.flags |= WIFI_FAST_CONNECT_PMK_UNUSABLE;
+    }
+
+    s_fc.flags |= WIFI_FAST_CONNECT_AP_VALID;
+    s_fc.channel = info->channel;
+    memcpy(s_fc.bssid, info->bssid, sizeof(s_fc.bssid));
+    wifi_fast_connect_save();
+    s_fc_state = (s_fc_state == WIFI_FAST_CONNECT_ATTEMPT) ? WIFI_FAST_CONNECT_CONNECTED : WIFI_FAST_CONNECT_IDLE;
+}
+
+bool esp_wifi_fast_connect_disconnected(void)
+{
+    switch (s_fc_state) {
+    case WIFI_FAST_CONNECT_ATTEMPT:
+        WIFI_DEBUG("fast connect failed, full connect\n");
+        wifi_fast_connect_set_config(&s_fc_orig_config);
+        s_fc_state = WIFI_FAST_CONNECT_FALLBACK;
+        esp_wifi_connect();
+        return true;
+    case WIFI_FAST_CONNECT_CONNECTED:
+        // Reconnections made by the application scan again
+        wifi_fast_connect_set_config(&s_fc_orig_config);
+        s_fc_state = WIFI_FAST_CONNECT_IDLE;
+        return false;
+    default:
+        s_fc_state = WIFI_FAST_CONNECT_IDLE;
+        return false;
+    }
+}
+
+esp_err_t esp_wifi_fast_connect_clear(void)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    memset(&s_fc_rtc, 0, sizeof(s_fc_rtc));
+    memset(&s_fc, 0, sizeof(s_fc));
+    memset(&s_fc_stored, 0, sizeof(s_fc_stored));
+
+    err = nvs_open(WIFI_FAST_CONNECT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_erase_all(handle);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#!/usr/bin/env python
+#
+# Appends the SHA-256 of an app image to it, for the bootloader to verify
+# (CONFIG_BOOTLOADER_VERIFY_APP_IMAGE).
+#
+# The digest covers the image header, all the sections, and the padding and
+# checksum byte which end the image on a 16 byte boundary. Data after that,
+# such as a digest appended by an earlier run, is replaced.
+import argparse
+import hashlib
+import struct
+import sys
+
+__version__ = '1.0'
+
+IMAGE_MAGIC = 0xE9
+HEADER_SIZE = 24
+SECTION_HEADER_SIZE = 8
+
+
+def image_length(data):
+    if len(data) < HEADER_SIZE or ord(data[0:1]) != IMAGE_MAGIC:
+        raise ValueError('not an app image')
+    pos = HEADER_SIZE
+    for _ in range(ord(data[1:2])):
+        if pos + SECTION_HEADER_SIZE > len(data):
+            raise ValueError('image truncated')
+        _, size = struct.unpack('<II', data[pos:pos + SECTION_HEADER_SIZE])
+        pos += SECTION_HEADER_SIZE + size
+    length = (pos | 15) + 1
+    if length > len(data):
+        raise ValueError('image truncated')
+    return length
+
+
+def main():
+    parser = argparse.ArgumentParser(description='image_digest.py v%s - append the SHA-256 of an app image' % __version__)
+    parser.add_argument('image', help='app image (.bin) to update in place')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        data = f.read()
+    try:
+        length = image_length(data)
+    except ValueError as e:
+        sys.stderr.write('%s: %s\n' % (args.image, e))
+        sys.exit(1)
+    with open(args.image, 'wb') as f:
+        f.write(data[:length])
+        f.write(hashlib.sha256(data[:length]).digest())
+
+
+if __name__ == '__main__':
+    main()
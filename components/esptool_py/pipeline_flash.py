@@ -0,0 +1,304 @@
+#!/usr/bin/env python
+#
+# Pipelined serial flasher for the ESP32.
+#
+# Loads pipeline_stub into RAM through the ROM serial loader, then streams
+# flash blocks without waiting for each one to be written: the stub keeps a
+# window of blocks in flight, erases ahead of the write pointer and hashes
+# the written region on target, so verifying doesn't need a read back.
+#
+# Usage: pipeline_flash.py --port PORT --stub STUB_ELF OFFSET FILE [OFFSET FILE ...]
+import argparse
+import hashlib
+import struct
+import sys
+import time
+
+try:
+    import serial
+except ImportError:
+    print('pipeline_flash.py needs pyserial, the same as esptool.py')
+    raise
+
+__version__ = '1.0'
+
+ROM_BAUD = 115200
+
+# ROM loader commands
+ROM_MEM_BEGIN = 0x05
+ROM_MEM_END = 0x06
+ROM_MEM_DATA = 0x07
+ROM_SYNC = 0x08
+ROM_CHANGE_BAUDRATE = 0x0F
+ROM_RAM_BLOCK = 0x1800
+ROM_STATUS_BYTES = 4
+
+# stub commands, see pipeline_stub/stub.c
+STUB_FLASH_BEGIN = 0xD0
+STUB_FLASH_DATA = 0xD1
+STUB_FLASH_END = 0xD2
+STUB_FLASH_HASH = 0xD3
+STUB_RESET = 0xD4
+STUB_STATUS_BYTES = 2
+STUB_BLOCK_SIZE = 4096
+STUB_GREETING = b'PIPE'
+
+STUB_ERRORS = {
+    1: 'bad argument',
+    2: 'bad sequence number',
+    3: 'bad checksum',
+    4: 'flash operation failed',
+    5: 'unknown command',
+    6: 'receive overflow',
+}
+
+HASH_TYPES = {'md5': (0, hashlib.md5), 'sha256': (1, hashlib.sha256)}
+
+CHECKSUM_SEED = 0xEF
+FLASH_SECTOR_SIZE = 0x1000
+
+# baud rates tried, fastest first, when the requested one doesn't work
+FALLBACK_BAUDS = [2000000, 1500000, 921600, 460800, 230400]
+
+ELF_MAGIC = b'\x7fELF'
+PT_LOAD = 1
+
+
+class FlashError(RuntimeError):
+    pass
+
+
+def checksum(data, state=CHECKSUM_SEED):
+    for b in bytearray(data):
+        state ^= b
+    return state
+
+
+def slip_encode(data):
+    return b'\xc0' + data.replace(b'\xdb', b'\xdb\xdd').replace(b'\xc0', b'\xdb\xdc') + b'\xc0'
+
+
+def load_stub(path):
+    """ Return (entry, [(address, data), ...]) for the PT_LOAD segments of an ELF32 file """
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != ELF_MAGIC or ord(elf[4:5]) != 1 or ord(elf[5:6]) != 1:
+        raise FlashError('%s is not a little endian ELF32 file' % path)
+    entry, phoff = struct.unpack('<II', elf[24:32])
+    phentsize, phnum = struct.unpack('<HH', elf[42:46])
+    segments = []
+    for i in range(phnum):
+        p_type, offset, vaddr, _, filesz = struct.unpack('<IIIII', elf[phoff + i * phentsize:][:20])
+        if p_type == PT_LOAD and filesz > 0:
+            segments.append((vaddr, elf[offset:offset + filesz]))
+    return entry, segments
+
+
+class PipelineFlasher(object):
+    def __init__(self, port, timeout=3):
+        self._port = serial.Serial(port, ROM_BAUD, timeout=0.1)
+        self._timeout = timeout
+        self._buffer = b''
+
+    def close(self):
+        self._port.close()
+
+    def reset_to_bootloader(self):
+        """ classic DTR/RTS auto reset circuit: EN on RTS, GPIO0 on DTR """
+        self._port.baudrate = ROM_BAUD
+        self._port.setDTR(False)
+        self._port.setRTS(True)
+        time.sleep(0.1)
+        self._port.setDTR(True)
+        self._port.setRTS(False)
+        time.sleep(0.05)
+        self._port.setDTR(False)
+        self._port.reset_input_buffer()
+        self._buffer = b''
+
+    def hard_reset(self):
+        self._port.setRTS(True)
+        time.sleep(0.1)
+        self._port.setRTS(False)
+
+    def write_frame(self, data):
+        self._port.write(slip_encode(data))
+
+    def read_frame(self, timeout=None):
+        """ Return the next SLIP frame, decoded """
+        deadline = time.time() + (timeout or self._timeout)
+        while True:
+            start = self._buffer.find(b'\xc0')
+            if start >= 0:
+                end = self._buffer.find(b'\xc0', start + 1)
+                if end > start + 1:
+                    frame = self._buffer[start + 1:end]
+                    self._buffer = self._buffer[end:]
+                    return frame.replace(b'\xdb\xdc', b'\xc0').replace(b'\xdb\xdd', b'\xdb')
+                if end == start + 1:
+                    # two END bytes in a row, the first closed an earlier frame
+                    self._buffer = self._buffer[end:]
+                    continue
+            if time.time() > deadline:
+                raise FlashError('timed out waiting for a response')
+            self._buffer += self._port.read(self._port.in_waiting or 1)
+
+    def send(self, op, data=b'', chk=0):
+        self.write_frame(struct.pack('<BBHI', 0, op, len(data), chk) + data)
+
+    def response(self, op, status_bytes, timeout=None):
+        """ Return (value, payload) of the next response to op, raising on failure """
+        while True:
+            frame = self.read_frame(timeout)
+            if len(frame) < 8 + status_bytes:
+                continue
+            resp, resp_op, size, value = struct.unpack('<BBHI', frame[:8])
+            if resp != 1 or resp_op != op:
+                continue
+            body = frame[8:8 + size]
+            status = bytearray(body[-status_bytes:])
+            if status[0] != 0:
+                raise FlashError('command 0x%02x failed: %s' % (op, STUB_ERRORS.get(status[1], status[1])))
+            return value, body[:-status_bytes]
+
+    def command(self, op, data=b'', chk=0, status_bytes=ROM_STATUS_BYTES, timeout=None):
+        self.send(op, data, chk)
+        return self.response(op, status_bytes, timeout)
+
+    def sync(self, attempts=5):
+        for _ in range(attempts):
+            try:
+                self.command(ROM_SYNC, b'\x07\x07\x12\x20' + 32 * b'\x55', timeout=0.2)
+                # the ROM answers each SYNC several times
+                time.sleep(0.05)
+                self._port.reset_input_buffer()
+                self._buffer = b''
+                return True
+            except FlashError:
+                pass
+        return False
+
+    def connect(self, baud):
+        """ Reset into the ROM loader and move it to the fastest working baud rate up to baud """
+        candidates = [baud] + [b for b in FALLBACK_BAUDS if b < baud]
+        if baud != ROM_BAUD:
+            candidates.append(ROM_BAUD)
+        for candidate in candidates:
+            self.reset_to_bootloader()
+            if not self.sync():
+                raise FlashError('failed to connect to the ROM loader')
+            if candidate == ROM_BAUD:
+                return candidate
+            self.command(ROM_CHANGE_BAUDRATE, struct.pack('<II', candidate, 0))
+            self._port.baudrate = candidate
+            time.sleep(0.05)
+            self._port.reset_input_buffer()
+            self._buffer = b''
+            if self.sync(attempts=3):
+                return candidate
+            print('%d baud failed, trying a lower rate' % candidate)
+        raise FlashError('no working baud rate')
+
+    def run_stub(self, stub):
+        entry, segments = load_stub(stub)
+        for addr, data in segments:
+            blocks = (len(data) + ROM_RAM_BLOCK - 1) // ROM_RAM_BLOCK
+            self.command(ROM_MEM_BEGIN, struct.pack('<IIII', len(data), blocks, ROM_RAM_BLOCK, addr))
+            for seq in range(blocks):
+                block = data[seq * ROM_RAM_BLOCK:(seq + 1) * ROM_RAM_BLOCK]
+                self.command(ROM_MEM_DATA, struct.pack('<IIII', len(block), seq, 0, 0) + block, checksum(block))
+        self.command(ROM_MEM_END, struct.pack('<II', 0, entry))
+        if self.read_frame() != STUB_GREETING:
+            raise FlashError('stub failed to start')
+
+    def stub_command(self, op, data=b'', chk=0, timeout=None):
+        return self.command(op, data, chk, STUB_STATUS_BYTES, timeout)
+
+    def flash(self, offset, data):
+        """ Stream data to flash at offset, keeping the stub's window of blocks in flight """
+        data += b'\xff' * (-len(data) % 4)
+        window, _ = self.stub_command(STUB_FLASH_BEGIN, struct.pack('<II', offset, len(data)))
+        blocks = [data[i:i + STUB_BLOCK_SIZE] for i in range(0, len(data), STUB_BLOCK_SIZE)]
+        acked = 0
+        for seq, block in enumerate(blocks):
+            if seq - acked >= window:
+                self.flash_data_ack(acked)
+                acked += 1
+            self.send(STUB_FLASH_DATA, struct.pack('<II', seq, len(block)) + block, checksum(block))
+        while acked < len(blocks):
+            self.flash_data_ack(acked)
+            acked += 1
+        self.stub_command(STUB_FLASH_END)
+
+    def flash_data_ack(self, seq):
+        # a block may wait for a 64 KB erase before it's written
+        value, _ = self.response(STUB_FLASH_DATA, STUB_STATUS_BYTES, timeout=10)
+        if value != seq:
+            raise FlashError('block %d acknowledged out of order (expected %d)' % (value, seq))
+
+    def flash_hash(self, offset, size, hash_type):
+        _, digest = self.stub_command(STUB_FLASH_HASH, struct.pack('<III', offset, size, hash_type),
+                                      timeout=30)
+        return digest
+
+    def reset(self):
+        self.stub_command(STUB_RESET)
+
+
+def arg_auto_int(x):
+    return int(x, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='pipeline_flash.py v%s - pipelined ESP32 serial flasher' % __version__)
+    parser.add_argument('--port', '-p', required=True, help='serial port device')
+    parser.add_argument('--baud', '-b', type=arg_auto_int, default=921600,
+                        help='baud rate to flash at; lower rates are tried if it does not work')
+    parser.add_argument('--stub', required=True, help='pipeline_stub ELF file')
+    parser.add_argument('--verify', choices=['md5', 'sha256', 'none'], default='md5',
+                        help='hash the written flash on target and compare it with the file')
+    parser.add_argument('--after', choices=['hard_reset', 'soft_reset', 'no_reset'], default='hard_reset',
+                        help='what to do once flashing is done')
+    parser.add_argument('addr_filename', nargs='+', metavar='OFFSET FILE',
+                        help='flash offset followed by the binary to write there')
+    args = parser.parse_args()
+
+    if len(args.addr_filename) % 2 != 0:
+        parser.error('arguments must be OFFSET FILE pairs')
+    images = []
+    for offset, path in zip(args.addr_filename[0::2], args.addr_filename[1::2]):
+        offset = arg_auto_int(offset)
+        if offset % FLASH_SECTOR_SIZE != 0:
+            parser.error('offset 0x%x is not aligned to a flash sector' % offset)
+        with open(path, 'rb') as f:
+            images.append((offset, path, f.read()))
+
+    flasher = PipelineFlasher(args.port)
+    try:
+        baud = flasher.connect(args.baud)
+        print('Connected at %d baud, loading stub...' % baud)
+        flasher.run_stub(args.stub)
+        for offset, path, data in images:
+            start = time.time()
+            flasher.flash(offset, data)
+            elapsed = time.time() - start
+            print('Wrote %d bytes at 0x%08x in %.1f seconds (%.1f kbit/s) from %s' %
+                  (len(data), offset, elapsed, len(data) * 8 / max(elapsed, 0.001) / 1000, path))
+            if args.verify != 'none':
+                hash_type, hash_func = HASH_TYPES[args.verify]
+                if flasher.flash_hash(offset, len(data), hash_type) != hash_func(data).digest():
+                    raise FlashError('%s verify failed at 0x%08x' % (args.verify, offset))
+                print('Verified %s' % args.verify)
+        if args.after == 'soft_reset':
+            flasher.reset()
+        elif args.after == 'hard_reset':
+            flasher.hard_reset()
+    except FlashError as e:
+        print('A fatal error occurred: %s' % e)
+        sys.exit(2)
+    finally:
+        flasher.close()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,395 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ Pipelined flashing stub, uploaded to RAM and started by pipeline_flash.py
+ through the ROM serial loader.
+
+ The UART receive interrupt SLIP-decodes frames into a small ring of
+ buffers, so the host can keep sending the next blocks while the stub is
+ busy erasing or programming. Between frames the stub erases ahead of the
+ write pointer, and once a region is written it hashes it on target, so
+ verifying doesn't need to read the flash back over the UART.
+
+ Frames use the ROM loader layout: direction byte, command, 16 bit payload
+ length, 32 bit checksum/value, payload. Responses end with a status and
+ an error byte.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rom/ets_sys.h"
+#include "rom/efuse.h"
+#include "rom/rtc.h"
+#include "rom/spi_flash.h"
+#include "rom/uart.h"
+#include "rom/md5_hash.h"
+#include "rom/sha.h"
+#include "soc/uart_reg.h"
+
+#define CMD_FLASH_BEGIN     0xD0
+#define CMD_FLASH_DATA      0xD1
+#define CMD_FLASH_END       0xD2
+#define CMD_FLASH_HASH      0xD3
+#define CMD_RESET           0xD4
+
+#define ERR_OK              0
+#define ERR_BAD_ARG         1
+#define ERR_BAD_SEQ         2
+#define ERR_BAD_CHECKSUM    3
+#define ERR_FLASH           4
+#define ERR_BAD_CMD         5
+#define ERR_OVERFLOW        6
+
+#define HASH_MD5            0
+#define HASH_SHA256         1
+
+#define SLIP_END            0xC0
+#define SLIP_ESC            0xDB
+#define SLIP_ESC_END        0xDC
+#define SLIP_ESC_ESC        0xDD
+
+#define STUB_BLOCK_SIZE     4096
+#define STUB_RX_BUFFERS     4
+#define FRAME_HEADER_SIZE   8
+/* FLASH_DATA payload header: sequence number and data length */
+#define DATA_HEADER_SIZE    8
+
+#define FLASH_SECTOR_SIZE   0x1000
+#define FLASH_BLOCK_SIZE    0x10000
+#define FLASH_MAX_SIZE      (16 * 1024 * 1024)
+
+#define CHECKSUM_SEED       0xEF
+
+typedef struct {
+    /* keeps the FLASH_DATA payload word aligned for SPIWrite */
+    uint32_t data[(FRAME_HEADER_SIZE + DATA_HEADER_SIZE + STUB_BLOCK_SIZE) / 4];
+    volatile uint32_t len;
+    volatile bool full;
+} rx_buffer_t;
+
+static rx_buffer_t s_rx[STUB_RX_BUFFERS];
+static uint32_t s_rx_fill;      /* buffer being filled by the ISR */
+static uint32_t s_rx_len;
+static bool s_rx_escape;
+static bool s_rx_discard;       /* rest of the current frame is dropped */
+static volatile bool s_rx_overflow;
+static uint32_t s_rx_next;      /* next buffer handled by the main loop */
+
+static uint32_t s_write_addr;
+static uint32_t s_write_end;
+static uint32_t s_erase_addr;
+static uint32_t s_erase_end;
+static uint32_t s_next_seq;
+
+static uint32_t s_read_buf[STUB_BLOCK_SIZE / 4];
+
+extern uint32_t _bss_start;
+extern uint32_t _bss_end;
+
+static void slip_rx_byte(uint8_t c)
+{
+    rx_buffer_t *buf = &s_rx[s_rx_fill];
+    if (c == SLIP_END) {
+        if (s_rx_len > 0 && !s_rx_discard) {
+            buf->len = s_rx_len;
+            buf->full = true;
+            s_rx_fill = (s_rx_fill + 1) % STUB_RX_BUFFERS;
+        }
+        s_rx_len = 0;
+        s_rx_escape = false;
+        s_rx_discard = false;
+        return;
+    }
+    if (s_rx_discard) {
+        return;
+    }
+    if (buf->full || s_rx_len >= sizeof(buf->data)) {
+        /* host ignored the window or sent an oversized frame */
+        s_rx_overflow = true;
+        s_rx_discard = true;
+        return;
+    }
+    if (c == SLIP_ESC) {
+        s_rx_escape = true;
+        return;
+    }
+    if (s_rx_escape) {
+        s_rx_escape = false;
+        if (c == SLIP_ESC_END) {
+            c = SLIP_END;
+        } else if (c == SLIP_ESC_ESC) {
+            c = SLIP_ESC;
+        }
+    }
+    ((uint8_t *) buf->data)[s_rx_len++] = c;
+}
+
+static void uart_rx_isr(void *arg)
+{
+    uint32_t status = READ_PERI_REG(UART_INT_ST_REG(0));
+    while ((READ_PERI_REG(UART_STATUS_REG(0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT_V) {
+        slip_rx_byte(READ_PERI_REG(UART_FIFO_REG(0)) & 0xff);
+    }
+    WRITE_PERI_REG(UART_INT_CLR_REG(0), status);
+}
+
+static void uart_rx_init(void)
+{
+    /* interrupt after 80 bytes, or after two byte times without data */
+    WRITE_PERI_REG(UART_CONF1_REG(0), UART_RX_TOUT_EN
+                   | (2 << UART_RX_TOUT_THRHD_S)
+                   | (80 << UART_RXFIFO_FULL_THRHD_S));
+    ets_isr_attach(ETS_UART0_INUM, uart_rx_isr, NULL);
+    WRITE_PERI_REG(UART_INT_CLR_REG(0), 0xffffffff);
+    WRITE_PERI_REG(UART_INT_ENA_REG(0), UART_RXFIFO_FULL_INT_ENA | UART_RXFIFO_TOUT_INT_ENA);
+    ets_isr_unmask(1 << ETS_UART0_INUM);
+}
+
+static void slip_tx_byte(uint8_t c)
+{
+    if (c == SLIP_END) {
+        uart_tx_one_char(SLIP_ESC);
+        uart_tx_one_char(SLIP_ESC_END);
+    } else if (c == SLIP_ESC) {
+        uart_tx_one_char(SLIP_ESC);
+        uart_tx_one_char(SLIP_ESC_ESC);
+    } else {
+        uart_tx_one_char(c);
+    }
+}
+
+static void slip_tx(const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    for (uint32_t i = 0; i < len; ++i) {
+        slip_tx_byte(p[i]);
+    }
+}
+
+static void send_response(uint8_t cmd, uint32_t value, const void *payload, uint16_t len, uint8_t error)
+{
+    uint8_t header[FRAME_HEADER_SIZE] = {
+        1, cmd, (len + 2) & 0xff, (len + 2) >> 8,
+        value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24
+    };
+    uint8_t status[2] = { error != ERR_OK, error };
+    uart_tx_one_char(SLIP_END);
+    slip_tx(header, sizeof(header));
+    slip_tx(payload, len);
+    slip_tx(status, sizeof(status));
+    uart_tx_one_char(SLIP_END);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static bool erase_step(void)
+{
+    SpiFlashOpResult rc;
+    if (s_erase_addr % FLASH_BLOCK_SIZE == 0 && s_erase_end - s_erase_addr >= FLASH_BLOCK_SIZE) {
+        rc = SPIEraseBlock(s_erase_addr / FLASH_BLOCK_SIZE);
+        s_erase_addr += FLASH_BLOCK_SIZE;
+    } else {
+        rc = SPIEraseSector(s_erase_addr / FLASH_SECTOR_SIZE);
+        s_erase_addr += FLASH_SECTOR_SIZE;
+    }
+    return rc == SPI_FLASH_RESULT_OK;
+}
+
+static uint8_t flash_begin(const uint8_t *payload, uint32_t len)
+{
+    if (len < 8) {
+        return ERR_BAD_ARG;
+    }
+    uint32_t offset = get_u32(payload);
+    uint32_t size = get_u32(payload + 4);
+    if (offset % FLASH_SECTOR_SIZE != 0 || size > FLASH_MAX_SIZE - offset) {
+        return ERR_BAD_ARG;
+    }
+    s_write_addr = offset;
+    s_write_end = offset + size;
+    s_erase_addr = offset;
+    s_erase_end = (offset + size + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+    s_next_seq = 0;
+    return ERR_OK;
+}
+
+static uint8_t flash_data(const uint8_t *payload, uint32_t len, uint32_t checksum, uint32_t *seq)
+{
+    if (len < DATA_HEADER_SIZE) {
+        return ERR_BAD_ARG;
+    }
+    *seq = get_u32(payload);
+    uint32_t data_len = get_u32(payload + 4);
+    const uint8_t *data = payload + DATA_HEADER_SIZE;
+    if (*seq != s_next_seq) {
+        return ERR_BAD_SEQ;
+    }
+    if (data_len != len - DATA_HEADER_SIZE || data_len % 4 != 0 ||
+            data_len > s_erase_end - s_write_addr) {
+        return ERR_BAD_ARG;
+    }
+    uint8_t sum = CHECKSUM_SEED;
+    for (uint32_t i = 0; i < data_len; ++i) {
+        sum ^= data[i];
+    }
+    if (sum != checksum) {
+        return ERR_BAD_CHECKSUM;
+    }
+    while (s_erase_addr < s_write_addr + data_len) {
+        if (!erase_step()) {
+            return ERR_FLASH;
+        }
+    }
+    if (SPIWrite(s_write_addr, (const uint32_t *) data, data_len) != SPI_FLASH_RESULT_OK) {
+        return ERR_FLASH;
+    }
+    s_write_addr += data_len;
+    s_next_seq++;
+    return ERR_OK;
+}
+
+static uint8_t flash_hash(const uint8_t *payload, uint32_t len, uint8_t *digest, uint16_t *digest_len)
+{
+    if (len < 12) {
+        return ERR_BAD_ARG;
+    }
+    uint32_t addr = get_u32(payload);
+    uint32_t size = get_u32(payload + 4);
+    uint32_t type = get_u32(payload + 8);
+    if (size > FLASH_MAX_SIZE || addr > FLASH_MAX_SIZE - size ||
+            (type != HASH_MD5 && type != HASH_SHA256)) {
+        return ERR_BAD_ARG;
+    }
+    struct MD5Context md5;
+    SHA_CTX sha;
+    if (type == HASH_MD5) {
+        MD5Init(&md5);
+    } else {
+        ets_sha_enable();
+        ets_sha_init(&sha);
+    }
+    while (size > 0) {
+        uint32_t n = (size < sizeof(s_read_buf)) ? size : sizeof(s_read_buf);
+        if (SPIRead(addr, s_read_buf, (n + 3) & ~3) != SPI_FLASH_RESULT_OK) {
+            if (type == HASH_SHA256) {
+                ets_sha_disable();
+            }
+            return ERR_FLASH;
+        }
+        if (type == HASH_MD5) {
+            MD5Update(&md5, (const unsigned char *) s_read_buf, n);
+        } else {
+            ets_sha_update(&sha, SHA2_256, (const uint8_t *) s_read_buf, n * 8);
+        }
+        addr += n;
+        size -= n;
+    }
+    if (type == HASH_MD5) {
+        MD5Final(digest, &md5);
+        *digest_len = 16;
+    } else {
+        ets_sha_finish(&sha, SHA2_256, digest);
+        ets_sha_disable();
+        *digest_len = 32;
+    }
+    return ERR_OK;
+}
+
+static void handle_frame(rx_buffer_t *buf)
+{
+    const uint8_t *frame = (const uint8_t *) buf->data;
+    uint32_t frame_len = buf->len;
+    uint8_t cmd = (frame_len >= 2) ? frame[1] : 0;
+    uint8_t digest[32];
+    uint16_t digest_len = 0;
+    uint32_t value = 0;
+    uint8_t error;
+
+    uint32_t len = (frame_len >= FRAME_HEADER_SIZE) ? frame[2] | (frame[3] << 8) : 0;
+    if (frame_len < FRAME_HEADER_SIZE || frame[0] != 0 || len != frame_len - FRAME_HEADER_SIZE) {
+        error = ERR_BAD_ARG;
+    } else {
+        const uint8_t *payload = frame + FRAME_HEADER_SIZE;
+        uint32_t checksum = get_u32(frame + 4);
+        switch (cmd) {
+        case CMD_FLASH_BEGIN:
+            error = flash_begin(payload, len);
+            /* the host may keep this many FLASH_DATA frames unacknowledged */
+            value = STUB_RX_BUFFERS - 1;
+            break;
+        case CMD_FLASH_DATA:
+            error = flash_data(payload, len, checksum, &value);
+            break;
+        case CMD_FLASH_END:
+            error = (s_write_addr >= s_write_end) ? ERR_OK : ERR_BAD_ARG;
+            s_erase_end = s_erase_addr;
+            break;
+        case CMD_FLASH_HASH:
+            error = flash_hash(payload, len, digest, &digest_len);
+            break;
+        case CMD_RESET:
+            send_response(cmd, 0, NULL, 0, ERR_OK);
+            uart_tx_flush(0);
+            software_reset();
+            return;
+        default:
+            error = ERR_BAD_CMD;
+            break;
+        }
+    }
+    if (s_rx_overflow) {
+        s_rx_overflow = false;
+        error = ERR_OVERFLOW;
+    }
+    /* free the buffer before answering, the reply releases the host's next frame */
+    buf->full = false;
+    send_response(cmd, value, digest, digest_len, error);
+}
+
+void stub_main(void)
+{
+    for (uint32_t *p = &_bss_start; p < &_bss_end; ++p) {
+        *p = 0;
+    }
+
+    spi_flash_attach(ets_efuse_get_spiconfig(), false);
+    SPIParamCfg(0, FLASH_MAX_SIZE, FLASH_BLOCK_SIZE, FLASH_SECTOR_SIZE, 0x100, 0xffff);
+    SPIUnlock();
+
+    uart_rx_init();
+
+    static const char greeting[] = "PIPE";
+    uart_tx_one_char(SLIP_END);
+    slip_tx(greeting, 4);
+    uart_tx_one_char(SLIP_END);
+
+    while (true) {
+        rx_buffer_t *buf = &s_rx[s_rx_next];
+        if (buf->full) {
+            handle_frame(buf);
+            s_rx_next = (s_rx_next + 1) % STUB_RX_BUFFERS;
+        } else if (s_erase_addr < s_erase_end) {
+            /* erase ahead while the next block is still on the wire */
+            if (!erase_step()) {
+                s_erase_end = s_erase_addr;
+            }
+        }
+    }
+}
@@ -246,6 +246,17 @@ XML_ParserCreate_MM(const XML_Char *encoding,
 XMLPARSEAPI(XML_Bool)
 XML_ParserReset(XML_Parser parser, const XML_Char *encoding);
 
+/* Espressif add start. */
+/* Like XML_ParserReset, but keeps all handlers and the user data, so that
+   a parser used for a sequence of documents of the same kind is set up
+   only once. The parser keeps its input buffer, string pools and free
+   lists as well, so the next document usually parses without growing
+   them again.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_ParserReuse(XML_Parser parser, const XML_Char *encoding);
+/* Espressif add end. */
+
 /* atts is array of name/value pairs, terminated by 0;
    names and values are 0 terminated.
 */
@@ -82,7 +82,16 @@
 
 /* Define to specify how much context to retain around the current parse
    point. */
-#define XML_CONTEXT_BYTES 1024
+/* Espressif add start. */
+/* Without it, XML_Parse parses the caller's buffer in place instead of
+   copying it into the parser's buffer first. */
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+#if defined(CONFIG_EXPAT_CONTEXT_BYTES) && CONFIG_EXPAT_CONTEXT_BYTES > 0
+#define XML_CONTEXT_BYTES CONFIG_EXPAT_CONTEXT_BYTES
+#endif
+/* Espressif add end. */
 
 /* Define to make parameter entity parsing functionality available. */
 #define XML_DTD 1
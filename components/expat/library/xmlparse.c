@@ -1000,6 +1000,27 @@ XML_ParserReset(XML_Parser parser, const XML_Char *encodingName)
   return XML_TRUE;
 }
 
+/* Espressif add start. */
+XML_Bool XMLCALL
+XML_ParserReuse(XML_Parser parser, const XML_Char *encodingName)
+{
+  /* The handlers are consecutive members, from startElementHandler
+     to xmlDeclHandler. */
+  char handlers[offsetof(struct XML_ParserStruct, m_encoding)
+                - offsetof(struct XML_ParserStruct, m_startElementHandler)];
+  void *oldUserData = userData;
+  void *oldHandlerArg = handlerArg;
+
+  memcpy(handlers, &startElementHandler, sizeof(handlers));
+  if (!XML_ParserReset(parser, encodingName))
+    return XML_FALSE;
+  memcpy(&startElementHandler, handlers, sizeof(handlers));
+  userData = oldUserData;
+  handlerArg = oldHandlerArg;
+  return XML_TRUE;
+}
+/* Espressif add end. */
+
 enum XML_Status XMLCALL
 XML_SetEncoding(XML_Parser parser, const XML_Char *encodingName)
 {
@@ -1650,6 +1671,40 @@ XML_Parse(XML_Parser parser, const char *s, int len, int isFinal)
     eventEndPtr = bufferPtr;
     return result;
   }
+  /* Espressif add start. */
+  else if (!isFinal) {
+    /* Data are left over from the last buffer. Rather than copying all of
+       s behind them, copy a growing prefix of s until the left over token
+       is complete, give back the part of the copy which has not been
+       parsed, and parse the rest of s where it is. */
+    int copied = 0;
+    int chunk = 64;
+    while (copied < len) {
+      int n = (len - copied < chunk) ? len - copied : chunk;
+      int pending;
+      enum XML_Status result;
+      void *buff = XML_GetBuffer(parser, n);
+      if (buff == NULL)
+        return XML_STATUS_ERROR;
+      memcpy(buff, s + copied, n);
+      result = XML_ParseBuffer(parser, n, XML_FALSE);
+      if (result != XML_STATUS_OK)
+        return result;
+      copied += n;
+      pending = (int)(bufferEnd - bufferPtr);
+      if (pending < n) {
+        /* everything unparsed is a copy of s */
+        bufferEnd = (char *)bufferPtr;
+        parseEndPtr = bufferEnd;
+        parseEndByteIndex -= pending;
+        copied -= pending;
+        return XML_Parse(parser, s + copied, len - copied, XML_FALSE);
+      }
+      chunk *= 2;
+    }
+    return XML_STATUS_OK;
+  }
+  /* Espressif add end. */
 #endif  /* not defined XML_CONTEXT_BYTES */
   else {
     void *buff = XML_GetBuffer(parser, len);
@@ -0,0 +1,269 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/lock.h>
+#include "expat_mem.h"
+
+/*
+ * First fit allocator over one preallocated region. Every block starts
+ * with a header holding its size; free blocks are kept in a list sorted
+ * by address, so that a freed block is merged with its free neighbours.
+ */
+
+#define ALIGN               8
+#define HEADER_SIZE         ((sizeof(block_t) + ALIGN - 1) & ~(ALIGN - 1))
+#define MIN_BLOCK_SIZE      (HEADER_SIZE + ALIGN)
+#define PAYLOAD(b)          ((void *)((char *)(b) + HEADER_SIZE))
+#define BLOCK(p)            ((block_t *)((char *)(p) - HEADER_SIZE))
+#define BLOCK_END(b)        ((block_t *)((char *)(b) + (b)->size))
+
+typedef struct block {
+    size_t size;            /* including the header */
+    struct block *next;     /* next free block, only valid while free */
+} block_t;
+
+static _lock_t s_lock;
+static char *s_pool;
+static bool s_pool_allocated;
+static block_t *s_free;
+static expat_mem_stats_t s_stats;
+
+static size_t block_size(size_t size)
+{
+    if (size > SIZE_MAX - HEADER_SIZE - ALIGN) {
+        return 0;
+    }
+    size = (size + HEADER_SIZE + ALIGN - 1) & ~(ALIGN - 1);
+    return size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size;
+}
+
+/* Put b in the free list, merging it with adjacent free blocks */
+static void insert_free(block_t *b)
+{
+    block_t *prev = NULL;
+    block_t *next = s_free;
+    while (next && next < b) {
+        prev = next;
+        next = next->next;
+    }
+    if (next && BLOCK_END(b) == next) {
+        b->size += next->size;
+        next = next->next;
+    }
+    b->next = next;
+    if (prev && BLOCK_END(prev) == b) {
+        prev->size += b->size;
+        prev->next = next;
+    } else if (prev) {
+        prev->next = b;
+    } else {
+        s_free = b;
+    }
+}
+
+/* Cut b down to size, returning the rest of it to the free list */
+static void split(block_t *b, size_t size)
+{
+    if (b->size - size >= MIN_BLOCK_SIZE) {
+        block_t *rest = (block_t *)((char *)b + size);
+        rest->size = b->size - size;
+        b->size = size;
+        insert_free(rest);
+    }
+}
+
+static void account_alloc(size_t size)
+{
+    s_stats.used += size;
+    s_stats.allocs++;
+    if (s_stats.used > s_stats.peak) {
+        s_stats.peak = s_stats.used;
+    }
+}
+
+static block_t *alloc_block(size_t size)
+{
+    block_t **link = &s_free;
+    for (block_t *b = s_free; b; link = &b->next, b = b->next) {
+        if (b->size >= size) {
+            *link = b->next;
+            split(b, size);
+            account_alloc(b->size);
+            return b;
+        }
+    }
+    s_stats.failures++;
+    return NULL;
+}
+
+static void free_block(block_t *b)
+{
+    s_stats.used -= b->size;
+    s_stats.allocs--;
+    insert_free(b);
+}
+
+/* Take the free block following b, if there is one and it is large enough */
+static bool grow_block(block_t *b, size_t size)
+{
+    block_t **link = &s_free;
+    block_t *end = BLOCK_END(b);
+    while (*link && *link < end) {
+        link = &(*link)->next;
+    }
+    if (*link != end || b->size + end->size < size) {
+        return false;
+    }
+    *link = end->next;
+    s_stats.used += end->size;
+    b->size += end->size;
+    s_stats.used -= b->size;
+    split(b, size);
+    s_stats.used += b->size;
+    if (s_stats.used > s_stats.peak) {
+        s_stats.peak = s_stats.used;
+    }
+    return true;
+}
+
+static void *pool_malloc(size_t size)
+{
+    size_t bsize = block_size(size);
+    block_t *b = NULL;
+    _lock_acquire(&s_lock);
+    if (s_pool && bsize) {
+        b = alloc_block(bsize);
+    }
+    _lock_release(&s_lock);
+    return b ? PAYLOAD(b) : NULL;
+}
+
+static void pool_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    _lock_acquire(&s_lock);
+    free_block(BLOCK(ptr));
+    _lock_release(&s_lock);
+}
+
+static void *pool_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return pool_malloc(size);
+    }
+    if (size == 0) {
+        pool_free(ptr);
+        return NULL;
+    }
+    size_t bsize = block_size(size);
+    if (bsize == 0) {
+        return NULL;
+    }
+    block_t *b = BLOCK(ptr);
+    block_t *nb = NULL;
+    size_t old_size;
+    _lock_acquire(&s_lock);
+    old_size = b->size;
+    if (bsize <= b->size) {
+        s_stats.used -= b->size;
+        split(b, bsize);
+        s_stats.used += b->size;
+        nb = b;
+    } else if (grow_block(b, bsize)) {
+        nb = b;
+    } else {
+        nb = alloc_block(bsize);
+    }
+    _lock_release(&s_lock);
+    if (nb && nb != b) {
+        memcpy(PAYLOAD(nb), ptr, old_size - HEADER_SIZE);
+        pool_free(ptr);
+    }
+    return nb ? PAYLOAD(nb) : NULL;
+}
+
+const XML_Memory_Handling_Suite expat_mem_suite = {
+    .malloc_fcn = pool_malloc,
+    .realloc_fcn = pool_realloc,
+    .free_fcn = pool_free,
+};
+
+esp_err_t expat_mem_init(void *buffer, size_t size)
+{
+    size &= ~(ALIGN - 1);
+    if (size < MIN_BLOCK_SIZE || ((uintptr_t)buffer & (ALIGN - 1))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    _lock_acquire(&s_lock);
+    if (s_pool) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        s_pool_allocated = (buffer == NULL);
+        s_pool = s_pool_allocated ? malloc(size) : buffer;
+        if (s_pool == NULL) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            s_free = (block_t *)s_pool;
+            s_free->size = size;
+            s_free->next = NULL;
+            memset(&s_stats, 0, sizeof(s_stats));
+            s_stats.size = size;
+        }
+    }
+    _lock_release(&s_lock);
+    return err;
+}
+
+void expat_mem_deinit(void)
+{
+    _lock_acquire(&s_lock);
+    if (s_pool_allocated) {
+        free(s_pool);
+    }
+    s_pool = NULL;
+    s_free = NULL;
+    _lock_release(&s_lock);
+}
+
+XML_Parser expat_mem_parser_create(const XML_Char *encoding)
+{
+    return XML_ParserCreate_MM(encoding, &expat_mem_suite, NULL);
+}
+
+void expat_mem_get_stats(expat_mem_stats_t *stats)
+{
+    _lock_acquire(&s_lock);
+    *stats = s_stats;
+    stats->largest_free = 0;
+    for (block_t *b = s_free; b; b = b->next) {
+        if (b->size - HEADER_SIZE > stats->largest_free) {
+            stats->largest_free = b->size - HEADER_SIZE;
+        }
+    }
+    _lock_release(&s_lock);
+}
+
+void expat_mem_reset_peak(void)
+{
+    _lock_acquire(&s_lock);
+    s_stats.peak = s_stats.used;
+    s_stats.failures = 0;
+    _lock_release(&s_lock);
+}
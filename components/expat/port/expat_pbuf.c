@@ -0,0 +1,61 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <errno.h>
+#include "lwip/sockets.h"
+#include "expat_pbuf.h"
+
+enum XML_Status expat_parse_pbuf(XML_Parser parser, const struct pbuf *p, int isFinal)
+{
+    enum XML_Status status = XML_STATUS_OK;
+    for (; p; p = p->next) {
+        status = XML_Parse(parser, p->payload, p->len, isFinal && p->next == NULL);
+        if (status != XML_STATUS_OK) {
+            return status;
+        }
+    }
+    return status;
+}
+
+enum XML_Status expat_parse_socket(XML_Parser parser, int sock)
+{
+    for (;;) {
+        enum XML_Status status = XML_STATUS_OK;
+#if LWIP_SOCKET_ZEROCOPY
+        struct pbuf *p;
+        int n = lwip_recv_pbuf(sock, &p, 0, NULL, NULL);
+        if (n > 0) {
+            status = expat_parse_pbuf(parser, p, 0);
+            lwip_recv_pbuf_free(sock, p);
+        }
+#else
+        void *buf = XML_GetBuffer(parser, TCP_MSS);
+        if (buf == NULL) {
+            return XML_STATUS_ERROR;
+        }
+        int n = recv(sock, buf, TCP_MSS, 0);
+        if (n > 0) {
+            status = XML_ParseBuffer(parser, n, 0);
+        }
+#endif
+        if (n == 0) {
+            return XML_Parse(parser, NULL, 0, 1);
+        }
+        if (n < 0 && errno != EINTR) {
+            return XML_STATUS_ERROR;
+        }
+        if (status != XML_STATUS_OK) {
+            return status;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef EXPAT_MEM_H
+#define EXPAT_MEM_H
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "expat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed memory budget for Expat parsers.
+ *
+ * Parsers created with expat_mem_parser_create (or with XML_ParserCreate_MM
+ * and expat_mem_suite) take all of their memory from one pool which is
+ * allocated once, by expat_mem_init. When the pool is exhausted, the
+ * allocation fails and the parser stops with XML_ERROR_NO_MEMORY, instead
+ * of taking more of the heap. The pool is shared by all of these parsers,
+ * so its size is the memory cap for all XML parsing of the application.
+ *
+ * Freed blocks are merged with free neighbours, and realloc grows a block
+ * in place when the memory after it is free, so the input buffer and string
+ * pools of a parser mostly grow without copying. To parse a sequence of
+ * documents, reuse the parser with XML_ParserReuse rather than creating a
+ * new one for each document: it keeps its buffers and handlers.
+ */
+
+typedef struct {
+    size_t size;            /*!< Size of the pool */
+    size_t used;            /*!< Bytes allocated, including block headers */
+    size_t peak;            /*!< Largest value of used since init or expat_mem_reset_peak */
+    size_t largest_free;    /*!< Largest block which can be allocated now */
+    unsigned allocs;        /*!< Number of blocks allocated now */
+    unsigned failures;      /*!< Number of allocations which failed for lack of memory */
+} expat_mem_stats_t;
+
+/* Memory handling suite allocating from the pool */
+extern const XML_Memory_Handling_Suite expat_mem_suite;
+
+/**
+ * @brief Set up the memory pool
+ *
+ * @param buffer Memory to use for the pool, 8-byte aligned, or NULL to
+ *               allocate it from the heap
+ * @param size   Size of the pool in bytes
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the pool is set up already,
+ *         ESP_ERR_INVALID_ARG if size is too small, or ESP_ERR_NO_MEM
+ */
+esp_err_t expat_mem_init(void *buffer, size_t size);
+
+/**
+ * @brief Release the memory pool
+ *
+ * All parsers using the pool must have been freed.
+ */
+void expat_mem_deinit(void);
+
+/**
+ * @brief Create a parser which allocates from the pool
+ *
+ * @param encoding Like for XML_ParserCreate
+ *
+ * @return the parser, or NULL if the pool has no room for it
+ */
+XML_Parser expat_mem_parser_create(const XML_Char *encoding);
+
+/**
+ * @brief Get the use of the pool
+ */
+void expat_mem_get_stats(expat_mem_stats_t *stats);
+
+/**
+ * @brief Restart the peak and failure counts of the statistics
+ */
+void expat_mem_reset_peak(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXPAT_MEM_H */
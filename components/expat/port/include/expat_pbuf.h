@@ -0,0 +1,68 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef EXPAT_PBUF_H
+#define EXPAT_PBUF_H
+
+#include "expat.h"
+#include "lwip/pbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Feeding Expat from lwIP without staging buffers.
+ *
+ * With CONFIG_EXPAT_CONTEXT_BYTES set to 0, XML_Parse parses each segment
+ * in place. Only a token split between two segments is copied into the
+ * parser's buffer.
+ *
+ * Handlers must not suspend the parser (XML_StopParser with resumable set):
+ * the remaining segments are not fed to it then, and XML_STATUS_SUSPENDED is
+ * returned.
+ */
+
+/**
+ * @brief Parse the data of a pbuf chain
+ *
+ * @param parser  the parser
+ * @param p       the pbuf chain, which is not freed
+ * @param isFinal non-zero if this is the end of the document
+ *
+ * @return the status of the last XML_Parse call
+ */
+enum XML_Status expat_parse_pbuf(XML_Parser parser, const struct pbuf *p, int isFinal);
+
+/**
+ * @brief Parse a document received on a socket until the peer closes it
+ *
+ * With CONFIG_LWIP_SOCKET_ZEROCOPY, the received pbufs are parsed with
+ * expat_parse_pbuf and given back right after. Otherwise the data are
+ * received directly into the buffer of the parser (XML_GetBuffer).
+ *
+ * @param parser the parser
+ * @param sock   a connected, blocking TCP socket
+ *
+ * @return XML_STATUS_OK when the document has been parsed completely,
+ *         XML_STATUS_ERROR if it is not well-formed or receiving fails
+ *         (XML_GetErrorCode then returns XML_ERROR_NONE and errno is set),
+ *         XML_STATUS_SUSPENDED if a handler suspended the parser
+ */
+enum XML_Status expat_parse_socket(XML_Parser parser, int sock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXPAT_PBUF_H */
@@ -87,14 +87,6 @@ header files above, but not in this file, in order to generate the correct
 privileged Vs unprivileged linkage and placement. */
 #undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE /*lint !e961 !e750. */
 
-#if ( INCLUDE_xEventGroupSetBitFromISR == 1 ) && ( configUSE_TIMERS == 0 )
-	#error configUSE_TIMERS must be set to 1 to make the xEventGroupSetBitFromISR() function available.
-#endif
-
-#if ( INCLUDE_xEventGroupSetBitFromISR == 1 ) && ( INCLUDE_xTimerPendFunctionCall == 0 )
-	#error INCLUDE_xTimerPendFunctionCall must also be set to one to make the xEventGroupSetBitFromISR() function available.
-#endif
-
 /* The following bit fields convey control information in a task's event list
 item value.  It is important they don't clash with the
 taskEVENT_LIST_ITEM_VALUE_IN_USE definition. */
@@ -113,7 +105,9 @@ taskEVENT_LIST_ITEM_VALUE_IN_USE definition. */
 typedef struct xEventGroupDefinition
 {
 	EventBits_t uxEventBits;
+	EventBits_t uxBitsWaitedFor;		/*< Union of the bits the tasks in xTasksWaitingForBits wait for.  Can contain bits no task waits for any more. */
 	List_t xTasksWaitingForBits;		/*< List of tasks waiting for a bit to be set. */
+	portMUX_TYPE eventGroupMux;		/*< Protects the event bits and the list of waiting tasks. */
 
 	#if( configUSE_TRACE_FACILITY == 1 )
 		UBaseType_t uxEventGroupNumber;
@@ -122,11 +116,6 @@ typedef struct xEventGroupDefinition
 } EventGroup_t;
 
 
-/* Again: one mux for all events. Maybe this can be made more granular. ToDo: look into that. -JD */
-static portMUX_TYPE xEventGroupMux = portMUX_INITIALIZER_UNLOCKED;
-static BaseType_t xMuxInitialized = pdFALSE;
-
-
 /*-----------------------------------------------------------*/
 
 /*
@@ -139,23 +128,32 @@ static BaseType_t xMuxInitialized = pdFALSE;
  */
 static BaseType_t prvTestWaitCondition( const EventBits_t uxCurrentEventBits, const EventBits_t uxBitsToWaitFor, const BaseType_t xWaitForAllBits );
 
+/*
+ * Set the bits in uxBitsToSet and unblock the tasks whose wait condition is
+ * met.  Must be called with the event group mux held.  Returns pdTRUE if a
+ * task with a priority above that of the calling task was unblocked.
+ */
+static BaseType_t prvSetBits( EventGroup_t *pxEventBits, const EventBits_t uxBitsToSet );
+
+/*
+ * Block the calling task on the event group until the bits in
+ * uxBitsToWaitFor are set.  Must be called with the event group mux held.
+ */
+static void prvPlaceOnWaitingList( EventGroup_t *pxEventBits, const EventBits_t uxBitsToWaitFor, const EventBits_t uxControlBits, const TickType_t xTicksToWait );
+
 /*-----------------------------------------------------------*/
 
 EventGroupHandle_t xEventGroupCreate( void )
 {
 EventGroup_t *pxEventBits;
 
-	//Initialize mux, if needed
-	if ( xMuxInitialized == pdFALSE ) {
-		vPortCPUInitializeMutex( & xEventGroupMux );
-		xMuxInitialized = pdTRUE;
-	}
-	
 	pxEventBits = pvPortMalloc( sizeof( EventGroup_t ) );
 	if( pxEventBits != NULL )
 	{
 		pxEventBits->uxEventBits = 0;
+		pxEventBits->uxBitsWaitedFor = 0;
 		vListInitialise( &( pxEventBits->xTasksWaitingForBits ) );
+		vPortCPUInitializeMutex( &( pxEventBits->eventGroupMux ) );
 		traceEVENT_GROUP_CREATE( pxEventBits );
 	}
 	else
@@ -171,7 +169,7 @@ EventBits_t xEventGroupSync( EventGroupHandle_t xEventGroup, const EventBits_t u
 {
 EventBits_t uxOriginalBitValue, uxReturn;
 EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
-BaseType_t xAlreadyYielded;
+BaseType_t xYieldRequired;
 BaseType_t xTimeoutOccurred = pdFALSE;
 
 	configASSERT( ( uxBitsToWaitFor & eventEVENT_BITS_CONTROL_BYTES ) == 0 );
@@ -182,11 +180,12 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 	}
 	#endif
 
-	vTaskSuspendAll();
+	taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 	{
 		uxOriginalBitValue = pxEventBits->uxEventBits;
 
-		( void ) xEventGroupSetBits( xEventGroup, uxBitsToSet );
+		traceEVENT_GROUP_SET_BITS( xEventGroup, uxBitsToSet );
+		xYieldRequired = prvSetBits( pxEventBits, uxBitsToSet );
 
 		if( ( ( uxOriginalBitValue | uxBitsToSet ) & uxBitsToWaitFor ) == uxBitsToWaitFor )
 		{
@@ -208,7 +207,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 				/* Store the bits that the calling task is waiting for in the
 				task's event list item so the kernel knows when a match is
 				found.  Then enter the blocked state. */
-				vTaskPlaceOnUnorderedEventList( &( pxEventBits->xTasksWaitingForBits ), ( uxBitsToWaitFor | eventCLEAR_EVENTS_ON_EXIT_BIT | eventWAIT_FOR_ALL_BITS ), xTicksToWait );
+				prvPlaceOnWaitingList( pxEventBits, uxBitsToWaitFor, ( eventCLEAR_EVENTS_ON_EXIT_BIT | eventWAIT_FOR_ALL_BITS ), xTicksToWait );
 
 				/* This assignment is obsolete as uxReturn will get set after
 				the task unblocks, but some compilers mistakenly generate a
@@ -224,18 +223,11 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 			}
 		}
 	}
-	xAlreadyYielded = xTaskResumeAll();
+	taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
 
 	if( xTicksToWait != ( TickType_t ) 0 )
 	{
-		if( xAlreadyYielded == pdFALSE )
-		{
-			portYIELD_WITHIN_API();
-		}
-		else
-		{
-			mtCOVERAGE_TEST_MARKER();
-		}
+		portYIELD_WITHIN_API();
 
 		/* The task blocked to wait for its required bits to be set - at this
 		point either the required bits were set or the block time expired.  If
@@ -246,7 +238,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 		if( ( uxReturn & eventUNBLOCKED_DUE_TO_BIT_SET ) == ( EventBits_t ) 0 )
 		{
 			/* The task timed out, just return the current event bit value. */
-			taskENTER_CRITICAL( &xEventGroupMux );
+			taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 			{
 				uxReturn = pxEventBits->uxEventBits;
 
@@ -263,7 +255,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 					mtCOVERAGE_TEST_MARKER();
 				}
 			}
-			taskEXIT_CRITICAL( &xEventGroupMux );
+			taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
 
 			xTimeoutOccurred = pdTRUE;
 		}
@@ -276,6 +268,15 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 		returned. */
 		uxReturn &= ~eventEVENT_BITS_CONTROL_BYTES;
 	}
+	else if( xYieldRequired != pdFALSE )
+	{
+		/* Setting the bits unblocked a task of higher priority. */
+		portYIELD_WITHIN_API();
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
 
 	traceEVENT_GROUP_SYNC_END( xEventGroup, uxBitsToSet, uxBitsToWaitFor, xTimeoutOccurred );
 
@@ -287,7 +288,7 @@ EventBits_t xEventGroupWaitBits( EventGroupHandle_t xEventGroup, const EventBits
 {
 EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
 EventBits_t uxReturn, uxControlBits = 0;
-BaseType_t xWaitConditionMet, xAlreadyYielded;
+BaseType_t xWaitConditionMet;
 BaseType_t xTimeoutOccurred = pdFALSE;
 
 	/* Check the user is not attempting to wait on the bits used by the kernel
@@ -301,7 +302,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 	}
 	#endif
 
-	vTaskSuspendAll();
+	taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 	{
 		const EventBits_t uxCurrentEventBits = pxEventBits->uxEventBits;
 
@@ -358,7 +359,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 			/* Store the bits that the calling task is waiting for in the
 			task's event list item so the kernel knows when a match is
 			found.  Then enter the blocked state. */
-			vTaskPlaceOnUnorderedEventList( &( pxEventBits->xTasksWaitingForBits ), ( uxBitsToWaitFor | uxControlBits ), xTicksToWait );
+			prvPlaceOnWaitingList( pxEventBits, uxBitsToWaitFor, uxControlBits, xTicksToWait );
 
 			/* This is obsolete as it will get set after the task unblocks, but
 			some compilers mistakenly generate a warning about the variable
@@ -368,18 +369,11 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 			traceEVENT_GROUP_WAIT_BITS_BLOCK( xEventGroup, uxBitsToWaitFor );
 		}
 	}
-	xAlreadyYielded = xTaskResumeAll();
+	taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
 
 	if( xTicksToWait != ( TickType_t ) 0 )
 	{
-		if( xAlreadyYielded == pdFALSE )
-		{
-			portYIELD_WITHIN_API();
-		}
-		else
-		{
-			mtCOVERAGE_TEST_MARKER();
-		}
+		portYIELD_WITHIN_API();
 
 		/* The task blocked to wait for its required bits to be set - at this
 		point either the required bits were set or the block time expired.  If
@@ -389,7 +383,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 
 		if( ( uxReturn & eventUNBLOCKED_DUE_TO_BIT_SET ) == ( EventBits_t ) 0 )
 		{
-			taskENTER_CRITICAL( &xEventGroupMux );
+			taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 			{
 				/* The task timed out, just return the current event bit value. */
 				uxReturn = pxEventBits->uxEventBits;
@@ -412,7 +406,7 @@ BaseType_t xTimeoutOccurred = pdFALSE;
 					mtCOVERAGE_TEST_MARKER();
 				}
 			}
-			taskEXIT_CRITICAL( &xEventGroupMux );
+			taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
 
 			/* Prevent compiler warnings when trace macros are not used. */
 			xTimeoutOccurred = pdFALSE;
@@ -441,7 +435,7 @@ EventBits_t uxReturn;
 	configASSERT( xEventGroup );
 	configASSERT( ( uxBitsToClear & eventEVENT_BITS_CONTROL_BYTES ) == 0 );
 
-	taskENTER_CRITICAL( &xEventGroupMux );
+	taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 	{
 		traceEVENT_GROUP_CLEAR_BITS( xEventGroup, uxBitsToClear );
 
@@ -452,38 +446,40 @@ EventBits_t uxReturn;
 		/* Clear the bits. */
 		pxEventBits->uxEventBits &= ~uxBitsToClear;
 	}
-	taskEXIT_CRITICAL( &xEventGroupMux );
+	taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
 
 	return uxReturn;
 }
 /*-----------------------------------------------------------*/
 
-#if ( ( configUSE_TRACE_FACILITY == 1 ) && ( INCLUDE_xTimerPendFunctionCall == 1 ) && ( configUSE_TIMERS == 1 ) )
+BaseType_t xEventGroupClearBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear )
+{
+EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
 
-	BaseType_t xEventGroupClearBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear )
-	{
-		BaseType_t xReturn;
+	configASSERT( xEventGroup );
+	configASSERT( ( uxBitsToClear & eventEVENT_BITS_CONTROL_BYTES ) == 0 );
 
+	taskENTER_CRITICAL_ISR( &( pxEventBits->eventGroupMux ) );
+	{
 		traceEVENT_GROUP_CLEAR_BITS_FROM_ISR( xEventGroup, uxBitsToClear );
-		xReturn = xTimerPendFunctionCallFromISR( vEventGroupClearBitsCallback, ( void * ) xEventGroup, ( uint32_t ) uxBitsToClear, NULL );
-
-		return xReturn;
+		pxEventBits->uxEventBits &= ~uxBitsToClear;
 	}
+	taskEXIT_CRITICAL_ISR( &( pxEventBits->eventGroupMux ) );
 
-#endif
+	return pdPASS;
+}
 /*-----------------------------------------------------------*/
 
 EventBits_t xEventGroupGetBitsFromISR( EventGroupHandle_t xEventGroup )
 {
-UBaseType_t uxSavedInterruptStatus;
 EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
 EventBits_t uxReturn;
 
-	uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+	taskENTER_CRITICAL_ISR( &( pxEventBits->eventGroupMux ) );
 	{
 		uxReturn = pxEventBits->uxEventBits;
 	}
-	portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+	taskEXIT_CRITICAL_ISR( &( pxEventBits->eventGroupMux ) );
 
 	return uxReturn;
 }
@@ -491,95 +487,173 @@ EventBits_t uxReturn;
 
 EventBits_t xEventGroupSetBits( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet )
 {
-ListItem_t *pxListItem, *pxNext;
-ListItem_t const *pxListEnd;
-List_t *pxList;
-EventBits_t uxBitsToClear = 0, uxBitsWaitedFor, uxControlBits;
 EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
-BaseType_t xMatchFound = pdFALSE;
+EventBits_t uxReturn;
+BaseType_t xYieldRequired;
 
 	/* Check the user is not attempting to set the bits used by the kernel
 	itself. */
 	configASSERT( xEventGroup );
 	configASSERT( ( uxBitsToSet & eventEVENT_BITS_CONTROL_BYTES ) == 0 );
 
-	pxList = &( pxEventBits->xTasksWaitingForBits );
-	pxListEnd = listGET_END_MARKER( pxList ); /*lint !e826 !e740 The mini list structure is used as the list end to save RAM.  This is checked and valid. */
-	vTaskSuspendAll();
+	taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 	{
 		traceEVENT_GROUP_SET_BITS( xEventGroup, uxBitsToSet );
+		xYieldRequired = prvSetBits( pxEventBits, uxBitsToSet );
+		uxReturn = pxEventBits->uxEventBits;
+	}
+	taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
 
-		pxListItem = listGET_HEAD_ENTRY( pxList );
+	if( xYieldRequired != pdFALSE )
+	{
+		portYIELD_WITHIN_API();
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
 
-		/* Set the bits. */
-		pxEventBits->uxEventBits |= uxBitsToSet;
+	return uxReturn;
+}
+/*-----------------------------------------------------------*/
 
-		/* See if the new bit value should unblock any tasks. */
-		while( pxListItem != pxListEnd )
-		{
-			pxNext = listGET_NEXT( pxListItem );
-			uxBitsWaitedFor = listGET_LIST_ITEM_VALUE( pxListItem );
-			xMatchFound = pdFALSE;
+BaseType_t xEventGroupSetBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet, BaseType_t *pxHigherPriorityTaskWoken )
+{
+EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
+BaseType_t xYieldRequired;
 
-			/* Split the bits waited for from the control bits. */
-			uxControlBits = uxBitsWaitedFor & eventEVENT_BITS_CONTROL_BYTES;
-			uxBitsWaitedFor &= ~eventEVENT_BITS_CONTROL_BYTES;
+	configASSERT( xEventGroup );
+	configASSERT( ( uxBitsToSet & eventEVENT_BITS_CONTROL_BYTES ) == 0 );
 
-			if( ( uxControlBits & eventWAIT_FOR_ALL_BITS ) == ( EventBits_t ) 0 )
-			{
-				/* Just looking for single bit being set. */
-				if( ( uxBitsWaitedFor & pxEventBits->uxEventBits ) != ( EventBits_t ) 0 )
-				{
-					xMatchFound = pdTRUE;
-				}
-				else
-				{
-					mtCOVERAGE_TEST_MARKER();
-				}
-			}
-			else if( ( uxBitsWaitedFor & pxEventBits->uxEventBits ) == uxBitsWaitedFor )
+	taskENTER_CRITICAL_ISR( &( pxEventBits->eventGroupMux ) );
+	{
+		traceEVENT_GROUP_SET_BITS_FROM_ISR( xEventGroup, uxBitsToSet );
+		xYieldRequired = prvSetBits( pxEventBits, uxBitsToSet );
+	}
+	taskEXIT_CRITICAL_ISR( &( pxEventBits->eventGroupMux ) );
+
+	if( ( xYieldRequired != pdFALSE ) && ( pxHigherPriorityTaskWoken != NULL ) )
+	{
+		*pxHigherPriorityTaskWoken = pdTRUE;
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	return pdPASS;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSetBits( EventGroup_t *pxEventBits, const EventBits_t uxBitsToSet )
+{
+ListItem_t *pxListItem, *pxNext;
+ListItem_t const *pxListEnd;
+List_t *pxList;
+EventBits_t uxBitsToClear = 0, uxBitsWaitedFor, uxControlBits, uxBitsStillWaitedFor = 0;
+BaseType_t xMatchFound, xYieldRequired = pdFALSE;
+
+	/* Set the bits. */
+	pxEventBits->uxEventBits |= uxBitsToSet;
+
+	/* Only walk the list of waiting tasks if one of them can be interested in
+	the new bits.  The list is walked with interrupts disabled, so setting bits
+	nobody waits for should not cost more than setting them. */
+	if( ( uxBitsToSet & pxEventBits->uxBitsWaitedFor ) == ( EventBits_t ) 0 )
+	{
+		return pdFALSE;
+	}
+
+	pxList = &( pxEventBits->xTasksWaitingForBits );
+	pxListEnd = listGET_END_MARKER( pxList ); /*lint !e826 !e740 The mini list structure is used as the list end to save RAM.  This is checked and valid. */
+	pxListItem = listGET_HEAD_ENTRY( pxList );
+
+	/* See if the new bit value should unblock any tasks. */
+	while( pxListItem != pxListEnd )
+	{
+		pxNext = listGET_NEXT( pxListItem );
+		uxBitsWaitedFor = listGET_LIST_ITEM_VALUE( pxListItem );
+		xMatchFound = pdFALSE;
+
+		/* Split the bits waited for from the control bits. */
+		uxControlBits = uxBitsWaitedFor & eventEVENT_BITS_CONTROL_BYTES;
+		uxBitsWaitedFor &= ~eventEVENT_BITS_CONTROL_BYTES;
+
+		if( ( uxControlBits & eventWAIT_FOR_ALL_BITS ) == ( EventBits_t ) 0 )
+		{
+			/* Just looking for single bit being set. */
+			if( ( uxBitsWaitedFor & pxEventBits->uxEventBits ) != ( EventBits_t ) 0 )
 			{
-				/* All bits are set. */
 				xMatchFound = pdTRUE;
 			}
 			else
 			{
-				/* Need all bits to be set, but not all the bits were set. */
+				mtCOVERAGE_TEST_MARKER();
 			}
+		}
+		else if( ( uxBitsWaitedFor & pxEventBits->uxEventBits ) == uxBitsWaitedFor )
+		{
+			/* All bits are set. */
+			xMatchFound = pdTRUE;
+		}
+		else
+		{
+			/* Need all bits to be set, but not all the bits were set. */
+		}
 
-			if( xMatchFound != pdFALSE )
+		if( xMatchFound != pdFALSE )
+		{
+			/* The bits match.  Should the bits be cleared on exit? */
+			if( ( uxControlBits & eventCLEAR_EVENTS_ON_EXIT_BIT ) != ( EventBits_t ) 0 )
 			{
-				/* The bits match.  Should the bits be cleared on exit? */
-				if( ( uxControlBits & eventCLEAR_EVENTS_ON_EXIT_BIT ) != ( EventBits_t ) 0 )
-				{
-					uxBitsToClear |= uxBitsWaitedFor;
-				}
-				else
-				{
-					mtCOVERAGE_TEST_MARKER();
-				}
-
-				/* Store the actual event flag value in the task's event list
-				item before removing the task from the event list.  The
-				eventUNBLOCKED_DUE_TO_BIT_SET bit is set so the task knows
-				that is was unblocked due to its required bits matching, rather
-				than because it timed out. */
-				( void ) xTaskRemoveFromUnorderedEventList( pxListItem, pxEventBits->uxEventBits | eventUNBLOCKED_DUE_TO_BIT_SET );
+				uxBitsToClear |= uxBitsWaitedFor;
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
 			}
 
-			/* Move onto the next list item.  Note pxListItem->pxNext is not
-			used here as the list item may have been removed from the event list
-			and inserted into the ready/pending reading list. */
-			pxListItem = pxNext;
+			/* Store the actual event flag value in the task's event list
+			item before removing the task from the event list.  The
+			eventUNBLOCKED_DUE_TO_BIT_SET bit is set so the task knows
+			that is was unblocked due to its required bits matching, rather
+			than because it timed out. */
+			if( xTaskRemoveFromUnorderedEventList( pxListItem, pxEventBits->uxEventBits | eventUNBLOCKED_DUE_TO_BIT_SET ) != pdFALSE )
+			{
+				xYieldRequired = pdTRUE;
+			}
+		}
+		else
+		{
+			uxBitsStillWaitedFor |= uxBitsWaitedFor;
 		}
 
-		/* Clear any bits that matched when the eventCLEAR_EVENTS_ON_EXIT_BIT
-		bit was set in the control word. */
-		pxEventBits->uxEventBits &= ~uxBitsToClear;
+		/* Move onto the next list item.  Note pxListItem->pxNext is not
+		used here as the list item may have been removed from the event list
+		and inserted into the ready/pending reading list. */
+		pxListItem = pxNext;
 	}
-	( void ) xTaskResumeAll();
 
-	return pxEventBits->uxEventBits;
+	/* Tasks that timed out left their bits in the summary, this is a good
+	moment to drop them. */
+	pxEventBits->uxBitsWaitedFor = uxBitsStillWaitedFor;
+
+	/* Clear any bits that matched when the eventCLEAR_EVENTS_ON_EXIT_BIT
+	bit was set in the control word. */
+	pxEventBits->uxEventBits &= ~uxBitsToClear;
+
+	return xYieldRequired;
+}
+/*-----------------------------------------------------------*/
+
+static void prvPlaceOnWaitingList( EventGroup_t *pxEventBits, const EventBits_t uxBitsToWaitFor, const EventBits_t uxControlBits, const TickType_t xTicksToWait )
+{
+	pxEventBits->uxBitsWaitedFor |= uxBitsToWaitFor;
+
+	/* Store the bits that the calling task is waiting for in the task's event
+	list item so the kernel knows when a match is found.  Then enter the
+	blocked state. */
+	vTaskPlaceOnUnorderedEventList( &( pxEventBits->xTasksWaitingForBits ), ( uxBitsToWaitFor | uxControlBits ), xTicksToWait );
 }
 /*-----------------------------------------------------------*/
 
@@ -588,7 +662,7 @@ void vEventGroupDelete( EventGroupHandle_t xEventGroup )
 EventGroup_t *pxEventBits = ( EventGroup_t * ) xEventGroup;
 const List_t *pxTasksWaitingForBits = &( pxEventBits->xTasksWaitingForBits );
 
-	vTaskSuspendAll();
+	taskENTER_CRITICAL( &( pxEventBits->eventGroupMux ) );
 	{
 		traceEVENT_GROUP_DELETE( xEventGroup );
 
@@ -599,10 +673,10 @@ const List_t *pxTasksWaitingForBits = &( pxEventBits->xTasksWaitingForBits );
 			configASSERT( pxTasksWaitingForBits->xListEnd.pxNext != ( ListItem_t * ) &( pxTasksWaitingForBits->xListEnd ) );
 			( void ) xTaskRemoveFromUnorderedEventList( pxTasksWaitingForBits->xListEnd.pxNext, eventUNBLOCKED_DUE_TO_BIT_SET );
 		}
-
-		vPortFree( pxEventBits );
 	}
-	( void ) xTaskResumeAll();
+	taskEXIT_CRITICAL( &( pxEventBits->eventGroupMux ) );
+
+	vPortFree( pxEventBits );
 }
 /*-----------------------------------------------------------*/
 
@@ -657,21 +731,6 @@ BaseType_t xWaitConditionMet = pdFALSE;
 }
 /*-----------------------------------------------------------*/
 
-#if ( ( configUSE_TRACE_FACILITY == 1 ) && ( INCLUDE_xTimerPendFunctionCall == 1 ) && ( configUSE_TIMERS == 1 ) )
-
-	BaseType_t xEventGroupSetBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet, BaseType_t *pxHigherPriorityTaskWoken )
-	{
-	BaseType_t xReturn;
-
-		traceEVENT_GROUP_SET_BITS_FROM_ISR( xEventGroup, uxBitsToSet );
-		xReturn = xTimerPendFunctionCallFromISR( vEventGroupSetBitsCallback, ( void * ) xEventGroup, ( uint32_t ) uxBitsToSet, pxHigherPriorityTaskWoken );
-
-		return xReturn;
-	}
-
-#endif
-/*-----------------------------------------------------------*/
-
 #if (configUSE_TRACE_FACILITY == 1)
 
 	UBaseType_t uxEventGroupGetNumber( void* xEventGroup )
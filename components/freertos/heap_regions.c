@@ -115,15 +115,25 @@
  */
 
 /*
-
-ToDo:
-- This malloc implementation can be somewhat slow, especially when it is called multiple times with multiple tags
-when having low memory issues. ToDo: Make it quicker.
- -JD
+ * Implementation notes:
+ *
+ * Free blocks are kept in segregated size class lists, one set of lists per tag, indexed by a
+ * two-level bitmap in the style of TLSF. The first level splits block sizes into powers of two,
+ * the second level splits every power of two into heapSL_COUNT equally sized ranges. A request
+ * is rounded up to the next second level boundary, so the head of any non-empty list found
+ * through the bitmaps is big enough; finding it takes a couple of bit scans.
+ *
+ * Every block also records the block located immediately before it in memory, so a block
+ * that is freed is merged with its free neighbours without walking any list. Allocating and
+ * freeing memory thus take constant time, however fragmented the heap gets.
+ *
+ * The lists for a tag are carved out of the start of the first region carrying that tag.
+ * Tags must be lower than heapMAX_TAGS.
  */
 
 
 #include <stdlib.h>
+#include <string.h>
 
 /* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
 all the API functions to use the MPU wrappers.  That should only be done when
@@ -137,6 +147,7 @@ task.h is included from an application file. */
 #undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
 
 #include "heap_regions.h"
+#include "heap_trace.h"
 
 #include "rom/ets_sys.h"
 
@@ -146,195 +157,883 @@ task.h is included from an application file. */
 /* Assumes 8bit bytes! */
 #define heapBITS_PER_BYTE		( ( size_t ) 8 )
 
-/* Define the linked list structure.  This is used to link free blocks in order
-of their memory address. */
+/* Number of tags the allocator keeps free lists for. */
+#define heapMAX_TAGS			16
+
+/* Size class index parameters. The first first level class holds blocks from
+( 1 << heapFL_SHIFT_MIN ) bytes up; all blocks of
+( 1 << ( heapFL_SHIFT_MIN + heapFL_COUNT ) ) bytes and more share the last list
+of the last class. */
+#define heapFL_SHIFT_MIN		4
+#define heapFL_COUNT			14
+#define heapSL_SHIFT			2
+#define heapSL_COUNT			( 1 << heapSL_SHIFT )
+
+/* Define the linked list structure.  This is used to link free blocks of the
+same size class, and to find the neighbours of a block in memory. */
 typedef struct A_BLOCK_LINK
 {
-	struct A_BLOCK_LINK *pxNextFreeBlock;	/*<< The next free block in the list. */
+	struct A_BLOCK_LINK *pxNextFreeBlock;	/*<< The next free block in the same size class list. */
 	size_t xBlockSize;						/*<< The size of the free block. */
 	BaseType_t xTag;							/*<< Tag of this region */
+	struct A_BLOCK_LINK *pxPrevPhysBlock;	/*<< The block right before this one in memory, NULL for the first block of a region. */
 } BlockLink_t;
 
+/* Free lists of one tag, with a bitmap of the non-empty ones.  These are kept
+in the first region of the tag, which may only allow 32-bit accesses, so all
+members are words. */
+typedef struct
+{
+	uint32_t ulFlBitmap;						/*<< Bit n is set if any list of first level class n is non-empty. */
+	uint32_t ulSlBitmap[ heapFL_COUNT ];		/*<< Bit m of entry n is set if pxFreeLists[ n ][ m ] is non-empty. */
+	BlockLink_t *pxFreeLists[ heapFL_COUNT ][ heapSL_COUNT ];
+} HeapTagLists_t;
+
 //Mux to protect the memory status data
 static portMUX_TYPE xMallocMutex = portMUX_INITIALIZER_UNLOCKED;
 
+#if( configHEAP_STATS == 1 )
+
+	#if( heapFL_COUNT != heapSTATS_HISTOGRAM_COUNT )
+		#error The free block histogram must have an entry for every first level class
+	#endif
+
+	/* Allocation counters of one tag.  Each core counts in its own copy, with
+	interrupts masked, so counting takes no lock. */
+	typedef struct
+	{
+		uint32_t ulAllocations;
+		uint32_t ulFrees;
+		uint32_t ulFailures;
+	} HeapCounters_t;
+
+	static HeapCounters_t xHeapCounters[ portNUM_PROCESSORS ][ heapMAX_TAGS ];
+
+	#define heapCOUNT( xTag, xMember )												\
+	{																				\
+		unsigned uxCountState = portENTER_CRITICAL_NESTED();						\
+		xHeapCounters[ xPortGetCoreID() ][ ( xTag ) ].xMember++;					\
+		portEXIT_CRITICAL_NESTED( uxCountState );									\
+	}
+
+	/* Time xMallocMutex is held for, in CPU cycles.  The lock is released on
+	the core it was taken on, so both timestamps come from the same counter. */
+	static HeapLockStats_t xLockStats;
+	static uint32_t ulLockTakenAt;
+
+	#define heapLOCK()																\
+	{																				\
+		taskENTER_CRITICAL( &xMallocMutex );										\
+		ulLockTakenAt = portGET_RUN_TIME_COUNTER_VALUE();							\
+	}
+
+	#define heapUNLOCK()															\
+	{																				\
+		uint32_t ulLockCycles = portGET_RUN_TIME_COUNTER_VALUE() - ulLockTakenAt;	\
+		xLockStats.ulCount++;														\
+		xLockStats.ullTotalCycles += ulLockCycles;									\
+		if( ulLockCycles > xLockStats.ulMaxCycles )									\
+		{																			\
+			xLockStats.ulMaxCycles = ulLockCycles;									\
+		}																			\
+		taskEXIT_CRITICAL( &xMallocMutex );											\
+	}
+
+#else
+
+	#define heapCOUNT( xTag, xMember )
+	#define heapLOCK()		taskENTER_CRITICAL( &xMallocMutex )
+	#define heapUNLOCK()	taskEXIT_CRITICAL( &xMallocMutex )
+
+#endif /* configHEAP_STATS */
+
+#if( configHEAP_TRACE == 1 )
+
+	#define heapTRACE_ALLOC( pv, xSize )	vPortHeapTraceAlloc( ( pv ), ( xSize ) )
+	#define heapTRACE_FREE( pv )			vPortHeapTraceFree( pv )
+
+#else
+
+	#define heapTRACE_ALLOC( pv, xSize )
+	#define heapTRACE_FREE( pv )
+
+#endif /* configHEAP_TRACE */
+
 /*-----------------------------------------------------------*/
 
 /*
- * Inserts a block of memory that is being freed into the correct position in
- * the list of free memory blocks.  The block being freed will be merged with
- * the block in front it and/or the block behind it if the memory blocks are
- * adjacent to each other.
+ * Inserts a block of memory that is being freed into the free list of its
+ * size class.  The block being freed will be merged with the block in front
+ * it and/or the block behind it if those are free as well.
  */
 static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert );
 
-/*-----------------------------------------------------------*/
+/*
+ * Turns a region of memory into a free block and links it behind the last
+ * region of the heap.
+ */
+static size_t prvAddRegion( const HeapRegionTagged_t * const pxHeapRegion );
+
+/*-----------------------------------------------------------*/
+
+/* The size of the structure placed at the beginning of each allocated memory
+block must by correctly byte aligned. */
+static const uint32_t uxHeapStructSize	= ( ( sizeof ( BlockLink_t ) + BLOCK_HEAD_LEN + BLOCK_TAIL_LEN + ( portBYTE_ALIGNMENT - 1 ) ) & ~portBYTE_ALIGNMENT_MASK );
+
+/* A free block keeps the previous block of its free list in the first word
+after the BlockLink_t structure, so every block must have room for it. */
+#define heapPREV_FREE_BLOCK( pxBlock )	( *( BlockLink_t ** ) ( ( ( uint8_t * ) ( pxBlock ) ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN ) )
+#define heapMINIMUM_ALLOCATION_SIZE		( ( size_t ) ( ( uxHeapStructSize + sizeof( BlockLink_t * ) + portBYTE_ALIGNMENT_MASK ) & ~portBYTE_ALIGNMENT_MASK ) )
+
+/* The block right after this one in memory. For the last block of a region,
+this is the end marker of the region. */
+#define heapNEXT_PHYS_BLOCK( pxBlock )	( ( BlockLink_t * ) ( ( ( uint8_t * ) ( pxBlock ) ) + ( ( pxBlock )->xBlockSize & ~xBlockAllocatedBit ) ) )
+
+/* xStart points to the first block of the first region, pxEnd is the end
+marker of the last region. The end marker of every other region points to the
+first block of the region after it. */
+static BlockLink_t xStart, *pxEnd = NULL;
+
+/* Free lists for every tag, NULL for tags no region was defined for. */
+static HeapTagLists_t *pxTagLists[ heapMAX_TAGS ];
+
+/* Keeps track of the number of free bytes remaining, but says nothing about
+fragmentation. */
+static size_t xFreeBytesRemaining = 0;
+static size_t xMinimumEverFreeBytesRemaining = 0;
+
+/* Gets set to the top bit of an size_t type.  When this bit in the xBlockSize
+member of an BlockLink_t structure is set then the block belongs to the
+application.  When the bit is free the block is still part of the free heap
+space. */
+static size_t xBlockAllocatedBit = 0;
+
+/*-----------------------------------------------------------*/
+
+static HeapTagLists_t *prvGetTagLists( BaseType_t xTag )
+{
+	if( ( xTag < 0 ) || ( xTag >= heapMAX_TAGS ) )
+	{
+		return NULL;
+	}
+	return pxTagLists[ xTag ];
+}
+/*-----------------------------------------------------------*/
+
+/* Works out the free list a block of the given size belongs to. */
+static void prvMapSize( size_t xSize, UBaseType_t *puxFl, UBaseType_t *puxSl )
+{
+UBaseType_t uxMsb = ( UBaseType_t ) ( 31 - __builtin_clz( ( unsigned int ) xSize ) );
+
+	if( uxMsb < heapFL_SHIFT_MIN )
+	{
+		*puxFl = 0;
+		*puxSl = 0;
+	}
+	else if( uxMsb >= heapFL_SHIFT_MIN + heapFL_COUNT )
+	{
+		*puxFl = heapFL_COUNT - 1;
+		*puxSl = heapSL_COUNT - 1;
+	}
+	else
+	{
+		*puxFl = uxMsb - heapFL_SHIFT_MIN;
+		*puxSl = ( xSize >> ( uxMsb - heapSL_SHIFT ) ) & ( heapSL_COUNT - 1 );
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvInsertFreeBlock( HeapTagLists_t *pxLists, BlockLink_t *pxBlock )
+{
+UBaseType_t uxFl, uxSl;
+BlockLink_t *pxHead;
+
+	prvMapSize( pxBlock->xBlockSize, &uxFl, &uxSl );
+	pxHead = pxLists->pxFreeLists[ uxFl ][ uxSl ];
+
+	pxBlock->pxNextFreeBlock = pxHead;
+	heapPREV_FREE_BLOCK( pxBlock ) = NULL;
+	if( pxHead != NULL )
+	{
+		heapPREV_FREE_BLOCK( pxHead ) = pxBlock;
+	}
+	pxLists->pxFreeLists[ uxFl ][ uxSl ] = pxBlock;
+
+	pxLists->ulSlBitmap[ uxFl ] |= ( 1UL << uxSl );
+	pxLists->ulFlBitmap |= ( 1UL << uxFl );
+}
+/*-----------------------------------------------------------*/
+
+/* Takes a block out of its free list. Must be called before its size changes. */
+static void prvRemoveFreeBlock( HeapTagLists_t *pxLists, BlockLink_t *pxBlock )
+{
+UBaseType_t uxFl, uxSl;
+BlockLink_t *pxNext = pxBlock->pxNextFreeBlock;
+BlockLink_t *pxPrev = heapPREV_FREE_BLOCK( pxBlock );
+
+	prvMapSize( pxBlock->xBlockSize, &uxFl, &uxSl );
+
+	if( pxPrev != NULL )
+	{
+		pxPrev->pxNextFreeBlock = pxNext;
+	}
+	else
+	{
+		pxLists->pxFreeLists[ uxFl ][ uxSl ] = pxNext;
+		if( pxNext == NULL )
+		{
+			pxLists->ulSlBitmap[ uxFl ] &= ~( 1UL << uxSl );
+			if( pxLists->ulSlBitmap[ uxFl ] == 0 )
+			{
+				pxLists->ulFlBitmap &= ~( 1UL << uxFl );
+			}
+		}
+	}
+
+	if( pxNext != NULL )
+	{
+		heapPREV_FREE_BLOCK( pxNext ) = pxPrev;
+	}
+
+	pxBlock->pxNextFreeBlock = NULL;
+}
+/*-----------------------------------------------------------*/
+
+static BlockLink_t *prvFirstFit( BlockLink_t *pxBlock, size_t xWantedSize )
+{
+	while( ( pxBlock != NULL ) && ( pxBlock->xBlockSize < xWantedSize ) )
+	{
+		#if (configENABLE_MEMORY_DEBUG == 1)
+		{
+			mem_check_block(pxBlock);
+		}
+		#endif
+
+		pxBlock = pxBlock->pxNextFreeBlock;
+	}
+	return pxBlock;
+}
+/*-----------------------------------------------------------*/
+
+/* Finds a free block of at least xWantedSize bytes, without taking it out of
+its list. */
+static BlockLink_t *prvFindFreeBlock( HeapTagLists_t *pxLists, size_t xWantedSize )
+{
+UBaseType_t uxFl, uxSl, uxMsb;
+uint32_t ulMap;
+size_t xRoundedSize = xWantedSize;
+BlockLink_t *pxBlock;
+
+	/* Round the size up to the next list boundary, so any block in that
+	list or in the ones after it is large enough. */
+	uxMsb = ( UBaseType_t ) ( 31 - __builtin_clz( ( unsigned int ) xWantedSize ) );
+	if( ( uxMsb >= heapFL_SHIFT_MIN ) && ( uxMsb < heapFL_SHIFT_MIN + heapFL_COUNT ) )
+	{
+		xRoundedSize += ( ( size_t ) 1 << ( uxMsb - heapSL_SHIFT ) ) - 1;
+	}
+	prvMapSize( xRoundedSize, &uxFl, &uxSl );
+
+	ulMap = pxLists->ulSlBitmap[ uxFl ] & ( ~0UL << uxSl );
+	if( ulMap == 0 )
+	{
+		ulMap = pxLists->ulFlBitmap & ( ~0UL << ( uxFl + 1 ) );
+		if( ulMap != 0 )
+		{
+			uxFl = ( UBaseType_t ) __builtin_ctz( ulMap );
+			ulMap = pxLists->ulSlBitmap[ uxFl ];
+		}
+	}
+
+	if( ulMap != 0 )
+	{
+		uxSl = ( UBaseType_t ) __builtin_ctz( ulMap );
+
+		/* The head of the list fits, except in the last list which holds all
+		blocks above the largest class. */
+		pxBlock = prvFirstFit( pxLists->pxFreeLists[ uxFl ][ uxSl ], xWantedSize );
+		if( pxBlock != NULL )
+		{
+			return pxBlock;
+		}
+	}
+
+	/* None of the lists that are sure to fit has a block left. The list the
+	size itself maps to can still have one that is large enough; this is
+	the only case in which a list needs to be searched. */
+	prvMapSize( xWantedSize, &uxFl, &uxSl );
+	return prvFirstFit( pxLists->pxFreeLists[ uxFl ][ uxSl ], xWantedSize );
+}
+/*-----------------------------------------------------------*/
+
+/* Works out the size of the block that holds xWantedSize bytes: room for the
+BlockLink_t structure is added and the size is aligned. */
+static size_t prvGetBlockSize( size_t xWantedSize )
+{
+	if( xWantedSize > 0 )
+	{
+		xWantedSize += uxHeapStructSize;
+
+		/* Ensure that blocks are always aligned to the required number
+		of bytes. */
+		if( ( xWantedSize & portBYTE_ALIGNMENT_MASK ) != 0x00 )
+		{
+			/* Byte alignment required. */
+			xWantedSize += ( portBYTE_ALIGNMENT - ( xWantedSize & portBYTE_ALIGNMENT_MASK ) );
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+
+		/* The block must be able to go into a free list later on. */
+		if( xWantedSize < heapMINIMUM_ALLOCATION_SIZE )
+		{
+			xWantedSize = heapMINIMUM_ALLOCATION_SIZE;
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	return xWantedSize;
+}
+/*-----------------------------------------------------------*/
+
+/* Hands out pxBlock, which has been taken out of the free lists of its tag,
+for an allocation of xWantedSize bytes (including the BlockLink_t structure).
+The part of the block that isn't needed is split off and put back into the
+free lists if it is large enough.  Must be called with xMallocMutex held. */
+static void *prvUseBlock( HeapTagLists_t *pxLists, BlockLink_t *pxBlock, size_t xWantedSize, BaseType_t tag )
+{
+BlockLink_t *pxNewBlockLink;
+
+	/* If the block is larger than required it can be split into
+	two. */
+
+	if( ( pxBlock->xBlockSize - xWantedSize ) > heapMINIMUM_BLOCK_SIZE )
+	{
+		/* This block is to be split into two.  Create a new
+		block following the number of bytes requested. The void
+		cast is used to prevent byte alignment warnings from the
+		compiler. */
+		pxNewBlockLink = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xWantedSize);
+
+		/* Calculate the sizes of two blocks split from the
+		single block. */
+		pxNewBlockLink->xBlockSize = pxBlock->xBlockSize - xWantedSize;
+		pxNewBlockLink->xTag = tag;
+		pxNewBlockLink->pxPrevPhysBlock = pxBlock;
+		pxBlock->xBlockSize = xWantedSize;
+		heapNEXT_PHYS_BLOCK( pxNewBlockLink )->pxPrevPhysBlock = pxNewBlockLink;
+
+                                    #if (configENABLE_MEMORY_DEBUG == 1)
+                                    {
+                                        mem_init_dog(pxNewBlockLink);
+                                    }
+                                    #endif
+
+
+		/* Insert the new block into the list of free blocks.
+		The block after it is in use, as free neighbours are
+		always merged, so there is nothing to merge with. */
+		prvInsertFreeBlock( pxLists, pxNewBlockLink );
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	xFreeBytesRemaining -= pxBlock->xBlockSize;
+
+	if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+	{
+		xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	/* The block is being returned - it is allocated and owned
+	by the application and has no "next" block. */
+	pxBlock->xBlockSize |= xBlockAllocatedBit;
+	pxBlock->pxNextFreeBlock = NULL;
+
+                            #if (configENABLE_MEMORY_DEBUG == 1)
+                            {
+                                mem_init_dog(pxBlock);
+                                mem_malloc_block(pxBlock);
+                            }
+                            #endif
+
+	/* Return the memory space pointed to - jumping over the
+	BlockLink_t structure at its start. */
+	return ( void * ) ( ( ( uint8_t * ) pxBlock ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN);
+}
+/*-----------------------------------------------------------*/
+
+/* Takes a block of xWantedSize bytes out of the free lists of a tag.  Must be
+called with xMallocMutex held. */
+static void *prvHeapAllocate( size_t xWantedSize, BaseType_t tag )
+{
+BlockLink_t *pxBlock;
+HeapTagLists_t *pxLists = prvGetTagLists( tag );
+void *pvReturn = NULL;
+
+	/* Check the requested block size is not so large that the top bit is
+	set.  The top bit of the block size member of the BlockLink_t structure
+	is used to determine who owns the block - the application or the
+	kernel, so it must be free. */
+	if( ( pxLists != NULL ) && ( ( xWantedSize & xBlockAllocatedBit ) == 0 ) )
+	{
+		/* The wanted size is increased so it can contain a BlockLink_t
+		structure in addition to the requested amount of bytes. */
+		xWantedSize = prvGetBlockSize( xWantedSize );
+
+		if( ( xWantedSize > 0 ) && ( xWantedSize <= xFreeBytesRemaining ) )
+		{
+			/* Look up a block of adequate size in the free lists of
+			this tag. */
+			pxBlock = prvFindFreeBlock( pxLists, xWantedSize );
+
+			if( pxBlock != NULL )
+			{
+				/* This block is being returned for use so must be taken out
+				of the list of free blocks. */
+				prvRemoveFreeBlock( pxLists, pxBlock );
+				pvReturn = prvUseBlock( pxLists, pxBlock, xWantedSize, tag );
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	traceMALLOC( pvReturn, xWantedSize );
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+/* Like prvHeapAllocate(), but the memory returned starts at a multiple of
+xAlignment, a power of two larger than portBYTE_ALIGNMENT.  A block that has
+room for the aligned allocation is looked up, and the memory in front of the
+aligned start goes back into the free lists as a block of its own.  Must be
+called with xMallocMutex held. */
+static void *prvHeapAllocateAligned( size_t xWantedSize, size_t xAlignment, BaseType_t tag )
+{
+BlockLink_t *pxBlock, *pxAlignedBlock;
+HeapTagLists_t *pxLists = prvGetTagLists( tag );
+const size_t xDataOffset = uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN;
+size_t xSearchSize, xLeadSize, xData;
+void *pvReturn = NULL;
+
+	/* Keeping both sizes below a quarter of the address space makes sure the
+	sum below can't overflow. */
+	if( ( pxLists != NULL ) && ( ( ( xWantedSize | xAlignment ) & ( xBlockAllocatedBit | ( xBlockAllocatedBit >> 1 ) ) ) == 0 ) )
+	{
+		xWantedSize = prvGetBlockSize( xWantedSize );
+
+		/* Any block this large can be split into a leading block that can go
+		into a free list and a block with aligned data of xWantedSize bytes. */
+		xSearchSize = xWantedSize + xAlignment + heapMINIMUM_ALLOCATION_SIZE;
+
+		if( ( xWantedSize > 0 ) && ( xSearchSize <= xFreeBytesRemaining ) )
+		{
+			pxBlock = prvFindFreeBlock( pxLists, xSearchSize );
+
+			if( pxBlock != NULL )
+			{
+				prvRemoveFreeBlock( pxLists, pxBlock );
+
+				/* Find the first aligned data address that either needs no
+				leading block, or leaves room for a free one. */
+				xData = ( ( size_t ) pxBlock + xDataOffset + xAlignment - 1 ) & ~( xAlignment - 1 );
+				xLeadSize = xData - xDataOffset - ( size_t ) pxBlock;
+				while( ( xLeadSize != 0 ) && ( xLeadSize < heapMINIMUM_ALLOCATION_SIZE ) )
+				{
+					xLeadSize += xAlignment;
+				}
+
+				if( xLeadSize != 0 )
+				{
+					/* Split off the leading memory.  The block in front of it
+					is in use, as free neighbours are always merged, so there
+					is nothing to merge it with. */
+					pxAlignedBlock = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xLeadSize );
+					pxAlignedBlock->xBlockSize = pxBlock->xBlockSize - xLeadSize;
+					pxAlignedBlock->xTag = tag;
+					pxAlignedBlock->pxPrevPhysBlock = pxBlock;
+					pxBlock->xBlockSize = xLeadSize;
+					heapNEXT_PHYS_BLOCK( pxAlignedBlock )->pxPrevPhysBlock = pxAlignedBlock;
+
+                                                #if (configENABLE_MEMORY_DEBUG == 1)
+                                                {
+                                                    mem_init_dog(pxBlock);
+                                                }
+                                                #endif
+
+					prvInsertFreeBlock( pxLists, pxBlock );
+					pxBlock = pxAlignedBlock;
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
+
+				pvReturn = prvUseBlock( pxLists, pxBlock, xWantedSize, tag );
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	traceMALLOC( pvReturn, xWantedSize );
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+/* Returns an allocated block to the free lists.  Must be called with
+xMallocMutex held, as the neighbours of a block that is freed look at its
+allocated bit. */
+static void prvHeapFree( BlockLink_t *pxLink )
+{
+	/* The block is being returned to the heap - it is no longer
+	allocated. */
+	pxLink->xBlockSize &= ~xBlockAllocatedBit;
+
+	/* Add this block to the list of free blocks. */
+	xFreeBytesRemaining += pxLink->xBlockSize;
+	traceFREE( ( ( uint8_t * ) pxLink ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN, pxLink->xBlockSize );
+	prvInsertBlockIntoFreeList( pxLink );
+}
+/*-----------------------------------------------------------*/
+
+#if( configHEAP_CORE_CACHE == 1 )
+
+/*
+ * Small requests are served from caches of blocks of a few fixed sizes, kept
+ * per core.  A core only touches its own cache, with interrupts masked, so no
+ * lock is taken on a hit.  On a miss a batch of blocks is taken from the heap
+ * under a single lock, and a cache list that gets full gives the older half
+ * of its blocks back in one go.  Cached blocks count as allocated in the heap.
+ */
+#define heapCACHE_MIN_SIZE		16
+#define heapCACHE_CLASS_COUNT	5
+#define heapCACHE_REFILL_COUNT	4
+#define heapCACHE_MAX_COUNT		16
+
+#define heapCACHE_DATA( pxBlock )	( ( void * ) ( ( ( uint8_t * ) ( pxBlock ) ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN ) )
+#define heapCACHE_BLOCK( pv )		( ( BlockLink_t * ) ( ( ( uint8_t * ) ( pv ) ) - ( uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN ) ) )
+
+typedef struct
+{
+	BlockLink_t *pxHead;			/*<< Cached blocks, linked through pxNextFreeBlock. */
+	UBaseType_t uxCount;
+} HeapCacheList_t;
+
+static HeapCacheList_t xCoreCache[ portNUM_PROCESSORS ][ heapCACHE_CLASS_COUNT ];
+
+/* Size of the blocks the heap hands out for each class. */
+static size_t xCacheBlockSize[ heapCACHE_CLASS_COUNT ];
+
+/* Returns the class serving xWantedSize bytes, heapCACHE_CLASS_COUNT if the
+request is too large to be cached. */
+static UBaseType_t prvCacheClass( size_t xWantedSize )
+{
+UBaseType_t uxClass = 0;
+
+	while( ( uxClass < heapCACHE_CLASS_COUNT ) && ( xWantedSize > ( ( size_t ) heapCACHE_MIN_SIZE << uxClass ) ) )
+	{
+		uxClass++;
+	}
+	return uxClass;
+}
+/*-----------------------------------------------------------*/
+
+static void prvCachePush( HeapCacheList_t *pxList, BlockLink_t *pxBlock )
+{
+	pxBlock->pxNextFreeBlock = pxList->pxHead;
+	pxList->pxHead = pxBlock;
+	pxList->uxCount++;
+}
+/*-----------------------------------------------------------*/
+
+/* Gives a chain of cached blocks back to the heap. */
+static void prvCacheRelease( BlockLink_t *pxBlock )
+{
+BlockLink_t *pxNext;
+
+	if( pxBlock == NULL )
+	{
+		return;
+	}
+
+	heapLOCK();
+	while( pxBlock != NULL )
+	{
+		pxNext = pxBlock->pxNextFreeBlock;
+		pxBlock->pxNextFreeBlock = NULL;
+		prvHeapFree( pxBlock );
+		pxBlock = pxNext;
+	}
+	heapUNLOCK();
+}
+/*-----------------------------------------------------------*/
+
+/* Empties the cache of the calling core. */
+static void prvCacheFlush( void )
+{
+BlockLink_t *pxHeads[ heapCACHE_CLASS_COUNT ];
+HeapCacheList_t *pxCache;
+UBaseType_t uxClass;
+unsigned uxState;
+
+	uxState = portENTER_CRITICAL_NESTED();
+	pxCache = xCoreCache[ xPortGetCoreID() ];
+	for( uxClass = 0; uxClass < heapCACHE_CLASS_COUNT; uxClass++ )
+	{
+		pxHeads[ uxClass ] = pxCache[ uxClass ].pxHead;
+		pxCache[ uxClass ].pxHead = NULL;
+		pxCache[ uxClass ].uxCount = 0;
+	}
+	portEXIT_CRITICAL_NESTED( uxState );
+
+	for( uxClass = 0; uxClass < heapCACHE_CLASS_COUNT; uxClass++ )
+	{
+		prvCacheRelease( pxHeads[ uxClass ] );
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void *prvCacheAllocate( UBaseType_t uxClass, BaseType_t tag )
+{
+HeapCacheList_t *pxList;
+BlockLink_t *pxBlock;
+void *pvBatch[ heapCACHE_REFILL_COUNT ];
+UBaseType_t uxCount, uxIndex;
+unsigned uxState;
+
+	uxState = portENTER_CRITICAL_NESTED();
+	pxList = &xCoreCache[ xPortGetCoreID() ][ uxClass ];
+	pxBlock = pxList->pxHead;
+	if( ( pxBlock != NULL ) && ( pxBlock->xTag == tag ) )
+	{
+		pxList->pxHead = pxBlock->pxNextFreeBlock;
+		pxList->uxCount--;
+		pxBlock->pxNextFreeBlock = NULL;
+		portEXIT_CRITICAL_NESTED( uxState );
+
+		traceMALLOC( heapCACHE_DATA( pxBlock ), xCacheBlockSize[ uxClass ] );
+		return heapCACHE_DATA( pxBlock );
+	}
+	portEXIT_CRITICAL_NESTED( uxState );
+
+	/* Nothing cached for this tag; take a batch of blocks from the heap. */
+	heapLOCK();
+	for( uxCount = 0; uxCount < heapCACHE_REFILL_COUNT; uxCount++ )
+	{
+		pvBatch[ uxCount ] = prvHeapAllocate( ( size_t ) heapCACHE_MIN_SIZE << uxClass, tag );
+		if( pvBatch[ uxCount ] == NULL )
+		{
+			break;
+		}
+	}
+	heapUNLOCK();
+
+	if( uxCount == 0 )
+	{
+		/* The heap is running out. Give back what this core holds on to, so
+		the caller can try to allocate the exact size from the heap. */
+		prvCacheFlush();
+		return NULL;
+	}
+
+	/* Keep all but the block that is returned. */
+	uxState = portENTER_CRITICAL_NESTED();
+	pxList = &xCoreCache[ xPortGetCoreID() ][ uxClass ];
+	for( uxIndex = 1; uxIndex < uxCount; uxIndex++ )
+	{
+		prvCachePush( pxList, heapCACHE_BLOCK( pvBatch[ uxIndex ] ) );
+	}
+	portEXIT_CRITICAL_NESTED( uxState );
+
+	return pvBatch[ 0 ];
+}
+/*-----------------------------------------------------------*/
+
+/* Puts a block that is freed into the cache of the calling core, if it has
+the size of one of the classes. Returns pdFALSE if it does not. */
+static BaseType_t prvCacheFree( BlockLink_t *pxLink )
+{
+HeapCacheList_t *pxList;
+BlockLink_t *pxBlock, *pxDrain = NULL;
+UBaseType_t uxClass, uxIndex;
+unsigned uxState;
+
+	for( uxClass = 0; uxClass < heapCACHE_CLASS_COUNT; uxClass++ )
+	{
+		if( ( pxLink->xBlockSize & ~xBlockAllocatedBit ) == xCacheBlockSize[ uxClass ] )
+		{
+			break;
+		}
+	}
 
-/* The size of the structure placed at the beginning of each allocated memory
-block must by correctly byte aligned. */
-static const uint32_t uxHeapStructSize	= ( ( sizeof ( BlockLink_t ) + BLOCK_HEAD_LEN + BLOCK_TAIL_LEN + ( portBYTE_ALIGNMENT - 1 ) ) & ~portBYTE_ALIGNMENT_MASK );
+	if( uxClass == heapCACHE_CLASS_COUNT )
+	{
+		return pdFALSE;
+	}
 
-/* Create a couple of list links to mark the start and end of the list. */
-static BlockLink_t xStart, *pxEnd = NULL;
+	traceFREE( heapCACHE_DATA( pxLink ), xCacheBlockSize[ uxClass ] );
 
-/* Keeps track of the number of free bytes remaining, but says nothing about
-fragmentation. */
-static size_t xFreeBytesRemaining = 0;
-static size_t xMinimumEverFreeBytesRemaining = 0;
+	uxState = portENTER_CRITICAL_NESTED();
+	pxList = &xCoreCache[ xPortGetCoreID() ][ uxClass ];
+	prvCachePush( pxList, pxLink );
+	if( pxList->uxCount > heapCACHE_MAX_COUNT )
+	{
+		/* Keep the blocks freed last, hand the older half back. */
+		pxBlock = pxList->pxHead;
+		for( uxIndex = 1; uxIndex < heapCACHE_MAX_COUNT / 2; uxIndex++ )
+		{
+			pxBlock = pxBlock->pxNextFreeBlock;
+		}
+		pxDrain = pxBlock->pxNextFreeBlock;
+		pxBlock->pxNextFreeBlock = NULL;
+		pxList->uxCount = heapCACHE_MAX_COUNT / 2;
+	}
+	portEXIT_CRITICAL_NESTED( uxState );
 
-/* Gets set to the top bit of an size_t type.  When this bit in the xBlockSize
-member of an BlockLink_t structure is set then the block belongs to the
-application.  When the bit is free the block is still part of the free heap
-space. */
-static size_t xBlockAllocatedBit = 0;
+	prvCacheRelease( pxDrain );
 
+	return pdTRUE;
+}
 /*-----------------------------------------------------------*/
 
+#endif /* configHEAP_CORE_CACHE */
+
 void *pvPortMallocTagged( size_t xWantedSize, BaseType_t tag )
 {
-BlockLink_t *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
 void *pvReturn = NULL;
 
 	/* The heap must be initialised before the first call to
 	prvPortMalloc(). */
 	configASSERT( pxEnd );
 
-	taskENTER_CRITICAL(&xMallocMutex);
+	#if( configHEAP_CORE_CACHE == 1 )
 	{
-		/* Check the requested block size is not so large that the top bit is
-		set.  The top bit of the block size member of the BlockLink_t structure
-		is used to determine who owns the block - the application or the
-		kernel, so it must be free. */
-		if( ( xWantedSize & xBlockAllocatedBit ) == 0 )
+		UBaseType_t uxClass = prvCacheClass( xWantedSize );
+
+		if( ( xWantedSize > 0 ) && ( uxClass < heapCACHE_CLASS_COUNT ) && ( prvGetTagLists( tag ) != NULL ) )
 		{
-			/* The wanted size is increased so it can contain a BlockLink_t
-			structure in addition to the requested amount of bytes. */
-			if( xWantedSize > 0 )
-			{
-				xWantedSize += uxHeapStructSize;
+			pvReturn = prvCacheAllocate( uxClass, tag );
+		}
+	}
+	#endif
 
-				/* Ensure that blocks are always aligned to the required number
-				of bytes. */
-				if( ( xWantedSize & portBYTE_ALIGNMENT_MASK ) != 0x00 )
-				{
-					/* Byte alignment required. */
-					xWantedSize += ( portBYTE_ALIGNMENT - ( xWantedSize & portBYTE_ALIGNMENT_MASK ) );
-				}
-				else
-				{
-					mtCOVERAGE_TEST_MARKER();
-				}
+	if( pvReturn == NULL )
+	{
+		heapLOCK();
+		pvReturn = prvHeapAllocate( xWantedSize, tag );
+		heapUNLOCK();
+	}
+
+	#if( configHEAP_STATS == 1 )
+	{
+		if( prvGetTagLists( tag ) != NULL )
+		{
+			if( pvReturn != NULL )
+			{
+				heapCOUNT( tag, ulAllocations );
 			}
 			else
 			{
-				mtCOVERAGE_TEST_MARKER();
+				heapCOUNT( tag, ulFailures );
 			}
+		}
+	}
+	#endif
 
-			if( ( xWantedSize > 0 ) && ( xWantedSize <= xFreeBytesRemaining ) )
-			{
-				/* Traverse the list from the start	(lowest address) block until
-				one	of adequate size is found. */
-				pxPreviousBlock = &xStart;
-				pxBlock = xStart.pxNextFreeBlock;
-				while( ( ( pxBlock->xTag != tag ) ||  ( pxBlock->xBlockSize < xWantedSize ) ) && ( pxBlock->pxNextFreeBlock != NULL ) )
-				{
-//					ets_printf("Block %x -> %x\n", (uint32_t)pxBlock, (uint32_t)pxBlock->pxNextFreeBlock);
+	heapTRACE_ALLOC( pvReturn, xWantedSize );
 
-                                        #if (configENABLE_MEMORY_DEBUG == 1)
-                                        {
-                                            mem_check_block(pxBlock);
-                                        }
-                                        #endif
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+	{
+		if( pvReturn == NULL )
+		{
+			extern void vApplicationMallocFailedHook( void );
+			vApplicationMallocFailedHook();
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	#endif
 
-					pxPreviousBlock = pxBlock;
-					pxBlock = pxBlock->pxNextFreeBlock;
-				}
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
 
-				/* If the end marker was not reached then a block of adequate size
-				was found. */
-				if( pxBlock != pxEnd )
-				{
-					/* Return the memory space pointed to - jumping over the
-					BlockLink_t structure at its start. */
-					pvReturn = ( void * ) ( ( ( uint8_t * ) pxPreviousBlock->pxNextFreeBlock ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN);
-
-					/* This block is being returned for use so must be taken out
-					of the list of free blocks. */
-					pxPreviousBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
-
-					/* If the block is larger than required it can be split into
-					two. */
-
-					if( ( pxBlock->xBlockSize - xWantedSize ) > heapMINIMUM_BLOCK_SIZE )
-					{
-						/* This block is to be split into two.  Create a new
-						block following the number of bytes requested. The void
-						cast is used to prevent byte alignment warnings from the
-						compiler. */
-						pxNewBlockLink = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xWantedSize);
-
-						/* Calculate the sizes of two blocks split from the
-						single block. */
-						pxNewBlockLink->xBlockSize = pxBlock->xBlockSize - xWantedSize;
-						pxNewBlockLink->xTag = tag;
-						pxBlock->xBlockSize = xWantedSize;
+void *pvPortMallocTaggedAligned( size_t xWantedSize, size_t xAlignment, BaseType_t tag )
+{
+void *pvReturn;
 
-                                                #if (configENABLE_MEMORY_DEBUG == 1)
-                                                {
-                                                    mem_init_dog(pxNewBlockLink);
-                                                }
-                                                #endif
+	/* The heap must be initialised before the first call to
+	prvPortMalloc(). */
+	configASSERT( pxEnd );
+	configASSERT( ( xAlignment & ( xAlignment - 1 ) ) == 0 );
 
+	if( xAlignment <= portBYTE_ALIGNMENT )
+	{
+		/* Every allocation is aligned this well. */
+		return pvPortMallocTagged( xWantedSize, tag );
+	}
 
-						/* Insert the new block into the list of free blocks. */
-						prvInsertBlockIntoFreeList( ( pxNewBlockLink ) );
-					}
-					else
-					{
-						mtCOVERAGE_TEST_MARKER();
-					}
-
-					xFreeBytesRemaining -= pxBlock->xBlockSize;
-
-					if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
-					{
-						xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
-					}
-					else
-					{
-						mtCOVERAGE_TEST_MARKER();
-					}
-
-					/* The block is being returned - it is allocated and owned
-					by the application and has no "next" block. */
-					pxBlock->xBlockSize |= xBlockAllocatedBit;
-					pxBlock->pxNextFreeBlock = NULL;
-
-                                        #if (configENABLE_MEMORY_DEBUG == 1)
-                                        {
-                                            mem_init_dog(pxBlock);
-                                            mem_malloc_block(pxBlock);
-                                        }
-                                        #endif
-				}
-				else
-				{
-					mtCOVERAGE_TEST_MARKER();
-				}
+	heapLOCK();
+	pvReturn = prvHeapAllocateAligned( xWantedSize, xAlignment, tag );
+	heapUNLOCK();
+
+	#if( configHEAP_STATS == 1 )
+	{
+		if( prvGetTagLists( tag ) != NULL )
+		{
+			if( pvReturn != NULL )
+			{
+				heapCOUNT( tag, ulAllocations );
 			}
 			else
 			{
-				mtCOVERAGE_TEST_MARKER();
+				heapCOUNT( tag, ulFailures );
 			}
 		}
-		else
-		{
-			mtCOVERAGE_TEST_MARKER();
-		}
-
-		traceMALLOC( pvReturn, xWantedSize );
 	}
-	taskEXIT_CRITICAL(&xMallocMutex);
+	#endif
+
+	heapTRACE_ALLOC( pvReturn, xWantedSize );
 
 	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
 	{
@@ -354,6 +1053,21 @@ void *pvReturn = NULL;
 }
 /*-----------------------------------------------------------*/
 
+void vPortAddHeapRegionTagged( const HeapRegionTagged_t * const pxHeapRegion )
+{
+size_t xRegionSize;
+
+	/* The heap must have been defined, and the region must have a tag. */
+	configASSERT( pxEnd );
+	configASSERT( ( pxHeapRegion->xTag >= 0 ) && ( pxHeapRegion->xTag < heapMAX_TAGS ) );
+
+	heapLOCK();
+	xRegionSize = prvAddRegion( pxHeapRegion );
+	xFreeBytesRemaining += xRegionSize;
+	heapUNLOCK();
+}
+/*-----------------------------------------------------------*/
+
 void vPortFree( void *pv )
 {
 uint8_t *puc = ( uint8_t * ) pv;
@@ -361,6 +1075,8 @@ BlockLink_t *pxLink;
 
 	if( pv != NULL )
 	{
+		heapTRACE_FREE( pv );
+
 		/* The memory being freed will have an BlockLink_t structure immediately
 		before it. */
 		puc -= (uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN) ;
@@ -370,10 +1086,10 @@ BlockLink_t *pxLink;
 
                 #if (configENABLE_MEMORY_DEBUG == 1)
                 {
-                    taskENTER_CRITICAL(&xMallocMutex);
+                    heapLOCK();
                     mem_check_block(pxLink);
                     mem_free_block(pxLink);
-                    taskEXIT_CRITICAL(&xMallocMutex);
+                    heapUNLOCK();
                 }
                 #endif
 
@@ -385,18 +1101,16 @@ BlockLink_t *pxLink;
 		{
 			if( pxLink->pxNextFreeBlock == NULL )
 			{
-				/* The block is being returned to the heap - it is no longer
-				allocated. */
-				pxLink->xBlockSize &= ~xBlockAllocatedBit;
+				heapCOUNT( pxLink->xTag, ulFrees );
 
-				taskENTER_CRITICAL(&xMallocMutex);
+				#if( configHEAP_CORE_CACHE == 1 )
+				if( prvCacheFree( pxLink ) == pdFALSE )
+				#endif
 				{
-					/* Add this block to the list of free blocks. */
-					xFreeBytesRemaining += pxLink->xBlockSize;
-					traceFREE( pv, pxLink->xBlockSize );
-					prvInsertBlockIntoFreeList( ( ( BlockLink_t * ) pxLink ) );
+					heapLOCK();
+					prvHeapFree( pxLink );
+					heapUNLOCK();
 				}
-				taskEXIT_CRITICAL(&xMallocMutex);
 			}
 			else
 			{
@@ -411,6 +1125,130 @@ BlockLink_t *pxLink;
 }
 /*-----------------------------------------------------------*/
 
+BaseType_t xPortReallocInPlace( void *pv, size_t xWantedSize )
+{
+BlockLink_t *pxLink, *pxNext, *pxNewBlockLink;
+HeapTagLists_t *pxLists;
+size_t xBlockSize;
+BaseType_t xReturn = pdFALSE;
+#if( configHEAP_TRACE == 1 )
+size_t xRequestedSize = xWantedSize;
+#endif
+
+	configASSERT( pv != NULL );
+
+	/* The memory will have an BlockLink_t structure immediately before it. */
+	pxLink = ( void * ) ( ( ( uint8_t * ) pv ) - ( uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN ) );
+
+	/* Check the block is actually allocated. */
+	configASSERT( ( pxLink->xBlockSize & xBlockAllocatedBit ) != 0 );
+	configASSERT( pxLink->pxNextFreeBlock == NULL );
+
+	if( ( xWantedSize == 0 ) || ( ( xWantedSize & xBlockAllocatedBit ) != 0 ) )
+	{
+		return pdFALSE;
+	}
+
+	xWantedSize = prvGetBlockSize( xWantedSize );
+	pxLists = prvGetTagLists( pxLink->xTag );
+
+	heapLOCK();
+	{
+		xBlockSize = pxLink->xBlockSize & ~xBlockAllocatedBit;
+		pxNext = heapNEXT_PHYS_BLOCK( pxLink );
+
+		if( xWantedSize <= xBlockSize )
+		{
+			/* Shrinking, or growing within the slack the block already has. */
+			xReturn = pdTRUE;
+		}
+		else if( ( pxNext->xBlockSize != 0 ) && ( ( pxNext->xBlockSize & xBlockAllocatedBit ) == 0 ) &&
+				 ( pxNext->xTag == pxLink->xTag ) && ( xBlockSize + pxNext->xBlockSize >= xWantedSize ) )
+		{
+			/* Growing into the free block that follows this one. */
+			prvRemoveFreeBlock( pxLists, pxNext );
+			xFreeBytesRemaining -= pxNext->xBlockSize;
+			xBlockSize += pxNext->xBlockSize;
+			pxLink->xBlockSize = xBlockSize | xBlockAllocatedBit;
+			heapNEXT_PHYS_BLOCK( pxLink )->pxPrevPhysBlock = pxLink;
+			xReturn = pdTRUE;
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+
+		if( xReturn != pdFALSE )
+		{
+			/* Give the part that is not needed back to the heap, if it is
+			large enough to make a block of its own. */
+			if( ( xBlockSize - xWantedSize ) > heapMINIMUM_BLOCK_SIZE )
+			{
+				pxNewBlockLink = ( void * ) ( ( ( uint8_t * ) pxLink ) + xWantedSize );
+				pxNewBlockLink->xBlockSize = xBlockSize - xWantedSize;
+				pxNewBlockLink->xTag = pxLink->xTag;
+				pxNewBlockLink->pxPrevPhysBlock = pxLink;
+				pxNewBlockLink->pxNextFreeBlock = NULL;
+				heapNEXT_PHYS_BLOCK( pxNewBlockLink )->pxPrevPhysBlock = pxNewBlockLink;
+				pxLink->xBlockSize = xWantedSize | xBlockAllocatedBit;
+
+                                #if (configENABLE_MEMORY_DEBUG == 1)
+                                {
+                                    mem_init_dog(pxNewBlockLink);
+                                }
+                                #endif
+
+				/* The remainder can be merged with the block after it. */
+				xFreeBytesRemaining += pxNewBlockLink->xBlockSize;
+				prvInsertBlockIntoFreeList( pxNewBlockLink );
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+
+			if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+			{
+				xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+
+                        #if (configENABLE_MEMORY_DEBUG == 1)
+                        {
+                            /* The tail guard moves with the end of the block. */
+                            mem_init_dog(pxLink);
+                        }
+                        #endif
+		}
+	}
+	heapUNLOCK();
+
+	#if( configHEAP_TRACE == 1 )
+	{
+		if( xReturn != pdFALSE )
+		{
+			vPortHeapTraceResize( pv, xRequestedSize );
+		}
+	}
+	#endif
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetAllocatedSize( void *pv )
+{
+BlockLink_t *pxLink = ( void * ) ( ( ( uint8_t * ) pv ) - ( uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN ) );
+
+	configASSERT( ( pxLink->xBlockSize & xBlockAllocatedBit ) != 0 );
+
+	return ( pxLink->xBlockSize & ~xBlockAllocatedBit ) - uxHeapStructSize;
+}
+/*-----------------------------------------------------------*/
+
 size_t xPortGetFreeHeapSize( void )
 {
 	return xFreeBytesRemaining;
@@ -423,167 +1261,250 @@ size_t xPortGetMinimumEverFreeHeapSize( void )
 }
 /*-----------------------------------------------------------*/
 
-static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert )
+BaseType_t xPortGetHeapStatsTagged( BaseType_t xTag, HeapStats_t *pxStats )
 {
-BlockLink_t *pxIterator;
-uint8_t *puc;
+HeapTagLists_t *pxLists = prvGetTagLists( xTag );
+BlockLink_t *pxBlock;
+UBaseType_t uxFl, uxSl;
+
+	if( pxLists == NULL )
+	{
+		return pdFALSE;
+	}
+
+	memset( pxStats, 0, sizeof( HeapStats_t ) );
 
-	/* Iterate through the list until a block is found that has a higher address
-	than the block being inserted. */
-	for( pxIterator = &xStart; pxIterator->pxNextFreeBlock < pxBlockToInsert; pxIterator = pxIterator->pxNextFreeBlock )
+	/* Walk all free blocks of the tag.  This holds the heap lock for a time
+	proportional to the number of free blocks, so it is meant for diagnostics,
+	not for every allocation. */
+	heapLOCK();
+	for( uxFl = 0; uxFl < heapFL_COUNT; uxFl++ )
 	{
-		/* Nothing to do here, just iterate to the right position. */
+		if( ( pxLists->ulFlBitmap & ( 1UL << uxFl ) ) == 0 )
+		{
+			continue;
+		}
+
+		for( uxSl = 0; uxSl < heapSL_COUNT; uxSl++ )
+		{
+			for( pxBlock = pxLists->pxFreeLists[ uxFl ][ uxSl ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+			{
+				pxStats->xFreeBytes += pxBlock->xBlockSize;
+				pxStats->xFreeBlocks++;
+				pxStats->xFreeBlockHistogram[ uxFl ]++;
+				if( pxBlock->xBlockSize > pxStats->xLargestFreeBlock )
+				{
+					pxStats->xLargestFreeBlock = pxBlock->xBlockSize;
+				}
+			}
+		}
 	}
+	heapUNLOCK();
 
-	/* Do the block being inserted, and the block it is being inserted after
-	make a contiguous block of memory, and are the tags the same? */
-	puc = ( uint8_t * ) pxIterator;
-	if( ( puc + pxIterator->xBlockSize ) == ( uint8_t * ) pxBlockToInsert && pxBlockToInsert->xTag==pxIterator->xTag)
+	/* Report the largest block as the largest allocation it can serve. */
+	if( pxStats->xLargestFreeBlock > uxHeapStructSize )
 	{
-		pxIterator->xBlockSize += pxBlockToInsert->xBlockSize;
-		pxBlockToInsert = pxIterator;
+		pxStats->xLargestFreeBlock -= uxHeapStructSize;
 	}
 	else
 	{
-		mtCOVERAGE_TEST_MARKER();
+		pxStats->xLargestFreeBlock = 0;
 	}
 
-	/* Do the block being inserted, and the block it is being inserted before
-	make a contiguous block of memory, and are the tags the same */
-	puc = ( uint8_t * ) pxBlockToInsert;
-	if( ( puc + pxBlockToInsert->xBlockSize ) == ( uint8_t * ) pxIterator->pxNextFreeBlock && pxBlockToInsert->xTag==pxIterator->pxNextFreeBlock->xTag )
+	#if( configHEAP_STATS == 1 )
 	{
-		if( pxIterator->pxNextFreeBlock != pxEnd )
-		{
-			/* Form one big block from the two blocks. */
-			pxBlockToInsert->xBlockSize += pxIterator->pxNextFreeBlock->xBlockSize;
-			pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock->pxNextFreeBlock;
-		}
-		else
+	UBaseType_t uxCore;
+
+		for( uxCore = 0; uxCore < portNUM_PROCESSORS; uxCore++ )
 		{
-			pxBlockToInsert->pxNextFreeBlock = pxEnd;
+			pxStats->ulAllocations += xHeapCounters[ uxCore ][ xTag ].ulAllocations;
+			pxStats->ulFrees += xHeapCounters[ uxCore ][ xTag ].ulFrees;
+			pxStats->ulFailures += xHeapCounters[ uxCore ][ xTag ].ulFailures;
 		}
 	}
+	#endif
+
+	pxStats->xTickCount = xTaskGetTickCount();
+
+	return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+#if( configHEAP_STATS == 1 )
+
+void vPortGetHeapLockStats( HeapLockStats_t *pxStats )
+{
+	heapLOCK();
+	*pxStats = xLockStats;
+	heapUNLOCK();
+}
+/*-----------------------------------------------------------*/
+
+#endif /* configHEAP_STATS */
+
+static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert )
+{
+HeapTagLists_t *pxLists = prvGetTagLists( pxBlockToInsert->xTag );
+BlockLink_t *pxNeighbour;
+
+	/* Is the block after the one being inserted free, and are the tags the
+	same? End markers have a size of zero and are never merged. */
+	pxNeighbour = heapNEXT_PHYS_BLOCK( pxBlockToInsert );
+	if( ( pxNeighbour->xBlockSize != 0 ) && ( ( pxNeighbour->xBlockSize & xBlockAllocatedBit ) == 0 ) && pxNeighbour->xTag == pxBlockToInsert->xTag )
+	{
+		/* Form one big block from the two blocks. */
+		prvRemoveFreeBlock( pxLists, pxNeighbour );
+		pxBlockToInsert->xBlockSize += pxNeighbour->xBlockSize;
+		heapNEXT_PHYS_BLOCK( pxBlockToInsert )->pxPrevPhysBlock = pxBlockToInsert;
+	}
 	else
 	{
-		pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock;
+		mtCOVERAGE_TEST_MARKER();
 	}
 
-	/* If the block being inserted plugged a gap, so was merged with the block
-	before and the block after, then it's pxNextFreeBlock pointer will have
-	already been set, and should not be set here as that would make it point
-	to itself. */
-	if( pxIterator != pxBlockToInsert )
+	/* Is the block before the one being inserted free, and are the tags the
+	same? */
+	pxNeighbour = pxBlockToInsert->pxPrevPhysBlock;
+	if( ( pxNeighbour != NULL ) && ( ( pxNeighbour->xBlockSize & xBlockAllocatedBit ) == 0 ) && pxNeighbour->xTag == pxBlockToInsert->xTag )
 	{
-		pxIterator->pxNextFreeBlock = pxBlockToInsert;
+		prvRemoveFreeBlock( pxLists, pxNeighbour );
+		pxNeighbour->xBlockSize += pxBlockToInsert->xBlockSize;
+		heapNEXT_PHYS_BLOCK( pxNeighbour )->pxPrevPhysBlock = pxNeighbour;
+		pxBlockToInsert = pxNeighbour;
 	}
 	else
 	{
 		mtCOVERAGE_TEST_MARKER();
 	}
+
+	prvInsertFreeBlock( pxLists, pxBlockToInsert );
 }
 /*-----------------------------------------------------------*/
 
-void vPortDefineHeapRegionsTagged( const HeapRegionTagged_t * const pxHeapRegions )
+/* Turns the memory of a region into a single free block followed by an end
+marker, and links it behind the last region of the heap.  The first region of
+a tag also holds the free lists of the tag.  Returns the size of the free
+block.  Must be called with xMallocMutex held once the heap is in use. */
+static size_t prvAddRegion( const HeapRegionTagged_t * const pxHeapRegion )
 {
-BlockLink_t *pxFirstFreeBlockInRegion = NULL, *pxPreviousFreeBlock;
+BlockLink_t *pxFirstFreeBlockInRegion, *pxPreviousFreeBlock;
 uint8_t *pucAlignedHeap;
-size_t xTotalRegionSize, xTotalHeapSize = 0;
-BaseType_t xDefinedRegions = 0, xRegIdx = 0;
-uint32_t ulAddress;
-const HeapRegionTagged_t *pxHeapRegion;
+size_t xTotalRegionSize;
+size_t xListsSize = ( sizeof( HeapTagLists_t ) + portBYTE_ALIGNMENT_MASK ) & ~portBYTE_ALIGNMENT_MASK;
+uint32_t ulAddress, *pulWord;
 
-	/* Can only call once! */
-	configASSERT( pxEnd == NULL );
+	xTotalRegionSize = pxHeapRegion->xSizeInBytes;
 
-	vPortCPUInitializeMutex(&xMallocMutex);
+	/* Ensure the heap region starts on a correctly aligned boundary. */
+	ulAddress = ( uint32_t ) pxHeapRegion->pucStartAddress;
+	if( ( ulAddress & portBYTE_ALIGNMENT_MASK ) != 0 )
+	{
+		ulAddress += ( portBYTE_ALIGNMENT - 1 );
+		ulAddress &= ~portBYTE_ALIGNMENT_MASK;
 
-	pxHeapRegion = &( pxHeapRegions[ xRegIdx ] );
+		/* Adjust the size for the bytes lost to alignment. */
+		xTotalRegionSize -= ulAddress - ( uint32_t ) pxHeapRegion->pucStartAddress;
+	}
 
-	while( pxHeapRegion->xSizeInBytes > 0 )
-	{
-		if ( pxHeapRegion->xTag == -1 ) {
-			/* Move onto the next HeapRegionTagged_t structure. */
-			xRegIdx++;
-			pxHeapRegion = &( pxHeapRegions[ xRegIdx ] );
-			continue;
-		}
+	pucAlignedHeap = ( uint8_t * ) ulAddress;
 
-		xTotalRegionSize = pxHeapRegion->xSizeInBytes;
+	/* The first region with a tag holds the free lists of that tag.  They are
+	cleared a word at a time, as the region may not allow byte accesses. */
+	if( pxTagLists[ pxHeapRegion->xTag ] == NULL )
+	{
+		configASSERT( xTotalRegionSize > xListsSize + ( heapMINIMUM_BLOCK_SIZE << 1 ) );
 
-		/* Ensure the heap region starts on a correctly aligned boundary. */
-		ulAddress = ( uint32_t ) pxHeapRegion->pucStartAddress;
-		if( ( ulAddress & portBYTE_ALIGNMENT_MASK ) != 0 )
+		for( pulWord = ( uint32_t * ) pucAlignedHeap; pulWord < ( uint32_t * ) ( pucAlignedHeap + xListsSize ); pulWord++ )
 		{
-			ulAddress += ( portBYTE_ALIGNMENT - 1 );
-			ulAddress &= ~portBYTE_ALIGNMENT_MASK;
-
-			/* Adjust the size for the bytes lost to alignment. */
-			xTotalRegionSize -= ulAddress - ( uint32_t ) pxHeapRegion->pucStartAddress;
+			*pulWord = 0;
 		}
+		pxTagLists[ pxHeapRegion->xTag ] = ( HeapTagLists_t * ) pucAlignedHeap;
+		pucAlignedHeap += xListsSize;
+		xTotalRegionSize -= xListsSize;
+	}
 
-		pucAlignedHeap = ( uint8_t * ) ulAddress;
+	/* Remember the location of the end marker in the previous region, if
+	any. */
+	pxPreviousFreeBlock = pxEnd;
+
+	/* pxEnd is used to mark the end of the blocks in this region and is
+	inserted at the end of the region space. */
+	ulAddress = ( ( uint32_t ) pucAlignedHeap ) + xTotalRegionSize;
+	ulAddress -= uxHeapStructSize;
+	ulAddress &= ~portBYTE_ALIGNMENT_MASK;
+	pxEnd = ( BlockLink_t * ) (ulAddress + BLOCK_HEAD_LEN);
+	pxEnd->xBlockSize = 0;
+	pxEnd->pxNextFreeBlock = NULL;
+	pxEnd->xTag = -1;
+
+	/* To start with there is a single free block in this region that is
+	sized to take up the entire heap region minus the space taken by the
+	free block structure. */
+	pxFirstFreeBlockInRegion = ( BlockLink_t * ) (pucAlignedHeap + BLOCK_HEAD_LEN);
+	pxFirstFreeBlockInRegion->xBlockSize = ulAddress - ( uint32_t ) pxFirstFreeBlockInRegion + BLOCK_HEAD_LEN;
+	pxFirstFreeBlockInRegion->xTag=pxHeapRegion->xTag;
+	pxFirstFreeBlockInRegion->pxPrevPhysBlock = NULL;
+	pxEnd->pxPrevPhysBlock = pxFirstFreeBlockInRegion;
+	prvInsertFreeBlock( pxTagLists[ pxHeapRegion->xTag ], pxFirstFreeBlockInRegion );
+
+	/* Link the previous region to this region, or, if this is the first
+	region, point xStart to it. */
+	if( pxPreviousFreeBlock != NULL )
+	{
+		pxPreviousFreeBlock->pxNextFreeBlock = pxFirstFreeBlockInRegion;
+	}
+	else
+	{
+		/* xStart is used to hold a pointer to the first block of the
+		heap. */
+		xStart.pxNextFreeBlock = pxFirstFreeBlockInRegion;
+		xStart.xBlockSize = ( size_t ) 0;
+	}
 
-		/* Set xStart if it has not already been set. */
-		if( xDefinedRegions == 0 )
-		{
-			/* xStart is used to hold a pointer to the first item in the list of
-			free blocks.  The void cast is used to prevent compiler warnings. */
-			xStart.pxNextFreeBlock = ( BlockLink_t * ) (pucAlignedHeap + BLOCK_HEAD_LEN);
-			xStart.xBlockSize = ( size_t ) 0;
-		}
-		else
-		{
-			/* Should only get here if one region has already been added to the
-			heap. */
-			configASSERT( pxEnd != NULL );
+            #if (configENABLE_MEMORY_DEBUG == 1)
+            {
+                mem_init_dog(pxFirstFreeBlockInRegion);
+                mem_init_dog(pxEnd);
+            }
+            #endif
 
-			/* Check blocks are passed in with increasing start addresses. */
-			configASSERT( ulAddress > ( uint32_t ) pxEnd );
-		}
+	return pxFirstFreeBlockInRegion->xBlockSize;
+}
+/*-----------------------------------------------------------*/
+
+void vPortDefineHeapRegionsTagged( const HeapRegionTagged_t * const pxHeapRegions )
+{
+size_t xTotalHeapSize = 0;
+BaseType_t xRegIdx = 0;
+const HeapRegionTagged_t *pxHeapRegion;
+
+	/* Can only call once! */
+	configASSERT( pxEnd == NULL );
 
-		/* Remember the location of the end marker in the previous region, if
-		any. */
-		pxPreviousFreeBlock = pxEnd;
+	vPortCPUInitializeMutex(&xMallocMutex);
 
-		/* pxEnd is used to mark the end of the list of free blocks and is
-		inserted at the end of the region space. */
-		ulAddress = ( ( uint32_t ) pucAlignedHeap ) + xTotalRegionSize;
-		ulAddress -= uxHeapStructSize;
-		ulAddress &= ~portBYTE_ALIGNMENT_MASK;
-		pxEnd = ( BlockLink_t * ) (ulAddress + BLOCK_HEAD_LEN);
-		pxEnd->xBlockSize = 0;
-		pxEnd->pxNextFreeBlock = NULL;
-		pxEnd->xTag = -1;
+	/* Work out the position of the top bit in a size_t variable. */
+	xBlockAllocatedBit = ( ( size_t ) 1 ) << ( ( sizeof( size_t ) * heapBITS_PER_BYTE ) - 1 );
 
-		/* To start with there is a single free block in this region that is
-		sized to take up the entire heap region minus the space taken by the
-		free block structure. */
-		pxFirstFreeBlockInRegion = ( BlockLink_t * ) (pucAlignedHeap + BLOCK_HEAD_LEN);
-		pxFirstFreeBlockInRegion->xBlockSize = ulAddress - ( uint32_t ) pxFirstFreeBlockInRegion + BLOCK_HEAD_LEN;
-		pxFirstFreeBlockInRegion->pxNextFreeBlock = pxEnd;
-		pxFirstFreeBlockInRegion->xTag=pxHeapRegion->xTag;
+	pxHeapRegion = &( pxHeapRegions[ xRegIdx ] );
 
-		/* If this is not the first region that makes up the entire heap space
-		then link the previous region to this region. */
-		if( pxPreviousFreeBlock != NULL )
-		{
-			pxPreviousFreeBlock->pxNextFreeBlock = pxFirstFreeBlockInRegion;
+	while( pxHeapRegion->xSizeInBytes > 0 )
+	{
+		if ( pxHeapRegion->xTag < 0 || pxHeapRegion->xTag >= heapMAX_TAGS ) {
+			/* Tag -1 disables the region, other tags must have free lists. */
+			configASSERT( pxHeapRegion->xTag == -1 );
 		}
+		else
+		{
+			/* Check blocks are passed in with increasing start addresses. */
+			configASSERT( ( pxEnd == NULL ) || ( ( uint32_t ) pxHeapRegion->pucStartAddress > ( uint32_t ) pxEnd ) );
 
-		xTotalHeapSize += pxFirstFreeBlockInRegion->xBlockSize;
+			xTotalHeapSize += prvAddRegion( pxHeapRegion );
+		}
 
 		/* Move onto the next HeapRegionTagged_t structure. */
-		xDefinedRegions++;
 		xRegIdx++;
 		pxHeapRegion = &( pxHeapRegions[ xRegIdx ] );
-
-                #if (configENABLE_MEMORY_DEBUG == 1)
-                {
-                    mem_init_dog(pxFirstFreeBlockInRegion);
-                    mem_init_dog(pxEnd);
-                }
-                #endif
 	}
 
 	xMinimumEverFreeBytesRemaining = xTotalHeapSize;
@@ -592,8 +1513,16 @@ const HeapRegionTagged_t *pxHeapRegion;
 	/* Check something was actually defined before it is accessed. */
 	configASSERT( xTotalHeapSize );
 
-	/* Work out the position of the top bit in a size_t variable. */
-	xBlockAllocatedBit = ( ( size_t ) 1 ) << ( ( sizeof( size_t ) * heapBITS_PER_BYTE ) - 1 );
+	#if( configHEAP_CORE_CACHE == 1 )
+	{
+		UBaseType_t uxClass;
+
+		for( uxClass = 0; uxClass < heapCACHE_CLASS_COUNT; uxClass++ )
+		{
+			xCacheBlockSize[ uxClass ] = prvGetBlockSize( ( size_t ) heapCACHE_MIN_SIZE << uxClass );
+		}
+	}
+	#endif
 
         #if (configENABLE_MEMORY_DEBUG == 1)
         {
@@ -602,4 +1531,3 @@ const HeapRegionTagged_t *pxHeapRegion;
         }
         #endif
 }
-
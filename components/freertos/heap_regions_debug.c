@@ -64,6 +64,49 @@ void mem_debug_malloc_show(void)
     taskEXIT_CRITICAL(g_malloc_mutex);
 }
 
+/* Print the bytes and blocks each task has allocated and not freed yet.
+Tasks are told apart by the first three characters of their name, as kept in
+the block head; tasks beyond DEBUG_MAX_TASK_NUM are summed up as "*". */
+void mem_debug_task_usage(void)
+{
+    struct {
+        char task[4];
+        size_t bytes;
+        uint32_t blocks;
+    } usage[DEBUG_MAX_TASK_NUM + 1];
+    os_block_t *b;
+    debug_block_t *d;
+    int i, n = 0;
+
+    memset(usage, 0, sizeof(usage));
+    strcpy(usage[DEBUG_MAX_TASK_NUM].task, "*");
+
+    taskENTER_CRITICAL(g_malloc_mutex);
+    for (b = g_malloc_list.next; b; b = b->next){
+        d = DEBUG_BLOCK(b);
+        for (i=0; i<n; i++){
+            if (strncmp(usage[i].task, d->head.task, 3) == 0) break;
+        }
+        if (i == n){
+            if (n < DEBUG_MAX_TASK_NUM){
+                strncpy(usage[n].task, d->head.task, 3);
+                n++;
+            } else {
+                i = DEBUG_MAX_TASK_NUM;
+            }
+        }
+        usage[i].bytes += b->size&(~g_alloc_bit);
+        usage[i].blocks++;
+    }
+    taskEXIT_CRITICAL(g_malloc_mutex);
+
+    for (i=0; i<=DEBUG_MAX_TASK_NUM; i++){
+        if (usage[i].blocks){
+            ets_printf("t=%s s=%u n=%u\n", usage[i].task, usage[i].bytes, usage[i].blocks);
+        }
+    }
+}
+
 void mem_debug_show(void)
 {
     uint32_t i;
@@ -125,10 +168,18 @@ void mem_check_all(void* pv)
 
     taskENTER_CRITICAL(g_malloc_mutex);
     b = g_free_list->next;
-    while(b && b != g_end){
+    /* Regions added at run time are linked behind g_end, so walk up to the
+       end marker of the last region instead, which links to nothing */
+    while(b){
         mem_check_block(b);
         ets_printf("check b=%p size=%d ok\n", b, b->size);
-        b = b->next;
+        if (b->size & (~g_alloc_bit)){
+            /* Step to the block right after this one in memory */
+            b = (os_block_t*)((char*)b + (b->size & (~g_alloc_bit)));
+        } else {
+            /* End marker of a region, points to the first block of the next region */
+            b = b->next;
+        }
     }
     taskEXIT_CRITICAL(g_malloc_mutex);
 }
@@ -0,0 +1,328 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Heap leak tracing, see heap_trace.h.
+ *
+ * Records live in an open addressing hash table keyed by the allocated
+ * address, with linear probing.  Records are removed by shifting the records
+ * following them back, so lookups never have to step over deleted entries.
+ * The table is never filled beyond seven eighths, to keep the probe
+ * sequences short; allocations beyond that are counted as dropped.
+ *
+ * The table has its own lock, taken after the heap lock has been released,
+ * and the caller addresses are collected before taking it.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/heap_trace.h"
+
+#include "rom/ets_sys.h"
+
+#if( configHEAP_TRACE == 1 )
+
+#if( ( configHEAP_TRACE_RECORDS & ( configHEAP_TRACE_RECORDS - 1 ) ) != 0 )
+	#error configHEAP_TRACE_RECORDS must be a power of two
+#endif
+
+#if( ( configHEAP_TRACE_STACK_DEPTH < 1 ) || ( configHEAP_TRACE_STACK_DEPTH > 8 ) )
+	#error configHEAP_TRACE_STACK_DEPTH must be between 1 and 8
+#endif
+
+#define traceMASK				( configHEAP_TRACE_RECORDS - 1 )
+#define traceMAX_RECORDS		( configHEAP_TRACE_RECORDS - ( configHEAP_TRACE_RECORDS / 8 ) )
+#define traceHASH_SHIFT			( 32 - __builtin_ctz( configHEAP_TRACE_RECORDS ) )
+
+/* Return addresses of the windowed ABI keep the call size in the top two
+bits; code lives at 0x4xxxxxxx. */
+#define tracePC( pv )			( ( void * ) ( ( ( uint32_t ) ( pv ) & 0x3fffffffUL ) | 0x40000000UL ) )
+
+/* Frames between the interesting callers and prvGetCallers(): its caller in
+this file and the heap function calling that. */
+#define traceSKIP_FRAMES		2
+
+static HeapTraceRecord_t xRecords[ configHEAP_TRACE_RECORDS ];
+static portMUX_TYPE xTraceMutex = portMUX_INITIALIZER_UNLOCKED;
+static volatile BaseType_t xTraceActive = pdFALSE;
+static uint32_t ulAllocations;
+static uint32_t ulFrees;
+static uint32_t ulDropped;
+static UBaseType_t uxOutstanding;
+static size_t xOutstandingBytes;
+
+/*-----------------------------------------------------------*/
+
+static UBaseType_t prvHome( const void *pv )
+{
+	/* Heap blocks are at least 8 byte aligned, the low bits carry nothing. */
+	return ( UBaseType_t ) ( ( uint32_t ) ( ( ( uint32_t ) pv >> 3 ) * 2654435761UL ) >> traceHASH_SHIFT );
+}
+/*-----------------------------------------------------------*/
+
+static UBaseType_t prvFind( const void *pv )
+{
+UBaseType_t uxSlot;
+
+	for( uxSlot = prvHome( pv ); xRecords[ uxSlot ].pvAddress != NULL; uxSlot = ( uxSlot + 1 ) & traceMASK )
+	{
+		if( xRecords[ uxSlot ].pvAddress == pv )
+		{
+			return uxSlot;
+		}
+	}
+
+	return configHEAP_TRACE_RECORDS;
+}
+/*-----------------------------------------------------------*/
+
+static void prvRemove( UBaseType_t uxSlot )
+{
+UBaseType_t uxNext = uxSlot, uxHome;
+
+	uxOutstanding--;
+	xOutstandingBytes -= xRecords[ uxSlot ].xSize;
+
+	for( ;; )
+	{
+		uxNext = ( uxNext + 1 ) & traceMASK;
+		if( xRecords[ uxNext ].pvAddress == NULL )
+		{
+			break;
+		}
+
+		/* A record may move back into the hole unless its home slot lies
+		cyclically between the hole and where the record is. */
+		uxHome = prvHome( xRecords[ uxNext ].pvAddress );
+		if( ( uxSlot <= uxNext ) ? ( ( uxSlot < uxHome ) && ( uxHome <= uxNext ) ) : ( ( uxSlot < uxHome ) || ( uxHome <= uxNext ) ) )
+		{
+			continue;
+		}
+
+		xRecords[ uxSlot ] = xRecords[ uxNext ];
+		uxSlot = uxNext;
+	}
+
+	xRecords[ uxSlot ].pvAddress = NULL;
+}
+/*-----------------------------------------------------------*/
+
+/* __builtin_return_address() needs a constant, hence the unrolled levels. */
+static void __attribute__(( noinline )) prvGetCallers( void **ppvCallers )
+{
+	memset( ppvCallers, 0, sizeof( void * ) * configHEAP_TRACE_STACK_DEPTH );
+
+	#define traceCALLER( n )																				\
+		if( ( n ) < configHEAP_TRACE_STACK_DEPTH )															\
+		{																									\
+			void *pvCaller = __builtin_return_address( ( n ) < configHEAP_TRACE_STACK_DEPTH ? ( n ) + traceSKIP_FRAMES : 0 );	\
+			if( pvCaller == NULL )																			\
+			{																								\
+				return;																						\
+			}																								\
+			ppvCallers[ ( n ) < configHEAP_TRACE_STACK_DEPTH ? ( n ) : 0 ] = tracePC( pvCaller );			\
+		}
+
+	traceCALLER( 0 )
+	traceCALLER( 1 )
+	traceCALLER( 2 )
+	traceCALLER( 3 )
+	traceCALLER( 4 )
+	traceCALLER( 5 )
+	traceCALLER( 6 )
+	traceCALLER( 7 )
+
+	#undef traceCALLER
+}
+/*-----------------------------------------------------------*/
+
+void __attribute__(( noinline )) vPortHeapTraceAlloc( void *pv, size_t xSize )
+{
+void *pvCallers[ configHEAP_TRACE_STACK_DEPTH ];
+UBaseType_t uxSlot;
+
+	if( ( xTraceActive == pdFALSE ) || ( pv == NULL ) )
+	{
+		return;
+	}
+
+	prvGetCallers( pvCallers );
+
+	taskENTER_CRITICAL( &xTraceMutex );
+	if( xTraceActive != pdFALSE )
+	{
+		uxSlot = prvFind( pv );
+		if( uxSlot != configHEAP_TRACE_RECORDS )
+		{
+			/* Freed by a path that wasn't traced; the old record is stale. */
+			prvRemove( uxSlot );
+		}
+
+		if( uxOutstanding < traceMAX_RECORDS )
+		{
+			for( uxSlot = prvHome( pv ); xRecords[ uxSlot ].pvAddress != NULL; uxSlot = ( uxSlot + 1 ) & traceMASK )
+			{
+			}
+
+			xRecords[ uxSlot ].pvAddress = pv;
+			xRecords[ uxSlot ].xSize = xSize;
+			xRecords[ uxSlot ].ulSequence = ulAllocations;
+			memcpy( xRecords[ uxSlot ].pvCallers, pvCallers, sizeof( pvCallers ) );
+			uxOutstanding++;
+			xOutstandingBytes += xSize;
+		}
+		else
+		{
+			ulDropped++;
+		}
+		ulAllocations++;
+	}
+	taskEXIT_CRITICAL( &xTraceMutex );
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapTraceFree( void *pv )
+{
+UBaseType_t uxSlot;
+
+	if( xTraceActive == pdFALSE )
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL( &xTraceMutex );
+	if( xTraceActive != pdFALSE )
+	{
+		uxSlot = prvFind( pv );
+		if( uxSlot != configHEAP_TRACE_RECORDS )
+		{
+			prvRemove( uxSlot );
+			ulFrees++;
+		}
+	}
+	taskEXIT_CRITICAL( &xTraceMutex );
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapTraceResize( void *pv, size_t xSize )
+{
+UBaseType_t uxSlot;
+
+	if( xTraceActive == pdFALSE )
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL( &xTraceMutex );
+	if( xTraceActive != pdFALSE )
+	{
+		uxSlot = prvFind( pv );
+		if( uxSlot != configHEAP_TRACE_RECORDS )
+		{
+			xOutstandingBytes += xSize - xRecords[ uxSlot ].xSize;
+			xRecords[ uxSlot ].xSize = xSize;
+		}
+	}
+	taskEXIT_CRITICAL( &xTraceMutex );
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapTraceStart( void )
+{
+	taskENTER_CRITICAL( &xTraceMutex );
+	memset( xRecords, 0, sizeof( xRecords ) );
+	ulAllocations = 0;
+	ulFrees = 0;
+	ulDropped = 0;
+	uxOutstanding = 0;
+	xOutstandingBytes = 0;
+	xTraceActive = pdTRUE;
+	taskEXIT_CRITICAL( &xTraceMutex );
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapTraceStop( void )
+{
+	taskENTER_CRITICAL( &xTraceMutex );
+	xTraceActive = pdFALSE;
+	taskEXIT_CRITICAL( &xTraceMutex );
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapTraceGetSummary( HeapTraceSummary_t *pxSummary )
+{
+	taskENTER_CRITICAL( &xTraceMutex );
+	pxSummary->xActive = xTraceActive;
+	pxSummary->ulAllocations = ulAllocations;
+	pxSummary->ulFrees = ulFrees;
+	pxSummary->ulDropped = ulDropped;
+	pxSummary->uxOutstanding = uxOutstanding;
+	pxSummary->xOutstandingBytes = xOutstandingBytes;
+	taskEXIT_CRITICAL( &xTraceMutex );
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxPortHeapTraceGetRecords( HeapTraceRecord_t *pxRecords, UBaseType_t uxMaxRecords )
+{
+UBaseType_t uxSlot, uxCount = 0;
+
+	taskENTER_CRITICAL( &xTraceMutex );
+	for( uxSlot = 0; ( uxSlot < configHEAP_TRACE_RECORDS ) && ( uxCount < uxMaxRecords ); uxSlot++ )
+	{
+		if( xRecords[ uxSlot ].pvAddress != NULL )
+		{
+			pxRecords[ uxCount++ ] = xRecords[ uxSlot ];
+		}
+	}
+	taskEXIT_CRITICAL( &xTraceMutex );
+
+	return uxCount;
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapTraceDump( void )
+{
+HeapTraceSummary_t xSummary;
+HeapTraceRecord_t xRecord;
+UBaseType_t uxSlot, uxCaller;
+
+	vPortHeapTraceGetSummary( &xSummary );
+	ets_printf( "heap trace: %u allocations, %u freed, %u dropped, %u outstanding (%u bytes)%s\n",
+				xSummary.ulAllocations, xSummary.ulFrees, xSummary.ulDropped,
+				xSummary.uxOutstanding, xSummary.xOutstandingBytes, xSummary.xActive ? ", still tracing" : "" );
+
+	/* Printing is slow, so the lock is only held to copy one record. */
+	for( uxSlot = 0; uxSlot < configHEAP_TRACE_RECORDS; uxSlot++ )
+	{
+		taskENTER_CRITICAL( &xTraceMutex );
+		xRecord = xRecords[ uxSlot ];
+		taskEXIT_CRITICAL( &xTraceMutex );
+
+		if( xRecord.pvAddress != NULL )
+		{
+			ets_printf( "#%u %p %u bytes, callers", xRecord.ulSequence, xRecord.pvAddress, xRecord.xSize );
+			for( uxCaller = 0; ( uxCaller < configHEAP_TRACE_STACK_DEPTH ) && ( xRecord.pvCallers[ uxCaller ] != NULL ); uxCaller++ )
+			{
+				ets_printf( " %p", xRecord.pvCallers[ uxCaller ] );
+			}
+			ets_printf( "\n" );
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
+#endif /* configHEAP_TRACE */
@@ -334,6 +334,17 @@ extern "C" {
 	#define traceEND()
 #endif
 
+#ifndef traceISR_ENTER
+	/* Called by the port when it starts running the handler of an interrupt,
+	with the interrupt number as the parameter. */
+	#define traceISR_ENTER( uxIntNum )
+#endif
+
+#ifndef traceISR_EXIT
+	/* Called by the port when the handler of an interrupt has returned. */
+	#define traceISR_EXIT( uxIntNum )
+#endif
+
 #ifndef traceTASK_SWITCHED_IN
 	/* Called after a task has been selected to run.  pxCurrentTCB holds a pointer
 	to the task control block of the selected task. */
@@ -687,6 +698,10 @@ extern "C" {
 	#define configUSE_QUEUE_SETS 0
 #endif
 
+#ifndef configUSE_QUEUE_GROUPS
+	#define configUSE_QUEUE_GROUPS 0
+#endif
+
 #ifndef portTASK_USES_FLOATING_POINT
 	#define portTASK_USES_FLOATING_POINT()
 #endif
@@ -735,6 +750,14 @@ extern "C" {
 	#define configUSE_TASK_NOTIFICATIONS 1
 #endif
 
+#ifndef configSUPPORT_STATIC_ALLOCATION
+	#define configSUPPORT_STATIC_ALLOCATION 0
+#endif
+
+#ifndef configRECORD_STACK_HIGH_ADDRESS
+	#define configRECORD_STACK_HIGH_ADDRESS 0
+#endif
+
 #ifndef portTICK_TYPE_IS_ATOMIC
 	#define portTICK_TYPE_IS_ATOMIC 0
 #endif
@@ -791,6 +814,132 @@ V8 if desired. */
 	#define configESP32_PER_TASK_DATA 1
 #endif
 
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+#if( configUSE_NEWLIB_REENTRANT == 1 )
+	#include "sys/reent.h"
+#endif
+
+/*
+ * In line with software engineering best practice, FreeRTOS implements a strict
+ * data hiding policy, so the real task and queue structures are not accessible
+ * to the application.  There are still cases where the application has to
+ * provide the memory for a task or a queue, for example for a system task that
+ * must not depend on the heap.  The structures below have the same size and
+ * alignment as the real structures, so they can be used to reserve memory for
+ * them without exposing their members.  The members must not be accessed, and
+ * the structures have to be kept in sync with the real ones.  Creating an
+ * object from a buffer with a mismatched size trips a configASSERT().
+ */
+typedef struct xSTATIC_LIST_ITEM
+{
+	#if( configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES == 1 )
+		TickType_t xDummy1;
+	#endif
+	TickType_t xDummy2;
+	void *pvDummy3[ 4 ];
+	#if( configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES == 1 )
+		TickType_t xDummy4;
+	#endif
+} StaticListItem_t;
+
+typedef struct xSTATIC_MINI_LIST_ITEM
+{
+	#if( configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES == 1 )
+		TickType_t xDummy1;
+	#endif
+	TickType_t xDummy2;
+	void *pvDummy3[ 2 ];
+} StaticMiniListItem_t;
+
+typedef struct xSTATIC_LIST
+{
+	#if( configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES == 1 )
+		TickType_t xDummy1;
+	#endif
+	UBaseType_t uxDummy2;
+	void *pvDummy3;
+	StaticMiniListItem_t xDummy4;
+	#if( configUSE_LIST_DATA_INTEGRITY_CHECK_BYTES == 1 )
+		TickType_t xDummy5;
+	#endif
+} StaticList_t;
+
+/* Mirror of the TCB_t structure in tasks.c, see the comment above. */
+typedef struct xSTATIC_TCB
+{
+	void				*pxDummy1;
+	#if ( portUSING_MPU_WRAPPERS == 1 )
+		xMPU_SETTINGS	xDummy2;
+		BaseType_t		xDummy3;
+	#endif
+	StaticListItem_t	xDummy4[ 2 ];
+	UBaseType_t			uxDummy5;
+	void				*pxDummy6;
+	uint8_t				ucDummy7[ configMAX_TASK_NAME_LEN ];
+	BaseType_t			xDummy8[ 2 ];
+	#if ( configUSE_CORE_AFFINITY_HINT == 1 )
+		BaseType_t		xDummy9;
+	#endif
+	#if ( ( portSTACK_GROWTH > 0 ) || ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
+		void			*pxDummy10;
+	#endif
+	#if ( portCRITICAL_NESTING_IN_TCB == 1 )
+		UBaseType_t		uxDummy11;
+		uint32_t		ulDummy12;
+	#endif
+	#if ( configUSE_TRACE_FACILITY == 1 )
+		UBaseType_t		uxDummy13[ 2 ];
+	#endif
+	#if ( configUSE_MUTEXES == 1 )
+		UBaseType_t		uxDummy14[ 2 ];
+	#endif
+	#if ( configUSE_APPLICATION_TASK_TAG == 1 )
+		void			*pxDummy15;
+	#endif
+	#if( configNUM_THREAD_LOCAL_STORAGE_POINTERS > 0 )
+		void			*pvDummy16[ configNUM_THREAD_LOCAL_STORAGE_POINTERS ];
+	#if ( configTHREAD_LOCAL_STORAGE_DELETE_CALLBACKS )
+		void			*pvDummy17[ configNUM_THREAD_LOCAL_STORAGE_POINTERS ];
+	#endif
+	#endif
+	#if ( configGENERATE_RUN_TIME_STATS == 1 )
+		uint64_t		ullDummy18[ portNUM_PROCESSORS ];
+	#endif
+	#if ( configUSE_NEWLIB_REENTRANT == 1 )
+		struct	_reent	xDummy19;
+	#endif
+	#if ( configUSE_TASK_NOTIFICATIONS == 1 )
+		uint32_t		ulDummy20;
+		uint32_t		eDummy21;
+	#endif
+	uint8_t				ucDummy22;
+} StaticTask_t;
+
+/* Mirror of the Queue_t structure in queue.c, see the comment above. */
+typedef struct xSTATIC_QUEUE
+{
+	void				*pvDummy1[ 4 ];
+	StaticList_t		xDummy2[ 2 ];
+	UBaseType_t			uxDummy3[ 3 ];
+	BaseType_t			xDummy4[ 2 ];
+	#if ( configUSE_TRACE_FACILITY == 1 )
+		UBaseType_t		uxDummy5;
+		uint8_t			ucDummy6;
+	#endif
+	#if ( configUSE_QUEUE_SETS == 1 )
+		void			*pvDummy7;
+	#endif
+	#if ( configUSE_QUEUE_GROUPS == 1 )
+		void			*pvDummy10;
+		uint32_t		ulDummy11;
+	#endif
+	portMUX_TYPE		xDummy8;
+	uint8_t				ucDummy9;
+} StaticQueue_t;
+
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 #ifdef __cplusplus
 }
 #endif
@@ -102,6 +102,13 @@
 /* TODO: config freq by menuconfig */
 #define XT_CLOCK_FREQ (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000)
 
+/* With power management the CPU frequency changes at run time. XT_CLOCK_FREQ
+is then only the frequency at startup, and the tick timer is reloaded from
+_xt_tick_divisor, which esp_pm updates, rather than from XT_TICK_DIVISOR. */
+#if CONFIG_PM_ENABLE
+#define XT_CLOCK_FREQ_DYNAMIC 1
+#endif
+
 /* Required for configuration-dependent settings */
 #include "xtensa_config.h"
 
@@ -186,11 +193,17 @@
 #define configUSE_TRACE_FACILITY		0		/* Used by vTaskList in main.c */
 #define configUSE_STATS_FORMATTING_FUNCTIONS	0	/* Used by vTaskList in main.c */
 #define configUSE_TRACE_FACILITY_2      0		/* Provided by Xtensa port patch */
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define configGENERATE_RUN_TIME_STATS   1		/* Per task and per core CPU time, see uxTaskGetRunTimeStats() */
+#endif
 #define configBENCHMARK					0		/* Provided by Xtensa port patch */
 #define configUSE_16_BIT_TICKS			0
 #define configIDLE_SHOULD_YIELD			0
 #define configQUEUE_REGISTRY_SIZE		0
 
+#define configSUPPORT_STATIC_ALLOCATION	1		/* xTaskCreateStatic(), xQueueCreateStatic() */
+#define configRECORD_STACK_HIGH_ADDRESS	1		/* Stack size of each task, see uxTaskGetStackInfo() */
+
 #define configUSE_MUTEXES				1
 #define configUSE_RECURSIVE_MUTEXES		1
 #define configUSE_COUNTING_SEMAPHORES	1
@@ -221,6 +234,7 @@
 #define INCLUDE_vTaskDelayUntil				1
 #define INCLUDE_vTaskDelay					1
 #define INCLUDE_uxTaskGetStackHighWaterMark	1
+#define INCLUDE_pcTaskGetTaskName			1
 
 #if CONFIG_ENABLE_MEMORY_DEBUG
 #define configENABLE_MEMORY_DEBUG 1
@@ -228,6 +242,37 @@
 #define configENABLE_MEMORY_DEBUG 0
 #endif
 
+#if CONFIG_FREERTOS_HEAP_CORE_CACHE
+#define configHEAP_CORE_CACHE 1
+#else
+#define configHEAP_CORE_CACHE 0
+#endif
+
+#if CONFIG_FREERTOS_HEAP_STATS
+#define configHEAP_STATS 1
+#else
+#define configHEAP_STATS 0
+#endif
+
+#if CONFIG_FREERTOS_HEAP_TRACE
+#define configHEAP_TRACE 1
+#define configHEAP_TRACE_RECORDS CONFIG_FREERTOS_HEAP_TRACE_RECORDS
+#define configHEAP_TRACE_STACK_DEPTH CONFIG_FREERTOS_HEAP_TRACE_STACK_DEPTH
+#else
+#define configHEAP_TRACE 0
+#endif
+
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define configUSE_TICKLESS_IDLE 1
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP
+#endif
+
+#if CONFIG_FREERTOS_CORE_AFFINITY_HINT
+#define configUSE_CORE_AFFINITY_HINT 1
+#else
+#define configUSE_CORE_AFFINITY_HINT 0
+#endif
+
 #define INCLUDE_xSemaphoreGetMutexHolder    1
 
 /* The priority at which the tick interrupt runs.  This should probably be
@@ -247,10 +292,16 @@
 #define configTIMER_TASK_PRIORITY           1
 #define configTIMER_QUEUE_LENGTH            10
 #define configTIMER_TASK_STACK_DEPTH        configMINIMAL_STACK_SIZE
+#if CONFIG_FREERTOS_TIMER_TASK_PER_CORE
+#define configTIMER_TASK_PER_CORE           1
+#else
+#define configTIMER_TASK_PER_CORE           0
+#endif
 
 #define INCLUDE_xTimerPendFunctionCall      1
 #define INCLUDE_eTaskGetState               1
 #define configUSE_QUEUE_SETS                1
+#define configUSE_QUEUE_GROUPS              1
 
 #if (!defined XT_INTEXC_HOOKS)
 #define configXT_INTEXC_HOOKS               1   /* Exception hooks used by certain tests */
@@ -262,6 +313,17 @@
 #define configXT_BOARD                      1   /* Board mode */
 #define configXT_SIMULATOR					0
 
+/* Record scheduler events in RAM, see trace_recorder.h */
+#if CONFIG_FREERTOS_TRACE_RECORDER
+#define configUSE_TRACE_RECORDER            1
+#define configTRACE_RECORDER_EVENTS         CONFIG_FREERTOS_TRACE_RECORDER_EVENTS
+#ifndef __ASSEMBLER__
+#include "trace_recorder.h"
+#endif
+#else
+#define configUSE_TRACE_RECORDER            0
+#endif
+
 
 #endif /* FREERTOS_CONFIG_H */
 
@@ -334,15 +334,8 @@ EventBits_t xEventGroupClearBits( EventGroupHandle_t xEventGroup, const EventBit
  *
  * A version of xEventGroupClearBits() that can be called from an interrupt.
  *
- * Setting bits in an event group is not a deterministic operation because there
- * are an unknown number of tasks that may be waiting for the bit or bits being
- * set.  FreeRTOS does not allow nondeterministic operations to be performed
- * while interrupts are disabled, so protects event groups that are accessed
- * from tasks by suspending the scheduler rather than disabling interrupts.  As
- * a result event groups cannot be accessed directly from an interrupt service
- * routine.  Therefore xEventGroupClearBitsFromISR() sends a message to the 
- * timer task to have the clear operation performed in the context of the timer 
- * task.
+ * Each event group is protected by its own mux, which interrupts can take as
+ * well, so the bits are cleared directly from the interrupt, on either core.
  *
  * @param xEventGroup The event group in which the bits are to be cleared.
  *
@@ -350,9 +343,8 @@ EventBits_t xEventGroupClearBits( EventGroupHandle_t xEventGroup, const EventBit
  * For example, to clear bit 3 only, set uxBitsToClear to 0x08.  To clear bit 3
  * and bit 0 set uxBitsToClear to 0x09.
  *
- * @return If the request to execute the function was posted successfully then 
- * pdPASS is returned, otherwise pdFALSE is returned.  pdFALSE will be returned 
- * if the timer service queue was full.
+ * @return pdPASS.  The return value is kept for compatibility with the
+ * version that defers the operation to the timer task.
  *
  * Example usage:
    <pre>
@@ -372,18 +364,14 @@ EventBits_t xEventGroupClearBits( EventGroupHandle_t xEventGroup, const EventBit
 
 		if( xResult == pdPASS )
 		{
-			// The message was posted successfully.
+			// The bits were cleared.
 		}
   }
    </pre>
  * \defgroup xEventGroupSetBitsFromISR xEventGroupSetBitsFromISR
  * \ingroup EventGroup
  */
-#if( configUSE_TRACE_FACILITY == 1 )
-	BaseType_t xEventGroupClearBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet );
-#else
-	#define xEventGroupClearBitsFromISR( xEventGroup, uxBitsToClear ) xTimerPendFunctionCallFromISR( vEventGroupClearBitsCallback, ( void * ) xEventGroup, ( uint32_t ) uxBitsToClear, NULL )
-#endif
+BaseType_t xEventGroupClearBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet );
 
 /**
  * event_groups.h
@@ -467,13 +455,11 @@ EventBits_t xEventGroupSetBits( EventGroupHandle_t xEventGroup, const EventBits_
  *
  * A version of xEventGroupSetBits() that can be called from an interrupt.
  *
- * Setting bits in an event group is not a deterministic operation because there
- * are an unknown number of tasks that may be waiting for the bit or bits being
- * set.  FreeRTOS does not allow nondeterministic operations to be performed in
- * interrupts or from critical sections.  Therefore xEventGroupSetBitFromISR()
- * sends a message to the timer task to have the set operation performed in the
- * context of the timer task - where a scheduler lock is used in place of a
- * critical section.
+ * The bits are set directly from the interrupt, under the mux of the event
+ * group, and the tasks waiting for them are unblocked before the function
+ * returns.  The time spent with interrupts disabled grows with the number of
+ * tasks waiting on the event group, but only when a task waits for one of the
+ * bits being set.
  *
  * @param xEventGroup The event group in which the bits are to be set.
  *
@@ -481,19 +467,16 @@ EventBits_t xEventGroupSetBits( EventGroupHandle_t xEventGroup, const EventBits_
  * For example, to set bit 3 only, set uxBitsToSet to 0x08.  To set bit 3
  * and bit 0 set uxBitsToSet to 0x09.
  *
- * @param pxHigherPriorityTaskWoken As mentioned above, calling this function
- * will result in a message being sent to the timer daemon task.  If the
- * priority of the timer daemon task is higher than the priority of the
- * currently running task (the task the interrupt interrupted) then
- * *pxHigherPriorityTaskWoken will be set to pdTRUE by
- * xEventGroupSetBitsFromISR(), indicating that a context switch should be
- * requested before the interrupt exits.  For that reason
+ * @param pxHigherPriorityTaskWoken If setting the bits unblocks a task with a
+ * priority higher than the priority of the currently running task (the task
+ * the interrupt interrupted) then *pxHigherPriorityTaskWoken will be set to
+ * pdTRUE by xEventGroupSetBitsFromISR(), indicating that a context switch
+ * should be requested before the interrupt exits.  For that reason
  * *pxHigherPriorityTaskWoken must be initialised to pdFALSE.  See the
- * example code below.
+ * example code below.  Can be NULL.
  *
- * @return If the request to execute the function was posted successfully then 
- * pdPASS is returned, otherwise pdFALSE is returned.  pdFALSE will be returned 
- * if the timer service queue was full.
+ * @return pdPASS.  The return value is kept for compatibility with the
+ * version that defers the operation to the timer task.
  *
  * Example usage:
    <pre>
@@ -517,7 +500,7 @@ EventBits_t xEventGroupSetBits( EventGroupHandle_t xEventGroup, const EventBits_
 							BIT_0 | BIT_4   // The bits being set.
 							&xHigherPriorityTaskWoken );
 
-		// Was the message posted successfully?
+		// Were the bits set?
 		if( xResult == pdPASS )
 		{
 			// If xHigherPriorityTaskWoken is now set to pdTRUE then a context
@@ -531,11 +514,7 @@ EventBits_t xEventGroupSetBits( EventGroupHandle_t xEventGroup, const EventBits_
  * \defgroup xEventGroupSetBitsFromISR xEventGroupSetBitsFromISR
  * \ingroup EventGroup
  */
-#if( configUSE_TRACE_FACILITY == 1 )
-	BaseType_t xEventGroupSetBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet, BaseType_t *pxHigherPriorityTaskWoken );
-#else
-	#define xEventGroupSetBitsFromISR( xEventGroup, uxBitsToSet, pxHigherPriorityTaskWoken ) xTimerPendFunctionCallFromISR( vEventGroupSetBitsCallback, ( void * ) xEventGroup, ( uint32_t ) uxBitsToSet, pxHigherPriorityTaskWoken )
-#endif
+BaseType_t xEventGroupSetBitsFromISR( EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet, BaseType_t *pxHigherPriorityTaskWoken );
 
 /**
  * event_groups.h
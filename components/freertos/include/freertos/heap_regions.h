@@ -27,8 +27,66 @@ typedef struct HeapRegionTagged
 
 
 void vPortDefineHeapRegionsTagged( const HeapRegionTagged_t * const pxHeapRegions );
+
+/* Adds a region to the heap after vPortDefineHeapRegionsTagged() has been
+called, for memory that only becomes available once the system is running.
+The region doesn't need to lie above the regions already defined. */
+void vPortAddHeapRegionTagged( const HeapRegionTagged_t * const pxHeapRegion );
+
 void *pvPortMallocTagged( size_t xWantedSize, BaseType_t tag );
 
+/* Like pvPortMallocTagged(), but the memory returned starts at a multiple of
+xAlignment, which must be a power of two.  The memory in front of the aligned
+start stays in the heap, so no more memory than needed is used.  Freed with
+vPortFree(). */
+void *pvPortMallocTaggedAligned( size_t xWantedSize, size_t xAlignment, BaseType_t tag );
+
+/* Resizes an allocated block without moving it: shrinks it, or grows it into
+the free memory following it. Returns pdFALSE if the block can't be resized
+in place, in which case it is left untouched. */
+BaseType_t xPortReallocInPlace( void *pv, size_t xWantedSize );
+
+/* Number of bytes usable in an allocated block, at least the size that was
+asked for. */
+size_t xPortGetAllocatedSize( void *pv );
+
+/* Number of entries in the free block size histogram.  Entry n counts the
+free blocks of ( 16 << n ) up to ( 32 << n ) - 1 bytes; the last entry counts
+all blocks from ( 16 << 13 ) bytes up. */
+#define heapSTATS_HISTOGRAM_COUNT	14
+
+/* Statistics of the free memory of one tag, filled in by
+xPortGetHeapStatsTagged().  Block sizes include the block header.  The
+counters only count with configHEAP_STATS set, and wrap around; take two
+snapshots and divide by the difference of xTickCount for a rate. */
+typedef struct HeapStats
+{
+	size_t xFreeBytes;										/*<< Free bytes, like xPortGetFreeHeapSize(). */
+	size_t xLargestFreeBlock;								/*<< Largest allocation that can currently succeed. */
+	size_t xFreeBlocks;										/*<< Number of free blocks. */
+	size_t xFreeBlockHistogram[ heapSTATS_HISTOGRAM_COUNT ];	/*<< Free blocks per size class. */
+	uint32_t ulAllocations;									/*<< Successful allocations. */
+	uint32_t ulFrees;										/*<< Frees. */
+	uint32_t ulFailures;									/*<< Allocations that found no free block of this tag. */
+	TickType_t xTickCount;									/*<< Tick count when the statistics were taken. */
+} HeapStats_t;
+
+/* How long the heap lock is held, in CPU cycles.  Only kept with
+configHEAP_STATS set. */
+typedef struct HeapLockStats
+{
+	uint32_t ulCount;										/*<< Number of times the lock was taken. */
+	uint32_t ulMaxCycles;									/*<< Longest time it was held for. */
+	uint64_t ullTotalCycles;								/*<< Total time it was held for. */
+} HeapLockStats_t;
+
+/* Fills in the statistics of the memory of one tag.  Walks all free blocks of
+the tag with the heap lock held.  Returns pdFALSE if no region has the tag. */
+BaseType_t xPortGetHeapStatsTagged( BaseType_t xTag, HeapStats_t *pxStats );
+
+/* Fills in the heap lock statistics. */
+void vPortGetHeapLockStats( HeapLockStats_t *pxStats );
+
 
 
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #define DEBUG_DOG_VALUE 0x1a2b3c4d
 #define DEBUG_MAX_INFO_NUM 20
+#define DEBUG_MAX_TASK_NUM 16
 #define DEBUG_TYPE_MALLOC 1
 #define DEBUG_TYPE_FREE   2
 
@@ -25,6 +26,7 @@ typedef struct _os_block_t {
     struct _os_block_t *next;
     size_t   size;
     unsigned int xtag;
+    struct _os_block_t *prev_phys;
 }os_block_t;
 
 typedef struct {
@@ -64,6 +66,7 @@ extern void mem_debug_init(size_t size, void *start, void *end, portMUX_TYPE *mu
 extern void mem_malloc_block(void *data);
 extern void mem_free_block(void *data);
 extern void mem_check_all(void* pv);
+extern void mem_debug_task_usage(void);
 
 #else
 
@@ -0,0 +1,75 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _HEAP_TRACE_H
+#define _HEAP_TRACE_H
+
+#include "freertos/FreeRTOS.h"
+
+#if( configHEAP_TRACE == 1 )
+
+/* Leak tracing.  Between vPortHeapTraceStart() and vPortHeapTraceStop(),
+every allocation is recorded with the addresses of its callers in a hash table
+of configHEAP_TRACE_RECORDS entries, and its record is dropped again when it is
+freed.  What is left in the table when tracing stops are the allocations that
+were made during the window and are still outstanding.  Outside the window,
+the cost is one test per malloc and free.
+
+The first caller addresses are usually the allocator layers above the heap
+(pvPortMallocCaps(), malloc()); the call site in the application follows
+them. */
+
+/* One outstanding allocation. */
+typedef struct HeapTraceRecord
+{
+	void *pvAddress;										/*<< The allocated memory. */
+	size_t xSize;											/*<< Size asked for. */
+	uint32_t ulSequence;									/*<< Number of the allocation, counting from 0 at vPortHeapTraceStart(). */
+	void *pvCallers[ configHEAP_TRACE_STACK_DEPTH ];		/*<< Return addresses, innermost first; NULL past the top of the stack. */
+} HeapTraceRecord_t;
+
+typedef struct HeapTraceSummary
+{
+	BaseType_t xActive;										/*<< pdTRUE between vPortHeapTraceStart() and vPortHeapTraceStop(). */
+	uint32_t ulAllocations;									/*<< Allocations made while tracing. */
+	uint32_t ulFrees;										/*<< Frees of recorded allocations. */
+	uint32_t ulDropped;										/*<< Allocations not recorded, the table being full. */
+	UBaseType_t uxOutstanding;								/*<< Records in the table. */
+	size_t xOutstandingBytes;								/*<< Sum of their sizes. */
+} HeapTraceSummary_t;
+
+/* Clears the table and starts recording.  Allocations made before are not
+traced, and freeing them doesn't affect the table. */
+void vPortHeapTraceStart( void );
+
+/* Stops recording, keeping the table for the functions below. */
+void vPortHeapTraceStop( void );
+
+void vPortHeapTraceGetSummary( HeapTraceSummary_t *pxSummary );
+
+/* Copies up to uxMaxRecords records of outstanding allocations, in no
+particular order.  Returns the number copied. */
+UBaseType_t uxPortHeapTraceGetRecords( HeapTraceRecord_t *pxRecords, UBaseType_t uxMaxRecords );
+
+/* Prints the summary and every outstanding allocation on the console, the
+caller addresses ready for xtensa-esp32-elf-addr2line. */
+void vPortHeapTraceDump( void );
+
+/* Called by the heap. */
+void vPortHeapTraceAlloc( void *pv, size_t xSize );
+void vPortHeapTraceFree( void *pv );
+void vPortHeapTraceResize( void *pv, size_t xSize );
+
+#endif /* configHEAP_TRACE */
+
+#endif
@@ -129,6 +129,16 @@ typedef struct {
 	const char *lastLockedFn;
 	int lastLockedLine;
 #endif
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+	const char *name;			// Set by xPortCPUMutexRegister(), NULL if not registered
+	uint64_t totalSpinCycles;
+	uint64_t totalHoldCycles;
+	uint32_t lockedAt;			// CCOUNT when the mux was taken non-recursively
+	uint32_t acquireCount;		// Non-recursive acquisitions
+	uint32_t contendedCount;	// Acquisitions that had to spin because the other core held the mux
+	uint32_t maxSpinCycles;		// Longest spin before the mux was taken
+	uint32_t maxHoldCycles;		// Longest time the mux was held
+#endif
 } portMUX_TYPE;
 
  /*
@@ -170,6 +180,10 @@ typedef struct {
 #define portASSERT_IF_IN_ISR()        vPortAssertIfInISR()
 void vPortAssertIfInISR();
 
+// Point watchpoint 1 of this core at the end of the stack that starts at pxStackStart, see
+// CONFIG_FREERTOS_WATCHPOINT_END_OF_STACK.
+void vPortSetStackWatchpoint( void* pxStackStart );
+
 #define portCRITICAL_NESTING_IN_TCB 1 
 
 /*
@@ -213,6 +227,47 @@ portBASE_TYPE vPortCPUReleaseMutex(portMUX_TYPE *mux);
 #define portEXIT_CRITICAL_ISR(mux)    vPortCPUReleaseMutex(mux)
 #endif
 
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+/*
+ * Give a mux a name and list it in the output of vPortCPUMutexStatsDump(). The
+ * mux must stay valid from then on, so this is only meant for muxes that are
+ * statically allocated or never freed. Returns pdFALSE if the table of
+ * registered muxes is full.
+ */
+portBASE_TYPE xPortCPUMutexRegister(portMUX_TYPE *mux, const char *name);
+
+/*
+ * Print the statistics of the registered muxes, and the time each core spent
+ * spinning on any mux, on the console.
+ */
+void vPortCPUMutexStatsDump(void);
+#endif
+
+/*
+ * Lock for critical sections that are too long to run with interrupts
+ * disabled but still have to be protected against tasks on both cores. It is
+ * owned by a task rather than a core. A task that finds it taken spins for a
+ * short while, in case the owner is about to release it on the other core,
+ * and then raises the priority of the owner to its own and yields until the
+ * lock is free, like a mutex with priority inheritance, but without the
+ * overhead of a queue. It must not be used from interrupts, and must not be
+ * taken inside a portENTER_CRITICAL section.
+ */
+typedef struct {
+	portMUX_TYPE mux;			// Protects the fields below, only held for a few instructions
+	void *owner;				// Task holding the lock, NULL if free
+	uint32_t count;				// Number of recursive acquisitions by the owner
+} portYIELDLOCK_TYPE;
+
+#define portYIELDLOCK_INITIALIZER { .mux = portMUX_INITIALIZER_UNLOCKED, .owner = NULL, .count = 0 }
+
+#define portYIELDLOCK_SPIN_TRIES		100	// Attempts before priority inheritance and yielding
+
+void vPortYieldLockInitialize(portYIELDLOCK_TYPE *lock);
+void vPortYieldLockAcquire(portYIELDLOCK_TYPE *lock);
+portBASE_TYPE xPortYieldLockTryAcquire(portYIELDLOCK_TYPE *lock);
+void vPortYieldLockRelease(portYIELDLOCK_TYPE *lock);
+
 
 // Cleaner and preferred solution allows nested interrupts disabling and restoring via local registers or stack.
 // They can be called from interrupts too.
@@ -236,6 +291,9 @@ static inline unsigned portENTER_CRITICAL_NESTED() { unsigned state = XTOS_SET_I
 
 /* Fine resolution time */
 #define portGET_RUN_TIME_COUNTER_VALUE()  xthal_get_ccount()
+#define portRUN_TIME_COUNTER_FREQ         XT_CLOCK_FREQ
+/* CCOUNT runs from reset and needs no setup. */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
 
 /* Kernel utilities. */
 void vPortYield( void );
@@ -244,6 +302,14 @@ void _frxt_setup_switch( void );
 #define portYIELD_FROM_ISR()		_frxt_setup_switch()
 /*-----------------------------------------------------------*/
 
+/* Tickless idle */
+#if configUSE_TICKLESS_IDLE != 0
+void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime );
+void vPortWakeSleepingCore( BaseType_t xCoreID );
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime )	vPortSuppressTicksAndSleep( xExpectedIdleTime )
+#endif
+/*-----------------------------------------------------------*/
+
 /* Task function macros as described on the FreeRTOS.org WEB site. */
 #define portTASK_FUNCTION_PROTO( vFunction, pvParameters ) void vFunction( void *pvParameters )
 #define portTASK_FUNCTION( vFunction, pvParameters ) void vFunction( void *pvParameters )
@@ -101,6 +101,16 @@ typedef void * QueueSetHandle_t;
  */
 typedef void * QueueSetMemberHandle_t;
 
+/**
+ * Type by which queue groups are referenced.  For example, a call to
+ * xQueueGroupCreate() returns a QueueGroupHandle_t variable that can then be
+ * used as a parameter to ulQueueGroupWait(), xQueueAddToGroup(), etc.
+ */
+typedef void * QueueGroupHandle_t;
+
+/* Number of queues and semaphores a queue group can hold. */
+#define queueGROUP_MAX_MEMBERS	32
+
 /* For internal use only. */
 #define	queueSEND_TO_BACK		( ( BaseType_t ) 0 )
 #define	queueSEND_TO_FRONT		( ( BaseType_t ) 1 )
@@ -172,6 +182,57 @@ typedef void * QueueSetMemberHandle_t;
  */
 #define xQueueCreate( uxQueueLength, uxItemSize ) xQueueGenericCreate( uxQueueLength, uxItemSize, queueQUEUE_TYPE_BASE )
 
+/**
+ * queue. h
+ * <pre>
+ QueueHandle_t xQueueCreateStatic(
+							  UBaseType_t uxQueueLength,
+							  UBaseType_t uxItemSize,
+							  uint8_t *pucQueueStorage,
+							  StaticQueue_t *pxQueueBuffer
+						  );
+ * </pre>
+ *
+ * Creates a new queue instance like xQueueCreate(), but without allocating
+ * any memory from the heap.  The queue structure and the item storage area
+ * are kept in the buffers provided by the caller, which must stay valid until
+ * the queue has been deleted.  Only available if
+ * configSUPPORT_STATIC_ALLOCATION is set to 1 in FreeRTOSConfig.h.
+ *
+ * @param uxQueueLength The maximum number of items that the queue can contain.
+ *
+ * @param uxItemSize The number of bytes each item in the queue will require.
+ *
+ * @param pucQueueStorage Buffer of at least uxQueueLength * uxItemSize bytes
+ * that holds the items, or NULL if uxItemSize is 0.
+ *
+ * @param pxQueueBuffer Buffer that holds the queue structure.
+ *
+ * @return The handle of the queue.  Creating a queue from static buffers
+ * cannot fail.
+ *
+ * Example usage:
+   <pre>
+ #define QUEUE_LENGTH 10
+
+ static StaticQueue_t xQueueBuffer;
+ static uint8_t ucQueueStorage[ QUEUE_LENGTH * sizeof( uint32_t ) ];
+
+ void vATask( void *pvParameters )
+ {
+ QueueHandle_t xQueue;
+
+	// Create a queue capable of containing 10 uint32_t values.
+	xQueue = xQueueCreateStatic( QUEUE_LENGTH, sizeof( uint32_t ), ucQueueStorage, &xQueueBuffer );
+ }
+ </pre>
+ * \defgroup xQueueCreateStatic xQueueCreateStatic
+ * \ingroup QueueManagement
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	#define xQueueCreateStatic( uxQueueLength, uxItemSize, pucQueueStorage, pxQueueBuffer ) xQueueGenericCreateStatic( ( uxQueueLength ), ( uxItemSize ), ( pucQueueStorage ), ( pxQueueBuffer ), queueQUEUE_TYPE_BASE )
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 /**
  * queue. h
  * <pre>
@@ -912,6 +973,87 @@ BaseType_t xQueuePeekFromISR( QueueHandle_t xQueue, void * const pvBuffer ) PRIV
  */
 BaseType_t xQueueGenericReceive( QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait, const BaseType_t xJustPeek ) PRIVILEGED_FUNCTION;
 
+/**
+ * queue. h
+ * <pre>
+ UBaseType_t xQueueSendMultiple(
+									QueueHandle_t xQueue,
+									const void *pvItems,
+									UBaseType_t uxCount,
+									TickType_t xTicksToWait
+								);
+ * </pre>
+ *
+ * Post up to uxCount items to the back of a queue.  The items are copied
+ * from the contiguous array pvItems while the queue is locked once, and
+ * tasks waiting to receive are woken once for the whole batch instead of
+ * once per item.
+ *
+ * If the queue has room for fewer than uxCount items only that many are
+ * posted.  The call blocks (for at most xTicksToWait) only while the queue
+ * is completely full.
+ *
+ * The queue must have a non-zero item size, so semaphores and mutexes
+ * cannot be used with this function.  It must not be called from an
+ * interrupt service routine.
+ *
+ * @param xQueue The handle to the queue on which the items are to be posted.
+ *
+ * @param pvItems Pointer to an array of items, each of the size given when
+ * the queue was created.
+ *
+ * @param uxCount The number of items in pvItems.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block
+ * waiting for space to become available on the queue, should it be full.
+ *
+ * @return The number of items posted, which is 0 if the queue remained full.
+ *
+ * \defgroup xQueueSendMultiple xQueueSendMultiple
+ * \ingroup QueueManagement
+ */
+UBaseType_t xQueueSendMultiple( QueueHandle_t xQueue, const void * const pvItems, const UBaseType_t uxCount, TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
+
+/**
+ * queue. h
+ * <pre>
+ UBaseType_t xQueueReceiveMultiple(
+									QueueHandle_t xQueue,
+									void *pvBuffer,
+									UBaseType_t uxMaxCount,
+									TickType_t xTicksToWait
+								);
+ * </pre>
+ *
+ * Receive up to uxMaxCount items from a queue into the contiguous buffer
+ * pvBuffer, locking the queue once for the whole batch.  Items are received
+ * in the order they were posted.
+ *
+ * The call blocks (for at most xTicksToWait) only while the queue is
+ * completely empty; once at least one item is available it returns with
+ * however many were available, up to uxMaxCount.
+ *
+ * The queue must have a non-zero item size.  This function must not be
+ * called from an interrupt service routine.
+ *
+ * @param xQueue The handle to the queue from which the items are to be
+ * received.
+ *
+ * @param pvBuffer Pointer to a buffer with room for uxMaxCount items.
+ *
+ * @param uxMaxCount The maximum number of items to receive.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block
+ * waiting for an item to receive should the queue be empty.
+ *
+ * @return The number of items received, which is 0 if the queue remained
+ * empty.
+ *
+ * \defgroup xQueueReceiveMultiple xQueueReceiveMultiple
+ * \ingroup QueueManagement
+ */
+UBaseType_t xQueueReceiveMultiple( QueueHandle_t xQueue, void * const pvBuffer, const UBaseType_t uxMaxCount, TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
+
 /**
  * queue. h
  * <pre>UBaseType_t uxQueueMessagesWaiting( const QueueHandle_t xQueue );</pre>
@@ -1543,6 +1685,14 @@ BaseType_t xQueueGiveMutexRecursive( QueueHandle_t pxMutex ) PRIVILEGED_FUNCTION
  */
 QueueHandle_t xQueueGenericCreate( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType ) PRIVILEGED_FUNCTION;
 
+/*
+ * Generic version of the function that creates a queue from buffers provided
+ * by the caller, called by the xQueueCreateStatic() macro.
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	QueueHandle_t xQueueGenericCreateStatic( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue, const uint8_t ucQueueType ) PRIVILEGED_FUNCTION;
+#endif
+
 /*
  * Queue sets provide a mechanism to allow a task to block (pend) on a read
  * operation from multiple queues or semaphores simultaneously.
@@ -1677,6 +1827,94 @@ QueueSetMemberHandle_t xQueueSelectFromSet( QueueSetHandle_t xQueueSet, const Ti
  */
 QueueSetMemberHandle_t xQueueSelectFromSetFromISR( QueueSetHandle_t xQueueSet ) PRIVILEGED_FUNCTION;
 
+/*
+ * Queue groups are a lighter alternative to queue sets, for a task that waits
+ * on many queues and semaphores.  configUSE_QUEUE_GROUPS must be set to 1 in
+ * FreeRTOSConfig.h for the functions below to be available.
+ *
+ * Each member of a group is given a bit.  Posting to a member only sets its
+ * bit in the group's readiness bitmap; nothing is copied into a second queue,
+ * so the group needs no storage sized for the sum of the member lengths.  The
+ * task waiting in ulQueueGroupWait() is woken with a single task notification,
+ * however many posts arrive before it runs, and gets the bitmap of the members
+ * that were posted to.  It then receives from (or takes) those members
+ * directly, with a block time of zero.
+ *
+ * Note 1:  A group has a single owner, the task calling ulQueueGroupWait().
+ * It waits on its own task notification, so that task must not use task
+ * notifications for anything else.
+ *
+ * Note 2:  A set bit means the member was posted to, not that it still holds
+ * an item: the owner, or another task, may have emptied it meanwhile.  The
+ * owner should drain each member it is given until the receive fails; a
+ * member it leaves items in is returned again by the next wait.
+ *
+ * Note 3:  A queue or semaphore can be in at most one queue group and
+ * must not at the same time be in a queue set.  Mutexes must not be added.
+ * Members must be removed from the group before they or the group are deleted.
+ */
+
+/*
+ * Creates an empty queue group.  Returns NULL if there is not enough heap
+ * memory.
+ */
+QueueGroupHandle_t xQueueGroupCreate( void ) PRIVILEGED_FUNCTION;
+
+/*
+ * Deletes a queue group, which must have no members left.
+ */
+void vQueueGroupDelete( QueueGroupHandle_t xQueueGroup ) PRIVILEGED_FUNCTION;
+
+/*
+ * Adds a queue or semaphore to a queue group as bit uxBit (0 to
+ * queueGROUP_MAX_MEMBERS - 1) of the bitmaps ulQueueGroupWait() returns.  The
+ * member may already hold items, in which case it is ready at once.
+ *
+ * @return pdPASS if the member was added, pdFAIL if it is already in a group
+ * or a queue set, or the bit is taken.
+ */
+BaseType_t xQueueAddToGroup( QueueSetMemberHandle_t xQueueOrSemaphore, QueueGroupHandle_t xQueueGroup, UBaseType_t uxBit ) PRIVILEGED_FUNCTION;
+
+/*
+ * Removes a queue or semaphore from a queue group.
+ *
+ * @return pdPASS if it was removed, pdFAIL if it wasn't a member of the group.
+ */
+BaseType_t xQueueRemoveFromGroup( QueueSetMemberHandle_t xQueueOrSemaphore, QueueGroupHandle_t xQueueGroup ) PRIVILEGED_FUNCTION;
+
+/*
+ * Blocks for at most xTicksToWait until a member of the group is posted to.
+ * Must not be called from an ISR.
+ *
+ * Example use:
+ * <pre>
+	for( ;; )
+	{
+		uint32_t ulReady = ulQueueGroupWait( xGroup, portMAX_DELAY );
+
+		if( ulReady & ( 1 << RX_BIT ) )
+		{
+			while( xQueueReceive( xRxQueue, &xPacket, 0 ) == pdTRUE )
+			{
+				prvHandlePacket( &xPacket );
+			}
+		}
+		if( ulReady & ( 1 << TIMER_BIT ) )
+		{
+			while( xSemaphoreTake( xTimerSemaphore, 0 ) == pdTRUE )
+			{
+				prvHandleTimer();
+			}
+		}
+	}
+ </pre>
+ *
+ * @return The bitmap of the members that were posted to since the previous
+ * call, plus the members returned by it that still hold items.  0 if none was
+ * before the block time expired.
+ */
+uint32_t ulQueueGroupWait( QueueGroupHandle_t xQueueGroup, TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
+
 /* Not public API functions. */
 void vQueueWaitForMessageRestricted( QueueHandle_t xQueue, TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
 BaseType_t xQueueGenericReset( QueueHandle_t xQueue, BaseType_t xNewQueue ) PRIVILEGED_FUNCTION;
@@ -0,0 +1,117 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FREERTOS_RINGBUF_H
+#define FREERTOS_RINGBUF_H
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ring buffer of variable-length items.
+ *
+ * With one producer and one consumer the buffer is lock-free: the producer only
+ * writes the write offset and the consumer only the read offset, published with
+ * release stores. The producer and consumer may be on different CPUs, and
+ * either of them may be an ISR.
+ *
+ * Items are written and read in place. The producer reserves space with
+ * pvRingbufferAcquire(), fills it and publishes it with vRingbufferCommit(). The
+ * consumer gets the oldest item with pvRingbufferReceive() and frees its space
+ * with vRingbufferReturnItem().
+ *
+ * A consumer waiting in pvRingbufferReceive() blocks on a semaphore which the
+ * producer only gives when the consumer is waiting, so committing an item
+ * usually costs no kernel call.
+ */
+
+typedef void * RingbufHandle_t;
+
+/* Flags for xRingbufferCreate. With these set, acquire/commit respectively
+receive/return take a spinlock for a few instructions, so several producers
+respectively consumers can share the buffer. The lock is not held between
+acquire and commit (receive and return), so each producer or consumer may keep
+its item for as long as it likes, and block meanwhile. Items are committed and
+returned in any order, but an item only becomes visible to the consumers once
+all items acquired before it are committed, and its space is only reused once
+all items received before it are returned. */
+#define ringbufMULTI_PRODUCER		( 1 << 0 )
+#define ringbufMULTI_CONSUMER		( 1 << 1 )
+
+/*
+ * Create a ring buffer with xBufferSize bytes of storage, rounded up to a
+ * multiple of 4. Every item uses 4 bytes for its length plus its size rounded
+ * up to a multiple of 4. Returns NULL if out of memory.
+ */
+RingbufHandle_t xRingbufferCreate( size_t xBufferSize, UBaseType_t uxFlags );
+
+/*
+ * Delete a ring buffer. No task may be waiting on it.
+ */
+void vRingbufferDelete( RingbufHandle_t xRingbuffer );
+
+/*
+ * Largest item that is guaranteed to fit into the ring buffer once it is
+ * empty, wherever its read and write offsets are.
+ */
+size_t xRingbufferGetMaxItemSize( RingbufHandle_t xRingbuffer );
+
+/*
+ * Reserve space for an item of xItemSize bytes. Returns a pointer to the item,
+ * 4-byte aligned, or NULL if there is not enough free space. Does not block and
+ * may be called from an ISR.
+ */
+void *pvRingbufferAcquire( RingbufHandle_t xRingbuffer, size_t xItemSize );
+
+/*
+ * Publish the item returned by the last pvRingbufferAcquire() call, and wake the
+ * consumer if it is waiting.
+ */
+void vRingbufferCommit( RingbufHandle_t xRingbuffer, void *pvItem );
+void vRingbufferCommitFromISR( RingbufHandle_t xRingbuffer, void *pvItem, BaseType_t *pxHigherPriorityTaskWoken );
+
+/*
+ * Copy xDataSize bytes into a new item. Returns pdFALSE if there is not enough
+ * free space.
+ */
+BaseType_t xRingbufferSend( RingbufHandle_t xRingbuffer, const void *pvData, size_t xDataSize );
+BaseType_t xRingbufferSendFromISR( RingbufHandle_t xRingbuffer, const void *pvData, size_t xDataSize, BaseType_t *pxHigherPriorityTaskWoken );
+
+/*
+ * Get the oldest item, waiting up to xTicksToWait for one to be committed.
+ * Returns a pointer to the item and stores its size in *pxItemSize, or returns
+ * NULL on timeout. The item stays in the buffer until vRingbufferReturnItem().
+ */
+void *pvRingbufferReceive( RingbufHandle_t xRingbuffer, size_t *pxItemSize, TickType_t xTicksToWait );
+
+/*
+ * Same as pvRingbufferReceive, but never blocks, for use in ISRs.
+ */
+void *pvRingbufferReceiveFromISR( RingbufHandle_t xRingbuffer, size_t *pxItemSize );
+
+/*
+ * Free the space of the item returned by the last receive call.
+ */
+void vRingbufferReturnItem( RingbufHandle_t xRingbuffer, void *pvItem );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERTOS_RINGBUF_H */
@@ -184,6 +184,28 @@ typedef QueueHandle_t SemaphoreHandle_t;
  */
 #define xSemaphoreCreateBinary() xQueueGenericCreate( ( UBaseType_t ) 1, semSEMAPHORE_QUEUE_ITEM_LENGTH, queueQUEUE_TYPE_BINARY_SEMAPHORE )
 
+/**
+ * semphr. h
+ * <pre>SemaphoreHandle_t xSemaphoreCreateBinaryStatic( StaticQueue_t *pxSemaphoreBuffer )</pre>
+ *
+ * Creates a binary semaphore like xSemaphoreCreateBinary(), but without
+ * allocating memory: the semaphore is held in *pxSemaphoreBuffer, which must
+ * remain valid until the semaphore is deleted.
+ *
+ * xSemaphoreCreateBinaryStatic() is only available when
+ * configSUPPORT_STATIC_ALLOCATION is set to 1 in FreeRTOSConfig.h.
+ *
+ * @param pxSemaphoreBuffer Buffer that holds the semaphore.
+ *
+ * @return Handle to the created semaphore, never NULL.
+ *
+ * \defgroup xSemaphoreCreateBinaryStatic xSemaphoreCreateBinaryStatic
+ * \ingroup Semaphores
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	#define xSemaphoreCreateBinaryStatic( pxSemaphoreBuffer ) xQueueGenericCreateStatic( ( UBaseType_t ) 1, semSEMAPHORE_QUEUE_ITEM_LENGTH, NULL, ( pxSemaphoreBuffer ), queueQUEUE_TYPE_BINARY_SEMAPHORE )
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 /**
  * semphr. h
  * <pre>xSemaphoreTake(
@@ -180,6 +180,43 @@ typedef struct xTASK_STATUS
 	uint16_t usStackHighWaterMark;	/* The minimum amount of stack space that has remained for the task since the task was created.  The closer this value is to zero the closer the task has come to overflowing its stack. */
 } TaskStatus_t;
 
+/* Used with the uxTaskGetRunTimeStats() function to return the run time of each
+task in the system. */
+typedef struct xTASK_RUN_TIME_STATS
+{
+	TaskHandle_t xHandle;			/* The handle of the task to which the rest of the information in the structure relates. */
+	const char *pcTaskName;			/* A pointer to the task's name.  This value will be invalid if the task was deleted since the structure was populated! */ /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	uint64_t ullRunTime[ portNUM_PROCESSORS ];	/* The time the task has spent running on each core, in run time counter counts (CPU cycles on the ESP32). */
+} TaskRunTimeStats_t;
+
+/* Used with the uxTaskGetRunTimeStats() function to return the run time of each
+core. */
+typedef struct xCORE_RUN_TIME_STATS
+{
+	uint64_t ullTotalRunTime;		/* The time accounted to tasks on the core since the scheduler started. */
+	uint64_t ullIdleRunTime;		/* The part of ullTotalRunTime spent in the idle task of the core. */
+} CoreRunTimeStats_t;
+
+/* Used with the uxTaskGetStackInfo() function to return the stack usage of
+each task in the system. */
+typedef struct xTASK_STACK_INFO
+{
+	TaskHandle_t xHandle;			/* The handle of the task to which the rest of the information in the structure relates. */
+	const char *pcTaskName;			/* A pointer to the task's name.  This value will be invalid if the task was deleted since the structure was populated! */ /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	UBaseType_t uxStackDepth;		/* The usable size of the stack, in words (bytes on the ESP32). */
+	UBaseType_t uxHighWaterMark;	/* The minimum amount of stack space that has remained for the task since the task was created, in words. */
+} TaskStackInfo_t;
+
+/* Used with the uxTaskGetSnapshotAll() function to return the TCB and the
+stack in use of each task in the system. */
+typedef struct xTASK_SNAPSHOT
+{
+	TaskHandle_t xHandle;			/* The handle of the task, which is the address of its TCB. */
+	StackType_t *pxTopOfStack;		/* The last item placed on the stack when the task was switched out.  Not current for a task running at the time of the snapshot. */
+	StackType_t *pxStack;			/* The lowest address of the stack. */
+	StackType_t *pxEndOfStack;		/* The highest valid address of the stack. */
+} TaskSnapshot_t;
+
 /* Possible return values for eTaskConfirmSleepModeStatus(). */
 typedef enum
 {
@@ -353,6 +390,61 @@ is used in assert() statements. */
 #define xTaskCreate( pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask ) xTaskGenericCreate( ( pvTaskCode ), ( pcName ), ( usStackDepth ), ( pvParameters ), ( uxPriority ), ( pxCreatedTask ), ( NULL ), ( NULL ), tskNO_AFFINITY )
 #define xTaskCreatePinnedToCore( pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, xCoreID ) xTaskGenericCreate( ( pvTaskCode ), ( pcName ), ( usStackDepth ), ( pvParameters ), ( uxPriority ), ( pxCreatedTask ), ( NULL ), ( NULL ), xCoreID )
 
+/**
+ * task. h
+ *<pre>
+ BaseType_t xTaskCreateStaticPinnedToCore(
+							  TaskFunction_t pvTaskCode,
+							  const char * const pcName,
+							  uint16_t usStackDepth,
+							  void *pvParameters,
+							  UBaseType_t uxPriority,
+							  StackType_t *puxStackBuffer,
+							  StaticTask_t *pxTaskBuffer,
+							  TaskHandle_t *pvCreatedTask,
+							  BaseType_t xCoreID
+						  );</pre>
+ *
+ * Create a new task like xTaskCreatePinnedToCore(), but without allocating
+ * any memory from the heap.  The stack and the TCB of the task are kept in
+ * the buffers provided by the caller, which must stay valid until the task
+ * has been deleted.  Only available if configSUPPORT_STATIC_ALLOCATION is
+ * set to 1 in FreeRTOSConfig.h.
+ *
+ * This is meant for tasks that are created once and must not fail, or must
+ * not fragment the heap, such as system tasks.  Internal RAM has to be used
+ * for the buffers.
+ *
+ * @param puxStackBuffer Buffer of at least usStackDepth StackType_t entries
+ * that is used as the stack of the task.
+ *
+ * @param pxTaskBuffer Buffer that holds the TCB of the task.
+ *
+ * See xTaskCreate() for the other parameters.
+ *
+ * @return pdPASS if the task was successfully created and added to a ready
+ * list, otherwise an error code defined in the file projdefs.h
+ *
+ * Example usage:
+   <pre>
+ #define STACK_SIZE 2048
+
+ static StackType_t xStack[ STACK_SIZE ];
+ static StaticTask_t xTaskBuffer;
+
+ void vOtherFunction( void )
+ {
+	 xTaskCreateStaticPinnedToCore( vTaskCode, "NAME", STACK_SIZE, NULL, tskIDLE_PRIORITY, xStack, &xTaskBuffer, NULL, 0 );
+ }
+   </pre>
+ * \defgroup xTaskCreateStatic xTaskCreateStatic
+ * \ingroup Tasks
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	BaseType_t xTaskCreateStaticPinnedToCore( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, StackType_t * const puxStackBuffer, StaticTask_t * const pxTaskBuffer, TaskHandle_t * const pxCreatedTask, const BaseType_t xCoreID ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	#define xTaskCreateStatic( pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, puxStackBuffer, pxTaskBuffer, pxCreatedTask ) xTaskCreateStaticPinnedToCore( ( pvTaskCode ), ( pcName ), ( usStackDepth ), ( pvParameters ), ( uxPriority ), ( puxStackBuffer ), ( pxTaskBuffer ), ( pxCreatedTask ), tskNO_AFFINITY )
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 /**
  * task. h
  *<pre>
@@ -1140,6 +1232,75 @@ char *pcTaskGetTaskName( TaskHandle_t xTaskToQuery ) PRIVILEGED_FUNCTION; /*lint
  */
 UBaseType_t uxTaskGetStackHighWaterMark( TaskHandle_t xTask ) PRIVILEGED_FUNCTION;
 
+/**
+ * task.h
+ * <PRE>UBaseType_t uxTaskGetStackInfo( TaskStackInfo_t * const pxTaskStackArray, const UBaseType_t uxArraySize );</PRE>
+ *
+ * INCLUDE_uxTaskGetStackHighWaterMark and configRECORD_STACK_HIGH_ADDRESS must
+ * be set to 1 in FreeRTOSConfig.h for this function to be available.
+ *
+ * Fills a TaskStackInfo_t structure with the stack size and high water mark
+ * of each task in the system, like uxTaskGetStackHighWaterMark() does for a
+ * single task.  A task that has never come close to its high water mark after
+ * it was exercised can be given a stack that is smaller by most of that
+ * amount.
+ *
+ * NOTE:  The stacks of all tasks are scanned while both cores are kept out of
+ * the scheduler, which takes roughly one CPU cycle for each unused stack
+ * byte.  It is meant for debugging and for sizing stacks, not to be called
+ * periodically in a product.
+ *
+ * @param pxTaskStackArray A pointer to an array of TaskStackInfo_t structures
+ * with at least one element for each task in the system (see
+ * uxTaskGetNumberOfTasks()).
+ *
+ * @param uxArraySize The number of elements in pxTaskStackArray.
+ *
+ * @return The number of TaskStackInfo_t structures that were populated.  This
+ * is zero if uxArraySize is too small.
+ *
+ * Example usage:
+   <pre>
+	void vStackReport( void )
+	{
+	TaskStackInfo_t xInfo[ 16 ];
+	UBaseType_t x, uxTasks;
+
+		uxTasks = uxTaskGetStackInfo( xInfo, 16 );
+		for( x = 0; x < uxTasks; x++ )
+		{
+			printf( "%-16s %5u of %5u bytes unused\n", xInfo[ x ].pcTaskName, xInfo[ x ].uxHighWaterMark, xInfo[ x ].uxStackDepth );
+		}
+	}
+	</pre>
+ */
+UBaseType_t uxTaskGetStackInfo( TaskStackInfo_t * const pxTaskStackArray, const UBaseType_t uxArraySize ) PRIVILEGED_FUNCTION;
+
+/**
+ * task.h
+ * <PRE>UBaseType_t uxTaskGetSnapshotAll( TaskSnapshot_t * const pxTaskSnapshotArray, const UBaseType_t uxArraySize, UBaseType_t * const pxTcbSize );</PRE>
+ *
+ * configRECORD_STACK_HIGH_ADDRESS must be set to 1 in FreeRTOSConfig.h for
+ * this function to be available.
+ *
+ * Fills a TaskSnapshot_t structure with the TCB and stack addresses of each
+ * task in the system, for the first uxArraySize tasks found.
+ *
+ * NOTE:  No lock is taken, so this is only meant for the panic handler, once
+ * the other core has been stopped.  The task lists may be corrupted at that
+ * point, so callers should check the addresses before using them.
+ *
+ * @param pxTaskSnapshotArray A pointer to an array of TaskSnapshot_t
+ * structures.
+ *
+ * @param uxArraySize The number of elements in pxTaskSnapshotArray.
+ *
+ * @param pxTcbSize Set to the size of a TCB, in bytes.
+ *
+ * @return The number of TaskSnapshot_t structures that were populated.
+ */
+UBaseType_t uxTaskGetSnapshotAll( TaskSnapshot_t * const pxTaskSnapshotArray, const UBaseType_t uxArraySize, UBaseType_t * const pxTcbSize ) PRIVILEGED_FUNCTION;
+
 /* When using trace macros it is sometimes necessary to include task.h before
 FreeRTOS.h.  When this is done TaskHookFunction_t will not yet have been defined,
 so the following two prototypes will cause a compilation error.  This can be
@@ -1305,6 +1466,64 @@ TaskHandle_t xTaskGetIdleTaskHandle( void );
  */
 UBaseType_t uxTaskGetSystemState( TaskStatus_t * const pxTaskStatusArray, const UBaseType_t uxArraySize, uint32_t * const pulTotalRunTime );
 
+/**
+ * configGENERATE_RUN_TIME_STATS must be defined as 1 in FreeRTOSConfig.h for
+ * uxTaskGetRunTimeStats() to be available.
+ *
+ * uxTaskGetRunTimeStats() takes a snapshot of the run time statistics: for each
+ * task the time it has spent running on each core, and for each core the total
+ * time and the time spent in its idle task.  Times are in run time counter
+ * counts, which are CPU cycles on the ESP32, and are 64 bits wide so they do
+ * not overflow.
+ *
+ * The accounting costs one counter read per context switch.  Time is added to
+ * a task when it is switched out, so the snapshot includes the time of the
+ * running task of the calling core up to now, but the time of the running task
+ * of the other core only up to the last context switch of that core.
+ *
+ * The idle percentage of a core over an interval is the difference of
+ * ullIdleRunTime between two snapshots, divided by the difference of
+ * ullTotalRunTime.
+ *
+ * NOTE:  All cores are kept out of the scheduler while the task lists are read,
+ * so this function is intended for monitoring at a low rate.
+ *
+ * @param pxTaskStatsArray A pointer to an array of TaskRunTimeStats_t
+ * structures with at least one element for each task in the system (see
+ * uxTaskGetNumberOfTasks()), or NULL to only read pxCoreStats.
+ *
+ * @param uxArraySize The number of elements in pxTaskStatsArray.
+ *
+ * @param pxCoreStats A pointer to an array of portNUM_PROCESSORS
+ * CoreRunTimeStats_t structures, indexed by core, or NULL.
+ *
+ * @return The number of TaskRunTimeStats_t structures that were populated.
+ * This is zero if pxTaskStatsArray is NULL or uxArraySize is too small.
+ *
+ * Example usage:
+   <pre>
+	void vIdleReport( void )
+	{
+	static CoreRunTimeStats_t xLast[ portNUM_PROCESSORS ];
+	CoreRunTimeStats_t xNow[ portNUM_PROCESSORS ];
+	uint64_t ullTotal;
+	BaseType_t x;
+
+		uxTaskGetRunTimeStats( NULL, 0, xNow );
+		for( x = 0; x < portNUM_PROCESSORS; x++ )
+		{
+			ullTotal = xNow[ x ].ullTotalRunTime - xLast[ x ].ullTotalRunTime;
+			if( ullTotal > 0 )
+			{
+				printf( "CPU%d idle %u%%\n", x, ( unsigned ) ( 100 * ( xNow[ x ].ullIdleRunTime - xLast[ x ].ullIdleRunTime ) / ullTotal ) );
+			}
+			xLast[ x ] = xNow[ x ];
+		}
+	}
+	</pre>
+ */
+UBaseType_t uxTaskGetRunTimeStats( TaskRunTimeStats_t * const pxTaskStatsArray, const UBaseType_t uxArraySize, CoreRunTimeStats_t * const pxCoreStats );
+
 /**
  * task. h
  * <PRE>void vTaskList( char *pcWriteBuffer );</PRE>
@@ -1691,7 +1910,7 @@ BaseType_t xTaskNotifyWait( uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClea
  * \defgroup xTaskNotifyGive xTaskNotifyGive
  * \ingroup TaskNotifications
  */
-#define xTaskNotifyGive( xTaskToNotify ) xTaskNotify( ( xTaskToNotify ), 0, eIncrement );
+#define xTaskNotifyGive( xTaskToNotify ) xTaskNotify( ( xTaskToNotify ), 0, eIncrement )
 
 /**
  * task. h
@@ -1933,6 +2152,21 @@ TickType_t uxTaskResetEventItemValue( void ) PRIVILEGED_FUNCTION;
  */
 TaskHandle_t xTaskGetCurrentTaskHandle( void ) PRIVILEGED_FUNCTION;
 
+/*
+ * Mark a task as safe to run while the flash cache is disabled: all its code
+ * is in IRAM and all data it accesses is in internal RAM.  Passing NULL marks
+ * the calling task.  With CONFIG_SPI_FLASH_IRAM_SAFE_TASKS enabled, such tasks
+ * keep running on the other CPU while a flash operation is in progress.
+ */
+void vTaskSetIramSafe( TaskHandle_t xTask, BaseType_t xIramSafe ) PRIVILEGED_FUNCTION;
+
+/*
+ * THIS FUNCTION MUST NOT BE USED FROM APPLICATION CODE.  IT IS USED BY THE
+ * FLASH DRIVER.  While set to pdTRUE, only tasks marked with vTaskSetIramSafe()
+ * are switched in on the calling CPU.
+ */
+void vTaskSetIramOnlyScheduling( BaseType_t xIramOnly ) PRIVILEGED_FUNCTION;
+
 /*
  * Capture the current time status for future reference.
  */
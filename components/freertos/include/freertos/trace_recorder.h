@@ -0,0 +1,97 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FREERTOS_TRACE_RECORDER_H
+#define FREERTOS_TRACE_RECORDER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Trace recorder for scheduler events, enabled with configUSE_TRACE_RECORDER.
+ *
+ * Every event is stored with the CCOUNT cycle counter of the core it happened
+ * on in a RAM ring buffer of that core. Each core only writes its own buffer,
+ * with interrupts masked for the few instructions it takes, so recording
+ * needs no lock and does not disturb the other core. When a buffer is full the
+ * oldest events are overwritten.
+ *
+ * vTraceRecorderDump prints the buffers as text on the console. The output is
+ * decoded into a timeline with components/freertos/trace_decode.py.
+ */
+
+/* Event codes. The numbers are part of the dump format read by
+trace_decode.py. */
+#define traceEVT_TASK_SWITCHED_IN		1	/* Argument: TCB of the task. */
+#define traceEVT_TASK_SWITCHED_OUT		2	/* Argument: TCB of the task. */
+#define traceEVT_TASK_READY				3	/* Argument: TCB added to a ready list. */
+#define traceEVT_QUEUE_BLOCK_SEND		4	/* Argument: queue. */
+#define traceEVT_QUEUE_BLOCK_RECEIVE	5	/* Argument: queue. */
+#define traceEVT_TASK_DELAY				6	/* Argument: ticks to delay, 0 for vTaskDelayUntil. */
+#define traceEVT_TASK_SUSPEND			7	/* Argument: TCB of the task. */
+#define traceEVT_TASK_DELETE			8	/* Argument: TCB of the task. */
+#define traceEVT_ISR_ENTER				9	/* Argument: interrupt number. */
+#define traceEVT_ISR_EXIT				10	/* Argument: interrupt number. */
+
+/*
+ * Record an event in the buffer of the calling core. Safe to call from tasks
+ * and from interrupts up to XCHAL_EXCM_LEVEL.
+ */
+void vTraceRecorderEvent( uint32_t ulEvent, uint32_t ulArg );
+
+/*
+ * Remember the name of a new task, so dumps can show names instead of TCB
+ * addresses. Called by traceTASK_CREATE.
+ */
+void vTraceRecorderTaskCreated( const void *pxTCB, const char *pcName );
+
+/*
+ * Recording runs from boot. vTraceRecorderStop freezes the buffers, for
+ * example right after the event of interest, and vTraceRecorderStart clears
+ * them and records again.
+ */
+void vTraceRecorderStart( void );
+void vTraceRecorderStop( void );
+
+/*
+ * Print the task names and the recorded events of all cores with ets_printf.
+ * Recording is stopped while the buffers are printed and resumed afterwards
+ * if it was running.
+ */
+void vTraceRecorderDump( void );
+
+/* Hook the recorder into the kernel trace macros. These expand inside tasks.c
+and queue.c. */
+#define traceTASK_SWITCHED_IN()					vTraceRecorderEvent( traceEVT_TASK_SWITCHED_IN, ( uint32_t ) pxCurrentTCB[ xPortGetCoreID() ] )
+#define traceTASK_SWITCHED_OUT()				vTraceRecorderEvent( traceEVT_TASK_SWITCHED_OUT, ( uint32_t ) pxCurrentTCB[ xPortGetCoreID() ] )
+#define traceMOVED_TASK_TO_READY_STATE( pxTCB )	vTraceRecorderEvent( traceEVT_TASK_READY, ( uint32_t ) ( pxTCB ) )
+#define traceBLOCKING_ON_QUEUE_SEND( pxQueue )	vTraceRecorderEvent( traceEVT_QUEUE_BLOCK_SEND, ( uint32_t ) ( pxQueue ) )
+#define traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue )	vTraceRecorderEvent( traceEVT_QUEUE_BLOCK_RECEIVE, ( uint32_t ) ( pxQueue ) )
+#define traceTASK_DELAY()						vTraceRecorderEvent( traceEVT_TASK_DELAY, ( uint32_t ) xTicksToDelay )
+#define traceTASK_DELAY_UNTIL()					vTraceRecorderEvent( traceEVT_TASK_DELAY, 0 )
+#define traceTASK_SUSPEND( pxTCB )				vTraceRecorderEvent( traceEVT_TASK_SUSPEND, ( uint32_t ) ( pxTCB ) )
+#define traceTASK_DELETE( pxTCB )				vTraceRecorderEvent( traceEVT_TASK_DELETE, ( uint32_t ) ( pxTCB ) )
+#define traceTASK_CREATE( pxNewTCB )			vTraceRecorderTaskCreated( ( pxNewTCB ), ( pxNewTCB )->pcTaskName )
+#define traceISR_ENTER( uxIntNum )				vTraceRecorderEvent( traceEVT_ISR_ENTER, ( uint32_t ) ( uxIntNum ) )
+#define traceISR_EXIT( uxIntNum )				vTraceRecorderEvent( traceEVT_ISR_EXIT, ( uint32_t ) ( uxIntNum ) )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERTOS_TRACE_RECORDER_H */
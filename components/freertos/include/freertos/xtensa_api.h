@@ -61,7 +61,8 @@ extern xt_exc_handler xt_set_exception_handler(int n, xt_exc_handler f);
 
 /*
 -------------------------------------------------------------------------------
-  Call this function to set a handler for the specified interrupt.
+  Call this function to set a handler for the specified interrupt. Each core
+  has its own handler table; the handler is set for the calling core only.
  
     n        - Interrupt number.
     f        - Handler function address, NULL to uninstall handler.
@@ -73,22 +74,36 @@ extern xt_handler xt_set_interrupt_handler(int n, xt_handler f, void * arg);
 
 /*
 -------------------------------------------------------------------------------
-  Call this function to enable the specified interrupts.
+  Call this function to check whether a handler is set for the specified
+  interrupt of the specified core.
+
+    n        - Interrupt number.
+    cpu      - Core number.
+-------------------------------------------------------------------------------
+*/
+extern int xt_int_has_handler(int n, int cpu);
+
+
+/*
+-------------------------------------------------------------------------------
+  Call this function to enable the specified interrupts on the calling core.
+  Returns the previous mask of enabled interrupts.
 
     mask     - Bit mask of interrupts to be enabled.
 -------------------------------------------------------------------------------
 */
-extern void xt_ints_on(unsigned int mask);
+extern unsigned int xt_ints_on(unsigned int mask);
 
 
 /*
 -------------------------------------------------------------------------------
-  Call this function to disable the specified interrupts.
+  Call this function to disable the specified interrupts on the calling core.
+  Returns the previous mask of enabled interrupts.
 
     mask     - Bit mask of interrupts to be disabled.
 -------------------------------------------------------------------------------
 */
-extern void xt_ints_off(unsigned int mask);
+extern unsigned int xt_ints_off(unsigned int mask);
 
 
 /*
@@ -27,6 +27,8 @@
 #include "soc/rtc_cntl_reg.h"
 
 #include "gdbstub.h"
+#include "esp_console.h"
+#include "esp_core_dump.h"
 
 /*
 Panic handlers; these get called when an unhandled exception occurs or the assembly-level
@@ -130,11 +132,33 @@ static int inOCDMode() {
 #endif
 }
 
+#if CONFIG_FREERTOS_WATCHPOINT_END_OF_STACK
+//Returns true if the debug exception that got us here was raised by the stack watchpoint,
+//see vPortSetStackWatchpoint().
+static int stackWatchpointTriggered() {
+	int debugcause;
+	asm("rsr.debugcause %0":"=r"(debugcause));
+	//DBNUM, the number of the watchpoint that triggered, is in bits 8-11.
+	return (debugcause&XCHAL_DEBUGCAUSE_DBREAK_MASK) && ((debugcause>>8)&0xf)==1;
+}
+#endif
+
 void panicHandler(XtExcFrame *frame) {
 	haltOtherCore();
+#if CONFIG_CONSOLE_UART_BUFFERED
+	esp_console_panic_flush();
+#endif
 	panicPutStr("Guru Meditation Error: Core ");
 	panicPutDec(xPortGetCoreID());
-	panicPutStr(" panic'ed.\r\n");
+	panicPutStr(" panic'ed");
+#if CONFIG_FREERTOS_WATCHPOINT_END_OF_STACK
+	if (stackWatchpointTriggered()) {
+		panicPutStr(" (Stack canary watchpoint triggered in task ");
+		panicPutStr(pcTaskGetTaskName(NULL));
+		panicPutStr(")");
+	}
+#endif
+	panicPutStr(".\r\n");
 
 	if (inOCDMode()) {
 		asm("break.n 1");
@@ -157,6 +181,9 @@ void xt_unhandled_exception(XtExcFrame *frame) {
 	int x;
 
 	haltOtherCore();
+#if CONFIG_CONSOLE_UART_BUFFERED
+	esp_console_panic_flush();
+#endif
 	panicPutStr("Guru Meditation Error of type ");
 	x=regs[20];
 	if (x<40) panicPutStr(edesc[x]); else panicPutStr("Unknown");
@@ -201,6 +228,14 @@ void commonErrorHandler(XtExcFrame *frame) {
 		}
 		panicPutStr("\r\n");
 	}
+#if CONFIG_ESP32_ENABLE_COREDUMP
+	panicPutStr("Writing core dump to flash... ");
+	x=esp_core_dump_to_flash(frame);
+	if (x==ESP_OK) panicPutStr("done.\r\n");
+	else if (x==ESP_ERR_INVALID_STATE) panicPutStr("kept the earlier dump.\r\n");
+	else if (x==ESP_ERR_NOT_FOUND) panicPutStr("no coredump partition.\r\n");
+	else panicPutStr("failed.\r\n");
+#endif
 #if CONFIG_FREERTOS_PANIC_GDBSTUB
 	panicPutStr("Entering gdb stub now.\r\n");
 	gdbstubPanicHandler(frame);
@@ -103,6 +103,13 @@
 
 #include "panic.h"
 
+#if configUSE_TICKLESS_IDLE != 0
+#include "xtensa_api.h"
+#include "xtensa/hal.h"
+#include "soc/soc.h"
+#include "soc/dport_reg.h"
+#endif
+
 /* Defined in portasm.h */
 extern void _frxt_tick_timer_init(void);
 
@@ -115,6 +122,20 @@ extern void _xt_coproc_init(void);
 unsigned port_xSchedulerRunning[portNUM_PROCESSORS] = {0}; // Duplicate of inaccessible xSchedulerRunning; needed at startup to avoid counting nesting
 unsigned port_interruptNesting[portNUM_PROCESSORS] = {0};  // Interrupt nesting level
 
+#if configUSE_TICKLESS_IDLE != 0
+static void prvTicklessInit( void );
+static void prvEndSuppression( TickType_t xElapsed );
+
+/* CCOUNT values compare correctly within half the range of the counter. */
+#define portMAX_SUPPRESSED_TICKS	( 0x7FFFFFFFUL / XT_TICK_DIVISOR )
+
+/* Ticks a core has suppressed while it sleeps, 0 while it is awake. Core 0
+only starts sleeping, and the other cores only stop, while holding
+xSleepMux, so core 0 never sleeps while another core runs tasks. */
+static volatile TickType_t xSuppressedTicks[ portNUM_PROCESSORS ] = { 0 };
+static portMUX_TYPE xSleepMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
 /*-----------------------------------------------------------*/
 
 // User exception dispatcher when exiting
@@ -205,6 +226,10 @@ BaseType_t xPortStartScheduler( void )
 	/* Setup the hardware to generate the tick. */
 	_frxt_tick_timer_init();
 
+	#if configUSE_TICKLESS_IDLE != 0
+	prvTicklessInit();
+	#endif
+
 	port_xSchedulerRunning[xPortGetCoreID()] = 1;
 
 	// Cannot be directly called from C; never returns
@@ -220,12 +245,23 @@ BaseType_t xPortSysTickHandler( void )
 	BaseType_t ret;
 
 	portbenchmarkIntLatency();
+	traceISR_ENTER( XT_TIMER_INTNUM );
+	#if configUSE_TICKLESS_IDLE != 0
+	if( xSuppressedTicks[ xPortGetCoreID() ] != 0 )
+	{
+		/* The timer fired at the end of a tick suppression. Account for the
+		ticks that were skipped, then handle this one as usual. */
+		prvEndSuppression( xSuppressedTicks[ xPortGetCoreID() ] - 1 );
+	}
+	#endif
+
 	ret = xTaskIncrementTick();
 	if( ret != pdFALSE )
 	{
 		portYIELD_FROM_ISR();
 	}
 
+	traceISR_EXIT( XT_TIMER_INTNUM );
 	return ret;
 }
 /*-----------------------------------------------------------*/
@@ -254,6 +290,20 @@ void vPortAssertIfInISR()
 }
 
 
+void vPortSetStackWatchpoint( void* pxStackStart ) {
+	//A watchpoint covers a naturally aligned power of two sized area, so the 32 bytes
+	//watched are the first aligned 32 bytes inside the stack.
+	uint32_t addr=((uint32_t)pxStackStart+31)&(~31);
+	//DBREAKC: break on stores, ignore the low 5 address bits.
+	uint32_t dbreakc=XCHAL_DBREAKC_STOREBREAK_MASK|(0x3F<<5 & XCHAL_DBREAKC_MASK_MASK);
+	asm volatile(
+		"wsr.dbreaka1 %0\n" \
+		"wsr.dbreakc1 %1\n" \
+		"isync\n" \
+		::"r"(addr),"r"(dbreakc));
+}
+
+
 /*
  * Wrapper for the Xtensa compare-and-set instruction. This subroutine will atomically compare
  * *mux to compare, and if it's the same, will set *mux to set. It will return the old value
@@ -275,6 +325,101 @@ uint32_t uxPortCompareSet(volatile uint32_t *mux, uint32_t compare, uint32_t set
 	return set;
 }
 
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+
+#define portMUX_STATS_MAX_REGISTERED	16
+#define portMUX_SPIN_WARN_CYCLES		(CONFIG_FREERTOS_PORTMUX_SPIN_WARN_US * (XT_CLOCK_FREQ / 1000000))
+
+static portMUX_TYPE *muxStatsRegistered[portMUX_STATS_MAX_REGISTERED];
+static portMUX_TYPE muxStatsRegisterMux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Cycles each core spent spinning on any mux, and the mux it spun on longest. These
+are only written by their own core, with interrupts disabled. */
+static uint64_t muxTotalSpinCycles[portNUM_PROCESSORS];
+static uint32_t muxMaxSpinCycles[portNUM_PROCESSORS];
+static portMUX_TYPE *muxMaxSpinMux[portNUM_PROCESSORS];
+
+/*
+ * Called in the spin loop of vPortCPUAcquireMutex, while the other core holds the mux.
+ */
+static inline void __attribute__((always_inline)) prvMuxStatsSpinning(portMUX_TYPE *mux, uint32_t spinStart, uint32_t res, portBASE_TYPE *warned) {
+#if CONFIG_FREERTOS_PORTMUX_SPIN_WARN_US > 0
+	if (!*warned && xthal_get_ccount()-spinStart > portMUX_SPIN_WARN_CYCLES) {
+		ets_printf("WARNING: core %d spinning on mux %p (%s) for more than %d us, held by core %d\n", xPortGetCoreID(), mux,
+				mux->name ? mux->name : "unregistered", CONFIG_FREERTOS_PORTMUX_SPIN_WARN_US, (res&portMUX_VAL_MASK)>>portMUX_VAL_SHIFT);
+		*warned=pdTRUE;
+	}
+#endif
+}
+
+/*
+ * Called once the mux has been taken non-recursively. The mux protects its own statistics.
+ */
+static inline void __attribute__((always_inline)) prvMuxStatsLocked(portMUX_TYPE *mux, uint32_t spinStart, portBASE_TYPE contended) {
+	uint32_t now=xthal_get_ccount();
+	uint32_t spin=now-spinStart;
+	int core=xPortGetCoreID();
+	mux->lockedAt=now;
+	mux->acquireCount++;
+	if (contended) {
+		mux->contendedCount++;
+		mux->totalSpinCycles+=spin;
+		if (spin>mux->maxSpinCycles) mux->maxSpinCycles=spin;
+		muxTotalSpinCycles[core]+=spin;
+		if (spin>muxMaxSpinCycles[core]) {
+			muxMaxSpinCycles[core]=spin;
+			muxMaxSpinMux[core]=mux;
+		}
+	}
+}
+
+/*
+ * Called just before the mux is released by its last non-recursive holder.
+ */
+static inline void __attribute__((always_inline)) prvMuxStatsUnlocking(portMUX_TYPE *mux) {
+	uint32_t hold=xthal_get_ccount()-mux->lockedAt;
+	mux->totalHoldCycles+=hold;
+	if (hold>mux->maxHoldCycles) mux->maxHoldCycles=hold;
+}
+
+portBASE_TYPE xPortCPUMutexRegister(portMUX_TYPE *mux, const char *name) {
+	portBASE_TYPE ret=pdFALSE;
+	int i;
+	portENTER_CRITICAL(&muxStatsRegisterMux);
+	for (i=0; i<portMUX_STATS_MAX_REGISTERED; i++) {
+		if (muxStatsRegistered[i]==NULL || muxStatsRegistered[i]==mux) {
+			muxStatsRegistered[i]=mux;
+			mux->name=name;
+			ret=pdTRUE;
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&muxStatsRegisterMux);
+	return ret;
+}
+
+void vPortCPUMutexStatsDump(void) {
+	const uint32_t cyclesPerUs=XT_CLOCK_FREQ/1000000;
+	int i;
+	/* The counters are read without taking the muxes, so a line may mix values from
+	before and after a concurrent critical section. */
+	ets_printf("%-16s %10s %10s %10s %12s %10s %12s\n", "mux", "acquired", "contended", "max spin", "total spin", "max hold", "total hold");
+	ets_printf("%-16s %10s %10s %10s %12s %10s %12s\n", "", "", "", "(cycles)", "(us)", "(cycles)", "(us)");
+	for (i=0; i<portMUX_STATS_MAX_REGISTERED && muxStatsRegistered[i]!=NULL; i++) {
+		portMUX_TYPE *mux=muxStatsRegistered[i];
+		ets_printf("%-16s %10u %10u %10u %12u %10u %12u\n", mux->name ? mux->name : "unregistered", mux->acquireCount, mux->contendedCount,
+				mux->maxSpinCycles, (uint32_t)(mux->totalSpinCycles/cyclesPerUs),
+				mux->maxHoldCycles, (uint32_t)(mux->totalHoldCycles/cyclesPerUs));
+	}
+	for (i=0; i<portNUM_PROCESSORS; i++) {
+		ets_printf("core %d: spun %u us on all muxes, longest %u cycles on mux %p (%s)\n", i,
+				(uint32_t)(muxTotalSpinCycles[i]/cyclesPerUs), muxMaxSpinCycles[i], muxMaxSpinMux[i],
+				(muxMaxSpinMux[i] && muxMaxSpinMux[i]->name) ? muxMaxSpinMux[i]->name : "unregistered");
+	}
+}
+
+#endif //CONFIG_FREERTOS_PORTMUX_STATS
+
 /*
  * For kernel use: Initialize a per-CPU mux. Mux will be initialized unlocked.
  */
@@ -283,6 +428,15 @@ void vPortCPUInitializeMutex(portMUX_TYPE *mux) {
 	ets_printf("Initializing mux %p\n", mux);
 	mux->lastLockedFn="(never locked)";
 	mux->lastLockedLine=-1;
+#endif
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+	mux->name=NULL;
+	mux->totalSpinCycles=0;
+	mux->totalHoldCycles=0;
+	mux->acquireCount=0;
+	mux->contendedCount=0;
+	mux->maxSpinCycles=0;
+	mux->maxHoldCycles=0;
 #endif
 	mux->mux=portMUX_FREE_VAL;
 }
@@ -308,6 +462,11 @@ void vPortCPUAcquireMutex(portMUX_TYPE *mux) {
 #endif
 
 	irqStatus=portENTER_CRITICAL_NESTED();
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+	uint32_t spinStart=xthal_get_ccount();
+	portBASE_TYPE contended=pdFALSE;
+	portBASE_TYPE warned=pdFALSE;
+#endif
 	do {
 		//Lock mux if it's currently unlocked
 		res=uxPortCompareSet(&mux->mux, portMUX_FREE_VAL, (xPortGetCoreID()<<portMUX_VAL_SHIFT)|portMUX_MAGIC_VAL);
@@ -322,6 +481,12 @@ void vPortCPUAcquireMutex(portMUX_TYPE *mux) {
 			mux->mux=portMUX_MAGIC_VAL|(recCnt<<portMUX_CNT_SHIFT)|(xPortGetCoreID()<<portMUX_VAL_SHIFT);
 			break;
 		}
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+		if (res!=portMUX_FREE_VAL) {
+			contended=pdTRUE;
+			prvMuxStatsSpinning(mux, spinStart, res, &warned);
+		}
+#endif
 #ifdef CONFIG_FREERTOS_PORTMUX_DEBUG
         cnt--;
 		if (cnt==0) {
@@ -335,6 +500,9 @@ void vPortCPUAcquireMutex(portMUX_TYPE *mux) {
 		mux->lastLockedFn=fnName;
 		mux->lastLockedLine=line;
 	}
+#endif
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+	if (res==portMUX_FREE_VAL) prvMuxStatsLocked(mux, spinStart, contended);
 #endif
 	portEXIT_CRITICAL_NESTED(irqStatus);
 }
@@ -360,6 +528,10 @@ portBASE_TYPE vPortCPUReleaseMutex(portMUX_TYPE *mux) {
 	mux->lastLockedFn=fnName;
 	mux->lastLockedLine=line;
 	if ( (mux->mux & portMUX_MAGIC_MASK) != portMUX_MAGIC_VAL ) ets_printf("ERROR: vPortCPUReleaseMutex: mux %p is uninitialized (0x%X)!\n", mux, mux->mux);
+#endif
+#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+	//Only we can change the mux while we hold it, so this can be checked before it's released.
+	if (mux->mux==((xPortGetCoreID()<<portMUX_VAL_SHIFT)|portMUX_MAGIC_VAL)) prvMuxStatsUnlocking(mux);
 #endif
 	//Unlock mux if it's currently locked with a recurse count of 0
 	res=uxPortCompareSet(&mux->mux, (xPortGetCoreID()<<portMUX_VAL_SHIFT)|portMUX_MAGIC_VAL, portMUX_FREE_VAL);
@@ -390,10 +562,233 @@ portBASE_TYPE vPortCPUReleaseMutex(portMUX_TYPE *mux) {
 	return ret;
 }
 
+/*
+ * Task owned lock, see portYIELDLOCK_TYPE in portmacro.h.
+ */
+void vPortYieldLockInitialize(portYIELDLOCK_TYPE *lock) {
+	vPortCPUInitializeMutex(&lock->mux);
+	lock->owner=NULL;
+	lock->count=0;
+}
+
+//Takes the lock if it is free or already ours. Must be called with lock->mux held.
+static portBASE_TYPE prvYieldLockTake(portYIELDLOCK_TYPE *lock, void *self) {
+	if (lock->owner==NULL) {
+		lock->owner=self;
+		lock->count=0;
+		//Counted like a mutex, so an inherited priority is kept until all of them are released.
+		(void) pvTaskIncrementMutexHeldCount();
+		return pdTRUE;
+	}
+	if (lock->owner==self) {
+		lock->count++;
+		return pdTRUE;
+	}
+	return pdFALSE;
+}
+
+void vPortYieldLockAcquire(portYIELDLOCK_TYPE *lock) {
+	void *self=xTaskGetCurrentTaskHandle();
+	int tries=0;
+	portBASE_TYPE taken;
+	portASSERT_IF_IN_ISR();
+	for (;;) {
+		portENTER_CRITICAL(&lock->mux);
+		taken=prvYieldLockTake(lock, self);
+		if (!taken && ++tries>=portYIELDLOCK_SPIN_TRIES) {
+			//The owner can't go away while we hold lock->mux. Lend it our priority so it
+			//gets to run and release the lock, even if it's a lower priority task on this core.
+			vTaskPriorityInherit(lock->owner);
+		}
+		portEXIT_CRITICAL(&lock->mux);
+		if (taken) return;
+		if (tries>=portYIELDLOCK_SPIN_TRIES) {
+			tries=0;
+			taskYIELD();
+		}
+	}
+}
+
+portBASE_TYPE xPortYieldLockTryAcquire(portYIELDLOCK_TYPE *lock) {
+	portBASE_TYPE taken;
+	portASSERT_IF_IN_ISR();
+	portENTER_CRITICAL(&lock->mux);
+	taken=prvYieldLockTake(lock, xTaskGetCurrentTaskHandle());
+	portEXIT_CRITICAL(&lock->mux);
+	return taken;
+}
+
+void vPortYieldLockRelease(portYIELDLOCK_TYPE *lock) {
+	void *self=xTaskGetCurrentTaskHandle();
+	portBASE_TYPE yield=pdFALSE;
+	portENTER_CRITICAL(&lock->mux);
+	configASSERT(lock->owner==self);
+	if (lock->count>0) {
+		lock->count--;
+	} else {
+		lock->owner=NULL;
+		//Drops a priority inherited from a waiting task, if no other lock or mutex is held.
+		yield=xTaskPriorityDisinherit(self);
+	}
+	portEXIT_CRITICAL(&lock->mux);
+	if (yield) taskYIELD();
+}
+
 #if CONFIG_FREERTOS_BREAK_ON_SCHEDULER_START_JTAG
 void vPortFirstTaskHook(TaskFunction_t function) {
 	setBreakpointIfJtag(function);
 }
 #endif
 
+/*-----------------------------------------------------------*/
+
+#if configUSE_TICKLESS_IDLE != 0
+
+/*
+ * A core waiting in tickless idle is woken from the other core through the
+ * cross-CPU interrupt. The interrupt only has to end the waiti; the handler
+ * just acknowledges it.
+ */
+static void prvWakeCore( int core )
+{
+	WRITE_PERI_REG( DPORT_CPU_INTR_FROM_CPU_0_REG + 4 * core, DPORT_CPU_INTR_FROM_CPU_0 );
+}
+
+static void prvWakeInterrupt( void *arg )
+{
+	WRITE_PERI_REG( DPORT_CPU_INTR_FROM_CPU_0_REG + 4 * xPortGetCoreID(), 0 );
+}
+
+static void prvTicklessInit( void )
+{
+	int core = xPortGetCoreID();
+
+	intr_matrix_set( core, ETS_FROM_CPU_INTR0_SOURCE + core, ETS_FROM_CPU_INUM );
+	xt_set_interrupt_handler( ETS_FROM_CPU_INUM, prvWakeInterrupt, NULL );
+	xt_ints_on( 1 << ETS_FROM_CPU_INUM );
+}
+
+void vPortWakeSleepingCore( BaseType_t xCoreID )
+{
+	int core;
+
+	for( core = 0; core < portNUM_PROCESSORS; core++ )
+	{
+		if( core != xPortGetCoreID() && ( xCoreID == tskNO_AFFINITY || xCoreID == core ) && xSuppressedTicks[ core ] != 0 )
+		{
+			prvWakeCore( core );
+		}
+	}
+}
+
+/* Called with interrupts disabled when a core stops sleeping. */
+static void prvEndSuppression( TickType_t xElapsed )
+{
+	BaseType_t xWaitForCore0;
+
+	if( xPortGetCoreID() == 0 )
+	{
+		/* Fix up the tick count before the other cores can see this core awake. */
+		if( xElapsed != 0 )
+		{
+			vTaskStepTick( xElapsed );
+		}
+		xSuppressedTicks[ 0 ] = 0;
+		return;
+	}
+
+	portENTER_CRITICAL_ISR( &xSleepMux );
+	xSuppressedTicks[ xPortGetCoreID() ] = 0;
+	xWaitForCore0 = ( xSuppressedTicks[ 0 ] != 0 );
+	portEXIT_CRITICAL_ISR( &xSleepMux );
+
+	if( xWaitForCore0 )
+	{
+		/* The tick count is stale while core 0 sleeps. Wake it up and wait
+		until it has corrected the count before running tasks here. */
+		prvWakeCore( 0 );
+		while( xSuppressedTicks[ 0 ] != 0 )
+		{
+		}
+	}
+}
+
+void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+{
+	const int core = xPortGetCoreID();
+	uint32_t ulFirstTick, ulNextTick;
+	TickType_t xElapsed;
+	BaseType_t xCanSleep = pdTRUE;
+	unsigned irqstate;
+	int i;
+
+	if( xExpectedIdleTime > portMAX_SUPPRESSED_TICKS )
+	{
+		xExpectedIdleTime = portMAX_SUPPRESSED_TICKS;
+	}
+
+	irqstate = portENTER_CRITICAL_NESTED();
+
+	portENTER_CRITICAL_ISR( &xSleepMux );
+	if( core == 0 )
+	{
+		for( i = 1; i < portNUM_PROCESSORS; i++ )
+		{
+			if( xSuppressedTicks[ i ] == 0 )
+			{
+				xCanSleep = pdFALSE;
+			}
+		}
+	}
+	if( xCanSleep )
+	{
+		xSuppressedTicks[ core ] = xExpectedIdleTime;
+	}
+	portEXIT_CRITICAL_ISR( &xSleepMux );
+
+	if( !xCanSleep )
+	{
+		portEXIT_CRITICAL_NESTED( irqstate );
+		return;
+	}
+
+	/* From here on a task readied for this core also raises the wake-up
+	interrupt, so anything that became ready before is found by this check. */
+	ulFirstTick = xthal_get_ccompare( XT_TIMER_INDEX );
+	if( eTaskConfirmSleepModeStatus() == eAbortSleep || ( int32_t )( xthal_get_ccount() - ulFirstTick ) >= 0 )
+	{
+		prvEndSuppression( 0 );
+		portEXIT_CRITICAL_NESTED( irqstate );
+		return;
+	}
+
+	/* CCOMPARE holds the time of the next tick; move it to the last tick of
+	the idle period. The tick interrupt then ends the suppression. */
+	xthal_set_ccompare( XT_TIMER_INDEX, ulFirstTick + ( xExpectedIdleTime - 1 ) * XT_TICK_DIVISOR );
+
+	__asm__ volatile ( "waiti 0" );
+	portENTER_CRITICAL_NESTED();
+
+	if( xSuppressedTicks[ core ] != 0 )
+	{
+		/* Woken up early by another interrupt. Program the next tick that is
+		still in the future and count the ones that have passed. */
+		do
+		{
+			int32_t lSinceFirst = ( int32_t )( xthal_get_ccount() - ulFirstTick );
+			xElapsed = ( lSinceFirst < 0 ) ? 0 : ( TickType_t )( lSinceFirst / XT_TICK_DIVISOR ) + 1;
+			ulNextTick = ulFirstTick + xElapsed * XT_TICK_DIVISOR;
+			xthal_set_ccompare( XT_TIMER_INDEX, ulNextTick );
+		} while( ( int32_t )( xthal_get_ccount() - ulNextTick ) >= 0 );
+
+		if( xElapsed > xExpectedIdleTime )
+		{
+			xElapsed = xExpectedIdleTime;
+		}
+		prvEndSuppression( xElapsed );
+	}
+
+	portEXIT_CRITICAL_NESTED( irqstate );
+}
 
+#endif /* configUSE_TICKLESS_IDLE */
@@ -175,14 +175,44 @@ typedef struct QueueDefinition
 		struct QueueDefinition *pxQueueSetContainer;
 	#endif
 
+	#if ( configUSE_QUEUE_GROUPS == 1 )
+		struct QueueGroupDefinition *pxQueueGroup;	/*< The queue group the queue is a member of, or NULL. */
+		uint32_t ulQueueGroupBit;					/*< The bit standing for the queue in the group's bitmaps. */
+	#endif
+
 	portMUX_TYPE mux;
 
+	#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		uint8_t ucStaticallyAllocated;	/*< Set to pdTRUE if the memory of the queue was provided by the application, so no attempt is made to free it when the queue is deleted. */
+	#endif
+
 } xQUEUE;
 
 /* The old xQUEUE name is maintained above then typedefed to the new Queue_t
 name below to enable the use of older kernel aware debuggers. */
 typedef xQUEUE Queue_t;
 
+#if ( configUSE_QUEUE_GROUPS == 1 )
+
+	/*
+	 * A queue group lets one task wait for any of up to
+	 * queueGROUP_MAX_MEMBERS queues and semaphores.  Posting to a member sets
+	 * its bit in ulReady; only when the owner task is blocked waiting is it
+	 * notified, once, however many posts follow before it runs.  Nothing is
+	 * copied, so the group needs no storage proportional to the members.
+	 */
+	typedef struct QueueGroupDefinition
+	{
+		volatile uint32_t ulReady;			/*< Bit n is set when member n was posted to since the last wait. */
+		uint32_t ulReturned;				/*< Members returned by the last wait, checked again by the next one. */
+		uint32_t ulMembers;					/*< Bits in use. */
+		TaskHandle_t xWaitingTask;			/*< Task blocked in ulQueueGroupWait() to be notified, or NULL. */
+		Queue_t *pxMembers[ queueGROUP_MAX_MEMBERS ];
+		portMUX_TYPE mux;
+	} QueueGroup_t;
+
+#endif /* configUSE_QUEUE_GROUPS */
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -247,6 +277,12 @@ static BaseType_t prvCopyDataToQueue( Queue_t * const pxQueue, const void *pvIte
  */
 static void prvCopyDataFromQueue( Queue_t * const pxQueue, void * const pvBuffer ) PRIVILEGED_FUNCTION;
 
+/*
+ * Initialises the members of a queue that was just allocated.  pucQueueStorage
+ * points to the storage area for the items, it is not used if uxItemSize is 0.
+ */
+static void prvInitialiseNewQueue( Queue_t * const pxNewQueue, const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, int8_t * const pucQueueStorage, const uint8_t ucQueueType ) PRIVILEGED_FUNCTION;
+
 #if ( configUSE_QUEUE_SETS == 1 )
 	/*
 	 * Checks to see if a queue is a member of a queue set, and if so, notifies
@@ -255,6 +291,16 @@ static void prvCopyDataFromQueue( Queue_t * const pxQueue, void * const pvBuffer
 	static BaseType_t prvNotifyQueueSetContainer( const Queue_t * const pxQueue, const BaseType_t xCopyPosition ) PRIVILEGED_FUNCTION;
 #endif
 
+#if ( configUSE_QUEUE_GROUPS == 1 )
+	/*
+	 * Marks a queue that was posted to as ready in its queue group, waking the
+	 * task waiting on the group if there is one.  Returns pdTRUE if that task
+	 * has a higher priority than the current one.  Called with the queue's
+	 * mux held.
+	 */
+	static BaseType_t prvNotifyQueueGroup( const Queue_t * const pxQueue ) PRIVILEGED_FUNCTION;
+#endif
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -365,38 +411,15 @@ int8_t *pcAllocatedBuffer;
 	{
 		pxNewQueue = ( Queue_t * ) pcAllocatedBuffer; /*lint !e826 MISRA The buffer cannot be to small because it was dimensioned by sizeof( Queue_t ) + xQueueSizeInBytes. */
 
-		if( uxItemSize == ( UBaseType_t ) 0 )
-		{
-			/* No RAM was allocated for the queue storage area, but PC head
-			cannot be set to NULL because NULL is used as a key to say the queue
-			is used as a mutex.  Therefore just set pcHead to point to the queue
-			as a benign value that is known to be within the memory map. */
-			pxNewQueue->pcHead = ( int8_t * ) pxNewQueue;
-		}
-		else
-		{
-			/* Jump past the queue structure to find the location of the queue
-			storage area - adding the padding bytes to get a better alignment. */
-			pxNewQueue->pcHead = pcAllocatedBuffer + sizeof( Queue_t );
-		}
-
-		/* Initialise the queue members as described above where the queue type
-		is defined. */
-		pxNewQueue->uxLength = uxQueueLength;
-		pxNewQueue->uxItemSize = uxItemSize;
-		( void ) xQueueGenericReset( pxNewQueue, pdTRUE );
+		/* Jump past the queue structure to find the location of the queue
+		storage area - adding the padding bytes to get a better alignment. */
+		prvInitialiseNewQueue( pxNewQueue, uxQueueLength, uxItemSize, pcAllocatedBuffer + sizeof( Queue_t ), ucQueueType );
 
-		#if ( configUSE_TRACE_FACILITY == 1 )
+		#if( configSUPPORT_STATIC_ALLOCATION == 1 )
 		{
-			pxNewQueue->ucQueueType = ucQueueType;
+			pxNewQueue->ucStaticallyAllocated = pdFALSE;
 		}
-		#endif /* configUSE_TRACE_FACILITY */
-
-		#if( configUSE_QUEUE_SETS == 1 )
-		{
-			pxNewQueue->pxQueueSetContainer = NULL;
-		}
-		#endif /* configUSE_QUEUE_SETS */
+		#endif /* configSUPPORT_STATIC_ALLOCATION */
 
 		traceQUEUE_CREATE( pxNewQueue );
 		xReturn = pxNewQueue;
@@ -412,6 +435,86 @@ int8_t *pcAllocatedBuffer;
 }
 /*-----------------------------------------------------------*/
 
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+	QueueHandle_t xQueueGenericCreateStatic( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue, const uint8_t ucQueueType )
+	{
+	Queue_t *pxNewQueue;
+
+		configASSERT( uxQueueLength > ( UBaseType_t ) 0 );
+		configASSERT( pxStaticQueue != NULL );
+
+		/* A storage area must be provided if the items have a size, and only
+		then. */
+		configASSERT( !( ( pucQueueStorage != NULL ) && ( uxItemSize == 0 ) ) );
+		configASSERT( !( ( pucQueueStorage == NULL ) && ( uxItemSize != 0 ) ) );
+
+		/* StaticQueue_t has to be able to hold a Queue_t, see its definition in
+		FreeRTOS.h. */
+		configASSERT( sizeof( StaticQueue_t ) == sizeof( Queue_t ) );
+
+		pxNewQueue = ( Queue_t * ) pxStaticQueue; /*lint !e740 Unusual cast is ok as the structures are designed to have the same alignment, and the size is checked by an assert. */
+
+		/* The storage area of a queue is normally one byte longer than needed,
+		as pcTail is never written to, so uxQueueLength * uxItemSize bytes are
+		enough here. */
+		prvInitialiseNewQueue( pxNewQueue, uxQueueLength, uxItemSize, ( int8_t * ) pucQueueStorage, ucQueueType );
+		pxNewQueue->ucStaticallyAllocated = pdTRUE;
+
+		traceQUEUE_CREATE( pxNewQueue );
+
+		return pxNewQueue;
+	}
+
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+/*-----------------------------------------------------------*/
+
+static void prvInitialiseNewQueue( Queue_t * const pxNewQueue, const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, int8_t * const pucQueueStorage, const uint8_t ucQueueType )
+{
+	/* Remove compiler warnings about unused parameters should
+	configUSE_TRACE_FACILITY not be set to 1. */
+	( void ) ucQueueType;
+
+	if( uxItemSize == ( UBaseType_t ) 0 )
+	{
+		/* No RAM was allocated for the queue storage area, but PC head
+		cannot be set to NULL because NULL is used as a key to say the queue
+		is used as a mutex.  Therefore just set pcHead to point to the queue
+		as a benign value that is known to be within the memory map. */
+		pxNewQueue->pcHead = ( int8_t * ) pxNewQueue;
+	}
+	else
+	{
+		pxNewQueue->pcHead = pucQueueStorage;
+	}
+
+	/* Initialise the queue members as described above where the queue type
+	is defined. */
+	pxNewQueue->uxLength = uxQueueLength;
+	pxNewQueue->uxItemSize = uxItemSize;
+	( void ) xQueueGenericReset( pxNewQueue, pdTRUE );
+
+	#if ( configUSE_TRACE_FACILITY == 1 )
+	{
+		pxNewQueue->ucQueueType = ucQueueType;
+	}
+	#endif /* configUSE_TRACE_FACILITY */
+
+	#if( configUSE_QUEUE_SETS == 1 )
+	{
+		pxNewQueue->pxQueueSetContainer = NULL;
+	}
+	#endif /* configUSE_QUEUE_SETS */
+
+	#if( configUSE_QUEUE_GROUPS == 1 )
+	{
+		pxNewQueue->pxQueueGroup = NULL;
+		pxNewQueue->ulQueueGroupBit = 0;
+	}
+	#endif /* configUSE_QUEUE_GROUPS */
+}
+/*-----------------------------------------------------------*/
+
 #if ( configUSE_MUTEXES == 1 )
 
 	QueueHandle_t xQueueCreateMutex( const uint8_t ucQueueType )
@@ -426,6 +529,12 @@ int8_t *pcAllocatedBuffer;
 		pxNewQueue = ( Queue_t * ) pvPortMalloc( sizeof( Queue_t ) );
 		if( pxNewQueue != NULL )
 		{
+			#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+			{
+				pxNewQueue->ucStaticallyAllocated = pdFALSE;
+			}
+			#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 			/* Information required for priority inheritance. */
 			pxNewQueue->pxMutexHolder = NULL;
 			pxNewQueue->uxQueueType = queueQUEUE_IS_MUTEX;
@@ -456,6 +565,13 @@ int8_t *pcAllocatedBuffer;
 			}
 			#endif
 
+			#if ( configUSE_QUEUE_GROUPS == 1 )
+			{
+				pxNewQueue->pxQueueGroup = NULL;
+				pxNewQueue->ulQueueGroupBit = 0;
+			}
+			#endif
+
 			/* Ensure the event queues start with the correct state. */
 			vListInitialise( &( pxNewQueue->xTasksWaitingToSend ) );
 			vListInitialise( &( pxNewQueue->xTasksWaitingToReceive ) );
@@ -668,6 +784,22 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 				traceQUEUE_SEND( pxQueue );
 				xYieldRequired = prvCopyDataToQueue( pxQueue, pvItemToQueue, xCopyPosition );
 
+				#if ( configUSE_QUEUE_GROUPS == 1 )
+				{
+					if( pxQueue->pxQueueGroup != NULL )
+					{
+						if( prvNotifyQueueGroup( pxQueue ) != pdFALSE )
+						{
+							queueYIELD_IF_USING_PREEMPTION_MUX(&pxQueue->mux);
+						}
+						else
+						{
+							mtCOVERAGE_TEST_MARKER();
+						}
+					}
+				}
+				#endif /* configUSE_QUEUE_GROUPS */
+
 				#if ( configUSE_QUEUE_SETS == 1 )
 				{
 					if( pxQueue->pxQueueSetContainer != NULL )
@@ -835,6 +967,158 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t xQueueSendMultiple( QueueHandle_t xQueue, const void * const pvItems, const UBaseType_t uxCount, TickType_t xTicksToWait )
+{
+BaseType_t xEntryTimeSet = pdFALSE, xYieldRequired = pdFALSE;
+TimeOut_t xTimeOut;
+UBaseType_t uxSpace, uxCopied;
+const int8_t *pcItem = ( const int8_t * ) pvItems;
+Queue_t * const pxQueue = ( Queue_t * ) xQueue;
+
+	configASSERT( pxQueue );
+	configASSERT( pvItems );
+	configASSERT( pxQueue->uxItemSize != ( UBaseType_t ) 0U );
+	#if ( ( INCLUDE_xTaskGetSchedulerState == 1 ) || ( configUSE_TIMERS == 1 ) )
+	{
+		configASSERT( !( ( xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED ) && ( xTicksToWait != 0 ) ) );
+	}
+	#endif
+
+	if( uxCount == ( UBaseType_t ) 0 )
+	{
+		return 0;
+	}
+
+	for( ;; )
+	{
+		taskENTER_CRITICAL(&pxQueue->mux);
+		{
+			/* Copy as many items as there is room for while the mux is held,
+			so a burst costs one critical section rather than one per item.
+			The call only blocks while the queue is completely full. */
+			uxSpace = pxQueue->uxLength - pxQueue->uxMessagesWaiting;
+
+			if( uxSpace > ( UBaseType_t ) 0 )
+			{
+				if( uxSpace > uxCount )
+				{
+					uxSpace = uxCount;
+				}
+
+				for( uxCopied = 0; uxCopied < uxSpace; uxCopied++ )
+				{
+					traceQUEUE_SEND( pxQueue );
+					( void ) prvCopyDataToQueue( pxQueue, pcItem, queueSEND_TO_BACK );
+					pcItem += pxQueue->uxItemSize;
+
+					#if ( configUSE_QUEUE_SETS == 1 )
+					{
+						/* The queue set holds one handle per item posted. */
+						if( pxQueue->pxQueueSetContainer != NULL )
+						{
+							if( prvNotifyQueueSetContainer( pxQueue, queueSEND_TO_BACK ) == pdTRUE )
+							{
+								xYieldRequired = pdTRUE;
+							}
+						}
+					}
+					#endif /* configUSE_QUEUE_SETS */
+				}
+
+				#if ( configUSE_QUEUE_GROUPS == 1 )
+				{
+					/* One notification for the whole batch. */
+					if( pxQueue->pxQueueGroup != NULL )
+					{
+						if( prvNotifyQueueGroup( pxQueue ) != pdFALSE )
+						{
+							xYieldRequired = pdTRUE;
+						}
+					}
+				}
+				#endif /* configUSE_QUEUE_GROUPS */
+
+				#if ( configUSE_QUEUE_SETS == 1 )
+				if( pxQueue->pxQueueSetContainer == NULL )
+				#endif /* configUSE_QUEUE_SETS */
+				{
+					/* Unblock at most one waiting task per item posted.  There
+					is normally a single receiver, in which case this is a
+					single wakeup for the whole batch. */
+					for( uxCopied = 0; ( uxCopied < uxSpace ) && ( listLIST_IS_EMPTY( &( pxQueue->xTasksWaitingToReceive ) ) == pdFALSE ); uxCopied++ )
+					{
+						if( xTaskRemoveFromEventList( &( pxQueue->xTasksWaitingToReceive ) ) == pdTRUE )
+						{
+							xYieldRequired = pdTRUE;
+						}
+						else
+						{
+							mtCOVERAGE_TEST_MARKER();
+						}
+					}
+				}
+
+				if( xYieldRequired != pdFALSE )
+				{
+					queueYIELD_IF_USING_PREEMPTION_MUX(&pxQueue->mux);
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
+
+				taskEXIT_CRITICAL(&pxQueue->mux);
+				return uxSpace;
+			}
+			else
+			{
+				if( xTicksToWait == ( TickType_t ) 0 )
+				{
+					taskEXIT_CRITICAL(&pxQueue->mux);
+					traceQUEUE_SEND_FAILED( pxQueue );
+					return 0;
+				}
+				else if( xEntryTimeSet == pdFALSE )
+				{
+					vTaskSetTimeOutState( &xTimeOut );
+					xEntryTimeSet = pdTRUE;
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
+			}
+		}
+		taskEXIT_CRITICAL(&pxQueue->mux);
+
+		taskENTER_CRITICAL(&pxQueue->mux);
+
+		if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
+		{
+			if( prvIsQueueFull( pxQueue ) != pdFALSE )
+			{
+				traceBLOCKING_ON_QUEUE_SEND( pxQueue );
+				vTaskPlaceOnEventList( &( pxQueue->xTasksWaitingToSend ), xTicksToWait );
+				taskEXIT_CRITICAL(&pxQueue->mux);
+				portYIELD_WITHIN_API();
+			}
+			else
+			{
+				/* Try again. */
+				taskEXIT_CRITICAL(&pxQueue->mux);
+			}
+		}
+		else
+		{
+			/* The timeout has expired. */
+			taskEXIT_CRITICAL(&pxQueue->mux);
+			traceQUEUE_SEND_FAILED( pxQueue );
+			return 0;
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
 #if ( configUSE_ALTERNATIVE_API == 1 )
 
 	BaseType_t xQueueAltGenericSend( QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition )
@@ -1129,6 +1413,24 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 			disinheritance here or to clear the mutex holder TCB member. */
 			( void ) prvCopyDataToQueue( pxQueue, pvItemToQueue, xCopyPosition );
 
+			#if ( configUSE_QUEUE_GROUPS == 1 )
+			{
+				/* Marking the queue ready doesn't touch its event lists, so
+				this is done even if the queue is locked. */
+				if( pxQueue->pxQueueGroup != NULL )
+				{
+					if( ( prvNotifyQueueGroup( pxQueue ) != pdFALSE ) && ( pxHigherPriorityTaskWoken != NULL ) )
+					{
+						*pxHigherPriorityTaskWoken = pdTRUE;
+					}
+					else
+					{
+						mtCOVERAGE_TEST_MARKER();
+					}
+				}
+			}
+			#endif /* configUSE_QUEUE_GROUPS */
+
 			/* The event list is not altered if the queue is locked.  This will
 			be done when the queue is unlocked later. */
 			if( pxQueue->xTxLock == queueUNLOCKED )
@@ -1285,6 +1587,24 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 
 			++( pxQueue->uxMessagesWaiting );
 
+			#if ( configUSE_QUEUE_GROUPS == 1 )
+			{
+				/* Marking the queue ready doesn't touch its event lists, so
+				this is done even if the queue is locked. */
+				if( pxQueue->pxQueueGroup != NULL )
+				{
+					if( ( prvNotifyQueueGroup( pxQueue ) != pdFALSE ) && ( pxHigherPriorityTaskWoken != NULL ) )
+					{
+						*pxHigherPriorityTaskWoken = pdTRUE;
+					}
+					else
+					{
+						mtCOVERAGE_TEST_MARKER();
+					}
+				}
+			}
+			#endif /* configUSE_QUEUE_GROUPS */
+
 			/* The event list is not altered if the queue is locked.  This will
 			be done when the queue is unlocked later. */
 			if( pxQueue->xTxLock == queueUNLOCKED )
@@ -1570,6 +1890,124 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t xQueueReceiveMultiple( QueueHandle_t xQueue, void * const pvBuffer, const UBaseType_t uxMaxCount, TickType_t xTicksToWait )
+{
+BaseType_t xEntryTimeSet = pdFALSE, xYieldRequired = pdFALSE;
+TimeOut_t xTimeOut;
+UBaseType_t uxAvailable, uxCopied;
+int8_t *pcItem = ( int8_t * ) pvBuffer;
+Queue_t * const pxQueue = ( Queue_t * ) xQueue;
+
+	configASSERT( pxQueue );
+	configASSERT( pvBuffer );
+	configASSERT( pxQueue->uxItemSize != ( UBaseType_t ) 0U );
+	#if ( ( INCLUDE_xTaskGetSchedulerState == 1 ) || ( configUSE_TIMERS == 1 ) )
+	{
+		configASSERT( !( ( xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED ) && ( xTicksToWait != 0 ) ) );
+	}
+	#endif
+
+	if( uxMaxCount == ( UBaseType_t ) 0 )
+	{
+		return 0;
+	}
+
+	for( ;; )
+	{
+		taskENTER_CRITICAL(&pxQueue->mux);
+		{
+			/* Drain up to uxMaxCount items under a single hold of the mux.
+			The call only blocks while the queue is completely empty. */
+			uxAvailable = pxQueue->uxMessagesWaiting;
+
+			if( uxAvailable > ( UBaseType_t ) 0 )
+			{
+				if( uxAvailable > uxMaxCount )
+				{
+					uxAvailable = uxMaxCount;
+				}
+
+				for( uxCopied = 0; uxCopied < uxAvailable; uxCopied++ )
+				{
+					traceQUEUE_RECEIVE( pxQueue );
+					prvCopyDataFromQueue( pxQueue, pcItem );
+					pcItem += pxQueue->uxItemSize;
+					--( pxQueue->uxMessagesWaiting );
+				}
+
+				/* Unblock at most one waiting sender per slot freed. */
+				for( uxCopied = 0; ( uxCopied < uxAvailable ) && ( listLIST_IS_EMPTY( &( pxQueue->xTasksWaitingToSend ) ) == pdFALSE ); uxCopied++ )
+				{
+					if( xTaskRemoveFromEventList( &( pxQueue->xTasksWaitingToSend ) ) == pdTRUE )
+					{
+						xYieldRequired = pdTRUE;
+					}
+					else
+					{
+						mtCOVERAGE_TEST_MARKER();
+					}
+				}
+
+				if( xYieldRequired != pdFALSE )
+				{
+					queueYIELD_IF_USING_PREEMPTION_MUX(&pxQueue->mux);
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
+
+				taskEXIT_CRITICAL(&pxQueue->mux);
+				return uxAvailable;
+			}
+			else
+			{
+				if( xTicksToWait == ( TickType_t ) 0 )
+				{
+					traceQUEUE_RECEIVE_FAILED( pxQueue );
+					taskEXIT_CRITICAL(&pxQueue->mux);
+					return 0;
+				}
+				else if( xEntryTimeSet == pdFALSE )
+				{
+					vTaskSetTimeOutState( &xTimeOut );
+					xEntryTimeSet = pdTRUE;
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
+			}
+		}
+		taskEXIT_CRITICAL(&pxQueue->mux);
+
+		taskENTER_CRITICAL(&pxQueue->mux);
+
+		if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
+		{
+			if( prvIsQueueEmpty( pxQueue ) != pdFALSE )
+			{
+				traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue );
+				vTaskPlaceOnEventList( &( pxQueue->xTasksWaitingToReceive ), xTicksToWait );
+				taskEXIT_CRITICAL(&pxQueue->mux);
+				portYIELD_WITHIN_API();
+			}
+			else
+			{
+				/* Try again. */
+				taskEXIT_CRITICAL(&pxQueue->mux);
+			}
+		}
+		else
+		{
+			taskEXIT_CRITICAL(&pxQueue->mux);
+			traceQUEUE_RECEIVE_FAILED( pxQueue );
+			return 0;
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t xQueueReceiveFromISR( QueueHandle_t xQueue, void * const pvBuffer, BaseType_t * const pxHigherPriorityTaskWoken )
 {
 BaseType_t xReturn;
@@ -1777,7 +2215,25 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 		vQueueUnregisterQueue( pxQueue );
 	}
 	#endif
-	vPortFree( pxQueue );
+
+	#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	{
+		/* The memory of a statically allocated queue belongs to the
+		application. */
+		if( pxQueue->ucStaticallyAllocated == pdFALSE )
+		{
+			vPortFree( pxQueue );
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	#else
+	{
+		vPortFree( pxQueue );
+	}
+	#endif
 }
 /*-----------------------------------------------------------*/
 
@@ -2511,6 +2967,13 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 				items in the queue/semaphore. */
 				xReturn = pdFAIL;
 			}
+			#if ( configUSE_QUEUE_GROUPS == 1 )
+			else if( ( ( Queue_t * ) xQueueOrSemaphore )->pxQueueGroup != NULL )
+			{
+				/* Cannot add a member of a queue group to a queue set. */
+				xReturn = pdFAIL;
+			}
+			#endif
 			else
 			{
 				( ( Queue_t * ) xQueueOrSemaphore )->pxQueueSetContainer = xQueueSet;
@@ -2631,15 +3094,237 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 	}
 
 #endif /* configUSE_QUEUE_SETS */
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_QUEUE_GROUPS == 1 )
+
+	QueueGroupHandle_t xQueueGroupCreate( void )
+	{
+	QueueGroup_t *pxGroup;
+
+		pxGroup = ( QueueGroup_t * ) pvPortMalloc( sizeof( QueueGroup_t ) );
+		if( pxGroup != NULL )
+		{
+			memset( pxGroup, 0, sizeof( QueueGroup_t ) );
+			vPortCPUInitializeMutex( &pxGroup->mux );
+		}
+		else
+		{
+			traceQUEUE_CREATE_FAILED( queueQUEUE_TYPE_SET );
+		}
 
+		return ( QueueGroupHandle_t ) pxGroup;
+	}
 
+#endif /* configUSE_QUEUE_GROUPS */
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_QUEUE_GROUPS == 1 )
 
+	void vQueueGroupDelete( QueueGroupHandle_t xQueueGroup )
+	{
+	QueueGroup_t * const pxGroup = ( QueueGroup_t * ) xQueueGroup;
 
+		/* Members would keep pointing at the freed group. */
+		configASSERT( pxGroup->ulMembers == 0 );
+		vPortFree( pxGroup );
+	}
 
+#endif /* configUSE_QUEUE_GROUPS */
+/*-----------------------------------------------------------*/
 
+#if ( configUSE_QUEUE_GROUPS == 1 )
 
+	BaseType_t xQueueAddToGroup( QueueSetMemberHandle_t xQueueOrSemaphore, QueueGroupHandle_t xQueueGroup, UBaseType_t uxBit )
+	{
+	Queue_t * const pxQueue = ( Queue_t * ) xQueueOrSemaphore;
+	QueueGroup_t * const pxGroup = ( QueueGroup_t * ) xQueueGroup;
+	BaseType_t xReturn = pdFAIL;
+	uint32_t ulBit;
 
+		configASSERT( pxQueue );
+		configASSERT( pxGroup );
+		configASSERT( uxBit < queueGROUP_MAX_MEMBERS );
+		ulBit = ( uint32_t ) 1 << uxBit;
 
+		/* Same order as when posting: the queue's mux, then the group's. */
+		taskENTER_CRITICAL( &pxQueue->mux );
+		taskENTER_CRITICAL( &pxGroup->mux );
+		{
+			if( ( pxQueue->pxQueueGroup == NULL ) && ( ( pxGroup->ulMembers & ulBit ) == 0 )
+				#if ( configUSE_QUEUE_SETS == 1 )
+					&& ( pxQueue->pxQueueSetContainer == NULL )
+				#endif
+				)
+			{
+				pxQueue->pxQueueGroup = pxGroup;
+				pxQueue->ulQueueGroupBit = ulBit;
+				pxGroup->pxMembers[ uxBit ] = pxQueue;
+				pxGroup->ulMembers |= ulBit;
+
+				/* Unlike a queue set, the group can take members that already
+				hold items; they are ready straight away. */
+				if( pxQueue->uxMessagesWaiting != ( UBaseType_t ) 0 )
+				{
+					pxGroup->ulReady |= ulBit;
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
 
+				xReturn = pdPASS;
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+		taskEXIT_CRITICAL( &pxGroup->mux );
+		taskEXIT_CRITICAL( &pxQueue->mux );
+
+		return xReturn;
+	}
+
+#endif /* configUSE_QUEUE_GROUPS */
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_QUEUE_GROUPS == 1 )
+
+	BaseType_t xQueueRemoveFromGroup( QueueSetMemberHandle_t xQueueOrSemaphore, QueueGroupHandle_t xQueueGroup )
+	{
+	Queue_t * const pxQueue = ( Queue_t * ) xQueueOrSemaphore;
+	QueueGroup_t * const pxGroup = ( QueueGroup_t * ) xQueueGroup;
+	BaseType_t xReturn = pdFAIL;
+	uint32_t ulBit;
+
+		configASSERT( pxQueue );
+		configASSERT( pxGroup );
+
+		taskENTER_CRITICAL( &pxQueue->mux );
+		taskENTER_CRITICAL( &pxGroup->mux );
+		{
+			if( pxQueue->pxQueueGroup == pxGroup )
+			{
+				ulBit = pxQueue->ulQueueGroupBit;
+				pxGroup->pxMembers[ __builtin_ctz( ulBit ) ] = NULL;
+				pxGroup->ulMembers &= ~ulBit;
+				pxGroup->ulReady &= ~ulBit;
+				pxGroup->ulReturned &= ~ulBit;
+				pxQueue->pxQueueGroup = NULL;
+				pxQueue->ulQueueGroupBit = 0;
+				xReturn = pdPASS;
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+		taskEXIT_CRITICAL( &pxGroup->mux );
+		taskEXIT_CRITICAL( &pxQueue->mux );
 
+		return xReturn;
+	}
+
+#endif /* configUSE_QUEUE_GROUPS */
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_QUEUE_GROUPS == 1 )
+
+	uint32_t ulQueueGroupWait( QueueGroupHandle_t xQueueGroup, TickType_t xTicksToWait )
+	{
+	QueueGroup_t * const pxGroup = ( QueueGroup_t * ) xQueueGroup;
+	uint32_t ulReady, ulCheck;
+	UBaseType_t uxBit;
+	TimeOut_t xTimeOut;
+
+		configASSERT( pxGroup );
+
+		vTaskSetTimeOutState( &xTimeOut );
+
+		for( ;; )
+		{
+			taskENTER_CRITICAL( &pxGroup->mux );
+			{
+				ulReady = pxGroup->ulReady;
+				pxGroup->ulReady = 0;
+
+				/* The owner should have drained the members returned last
+				time, but a member it left items in must not be lost. */
+				ulCheck = pxGroup->ulReturned & ~ulReady;
+				while( ulCheck != 0 )
+				{
+					uxBit = ( UBaseType_t ) __builtin_ctz( ulCheck );
+					ulCheck &= ulCheck - 1;
+					if( pxGroup->pxMembers[ uxBit ]->uxMessagesWaiting != ( UBaseType_t ) 0 )
+					{
+						ulReady |= ( uint32_t ) 1 << uxBit;
+					}
+				}
+				pxGroup->ulReturned = ulReady;
+
+				/* Only a blocked owner gets notified by the posts. */
+				if( ( ulReady == 0 ) && ( xTicksToWait != ( TickType_t ) 0 ) )
+				{
+					pxGroup->xWaitingTask = xTaskGetCurrentTaskHandle();
+				}
+				else
+				{
+					pxGroup->xWaitingTask = NULL;
+				}
+			}
+			taskEXIT_CRITICAL( &pxGroup->mux );
+
+			if( ( ulReady != 0 ) || ( xTicksToWait == ( TickType_t ) 0 ) )
+			{
+				return ulReady;
+			}
+
+			if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) != pdFALSE )
+			{
+				/* Look once more without blocking, which also forgets the
+				waiting task. */
+				xTicksToWait = ( TickType_t ) 0;
+				continue;
+			}
+
+			/* A notification can be left over from a post that raced with an
+			earlier timeout; the loop then simply looks again. */
+			( void ) ulTaskNotifyTake( pdTRUE, xTicksToWait );
+		}
+	}
+
+#endif /* configUSE_QUEUE_GROUPS */
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_QUEUE_GROUPS == 1 )
+
+	static BaseType_t prvNotifyQueueGroup( const Queue_t * const pxQueue )
+	{
+	QueueGroup_t * const pxGroup = pxQueue->pxQueueGroup;
+	TaskHandle_t xWaitingTask;
+	BaseType_t xReturn = pdFALSE;
+
+		/* Called with the queue's mux held, so interrupts are already
+		masked. */
+		taskENTER_CRITICAL_ISR( &pxGroup->mux );
+		{
+			pxGroup->ulReady |= pxQueue->ulQueueGroupBit;
+			xWaitingTask = pxGroup->xWaitingTask;
+			pxGroup->xWaitingTask = NULL;
+		}
+		taskEXIT_CRITICAL_ISR( &pxGroup->mux );
+
+		if( xWaitingTask != NULL )
+		{
+			vTaskNotifyGiveFromISR( xWaitingTask, &xReturn );
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+
+		return xReturn;
+	}
 
+#endif /* configUSE_QUEUE_GROUPS */
@@ -0,0 +1,398 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
+
+/* Every item starts with a 32-bit header holding its length. A header with
+this value marks the rest of the buffer as unused; the next item is at the
+start of the buffer. */
+#define rbWRAP_MARKER			0xFFFFFFFFUL
+#define rbHEADER_SIZE			sizeof( uint32_t )
+#define rbITEM_SPACE( xSize )	( rbHEADER_SIZE + ( ( ( xSize ) + 3 ) & ~( size_t ) 3 ) )
+
+/* Set in the header of an item while it is acquired but not yet committed, and
+again once it has been returned. The write and read offsets are only moved
+over items in the right state, so with several producers or consumers the
+items can be committed and returned in any order. */
+#define rbFLAG_OPEN				0x80000000UL
+#define rbHEADER( pvItem )		( ( volatile uint32_t * ) ( ( uint8_t * ) ( pvItem ) - rbHEADER_SIZE ) )
+
+/* The write offset is only written by the producer and the read offset only by
+the consumer. Each is published with a release store and read by the other
+side with an acquire load, so the item data is visible before the offset. */
+#define rbLOAD_ACQUIRE( pxOffset )				__atomic_load_n( ( pxOffset ), __ATOMIC_ACQUIRE )
+#define rbSTORE_RELEASE( pxOffset, xValue )	__atomic_store_n( ( pxOffset ), ( xValue ), __ATOMIC_RELEASE )
+#define rbFULL_BARRIER()						__sync_synchronize()
+
+typedef struct
+{
+	uint8_t *pucBuffer;
+	size_t xSize;
+	UBaseType_t uxFlags;
+	volatile size_t xWrite;				/*< Offset after the last committed item, written by the producer. */
+	volatile size_t xRead;				/*< Offset of the oldest item that is not returned, written by the consumer. */
+	size_t xReserve;					/*< Offset where the next item is acquired, producer side. */
+	size_t xClaim;						/*< Offset of the next item to receive, consumer side. */
+	volatile UBaseType_t uxWaiting;		/*< Number of consumers blocked in pvRingbufferReceive. */
+	SemaphoreHandle_t xWakeSem;
+	portMUX_TYPE xProducerMux;
+	portMUX_TYPE xConsumerMux;
+	portMUX_TYPE xWaitingMux;
+} Ringbuf_t;
+
+RingbufHandle_t xRingbufferCreate( size_t xBufferSize, UBaseType_t uxFlags )
+{
+Ringbuf_t *pxRb;
+const portMUX_TYPE xMuxInit = portMUX_INITIALIZER_UNLOCKED;
+
+	xBufferSize = ( xBufferSize + 3 ) & ~( size_t ) 3;
+	configASSERT( xBufferSize >= 2 * rbITEM_SPACE( 1 ) );
+
+	pxRb = pvPortMalloc( sizeof( Ringbuf_t ) + xBufferSize );
+	if( pxRb == NULL )
+	{
+		return NULL;
+	}
+	memset( pxRb, 0, sizeof( Ringbuf_t ) );
+	pxRb->pucBuffer = ( uint8_t * ) ( pxRb + 1 );
+	pxRb->xSize = xBufferSize;
+	pxRb->uxFlags = uxFlags;
+	pxRb->xProducerMux = xMuxInit;
+	pxRb->xConsumerMux = xMuxInit;
+	pxRb->xWaitingMux = xMuxInit;
+
+	/* Several consumers can wait at once, so every commit has to be able to
+	wake one of them. */
+	if( ( uxFlags & ringbufMULTI_CONSUMER ) != 0 )
+	{
+		pxRb->xWakeSem = xSemaphoreCreateCounting( xBufferSize / rbITEM_SPACE( 1 ), 0 );
+	}
+	else
+	{
+		pxRb->xWakeSem = xSemaphoreCreateBinary();
+	}
+	if( pxRb->xWakeSem == NULL )
+	{
+		vPortFree( pxRb );
+		return NULL;
+	}
+	return pxRb;
+}
+
+void vRingbufferDelete( RingbufHandle_t xRingbuffer )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+
+	configASSERT( pxRb->uxWaiting == 0 );
+	vSemaphoreDelete( pxRb->xWakeSem );
+	vPortFree( pxRb );
+}
+
+size_t xRingbufferGetMaxItemSize( RingbufHandle_t xRingbuffer )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+
+	/* With empty buffer at offset X, an item fits either into the space after
+	X or into the one before it, and one of them is at least half the buffer. */
+	return ( ( pxRb->xSize / 2 ) & ~( size_t ) 3 ) - rbHEADER_SIZE;
+}
+
+void *pvRingbufferAcquire( RingbufHandle_t xRingbuffer, size_t xItemSize )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+const size_t xNeeded = rbITEM_SPACE( xItemSize );
+size_t xWrite, xRead, xOffset;
+void *pvItem = NULL;
+
+	/* With several producers the lock is only held while the space is
+	reserved; the item is filled and committed without it. */
+	if( ( pxRb->uxFlags & ringbufMULTI_PRODUCER ) != 0 )
+	{
+		taskENTER_CRITICAL( &pxRb->xProducerMux );
+	}
+
+	/* The read and reserve offsets are only equal when the buffer is empty, so
+	the reserve offset may never catch up with the read offset. */
+	xWrite = pxRb->xReserve;
+	xRead = rbLOAD_ACQUIRE( &pxRb->xRead );
+	if( xWrite >= xRead )
+	{
+		if( xNeeded < pxRb->xSize - xWrite || ( xNeeded == pxRb->xSize - xWrite && xRead != 0 ) )
+		{
+			xOffset = xWrite;
+		}
+		else if( xNeeded < xRead )
+		{
+			/* The consumer can't see the marker before the item is committed. */
+			*( uint32_t * ) ( pxRb->pucBuffer + xWrite ) = rbWRAP_MARKER;
+			xOffset = 0;
+		}
+		else
+		{
+			goto done;
+		}
+	}
+	else if( xNeeded < xRead - xWrite )
+	{
+		xOffset = xWrite;
+	}
+	else
+	{
+		goto done;
+	}
+
+	*( uint32_t * ) ( pxRb->pucBuffer + xOffset ) = xItemSize | rbFLAG_OPEN;
+	pvItem = pxRb->pucBuffer + xOffset + rbHEADER_SIZE;
+	xOffset += xNeeded;
+	pxRb->xReserve = ( xOffset == pxRb->xSize ) ? 0 : xOffset;
+
+done:
+	if( ( pxRb->uxFlags & ringbufMULTI_PRODUCER ) != 0 )
+	{
+		taskEXIT_CRITICAL( &pxRb->xProducerMux );
+	}
+	return pvItem;
+}
+
+/* Move xOffset over the items whose rbFLAG_OPEN bit equals ulOpen, stopping at
+xEnd, and add the number of items passed to *puxCount if it is not NULL. */
+static size_t prvSkipItems( Ringbuf_t *pxRb, size_t xOffset, size_t xEnd, uint32_t ulOpen, UBaseType_t *puxCount )
+{
+uint32_t ulHeader;
+
+	while( xOffset != xEnd )
+	{
+		ulHeader = *( volatile uint32_t * ) ( pxRb->pucBuffer + xOffset );
+		if( ulHeader == rbWRAP_MARKER )
+		{
+			xOffset = 0;
+			continue;
+		}
+		if( ( ulHeader & rbFLAG_OPEN ) != ulOpen )
+		{
+			break;
+		}
+		xOffset += rbITEM_SPACE( ulHeader & ~rbFLAG_OPEN );
+		if( xOffset == pxRb->xSize )
+		{
+			xOffset = 0;
+		}
+		if( puxCount != NULL )
+		{
+			( *puxCount )++;
+		}
+	}
+	return xOffset;
+}
+
+/* Publish the acquired item, and with several producers the items committed
+before it that were waiting for it. Returns the number of consumers to wake. */
+static UBaseType_t prvCommit( Ringbuf_t *pxRb, void *pvItem )
+{
+UBaseType_t uxPublished = 0;
+
+	configASSERT( ( *rbHEADER( pvItem ) & rbFLAG_OPEN ) != 0 );
+	if( ( pxRb->uxFlags & ringbufMULTI_PRODUCER ) != 0 )
+	{
+		taskENTER_CRITICAL( &pxRb->xProducerMux );
+	}
+	*rbHEADER( pvItem ) &= ~rbFLAG_OPEN;
+	rbSTORE_RELEASE( &pxRb->xWrite, prvSkipItems( pxRb, pxRb->xWrite, pxRb->xReserve, 0, &uxPublished ) );
+	if( ( pxRb->uxFlags & ringbufMULTI_PRODUCER ) != 0 )
+	{
+		taskEXIT_CRITICAL( &pxRb->xProducerMux );
+	}
+
+	/* Pairs with the barrier in pvRingbufferReceive: either the consumer sees
+	the new write offset, or this sees the consumer waiting. */
+	rbFULL_BARRIER();
+	if( pxRb->uxWaiting == 0 )
+	{
+		return 0;
+	}
+	return ( uxPublished < pxRb->uxWaiting ) ? uxPublished : pxRb->uxWaiting;
+}
+
+void vRingbufferCommit( RingbufHandle_t xRingbuffer, void *pvItem )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+UBaseType_t uxWake = prvCommit( pxRb, pvItem );
+
+	while( uxWake-- > 0 )
+	{
+		xSemaphoreGive( pxRb->xWakeSem );
+	}
+}
+
+void vRingbufferCommitFromISR( RingbufHandle_t xRingbuffer, void *pvItem, BaseType_t *pxHigherPriorityTaskWoken )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+UBaseType_t uxWake = prvCommit( pxRb, pvItem );
+
+	while( uxWake-- > 0 )
+	{
+		xSemaphoreGiveFromISR( pxRb->xWakeSem, pxHigherPriorityTaskWoken );
+	}
+}
+
+BaseType_t xRingbufferSend( RingbufHandle_t xRingbuffer, const void *pvData, size_t xDataSize )
+{
+void *pvItem = pvRingbufferAcquire( xRingbuffer, xDataSize );
+
+	if( pvItem == NULL )
+	{
+		return pdFALSE;
+	}
+	memcpy( pvItem, pvData, xDataSize );
+	vRingbufferCommit( xRingbuffer, pvItem );
+	return pdTRUE;
+}
+
+BaseType_t xRingbufferSendFromISR( RingbufHandle_t xRingbuffer, const void *pvData, size_t xDataSize, BaseType_t *pxHigherPriorityTaskWoken )
+{
+void *pvItem = pvRingbufferAcquire( xRingbuffer, xDataSize );
+
+	if( pvItem == NULL )
+	{
+		return pdFALSE;
+	}
+	memcpy( pvItem, pvData, xDataSize );
+	vRingbufferCommitFromISR( xRingbuffer, pvItem, pxHigherPriorityTaskWoken );
+	return pdTRUE;
+}
+
+/* Get the oldest item that is not received yet, without blocking. With
+ringbufMULTI_CONSUMER the lock is only held while the item is claimed. */
+static void *prvTryReceive( Ringbuf_t *pxRb, size_t *pxItemSize )
+{
+size_t xClaim, xWrite;
+uint32_t ulLength;
+void *pvItem = NULL;
+
+	if( ( pxRb->uxFlags & ringbufMULTI_CONSUMER ) != 0 )
+	{
+		taskENTER_CRITICAL( &pxRb->xConsumerMux );
+	}
+
+	xClaim = pxRb->xClaim;
+	xWrite = rbLOAD_ACQUIRE( &pxRb->xWrite );
+	if( xClaim != xWrite && *( uint32_t * ) ( pxRb->pucBuffer + xClaim ) == rbWRAP_MARKER )
+	{
+		/* The write offset can stop right after the marker, in front of an
+		item at the start of the buffer that is not committed yet. */
+		xClaim = 0;
+		pxRb->xClaim = 0;
+	}
+	if( xClaim != xWrite )
+	{
+		ulLength = *( uint32_t * ) ( pxRb->pucBuffer + xClaim );
+		pvItem = pxRb->pucBuffer + xClaim + rbHEADER_SIZE;
+		*pxItemSize = ulLength;
+		xClaim += rbITEM_SPACE( ulLength );
+		pxRb->xClaim = ( xClaim == pxRb->xSize ) ? 0 : xClaim;
+	}
+
+	if( ( pxRb->uxFlags & ringbufMULTI_CONSUMER ) != 0 )
+	{
+		taskEXIT_CRITICAL( &pxRb->xConsumerMux );
+	}
+	return pvItem;
+}
+
+static void prvSetWaiting( Ringbuf_t *pxRb, BaseType_t xWaiting )
+{
+	if( ( pxRb->uxFlags & ringbufMULTI_CONSUMER ) != 0 )
+	{
+		taskENTER_CRITICAL( &pxRb->xWaitingMux );
+		if( xWaiting != pdFALSE )
+		{
+			pxRb->uxWaiting++;
+		}
+		else
+		{
+			pxRb->uxWaiting--;
+		}
+		taskEXIT_CRITICAL( &pxRb->xWaitingMux );
+	}
+	else
+	{
+		pxRb->uxWaiting = ( xWaiting != pdFALSE ) ? 1 : 0;
+	}
+}
+
+void *pvRingbufferReceive( RingbufHandle_t xRingbuffer, size_t *pxItemSize, TickType_t xTicksToWait )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+TimeOut_t xTimeOut;
+void *pvItem;
+
+	vTaskSetTimeOutState( &xTimeOut );
+	for( ;; )
+	{
+		pvItem = prvTryReceive( pxRb, pxItemSize );
+		if( pvItem != NULL || xTicksToWait == 0 )
+		{
+			return pvItem;
+		}
+
+		/* Announce that we are going to wait, then look again: an item
+		committed before the producer could see the announcement is found
+		here. */
+		prvSetWaiting( pxRb, pdTRUE );
+		rbFULL_BARRIER();
+		pvItem = prvTryReceive( pxRb, pxItemSize );
+		if( pvItem == NULL && xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
+		{
+			/* A wake-up can be left over from an earlier wait; that only
+			costs another round of this loop. */
+			xSemaphoreTake( pxRb->xWakeSem, xTicksToWait );
+			prvSetWaiting( pxRb, pdFALSE );
+			continue;
+		}
+		prvSetWaiting( pxRb, pdFALSE );
+		return pvItem;
+	}
+}
+
+void *pvRingbufferReceiveFromISR( RingbufHandle_t xRingbuffer, size_t *pxItemSize )
+{
+	return prvTryReceive( ( Ringbuf_t * ) xRingbuffer, pxItemSize );
+}
+
+void vRingbufferReturnItem( RingbufHandle_t xRingbuffer, void *pvItem )
+{
+Ringbuf_t *pxRb = ( Ringbuf_t * ) xRingbuffer;
+
+	configASSERT( ( *rbHEADER( pvItem ) & rbFLAG_OPEN ) == 0 );
+	if( ( pxRb->uxFlags & ringbufMULTI_CONSUMER ) != 0 )
+	{
+		taskENTER_CRITICAL( &pxRb->xConsumerMux );
+	}
+	/* Items received after this one may have been returned already; free
+	their space too. */
+	*rbHEADER( pvItem ) |= rbFLAG_OPEN;
+	rbSTORE_RELEASE( &pxRb->xRead, prvSkipItems( pxRb, pxRb->xRead, pxRb->xClaim, rbFLAG_OPEN, NULL ) );
+	if( ( pxRb->uxFlags & ringbufMULTI_CONSUMER ) != 0 )
+	{
+		taskEXIT_CRITICAL( &pxRb->xConsumerMux );
+	}
+}
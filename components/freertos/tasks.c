@@ -86,6 +86,9 @@ task.h is included from an application file. */
 #include "portmacro.h"
 #include "semphr.h"
 #include "sys/reent.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm_impl.h"
+#endif
 
 /* Lint e961 and e750 are suppressed as a MISRA exception justified because the
 MPU ports require MPU_WRAPPERS_INCLUDED_FROM_API_FILE to be defined for the
@@ -157,9 +160,14 @@ typedef struct tskTaskControlBlock
 	StackType_t			*pxStack;			/*< Points to the start of the stack. */
 	char				pcTaskName[ configMAX_TASK_NAME_LEN ];/*< Descriptive name given to the task when created.  Facilitates debugging only. */ /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 	BaseType_t			xCoreID;			/*< Core this task is pinned to */
+	BaseType_t			xIramSafe;			/*< Set to pdTRUE if the task only runs code and touches data in internal RAM, see vTaskSetIramSafe() */
+
+	#if ( configUSE_CORE_AFFINITY_HINT == 1 )
+		BaseType_t		xLastCoreID;		/*< Core this task last ran on, tskNO_AFFINITY if it did not run yet */
+	#endif
 
-	#if ( portSTACK_GROWTH > 0 )
-		StackType_t		*pxEndOfStack;		/*< Points to the end of the stack on architectures where the stack grows up from low memory. */
+	#if ( ( portSTACK_GROWTH > 0 ) || ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
+		StackType_t		*pxEndOfStack;		/*< Points to the end of the stack on architectures where the stack grows up from low memory, and to the highest valid address of the stack if it grows down. */
 	#endif
 
 	#if ( portCRITICAL_NESTING_IN_TCB == 1 )
@@ -189,7 +197,7 @@ typedef struct tskTaskControlBlock
 	#endif
 
 	#if ( configGENERATE_RUN_TIME_STATS == 1 )
-		uint32_t		ulRunTimeCounter;	/*< Stores the amount of time the task has spent in the Running state. */
+		uint64_t		ullRunTimeCounter[ portNUM_PROCESSORS ];	/*< Stores the amount of time the task has spent in the Running state on each core. */
 	#endif
 
 	#if ( configUSE_NEWLIB_REENTRANT == 1 )
@@ -208,6 +216,10 @@ typedef struct tskTaskControlBlock
 		volatile eNotifyValue eNotifyState;
 	#endif
 
+	#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		uint8_t			ucStaticallyAllocated;	/*< Set to tskSTATICALLY_ALLOCATED_STACK_ONLY or tskSTATICALLY_ALLOCATED_STACK_AND_TCB if the memory was not taken from the heap, so no attempt is made to free it when the task is deleted. */
+	#endif
+
 } tskTCB;
 
 /* The old tskTCB name is maintained above then typedefed to the new TCB_t name
@@ -228,7 +240,8 @@ static variables must be declared volatile. */
 PRIVILEGED_DATA TCB_t * volatile pxCurrentTCB[ portNUM_PROCESSORS ] = { NULL };
 
 /* Lists for ready and blocked tasks. --------------------*/
-PRIVILEGED_DATA static List_t pxReadyTasksLists[ configMAX_PRIORITIES ];/*< Prioritised ready tasks. */
+PRIVILEGED_DATA static List_t pxReadyTasksLists[ configMAX_PRIORITIES ];/*< Prioritised ready tasks that can run on any core. */
+PRIVILEGED_DATA static List_t pxCoreReadyTasksLists[ portNUM_PROCESSORS ][ configMAX_PRIORITIES ];/*< Prioritised ready tasks pinned to a core. */
 PRIVILEGED_DATA static List_t xDelayedTaskList1;						/*< Delayed tasks. */
 PRIVILEGED_DATA static List_t xDelayedTaskList2;						/*< Delayed tasks (two lists are used - one for delays that have overflowed the current tick count. */
 PRIVILEGED_DATA static List_t * volatile pxDelayedTaskList;				/*< Points to the delayed task list currently being used. */
@@ -248,16 +261,17 @@ PRIVILEGED_DATA static List_t xPendingReadyList;						/*< Tasks that have been r
 
 #endif
 
-#if ( INCLUDE_xTaskGetIdleTaskHandle == 1 )
+#if ( INCLUDE_xTaskGetIdleTaskHandle == 1 ) || ( configGENERATE_RUN_TIME_STATS == 1 ) || CONFIG_PM_ENABLE
 
-	PRIVILEGED_DATA static TaskHandle_t xIdleTaskHandle = NULL;			/*< Holds the handle of the idle task.  The idle task is created automatically when the scheduler is started. */
+	PRIVILEGED_DATA static TaskHandle_t xIdleTaskHandle[ portNUM_PROCESSORS ] = { NULL };	/*< Holds the handles of the idle tasks.  The idle tasks are created automatically when the scheduler is started. */
 
 #endif
 
 /* Other file private variables. --------------------------------*/
 PRIVILEGED_DATA static volatile UBaseType_t uxCurrentNumberOfTasks 	= ( UBaseType_t ) 0U;
 PRIVILEGED_DATA static volatile TickType_t xTickCount 				= ( TickType_t ) 0U;
-PRIVILEGED_DATA static volatile UBaseType_t uxTopReadyPriority 		= tskIDLE_PRIORITY;
+PRIVILEGED_DATA static volatile UBaseType_t uxTopReadyPriority 		= tskIDLE_PRIORITY;	/*< Upper bound of the priority of the tasks in the shared ready lists, changed under xSharedReadyListsMux. */
+PRIVILEGED_DATA static volatile UBaseType_t uxCoreTopReadyPriority[ portNUM_PROCESSORS ] = { tskIDLE_PRIORITY };	/*< Same for the ready lists of each core, changed under xCoreReadyListsMux of the core. */
 PRIVILEGED_DATA static volatile BaseType_t xSchedulerRunning 		= pdFALSE;
 PRIVILEGED_DATA static volatile UBaseType_t uxPendedTicks 			= ( UBaseType_t ) 0U;
 PRIVILEGED_DATA static volatile BaseType_t xYieldPending 			= pdFALSE;
@@ -275,6 +289,16 @@ when the scheduler is unsuspended.  The pending ready list itself can only be
 accessed from a critical section. */
 PRIVILEGED_DATA static volatile UBaseType_t uxSchedulerSuspended[ portNUM_PROCESSORS ]	= { ( UBaseType_t ) pdFALSE };
 
+/* While set for a core, only tasks marked with vTaskSetIramSafe() are switched
+in on that core. The flash driver sets this while the cache of the core is
+disabled. */
+PRIVILEGED_DATA static volatile BaseType_t xIramOnlyScheduling[ portNUM_PROCESSORS ]	= { pdFALSE };
+
+/* Set for a core when its last switch picked a task from its own ready list,
+so that the next switch looks at the shared list of the same priority first.
+Pinned and unpinned tasks of equal priority then take turns on the core. */
+PRIVILEGED_DATA static BaseType_t xSharedListFirst[ portNUM_PROCESSORS ]	= { pdFALSE };
+
 /* Muxes used in the task code */
 PRIVILEGED_DATA static portBASE_TYPE xMutexesInitialised = pdFALSE;
 /* For now, we use just one mux for all the critical sections. ToDo: give evrything a bit more granularity;
@@ -282,10 +306,31 @@ PRIVILEGED_DATA static portBASE_TYPE xMutexesInitialised = pdFALSE;
 PRIVILEGED_DATA static portMUX_TYPE xTaskQueueMutex = portMUX_INITIALIZER_UNLOCKED;
 PRIVILEGED_DATA static portMUX_TYPE xTickCountMutex = portMUX_INITIALIZER_UNLOCKED;
 
+/* The ready lists have locks of their own: code that changes them holds
+xTaskQueueMutex and also takes the lock of the list it changes, so that a
+context switch only needs the locks of the lists it selects from.  A core
+takes the lock of its own ready lists, and the lock of the shared lists only
+once these can hold a task it would run, so the switches between pinned tasks
+of different cores don't contend for a lock.  The locks are taken in the order
+xTaskQueueMutex, the core locks by ascending core, xSharedReadyListsMux. */
+PRIVILEGED_DATA static portMUX_TYPE xCoreReadyListsMux[ portNUM_PROCESSORS ];
+PRIVILEGED_DATA static portMUX_TYPE xSharedReadyListsMux = portMUX_INITIALIZER_UNLOCKED;
+
 #if ( configGENERATE_RUN_TIME_STATS == 1 )
 
-	PRIVILEGED_DATA static uint32_t ulTaskSwitchedInTime = 0UL;	/*< Holds the value of a timer/counter the last time a task was switched in. */
-	PRIVILEGED_DATA static uint32_t ulTotalRunTime = 0UL;		/*< Holds the total amount of execution time as defined by the run time counter clock. */
+	/* The run time counter of each core is only compared with values read on
+	the same core, so the counters of the cores need not be synchronised. */
+	PRIVILEGED_DATA static uint32_t ulTaskSwitchedInTime[ portNUM_PROCESSORS ] = { 0UL };	/*< Holds the value of the run time counter of each core the last time a task was switched in on it. */
+	PRIVILEGED_DATA static BaseType_t xTaskSwitchedInTimeValid[ portNUM_PROCESSORS ] = { pdFALSE };	/*< Set once ulTaskSwitchedInTime of the core has been written. */
+	PRIVILEGED_DATA static uint64_t ullTotalRunTime[ portNUM_PROCESSORS ] = { 0ULL };	/*< Holds the total run time accounted to tasks on each core. */
+
+	/* uxTaskGetSystemState() reports run time in microseconds, so its 32-bit
+	counters do not wrap as quickly as the run time counter. */
+	#ifdef portRUN_TIME_COUNTER_FREQ
+		#define tskRUN_TIME_COUNTS_PER_US	( portRUN_TIME_COUNTER_FREQ / 1000000UL )
+	#else
+		#define tskRUN_TIME_COUNTS_PER_US	( 1UL )
+	#endif
 
 #endif
 
@@ -299,6 +344,14 @@ PRIVILEGED_DATA static portMUX_TYPE xTickCountMutex = portMUX_INITIALIZER_UNLOCK
  */
 #define tskSTACK_FILL_BYTE	( 0xa5U )
 
+/*
+ * Values for TCB_t.ucStaticallyAllocated, which records which parts of the
+ * memory used by a task were provided by the application.
+ */
+#define tskDYNAMICALLY_ALLOCATED_STACK_AND_TCB		( ( uint8_t ) 0 )
+#define tskSTATICALLY_ALLOCATED_STACK_ONLY			( ( uint8_t ) 1 )
+#define tskSTATICALLY_ALLOCATED_STACK_AND_TCB		( ( uint8_t ) 2 )
+
 /*
  * Macros used by vListTask to indicate which state a task is in.
  */
@@ -352,6 +405,10 @@ PRIVILEGED_DATA static portMUX_TYPE xTickCountMutex = portMUX_INITIALIZER_UNLOCK
 
 #else /* configUSE_PORT_OPTIMISED_TASK_SELECTION */
 
+	#if ( portNUM_PROCESSORS > 1 )
+		#error configUSE_PORT_OPTIMISED_TASK_SELECTION does not support the per-core ready lists
+	#endif
+
 	/* If configUSE_PORT_OPTIMISED_TASK_SELECTION is 1 then task selection is
 	performed in a way that is tailored to the particular microcontroller
 	architecture being used. */
@@ -406,14 +463,62 @@ count overflows. */
 
 /*-----------------------------------------------------------*/
 
+/*
+ * Tasks pinned to a core are kept in the ready lists of that core, tasks
+ * without affinity in the shared ready lists.  A core therefore never has to
+ * step over the tasks pinned to the other core when it selects a task.
+ */
+#define prvReadyListForTask( pxTCB, uxPriority )													\
+	( ( ( pxTCB )->xCoreID == tskNO_AFFINITY ) ? &( pxReadyTasksLists[ ( uxPriority ) ] ) : &( pxCoreReadyTasksLists[ ( pxTCB )->xCoreID ][ ( uxPriority ) ] ) )
+
+/*
+ * Lock of the ready lists the task is put in.
+ */
+#define prvReadyListsMuxForTask( pxTCB )																\
+	( ( ( pxTCB )->xCoreID == tskNO_AFFINITY ) ? &xSharedReadyListsMux : &( xCoreReadyListsMux[ ( pxTCB )->xCoreID ] ) )
+
+/*
+ * Raise the upper bound of the priority of the ready lists the task is put in.
+ */
+#define prvRecordReadyPriority( pxTCB )																\
+{																									\
+	if( ( pxTCB )->xCoreID == tskNO_AFFINITY )														\
+	{																								\
+		taskRECORD_READY_PRIORITY( ( pxTCB )->uxPriority );											\
+	}																								\
+	else if( ( pxTCB )->uxPriority > uxCoreTopReadyPriority[ ( pxTCB )->xCoreID ] )				\
+	{																								\
+		uxCoreTopReadyPriority[ ( pxTCB )->xCoreID ] = ( pxTCB )->uxPriority;						\
+	}																								\
+}
+
+/*
+ * Number of ready tasks of the given priority that may run on the given core.
+ */
+#define prvReadyTasksForCore( xCoreID, uxPriority )												\
+	( listCURRENT_LIST_LENGTH( &( pxReadyTasksLists[ ( uxPriority ) ] ) ) + listCURRENT_LIST_LENGTH( &( pxCoreReadyTasksLists[ ( xCoreID ) ][ ( uxPriority ) ] ) ) )
+
 /*
  * Place the task represented by pxTCB into the appropriate ready list for
  * the task.  It is inserted at the end of the list.
  */
 #define prvAddTaskToReadyList( pxTCB )																\
-	traceMOVED_TASK_TO_READY_STATE( pxTCB )															\
-	taskRECORD_READY_PRIORITY( ( pxTCB )->uxPriority );												\
-	vListInsertEnd( &( pxReadyTasksLists[ ( pxTCB )->uxPriority ] ), &( ( pxTCB )->xGenericListItem ) )
+	traceMOVED_TASK_TO_READY_STATE( pxTCB );														\
+	taskENTER_CRITICAL_ISR( prvReadyListsMuxForTask( pxTCB ) );										\
+	prvRecordReadyPriority( pxTCB );																\
+	vListInsertEnd( prvReadyListForTask( ( pxTCB ), ( pxTCB )->uxPriority ), &( ( pxTCB )->xGenericListItem ) );	\
+	taskEXIT_CRITICAL_ISR( prvReadyListsMuxForTask( pxTCB ) );										\
+	taskWAKE_SLEEPING_CORE( ( pxTCB )->xCoreID )
+
+/*
+ * A core that has suppressed its tick sleeps until its next timeout; it has to
+ * be woken up when a task that may run on it becomes ready.
+ */
+#if ( configUSE_TICKLESS_IDLE != 0 )
+	#define taskWAKE_SLEEPING_CORE( xCoreID )	vPortWakeSleepingCore( xCoreID )
+#else
+	#define taskWAKE_SLEEPING_CORE( xCoreID )
+#endif
 /*-----------------------------------------------------------*/
 
 /*
@@ -515,11 +620,48 @@ static void prvCheckTasksWaitingTermination( void ) PRIVILEGED_FUNCTION;
  */
 static void prvAddCurrentTaskToDelayedList( const portBASE_TYPE xCoreID, const TickType_t xTimeToWake ) PRIVILEGED_FUNCTION;
 
+/*
+ * Used by vTaskSwitchContext() to pick the next task of one ready list that
+ * may be switched in on core xCoreID.  With xLastCoreOnly set, tasks that last
+ * ran on another core are passed over.  Returns NULL if there is none.
+ */
+static TCB_t *prvSelectFromReadyList( List_t * const pxList, const BaseType_t xCoreID, const BaseType_t xLastCoreOnly ) PRIVILEGED_FUNCTION;
+
+/*
+ * Selects an unpinned task of the given priority that can run on the given
+ * core, or returns NULL.
+ */
+static TCB_t *prvSelectFromSharedReadyList( const UBaseType_t uxPriority, const BaseType_t xCoreID ) PRIVILEGED_FUNCTION;
+
+/*
+ * Removes the task from the list its xGenericListItem is in, like uxListRemove,
+ * and takes the lock of that list if it is a ready list.  Must be called with
+ * xTaskQueueMutex held, which keeps the task from being moved to another list
+ * meanwhile.
+ */
+static UBaseType_t prvRemoveTaskFromStateList( TCB_t *pxTCB ) PRIVILEGED_FUNCTION;
+
+/*
+ * Take, respectively release, the locks of all the ready lists, for the
+ * functions that walk them.  Interrupts must be disabled, e.g. by holding
+ * xTaskQueueMutex.
+ */
+static void prvLockReadyLists( void ) PRIVILEGED_FUNCTION;
+static void prvUnlockReadyLists( void ) PRIVILEGED_FUNCTION;
+
 /*
  * Allocates memory from the heap for a TCB and associated stack.  Checks the
- * allocation was successful.
+ * allocation was successful.  If puxStackBuffer or pxTCBBuffer are not NULL
+ * the memory they point to is used instead.  pxTCBBuffer can only be set if
+ * puxStackBuffer is set too.
+ */
+static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer, TCB_t * const pxTCBBuffer ) PRIVILEGED_FUNCTION;
+
+/*
+ * Creates a task, see xTaskGenericCreate().  pxTaskBuffer is NULL if the TCB
+ * is to be allocated from the heap.
  */
-static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer ) PRIVILEGED_FUNCTION;
+static BaseType_t prvTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions, const BaseType_t xCoreID, TCB_t * const pxTaskBuffer ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 
 /*
  * Fills an TaskStatus_t structure with information on each task that is
@@ -582,14 +724,54 @@ static void prvResetNextTaskUnblockTime( void );
 
 static void vTaskInitializeLocalMuxes( void )
 {
+BaseType_t xCoreID;
+
 	vPortCPUInitializeMutex(&xTaskQueueMutex);
 	vPortCPUInitializeMutex(&xTickCountMutex);
+	vPortCPUInitializeMutex(&xSharedReadyListsMux);
+	for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+	{
+		vPortCPUInitializeMutex(&xCoreReadyListsMux[ xCoreID ]);
+	}
+	#ifdef CONFIG_FREERTOS_PORTMUX_STATS
+	{
+		xPortCPUMutexRegister( &xTaskQueueMutex, "xTaskQueueMutex" );
+		xPortCPUMutexRegister( &xTickCountMutex, "xTickCountMutex" );
+		xPortCPUMutexRegister( &xSharedReadyListsMux, "xSharedReadyListsMux" );
+		for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+		{
+			xPortCPUMutexRegister( &xCoreReadyListsMux[ xCoreID ], "xCoreReadyListsMux" );
+		}
+	}
+	#endif
 	xMutexesInitialised = pdTRUE;
 }
 
 /*-----------------------------------------------------------*/
 
 BaseType_t xTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions, const BaseType_t xCoreID) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+{
+	return prvTaskGenericCreate( pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, puxStackBuffer, xRegions, xCoreID, NULL );
+}
+/*-----------------------------------------------------------*/
+
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+	BaseType_t xTaskCreateStaticPinnedToCore( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, StackType_t * const puxStackBuffer, StaticTask_t * const pxTaskBuffer, TaskHandle_t * const pxCreatedTask, const BaseType_t xCoreID ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	{
+		/* StaticTask_t has to be able to hold a TCB_t, see its definition in
+		FreeRTOS.h. */
+		configASSERT( sizeof( StaticTask_t ) == sizeof( TCB_t ) );
+		configASSERT( puxStackBuffer != NULL );
+		configASSERT( pxTaskBuffer != NULL );
+
+		return prvTaskGenericCreate( pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, puxStackBuffer, NULL, xCoreID, ( TCB_t * ) pxTaskBuffer ); /*lint !e740 Unusual cast is ok as the structures are designed to have the same alignment, and the size is checked by an assert. */
+	}
+
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions, const BaseType_t xCoreID, TCB_t * const pxTaskBuffer ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 {
 BaseType_t xReturn;
 TCB_t * pxNewTCB;
@@ -605,7 +787,7 @@ BaseType_t i;
 
 	/* Allocate the memory required by the TCB and stack for the new task,
 	checking that the allocation was successful. */
-	pxNewTCB = prvAllocateTCBAndStack( usStackDepth, puxStackBuffer );
+	pxNewTCB = prvAllocateTCBAndStack( usStackDepth, puxStackBuffer, pxTaskBuffer );
 
 	if( pxNewTCB != NULL )
 	{
@@ -648,6 +830,14 @@ BaseType_t i;
 
 			/* Check the alignment of the calculated top of stack is correct. */
 			configASSERT( ( ( ( portPOINTER_SIZE_TYPE ) pxTopOfStack & ( portPOINTER_SIZE_TYPE ) portBYTE_ALIGNMENT_MASK ) == 0UL ) );
+
+			#if( configRECORD_STACK_HIGH_ADDRESS == 1 )
+			{
+				/* Also record the stack high address for the debugger, and
+				uxTaskGetStackInfo(). */
+				pxNewTCB->pxEndOfStack = pxTopOfStack;
+			}
+			#endif /* configRECORD_STACK_HIGH_ADDRESS */
 		}
 		#else /* portSTACK_GROWTH */
 		{
@@ -798,7 +988,7 @@ BaseType_t i;
 			This will stop the task from be scheduled.  The idle task will check
 			the termination list and free up any memory allocated by the
 			scheduler for the TCB and stack. */
-			if( uxListRemove( &( pxTCB->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+			if( prvRemoveTaskFromStateList( pxTCB ) == ( UBaseType_t ) 0 )
 			{
 				taskRESET_READY_PRIORITY( pxTCB->uxPriority );
 			}
@@ -930,7 +1120,7 @@ BaseType_t i;
 
 				/* Remove the task from the ready list before adding it to the
 				blocked list as the same list item is used for both lists. */
-				if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+				if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 				{
 					/* The current task must be in a ready list, so there is
 					no need to check, and the port reset macro can be called
@@ -999,7 +1189,7 @@ BaseType_t i;
 				/* We must remove ourselves from the ready list before adding
 				ourselves to the blocked list as the same list item is used for
 				both lists. */
-				if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+				if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 				{
 					/* The current task must be in a ready list, so there is
 					no need to check, and the port reset macro can be called
@@ -1272,12 +1462,12 @@ BaseType_t i;
 				nothing more than change it's priority variable. However, if
 				the task is in a ready list it needs to be removed and placed
 				in the list appropriate to its new priority. */
-				if( listIS_CONTAINED_WITHIN( &( pxReadyTasksLists[ uxPriorityUsedOnEntry ] ), &( pxTCB->xGenericListItem ) ) != pdFALSE )
+				if( listIS_CONTAINED_WITHIN( prvReadyListForTask( pxTCB, uxPriorityUsedOnEntry ), &( pxTCB->xGenericListItem ) ) != pdFALSE )
 				{
 					/* The task is currently in its ready list - remove before adding
 					it to it's new ready list.  As we are in a critical section we
 					can do this even if the scheduler is suspended. */
-					if( uxListRemove( &( pxTCB->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+					if( prvRemoveTaskFromStateList( pxTCB ) == ( UBaseType_t ) 0 )
 					{
 						/* It is known that the task is in its ready list so
 						there is no need to check again and the port level
@@ -1315,6 +1505,25 @@ BaseType_t i;
 #endif /* INCLUDE_vTaskPrioritySet */
 /*-----------------------------------------------------------*/
 
+void vTaskSetIramSafe( TaskHandle_t xTask, BaseType_t xIramSafe )
+{
+TCB_t *pxTCB;
+
+	taskENTER_CRITICAL(&xTaskQueueMutex);
+	{
+		pxTCB = prvGetTCBFromHandle( xTask );
+		pxTCB->xIramSafe = xIramSafe;
+	}
+	taskEXIT_CRITICAL(&xTaskQueueMutex);
+}
+/*-----------------------------------------------------------*/
+
+void vTaskSetIramOnlyScheduling( BaseType_t xIramOnly )
+{
+	xIramOnlyScheduling[ xPortGetCoreID() ] = xIramOnly;
+}
+/*-----------------------------------------------------------*/
+
 #if ( INCLUDE_vTaskSuspend == 1 )
 /* ToDo: Make this multicore-compatible. */
 	void vTaskSuspend( TaskHandle_t xTaskToSuspend )
@@ -1332,7 +1541,7 @@ BaseType_t i;
 
 			/* Remove task from the ready/delayed list and place in the
 			suspended list. */
-			if( uxListRemove( &( pxTCB->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+			if( prvRemoveTaskFromStateList( pxTCB ) == ( UBaseType_t ) 0 )
 			{
 				taskRESET_READY_PRIORITY( pxTCB->uxPriority );
 			}
@@ -1478,7 +1687,7 @@ BaseType_t i;
 
 					/* As we are in a critical section we can access the ready
 					lists even if the scheduler is suspended. */
-					( void ) uxListRemove(  &( pxTCB->xGenericListItem ) );
+					( void ) prvRemoveTaskFromStateList( pxTCB );
 					prvAddTaskToReadyList( pxTCB );
 
 					/* We may have just resumed a higher priority task. */
@@ -1542,7 +1751,7 @@ BaseType_t i;
 						mtCOVERAGE_TEST_MARKER();
 					}
 
-					( void ) uxListRemove(  &( pxTCB->xGenericListItem ) );
+					( void ) prvRemoveTaskFromStateList( pxTCB );
 					prvAddTaskToReadyList( pxTCB );
 				}
 				else
@@ -1573,7 +1782,7 @@ BaseType_t i;
 
 	/* Add the per-core idle tasks at the lowest priority. */
 	for ( i=0; i<portNUM_PROCESSORS; i++) {
-		#if ( INCLUDE_xTaskGetIdleTaskHandle == 1 )
+		#if ( INCLUDE_xTaskGetIdleTaskHandle == 1 ) || ( configGENERATE_RUN_TIME_STATS == 1 ) || CONFIG_PM_ENABLE
 		{
 			/* Create the idle task, storing its handle in xIdleTaskHandle so it can
 			be returned by the xTaskGetIdleTaskHandle() function. */
@@ -1690,7 +1899,7 @@ void vTaskSuspendAll( void )
 		{
 			xReturn = 0;
 		}
-		else if( listCURRENT_LIST_LENGTH( &( pxReadyTasksLists[ tskIDLE_PRIORITY ] ) ) > 1 )
+		else if( prvReadyTasksForCore( xPortGetCoreID(), tskIDLE_PRIORITY ) > 1 )
 		{
 			/* There are other idle priority tasks in the ready state.  If
 			time slicing is used then the very next tick interrupt must be
@@ -1743,7 +1952,7 @@ BaseType_t xAlreadyYielded = pdFALSE;
 				{
 					pxTCB = ( TCB_t * ) listGET_OWNER_OF_HEAD_ENTRY( ( &xPendingReadyList ) );
 					( void ) uxListRemove( &( pxTCB->xEventListItem ) );
-					( void ) uxListRemove( &( pxTCB->xGenericListItem ) );
+					( void ) prvRemoveTaskFromStateList( pxTCB );
 					prvAddTaskToReadyList( pxTCB );
 
 					/* If the moved task has a priority higher than the current
@@ -1867,6 +2076,7 @@ UBaseType_t uxTaskGetNumberOfTasks( void )
 	UBaseType_t uxTaskGetSystemState( TaskStatus_t * const pxTaskStatusArray, const UBaseType_t uxArraySize, uint32_t * const pulTotalRunTime )
 	{
 	UBaseType_t uxTask = 0, uxQueue = configMAX_PRIORITIES;
+BaseType_t xCoreID;
 
 		ets_printf("ToDo %s\n", __FUNCTION__);
 		vTaskSuspendAll(); //WARNING: This only suspends one CPU. ToDo: suspend others as well. Mux using taskQueueMutex maybe?
@@ -1875,13 +2085,22 @@ UBaseType_t uxTaskGetNumberOfTasks( void )
 			if( uxArraySize >= uxCurrentNumberOfTasks )
 			{
 				/* Fill in an TaskStatus_t structure with information on each
-				task in the Ready state. */
+				task in the Ready state.  The ready lists are locked, as the
+				context switches walk them as well. */
+				taskENTER_CRITICAL(&xTaskQueueMutex);
+				prvLockReadyLists();
 				do
 				{
 					uxQueue--;
 					uxTask += prvListTaskWithinSingleList( &( pxTaskStatusArray[ uxTask ] ), &( pxReadyTasksLists[ uxQueue ] ), eReady );
+					for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+					{
+						uxTask += prvListTaskWithinSingleList( &( pxTaskStatusArray[ uxTask ] ), &( pxCoreReadyTasksLists[ xCoreID ][ uxQueue ] ), eReady );
+					}
 
 				} while( uxQueue > ( UBaseType_t ) tskIDLE_PRIORITY ); /*lint !e961 MISRA exception as the casts are only redundant for some ports. */
+				prvUnlockReadyLists();
+				taskEXIT_CRITICAL(&xTaskQueueMutex);
 
 				/* Fill in an TaskStatus_t structure with information on each
 				task in the Blocked state. */
@@ -1908,11 +2127,15 @@ UBaseType_t uxTaskGetNumberOfTasks( void )
 				{
 					if( pulTotalRunTime != NULL )
 					{
-						#ifdef portALT_GET_RUN_TIME_COUNTER_VALUE
-							portALT_GET_RUN_TIME_COUNTER_VALUE( ( *pulTotalRunTime ) );
-						#else
-							*pulTotalRunTime = portGET_RUN_TIME_COUNTER_VALUE();
-						#endif
+					uint64_t ullTotal = 0;
+
+						/* Reported in the same unit as ulRunTimeCounter, so the
+						task counters add up to the total of all cores. */
+						for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+						{
+							ullTotal += ullTotalRunTime[ xCoreID ];
+						}
+						*pulTotalRunTime = ( uint32_t ) ( ullTotal / tskRUN_TIME_COUNTS_PER_US );
 					}
 				}
 				#else
@@ -1937,14 +2160,129 @@ UBaseType_t uxTaskGetNumberOfTasks( void )
 #endif /* configUSE_TRACE_FACILITY */
 /*----------------------------------------------------------*/
 
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+
+	static UBaseType_t prvListTaskRunTimeWithinSingleList( TaskRunTimeStats_t *pxTaskStatsArray, List_t *pxList )
+	{
+	volatile TCB_t *pxNextTCB, *pxFirstTCB;
+	UBaseType_t uxTask = 0;
+
+		if( listCURRENT_LIST_LENGTH( pxList ) > ( UBaseType_t ) 0 )
+		{
+			listGET_OWNER_OF_NEXT_ENTRY( pxFirstTCB, pxList );
+			do
+			{
+				listGET_OWNER_OF_NEXT_ENTRY( pxNextTCB, pxList );
+
+				pxTaskStatsArray[ uxTask ].xHandle = ( TaskHandle_t ) pxNextTCB;
+				pxTaskStatsArray[ uxTask ].pcTaskName = ( const char * ) &( pxNextTCB->pcTaskName [ 0 ] );
+				memcpy( pxTaskStatsArray[ uxTask ].ullRunTime, ( const void * ) pxNextTCB->ullRunTimeCounter, sizeof( pxTaskStatsArray[ uxTask ].ullRunTime ) );
+				uxTask++;
+
+			} while( pxNextTCB != pxFirstTCB );
+		}
+
+		return uxTask;
+	}
+	/*-----------------------------------------------------------*/
+
+	UBaseType_t uxTaskGetRunTimeStats( TaskRunTimeStats_t * const pxTaskStatsArray, const UBaseType_t uxArraySize, CoreRunTimeStats_t * const pxCoreStats )
+	{
+	UBaseType_t uxTask = 0, uxQueue = configMAX_PRIORITIES, uxCallerTask = 0;
+	BaseType_t xCoreID, xCallerCoreID;
+	TCB_t *pxCallerTCB;
+	uint32_t ulNow, ulRunning;
+
+		/* The counters are updated under the locks of the ready lists of each
+		core, so holding all of them gives a consistent snapshot of all cores. */
+		taskENTER_CRITICAL(&xTaskQueueMutex);
+		prvLockReadyLists();
+
+		/* The counters only include time up to the last context switch of each
+		core.  The run time counter of the calling core can be read here, so the
+		time of the calling task is brought up to date. */
+		xCallerCoreID = xPortGetCoreID();
+		pxCallerTCB = pxCurrentTCB[ xCallerCoreID ];
+		#ifdef portALT_GET_RUN_TIME_COUNTER_VALUE
+			portALT_GET_RUN_TIME_COUNTER_VALUE( ulNow );
+		#else
+			ulNow = portGET_RUN_TIME_COUNTER_VALUE();
+		#endif
+		ulRunning = ( xTaskSwitchedInTimeValid[ xCallerCoreID ] != pdFALSE ) ? ( uint32_t ) ( ulNow - ulTaskSwitchedInTime[ xCallerCoreID ] ) : 0;
+
+		if( pxCoreStats != NULL )
+		{
+			for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+			{
+				pxCoreStats[ xCoreID ].ullTotalRunTime = ullTotalRunTime[ xCoreID ];
+				pxCoreStats[ xCoreID ].ullIdleRunTime = ( xIdleTaskHandle[ xCoreID ] != NULL ) ? ( ( TCB_t * ) xIdleTaskHandle[ xCoreID ] )->ullRunTimeCounter[ xCoreID ] : 0;
+			}
+			pxCoreStats[ xCallerCoreID ].ullTotalRunTime += ulRunning;
+			if( ( TaskHandle_t ) pxCallerTCB == xIdleTaskHandle[ xCallerCoreID ] )
+			{
+				pxCoreStats[ xCallerCoreID ].ullIdleRunTime += ulRunning;
+			}
+		}
+
+		/* Is there a space in the array for each task in the system? */
+		if( ( pxTaskStatsArray != NULL ) && ( uxArraySize >= uxCurrentNumberOfTasks ) )
+		{
+			do
+			{
+				uxQueue--;
+				uxTask += prvListTaskRunTimeWithinSingleList( &( pxTaskStatsArray[ uxTask ] ), &( pxReadyTasksLists[ uxQueue ] ) );
+				for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+				{
+					uxTask += prvListTaskRunTimeWithinSingleList( &( pxTaskStatsArray[ uxTask ] ), &( pxCoreReadyTasksLists[ xCoreID ][ uxQueue ] ) );
+				}
+			} while( uxQueue > ( UBaseType_t ) tskIDLE_PRIORITY ); /*lint !e961 MISRA exception as the casts are only redundant for some ports. */
+
+			uxTask += prvListTaskRunTimeWithinSingleList( &( pxTaskStatsArray[ uxTask ] ), ( List_t * ) pxDelayedTaskList );
+			uxTask += prvListTaskRunTimeWithinSingleList( &( pxTaskStatsArray[ uxTask ] ), ( List_t * ) pxOverflowDelayedTaskList );
+
+			#if( INCLUDE_vTaskDelete == 1 )
+			{
+				uxTask += prvListTaskRunTimeWithinSingleList( &( pxTaskStatsArray[ uxTask ] ), &xTasksWaitingTermination );
+			}
+			#endif
+
+			#if ( INCLUDE_vTaskSuspend == 1 )
+			{
+				uxTask += prvListTaskRunTimeWithinSingleList( &( pxTaskStatsArray[ uxTask ] ), &xSuspendedTaskList );
+			}
+			#endif
+
+			for( uxCallerTask = 0; uxCallerTask < uxTask; uxCallerTask++ )
+			{
+				if( pxTaskStatsArray[ uxCallerTask ].xHandle == ( TaskHandle_t ) pxCallerTCB )
+				{
+					pxTaskStatsArray[ uxCallerTask ].ullRunTime[ xCallerCoreID ] += ulRunning;
+					break;
+				}
+			}
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+
+		prvUnlockReadyLists();
+		taskEXIT_CRITICAL(&xTaskQueueMutex);
+
+		return uxTask;
+	}
+
+#endif /* configGENERATE_RUN_TIME_STATS */
+/*----------------------------------------------------------*/
+
 #if ( INCLUDE_xTaskGetIdleTaskHandle == 1 )
 
 	TaskHandle_t xTaskGetIdleTaskHandle( void )
 	{
 		/* If xTaskGetIdleTaskHandle() is called before the scheduler has been
 		started, then xIdleTaskHandle will be NULL. */
-		configASSERT( ( xIdleTaskHandle != NULL ) );
-		return xIdleTaskHandle;
+		configASSERT( ( xIdleTaskHandle[ xPortGetCoreID() ] != NULL ) );
+		return xIdleTaskHandle[ xPortGetCoreID() ];
 	}
 
 #endif /* INCLUDE_xTaskGetIdleTaskHandle */
@@ -2064,7 +2402,7 @@ BaseType_t xSwitchRequired = pdFALSE;
 						}
 
 						/* It is time to remove the item from the Blocked state. */
-						( void ) uxListRemove( &( pxTCB->xGenericListItem ) );
+						( void ) prvRemoveTaskFromStateList( pxTCB );
 
 						/* Is the task waiting on an event also?  If so remove
 						it from the event list. */
@@ -2109,7 +2447,7 @@ BaseType_t xSwitchRequired = pdFALSE;
 		writer has not explicitly turned time slicing off. */
 		#if ( ( configUSE_PREEMPTION == 1 ) && ( configUSE_TIME_SLICING == 1 ) )
 		{
-			if( listCURRENT_LIST_LENGTH( &( pxReadyTasksLists[ pxCurrentTCB[ xPortGetCoreID() ]->uxPriority ] ) ) > ( UBaseType_t ) 1 )
+			if( prvReadyTasksForCore( xPortGetCoreID(), pxCurrentTCB[ xPortGetCoreID() ]->uxPriority ) > ( UBaseType_t ) 1 )
 			{
 				xSwitchRequired = pdTRUE;
 			}
@@ -2256,6 +2594,151 @@ BaseType_t xSwitchRequired = pdFALSE;
 #endif /* configUSE_APPLICATION_TASK_TAG */
 /*-----------------------------------------------------------*/
 
+static UBaseType_t prvRemoveTaskFromStateList( TCB_t *pxTCB )
+{
+List_t * const pxList = ( List_t * ) listLIST_ITEM_CONTAINER( &( pxTCB->xGenericListItem ) );
+portMUX_TYPE *pxMux = NULL;
+UBaseType_t uxReturn;
+
+	if( ( pxList >= &( pxReadyTasksLists[ 0 ] ) ) && ( pxList < &( pxReadyTasksLists[ configMAX_PRIORITIES ] ) ) )
+	{
+		pxMux = &xSharedReadyListsMux;
+	}
+	else if( ( pxList >= &( pxCoreReadyTasksLists[ 0 ][ 0 ] ) ) && ( pxList < &( pxCoreReadyTasksLists[ 0 ][ 0 ] ) + portNUM_PROCESSORS * configMAX_PRIORITIES ) )
+	{
+		pxMux = &( xCoreReadyListsMux[ ( pxList - &( pxCoreReadyTasksLists[ 0 ][ 0 ] ) ) / configMAX_PRIORITIES ] );
+	}
+
+	if( pxMux != NULL )
+	{
+		taskENTER_CRITICAL_ISR( pxMux );
+	}
+	uxReturn = prvRemoveTaskFromStateList( pxTCB );
+	if( pxMux != NULL )
+	{
+		taskEXIT_CRITICAL_ISR( pxMux );
+	}
+	return uxReturn;
+}
+/*-----------------------------------------------------------*/
+
+static void prvLockReadyLists( void )
+{
+BaseType_t xCoreID;
+
+	for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+	{
+		taskENTER_CRITICAL_ISR( &( xCoreReadyListsMux[ xCoreID ] ) );
+	}
+	taskENTER_CRITICAL_ISR( &xSharedReadyListsMux );
+}
+/*-----------------------------------------------------------*/
+
+static void prvUnlockReadyLists( void )
+{
+BaseType_t xCoreID;
+
+	taskEXIT_CRITICAL_ISR( &xSharedReadyListsMux );
+	for( xCoreID = portNUM_PROCESSORS - 1; xCoreID >= 0; xCoreID-- )
+	{
+		taskEXIT_CRITICAL_ISR( &( xCoreReadyListsMux[ xCoreID ] ) );
+	}
+}
+/*-----------------------------------------------------------*/
+
+static TCB_t *prvSelectFromSharedReadyList( const UBaseType_t uxPriority, const BaseType_t xCoreID )
+{
+TCB_t *pxTCB = NULL;
+
+	#if ( configUSE_CORE_AFFINITY_HINT == 1 )
+	{
+		/* Prefer the unpinned tasks that last ran here; only steal one from
+		the other core when there is none. */
+		pxTCB = prvSelectFromReadyList( &( pxReadyTasksLists[ uxPriority ] ), xCoreID, pdTRUE );
+	}
+	#endif
+	if( pxTCB == NULL )
+	{
+		pxTCB = prvSelectFromReadyList( &( pxReadyTasksLists[ uxPriority ] ), xCoreID, pdFALSE );
+	}
+	return pxTCB;
+}
+/*-----------------------------------------------------------*/
+
+static TCB_t *prvSelectFromReadyList( List_t * const pxList, const BaseType_t xCoreID, const BaseType_t xLastCoreOnly )
+{
+TCB_t *pxTCB, *pxRefTCB, *pxResetTCB;
+BaseType_t xSkipped = pdFALSE, xUsable;
+BaseType_t i;
+
+	if( listLIST_IS_EMPTY( pxList ) != pdFALSE )
+	{
+		return NULL;
+	}
+
+	/* Remember the current list item so that we can detect if all items have
+	been inspected. Note: pxIndex can point at the list end marker, in that
+	case skip it and start from the first real item. */
+	pxRefTCB = pxList->pxIndex->pvOwner;
+	if( ( void * ) pxList->pxIndex == ( void * ) &( pxList->xListEnd ) )
+	{
+		listGET_OWNER_OF_NEXT_ENTRY( pxRefTCB, pxList );
+	}
+
+	do
+	{
+		listGET_OWNER_OF_NEXT_ENTRY( pxTCB, pxList );
+
+		/* An unpinned task may already be running on the other core. */
+		xUsable = pdTRUE;
+		for( i = 0; i < portNUM_PROCESSORS; i++ )
+		{
+			if( ( i != xCoreID ) && ( pxCurrentTCB[ i ] == pxTCB ) )
+			{
+				xUsable = pdFALSE;
+			}
+		}
+
+		/* While the cache of this core is disabled, only tasks that do not
+		touch flash can be switched in. */
+		if( ( xIramOnlyScheduling[ xCoreID ] == pdTRUE ) && ( pxTCB->xIramSafe == pdFALSE ) )
+		{
+			xUsable = pdFALSE;
+		}
+
+		#if ( configUSE_CORE_AFFINITY_HINT == 1 )
+		{
+			if( ( xLastCoreOnly != pdFALSE ) && ( pxTCB->xLastCoreID != tskNO_AFFINITY ) && ( pxTCB->xLastCoreID != xCoreID ) )
+			{
+				xUsable = pdFALSE;
+			}
+		}
+		#else
+		{
+			( void ) xLastCoreOnly;
+		}
+		#endif
+
+		if( xUsable != pdFALSE )
+		{
+			if( xSkipped != pdFALSE )
+			{
+				/* Rewind the list index, so the tasks that were stepped over
+				are the first to be inspected at the next switch. */
+				do
+				{
+					listGET_OWNER_OF_NEXT_ENTRY( pxResetTCB, pxList );
+				} while( pxResetTCB != pxRefTCB );
+			}
+			return pxTCB;
+		}
+		xSkipped = pdTRUE;
+	} while( pxTCB != pxRefTCB );
+
+	return NULL;
+}
+/*-----------------------------------------------------------*/
+
 void vTaskSwitchContext( void )
 {
 	tskTCB * pxTCB;
@@ -2276,30 +2759,35 @@ void vTaskSwitchContext( void )
 
 		#if ( configGENERATE_RUN_TIME_STATS == 1 )
 		{
+		uint32_t ulNow;
+		BaseType_t xCoreID = xPortGetCoreID();
+
 				#ifdef portALT_GET_RUN_TIME_COUNTER_VALUE
-					portALT_GET_RUN_TIME_COUNTER_VALUE( ulTotalRunTime );
+					portALT_GET_RUN_TIME_COUNTER_VALUE( ulNow );
 				#else
-					ulTotalRunTime = portGET_RUN_TIME_COUNTER_VALUE();
+					ulNow = portGET_RUN_TIME_COUNTER_VALUE();
 				#endif
 
-				/* Add the amount of time the task has been running to the
-				accumulated	time so far.  The time the task started running was
-				stored in ulTaskSwitchedInTime.  Note that there is no overflow
-				protection here	so count values are only valid until the timer
-				overflows.  The guard against negative values is to protect
-				against suspect run time stat counter implementations - which
-				are provided by the application, not the kernel. */
-				taskENTER_CRITICAL_ISR(&xTaskQueueMutex);
-				if( ulTotalRunTime > ulTaskSwitchedInTime )
+				/* Add the amount of time the task has been running on this core
+				to its accumulated time.  The time the task started running was
+				stored in ulTaskSwitchedInTime.  The unsigned subtraction gives
+				the right result across a wrap of the 32-bit counter, so counts
+				are only lost if a task runs for longer than a full counter
+				period without a context switch.  The totals are 64 bits wide
+				and do not overflow.  They are updated under the lock of the
+				ready lists of this core, which uxTaskGetRunTimeStats takes. */
+				taskENTER_CRITICAL_ISR(&xCoreReadyListsMux[ xCoreID ]);
+				if( xTaskSwitchedInTimeValid[ xCoreID ] != pdFALSE )
 				{
-					pxCurrentTCB[ xPortGetCoreID() ]->ulRunTimeCounter += ( ulTotalRunTime - ulTaskSwitchedInTime );
+					pxCurrentTCB[ xCoreID ]->ullRunTimeCounter[ xCoreID ] += ( uint32_t ) ( ulNow - ulTaskSwitchedInTime[ xCoreID ] );
+					ullTotalRunTime[ xCoreID ] += ( uint32_t ) ( ulNow - ulTaskSwitchedInTime[ xCoreID ] );
 				}
 				else
 				{
-					mtCOVERAGE_TEST_MARKER();
+					xTaskSwitchedInTimeValid[ xCoreID ] = pdTRUE;
 				}
-				taskEXIT_CRITICAL_ISR(&xTaskQueueMutex);
-				ulTaskSwitchedInTime = ulTotalRunTime;
+				ulTaskSwitchedInTime[ xCoreID ] = ulNow;
+				taskEXIT_CRITICAL_ISR(&xCoreReadyListsMux[ xCoreID ]);
 		}
 		#endif /* configGENERATE_RUN_TIME_STATS */
 
@@ -2313,97 +2801,112 @@ void vTaskSwitchContext( void )
 		   taskSELECT_HIGHEST_PRIORITY_TASK macro, then replace this all with a taskSELECT_HIGHEST_PRIORITY_TASK(); 
 		   call */
 		
-		taskENTER_CRITICAL_ISR(&xTaskQueueMutex);
-		
-		unsigned portBASE_TYPE foundNonExecutingWaiter = pdFALSE, ableToSchedule = pdFALSE, resetListHead;
-		unsigned portBASE_TYPE uxDynamicTopReady = uxTopReadyPriority;
-		unsigned portBASE_TYPE holdTop=pdFALSE;
-		
-		/*
-		 *  ToDo: This scheduler doesn't correctly implement the round-robin scheduling as done in the single-core
-		 *  FreeRTOS stack when multiple tasks have the same priority and are all ready; it just keeps grabbing the
-		 *  first one. ToDo: fix this.
-		 *  (Is this still true? if any, there's the issue with one core skipping over the processes for the other
-		 *  core, potentially not giving the skipped-over processes any time.)
-		 */
-		
-		while ( ableToSchedule == pdFALSE && uxDynamicTopReady >= 0 )
+		BaseType_t xCoreID = xPortGetCoreID();
+		UBaseType_t uxDynamicTopReady;
+		BaseType_t xSharedLocked = pdFALSE;
+
+		/* Only the ready lists are looked at, so xTaskQueueMutex isn't needed;
+		the lists of this core are locked for the whole selection. */
+		taskENTER_CRITICAL_ISR(&xCoreReadyListsMux[ xCoreID ]);
+
+		uxDynamicTopReady = uxCoreTopReadyPriority[ xCoreID ];
+		if( uxTopReadyPriority > uxDynamicTopReady )
 		{
-			configASSERT( uxTopReadyPriority>=0 );
-			configASSERT( uxDynamicTopReady>=0 );
-			resetListHead = pdFALSE;
-			// Nothing to do for empty lists
-			if (!listLIST_IS_EMPTY( &( pxReadyTasksLists[ uxDynamicTopReady ] ) )) {
-				
-				ableToSchedule = pdFALSE;
-				tskTCB * pxRefTCB;
-				
-				/* Remember the current list item so that we
-				can detect if all items have been inspected.
-				Once this happens, we move on to a lower
-				priority list (assuming nothing is suitable
-				for scheduling). Note: This can return NULL if 
-				the list index is at the listItem */
-				pxRefTCB = pxReadyTasksLists[ uxDynamicTopReady ].pxIndex->pvOwner;
-
-				if ((void*)pxReadyTasksLists[ uxDynamicTopReady ].pxIndex==(void*)&pxReadyTasksLists[ uxDynamicTopReady ].xListEnd) {
-					//pxIndex points to the list end marker. Skip that and just get the next item.
-					listGET_OWNER_OF_NEXT_ENTRY( pxRefTCB, &( pxReadyTasksLists[ uxDynamicTopReady ] ) );
+			uxDynamicTopReady = uxTopReadyPriority;
+		}
+
+		for( ;; )
+		{
+			/* The shared lists are locked once they can hold a task of the
+			priority looked at.  uxTopReadyPriority is read without their lock:
+			an unpinned task readied on the other core meanwhile is picked up
+			at the next switch, as if it had been readied just after this one. */
+			if( ( xSharedLocked == pdFALSE ) && ( uxDynamicTopReady <= uxTopReadyPriority ) )
+			{
+				taskENTER_CRITICAL_ISR(&xSharedReadyListsMux);
+				xSharedLocked = pdTRUE;
+			}
+
+			/* The list of the tasks pinned to this core and the shared list of
+			the same priority take turns in being looked at first, so neither
+			kind of task starves the other at equal priority (the idle task is
+			pinned, so unpinned tasks of tskIDLE_PRIORITY depend on this). An
+			unpinned task that is passed over here can be picked up by the
+			other core at its next switch; this is the path by which tasks
+			without affinity move between the cores. */
+			pxTCB = NULL;
+			if( ( xSharedLocked != pdFALSE ) && ( xSharedListFirst[ xCoreID ] != pdFALSE ) )
+			{
+				pxTCB = prvSelectFromSharedReadyList( uxDynamicTopReady, xCoreID );
+				if( pxTCB != NULL )
+				{
+					xSharedListFirst[ xCoreID ] = pdFALSE;
 				}
-				
-				do {
-					listGET_OWNER_OF_NEXT_ENTRY( pxTCB, &( pxReadyTasksLists[ uxDynamicTopReady ] ) );
-					/* Find out if the next task in the list is
-					already being executed by another core */
-					foundNonExecutingWaiter = pdTRUE;
-					portBASE_TYPE i = 0;
-					for ( i=0; i<portNUM_PROCESSORS; i++ ) {
-						if (i == xPortGetCoreID()) {
-							continue;
-						} else if (pxCurrentTCB[i] == pxTCB) {
-							holdTop=pdTRUE; //keep this as the top prio, for the other CPU
-							foundNonExecutingWaiter = pdFALSE;
-							break;
-						}
-					}
-					
-					if (foundNonExecutingWaiter == pdTRUE) {
-						/* If the task is not being executed
-						by another core and its affinity is
-						compatible with the current one,
-						prepare it to be swapped in */
-						if (pxTCB->xCoreID == tskNO_AFFINITY) {
-							pxCurrentTCB[xPortGetCoreID()] = pxTCB;
-							ableToSchedule = pdTRUE;
-						} else if (pxTCB->xCoreID == xPortGetCoreID()) {
-							pxCurrentTCB[xPortGetCoreID()] = pxTCB;
-							ableToSchedule = pdTRUE;
-						} else {
-							ableToSchedule = pdFALSE;
-							holdTop=pdTRUE; //keep this as the top prio, for the other CPU
-						}
-					} else {
-						ableToSchedule = pdFALSE;
-					}
-					
-					if (ableToSchedule == pdFALSE) {
-						resetListHead = pdTRUE;
-					} else if ((ableToSchedule == pdTRUE) && (resetListHead == pdTRUE)) {
-						tskTCB * pxResetTCB;
-						do {
-							listGET_OWNER_OF_NEXT_ENTRY( pxResetTCB, &( pxReadyTasksLists[ uxDynamicTopReady ] ) );
-						} while(pxResetTCB != pxRefTCB);
-					}
-				} while ((ableToSchedule == pdFALSE) && (pxTCB != pxRefTCB));
-			} else {
-				if (!holdTop) --uxTopReadyPriority;
+			}
+			if( pxTCB == NULL )
+			{
+				pxTCB = prvSelectFromReadyList( &( pxCoreReadyTasksLists[ xCoreID ][ uxDynamicTopReady ] ), xCoreID, pdFALSE );
+				if( pxTCB != NULL )
+				{
+					xSharedListFirst[ xCoreID ] = pdTRUE;
+				}
+			}
+			if( ( pxTCB == NULL ) && ( xSharedLocked != pdFALSE ) && ( xSharedListFirst[ xCoreID ] == pdFALSE ) )
+			{
+				pxTCB = prvSelectFromSharedReadyList( uxDynamicTopReady, xCoreID );
+			}
+			if( pxTCB != NULL )
+			{
+				#if ( configUSE_CORE_AFFINITY_HINT == 1 )
+				{
+					pxTCB->xLastCoreID = xCoreID;
+				}
+				#endif
+				pxCurrentTCB[ xCoreID ] = pxTCB;
+				break;
+			}
+
+			/* Each upper bound is only lowered under the lock of its lists. */
+			if( ( uxDynamicTopReady == uxCoreTopReadyPriority[ xCoreID ] ) && ( uxDynamicTopReady > tskIDLE_PRIORITY ) && ( listLIST_IS_EMPTY( &( pxCoreReadyTasksLists[ xCoreID ][ uxDynamicTopReady ] ) ) != pdFALSE ) )
+			{
+				--uxCoreTopReadyPriority[ xCoreID ];
+			}
+			if( ( xSharedLocked != pdFALSE ) && ( uxDynamicTopReady == uxTopReadyPriority ) && ( uxDynamicTopReady > tskIDLE_PRIORITY ) && ( listLIST_IS_EMPTY( &( pxReadyTasksLists[ uxDynamicTopReady ] ) ) != pdFALSE ) )
+			{
+				--uxTopReadyPriority;
+			}
+
+			if( uxDynamicTopReady == tskIDLE_PRIORITY )
+			{
+				/* Nothing can be switched in; keep running the current task. */
+				break;
 			}
 			--uxDynamicTopReady;
 		}
-		taskEXIT_CRITICAL_ISR(&xTaskQueueMutex);
+		if( xSharedLocked != pdFALSE )
+		{
+			taskEXIT_CRITICAL_ISR(&xSharedReadyListsMux);
+		}
+		taskEXIT_CRITICAL_ISR(&xCoreReadyListsMux[ xCoreID ]);
 
 		/* ToDo: taskSELECT_HIGHEST_PRIORITY_TASK replacement code ends here. */
 
+		#if CONFIG_FREERTOS_WATCHPOINT_END_OF_STACK
+		{
+			/* Move the watchpoint to the end of the stack of the task that
+			runs next. */
+			vPortSetStackWatchpoint( pxCurrentTCB[ xPortGetCoreID() ]->pxStack );
+		}
+		#endif
+
+		#if CONFIG_PM_ENABLE
+		{
+			/* The CPU frequency drops once the idle tasks run on all cores,
+			and goes up again when any core switches to another task. */
+			esp_pm_impl_switched_in( pxCurrentTCB[ xPortGetCoreID() ] == xIdleTaskHandle[ xPortGetCoreID() ] );
+		}
+		#endif
+
 		traceTASK_SWITCHED_IN();
 
 	}
@@ -2428,7 +2931,7 @@ TickType_t xTimeToWake;
 	/* The task must be removed from from the ready list before it is added to
 	the blocked list as the same list item is used for both lists.  Exclusive
 	access to the ready lists guaranteed because the scheduler is locked. */
-	if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+	if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 	{
 		/* The current task must be in a ready list, so there is no need to
 		check, and the port reset macro can be called directly. */
@@ -2480,9 +2983,8 @@ TickType_t xTimeToWake;
 
 	taskENTER_CRITICAL(&xTaskQueueMutex);
 
-	/* THIS FUNCTION MUST BE CALLED WITH THE SCHEDULER SUSPENDED.  It is used by
-	the event groups implementation. */
-	configASSERT( uxSchedulerSuspended[ xPortGetCoreID() ] != 0 );
+	/* THIS FUNCTION MUST BE CALLED WITH THE MUX OF THE EVENT GROUP HELD.  It is
+	used by the event groups implementation. */
 
 	/* Store the item value in the event list item.  It is safe to access the
 	event list item here as interrupts won't access the event list item of a
@@ -2490,16 +2992,15 @@ TickType_t xTimeToWake;
 	listSET_LIST_ITEM_VALUE( &( pxCurrentTCB[ xPortGetCoreID() ]->xEventListItem ), xItemValue | taskEVENT_LIST_ITEM_VALUE_IN_USE );
 
 	/* Place the event list item of the TCB at the end of the appropriate event
-	list.  It is safe to access the event list here because it is part of an
-	event group implementation - and interrupts don't access event groups
-	directly (instead they access them indirectly by pending function calls to
-	the task level). */
+	list.  It is safe to access the event list here because the caller holds
+	the mux of the event group, which tasks and interrupts setting bits in it
+	take as well. */
 	vListInsertEnd( pxEventList, &( pxCurrentTCB[ xPortGetCoreID() ]->xEventListItem ) );
 
 	/* The task must be removed from the ready list before it is added to the
 	blocked list.  Exclusive access can be assured to the ready list as the
 	scheduler is locked. */
-	if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+	if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 	{
 		/* The current task must be in a ready list, so there is no need to
 		check, and the port reset macro can be called directly. */
@@ -2566,7 +3067,7 @@ TickType_t xTimeToWake;
 		/* We must remove this task from the ready list before adding it to the
 		blocked list as the same list item is used for both lists.  This
 		function is called form a critical section. */
-		if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+		if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 		{
 			/* The current task must be in a ready list, so there is no need to
 			check, and the port reset macro can be called directly. */
@@ -2614,7 +3115,7 @@ BaseType_t xReturn;
 
 	if( uxSchedulerSuspended[ xPortGetCoreID() ] == ( UBaseType_t ) pdFALSE )
 	{
-		( void ) uxListRemove( &( pxUnblockedTCB->xGenericListItem ) );
+		( void ) prvRemoveTaskFromStateList( pxUnblockedTCB );
 		prvAddTaskToReadyList( pxUnblockedTCB );
 	}
 	else
@@ -2666,25 +3167,39 @@ BaseType_t xTaskRemoveFromUnorderedEventList( ListItem_t * pxEventListItem, cons
 TCB_t *pxUnblockedTCB;
 BaseType_t xReturn;
 
-	taskENTER_CRITICAL(&xTaskQueueMutex);
-	/* THIS FUNCTION MUST BE CALLED WITH THE SCHEDULER SUSPENDED.  It is used by
-	the event flags implementation. */
-	configASSERT( uxSchedulerSuspended[ xPortGetCoreID() ] != pdFALSE );
+	/* THIS FUNCTION MUST BE CALLED WITH THE MUX OF THE EVENT GROUP HELD.  It is
+	used by the event flags implementation, and can be called from an ISR. */
+	taskENTER_CRITICAL_ISR(&xTaskQueueMutex);
+
+	/* The tick interrupt of the other core may have timed the task out and
+	taken it off the event list since the caller looked at it. */
+	if( listLIST_ITEM_CONTAINER( pxEventListItem ) == NULL )
+	{
+		taskEXIT_CRITICAL_ISR(&xTaskQueueMutex);
+		return pdFALSE;
+	}
 
 	/* Store the new item value in the event list. */
 	listSET_LIST_ITEM_VALUE( pxEventListItem, xItemValue | taskEVENT_LIST_ITEM_VALUE_IN_USE );
 
-	/* Remove the event list form the event flag.  Interrupts do not access
-	event flags. */
+	/* Remove the event list form the event flag. */
 	pxUnblockedTCB = ( TCB_t * ) listGET_LIST_ITEM_OWNER( pxEventListItem );
 	configASSERT( pxUnblockedTCB );
 	( void ) uxListRemove( pxEventListItem );
 
-	/* Remove the task from the delayed list and add it to the ready list.  The
-	scheduler is suspended so interrupts will not be accessing the ready
-	lists. */
-	( void ) uxListRemove( &( pxUnblockedTCB->xGenericListItem ) );
-	prvAddTaskToReadyList( pxUnblockedTCB );
+	if( uxSchedulerSuspended[ xPortGetCoreID() ] == ( UBaseType_t ) pdFALSE )
+	{
+		/* Remove the task from the delayed list and add it to the ready
+		list. */
+		( void ) prvRemoveTaskFromStateList( pxUnblockedTCB );
+		prvAddTaskToReadyList( pxUnblockedTCB );
+	}
+	else
+	{
+		/* The delayed and ready lists cannot be accessed, so hold this task
+		pending until the scheduler is resumed. */
+		vListInsertEnd( &( xPendingReadyList ), pxEventListItem );
+	}
 
 	if( pxUnblockedTCB->uxPriority > pxCurrentTCB[ xPortGetCoreID() ]->uxPriority )
 	{
@@ -2703,7 +3218,7 @@ BaseType_t xReturn;
 		xReturn = pdFALSE;
 	}
 
-	taskEXIT_CRITICAL(&xTaskQueueMutex);
+	taskEXIT_CRITICAL_ISR(&xTaskQueueMutex);
 	return xReturn;
 }
 /*-----------------------------------------------------------*/
@@ -2851,7 +3366,7 @@ static portTASK_FUNCTION( prvIdleTask, pvParameters )
 			the list, and an occasional incorrect value will not matter.  If
 			the ready list at the idle priority contains more than one task
 			then a task other than the idle task is ready to execute. */
-			if( listCURRENT_LIST_LENGTH( &( pxReadyTasksLists[ tskIDLE_PRIORITY ] ) ) > ( UBaseType_t ) 1 )
+			if( prvReadyTasksForCore( xPortGetCoreID(), tskIDLE_PRIORITY ) > ( UBaseType_t ) 1 )
 			{
 				taskYIELD();
 			}
@@ -2892,28 +3407,29 @@ static portTASK_FUNCTION( prvIdleTask, pvParameters )
 
 			if( xExpectedIdleTime >= configEXPECTED_IDLE_TIME_BEFORE_SLEEP )
 			{
-//				vTaskSuspendAll();
 				taskENTER_CRITICAL(&xTaskQueueMutex);
 				{
-					/* Now the scheduler is suspended, the expected idle
-					time can be sampled again, and this time its value can
-					be used. */
+					/* Sample the expected idle time again, this time with
+					the task lists locked. */
 					configASSERT( xNextTaskUnblockTime >= xTickCount );
 					xExpectedIdleTime = prvGetExpectedIdleTime();
-
-					if( xExpectedIdleTime >= configEXPECTED_IDLE_TIME_BEFORE_SLEEP )
-					{
-						traceLOW_POWER_IDLE_BEGIN();
-						portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime );
-						traceLOW_POWER_IDLE_END();
-					}
-					else
-					{
-						mtCOVERAGE_TEST_MARKER();
-					}
 				}
 				taskEXIT_CRITICAL(&xTaskQueueMutex);
-//				( void ) xTaskResumeAll();
+
+				/* The lists are not kept locked while sleeping, that would
+				stall the scheduler of the other core. The port checks again
+				with eTaskConfirmSleepModeStatus() once its interrupts are
+				disabled. */
+				if( xExpectedIdleTime >= configEXPECTED_IDLE_TIME_BEFORE_SLEEP )
+				{
+					traceLOW_POWER_IDLE_BEGIN();
+					portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime );
+					traceLOW_POWER_IDLE_END();
+				}
+				else
+				{
+					mtCOVERAGE_TEST_MARKER();
+				}
 			}
 			else
 			{
@@ -2930,6 +3446,7 @@ static portTASK_FUNCTION( prvIdleTask, pvParameters )
 	eSleepModeStatus eTaskConfirmSleepModeStatus( void )
 	{
 	eSleepModeStatus eReturn = eStandardSleep;
+	UBaseType_t uxPriority;
 		taskENTER_CRITICAL(&xTaskQueueMutex);
 
 		if( listCURRENT_LIST_LENGTH( &xPendingReadyList ) != 0 )
@@ -2942,12 +3459,34 @@ static portTASK_FUNCTION( prvIdleTask, pvParameters )
 			/* A yield was pended while the scheduler was suspended. */
 			eReturn = eAbortSleep;
 		}
+		else if( prvReadyTasksForCore( xPortGetCoreID(), tskIDLE_PRIORITY ) > 1 )
+		{
+			/* Another idle priority task can run on this core. */
+			eReturn = eAbortSleep;
+		}
+		else
+		{
+			/* The other core may have readied a task for this core since
+			the idle task was switched in. */
+			for( uxPriority = tskIDLE_PRIORITY + 1; uxPriority < ( UBaseType_t ) configMAX_PRIORITIES; uxPriority++ )
+			{
+				if( prvReadyTasksForCore( xPortGetCoreID(), uxPriority ) != 0 )
+				{
+					eReturn = eAbortSleep;
+				}
+			}
+		}
+
+		if( eReturn == eAbortSleep )
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
 		else
 		{
 			#if configUSE_TIMERS == 0
 			{
-				/* The idle task exists in addition to the application tasks. */
-				const UBaseType_t uxNonApplicationTasks = 1;
+				/* The idle tasks exist in addition to the application tasks. */
+				const UBaseType_t uxNonApplicationTasks = portNUM_PROCESSORS;
 
 				/* If timers are not being used and all the tasks are in the
 				suspended list (which might mean they have an infinite block
@@ -3010,6 +3549,12 @@ UBaseType_t x;
 
 	pxTCB->uxPriority = uxPriority;
 	pxTCB->xCoreID = xCoreID;
+	pxTCB->xIramSafe = pdFALSE;
+	#if ( configUSE_CORE_AFFINITY_HINT == 1 )
+	{
+		pxTCB->xLastCoreID = tskNO_AFFINITY;
+	}
+	#endif
 	#if ( configUSE_MUTEXES == 1 )
 	{
 		pxTCB->uxBasePriority = uxPriority;
@@ -3042,7 +3587,7 @@ UBaseType_t x;
 
 	#if ( configGENERATE_RUN_TIME_STATS == 1 )
 	{
-		pxTCB->ulRunTimeCounter = 0UL;
+		memset( pxTCB->ullRunTimeCounter, 0, sizeof( pxTCB->ullRunTimeCounter ) );
 	}
 	#endif /* configGENERATE_RUN_TIME_STATS */
 
@@ -3167,10 +3712,15 @@ UBaseType_t x;
 static void prvInitialiseTaskLists( void )
 {
 UBaseType_t uxPriority;
+BaseType_t xCoreID;
 
 	for( uxPriority = ( UBaseType_t ) 0U; uxPriority < ( UBaseType_t ) configMAX_PRIORITIES; uxPriority++ )
 	{
 		vListInitialise( &( pxReadyTasksLists[ uxPriority ] ) );
+		for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+		{
+			vListInitialise( &( pxCoreReadyTasksLists[ xCoreID ][ uxPriority ] ) );
+		}
 	}
 
 	vListInitialise( &xDelayedTaskList1 );
@@ -3219,7 +3769,7 @@ static void prvCheckTasksWaitingTermination( void )
 				taskENTER_CRITICAL(&xTaskQueueMutex);
 				{
 					pxTCB = ( TCB_t * ) listGET_OWNER_OF_HEAD_ENTRY( ( &xTasksWaitingTermination ) );
-					( void ) uxListRemove( &( pxTCB->xGenericListItem ) );
+					( void ) prvRemoveTaskFromStateList( pxTCB );
 					--uxCurrentNumberOfTasks;
 					--uxTasksDeleted;
 				}
@@ -3280,10 +3830,19 @@ static void prvAddCurrentTaskToDelayedList( const BaseType_t xCoreID, const Tick
 }
 /*-----------------------------------------------------------*/
 
-static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer )
+static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer, TCB_t * const pxTCBBuffer )
 {
 TCB_t *pxNewTCB;
 
+	/* A statically allocated TCB is only supported together with a statically
+	allocated stack, so nothing has to be undone if the allocation fails. */
+	if( pxTCBBuffer != NULL )
+	{
+		configASSERT( puxStackBuffer != NULL );
+		pxNewTCB = pxTCBBuffer;
+		pxNewTCB->pxStack = puxStackBuffer;
+	}
+	else
 	/* If the stack grows down then allocate the stack then the TCB so the stack
 	does not grow into the TCB.  Likewise if the stack grows up then allocate
 	the TCB then the stack. */
@@ -3342,6 +3901,25 @@ TCB_t *pxNewTCB;
 
 	if( pxNewTCB != NULL )
 	{
+		#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		{
+			/* Remember which memory was provided by the application, so
+			prvDeleteTCB() does not try to free it. */
+			if( pxTCBBuffer != NULL )
+			{
+				pxNewTCB->ucStaticallyAllocated = tskSTATICALLY_ALLOCATED_STACK_AND_TCB;
+			}
+			else if( puxStackBuffer != NULL )
+			{
+				pxNewTCB->ucStaticallyAllocated = tskSTATICALLY_ALLOCATED_STACK_ONLY;
+			}
+			else
+			{
+				pxNewTCB->ucStaticallyAllocated = tskDYNAMICALLY_ALLOCATED_STACK_AND_TCB;
+			}
+		}
+		#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 		/* Avoid dependency on memset() if it is not required. */
 		#if( ( configCHECK_FOR_STACK_OVERFLOW > 1 ) || ( configUSE_TRACE_FACILITY == 1 ) || ( INCLUDE_uxTaskGetStackHighWaterMark == 1 ) )
 		{
@@ -3407,7 +3985,14 @@ TCB_t *pxNewTCB;
 
 				#if ( configGENERATE_RUN_TIME_STATS == 1 )
 				{
-					pxTaskStatusArray[ uxTask ].ulRunTimeCounter = pxNextTCB->ulRunTimeCounter;
+				uint64_t ullRunTime = 0;
+				BaseType_t xCoreID;
+
+					for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+					{
+						ullRunTime += pxNextTCB->ullRunTimeCounter[ xCoreID ];
+					}
+					pxTaskStatusArray[ uxTask ].ulRunTimeCounter = ( uint32_t ) ( ullRunTime / tskRUN_TIME_COUNTS_PER_US );
 				}
 				#else
 				{
@@ -3488,6 +4073,160 @@ TCB_t *pxNewTCB;
 #endif /* INCLUDE_uxTaskGetStackHighWaterMark */
 /*-----------------------------------------------------------*/
 
+#if ( ( INCLUDE_uxTaskGetStackHighWaterMark == 1 ) && ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
+
+	static UBaseType_t prvListTaskStackInfoWithinSingleList( TaskStackInfo_t *pxTaskStackArray, List_t *pxList )
+	{
+	volatile TCB_t *pxNextTCB, *pxFirstTCB;
+	UBaseType_t uxTask = 0;
+
+		if( listCURRENT_LIST_LENGTH( pxList ) > ( UBaseType_t ) 0 )
+		{
+			listGET_OWNER_OF_NEXT_ENTRY( pxFirstTCB, pxList );
+			do
+			{
+				listGET_OWNER_OF_NEXT_ENTRY( pxNextTCB, pxList );
+
+				pxTaskStackArray[ uxTask ].xHandle = ( TaskHandle_t ) pxNextTCB;
+				pxTaskStackArray[ uxTask ].pcTaskName = ( const char * ) &( pxNextTCB->pcTaskName [ 0 ] );
+				pxTaskStackArray[ uxTask ].uxStackDepth = ( UBaseType_t ) ( pxNextTCB->pxEndOfStack - pxNextTCB->pxStack ) + 1;
+				#if( portSTACK_GROWTH < 0 )
+				{
+					pxTaskStackArray[ uxTask ].uxHighWaterMark = ( UBaseType_t ) prvTaskCheckFreeStackSpace( ( uint8_t * ) pxNextTCB->pxStack );
+				}
+				#else
+				{
+					pxTaskStackArray[ uxTask ].uxHighWaterMark = ( UBaseType_t ) prvTaskCheckFreeStackSpace( ( uint8_t * ) pxNextTCB->pxEndOfStack );
+				}
+				#endif
+				uxTask++;
+
+			} while( pxNextTCB != pxFirstTCB );
+		}
+
+		return uxTask;
+	}
+	/*-----------------------------------------------------------*/
+
+	UBaseType_t uxTaskGetStackInfo( TaskStackInfo_t * const pxTaskStackArray, const UBaseType_t uxArraySize )
+	{
+	UBaseType_t uxTask = 0, uxQueue = configMAX_PRIORITIES;
+	BaseType_t xCoreID;
+
+		/* Holding xTaskQueueMutex keeps both cores from deleting a task, and
+		so freeing its stack, while it is scanned. */
+		taskENTER_CRITICAL(&xTaskQueueMutex);
+
+		/* Is there a space in the array for each task in the system? */
+		if( uxArraySize >= uxCurrentNumberOfTasks )
+		{
+			prvLockReadyLists();
+			do
+			{
+				uxQueue--;
+				uxTask += prvListTaskStackInfoWithinSingleList( &( pxTaskStackArray[ uxTask ] ), &( pxReadyTasksLists[ uxQueue ] ) );
+				for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+				{
+					uxTask += prvListTaskStackInfoWithinSingleList( &( pxTaskStackArray[ uxTask ] ), &( pxCoreReadyTasksLists[ xCoreID ][ uxQueue ] ) );
+				}
+			} while( uxQueue > ( UBaseType_t ) tskIDLE_PRIORITY ); /*lint !e961 MISRA exception as the casts are only redundant for some ports. */
+			prvUnlockReadyLists();
+
+			uxTask += prvListTaskStackInfoWithinSingleList( &( pxTaskStackArray[ uxTask ] ), ( List_t * ) pxDelayedTaskList );
+			uxTask += prvListTaskStackInfoWithinSingleList( &( pxTaskStackArray[ uxTask ] ), ( List_t * ) pxOverflowDelayedTaskList );
+
+			#if( INCLUDE_vTaskDelete == 1 )
+			{
+				uxTask += prvListTaskStackInfoWithinSingleList( &( pxTaskStackArray[ uxTask ] ), &xTasksWaitingTermination );
+			}
+			#endif
+
+			#if ( INCLUDE_vTaskSuspend == 1 )
+			{
+				uxTask += prvListTaskStackInfoWithinSingleList( &( pxTaskStackArray[ uxTask ] ), &xSuspendedTaskList );
+			}
+			#endif
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+
+		taskEXIT_CRITICAL(&xTaskQueueMutex);
+
+		return uxTask;
+	}
+
+#endif /* ( INCLUDE_uxTaskGetStackHighWaterMark == 1 ) && ( configRECORD_STACK_HIGH_ADDRESS == 1 ) */
+/*-----------------------------------------------------------*/
+
+#if ( configRECORD_STACK_HIGH_ADDRESS == 1 )
+
+	static UBaseType_t prvTaskGetSnapshotsFromList( TaskSnapshot_t *pxTaskSnapshotArray, UBaseType_t uxArraySize, List_t *pxList )
+	{
+	TCB_t *pxNextTCB, *pxFirstTCB;
+	UBaseType_t uxTask = 0;
+
+		if( listCURRENT_LIST_LENGTH( pxList ) > ( UBaseType_t ) 0 )
+		{
+			listGET_OWNER_OF_NEXT_ENTRY( pxFirstTCB, pxList );
+			do
+			{
+				listGET_OWNER_OF_NEXT_ENTRY( pxNextTCB, pxList );
+				if( uxTask >= uxArraySize )
+				{
+					break;
+				}
+				pxTaskSnapshotArray[ uxTask ].xHandle = ( TaskHandle_t ) pxNextTCB;
+				pxTaskSnapshotArray[ uxTask ].pxTopOfStack = ( StackType_t * ) pxNextTCB->pxTopOfStack;
+				pxTaskSnapshotArray[ uxTask ].pxStack = pxNextTCB->pxStack;
+				pxTaskSnapshotArray[ uxTask ].pxEndOfStack = pxNextTCB->pxEndOfStack;
+				uxTask++;
+			} while( pxNextTCB != pxFirstTCB );
+		}
+
+		return uxTask;
+	}
+	/*-----------------------------------------------------------*/
+
+	UBaseType_t uxTaskGetSnapshotAll( TaskSnapshot_t * const pxTaskSnapshotArray, const UBaseType_t uxArraySize, UBaseType_t * const pxTcbSize )
+	{
+	UBaseType_t uxTask = 0, uxQueue = configMAX_PRIORITIES;
+	BaseType_t xCoreID;
+
+		*pxTcbSize = sizeof( TCB_t );
+
+		do
+		{
+			uxQueue--;
+			uxTask += prvTaskGetSnapshotsFromList( &( pxTaskSnapshotArray[ uxTask ] ), uxArraySize - uxTask, &( pxReadyTasksLists[ uxQueue ] ) );
+			for( xCoreID = 0; xCoreID < portNUM_PROCESSORS; xCoreID++ )
+			{
+				uxTask += prvTaskGetSnapshotsFromList( &( pxTaskSnapshotArray[ uxTask ] ), uxArraySize - uxTask, &( pxCoreReadyTasksLists[ xCoreID ][ uxQueue ] ) );
+			}
+		} while( uxQueue > ( UBaseType_t ) tskIDLE_PRIORITY ); /*lint !e961 MISRA exception as the casts are only redundant for some ports. */
+
+		uxTask += prvTaskGetSnapshotsFromList( &( pxTaskSnapshotArray[ uxTask ] ), uxArraySize - uxTask, ( List_t * ) pxDelayedTaskList );
+		uxTask += prvTaskGetSnapshotsFromList( &( pxTaskSnapshotArray[ uxTask ] ), uxArraySize - uxTask, ( List_t * ) pxOverflowDelayedTaskList );
+
+		#if( INCLUDE_vTaskDelete == 1 )
+		{
+			uxTask += prvTaskGetSnapshotsFromList( &( pxTaskSnapshotArray[ uxTask ] ), uxArraySize - uxTask, &xTasksWaitingTermination );
+		}
+		#endif
+
+		#if ( INCLUDE_vTaskSuspend == 1 )
+		{
+			uxTask += prvTaskGetSnapshotsFromList( &( pxTaskSnapshotArray[ uxTask ] ), uxArraySize - uxTask, &xSuspendedTaskList );
+		}
+		#endif
+
+		return uxTask;
+	}
+
+#endif /* configRECORD_STACK_HIGH_ADDRESS == 1 */
+/*-----------------------------------------------------------*/
+
 #if ( INCLUDE_vTaskDelete == 1 )
 
 	// TODO: move this to newlib component and provide a header file
@@ -3509,7 +4248,25 @@ TCB_t *pxNewTCB;
 		}
 		#endif /* configUSE_NEWLIB_REENTRANT */
 
-		#if( portUSING_MPU_WRAPPERS == 1 )
+		#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		{
+			/* Only free the memory that was allocated dynamically in the first
+			place. */
+			if( pxTCB->ucStaticallyAllocated == tskDYNAMICALLY_ALLOCATED_STACK_AND_TCB )
+			{
+				vPortFreeAligned( pxTCB->pxStack );
+				vPortFree( pxTCB );
+			}
+			else if( pxTCB->ucStaticallyAllocated == tskSTATICALLY_ALLOCATED_STACK_ONLY )
+			{
+				vPortFree( pxTCB );
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+		#elif( portUSING_MPU_WRAPPERS == 1 )
 		{
 			/* Only free the stack if it was allocated dynamically in the first
 			place. */
@@ -3517,14 +4274,15 @@ TCB_t *pxNewTCB;
 			{
 				vPortFreeAligned( pxTCB->pxStack );
 			}
+
+			vPortFree( pxTCB );
 		}
 		#else
 		{
 			vPortFreeAligned( pxTCB->pxStack );
+			vPortFree( pxTCB );
 		}
 		#endif
-
-		vPortFree( pxTCB );
 	}
 
 #endif /* INCLUDE_vTaskDelete */
@@ -3634,9 +4392,9 @@ In fact, nothing below this line has/is.
 
 				/* If the task being modified is in the ready state it will need to
 				be moved into a new list. */
-				if( listIS_CONTAINED_WITHIN( &( pxReadyTasksLists[ pxTCB->uxPriority ] ), &( pxTCB->xGenericListItem ) ) != pdFALSE )
+				if( listIS_CONTAINED_WITHIN( prvReadyListForTask( pxTCB, pxTCB->uxPriority ), &( pxTCB->xGenericListItem ) ) != pdFALSE )
 				{
-					if( uxListRemove( &( pxTCB->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+					if( prvRemoveTaskFromStateList( pxTCB ) == ( UBaseType_t ) 0 )
 					{
 						taskRESET_READY_PRIORITY( pxTCB->uxPriority );
 					}
@@ -3700,7 +4458,7 @@ In fact, nothing below this line has/is.
 					given from an interrupt, and if a mutex is given by the
 					holding	task then it must be the running state task.  Remove
 					the	holding task from the ready	list. */
-					if( uxListRemove( &( pxTCB->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+					if( prvRemoveTaskFromStateList( pxTCB ) == ( UBaseType_t ) 0 )
 					{
 						taskRESET_READY_PRIORITY( pxTCB->uxPriority );
 					}
@@ -4161,7 +4919,7 @@ TickType_t uxReturn;
 				{
 					/* The task is going to block.  First it must be removed
 					from the ready list. */
-					if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+					if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 					{
 						/* The current task must be in a ready list, so there is
 						no need to check, and the port reset macro can be called
@@ -4276,7 +5034,7 @@ TickType_t uxReturn;
 				{
 					/* The task is going to block.  First it must be removed
 					from the	ready list. */
-					if( uxListRemove( &( pxCurrentTCB[ xPortGetCoreID() ]->xGenericListItem ) ) == ( UBaseType_t ) 0 )
+					if( prvRemoveTaskFromStateList( pxCurrentTCB[ xPortGetCoreID() ] ) == ( UBaseType_t ) 0 )
 					{
 						/* The current task must be in a ready list, so there is
 						no need to check, and the port reset macro can be called
@@ -4427,7 +5185,7 @@ TickType_t uxReturn;
 			notification then unblock it now. */
 			if( eOriginalNotifyState == eWaitingNotification )
 			{
-				( void ) uxListRemove( &( pxTCB->xGenericListItem ) );
+				( void ) prvRemoveTaskFromStateList( pxTCB );
 				prvAddTaskToReadyList( pxTCB );
 
 				/* The task should not have been on an event list. */
@@ -4518,7 +5276,7 @@ TickType_t uxReturn;
 
 				if( uxSchedulerSuspended[ xPortGetCoreID() ] == ( UBaseType_t ) pdFALSE )
 				{
-					( void ) uxListRemove( &( pxTCB->xGenericListItem ) );
+					( void ) prvRemoveTaskFromStateList( pxTCB );
 					prvAddTaskToReadyList( pxTCB );
 				}
 				else
@@ -4581,7 +5339,7 @@ TickType_t uxReturn;
 
 				if( uxSchedulerSuspended[ xPortGetCoreID() ] == ( UBaseType_t ) pdFALSE )
 				{
-					( void ) uxListRemove( &( pxTCB->xGenericListItem ) );
+					( void ) prvRemoveTaskFromStateList( pxTCB );
 					prvAddTaskToReadyList( pxTCB );
 				}
 				else
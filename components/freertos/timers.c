@@ -101,6 +101,27 @@ configUSE_TIMERS is set to 1 in FreeRTOSConfig.h. */
 /* Misc definitions. */
 #define tmrNO_DELAY		( TickType_t ) 0U
 
+/* Number of timer service tasks.  With configTIMER_TASK_PER_CORE each core
+runs its own service task and a timer is serviced by the core it was created
+on, otherwise all timers are serviced by one task on core 0. */
+#if ( configTIMER_TASK_PER_CORE == 1 ) && ( portNUM_PROCESSORS > 1 )
+	#define tmrNUM_SERVICES			portNUM_PROCESSORS
+	#define tmrCALLER_SERVICE()		( ( BaseType_t ) xPortGetCoreID() )
+#else
+	#define tmrNUM_SERVICES			1
+	#define tmrCALLER_SERVICE()		( ( BaseType_t ) 0 )
+#endif
+
+/* Geometry of the hierarchical timer wheel.  Each level has tmrWHEEL_SLOTS
+slots, and a slot at level n covers tmrWHEEL_SLOTS^n ticks, so the wheel
+covers tmrWHEEL_RANGE ticks ahead of its current time.  Timers further in the
+future are parked in the last slot of the top level and re-filed from there. */
+#define tmrWHEEL_BITS			5
+#define tmrWHEEL_SLOTS			( 1UL << tmrWHEEL_BITS )
+#define tmrWHEEL_MASK			( tmrWHEEL_SLOTS - 1UL )
+#define tmrWHEEL_LEVELS			4
+#define tmrWHEEL_RANGE			( ( TickType_t ) 1UL << ( tmrWHEEL_BITS * tmrWHEEL_LEVELS ) )
+
 /* The definition of the timers themselves. */
 typedef struct tmrTimerControl
 {
@@ -110,6 +131,7 @@ typedef struct tmrTimerControl
 	UBaseType_t				uxAutoReload;		/*<< Set to pdTRUE if the timer should be automatically restarted once expired.  Set to pdFALSE if the timer is, in effect, a one-shot timer. */
 	void 					*pvTimerID;			/*<< An ID to identify the timer.  This allows the timer to be identified when the same callback is used for multiple timers. */
 	TimerCallbackFunction_t	pxCallbackFunction;	/*<< The function that will be called when the timer expires. */
+	BaseType_t				xServiceID;			/*<< The timer service task (and wheel) that owns the timer.  Only that task touches xTimerListItem. */
 	#if( configUSE_TRACE_FACILITY == 1 )
 		UBaseType_t			uxTimerNumber;		/*<< An ID assigned by trace tools such as FreeRTOS+Trace */
 	#endif
@@ -155,26 +177,37 @@ typedef struct tmrTimerQueueMessage
 	} u;
 } DaemonTaskMessage_t;
 
+/* Active timers are kept in a hierarchical timer wheel.  A timer is filed in
+the slot of the lowest level whose span still reaches its expiry time, which
+makes starting and stopping a timer O(1).  When the wheel time crosses the
+boundary of a slot at a higher level, the timers in that slot are re-filed
+(cascaded) into the levels below.  A bit per slot records which slots are
+occupied, so the next tick at which anything has to happen can be found
+without walking the slots one by one. */
+typedef struct tmrTimerWheel
+{
+	List_t				xSlots[ tmrWHEEL_LEVELS ][ tmrWHEEL_SLOTS ];
+	uint32_t			ulOccupied[ tmrWHEEL_LEVELS ];	/*<< Bit n is set if xSlots[ level ][ n ] is not empty. */
+	TickType_t			xNextTick;						/*<< The first tick that has not been processed yet. */
+	UBaseType_t			uxActiveTimers;
+} TimerWheel_t;
+
 /*lint -e956 A manual analysis and inspection has been used to determine which
 static variables must be declared volatile. */
 
-/* The list in which active timers are stored.  Timers are referenced in expire
-time order, with the nearest expiry time at the front of the list.  Only the
-timer service task is allowed to access these lists. */
-PRIVILEGED_DATA static List_t xActiveTimerList1;
-PRIVILEGED_DATA static List_t xActiveTimerList2;
-PRIVILEGED_DATA static List_t *pxCurrentTimerList;
-PRIVILEGED_DATA static List_t *pxOverflowTimerList;
+/* The wheels in which active timers are stored, one per timer service task.
+Only the timer service task owning a wheel is allowed to access it. */
+PRIVILEGED_DATA static TimerWheel_t xTimerWheels[ tmrNUM_SERVICES ];
 
-/* A queue that is used to send commands to the timer service task. */
-PRIVILEGED_DATA static QueueHandle_t xTimerQueue = NULL;
+/* The queues that are used to send commands to the timer service tasks. */
+PRIVILEGED_DATA static QueueHandle_t xTimerQueues[ tmrNUM_SERVICES ] = { NULL };
 
 /* Mux. We use a single mux for all the timers for now. ToDo: maybe increase granularity here? */
 PRIVILEGED_DATA portMUX_TYPE xTimerMux = portMUX_INITIALIZER_UNLOCKED;
 
 #if ( INCLUDE_xTimerGetTimerDaemonTaskHandle == 1 )
 
-	PRIVILEGED_DATA static TaskHandle_t xTimerTaskHandle = NULL;
+	PRIVILEGED_DATA static TaskHandle_t xTimerTaskHandles[ tmrNUM_SERVICES ] = { NULL };
 
 #endif
 
@@ -190,8 +223,8 @@ static void prvCheckForValidListAndQueue( void ) PRIVILEGED_FUNCTION;
 
 /*
  * The timer service task (daemon).  Timer functionality is controlled by this
- * task.  Other tasks communicate with the timer service task using the
- * xTimerQueue queue.
+ * task.  Other tasks communicate with the timer service task using its
+ * xTimerQueues[] entry.  pvParameters holds the service index.
  */
 static void prvTimerTask( void *pvParameters ) PRIVILEGED_FUNCTION;
 
@@ -199,80 +232,89 @@ static void prvTimerTask( void *pvParameters ) PRIVILEGED_FUNCTION;
  * Called by the timer service task to interpret and process a command it
  * received on the timer queue.
  */
-static void	prvProcessReceivedCommands( void ) PRIVILEGED_FUNCTION;
+static void	prvProcessReceivedCommands( const BaseType_t xServiceID ) PRIVILEGED_FUNCTION;
 
 /*
- * Insert the timer into either xActiveTimerList1, or xActiveTimerList2,
- * depending on if the expire time causes a timer counter overflow.
+ * File an active timer with the given expiry time into the wheel.  The expiry
+ * time must not be before pxWheel->xNextTick.
  */
-static BaseType_t prvInsertTimerInActiveList( Timer_t * const pxTimer, const TickType_t xNextExpiryTime, const TickType_t xTimeNow, const TickType_t xCommandTime ) PRIVILEGED_FUNCTION;
+static void prvWheelInsert( TimerWheel_t * const pxWheel, Timer_t * const pxTimer, const TickType_t xExpiryTime ) PRIVILEGED_FUNCTION;
 
 /*
- * An active timer has reached its expire time.  Reload the timer if it is an
- * auto reload timer, then call its callback.
+ * Remove a timer from the wheel if it is in it.
  */
-static void prvProcessExpiredTimer( const TickType_t xNextExpireTime, const TickType_t xTimeNow ) PRIVILEGED_FUNCTION;
+static void prvWheelRemove( TimerWheel_t * const pxWheel, Timer_t * const pxTimer ) PRIVILEGED_FUNCTION;
 
 /*
- * The tick count has overflowed.  Switch the timer lists after ensuring the
- * current timer list does not still reference some timers.
+ * Return the number of ticks from pxWheel->xNextTick to the first tick at
+ * which a slot has to be run or cascaded, setting *pxWheelWasEmpty to pdTRUE
+ * (and returning 0) if the wheel holds no timers.
  */
-static void prvSwitchTimerLists( void ) PRIVILEGED_FUNCTION;
+static TickType_t prvWheelTicksToNextEvent( const TimerWheel_t * const pxWheel, BaseType_t * const pxWheelWasEmpty ) PRIVILEGED_FUNCTION;
 
 /*
- * Obtain the current tick count, setting *pxTimerListsWereSwitched to pdTRUE
- * if a tick count overflow occurred since prvSampleTimeNow() was last called.
+ * Process all ticks up to and including xTimeNow: cascade the higher level
+ * slots whose boundary is crossed and run the callbacks of the timers that
+ * expire.
  */
-static TickType_t prvSampleTimeNow( BaseType_t * const pxTimerListsWereSwitched ) PRIVILEGED_FUNCTION;
+static void prvWheelAdvance( TimerWheel_t * const pxWheel, const TickType_t xTimeNow ) PRIVILEGED_FUNCTION;
 
 /*
- * If the timer list contains any active timers then return the expire time of
- * the timer that will expire first and set *pxListWasEmpty to false.  If the
- * timer list does not contain any timers then return 0 and set *pxListWasEmpty
- * to pdTRUE.
+ * An active timer has reached its expire time.  Reload the timer if it is an
+ * auto reload timer, then call its callback.
  */
-static TickType_t prvGetNextExpireTime( BaseType_t * const pxListWasEmpty ) PRIVILEGED_FUNCTION;
+static void prvProcessExpiredTimer( TimerWheel_t * const pxWheel, Timer_t * const pxTimer, const TickType_t xExpiryTime ) PRIVILEGED_FUNCTION;
 
 /*
  * If a timer has expired, process it.  Otherwise, block the timer service task
  * until either a timer does expire or a command is received.
  */
-static void prvProcessTimerOrBlockTask( const TickType_t xNextExpireTime, const BaseType_t xListWasEmpty ) PRIVILEGED_FUNCTION;
+static void prvProcessTimerOrBlockTask( const BaseType_t xServiceID ) PRIVILEGED_FUNCTION;
 
 /*-----------------------------------------------------------*/
 
 BaseType_t xTimerCreateTimerTask( void )
 {
 BaseType_t xReturn = pdFAIL;
+BaseType_t xServiceID;
 
 	/* This function is called when the scheduler is started if
 	configUSE_TIMERS is set to 1.  Check that the infrastructure used by the
 	timer service task has been created/initialised.  If timers have already
 	been created then the initialisation will already have been performed. */
 
-	/* For now, the timer task will be fixed to core 0. This means whatever process
-	   running on whatever core schedules the timer, the timer callback function
-	   will *ALWAYS* run on core 0. */
+	/* Service task n is pinned to core n.  Without configTIMER_TASK_PER_CORE
+	there is a single task on core 0, so whatever core schedules a timer, the
+	timer callback function will *ALWAYS* run on core 0. */
 	prvCheckForValidListAndQueue();
 
-	if( xTimerQueue != NULL )
+	for( xServiceID = 0; xServiceID < tmrNUM_SERVICES; xServiceID++ )
 	{
-		#if ( INCLUDE_xTimerGetTimerDaemonTaskHandle == 1 )
+		if( xTimerQueues[ xServiceID ] != NULL )
 		{
-			/* Create the timer task, storing its handle in xTimerTaskHandle so
-			it can be returned by the xTimerGetTimerDaemonTaskHandle() function. */
-			xReturn = xTaskCreatePinnedToCore( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, NULL, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, &xTimerTaskHandle, 0 );
+			#if ( INCLUDE_xTimerGetTimerDaemonTaskHandle == 1 )
+			{
+				/* Create the timer task, storing its handle in xTimerTaskHandles
+				so it can be returned by the xTimerGetTimerDaemonTaskHandle()
+				function. */
+				xReturn = xTaskCreatePinnedToCore( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, ( void * ) xServiceID, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, &xTimerTaskHandles[ xServiceID ], xServiceID );
+			}
+			#else
+			{
+				/* Create the timer task without storing its handle. */
+				xReturn = xTaskCreatePinnedToCore( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, ( void * ) xServiceID, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, NULL, xServiceID );
+			}
+			#endif
 		}
-		#else
+		else
 		{
-			/* Create the timer task without storing its handle. */
-			xReturn = xTaskCreatePinnedToCore( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, NULL, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, NULL, 0 );
+			xReturn = pdFAIL;
+		}
+
+		if( xReturn != pdPASS )
+		{
+			break;
 		}
-		#endif
-	}
-	else
-	{
-		mtCOVERAGE_TEST_MARKER();
 	}
 
 	configASSERT( xReturn );
@@ -304,6 +346,8 @@ Timer_t *pxNewTimer;
 			pxNewTimer->uxAutoReload = uxAutoReload;
 			pxNewTimer->pvTimerID = pvTimerID;
 			pxNewTimer->pxCallbackFunction = pxCallbackFunction;
+			/* The timer is serviced on the core that created it. */
+			pxNewTimer->xServiceID = tmrCALLER_SERVICE();
 			vListInitialiseItem( &( pxNewTimer->xTimerListItem ) );
 
 			traceTIMER_CREATE( pxNewTimer );
@@ -325,9 +369,10 @@ BaseType_t xTimerGenericCommand( TimerHandle_t xTimer, const BaseType_t xCommand
 {
 BaseType_t xReturn = pdFAIL;
 DaemonTaskMessage_t xMessage;
+QueueHandle_t xTimerQueue = xTimerQueues[ ( ( Timer_t * ) xTimer )->xServiceID ];
 
-	/* Send a message to the timer service task to perform a particular action
-	on a particular timer definition. */
+	/* Send a message to the service task that owns the timer to perform a
+	particular action on a particular timer definition. */
 	if( xTimerQueue != NULL )
 	{
 		/* Send a command to the timer service task to start the xTimer timer. */
@@ -366,10 +411,14 @@ DaemonTaskMessage_t xMessage;
 
 	TaskHandle_t xTimerGetTimerDaemonTaskHandle( void )
 	{
-		/* If xTimerGetTimerDaemonTaskHandle() is called before the scheduler has been
-		started, then xTimerTaskHandle will be NULL. */
-		configASSERT( ( xTimerTaskHandle != NULL ) );
-		return xTimerTaskHandle;
+	TaskHandle_t xHandle = xTimerTaskHandles[ tmrCALLER_SERVICE() ];
+
+		/* With one service task per core, this is the one of the calling
+		core.  If xTimerGetTimerDaemonTaskHandle() is called before the
+		scheduler has been started, then the handle will be NULL. */
+
+		configASSERT( ( xHandle != NULL ) );
+		return xHandle;
 	}
 
 #endif
@@ -383,221 +432,279 @@ Timer_t *pxTimer = ( Timer_t * ) xTimer;
 }
 /*-----------------------------------------------------------*/
 
-static void prvProcessExpiredTimer( const TickType_t xNextExpireTime, const TickType_t xTimeNow )
+static void prvWheelInsert( TimerWheel_t * const pxWheel, Timer_t * const pxTimer, const TickType_t xExpiryTime )
 {
-BaseType_t xResult;
-Timer_t * const pxTimer = ( Timer_t * ) listGET_OWNER_OF_HEAD_ENTRY( pxCurrentTimerList );
+TickType_t xDelta = xExpiryTime - pxWheel->xNextTick;
+TickType_t xSlotTime = xExpiryTime;
+UBaseType_t uxLevel, uxSlot;
 
-	/* Remove the timer from the list of active timers.  A check has already
-	been performed to ensure the list is not empty. */
-	( void ) uxListRemove( &( pxTimer->xTimerListItem ) );
-	traceTIMER_EXPIRED( pxTimer );
+	listSET_LIST_ITEM_VALUE( &( pxTimer->xTimerListItem ), xExpiryTime );
+	listSET_LIST_ITEM_OWNER( &( pxTimer->xTimerListItem ), pxTimer );
 
-	/* If the timer is an auto reload timer then calculate the next
-	expiry time and re-insert the timer in the list of active timers. */
-	if( pxTimer->uxAutoReload == ( UBaseType_t ) pdTRUE )
+	/* Find the lowest level whose span reaches the expiry time. */
+	for( uxLevel = 0; uxLevel < ( tmrWHEEL_LEVELS - 1 ); uxLevel++ )
+	{
+		if( xDelta < ( ( TickType_t ) 1UL << ( tmrWHEEL_BITS * ( uxLevel + 1 ) ) ) )
+		{
+			break;
+		}
+	}
+
+	if( xDelta >= tmrWHEEL_RANGE )
+	{
+		/* Beyond the reach of the wheel.  Park the timer in the last top
+		level slot; it is filed again when that slot is cascaded. */
+		xSlotTime = pxWheel->xNextTick + ( tmrWHEEL_RANGE - 1 );
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	uxSlot = ( UBaseType_t ) ( ( xSlotTime >> ( tmrWHEEL_BITS * uxLevel ) ) & tmrWHEEL_MASK );
+	vListInsertEnd( &( pxWheel->xSlots[ uxLevel ][ uxSlot ] ), &( pxTimer->xTimerListItem ) );
+	pxWheel->ulOccupied[ uxLevel ] |= ( 1UL << uxSlot );
+	( pxWheel->uxActiveTimers )++;
+}
+/*-----------------------------------------------------------*/
+
+static void prvWheelRemove( TimerWheel_t * const pxWheel, Timer_t * const pxTimer )
+{
+List_t * const pxSlot = ( List_t * ) listLIST_ITEM_CONTAINER( &( pxTimer->xTimerListItem ) );
+UBaseType_t uxIndex;
+
+	if( pxSlot != NULL )
 	{
-		/* The timer is inserted into a list using a time relative to anything
-		other than the current time.  It will therefore be inserted into the
-		correct list relative to the time this task thinks it is now. */
-		if( prvInsertTimerInActiveList( pxTimer, ( xNextExpireTime + pxTimer->xTimerPeriodInTicks ), xTimeNow, xNextExpireTime ) == pdTRUE )
+		if( uxListRemove( &( pxTimer->xTimerListItem ) ) == ( UBaseType_t ) 0 )
 		{
-			/* The timer expired before it was added to the active timer
-			list.  Reload it now.  */
-			xResult = xTimerGenericCommand( pxTimer, tmrCOMMAND_START_DONT_TRACE, xNextExpireTime, NULL, tmrNO_DELAY );
-			configASSERT( xResult );
-			( void ) xResult;
+			uxIndex = ( UBaseType_t ) ( pxSlot - &( pxWheel->xSlots[ 0 ][ 0 ] ) );
+			pxWheel->ulOccupied[ uxIndex >> tmrWHEEL_BITS ] &= ~( 1UL << ( uxIndex & tmrWHEEL_MASK ) );
 		}
 		else
 		{
 			mtCOVERAGE_TEST_MARKER();
 		}
+
+		( pxWheel->uxActiveTimers )--;
 	}
 	else
 	{
 		mtCOVERAGE_TEST_MARKER();
 	}
-
-	/* Call the timer callback. */
-	pxTimer->pxCallbackFunction( ( TimerHandle_t ) pxTimer );
 }
 /*-----------------------------------------------------------*/
 
-static void prvTimerTask( void *pvParameters )
+static TickType_t prvWheelTicksToNextEvent( const TimerWheel_t * const pxWheel, BaseType_t * const pxWheelWasEmpty )
 {
-TickType_t xNextExpireTime;
-BaseType_t xListWasEmpty;
-
-	/* Just to avoid compiler warnings. */
-	( void ) pvParameters;
+TickType_t xTicks = portMAX_DELAY, xGroup, xEvent;
+UBaseType_t uxLevel, uxShift, uxIndex;
+uint32_t ulOccupied;
 
-	for( ;; )
+	if( pxWheel->uxActiveTimers == ( UBaseType_t ) 0 )
 	{
-		/* Query the timers list to see if it contains any timers, and if so,
-		obtain the time at which the next timer will expire. */
-		xNextExpireTime = prvGetNextExpireTime( &xListWasEmpty );
+		*pxWheelWasEmpty = pdTRUE;
+		return ( TickType_t ) 0U;
+	}
 
-		/* If a timer has expired, process it.  Otherwise, block this task
-		until either a timer does expire, or a command is received. */
-		prvProcessTimerOrBlockTask( xNextExpireTime, xListWasEmpty );
+	*pxWheelWasEmpty = pdFALSE;
 
-		/* Empty the command queue. */
-		prvProcessReceivedCommands();
+	for( uxLevel = 0; uxLevel < tmrWHEEL_LEVELS; uxLevel++ )
+	{
+		ulOccupied = pxWheel->ulOccupied[ uxLevel ];
+		if( ulOccupied == 0UL )
+		{
+			continue;
+		}
+
+		/* A slot at this level is due at the first slot boundary at or after
+		xNextTick that carries its index.  Rotate the occupancy bits so that
+		bit 0 is the slot of that first boundary. */
+		uxShift = tmrWHEEL_BITS * uxLevel;
+		xGroup = ( pxWheel->xNextTick + ( ( ( TickType_t ) 1UL << uxShift ) - 1 ) ) >> uxShift;
+		uxIndex = ( UBaseType_t ) ( xGroup & tmrWHEEL_MASK );
+		ulOccupied = ( ulOccupied >> uxIndex ) | ( ulOccupied << ( ( tmrWHEEL_SLOTS - uxIndex ) & tmrWHEEL_MASK ) );
+
+		xGroup += ( TickType_t ) __builtin_ctz( ulOccupied );
+		xEvent = ( xGroup << uxShift ) - pxWheel->xNextTick;
+		if( xEvent < xTicks )
+		{
+			xTicks = xEvent;
+		}
 	}
+
+	return xTicks;
 }
 /*-----------------------------------------------------------*/
 
-static void prvProcessTimerOrBlockTask( const TickType_t xNextExpireTime, const BaseType_t xListWasEmpty )
+static void prvWheelAdvance( TimerWheel_t * const pxWheel, const TickType_t xTimeNow )
 {
-TickType_t xTimeNow;
-BaseType_t xTimerListsWereSwitched;
+TickType_t xPending, xTicks, xTick;
+BaseType_t xWheelWasEmpty;
+UBaseType_t uxLevel, uxSlot;
+List_t *pxSlot;
+Timer_t *pxTimer;
 
-	vTaskSuspendAll();
+	/* Number of ticks up to and including xTimeNow still to be processed. */
+	xPending = ( TickType_t ) ( xTimeNow + 1 ) - pxWheel->xNextTick;
+
+	while( xPending > ( TickType_t ) 0U )
 	{
-		/* Obtain the time now to make an assessment as to whether the timer
-		has expired or not.  If obtaining the time causes the lists to switch
-		then don't process this timer as any timers that remained in the list
-		when the lists were switched will have been processed within the
-		prvSampleTimeNow() function. */
-		xTimeNow = prvSampleTimeNow( &xTimerListsWereSwitched );
-		if( xTimerListsWereSwitched == pdFALSE )
+		/* Nothing happens on the ticks before the next event, so they can be
+		skipped in one go. */
+		xTicks = prvWheelTicksToNextEvent( pxWheel, &xWheelWasEmpty );
+		if( ( xWheelWasEmpty != pdFALSE ) || ( xTicks >= xPending ) )
 		{
-			/* The tick count has not overflowed, has the timer expired? */
-			if( ( xListWasEmpty == pdFALSE ) && ( xNextExpireTime <= xTimeNow ) )
+			pxWheel->xNextTick = xTimeNow + 1;
+			break;
+		}
+
+		pxWheel->xNextTick += xTicks;
+		xPending -= xTicks;
+		xTick = pxWheel->xNextTick;
+
+		/* Cascade the higher levels whose slot boundary is this tick,
+		bottom up until the first level that is not at a boundary. */
+		for( uxLevel = 1; uxLevel < tmrWHEEL_LEVELS; uxLevel++ )
+		{
+			if( ( xTick & ( ( ( TickType_t ) 1UL << ( tmrWHEEL_BITS * uxLevel ) ) - 1 ) ) != 0 )
 			{
-				( void ) xTaskResumeAll();
-				prvProcessExpiredTimer( xNextExpireTime, xTimeNow );
+				break;
 			}
-			else
+
+			uxSlot = ( UBaseType_t ) ( ( xTick >> ( tmrWHEEL_BITS * uxLevel ) ) & tmrWHEEL_MASK );
+			pxSlot = &( pxWheel->xSlots[ uxLevel ][ uxSlot ] );
+
+			/* Every timer in the slot expires within the span of the slot,
+			so re-filing it always puts it in a lower level (or, for a parked
+			timer, in another top level slot). */
+			while( listLIST_IS_EMPTY( pxSlot ) == pdFALSE )
 			{
-				/* The tick count has not overflowed, and the next expire
-				time has not been reached yet.  This task should therefore
-				block to wait for the next expire time or a command to be
-				received - whichever comes first.  The following line cannot
-				be reached unless xNextExpireTime > xTimeNow, except in the
-				case when the current timer list is empty. */
-				vQueueWaitForMessageRestricted( xTimerQueue, ( xNextExpireTime - xTimeNow ) );
-
-				if( xTaskResumeAll() == pdFALSE )
-				{
-					/* Yield to wait for either a command to arrive, or the
-					block time to expire.  If a command arrived between the
-					critical section being exited and this yield then the yield
-					will not cause the task to block. */
-					portYIELD_WITHIN_API();
-				}
-				else
-				{
-					mtCOVERAGE_TEST_MARKER();
-				}
+				pxTimer = ( Timer_t * ) listGET_OWNER_OF_HEAD_ENTRY( pxSlot );
+				prvWheelRemove( pxWheel, pxTimer );
+				prvWheelInsert( pxWheel, pxTimer, listGET_LIST_ITEM_VALUE( &( pxTimer->xTimerListItem ) ) );
 			}
 		}
-		else
+
+		/* Everything in the level 0 slot of this tick expires now.  Timers
+		reloaded from here are at least one tick ahead, so never land back in
+		this slot. */
+		pxSlot = &( pxWheel->xSlots[ 0 ][ xTick & tmrWHEEL_MASK ] );
+		while( listLIST_IS_EMPTY( pxSlot ) == pdFALSE )
 		{
-			( void ) xTaskResumeAll();
+			pxTimer = ( Timer_t * ) listGET_OWNER_OF_HEAD_ENTRY( pxSlot );
+			prvProcessExpiredTimer( pxWheel, pxTimer, xTick );
 		}
+
+		( pxWheel->xNextTick )++;
+		xPending--;
 	}
 }
 /*-----------------------------------------------------------*/
 
-static TickType_t prvGetNextExpireTime( BaseType_t * const pxListWasEmpty )
+static void prvProcessExpiredTimer( TimerWheel_t * const pxWheel, Timer_t * const pxTimer, const TickType_t xExpiryTime )
 {
-TickType_t xNextExpireTime;
-
-	/* Timers are listed in expiry time order, with the head of the list
-	referencing the task that will expire first.  Obtain the time at which
-	the timer with the nearest expiry time will expire.  If there are no
-	active timers then just set the next expire time to 0.  That will cause
-	this task to unblock when the tick count overflows, at which point the
-	timer lists will be switched and the next expiry time can be
-	re-assessed.  */
-	*pxListWasEmpty = listLIST_IS_EMPTY( pxCurrentTimerList );
-	if( *pxListWasEmpty == pdFALSE )
+	/* Remove the timer from the wheel.  A check has already been performed
+	to ensure it is in it. */
+	prvWheelRemove( pxWheel, pxTimer );
+	traceTIMER_EXPIRED( pxTimer );
+
+	/* If the timer is an auto reload timer then calculate the next expiry
+	time and re-insert the timer in the wheel.  The reload is relative to the
+	time the timer was due, not to the time now, so a late service task
+	catches up by running the missed periods back to back. */
+	if( pxTimer->uxAutoReload == ( UBaseType_t ) pdTRUE )
 	{
-		xNextExpireTime = listGET_ITEM_VALUE_OF_HEAD_ENTRY( pxCurrentTimerList );
+		prvWheelInsert( pxWheel, pxTimer, xExpiryTime + pxTimer->xTimerPeriodInTicks );
 	}
 	else
 	{
-		/* Ensure the task unblocks when the tick count rolls over. */
-		xNextExpireTime = ( TickType_t ) 0U;
+		mtCOVERAGE_TEST_MARKER();
 	}
 
-	return xNextExpireTime;
+	/* Call the timer callback. */
+	pxTimer->pxCallbackFunction( ( TimerHandle_t ) pxTimer );
 }
 /*-----------------------------------------------------------*/
 
-static TickType_t prvSampleTimeNow( BaseType_t * const pxTimerListsWereSwitched )
+static void prvTimerTask( void *pvParameters )
 {
-TickType_t xTimeNow;
-PRIVILEGED_DATA static TickType_t xLastTime = ( TickType_t ) 0U; /*lint !e956 Variable is only accessible to one task. */
+const BaseType_t xServiceID = ( BaseType_t ) pvParameters;
 
-	xTimeNow = xTaskGetTickCount();
-
-	if( xTimeNow < xLastTime )
-	{
-		prvSwitchTimerLists();
-		*pxTimerListsWereSwitched = pdTRUE;
-	}
-	else
+	for( ;; )
 	{
-		*pxTimerListsWereSwitched = pdFALSE;
-	}
-
-	xLastTime = xTimeNow;
+		/* If a timer has expired, process it.  Otherwise, block this task
+		until either a timer does expire, or a command is received. */
+		prvProcessTimerOrBlockTask( xServiceID );
 
-	return xTimeNow;
+		/* Empty the command queue. */
+		prvProcessReceivedCommands( xServiceID );
+	}
 }
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvInsertTimerInActiveList( Timer_t * const pxTimer, const TickType_t xNextExpiryTime, const TickType_t xTimeNow, const TickType_t xCommandTime )
+static void prvProcessTimerOrBlockTask( const BaseType_t xServiceID )
 {
-BaseType_t xProcessTimerNow = pdFALSE;
+TimerWheel_t * const pxWheel = &( xTimerWheels[ xServiceID ] );
+TickType_t xTimeNow, xTicksToNextEvent, xPending;
+BaseType_t xWheelWasEmpty;
 
-	listSET_LIST_ITEM_VALUE( &( pxTimer->xTimerListItem ), xNextExpiryTime );
-	listSET_LIST_ITEM_OWNER( &( pxTimer->xTimerListItem ), pxTimer );
+	/* Query the wheel to see if it contains any timers, and if so, obtain
+	the number of ticks until the next one has to be looked at. */
+	xTicksToNextEvent = prvWheelTicksToNextEvent( pxWheel, &xWheelWasEmpty );
 
-	if( xNextExpiryTime <= xTimeNow )
-	{
-		/* Has the expiry time elapsed between the command to start/reset a
-		timer was issued, and the time the command was processed? */
-		if( ( xTimeNow - xCommandTime ) >= pxTimer->xTimerPeriodInTicks )
-		{
-			/* The time between a command being issued and the command being
-			processed actually exceeds the timers period.  */
-			xProcessTimerNow = pdTRUE;
-		}
-		else
-		{
-			vListInsert( pxOverflowTimerList, &( pxTimer->xTimerListItem ) );
-		}
-	}
-	else
+	vTaskSuspendAll();
 	{
-		if( ( xTimeNow < xCommandTime ) && ( xNextExpiryTime >= xCommandTime ) )
+		/* Obtain the time now to make an assessment as to whether a timer has
+		expired or not.  Tick count overflows need no special handling, all
+		wheel arithmetic is relative to pxWheel->xNextTick. */
+		xTimeNow = xTaskGetTickCount();
+		xPending = ( TickType_t ) ( xTimeNow + 1 ) - pxWheel->xNextTick;
+
+		if( ( xWheelWasEmpty == pdFALSE ) && ( xTicksToNextEvent < xPending ) )
 		{
-			/* If, since the command was issued, the tick count has overflowed
-			but the expiry time has not, then the timer must have already passed
-			its expiry time and should be processed immediately. */
-			xProcessTimerNow = pdTRUE;
+			( void ) xTaskResumeAll();
+			prvWheelAdvance( pxWheel, xTimeNow );
 		}
 		else
 		{
-			vListInsert( pxCurrentTimerList, &( pxTimer->xTimerListItem ) );
+			/* The next event has not been reached yet.  This task should
+			therefore block to wait for it or for a command to be received -
+			whichever comes first. */
+			if( xWheelWasEmpty == pdFALSE )
+			{
+				vQueueWaitForMessageRestricted( xTimerQueues[ xServiceID ], xTicksToNextEvent - xPending + 1 );
+			}
+			else
+			{
+				vQueueWaitForMessageRestricted( xTimerQueues[ xServiceID ], portMAX_DELAY );
+			}
+
+			if( xTaskResumeAll() == pdFALSE )
+			{
+				/* Yield to wait for either a command to arrive, or the
+				block time to expire.  If a command arrived between the
+				critical section being exited and this yield then the yield
+				will not cause the task to block. */
+				portYIELD_WITHIN_API();
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
 		}
 	}
-
-	return xProcessTimerNow;
 }
 /*-----------------------------------------------------------*/
 
-static void	prvProcessReceivedCommands( void )
+static void	prvProcessReceivedCommands( const BaseType_t xServiceID )
 {
+TimerWheel_t * const pxWheel = &( xTimerWheels[ xServiceID ] );
 DaemonTaskMessage_t xMessage;
 Timer_t *pxTimer;
-BaseType_t xTimerListsWereSwitched, xResult;
+BaseType_t xResult;
 TickType_t xTimeNow;
 
-	while( xQueueReceive( xTimerQueue, &xMessage, tmrNO_DELAY ) != pdFAIL ) /*lint !e603 xMessage does not have to be initialised as it is passed out, not in, and it is not used unless xQueueReceive() returns pdTRUE. */
+	while( xQueueReceive( xTimerQueues[ xServiceID ], &xMessage, tmrNO_DELAY ) != pdFAIL ) /*lint !e603 xMessage does not have to be initialised as it is passed out, not in, and it is not used unless xQueueReceive() returns pdTRUE. */
 	{
 		#if ( INCLUDE_xTimerPendFunctionCall == 1 )
 		{
@@ -628,26 +735,21 @@ TickType_t xTimeNow;
 			/* The messages uses the xTimerParameters member to work on a
 			software timer. */
 			pxTimer = xMessage.u.xTimerParameters.pxTimer;
+			configASSERT( pxTimer->xServiceID == xServiceID );
 
-			if( listIS_CONTAINED_WITHIN( NULL, &( pxTimer->xTimerListItem ) ) == pdFALSE )
-			{
-				/* The timer is in a list, remove it. */
-				( void ) uxListRemove( &( pxTimer->xTimerListItem ) );
-			}
-			else
-			{
-				mtCOVERAGE_TEST_MARKER();
-			}
+			/* If the timer is in the wheel, remove it. */
+			prvWheelRemove( pxWheel, pxTimer );
 
 			traceTIMER_COMMAND_RECEIVED( pxTimer, xMessage.xMessageID, xMessage.u.xTimerParameters.xMessageValue );
 
-			/* In this case the xTimerListsWereSwitched parameter is not used, but
-			it must be present in the function call.  prvSampleTimeNow() must be
-			called after the message is received from xTimerQueue so there is no
-			possibility of a higher priority task adding a message to the message
-			queue with a time that is ahead of the timer daemon task (because it
-			pre-empted the timer daemon task after the xTimeNow value was set). */
-			xTimeNow = prvSampleTimeNow( &xTimerListsWereSwitched );
+			/* prvWheelAdvance() must be called after the message is received
+			from the queue so there is no possibility of a higher priority task
+			adding a message to the message queue with a time that is ahead of
+			the timer daemon task (because it pre-empted the timer daemon task
+			after the xTimeNow value was set).  Bringing the wheel up to date
+			also guarantees that any expiry time after xTimeNow can be filed. */
+			xTimeNow = xTaskGetTickCount();
+			prvWheelAdvance( pxWheel, xTimeNow );
 
 			switch( xMessage.xMessageID )
 			{
@@ -656,8 +758,10 @@ TickType_t xTimeNow;
 			    case tmrCOMMAND_RESET :
 			    case tmrCOMMAND_RESET_FROM_ISR :
 				case tmrCOMMAND_START_DONT_TRACE :
-					/* Start or restart a timer. */
-					if( prvInsertTimerInActiveList( pxTimer,  xMessage.u.xTimerParameters.xMessageValue + pxTimer->xTimerPeriodInTicks, xTimeNow, xMessage.u.xTimerParameters.xMessageValue ) == pdTRUE )
+					/* Start or restart a timer.  Has the expiry time elapsed
+					between the command being issued and the command being
+					processed? */
+					if( ( TickType_t ) ( xTimeNow - xMessage.u.xTimerParameters.xMessageValue ) >= pxTimer->xTimerPeriodInTicks )
 					{
 						/* The timer expired before it was added to the active
 						timer list.  Process it now. */
@@ -677,7 +781,7 @@ TickType_t xTimeNow;
 					}
 					else
 					{
-						mtCOVERAGE_TEST_MARKER();
+						prvWheelInsert( pxWheel, pxTimer, xMessage.u.xTimerParameters.xMessageValue + pxTimer->xTimerPeriodInTicks );
 					}
 					break;
 
@@ -698,7 +802,7 @@ TickType_t xTimeNow;
 					zero the next expiry time can only be in the future, meaning
 					(unlike for the xTimerStart() case above) there is no fail case
 					that needs to be handled here. */
-					( void ) prvInsertTimerInActiveList( pxTimer, ( xTimeNow + pxTimer->xTimerPeriodInTicks ), xTimeNow, xTimeNow );
+					prvWheelInsert( pxWheel, pxTimer, xTimeNow + pxTimer->xTimerPeriodInTicks );
 					break;
 
 				case tmrCOMMAND_DELETE :
@@ -716,65 +820,6 @@ TickType_t xTimeNow;
 }
 /*-----------------------------------------------------------*/
 
-static void prvSwitchTimerLists( void )
-{
-TickType_t xNextExpireTime, xReloadTime;
-List_t *pxTemp;
-Timer_t *pxTimer;
-BaseType_t xResult;
-
-	/* The tick count has overflowed.  The timer lists must be switched.
-	If there are any timers still referenced from the current timer list
-	then they must have expired and should be processed before the lists
-	are switched. */
-	while( listLIST_IS_EMPTY( pxCurrentTimerList ) == pdFALSE )
-	{
-		xNextExpireTime = listGET_ITEM_VALUE_OF_HEAD_ENTRY( pxCurrentTimerList );
-
-		/* Remove the timer from the list. */
-		pxTimer = ( Timer_t * ) listGET_OWNER_OF_HEAD_ENTRY( pxCurrentTimerList );
-		( void ) uxListRemove( &( pxTimer->xTimerListItem ) );
-		traceTIMER_EXPIRED( pxTimer );
-
-		/* Execute its callback, then send a command to restart the timer if
-		it is an auto-reload timer.  It cannot be restarted here as the lists
-		have not yet been switched. */
-		pxTimer->pxCallbackFunction( ( TimerHandle_t ) pxTimer );
-
-		if( pxTimer->uxAutoReload == ( UBaseType_t ) pdTRUE )
-		{
-			/* Calculate the reload value, and if the reload value results in
-			the timer going into the same timer list then it has already expired
-			and the timer should be re-inserted into the current list so it is
-			processed again within this loop.  Otherwise a command should be sent
-			to restart the timer to ensure it is only inserted into a list after
-			the lists have been swapped. */
-			xReloadTime = ( xNextExpireTime + pxTimer->xTimerPeriodInTicks );
-			if( xReloadTime > xNextExpireTime )
-			{
-				listSET_LIST_ITEM_VALUE( &( pxTimer->xTimerListItem ), xReloadTime );
-				listSET_LIST_ITEM_OWNER( &( pxTimer->xTimerListItem ), pxTimer );
-				vListInsert( pxCurrentTimerList, &( pxTimer->xTimerListItem ) );
-			}
-			else
-			{
-				xResult = xTimerGenericCommand( pxTimer, tmrCOMMAND_START_DONT_TRACE, xNextExpireTime, NULL, tmrNO_DELAY );
-				configASSERT( xResult );
-				( void ) xResult;
-			}
-		}
-		else
-		{
-			mtCOVERAGE_TEST_MARKER();
-		}
-	}
-
-	pxTemp = pxCurrentTimerList;
-	pxCurrentTimerList = pxOverflowTimerList;
-	pxOverflowTimerList = pxTemp;
-}
-/*-----------------------------------------------------------*/
-
 static void prvCheckForValidListAndQueue( void )
 {
 	/* Check that the list from which active timers are referenced, and the
@@ -785,31 +830,43 @@ static void prvCheckForValidListAndQueue( void )
 	   atomically because we don't have a lock yet... I'm pretty sure doubly-initializing a lock on 2 cpus 
 	   is no problem in the current implementation, but this is not a nice way to solve things. ToDo - improve. */
 
-	if( xTimerQueue == NULL ) vPortCPUInitializeMutex( &xTimerMux );
+	if( xTimerQueues[ 0 ] == NULL ) vPortCPUInitializeMutex( &xTimerMux );
 
 	taskENTER_CRITICAL( &xTimerMux );
 	{
-		if( xTimerQueue == NULL )
+		if( xTimerQueues[ 0 ] == NULL )
 		{
-			vListInitialise( &xActiveTimerList1 );
-			vListInitialise( &xActiveTimerList2 );
-			pxCurrentTimerList = &xActiveTimerList1;
-			pxOverflowTimerList = &xActiveTimerList2;
-			xTimerQueue = xQueueCreate( ( UBaseType_t ) configTIMER_QUEUE_LENGTH, sizeof( DaemonTaskMessage_t ) );
-			configASSERT( xTimerQueue );
-
-			#if ( configQUEUE_REGISTRY_SIZE > 0 )
+		BaseType_t xServiceID;
+		UBaseType_t uxSlot;
+		TimerWheel_t *pxWheel;
+
+			for( xServiceID = tmrNUM_SERVICES - 1; xServiceID >= 0; xServiceID-- )
 			{
-				if( xTimerQueue != NULL )
+				pxWheel = &( xTimerWheels[ xServiceID ] );
+				for( uxSlot = 0; uxSlot < ( tmrWHEEL_LEVELS * tmrWHEEL_SLOTS ); uxSlot++ )
 				{
-					vQueueAddToRegistry( xTimerQueue, "TmrQ" );
+					vListInitialise( &( pxWheel->xSlots[ 0 ][ uxSlot ] ) );
 				}
-				else
+				pxWheel->xNextTick = xTaskGetTickCount();
+
+				/* Queue 0 is created last, it marks the initialisation as
+				done. */
+				xTimerQueues[ xServiceID ] = xQueueCreate( ( UBaseType_t ) configTIMER_QUEUE_LENGTH, sizeof( DaemonTaskMessage_t ) );
+				configASSERT( xTimerQueues[ xServiceID ] );
+
+				#if ( configQUEUE_REGISTRY_SIZE > 0 )
 				{
-					mtCOVERAGE_TEST_MARKER();
+					if( xTimerQueues[ xServiceID ] != NULL )
+					{
+						vQueueAddToRegistry( xTimerQueues[ xServiceID ], "TmrQ" );
+					}
+					else
+					{
+						mtCOVERAGE_TEST_MARKER();
+					}
 				}
+				#endif /* configQUEUE_REGISTRY_SIZE */
 			}
-			#endif /* configQUEUE_REGISTRY_SIZE */
 		}
 		else
 		{
@@ -829,8 +886,8 @@ Timer_t *pxTimer = ( Timer_t * ) xTimer;
 	taskENTER_CRITICAL( &xTimerMux );
 	{
 		/* Checking to see if it is in the NULL list in effect checks to see if
-		it is referenced from either the current or the overflow timer lists in
-		one go, but the logic has to be reversed, hence the '!'. */
+		it is referenced from any slot of the timer wheel in one go, but the
+		logic has to be reversed, hence the '!'. */
 		xTimerIsInActiveList = ( BaseType_t ) !( listIS_CONTAINED_WITHIN( NULL, &( pxTimer->xTimerListItem ) ) );
 	}
 	taskEXIT_CRITICAL( &xTimerMux );
@@ -861,7 +918,7 @@ Timer_t * const pxTimer = ( Timer_t * ) xTimer;
 		xMessage.u.xCallbackParameters.pvParameter1 = pvParameter1;
 		xMessage.u.xCallbackParameters.ulParameter2 = ulParameter2;
 
-		xReturn = xQueueSendFromISR( xTimerQueue, &xMessage, pxHigherPriorityTaskWoken );
+		xReturn = xQueueSendFromISR( xTimerQueues[ tmrCALLER_SERVICE() ], &xMessage, pxHigherPriorityTaskWoken );
 
 		tracePEND_FUNC_CALL_FROM_ISR( xFunctionToPend, pvParameter1, ulParameter2, xReturn );
 
@@ -881,7 +938,7 @@ Timer_t * const pxTimer = ( Timer_t * ) xTimer;
 		/* This function can only be called after a timer has been created or
 		after the scheduler has been started because, until then, the timer
 		queue does not exist. */
-		configASSERT( xTimerQueue );
+		configASSERT( xTimerQueues[ 0 ] );
 
 		/* Complete the message with the function parameters and post it to the
 		daemon task. */
@@ -890,7 +947,7 @@ Timer_t * const pxTimer = ( Timer_t * ) xTimer;
 		xMessage.u.xCallbackParameters.pvParameter1 = pvParameter1;
 		xMessage.u.xCallbackParameters.ulParameter2 = ulParameter2;
 
-		xReturn = xQueueSendToBack( xTimerQueue, &xMessage, xTicksToWait );
+		xReturn = xQueueSendToBack( xTimerQueues[ tmrCALLER_SERVICE() ], &xMessage, xTicksToWait );
 
 		tracePEND_FUNC_CALL( xFunctionToPend, pvParameter1, ulParameter2, xReturn );
 
@@ -0,0 +1,193 @@
+#!/usr/bin/env python
+#
+# FreeRTOS trace recorder decoder
+#
+# Reads the output of vTraceRecorderDump() (a serial console log is fine, other
+# lines are skipped) and prints a timeline of the scheduler events of each core,
+# followed by the CPU time used by each task and interrupt.
+#
+# Timestamps are CPU cycle counts of the core that recorded the event. The
+# counters of the two cores are not synchronised, so each core is shown on its
+# own time base, starting at its oldest recorded event.
+import argparse
+import re
+import sys
+
+__version__ = '1.0'
+
+# Event codes from trace_recorder.h
+EVT_TASK_SWITCHED_IN = 1
+EVT_TASK_SWITCHED_OUT = 2
+EVT_TASK_READY = 3
+EVT_QUEUE_BLOCK_SEND = 4
+EVT_QUEUE_BLOCK_RECEIVE = 5
+EVT_TASK_DELAY = 6
+EVT_TASK_SUSPEND = 7
+EVT_TASK_DELETE = 8
+EVT_ISR_ENTER = 9
+EVT_ISR_EXIT = 10
+
+RE_BEGIN = re.compile(r'TRACE BEGIN cores=(\d+) freq=(\d+)')
+RE_TASK = re.compile(r'^T ([0-9a-fA-F]{8}) (.*)$')
+RE_LOST = re.compile(r'^L (\d+) (\d+)$')
+RE_EVENT = re.compile(r'^E (\d+) ([0-9a-fA-F]{8}) (\d+) ([0-9a-fA-F]{8})$')
+RE_END = re.compile(r'TRACE END')
+
+
+class Trace(object):
+    def __init__(self):
+        self.cores = 0
+        self.freq = 0
+        self.tasks = {}
+        self.lost = {}
+        self.events = {}   # core -> list of (cycles, event, arg)
+
+    def task_name(self, tcb):
+        return self.tasks.get(tcb, '0x%08x' % tcb)
+
+    def describe(self, event, arg):
+        if event == EVT_TASK_SWITCHED_IN:
+            return 'switch in    %s' % self.task_name(arg)
+        if event == EVT_TASK_SWITCHED_OUT:
+            return 'switch out   %s' % self.task_name(arg)
+        if event == EVT_TASK_READY:
+            return 'ready        %s' % self.task_name(arg)
+        if event == EVT_QUEUE_BLOCK_SEND:
+            return 'block send   queue 0x%08x' % arg
+        if event == EVT_QUEUE_BLOCK_RECEIVE:
+            return 'block recv   queue 0x%08x' % arg
+        if event == EVT_TASK_DELAY:
+            if arg == 0:
+                return 'delay until'
+            return 'delay        %d ticks' % arg
+        if event == EVT_TASK_SUSPEND:
+            return 'suspend      %s' % self.task_name(arg)
+        if event == EVT_TASK_DELETE:
+            return 'delete       %s' % self.task_name(arg)
+        if event == EVT_ISR_ENTER:
+            return 'isr enter    %d' % arg
+        if event == EVT_ISR_EXIT:
+            return 'isr exit     %d' % arg
+        return 'event %d      0x%08x' % (event, arg)
+
+
+def parse(lines):
+    """ Parse the last complete dump in the given lines """
+    trace = None
+    result = None
+    for line in lines:
+        line = line.strip()
+        m = RE_BEGIN.search(line)
+        if m:
+            trace = Trace()
+            trace.cores = int(m.group(1))
+            trace.freq = int(m.group(2))
+            continue
+        if trace is None:
+            continue
+        if RE_END.search(line):
+            result = trace
+            trace = None
+            continue
+        m = RE_TASK.match(line)
+        if m:
+            trace.tasks[int(m.group(1), 16)] = m.group(2)
+            continue
+        m = RE_LOST.match(line)
+        if m:
+            trace.lost[int(m.group(1))] = int(m.group(2))
+            continue
+        m = RE_EVENT.match(line)
+        if m:
+            core = int(m.group(1))
+            trace.events.setdefault(core, []).append((int(m.group(2), 16), int(m.group(3)), int(m.group(4), 16)))
+    if result is None:
+        raise ValueError('no complete TRACE BEGIN ... TRACE END block found')
+    return result
+
+
+def unwrap(events):
+    """ Turn the 32-bit cycle counts of one core into a monotonic count """
+    out = []
+    base = 0
+    last = None
+    for (cycles, event, arg) in events:
+        if last is not None and cycles < last:
+            base += 1 << 32
+        last = cycles
+        out.append((base + cycles, event, arg))
+    return out
+
+
+def print_core(trace, core, events, timeline, out):
+    if not events:
+        return
+    us_per_cycle = 1e6 / trace.freq
+    start = events[0][0]
+    out.write('Core %d: %d events' % (core, len(events)))
+    if core in trace.lost:
+        out.write(', %d older events overwritten' % trace.lost[core])
+    out.write('\n')
+
+    running = None
+    run_start = start
+    task_time = {}
+    task_switches = {}
+    isr_start = {}
+    isr_time = {}
+    isr_count = {}
+    isr_max = {}
+
+    for (cycles, event, arg) in events:
+        if timeline:
+            out.write('%14.3f us  %s\n' % ((cycles - start) * us_per_cycle, trace.describe(event, arg)))
+        if event == EVT_TASK_SWITCHED_IN:
+            running = arg
+            run_start = cycles
+            task_switches[arg] = task_switches.get(arg, 0) + 1
+        elif event == EVT_TASK_SWITCHED_OUT:
+            if running == arg:
+                task_time[arg] = task_time.get(arg, 0) + cycles - run_start
+            running = None
+        elif event == EVT_ISR_ENTER:
+            isr_start[arg] = cycles
+        elif event == EVT_ISR_EXIT and arg in isr_start:
+            length = cycles - isr_start.pop(arg)
+            isr_time[arg] = isr_time.get(arg, 0) + length
+            isr_count[arg] = isr_count.get(arg, 0) + 1
+            isr_max[arg] = max(isr_max.get(arg, 0), length)
+    if running is not None:
+        task_time[running] = task_time.get(running, 0) + events[-1][0] - run_start
+
+    total = max(events[-1][0] - start, 1)
+    out.write('\n  %-20s %12s %7s %9s\n' % ('Task', 'Time (us)', 'Share', 'Switches'))
+    for tcb in sorted(task_time, key=lambda t: -task_time[t]):
+        out.write('  %-20s %12.1f %6.1f%% %9d\n' % (trace.task_name(tcb), task_time[tcb] * us_per_cycle,
+                                                   100.0 * task_time[tcb] / total, task_switches.get(tcb, 0)))
+    if isr_count:
+        out.write('\n  %-9s %8s %12s %12s\n' % ('Interrupt', 'Count', 'Total (us)', 'Max (us)'))
+        for n in sorted(isr_count):
+            out.write('  %-9d %8d %12.1f %12.1f\n' % (n, isr_count[n], isr_time[n] * us_per_cycle, isr_max[n] * us_per_cycle))
+    out.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='FreeRTOS trace recorder decoder')
+    parser.add_argument('--summary', '-s', help='Only print the per-core summary, not the event timeline', action='store_true')
+    parser.add_argument('input', help='Console log containing the output of vTraceRecorderDump(). Will use stdin if omitted.',
+                        type=argparse.FileType('r'), nargs='?', default=sys.stdin)
+    parser.add_argument('output', help='Path to output file. Will use stdout if omitted.',
+                        type=argparse.FileType('w'), nargs='?', default=sys.stdout)
+    args = parser.parse_args()
+
+    trace = parse(args.input)
+    for core in sorted(trace.events):
+        print_core(trace, core, unwrap(trace.events[core]), not args.summary, args.output)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except ValueError as e:
+        sys.stderr.write(str(e) + '\n')
+        sys.exit(2)
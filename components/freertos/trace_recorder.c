@@ -0,0 +1,187 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rom/ets_sys.h"
+#include "xtensa/hal.h"
+
+#if configUSE_TRACE_RECORDER
+
+/* Number of task names remembered for dumps. When more tasks are created, the
+oldest names are forgotten and their TCBs are shown as addresses. */
+#define trcMAX_TASK_NAMES		32
+
+typedef struct
+{
+	uint32_t ulTimestamp;	/* CCOUNT of the core that recorded the event. */
+	uint32_t ulArg;
+	uint32_t ulEvent;
+} TraceEvent_t;
+
+typedef struct
+{
+	TraceEvent_t xEvents[ configTRACE_RECORDER_EVENTS ];
+	uint32_t ulHead;		/* Index of the next event to write. */
+	uint32_t ulRecorded;	/* Events recorded since the buffer was cleared. */
+} TraceBuffer_t;
+
+typedef struct
+{
+	const void *pxTCB;
+	char pcName[ configMAX_TASK_NAME_LEN ];
+} TraceTaskName_t;
+
+/* Only core N writes xTraceBuffers[ N ]. */
+static TraceBuffer_t xTraceBuffers[ portNUM_PROCESSORS ];
+static volatile BaseType_t xTraceRunning = pdTRUE;
+
+static TraceTaskName_t xTraceTaskNames[ trcMAX_TASK_NAMES ];
+static UBaseType_t uxNextTaskName = 0;
+static portMUX_TYPE xTaskNamesMux = portMUX_INITIALIZER_UNLOCKED;
+
+void vTraceRecorderEvent( uint32_t ulEvent, uint32_t ulArg )
+{
+TraceBuffer_t *pxBuffer;
+TraceEvent_t *pxEvent;
+unsigned uxState;
+
+	if( xTraceRunning == pdFALSE )
+	{
+		return;
+	}
+
+	/* Masking interrupts keeps an interrupt on this core from recording an
+	event between reading and advancing the head. */
+	uxState = portENTER_CRITICAL_NESTED();
+	pxBuffer = &xTraceBuffers[ xPortGetCoreID() ];
+	pxEvent = &pxBuffer->xEvents[ pxBuffer->ulHead ];
+	pxEvent->ulTimestamp = xthal_get_ccount();
+	pxEvent->ulArg = ulArg;
+	pxEvent->ulEvent = ulEvent;
+	if( ++pxBuffer->ulHead == configTRACE_RECORDER_EVENTS )
+	{
+		pxBuffer->ulHead = 0;
+	}
+	pxBuffer->ulRecorded++;
+	portEXIT_CRITICAL_NESTED( uxState );
+}
+/*-----------------------------------------------------------*/
+
+void vTraceRecorderTaskCreated( const void *pxTCB, const char *pcName )
+{
+UBaseType_t ux;
+
+	portENTER_CRITICAL( &xTaskNamesMux );
+	/* A TCB allocated at the address of a deleted task takes over its entry. */
+	for( ux = 0; ux < trcMAX_TASK_NAMES; ux++ )
+	{
+		if( xTraceTaskNames[ ux ].pxTCB == pxTCB )
+		{
+			break;
+		}
+	}
+	if( ux == trcMAX_TASK_NAMES )
+	{
+		ux = uxNextTaskName;
+		uxNextTaskName = ( uxNextTaskName + 1 ) % trcMAX_TASK_NAMES;
+	}
+	xTraceTaskNames[ ux ].pxTCB = pxTCB;
+	strncpy( xTraceTaskNames[ ux ].pcName, pcName, configMAX_TASK_NAME_LEN - 1 );
+	xTraceTaskNames[ ux ].pcName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+	portEXIT_CRITICAL( &xTaskNamesMux );
+}
+/*-----------------------------------------------------------*/
+
+void vTraceRecorderStart( void )
+{
+UBaseType_t uxCore;
+
+	xTraceRunning = pdFALSE;
+	for( uxCore = 0; uxCore < portNUM_PROCESSORS; uxCore++ )
+	{
+		xTraceBuffers[ uxCore ].ulHead = 0;
+		xTraceBuffers[ uxCore ].ulRecorded = 0;
+	}
+	xTraceRunning = pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+void vTraceRecorderStop( void )
+{
+	xTraceRunning = pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+void vTraceRecorderDump( void )
+{
+BaseType_t xWasRunning = xTraceRunning;
+TraceTaskName_t xName;
+UBaseType_t ux, uxCore;
+uint32_t ulCount, ulIndex;
+
+	/* Printing takes far longer than recording, so the buffers are frozen
+	instead of being locked. An event that was being written on the other core
+	when recording stopped may be printed half updated. */
+	xTraceRunning = pdFALSE;
+
+	ets_printf( "TRACE BEGIN cores=%d freq=%d\n", portNUM_PROCESSORS, XT_CLOCK_FREQ );
+
+	for( ux = 0; ux < trcMAX_TASK_NAMES; ux++ )
+	{
+		portENTER_CRITICAL( &xTaskNamesMux );
+		xName = xTraceTaskNames[ ux ];
+		portEXIT_CRITICAL( &xTaskNamesMux );
+		if( xName.pxTCB != NULL )
+		{
+			ets_printf( "T %08x %s\n", ( uint32_t ) xName.pxTCB, xName.pcName );
+		}
+	}
+
+	for( uxCore = 0; uxCore < portNUM_PROCESSORS; uxCore++ )
+	{
+		const TraceBuffer_t *pxBuffer = &xTraceBuffers[ uxCore ];
+
+		ulCount = pxBuffer->ulRecorded;
+		ulIndex = 0;
+		if( ulCount > configTRACE_RECORDER_EVENTS )
+		{
+			/* The buffer has wrapped. The oldest event left is at the head. */
+			ets_printf( "L %d %u\n", uxCore, ulCount - configTRACE_RECORDER_EVENTS );
+			ulCount = configTRACE_RECORDER_EVENTS;
+			ulIndex = pxBuffer->ulHead;
+		}
+
+		while( ulCount-- > 0 )
+		{
+			const TraceEvent_t *pxEvent = &pxBuffer->xEvents[ ulIndex ];
+
+			ets_printf( "E %d %08x %u %08x\n", uxCore, pxEvent->ulTimestamp, pxEvent->ulEvent, pxEvent->ulArg );
+			if( ++ulIndex == configTRACE_RECORDER_EVENTS )
+			{
+				ulIndex = 0;
+			}
+		}
+	}
+
+	ets_printf( "TRACE END\n" );
+
+	xTraceRunning = xWasRunning;
+}
+
+#endif /* configUSE_TRACE_RECORDER */
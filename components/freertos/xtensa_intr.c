@@ -30,6 +30,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <xtensa/config/core.h>
 
+#include "freertos/FreeRTOS.h"
 #include "freertos/xtensa_api.h"
 
 #include "rom/ets_sys.h"
@@ -89,7 +90,8 @@ typedef struct xt_handler_table_entry {
     void * arg;
 } xt_handler_table_entry;
 
-extern xt_handler_table_entry _xt_interrupt_table[XCHAL_NUM_INTERRUPTS];
+/* One table of XCHAL_NUM_INTERRUPTS entries per core */
+extern xt_handler_table_entry _xt_interrupt_table[XCHAL_NUM_INTERRUPTS*portNUM_PROCESSORS];
 
 
 /*
@@ -102,29 +104,65 @@ void xt_unhandled_interrupt(void * arg)
 }
 
 
+#if configUSE_TRACE_RECORDER
+
+/*
+  With the trace recorder, the dispatcher calls a wrapper that records entry
+  and exit of the handler. The real handlers are kept in this table.
+*/
+static xt_handler_table_entry xt_traced_interrupt_table[XCHAL_NUM_INTERRUPTS*portNUM_PROCESSORS];
+
+static void xt_traced_interrupt(void * arg)
+{
+    int n = (int)arg;
+    xt_handler_table_entry * entry = xt_traced_interrupt_table + xPortGetCoreID()*XCHAL_NUM_INTERRUPTS + n;
+
+    traceISR_ENTER(n);
+    ((xt_handler)entry->handler)(entry->arg);
+    traceISR_EXIT(n);
+}
+
+#endif
+
+
 /*
-  This function registers a handler for the specified interrupt. The "arg"
-  parameter specifies the argument to be passed to the handler when it is
-  invoked. The function returns the address of the previous handler.
+  This function registers a handler for the specified interrupt of the calling
+  core. The "arg" parameter specifies the argument to be passed to the handler
+  when it is invoked. The function returns the address of the previous handler.
   On error, it returns 0.
 */
 xt_handler xt_set_interrupt_handler(int n, xt_handler f, void * arg)
 {
     xt_handler_table_entry * entry;
     xt_handler               old;
+    int                      index;
 
     if( n < 0 || n >= XCHAL_NUM_INTERRUPTS )
         return 0;       /* invalid interrupt number */
     if( Xthal_intlevel[n] > XCHAL_EXCM_LEVEL )
         return 0;       /* priority level too high to safely handle in C */
 
-    entry = _xt_interrupt_table + n;
+    index = xPortGetCoreID()*XCHAL_NUM_INTERRUPTS + n;
+    entry = _xt_interrupt_table + index;
     old   = entry->handler;
 
+#if configUSE_TRACE_RECORDER
+    if (old == &xt_traced_interrupt) {
+        old = xt_traced_interrupt_table[index].handler;
+    }
+    if (f) {
+        /* Fill in the real handler before the dispatcher can call the wrapper. */
+        xt_traced_interrupt_table[index].handler = f;
+        xt_traced_interrupt_table[index].arg     = arg;
+        entry->handler = &xt_traced_interrupt;
+        entry->arg     = (void*)n;
+    }
+#else
     if (f) {
         entry->handler = f;
         entry->arg     = arg;
     }
+#endif
     else {
         entry->handler = &xt_unhandled_interrupt;
         entry->arg     = (void*)n;
@@ -134,5 +172,18 @@ xt_handler xt_set_interrupt_handler(int n, xt_handler f, void * arg)
 }
 
 
+/*
+  This function returns non-zero if a handler is installed for the specified
+  interrupt of the specified core.
+*/
+int xt_int_has_handler(int n, int cpu)
+{
+    if( n < 0 || n >= XCHAL_NUM_INTERRUPTS || cpu < 0 || cpu >= portNUM_PROCESSORS )
+        return 0;
+
+    return (_xt_interrupt_table[cpu*XCHAL_NUM_INTERRUPTS + n].handler != &xt_unhandled_interrupt);
+}
+
+
 #endif /* XCHAL_HAVE_INTERRUPTS */
 
@@ -0,0 +1,65 @@
+/* Host build of the parser benchmark.
+
+   parser_bench [-t ms] [-b baseline] [-p tolerance_pct]
+
+   Prints the results table. With -b, the results are compared against the
+   table in the baseline file, saved from an earlier run, and the exit
+   status is 1 if any of them regresses (see parser_bench_check). The
+   throughput may be lower by the tolerance, 10 % by default; -p 100 only
+   checks allocations and peak memory.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "parser_bench.h"
+
+int main(int argc, char **argv)
+{
+    parser_bench_cfg_t cfg = { 0 };
+    const char *baseline_file = NULL;
+    unsigned tolerance = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:b:p:")) != -1) {
+        switch (opt) {
+        case 't':
+            cfg.min_time_ms = atoi(optarg);
+            break;
+        case 'b':
+            baseline_file = optarg;
+            break;
+        case 'p':
+            tolerance = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t ms] [-b baseline] [-p tolerance_pct]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static parser_bench_result_t results[PARSER_BENCH_MAX_RESULTS];
+    size_t count;
+    if (parser_bench_run(&cfg, results, &count) != ESP_OK) {
+        return 1;
+    }
+    parser_bench_print(results, count);
+    if (baseline_file == NULL) {
+        return 0;
+    }
+
+    static parser_bench_result_t baseline[PARSER_BENCH_MAX_RESULTS];
+    size_t baseline_count = 0;
+    char line[256];
+    FILE *f = fopen(baseline_file, "r");
+    if (f == NULL) {
+        perror(baseline_file);
+        return 2;
+    }
+    while (baseline_count < PARSER_BENCH_MAX_RESULTS && fgets(line, sizeof(line), f)) {
+        if (parser_bench_parse_line(line, &baseline[baseline_count])) {
+            baseline_count++;
+        }
+    }
+    fclose(f);
+    return parser_bench_check(results, count, baseline, baseline_count, tolerance) == ESP_OK ? 0 : 1;
+}
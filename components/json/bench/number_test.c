@@ -0,0 +1,71 @@
+/* Host test of number parsing.
+
+   number_test [count]
+
+   Parses numbers with cJSON_Parse and with cJSONStream, and checks that both
+   give the same double as strtod: a list of edge cases, then count random
+   numbers of the form d.ddde+-NNN (200000 by default). The exit status is 1
+   if any of them differs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "cJSON_Stream.h"
+
+static const char *s_cases[] = {
+    "0", "-0", "1", "-1", "2147483647", "2147483648", "-2147483649",
+    "9007199254740993", "18446744073709551615", "123456789012345678901234567890",
+    "0.1", "1e22", "1e23", "8.5e-5", "13301.585e29", "1.7976931348623157e308",
+    "2.2250738585072011e-308", "2.2250738585072014e-308", "4.9e-324", "2.4703282292062328e-324",
+    "1e-400", "0e400", "12345678901234567890123e-4", "0.000000000000000000000000012345678901234567890",
+};
+
+static int s_failures;
+
+static void check(const char *text)
+{
+    const double expected = strtod(text, NULL);
+
+    cJSON *tree = cJSON_Parse(text);
+    const double parsed = tree ? tree->valuedouble : 0;
+    if (!tree || memcmp(&parsed, &expected, sizeof(double)) != 0) {
+        printf("cJSON_Parse(\"%s\") = %.17g, strtod = %.17g\n", text, parsed, expected);
+        ++s_failures;
+    }
+    cJSON_Delete(tree);
+
+    cJSONStream *stream = cJSONStream_New(NULL, NULL);
+    tree = NULL;
+    if (stream && cJSONStream_Feed(stream, text, strlen(text)) == cJSONStream_Ok &&
+            cJSONStream_Finish(stream) == cJSONStream_Ok) {
+        tree = cJSONStream_DetachTree(stream);
+    }
+    const double streamed = tree ? tree->valuedouble : 0;
+    if (!tree || memcmp(&streamed, &expected, sizeof(double)) != 0) {
+        printf("cJSONStream(\"%s\") = %.17g, strtod = %.17g\n", text, streamed, expected);
+        ++s_failures;
+    }
+    cJSON_Delete(tree);
+    cJSONStream_Delete(stream);
+}
+
+int main(int argc, char **argv)
+{
+    const long count = (argc > 1) ? atol(argv[1]) : 200000;
+    char text[32];
+
+    for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); ++i) {
+        check(s_cases[i]);
+    }
+    srand(1);
+    for (long i = 0; i < count; ++i) {
+        snprintf(text, sizeof(text), "%d.%03de%c%d", rand() % 10, rand() % 1000,
+                 (rand() % 2) ? '+' : '-', rand() % 330);
+        check(text);
+    }
+    printf("%d of %ld numbers differ from strtod\n", s_failures,
+           (long) (sizeof(s_cases) / sizeof(s_cases[0])) + count);
+    return s_failures ? 1 : 0;
+}
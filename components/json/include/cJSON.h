@@ -39,6 +39,9 @@ extern "C"
 	
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+#define cJSON_IsArena 1024		/* Allocated in the arena of a document parsed by cJSON_ParseArena */
+#define cJSON_ArenaRoot 2048	/* Root of a document parsed by cJSON_ParseArena */
+#define cJSON_ValueStringIsConst 4096	/* valuestring isn't owned by the item, see cJSON_ParseInPlace */
 
 /* The cJSON structure: */
 typedef struct cJSON {
@@ -128,6 +131,20 @@ The item->next and ->prev pointers are always zero on return from Duplicate. */
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 extern cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated);
 
+/* Parse like cJSON_ParseWithOpts, but allocate all items and strings of the document from a few large chunks
+instead of one allocation each. cJSON_Delete on the returned root frees the chunks at once. Items of the document
+carry the cJSON_IsArena flag (use type&255 to get their type); deleting or detaching one of them doesn't free its memory
+before the root is deleted, and they must not be used after that. Items created with cJSON_CreateXxx can still be added
+to the document, and are freed with it. */
+extern cJSON *cJSON_ParseArena(const char *value);
+extern cJSON *cJSON_ParseArenaWithOpts(const char *value,const char **return_parse_end,int require_null_terminated);
+
+/* Parse like cJSON_ParseWithOpts, but unescape the strings inside value and point valuestring and string of the
+items to them instead of copies (items carry cJSON_ValueStringIsConst and cJSON_StringIsConst). value is modified,
+also when parsing fails, and must outlive the tree. */
+extern cJSON *cJSON_ParseInPlace(char *value);
+extern cJSON *cJSON_ParseInPlaceWithOpts(char *value,const char **return_parse_end,int require_null_terminated);
+
 extern void cJSON_Minify(char *json);
 
 /* Macros for creating things quickly. */
@@ -30,6 +30,7 @@
 #include <float.h>
 #include <limits.h>
 #include <ctype.h>
+#include <stdint.h>
 #include "cJSON.h"
 
 static const char *ep;
@@ -69,47 +70,192 @@ void cJSON_InitHooks(cJSON_Hooks* hooks)
 	cJSON_free	 = (hooks->free_fn)?hooks->free_fn:free;
 }
 
+/* Espressif add start. */
+/* Arena of a document parsed by cJSON_ParseArena: the root item, followed
+   by the chunks holding all other items and strings of the document. */
+typedef struct cJSON_ArenaChunk {
+	struct cJSON_ArenaChunk *next;
+	size_t used,size;
+} cJSON_ArenaChunk;
+
+typedef struct {
+	cJSON root;					/* first, the root item is the document */
+	cJSON_ArenaChunk *chunks;	/* newest first */
+	size_t next_size;			/* size of the next chunk */
+} cJSON_Arena;
+
+#define ARENA_CHUNK_DATA	((sizeof(cJSON_ArenaChunk)+7)&~7)
+
+/* Arena of the document being parsed, 0 when not parsing into an arena */
+static cJSON_Arena *parse_arena;
+/* Strings are unescaped in the text being parsed, see cJSON_ParseInPlace */
+static int parse_in_place;
+
+static void *cJSON_arena_alloc(size_t sz)
+{
+	cJSON_ArenaChunk *chunk=parse_arena->chunks;
+	char *ptr;size_t size;
+
+	sz=(sz+7)&~7;
+	if (!chunk || chunk->used+sz>chunk->size)
+	{
+		size=parse_arena->next_size;if (size<sz) size=sz;
+		chunk=(cJSON_ArenaChunk*)cJSON_malloc(ARENA_CHUNK_DATA+size);
+		if (!chunk) return 0;
+		chunk->next=parse_arena->chunks;chunk->used=0;chunk->size=size;
+		parse_arena->chunks=chunk;
+		parse_arena->next_size=size*2;
+	}
+	ptr=(char*)chunk+ARENA_CHUNK_DATA+chunk->used;
+	chunk->used+=sz;
+	return ptr;
+}
+
+/* Whether ptr was allocated from the chunks of arena */
+static int cJSON_arena_owns(cJSON_Arena *arena,const void *ptr)
+{
+	cJSON_ArenaChunk *chunk;
+	for (chunk=arena->chunks;chunk;chunk=chunk->next)
+		if ((const char*)ptr>=(char*)chunk+ARENA_CHUNK_DATA && (const char*)ptr<(char*)chunk+ARENA_CHUNK_DATA+chunk->used) return 1;
+	return 0;
+}
+
+static void cJSON_arena_free(cJSON_Arena *arena)
+{
+	cJSON_ArenaChunk *chunk,*next;
+	for (chunk=arena->chunks;chunk;chunk=next) {next=chunk->next;cJSON_free(chunk);}
+	cJSON_free(arena);
+}
+/* Espressif add end. */
+
 /* Internal constructor. */
 static cJSON *cJSON_New_Item(void)
 {
-	cJSON* node = (cJSON*)cJSON_malloc(sizeof(cJSON));
+	cJSON* node = (cJSON*)(parse_arena?cJSON_arena_alloc(sizeof(cJSON)):cJSON_malloc(sizeof(cJSON)));
 	if (node) memset(node,0,sizeof(cJSON));
 	return node;
 }
 
-/* Delete a cJSON structure. */
+/* Delete a cJSON structure. Items in an arena are released with the whole
+   arena when its root is deleted, only items added to the document after
+   parsing are freed one by one. */
+static void cJSON_Delete_Items(cJSON *c,cJSON_Arena *arena);
+
+static void cJSON_Delete_Arena(cJSON *root)
+{
+	cJSON_Arena *arena=(cJSON_Arena*)root;
+	if (root->child) cJSON_Delete_Items(root->child,arena);
+	if (root->valuestring && !cJSON_arena_owns(arena,root->valuestring)) cJSON_free(root->valuestring);
+	if (!(root->type&cJSON_StringIsConst) && root->string) cJSON_free(root->string);
+	cJSON_arena_free(arena);
+}
+
+static void cJSON_Delete_Items(cJSON *c,cJSON_Arena *arena)
+{
+	cJSON *next;
+	while (c)
+	{
+		next=c->next;
+		if (c->type&cJSON_ArenaRoot) {cJSON_Delete_Arena(c);c=next;continue;}
+		if (!(c->type&cJSON_IsReference) && c->child) cJSON_Delete_Items(c->child,arena);
+		if (!(c->type&cJSON_IsArena))
+		{
+			if (!(c->type&(cJSON_IsReference|cJSON_ValueStringIsConst)) && c->valuestring) cJSON_free(c->valuestring);
+			if (!(c->type&cJSON_StringIsConst) && c->string) cJSON_free(c->string);
+			cJSON_free(c);
+		}
+		else if (arena)
+		{
+			/* Names given to items of the arena after parsing */
+			if (!(c->type&(cJSON_IsReference|cJSON_ValueStringIsConst)) && c->valuestring && !cJSON_arena_owns(arena,c->valuestring)) cJSON_free(c->valuestring);
+			if (!(c->type&cJSON_StringIsConst) && c->string && !cJSON_arena_owns(arena,c->string)) cJSON_free(c->string);
+		}
+		c=next;
+	}
+}
+
 void cJSON_Delete(cJSON *c)
+{
+	cJSON_Delete_Items(c,0);
+}
+
+/* Delete the tree of a failed parse. Parsing in place, a failure can leave
+   items pointing into the text without their flags set yet, but all their
+   strings are in the text. */
+static void cJSON_Delete_Parsed(cJSON *c)
 {
 	cJSON *next;
+	if (!parse_in_place) {cJSON_Delete(c);return;}
 	while (c)
 	{
 		next=c->next;
-		if (!(c->type&cJSON_IsReference) && c->child) cJSON_Delete(c->child);
-		if (!(c->type&cJSON_IsReference) && c->valuestring) cJSON_free(c->valuestring);
-		if (!(c->type&cJSON_StringIsConst) && c->string) cJSON_free(c->string);
+		cJSON_Delete_Parsed(c->child);
 		cJSON_free(c);
 		c=next;
 	}
 }
 
-/* Parse the input text to generate a number, and populate the result into item. */
+/* Espressif add start. */
+/* Powers of ten exactly representable as double */
+static const double exact_pow10[23]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+#define MANTISSA_DIGITS	19	/* decimal digits always fitting a uint64_t */
+
+/* Convert the number text from start to end with strtod, which rounds correctly
+   and is what cJSONStream uses, so both parsers give the same double. */
+static double parse_double(const char *start,const char *end)
+{
+	char buf[32],*copy=buf,*stop;size_t len=end-start;double n=strtod(start,&stop);
+	if (stop<=end) return n;
+	/* strtod went on past the JSON number (as in "1.e5" or "0x1"): convert a copy */
+	if (len>=sizeof(buf) && !(copy=(char*)cJSON_malloc(len+1))) return n;
+	memcpy(copy,start,len);copy[len]=0;
+	n=strtod(copy,0);
+	if (copy!=buf) cJSON_free(copy);
+	return n;
+}
+/* Espressif add end. */
+
+/* Parse the input text to generate a number, and populate the result into item.
+   The digits are gathered in an integer, so integers are converted to double
+   once, and other numbers scaled with one exact multiplication or division
+   when possible. The rest goes through strtod. */
 static const char *parse_number(cJSON *item,const char *num)
 {
-	double n=0,sign=1,scale=0;int subscale=0,signsubscale=1;
+	uint64_t m=0;int sign=1,digits=0,scale=0,subscale=0,signsubscale=1,e,truncated=0;double n;const char *start=num;
 
 	if (*num=='-') sign=-1,num++;	/* Has sign? */
 	if (*num=='0') num++;			/* is zero */
-	if (*num>='1' && *num<='9')	do	n=(n*10.0)+(*num++ -'0');	while (*num>='0' && *num<='9');	/* Number? */
-	if (*num=='.' && num[1]>='0' && num[1]<='9') {num++;		do	n=(n*10.0)+(*num++ -'0'),scale--; while (*num>='0' && *num<='9');}	/* Fractional part? */
+	for (;*num>='0' && *num<='9';num++)	/* Number? */
+	{
+		if (digits<MANTISSA_DIGITS) {m=m*10+(*num-'0');if (m) digits++;}
+		else scale++,truncated=1;		/* digits beyond the precision of double */
+	}
+	if (*num=='.' && num[1]>='0' && num[1]<='9')	/* Fractional part? */
+	{
+		for (num++;*num>='0' && *num<='9';num++)
+			if (digits<MANTISSA_DIGITS) {m=m*10+(*num-'0');if (m) digits++;scale--;}
+			else truncated=1;
+	}
 	if (*num=='e' || *num=='E')		/* Exponent? */
 	{	num++;if (*num=='+') num++;	else if (*num=='-') signsubscale=-1,num++;		/* With sign? */
-		while (*num>='0' && *num<='9') subscale=(subscale*10)+(*num++ - '0');	/* Number? */
+		while (*num>='0' && *num<='9') {if (subscale<100000) subscale=(subscale*10)+(*num-'0');num++;}	/* Number? */
 	}
+	e=scale+subscale*signsubscale;	/* number = +/- mantissa * 10^+/- e */
 
-	n=sign*n*pow(10.0,(scale+subscale*signsubscale));	/* number = +/- number.fraction * 10^+/- exponent */
-	
+	if (!truncated && (e==0 || m==0))
+	{
+		/* Integer: valueint without floating point */
+		n=sign*(double)m;
+		if (m<=(uint64_t)INT_MAX) item->valueint=sign*(int)m;
+		else item->valueint=(sign<0)?INT_MIN:INT_MAX;
+	}
+	else
+	{
+		if (!truncated && m<((uint64_t)1<<53) && e>=-22 && e<=22) n=sign*((e<0)?(double)m/exact_pow10[-e]:(double)m*exact_pow10[e]);
+		else n=parse_double(start,num);
+		item->valueint=(n>=INT_MAX)?INT_MAX:(n<=INT_MIN)?INT_MIN:(int)n;
+	}
 	item->valuedouble=n;
-	item->valueint=(int)n;
 	item->type=cJSON_Number;
 	return num;
 }
@@ -187,20 +333,54 @@ static unsigned parse_hex4(const char *str)
 	return h;
 }
 
-/* Parse the input text into an unescaped cstring, and populate item. */
+/* Espressif add start. */
+/* Non-zero if a byte of the word v is zero, or is c */
+#define WORD_HAS_ZERO(v)		(((v)-0x01010101u)&~(v)&0x80808080u)
+#define WORD_HAS_BYTE(v,c)		WORD_HAS_ZERO((v)^(0x01010101u*(unsigned char)(c)))
+
+/* Find the closing quote of the string starting at ptr (or its NUL terminator),
+   skipping escaped characters. Goes through aligned words without quote,
+   backslash or NUL in one step: the loads never cross a word boundary, so
+   they don't read past the terminator into unmapped memory. */
+static const char *string_end(const char *ptr,int *escaped)
+{
+	uint32_t w;
+	for (;;)
+	{
+		if (((uintptr_t)ptr&3)==0)
+		{
+			for (;;ptr+=4)
+			{
+				memcpy(&w,ptr,4);
+				if (WORD_HAS_ZERO(w) || WORD_HAS_BYTE(w,'\"') || WORD_HAS_BYTE(w,'\\')) break;
+			}
+		}
+		if (*ptr=='\"' || !*ptr) return ptr;
+		if (*ptr=='\\') {*escaped=1;ptr++;if (!*ptr) return ptr;}
+		ptr++;
+	}
+}
+/* Espressif add end. */
+
+/* Parse the input text into an unescaped cstring, and populate item. Strings
+   without escapes are copied in one go. */
 static const unsigned char firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
 static const char *parse_string(cJSON *item,const char *str)
 {
-	const char *ptr=str+1;char *ptr2;char *out;int len=0;unsigned uc,uc2;
+	const char *ptr=str+1,*end;char *ptr2;char *out;int len=0,escaped=0,closed;unsigned uc,uc2;
 	if (*str!='\"') {ep=str;return 0;}	/* not a string! */
 	
-	while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
+	end=string_end(ptr,&escaped);
+	len=end-ptr;	/* escapes don't grow the string */
+	closed=(*end=='\"');
 	
-	out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
+	if (parse_in_place) out=(char*)ptr;	/* the unescaped string is never ahead of the text */
+	else out=(char*)(parse_arena?cJSON_arena_alloc(len+1):cJSON_malloc(len+1));
 	if (!out) return 0;
 	
-	ptr=str+1;ptr2=out;
-	while (*ptr!='\"' && *ptr)
+	ptr2=out;
+	if (!escaped) {if (out!=ptr) memcpy(out,ptr,len);ptr2+=len;ptr=end;}
+	while (ptr<end)
 	{
 		if (*ptr!='\\') *ptr2++=*ptr++;
 		else
@@ -241,8 +421,8 @@ static const char *parse_string(cJSON *item,const char *str)
 			ptr++;
 		}
 	}
-	*ptr2=0;
-	if (*ptr=='\"') ptr++;
+	*ptr2=0;	/* in place, at most on the closing quote */
+	ptr=end+closed;
 	item->valuestring=out;
 	item->type=cJSON_String;
 	return ptr;
@@ -328,16 +508,55 @@ cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int r
 	if (!c) return 0;       /* memory fail */
 
 	end=parse_value(c,skip(value));
-	if (!end)	{cJSON_Delete(c);return 0;}	/* parse failure. ep is set. */
+	if (!end)	{cJSON_Delete_Parsed(c);return 0;}	/* parse failure. ep is set. */
 
 	/* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
-	if (require_null_terminated) {end=skip(end);if (*end) {cJSON_Delete(c);ep=end;return 0;}}
+	if (require_null_terminated) {end=skip(end);if (*end) {cJSON_Delete_Parsed(c);ep=end;return 0;}}
 	if (return_parse_end) *return_parse_end=end;
 	return c;
 }
 /* Default options for cJSON_Parse */
 cJSON *cJSON_Parse(const char *value) {return cJSON_ParseWithOpts(value,0,0);}
 
+/* Espressif add start. */
+/* Parse into an arena: all items and strings are allocated from a few large
+   chunks, the first one sized for the text, and freed together. */
+cJSON *cJSON_ParseArenaWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
+{
+	const char *end=0;
+	cJSON_Arena *arena;
+	ep=0;
+	if (!value) return 0;
+	arena=(cJSON_Arena*)cJSON_malloc(sizeof(cJSON_Arena));
+	if (!arena) return 0;	/* memory fail */
+	memset(arena,0,sizeof(cJSON_Arena));
+	arena->next_size=strlen(value)*2+256;
+
+	parse_arena=arena;
+	end=parse_value(&arena->root,skip(value));
+	parse_arena=0;
+
+	if (end && require_null_terminated) {end=skip(end);if (*end) {ep=end;end=0;}}
+	if (!end) {cJSON_arena_free(arena);return 0;}	/* parse failure. ep is set. */
+	arena->root.type=(arena->root.type&~cJSON_IsArena)|cJSON_ArenaRoot;
+	if (return_parse_end) *return_parse_end=end;
+	return &arena->root;
+}
+cJSON *cJSON_ParseArena(const char *value) {return cJSON_ParseArenaWithOpts(value,0,0);}
+
+/* Parse keeping the strings in value: they are unescaped where they are, and
+   the items point to them instead of copies. */
+cJSON *cJSON_ParseInPlaceWithOpts(char *value,const char **return_parse_end,int require_null_terminated)
+{
+	cJSON *c;
+	parse_in_place=1;
+	c=cJSON_ParseWithOpts(value,return_parse_end,require_null_terminated);
+	parse_in_place=0;
+	return c;
+}
+cJSON *cJSON_ParseInPlace(char *value) {return cJSON_ParseInPlaceWithOpts(value,0,0);}
+/* Espressif add end. */
+
 /* Render a cJSON item/entity/structure to text. */
 char *cJSON_Print(cJSON *item)				{return print_value(item,0,1,0);}
 char *cJSON_PrintUnformatted(cJSON *item)	{return print_value(item,0,0,0);}
@@ -354,7 +573,20 @@ char *cJSON_PrintBuffered(cJSON *item,int prebuffer,int fmt)
 
 
 /* Parser core - when encountering text, process appropriately. */
+static const char *parse_value_type(cJSON *item,const char *value);
 static const char *parse_value(cJSON *item,const char *value)
+{
+	const char *end=parse_value_type(item,value);
+	if (parse_arena) item->type|=cJSON_IsArena;
+	if (parse_in_place)
+	{
+		if (item->valuestring) item->type|=cJSON_ValueStringIsConst;
+		if (item->string) item->type|=cJSON_StringIsConst;
+	}
+	return end;
+}
+
+static const char *parse_value_type(cJSON *item,const char *value)
 {
 	if (!value)						return 0;	/* Fail on null. */
 	if (!strncmp(value,"null",4))	{ item->type=cJSON_NULL;  return value+4; }
@@ -665,12 +897,12 @@ cJSON *cJSON_GetObjectItem(cJSON *object,const char *string)	{cJSON *c=object->c
 /* Utility for array list handling. */
 static void suffix_object(cJSON *prev,cJSON *item) {prev->next=item;item->prev=prev;}
 /* Utility for handling references. */
-static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(cJSON));ref->string=0;ref->type|=cJSON_IsReference;ref->next=ref->prev=0;return ref;}
+static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(cJSON));ref->string=0;ref->type=(ref->type&~(cJSON_IsArena|cJSON_ArenaRoot))|cJSON_IsReference;ref->next=ref->prev=0;return ref;}
 
 /* Add item to array/object. */
 void   cJSON_AddItemToArray(cJSON *array, cJSON *item)						{cJSON *c=array->child;if (!item) return; if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
-void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (item->string) cJSON_free(item->string);item->string=cJSON_strdup(string);cJSON_AddItemToArray(object,item);}
-void   cJSON_AddItemToObjectCS(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&cJSON_StringIsConst) && item->string) cJSON_free(item->string);item->string=(char*)string;item->type|=cJSON_StringIsConst;cJSON_AddItemToArray(object,item);}
+void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&(cJSON_IsArena|cJSON_StringIsConst)) && item->string) cJSON_free(item->string);item->string=cJSON_strdup(string);item->type&=~cJSON_StringIsConst;cJSON_AddItemToArray(object,item);}
+void   cJSON_AddItemToObjectCS(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&(cJSON_StringIsConst|cJSON_IsArena)) && item->string) cJSON_free(item->string);item->string=(char*)string;item->type|=cJSON_StringIsConst;cJSON_AddItemToArray(object,item);}
 void	cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item)						{cJSON_AddItemToArray(array,create_reference(item));}
 void	cJSON_AddItemReferenceToObject(cJSON *object,const char *string,cJSON *item)	{cJSON_AddItemToObject(object,string,create_reference(item));}
 
@@ -714,7 +946,7 @@ cJSON *cJSON_Duplicate(cJSON *item,int recurse)
 	newitem=cJSON_New_Item();
 	if (!newitem) return 0;
 	/* Copy over all vars */
-	newitem->type=item->type&(~cJSON_IsReference),newitem->valueint=item->valueint,newitem->valuedouble=item->valuedouble;
+	newitem->type=item->type&(~(cJSON_IsReference|cJSON_IsArena|cJSON_ArenaRoot|cJSON_StringIsConst|cJSON_ValueStringIsConst)),newitem->valueint=item->valueint,newitem->valuedouble=item->valuedouble;
 	if (item->valuestring)	{newitem->valuestring=cJSON_strdup(item->valuestring);	if (!newitem->valuestring)	{cJSON_Delete(newitem);return 0;}}
 	if (item->string)		{newitem->string=cJSON_strdup(item->string);			if (!newitem->string)		{cJSON_Delete(newitem);return 0;}}
 	/* If non-recursive, then we're done! */
@@ -0,0 +1,118 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include "cJSON_Index.h"
+
+struct cJSONIndex {
+	cJSON *container;
+	int size;
+	cJSON **items;			/* children in order, built by the first positional lookup */
+	cJSON **table;			/* open addressing hash table of the members, built by the first lookup by name */
+	unsigned table_mask;	/* table size - 1, a power of two */
+};
+
+static int cJSONIndex_strcasecmp(const char *s1, const char *s2)
+{
+	if (!s1) return (s1 == s2) ? 0 : 1;
+	if (!s2) return 1;
+	for (; tolower(*(const unsigned char *)s1) == tolower(*(const unsigned char *)s2); ++s1, ++s2) if (*s1 == 0) return 0;
+	return tolower(*(const unsigned char *)s1) - tolower(*(const unsigned char *)s2);
+}
+
+/* FNV-1a of the lower case name, names compare case insensitive */
+static unsigned cJSONIndex_hash(const char *s)
+{
+	unsigned h = 2166136261u;
+	if (!s) return 0;
+	for (; *s; s++) h = (h ^ (unsigned)tolower(*(const unsigned char *)s)) * 16777619u;
+	return h;
+}
+
+static int cJSONIndex_build_items(cJSONIndex *index)
+{
+	cJSON *c;
+	int i = 0;
+
+	index->items = (cJSON**)malloc(index->size * sizeof(cJSON*));
+	if (!index->items) return 0;
+	for (c = index->container->child; c; c = c->next) index->items[i++] = c;
+	return 1;
+}
+
+static int cJSONIndex_build_table(cJSONIndex *index)
+{
+	unsigned size = 1, slot;
+	cJSON *c, *other;
+
+	while (size < (unsigned)index->size * 2) size <<= 1;
+	index->table = (cJSON**)calloc(size, sizeof(cJSON*));
+	if (!index->table) return 0;
+	index->table_mask = size - 1;
+	for (c = index->container->child; c; c = c->next)
+	{
+		for (slot = cJSONIndex_hash(c->string) & index->table_mask; (other = index->table[slot]) != 0; slot = (slot + 1) & index->table_mask)
+			if (!cJSONIndex_strcasecmp(other->string, c->string)) break;
+		/* The first of members with the same name is found, as by cJSON_GetObjectItem */
+		if (!other) index->table[slot] = c;
+	}
+	return 1;
+}
+
+cJSONIndex *cJSONIndex_Create(cJSON *container)
+{
+	cJSONIndex *index;
+
+	if (!container) return 0;
+	index = (cJSONIndex*)calloc(1, sizeof(cJSONIndex));
+	if (!index) return 0;
+	index->container = container;
+	index->size = cJSON_GetArraySize(container);
+	return index;
+}
+
+int cJSONIndex_GetSize(cJSONIndex *index)
+{
+	return index->size;
+}
+
+cJSON *cJSONIndex_GetArrayItem(cJSONIndex *index, int item)
+{
+	if (item < 0 || item >= index->size) return 0;
+	if (index->size < cJSONIndex_MIN_ITEMS || (!index->items && !cJSONIndex_build_items(index)))
+		return cJSON_GetArrayItem(index->container, item);
+	return index->items[item];
+}
+
+cJSON *cJSONIndex_GetObjectItem(cJSONIndex *index, const char *string)
+{
+	unsigned slot;
+	cJSON *c;
+
+	if (index->size < cJSONIndex_MIN_ITEMS || (!index->table && !cJSONIndex_build_table(index)))
+		return cJSON_GetObjectItem(index->container, string);
+	for (slot = cJSONIndex_hash(string) & index->table_mask; (c = index->table[slot]) != 0; slot = (slot + 1) & index->table_mask)
+		if (!cJSONIndex_strcasecmp(c->string, string)) return c;
+	return 0;
+}
+
+void cJSONIndex_Delete(cJSONIndex *index)
+{
+	if (!index) return;
+	free(index->items);
+	free(index->table);
+	free(index);
+}
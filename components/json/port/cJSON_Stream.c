@@ -0,0 +1,604 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include "cJSON_Stream.h"
+
+/* Parser states */
+enum {
+	ST_VALUE,		/* before a value */
+	ST_MEMBER,		/* before the name of an object member */
+	ST_COLON,		/* after the name of an object member */
+	ST_AFTER,		/* after a value in an array or object */
+	ST_STRING,		/* in a string, value or member name */
+	ST_NUMBER,
+	ST_LITERAL,		/* in true, false or null */
+	ST_DONE,		/* after the document */
+	ST_ERROR
+};
+
+/* Growing NUL terminated buffer */
+typedef struct {
+	char *data;
+	size_t len, size;
+} stream_buffer;
+
+struct cJSONStream {
+	cJSONStream_Handler handler;
+	void *arg;
+	int state;
+	int error;
+	size_t offset;					/* bytes parsed */
+
+	int depth;
+	char object[cJSONStream_MAX_DEPTH];	/* open container at each depth is an object */
+	int empty;						/* no value in the innermost container yet */
+
+	stream_buffer token;			/* string, number or literal being parsed */
+	stream_buffer name;				/* member name of the value being parsed */
+	int in_name;					/* the string is a member name */
+	int escape;						/* 0, 1 after a backslash, 2-5 in \uXXXX */
+	unsigned uc, uc_high;			/* \u escape and pending high surrogate */
+
+	/* Tree built without handler */
+	cJSON *root;
+	cJSON *node[cJSONStream_MAX_DEPTH];	/* open container at each depth */
+	cJSON *last[cJSONStream_MAX_DEPTH];	/* its last child */
+	cJSON scratch;					/* sets member names without walking the members */
+};
+
+static int buffer_put(stream_buffer *b, char c)
+{
+	char *data;
+	size_t size;
+
+	if (b->len + 1 >= b->size)
+	{
+		size = b->size ? b->size * 2 : 32;
+		data = (char*)realloc(b->data, size);
+		if (!data) return 0;
+		b->data = data;
+		b->size = size;
+	}
+	b->data[b->len++] = c;
+	b->data[b->len] = 0;
+	return 1;
+}
+
+static void buffer_reset(stream_buffer *b)
+{
+	b->len = 0;
+	if (b->data) b->data[0] = 0;
+}
+
+static const char *buffer_str(stream_buffer *b)
+{
+	return b->data ? b->data : "";
+}
+
+/* Add a node at depth to the tree */
+static int build_attach(cJSONStream *s, int depth, const char *name, cJSON *item)
+{
+	cJSON *parent;
+
+	if (!item) return 0;
+	if (depth == 0)
+	{
+		s->root = item;
+		return 1;
+	}
+	if (name)
+	{
+		/* cJSON_AddItemToObject copies the name with the cJSON hooks, on an
+		   empty object so it doesn't walk the members */
+		s->scratch.child = 0;
+		cJSON_AddItemToObject(&s->scratch, name, item);
+		s->scratch.child = 0;
+		if (!item->string) {cJSON_Delete(item); return 0;}
+	}
+	parent = s->node[depth - 1];
+	if (s->last[depth - 1]) {s->last[depth - 1]->next = item; item->prev = s->last[depth - 1];}
+	else parent->child = item;
+	s->last[depth - 1] = item;
+	return 1;
+}
+
+/* Handler building the tree */
+static int build_handler(void *arg, const cJSONStream_Token *t)
+{
+	cJSONStream *s = (cJSONStream*)arg;
+	cJSON *item = 0;
+
+	switch (t->event)
+	{
+		case cJSONStream_Null:			item = cJSON_CreateNull(); break;
+		case cJSONStream_False:			item = cJSON_CreateFalse(); break;
+		case cJSONStream_True:			item = cJSON_CreateTrue(); if (item) item->valueint = 1; break;
+		case cJSONStream_Number:		item = cJSON_CreateNumber(t->valuedouble); break;
+		case cJSONStream_String:		item = cJSON_CreateString(t->valuestring); break;
+		case cJSONStream_ArrayStart:	item = cJSON_CreateArray(); break;
+		case cJSONStream_ObjectStart:	item = cJSON_CreateObject(); break;
+		default:						return 0;	/* end of a container */
+	}
+	if (t->event == cJSONStream_String && item && !item->valuestring) {cJSON_Delete(item); item = 0;}
+	if (!build_attach(s, t->depth, t->name, item)) {s->error = cJSONStream_NoMemory; return 1;}
+	if (t->event == cJSONStream_ArrayStart || t->event == cJSONStream_ObjectStart)
+	{
+		s->node[t->depth] = item;
+		s->last[t->depth] = 0;
+	}
+	return 0;
+}
+
+static int fail(cJSONStream *s, int error)
+{
+	s->state = ST_ERROR;
+	s->error = error;
+	return error;
+}
+
+/* State after a complete value */
+static void value_done(cJSONStream *s)
+{
+	s->state = s->depth ? ST_AFTER : ST_DONE;
+}
+
+static int emit(cJSONStream *s, cJSONStream_Event event, const char *string, double number)
+{
+	cJSONStream_Token t;
+	int end = (event == cJSONStream_ArrayEnd || event == cJSONStream_ObjectEnd);
+
+	t.event = event;
+	t.depth = s->depth;
+	t.name = (!end && s->depth && s->object[s->depth - 1]) ? buffer_str(&s->name) : 0;
+	t.valuestring = string;
+	t.valuedouble = number;
+	s->error = 0;
+	if (s->handler(s->arg, &t)) return fail(s, s->error ? s->error : cJSONStream_Aborted);
+	return cJSONStream_Ok;
+}
+
+static int open_container(cJSONStream *s, int object)
+{
+	int err;
+
+	if (s->depth == cJSONStream_MAX_DEPTH) return fail(s, cJSONStream_TooDeep);
+	err = emit(s, object ? cJSONStream_ObjectStart : cJSONStream_ArrayStart, 0, 0);
+	if (err) return err;
+	s->object[s->depth++] = object;
+	s->empty = 1;
+	s->state = object ? ST_MEMBER : ST_VALUE;
+	return cJSONStream_Ok;
+}
+
+static int close_container(cJSONStream *s, char c)
+{
+	int object = (c == '}');
+	int err;
+
+	if (!s->depth || s->object[s->depth - 1] != object) return fail(s, cJSONStream_SyntaxError);
+	s->depth--;
+	err = emit(s, object ? cJSONStream_ObjectEnd : cJSONStream_ArrayEnd, 0, 0);
+	if (err) return err;
+	value_done(s);
+	return cJSONStream_Ok;
+}
+
+/* Append code point uc as UTF-8 to the string, as cJSON_Parse does */
+static int put_utf8(stream_buffer *b, unsigned uc)
+{
+	static const unsigned char first_byte_mark[5] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0 };
+	unsigned char out[4];
+	int len, i;
+
+	len = (uc < 0x80) ? 1 : (uc < 0x800) ? 2 : (uc < 0x10000) ? 3 : 4;
+	for (i = len - 1; i > 0; i--) {out[i] = (uc | 0x80) & 0xBF; uc >>= 6;}
+	out[0] = uc | first_byte_mark[len];
+	for (i = 0; i < len; i++) if (!buffer_put(b, out[i])) return 0;
+	return 1;
+}
+
+/* End of a \uXXXX escape */
+static int string_unicode(cJSONStream *s)
+{
+	unsigned uc = s->uc;
+
+	if (uc >= 0xD800 && uc <= 0xDBFF) {s->uc_high = uc; return 1;}
+	if (uc >= 0xDC00 && uc <= 0xDFFF)
+	{
+		/* A lone low surrogate is dropped, like cJSON_Parse does */
+		if (!s->uc_high) return 1;
+		uc = 0x10000 + (((s->uc_high & 0x3FF) << 10) | (uc & 0x3FF));
+	}
+	s->uc_high = 0;
+	if (uc == 0) return 1;
+	return put_utf8(&s->token, uc);
+}
+
+static int string_char(cJSONStream *s, char c)
+{
+	int h;
+	stream_buffer tmp;
+
+	if (s->escape >= 2)
+	{
+		if (c >= '0' && c <= '9') h = c - '0';
+		else if (c >= 'A' && c <= 'F') h = 10 + c - 'A';
+		else if (c >= 'a' && c <= 'f') h = 10 + c - 'a';
+		else return fail(s, cJSONStream_SyntaxError);
+		s->uc = (s->uc << 4) | h;
+		if (++s->escape == 6)
+		{
+			s->escape = 0;
+			if (!string_unicode(s)) return fail(s, cJSONStream_NoMemory);
+		}
+		return cJSONStream_Ok;
+	}
+	if (c == 0) return fail(s, cJSONStream_SyntaxError);
+	if (s->escape == 1)
+	{
+		s->escape = 0;
+		switch (c)
+		{
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			case 'u': s->escape = 2; s->uc = 0; return cJSONStream_Ok;
+			default: break;		/* \" \\ \/ and others stand for the character */
+		}
+	}
+	else if (c == '\\') {s->escape = 1; return cJSONStream_Ok;}
+	else if (c == '\"')
+	{
+		if (s->in_name)
+		{
+			/* Keep the name until the value is complete */
+			tmp = s->name; s->name = s->token; s->token = tmp;
+			buffer_reset(&s->token);
+			s->state = ST_COLON;
+			return cJSONStream_Ok;
+		}
+		h = emit(s, cJSONStream_String, buffer_str(&s->token), 0);
+		if (!h) value_done(s);
+		return h;
+	}
+	s->uc_high = 0;
+	if (!buffer_put(&s->token, c)) return fail(s, cJSONStream_NoMemory);
+	return cJSONStream_Ok;
+}
+
+static int end_number(cJSONStream *s)
+{
+	const char *str = buffer_str(&s->token);
+	char *end;
+	double n;
+	int err;
+
+	n = strtod(str, &end);
+	if (end == str || *end) return fail(s, cJSONStream_SyntaxError);
+	err = emit(s, cJSONStream_Number, 0, n);
+	if (!err) value_done(s);
+	return err;
+}
+
+static int end_literal(cJSONStream *s)
+{
+	const char *str = buffer_str(&s->token);
+	cJSONStream_Event event;
+	int err;
+
+	if (!strcmp(str, "null")) event = cJSONStream_Null;
+	else if (!strcmp(str, "false")) event = cJSONStream_False;
+	else if (!strcmp(str, "true")) event = cJSONStream_True;
+	else return fail(s, cJSONStream_SyntaxError);
+	err = emit(s, event, 0, 0);
+	if (!err) value_done(s);
+	return err;
+}
+
+static int start_token(cJSONStream *s, int state, char c)
+{
+	buffer_reset(&s->token);
+	s->state = state;
+	if (state == ST_STRING) {s->escape = 0; s->uc_high = 0; return cJSONStream_Ok;}
+	if (!buffer_put(&s->token, c)) return fail(s, cJSONStream_NoMemory);
+	return cJSONStream_Ok;
+}
+
+/* Parse one character */
+static int stream_char(cJSONStream *s, char c)
+{
+	int space = ((unsigned char)c <= 32);
+	int err;
+
+	switch (s->state)
+	{
+		case ST_STRING:
+			return string_char(s, c);
+
+		case ST_NUMBER:
+			if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+			{
+				if (!buffer_put(&s->token, c)) return fail(s, cJSONStream_NoMemory);
+				return cJSONStream_Ok;
+			}
+			err = end_number(s);
+			return err ? err : stream_char(s, c);
+
+		case ST_LITERAL:
+			if (c >= 'a' && c <= 'z' && s->token.len < 5)
+			{
+				if (!buffer_put(&s->token, c)) return fail(s, cJSONStream_NoMemory);
+				return cJSONStream_Ok;
+			}
+			err = end_literal(s);
+			return err ? err : stream_char(s, c);
+
+		case ST_VALUE:
+			if (space) return cJSONStream_Ok;
+			if (c == ']' && s->empty) return close_container(s, c);
+			s->empty = 0;
+			s->in_name = 0;
+			if (c == '{' || c == '[') return open_container(s, c == '{');
+			if (c == '\"') return start_token(s, ST_STRING, c);
+			if (c == '-' || (c >= '0' && c <= '9')) return start_token(s, ST_NUMBER, c);
+			if (c == 't' || c == 'f' || c == 'n') return start_token(s, ST_LITERAL, c);
+			return fail(s, cJSONStream_SyntaxError);
+
+		case ST_MEMBER:
+			if (space) return cJSONStream_Ok;
+			if (c == '}' && s->empty) return close_container(s, c);
+			if (c != '\"') return fail(s, cJSONStream_SyntaxError);
+			s->empty = 0;
+			s->in_name = 1;
+			return start_token(s, ST_STRING, c);
+
+		case ST_COLON:
+			if (space) return cJSONStream_Ok;
+			if (c != ':') return fail(s, cJSONStream_SyntaxError);
+			s->state = ST_VALUE;
+			return cJSONStream_Ok;
+
+		case ST_AFTER:
+			if (space) return cJSONStream_Ok;
+			if (c == ']' || c == '}') return close_container(s, c);
+			if (c != ',') return fail(s, cJSONStream_SyntaxError);
+			s->state = s->object[s->depth - 1] ? ST_MEMBER : ST_VALUE;
+			return cJSONStream_Ok;
+
+		case ST_DONE:
+			if (space) return cJSONStream_Ok;
+			return fail(s, cJSONStream_SyntaxError);
+
+		default:
+			return s->error;
+	}
+}
+
+cJSONStream *cJSONStream_New(cJSONStream_Handler handler, void *arg)
+{
+	cJSONStream *s = (cJSONStream*)calloc(1, sizeof(cJSONStream));
+
+	if (!s) return 0;
+	s->handler = handler ? handler : build_handler;
+	s->arg = handler ? arg : s;
+	s->state = ST_VALUE;
+	return s;
+}
+
+int cJSONStream_Feed(cJSONStream *s, const char *data, size_t len)
+{
+	int err;
+
+	if (s->state == ST_ERROR) return s->error;
+	while (len--)
+	{
+		err = stream_char(s, *data++);
+		if (err) return err;
+		s->offset++;
+	}
+	return cJSONStream_Ok;
+}
+
+int cJSONStream_Finish(cJSONStream *s)
+{
+	int err = cJSONStream_Ok;
+
+	if (s->state == ST_ERROR) return s->error;
+	if (s->state == ST_NUMBER) err = end_number(s);
+	else if (s->state == ST_LITERAL) err = end_literal(s);
+	if (err) return err;
+	if (s->state != ST_DONE) return fail(s, cJSONStream_Incomplete);
+	return cJSONStream_Ok;
+}
+
+cJSON *cJSONStream_DetachTree(cJSONStream *s)
+{
+	cJSON *root;
+
+	if (s->state != ST_DONE) return 0;
+	root = s->root;
+	s->root = 0;
+	return root;
+}
+
+size_t cJSONStream_GetErrorOffset(cJSONStream *s)
+{
+	return s->offset;
+}
+
+void cJSONStream_Delete(cJSONStream *s)
+{
+	if (!s) return;
+	cJSON_Delete(s->root);
+	free(s->token.data);
+	free(s->name.data);
+	free(s);
+}
+
+/* Printer */
+typedef struct {
+	char *buffer;
+	size_t size, used;
+	cJSONStream_Writer writer;
+	void *arg;
+	int error;
+} stream_printer;
+
+static void print_flush(stream_printer *p)
+{
+	if (p->used && !p->error && p->writer(p->arg, p->buffer, p->used)) p->error = cJSONStream_Aborted;
+	p->used = 0;
+}
+
+static void print_data(stream_printer *p, const char *data, size_t len)
+{
+	size_t n;
+
+	while (len && !p->error)
+	{
+		n = p->size - p->used;
+		if (n > len) n = len;
+		memcpy(p->buffer + p->used, data, n);
+		p->used += n;
+		data += n;
+		len -= n;
+		if (p->used == p->size) print_flush(p);
+	}
+}
+
+static void print_str(stream_printer *p, const char *str)
+{
+	print_data(p, str, strlen(str));
+}
+
+static void print_tabs(stream_printer *p, int count)
+{
+	while (count-- > 0) print_data(p, "\t", 1);
+}
+
+/* Same format as print_number of cJSON.c */
+static void print_number(stream_printer *p, cJSON *item)
+{
+	char str[64];
+	double d = item->valuedouble;
+
+	if (d == 0) strcpy(str, "0");
+	else if (fabs(((double)item->valueint) - d) <= DBL_EPSILON && d <= INT_MAX && d >= INT_MIN) sprintf(str, "%d", item->valueint);
+	else if (fabs(floor(d) - d) <= DBL_EPSILON && fabs(d) < 1.0e60) sprintf(str, "%.0f", d);
+	else if (fabs(d) < 1.0e-6 || fabs(d) > 1.0e9) sprintf(str, "%e", d);
+	else sprintf(str, "%f", d);
+	print_str(p, str);
+}
+
+/* Same escapes as print_string_ptr of cJSON.c */
+static void print_string(stream_printer *p, const char *str)
+{
+	const char *run;
+	char esc[8];
+	unsigned char c;
+
+	print_data(p, "\"", 1);
+	while (str && *str)
+	{
+		/* Characters without escape in one go */
+		for (run = str; (unsigned char)*str > 31 && *str != '\"' && *str != '\\'; str++) {}
+		print_data(p, run, str - run);
+		if (!*str) break;
+		c = (unsigned char)*str++;
+		esc[0] = '\\';
+		esc[2] = 0;
+		switch (c)
+		{
+			case '\\':	esc[1] = '\\'; break;
+			case '\"':	esc[1] = '\"'; break;
+			case '\b':	esc[1] = 'b'; break;
+			case '\f':	esc[1] = 'f'; break;
+			case '\n':	esc[1] = 'n'; break;
+			case '\r':	esc[1] = 'r'; break;
+			case '\t':	esc[1] = 't'; break;
+			default:	sprintf(esc + 1, "u%04x", c); break;
+		}
+		print_str(p, esc);
+	}
+	print_data(p, "\"", 1);
+}
+
+/* Same layout as print_value of cJSON.c */
+static void print_value(stream_printer *p, cJSON *item, int depth, int fmt)
+{
+	cJSON *child;
+
+	switch (item->type & 255)
+	{
+		case cJSON_NULL:	print_str(p, "null"); break;
+		case cJSON_False:	print_str(p, "false"); break;
+		case cJSON_True:	print_str(p, "true"); break;
+		case cJSON_Number:	print_number(p, item); break;
+		case cJSON_String:	print_string(p, item->valuestring); break;
+		case cJSON_Array:
+			print_data(p, "[", 1);
+			for (child = item->child; child && !p->error; child = child->next)
+			{
+				print_value(p, child, depth + 1, fmt);
+				if (child->next) print_str(p, fmt ? ", " : ",");
+			}
+			print_data(p, "]", 1);
+			break;
+		case cJSON_Object:
+			print_data(p, "{", 1);
+			if (!item->child)
+			{
+				if (fmt) {print_data(p, "\n", 1); print_tabs(p, depth - 1);}
+				print_data(p, "}", 1);
+				break;
+			}
+			if (fmt) print_data(p, "\n", 1);
+			for (child = item->child; child && !p->error; child = child->next)
+			{
+				if (fmt) print_tabs(p, depth + 1);
+				print_string(p, child->string);
+				print_str(p, fmt ? ":\t" : ":");
+				print_value(p, child, depth + 1, fmt);
+				if (child->next) print_data(p, ",", 1);
+				if (fmt) print_data(p, "\n", 1);
+			}
+			if (fmt) print_tabs(p, depth);
+			print_data(p, "}", 1);
+			break;
+	}
+}
+
+int cJSONStream_Print(cJSON *item, int fmt, char *buffer, size_t size, cJSONStream_Writer writer, void *arg)
+{
+	stream_printer p;
+
+	if (!item || !buffer || !size) return cJSONStream_Aborted;
+	p.buffer = buffer;
+	p.size = size;
+	p.used = 0;
+	p.writer = writer;
+	p.arg = arg;
+	p.error = 0;
+	print_value(&p, item, 0, fmt);
+	print_flush(&p);
+	return p.error;
+}
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "cJSON_Utils.h"
+#include "cJSON_Index.h"
 
 static int cJSONUtils_strcasecmp(const char *s1,const char *s2)
 {
@@ -38,7 +39,7 @@ static void cJSONUtils_PointerEncodedstrcpy(char *d,const char *s)
 
 char *cJSONUtils_FindPointerFromObjectTo(cJSON *object,cJSON *target)
 {
-	int type=object->type,c=0;cJSON *obj=0;
+	int type=object->type&255,c=0;cJSON *obj=0;
 
 	if (object==target) return strdup("");
 
@@ -73,13 +74,13 @@ cJSON *cJSONUtils_GetPointer(cJSON *object,const char *pointer)
 {
 	while (*pointer++=='/' && object)
 	{
-		if (object->type==cJSON_Array)
+		if ((object->type&255)==cJSON_Array)
 		{
 			int which=0; while (*pointer>='0' && *pointer<='9') which=(10*which) + *pointer++ - '0';
 			if (*pointer && *pointer!='/') return 0;
 			object=cJSON_GetArrayItem(object,which);
 		}
-		else if (object->type==cJSON_Object)
+		else if ((object->type&255)==cJSON_Object)
 		{
 			object=object->child;	while (object && cJSONUtils_Pstrcasecmp(object->string,pointer)) object=object->next;	/* GetObjectItem. */
 			while (*pointer && *pointer!='/') pointer++;
@@ -106,33 +107,66 @@ static cJSON *cJSONUtils_PatchDetach(cJSON *object,const char *path)
 	cJSONUtils_InplaceDecodePointerString(childptr);
 
 	if (!parent) ret=0;	/* Couldn't find object to remove child from. */
-	else if (parent->type==cJSON_Array)		ret=cJSON_DetachItemFromArray(parent,atoi(childptr));
-	else if (parent->type==cJSON_Object)	ret=cJSON_DetachItemFromObject(parent,childptr);
+	else if ((parent->type&255)==cJSON_Array)	ret=cJSON_DetachItemFromArray(parent,atoi(childptr));
+	else if ((parent->type&255)==cJSON_Object)	ret=cJSON_DetachItemFromObject(parent,childptr);
 	free(parentptr);
 	return ret;
 }
 
+/* Member lookup by name: through a hash index for large objects, walking the list for small ones. */
+static cJSONIndex *cJSONUtils_Index(cJSON *object)	{return (cJSON_GetArraySize(object)>=cJSONIndex_MIN_ITEMS)?cJSONIndex_Create(object):0;}
+static cJSON *cJSONUtils_Member(cJSONIndex *index,cJSON *object,const char *name)	{return index?cJSONIndex_GetObjectItem(index,name):cJSON_GetObjectItem(object,name);}
+
+/* Put item in the place of old among the children of parent, old is detached. */
+static void cJSONUtils_ReplaceChild(cJSON *parent,cJSON *old,cJSON *item)
+{
+	item->next=old->next;item->prev=old->prev;
+	if (item->next) item->next->prev=item;
+	if (parent->child==old) parent->child=item; else item->prev->next=item;
+	old->next=old->prev=0;
+}
+
+/* Give item a copy of name with the cJSON hooks, without walking the members of an object. */
+static int cJSONUtils_SetName(cJSON *item,const char *name)
+{
+	cJSON scratch;
+	memset(&scratch,0,sizeof(scratch));
+	cJSON_AddItemToObject(&scratch,name,item);
+	return item->string!=0;
+}
+
+/* Add item named name after last, the last member of object. */
+static void cJSONUtils_Append(cJSON *object,cJSON **last,const char *name,cJSON *item)
+{
+	if (!item) return;
+	if (!cJSONUtils_SetName(item,name)) {cJSON_Delete(item);return;}
+	if (*last) {(*last)->next=item;item->prev=*last;} else object->child=item;
+	*last=item;
+}
+
 static int cJSONUtils_Compare(cJSON *a,cJSON *b)
 {
-	if (a->type!=b->type)	return -1;	/* mismatched type. */
-	switch (a->type)
+	if ((a->type&255)!=(b->type&255))	return -1;	/* mismatched type. */
+	switch (a->type&255)
 	{
 	case cJSON_Number:	return (a->valueint!=b->valueint || a->valuedouble!=b->valuedouble)?-2:0;	/* numeric mismatch. */
 	case cJSON_String:	return (strcmp(a->valuestring,b->valuestring)!=0)?-3:0;						/* string mismatch. */
 	case cJSON_Array:	for (a=a->child,b=b->child;a && b;a=a->next,b=b->next)	{int err=cJSONUtils_Compare(a,b);if (err) return err;}
 						return (a || b)?-4:0;	/* array size mismatch. */
 	case cJSON_Object:
-						cJSONUtils_SortObject(a);
-						cJSONUtils_SortObject(b);
-						a=a->child,b=b->child;
-						while (a && b)
+	{
+						/* Members are matched by name, the objects are left in their order. */
+						cJSONIndex *index;cJSON *object=b,*m;int err=0;
+						if (cJSON_GetArraySize(a)!=cJSON_GetArraySize(b)) return -5;	/* object length mismatch */
+						index=cJSONUtils_Index(b);
+						for (a=a->child;a && !err;a=a->next)
 						{
-							int err;
-							if (cJSONUtils_strcasecmp(a->string,b->string))	return -6;	/* missing member */
-							err=cJSONUtils_Compare(a,b);if (err) return err;
-							a=a->next,b=b->next;
+							m=cJSONUtils_Member(index,object,a->string);
+							err=m?cJSONUtils_Compare(a,m):-6;	/* missing member */
 						}
-						return (a || b)?-5:0;	/* object length mismatch */
+						cJSONIndex_Delete(index);
+						return err;
+	}
 
 	default:			break;
 	}
@@ -155,10 +189,10 @@ static int cJSONUtils_ApplyPatch(cJSON *object,cJSON *patch)
 	else if (!strcmp(op->valuestring,"test"))	return cJSONUtils_Compare(cJSONUtils_GetPointer(object,path->valuestring),cJSON_GetObjectItem(patch,"value"));
 	else return 3; /* unknown opcode. */
 
-	if (opcode==1 || opcode==2)	/* Remove/Replace */
+	if (opcode==1)	/* Remove */
 	{
 		cJSON_Delete(cJSONUtils_PatchDetach(object,path->valuestring));	/* Get rid of old. */
-		if (opcode==1) return 0;	/* For Remove, this is job done. */
+		return 0;
 	}
 
 	if (opcode==3 || opcode==4)	/* Copy/Move uses "from". */
@@ -183,16 +217,26 @@ static int cJSONUtils_ApplyPatch(cJSON *object,cJSON *patch)
 
 	parentptr=strdup(path->valuestring);	childptr=strrchr(parentptr,'/');	if (childptr) *childptr++=0;
 	parent=cJSONUtils_GetPointer(object,parentptr);
-	cJSONUtils_InplaceDecodePointerString(childptr);
+	if (childptr) cJSONUtils_InplaceDecodePointerString(childptr);
 
 	/* add, remove, replace, move, copy, test. */
-	if (!parent) {free(parentptr); cJSON_Delete(value); return 9;}	/* Couldn't find object to add to. */
-	else if (parent->type==cJSON_Array)
+	if (!parent || !childptr) {free(parentptr); cJSON_Delete(value); return 9;}	/* Couldn't find object to add to. */
+	else if (opcode==2)
+	{
+		/* Replace in place, the path is resolved once and the member keeps its position. */
+		cJSON *old=((parent->type&255)==cJSON_Array)?cJSON_GetArrayItem(parent,atoi(childptr)):
+				   ((parent->type&255)==cJSON_Object)?cJSON_GetObjectItem(parent,childptr):0;
+		if (old && (parent->type&255)==cJSON_Object && !cJSONUtils_SetName(value,old->string)) old=0;
+		if (!old) {free(parentptr); cJSON_Delete(value); return 9;}
+		cJSONUtils_ReplaceChild(parent,old,value);
+		cJSON_Delete(old);
+	}
+	else if ((parent->type&255)==cJSON_Array)
 	{
 		if (!strcmp(childptr,"-"))	cJSON_AddItemToArray(parent,value);
 		else						cJSON_InsertItemInArray(parent,atoi(childptr),value);
 	}
-	else if (parent->type==cJSON_Object)
+	else if ((parent->type&255)==cJSON_Object)
 	{
 		cJSON_DeleteItemFromObject(parent,childptr);
 		cJSON_AddItemToObject(parent,childptr,value);
@@ -209,8 +253,8 @@ static int cJSONUtils_ApplyPatch(cJSON *object,cJSON *patch)
 int cJSONUtils_ApplyPatches(cJSON *object,cJSON *patches)
 {
 	int err;
-	if (patches->type!=cJSON_Array) return 1;	/* malformed patches. */
-	if (patches) patches=patches->child;
+	if (!patches || (patches->type&255)!=cJSON_Array) return 1;	/* malformed patches. */
+	patches=patches->child;
 	while (patches)
 	{
 		if ((err=cJSONUtils_ApplyPatch(object,patches))) return err;
@@ -237,56 +281,76 @@ static void cJSONUtils_GeneratePatch(cJSON *patches,const char *op,const char *p
 
 void cJSONUtils_AddPatchToArray(cJSON *array,const char *op,const char *path,cJSON *val)	{cJSONUtils_GeneratePatch(array,op,path,0,val);}
 
-static void cJSONUtils_CompareToPatch(cJSON *patches,const char *path,cJSON *from,cJSON *to)
+/* Path of the value being compared, grown for nested values instead of one allocation per member. */
+typedef struct {char *buf;size_t len,size;int fail;} cJSONUtils_Path;
+
+/* Append "/" and the encoded name, or the index if name is 0. Returns the length to truncate back to. */
+static size_t cJSONUtils_PathPush(cJSONUtils_Path *p,const char *name,int index)
+{
+	size_t len=p->len,need=len+(name?cJSONUtils_PointerEncodedstrlen(name):20)+2;
+	char *buf;
+	if (need>p->size)
+	{
+		buf=(char*)realloc(p->buf,need*2);
+		if (!buf) {p->fail=1;return len;}
+		p->buf=buf;p->size=need*2;
+	}
+	p->buf[len]='/';
+	if (name) cJSONUtils_PointerEncodedstrcpy(p->buf+len+1,name);
+	else sprintf(p->buf+len+1,"%d",index);
+	p->len+=strlen(p->buf+len);
+	return len;
+}
+
+static void cJSONUtils_PathPop(cJSONUtils_Path *p,size_t len)	{p->len=len;p->buf[len]=0;}
+
+static void cJSONUtils_CompareToPatch(cJSON *patches,cJSONUtils_Path *path,cJSON *from,cJSON *to)
 {
-	if (from->type!=to->type)	{cJSONUtils_GeneratePatch(patches,"replace",path,0,to);	return;	}
+	size_t len;
+	if (path->fail) return;
+	if ((from->type&255)!=(to->type&255))	{cJSONUtils_GeneratePatch(patches,"replace",path->buf,0,to);	return;	}
 	
-	switch (from->type)
+	switch (from->type&255)
 	{
 	case cJSON_Number:	
 		if (from->valueint!=to->valueint || from->valuedouble!=to->valuedouble)
-			cJSONUtils_GeneratePatch(patches,"replace",path,0,to);
+			cJSONUtils_GeneratePatch(patches,"replace",path->buf,0,to);
 		return;
 						
 	case cJSON_String:	
 		if (strcmp(from->valuestring,to->valuestring)!=0)
-			cJSONUtils_GeneratePatch(patches,"replace",path,0,to);
+			cJSONUtils_GeneratePatch(patches,"replace",path->buf,0,to);
 		return;
 
 	case cJSON_Array:
 	{
-		int c;char *newpath=(char*)malloc(strlen(path)+23);	/* Allow space for 64bit int. */
-		for (c=0,from=from->child,to=to->child;from && to;from=from->next,to=to->next,c++){
-										sprintf(newpath,"%s/%d",path,c);	cJSONUtils_CompareToPatch(patches,newpath,from,to);
+		int c,n;char index[24];
+		for (c=0,from=from->child,to=to->child;from && to;from=from->next,to=to->next,c++)
+		{
+			len=cJSONUtils_PathPush(path,0,c);	cJSONUtils_CompareToPatch(patches,path,from,to);	cJSONUtils_PathPop(path,len);
 		}
-		for (;from;from=from->next,c++)	{sprintf(newpath,"%d",c);	cJSONUtils_GeneratePatch(patches,"remove",path,newpath,0);	}
-		for (;to;to=to->next,c++)		cJSONUtils_GeneratePatch(patches,"add",path,"-",to);
-		free(newpath);
+		/* Remove surplus items from the last, so that the indexes of the others don't move. */
+		for (n=0;from;from=from->next) n++;
+		while (n-- > 0)					{sprintf(index,"%d",c+n);	cJSONUtils_GeneratePatch(patches,"remove",path->buf,index,0);	}
+		for (;to;to=to->next,c++)		cJSONUtils_GeneratePatch(patches,"add",path->buf,"-",to);
 		return;
 	}
 
 	case cJSON_Object:
 	{
+		/* Members are matched by name through hash indexes of large objects, the objects are not reordered. */
+		cJSONIndex *from_index=cJSONUtils_Index(from),*to_index=cJSONUtils_Index(to);
 		cJSON *a,*b;
-		cJSONUtils_SortObject(from);
-		cJSONUtils_SortObject(to);
-		
-		a=from->child,b=to->child;
-		while (a || b)
+		for (a=from->child;a;a=a->next)
 		{
-			int diff=(!a)?1:(!b)?-1:cJSONUtils_strcasecmp(a->string,b->string);
-			if (!diff)
-			{
-				char *newpath=(char*)malloc(strlen(path)+cJSONUtils_PointerEncodedstrlen(a->string)+2);
-				cJSONUtils_PointerEncodedstrcpy(newpath+sprintf(newpath,"%s/",path),a->string);
-				cJSONUtils_CompareToPatch(patches,newpath,a,b);
-				free(newpath);
-				a=a->next;
-				b=b->next;
-			}
-			else if (diff<0)	{cJSONUtils_GeneratePatch(patches,"remove",path,a->string,0);	a=a->next;}
-			else				{cJSONUtils_GeneratePatch(patches,"add",path,b->string,b);		b=b->next;}
+			b=cJSONUtils_Member(to_index,to,a->string);
+			if (!b)	{cJSONUtils_GeneratePatch(patches,"remove",path->buf,a->string,0);	continue;}
+			len=cJSONUtils_PathPush(path,a->string,0);	cJSONUtils_CompareToPatch(patches,path,a,b);	cJSONUtils_PathPop(path,len);
 		}
+		for (b=to->child;b;b=b->next)
+			if (!cJSONUtils_Member(from_index,from,b->string))	cJSONUtils_GeneratePatch(patches,"add",path->buf,b->string,b);
+		cJSONIndex_Delete(from_index);
+		cJSONIndex_Delete(to_index);
 		return;
 	}
 
@@ -298,7 +362,12 @@ static void cJSONUtils_CompareToPatch(cJSON *patches,const char *path,cJSON *fro
 cJSON* cJSONUtils_GeneratePatches(cJSON *from,cJSON *to)
 {
 	cJSON *patches=cJSON_CreateArray();	
-	cJSONUtils_CompareToPatch(patches,"",from,to);
+	cJSONUtils_Path path={0,0,0,0};
+	if (!patches) return 0;
+	cJSONUtils_PathPush(&path,"",0);cJSONUtils_PathPop(&path,0);	/* empty path of the root */
+	if (!path.fail) cJSONUtils_CompareToPatch(patches,&path,from,to);
+	free(path.buf);
+	if (path.fail) {cJSON_Delete(patches);return 0;}
 	return patches;
 }
 
@@ -343,53 +412,85 @@ static cJSON *cJSONUtils_SortList(cJSON *list)
 
 void cJSONUtils_SortObject(cJSON *object)	{object->child=cJSONUtils_SortList(object->child);}
 
-cJSON* cJSONUtils_MergePatch(cJSON *target, cJSON *patch)
+/* Merge patch into the members of target in place: members keep their position, only changed
+   values are copied from the patch, and members are found through a hash index for large targets. */
+static void cJSONUtils_MergeMembers(cJSON *target,cJSON *patch,cJSON **removed)
 {
-	if (!patch || patch->type != cJSON_Object) {cJSON_Delete(target);return cJSON_Duplicate(patch,1);}
-	if (!target || target->type != cJSON_Object) {cJSON_Delete(target);target=cJSON_CreateObject();}
+	cJSONIndex *index=cJSONUtils_Index(target);
+	cJSON *last=target->child,*old,*item;
 
-	patch=patch->child;
-	while (patch)
+	while (last && last->next) last=last->next;
+	for (patch=patch->child;patch;patch=patch->next)
 	{
-		if (patch->type == cJSON_NULL) cJSON_DeleteItemFromObject(target,patch->string);
+		old=cJSONUtils_Member(index,target,patch->string);
+		if (old && old->prev==old) old=0;	/* removed for an earlier member of the same name */
+		if ((patch->type&255)==cJSON_NULL)
+		{
+			if (!old) continue;
+			if (old==last) last=old->prev;
+			if (target->child==old) target->child=old->next;
+			if (old->prev) old->prev->next=old->next;
+			if (old->next) old->next->prev=old->prev;
+			/* Freed at the end: the index may still return it for a repeated name */
+			old->prev=old;old->next=*removed;*removed=old;
+		}
+		else if (old && (old->type&255)==cJSON_Object && (patch->type&255)==cJSON_Object)
+			cJSONUtils_MergeMembers(old,patch,removed);
 		else
 		{
-			cJSON *replaceme=cJSON_DetachItemFromObject(target,patch->string);
-			cJSON_AddItemToObject(target,patch->string,cJSONUtils_MergePatch(replaceme,patch));
+			item=cJSONUtils_MergePatch(0,patch);
+			if (!item) continue;
+			if (!cJSONUtils_SetName(item,patch->string)) {cJSON_Delete(item);continue;}
+			if (old)
+			{
+				cJSONUtils_ReplaceChild(target,old,item);
+				if (old==last) last=item;
+				old->prev=old;old->next=*removed;*removed=old;
+			}
+			else
+			{
+				if (last) {last->next=item;item->prev=last;} else target->child=item;
+				last=item;
+			}
 		}
-		patch=patch->next;
 	}
+	cJSONIndex_Delete(index);
+}
+
+cJSON* cJSONUtils_MergePatch(cJSON *target, cJSON *patch)
+{
+	cJSON *removed=0;
+	if (!patch || (patch->type&255) != cJSON_Object) {cJSON_Delete(target);return cJSON_Duplicate(patch,1);}
+	if (!target || (target->type&255) != cJSON_Object) {cJSON_Delete(target);target=cJSON_CreateObject();}
+	if (!target) return 0;
+
+	cJSONUtils_MergeMembers(target,patch,&removed);
+	cJSON_Delete(removed);
 	return target;
 }
 
 cJSON *cJSONUtils_GenerateMergePatch(cJSON *from,cJSON *to)
 {
-	cJSON *patch=0;
+	cJSONIndex *from_index,*to_index;
+	cJSON *patch=0,*last=0,*a,*b,*item;
 	if (!to) return cJSON_CreateNull();
-	if (to->type!=cJSON_Object || !from || from->type!=cJSON_Object) return cJSON_Duplicate(to,1);
-	cJSONUtils_SortObject(from);
-	cJSONUtils_SortObject(to);
-	from=from->child;to=to->child;
+	if ((to->type&255)!=cJSON_Object || !from || (from->type&255)!=cJSON_Object) return cJSON_Duplicate(to,1);
 	patch=cJSON_CreateObject();
-	while (from || to)
+	if (!patch) return 0;
+	from_index=cJSONUtils_Index(from);
+	to_index=cJSONUtils_Index(to);
+	for (a=from->child;a;a=a->next)
+		if (!cJSONUtils_Member(to_index,to,a->string)) cJSONUtils_Append(patch,&last,a->string,cJSON_CreateNull());
+	for (b=to->child;b;b=b->next)
 	{
-		int compare=from?(to?strcmp(from->string,to->string):-1):1;
-		if (compare<0)
-		{
-			cJSON_AddItemToObject(patch,from->string,cJSON_CreateNull());
-			from=from->next;
-		}
-		else if (compare>0)
-		{
-			cJSON_AddItemToObject(patch,to->string,cJSON_Duplicate(to,1));
-			to=to->next;
-		}
-		else
-		{
-			if (cJSONUtils_Compare(from,to)) cJSON_AddItemToObject(patch,to->string,cJSONUtils_GenerateMergePatch(from,to));
-			from=from->next;to=to->next;
-		}
+		a=cJSONUtils_Member(from_index,from,b->string);
+		if (!a)	item=cJSON_Duplicate(b,1);
+		else if ((a->type&255)==cJSON_Object && (b->type&255)==cJSON_Object) item=cJSONUtils_GenerateMergePatch(a,b);	/* 0 if equal */
+		else item=cJSONUtils_Compare(a,b)?cJSON_Duplicate(b,1):0;
+		cJSONUtils_Append(patch,&last,b->string,item);
 	}
+	cJSONIndex_Delete(from_index);
+	cJSONIndex_Delete(to_index);
 	if (!patch->child) {cJSON_Delete(patch);return 0;}
 	return patch;
-}
\ No newline at end of file
+}
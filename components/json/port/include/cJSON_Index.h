@@ -0,0 +1,59 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Index of the items of a cJSON array or object.
+
+   cJSON_GetObjectItem, cJSON_GetArrayItem and cJSON_GetArraySize walk the
+   list of children, which makes processing all members of a large object
+   quadratic. An index built once for a container finds members by name
+   through a hash table and items by position through a vector. Both are
+   built at their first use, and not at all for containers with fewer than
+   cJSONIndex_MIN_ITEMS children: lookups in those walk the list as before.
+
+   The index doesn't follow changes: create it again after adding,
+   removing or renaming children of the container. */
+
+#ifndef cJSON_Index__h
+#define cJSON_Index__h
+
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Containers with fewer children are looked up without tables */
+#ifndef cJSONIndex_MIN_ITEMS
+#define cJSONIndex_MIN_ITEMS 16
+#endif
+
+typedef struct cJSONIndex cJSONIndex;
+
+/* Create an index of the children of array or object. Returns NULL if out of memory. */
+extern cJSONIndex *cJSONIndex_Create(cJSON *container);
+/* Number of children, like cJSON_GetArraySize. */
+extern int cJSONIndex_GetSize(cJSONIndex *index);
+/* Child number item, like cJSON_GetArrayItem. */
+extern cJSON *cJSONIndex_GetArrayItem(cJSONIndex *index, int item);
+/* First member named string, case insensitive, like cJSON_GetObjectItem. */
+extern cJSON *cJSONIndex_GetObjectItem(cJSONIndex *index, const char *string);
+/* Free the index, the container is left as it is. */
+extern void cJSONIndex_Delete(cJSONIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
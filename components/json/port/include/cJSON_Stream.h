@@ -0,0 +1,108 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Incremental (push) parser and printer for cJSON.
+
+   The document is fed in chunks of any size, as they arrive from a socket or
+   a file, and is never held in full. Each value produces an event for the
+   handler as soon as it is complete. Without a handler, the events build a
+   cJSON tree like cJSON_Parse does, so only the tree and the value being
+   parsed are held in memory. Unlike cJSON_Parse, anything but whitespace
+   after the document is an error. */
+
+#ifndef cJSON_Stream__h
+#define cJSON_Stream__h
+
+#include <stddef.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Deepest nesting of arrays and objects accepted */
+#ifndef cJSONStream_MAX_DEPTH
+#define cJSONStream_MAX_DEPTH 32
+#endif
+
+/* Results of cJSONStream_Feed and cJSONStream_Finish */
+#define cJSONStream_Ok				0
+#define cJSONStream_SyntaxError		(-1)	/* invalid JSON, see cJSONStream_GetErrorOffset */
+#define cJSONStream_NoMemory		(-2)
+#define cJSONStream_TooDeep			(-3)	/* nested deeper than cJSONStream_MAX_DEPTH */
+#define cJSONStream_Aborted			(-4)	/* the handler returned non-zero */
+#define cJSONStream_Incomplete		(-5)	/* cJSONStream_Finish before the end of the document */
+
+/* Events, in document order: a value of one of the cJSON types, or the start
+   or end of an array or object. */
+typedef enum {
+	cJSONStream_Null,
+	cJSONStream_False,
+	cJSONStream_True,
+	cJSONStream_Number,
+	cJSONStream_String,
+	cJSONStream_ArrayStart,
+	cJSONStream_ArrayEnd,
+	cJSONStream_ObjectStart,
+	cJSONStream_ObjectEnd
+} cJSONStream_Event;
+
+typedef struct {
+	cJSONStream_Event event;
+	int depth;					/* number of arrays and objects the value is in */
+	const char *name;			/* member name for values in objects, else NULL, also NULL for end events */
+	const char *valuestring;	/* string for cJSONStream_String */
+	double valuedouble;			/* number for cJSONStream_Number */
+} cJSONStream_Token;
+
+/* Called for every event, the strings of token are only valid during the
+   call. Return 0 to go on, anything else stops the parser. */
+typedef int (*cJSONStream_Handler)(void *arg, const cJSONStream_Token *token);
+
+typedef struct cJSONStream cJSONStream;
+
+/* Create a parser calling handler for every event, or building a cJSON tree
+   if handler is NULL. Returns NULL if out of memory. */
+extern cJSONStream *cJSONStream_New(cJSONStream_Handler handler, void *arg);
+/* Parse the next len bytes of the document. Returns cJSONStream_Ok or the
+   first error, the parser refuses further input after an error. */
+extern int cJSONStream_Feed(cJSONStream *stream, const char *data, size_t len);
+/* End of input: completes a number or literal at the end of the document
+   and checks that the document is complete. */
+extern int cJSONStream_Finish(cJSONStream *stream);
+/* Take the tree built without handler after cJSONStream_Finish returned
+   cJSONStream_Ok. The caller owns it and frees it with cJSON_Delete. */
+extern cJSON *cJSONStream_DetachTree(cJSONStream *stream);
+/* Number of bytes parsed before the first error. */
+extern size_t cJSONStream_GetErrorOffset(cJSONStream *stream);
+/* Free the parser and a tree not detached. */
+extern void cJSONStream_Delete(cJSONStream *stream);
+
+/* Called with each chunk of printed text. Return 0 to go on, anything else
+   stops printing. */
+typedef int (*cJSONStream_Writer)(void *arg, const char *data, size_t len);
+
+/* Print item as cJSON_Print (fmt=1) or cJSON_PrintUnformatted (fmt=0) do,
+   through buffer: writer is called each time size bytes are ready, and once
+   with the rest at the end. Uses no memory beside buffer, whatever the size of
+   the document. Returns cJSONStream_Ok, or cJSONStream_Aborted if writer
+   failed. */
+extern int cJSONStream_Print(cJSON *item, int fmt, char *buffer, size_t size, cJSONStream_Writer writer, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef PARSER_BENCH_H
+#define PARSER_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Benchmark of the cJSON and Expat parsers, for the host (see bench/) and
+ * for the target.
+ *
+ * Each test runs over four generated corpora: a configuration document, an
+ * array of telemetry samples, deeply nested containers and large strings
+ * with escapes, in JSON and in XML. It measures throughput, allocations per
+ * document and the peak of memory allocated by the parser, counted through
+ * cJSON_InitHooks and an Expat memory suite. Cycles per byte are derived
+ * from the CPU frequency on the target, and from the TSC on x86 hosts.
+ *
+ * Results can be compared against a baseline with parser_bench_check, for
+ * use as a regression gate.
+ */
+
+typedef enum {
+    PARSER_BENCH_JSON_PARSE     = 1 << 0,   /*!< cJSON_Parse and cJSON_Delete */
+    PARSER_BENCH_JSON_ARENA     = 1 << 1,   /*!< cJSON_ParseArena and cJSON_Delete */
+    PARSER_BENCH_JSON_IN_PLACE  = 1 << 2,   /*!< copy of the text, cJSON_ParseInPlace and cJSON_Delete */
+    PARSER_BENCH_JSON_PRINT     = 1 << 3,   /*!< cJSON_PrintUnformatted of a parsed document */
+    PARSER_BENCH_XML_PARSE      = 1 << 4,   /*!< XML_ParserCreate_MM, XML_Parse and XML_ParserFree */
+    PARSER_BENCH_XML_REUSE      = 1 << 5,   /*!< XML_Parse with one parser, reset by XML_ParserReuse */
+    PARSER_BENCH_ALL            = 0x3f,
+} parser_bench_test_t;
+
+typedef struct {
+    uint32_t tests;         /*!< PARSER_BENCH_xxx to run, 0 for all */
+    uint32_t min_time_ms;   /*!< Each test repeats for at least this long, 0 for 200 ms */
+} parser_bench_cfg_t;
+
+#define PARSER_BENCH_NAME_LEN   32
+
+typedef struct {
+    char name[PARSER_BENCH_NAME_LEN];   /*!< "<test>/<corpus>" */
+    uint32_t size;                      /*!< Bytes parsed or printed per document */
+    uint32_t kbytes_per_s;              /*!< Throughput, in units of 1000 bytes per second */
+    uint32_t allocs;                    /*!< Allocations per document */
+    uint32_t peak_bytes;                /*!< Most memory allocated at one time, beyond what the test keeps between documents */
+    uint32_t cycles_per_byte_x10;       /*!< Tenths of CPU cycles per byte, 0 if unknown */
+} parser_bench_result_t;
+
+/* Upper bound of the number of results of parser_bench_run */
+#define PARSER_BENCH_MAX_RESULTS    24
+
+/**
+ * @brief Run the benchmark
+ *
+ * @param cfg     tests to run, NULL for all with the default duration
+ * @param results array of PARSER_BENCH_MAX_RESULTS entries for the results
+ * @param count   returns the number of results
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if a corpus can't be generated, or
+ *         ESP_FAIL if a document doesn't parse or prints differently
+ */
+esp_err_t parser_bench_run(const parser_bench_cfg_t *cfg, parser_bench_result_t *results, size_t *count);
+
+/**
+ * @brief Print results as a table, in the format read by parser_bench_parse_line
+ */
+void parser_bench_print(const parser_bench_result_t *results, size_t count);
+
+/**
+ * @brief Read one line of the table printed by parser_bench_print
+ *
+ * @return true if the line holds a result, false for the header and other lines
+ */
+bool parser_bench_parse_line(const char *line, parser_bench_result_t *result);
+
+/**
+ * @brief Compare results against a baseline and print the regressions
+ *
+ * A result regresses if its throughput is lower than the baseline by more
+ * than tolerance_pct percent, or if it makes more allocations per document
+ * or has a higher peak than the baseline. Allocations and peak memory don't
+ * depend on the machine or its load, so with a tolerance_pct of 100 only
+ * they are checked, which suits build machines shared with other jobs.
+ * Results without a baseline entry of the same name are not checked.
+ *
+ * @return ESP_OK, or ESP_FAIL if a result regresses
+ */
+esp_err_t parser_bench_check(const parser_bench_result_t *results, size_t count,
+                             const parser_bench_result_t *baseline, size_t baseline_count,
+                             unsigned tolerance_pct);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARSER_BENCH_H */
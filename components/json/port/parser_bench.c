@@ -0,0 +1,565 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "expat.h"
+#include "parser_bench.h"
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_timer.h"
+
+static int64_t now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+/* Cycles from time: CCOUNT differs between the CPUs, and the task may move */
+#define CYCLES(us, tsc)     ((uint64_t) (us) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ + 0 * (tsc))
+#define READ_TSC()          0
+#else
+#include <time.h>
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_TSC()          __rdtsc()
+#define CYCLES(us, tsc)     (tsc)
+#else
+#define READ_TSC()          0
+#define CYCLES(us, tsc)     (0 * (tsc))
+#endif
+#endif
+
+/*
+ * Counting allocator, used by cJSON through its hooks and by Expat through
+ * its memory suite. Each block is preceded by its size.
+ */
+
+#define HEADER_SIZE     8
+
+#define BENCH_ROUNDS    5
+
+static size_t s_bytes;
+static size_t s_peak;
+static uint32_t s_allocs;
+
+static void *count_malloc(size_t size)
+{
+    char *p = malloc(size + HEADER_SIZE);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t *) p = size;
+    s_allocs++;
+    s_bytes += size;
+    if (s_bytes > s_peak) {
+        s_peak = s_bytes;
+    }
+    return p + HEADER_SIZE;
+}
+
+static void count_free(void *ptr)
+{
+    if (ptr) {
+        char *p = (char *) ptr - HEADER_SIZE;
+        s_bytes -= *(size_t *) p;
+        free(p);
+    }
+}
+
+static void *count_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return count_malloc(size);
+    }
+    char *p = (char *) ptr - HEADER_SIZE;
+    size_t old = *(size_t *) p;
+    p = realloc(p, size + HEADER_SIZE);
+    if (p == NULL) {
+        return NULL;
+    }
+    *(size_t *) p = size;
+    s_allocs++;
+    s_bytes += size - old;
+    if (s_bytes > s_peak) {
+        s_peak = s_bytes;
+    }
+    return p + HEADER_SIZE;
+}
+
+static cJSON_Hooks s_json_hooks = {
+    .malloc_fn = count_malloc,
+    .free_fn = count_free,
+};
+
+static const XML_Memory_Handling_Suite s_xml_suite = {
+    .malloc_fcn = count_malloc,
+    .realloc_fcn = count_realloc,
+    .free_fcn = count_free,
+};
+
+/*
+ * Corpora
+ */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+    bool failed;
+} text_t;
+
+static void append(text_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(text_t *t, const char *fmt, ...)
+{
+    va_list ap;
+    for (;;) {
+        size_t room = t->size - t->len;
+        va_start(ap, fmt);
+        int n = t->failed ? 0 : vsnprintf(t->buf + t->len, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            t->failed = true;
+        }
+        if (t->failed || (size_t) n < room) {
+            t->len += t->failed ? 0 : n;
+            return;
+        }
+        size_t size = t->size ? t->size * 2 : 1024;
+        while (size < t->len + n + 1) {
+            size *= 2;
+        }
+        char *buf = realloc(t->buf, size);
+        if (buf == NULL) {
+            t->failed = true;
+            return;
+        }
+        t->buf = buf;
+        t->size = size;
+    }
+}
+
+typedef enum {
+    CORPUS_CONFIG,
+    CORPUS_TELEMETRY,
+    CORPUS_NESTED,
+    CORPUS_STRINGS,
+    CORPUS_COUNT
+} corpus_t;
+
+static const char *const s_corpus_names[CORPUS_COUNT] = {
+    "config", "telemetry", "nested", "strings"
+};
+
+#define TELEMETRY_SAMPLES   300
+#define NESTED_DEPTH        24
+#define NESTED_REPEAT       8
+#define STRING_COUNT        4
+#define STRING_LEN          8192
+
+static void make_json(text_t *t, corpus_t corpus)
+{
+    switch (corpus) {
+    case CORPUS_CONFIG:
+        append(t, "{\"version\":3,\"device\":{\"name\":\"sensor-hub\",\"location\":\"lab 2\",\"enabled\":true},"
+               "\"wifi\":{\"ssid\":\"office\",\"password\":\"secret\",\"channel\":6,\"power\":19.5,\"static_ip\":null},");
+        append(t, "\"sensors\":[");
+        for (int i = 0; i < 16; i++) {
+            append(t, "%s{\"id\":%d,\"type\":\"%s\",\"period_ms\":%d,\"offset\":%d.%d,\"alarm\":{\"low\":-%d,\"high\":%d}}",
+                   i ? "," : "", i, (i & 1) ? "humidity" : "temperature", 1000 * (i + 1), i, 25 * i % 100, i * 3, 40 + i);
+        }
+        append(t, "],\"log\":{\"level\":\"info\",\"remote\":false}}");
+        break;
+    case CORPUS_TELEMETRY:
+        append(t, "[");
+        for (int i = 0; i < TELEMETRY_SAMPLES; i++) {
+            append(t, "%s{\"t\":%d,\"id\":%d,\"v\":%d.%03d,\"ok\":%s}", i ? "," : "",
+                   1480000000 + i * 10, i % 12, 20 + i % 7, (i * 397) % 1000, (i % 17) ? "true" : "false");
+        }
+        append(t, "]");
+        break;
+    case CORPUS_NESTED:
+        append(t, "[");
+        for (int r = 0; r < NESTED_REPEAT; r++) {
+            append(t, "%s", r ? "," : "");
+            for (int d = 0; d < NESTED_DEPTH; d++) {
+                append(t, "{\"level\":%d,\"items\":[%d,%d],\"next\":", d, d, r);
+            }
+            append(t, "null");
+            for (int d = 0; d < NESTED_DEPTH; d++) {
+                append(t, "}");
+            }
+        }
+        append(t, "]");
+        break;
+    default:
+        append(t, "{");
+        for (int s = 0; s < STRING_COUNT; s++) {
+            append(t, "%s\"text%d\":\"", s ? "," : "", s);
+            for (int i = 0; i < STRING_LEN / 64; i++) {
+                append(t, "%s", (i % 8 == 7) ? "Line with \\\"quotes\\\", a tab\\t and \\u00e9\\n        "
+                       : "The quick brown fox jumps over the lazy dog, 0123456789 ABCDEF.");
+            }
+            append(t, "\"");
+        }
+        append(t, "}");
+        break;
+    }
+}
+
+static void make_xml(text_t *t, corpus_t corpus)
+{
+    append(t, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+    switch (corpus) {
+    case CORPUS_CONFIG:
+        append(t, "<config version=\"3\">\n <device name=\"sensor-hub\" location=\"lab 2\" enabled=\"true\"/>\n"
+               " <wifi ssid=\"office\" password=\"secret\" channel=\"6\" power=\"19.5\"/>\n <sensors>\n");
+        for (int i = 0; i < 16; i++) {
+            append(t, "  <sensor id=\"%d\" type=\"%s\" period_ms=\"%d\">\n   <offset>%d.%d</offset>\n"
+                   "   <alarm low=\"-%d\" high=\"%d\"/>\n  </sensor>\n",
+                   i, (i & 1) ? "humidity" : "temperature", 1000 * (i + 1), i, 25 * i % 100, i * 3, 40 + i);
+        }
+        append(t, " </sensors>\n <log level=\"info\" remote=\"false\"/>\n</config>\n");
+        break;
+    case CORPUS_TELEMETRY:
+        append(t, "<samples>\n");
+        for (int i = 0; i < TELEMETRY_SAMPLES; i++) {
+            append(t, "<s t=\"%d\" id=\"%d\" v=\"%d.%03d\" ok=\"%s\"/>\n",
+                   1480000000 + i * 10, i % 12, 20 + i % 7, (i * 397) % 1000, (i % 17) ? "true" : "false");
+        }
+        append(t, "</samples>\n");
+        break;
+    case CORPUS_NESTED:
+        append(t, "<root>");
+        for (int r = 0; r < NESTED_REPEAT; r++) {
+            for (int d = 0; d < NESTED_DEPTH; d++) {
+                append(t, "<node level=\"%d\"><item>%d</item><item>%d</item>", d, d, r);
+            }
+            for (int d = 0; d < NESTED_DEPTH; d++) {
+                append(t, "</node>");
+            }
+        }
+        append(t, "</root>\n");
+        break;
+    default:
+        append(t, "<texts>\n");
+        for (int s = 0; s < STRING_COUNT; s++) {
+            append(t, "<text id=\"%d\">", s);
+            for (int i = 0; i < STRING_LEN / 64; i++) {
+                append(t, "%s", (i % 8 == 7) ? "Line with &quot;quotes&quot;, &lt;tags&gt; &amp; &#233;\n"
+                       : "The quick brown fox jumps over the lazy dog, 0123456789 ABCDEF.");
+            }
+            append(t, "</text>\n");
+        }
+        append(t, "</texts>\n");
+        break;
+    }
+}
+
+/*
+ * Tests
+ */
+
+typedef struct {
+    const char *text;       /* the document */
+    size_t len;
+    char *copy;             /* room for a copy of it, for in-place parsing */
+    cJSON *json;            /* the document parsed, for printing */
+    size_t printed_len;     /* length of cJSON_PrintUnformatted of it */
+    XML_Parser parser;      /* parser for PARSER_BENCH_XML_REUSE */
+    unsigned elements;      /* number of XML elements of the document */
+    unsigned counted;
+} bench_doc_t;
+
+static void XMLCALL xml_start(void *arg, const XML_Char *name, const XML_Char **atts)
+{
+    ((bench_doc_t *) arg)->counted++;
+}
+
+static size_t json_parse(bench_doc_t *doc)
+{
+    cJSON *json = cJSON_Parse(doc->text);
+    if (json == NULL) {
+        return 0;
+    }
+    cJSON_Delete(json);
+    return doc->len;
+}
+
+static size_t json_arena(bench_doc_t *doc)
+{
+    cJSON *json = cJSON_ParseArena(doc->text);
+    if (json == NULL) {
+        return 0;
+    }
+    cJSON_Delete(json);
+    return doc->len;
+}
+
+static size_t json_in_place(bench_doc_t *doc)
+{
+    memcpy(doc->copy, doc->text, doc->len + 1);
+    cJSON *json = cJSON_ParseInPlace(doc->copy);
+    if (json == NULL) {
+        return 0;
+    }
+    cJSON_Delete(json);
+    return doc->len;
+}
+
+static size_t json_print(bench_doc_t *doc)
+{
+    char *out = cJSON_PrintUnformatted(doc->json);
+    size_t len = out ? strlen(out) : 0;
+    count_free(out);
+    return len == doc->printed_len ? len : 0;
+}
+
+static size_t xml_run(bench_doc_t *doc, XML_Parser parser)
+{
+    XML_SetUserData(parser, doc);
+    XML_SetStartElementHandler(parser, xml_start);
+    doc->counted = 0;
+    if (XML_Parse(parser, doc->text, doc->len, 1) != XML_STATUS_OK ||
+            (doc->elements && doc->counted != doc->elements)) {
+        return 0;
+    }
+    doc->elements = doc->counted;
+    return doc->len;
+}
+
+static size_t xml_parse(bench_doc_t *doc)
+{
+    XML_Parser parser = XML_ParserCreate_MM(NULL, &s_xml_suite, NULL);
+    if (parser == NULL) {
+        return 0;
+    }
+    size_t len = xml_run(doc, parser);
+    XML_ParserFree(parser);
+    return len;
+}
+
+static size_t xml_reuse(bench_doc_t *doc)
+{
+    if (!XML_ParserReuse(doc->parser, NULL)) {
+        return 0;
+    }
+    return xml_run(doc, doc->parser);
+}
+
+typedef struct {
+    const char *name;
+    uint32_t test;
+    bool xml;
+    size_t (*run)(bench_doc_t *doc);
+} bench_test_t;
+
+static const bench_test_t s_tests[] = {
+    { "json_parse",     PARSER_BENCH_JSON_PARSE,    false,  json_parse },
+    { "json_arena",     PARSER_BENCH_JSON_ARENA,    false,  json_arena },
+    { "json_in_place",  PARSER_BENCH_JSON_IN_PLACE, false,  json_in_place },
+    { "json_print",     PARSER_BENCH_JSON_PRINT,    false,  json_print },
+    { "xml_parse",      PARSER_BENCH_XML_PARSE,     true,   xml_parse },
+    { "xml_reuse",      PARSER_BENCH_XML_REUSE,     true,   xml_reuse },
+};
+
+static esp_err_t measure(const bench_test_t *test, bench_doc_t *doc, uint32_t min_time_ms,
+                         parser_bench_result_t *result)
+{
+    /* one run to warm up, and to check the result */
+    size_t len = test->run(doc);
+    if (len == 0) {
+        printf("%s failed\n", result->name);
+        return ESP_FAIL;
+    }
+
+    size_t base = s_bytes;
+    uint32_t allocs = s_allocs;
+    uint32_t total_runs = 0;
+    uint64_t best_bytes = 0;
+    int64_t best_elapsed = 1;
+    uint64_t best_tsc = 0;
+    s_peak = s_bytes;
+    /* Keep the fastest of a few rounds, which is the least disturbed by
+       interrupts and other tasks (or processes on the host) */
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        uint32_t runs = 0;
+        uint64_t tsc = READ_TSC();
+        int64_t start = now_us();
+        int64_t elapsed;
+        do {
+            test->run(doc);
+            runs++;
+            elapsed = now_us() - start;
+        } while (elapsed < (int64_t) min_time_ms * 1000 / BENCH_ROUNDS);
+        tsc = READ_TSC() - tsc;
+        total_runs += runs;
+        if (elapsed == 0) {
+            elapsed = 1;
+        }
+        if ((uint64_t) len * runs * best_elapsed > best_bytes * elapsed) {
+            best_bytes = (uint64_t) len * runs;
+            best_elapsed = elapsed;
+            best_tsc = tsc;
+        }
+    }
+
+    result->size = len;
+    result->kbytes_per_s = (uint32_t) (best_bytes * 1000 / best_elapsed);
+    result->allocs = (s_allocs - allocs) / total_runs;
+    result->peak_bytes = s_peak - base;
+    result->cycles_per_byte_x10 = (uint32_t) (CYCLES(best_elapsed, best_tsc) * 10 / best_bytes);
+    return ESP_OK;
+}
+
+static esp_err_t run_corpus(const parser_bench_cfg_t *cfg, corpus_t corpus, bool xml,
+                            parser_bench_result_t *results, size_t *count)
+{
+    text_t text = { 0 };
+    bench_doc_t doc = { 0 };
+    esp_err_t err = ESP_OK;
+
+    if (xml) {
+        make_xml(&text, corpus);
+    } else {
+        make_json(&text, corpus);
+    }
+    doc.text = text.buf;
+    doc.len = text.len;
+    doc.copy = malloc(text.len + 1);
+    if (!xml) {
+        doc.json = cJSON_Parse(text.buf);
+        char *out = doc.json ? cJSON_PrintUnformatted(doc.json) : NULL;
+        doc.printed_len = out ? strlen(out) : 0;
+        count_free(out);
+    } else {
+        doc.parser = XML_ParserCreate_MM(NULL, &s_xml_suite, NULL);
+    }
+    if (text.failed || doc.copy == NULL || (xml ? doc.parser == NULL : doc.json == NULL)) {
+        err = text.failed || doc.copy == NULL ? ESP_ERR_NO_MEM : ESP_FAIL;
+    }
+
+    for (size_t i = 0; err == ESP_OK && i < sizeof(s_tests) / sizeof(s_tests[0]); i++) {
+        const bench_test_t *test = &s_tests[i];
+        if (test->xml != xml || !(cfg->tests & test->test)) {
+            continue;
+        }
+        parser_bench_result_t *result = &results[(*count)++];
+        memset(result, 0, sizeof(*result));
+        snprintf(result->name, sizeof(result->name), "%s/%s", test->name, s_corpus_names[corpus]);
+        err = measure(test, &doc, cfg->min_time_ms, result);
+    }
+
+    cJSON_Delete(doc.json);
+    if (doc.parser) {
+        XML_ParserFree(doc.parser);
+    }
+    free(doc.copy);
+    free(text.buf);
+    return err;
+}
+
+esp_err_t parser_bench_run(const parser_bench_cfg_t *cfg, parser_bench_result_t *results, size_t *count)
+{
+    parser_bench_cfg_t c = {
+        .tests = (cfg && cfg->tests) ? cfg->tests : PARSER_BENCH_ALL,
+        .min_time_ms = (cfg && cfg->min_time_ms) ? cfg->min_time_ms : 200,
+    };
+    esp_err_t err = ESP_OK;
+
+    *count = 0;
+    cJSON_InitHooks(&s_json_hooks);
+    for (int xml = 0; xml < 2 && err == ESP_OK; xml++) {
+        for (corpus_t corpus = 0; corpus < CORPUS_COUNT && err == ESP_OK; corpus++) {
+            err = run_corpus(&c, corpus, xml, results, count);
+        }
+    }
+    cJSON_InitHooks(NULL);
+    return err;
+}
+
+void parser_bench_print(const parser_bench_result_t *results, size_t count)
+{
+    printf("# %-28s %8s %10s %8s %10s %8s\n", "test", "bytes", "MB/s", "allocs", "peak", "c/B");
+    for (size_t i = 0; i < count; i++) {
+        const parser_bench_result_t *r = &results[i];
+        printf("%-30s %8u %6u.%03u %8u %10u %6u.%u\n", r->name, r->size,
+               r->kbytes_per_s / 1000, r->kbytes_per_s % 1000, r->allocs, r->peak_bytes,
+               r->cycles_per_byte_x10 / 10, r->cycles_per_byte_x10 % 10);
+    }
+}
+
+bool parser_bench_parse_line(const char *line, parser_bench_result_t *result)
+{
+    unsigned size, mb, kb, allocs, peak, cpb, cpb_tenths;
+    char name[PARSER_BENCH_NAME_LEN];
+    if (sscanf(line, "%31s %u %u.%u %u %u %u.%u", name, &size, &mb, &kb,
+               &allocs, &peak, &cpb, &cpb_tenths) != 8 || name[0] == '#') {
+        return false;
+    }
+    memset(result, 0, sizeof(*result));
+    strcpy(result->name, name);
+    result->size = size;
+    result->kbytes_per_s = mb * 1000 + kb;
+    result->allocs = allocs;
+    result->peak_bytes = peak;
+    result->cycles_per_byte_x10 = cpb * 10 + cpb_tenths;
+    return true;
+}
+
+esp_err_t parser_bench_check(const parser_bench_result_t *results, size_t count,
+                             const parser_bench_result_t *baseline, size_t baseline_count,
+                             unsigned tolerance_pct)
+{
+    esp_err_t err = ESP_OK;
+    if (tolerance_pct > 100) {
+        tolerance_pct = 100;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const parser_bench_result_t *r = &results[i];
+        const parser_bench_result_t *b = NULL;
+        for (size_t j = 0; j < baseline_count && b == NULL; j++) {
+            if (strcmp(baseline[j].name, r->name) == 0) {
+                b = &baseline[j];
+            }
+        }
+        if (b == NULL) {
+            continue;
+        }
+        if ((uint64_t) r->kbytes_per_s * 100 < (uint64_t) b->kbytes_per_s * (100 - tolerance_pct)) {
+            printf("%s: %u kB/s, baseline %u kB/s\n", r->name, r->kbytes_per_s, b->kbytes_per_s);
+            err = ESP_FAIL;
+        }
+        if (r->peak_bytes > b->peak_bytes) {
+            printf("%s: peak %u bytes, baseline %u bytes\n", r->name, r->peak_bytes, b->peak_bytes);
+            err = ESP_FAIL;
+        }
+        if (r->allocs > b->allocs) {
+            printf("%s: %u allocations, baseline %u\n", r->name, r->allocs, b->allocs);
+            err = ESP_FAIL;
+        }
+    }
+    return err;
+}
@@ -16,8 +16,10 @@
 #define __ESP_LOG_H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include "sdkconfig.h"
+#include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,7 +33,8 @@ extern "C" {
  *
  * At compile time, filtering is done using CONFIG_LOG_DEFAULT_LEVEL macro, set via
  * menuconfig. All logging statments for levels higher than CONFIG_LOG_DEFAULT_LEVEL
- * will be removed by the preprocessor.
+ * will be removed by the preprocessor. CONFIG_LOG_COMPONENT_LEVELS overrides this
+ * level for individual components.
  *
  * At run time, all logs below CONFIG_LOG_DEFAULT_LEVEL are enabled by default.
  * esp_log_set_level function may be used to set logging level per module.
@@ -117,8 +120,66 @@ void esp_log_level_set(const char* tag, esp_log_level_t level);
  * output to some other destination, such as file or network.
  *
  * @param func Function used for output. Must have same signature as vprintf.
+ *
+ * @return the function used for output until now
+ */
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+
+/**
+ * @brief Output log entries asynchronously
+ *
+ * By default, esp_log_write outputs each entry before it returns, so tasks
+ * which log wait until the entry has been sent to the UART. Once this function
+ * has been called, esp_log_write formats entries into a buffer of the calling
+ * CPU and returns. A low priority task outputs the buffered entries with the
+ * function set by esp_log_set_vprintf.
+ *
+ * Entries longer than CONFIG_LOG_ASYNC_LINE_MAX are truncated. Entries which
+ * don't fit into the buffer are dropped and counted; the log task reports the
+ * number of dropped entries once the buffer has room again.
+ *
+ * @return
+ *         - ESP_OK on success, or if asynchronous output is already enabled
+ *         - ESP_ERR_NO_MEM if the buffers or the task can't be allocated
+ */
+esp_err_t esp_log_async_start();
+
+typedef void (*esp_log_binary_sink_t)(const void* record, size_t size);
+
+/**
+ * @brief Output log entries as binary records, to be formatted on the host
+ *
+ * Once a sink is set, esp_log_write doesn't format log entries. Instead it
+ * passes a binary record to the sink, from the log task if asynchronous output
+ * is enabled, or directly otherwise. Records are usually several times
+ * smaller than the formatted text. log_decode.py, in the log component,
+ * formats them using the ELF file of the application.
+ *
+ * Records consist of, in little endian byte order:
+ *
+ *  - record size in bytes, including this header (2 bytes)
+ *  - log level in bits 0-2, bit 7 set if arguments have been cut (1 byte)
+ *  - address of the format string (4 bytes)
+ *  - the arguments, in the order of the conversions in the format string:
+ *    4 bytes for integers, characters and pointers, 8 bytes for long long
+ *    integers and doubles, and for strings one length byte followed by up to
+ *    254 characters. Strings in flash, such as tags and string literals, are
+ *    instead stored as a 0xff byte followed by their address.
+ *
+ * Records are at most 128 bytes long. The timestamp and the tag are the
+ * first two arguments of entries made with the ESP_LOGx macros.
+ *
+ * @param sink function which gets the records, or NULL to output text again.
+ *             Records are only valid during the call.
  */
-void esp_log_set_vprintf(vprintf_like_t func);
+void esp_log_set_binary_sink(esp_log_binary_sink_t sink);
+
+/**
+ * @brief Get the number of log entries dropped since asynchronous output was enabled
+ *
+ * @return number of entries dropped because the buffer was full
+ */
+uint32_t esp_log_async_get_dropped();
 
 /**
  * @brief Write message into the log
@@ -175,7 +236,12 @@ uint32_t esp_log_timestamp();
 
 #ifndef LOG_LOCAL_LEVEL
 #ifndef BOOTLOADER_BUILD
+#ifdef LOG_COMPONENT_LEVEL
+// set by the build system from CONFIG_LOG_COMPONENT_LEVELS
+#define LOG_LOCAL_LEVEL  ((esp_log_level_t) LOG_COMPONENT_LEVEL)
+#else
 #define LOG_LOCAL_LEVEL  ((esp_log_level_t) CONFIG_LOG_DEFAULT_LEVEL)
+#endif
 #else
 #define LOG_LOCAL_LEVEL  ((esp_log_level_t) CONFIG_LOG_BOOTLOADER_LEVEL)
 #endif
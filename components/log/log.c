@@ -21,18 +21,41 @@
  * To avoid looking up log level for given tag each time message is
  * printed, this library caches pointers to tags. Because the suggested
  * way of creating tags uses one 'TAG' constant per file, this caching
- * should be effective. Cache is a binary min-heap of cached_tag_entry_t
- * items, ordering is done on 'generation' member. In this context,
- * generation is an integer which is incremented each time an operation
- * with cache is performed. When cache is full, new item is inserted in
- * place of an oldest item (that is, with smallest 'generation' value).
- * After that, bubble-down operation is performed to fix ordering in the
- * min-heap.
+ * should be effective. Cache is a hash table of cached_tag_entry_t items,
+ * indexed by the tag pointer, with linear probing.
+ *
+ * The cache is read without taking any lock, so that logs which are
+ * filtered out only cost a few loads. Each entry holds the tag pointer and
+ * a 'state' word with the log level and the cache generation at the time
+ * the entry was added. The generation is incremented by esp_log_level_set,
+ * which invalidates all entries at once. Entries of an older generation are
+ * treated as empty, so the entries of the current generation always form a
+ * prefix of each probe sequence; lookups stop at the first empty entry.
+ *
+ * Entries are added with s_log_mutex held. The state word of an entry is
+ * cleared before its tag is changed, and written again after, so a lookup
+ * which reads the same valid state word before and after reading the tag
+ * has a matching tag and level.
+ *
+ * Only cache misses take s_log_mutex, to walk the linked list of tags and
+ * add the result to the cache. When the cache is full, the result isn't
+ * cached.
  *
  * The potential problem with wrap-around of cache generation counter is
- * ignored for now. This will happen if someone happens to output more
- * than 4 billion log entries, at which point wrap-around will not be
- * the biggest problem.
+ * ignored for now. This will happen if someone calls esp_log_level_set
+ * more than 500 million times.
+ *
+ * Once esp_log_async_start is called, lines are formatted on the stack of
+ * the caller and copied into a ring buffer of the current CPU, so that
+ * tasks on one CPU don't contend with the other CPU. The log task takes
+ * lines from both buffers, in turns, and outputs them with
+ * s_log_print_func. It is woken with a task notification for each line.
+ *
+ * With a binary sink set, lines aren't formatted. Instead, esp_log_write
+ * walks the format string to find the types of the arguments, and copies
+ * them into a binary record along with the address of the format string.
+ * Binary records go through the asynchronous buffers when they are
+ * enabled, with a leading byte telling them apart from text lines.
  *
  */
 
@@ -41,6 +64,7 @@
 #include <freertos/FreeRTOSConfig.h>
 #include <freertos/task.h>
 #include <freertos/semphr.h>
+#include <freertos/ringbuf.h>
 #endif
 
 #include "esp_attr.h"
@@ -53,24 +77,43 @@
 #include <stdio.h>
 #include <assert.h>
 #include "esp_log.h"
+#include "esp_task.h"
 
 
 #ifndef BOOTLOADER_BUILD
 
-// Number of tags to be cached. Must be 2**n - 1, n >= 2.
-#define TAG_CACHE_SIZE 31
+// Number of tags to be cached. Must be 2**n.
+#define TAG_CACHE_SIZE 32
 
-// Maximum time to wait for the mutex in a logging statement.
+// Maximum time to wait for the mutex when a tag isn't found in cache.
 #define MAX_MUTEX_WAIT_MS 10
 #define MAX_MUTEX_WAIT_TICKS ((MAX_MUTEX_WAIT_MS + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS)
 
-// Uncomment this to enable consistency checks and cache statistics in this file.
+// Uncomment this to enable cache statistics in this file.
 // #define LOG_BUILTIN_CHECKS
 
+// Layout of cached_tag_entry_t::state. An entry is valid if its generation
+// is the current cache generation, which is never 0.
+#define CACHE_STATE_LEVEL_MASK      0x7
+#define CACHE_STATE_GEN_SHIFT       3
+#define CACHE_STATE(gen, level)     (((gen) << CACHE_STATE_GEN_SHIFT) | (level))
+
+// Kinds of items in the asynchronous log buffers, stored in their first byte
+#define LOG_ITEM_TEXT               0
+#define LOG_ITEM_BINARY             1
+
+// Binary records, see esp_log_set_binary_sink
+#define LOG_BINARY_RECORD_MAX       128
+#define LOG_BINARY_HEADER_SIZE      7
+#define LOG_BINARY_TRUNCATED        0x80
+#define LOG_BINARY_STR_ADDR         0xff
+#define LOG_BINARY_STR_MAX          0xfe
+#define LOG_BINARY_DROM_LOW         0x3f400000
+#define LOG_BINARY_DROM_HIGH        0x3f800000
+
 typedef struct {
     const char* tag;
-    uint32_t level : 3;
-    uint32_t generation : 29;
+    uint32_t state;
 } cached_tag_entry_t;
 
 typedef struct uncached_tag_entry_{
@@ -82,11 +125,17 @@ typedef struct uncached_tag_entry_{
 static esp_log_level_t s_log_default_level = ESP_LOG_VERBOSE;
 static uncached_tag_entry_t* s_log_tags_head = NULL;
 static uncached_tag_entry_t* s_log_tags_tail = NULL;
-static cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
-static uint32_t s_log_cache_max_generation = 0;
-static uint32_t s_log_cache_entry_count = 0;
+static volatile cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
+static volatile uint32_t s_log_cache_generation = 1;
 static vprintf_like_t s_log_print_func = &vprintf;
 static SemaphoreHandle_t s_log_mutex = NULL;
+static portMUX_TYPE s_log_mutex_init_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static RingbufHandle_t s_log_async_buf[portNUM_PROCESSORS];
+static TaskHandle_t s_log_async_task = NULL;
+static uint32_t s_log_async_dropped = 0;
+static portMUX_TYPE s_log_async_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_log_binary_sink_t s_log_binary_sink = NULL;
 
 #ifdef LOG_BUILTIN_CHECKS
 static uint32_t s_log_cache_misses = 0;
@@ -95,28 +144,38 @@ static uint32_t s_log_cache_misses = 0;
 static inline bool get_cached_log_level(const char* tag, esp_log_level_t* level);
 static inline bool get_uncached_log_level(const char* tag, esp_log_level_t* level);
 static inline void add_to_cache(const char* tag, esp_log_level_t level);
-static void heap_bubble_down(int index);
-static inline void heap_swap(int i, int j);
+static inline uint32_t cache_index(const char* tag);
 static inline bool should_output(esp_log_level_t level_for_message, esp_log_level_t level_for_tag);
 static inline void clear_log_level_list();
+static SemaphoreHandle_t get_log_mutex();
+static void log_write_async(const char* format, va_list list);
+static void log_write_binary(esp_log_level_t level, const char* format, va_list list);
 
-void esp_log_set_vprintf(vprintf_like_t func)
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
 {
+    vprintf_like_t orig_func = s_log_print_func;
     s_log_print_func = func;
+    return orig_func;
+}
+
+void esp_log_set_binary_sink(esp_log_binary_sink_t sink)
+{
+    s_log_binary_sink = sink;
 }
 
 void esp_log_level_set(const char* tag, esp_log_level_t level)
 {
-    if (!s_log_mutex) {
-        s_log_mutex = xSemaphoreCreateMutex();
+    SemaphoreHandle_t mutex = get_log_mutex();
+    if (!mutex) {
+        return;
     }
-    xSemaphoreTake(s_log_mutex, portMAX_DELAY);
+    xSemaphoreTake(mutex, portMAX_DELAY);
 
     // for wildcard tag, remove all linked list items and clear the cache
     if (strcmp(tag, "*") == 0) {
         s_log_default_level = level;
         clear_log_level_list();
-        xSemaphoreGive(s_log_mutex);
+        xSemaphoreGive(mutex);
         return;
     }
 
@@ -124,7 +183,7 @@ void esp_log_level_set(const char* tag, esp_log_level_t level)
     size_t entry_size = offsetof(uncached_tag_entry_t, tag) + strlen(tag) + 1;
     uncached_tag_entry_t* new_entry = (uncached_tag_entry_t*) malloc(entry_size);
     if (!new_entry) {
-        xSemaphoreGive(s_log_mutex);
+        xSemaphoreGive(mutex);
         return;
     }
     new_entry->next = NULL;
@@ -137,7 +196,9 @@ void esp_log_level_set(const char* tag, esp_log_level_t level)
     if (!s_log_tags_head) {
         s_log_tags_head = new_entry;
     }
-    xSemaphoreGive(s_log_mutex);
+    // cached levels may be overridden by the new entry
+    ++s_log_cache_generation;
+    xSemaphoreGive(mutex);
 }
 
 void clear_log_level_list()
@@ -149,27 +210,47 @@ void clear_log_level_list()
     }
     s_log_tags_tail = NULL;
     s_log_tags_head = NULL;
-    s_log_cache_entry_count = 0;
-    s_log_cache_max_generation = 0;
+    ++s_log_cache_generation;
 #ifdef LOG_BUILTIN_CHECKS
     s_log_cache_misses = 0;
 #endif
 
 }
 
+static SemaphoreHandle_t get_log_mutex()
+{
+    if (s_log_mutex) {
+        return s_log_mutex;
+    }
+    // Two tasks may get here at the same time; the one which comes second
+    // deletes its mutex and uses the other one.
+    SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return NULL;
+    }
+    portENTER_CRITICAL(&s_log_mutex_init_lock);
+    bool created = (s_log_mutex == NULL);
+    if (created) {
+        s_log_mutex = mutex;
+    }
+    portEXIT_CRITICAL(&s_log_mutex_init_lock);
+    if (!created) {
+        vSemaphoreDelete(mutex);
+    }
+    return s_log_mutex;
+}
+
 void IRAM_ATTR esp_log_write(esp_log_level_t level,
         const char* tag,
         const char* format, ...)
 {
-    if (!s_log_mutex) {
-        s_log_mutex = xSemaphoreCreateMutex();
-    }
-    if (xSemaphoreTake(s_log_mutex, MAX_MUTEX_WAIT_TICKS) == pdFALSE) {
-        return;
-    }
     esp_log_level_t level_for_tag;
     // Look for the tag in cache first, then in the linked list of all tags
     if (!get_cached_log_level(tag, &level_for_tag)) {
+        SemaphoreHandle_t mutex = get_log_mutex();
+        if (!mutex || xSemaphoreTake(mutex, MAX_MUTEX_WAIT_TICKS) == pdFALSE) {
+            return;
+        }
         if (!get_uncached_log_level(tag, &level_for_tag)) {
             level_for_tag = s_log_default_level;
         }
@@ -177,74 +258,315 @@ void IRAM_ATTR esp_log_write(esp_log_level_t level,
 #ifdef LOG_BUILTIN_CHECKS
         ++s_log_cache_misses;
 #endif
+        xSemaphoreGive(mutex);
     }
-    xSemaphoreGive(s_log_mutex);
     if (!should_output(level, level_for_tag)) {
         return;
     }
 
     va_list list;
     va_start(list, format);
-    (*s_log_print_func)(format, list);
+    if (s_log_binary_sink) {
+        log_write_binary(level, format, list);
+    } else if (s_log_async_task) {
+        log_write_async(format, list);
+    } else {
+        (*s_log_print_func)(format, list);
+    }
     va_end(list);
 }
 
-static inline bool get_cached_log_level(const char* tag, esp_log_level_t* level)
+static void IRAM_ATTR log_queue_item(const uint8_t* item, size_t size)
 {
-    // Look for `tag` in cache
-    int i;
-    for (i = 0; i < s_log_cache_entry_count; ++i) {
-#ifdef LOG_BUILTIN_CHECKS
-        assert(i == 0 || s_log_cache[(i - 1) / 2].generation < s_log_cache[i].generation);
-#endif
-        if (s_log_cache[i].tag == tag) {
-            break;
-        }
+    // The task may move to the other CPU meanwhile, so the buffer is still
+    // created for multiple producers
+    RingbufHandle_t buf = s_log_async_buf[xPortGetCoreID()];
+    if (xRingbufferSend(buf, item, size) == pdFALSE) {
+        portENTER_CRITICAL(&s_log_async_lock);
+        ++s_log_async_dropped;
+        portEXIT_CRITICAL(&s_log_async_lock);
+    }
+    xTaskNotifyGive(s_log_async_task);
+}
+
+static void IRAM_ATTR log_write_async(const char* format, va_list list)
+{
+    char item[CONFIG_LOG_ASYNC_LINE_MAX + 1];
+    char* line = item + 1;
+    const size_t line_size = CONFIG_LOG_ASYNC_LINE_MAX;
+    item[0] = LOG_ITEM_TEXT;
+    int len = vsnprintf(line, line_size, format, list);
+    if (len < 0) {
+        return;
     }
-    if (i == s_log_cache_entry_count) { // Not found in cache
+    if (len >= line_size) {
+        // Keep the line terminated when it is cut
+        len = line_size - 1;
+        line[len - 1] = '\n';
+    }
+    log_queue_item((const uint8_t*) item, len + 2);
+}
+
+static inline bool IRAM_ATTR log_binary_put(uint8_t** pos, const uint8_t* end, const void* data, size_t size)
+{
+    if (end - *pos < size) {
         return false;
     }
-    // Return level from cache
-    *level = (esp_log_level_t) s_log_cache[i].level;
-    // If cache has been filled, start taking ordering into account
-    // (other options are: dynamically resize cache, add "dummy" entries
-    //  to the cache; this option was chosen because code is much simpler,
-    //  and the unfair behavior of cache will show it self at most once, when
-    //  it has just been filled)
-    if (s_log_cache_entry_count == TAG_CACHE_SIZE) {
-        // Update item generation
-        s_log_cache[i].generation = s_log_cache_max_generation++;
-        // Restore heap ordering
-        heap_bubble_down(i);
+    memcpy(*pos, data, size);
+    *pos += size;
+    return true;
+}
+
+/*
+ * Append the arguments of `format` to a binary record, in the order in which
+ * they appear. Returns false if the record is too short for all of them.
+ */
+static bool IRAM_ATTR log_binary_put_args(uint8_t** pos, const uint8_t* end, const char* format, va_list list)
+{
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%') {
+            continue;
+        }
+        ++p;
+        if (*p == '%') {
+            continue;
+        }
+        while (*p && strchr("-+ #0", *p)) {
+            ++p;
+        }
+        for (int part = 0; part < 2; ++part) {
+            // width, then precision
+            if (part == 1) {
+                if (*p != '.') {
+                    break;
+                }
+                ++p;
+            }
+            if (*p == '*') {
+                int value = va_arg(list, int);
+                if (!log_binary_put(pos, end, &value, sizeof(value))) {
+                    return false;
+                }
+                ++p;
+            }
+            while (*p >= '0' && *p <= '9') {
+                ++p;
+            }
+        }
+        int longs = 0;
+        while (*p && strchr("hlLjzt", *p)) {
+            if (*p == 'l' || *p == 'j' || *p == 'L') {
+                ++longs;
+            }
+            ++p;
+        }
+        switch (*p) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                if (longs >= 2 || (longs == 1 && p[-1] == 'j')) {
+                    long long value = va_arg(list, long long);
+                    if (!log_binary_put(pos, end, &value, sizeof(value))) {
+                        return false;
+                    }
+                    break;
+                }
+                /* no break */
+            case 'p': case 'n': {
+                uint32_t value = va_arg(list, uint32_t);
+                if (!log_binary_put(pos, end, &value, sizeof(value))) {
+                    return false;
+                }
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double value = va_arg(list, double);
+                if (!log_binary_put(pos, end, &value, sizeof(value))) {
+                    return false;
+                }
+                break;
+            }
+            case 's': {
+                const char* str = va_arg(list, const char*);
+                uint32_t addr = (uint32_t) str;
+                if (addr >= LOG_BINARY_DROM_LOW && addr < LOG_BINARY_DROM_HIGH) {
+                    // in the application image, the decoder reads it from the ELF file
+                    uint8_t marker = LOG_BINARY_STR_ADDR;
+                    if (!log_binary_put(pos, end, &marker, 1) ||
+                            !log_binary_put(pos, end, &addr, sizeof(addr))) {
+                        return false;
+                    }
+                    break;
+                }
+                if (!str) {
+                    str = "(null)";
+                }
+                size_t len = strnlen(str, LOG_BINARY_STR_MAX);
+                uint8_t len_byte = (uint8_t) len;
+                if (!log_binary_put(pos, end, &len_byte, 1) ||
+                        !log_binary_put(pos, end, str, len)) {
+                    return false;
+                }
+                break;
+            }
+            default:
+                // unknown conversion, the decoder stops here as well
+                return true;
+        }
     }
     return true;
 }
 
-static inline void add_to_cache(const char* tag, esp_log_level_t level)
+static void IRAM_ATTR log_write_binary(esp_log_level_t level, const char* format, va_list list)
 {
-    uint32_t generation = s_log_cache_max_generation++;
-    // First consider the case when cache is not filled yet.
-    // In this case, just add new entry at the end.
-    // This happens to satisfy binary min-heap ordering.
-    if (s_log_cache_entry_count < TAG_CACHE_SIZE) {
-        s_log_cache[s_log_cache_entry_count] = (cached_tag_entry_t) {
-            .generation = generation,
-            .level = level,
-            .tag = tag
-        };
-        ++s_log_cache_entry_count;
-        return;
+    uint8_t item[1 + LOG_BINARY_RECORD_MAX];
+    uint8_t* record = item + 1;
+    uint8_t* pos = record + LOG_BINARY_HEADER_SIZE;
+    item[0] = LOG_ITEM_BINARY;
+    uint8_t flags = (uint8_t) level;
+    if (!log_binary_put_args(&pos, record + LOG_BINARY_RECORD_MAX, format, list)) {
+        flags |= LOG_BINARY_TRUNCATED;
     }
+    uint16_t size = pos - record;
+    uint32_t format_addr = (uint32_t) format;
+    memcpy(record, &size, sizeof(size));
+    record[2] = flags;
+    memcpy(record + 3, &format_addr, sizeof(format_addr));
+    if (s_log_async_task) {
+        log_queue_item(item, size + 1);
+    } else {
+        (*s_log_binary_sink)(record, size);
+    }
+}
 
-    // Cache is full, so we replace the oldest entry (which is at index 0
-    // because this is a min-heap) with the new one, and do bubble-down
-    // operation to restore min-heap ordering.
-    s_log_cache[0] = (cached_tag_entry_t) {
-        .tag = tag,
-        .level = level,
-        .generation = generation
-    };
-    heap_bubble_down(0);
+static int log_print_line(const char* format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int ret = (*s_log_print_func)(format, list);
+    va_end(list);
+    return ret;
+}
+
+static void log_async_task(void* arg)
+{
+    uint32_t reported_dropped = 0;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bool output;
+        do {
+            output = false;
+            for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+                size_t size;
+                uint8_t* item = (uint8_t*) pvRingbufferReceive(s_log_async_buf[i], &size, 0);
+                if (!item) {
+                    continue;
+                }
+                if (item[0] == LOG_ITEM_TEXT) {
+                    log_print_line("%s", (const char*) item + 1);
+                } else {
+                    esp_log_binary_sink_t sink = s_log_binary_sink;
+                    if (sink) {
+                        (*sink)(item + 1, size - 1);
+                    }
+                }
+                vRingbufferReturnItem(s_log_async_buf[i], item);
+                output = true;
+            }
+        } while (output);
+        uint32_t dropped = s_log_async_dropped;
+        if (dropped != reported_dropped) {
+            log_print_line("W (%d) log: %u lines dropped\n", esp_log_timestamp(), (unsigned) (dropped - reported_dropped));
+            reported_dropped = dropped;
+        }
+    }
+}
+
+esp_err_t esp_log_async_start()
+{
+    SemaphoreHandle_t mutex = get_log_mutex();
+    if (!mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (s_log_async_task) {
+        xSemaphoreGive(mutex);
+        return ESP_OK;
+    }
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        if (!s_log_async_buf[i]) {
+            s_log_async_buf[i] = xRingbufferCreate(CONFIG_LOG_ASYNC_BUFFER_SIZE, ringbufMULTI_PRODUCER);
+        }
+        if (!s_log_async_buf[i]) {
+            xSemaphoreGive(mutex);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    TaskHandle_t task;
+    if (xTaskCreatePinnedToCore(&log_async_task, "log", ESP_TASKD_LOG_STACK, NULL,
+                ESP_TASKD_LOG_PRIO, &task, ESP_TASK_PROTOCOL_CORE) != pdPASS) {
+        xSemaphoreGive(mutex);
+        return ESP_ERR_NO_MEM;
+    }
+    // buffers have to be visible to the other CPU before the task handle
+    __sync_synchronize();
+    s_log_async_task = task;
+    xSemaphoreGive(mutex);
+    return ESP_OK;
+}
+
+uint32_t esp_log_async_get_dropped()
+{
+    return s_log_async_dropped;
+}
+
+static inline uint32_t cache_index(const char* tag)
+{
+    // Tags are usually word aligned string literals, drop the low bits
+    return (((uint32_t) tag >> 2) * 2654435761u) >> (32 - __builtin_ctz(TAG_CACHE_SIZE));
+}
+
+static inline bool get_cached_log_level(const char* tag, esp_log_level_t* level)
+{
+    uint32_t generation = s_log_cache_generation;
+    uint32_t index = cache_index(tag);
+    for (int probe = 0; probe < TAG_CACHE_SIZE; ++probe) {
+        volatile cached_tag_entry_t* entry = &s_log_cache[index];
+        uint32_t state = entry->state;
+        if ((state >> CACHE_STATE_GEN_SHIFT) != generation) {
+            // End of the probe sequence: tag isn't cached
+            return false;
+        }
+        const char* entry_tag = entry->tag;
+        if (entry_tag == tag && entry->state == state) {
+            *level = (esp_log_level_t) (state & CACHE_STATE_LEVEL_MASK);
+            return true;
+        }
+        index = (index + 1) & (TAG_CACHE_SIZE - 1);
+    }
+    return false;
+}
+
+static inline void add_to_cache(const char* tag, esp_log_level_t level)
+{
+    // Called with s_log_mutex held, so the generation doesn't change here
+    uint32_t generation = s_log_cache_generation;
+    uint32_t index = cache_index(tag);
+    for (int probe = 0; probe < TAG_CACHE_SIZE; ++probe) {
+        volatile cached_tag_entry_t* entry = &s_log_cache[index];
+        if ((entry->state >> CACHE_STATE_GEN_SHIFT) != generation) {
+            entry->state = 0;
+            __sync_synchronize();
+            entry->tag = tag;
+            __sync_synchronize();
+            entry->state = CACHE_STATE(generation, level);
+            return;
+        }
+        if (entry->tag == tag) {
+            // Added by another task while this one was waiting for the mutex
+            return;
+        }
+        index = (index + 1) & (TAG_CACHE_SIZE - 1);
+    }
+    // Cache is full; the level will be looked up again next time
 }
 
 static inline bool get_uncached_log_level(const char* tag, esp_log_level_t* level)
@@ -264,24 +586,6 @@ static inline bool should_output(esp_log_level_t level_for_message, esp_log_leve
 {
     return level_for_message <= level_for_tag;
 }
-
-static void heap_bubble_down(int index)
-{
-    while (index < TAG_CACHE_SIZE / 2) {
-        int left_index = index * 2 + 1;
-        int right_index = left_index + 1;
-        int next = (s_log_cache[left_index].generation < s_log_cache[right_index].generation) ? left_index : right_index;
-        heap_swap(index, next);
-        index = next;
-    }
-}
-
-static inline void heap_swap(int i, int j)
-{
-    cached_tag_entry_t tmp = s_log_cache[i];
-    s_log_cache[i] = s_log_cache[j];
-    s_log_cache[j] = tmp;
-}
 #endif //BOOTLOADER_BUILD
 
 inline IRAM_ATTR uint32_t esp_log_early_timestamp()
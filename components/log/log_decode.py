@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+#
+# Binary log decoder
+#
+# Formats the binary log records produced with esp_log_set_binary_sink() as
+# text, the same way esp_log_write would have. Format strings and strings in
+# flash are read from the ELF file of the application which produced the log.
+#
+# The input is the concatenation of the records, as passed to the sink.
+import argparse
+import re
+import struct
+import sys
+
+__version__ = '1.0'
+
+SHT_NOBITS = 8
+SHF_ALLOC = 2
+
+HEADER_SIZE = 7
+FLAG_TRUNCATED = 0x80
+STR_ADDR = 0xff
+
+# Same conversions as log_binary_put_args in log.c
+RE_CONVERSION = re.compile(r'%([-+ #0]*)(\*|\d*)(?:\.(\*|\d*))?([hlLjzt]*)(.)')
+
+
+class ElfImage(object):
+    """ Allocated sections of a little endian ELF32 file, looked up by address """
+    def __init__(self, f):
+        data = f.read()
+        if data[:4] != b'\x7fELF' or data[4:5] != b'\x01' or data[5:6] != b'\x01':
+            raise ValueError('%s is not a little endian ELF32 file' % f.name)
+        (shoff,) = struct.unpack_from('<I', data, 0x20)
+        (shentsize, shnum) = struct.unpack_from('<HH', data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, flags, addr, offset, size) = struct.unpack_from('<IIIIII', data, shoff + i * shentsize)
+            if (flags & SHF_ALLOC) != 0 and sh_type != SHT_NOBITS and size != 0:
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def read_string(self, addr):
+        for (start, contents) in self.sections:
+            if start <= addr < start + len(contents):
+                end = contents.find(b'\0', addr - start)
+                if end < 0:
+                    end = len(contents)
+                return contents[addr - start:end].decode('utf-8', 'replace')
+        return '<0x%08x>' % addr
+
+
+class Truncated(Exception):
+    pass
+
+
+class Reader(object):
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, fmt):
+        size = struct.calcsize(fmt)
+        if self.pos + size > len(self.data):
+            raise Truncated()
+        values = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += size
+        return values[0]
+
+    def take_bytes(self, size):
+        if self.pos + size > len(self.data):
+            raise Truncated()
+        value = self.data[self.pos:self.pos + size]
+        self.pos += size
+        return value
+
+
+def format_record(elf, payload, flags, format_addr):
+    fmt = elf.read_string(format_addr)
+    args = Reader(payload)
+    out = []
+    last = 0
+    for m in RE_CONVERSION.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        (flag_chars, width, precision, length, conv) = m.groups()
+        if conv == '%' and not (flag_chars or width or precision or length):
+            out.append('%')
+            continue
+        try:
+            if width == '*':
+                width = str(args.take('<i'))
+            if precision == '*':
+                precision = str(args.take('<i'))
+            spec = '%' + flag_chars + width + ('.' + precision if precision is not None else '')
+            longs = sum(1 for c in length if c in 'ljL')
+            if conv in 'diuxXoc':
+                if longs >= 2 or length == 'j':
+                    value = args.take('<q')
+                else:
+                    value = args.take('<i')
+                if conv in 'uxXo':
+                    value &= (1 << (64 if longs >= 2 or length == 'j' else 32)) - 1
+                if conv == 'c':
+                    value = chr(value & 0xff)
+                elif conv in 'iu':
+                    conv = 'd'
+                out.append((spec + conv) % value)
+            elif conv in 'pn':
+                value = args.take('<I')
+                if conv == 'p':
+                    out.append((spec + 's') % ('0x%x' % value))
+            elif conv in 'fFeEgGaA':
+                value = args.take('<d')
+                if conv in 'aA':
+                    out.append(float.hex(value))
+                else:
+                    out.append((spec + conv) % value)
+            elif conv == 's':
+                length_byte = args.take('<B')
+                if length_byte == STR_ADDR:
+                    value = elf.read_string(args.take('<I'))
+                else:
+                    value = args.take_bytes(length_byte).decode('utf-8', 'replace')
+                out.append((spec + 's') % value)
+            else:
+                # unknown conversion, the device stops encoding here as well
+                out.append(fmt[m.start():])
+                last = len(fmt)
+                break
+        except Truncated:
+            out.append('<...>')
+            last = len(fmt)
+            break
+    out.append(fmt[last:])
+    text = ''.join(out)
+    if (flags & FLAG_TRUNCATED) != 0 and not text.endswith('\n'):
+        text += '\n'
+    return text
+
+
+def decode(elf, data, out):
+    pos = 0
+    while pos + HEADER_SIZE <= len(data):
+        (size, flags, format_addr) = struct.unpack_from('<HBI', data, pos)
+        if size < HEADER_SIZE or pos + size > len(data):
+            raise ValueError('invalid record at offset %d' % pos)
+        out.write(format_record(elf, data[pos + HEADER_SIZE:pos + size], flags, format_addr))
+        pos += size
+    if pos != len(data):
+        sys.stderr.write('ignoring %d trailing bytes\n' % (len(data) - pos))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 binary log decoder')
+    parser.add_argument('elf', help='ELF file of the application which produced the log',
+                        type=argparse.FileType('rb'))
+    parser.add_argument('input', help='Binary log records. Will use stdin if omitted.',
+                        type=argparse.FileType('rb'), nargs='?', default=None)
+    parser.add_argument('output', help='Path to output file. Will use stdout if omitted.',
+                        type=argparse.FileType('w'), nargs='?', default=sys.stdout)
+    args = parser.parse_args()
+
+    elf = ElfImage(args.elf)
+    if args.input is None:
+        data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+    else:
+        data = args.input.read()
+    decode(elf, data, args.output)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except ValueError as e:
+        sys.stderr.write(str(e) + '\n')
+        sys.exit(2)
@@ -0,0 +1,7 @@
+#
+# Component Makefile
+#
+
+COMPONENT_ADD_INCLUDEDIRS := include
+
+include $(IDF_PATH)/make/component_common.mk
@@ -0,0 +1,213 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_LOGFS_H__
+#define __ESP_LOGFS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Log-structured file system for append-only files, such as data logs.
+ *
+ * The partition is used as a ring of 4 kB sectors. Data appended to a file,
+ * and changes to the list of files, are written as records at the head of
+ * the ring. When free sectors run out, the live records of the oldest
+ * sector are copied to the head and the sector is reused, so all sectors
+ * are erased equally often.
+ *
+ * Each file has an index of where its data is in RAM, so appending writes
+ * just the new record, and reading finds the record without searching
+ * flash. Mounting reads the header of each sector, the summary of the
+ * records each full sector has, and the records of the newest sector.
+ */
+
+#define ESP_ERR_LOGFS_BASE              0x1600
+#define ESP_ERR_LOGFS_NOT_FORMATTED     (ESP_ERR_LOGFS_BASE + 0x01)  /*!< the partition has no file system */
+#define ESP_ERR_LOGFS_FULL              (ESP_ERR_LOGFS_BASE + 0x02)  /*!< no room for the data */
+#define ESP_ERR_LOGFS_TOO_MANY_FILES    (ESP_ERR_LOGFS_BASE + 0x03)  /*!< CONFIG_LOGFS_MAX_FILES files exist */
+#define ESP_ERR_LOGFS_EXISTS            (ESP_ERR_LOGFS_BASE + 0x04)  /*!< a file with this name exists */
+#define ESP_ERR_LOGFS_CORRUPT           (ESP_ERR_LOGFS_BASE + 0x05)  /*!< data doesn't match the index */
+
+#define LOGFS_NAME_MAX      27      /*!< maximum length of file names */
+
+typedef struct logfs_t logfs_t;
+
+typedef struct {
+    uint32_t sector_count;  /*!< sectors of the partition */
+    size_t total_bytes;     /*!< room for file data, including record headers */
+    size_t used_bytes;      /*!< space taken by file data */
+    uint32_t erase_count;   /*!< times each sector has been erased, give or take one */
+    uint32_t gc_bytes;      /*!< bytes copied by garbage collection since mounting */
+} logfs_info_t;
+
+/**
+ * @brief Create an empty file system
+ *
+ * Only one sector is erased, data of an earlier file system in the other
+ * sectors is ignored.
+ *
+ * @param offset  of the partition in flash, multiple of SPI_FLASH_SEC_SIZE
+ * @param size    of the partition, at least 4 sectors
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG or an error of spi_flash
+ */
+esp_err_t logfs_format(uint32_t offset, size_t size);
+
+/**
+ * @brief Mount a file system
+ *
+ * @param offset  of the partition in flash
+ * @param size    of the partition
+ * @param out_fs  receives the file system
+ *
+ * @return ESP_OK, ESP_ERR_LOGFS_NOT_FORMATTED, ESP_ERR_INVALID_ARG,
+ *         ESP_ERR_NO_MEM or an error of spi_flash
+ */
+esp_err_t logfs_mount(uint32_t offset, size_t size, logfs_t **out_fs);
+
+/**
+ * @brief Write buffered data and free the file system
+ */
+void logfs_unmount(logfs_t *fs);
+
+/**
+ * @brief Write data which is still in the spi_flash write buffer
+ *
+ * Records are buffered with spi_flash_write_buffered if
+ * CONFIG_SPI_FLASH_WRITE_BUFFER is set, which writes them when a page is
+ * full or after CONFIG_SPI_FLASH_WRITE_BUFFER_TIMEOUT. Data in the buffer is
+ * lost on power loss.
+ *
+ * @return ESP_OK or an error of spi_flash
+ */
+esp_err_t logfs_sync(logfs_t *fs);
+
+/**
+ * @brief Find a file
+ *
+ * @param name     file name
+ * @param out_id   receives the identifier of the file
+ * @param out_size receives the size of the file, may be NULL
+ *
+ * @return ESP_OK or ESP_ERR_NOT_FOUND
+ */
+esp_err_t logfs_lookup(logfs_t *fs, const char *name, uint16_t *out_id, uint32_t *out_size);
+
+/**
+ * @brief Create an empty file
+ *
+ * @param name     file name, at most LOGFS_NAME_MAX characters
+ * @param out_id   receives the identifier of the file
+ *
+ * @return ESP_OK, ESP_ERR_LOGFS_EXISTS, ESP_ERR_LOGFS_TOO_MANY_FILES,
+ *         ESP_ERR_INVALID_ARG, ESP_ERR_LOGFS_FULL or an error of spi_flash
+ */
+esp_err_t logfs_create(logfs_t *fs, const char *name, uint16_t *out_id);
+
+/**
+ * @brief Delete a file
+ *
+ * Identifiers aren't reused, so the identifier of the file stays invalid.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_LOGFS_FULL or an error of spi_flash
+ */
+esp_err_t logfs_remove(logfs_t *fs, const char *name);
+
+/**
+ * @brief Rename a file
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_LOGFS_EXISTS, ESP_ERR_INVALID_ARG,
+ *         ESP_ERR_LOGFS_FULL or an error of spi_flash
+ */
+esp_err_t logfs_rename(logfs_t *fs, const char *src, const char *dst);
+
+/**
+ * @brief Append data to a file
+ *
+ * Data is written in one or more records at the head of the log. Either
+ * all of it is appended, or, if the file system is full, none.
+ *
+ * @param id    file identifier from logfs_lookup or logfs_create
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_LOGFS_FULL, ESP_ERR_NO_MEM or
+ *         an error of spi_flash
+ */
+esp_err_t logfs_append(logfs_t *fs, uint16_t id, const void *data, size_t size);
+
+/**
+ * @brief Read data from a file
+ *
+ * @param id       file identifier
+ * @param pos      position in the file
+ * @param dst      receives the data
+ * @param size     number of bytes to read
+ * @param out_read receives the number of bytes read, less than size at the
+ *                 end of the file
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_LOGFS_CORRUPT or an error of
+ *         spi_flash
+ */
+esp_err_t logfs_read(logfs_t *fs, uint16_t id, uint32_t pos, void *dst, size_t size, size_t *out_read);
+
+/**
+ * @brief Get the size of a file
+ *
+ * @return ESP_OK or ESP_ERR_NOT_FOUND
+ */
+esp_err_t logfs_get_size(logfs_t *fs, uint16_t id, uint32_t *out_size);
+
+/**
+ * @brief Get the name of the n-th file, to list the files
+ *
+ * @param index  0 for the first file
+ * @param name   receives the name, LOGFS_NAME_MAX + 1 bytes
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if there are index files or less
+ */
+esp_err_t logfs_get_name(logfs_t *fs, size_t index, char *name);
+
+/**
+ * @brief Get space usage and wear of the file system
+ */
+void logfs_get_info(logfs_t *fs, logfs_info_t *info);
+
+/**
+ * @brief Make a file system on a flash partition available through the VFS
+ *
+ * Files are opened as base_path/name, there are no directories. Files can
+ * only be appended to: writes append to the end of the file regardless of
+ * the file position, and O_TRUNC deletes the data of the file. lseek,
+ * fstat, stat, unlink and rename are supported. close writes buffered data
+ * to flash.
+ *
+ * @param base_path  path, e.g. "/log"
+ * @param label      label of the partition in the partition table
+ * @param format_if_empty  format the partition if it has no file system
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no such partition, or an
+ *         error of logfs_mount, logfs_format or esp_vfs_register
+ */
+esp_err_t esp_vfs_logfs_register(const char *base_path, const char *label, bool format_if_empty);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_LOGFS_H__ */
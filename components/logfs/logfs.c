@@ -0,0 +1,1337 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "esp_logfs.h"
+#include "esp_spi_flash.h"
+#include "rom/crc.h"
+#include "sdkconfig.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#define LOGFS_LOCK(fs)      xSemaphoreTake((fs)->lock, portMAX_DELAY)
+#define LOGFS_UNLOCK(fs)    xSemaphoreGive((fs)->lock)
+#else
+/* host tests are single threaded */
+#define LOGFS_LOCK(fs)
+#define LOGFS_UNLOCK(fs)
+#endif
+
+/*
+ * Sector layout:
+ *
+ *    0  sector_hdr_t, written when the sector becomes the head of the log
+ *   16  sector_summary_t, written when the sector is full
+ *  256  records
+ *
+ * Sectors are used in order of their seq, which goes up by one for each
+ * sector, so sector (head - n) has seq (head_seq - n) and the sectors from
+ * tail_seq to head_seq hold the log. The first record of each sector is a
+ * checkpoint of the list of files. The summary lists the data in the sector
+ * as runs of consecutive file data, so that mounting reads the records of
+ * the head sector only.
+ *
+ * Data is never overwritten: files are append-only, and data copied by
+ * garbage collection keeps its position in the file, so copies of the
+ * same file data are interchangeable. The newest copy is used.
+ */
+
+#define LOGFS_MAGIC         0x5346474c  /* "LGFS" */
+#define SECTOR_SIZE         SPI_FLASH_SEC_SIZE
+#define SUMMARY_OFFSET      sizeof(sector_hdr_t)
+#define SUMMARY_RUNS        14
+#define RECORDS_OFFSET      256
+
+#define ID_FREE             0xffff      /* erased flash */
+#define ID_CHECKPOINT       0xfff0      /* checkpoint_hdr_t and checkpoint_file_t for each file */
+#define ID_CREATE           0xfff1      /* file_pos is the id, data the name */
+#define ID_DELETE           0xfff2      /* file_pos is the id */
+#define ID_RENAME           0xfff3      /* file_pos is the id, data the new name */
+#define ID_GC               0xfff4      /* file_pos is the new tail_seq */
+#define ID_MAX              0xffef      /* highest file id */
+
+#define SUMMARY_OPEN        0xffff      /* sector not full yet */
+#define SUMMARY_OVERFLOW    0xfffe      /* too many runs, records have to be read */
+
+/* Sectors kept free for garbage collection, which may have to copy a full
+ * sector to the head, and start a new sector on the way */
+#define SPARE_SECTORS       3
+
+/* Records shorter than this aren't written at the end of a sector */
+#define MIN_PAYLOAD         16
+
+#define ALIGN4(n)           (((n) + 3) & ~3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t reserved;
+    uint32_t crc;       // of the fields above
+} sector_hdr_t;
+
+/* Data of a file in a sector, from the record at offset on */
+typedef struct {
+    uint16_t file_id;
+    uint16_t offset;
+    uint32_t file_pos;
+    uint32_t len;
+    uint32_t bytes;     // flash space of the records
+} run_t;
+
+typedef struct {
+    uint16_t count;     // SUMMARY_OPEN or SUMMARY_OVERFLOW if no runs follow
+    uint16_t reserved;
+    uint32_t crc;       // of count and the runs
+    run_t runs[SUMMARY_RUNS];
+} sector_summary_t;
+
+typedef struct {
+    uint16_t file_id;   // or one of the ID_ values
+    uint16_t len;       // of the data
+    uint32_t file_pos;
+    uint32_t crc;       // of the fields above and the data
+} record_hdr_t;
+
+typedef struct {
+    uint32_t tail_seq;
+    uint16_t next_id;
+    uint16_t count;
+} checkpoint_hdr_t;
+
+typedef struct {
+    uint16_t id;        // 0 if the entry is free
+    uint16_t reserved;
+    char name[LOGFS_NAME_MAX + 1];
+} checkpoint_file_t;
+
+#define CHECKPOINT_MAX      (sizeof(record_hdr_t) + sizeof(checkpoint_hdr_t) + \
+                             CONFIG_LOGFS_MAX_FILES * sizeof(checkpoint_file_t))
+
+/* Longest record, so that any record fits into a sector after a checkpoint */
+#define MAX_PAYLOAD         ((SECTOR_SIZE - RECORDS_OFFSET - CHECKPOINT_MAX - sizeof(record_hdr_t)) & ~3)
+
+/* Data of a file in the RAM index, like run_t */
+typedef struct {
+    uint16_t sector;
+    uint16_t offset;
+    uint32_t file_pos;
+    uint32_t len;
+    uint32_t bytes;
+} extent_t;
+
+typedef struct {
+    checkpoint_file_t entry;
+    uint32_t size;
+    extent_t *extents;  // sorted by file_pos, without gaps or overlaps
+    size_t extent_count;
+    size_t extent_cap;
+    /* record at which the last read ended, valid while rd_gen == gen */
+    uint32_t rd_gen;
+    uint16_t rd_sector;
+    uint16_t rd_offset;
+    uint32_t rd_pos;
+} logfs_file_t;
+
+typedef struct {
+    const void *data;
+    size_t len;
+} chunk_t;
+
+struct logfs_t {
+    uint32_t offset;
+    uint32_t sector_count;
+    uint32_t head;              // sector records are written to
+    uint32_t head_seq;
+    uint32_t head_pos;          // offset of the next record in the head
+    bool head_closed;           // summary of the head is written
+    uint16_t head_run_count;    // or SUMMARY_OVERFLOW
+    run_t head_runs[SUMMARY_RUNS];
+    uint32_t tail_seq;          // oldest sector with live data
+    uint16_t next_id;
+    uint32_t *live;             // bytes of live records in each sector
+    size_t live_total;
+    uint32_t gc_bytes;
+    uint32_t gen;               // incremented when a sector is erased
+    bool in_gc;
+    bool unflushed;             // records may be in the spi_flash write buffer
+    logfs_file_t files[CONFIG_LOGFS_MAX_FILES];
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t lock;
+#endif
+};
+
+static esp_err_t start_sector(logfs_t *fs);
+
+static inline uint32_t record_size(size_t len)
+{
+    return sizeof(record_hdr_t) + ALIGN4(len);
+}
+
+static inline uint32_t sector_addr(const logfs_t *fs, uint32_t sector)
+{
+    return fs->offset + sector * SECTOR_SIZE;
+}
+
+static inline uint32_t free_sectors(const logfs_t *fs)
+{
+    return fs->sector_count - (fs->head_seq - fs->tail_seq + 1);
+}
+
+/* Room for records in the sectors which aren't spare, less the checkpoint,
+ * the garbage collection record and what may be left at the end */
+static inline size_t capacity(const logfs_t *fs)
+{
+    return (fs->sector_count - SPARE_SECTORS) *
+           (SECTOR_SIZE - RECORDS_OFFSET - CHECKPOINT_MAX - record_size(0) - record_size(MIN_PAYLOAD));
+}
+
+static uint32_t seq_sector(const logfs_t *fs, uint32_t seq)
+{
+    uint32_t back = (fs->head_seq - seq) % fs->sector_count;
+    return (fs->head + fs->sector_count - back) % fs->sector_count;
+}
+
+static esp_err_t flash_flush(logfs_t *fs)
+{
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+    if (fs->unflushed) {
+        esp_err_t err = spi_flash_write_buffer_flush();
+        if (err != ESP_OK) {
+            return err;
+        }
+        fs->unflushed = false;
+    }
+#endif
+    return ESP_OK;
+}
+
+static esp_err_t flash_read(logfs_t *fs, uint32_t sector, uint32_t offset, void *dst, size_t size)
+{
+    if (sector == fs->head) {
+        esp_err_t err = flash_flush(fs);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return spi_flash_read_bytes(sector_addr(fs, sector) + offset, dst, size);
+}
+
+/* Appends are combined into page writes by the spi_flash write buffer */
+static esp_err_t flash_write(logfs_t *fs, uint32_t sector, uint32_t offset, const void *src, size_t size)
+{
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+    fs->unflushed = true;
+    return spi_flash_write_buffered(sector_addr(fs, sector) + offset, src, size);
+#else
+    return spi_flash_write_bytes(sector_addr(fs, sector) + offset, src, size);
+#endif
+}
+
+static esp_err_t flash_erase(logfs_t *fs, uint32_t sector)
+{
+    esp_err_t err = flash_flush(fs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++fs->gen;
+    return spi_flash_erase_sector(sector_addr(fs, sector) / SECTOR_SIZE);
+}
+
+static uint32_t sector_hdr_crc(const sector_hdr_t *hdr)
+{
+    return crc32_le(0, (const uint8_t *) hdr, offsetof(sector_hdr_t, crc));
+}
+
+static esp_err_t read_sector_hdr(logfs_t *fs, uint32_t sector, sector_hdr_t *hdr, bool *valid)
+{
+    esp_err_t err = spi_flash_read_bytes(sector_addr(fs, sector), hdr, sizeof(*hdr));
+    *valid = err == ESP_OK && hdr->magic == LOGFS_MAGIC && hdr->crc == sector_hdr_crc(hdr);
+    return err;
+}
+
+/* Read the header of the record at offset. *valid is false at the end of
+ * the records, or if the header is damaged */
+static esp_err_t read_record_hdr(logfs_t *fs, uint32_t sector, uint32_t offset, record_hdr_t *hdr, bool *valid)
+{
+    *valid = false;
+    if (offset + sizeof(*hdr) > SECTOR_SIZE) {
+        return ESP_OK;
+    }
+    esp_err_t err = flash_read(fs, sector, offset, hdr, sizeof(*hdr));
+    if (err != ESP_OK) {
+        return err;
+    }
+    *valid = hdr->file_id != ID_FREE && offset + record_size(hdr->len) <= SECTOR_SIZE;
+    return ESP_OK;
+}
+
+/* Check the CRC of a record, and read the first dst_size bytes of its data */
+static esp_err_t check_record(logfs_t *fs, uint32_t sector, uint32_t offset, const record_hdr_t *hdr,
+                              void *dst, size_t dst_size, bool *valid)
+{
+    uint8_t buf[64];
+    uint32_t crc = crc32_le(0, (const uint8_t *) hdr, offsetof(record_hdr_t, crc));
+    for (size_t pos = 0; pos < hdr->len; pos += sizeof(buf)) {
+        size_t n = hdr->len - pos < sizeof(buf) ? hdr->len - pos : sizeof(buf);
+        esp_err_t err = flash_read(fs, sector, offset + sizeof(*hdr) + pos, buf, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        crc = crc32_le(crc, buf, n);
+        if (pos < dst_size) {
+            memcpy((uint8_t *) dst + pos, buf, dst_size - pos < n ? dst_size - pos : n);
+        }
+    }
+    *valid = crc == hdr->crc;
+    return ESP_OK;
+}
+
+/* Write a record at the head, which must have room for it */
+static esp_err_t write_record(logfs_t *fs, uint16_t file_id, uint32_t file_pos,
+                              const chunk_t *chunks, size_t chunk_count)
+{
+    record_hdr_t hdr = {
+        .file_id = file_id,
+        .len = 0,
+        .file_pos = file_pos,
+    };
+    for (size_t i = 0; i < chunk_count; ++i) {
+        hdr.len += chunks[i].len;
+    }
+    hdr.crc = crc32_le(0, (const uint8_t *) &hdr, offsetof(record_hdr_t, crc));
+    for (size_t i = 0; i < chunk_count; ++i) {
+        hdr.crc = crc32_le(hdr.crc, chunks[i].data, chunks[i].len);
+    }
+    esp_err_t err = flash_write(fs, fs->head, fs->head_pos, &hdr, sizeof(hdr));
+    uint32_t pos = fs->head_pos + sizeof(hdr);
+    for (size_t i = 0; i < chunk_count && err == ESP_OK; ++i) {
+        err = flash_write(fs, fs->head, pos, chunks[i].data, chunks[i].len);
+        pos += chunks[i].len;
+    }
+    if (err != ESP_OK) {
+        /* don't write behind a record which may be incomplete */
+        fs->head_pos = SECTOR_SIZE;
+        return err;
+    }
+    fs->head_pos += record_size(hdr.len);
+    return ESP_OK;
+}
+
+/* Make room for a record at the head */
+static esp_err_t reserve(logfs_t *fs, uint32_t bytes)
+{
+    if (fs->head_pos + bytes <= SECTOR_SIZE) {
+        return ESP_OK;
+    }
+    return start_sector(fs);
+}
+
+static logfs_file_t *find_id(logfs_t *fs, uint16_t id)
+{
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        if (id != 0 && fs->files[i].entry.id == id) {
+            return &fs->files[i];
+        }
+    }
+    return NULL;
+}
+
+static logfs_file_t *find_name(logfs_t *fs, const char *name)
+{
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        if (fs->files[i].entry.id != 0 &&
+                strncmp(fs->files[i].entry.name, name, sizeof(fs->files[i].entry.name)) == 0) {
+            return &fs->files[i];
+        }
+    }
+    return NULL;
+}
+
+static logfs_file_t *find_free(logfs_t *fs)
+{
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        if (fs->files[i].entry.id == 0) {
+            return &fs->files[i];
+        }
+    }
+    return NULL;
+}
+
+static void sub_live(logfs_t *fs, uint32_t sector, uint32_t bytes)
+{
+    if (bytes > fs->live[sector]) {
+        bytes = fs->live[sector];
+    }
+    fs->live[sector] -= bytes;
+    fs->live_total -= bytes;
+}
+
+/* Index of the first extent which ends after pos */
+static size_t extent_find(const logfs_file_t *f, uint32_t pos)
+{
+    size_t lo = 0;
+    size_t hi = f->extent_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const extent_t *e = &f->extents[mid];
+        if (e->file_pos + e->len <= pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void extent_split(extent_t *e, uint32_t pos, uint32_t len)
+{
+    uint32_t bytes = (uint32_t) ((uint64_t) e->bytes * len / e->len);
+    e->file_pos = pos;
+    e->len = len;
+    e->bytes = bytes;
+}
+
+/* Add data at [pos, pos + len) to the index of a file, replacing older
+ * copies of the range. Appending to the last extent takes constant time. */
+static esp_err_t extent_put(logfs_t *fs, logfs_file_t *f, uint32_t sector, uint32_t offset,
+                            uint32_t pos, uint32_t len, uint32_t bytes)
+{
+    if (f->extent_count > 0) {
+        extent_t *last = &f->extents[f->extent_count - 1];
+        if (last->file_pos + last->len == pos && last->sector == sector && last->offset <= offset) {
+            last->len += len;
+            last->bytes += bytes;
+            fs->live[sector] += bytes;
+            fs->live_total += bytes;
+            return ESP_OK;
+        }
+    }
+    size_t first = extent_find(f, pos);
+    size_t end = first;
+    while (end < f->extent_count && f->extents[end].file_pos < pos + len) {
+        ++end;
+    }
+    extent_t parts[3];
+    size_t count = 0;
+    if (first < end && f->extents[first].file_pos < pos) {
+        parts[count] = f->extents[first];
+        extent_split(&parts[count], parts[count].file_pos, pos - parts[count].file_pos);
+        ++count;
+    }
+    parts[count++] = (extent_t) {
+        .sector = sector,
+        .offset = offset,
+        .file_pos = pos,
+        .len = len,
+        .bytes = bytes,
+    };
+    if (first < end) {
+        const extent_t *e = &f->extents[end - 1];
+        if (e->file_pos + e->len > pos + len) {
+            parts[count] = *e;
+            extent_split(&parts[count], pos + len, e->file_pos + e->len - (pos + len));
+            ++count;
+        }
+    }
+    size_t new_count = f->extent_count - (end - first) + count;
+    if (new_count > f->extent_cap) {
+        size_t cap = f->extent_cap ? f->extent_cap * 2 : 4;
+        extent_t *extents = realloc(f->extents, cap * sizeof(extent_t));
+        if (extents == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        f->extents = extents;
+        f->extent_cap = cap;
+    }
+    for (size_t i = first; i < end; ++i) {
+        sub_live(fs, f->extents[i].sector, f->extents[i].bytes);
+    }
+    memmove(&f->extents[first + count], &f->extents[end], (f->extent_count - end) * sizeof(extent_t));
+    for (size_t i = 0; i < count; ++i) {
+        f->extents[first + i] = parts[i];
+        fs->live[parts[i].sector] += parts[i].bytes;
+        fs->live_total += parts[i].bytes;
+    }
+    f->extent_count = new_count;
+    return ESP_OK;
+}
+
+static void file_clear(logfs_t *fs, logfs_file_t *f)
+{
+    for (size_t i = 0; i < f->extent_count; ++i) {
+        sub_live(fs, f->extents[i].sector, f->extents[i].bytes);
+    }
+    free(f->extents);
+    memset(f, 0, sizeof(*f));
+}
+
+/* Remember a record written to the head for the summary of the sector */
+static void head_run_add(logfs_t *fs, uint16_t file_id, uint32_t offset, uint32_t pos, uint32_t len, uint32_t bytes)
+{
+    if (fs->head_run_count == SUMMARY_OVERFLOW) {
+        return;
+    }
+    for (size_t i = fs->head_run_count; i-- > 0;) {
+        run_t *run = &fs->head_runs[i];
+        if (run->file_id == file_id && run->file_pos + run->len == pos) {
+            run->len += len;
+            run->bytes += bytes;
+            return;
+        }
+    }
+    if (fs->head_run_count == SUMMARY_RUNS) {
+        fs->head_run_count = SUMMARY_OVERFLOW;
+        return;
+    }
+    fs->head_runs[fs->head_run_count++] = (run_t) {
+        .file_id = file_id,
+        .offset = offset,
+        .file_pos = pos,
+        .len = len,
+        .bytes = bytes,
+    };
+}
+
+/* Add a data record written at the head to the index */
+static esp_err_t index_head_record(logfs_t *fs, logfs_file_t *f, uint32_t offset, const record_hdr_t *hdr)
+{
+    uint32_t bytes = record_size(hdr->len);
+    head_run_add(fs, hdr->file_id, offset, hdr->file_pos, hdr->len, bytes);
+    esp_err_t err = extent_put(fs, f, fs->head, offset, hdr->file_pos, hdr->len, bytes);
+    if (err == ESP_OK && hdr->file_pos + hdr->len > f->size) {
+        f->size = hdr->file_pos + hdr->len;
+    }
+    return err;
+}
+
+static esp_err_t write_checkpoint(logfs_t *fs)
+{
+    checkpoint_hdr_t cp = {
+        .tail_seq = fs->tail_seq,
+        .next_id = fs->next_id,
+        .count = 0,
+    };
+    chunk_t chunks[1 + CONFIG_LOGFS_MAX_FILES];
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        if (fs->files[i].entry.id != 0) {
+            ++cp.count;
+            chunks[cp.count] = (chunk_t) { &fs->files[i].entry, sizeof(checkpoint_file_t) };
+        }
+    }
+    chunks[0] = (chunk_t) { &cp, sizeof(cp) };
+    return write_record(fs, ID_CHECKPOINT, 0, chunks, 1 + cp.count);
+}
+
+/* Erase a sector and make it the head */
+static esp_err_t init_sector(logfs_t *fs, uint32_t sector, uint32_t seq)
+{
+    esp_err_t err = flash_erase(fs, sector);
+    if (err != ESP_OK) {
+        return err;
+    }
+    sector_hdr_t hdr = {
+        .magic = LOGFS_MAGIC,
+        .seq = seq,
+        .reserved = 0xffffffff,
+    };
+    hdr.crc = sector_hdr_crc(&hdr);
+    fs->head = sector;
+    fs->head_seq = seq;
+    fs->head_pos = SECTOR_SIZE;
+    fs->head_closed = false;
+    fs->head_run_count = 0;
+    fs->live[sector] = 0;
+    err = flash_write(fs, sector, 0, &hdr, sizeof(hdr));
+    if (err != ESP_OK) {
+        return err;
+    }
+    fs->head_pos = RECORDS_OFFSET;
+    return write_checkpoint(fs);
+}
+
+static esp_err_t close_sector(logfs_t *fs)
+{
+    if (fs->head_closed) {
+        return ESP_OK;
+    }
+    sector_summary_t summary = {
+        .count = fs->head_run_count,
+        .reserved = 0xffff,
+    };
+    size_t size = offsetof(sector_summary_t, runs);
+    if (summary.count != SUMMARY_OVERFLOW) {
+        memcpy(summary.runs, fs->head_runs, summary.count * sizeof(run_t));
+        size += summary.count * sizeof(run_t);
+    }
+    summary.crc = crc32_le(0, (const uint8_t *) &summary, offsetof(sector_summary_t, crc));
+    summary.crc = crc32_le(summary.crc, (const uint8_t *) summary.runs, size - offsetof(sector_summary_t, runs));
+    esp_err_t err = flash_write(fs, fs->head, SUMMARY_OFFSET, &summary, size);
+    if (err == ESP_OK) {
+        fs->head_closed = true;
+    }
+    return err;
+}
+
+/* Copy a live record of the tail sector to the head. It is split if it
+ * doesn't fit into the head, so that no space is left at its end. */
+static esp_err_t copy_record(logfs_t *fs, logfs_file_t *f, uint32_t sector, uint32_t offset, const record_hdr_t *hdr)
+{
+    uint8_t buf[128];
+    uint32_t src = offset + sizeof(*hdr);
+    uint32_t pos = hdr->file_pos;
+    uint32_t len = hdr->len;
+    while (len > 0) {
+        esp_err_t err;
+        uint32_t room = SECTOR_SIZE - fs->head_pos;
+        if (room < record_size(len < MIN_PAYLOAD ? len : MIN_PAYLOAD)) {
+            err = start_sector(fs);
+            if (err != ESP_OK) {
+                return err;
+            }
+            continue;
+        }
+        record_hdr_t copy = {
+            .file_id = hdr->file_id,
+            .len = len < room - sizeof(copy) ? len : room - sizeof(copy),
+            .file_pos = pos,
+        };
+        copy.crc = crc32_le(0, (const uint8_t *) &copy, offsetof(record_hdr_t, crc));
+        for (uint32_t i = 0; i < copy.len; i += sizeof(buf)) {
+            size_t n = copy.len - i < sizeof(buf) ? copy.len - i : sizeof(buf);
+            err = flash_read(fs, sector, src + i, buf, n);
+            if (err != ESP_OK) {
+                return err;
+            }
+            copy.crc = crc32_le(copy.crc, buf, n);
+        }
+        uint32_t dst = fs->head_pos;
+        err = flash_write(fs, fs->head, dst, &copy, sizeof(copy));
+        for (uint32_t i = 0; i < copy.len && err == ESP_OK; i += sizeof(buf)) {
+            size_t n = copy.len - i < sizeof(buf) ? copy.len - i : sizeof(buf);
+            err = flash_read(fs, sector, src + i, buf, n);
+            if (err == ESP_OK) {
+                err = flash_write(fs, fs->head, dst + sizeof(copy) + i, buf, n);
+            }
+        }
+        if (err != ESP_OK) {
+            fs->head_pos = SECTOR_SIZE;
+            return err;
+        }
+        fs->head_pos += record_size(copy.len);
+        fs->gc_bytes += record_size(copy.len);
+        err = index_head_record(fs, f, dst, &copy);
+        if (err != ESP_OK) {
+            return err;
+        }
+        src += copy.len;
+        pos += copy.len;
+        len -= copy.len;
+    }
+    return ESP_OK;
+}
+
+static bool record_is_live(logfs_t *fs, const logfs_file_t *f, uint32_t sector, const record_hdr_t *hdr)
+{
+    for (size_t i = extent_find(f, hdr->file_pos);
+            i < f->extent_count && f->extents[i].file_pos < hdr->file_pos + hdr->len; ++i) {
+        if (f->extents[i].sector == sector) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Remove what is left of a sector from the index, after its records
+ * were copied (or couldn't be read) */
+static void drop_sector(logfs_t *fs, uint32_t sector)
+{
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        logfs_file_t *f = &fs->files[i];
+        size_t n = 0;
+        for (size_t j = 0; j < f->extent_count; ++j) {
+            if (f->extents[j].sector != sector) {
+                f->extents[n++] = f->extents[j];
+            }
+        }
+        f->extent_count = n;
+    }
+    fs->live_total -= fs->live[sector];
+    fs->live[sector] = 0;
+}
+
+/* Garbage collection: copy the live records of the tail sector to the
+ * head, and free the tail sector */
+static esp_err_t collect(logfs_t *fs)
+{
+    uint32_t sector = seq_sector(fs, fs->tail_seq);
+    esp_err_t err = ESP_OK;
+    fs->in_gc = true;
+    for (uint32_t offset = RECORDS_OFFSET; ;) {
+        record_hdr_t hdr;
+        bool valid;
+        err = read_record_hdr(fs, sector, offset, &hdr, &valid);
+        if (err != ESP_OK || !valid) {
+            break;
+        }
+        if (hdr.file_id <= ID_MAX) {
+            logfs_file_t *f = find_id(fs, hdr.file_id);
+            if (f != NULL && record_is_live(fs, f, sector, &hdr)) {
+                err = copy_record(fs, f, sector, offset, &hdr);
+                if (err != ESP_OK) {
+                    break;
+                }
+            }
+        }
+        offset += record_size(hdr.len);
+    }
+    if (err == ESP_OK) {
+        drop_sector(fs, sector);
+        ++fs->tail_seq;
+        err = reserve(fs, record_size(0));
+        if (err == ESP_OK) {
+            err = write_record(fs, ID_GC, fs->tail_seq, NULL, 0);
+        }
+    }
+    fs->in_gc = false;
+    return err;
+}
+
+/* Close the head sector and continue the log in the next one */
+static esp_err_t start_sector(logfs_t *fs)
+{
+    esp_err_t err;
+    for (uint32_t i = 0; !fs->in_gc && free_sectors(fs) < SPARE_SECTORS; ++i) {
+        if (i == 2 * fs->sector_count) {
+            /* went around the log twice, which compacts it */
+            return ESP_ERR_LOGFS_FULL;
+        }
+        err = collect(fs);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    if (free_sectors(fs) == 0) {
+        return ESP_ERR_LOGFS_FULL;
+    }
+    err = close_sector(fs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return init_sector(fs, (fs->head + 1) % fs->sector_count, fs->head_seq + 1);
+}
+
+static esp_err_t write_meta(logfs_t *fs, uint16_t type, uint16_t id, const char *name)
+{
+    char buf[LOGFS_NAME_MAX + 1] = { 0 };
+    chunk_t chunk = { buf, sizeof(buf) };
+    if (name != NULL) {
+        strncpy(buf, name, LOGFS_NAME_MAX);
+    }
+    esp_err_t err = reserve(fs, record_size(name != NULL ? sizeof(buf) : 0));
+    if (err != ESP_OK) {
+        return err;
+    }
+    return write_record(fs, type, id, &chunk, name != NULL ? 1 : 0);
+}
+
+static bool name_valid(const char *name)
+{
+    size_t len = strlen(name);
+    return len > 0 && len <= LOGFS_NAME_MAX;
+}
+
+static esp_err_t check_geometry(uint32_t offset, size_t size)
+{
+    if (offset % SECTOR_SIZE != 0 || size / SECTOR_SIZE < SPARE_SECTORS + 1 ||
+            size / SECTOR_SIZE > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/* Find the sector with the highest seq below limit (if limited) */
+static esp_err_t find_newest(logfs_t *fs, bool limited, uint32_t limit, bool *found, uint32_t *out_sector, uint32_t *out_seq)
+{
+    *found = false;
+    for (uint32_t sector = 0; sector < fs->sector_count; ++sector) {
+        sector_hdr_t hdr;
+        bool valid;
+        esp_err_t err = read_sector_hdr(fs, sector, &hdr, &valid);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (valid && (!limited || hdr.seq < limit) && (!*found || hdr.seq > *out_seq)) {
+            *found = true;
+            *out_sector = sector;
+            *out_seq = hdr.seq;
+        }
+    }
+    return ESP_OK;
+}
+
+static logfs_t *fs_alloc(uint32_t offset, size_t size)
+{
+    logfs_t *fs = calloc(1, sizeof(logfs_t));
+    if (fs == NULL) {
+        return NULL;
+    }
+    fs->offset = offset;
+    fs->sector_count = size / SECTOR_SIZE;
+    fs->live = calloc(fs->sector_count, sizeof(uint32_t));
+#ifdef ESP_PLATFORM
+    fs->lock = xSemaphoreCreateMutex();
+    if (fs->lock == NULL) {
+        free(fs->live);
+        fs->live = NULL;
+    }
+#endif
+    if (fs->live == NULL) {
+        free(fs);
+        return NULL;
+    }
+    return fs;
+}
+
+static void fs_free(logfs_t *fs)
+{
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        free(fs->files[i].extents);
+    }
+#ifdef ESP_PLATFORM
+    vSemaphoreDelete(fs->lock);
+#endif
+    free(fs->live);
+    free(fs);
+}
+
+esp_err_t logfs_format(uint32_t offset, size_t size)
+{
+    esp_err_t err = check_geometry(offset, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    logfs_t *fs = fs_alloc(offset, size);
+    if (fs == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    /* sectors of an earlier file system are older than the new one, and
+     * outside of its log */
+    bool found;
+    uint32_t sector, seq = 0;
+    err = find_newest(fs, false, 0, &found, &sector, &seq);
+    if (err == ESP_OK) {
+        seq = found ? seq + 1 : 0;
+        fs->tail_seq = seq;
+        fs->next_id = 1;
+        err = init_sector(fs, 0, seq);
+    }
+    if (err == ESP_OK) {
+        err = flash_flush(fs);
+    }
+    fs_free(fs);
+    return err;
+}
+
+/* Read the checkpoint at the start of a sector into the file table */
+static esp_err_t load_checkpoint(logfs_t *fs, uint32_t sector, bool *valid)
+{
+    record_hdr_t hdr;
+    esp_err_t err = read_record_hdr(fs, sector, RECORDS_OFFSET, &hdr, valid);
+    if (err != ESP_OK || !*valid) {
+        return err;
+    }
+    checkpoint_hdr_t cp;
+    *valid = hdr.file_id == ID_CHECKPOINT && hdr.len >= sizeof(cp) &&
+             (hdr.len - sizeof(cp)) % sizeof(checkpoint_file_t) == 0 &&
+             (hdr.len - sizeof(cp)) / sizeof(checkpoint_file_t) <= CONFIG_LOGFS_MAX_FILES;
+    if (!*valid) {
+        return ESP_OK;
+    }
+    err = check_record(fs, sector, RECORDS_OFFSET, &hdr, &cp, sizeof(cp), valid);
+    if (err != ESP_OK || !*valid) {
+        return err;
+    }
+    fs->tail_seq = cp.tail_seq;
+    fs->next_id = cp.next_id;
+    uint32_t pos = RECORDS_OFFSET + sizeof(hdr) + sizeof(cp);
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        memset(&fs->files[i], 0, sizeof(logfs_file_t));
+        if (i < cp.count) {
+            err = flash_read(fs, sector, pos, &fs->files[i].entry, sizeof(checkpoint_file_t));
+            if (err != ESP_OK) {
+                return err;
+            }
+            fs->files[i].entry.name[LOGFS_NAME_MAX] = 0;
+            pos += sizeof(checkpoint_file_t);
+        }
+    }
+    return ESP_OK;
+}
+
+static bool is_erased(const void *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (((const uint8_t *) data)[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Apply the changes to the files made by the records after the checkpoint
+ * of the head sector, and find the end of the log */
+static esp_err_t replay_head_files(logfs_t *fs)
+{
+    record_hdr_t hdr;
+    bool valid;
+    esp_err_t err = read_record_hdr(fs, fs->head, RECORDS_OFFSET, &hdr, &valid);
+    uint32_t offset = RECORDS_OFFSET + record_size(hdr.len);
+    while (err == ESP_OK) {
+        char name[LOGFS_NAME_MAX + 1] = { 0 };
+        err = read_record_hdr(fs, fs->head, offset, &hdr, &valid);
+        if (err == ESP_OK && valid) {
+            err = check_record(fs, fs->head, offset, &hdr, name, LOGFS_NAME_MAX, &valid);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (!valid) {
+            /* power was lost while this record was written, nothing may
+             * be written behind it */
+            if (offset + sizeof(hdr) <= SECTOR_SIZE && !is_erased(&hdr, sizeof(hdr))) {
+                fs->head_closed = true;
+            }
+            break;
+        }
+        logfs_file_t *f = find_id(fs, (uint16_t) hdr.file_pos);
+        if (hdr.file_id == ID_CREATE && f == NULL && (f = find_free(fs)) != NULL) {
+            f->entry.id = hdr.file_pos;
+            strcpy(f->entry.name, name);
+            if (fs->next_id <= hdr.file_pos) {
+                fs->next_id = hdr.file_pos + 1;
+            }
+        } else if (hdr.file_id == ID_DELETE && f != NULL) {
+            file_clear(fs, f);
+        } else if (hdr.file_id == ID_RENAME && f != NULL) {
+            strcpy(f->entry.name, name);
+        } else if (hdr.file_id == ID_GC && hdr.file_pos > fs->tail_seq) {
+            fs->tail_seq = hdr.file_pos;
+        }
+        offset += record_size(hdr.len);
+    }
+    fs->head_pos = offset;
+    return ESP_OK;
+}
+
+/* Add the data in the head sector to the index, after the older sectors
+ * so that it takes precedence */
+static esp_err_t replay_head_data(logfs_t *fs, uint32_t end)
+{
+    record_hdr_t hdr;
+    bool valid;
+    esp_err_t err = read_record_hdr(fs, fs->head, RECORDS_OFFSET, &hdr, &valid);
+    for (uint32_t offset = RECORDS_OFFSET + record_size(hdr.len); err == ESP_OK && offset < end;
+            offset += record_size(hdr.len)) {
+        err = read_record_hdr(fs, fs->head, offset, &hdr, &valid);
+        logfs_file_t *f = hdr.file_id <= ID_MAX ? find_id(fs, hdr.file_id) : NULL;
+        if (err == ESP_OK && f != NULL) {
+            err = index_head_record(fs, f, offset, &hdr);
+        }
+    }
+    return err;
+}
+
+/* Add the data of a sector which isn't the head to the index */
+static esp_err_t load_sector(logfs_t *fs, uint32_t sector)
+{
+    sector_summary_t summary;
+    esp_err_t err = spi_flash_read_bytes(sector_addr(fs, sector) + SUMMARY_OFFSET, &summary, sizeof(summary));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (summary.count <= SUMMARY_RUNS) {
+        uint32_t crc = crc32_le(0, (const uint8_t *) &summary, offsetof(sector_summary_t, crc));
+        crc = crc32_le(crc, (const uint8_t *) summary.runs, summary.count * sizeof(run_t));
+        if (crc == summary.crc) {
+            for (size_t i = 0; i < summary.count && err == ESP_OK; ++i) {
+                const run_t *run = &summary.runs[i];
+                logfs_file_t *f = find_id(fs, run->file_id);
+                if (f != NULL) {
+                    err = extent_put(fs, f, sector, run->offset, run->file_pos, run->len, run->bytes);
+                    if (run->file_pos + run->len > f->size) {
+                        f->size = run->file_pos + run->len;
+                    }
+                }
+            }
+            return err;
+        }
+    }
+    /* no summary, read the records */
+    for (uint32_t offset = RECORDS_OFFSET; ;) {
+        record_hdr_t hdr;
+        bool valid;
+        err = read_record_hdr(fs, sector, offset, &hdr, &valid);
+        if (err == ESP_OK && valid) {
+            err = check_record(fs, sector, offset, &hdr, NULL, 0, &valid);
+        }
+        if (err != ESP_OK || !valid) {
+            return err;
+        }
+        logfs_file_t *f = hdr.file_id <= ID_MAX ? find_id(fs, hdr.file_id) : NULL;
+        if (f != NULL) {
+            err = extent_put(fs, f, sector, offset, hdr.file_pos, hdr.len, record_size(hdr.len));
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (hdr.file_pos + hdr.len > f->size) {
+                f->size = hdr.file_pos + hdr.len;
+            }
+        }
+        offset += record_size(hdr.len);
+    }
+}
+
+static esp_err_t mount(logfs_t *fs)
+{
+    /* the head is the newest sector with a checkpoint; a newer one without
+     * checkpoint was being started when power was lost, and is free */
+    bool found, valid = false, limited = false;
+    uint32_t sector, seq = 0;
+    while (!valid) {
+        esp_err_t err = find_newest(fs, limited, seq, &found, &sector, &seq);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (!found) {
+            return ESP_ERR_LOGFS_NOT_FORMATTED;
+        }
+        err = load_checkpoint(fs, sector, &valid);
+        if (err != ESP_OK) {
+            return err;
+        }
+        limited = true;
+    }
+    fs->head = sector;
+    fs->head_seq = seq;
+    fs->head_pos = SECTOR_SIZE;
+
+    uint16_t summary_count;
+    esp_err_t err = spi_flash_read_bytes(sector_addr(fs, sector) + SUMMARY_OFFSET, &summary_count, sizeof(summary_count));
+    if (err != ESP_OK) {
+        return err;
+    }
+    fs->head_closed = summary_count != SUMMARY_OPEN;
+    err = replay_head_files(fs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (fs->tail_seq > fs->head_seq) {
+        fs->tail_seq = fs->head_seq;
+    }
+    if (fs->head_seq - fs->tail_seq >= fs->sector_count) {
+        fs->tail_seq = fs->head_seq - fs->sector_count + 1;
+    }
+    for (seq = fs->tail_seq; seq != fs->head_seq; ++seq) {
+        sector_hdr_t hdr;
+        sector = seq_sector(fs, seq);
+        err = read_sector_hdr(fs, sector, &hdr, &valid);
+        if (err == ESP_OK && valid && hdr.seq == seq) {
+            err = load_sector(fs, sector);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    err = replay_head_data(fs, fs->head_pos);
+    if (err != ESP_OK) {
+        return err;
+    }
+    /* a closed or damaged head isn't written to anymore */
+    if (fs->head_closed) {
+        fs->head_pos = SECTOR_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t logfs_mount(uint32_t offset, size_t size, logfs_t **out_fs)
+{
+    esp_err_t err = check_geometry(offset, size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    logfs_t *fs = fs_alloc(offset, size);
+    if (fs == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = mount(fs);
+    if (err != ESP_OK) {
+        fs_free(fs);
+        return err;
+    }
+    *out_fs = fs;
+    return ESP_OK;
+}
+
+void logfs_unmount(logfs_t *fs)
+{
+    flash_flush(fs);
+    fs_free(fs);
+}
+
+esp_err_t logfs_sync(logfs_t *fs)
+{
+    LOGFS_LOCK(fs);
+    esp_err_t err = flash_flush(fs);
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+esp_err_t logfs_lookup(logfs_t *fs, const char *name, uint16_t *out_id, uint32_t *out_size)
+{
+    LOGFS_LOCK(fs);
+    logfs_file_t *f = find_name(fs, name);
+    if (f != NULL) {
+        *out_id = f->entry.id;
+        if (out_size != NULL) {
+            *out_size = f->size;
+        }
+    }
+    LOGFS_UNLOCK(fs);
+    return f != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t logfs_create(logfs_t *fs, const char *name, uint16_t *out_id)
+{
+    if (!name_valid(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    LOGFS_LOCK(fs);
+    esp_err_t err = ESP_OK;
+    logfs_file_t *f = NULL;
+    if (find_name(fs, name) != NULL) {
+        err = ESP_ERR_LOGFS_EXISTS;
+    } else if (fs->next_id > ID_MAX || (f = find_free(fs)) == NULL) {
+        err = ESP_ERR_LOGFS_TOO_MANY_FILES;
+    }
+    if (err == ESP_OK) {
+        uint16_t id = fs->next_id;
+        err = write_meta(fs, ID_CREATE, id, name);
+        if (err == ESP_OK) {
+            ++fs->next_id;
+            f->entry.id = id;
+            strcpy(f->entry.name, name);
+            *out_id = id;
+        }
+    }
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+esp_err_t logfs_remove(logfs_t *fs, const char *name)
+{
+    LOGFS_LOCK(fs);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    logfs_file_t *f = find_name(fs, name);
+    if (f != NULL) {
+        err = write_meta(fs, ID_DELETE, f->entry.id, NULL);
+        if (err == ESP_OK) {
+            file_clear(fs, f);
+        }
+    }
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+esp_err_t logfs_rename(logfs_t *fs, const char *src, const char *dst)
+{
+    if (!name_valid(dst)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    LOGFS_LOCK(fs);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    logfs_file_t *f = find_name(fs, src);
+    if (f != NULL && find_name(fs, dst) != NULL) {
+        err = ESP_ERR_LOGFS_EXISTS;
+    } else if (f != NULL) {
+        err = write_meta(fs, ID_RENAME, f->entry.id, dst);
+        if (err == ESP_OK) {
+            strcpy(f->entry.name, dst);
+        }
+    }
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+esp_err_t logfs_append(logfs_t *fs, uint16_t id, const void *data, size_t size)
+{
+    LOGFS_LOCK(fs);
+    esp_err_t err = ESP_OK;
+    logfs_file_t *f = find_id(fs, id);
+    size_t records = (size + MAX_PAYLOAD - 1) / MAX_PAYLOAD + 1;
+    if (f == NULL) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (fs->live_total + size + records * record_size(0) > capacity(fs)) {
+        err = ESP_ERR_LOGFS_FULL;
+    }
+    const uint8_t *src = (const uint8_t *) data;
+    while (err == ESP_OK && size > 0) {
+        uint32_t room = SECTOR_SIZE - fs->head_pos;
+        if (room < record_size(size < MIN_PAYLOAD ? size : MIN_PAYLOAD)) {
+            err = start_sector(fs);
+            continue;
+        }
+        size_t n = room - sizeof(record_hdr_t);
+        if (n > MAX_PAYLOAD) {
+            n = MAX_PAYLOAD;
+        }
+        if (n > size) {
+            n = size;
+        }
+        record_hdr_t hdr = {
+            .file_id = id,
+            .len = n,
+            .file_pos = f->size,
+        };
+        chunk_t chunk = { src, n };
+        uint32_t offset = fs->head_pos;
+        err = write_record(fs, id, f->size, &chunk, 1);
+        if (err == ESP_OK) {
+            err = index_head_record(fs, f, offset, &hdr);
+        }
+        src += n;
+        size -= n;
+    }
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+static esp_err_t read_extent(logfs_t *fs, logfs_file_t *f, const extent_t *e, uint32_t *pos, uint8_t **dst, size_t *size)
+{
+    uint32_t offset = e->offset;
+    /* continue a sequential read at the record where the last one ended.
+     * Records copied by garbage collection aren't always in order, so the
+     * sector is searched from the start of the extent if that fails. */
+    bool resumed = false;
+    if (f->rd_gen == fs->gen && f->rd_sector == e->sector && f->rd_offset > offset &&
+            f->rd_pos >= e->file_pos && f->rd_pos <= *pos) {
+        offset = f->rd_offset;
+        resumed = true;
+    }
+    uint32_t end = e->file_pos + e->len;
+    while (*size > 0 && *pos < end) {
+        record_hdr_t hdr;
+        bool valid;
+        esp_err_t err = read_record_hdr(fs, e->sector, offset, &hdr, &valid);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (!valid && resumed) {
+            offset = e->offset;
+            resumed = false;
+            continue;
+        }
+        if (!valid) {
+            return ESP_ERR_LOGFS_CORRUPT;
+        }
+        if (hdr.file_id == f->entry.id && hdr.file_pos <= *pos && *pos < hdr.file_pos + hdr.len) {
+            uint32_t n = hdr.file_pos + hdr.len - *pos;
+            if (n > end - *pos) {
+                n = end - *pos;
+            }
+            if (n > *size) {
+                n = *size;
+            }
+            err = flash_read(fs, e->sector, offset + sizeof(hdr) + (*pos - hdr.file_pos), *dst, n);
+            if (err != ESP_OK) {
+                return err;
+            }
+            f->rd_gen = fs->gen;
+            f->rd_sector = e->sector;
+            f->rd_offset = offset;
+            f->rd_pos = hdr.file_pos;
+            *pos += n;
+            *dst += n;
+            *size -= n;
+        } else {
+            offset += record_size(hdr.len);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t logfs_read(logfs_t *fs, uint16_t id, uint32_t pos, void *dst, size_t size, size_t *out_read)
+{
+    LOGFS_LOCK(fs);
+    esp_err_t err = ESP_OK;
+    uint8_t *p = (uint8_t *) dst;
+    logfs_file_t *f = find_id(fs, id);
+    if (f == NULL) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (pos > f->size) {
+        size = 0;
+    } else if (size > f->size - pos) {
+        size = f->size - pos;
+    }
+    while (err == ESP_OK && size > 0) {
+        size_t i = extent_find(f, pos);
+        if (i == f->extent_count || f->extents[i].file_pos > pos) {
+            err = ESP_ERR_LOGFS_CORRUPT;
+            break;
+        }
+        err = read_extent(fs, f, &f->extents[i], &pos, &p, &size);
+    }
+    *out_read = p - (uint8_t *) dst;
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+esp_err_t logfs_get_size(logfs_t *fs, uint16_t id, uint32_t *out_size)
+{
+    LOGFS_LOCK(fs);
+    logfs_file_t *f = find_id(fs, id);
+    if (f != NULL) {
+        *out_size = f->size;
+    }
+    LOGFS_UNLOCK(fs);
+    return f != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t logfs_get_name(logfs_t *fs, size_t index, char *name)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    LOGFS_LOCK(fs);
+    for (size_t i = 0; i < CONFIG_LOGFS_MAX_FILES; ++i) {
+        if (fs->files[i].entry.id != 0 && index-- == 0) {
+            strcpy(name, fs->files[i].entry.name);
+            err = ESP_OK;
+            break;
+        }
+    }
+    LOGFS_UNLOCK(fs);
+    return err;
+}
+
+void logfs_get_info(logfs_t *fs, logfs_info_t *info)
+{
+    LOGFS_LOCK(fs);
+    info->sector_count = fs->sector_count;
+    info->total_bytes = capacity(fs);
+    info->used_bytes = fs->live_total;
+    info->erase_count = (fs->head_seq + 1) / fs->sector_count;
+    info->gc_bytes = fs->gc_bytes;
+    LOGFS_UNLOCK(fs);
+}
@@ -0,0 +1,311 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/lock.h>
+#include "esp_logfs.h"
+#include "esp_vfs.h"
+#include "esp_vfs_dev.h"
+#include "esp_spi_flash.h"
+#include "sdkconfig.h"
+
+typedef struct {
+    logfs_t *fs;        // NULL if the entry is free
+    uint16_t id;
+    int flags;
+    uint32_t pos;
+} logfs_open_file_t;
+
+static logfs_open_file_t s_files[CONFIG_LOGFS_MAX_OPEN_FILES];
+static _lock_t s_files_lock;
+
+static logfs_open_file_t* get_file(int fd)
+{
+    if (fd < 0 || fd >= CONFIG_LOGFS_MAX_OPEN_FILES || s_files[fd].fs == NULL) {
+        return NULL;
+    }
+    return &s_files[fd];
+}
+
+static int set_errno(esp_err_t err)
+{
+    switch (err) {
+    case ESP_ERR_NOT_FOUND:
+        errno = ENOENT;
+        break;
+    case ESP_ERR_LOGFS_EXISTS:
+        errno = EEXIST;
+        break;
+    case ESP_ERR_LOGFS_FULL:
+        errno = ENOSPC;
+        break;
+    case ESP_ERR_LOGFS_TOO_MANY_FILES:
+        errno = ENFILE;
+        break;
+    case ESP_ERR_INVALID_ARG:
+        errno = ENAMETOOLONG;
+        break;
+    case ESP_ERR_NO_MEM:
+        errno = ENOMEM;
+        break;
+    default:
+        errno = EIO;
+        break;
+    }
+    return -1;
+}
+
+/* Paths are "/name", there are no directories */
+static const char* file_name(const char *path)
+{
+    if (path[0] != '/' || strchr(path + 1, '/') != NULL) {
+        return NULL;
+    }
+    return path + 1;
+}
+
+static int logfs_vfs_open(void *ctx, const char *path, int flags, int mode)
+{
+    logfs_t *fs = (logfs_t *) ctx;
+    const char *name = file_name(path);
+    if (name == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    uint16_t id;
+    esp_err_t err = logfs_lookup(fs, name, &id, NULL);
+    if (err == ESP_OK && (flags & O_CREAT) && (flags & O_EXCL)) {
+        errno = EEXIST;
+        return -1;
+    }
+    if (err == ESP_OK && (flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY) {
+        err = logfs_remove(fs, name);
+        if (err == ESP_OK) {
+            err = ESP_ERR_NOT_FOUND;
+        }
+    }
+    if (err == ESP_ERR_NOT_FOUND && (flags & O_CREAT)) {
+        err = logfs_create(fs, name, &id);
+    }
+    if (err != ESP_OK) {
+        return set_errno(err);
+    }
+    int fd = -1;
+    _lock_acquire(&s_files_lock);
+    for (int i = 0; i < CONFIG_LOGFS_MAX_OPEN_FILES; ++i) {
+        if (s_files[i].fs == NULL) {
+            s_files[i] = (logfs_open_file_t) {
+                .fs = fs,
+                .id = id,
+                .flags = flags,
+                .pos = 0,
+            };
+            fd = i;
+            break;
+        }
+    }
+    _lock_release(&s_files_lock);
+    if (fd < 0) {
+        errno = ENFILE;
+    }
+    return fd;
+}
+
+static ssize_t logfs_vfs_read(void *ctx, int fd, void *dst, size_t size)
+{
+    logfs_open_file_t *f = get_file(fd);
+    if (f == NULL || (f->flags & O_ACCMODE) == O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    size_t n;
+    esp_err_t err = logfs_read(f->fs, f->id, f->pos, dst, size, &n);
+    if (err != ESP_OK) {
+        return set_errno(err);
+    }
+    f->pos += n;
+    return n;
+}
+
+/* Files can only grow, data is appended wherever the file position is */
+static ssize_t logfs_vfs_write(void *ctx, int fd, const void *data, size_t size)
+{
+    logfs_open_file_t *f = get_file(fd);
+    if (f == NULL || (f->flags & O_ACCMODE) == O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    esp_err_t err = logfs_append(f->fs, f->id, data, size);
+    if (err == ESP_OK) {
+        err = logfs_get_size(f->fs, f->id, &f->pos);
+    }
+    if (err != ESP_OK) {
+        return set_errno(err);
+    }
+    return size;
+}
+
+static off_t logfs_vfs_lseek(void *ctx, int fd, off_t offset, int whence)
+{
+    logfs_open_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    uint32_t size;
+    esp_err_t err = logfs_get_size(f->fs, f->id, &size);
+    if (err != ESP_OK) {
+        return set_errno(err);
+    }
+    off_t pos;
+    switch (whence) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = f->pos + offset;
+        break;
+    case SEEK_END:
+        pos = size + offset;
+        break;
+    default:
+        pos = -1;
+        break;
+    }
+    if (pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->pos = pos;
+    return pos;
+}
+
+static int logfs_vfs_close(void *ctx, int fd)
+{
+    logfs_open_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    esp_err_t err = ESP_OK;
+    if ((f->flags & O_ACCMODE) != O_RDONLY) {
+        err = logfs_sync(f->fs);
+    }
+    _lock_acquire(&s_files_lock);
+    f->fs = NULL;
+    _lock_release(&s_files_lock);
+    return err == ESP_OK ? 0 : set_errno(err);
+}
+
+static int logfs_vfs_stat_size(uint32_t size, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFREG;
+    st->st_size = size;
+    st->st_blksize = SPI_FLASH_SEC_SIZE;
+    return 0;
+}
+
+static int logfs_vfs_fstat(void *ctx, int fd, struct stat *st)
+{
+    logfs_open_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    uint32_t size;
+    esp_err_t err = logfs_get_size(f->fs, f->id, &size);
+    if (err != ESP_OK) {
+        return set_errno(err);
+    }
+    return logfs_vfs_stat_size(size, st);
+}
+
+static int logfs_vfs_stat(void *ctx, const char *path, struct stat *st)
+{
+    const char *name = file_name(path);
+    uint16_t id;
+    uint32_t size;
+    if (name == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    esp_err_t err = logfs_lookup((logfs_t *) ctx, name, &id, &size);
+    if (err != ESP_OK) {
+        return set_errno(err);
+    }
+    return logfs_vfs_stat_size(size, st);
+}
+
+static int logfs_vfs_unlink(void *ctx, const char *path)
+{
+    const char *name = file_name(path);
+    if (name == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    esp_err_t err = logfs_remove((logfs_t *) ctx, name);
+    return err == ESP_OK ? 0 : set_errno(err);
+}
+
+static int logfs_vfs_rename(void *ctx, const char *src, const char *dst)
+{
+    const char *src_name = file_name(src);
+    const char *dst_name = file_name(dst);
+    if (src_name == NULL || dst_name == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    esp_err_t err = logfs_rename((logfs_t *) ctx, src_name, dst_name);
+    return err == ESP_OK ? 0 : set_errno(err);
+}
+
+esp_err_t esp_vfs_logfs_register(const char *base_path, const char *label, bool format_if_empty)
+{
+    uint32_t offset, size;
+    esp_err_t err = esp_vfs_flash_find_partition(label, &offset, &size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    logfs_t *fs;
+    err = logfs_mount(offset, size, &fs);
+    if (err == ESP_ERR_LOGFS_NOT_FORMATTED && format_if_empty) {
+        err = logfs_format(offset, size);
+        if (err == ESP_OK) {
+            err = logfs_mount(offset, size, &fs);
+        }
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    const esp_vfs_t vfs = {
+        .open = &logfs_vfs_open,
+        .read = &logfs_vfs_read,
+        .write = &logfs_vfs_write,
+        .lseek = &logfs_vfs_lseek,
+        .close = &logfs_vfs_close,
+        .fstat = &logfs_vfs_fstat,
+        .stat = &logfs_vfs_stat,
+        .unlink = &logfs_vfs_unlink,
+        .rename = &logfs_vfs_rename,
+    };
+    err = esp_vfs_register(base_path, &vfs, fs);
+    if (err != ESP_OK) {
+        logfs_unmount(fs);
+    }
+    return err;
+}
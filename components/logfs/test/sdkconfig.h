@@ -0,0 +1,13 @@
+/*
+ * Configuration used for building logfs on the host.
+ * On the target, sdkconfig.h is generated from Kconfig options.
+ * SpiFlashEmulator has no write buffer, so CONFIG_SPI_FLASH_WRITE_BUFFER
+ * is not set.
+ */
+#ifndef sdkconfig_h
+#define sdkconfig_h
+
+#define CONFIG_LOGFS_MAX_FILES 16
+#define CONFIG_LOGFS_MAX_OPEN_FILES 4
+
+#endif /* sdkconfig_h */
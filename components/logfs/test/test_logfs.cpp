@@ -0,0 +1,295 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "esp_logfs.h"
+#include "spi_flash_emulation.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const size_t SECTORS = 16;
+static const size_t SIZE = SECTORS * SPI_FLASH_SEC_SIZE;
+
+static vector<uint8_t> pattern(uint32_t seed, size_t pos, size_t size)
+{
+    vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = (uint8_t) ((pos + i) * 7 + seed);
+    }
+    return data;
+}
+
+static void check_contents(logfs_t *fs, uint16_t id, uint32_t seed, size_t size, size_t chunk = 1000)
+{
+    vector<uint8_t> buf(chunk);
+    for (size_t pos = 0; pos < size; pos += chunk) {
+        size_t n;
+        REQUIRE(logfs_read(fs, id, pos, buf.data(), chunk, &n) == ESP_OK);
+        REQUIRE(n == min(chunk, size - pos));
+        buf.resize(n);
+        REQUIRE(buf == pattern(seed, pos, n));
+        buf.resize(chunk);
+    }
+    size_t n;
+    CHECK(logfs_read(fs, id, size, buf.data(), chunk, &n) == ESP_OK);
+    CHECK(n == 0);
+}
+
+TEST_CASE("unformatted partition can't be mounted", "[logfs]")
+{
+    SpiFlashEmulator emu(SECTORS);
+    logfs_t *fs;
+    CHECK(logfs_mount(0, SIZE, &fs) == ESP_ERR_LOGFS_NOT_FORMATTED);
+    CHECK(logfs_mount(0, 3 * SPI_FLASH_SEC_SIZE, &fs) == ESP_ERR_INVALID_ARG);
+    CHECK(logfs_format(100, SIZE) == ESP_ERR_INVALID_ARG);
+}
+
+TEST_CASE("data can be appended and read back after remounting", "[logfs]")
+{
+    SpiFlashEmulator emu(SECTORS);
+    REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+    logfs_t *fs;
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    uint16_t id;
+    REQUIRE(logfs_create(fs, "samples", &id) == ESP_OK);
+    CHECK(logfs_create(fs, "samples", &id) == ESP_ERR_LOGFS_EXISTS);
+    size_t size = 0;
+    for (size_t n = 1; size + n < 20000; n += 37) {
+        REQUIRE(logfs_append(fs, id, pattern(1, size, n).data(), n) == ESP_OK);
+        size += n;
+    }
+    check_contents(fs, id, 1, size);
+    check_contents(fs, id, 1, size, 13);
+    logfs_unmount(fs);
+
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    uint16_t id2;
+    uint32_t size2;
+    REQUIRE(logfs_lookup(fs, "samples", &id2, &size2) == ESP_OK);
+    CHECK(id2 == id);
+    CHECK(size2 == size);
+    check_contents(fs, id, 1, size);
+    REQUIRE(logfs_append(fs, id, pattern(1, size, 100).data(), 100) == ESP_OK);
+    check_contents(fs, id, 1, size + 100);
+    logfs_unmount(fs);
+}
+
+TEST_CASE("files can be renamed and removed", "[logfs]")
+{
+    SpiFlashEmulator emu(SECTORS);
+    REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+    logfs_t *fs;
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    uint16_t a, b;
+    REQUIRE(logfs_create(fs, "a", &a) == ESP_OK);
+    REQUIRE(logfs_create(fs, "b", &b) == ESP_OK);
+    REQUIRE(logfs_append(fs, a, pattern(2, 0, 5000).data(), 5000) == ESP_OK);
+    REQUIRE(logfs_append(fs, b, pattern(3, 0, 5000).data(), 5000) == ESP_OK);
+    CHECK(logfs_rename(fs, "a", "b") == ESP_ERR_LOGFS_EXISTS);
+    REQUIRE(logfs_remove(fs, "b") == ESP_OK);
+    REQUIRE(logfs_rename(fs, "a", "c") == ESP_OK);
+    CHECK(logfs_create(fs, "this name is much too long for logfs", &b) == ESP_ERR_INVALID_ARG);
+    logfs_unmount(fs);
+
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    uint16_t id;
+    CHECK(logfs_lookup(fs, "a", &id, NULL) == ESP_ERR_NOT_FOUND);
+    CHECK(logfs_lookup(fs, "b", &id, NULL) == ESP_ERR_NOT_FOUND);
+    REQUIRE(logfs_lookup(fs, "c", &id, NULL) == ESP_OK);
+    CHECK(id == a);
+    check_contents(fs, a, 2, 5000);
+    char name[LOGFS_NAME_MAX + 1];
+    CHECK(logfs_get_name(fs, 0, name) == ESP_OK);
+    CHECK(string(name) == "c");
+    CHECK(logfs_get_name(fs, 1, name) == ESP_ERR_NOT_FOUND);
+    logfs_unmount(fs);
+}
+
+TEST_CASE("full file system refuses appends until files are removed", "[logfs]")
+{
+    SpiFlashEmulator emu(SECTORS);
+    REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+    logfs_t *fs;
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    uint16_t id;
+    REQUIRE(logfs_create(fs, "log", &id) == ESP_OK);
+    size_t size = 0;
+    esp_err_t err;
+    while ((err = logfs_append(fs, id, pattern(4, size, 500).data(), 500)) == ESP_OK) {
+        size += 500;
+    }
+    CHECK(err == ESP_ERR_LOGFS_FULL);
+    logfs_info_t info;
+    logfs_get_info(fs, &info);
+    CHECK(size > info.total_bytes * 9 / 10);
+    CHECK(size <= info.total_bytes);
+    check_contents(fs, id, 4, size);
+    REQUIRE(logfs_remove(fs, "log") == ESP_OK);
+    REQUIRE(logfs_create(fs, "log", &id) == ESP_OK);
+    REQUIRE(logfs_append(fs, id, pattern(5, 0, 20000).data(), 20000) == ESP_OK);
+    check_contents(fs, id, 5, 20000);
+    logfs_unmount(fs);
+}
+
+TEST_CASE("rotating logs wear all sectors evenly", "[logfs]")
+{
+    SpiFlashEmulator emu(SECTORS);
+    REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+    logfs_t *fs;
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    /* a file which is never deleted has to be moved along */
+    uint16_t config;
+    REQUIRE(logfs_create(fs, "config", &config) == ESP_OK);
+    REQUIRE(logfs_append(fs, config, pattern(6, 0, 3000).data(), 3000) == ESP_OK);
+    for (int i = 0; i < 40; ++i) {
+        string name = "log" + to_string(i);
+        uint16_t id;
+        REQUIRE(logfs_create(fs, name.c_str(), &id) == ESP_OK);
+        for (size_t pos = 0; pos < 10000; pos += 250) {
+            REQUIRE(logfs_append(fs, id, pattern(i, pos, 250).data(), 250) == ESP_OK);
+        }
+        if (i >= 2) {
+            REQUIRE(logfs_remove(fs, ("log" + to_string(i - 2)).c_str()) == ESP_OK);
+        }
+        if (i % 7 == 0) {
+            logfs_unmount(fs);
+            REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+        }
+    }
+    check_contents(fs, config, 6, 3000);
+    uint16_t id;
+    REQUIRE(logfs_lookup(fs, "log38", &id, NULL) == ESP_OK);
+    check_contents(fs, id, 38, 10000);
+    size_t min_erases = SIZE_MAX, max_erases = 0;
+    for (size_t i = 0; i < SECTORS; ++i) {
+        min_erases = min(min_erases, emu.getSectorEraseCount(i));
+        max_erases = max(max_erases, emu.getSectorEraseCount(i));
+    }
+    CHECK(min_erases > 10);
+    CHECK(max_erases - min_erases <= 1);
+    logfs_info_t info;
+    logfs_get_info(fs, &info);
+    CHECK(info.erase_count >= min_erases - 1);
+    CHECK(info.erase_count <= max_erases);
+    logfs_unmount(fs);
+}
+
+TEST_CASE("mounting reads headers, summaries and the head sector only", "[logfs]")
+{
+    const size_t sectors = 64;
+    SpiFlashEmulator emu(sectors);
+    REQUIRE(logfs_format(0, sectors * SPI_FLASH_SEC_SIZE) == ESP_OK);
+    logfs_t *fs;
+    REQUIRE(logfs_mount(0, sectors * SPI_FLASH_SEC_SIZE, &fs) == ESP_OK);
+    uint16_t ids[4];
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(logfs_create(fs, ("f" + to_string(i)).c_str(), &ids[i]) == ESP_OK);
+    }
+    for (size_t pos = 0; pos < 30000; pos += 40) {
+        for (int i = 0; i < 4; ++i) {
+            REQUIRE(logfs_append(fs, ids[i], pattern(i, pos, 40).data(), 40) == ESP_OK);
+        }
+    }
+    logfs_unmount(fs);
+    emu.clearStats();
+    REQUIRE(logfs_mount(0, sectors * SPI_FLASH_SEC_SIZE, &fs) == ESP_OK);
+    INFO("read " << emu.getReadBytes() << " bytes of " << emu.size());
+    CHECK(emu.getReadBytes() < emu.size() / 8);
+    for (int i = 0; i < 4; ++i) {
+        check_contents(fs, ids[i], i, 30000);
+    }
+    logfs_unmount(fs);
+}
+
+TEST_CASE("formatting forgets the previous file system", "[logfs]")
+{
+    SpiFlashEmulator emu(SECTORS);
+    REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+    logfs_t *fs;
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    uint16_t id;
+    REQUIRE(logfs_create(fs, "old", &id) == ESP_OK);
+    REQUIRE(logfs_append(fs, id, pattern(7, 0, 30000).data(), 30000) == ESP_OK);
+    logfs_unmount(fs);
+    REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+    REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+    CHECK(logfs_lookup(fs, "old", &id, NULL) == ESP_ERR_NOT_FOUND);
+    REQUIRE(logfs_create(fs, "new", &id) == ESP_OK);
+    bool recreated = false;
+    for (size_t pos = 0; pos < 40000; pos += 1000) {
+        REQUIRE(logfs_append(fs, id, pattern(8, pos, 1000).data(), 1000) == ESP_OK);
+        if (pos % 15000 == 0) {
+            logfs_unmount(fs);
+            REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+        }
+        if (pos == 20000 && !recreated) {
+            recreated = true;
+            REQUIRE(logfs_remove(fs, "new") == ESP_OK);
+            REQUIRE(logfs_create(fs, "new", &id) == ESP_OK);
+            REQUIRE(logfs_append(fs, id, pattern(8, 0, 1000).data(), 1000) == ESP_OK);
+            pos = 0;
+        }
+    }
+    check_contents(fs, id, 8, 40000);
+    logfs_unmount(fs);
+}
+
+TEST_CASE("power loss keeps data which was appended before", "[logfs]")
+{
+    for (uint32_t cut = 1; cut < 400; cut += 7) {
+        SpiFlashEmulator emu(SECTORS);
+        REQUIRE(logfs_format(0, SIZE) == ESP_OK);
+        logfs_t *fs;
+        REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+        uint16_t keep, log;
+        REQUIRE(logfs_create(fs, "keep", &keep) == ESP_OK);
+        REQUIRE(logfs_append(fs, keep, pattern(9, 0, 2000).data(), 2000) == ESP_OK);
+        REQUIRE(logfs_create(fs, "log", &log) == ESP_OK);
+        emu.powerCutAfter(cut, cut % 5);
+        size_t written = 0;
+        for (int i = 0; i < 60 && !emu.isPoweredOff(); ++i) {
+            size_t n = 100 + i * 7;
+            if (logfs_append(fs, log, pattern(10, written, n).data(), n) == ESP_OK) {
+                written += n;
+            }
+            if (i % 10 == 9 && logfs_remove(fs, "keep") == ESP_OK &&
+                    logfs_create(fs, "keep", &keep) == ESP_OK) {
+                logfs_append(fs, keep, pattern(9, 0, 2000).data(), 2000);
+            }
+        }
+        logfs_unmount(fs);
+        emu.clearFailure();
+
+        INFO("cut after " << cut << " operations, " << written << " bytes written");
+        REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+        uint32_t size;
+        if (logfs_lookup(fs, "keep", &keep, &size) == ESP_OK) {
+            check_contents(fs, keep, 9, size);
+        }
+        REQUIRE(logfs_lookup(fs, "log", &log, &size) == ESP_OK);
+        CHECK(size >= written);
+        check_contents(fs, log, 10, size);
+        /* the file system can be written to after the power loss */
+        logfs_info_t info;
+        logfs_get_info(fs, &info);
+        INFO("used " << info.used_bytes << " of " << info.total_bytes);
+        REQUIRE(logfs_append(fs, log, pattern(10, size, 5000).data(), 5000) == ESP_OK);
+        check_contents(fs, log, 10, size + 5000);
+        logfs_unmount(fs);
+        REQUIRE(logfs_mount(0, SIZE, &fs) == ESP_OK);
+        check_contents(fs, log, 10, size + 5000);
+        logfs_unmount(fs);
+    }
+}
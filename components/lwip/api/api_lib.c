@@ -682,6 +682,40 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
   return err;
 }
 
+/**
+ * Send several netbufs over a UDP or RAW netconn with one message to
+ * tcpip_thread (or with the core lock taken once). Sending stops at the
+ * first netbuf which fails.
+ *
+ * @param conn the UDP or RAW netconn over which to send data
+ * @param bufs array of netbufs which contain the data to send
+ * @param num number of netbufs in 'bufs'
+ * @param sent returns the number of netbufs sent
+ * @return ERR_OK if all netbufs were sent, otherwise the error of the first
+ *         one which wasn't
+ */
+err_t
+netconn_send_multi(struct netconn *conn, struct netbuf *bufs, u16_t num, u16_t *sent)
+{
+  API_MSG_VAR_DECLARE(msg);
+  err_t err;
+
+  LWIP_ERROR("netconn_send_multi: invalid conn",  (conn != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_send_multi: invalid sent",  (sent != NULL), return ERR_ARG;);
+
+  LWIP_DEBUGF(API_LIB_DEBUG, ("netconn_send_multi: sending %"U16_F" netbufs\n", num));
+  API_MSG_VAR_ALLOC(msg);
+  API_MSG_VAR_REF(msg).msg.conn = conn;
+  API_MSG_VAR_REF(msg).msg.msg.bm.bufs = bufs;
+  API_MSG_VAR_REF(msg).msg.msg.bm.num = num;
+  API_MSG_VAR_REF(msg).msg.msg.bm.sent = 0;
+  TCPIP_APIMSG(&API_MSG_VAR_REF(msg), lwip_netconn_do_send_multi, err);
+  *sent = API_MSG_VAR_REF(msg).msg.msg.bm.sent;
+  API_MSG_VAR_FREE(msg);
+
+  return err;
+}
+
 /**
  * Send data over a TCP netconn.
  *
@@ -340,6 +340,11 @@ sent_tcp(void *arg, struct tcp_pcb *pcb, u16_t len)
   LWIP_ASSERT("conn != NULL", (conn != NULL));
 
   if (conn) {
+#if LWIP_SOCKET_ZEROCOPY
+    /* let the socket complete zero-copy sends which are acknowledged now */
+    API_EVENT(conn, NETCONN_EVT_SENT, len);
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
     if (conn->state == NETCONN_WRITE) {
       lwip_netconn_do_writemore(conn  WRITE_DELAYED);
     } else if (conn->state == NETCONN_CLOSE) {
@@ -1372,54 +1377,90 @@ lwip_netconn_do_listen(void *m)
 #endif /* LWIP_TCP */
 
 /**
- * Send some data on a RAW or UDP pcb contained in a netconn
- * Called from netconn_send
+ * Send a netbuf on the RAW or UDP pcb contained in a netconn.
  *
- * @param msg the api_msg_msg pointing to the connection
+ * @param conn the netconn to send on
+ * @param buf the netbuf to send
+ * @return the error of the send function
  */
-void
-lwip_netconn_do_send(void *m)
+static err_t
+lwip_netconn_send_netbuf(struct netconn *conn, struct netbuf *buf)
 {
-  struct api_msg_msg *msg = (struct api_msg_msg*)m;
+  err_t err;
 
-  if (ERR_IS_FATAL(msg->conn->last_err)) {
-    msg->err = msg->conn->last_err;
-  } else {
-    msg->err = ERR_CONN;
-    if (msg->conn->pcb.tcp != NULL) {
-      switch (NETCONNTYPE_GROUP(msg->conn->type)) {
+  if (ERR_IS_FATAL(conn->last_err)) {
+    return conn->last_err;
+  }
+  err = ERR_CONN;
+  if (conn->pcb.tcp != NULL) {
+    switch (NETCONNTYPE_GROUP(conn->type)) {
 #if LWIP_RAW
-      case NETCONN_RAW:
-        if (ip_addr_isany(&msg->msg.b->addr)) {
-          msg->err = raw_send(msg->conn->pcb.raw, msg->msg.b->p);
-        } else {
-          msg->err = raw_sendto(msg->conn->pcb.raw, msg->msg.b->p, &msg->msg.b->addr);
-        }
-        break;
+    case NETCONN_RAW:
+      if (ip_addr_isany(&buf->addr)) {
+        err = raw_send(conn->pcb.raw, buf->p);
+      } else {
+        err = raw_sendto(conn->pcb.raw, buf->p, &buf->addr);
+      }
+      break;
 #endif
 #if LWIP_UDP
-      case NETCONN_UDP:
+    case NETCONN_UDP:
 #if LWIP_CHECKSUM_ON_COPY
-        if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-          msg->err = udp_send_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-            msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
-        } else {
-          msg->err = udp_sendto_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-            &msg->msg.b->addr, msg->msg.b->port,
-            msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
-        }
+      if (ip_addr_isany(&buf->addr) || IP_IS_ANY_TYPE_VAL(buf->addr)) {
+        err = udp_send_chksum(conn->pcb.udp, buf->p,
+          buf->flags & NETBUF_FLAG_CHKSUM, buf->toport_chksum);
+      } else {
+        err = udp_sendto_chksum(conn->pcb.udp, buf->p,
+          &buf->addr, buf->port,
+          buf->flags & NETBUF_FLAG_CHKSUM, buf->toport_chksum);
+      }
 #else /* LWIP_CHECKSUM_ON_COPY */
-        if (ip_addr_isany_val(msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-          msg->err = udp_send(msg->conn->pcb.udp, msg->msg.b->p);
-        } else {
-          msg->err = udp_sendto(msg->conn->pcb.udp, msg->msg.b->p, &msg->msg.b->addr, msg->msg.b->port);
-        }
+      if (ip_addr_isany_val(buf->addr) || IP_IS_ANY_TYPE_VAL(buf->addr)) {
+        err = udp_send(conn->pcb.udp, buf->p);
+      } else {
+        err = udp_sendto(conn->pcb.udp, buf->p, &buf->addr, buf->port);
+      }
 #endif /* LWIP_CHECKSUM_ON_COPY */
-        break;
+      break;
 #endif /* LWIP_UDP */
-      default:
-        break;
-      }
+    default:
+      break;
+    }
+  }
+  return err;
+}
+
+/**
+ * Send some data on a RAW or UDP pcb contained in a netconn
+ * Called from netconn_send
+ *
+ * @param msg the api_msg_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send(void *m)
+{
+  struct api_msg_msg *msg = (struct api_msg_msg*)m;
+
+  msg->err = lwip_netconn_send_netbuf(msg->conn, msg->msg.b);
+  TCPIP_APIMSG_ACK(msg);
+}
+
+/**
+ * Send several netbufs, stopping at the first one which fails.
+ * Called from netconn_send_multi()
+ *
+ * @param msg the api_msg_msg pointing to the connection and the netbufs
+ */
+void
+lwip_netconn_do_send_multi(void *m)
+{
+  struct api_msg_msg *msg = (struct api_msg_msg*)m;
+
+  msg->err = ERR_OK;
+  for (msg->msg.bm.sent = 0; msg->msg.bm.sent < msg->msg.bm.num; msg->msg.bm.sent++) {
+    msg->err = lwip_netconn_send_netbuf(msg->conn, &msg->msg.bm.bufs[msg->msg.bm.sent]);
+    if (msg->err != ERR_OK) {
+      break;
     }
   }
   TCPIP_APIMSG_ACK(msg);
@@ -1491,6 +1532,12 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
   dontblock = netconn_is_nonblocking(conn) ||
        (conn->current_msg->msg.w.apiflags & NETCONN_DONTBLOCK);
   apiflags = conn->current_msg->msg.w.apiflags;
+  /* MSG_MORE holds back partial segments until a write without it */
+  if (apiflags & NETCONN_MORE) {
+    conn->pcb.tcp->flags |= TF_MORE;
+  } else {
+    conn->pcb.tcp->flags &= ~TF_MORE;
+  }
 
 #if LWIP_SO_SNDTIMEO
   if ((conn->send_timeout != 0) &&
@@ -1646,14 +1693,9 @@ lwip_netconn_do_write(void *m)
         if (lwip_netconn_do_writemore(msg->conn, 0) != ERR_OK) {
           LWIP_ASSERT("state!", msg->conn->state == NETCONN_WRITE);
           UNLOCK_TCPIP_CORE();
-
-#ifdef LWIP_ESP8266
-//#if 0
-            sys_arch_sem_wait( LWIP_API_MSG_SND_SEM(msg), 0);
-#else
-            sys_arch_sem_wait(LWIP_API_MSG_SEM(msg), 0);
-#endif
-                
+          /* lwip_netconn_do_writemore signals op_completed_sem when the
+             write completes, with or without LWIP_ESP8266 */
+          sys_arch_sem_wait(LWIP_API_MSG_SEM(msg), 0);
           LOCK_TCPIP_CORE();
           LWIP_ASSERT("state!", msg->conn->state != NETCONN_WRITE);
         }
@@ -54,6 +54,9 @@
 #include "lwip/pbuf.h"
 #include "lwip/priv/tcpip_priv.h"
 #include "lwip/priv/api_msg.h"
+#if LWIP_TCP
+#include "lwip/priv/tcp_priv.h"
+#endif /* LWIP_TCP */
 //#include "esp_common.h"
 #if LWIP_CHECKSUM_ON_COPY
 #include "lwip/inet_chksum.h"
@@ -190,12 +193,13 @@ static void sockaddr_to_ipaddr_port(const struct sockaddr* sockaddr, ip_addr_t*
 
 #define NUM_SOCKETS MEMP_NUM_NETCONN
 
-/** This is overridable for the rare case where more than 255 threads
- * select on the same socket...
- */
-#ifndef SELWAIT_T
-#define SELWAIT_T u8_t
-#endif
+/** Events a socket can be ready for, tested by select, poll and epoll */
+#define LWIP_SOCK_EV_READ   0x01
+#define LWIP_SOCK_EV_WRITE  0x02
+#define LWIP_SOCK_EV_ERROR  0x04
+
+struct lwip_sock_waiter;
+struct lwip_sock_sent;
 
 /** Contains all internal pointers and states used for a socket */
 struct lwip_sock {
@@ -235,9 +239,28 @@ struct lwip_sock {
   u8_t age;
 #endif
  
-  /** counter of how many threads are waiting for this socket using select */
-  SELWAIT_T select_waiting;
+  /** select, poll and epoll waiters interested in events of this socket */
+  struct lwip_sock_waiter *waiters;
+#if LWIP_SOCKET_ZEROCOPY
+  /** lwip_send_nocopy() data not acknowledged yet, oldest first
+      (only accessed from tcpip_thread) */
+  struct lwip_sock_sent *sent_refs;
+#endif /* LWIP_SOCKET_ZEROCOPY */
+};
+
+#if LWIP_SOCKET_ZEROCOPY
+/** A buffer sent with lwip_send_nocopy(), referenced by the TCP segments
+    until the remote side acknowledges them */
+struct lwip_sock_sent {
+  struct lwip_sock_sent *next;
+  struct lwip_sock *sock;
+  int s;
+  /** sequence number following the last byte of the buffer */
+  u32_t end;
+  lwip_sent_fn sent;
+  void *arg;
 };
+#endif /* LWIP_SOCKET_ZEROCOPY */
 
 #if LWIP_THREAD_SAFE
 
@@ -332,24 +355,69 @@ do{\
 #define SELECT_SEM_PTR(sem) (&(sem))
 #endif /* LWIP_NETCONN_SEM_PER_THREAD */
 
-/** Description for a task waiting in select */
+/** Description for a task waiting in select, poll or epoll_wait */
 struct lwip_select_cb {
-  /** Pointer to the next waiting task */
-  struct lwip_select_cb *next;
-  /** Pointer to the previous waiting task */
-  struct lwip_select_cb *prev;
-  /** readset passed to select */
-  fd_set *readset;
-  /** writeset passed to select */
-  fd_set *writeset;
-  /** unimplemented: exceptset passed to select */
-  fd_set *exceptset;
   /** don't signal the same semaphore twice: set to 1 when signalled */
   int sem_signalled;
   /** semaphore to wake up a task waiting for select */
   SELECT_SEM_T sem;
 };
 
+#if LWIP_SOCKET_EPOLL_NUM
+struct lwip_epoll_item;
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+
+/** Entry on the waiter list of a socket. event_callback only looks at the
+    waiters of the socket the event is for, and only wakes up those which
+    are interested in an event the socket is ready for. */
+struct lwip_sock_waiter {
+  /** Pointer to the next waiter of the same socket */
+  struct lwip_sock_waiter *next;
+  /** LWIP_SOCK_EV_xxx events this waiter is interested in */
+  u8_t events;
+  /** task to wake up (select and poll) */
+  struct lwip_select_cb *scb;
+#if LWIP_SOCKET_EPOLL_NUM
+  /** registration to put on the ready list of its epoll instance (scb is NULL then) */
+  struct lwip_epoll_item *item;
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+};
+
+#if LWIP_SOCKET_EPOLL_NUM
+/** epoll file descriptors follow the socket file descriptors */
+#define LWIP_EPOLL_OFFSET (LWIP_SOCKET_OFFSET + NUM_SOCKETS)
+
+/** Registration of a socket on an epoll instance */
+struct lwip_epoll_item {
+  /** waiter linked on the socket while it is registered */
+  struct lwip_sock_waiter waiter;
+  /** the epoll instance this registration belongs to */
+  struct lwip_epoll *ep;
+  /** Pointer to the next registration on the ready list of the instance */
+  struct lwip_epoll_item *ready_next;
+  /** EPOLLxxx events and flags passed to epoll_ctl */
+  u32_t events;
+  /** user data returned by epoll_wait */
+  epoll_data_t data;
+  /** 1 while the socket is registered */
+  u8_t registered;
+  /** 1 while the registration is on the ready list */
+  u8_t queued;
+};
+
+/** An epoll instance, its registrations are indexed by socket */
+struct lwip_epoll {
+  /** 1 while the instance is open */
+  u8_t used;
+  /** task waiting in epoll_wait, NULL if there is none */
+  struct lwip_select_cb *wait;
+  /** registrations which became ready since the last epoll_wait */
+  struct lwip_epoll_item *ready_head;
+  struct lwip_epoll_item *ready_tail;
+  struct lwip_epoll_item items[NUM_SOCKETS];
+};
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+
 /** A struct sockaddr replacement that has the same alignment as sockaddr_in/
  *  sockaddr_in6 if instantiated.
  */
@@ -419,11 +487,10 @@ static struct lwip_sock sockets[NUM_SOCKETS];
 #if LWIP_THREAD_SAFE
 static bool sockets_init_flag = false;
 #endif
-/** The global list of tasks waiting for select */
-static struct lwip_select_cb *select_cb_list;
-/** This counter is increased from lwip_select when the list is changed
-    and checked in event_callback to see if it has changed. */
-static volatile int select_cb_ctr;
+#if LWIP_SOCKET_EPOLL_NUM
+/** The global array of epoll instances */
+static struct lwip_epoll epolls[LWIP_SOCKET_EPOLL_NUM];
+#endif /* LWIP_SOCKET_EPOLL_NUM */
 
 /** Table to quickly map an lwIP error (err_t) to a socket error
   * by using -err as an index */
@@ -571,6 +638,202 @@ tryget_socket(int s)
   return &sockets[s];
 }
 
+/**
+ * Get the LWIP_SOCK_EV_xxx events a socket is ready for.
+ * Has to be called with SYS_ARCH protected.
+ */
+static u8_t
+lwip_sock_ready(struct lwip_sock *sock)
+{
+  u8_t ready = 0;
+
+  if ((sock->lastdata != NULL) || (sock->rcvevent > 0)) {
+    ready |= LWIP_SOCK_EV_READ;
+  }
+  if (sock->sendevent != 0) {
+    ready |= LWIP_SOCK_EV_WRITE;
+  }
+  if (sock->errevent != 0) {
+    ready |= LWIP_SOCK_EV_ERROR;
+  }
+  return ready;
+}
+
+/** Put a waiter on a socket. Has to be called with SYS_ARCH protected. */
+static void
+lwip_sock_add_waiter(struct lwip_sock *sock, struct lwip_sock_waiter *waiter)
+{
+  waiter->next = sock->waiters;
+  sock->waiters = waiter;
+}
+
+/** Take a waiter off a socket. Has to be called with SYS_ARCH protected. */
+static void
+lwip_sock_remove_waiter(struct lwip_sock *sock, struct lwip_sock_waiter *waiter)
+{
+  struct lwip_sock_waiter **pwaiter;
+
+  for (pwaiter = &sock->waiters; *pwaiter != NULL; pwaiter = &(*pwaiter)->next) {
+    if (*pwaiter == waiter) {
+      *pwaiter = waiter->next;
+      break;
+    }
+  }
+}
+
+#if LWIP_SOCKET_EPOLL_NUM
+/**
+ * Put an epoll registration on the ready list of its instance and wake up
+ * the task waiting on the instance. Has to be called with SYS_ARCH protected.
+ */
+static void
+lwip_epoll_queue(struct lwip_epoll_item *item)
+{
+  struct lwip_epoll *ep = item->ep;
+
+  if (!item->queued) {
+    item->queued = 1;
+    item->ready_next = NULL;
+    if (ep->ready_tail != NULL) {
+      ep->ready_tail->ready_next = item;
+    } else {
+      ep->ready_head = item;
+    }
+    ep->ready_tail = item;
+  }
+  if ((ep->wait != NULL) && (ep->wait->sem_signalled == 0)) {
+    ep->wait->sem_signalled = 1;
+    sys_sem_signal(SELECT_SEM_PTR(ep->wait->sem));
+  }
+}
+
+/**
+ * Take an epoll registration off its socket and off the ready list.
+ * Has to be called with SYS_ARCH protected.
+ */
+static void
+lwip_epoll_unregister(struct lwip_epoll_item *item, struct lwip_sock *sock)
+{
+  struct lwip_epoll *ep = item->ep;
+
+  lwip_sock_remove_waiter(sock, &item->waiter);
+  if (item->queued) {
+    struct lwip_epoll_item *prev = NULL, *it = ep->ready_head;
+    while (it != item) {
+      prev = it;
+      it = it->ready_next;
+    }
+    if (prev != NULL) {
+      prev->ready_next = item->ready_next;
+    } else {
+      ep->ready_head = item->ready_next;
+    }
+    if (ep->ready_tail == item) {
+      ep->ready_tail = prev;
+    }
+    item->queued = 0;
+  }
+  item->registered = 0;
+}
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+
+/**
+ * Wake up the waiters of a socket which are interested in one of the
+ * 'ready' events. Has to be called with SYS_ARCH protected.
+ */
+static void
+lwip_sock_signal_waiters(struct lwip_sock *sock, u8_t ready)
+{
+  struct lwip_sock_waiter *waiter;
+
+  for (waiter = sock->waiters; waiter != NULL; waiter = waiter->next) {
+    if (!(waiter->events & ready)) {
+      continue;
+    }
+#if LWIP_SOCKET_EPOLL_NUM
+    if (waiter->item != NULL) {
+      lwip_epoll_queue(waiter->item);
+      continue;
+    }
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+    if (waiter->scb->sem_signalled == 0) {
+      waiter->scb->sem_signalled = 1;
+      /* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
+         lead to the select thread taking its waiters off, invalidating the semaphore. */
+      sys_sem_signal(SELECT_SEM_PTR(waiter->scb->sem));
+    }
+  }
+}
+
+#if LWIP_SOCKET_ZEROCOPY
+/**
+ * Call the callbacks of the lwip_send_nocopy() buffers which are no longer
+ * referenced: all of them if the connection is gone, otherwise those which
+ * have been acknowledged.
+ * Called from tcpip_thread.
+ *
+ * @param sock the socket to check
+ */
+static void
+lwip_sock_sent_acked(struct lwip_sock *sock)
+{
+  struct tcp_pcb *pcb = sock->conn->pcb.tcp;
+  struct lwip_sock_sent *sent;
+
+  while ((sent = sock->sent_refs) != NULL) {
+    if ((pcb != NULL) && TCP_SEQ_LT(pcb->lastack, sent->end)) {
+      break;
+    }
+    sock->sent_refs = sent->next;
+    sent->sent(sent->s, sent->arg, (pcb != NULL) ? 0 : ECONNRESET);
+    mem_free(sent);
+  }
+}
+
+/**
+ * Remember the end of the data queued by lwip_send_nocopy(). Running in
+ * tcpip_thread after the write, snd_lbb is at or behind the end of the
+ * buffer, so the callback is never called too early.
+ *
+ * @param arg the struct lwip_sock_sent to enqueue
+ */
+static void
+lwip_sock_sent_track(void *arg)
+{
+  struct lwip_sock_sent *sent = (struct lwip_sock_sent *)arg;
+  struct lwip_sock_sent **tail;
+  struct tcp_pcb *pcb = sent->sock->conn->pcb.tcp;
+
+  sent->next = NULL;
+  if (pcb != NULL) {
+    sent->end = pcb->snd_lbb;
+  }
+  for (tail = &sent->sock->sent_refs; *tail != NULL; tail = &(*tail)->next);
+  *tail = sent;
+  lwip_sock_sent_acked(sent->sock);
+}
+
+/**
+ * Reset the connection of a socket being closed while lwip_send_nocopy()
+ * data is not acknowledged: a graceful close would keep sending from the
+ * buffers after their callbacks can no longer be called.
+ * Queued by lwip_close() ahead of the netconn_delete() message.
+ *
+ * @param arg the socket being closed
+ */
+static void
+lwip_sock_sent_abort(void *arg)
+{
+  struct lwip_sock *sock = (struct lwip_sock *)arg;
+
+  if ((sock->sent_refs != NULL) && (sock->conn->pcb.tcp != NULL)) {
+    /* err_tcp() reports the error, which calls the remaining callbacks */
+    tcp_abort(sock->conn->pcb.tcp);
+  }
+  lwip_sock_sent_acked(sock);
+}
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
 /**
  * Allocate a new socket for a given netconn.
  *
@@ -633,7 +896,9 @@ alloc_socket(struct netconn *newconn, int accepted)
     sockets[oldest].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
     sockets[oldest].errevent   = 0;
     sockets[oldest].err        = 0;
-    sockets[oldest].select_waiting = 0;
+#if LWIP_SOCKET_ZEROCOPY
+    sockets[oldest].sent_refs  = NULL;
+#endif /* LWIP_SOCKET_ZEROCOPY */
 
     sockets[oldest].state      = LWIP_SOCK_OPEN;
     sockets[oldest].age        = 0;
@@ -671,7 +936,9 @@ alloc_socket(struct netconn *newconn, int accepted)
       sockets[i].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
       sockets[i].errevent   = 0;
       sockets[i].err        = 0;
-      sockets[i].select_waiting = 0;
+#if LWIP_SOCKET_ZEROCOPY
+      sockets[i].sent_refs  = NULL;
+#endif /* LWIP_SOCKET_ZEROCOPY */
 
       return i + LWIP_SOCKET_OFFSET;
     }
@@ -713,7 +980,22 @@ free_socket(struct lwip_sock *sock, int is_tcp)
 #endif
 
   /* Protect socket array */
-  SYS_ARCH_SET(sock->conn, NULL);
+  SYS_ARCH_PROTECT(lev);
+  sock->conn = NULL;
+#if LWIP_SOCKET_EPOLL_NUM
+  /* A closed socket is removed from the epoll instances it is registered on */
+  {
+    int i, idx = sock - sockets;
+    for (i = 0; i < LWIP_SOCKET_EPOLL_NUM; i++) {
+      if (epolls[i].used && epolls[i].items[idx].registered) {
+        lwip_epoll_unregister(&epolls[i].items[idx], sock);
+      }
+    }
+  }
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+  /* Wake up the tasks waiting in select or poll, they find the socket closed */
+  lwip_sock_signal_waiters(sock, LWIP_SOCK_EV_READ | LWIP_SOCK_EV_WRITE | LWIP_SOCK_EV_ERROR);
+  SYS_ARCH_UNPROTECT(lev);
   /* don't use 'sock' after this line, as another task might have allocated it */
 
   if (lastdata != NULL) {
@@ -895,6 +1177,13 @@ lwip_close(int s)
   lwip_socket_drop_registered_memberships(s);
 #endif /* LWIP_IGMP */
 
+#if LWIP_SOCKET_ZEROCOPY
+  if (is_tcp) {
+    /* processed before netconn_delete(), after any pending lwip_sock_sent_track() */
+    tcpip_callback(lwip_sock_sent_abort, sock);
+  }
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
   err = netconn_delete(sock->conn);
   if (err != ERR_OK) {
     LWIP_DEBUGF(SOCKETS_DEBUG|THREAD_SAFE_DEBUG, ("netconn_delete fail, ret=%d\n", err));
@@ -1205,6 +1494,317 @@ lwip_recv(int s, void *mem, size_t len, int flags)
   return lwip_recvfrom(s, mem, len, flags, NULL, NULL);
 }
 
+/**
+ * Receive several datagrams: wait for the first one as lwip_recvfrom()
+ * would, then take the ones already queued without waiting again.
+ *
+ * @param s the UDP or RAW socket
+ * @param msgvec the messages to fill: msg_len returns the bytes received,
+ *        msg_flags MSG_TRUNC if the datagram didn't fit, msg_name (if not
+ *        NULL) the sender
+ * @param vlen number of messages in 'msgvec'
+ * @param flags MSG_DONTWAIT to not wait for the first datagram
+ * @param timeout not supported, must be NULL (use SO_RCVTIMEO)
+ * @return the number of messages received, -1 on error
+ */
+int
+lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+              struct timeval *timeout)
+{
+  struct lwip_sock *sock;
+  struct netbuf    *buf;
+  unsigned int     n;
+  err_t            err;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if ((timeout != NULL) || ((msgvec == NULL) && (vlen > 0))) {
+    sock_set_errno(sock, EINVAL);
+    return -1;
+  }
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    sock_set_errno(sock, EOPNOTSUPP);
+    return -1;
+  }
+
+  for (n = 0; n < vlen; n++) {
+    struct msghdr *msg = &msgvec[n].msg_hdr;
+    struct pbuf *p;
+    u16_t copied = 0;
+    int i;
+
+    if (sock->lastdata) {
+      /* datagram left by lwip_recvfrom() with MSG_PEEK */
+      buf = (struct netbuf *)sock->lastdata;
+      sock->lastdata = NULL;
+    } else {
+      if (((n > 0) || (flags & MSG_DONTWAIT) || netconn_is_nonblocking(sock->conn)) &&
+          (sock->rcvevent <= 0)) {
+        if (n > 0) {
+          break;
+        }
+        sock_set_errno(sock, EWOULDBLOCK);
+        return -1;
+      }
+      err = netconn_recv(sock->conn, &buf);
+      if (err != ERR_OK) {
+        if (n > 0) {
+          break;
+        }
+        sock_set_errno(sock, err_to_errno(err));
+        return -1;
+      }
+    }
+
+    /* scatter the datagram into the IO vectors */
+    p = buf->p;
+    for (i = 0; (i < msg->msg_iovlen) && (copied < p->tot_len); i++) {
+      u16_t len = (u16_t)LWIP_MIN(msg->msg_iov[i].iov_len, 0xffff);
+      copied += pbuf_copy_partial(p, msg->msg_iov[i].iov_base, len, copied);
+    }
+    msgvec[n].msg_len = copied;
+    msg->msg_flags = (copied < p->tot_len) ? MSG_TRUNC : 0;
+
+    if ((msg->msg_name != NULL) && (msg->msg_namelen > 0)) {
+      union sockaddr_aligned saddr;
+      IPADDR_PORT_TO_SOCKADDR(&saddr, netbuf_fromaddr(buf), netbuf_fromport(buf));
+      if (msg->msg_namelen > saddr.sa.sa_len) {
+        msg->msg_namelen = saddr.sa.sa_len;
+      }
+      MEMCPY(msg->msg_name, &saddr, msg->msg_namelen);
+    }
+    netbuf_delete(buf);
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmmsg(%d) received %u\n", s, n));
+  sock_set_errno(sock, 0);
+  return (int)n;
+}
+
+#if LWIP_SOCKET_ZEROCOPY
+/**
+ * Receive without copying: return the next received data as a pbuf chain
+ * instead of copying it into a buffer. Each call returns the data of one
+ * pbuf chain as received (TCP) or one datagram (UDP, RAW).
+ *
+ * The pbufs stay allocated (possibly as WiFi receive buffers) until they are
+ * given back with lwip_recv_pbuf_free(), and the TCP receive window is only
+ * opened again then, so the sender is slowed down while they are held.
+ *
+ * @param s the socket
+ * @param p returns the received pbuf chain
+ * @param flags MSG_DONTWAIT (MSG_PEEK is not supported)
+ * @param from returns the address of the sender if not NULL
+ * @param fromlen size of 'from', returns the size of the address
+ * @return the number of bytes in the pbuf chain, 0 if the connection was
+ *         closed, -1 on error
+ */
+int
+lwip_recv_pbuf(int s, struct pbuf **p, int flags,
+               struct sockaddr *from, socklen_t *fromlen)
+{
+  struct lwip_sock *sock;
+  void             *buf;
+  struct pbuf      *q;
+  u16_t            port = 0;
+  ip_addr_t        tmpaddr;
+  ip_addr_t        *fromaddr = &tmpaddr;
+  u8_t             is_tcp;
+  err_t            err;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_pbuf(%d, %p, 0x%x, ..)\n", s, (void *)p, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if ((p == NULL) || ((flags & MSG_PEEK) != 0)) {
+    sock_set_errno(sock, EINVAL);
+    return -1;
+  }
+  *p = NULL;
+  is_tcp = NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP;
+
+  if (sock->lastdata) {
+    /* data left by lwip_recvfrom() */
+    buf = sock->lastdata;
+    sock->lastdata = NULL;
+  } else {
+    if (((flags & MSG_DONTWAIT) || netconn_is_nonblocking(sock->conn)) &&
+        (sock->rcvevent <= 0)) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_pbuf(%d): returning EWOULDBLOCK\n", s));
+      sock_set_errno(sock, EWOULDBLOCK);
+      return -1;
+    }
+    if (is_tcp) {
+      err = netconn_recv_tcp_pbuf(sock->conn, (struct pbuf **)&buf);
+    } else {
+      err = netconn_recv(sock->conn, (struct netbuf **)&buf);
+    }
+    if (err != ERR_OK) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_pbuf(%d): error is \"%s\"!\n",
+        s, lwip_strerr(err)));
+      sock_set_errno(sock, err_to_errno(err));
+      return (err == ERR_CLSD) ? 0 : -1;
+    }
+  }
+
+  if (is_tcp) {
+    q = (struct pbuf *)buf;
+    /* drop the part lwip_recvfrom() has already returned, which also
+       opened the receive window for it */
+    while (sock->lastoffset >= q->len) {
+      struct pbuf *next = q->next;
+      sock->lastoffset -= q->len;
+      q->next = NULL;
+      pbuf_free(q);
+      q = next;
+    }
+    if (sock->lastoffset > 0) {
+      pbuf_header(q, -(s16_t)sock->lastoffset);
+      sock->lastoffset = 0;
+    }
+    if (from && fromlen) {
+      netconn_getaddr(sock->conn, fromaddr, &port, 0);
+    }
+  } else {
+    q = ((struct netbuf *)buf)->p;
+    port = netbuf_fromport((struct netbuf *)buf);
+    fromaddr = netbuf_fromaddr((struct netbuf *)buf);
+  }
+
+  if (from && fromlen) {
+    union sockaddr_aligned saddr;
+    IPADDR_PORT_TO_SOCKADDR(&saddr, fromaddr, port);
+    if (*fromlen > saddr.sa.sa_len) {
+      *fromlen = saddr.sa.sa_len;
+    }
+    MEMCPY(from, &saddr, *fromlen);
+  }
+
+  if (!is_tcp) {
+    /* keep the pbufs, free only the netbuf */
+    ((struct netbuf *)buf)->p = NULL;
+    netbuf_delete((struct netbuf *)buf);
+  }
+
+  *p = q;
+  sock_set_errno(sock, 0);
+  return q->tot_len;
+}
+
+/**
+ * Give back a pbuf chain returned by lwip_recv_pbuf() and, for TCP, open
+ * the receive window for its data again. The pbuf is freed even if the
+ * socket has been closed in the meantime.
+ *
+ * @param s the socket the pbuf was received on
+ * @param p the pbuf chain as returned by lwip_recv_pbuf()
+ * @return 0 on success, -1 if the socket is closed
+ */
+int
+lwip_recv_pbuf_free(int s, struct pbuf *p)
+{
+  struct lwip_sock *sock;
+  u16_t len;
+
+  if (p == NULL) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  len = p->tot_len;
+  pbuf_free(p);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    netconn_recved(sock->conn, len);
+  }
+  sock_set_errno(sock, 0);
+  return 0;
+}
+
+/**
+ * Send on a TCP socket without copying the data. The TCP segments reference
+ * the caller's buffer until they are acknowledged, then 'sent' is called
+ * from the tcpip thread with err 0, and the buffer may be reused. If the
+ * connection fails first, 'sent' is called with ECONNRESET once the
+ * segments have been dropped. Closing the socket while data is not
+ * acknowledged resets the connection, so wait for the last callback before
+ * closing for an orderly shutdown.
+ *
+ * 'sent' must not block or call socket functions which wait for the tcpip
+ * thread. It is only called if data was queued, i.e. if the return value
+ * is >= 0.
+ *
+ * @param s the TCP socket
+ * @param data the data, which must not be changed until 'sent' is called
+ * @param size number of bytes to send
+ * @param flags MSG_DONTWAIT, MSG_MORE
+ * @param sent callback called once 'data' is no longer referenced
+ * @param arg argument passed to 'sent'
+ * @return the number of bytes queued (fewer than 'size' for a non-blocking
+ *         send), -1 on error
+ */
+int
+lwip_send_nocopy(int s, const void *data, size_t size, int flags,
+                 lwip_sent_fn sent, void *arg)
+{
+  struct lwip_sock *sock;
+  struct lwip_sock_sent *ref;
+  err_t err;
+  u8_t write_flags;
+  size_t written = 0;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_send_nocopy(%d, data=%p, size=%"SZT_F", flags=0x%x)\n",
+                              s, data, size, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+    sock_set_errno(sock, EOPNOTSUPP);
+    return -1;
+  }
+  if (sent == NULL) {
+    sock_set_errno(sock, EINVAL);
+    return -1;
+  }
+
+  ref = (struct lwip_sock_sent *)mem_malloc(sizeof(struct lwip_sock_sent));
+  if (ref == NULL) {
+    sock_set_errno(sock, ENOMEM);
+    return -1;
+  }
+  ref->sock = sock;
+  ref->s = s;
+  ref->end = 0;
+  ref->sent = sent;
+  ref->arg = arg;
+
+  write_flags = NETCONN_REF |
+    ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
+    ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0);
+  err = netconn_write_partly(sock->conn, data, size, write_flags, &written);
+  if ((err != ERR_OK) && (written == 0)) {
+    /* nothing was queued */
+    mem_free(ref);
+    sock_set_errno(sock, err_to_errno(err));
+    return -1;
+  }
+
+  /* can't fail: tcpip_callback() waits for room in the mailbox */
+  tcpip_callback(lwip_sock_sent_track, ref);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_send_nocopy(%d) written=%"SZT_F"\n", s, written));
+  sock_set_errno(sock, 0);
+  return (int)written;
+}
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
 int
 lwip_send(int s, const void *data, size_t size, int flags)
 {
@@ -1244,13 +1844,99 @@ lwip_send(int s, const void *data, size_t size, int flags)
   return (err == ERR_OK ? (int)written : -1);
 }
 
-int
-lwip_sendmsg(int s, const struct msghdr *msg, int flags)
-{
-  struct lwip_sock *sock;
-  struct netbuf *chain_buf;
+#if LWIP_UDP || LWIP_RAW
+/**
+ * Fill an empty netbuf with the destination and the IO vectors of a msghdr,
+ * for sending it on a UDP or RAW socket.
+ *
+ * @param msg the message to send
+ * @param buf the netbuf to fill (empty, as returned by netbuf_new())
+ * @param size returns the number of bytes in the netbuf
+ * @return ERR_OK or an error code, the netbuf still has to be freed then
+ */
+static err_t
+lwip_sendmsg_netbuf(const struct msghdr *msg, struct netbuf *buf, int *size)
+{
   u16_t remote_port;
   int i;
+  err_t err = ERR_OK;
+
+  *size = 0;
+  if (msg->msg_name) {
+    SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &buf->addr, remote_port);
+    netbuf_fromport(buf) = remote_port;
+  }
+#if LWIP_NETIF_TX_SINGLE_PBUF
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    *size += msg->msg_iov[i].iov_len;
+  }
+  /* Allocate a new netbuf and copy the data into it. */
+  if (netbuf_alloc(buf, (u16_t)*size) == NULL) {
+    err = ERR_MEM;
+  }
+  else {
+    /* flatten the IO vectors */
+    size_t offset = 0;
+#if LWIP_CHECKSUM_ON_COPY
+    /* checksum each IO vector while copying it, and add them up */
+    u32_t acc = 0;
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      u16_t chksum = LWIP_CHKSUM_COPY(&((u8_t*)buf->p->payload)[offset], msg->msg_iov[i].iov_base,
+                                      (u16_t)msg->msg_iov[i].iov_len);
+      if (offset & 1) {
+        /* the vector starts on an odd offset of the packet */
+        chksum = SWAP_BYTES_IN_WORD(chksum);
+      }
+      acc += chksum;
+      offset += msg->msg_iov[i].iov_len;
+    }
+    acc = FOLD_U32T(acc);
+    acc = FOLD_U32T(acc);
+    netbuf_set_chksum(buf, (u16_t)acc);
+#else /* LWIP_CHECKSUM_ON_COPY */
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      MEMCPY(&((u8_t*)buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      offset += msg->msg_iov[i].iov_len;
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY */
+    err = ERR_OK;
+  }
+#else /* LWIP_NETIF_TX_SINGLE_PBUF */
+  /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
+     manually to avoid having to allocate, chain, and delete a netbuf for each iov */
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
+    if (p == NULL) {
+      err = ERR_MEM; /* let the caller free buf */
+      break;
+    }
+    p->payload = msg->msg_iov[i].iov_base;
+    LWIP_ASSERT("iov_len < u16_t", msg->msg_iov[i].iov_len <= 0xFFFF);
+    p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
+    /* netbuf empty, add new pbuf */
+    if (buf->p == NULL) {
+      buf->p = buf->ptr = p;
+    /* add pbuf to existing pbuf chain */
+    } else {
+      pbuf_cat(buf->p, p);
+    }
+  }    
+  /* save size of total chain */
+  if (err == ERR_OK) {
+    *size = netbuf_len(buf);
+  }
+#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+
+  return err;
+}
+#endif /* LWIP_UDP || LWIP_RAW */
+
+int
+lwip_sendmsg(int s, const struct msghdr *msg, int flags)
+{
+  struct lwip_sock *sock;
+  struct netbuf *chain_buf;
+  int i;
 #if LWIP_TCP
   u8_t write_flags;
   size_t written;
@@ -1318,59 +2004,7 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
     sock_set_errno(sock, err_to_errno(ERR_MEM));
     return -1;
   }
-  if (msg->msg_name) {
-    SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf->addr, remote_port);
-    netbuf_fromport(chain_buf) = remote_port;
-  }
-#if LWIP_NETIF_TX_SINGLE_PBUF
-  for (i = 0; i < msg->msg_iovlen; i++) {
-    size += msg->msg_iov[i].iov_len;
-  }
-  /* Allocate a new netbuf and copy the data into it. */
-  if (netbuf_alloc(chain_buf, (u16_t)size) == NULL) {
-    err = ERR_MEM;
-  }
-  else {
-    /* flatten the IO vectors */
-    size_t offset = 0;
-    for (i = 0; i < msg->msg_iovlen; i++) {
-      MEMCPY(&((u8_t*)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
-      offset += msg->msg_iov[i].iov_len;
-    }
-#if LWIP_CHECKSUM_ON_COPY
-    {
-      /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
-      u16_t chksum = ~inet_chksum_pbuf(chain_buf->p);
-      netbuf_set_chksum(chain_buf, chksum);
-    }
-#endif /* LWIP_CHECKSUM_ON_COPY */
-    err = ERR_OK;
-  }
-#else /* LWIP_NETIF_TX_SINGLE_PBUF */
-  /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
-     manually to avoid having to allocate, chain, and delete a netbuf for each iov */
-  for (i = 0; i < msg->msg_iovlen; i++) {
-    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
-    if (p == NULL) {
-      err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
-      break;
-    }
-    p->payload = msg->msg_iov[i].iov_base;
-    LWIP_ASSERT("iov_len < u16_t", msg->msg_iov[i].iov_len <= 0xFFFF);
-    p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
-    /* netbuf empty, add new pbuf */
-    if (chain_buf->p == NULL) {
-      chain_buf->p = chain_buf->ptr = p;
-    /* add pbuf to existing pbuf chain */
-    } else {
-      pbuf_cat(chain_buf->p, p);
-    }
-  }    
-  /* save size of total chain */
-  if (err == ERR_OK) {
-    size = netbuf_len(chain_buf);
-  }
-#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+  err = lwip_sendmsg_netbuf(msg, chain_buf, &size);
 
   if (err == ERR_OK) {
     /* send the data */
@@ -1388,6 +2022,93 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 #endif /* LWIP_UDP || LWIP_RAW */
 }
 
+/**
+ * Send several datagrams. The datagrams of up to LWIP_SOCKET_MMSG_BATCH
+ * messages are built first and then sent with one message to tcpip_thread
+ * (or with the core lock taken once), which saves a round-trip per
+ * datagram compared to lwip_sendmsg().
+ *
+ * @param s the UDP or RAW socket
+ * @param msgvec the messages to send, msg_len returns the bytes sent
+ * @param vlen number of messages in 'msgvec'
+ * @param flags unused
+ * @return the number of messages sent, -1 if the first one failed
+ */
+int
+lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+#if LWIP_UDP || LWIP_RAW
+  struct netbuf bufs[LWIP_SOCKET_MMSG_BATCH];
+  unsigned int done = 0;
+  err_t err = ERR_OK;
+#endif /* LWIP_UDP || LWIP_RAW */
+
+  LWIP_UNUSED_ARG(flags);
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  LWIP_ERROR("lwip_sendmmsg: invalid msgvec", (msgvec != NULL) || (vlen == 0),
+             sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    sock_set_errno(sock, EOPNOTSUPP);
+    return -1;
+  }
+#if LWIP_UDP || LWIP_RAW
+  while (done < vlen) {
+    u16_t num = (u16_t)LWIP_MIN(vlen - done, LWIP_SOCKET_MMSG_BATCH);
+    u16_t built, sent = 0, i;
+
+    esp32_tx_flow_ctrl();
+
+    for (built = 0; built < num; built++) {
+      const struct msghdr *msg = &msgvec[done + built].msg_hdr;
+      int size;
+
+      if ((msg->msg_iov == NULL) || (msg->msg_iovlen == 0) ||
+          ((msg->msg_name != NULL) ? !IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen) : (msg->msg_namelen != 0))) {
+        err = ERR_ARG;
+        break;
+      }
+      memset(&bufs[built], 0, sizeof(struct netbuf));
+      err = lwip_sendmsg_netbuf(msg, &bufs[built], &size);
+      if (err != ERR_OK) {
+        netbuf_free(&bufs[built]);
+        break;
+      }
+      msgvec[done + built].msg_len = (unsigned int)size;
+    }
+
+    if (built > 0) {
+      err_t send_err = netconn_send_multi(sock->conn, bufs, built, &sent);
+      if (send_err != ERR_OK) {
+        err = send_err;
+      }
+    }
+    for (i = 0; i < built; i++) {
+      netbuf_free(&bufs[i]);
+    }
+    done += sent;
+    if (sent < num) {
+      break;
+    }
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendmmsg(%d) sent %u of %u\n", s, done, vlen));
+  if ((done == 0) && (vlen > 0)) {
+    sock_set_errno(sock, err_to_errno(err));
+    return -1;
+  }
+  sock_set_errno(sock, 0);
+  return (int)done;
+#else /* LWIP_UDP || LWIP_RAW */
+  sock_set_errno(sock, err_to_errno(ERR_ARG));
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
 int
 lwip_sendto(int s, const void *data, size_t size, int flags,
        const struct sockaddr *to, socklen_t tolen)
@@ -1651,219 +2372,799 @@ lwip_selscan(int maxfdp1, fd_set *readset_in, fd_set *writeset_in, fd_set *excep
   *writeset_out = lwriteset;
   *exceptset_out = lexceptset;
 
-  LWIP_ASSERT("nready >= 0", nready >= 0);
-  return nready;
+  LWIP_ASSERT("nready >= 0", nready >= 0);
+  return nready;
+}
+
+int
+lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
+            struct timeval *timeout)
+{
+  u32_t waitres = 0;
+  int nready;
+  fd_set lreadset, lwriteset, lexceptset;
+  u32_t msectimeout;
+  struct lwip_select_cb select_cb;
+  struct lwip_sock_waiter waiters[NUM_SOCKETS];
+  int i;
+#if LWIP_NETCONN_SEM_PER_THREAD
+  int waited = 0;
+#endif
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select(%d, %p, %p, %p, tvsec=%"S32_F" tvusec=%"S32_F")\n",
+                  maxfdp1, (void *)readset, (void *) writeset, (void *) exceptset,
+                  timeout ? (s32_t)timeout->tv_sec : (s32_t)-1,
+                  timeout ? (s32_t)timeout->tv_usec : (s32_t)-1));
+
+  /* Go through each socket in each list to count number of sockets which
+     currently match */
+  nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
+
+  /* If we don't have any current events, then suspend if we are supposed to */
+  if (!nready) {
+    if (timeout && timeout->tv_sec == 0 && timeout->tv_usec == 0) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: no timeout, returning 0\n"));
+      /* This is OK as the local fdsets are empty and nready is zero,
+         or we would have returned earlier. */
+      goto return_copy_fdsets;
+    }
+
+    /* None ready: put a waiter on each socket we are interested in.
+       We don't actually need any dynamic memory. Our waiters are only
+       linked while we are in this function, so it's ok to use local
+       variables. */
+
+    select_cb.sem_signalled = 0;
+#if LWIP_NETCONN_SEM_PER_THREAD
+    select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+    if (sys_sem_new(&select_cb.sem, 0) != ERR_OK) {
+      /* failed to create semaphore */
+      set_errno(ENOMEM);
+      return -1;
+    }
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    for (i = 0; i < NUM_SOCKETS; i++) {
+      waiters[i].events = 0;
+    }
+    for (i = LWIP_SOCKET_OFFSET; i < maxfdp1; i++) {
+      struct lwip_sock *sock;
+      struct lwip_sock_waiter *waiter;
+      u8_t events = 0;
+
+      if (readset && FD_ISSET(i, readset)) {
+        events |= LWIP_SOCK_EV_READ;
+      }
+      if (writeset && FD_ISSET(i, writeset)) {
+        events |= LWIP_SOCK_EV_WRITE;
+      }
+      if (exceptset && FD_ISSET(i, exceptset)) {
+        events |= LWIP_SOCK_EV_ERROR;
+      }
+      if (events == 0) {
+        continue;
+      }
+      SYS_ARCH_PROTECT(lev);
+      sock = tryget_socket(i);
+      if (sock == NULL) {
+        /* Not a valid socket */
+        nready = -1;
+        SYS_ARCH_UNPROTECT(lev);
+        break;
+      }
+      waiter = &waiters[i - LWIP_SOCKET_OFFSET];
+      waiter->events = events;
+      waiter->scb = &select_cb;
+#if LWIP_SOCKET_EPOLL_NUM
+      waiter->item = NULL;
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+      lwip_sock_add_waiter(sock, waiter);
+      SYS_ARCH_UNPROTECT(lev);
+    }
+
+    if (nready >= 0) {
+      /* Call lwip_selscan again: there could have been events between
+         the last scan (without our waiters) and putting our waiters on! */
+      nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
+      if (!nready) {
+        /* Still none ready, just wait to be woken */
+        if (timeout == 0) {
+          /* Wait forever */
+          msectimeout = 0;
+        } else {
+          msectimeout =  ((timeout->tv_sec * 1000) + ((timeout->tv_usec + 500)/1000));
+          if (msectimeout == 0) {
+            /* Wait 1ms at least (0 means wait forever) */
+            msectimeout = 1;
+          }
+        }
+
+        waitres = sys_arch_sem_wait(SELECT_SEM_PTR(select_cb.sem), msectimeout);
+#if LWIP_NETCONN_SEM_PER_THREAD
+        waited = 1;
+#endif
+      }
+    }
+
+    /* Take our waiters off the sockets */
+    for (i = 0; i < NUM_SOCKETS; i++) {
+      if (waiters[i].events != 0) {
+        SYS_ARCH_PROTECT(lev);
+        lwip_sock_remove_waiter(&sockets[i], &waiters[i]);
+        if (sockets[i].conn == NULL) {
+          /* Not a valid socket anymore */
+          nready = -1;
+        }
+        SYS_ARCH_UNPROTECT(lev);
+      }
+    }
+
+#if LWIP_NETCONN_SEM_PER_THREAD
+    if (select_cb.sem_signalled && (!waited || (waitres == SYS_ARCH_TIMEOUT))) {
+      /* don't leave the thread-local semaphore signalled */
+      sys_arch_sem_wait(select_cb.sem, 1);
+    }
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+    sys_sem_free(&select_cb.sem);
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    if (nready < 0) {
+      /* This happens when a socket got closed while waiting */
+      set_errno(EBADF);
+      return -1;
+    }
+
+    if (waitres == SYS_ARCH_TIMEOUT) {
+      /* Timeout */
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: timeout expired\n"));
+      /* This is OK as the local fdsets are empty and nready is zero,
+         or we would have returned earlier. */
+      goto return_copy_fdsets;
+    }
+
+    /* See what's set */
+    nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: nready=%d\n", nready));
+return_copy_fdsets:
+  set_errno(0);
+  if (readset) {
+    *readset = lreadset;
+  }
+  if (writeset) {
+    *writeset = lwriteset;
+  }
+  if (exceptset) {
+    *exceptset = lexceptset;
+  }
+  return nready;
+}
+
+#if LWIP_SOCKET_SELECT_HOOKS
+#if !LWIP_NETCONN_SEM_PER_THREAD
+#error LWIP_SOCKET_SELECT_HOOKS requires LWIP_NETCONN_SEM_PER_THREAD
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
+
+/** Waiters of a select started with lwip_select_start() */
+struct lwip_select_hook {
+  struct lwip_select_cb select_cb;
+  struct lwip_sock_waiter waiters[NUM_SOCKETS];
+};
+
+/**
+ * Start waiting for sockets as part of a select() which waits for other
+ * file descriptors as well: put a waiter on each socket in the sets, which
+ * signals 'sem' once one of them may have become ready. 'sem' is signalled
+ * at most once until lwip_select_end() is called, and can be shared with
+ * other sources of events.
+ *
+ * The sockets can become ready before the waiters are on, so the caller has
+ * to check them with lwip_select() and a zero timeout after this.
+ *
+ * @param maxfdp1 the highest socket index in the sets + 1
+ * @param readset sockets to wait for read events on, or NULL
+ * @param writeset sockets to wait for write events on, or NULL
+ * @param exceptset sockets to wait for errors on, or NULL
+ * @param sem semaphore to signal, which has to stay valid until lwip_select_end()
+ * @return handle to pass to lwip_select_end(), NULL if a socket is invalid
+ *         (errno EBADF) or there is no memory (errno ENOMEM)
+ */
+void *
+lwip_select_start(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
+                  sys_sem_t *sem)
+{
+  struct lwip_select_hook *hook;
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  hook = (struct lwip_select_hook *)mem_malloc(sizeof(struct lwip_select_hook));
+  if (hook == NULL) {
+    set_errno(ENOMEM);
+    return NULL;
+  }
+  hook->select_cb.sem_signalled = 0;
+  hook->select_cb.sem = sem;
+  for (i = 0; i < NUM_SOCKETS; i++) {
+    hook->waiters[i].events = 0;
+  }
+  for (i = LWIP_SOCKET_OFFSET; i < maxfdp1; i++) {
+    struct lwip_sock *sock;
+    struct lwip_sock_waiter *waiter;
+    u8_t events = 0;
+
+    if (readset && FD_ISSET(i, readset)) {
+      events |= LWIP_SOCK_EV_READ;
+    }
+    if (writeset && FD_ISSET(i, writeset)) {
+      events |= LWIP_SOCK_EV_WRITE;
+    }
+    if (exceptset && FD_ISSET(i, exceptset)) {
+      events |= LWIP_SOCK_EV_ERROR;
+    }
+    if (events == 0) {
+      continue;
+    }
+    SYS_ARCH_PROTECT(lev);
+    sock = tryget_socket(i);
+    if (sock == NULL) {
+      SYS_ARCH_UNPROTECT(lev);
+      lwip_select_end(hook);
+      set_errno(EBADF);
+      return NULL;
+    }
+    waiter = &hook->waiters[i - LWIP_SOCKET_OFFSET];
+    waiter->events = events;
+    waiter->scb = &hook->select_cb;
+#if LWIP_SOCKET_EPOLL_NUM
+    waiter->item = NULL;
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+    lwip_sock_add_waiter(sock, waiter);
+    SYS_ARCH_UNPROTECT(lev);
+  }
+  return hook;
+}
+
+/**
+ * Take the waiters put on by lwip_select_start() off the sockets again.
+ * lwIP doesn't signal the semaphore anymore once this returns.
+ *
+ * @param handle as returned by lwip_select_start()
+ */
+void
+lwip_select_end(void *handle)
+{
+  struct lwip_select_hook *hook = (struct lwip_select_hook *)handle;
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  for (i = 0; i < NUM_SOCKETS; i++) {
+    if (hook->waiters[i].events != 0) {
+      SYS_ARCH_PROTECT(lev);
+      lwip_sock_remove_waiter(&sockets[i], &hook->waiters[i]);
+      SYS_ARCH_UNPROTECT(lev);
+    }
+  }
+  mem_free(hook);
+}
+#endif /* LWIP_SOCKET_SELECT_HOOKS */
+
+/**
+ * Go through the pollfd entries and set their revents.
+ * Invalid sockets get POLLNVAL, entries with a negative fd are ignored.
+ *
+ * @return number of entries with events (>= 0)
+ */
+static int
+lwip_pollscan(struct pollfd *fds, nfds_t nfds)
+{
+  nfds_t i;
+  int nready = 0;
+  struct lwip_sock *sock;
+  u8_t ready;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  for (i = 0; i < nfds; i++) {
+    fds[i].revents = 0;
+    if (fds[i].fd < 0) {
+      continue;
+    }
+    SYS_ARCH_PROTECT(lev);
+    sock = tryget_socket(fds[i].fd);
+    if (sock == NULL) {
+      SYS_ARCH_UNPROTECT(lev);
+      fds[i].revents = POLLNVAL;
+      nready++;
+      continue;
+    }
+    ready = lwip_sock_ready(sock);
+    SYS_ARCH_UNPROTECT(lev);
+
+    if ((fds[i].events & POLLIN) && (ready & LWIP_SOCK_EV_READ)) {
+      fds[i].revents |= POLLIN;
+    }
+    if ((fds[i].events & POLLOUT) && (ready & LWIP_SOCK_EV_WRITE)) {
+      fds[i].revents |= POLLOUT;
+    }
+    if (ready & LWIP_SOCK_EV_ERROR) {
+      fds[i].revents |= POLLERR;
+    }
+    if (fds[i].revents != 0) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_pollscan: fd=%d revents=0x%x\n", fds[i].fd, fds[i].revents));
+      nready++;
+    }
+  }
+  return nready;
+}
+
+/**
+ * Wait until one of the sockets is ready for the events of its pollfd entry.
+ * Unlike select, this only puts a waiter on the sockets passed in, so an
+ * event on another socket doesn't wake the task up.
+ *
+ * @param timeout in milliseconds, -1 to wait forever
+ */
+int
+lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+  u32_t waitres = 0;
+  int nready;
+  nfds_t i;
+  int waited = 0;
+  struct lwip_select_cb select_cb;
+  struct lwip_sock_waiter local_waiters[NUM_SOCKETS];
+  struct lwip_sock_waiter *waiters = local_waiters;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll(%p, %u, %d)\n", (void *)fds, (unsigned)nfds, timeout));
+
+  nready = lwip_pollscan(fds, nfds);
+  if (nready || (timeout == 0)) {
+    set_errno(0);
+    return nready;
+  }
+
+  /* None ready: put a waiter on each socket. The waiters of up to NUM_SOCKETS
+     entries are local variables, more entries need dynamic memory. */
+  if (nfds > NUM_SOCKETS) {
+    waiters = (struct lwip_sock_waiter *)mem_malloc(nfds * sizeof(struct lwip_sock_waiter));
+    if (waiters == NULL) {
+      set_errno(ENOMEM);
+      return -1;
+    }
+  }
+
+  select_cb.sem_signalled = 0;
+#if LWIP_NETCONN_SEM_PER_THREAD
+  select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+  if (sys_sem_new(&select_cb.sem, 0) != ERR_OK) {
+    /* failed to create semaphore */
+    if (waiters != local_waiters) {
+      mem_free(waiters);
+    }
+    set_errno(ENOMEM);
+    return -1;
+  }
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+  for (i = 0; i < nfds; i++) {
+    struct lwip_sock *sock;
+
+    waiters[i].events = 0;
+    if (fds[i].fd < 0) {
+      continue;
+    }
+    SYS_ARCH_PROTECT(lev);
+    sock = tryget_socket(fds[i].fd);
+    if (sock != NULL) {
+      waiters[i].events = LWIP_SOCK_EV_ERROR;
+      if (fds[i].events & POLLIN) {
+        waiters[i].events |= LWIP_SOCK_EV_READ;
+      }
+      if (fds[i].events & POLLOUT) {
+        waiters[i].events |= LWIP_SOCK_EV_WRITE;
+      }
+      waiters[i].scb = &select_cb;
+#if LWIP_SOCKET_EPOLL_NUM
+      waiters[i].item = NULL;
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+      lwip_sock_add_waiter(sock, &waiters[i]);
+    }
+    /* else: closed meanwhile, the next scan reports POLLNVAL */
+    SYS_ARCH_UNPROTECT(lev);
+  }
+
+  /* Scan again: there could have been events between the last scan
+     (without our waiters) and putting our waiters on! */
+  nready = lwip_pollscan(fds, nfds);
+  if (!nready) {
+    /* 0 means wait forever */
+    waitres = sys_arch_sem_wait(SELECT_SEM_PTR(select_cb.sem), (timeout < 0) ? 0 : (u32_t)timeout);
+    waited = 1;
+  }
+
+  /* Take our waiters off the sockets */
+  for (i = 0; i < nfds; i++) {
+    if (waiters[i].events != 0) {
+      SYS_ARCH_PROTECT(lev);
+      lwip_sock_remove_waiter(&sockets[fds[i].fd - LWIP_SOCKET_OFFSET], &waiters[i]);
+      SYS_ARCH_UNPROTECT(lev);
+    }
+  }
+  if (waiters != local_waiters) {
+    mem_free(waiters);
+  }
+
+#if LWIP_NETCONN_SEM_PER_THREAD
+  if (select_cb.sem_signalled && (!waited || (waitres == SYS_ARCH_TIMEOUT))) {
+    /* don't leave the thread-local semaphore signalled */
+    sys_arch_sem_wait(select_cb.sem, 1);
+  }
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+  sys_sem_free(&select_cb.sem);
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+  if (waited) {
+    if (waitres == SYS_ARCH_TIMEOUT) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: timeout expired\n"));
+      /* the revents are all 0 from the last scan */
+      nready = 0;
+    } else {
+      /* See what's set */
+      nready = lwip_pollscan(fds, nfds);
+    }
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: nready=%d\n", nready));
+  set_errno(0);
+  return nready;
+}
+
+#if LWIP_SOCKET_EPOLL_NUM
+/**
+ * Map an externally used epoll file descriptor to the epoll instance.
+ *
+ * @return the epoll instance or NULL if not found
+ */
+static struct lwip_epoll *
+get_epoll(int epfd)
+{
+  epfd -= LWIP_EPOLL_OFFSET;
+
+  if ((epfd < 0) || (epfd >= LWIP_SOCKET_EPOLL_NUM) || !epolls[epfd].used) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("get_epoll(%d): invalid\n", epfd + LWIP_EPOLL_OFFSET));
+    set_errno(EBADF);
+    return NULL;
+  }
+  return &epolls[epfd];
+}
+
+/**
+ * Create an epoll instance. Its file descriptor has to be closed with
+ * lwip_epoll_close.
+ *
+ * @param size unused, has to be > 0
+ * @return the epoll file descriptor; -1 on error
+ */
+int
+lwip_epoll_create(int size)
+{
+  int i, j;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (size <= 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  for (i = 0; i < LWIP_SOCKET_EPOLL_NUM; i++) {
+    if (!epolls[i].used) {
+      epolls[i].used = 1;
+      epolls[i].wait = NULL;
+      epolls[i].ready_head = NULL;
+      epolls[i].ready_tail = NULL;
+      SYS_ARCH_UNPROTECT(lev);
+
+      /* Nothing is registered on a closed instance, so event_callback
+         doesn't look at the items */
+      for (j = 0; j < NUM_SOCKETS; j++) {
+        epolls[i].items[j].ep = &epolls[i];
+        epolls[i].items[j].waiter.scb = NULL;
+        epolls[i].items[j].waiter.item = &epolls[i].items[j];
+      }
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_create: %d\n", i + LWIP_EPOLL_OFFSET));
+      set_errno(0);
+      return i + LWIP_EPOLL_OFFSET;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  set_errno(ENFILE);
+  return -1;
 }
 
+/**
+ * Close an epoll instance: the sockets registered on it are unregistered,
+ * a task waiting on it returns with EBADF.
+ */
 int
-lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
-            struct timeval *timeout)
+lwip_epoll_close(int epfd)
 {
-  u32_t waitres = 0;
-  int nready;
-  fd_set lreadset, lwriteset, lexceptset;
-  u32_t msectimeout;
-  struct lwip_select_cb select_cb;
+  struct lwip_epoll *ep;
   int i;
-  int maxfdp2;
-#if LWIP_NETCONN_SEM_PER_THREAD
-  int waited = 0;
-#endif
   SYS_ARCH_DECL_PROTECT(lev);
 
-  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select(%d, %p, %p, %p, tvsec=%"S32_F" tvusec=%"S32_F")\n",
-                  maxfdp1, (void *)readset, (void *) writeset, (void *) exceptset,
-                  timeout ? (s32_t)timeout->tv_sec : (s32_t)-1,
-                  timeout ? (s32_t)timeout->tv_usec : (s32_t)-1));
-
-  /* Go through each socket in each list to count number of sockets which
-     currently match */
-  nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
 
-  /* If we don't have any current events, then suspend if we are supposed to */
-  if (!nready) {
-    if (timeout && timeout->tv_sec == 0 && timeout->tv_usec == 0) {
-      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: no timeout, returning 0\n"));
-      /* This is OK as the local fdsets are empty and nready is zero,
-         or we would have returned earlier. */
-      goto return_copy_fdsets;
+  for (i = 0; i < NUM_SOCKETS; i++) {
+    SYS_ARCH_PROTECT(lev);
+    if (ep->items[i].registered) {
+      lwip_epoll_unregister(&ep->items[i], &sockets[i]);
     }
+    SYS_ARCH_UNPROTECT(lev);
+  }
 
-    /* None ready: add our semaphore to list:
-       We don't actually need any dynamic memory. Our entry on the
-       list is only valid while we are in this function, so it's ok
-       to use local variables. */
+  SYS_ARCH_PROTECT(lev);
+  ep->used = 0;
+  if ((ep->wait != NULL) && (ep->wait->sem_signalled == 0)) {
+    ep->wait->sem_signalled = 1;
+    sys_sem_signal(SELECT_SEM_PTR(ep->wait->sem));
+  }
+  SYS_ARCH_UNPROTECT(lev);
 
-    select_cb.next = NULL;
-    select_cb.prev = NULL;
-    select_cb.readset = readset;
-    select_cb.writeset = writeset;
-    select_cb.exceptset = exceptset;
-    select_cb.sem_signalled = 0;
-#if LWIP_NETCONN_SEM_PER_THREAD
-    select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
-#else /* LWIP_NETCONN_SEM_PER_THREAD */
-    if (sys_sem_new(&select_cb.sem, 0) != ERR_OK) {
-      /* failed to create semaphore */
-      set_errno(ENOMEM);
-      return -1;
-    }
-#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+  set_errno(0);
+  return 0;
+}
 
-    /* Protect the select_cb_list */
-    SYS_ARCH_PROTECT(lev);
+/**
+ * Register, modify or unregister a socket on an epoll instance.
+ *
+ * EPOLLIN, EPOLLOUT, EPOLLET and EPOLLONESHOT are supported; EPOLLERR is
+ * always reported. Closing a socket unregisters it.
+ */
+int
+lwip_epoll_ctl(int epfd, int op, int s, struct epoll_event *event)
+{
+  struct lwip_epoll *ep;
+  struct lwip_sock *sock;
+  struct lwip_epoll_item *item;
+  u8_t events = LWIP_SOCK_EV_ERROR;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_ctl(%d, %d, %d)\n", epfd, op, s));
 
-    /* Put this select_cb on top of list */
-    select_cb.next = select_cb_list;
-    if (select_cb_list != NULL) {
-      select_cb_list->prev = &select_cb;
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  sock = get_socket(s);
+  if (sock == NULL) {
+    return -1;
+  }
+  if ((op != EPOLL_CTL_ADD) && (op != EPOLL_CTL_MOD) && (op != EPOLL_CTL_DEL)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  if (op != EPOLL_CTL_DEL) {
+    if (event == NULL) {
+      set_errno(EFAULT);
+      return -1;
+    }
+    if (event->events & EPOLLIN) {
+      events |= LWIP_SOCK_EV_READ;
     }
-    select_cb_list = &select_cb;
-    /* Increasing this counter tells event_callback that the list has changed. */
-    select_cb_ctr++;
+    if (event->events & EPOLLOUT) {
+      events |= LWIP_SOCK_EV_WRITE;
+    }
+  }
 
-    /* Now we can safely unprotect */
+  item = &ep->items[s - LWIP_SOCKET_OFFSET];
+
+  SYS_ARCH_PROTECT(lev);
+  if (sock->conn == NULL) {
+    /* closed meanwhile */
+    SYS_ARCH_UNPROTECT(lev);
+    set_errno(EBADF);
+    return -1;
+  }
+  if ((op == EPOLL_CTL_ADD) ? item->registered : !item->registered) {
     SYS_ARCH_UNPROTECT(lev);
+    if (op == EPOLL_CTL_ADD) {
+      set_errno(EEXIST);
+    } else {
+      set_errno(ENOENT);
+    }
+    return -1;
+  }
 
-    /* Increase select_waiting for each socket we are interested in */
-    maxfdp2 = maxfdp1;
-    for (i = LWIP_SOCKET_OFFSET; i < maxfdp1; i++) {
-      if ((readset && FD_ISSET(i, readset)) ||
-          (writeset && FD_ISSET(i, writeset)) ||
-          (exceptset && FD_ISSET(i, exceptset))) {
-        struct lwip_sock *sock;
-        SYS_ARCH_PROTECT(lev);
-        sock = tryget_socket(i);
-        if (sock != NULL) {
-          sock->select_waiting++;
-          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
-        } else {
-          /* Not a valid socket */
-          nready = -1;
-          maxfdp2 = i;
-          SYS_ARCH_UNPROTECT(lev);
-          break;
-        }
-        SYS_ARCH_UNPROTECT(lev);
-      }
+  if (op == EPOLL_CTL_DEL) {
+    lwip_epoll_unregister(item, sock);
+  } else {
+    if (op == EPOLL_CTL_ADD) {
+      item->registered = 1;
+      lwip_sock_add_waiter(sock, &item->waiter);
+    }
+    item->events = event->events;
+    item->data = event->data;
+    item->waiter.events = events;
+    /* Report the events the socket is already ready for */
+    if (lwip_sock_ready(sock) & events) {
+      lwip_epoll_queue(item);
     }
+  }
+  SYS_ARCH_UNPROTECT(lev);
 
-    if (nready >= 0) {
-      /* Call lwip_selscan again: there could have been events between
-         the last scan (without us on the list) and putting us on the list! */
-      nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
-      if (!nready) {
-        /* Still none ready, just wait to be woken */
-        if (timeout == 0) {
-          /* Wait forever */
-          msectimeout = 0;
-        } else {
-          msectimeout =  ((timeout->tv_sec * 1000) + ((timeout->tv_usec + 500)/1000));
-          if (msectimeout == 0) {
-            /* Wait 1ms at least (0 means wait forever) */
-            msectimeout = 1;
-          }
-        }
+  set_errno(0);
+  return 0;
+}
 
-        waitres = sys_arch_sem_wait(SELECT_SEM_PTR(select_cb.sem), msectimeout);
-#if LWIP_NETCONN_SEM_PER_THREAD
-        waited = 1;
-#endif
-      }
+/**
+ * Move the registrations on the ready list of an epoll instance which are
+ * still ready to 'events'. Level-triggered ones go back on the ready list,
+ * so the next lwip_epoll_wait checks them again.
+ * Has to be called with SYS_ARCH protected.
+ *
+ * @return number of events stored
+ */
+static int
+lwip_epoll_collect(struct lwip_epoll *ep, struct epoll_event *events, int maxevents)
+{
+  struct lwip_epoll_item *item, *next;
+  u8_t ready;
+  int n = 0;
+
+  item = ep->ready_head;
+  ep->ready_head = NULL;
+  ep->ready_tail = NULL;
+
+  for (; item != NULL; item = next) {
+    next = item->ready_next;
+    item->queued = 0;
+    if (n == maxevents) {
+      /* no room left, keep it for the next call */
+      lwip_epoll_queue(item);
+      continue;
     }
 
-    /* Decrease select_waiting for each socket we are interested in */
-    for (i = LWIP_SOCKET_OFFSET; i < maxfdp2; i++) {
-      if ((readset && FD_ISSET(i, readset)) ||
-          (writeset && FD_ISSET(i, writeset)) ||
-          (exceptset && FD_ISSET(i, exceptset))) {
-        struct lwip_sock *sock;
-        SYS_ARCH_PROTECT(lev);
-        sock = tryget_socket(i);
-        if (sock != NULL) {
-          /* @todo: what if this is a new socket (reallocated?) in this case,
-             select_waiting-- would be wrong (a global 'sockalloc' counter,
-             stored per socket could help) */
-          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
-          if (sock->select_waiting > 0) {
-            sock->select_waiting--;
-          }
-        } else {
-          /* Not a valid socket */
-          nready = -1;
-        }
-        SYS_ARCH_UNPROTECT(lev);
-      }
+    ready = lwip_sock_ready(&sockets[item - ep->items]) & item->waiter.events;
+    if (ready == 0) {
+      /* not ready anymore, event_callback queues it again */
+      continue;
     }
-    /* Take us off the list */
-    SYS_ARCH_PROTECT(lev);
-    if (select_cb.next != NULL) {
-      select_cb.next->prev = select_cb.prev;
+
+    events[n].events = 0;
+    if (ready & LWIP_SOCK_EV_READ) {
+      events[n].events |= EPOLLIN;
     }
-    if (select_cb_list == &select_cb) {
-      LWIP_ASSERT("select_cb.prev == NULL", select_cb.prev == NULL);
-      select_cb_list = select_cb.next;
-    } else {
-      LWIP_ASSERT("select_cb.prev != NULL", select_cb.prev != NULL);
-      select_cb.prev->next = select_cb.next;
+    if (ready & LWIP_SOCK_EV_WRITE) {
+      events[n].events |= EPOLLOUT;
     }
-    /* Increasing this counter tells event_callback that the list has changed. */
-    select_cb_ctr++;
-    SYS_ARCH_UNPROTECT(lev);
+    if (ready & LWIP_SOCK_EV_ERROR) {
+      events[n].events |= EPOLLERR;
+    }
+    events[n].data = item->data;
+    n++;
+
+    if (item->events & EPOLLONESHOT) {
+      /* disabled until EPOLL_CTL_MOD */
+      item->waiter.events = 0;
+    } else if (!(item->events & EPOLLET)) {
+      lwip_epoll_queue(item);
+    }
+  }
+  return n;
+}
+
+/**
+ * Wait until sockets registered on an epoll instance become ready.
+ * This only looks at the registrations which got events, not at all the
+ * registered sockets. Only one task can wait on an instance at a time.
+ *
+ * @param timeout in milliseconds, -1 to wait forever
+ * @return number of events stored; -1 on error
+ */
+int
+lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  struct lwip_epoll *ep;
+  struct lwip_select_cb wait_cb;
+  u32_t waitres;
+  int n, signalled;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait(%d, %p, %d, %d)\n", epfd, (void *)events, maxevents, timeout));
+
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  if ((events == NULL) || (maxevents <= 0)) {
+    set_errno(EINVAL);
+    return -1;
+  }
 
 #if LWIP_NETCONN_SEM_PER_THREAD
-    if (select_cb.sem_signalled && (!waited || (waitres == SYS_ARCH_TIMEOUT))) {
-      /* don't leave the thread-local semaphore signalled */
-      sys_arch_sem_wait(select_cb.sem, 1);
-    }
+  wait_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
 #else /* LWIP_NETCONN_SEM_PER_THREAD */
-    sys_sem_free(&select_cb.sem);
+  if (sys_sem_new(&wait_cb.sem, 0) != ERR_OK) {
+    /* failed to create semaphore */
+    set_errno(ENOMEM);
+    return -1;
+  }
 #endif /* LWIP_NETCONN_SEM_PER_THREAD */
 
-    if (nready < 0) {
-      /* This happens when a socket got closed while waiting */
+  for (;;) {
+    SYS_ARCH_PROTECT(lev);
+    if (!ep->used) {
+      /* closed while waiting */
+      SYS_ARCH_UNPROTECT(lev);
       set_errno(EBADF);
-      return -1;
+      n = -1;
+      break;
+    }
+    n = lwip_epoll_collect(ep, events, maxevents);
+    if ((n != 0) || (timeout == 0)) {
+      SYS_ARCH_UNPROTECT(lev);
+      set_errno(0);
+      break;
+    }
+    if (ep->wait != NULL) {
+      SYS_ARCH_UNPROTECT(lev);
+      set_errno(EBUSY);
+      n = -1;
+      break;
     }
+    wait_cb.sem_signalled = 0;
+    ep->wait = &wait_cb;
+    SYS_ARCH_UNPROTECT(lev);
+
+    /* 0 means wait forever */
+    waitres = sys_arch_sem_wait(SELECT_SEM_PTR(wait_cb.sem), (timeout < 0) ? 0 : (u32_t)timeout);
+
+    SYS_ARCH_PROTECT(lev);
+    ep->wait = NULL;
+    signalled = wait_cb.sem_signalled;
+    SYS_ARCH_UNPROTECT(lev);
 
     if (waitres == SYS_ARCH_TIMEOUT) {
-      /* Timeout */
-      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: timeout expired\n"));
-      /* This is OK as the local fdsets are empty and nready is zero,
-         or we would have returned earlier. */
-      goto return_copy_fdsets;
+#if LWIP_NETCONN_SEM_PER_THREAD
+      if (signalled) {
+        /* don't leave the thread-local semaphore signalled */
+        sys_arch_sem_wait(wait_cb.sem, 1);
+      }
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+      /* look at the ready list a last time */
+      timeout = 0;
+    } else if (timeout > 0) {
+      timeout = (waitres < (u32_t)timeout) ? (timeout - (int)waitres) : 0;
     }
-
-    /* See what's set */
-    nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
   }
 
-  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: nready=%d\n", nready));
-return_copy_fdsets:
-  set_errno(0);
-  if (readset) {
-    *readset = lreadset;
-  }
-  if (writeset) {
-    *writeset = lwriteset;
-  }
-  if (exceptset) {
-    *exceptset = lexceptset;
-  }
-  return nready;
+#if !LWIP_NETCONN_SEM_PER_THREAD
+  sys_sem_free(&wait_cb.sem);
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
+  LWIP_UNUSED_ARG(signalled);
+  return n;
 }
+#endif /* LWIP_SOCKET_EPOLL_NUM */
 
 /**
  * Callback registered in the netconn layer for each socket-netconn.
- * Processes recvevent (data available) and wakes up tasks waiting for select.
+ * Processes recvevent (data available) and wakes up tasks waiting for
+ * select, poll or epoll_wait on the socket.
  */
 static void
 event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
 {
   int s;
   struct lwip_sock *sock;
-  struct lwip_select_cb *scb;
-  int last_select_cb_ctr;
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -1897,6 +3198,17 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
     return;
   }
 
+#if LWIP_SOCKET_ZEROCOPY
+  if ((evt == NETCONN_EVT_SENT) || (evt == NETCONN_EVT_ERROR)) {
+    if (sock->sent_refs != NULL) {
+      lwip_sock_sent_acked(sock);
+    }
+    if (evt == NETCONN_EVT_SENT) {
+      return;
+    }
+  }
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
   SYS_ARCH_PROTECT(lev);
   /* Set event as required */
   switch (evt) {
@@ -1920,56 +3232,9 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
-  if (sock->select_waiting == 0) {
-    /* noone is waiting for this socket, no need to check select_cb_list */
-    SYS_ARCH_UNPROTECT(lev);
-    return;
-  }
-
-  /* Now decide if anyone is waiting for this socket */
-  /* NOTE: This code goes through the select_cb_list list multiple times
-     ONLY IF a select was actually waiting. We go through the list the number
-     of waiting select calls + 1. This list is expected to be small. */
-
-  /* At this point, SYS_ARCH is still protected! */
-again:
-  for (scb = select_cb_list; scb != NULL; scb = scb->next) {
-    /* remember the state of select_cb_list to detect changes */
-    last_select_cb_ctr = select_cb_ctr;
-    if (scb->sem_signalled == 0) {
-      /* semaphore not signalled yet */
-      int do_signal = 0;
-      /* Test this select call for our socket */
-      if (sock->rcvevent > 0) {
-        if (scb->readset && FD_ISSET(s, scb->readset)) {
-          do_signal = 1;
-        }
-      }
-      if (sock->sendevent != 0) {
-        if (!do_signal && scb->writeset && FD_ISSET(s, scb->writeset)) {
-          do_signal = 1;
-        }
-      }
-      if (sock->errevent != 0) {
-        if (!do_signal && scb->exceptset && FD_ISSET(s, scb->exceptset)) {
-          do_signal = 1;
-        }
-      }
-      if (do_signal) {
-        scb->sem_signalled = 1;
-        /* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
-           lead to the select thread taking itself off the list, invalidating the semaphore. */
-        sys_sem_signal(SELECT_SEM_PTR(scb->sem));
-      }
-    }
-    /* unlock interrupts with each step */
-    SYS_ARCH_UNPROTECT(lev);
-    /* this makes sure interrupt protection time is short */
-    SYS_ARCH_PROTECT(lev);
-    if (last_select_cb_ctr != select_cb_ctr) {
-      /* someone has changed select_cb_list, restart at the beginning */
-      goto again;
-    }
+  /* Only the waiters of this socket are looked at: noone waiting, nothing to do */
+  if (sock->waiters != NULL) {
+    lwip_sock_signal_waiters(sock, lwip_sock_ready(sock));
   }
   SYS_ARCH_UNPROTECT(lev);
 }
@@ -2168,6 +3433,41 @@ lwip_getsockopt_callback(void *arg)
 }
 #endif  /* LWIP_TCPIP_CORE_LOCKING */
 
+#if LWIP_TCP
+/** Fill in the TCP_INFO of a connected TCP socket.
+ * Called from lwip_getsockopt_impl, i.e. in the tcpip thread or with the core locked.
+ */
+static void
+lwip_sock_tcp_info(struct lwip_sock *sock, struct tcp_info *info)
+{
+  struct tcp_pcb *pcb = sock->conn->pcb.tcp;
+
+  memset(info, 0, sizeof(struct tcp_info));
+  info->tcpi_state = (u8_t)pcb->state;
+  if (pcb->state == LISTEN) {
+    return;
+  }
+  info->tcpi_retransmits = pcb->nrtx;
+  info->tcpi_snd_mss = pcb->mss;
+  /* sa holds 8 times and sv 4 times the estimate, all in slow timer ticks */
+  info->tcpi_rto = (u32_t)pcb->rto * TCP_SLOW_INTERVAL;
+  info->tcpi_rtt = (u32_t)(pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+  info->tcpi_rttvar = (u32_t)(pcb->sv >> 2) * TCP_SLOW_INTERVAL;
+  info->tcpi_snd_cwnd = pcb->cwnd;
+  info->tcpi_snd_ssthresh = pcb->ssthresh;
+  info->tcpi_snd_wnd = pcb->snd_wnd;
+  info->tcpi_rcv_wnd = pcb->rcv_ann_wnd;
+  info->tcpi_unacked = pcb->snd_nxt - pcb->lastack;
+  info->tcpi_unsent = pcb->snd_lbb - pcb->snd_nxt;
+  info->tcpi_snd_queuelen = pcb->snd_queuelen;
+  info->tcpi_rcv_queuelen = (sock->rcvevent > 0) ? (u32_t)sock->rcvevent : 0;
+#if TCP_STATS
+  info->tcpi_total_retrans = pcb->rexmit_total;
+  info->tcpi_zerownd = pcb->zerownd_total;
+#endif /* TCP_STATS */
+}
+#endif /* LWIP_TCP */
+
 /** lwip_getsockopt_impl: the actual implementation of getsockopt:
  * same argument as lwip_getsockopt, either called directly or through callback
  */
@@ -2357,7 +3657,14 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
 #if LWIP_TCP
 /* Level: IPPROTO_TCP */
   case IPPROTO_TCP:
-    /* Special case: all IPPROTO_TCP option take an int */
+    if (optname == TCP_INFO) {
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, struct tcp_info, NETCONN_TCP);
+      lwip_sock_tcp_info(sock, (struct tcp_info *)optval);
+      *optlen = sizeof(struct tcp_info);
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_INFO)\n", s));
+      break;
+    }
+    /* Special case: all other IPPROTO_TCP option take an int */
     LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, int, NETCONN_TCP);
     switch (optname) {
     case TCP_NODELAY:
@@ -2365,6 +3672,11 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_NODELAY) = %s\n",
                   s, (*(int*)optval)?"on":"off") );
       break;
+    case TCP_CORK:
+      *(int*)optval = tcp_corked(sock->conn->pcb.tcp);
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_CORK) = %s\n",
+                  s, (*(int*)optval)?"on":"off") );
+      break;
     case TCP_KEEPALIVE:
       *(int*)optval = (int)sock->conn->pcb.tcp->keep_idle;
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_KEEPALIVE) = %d\n",
@@ -2602,6 +3914,12 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       } else {
         ip_reset_option(sock->conn->pcb.ip, optname);
       }
+#if LWIP_TCP && TCP_TMR_IDLE_SLEEP
+      if (optname == SO_KEEPALIVE) {
+        /* a keepalive may be due before the TCP timer wakes up */
+        tcp_timer_needed();
+      }
+#endif /* LWIP_TCP && TCP_TMR_IDLE_SLEEP */
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n",
                   s, optname, (*(const int*)optval?"on":"off")));
       break;
@@ -2762,6 +4080,19 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_NODELAY) -> %s\n",
                   s, (*(const int *)optval)?"on":"off") );
       break;
+    case TCP_CORK:
+      if (*(const int*)optval) {
+        sock->conn->pcb.tcp->flags |= TF_CORK;
+      } else {
+        sock->conn->pcb.tcp->flags &= ~TF_CORK;
+        if (sock->conn->pcb.tcp->state != LISTEN) {
+          /* send what was held back */
+          tcp_output(sock->conn->pcb.tcp);
+        }
+      }
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_CORK) -> %s\n",
+                  s, (*(const int *)optval)?"on":"off") );
+      break;
     case TCP_KEEPALIVE:
       sock->conn->pcb.tcp->keep_idle = (u32_t)(*(const int*)optval);
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPALIVE) -> %"U32_F"\n",
@@ -2791,6 +4122,10 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       err = ENOPROTOOPT;
       break;
     }  /* switch (optname) */
+#if TCP_TMR_IDLE_SLEEP
+    /* the keepalive settings may have moved the next keepalive forward */
+    tcp_timer_needed();
+#endif /* TCP_TMR_IDLE_SLEEP */
     break;
 #endif /* LWIP_TCP*/
 
@@ -3129,6 +4464,23 @@ lwip_recvfrom_r(int s, void *mem, size_t len, int flags,
   LWIP_API_UNLOCK();
 }
 
+int
+lwip_sendmmsg_r(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  LWIP_API_LOCK();
+  __ret = lwip_sendmmsg(s, msgvec, vlen, flags);
+  LWIP_API_UNLOCK();
+}
+
+int
+lwip_recvmmsg_r(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+              struct timeval *timeout)
+{
+  LWIP_API_LOCK();
+  __ret = lwip_recvmmsg(s, msgvec, vlen, flags, timeout);
+  LWIP_API_UNLOCK();
+}
+
 int
 lwip_recv_r(int s, void *mem, size_t len, int flags)
 {
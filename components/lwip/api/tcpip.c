@@ -73,6 +73,64 @@ static sys_mbox_t mbox;
 sys_mutex_t lock_tcpip_core;
 #endif /* LWIP_TCPIP_CORE_LOCKING */
 
+#ifdef LWIP_ESP8266
+static struct tcpip_stats tcpip_input_stats;
+#endif
+
+#if ESP_RX_RING_SIZE && !LWIP_TCPIP_CORE_LOCKING_INPUT
+#if ESP_RX_RING_SIZE & (ESP_RX_RING_SIZE - 1)
+#error "ESP_RX_RING_SIZE must be a power of two"
+#endif
+/* Received frames on their way to the tcpip thread. The WiFi driver side
+   appends to the ring in a short critical section (frames can come from the
+   station and the softAP interface); only the tcpip thread removes frames,
+   without locking. rx_head and rx_tail are free running counters.
+
+   rx_ring_msg is posted when the first frame is queued while no wakeup is
+   pending, and the tcpip thread then processes all frames queued so far. */
+struct rx_slot {
+  struct pbuf *p;
+  struct netif *netif;
+  netif_input_fn input_fn;
+};
+static struct rx_slot rx_ring[ESP_RX_RING_SIZE];
+static volatile u32_t rx_head;
+static volatile u32_t rx_tail;
+static u8_t rx_wakeup_pending;
+static struct tcpip_msg rx_ring_msg;
+
+/** Process the frames in the RX ring, in the tcpip thread */
+static void
+tcpip_rx_ring_drain(void)
+{
+  u32_t head = rx_head;
+  u32_t tail = rx_tail;
+
+  if (head == tail) {
+    return;
+  }
+  tcpip_input_stats.rx_batches++;
+  while (tail != head) {
+    struct rx_slot slot = rx_ring[tail & (ESP_RX_RING_SIZE - 1)];
+    rx_tail = ++tail;
+    slot.input_fn(slot.p, slot.netif);
+  }
+}
+
+static void
+tcpip_rx_ring_wakeup(void *ctx)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+  LWIP_UNUSED_ARG(ctx);
+
+  /* frames queued from now on need a new wakeup */
+  SYS_ARCH_PROTECT(lev);
+  rx_wakeup_pending = 0;
+  SYS_ARCH_UNPROTECT(lev);
+  tcpip_rx_ring_drain();
+}
+#endif /* ESP_RX_RING_SIZE && !LWIP_TCPIP_CORE_LOCKING_INPUT */
+
 
 /**
  * The main lwIP thread. This thread has exclusive access to lwIP core functions
@@ -108,6 +166,14 @@ tcpip_thread(void *arg)
     /* wait for a message, timeouts are processed while waiting */
     sys_timeouts_mbox_fetch(&mbox, (void **)&msg);
     LOCK_TCPIP_CORE();
+#ifdef LWIP_ESP8266
+    {
+      u32_t waiting = sys_mbox_waiting(&mbox) + 1;
+      if (waiting > tcpip_input_stats.mbox_high_water) {
+        tcpip_input_stats.mbox_high_water = waiting;
+      }
+    }
+#endif
     
 
     
@@ -194,6 +260,11 @@ tcpip_thread(void *arg)
       break;
     }
 
+#if ESP_RX_RING_SIZE && !LWIP_TCPIP_CORE_LOCKING_INPUT
+    /* also picks up frames whose wakeup didn't fit in the mailbox */
+    tcpip_rx_ring_drain();
+#endif
+
   }
 }
 
@@ -214,6 +285,43 @@ tcpip_inpkt(struct pbuf *p, struct netif *inp, netif_input_fn input_fn)
   ret = input_fn(p, inp);
   UNLOCK_TCPIP_CORE();
   return ret;
+#elif ESP_RX_RING_SIZE
+  struct rx_slot *slot;
+  u8_t wakeup;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (!sys_mbox_valid_val(mbox)) {
+    return ERR_VAL;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  if (rx_head - rx_tail >= ESP_RX_RING_SIZE) {
+    tcpip_input_stats.rx_dropped++;
+    SYS_ARCH_UNPROTECT(lev);
+    return ERR_MEM;
+  }
+  slot = &rx_ring[rx_head & (ESP_RX_RING_SIZE - 1)];
+  slot->p = p;
+  slot->netif = inp;
+  slot->input_fn = input_fn;
+  rx_head++;
+  tcpip_input_stats.rx_frames++;
+  if (rx_head - rx_tail > tcpip_input_stats.rx_ring_high_water) {
+    tcpip_input_stats.rx_ring_high_water = rx_head - rx_tail;
+  }
+  wakeup = !rx_wakeup_pending;
+  rx_wakeup_pending = 1;
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (wakeup && sys_mbox_trypost(&mbox, &rx_ring_msg) != ERR_OK) {
+    /* the tcpip thread is busy and drains the ring after each message;
+       the next frame tries to post a wakeup again */
+    SYS_ARCH_PROTECT(lev);
+    rx_wakeup_pending = 0;
+    tcpip_input_stats.mbox_post_failed++;
+    SYS_ARCH_UNPROTECT(lev);
+  }
+  return ERR_OK;
 #else /* LWIP_TCPIP_CORE_LOCKING_INPUT */
   struct tcpip_msg *msg;
 
@@ -232,6 +340,9 @@ tcpip_inpkt(struct pbuf *p, struct netif *inp, netif_input_fn input_fn)
   if (sys_mbox_trypost(&mbox, msg) != ERR_OK) {
 #ifdef PERF
     g_rx_post_mbox_fail_cnt ++; 
+#endif
+#ifdef LWIP_ESP8266
+    SYS_ARCH_INC(tcpip_input_stats.mbox_post_failed, 1);
 #endif
     memp_free(MEMP_TCPIP_MSG_INPKT, msg);
     return ERR_MEM;
@@ -501,6 +612,11 @@ tcpip_init(tcpip_init_done_fn initfunc, void *arg)
     LWIP_ASSERT("failed to create lock_tcpip_core", 0);
   }
 #endif /* LWIP_TCPIP_CORE_LOCKING */
+#if ESP_RX_RING_SIZE && !LWIP_TCPIP_CORE_LOCKING_INPUT
+  rx_ring_msg.type = TCPIP_MSG_CALLBACK_STATIC;
+  rx_ring_msg.msg.cb.function = tcpip_rx_ring_wakeup;
+  rx_ring_msg.msg.cb.ctx = NULL;
+#endif
 
 
 #ifdef LWIP_ESP8266
@@ -515,6 +631,22 @@ tcpip_init(tcpip_init_done_fn initfunc, void *arg)
 
 }
 
+#ifdef LWIP_ESP8266
+/**
+ * Get the counters of the tcpip thread input path
+ *
+ * @param stats filled with the counters
+ */
+void
+tcpip_get_stats(struct tcpip_stats *stats)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+  SYS_ARCH_PROTECT(lev);
+  *stats = tcpip_input_stats;
+  SYS_ARCH_UNPROTECT(lev);
+}
+#endif /* LWIP_ESP8266 */
+
 /**
  * Simple callback function used with tcpip_callback to free a pbuf
  * (pbuf_free has a wrong signature for tcpip_callback)
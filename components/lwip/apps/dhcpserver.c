@@ -62,7 +62,13 @@
 #define DHCPS_DEBUG          0
 #define DHCPS_LOG printf
 
-#define MAX_STATION_NUM      8
+#ifndef DHCPS_MAX_STATION_NUM
+#define DHCPS_MAX_STATION_NUM 8
+#endif
+
+#define DHCPS_LEASE_HASH_SIZE   DHCPS_MAX_STATION_NUM
+/* the address pool of dhcps_poll_set has at most DHCPS_MAX_LEASE + 1 addresses */
+#define DHCPS_LEASE_ADDR_NUM    (DHCPS_MAX_LEASE + 1)
 
 #define DHCPS_STATE_OFFER 1
 #define DHCPS_STATE_DECLINE 2
@@ -85,7 +91,22 @@ static ip4_addr_t server_address;
 static ip4_addr_t client_address;        //added
 static ip4_addr_t client_address_plus;
 
-static list_node *plist = NULL;
+/* Leases are kept in a table of DHCPS_MAX_STATION_NUM entries, found by
+ * the hash of the MAC address of the client. A min-heap on the expiry time
+ * gives the lease to drop when it expires, or when the table is full. */
+struct dhcps_lease {
+    struct dhcps_pool pool;     /* lease_timer is the expiry time in minutes */
+    s16_t next;                 /* next lease in the hash bucket or the free list */
+    u16_t heap_pos;             /* position in dhcps_lease_heap */
+};
+
+static struct dhcps_lease dhcps_leases[DHCPS_MAX_STATION_NUM];
+static s16_t dhcps_lease_buckets[DHCPS_LEASE_HASH_SIZE];
+static s16_t dhcps_lease_heap[DHCPS_MAX_STATION_NUM];
+static u16_t dhcps_lease_count = 0;
+static s16_t dhcps_lease_free = -1;
+static u32_t dhcps_lease_used[(DHCPS_LEASE_ADDR_NUM + 31) / 32];  /* leased addresses of the pool */
+static u32_t dhcps_lease_now = 0;                                 /* minutes since start */
 static bool renew = false;
 
 static dhcps_lease_t dhcps_poll;
@@ -133,80 +154,245 @@ void *dhcps_option_info(u8_t op_id, u32_t opt_len)
 }
 
 /******************************************************************************
- * FunctionName : node_insert_to_list
- * Description  : insert the node to the list
- * Parameters   : phead -- the head node of the list
- *                pinsert -- the insert node of the list
+ * FunctionName : dhcps_lease_hash
+ * Description  : get the hash bucket of a MAC address
+ * Parameters   : mac -- The MAC addr
+ * Returns      : the index of the bucket in dhcps_lease_buckets
+*******************************************************************************/
+static u16_t dhcps_lease_hash(const u8_t *mac)
+{
+    u32_t hash = 2166136261UL;
+    u8_t i;
+
+    for (i = 0; i < 6; i++) {
+        hash = (hash ^ mac[i]) * 16777619UL;
+    }
+
+    return (u16_t)(hash % DHCPS_LEASE_HASH_SIZE);
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_lease_find
+ * Description  : search the lease of a MAC address
+ * Parameters   : mac -- The MAC addr
+ * Returns      : the index of the lease, or -1 if there is none
+*******************************************************************************/
+static s16_t dhcps_lease_find(const u8_t *mac)
+{
+    s16_t idx;
+
+    if (dhcps_lease_count == 0) {
+        return -1;
+    }
+
+    for (idx = dhcps_lease_buckets[dhcps_lease_hash(mac)]; idx >= 0; idx = dhcps_leases[idx].next) {
+        if (memcmp(dhcps_leases[idx].pool.mac, mac, sizeof(dhcps_leases[idx].pool.mac)) == 0) {
+            break;
+        }
+    }
+
+    return idx;
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_lease_heap_set
+ * Description  : put a lease at a position of the expiry heap
+ * Parameters   : pos -- the position in the heap
+ *                idx -- the index of the lease
  * Returns      : none
 *******************************************************************************/
-void node_insert_to_list(list_node **phead, list_node *pinsert)
+static void dhcps_lease_heap_set(u16_t pos, s16_t idx)
 {
-    list_node *plist = NULL;
-    struct dhcps_pool *pdhcps_pool = NULL;
-    struct dhcps_pool *pdhcps_node = NULL;
+    dhcps_lease_heap[pos] = idx;
+    dhcps_leases[idx].heap_pos = pos;
+}
 
-    if (*phead == NULL) {
-        *phead = pinsert;
-    } else {
-        plist = *phead;
-        pdhcps_node = pinsert->pnode;
-        pdhcps_pool = plist->pnode;
+/******************************************************************************
+ * FunctionName : dhcps_lease_heap_update
+ * Description  : restore the order of the expiry heap after the expiry
+ *                time of the lease at a position changed
+ * Parameters   : pos -- the position in the heap
+ * Returns      : none
+*******************************************************************************/
+static void dhcps_lease_heap_update(u16_t pos)
+{
+    s16_t idx = dhcps_lease_heap[pos];
+    u32_t expiry = dhcps_leases[idx].pool.lease_timer;
 
-        if (pdhcps_node->ip.addr < pdhcps_pool->ip.addr) {
-            pinsert->pnext = plist;
-            *phead = pinsert;
-        } else {
-            while (plist->pnext != NULL) {
-                pdhcps_pool = plist->pnext->pnode;
+    /* sift up, the earliest expiry is at the top */
+    while (pos > 0) {
+        u16_t parent = (pos - 1) / 2;
 
-                if (pdhcps_node->ip.addr < pdhcps_pool->ip.addr) {
-                    pinsert->pnext = plist->pnext;
-                    plist->pnext = pinsert;
-                    break;
-                }
+        if (dhcps_leases[dhcps_lease_heap[parent]].pool.lease_timer <= expiry) {
+            break;
+        }
 
-                plist = plist->pnext;
-            }
+        dhcps_lease_heap_set(pos, dhcps_lease_heap[parent]);
+        pos = parent;
+    }
 
-            if (plist->pnext == NULL) {
-                plist->pnext = pinsert;
-            }
+    /* sift down */
+    for (;;) {
+        u16_t child = 2 * pos + 1;
+
+        if (child >= dhcps_lease_count) {
+            break;
+        }
+
+        if ((child + 1 < dhcps_lease_count) &&
+                (dhcps_leases[dhcps_lease_heap[child + 1]].pool.lease_timer <
+                 dhcps_leases[dhcps_lease_heap[child]].pool.lease_timer)) {
+            child++;
         }
+
+        if (expiry <= dhcps_leases[dhcps_lease_heap[child]].pool.lease_timer) {
+            break;
+        }
+
+        dhcps_lease_heap_set(pos, dhcps_lease_heap[child]);
+        pos = child;
     }
 
-//	pinsert->pnext = NULL;
+    dhcps_lease_heap_set(pos, idx);
 }
 
 /******************************************************************************
- * FunctionName : node_delete_from_list
- * Description  : remove the node from list
- * Parameters   : phead -- the head node of the list
- *                pdelete -- the remove node of the list
+ * FunctionName : dhcps_lease_offset
+ * Description  : get the position of an address in the address pool
+ * Parameters   : ip -- The IP addr
+ * Returns      : the offset of the address from dhcps_poll.start_ip
+*******************************************************************************/
+static u32_t dhcps_lease_offset(const ip4_addr_t *ip)
+{
+    return htonl(ip->addr) - htonl(dhcps_poll.start_ip.addr);
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_lease_remove
+ * Description  : remove a lease from the table
+ * Parameters   : idx -- the index of the lease
  * Returns      : none
 *******************************************************************************/
-void node_remove_from_list(list_node **phead, list_node *pdelete)
+static void dhcps_lease_remove(s16_t idx)
 {
-    list_node *plist = NULL;
+    struct dhcps_lease *lease = &dhcps_leases[idx];
+    s16_t *pnext = &dhcps_lease_buckets[dhcps_lease_hash(lease->pool.mac)];
+    u32_t offset = dhcps_lease_offset(&lease->pool.ip);
+    u16_t pos = lease->heap_pos;
 
-    plist = *phead;
+    while (*pnext != idx) {
+        pnext = &dhcps_leases[*pnext].next;
+    }
+    *pnext = lease->next;
 
-    if (plist == NULL) {
-        *phead = NULL;
-    } else {
-        if (plist == pdelete) {
-            *phead = plist->pnext;
-            pdelete->pnext = NULL;
-        } else {
-            while (plist != NULL) {
-                if (plist->pnext == pdelete) {
-                    plist->pnext = pdelete->pnext;
-                    pdelete->pnext = NULL;
-                }
+    dhcps_lease_count--;
+    if (pos < dhcps_lease_count) {
+        dhcps_lease_heap_set(pos, dhcps_lease_heap[dhcps_lease_count]);
+        dhcps_lease_heap_update(pos);
+    }
 
-                plist = plist->pnext;
-            }
+    if (offset < DHCPS_LEASE_ADDR_NUM) {
+        dhcps_lease_used[offset / 32] &= ~(1UL << (offset % 32));
+    }
+
+    lease->next = dhcps_lease_free;
+    dhcps_lease_free = idx;
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_lease_add
+ * Description  : add a lease to the table, the lease which expires first
+ *                is dropped if the table is full
+ * Parameters   : mac -- The MAC addr
+ *                ip  -- The IP addr leased to it
+ * Returns      : the index of the lease
+*******************************************************************************/
+static s16_t dhcps_lease_add(const u8_t *mac, const ip4_addr_t *ip)
+{
+    struct dhcps_lease *lease;
+    u16_t bucket = dhcps_lease_hash(mac);
+    u32_t offset = dhcps_lease_offset(ip);
+    s16_t idx;
+
+    if (dhcps_lease_free < 0) {
+        dhcps_lease_remove(dhcps_lease_heap[0]);
+    }
+
+    idx = dhcps_lease_free;
+    lease = &dhcps_leases[idx];
+    dhcps_lease_free = lease->next;
+
+    memcpy(lease->pool.mac, mac, sizeof(lease->pool.mac));
+    lease->pool.ip.addr = ip->addr;
+    lease->pool.lease_timer = dhcps_lease_now + dhcps_lease_time;
+    lease->next = dhcps_lease_buckets[bucket];
+    dhcps_lease_buckets[bucket] = idx;
+
+    dhcps_lease_heap_set(dhcps_lease_count, idx);
+    dhcps_lease_count++;
+    dhcps_lease_heap_update(lease->heap_pos);
+
+    if (offset < DHCPS_LEASE_ADDR_NUM) {
+        dhcps_lease_used[offset / 32] |= 1UL << (offset % 32);
+    }
+
+    return idx;
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_lease_clear
+ * Description  : remove all the leases
+ * Parameters   : none
+ * Returns      : none
+*******************************************************************************/
+static void dhcps_lease_clear(void)
+{
+    s16_t idx;
+
+    for (idx = 0; idx < DHCPS_LEASE_HASH_SIZE; idx++) {
+        dhcps_lease_buckets[idx] = -1;
+    }
+
+    for (idx = 0; idx < DHCPS_MAX_STATION_NUM; idx++) {
+        dhcps_leases[idx].next = (idx + 1 < DHCPS_MAX_STATION_NUM) ? idx + 1 : -1;
+    }
+
+    dhcps_lease_free = 0;
+    dhcps_lease_count = 0;
+    memset(dhcps_lease_used, 0, sizeof(dhcps_lease_used));
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_lease_next_ip
+ * Description  : search the first address of the pool which isn't leased,
+ *                starting from client_address_plus
+ * Parameters   : ip -- set to the address found, or to 0 if all are leased
+ * Returns      : none
+*******************************************************************************/
+static void dhcps_lease_next_ip(ip4_addr_t *ip)
+{
+    u32_t num = dhcps_lease_offset(&dhcps_poll.end_ip) + 1;
+    u32_t start = dhcps_lease_offset(&client_address_plus);
+    u32_t i;
+
+    if (num > DHCPS_LEASE_ADDR_NUM) {
+        num = DHCPS_LEASE_ADDR_NUM;
+    }
+
+    if (start >= num) {
+        start = 0;
+    }
+
+    for (i = 0; i < num; i++) {
+        u32_t offset = (start + i) % num;
+
+        if ((dhcps_lease_used[offset / 32] & (1UL << (offset % 32))) == 0) {
+            ip->addr = htonl(htonl(dhcps_poll.start_ip.addr) + offset);
+            return;
         }
     }
+
+    ip4_addr_set_zero(ip);
 }
 
 /******************************************************************************
@@ -726,94 +912,40 @@ static s16_t parse_msg(struct dhcps_msg *m, u16_t len)
         DHCPS_LOG("dhcps: len = %d\n", len);
 #endif
         ip4_addr_t addr_tmp;
+        s16_t idx;
 
-        struct dhcps_pool *pdhcps_pool = NULL;
-        list_node *pnode = NULL;
-        list_node *pback_node = NULL;
-        ip4_addr_t first_address;
-        bool flag = false;
-
-        first_address.addr = dhcps_poll.start_ip.addr;
-        client_address.addr = client_address_plus.addr;
         renew = false;
+        idx = dhcps_lease_find(m->chaddr);
 
-        if (plist != NULL) {
-            for (pback_node = plist; pback_node != NULL; pback_node = pback_node->pnext) {
-                pdhcps_pool = pback_node->pnode;
-
-                if (memcmp(pdhcps_pool->mac, m->chaddr, sizeof(pdhcps_pool->mac)) == 0) {
-                    if (memcmp(&pdhcps_pool->ip.addr, m->ciaddr, sizeof(pdhcps_pool->ip.addr)) == 0) {
-                        renew = true;
-                    }
-
-                    client_address.addr = pdhcps_pool->ip.addr;
-                    pdhcps_pool->lease_timer = dhcps_lease_time;
-                    pnode = pback_node;
-                    goto POOL_CHECK;
-                } else if (pdhcps_pool->ip.addr == client_address_plus.addr) {
-                    addr_tmp.addr = htonl(client_address_plus.addr);
-                    addr_tmp.addr++;
-                    client_address_plus.addr = htonl(addr_tmp.addr);
-                    client_address.addr = client_address_plus.addr;
-                }
+        if (idx >= 0) {
+            struct dhcps_pool *pdhcps_pool = &dhcps_leases[idx].pool;
 
-                if (flag == false) { // search the fisrt unused ip
-                    if (first_address.addr < pdhcps_pool->ip.addr) {
-                        flag = true;
-                    } else {
-                        addr_tmp.addr = htonl(first_address.addr);
-                        addr_tmp.addr++;
-                        first_address.addr = htonl(addr_tmp.addr);
-                    }
-                }
+            if (memcmp(&pdhcps_pool->ip.addr, m->ciaddr, sizeof(pdhcps_pool->ip.addr)) == 0) {
+                renew = true;
             }
+
+            client_address.addr = pdhcps_pool->ip.addr;
+            pdhcps_pool->lease_timer = dhcps_lease_now + dhcps_lease_time;
+            dhcps_lease_heap_update(dhcps_leases[idx].heap_pos);
         } else {
-            client_address.addr = dhcps_poll.start_ip.addr;
-        }
+            dhcps_lease_next_ip(&client_address);
 
-        if (client_address_plus.addr > dhcps_poll.end_ip.addr) {
-            client_address.addr = first_address.addr;
-        }
+            if (!ip4_addr_isany(&client_address)) {
+                idx = dhcps_lease_add(m->chaddr, &client_address);
 
-        if (client_address.addr > dhcps_poll.end_ip.addr) {
-            client_address_plus.addr = dhcps_poll.start_ip.addr;
-            pdhcps_pool = NULL;
-            pnode = NULL;
-        } else {
-            pdhcps_pool = (struct dhcps_pool *)malloc(sizeof(struct dhcps_pool));
-            memset(pdhcps_pool , 0x00 , sizeof(struct dhcps_pool));
-
-            pdhcps_pool->ip.addr = client_address.addr;
-            memcpy(pdhcps_pool->mac, m->chaddr, sizeof(pdhcps_pool->mac));
-            pdhcps_pool->lease_timer = dhcps_lease_time;
-            pnode = (list_node *)malloc(sizeof(list_node));
-            memset(pnode , 0x00 , sizeof(list_node));
-
-            pnode->pnode = pdhcps_pool;
-            pnode->pnext = NULL;
-            node_insert_to_list(&plist, pnode);
-
-            if (client_address.addr == dhcps_poll.end_ip.addr) {
-                client_address_plus.addr = dhcps_poll.start_ip.addr;
-            } else {
-                addr_tmp.addr = htonl(client_address.addr);
-                addr_tmp.addr++;
-                client_address_plus.addr = htonl(addr_tmp.addr);
+                if (client_address.addr == dhcps_poll.end_ip.addr) {
+                    client_address_plus.addr = dhcps_poll.start_ip.addr;
+                } else {
+                    addr_tmp.addr = htonl(client_address.addr);
+                    addr_tmp.addr++;
+                    client_address_plus.addr = htonl(addr_tmp.addr);
+                }
             }
         }
 
-POOL_CHECK:
-
         if ((client_address.addr > dhcps_poll.end_ip.addr) || (ip4_addr_isany(&client_address))) {
-            if (pnode != NULL) {
-                node_remove_from_list(&plist, pnode);
-                free(pnode);
-                pnode = NULL;
-            }
-
-            if (pdhcps_pool != NULL) {
-                free(pdhcps_pool);
-                pdhcps_pool = NULL;
+            if (idx >= 0) {
+                dhcps_lease_remove(idx);
             }
 
             return 4;
@@ -822,17 +954,7 @@ POOL_CHECK:
         s16_t ret = parse_options(&m->options[4], len);;
 
         if (ret == DHCPS_STATE_RELEASE) {
-            if (pnode != NULL) {
-                node_remove_from_list(&plist, pnode);
-                free(pnode);
-                pnode = NULL;
-            }
-
-            if (pdhcps_pool != NULL) {
-                free(pdhcps_pool);
-                pdhcps_pool = NULL;
-            }
-
+            dhcps_lease_remove(idx);
             memset(&client_address, 0x0, sizeof(client_address));
         }
 
@@ -1046,6 +1168,7 @@ void dhcps_start(struct netif *netif, ip4_addr_t ip)
     dhcps_poll_set(server_address.addr);
 
     client_address_plus.addr = dhcps_poll.start_ip.addr;
+    dhcps_lease_clear();
 
     udp_bind(pcb_dhcps, IP_ADDR_ANY, DHCPS_SERVER_PORT);
     udp_recv(pcb_dhcps, handle_dhcp, NULL);
@@ -1076,55 +1199,7 @@ void dhcps_stop(struct netif *netif)
         apnetif->dhcps_pcb = NULL;
     }
 
-    list_node *pnode = NULL;
-    list_node *pback_node = NULL;
-    pnode = plist;
-
-    while (pnode != NULL) {
-        pback_node = pnode;
-        pnode = pback_node->pnext;
-        node_remove_from_list(&plist, pback_node);
-        free(pback_node->pnode);
-        pback_node->pnode = NULL;
-        free(pback_node);
-        pback_node = NULL;
-    }
-}
-
-/******************************************************************************
- * FunctionName : kill_oldest_dhcps_pool
- * Description  : remove the oldest node from list
- * Parameters   : none
- * Returns      : none
-*******************************************************************************/
-static void kill_oldest_dhcps_pool(void)
-{
-    list_node *pre = NULL, *p = NULL;
-    list_node *minpre = NULL, *minp = NULL;
-    struct dhcps_pool *pdhcps_pool = NULL, *pmin_pool = NULL;
-    pre = plist;
-    p = pre->pnext;
-    minpre = pre;
-    minp = p;
-
-    while (p != NULL) {
-        pdhcps_pool = p->pnode;
-        pmin_pool = minp->pnode;
-
-        if (pdhcps_pool->lease_timer < pmin_pool->lease_timer) {
-            minp = p;
-            minpre = pre;
-        }
-
-        pre = p;
-        p = p->pnext;
-    }
-
-    minpre->pnext = minp->pnext;
-    free(minp->pnode);
-    minp->pnode = NULL;
-    free(minp);
-    minp = NULL;
+    dhcps_lease_clear();
 }
 
 /******************************************************************************
@@ -1135,32 +1210,11 @@ static void kill_oldest_dhcps_pool(void)
 *******************************************************************************/
 void dhcps_coarse_tmr(void)
 {
-    u8_t num_dhcps_pool = 0;
-    list_node *pback_node = NULL;
-    list_node *pnode = NULL;
-    struct dhcps_pool *pdhcps_pool = NULL;
-    pnode = plist;
-
-    while (pnode != NULL) {
-        pdhcps_pool = pnode->pnode;
-        pdhcps_pool->lease_timer --;
-
-        if (pdhcps_pool->lease_timer == 0) {
-            pback_node = pnode;
-            pnode = pback_node->pnext;
-            node_remove_from_list(&plist, pback_node);
-            free(pback_node->pnode);
-            pback_node->pnode = NULL;
-            free(pback_node);
-            pback_node = NULL;
-        } else {
-            pnode = pnode ->pnext;
-            num_dhcps_pool ++;
-        }
-    }
+    dhcps_lease_now++;
 
-    if (num_dhcps_pool >= MAX_STATION_NUM) {
-        kill_oldest_dhcps_pool();
+    while ((dhcps_lease_count > 0) &&
+            (dhcps_leases[dhcps_lease_heap[0]].pool.lease_timer <= dhcps_lease_now)) {
+        dhcps_lease_remove(dhcps_lease_heap[0]);
     }
 }
 
@@ -1173,21 +1227,37 @@ void dhcps_coarse_tmr(void)
 *******************************************************************************/
 bool dhcp_search_ip_on_mac(u8_t *mac, ip4_addr_t *ip)
 {
-    struct dhcps_pool *pdhcps_pool = NULL;
-    list_node *pback_node = NULL;
-    bool ret = false;
+    s16_t idx = dhcps_lease_find(mac);
 
-    for (pback_node = plist; pback_node != NULL; pback_node = pback_node->pnext) {
-        pdhcps_pool = pback_node->pnode;
+    if (idx < 0) {
+        return false;
+    }
 
-        if (memcmp(pdhcps_pool->mac, mac, sizeof(pdhcps_pool->mac)) == 0) {
-            memcpy(&ip->addr, &pdhcps_pool->ip.addr, sizeof(pdhcps_pool->ip.addr));
-            ret = true;
-            break;
-        }
+    memcpy(&ip->addr, &dhcps_leases[idx].pool.ip.addr, sizeof(ip->addr));
+    return true;
+}
+
+/******************************************************************************
+ * FunctionName : dhcps_get_leases
+ * Description  : Copy the active leases, soonest expiring first, without
+ *                allocating. lease_timer of the copies is the time left, in
+ *                minutes, rather than the expiry time.
+ * Parameters   : pools -- array to fill
+ *				  max -- number of entries of pools
+ * Returns      : number of leases copied
+*******************************************************************************/
+u16_t dhcps_get_leases(struct dhcps_pool *pools, u16_t max)
+{
+    u16_t i, n = 0;
+
+    /* the heap array holds exactly the active leases */
+    for (i = 0; i < dhcps_lease_count && n < max; i++) {
+        pools[n] = dhcps_leases[dhcps_lease_heap[i]].pool;
+        pools[n].lease_timer -= dhcps_lease_now;
+        n++;
     }
 
-    return ret;
+    return n;
 }
 #endif
 
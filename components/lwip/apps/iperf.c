@@ -0,0 +1,817 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "lwip/stats.h"
+#include "esp_log.h"
+#include "esp_task.h"
+#include "esp_timer.h"
+
+#include "apps/iperf.h"
+
+/* How often counters are collected and the stop flag is checked */
+#define IPERF_POLL_MS           100
+
+/* A UDP server test ends if nothing was received for this long */
+#define IPERF_UDP_IDLE_MS       2000
+
+/* A ping reply not received within this time is counted as lost */
+#define IPERF_PING_TIMEOUT_MS   1000
+
+/* Times the final datagram of a UDP client is sent while waiting for the ack */
+#define IPERF_UDP_FIN_TRIES     10
+
+/* Header of iperf 2 UDP datagrams, in network byte order. A negative id
+   marks the final datagram of a test. */
+typedef struct {
+    int32_t id;
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+} iperf_udp_hdr_t;
+
+/* Counters of one stream, written by its task only */
+typedef struct {
+    volatile uint32_t bytes;
+    volatile uint32_t datagrams;
+    volatile uint32_t send_errors;
+    uint32_t seen_bytes;        // values already added up by the control task
+    uint32_t seen_datagrams;
+    uint32_t seen_errors;
+    uint8_t index;
+} iperf_stream_t;
+
+/* Totals at one point in time */
+typedef struct {
+    int64_t time_us;
+    uint64_t bytes;
+    uint32_t datagrams;
+    uint32_t lost;
+    uint32_t out_of_order;
+    uint32_t send_errors;
+    uint32_t pbuf_failures;
+    uint32_t rtt_samples;
+    uint64_t rtt_sum_us;
+#if configGENERATE_RUN_TIME_STATS
+    CoreRunTimeStats_t cpu[portNUM_PROCESSORS];
+#endif
+} iperf_snapshot_t;
+
+/* Round trip times since the last report, and over the whole test */
+typedef struct {
+    uint32_t min_us;
+    uint32_t max_us;
+} iperf_rtt_range_t;
+
+typedef struct {
+    iperf_config_t config;
+    volatile bool stop;
+    TaskHandle_t task;
+    SemaphoreHandle_t exited;       // given by the control task when it ends
+    SemaphoreHandle_t report_ready; // given with every final report
+    portMUX_TYPE lock;              // protects last_report and the ping results
+    iperf_report_t last_report;
+    iperf_stream_t streams[IPERF_MAX_STREAMS];
+    volatile uint8_t streams_running;
+    uint32_t rtt_samples;           // ping results, written by the ping stream under lock
+    uint64_t rtt_sum_us;
+    uint32_t rtt_lost;
+    iperf_rtt_range_t rtt_interval;
+    iperf_rtt_range_t rtt_test;
+    iperf_snapshot_t now;           // totals, brought up to date by iperf_poll
+    iperf_snapshot_t test_start;
+    iperf_snapshot_t interval_start;
+    uint32_t heap_min_interval;
+    uint32_t heap_min_test;
+    bool in_test;
+} iperf_t;
+
+static const char* TAG = "iperf";
+static iperf_t* s_iperf = NULL;
+
+#if defined(PERF) && !(LWIP_STATS && LINK_STATS)
+extern uint32_t g_rx_alloc_pbuf_fail_cnt;
+#endif
+
+static uint32_t pbuf_failures()
+{
+#if LWIP_STATS && LINK_STATS
+    return lwip_stats.link.memerr;
+#elif defined(PERF)
+    return g_rx_alloc_pbuf_fail_cnt;
+#else
+    return 0;
+#endif
+}
+
+static void rtt_range_reset(iperf_rtt_range_t* range)
+{
+    range->min_us = UINT32_MAX;
+    range->max_us = 0;
+}
+
+static void rtt_range_add(iperf_rtt_range_t* range, uint32_t rtt_us)
+{
+    if (rtt_us < range->min_us) {
+        range->min_us = rtt_us;
+    }
+    if (rtt_us > range->max_us) {
+        range->max_us = rtt_us;
+    }
+}
+
+/* Adds up what the streams counted since the last call */
+static void iperf_poll(iperf_t* ip)
+{
+    for (int i = 0; i < IPERF_MAX_STREAMS; ++i) {
+        iperf_stream_t* st = &ip->streams[i];
+        uint32_t bytes = st->bytes;
+        uint32_t datagrams = st->datagrams;
+        uint32_t errors = st->send_errors;
+        ip->now.bytes += bytes - st->seen_bytes;
+        ip->now.datagrams += datagrams - st->seen_datagrams;
+        ip->now.send_errors += errors - st->seen_errors;
+        st->seen_bytes = bytes;
+        st->seen_datagrams = datagrams;
+        st->seen_errors = errors;
+    }
+    portENTER_CRITICAL(&ip->lock);
+    ip->now.rtt_samples = ip->rtt_samples;
+    ip->now.rtt_sum_us = ip->rtt_sum_us;
+    if (ip->config.mode == IPERF_PING) {
+        ip->now.lost = ip->rtt_lost;
+    }
+    portEXIT_CRITICAL(&ip->lock);
+
+    uint32_t heap_free = xPortGetFreeHeapSize();
+    if (heap_free < ip->heap_min_interval) {
+        ip->heap_min_interval = heap_free;
+    }
+    if (heap_free < ip->heap_min_test) {
+        ip->heap_min_test = heap_free;
+    }
+}
+
+/* Completes the totals with the values which are only read at the start and
+   the end of intervals: reading the run time statistics stops all cores */
+static void iperf_snapshot(iperf_t* ip, iperf_snapshot_t* snap)
+{
+    iperf_poll(ip);
+    ip->now.time_us = esp_timer_get_time();
+    ip->now.pbuf_failures = pbuf_failures();
+#if configGENERATE_RUN_TIME_STATS
+    uxTaskGetRunTimeStats(NULL, 0, ip->now.cpu);
+#endif
+    *snap = ip->now;
+}
+
+static void iperf_report_fill(iperf_t* ip, iperf_report_t* r, const iperf_snapshot_t* from,
+                              const iperf_snapshot_t* to, const iperf_rtt_range_t* rtt)
+{
+    memset(r, 0, sizeof(*r));
+    uint64_t duration_us = to->time_us - from->time_us;
+    r->duration_ms = duration_us / 1000;
+    r->bytes = to->bytes - from->bytes;
+    r->kbps = duration_us ? (r->bytes * 8000) / duration_us : 0;
+    r->datagrams = to->datagrams - from->datagrams;
+    r->lost = to->lost - from->lost;
+    r->out_of_order = to->out_of_order - from->out_of_order;
+    r->send_errors = to->send_errors - from->send_errors;
+    r->rtt_samples = to->rtt_samples - from->rtt_samples;
+    if (r->rtt_samples) {
+        r->rtt_min_us = rtt->min_us;
+        r->rtt_max_us = rtt->max_us;
+        r->rtt_avg_us = (to->rtt_sum_us - from->rtt_sum_us) / r->rtt_samples;
+    }
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+#if configGENERATE_RUN_TIME_STATS
+        uint64_t total = to->cpu[i].ullTotalRunTime - from->cpu[i].ullTotalRunTime;
+        uint64_t idle = to->cpu[i].ullIdleRunTime - from->cpu[i].ullIdleRunTime;
+        r->cpu_load[i] = total ? 100 - (uint8_t) ((idle * 100) / total) : 0;
+#else
+        r->cpu_load[i] = 0xff;
+#endif
+    }
+    r->heap_min_ever = xPortGetMinimumEverFreeHeapSize();
+    r->pbuf_failures = to->pbuf_failures - from->pbuf_failures;
+}
+
+static void iperf_report_log(iperf_t* ip, const iperf_report_t* r, uint32_t start_ms, bool final)
+{
+    char cpu[8 * portNUM_PROCESSORS + 1];
+    size_t pos = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        if (r->cpu_load[i] == 0xff) {
+            pos += snprintf(cpu + pos, sizeof(cpu) - pos, " -");
+        } else {
+            pos += snprintf(cpu + pos, sizeof(cpu) - pos, " %u%%", r->cpu_load[i]);
+        }
+    }
+    uint32_t end_ms = start_ms + r->duration_ms;
+    ESP_LOGI(TAG, "%s%3u.%u-%3u.%u s %7u KBytes %3u.%02u Mbits/s cpu%s heap %u/%u pbuf fail %u",
+             final ? "total " : "", start_ms / 1000, (start_ms % 1000) / 100,
+             end_ms / 1000, (end_ms % 1000) / 100, (uint32_t) (r->bytes / 1024),
+             r->kbps / 1000, (r->kbps % 1000) / 10, cpu,
+             r->heap_min_free, r->heap_min_ever, r->pbuf_failures);
+    if (ip->config.udp && ip->config.mode != IPERF_PING) {
+        ESP_LOGI(TAG, "      %u datagrams, %u lost, %u out of order, %u send errors",
+                 r->datagrams, r->lost, r->out_of_order, r->send_errors);
+    } else if (r->send_errors) {
+        ESP_LOGI(TAG, "      %u send errors", r->send_errors);
+    }
+    if (ip->config.mode == IPERF_PING) {
+        ESP_LOGI(TAG, "      rtt min/avg/max %u/%u/%u us, %u replies, %u lost",
+                 r->rtt_samples ? r->rtt_min_us : 0, r->rtt_avg_us, r->rtt_max_us,
+                 r->rtt_samples, r->lost);
+    }
+}
+
+static void iperf_test_begin(iperf_t* ip)
+{
+    ip->heap_min_test = UINT32_MAX;
+    ip->heap_min_interval = UINT32_MAX;
+    portENTER_CRITICAL(&ip->lock);
+    rtt_range_reset(&ip->rtt_interval);
+    rtt_range_reset(&ip->rtt_test);
+    portEXIT_CRITICAL(&ip->lock);
+    iperf_snapshot(ip, &ip->test_start);
+    ip->interval_start = ip->test_start;
+    ip->in_test = true;
+}
+
+/* Logs an interval report once interval_s has passed */
+static void iperf_test_tick(iperf_t* ip)
+{
+    iperf_poll(ip);
+    if (!ip->in_test || ip->config.interval_s == 0 ||
+            esp_timer_get_time() - ip->interval_start.time_us < (int64_t) ip->config.interval_s * 1000000) {
+        return;
+    }
+    iperf_snapshot_t snap;
+    iperf_rtt_range_t rtt;
+    iperf_report_t r;
+    iperf_snapshot(ip, &snap);
+    portENTER_CRITICAL(&ip->lock);
+    rtt = ip->rtt_interval;
+    rtt_range_reset(&ip->rtt_interval);
+    portEXIT_CRITICAL(&ip->lock);
+    iperf_report_fill(ip, &r, &ip->interval_start, &snap, &rtt);
+    r.heap_min_free = ip->heap_min_interval;
+    iperf_report_log(ip, &r, (ip->interval_start.time_us - ip->test_start.time_us) / 1000, false);
+    ip->interval_start = snap;
+    ip->heap_min_interval = UINT32_MAX;
+}
+
+static void iperf_test_end(iperf_t* ip)
+{
+    if (!ip->in_test) {
+        return;
+    }
+    iperf_snapshot_t snap;
+    iperf_rtt_range_t rtt;
+    iperf_report_t r;
+    iperf_snapshot(ip, &snap);
+    portENTER_CRITICAL(&ip->lock);
+    rtt = ip->rtt_test;
+    portEXIT_CRITICAL(&ip->lock);
+    iperf_report_fill(ip, &r, &ip->test_start, &snap, &rtt);
+    r.heap_min_free = ip->heap_min_test;
+    iperf_report_log(ip, &r, 0, true);
+    portENTER_CRITICAL(&ip->lock);
+    ip->last_report = r;
+    portEXIT_CRITICAL(&ip->lock);
+    xSemaphoreGive(ip->report_ready);
+    ip->in_test = false;
+}
+
+static bool iperf_time_over(iperf_t* ip, int64_t start_us)
+{
+    return ip->stop || (ip->config.time_s &&
+            esp_timer_get_time() - start_us >= (int64_t) ip->config.time_s * 1000000);
+}
+
+static void set_recv_timeout(int sock, uint32_t ms)
+{
+    struct timeval tv = {
+        .tv_sec = ms / 1000,
+        .tv_usec = (ms % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static int iperf_connect(iperf_t* ip, int type)
+{
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(ip->config.port),
+        .sin_addr.s_addr = ip->config.addr,
+    };
+    int sock = socket(AF_INET, type, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*) &to, sizeof(to)) != 0) {
+        ESP_LOGE(TAG, "connect failed, errno %d", errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void client_tcp(iperf_t* ip, iperf_stream_t* st, uint8_t* buf, int64_t start_us)
+{
+    int sock = iperf_connect(ip, SOCK_STREAM);
+    if (sock < 0) {
+        return;
+    }
+    while (!iperf_time_over(ip, start_us)) {
+        int n = send(sock, buf, ip->config.len, 0);
+        if (n < 0) {
+            if (errno == ENOMEM || errno == EAGAIN) {
+                ++st->send_errors;
+                vTaskDelay(1);
+                continue;
+            }
+            ESP_LOGE(TAG, "stream %u: send failed, errno %d", st->index, errno);
+            break;
+        }
+        st->bytes += n;
+    }
+    close(sock);
+}
+
+static void client_udp(iperf_t* ip, iperf_stream_t* st, uint8_t* buf, int64_t start_us)
+{
+    iperf_udp_hdr_t* hdr = (iperf_udp_hdr_t*) buf;
+    const uint32_t len = ip->config.len;
+    int32_t id = 0;
+    /* time between datagrams for this stream's share of the rate */
+    const int64_t gap_us = ip->config.udp_kbps ?
+            (int64_t) len * 8 * 1000 * ip->config.streams / ip->config.udp_kbps : 0;
+    int64_t next_us = esp_timer_get_time();
+
+    int sock = iperf_connect(ip, SOCK_DGRAM);
+    if (sock < 0) {
+        return;
+    }
+    while (!iperf_time_over(ip, start_us)) {
+        int64_t now = esp_timer_get_time();
+        if (gap_us) {
+            if (next_us - now >= portTICK_PERIOD_MS * 1000) {
+                vTaskDelay((next_us - now) / (portTICK_PERIOD_MS * 1000));
+                continue;
+            }
+            if (now < next_us) {
+                continue;
+            }
+            next_us += gap_us;
+            /* don't try to catch up after a long stall */
+            if (next_us < now - 10 * gap_us) {
+                next_us = now;
+            }
+        }
+        hdr->id = htonl(id);
+        hdr->tv_sec = htonl(now / 1000000);
+        hdr->tv_usec = htonl(now % 1000000);
+        if (send(sock, buf, len, 0) < 0) {
+            ++st->send_errors;
+            /* out of buffers: give the stack some time to send */
+            taskYIELD();
+            continue;
+        }
+        ++id;
+        st->bytes += len;
+        ++st->datagrams;
+    }
+
+    /* Final datagram, repeated until the server acknowledges it */
+    hdr->id = htonl(-id);
+    set_recv_timeout(sock, 250);
+    for (int i = 0; i < IPERF_UDP_FIN_TRIES; ++i) {
+        iperf_udp_hdr_t ack;
+        send(sock, buf, len, 0);
+        if (recv(sock, &ack, sizeof(ack), 0) > 0) {
+            break;
+        }
+    }
+    close(sock);
+}
+
+static void ping_add(iperf_t* ip, uint32_t rtt_us)
+{
+    portENTER_CRITICAL(&ip->lock);
+    ++ip->rtt_samples;
+    ip->rtt_sum_us += rtt_us;
+    rtt_range_add(&ip->rtt_interval, rtt_us);
+    rtt_range_add(&ip->rtt_test, rtt_us);
+    portEXIT_CRITICAL(&ip->lock);
+}
+
+static void ping_lost(iperf_t* ip)
+{
+    portENTER_CRITICAL(&ip->lock);
+    ++ip->rtt_lost;
+    portEXIT_CRITICAL(&ip->lock);
+}
+
+static void ping(iperf_t* ip, iperf_stream_t* st, uint8_t* buf, int64_t start_us)
+{
+    const uint32_t len = ip->config.len;
+    uint8_t* reply = buf + len;
+    uint32_t seq = 0;
+
+    int sock = iperf_connect(ip, ip->config.udp ? SOCK_DGRAM : SOCK_STREAM);
+    if (sock < 0) {
+        return;
+    }
+    if (!ip->config.udp) {
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    set_recv_timeout(sock, IPERF_PING_TIMEOUT_MS);
+
+    while (!iperf_time_over(ip, start_us)) {
+        memcpy(buf, &seq, sizeof(seq));
+        int64_t t0 = esp_timer_get_time();
+        if (send(sock, buf, len, 0) != len) {
+            ++st->send_errors;
+            vTaskDelay(1);
+            continue;
+        }
+        uint32_t got = 0;
+        bool ok = false;
+        while (true) {
+            int n = recv(sock, reply + got, len - got, 0);
+            if (n <= 0) {
+                break;
+            }
+            if (ip->config.udp) {
+                /* skip late replies to earlier messages */
+                if (n >= sizeof(seq) && memcmp(reply, &seq, sizeof(seq)) == 0) {
+                    ok = true;
+                    break;
+                }
+                continue;
+            }
+            got += n;
+            if (got == len) {
+                ok = true;
+                break;
+            }
+        }
+        if (ok) {
+            ping_add(ip, esp_timer_get_time() - t0);
+            st->bytes += len;
+        } else if (ip->config.udp) {
+            ping_lost(ip);
+        } else {
+            /* the TCP stream is out of step now */
+            ping_lost(ip);
+            ESP_LOGE(TAG, "no reply, errno %d", errno);
+            break;
+        }
+        ++seq;
+    }
+    close(sock);
+}
+
+static void iperf_stream_task(void* arg)
+{
+    iperf_stream_t* st = (iperf_stream_t*) arg;
+    iperf_t* ip = s_iperf;
+    const int64_t start_us = ip->test_start.time_us;
+    /* ping replies are received after the message */
+    uint8_t* buf = (uint8_t*) calloc(ip->config.mode == IPERF_PING ? 2 : 1, ip->config.len);
+
+    if (buf) {
+        if (ip->config.mode == IPERF_PING) {
+            ping(ip, st, buf, start_us);
+        } else if (ip->config.udp) {
+            client_udp(ip, st, buf, start_us);
+        } else {
+            client_tcp(ip, st, buf, start_us);
+        }
+        free(buf);
+    }
+    portENTER_CRITICAL(&ip->lock);
+    --ip->streams_running;
+    portEXIT_CRITICAL(&ip->lock);
+    vTaskDelete(NULL);
+}
+
+static void run_client(iperf_t* ip)
+{
+    const uint8_t streams = ip->config.mode == IPERF_PING ? 1 : ip->config.streams;
+
+    iperf_test_begin(ip);
+    for (uint8_t i = 0; i < streams; ++i) {
+        ip->streams[i].index = i;
+        portENTER_CRITICAL(&ip->lock);
+        ++ip->streams_running;
+        portEXIT_CRITICAL(&ip->lock);
+        if (xTaskCreate(&iperf_stream_task, "iperf_stream", ESP_TASK_IPERF_STACK, &ip->streams[i],
+                    ESP_TASK_IPERF_PRIO, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "can't start stream %u", i);
+            portENTER_CRITICAL(&ip->lock);
+            --ip->streams_running;
+            portEXIT_CRITICAL(&ip->lock);
+            break;
+        }
+    }
+    while (ip->streams_running) {
+        vTaskDelay(IPERF_POLL_MS / portTICK_PERIOD_MS);
+        iperf_test_tick(ip);
+    }
+    iperf_test_end(ip);
+}
+
+static int iperf_listen(iperf_t* ip, int type)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(ip->config.port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int sock = socket(AF_INET, type, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+            (type == SOCK_STREAM && listen(sock, IPERF_MAX_STREAMS) != 0)) {
+        ESP_LOGE(TAG, "can't listen on port %u, errno %d", ip->config.port, errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void run_server_tcp(iperf_t* ip, uint8_t* buf)
+{
+    const bool echo = ip->config.mode == IPERF_ECHO;
+    const int64_t start_us = esp_timer_get_time();
+    iperf_stream_t* st = &ip->streams[0];
+    int conns[IPERF_MAX_STREAMS];
+    int conn_count = 0;
+
+    int listen_sock = iperf_listen(ip, SOCK_STREAM);
+    if (listen_sock < 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "TCP %s listening on port %u", echo ? "echo server" : "server", ip->config.port);
+
+    while (!iperf_time_over(ip, start_us)) {
+        fd_set readset;
+        int maxfd = listen_sock;
+        struct timeval tv = {
+            .tv_sec = 0,
+            .tv_usec = IPERF_POLL_MS * 1000,
+        };
+        FD_ZERO(&readset);
+        if (conn_count < IPERF_MAX_STREAMS) {
+            FD_SET(listen_sock, &readset);
+        }
+        for (int i = 0; i < conn_count; ++i) {
+            FD_SET(conns[i], &readset);
+            if (conns[i] > maxfd) {
+                maxfd = conns[i];
+            }
+        }
+        int ready = select(maxfd + 1, &readset, NULL, NULL, &tv);
+        if (ready > 0 && FD_ISSET(listen_sock, &readset)) {
+            int sock = accept(listen_sock, NULL, NULL);
+            if (sock >= 0) {
+                if (conn_count == 0) {
+                    iperf_test_begin(ip);
+                }
+                if (echo) {
+                    int one = 1;
+                    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                conns[conn_count++] = sock;
+            }
+        }
+        for (int i = 0; ready > 0 && i < conn_count; ++i) {
+            if (!FD_ISSET(conns[i], &readset)) {
+                continue;
+            }
+            int n = recv(conns[i], buf, ip->config.len, 0);
+            if (n > 0) {
+                st->bytes += n;
+                if (echo && send(conns[i], buf, n, 0) != n) {
+                    ++st->send_errors;
+                }
+                continue;
+            }
+            close(conns[i]);
+            conns[i--] = conns[--conn_count];
+            if (conn_count == 0) {
+                iperf_test_end(ip);
+            }
+        }
+        iperf_test_tick(ip);
+    }
+
+    for (int i = 0; i < conn_count; ++i) {
+        close(conns[i]);
+    }
+    iperf_test_end(ip);
+    close(listen_sock);
+}
+
+static void run_server_udp(iperf_t* ip, uint8_t* buf)
+{
+    const bool echo = ip->config.mode == IPERF_ECHO;
+    const int64_t start_us = esp_timer_get_time();
+    iperf_stream_t* st = &ip->streams[0];
+    int64_t last_rx_us = 0;
+    int32_t next_id = 0;
+
+    int sock = iperf_listen(ip, SOCK_DGRAM);
+    if (sock < 0) {
+        return;
+    }
+    set_recv_timeout(sock, IPERF_POLL_MS);
+    ESP_LOGI(TAG, "UDP %s listening on port %u", echo ? "echo server" : "server", ip->config.port);
+
+    while (!iperf_time_over(ip, start_us)) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(sock, buf, IPERF_UDP_LEN_MAX, 0, (struct sockaddr*) &from, &from_len);
+        if (n <= 0) {
+            if (ip->in_test && !echo &&
+                    esp_timer_get_time() - last_rx_us > IPERF_UDP_IDLE_MS * 1000) {
+                ESP_LOGW(TAG, "client went silent");
+                iperf_test_end(ip);
+            }
+            iperf_test_tick(ip);
+            continue;
+        }
+        last_rx_us = esp_timer_get_time();
+        if (echo) {
+            if (!ip->in_test) {
+                iperf_test_begin(ip);
+            }
+            st->bytes += n;
+            ++st->datagrams;
+            if (sendto(sock, buf, n, 0, (struct sockaddr*) &from, from_len) != n) {
+                ++st->send_errors;
+            }
+            iperf_test_tick(ip);
+            continue;
+        }
+        if (n < sizeof(iperf_udp_hdr_t)) {
+            continue;
+        }
+        int32_t id = ntohl(((iperf_udp_hdr_t*) buf)->id);
+        if (id < 0) {
+            /* The client repeats the final datagram until it gets an ack.
+               No server report is sent with it. */
+            sendto(sock, buf, sizeof(iperf_udp_hdr_t), 0, (struct sockaddr*) &from, from_len);
+            iperf_test_end(ip);
+            next_id = 0;
+            continue;
+        }
+        if (!ip->in_test) {
+            iperf_test_begin(ip);
+            next_id = 0;
+        }
+        st->bytes += n;
+        ++st->datagrams;
+        if (id > next_id) {
+            ip->now.lost += id - next_id;
+        } else if (id < next_id) {
+            ++ip->now.out_of_order;
+            /* counted as lost when the gap was seen */
+            if (ip->now.lost > 0) {
+                --ip->now.lost;
+            }
+        }
+        if (id >= next_id) {
+            next_id = id + 1;
+        }
+        iperf_test_tick(ip);
+    }
+
+    iperf_test_end(ip);
+    close(sock);
+}
+
+static void iperf_task(void* arg)
+{
+    iperf_t* ip = (iperf_t*) arg;
+
+    if (ip->config.mode == IPERF_CLIENT || ip->config.mode == IPERF_PING) {
+        run_client(ip);
+    } else {
+        uint8_t* buf = (uint8_t*) malloc(ip->config.udp ? IPERF_UDP_LEN_MAX : ip->config.len);
+        if (buf) {
+            if (ip->config.udp) {
+                run_server_udp(ip, buf);
+            } else {
+                run_server_tcp(ip, buf);
+            }
+            free(buf);
+        } else {
+            ESP_LOGE(TAG, "out of memory");
+        }
+    }
+    xSemaphoreGive(ip->exited);
+    vTaskDelete(NULL);
+}
+
+static void iperf_free(iperf_t* ip)
+{
+    if (ip->exited) {
+        vSemaphoreDelete(ip->exited);
+    }
+    if (ip->report_ready) {
+        vSemaphoreDelete(ip->report_ready);
+    }
+    free(ip);
+}
+
+esp_err_t iperf_start(const iperf_config_t* config)
+{
+    if (s_iperf) {
+        /* release a benchmark which has ended by itself */
+        if (xSemaphoreTake(s_iperf->exited, 0) != pdTRUE) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        iperf_free(s_iperf);
+        s_iperf = NULL;
+    }
+    if (config->len == 0 || config->streams == 0 || config->streams > IPERF_MAX_STREAMS ||
+            (config->udp && (config->len < sizeof(iperf_udp_hdr_t) || config->len > IPERF_UDP_LEN_MAX)) ||
+            (config->mode == IPERF_PING && config->len < sizeof(uint32_t))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    iperf_t* ip = (iperf_t*) calloc(1, sizeof(iperf_t));
+    if (!ip) {
+        return ESP_ERR_NO_MEM;
+    }
+    ip->config = *config;
+    ip->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+    ip->exited = xSemaphoreCreateBinary();
+    ip->report_ready = xSemaphoreCreateBinary();
+    if (!ip->exited || !ip->report_ready) {
+        iperf_free(ip);
+        return ESP_ERR_NO_MEM;
+    }
+    s_iperf = ip;
+    if (xTaskCreate(&iperf_task, "iperf", ESP_TASK_IPERF_STACK, ip,
+                ESP_TASK_IPERF_PRIO + 1, &ip->task) != pdPASS) {
+        s_iperf = NULL;
+        iperf_free(ip);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t iperf_stop()
+{
+    iperf_t* ip = s_iperf;
+    if (!ip) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ip->stop = true;
+    xSemaphoreTake(ip->exited, portMAX_DELAY);
+    /* streams notice the stop flag within a send or receive timeout */
+    while (ip->streams_running) {
+        vTaskDelay(IPERF_POLL_MS / portTICK_PERIOD_MS);
+    }
+    s_iperf = NULL;
+    iperf_free(ip);
+    return ESP_OK;
+}
+
+esp_err_t iperf_wait(iperf_report_t* report, TickType_t timeout)
+{
+    iperf_t* ip = s_iperf;
+    if (!ip) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(ip->report_ready, timeout) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    portENTER_CRITICAL(&ip->lock);
+    *report = ip->last_report;
+    portEXIT_CRITICAL(&ip->lock);
+    return ESP_OK;
+}
@@ -0,0 +1,226 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_task.h"
+
+#include "apps/netlog.h"
+
+/* Longest line kept, longer ones are cut */
+#define NETLOG_LINE_MAX         256
+
+/* Each queued line is preceded by its length */
+#define NETLOG_LEN_SIZE         2
+
+typedef struct {
+    netlog_config_t config;
+    uint8_t* queue;
+    uint32_t read;              // offset of the oldest line
+    uint32_t used;              // bytes in use, including the lengths
+    uint32_t dropped;
+    portMUX_TYPE lock;
+    TaskHandle_t task;
+    int sock;
+    vprintf_like_t prev_vprintf;
+} netlog_t;
+
+static netlog_t* s_netlog = NULL;
+
+static void queue_copy_in(netlog_t* nl, uint32_t offset, const void* data, uint32_t size)
+{
+    uint32_t pos = (nl->read + offset) % nl->config.queue_size;
+    uint32_t first = nl->config.queue_size - pos;
+    if (first > size) {
+        first = size;
+    }
+    memcpy(nl->queue + pos, data, first);
+    memcpy(nl->queue, (const uint8_t*) data + first, size - first);
+}
+
+static void queue_copy_out(netlog_t* nl, uint32_t offset, void* data, uint32_t size)
+{
+    uint32_t pos = (nl->read + offset) % nl->config.queue_size;
+    uint32_t first = nl->config.queue_size - pos;
+    if (first > size) {
+        first = size;
+    }
+    memcpy(data, nl->queue + pos, first);
+    memcpy((uint8_t*) data + first, nl->queue, size - first);
+}
+
+static uint16_t queue_peek_len(netlog_t* nl)
+{
+    uint16_t len;
+    queue_copy_out(nl, 0, &len, sizeof(len));
+    return len;
+}
+
+static void queue_pop(netlog_t* nl, uint16_t len)
+{
+    nl->read = (nl->read + NETLOG_LEN_SIZE + len) % nl->config.queue_size;
+    nl->used -= NETLOG_LEN_SIZE + len;
+}
+
+static void queue_push(netlog_t* nl, const char* line, uint16_t len)
+{
+    uint32_t needed = NETLOG_LEN_SIZE + len;
+    portENTER_CRITICAL(&nl->lock);
+    while (nl->config.queue_size - nl->used < needed) {
+        queue_pop(nl, queue_peek_len(nl));
+        ++nl->dropped;
+    }
+    queue_copy_in(nl, nl->used, &len, sizeof(len));
+    queue_copy_in(nl, nl->used + NETLOG_LEN_SIZE, line, len);
+    nl->used += needed;
+    bool full_datagram = nl->used >= NETLOG_DATAGRAM_MAX;
+    portEXIT_CRITICAL(&nl->lock);
+    if (full_datagram) {
+        xTaskNotifyGive(nl->task);
+    }
+}
+
+/* Takes as many whole lines as fit into max_size bytes. Returns their size. */
+static size_t queue_take_lines(netlog_t* nl, char* datagram, size_t max_size)
+{
+    size_t size = 0;
+    portENTER_CRITICAL(&nl->lock);
+    while (nl->used > 0) {
+        uint16_t len = queue_peek_len(nl);
+        if (size + len > max_size) {
+            break;
+        }
+        queue_copy_out(nl, NETLOG_LEN_SIZE, datagram + size, len);
+        queue_pop(nl, len);
+        size += len;
+    }
+    portEXIT_CRITICAL(&nl->lock);
+    return size;
+}
+
+static int netlog_vprintf(const char* format, va_list list)
+{
+    netlog_t* nl = s_netlog;
+    if (nl->config.echo && nl->prev_vprintf) {
+        va_list copy;
+        va_copy(copy, list);
+        (*nl->prev_vprintf)(format, copy);
+        va_end(copy);
+    }
+    char line[NETLOG_LINE_MAX];
+    int len = vsnprintf(line, sizeof(line), format, list);
+    if (len <= 0) {
+        return len;
+    }
+    if (len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+    queue_push(nl, line, len);
+    return len;
+}
+
+static void netlog_task(void* arg)
+{
+    netlog_t* nl = (netlog_t*) arg;
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(nl->config.port),
+        .sin_addr.s_addr = nl->config.addr,
+    };
+    const TickType_t flush_ticks = (nl->config.flush_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    const TickType_t min_interval = nl->config.max_datagrams_per_sec ?
+            (configTICK_RATE_HZ + nl->config.max_datagrams_per_sec - 1) / nl->config.max_datagrams_per_sec : 0;
+    TickType_t last_send = xTaskGetTickCount() - min_interval;
+    uint32_t reported_dropped = 0;
+    char* datagram = (char*) malloc(NETLOG_DATAGRAM_MAX);
+    configASSERT(datagram);
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, flush_ticks ? flush_ticks : 1);
+        while (true) {
+            // Rate limit: lines keep accumulating in the queue meanwhile,
+            // so the datagrams sent get fuller
+            TickType_t since_last = xTaskGetTickCount() - last_send;
+            if (since_last < min_interval) {
+                vTaskDelay(min_interval - since_last);
+            }
+            size_t size = 0;
+            uint32_t dropped = nl->dropped;
+            if (dropped != reported_dropped) {
+                size = snprintf(datagram, NETLOG_DATAGRAM_MAX, "W (%d) netlog: %u lines dropped\n",
+                                esp_log_timestamp(), (unsigned) (dropped - reported_dropped));
+                reported_dropped = dropped;
+            }
+            size += queue_take_lines(nl, datagram + size, NETLOG_DATAGRAM_MAX - size);
+            if (size == 0) {
+                break;
+            }
+            // Failures, such as no IP address yet, lose this datagram only
+            sendto(nl->sock, datagram, size, 0, (struct sockaddr*) &to, sizeof(to));
+            last_send = xTaskGetTickCount();
+            if (nl->used < NETLOG_DATAGRAM_MAX) {
+                break;
+            }
+        }
+    }
+}
+
+esp_err_t netlog_start(const netlog_config_t* config)
+{
+    if (s_netlog) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->queue_size < NETLOG_LINE_MAX + NETLOG_LEN_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    netlog_t* nl = (netlog_t*) calloc(1, sizeof(netlog_t));
+    if (!nl) {
+        return ESP_ERR_NO_MEM;
+    }
+    nl->config = *config;
+    nl->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+    nl->queue = (uint8_t*) malloc(config->queue_size);
+    if (!nl->queue) {
+        free(nl);
+        return ESP_ERR_NO_MEM;
+    }
+    nl->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (nl->sock < 0) {
+        free(nl->queue);
+        free(nl);
+        return ESP_FAIL;
+    }
+    if (xTaskCreate(&netlog_task, "netlog", ESP_TASK_NETLOG_STACK, nl,
+                ESP_TASK_NETLOG_PRIO, &nl->task) != pdPASS) {
+        close(nl->sock);
+        free(nl->queue);
+        free(nl);
+        return ESP_ERR_NO_MEM;
+    }
+    s_netlog = nl;
+    nl->prev_vprintf = esp_log_set_vprintf(&netlog_vprintf);
+    return ESP_OK;
+}
+
+uint32_t netlog_get_dropped()
+{
+    return s_netlog ? s_netlog->dropped : 0;
+}
@@ -58,8 +58,23 @@
 #include <string.h>
 #include <time.h>
 
+/* Espressif add start. */
+#include <sys/time.h>
+#include "esp_time.h"
+/* Espressif add end. */
+
 #if LWIP_UDP
 
+/* Espressif add start. */
+#ifndef SNTP_PARALLEL_REQUESTS
+#define SNTP_PARALLEL_REQUESTS 0
+#endif
+
+#if SNTP_PARALLEL_REQUESTS && (SNTP_CHECK_RESPONSE >= 2)
+#error "SNTP_PARALLEL_REQUESTS doesn't support SNTP_CHECK_RESPONSE >= 2"
+#endif
+/* Espressif add end. */
+
 /* Handle support for more than one server via SNTP_MAX_SERVERS */
 #if SNTP_MAX_SERVERS > 1
 #define SNTP_SUPPORT_MULTIPLE_SERVERS 1
@@ -171,12 +186,20 @@ static struct sntp_server sntp_servers[SNTP_MAX_SERVERS];
 #if SNTP_GET_SERVERS_FROM_DHCP
 static u8_t sntp_set_servers_from_dhcp;
 #endif /* SNTP_GET_SERVERS_FROM_DHCP */
-#if SNTP_SUPPORT_MULTIPLE_SERVERS
+#if SNTP_SUPPORT_MULTIPLE_SERVERS && !SNTP_PARALLEL_REQUESTS
 /** The currently used server (initialized to 0) */
 static u8_t sntp_current_server;
-#else /* SNTP_SUPPORT_MULTIPLE_SERVERS */
+#else /* SNTP_SUPPORT_MULTIPLE_SERVERS && !SNTP_PARALLEL_REQUESTS */
 #define sntp_current_server 0
-#endif /* SNTP_SUPPORT_MULTIPLE_SERVERS */
+#endif /* SNTP_SUPPORT_MULTIPLE_SERVERS && !SNTP_PARALLEL_REQUESTS */
+
+/* Espressif add start. */
+#if SNTP_PARALLEL_REQUESTS
+/** Set once a valid response of the current round of requests arrived, to
+ * ignore those of the other servers */
+static u8_t sntp_round_done;
+#endif /* SNTP_PARALLEL_REQUESTS */
+/* Espressif add end. */
 
 #if SNTP_RETRY_TIMEOUT_EXP
 #define SNTP_RESET_RETRY_TIMEOUT() sntp_retry_timeout = SNTP_RETRY_TIMEOUT
@@ -187,10 +210,10 @@ static u32_t sntp_retry_timeout;
 #define sntp_retry_timeout SNTP_RETRY_TIMEOUT
 #endif /* SNTP_RETRY_TIMEOUT_EXP */
 
-#if SNTP_CHECK_RESPONSE >= 1
+#if SNTP_CHECK_RESPONSE >= 1 && !SNTP_PARALLEL_REQUESTS
 /** Saves the last server address to compare with response */
 static ip_addr_t sntp_last_server_address;
-#endif /* SNTP_CHECK_RESPONSE >= 1 */
+#endif /* SNTP_CHECK_RESPONSE >= 1 && !SNTP_PARALLEL_REQUESTS */
 
 #if SNTP_CHECK_RESPONSE >= 2
 /** Saves the last timestamp sent (which is sent back by the server)
@@ -266,6 +289,10 @@ sntp_retry(void* arg)
     sntp_retry_timeout));
 
   /* set up a timer to send a retry and increase the retry delay */
+#if SNTP_PARALLEL_REQUESTS
+  /* a late DNS answer may have armed another receive timeout */
+  sys_untimeout(sntp_request, NULL);
+#endif /* SNTP_PARALLEL_REQUESTS */
   sys_timeout(sntp_retry_timeout, sntp_request, NULL);
 
 #if SNTP_RETRY_TIMEOUT_EXP
@@ -282,7 +309,7 @@ sntp_retry(void* arg)
 #endif /* SNTP_RETRY_TIMEOUT_EXP */
 }
 
-#if SNTP_SUPPORT_MULTIPLE_SERVERS
+#if SNTP_SUPPORT_MULTIPLE_SERVERS && !SNTP_PARALLEL_REQUESTS
 /**
  * If Kiss-of-Death is received (or another packet parsing error),
  * try the next server or retry the current server and increase the retry
@@ -321,10 +348,46 @@ sntp_try_next_server(void* arg)
   sntp_current_server = old_server;
   sntp_retry(NULL);
 }
-#else /* SNTP_SUPPORT_MULTIPLE_SERVERS */
-/* Always retry on error if only one server is supported */
+#else /* SNTP_SUPPORT_MULTIPLE_SERVERS && !SNTP_PARALLEL_REQUESTS */
+/* Always retry on error if only one server is supported, or all servers
+ * are asked at once */
 #define sntp_try_next_server    sntp_retry
-#endif /* SNTP_SUPPORT_MULTIPLE_SERVERS */
+#endif /* SNTP_SUPPORT_MULTIPLE_SERVERS && !SNTP_PARALLEL_REQUESTS */
+
+/* Espressif add start. */
+#if SNTP_PARALLEL_REQUESTS && (SNTP_CHECK_RESPONSE >= 1)
+/** Check if addr is the address of one of the servers */
+static u8_t
+sntp_is_server_address(const ip_addr_t *addr)
+{
+  u8_t i;
+  for (i = 0; i < SNTP_MAX_SERVERS; i++) {
+    if (ip_addr_cmp(addr, &sntp_servers[i].addr)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* SNTP_PARALLEL_REQUESTS && (SNTP_CHECK_RESPONSE >= 1) */
+
+#if SNTP_SKIP_SYNC_AGE
+/**
+ * SNTP_STARTUP_DELAY_FUNC: don't synchronize before the time, possibly kept
+ * in RTC memory over a deep sleep or reset, is SNTP_SKIP_SYNC_AGE seconds
+ * old.
+ */
+static u32_t
+sntp_startup_delay(void)
+{
+  uint32_t age;
+  if ((esp_time_get_sync_age(&age) != ESP_OK) || (age >= SNTP_SKIP_SYNC_AGE)) {
+    return 0;
+  }
+  LWIP_DEBUGF(SNTP_DEBUG_STATE, ("sntp_startup_delay: time set %"U32_F" s ago\n", (u32_t)age));
+  return (SNTP_SKIP_SYNC_AGE - age) * 1000;
+}
+#endif /* SNTP_SKIP_SYNC_AGE */
+/* Espressif add end. */
 
 /** UDP recv callback for the sntp pcb */
 static void
@@ -338,15 +401,28 @@ sntp_recv(void *arg, struct udp_pcb* pcb, struct pbuf *p, const ip_addr_t *addr,
   LWIP_UNUSED_ARG(arg);
   LWIP_UNUSED_ARG(pcb);
 
+#if SNTP_PARALLEL_REQUESTS
+  /* the other servers may still answer: keep waiting until a valid response */
+  if (sntp_round_done) {
+    pbuf_free(p);
+    return;
+  }
+#else /* SNTP_PARALLEL_REQUESTS */
   /* packet received: stop retry timeout  */
   sys_untimeout(sntp_try_next_server, NULL);
   sys_untimeout(sntp_request, NULL);
+#endif /* SNTP_PARALLEL_REQUESTS */
 
   err = ERR_ARG;
 #if SNTP_CHECK_RESPONSE >= 1
   /* check server address and port */
+#if SNTP_PARALLEL_REQUESTS
+  if (((sntp_opmode != SNTP_OPMODE_POLL) || sntp_is_server_address(addr)) &&
+    (port == SNTP_PORT))
+#else /* SNTP_PARALLEL_REQUESTS */
   if (((sntp_opmode != SNTP_OPMODE_POLL) || ip_addr_cmp(addr, &sntp_last_server_address)) &&
     (port == SNTP_PORT))
+#endif /* SNTP_PARALLEL_REQUESTS */
 #else /* SNTP_CHECK_RESPONSE >= 1 */
   LWIP_UNUSED_ARG(addr);
   LWIP_UNUSED_ARG(port);
@@ -398,6 +474,18 @@ sntp_recv(void *arg, struct udp_pcb* pcb, struct pbuf *p, const ip_addr_t *addr,
   }
 #endif /* SNTP_CHECK_RESPONSE >= 1 */
   pbuf_free(p);
+#if SNTP_PARALLEL_REQUESTS
+  if (err == ERR_OK) {
+    sys_untimeout(sntp_try_next_server, NULL);
+    sys_untimeout(sntp_request, NULL);
+    if (sntp_opmode == SNTP_OPMODE_POLL) {
+      sntp_round_done = 1;
+    }
+  } else {
+    /* wait for the other servers, or the receive timeout */
+    err = ERR_TIMEOUT;
+  }
+#endif /* SNTP_PARALLEL_REQUESTS */
   if (err == ERR_OK) {
     sntp_process(receive_timestamp);
 
@@ -442,16 +530,23 @@ sntp_send_request(const ip_addr_t *server_addr)
     udp_sendto(sntp_pcb, p, server_addr, SNTP_PORT);
     /* free the pbuf after sending it */
     pbuf_free(p);
+#if SNTP_PARALLEL_REQUESTS
+    /* one receive timeout for all servers, from the last request sent */
+    sys_untimeout(sntp_try_next_server, NULL);
+#endif /* SNTP_PARALLEL_REQUESTS */
     /* set up receive timeout: try next server or retry on timeout */
     sys_timeout((u32_t)SNTP_RECV_TIMEOUT, sntp_try_next_server, NULL);
-#if SNTP_CHECK_RESPONSE >= 1
+#if SNTP_CHECK_RESPONSE >= 1 && !SNTP_PARALLEL_REQUESTS
     /* save server address to verify it in sntp_recv */
     ip_addr_set(&sntp_last_server_address, server_addr);
-#endif /* SNTP_CHECK_RESPONSE >= 1 */
+#endif /* SNTP_CHECK_RESPONSE >= 1 && !SNTP_PARALLEL_REQUESTS */
   } else {
     LWIP_DEBUGF(SNTP_DEBUG_SERIOUS, ("sntp_send_request: Out of memory, trying again in %"U32_F" ms\n",
       (u32_t)SNTP_RETRY_TIMEOUT));
     /* out of memory: set up a timer to send a retry */
+#if SNTP_PARALLEL_REQUESTS
+    sys_untimeout(sntp_request, NULL);
+#endif /* SNTP_PARALLEL_REQUESTS */
     sys_timeout((u32_t)SNTP_RETRY_TIMEOUT, sntp_request, NULL);
   }
 }
@@ -463,52 +558,54 @@ sntp_send_request(const ip_addr_t *server_addr)
 static void
 sntp_dns_found(const char* hostname, const ip_addr_t *ipaddr, void *arg)
 {
+  u8_t idx = (u8_t)(mem_ptr_t)arg;
   LWIP_UNUSED_ARG(hostname);
-  LWIP_UNUSED_ARG(arg);
 
   if (ipaddr != NULL) {
     /* Address resolved, send request */
     LWIP_DEBUGF(SNTP_DEBUG_STATE, ("sntp_dns_found: Server address resolved, sending request\n"));
+    sntp_servers[idx].addr = *ipaddr;
     sntp_send_request(ipaddr);
   } else {
     /* DNS resolving failed -> try another server */
     LWIP_DEBUGF(SNTP_DEBUG_WARN_STATE, ("sntp_dns_found: Failed to resolve server address resolved, trying next server\n"));
+#if !SNTP_PARALLEL_REQUESTS
     sntp_try_next_server(NULL);
+#endif /* !SNTP_PARALLEL_REQUESTS */
   }
 }
 #endif /* SNTP_SERVER_DNS */
 
 /**
- * Send out an sntp request.
+ * Send out an sntp request to server idx, or resolve its name first.
  *
- * @param arg is unused (only necessary to conform to sys_timeout)
+ * @return ERR_OK if the request was sent, ERR_INPROGRESS if it is sent once
+ *         the name is resolved, another error if the server isn't set
  */
-static void
-sntp_request(void *arg)
+static err_t
+sntp_request_server(u8_t idx)
 {
   ip_addr_t sntp_server_address;
   err_t err;
 
-  LWIP_UNUSED_ARG(arg);
-
   /* initialize SNTP server address */
 #if SNTP_SERVER_DNS
-  if (sntp_servers[sntp_current_server].name) {
+  if (sntp_servers[idx].name) {
     /* always resolve the name and rely on dns-internal caching & timeout */
-    ip_addr_set_zero(&sntp_servers[sntp_current_server].addr);
-    err = dns_gethostbyname(sntp_servers[sntp_current_server].name, &sntp_server_address,
-      sntp_dns_found, NULL);
+    ip_addr_set_zero(&sntp_servers[idx].addr);
+    err = dns_gethostbyname(sntp_servers[idx].name, &sntp_server_address,
+      sntp_dns_found, (void *)(mem_ptr_t)idx);
     if (err == ERR_INPROGRESS) {
       /* DNS request sent, wait for sntp_dns_found being called */
       LWIP_DEBUGF(SNTP_DEBUG_STATE, ("sntp_request: Waiting for server address to be resolved.\n"));
-      return;
+      return err;
     } else if (err == ERR_OK) {
-      sntp_servers[sntp_current_server].addr = sntp_server_address;
+      sntp_servers[idx].addr = sntp_server_address;
     }
   } else
 #endif /* SNTP_SERVER_DNS */
   {
-    sntp_server_address = sntp_servers[sntp_current_server].addr;
+    sntp_server_address = sntp_servers[idx].addr;
     err = (ip_addr_isany_val(sntp_server_address)) ? ERR_ARG : ERR_OK;
   }
 
@@ -516,7 +613,49 @@ sntp_request(void *arg)
     LWIP_DEBUGF(SNTP_DEBUG_TRACE, ("sntp_request: current server address is %s\n",
       ipaddr_ntoa(&sntp_server_address)));
     sntp_send_request(&sntp_server_address);
-  } else {
+  }
+  return err;
+}
+
+/**
+ * Send out an sntp request.
+ *
+ * @param arg is unused (only necessary to conform to sys_timeout)
+ */
+static void
+sntp_request(void *arg)
+{
+  err_t err;
+
+  LWIP_UNUSED_ARG(arg);
+
+#if SNTP_PARALLEL_REQUESTS
+  {
+    u8_t i;
+
+    /* ask all servers at once, the first valid response wins */
+    sntp_round_done = 0;
+    err = ERR_ARG;
+    for (i = 0; i < SNTP_MAX_SERVERS; i++) {
+      err_t server_err = sntp_request_server(i);
+      if ((server_err == ERR_OK) || (server_err == ERR_INPROGRESS)) {
+        err = ERR_OK;
+      }
+    }
+    if (err == ERR_OK) {
+      /* receive timeout of the round, also when no name can be resolved */
+      sys_untimeout(sntp_try_next_server, NULL);
+      sys_timeout((u32_t)SNTP_RECV_TIMEOUT, sntp_try_next_server, NULL);
+    }
+  }
+#else /* SNTP_PARALLEL_REQUESTS */
+  err = sntp_request_server(sntp_current_server);
+  if (err == ERR_INPROGRESS) {
+    err = ERR_OK;
+  }
+#endif /* SNTP_PARALLEL_REQUESTS */
+
+  if (err != ERR_OK) {
     /* address conversion failed, try another server */
     LWIP_DEBUGF(SNTP_DEBUG_WARN_STATE, ("sntp_request: Invalid server address, trying next server.\n"));
     sys_timeout((u32_t)SNTP_RETRY_TIMEOUT, sntp_try_next_server, NULL);
@@ -567,6 +706,7 @@ sntp_stop(void)
 {
   if (sntp_pcb != NULL) {
     sys_untimeout(sntp_request, NULL);
+    sys_untimeout(sntp_try_next_server, NULL);
     udp_remove(sntp_pcb);
     sntp_pcb = NULL;
   }
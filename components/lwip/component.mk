@@ -6,6 +6,10 @@ COMPONENT_ADD_INCLUDEDIRS := include/lwip include/lwip/port include/lwip/posix
 
 COMPONENT_SRCDIRS := api apps/sntp apps core/ipv4 core/ipv6 core netif port/freertos port/netif port
 
+ifdef CONFIG_LWIP_PPP_SUPPORT
+COMPONENT_SRCDIRS += netif/ppp netif/ppp/polarssl
+endif
+
 CFLAGS += -Wno-error=address -Waddress
 
 include $(IDF_PATH)/make/component_common.mk
@@ -82,6 +82,7 @@
 #include "lwip/mem.h"
 #include "lwip/memp.h"
 #include "lwip/dns.h"
+#include "lwip/sys.h"
 
 #include <string.h>
 
@@ -119,6 +120,15 @@ static u16_t dns_txid;
 #define DNS_MAX_TTL               604800
 #endif
 
+#if DNS_CACHE_SIZE
+/** Number of dns_cache entries looked at for a name, starting at its hash */
+#define DNS_CACHE_PROBES          LWIP_MIN(4, DNS_CACHE_SIZE)
+#endif /* DNS_CACHE_SIZE */
+
+/** DNS_PARALLEL_FALLBACK: ask for both address types at once for
+ * LWIP_DNS_ADDRTYPE_IPV4_IPV6 and LWIP_DNS_ADDRTYPE_IPV6_IPV4 requests */
+#define DNS_PARALLEL_FALLBACK     (DNS_PARALLEL_QUERIES && LWIP_IPV4 && LWIP_IPV6)
+
 /* The number of parallel requests (i.e. calls to dns_gethostbyname
  * that cannot be answered from the DNS table.
  * This is set to the table size by default.
@@ -208,6 +218,18 @@ static u16_t dns_txid;
 #define DNS_STATE_ASKING            2
 #define DNS_STATE_DONE              3
 
+#if DNS_PARALLEL_FALLBACK
+/* DNS query for the fallback address type, asked at the same time */
+#define DNS_FALLBACK_ASKING         0
+#define DNS_FALLBACK_FOUND          1
+#define DNS_FALLBACK_FAILED         2
+
+#define DNS_FALLBACK_ADDRTYPE(t)    (((t) == LWIP_DNS_ADDRTYPE_IPV4_IPV6) ? LWIP_DNS_ADDRTYPE_IPV6 : LWIP_DNS_ADDRTYPE_IPV4)
+#define DNS_FALLBACK_PENDING(e)     ((((e)->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV4_IPV6) || \
+                                      ((e)->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV6_IPV4)) && \
+                                     ((e)->fallback_state == DNS_FALLBACK_ASKING))
+#endif /* DNS_PARALLEL_FALLBACK */
+
 #ifdef PACK_STRUCT_USE_INCLUDES
 #  include "arch/bpstruct.h"
 #endif
@@ -254,7 +276,7 @@ struct dns_answer {
 
 /** DNS table entry */
 struct dns_table_entry {
-  u32_t ttl;
+  u32_t expires;                      /* dns_time at which a completed entry expires */
   ip_addr_t ipaddr;
   u16_t txid;
   u8_t  state;
@@ -269,6 +291,13 @@ struct dns_table_entry {
 #if LWIP_IPV4 && LWIP_IPV6
   u8_t reqaddrtype;
 #endif /* LWIP_IPV4 && LWIP_IPV6 */
+#if DNS_PARALLEL_FALLBACK
+  /* query for the fallback address type and its answer, if it came first */
+  u16_t txid2;
+  u8_t fallback_state;
+  u32_t fallback_ttl;
+  ip_addr_t fallback_addr;
+#endif /* DNS_PARALLEL_FALLBACK */
 };
 
 /** DNS request table entry: used when dns_gehostbyname cannot answer the
@@ -329,9 +358,39 @@ static u8_t                   dns_last_pcb_idx;
 #endif
 static u8_t                   dns_seqno;
 static struct dns_table_entry dns_table[DNS_TABLE_SIZE];
+/* seconds since boot, see dns_now */
+static u32_t                  dns_time;
+/* sys_now() at the second dns_time was last advanced to */
+static u32_t                  dns_time_ms;
+
+/** Seconds since boot, from sys_now(), so that entries and the DNS cache
+ * expire while the DNS timer doesn't run (it only runs during queries).
+ * Unlike sys_now() / 1000, it doesn't jump when sys_now() wraps around. */
+static u32_t
+dns_now(void)
+{
+  u32_t elapsed_s = (sys_now() - dns_time_ms) / 1000;
+  dns_time += elapsed_s;
+  dns_time_ms += elapsed_s * 1000;
+  return dns_time;
+}
 static struct dns_req_entry   dns_requests[DNS_MAX_REQUESTS];
 static ip_addr_t              dns_servers[DNS_MAX_SERVERS];
 
+#if DNS_CACHE_SIZE
+/** DNS cache entry: result of a completed query, kept until its TTL expires */
+struct dns_cache_entry {
+  u32_t expires;                      /* dns_time at which the entry expires */
+  u32_t hash;
+  ip_addr_t ipaddr;
+  u8_t  negative;                     /* the name doesn't exist, ipaddr is unused */
+  u8_t  hits;
+  char  name[DNS_CACHE_NAME_LENGTH];  /* empty for unused entries */
+};
+
+static struct dns_cache_entry dns_cache[DNS_CACHE_SIZE];
+#endif /* DNS_CACHE_SIZE */
+
 #ifndef LWIP_DNS_STRICMP
 #define LWIP_DNS_STRICMP(str1, str2) dns_stricmp(str1, str2)
 /**
@@ -455,6 +514,25 @@ dns_tmr(void)
   dns_check_entries();
 }
 
+/**
+ * Check whether queries are pending, for which dns_tmr has to be called.
+ * Completed entries and the DNS cache expire by dns_now, without the timer.
+ *
+ * @return 1 if an entry is waiting to be sent or for an answer, 0 otherwise
+ */
+u8_t
+dns_pending(void)
+{
+  u8_t i;
+
+  for (i = 0; i < DNS_TABLE_SIZE; ++i) {
+    if ((dns_table[i].state == DNS_STATE_NEW) || (dns_table[i].state == DNS_STATE_ASKING)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 #if DNS_LOCAL_HOSTLIST
 static void
 dns_init_local(void)
@@ -592,6 +670,210 @@ dns_local_addhost(const char *hostname, const ip_addr_t *addr)
 #endif /* DNS_LOCAL_HOSTLIST_IS_DYNAMIC*/
 #endif /* DNS_LOCAL_HOSTLIST */
 
+#if DNS_CACHE_SIZE
+/** Case insensitive FNV-1a hash of a hostname */
+static u32_t
+dns_cache_hash(const char *name)
+{
+  u32_t hash = 2166136261UL;
+  char c;
+
+  while ((c = *name++) != 0) {
+    if ((c >= 'A') && (c <= 'Z')) {
+      c += 'a' - 'A';
+    }
+    hash = (hash ^ (u8_t)c) * 16777619UL;
+  }
+  return hash;
+}
+
+/** Check whether a dns_cache entry is in use and its TTL hasn't expired yet */
+static int
+dns_cache_valid(const struct dns_cache_entry *entry)
+{
+  return (entry->name[0] != 0) && ((s32_t)(entry->expires - dns_now()) > 0);
+}
+
+/**
+ * Look up a hostname in the DNS cache.
+ *
+ * @param name the hostname to look up
+ * @param addr where to store the cached address
+ * @return ERR_OK if found, ERR_VAL if the name is known not to exist,
+ *         ERR_ARG if not found
+ */
+static err_t
+dns_cache_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addrtype))
+{
+  u32_t hash = dns_cache_hash(name);
+  err_t err = ERR_ARG;
+  u8_t i;
+
+  for (i = 0; i < DNS_CACHE_PROBES; i++) {
+    struct dns_cache_entry *entry = &dns_cache[(hash + i) % DNS_CACHE_SIZE];
+    if ((entry->hash != hash) || !dns_cache_valid(entry) ||
+        (LWIP_DNS_STRICMP(name, entry->name) != 0)) {
+      continue;
+    }
+    if (entry->negative) {
+      /* an address of the other type may still be cached */
+      err = ERR_VAL;
+    } else if (LWIP_DNS_ADDRTYPE_MATCH_IP(dns_addrtype, entry->ipaddr)) {
+      LWIP_DEBUGF(DNS_DEBUG, ("dns_cache_lookup: \"%s\": found = ", name));
+      ip_addr_debug_print(DNS_DEBUG, &(entry->ipaddr));
+      LWIP_DEBUGF(DNS_DEBUG, ("\n"));
+      if (entry->hits < 0xff) {
+        entry->hits++;
+      }
+      if (addr) {
+        ip_addr_copy(*addr, entry->ipaddr);
+      }
+      return ERR_OK;
+    }
+  }
+  return err;
+}
+
+/**
+ * Add the result of a query to the DNS cache. An entry for the same name and
+ * address type is replaced, otherwise a free or expired entry, or the least
+ * used one.
+ *
+ * @param name the hostname
+ * @param addr its address, or NULL if the name doesn't exist
+ * @param ttl time in seconds for which the entry is valid
+ * @return the entry or NULL if the result isn't cached
+ */
+static struct dns_cache_entry *
+dns_cache_add(const char *name, const ip_addr_t *addr, u32_t ttl)
+{
+  struct dns_cache_entry *entry, *victim = NULL;
+  size_t namelen = strlen(name);
+  u32_t hash;
+  u8_t i;
+
+  if ((ttl == 0) || (namelen >= DNS_CACHE_NAME_LENGTH)) {
+    return NULL;
+  }
+  hash = dns_cache_hash(name);
+  for (i = 0; i < DNS_CACHE_PROBES; i++) {
+    entry = &dns_cache[(hash + i) % DNS_CACHE_SIZE];
+    if (!dns_cache_valid(entry)) {
+      if ((victim == NULL) || dns_cache_valid(victim)) {
+        victim = entry;
+      }
+      continue;
+    }
+    if ((entry->hash == hash) && (LWIP_DNS_STRICMP(name, entry->name) == 0) &&
+        ((addr == NULL) || entry->negative || (IP_IS_V6_VAL(entry->ipaddr) == IP_IS_V6(addr)))) {
+      /* refresh the entry of this name */
+      victim = entry;
+      break;
+    }
+    if ((victim == NULL) || (dns_cache_valid(victim) && (entry->hits < victim->hits))) {
+      victim = entry;
+    }
+  }
+
+  if ((victim->hash != hash) || (LWIP_DNS_STRICMP(name, victim->name) != 0)) {
+    victim->hits = 0;
+    MEMCPY(victim->name, name, namelen + 1);
+  }
+  victim->hash = hash;
+  victim->expires = dns_now() + LWIP_MIN(ttl, DNS_MAX_TTL);
+  victim->negative = (addr == NULL);
+  if (addr != NULL) {
+    ip_addr_copy(victim->ipaddr, *addr);
+  } else {
+    ip_addr_set_zero(&victim->ipaddr);
+  }
+  return victim;
+}
+
+/**
+ * Remove all entries from the DNS cache, e.g. after connecting to another
+ * network.
+ */
+void
+dns_cache_clear(void)
+{
+  u8_t i;
+
+  for (i = 0; i < DNS_CACHE_SIZE; i++) {
+    dns_cache[i].name[0] = 0;
+  }
+}
+
+/**
+ * Copy the most used addresses of the DNS cache, so that they can be kept
+ * over a deep sleep or reboot (e.g. in NVS) and given back to
+ * dns_cache_import afterwards. Names which don't exist are not exported.
+ *
+ * @param records where to store the entries, most used first
+ * @param max_records size of records
+ * @return number of entries stored
+ */
+u16_t
+dns_cache_export(struct dns_cache_record *records, u16_t max_records)
+{
+  u8_t exported[(DNS_CACHE_SIZE + 7) / 8];
+  u16_t count;
+  u8_t i;
+
+  memset(exported, 0, sizeof(exported));
+  for (count = 0; count < max_records; count++) {
+    struct dns_cache_entry *best = NULL;
+    u8_t best_idx = 0;
+    for (i = 0; i < DNS_CACHE_SIZE; i++) {
+      struct dns_cache_entry *entry = &dns_cache[i];
+      if (!dns_cache_valid(entry) || entry->negative || (exported[i / 8] & (1 << (i % 8)))) {
+        continue;
+      }
+      if ((best == NULL) || (entry->hits > best->hits)) {
+        best = entry;
+        best_idx = i;
+      }
+    }
+    if (best == NULL) {
+      break;
+    }
+    exported[best_idx / 8] |= (u8_t)(1 << (best_idx % 8));
+    records[count].ttl = best->expires - dns_now();
+    ip_addr_copy(records[count].ipaddr, best->ipaddr);
+    records[count].hits = best->hits;
+    MEMCPY(records[count].name, best->name, DNS_CACHE_NAME_LENGTH);
+  }
+  return count;
+}
+
+/**
+ * Add entries saved with dns_cache_export to the DNS cache.
+ *
+ * @param records the entries
+ * @param count number of entries
+ * @param elapsed_s seconds since they were exported, entries which expired
+ *        in the meantime are skipped
+ */
+void
+dns_cache_import(const struct dns_cache_record *records, u16_t count, u32_t elapsed_s)
+{
+  struct dns_cache_entry *entry;
+  u16_t i;
+
+  for (i = 0; i < count; i++) {
+    const struct dns_cache_record *record = &records[i];
+    if ((record->ttl <= elapsed_s) || (record->name[0] == 0) ||
+        (record->name[DNS_CACHE_NAME_LENGTH - 1] != 0)) {
+      continue;
+    }
+    entry = dns_cache_add(record->name, &record->ipaddr, record->ttl - elapsed_s);
+    if (entry != NULL) {
+      entry->hits = record->hits;
+    }
+  }
+}
+#endif /* DNS_CACHE_SIZE */
+
 /**
  * Look up a hostname in the array of known hostnames.
  *
@@ -604,7 +886,8 @@ dns_local_addhost(const char *hostname, const ip_addr_t *addr)
  * @param addr the hostname's IP address, as u32_t (instead of ip_addr_t to
  *         better check for failure: != IPADDR_NONE) or IPADDR_NONE if the hostname
  *         was not found in the cached dns_table.
- * @return ERR_OK if found, ERR_ARG if not found
+ * @return ERR_OK if found, ERR_VAL if the name is known not to exist,
+ *         ERR_ARG if not found
  */
 static err_t
 dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addrtype))
@@ -626,6 +909,7 @@ dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addr
   /* Walk through name list, return entry if found. If not, return NULL. */
   for (i = 0; i < DNS_TABLE_SIZE; ++i) {
     if ((dns_table[i].state == DNS_STATE_DONE) &&
+        ((s32_t)(dns_table[i].expires - dns_now()) > 0) &&
         (LWIP_DNS_STRICMP(name, dns_table[i].name) == 0) &&
         LWIP_DNS_ADDRTYPE_MATCH_IP(dns_addrtype, dns_table[i].ipaddr)) {
       LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": found = ", name));
@@ -638,7 +922,11 @@ dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addr
     }
   }
 
+#if DNS_CACHE_SIZE
+  return dns_cache_lookup(name, addr LWIP_DNS_ADDRTYPE_ARG(dns_addrtype));
+#else /* DNS_CACHE_SIZE */
   return ERR_ARG;
+#endif /* DNS_CACHE_SIZE */
 }
 
 /**
@@ -712,13 +1000,16 @@ dns_parse_name(struct pbuf* p, u16_t query_idx)
 }
 
 /**
- * Send a DNS query packet.
+ * Send one DNS query packet.
  *
- * @param idx the DNS table entry index for which to send a request
+ * @param entry the DNS table entry for which to send a request
+ * @param server_idx the server to ask
+ * @param txid the ID of the query
+ * @param is_ipv6 ask for an AAAA instead of an A record
  * @return ERR_OK if packet is sent; an err_t indicating the problem otherwise
  */
 static err_t
-dns_send(u8_t idx)
+dns_send_query(struct dns_table_entry *entry, u8_t server_idx, u16_t txid, u8_t is_ipv6)
 {
   err_t err;
   struct dns_hdr hdr;
@@ -728,27 +1019,13 @@ dns_send(u8_t idx)
   const char *hostname, *hostname_part;
   u8_t n;
   u8_t pcb_idx;
-  struct dns_table_entry* entry = &dns_table[idx];
 
-  LWIP_DEBUGF(DNS_DEBUG, ("dns_send: dns_servers[%"U16_F"] \"%s\": request\n",
-              (u16_t)(entry->server_idx), entry->name));
-  LWIP_ASSERT("dns server out of array", entry->server_idx < DNS_MAX_SERVERS);
-  if (ip_addr_isany_val(dns_servers[entry->server_idx])) {
-    /* DNS server not valid anymore, e.g. PPP netif has been shut down */
-    /* call specified callback function if provided */
-    dns_call_found(idx, NULL);
-    /* flush this entry */
-    entry->state = DNS_STATE_UNUSED;
-    return ERR_OK;
-  }
-
-  /* if here, we have either a new query or a retry on a previous query to process */
   p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(SIZEOF_DNS_HDR + strlen(entry->name) + 2 +
                  SIZEOF_DNS_QUERY), PBUF_RAM);
   if (p != NULL) {
     /* fill dns header */
     memset(&hdr, 0, SIZEOF_DNS_HDR);
-    hdr.id = htons(entry->txid);
+    hdr.id = htons(txid);
     hdr.flags1 = DNS_FLAG1_RD;
     hdr.numquestions = PP_HTONS(1);
     pbuf_take(p, &hdr, SIZEOF_DNS_HDR);
@@ -772,7 +1049,7 @@ dns_send(u8_t idx)
     query_idx++;
 
     /* fill dns query */
-    if (LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype)) {
+    if (is_ipv6) {
       qry.type = PP_HTONS(DNS_RRTYPE_AAAA);
     } else {
       qry.type = PP_HTONS(DNS_RRTYPE_A);
@@ -787,8 +1064,8 @@ dns_send(u8_t idx)
 #endif
     /* send dns packet */
     LWIP_DEBUGF(DNS_DEBUG, ("sending DNS request ID %d for name \"%s\" to server %d\r\n",
-      entry->txid, entry->name, entry->server_idx));
-    err = udp_sendto(dns_pcbs[pcb_idx], p, &dns_servers[entry->server_idx], DNS_SERVER_PORT);
+      txid, entry->name, server_idx));
+    err = udp_sendto(dns_pcbs[pcb_idx], p, &dns_servers[server_idx], DNS_SERVER_PORT);
 
     /* free pbuf */
     pbuf_free(p);
@@ -799,6 +1076,79 @@ dns_send(u8_t idx)
   return err;
 }
 
+/**
+ * Send the DNS query packets of an entry: to the current server or, with
+ * DNS_PARALLEL_QUERIES, to all servers (the first answer is used).
+ *
+ * @param idx the DNS table entry index for which to send a request
+ * @return ERR_OK if packet is sent; an err_t indicating the problem otherwise
+ */
+static err_t
+dns_send(u8_t idx)
+{
+  err_t err;
+  u8_t server_idx;
+  struct dns_table_entry* entry = &dns_table[idx];
+
+  LWIP_DEBUGF(DNS_DEBUG, ("dns_send: dns_servers[%"U16_F"] \"%s\": request\n",
+              (u16_t)(entry->server_idx), entry->name));
+  LWIP_ASSERT("dns server out of array", entry->server_idx < DNS_MAX_SERVERS);
+  if (ip_addr_isany_val(dns_servers[entry->server_idx])) {
+    /* DNS server not valid anymore, e.g. PPP netif has been shut down */
+    /* call specified callback function if provided */
+    dns_call_found(idx, NULL);
+    /* flush this entry */
+    entry->state = DNS_STATE_UNUSED;
+    return ERR_OK;
+  }
+
+  /* if here, we have either a new query or a retry on a previous query to process */
+  err = ERR_VAL;
+  for (server_idx = 0; server_idx < DNS_MAX_SERVERS; server_idx++) {
+    err_t e;
+    if ((!DNS_PARALLEL_QUERIES && (server_idx != entry->server_idx)) ||
+        ip_addr_isany_val(dns_servers[server_idx])) {
+      continue;
+    }
+    e = dns_send_query(entry, server_idx, entry->txid, LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype));
+#if DNS_PARALLEL_FALLBACK
+    if (DNS_FALLBACK_PENDING(entry)) {
+      err_t e2 = dns_send_query(entry, server_idx, entry->txid2, !LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype));
+      if (e == ERR_OK) {
+        e = e2;
+      }
+    }
+#endif /* DNS_PARALLEL_FALLBACK */
+    if (err != ERR_OK) {
+      err = e;
+    }
+  }
+
+  return err;
+}
+
+/**
+ * Check whether a DNS response comes from the same network address to which
+ * the question was sent (RFC 5452), any of the servers with DNS_PARALLEL_QUERIES.
+ */
+static int
+dns_is_server(const struct dns_table_entry *entry, const ip_addr_t *addr)
+{
+#if DNS_PARALLEL_QUERIES
+  u8_t i;
+  LWIP_UNUSED_ARG(entry);
+
+  for (i = 0; i < DNS_MAX_SERVERS; i++) {
+    if (!ip_addr_isany_val(dns_servers[i]) && ip_addr_cmp(addr, &dns_servers[i])) {
+      return 1;
+    }
+  }
+  return 0;
+#else /* DNS_PARALLEL_QUERIES */
+  return ip_addr_cmp(addr, &dns_servers[entry->server_idx]);
+#endif /* DNS_PARALLEL_QUERIES */
+}
+
 #if ((LWIP_DNS_SECURE & LWIP_DNS_SECURE_RAND_SRC_PORT) != 0)
 static struct udp_pcb*
 dns_alloc_random_port(void)
@@ -950,6 +1300,12 @@ again:
       /* ID already used by another pending query */
       goto again;
     }
+#if DNS_PARALLEL_FALLBACK
+    if ((dns_table[i].state == DNS_STATE_ASKING) && DNS_FALLBACK_PENDING(&dns_table[i]) &&
+        (dns_table[i].txid2 == txid)) {
+      goto again;
+    }
+#endif /* DNS_PARALLEL_FALLBACK */
   }
 
   return txid;
@@ -983,6 +1339,11 @@ dns_check_entry(u8_t i)
       entry->server_idx = 0;
       entry->tmr = 1;
       entry->retries = 0;
+#if DNS_PARALLEL_FALLBACK
+      /* unique against the ID of this entry as well, which is ASKING now */
+      entry->fallback_state = DNS_FALLBACK_ASKING;
+      entry->txid2 = dns_create_txid();
+#endif /* DNS_PARALLEL_FALLBACK */
 
       /* send DNS packet for this entry */
       err = dns_send(i);
@@ -996,7 +1357,8 @@ dns_check_entry(u8_t i)
     case DNS_STATE_ASKING:
       if (--entry->tmr == 0) {
         if (++entry->retries == DNS_MAX_RETRIES) {
-          if ((entry->server_idx + 1 < DNS_MAX_SERVERS) && !ip_addr_isany_val(dns_servers[entry->server_idx + 1])) {
+          if (!DNS_PARALLEL_QUERIES && (entry->server_idx + 1 < DNS_MAX_SERVERS) &&
+              !ip_addr_isany_val(dns_servers[entry->server_idx + 1])) {
             /* change of server */
             entry->server_idx++;
             entry->tmr = 1;
@@ -1023,8 +1385,8 @@ dns_check_entry(u8_t i)
       }
       break;
     case DNS_STATE_DONE:
-      /* if the time to live is nul */
-      if ((entry->ttl == 0) || (--entry->ttl == 0)) {
+      /* if the time to live has expired */
+      if ((s32_t)(entry->expires - dns_now()) <= 0) {
         LWIP_DEBUGF(DNS_DEBUG, ("dns_check_entry: \"%s\": flush\n", entry->name));
         /* flush this entry, there cannot be any related pending entries in this state */
         entry->state = DNS_STATE_UNUSED;
@@ -1052,6 +1414,75 @@ dns_check_entries(void)
   }
 }
 
+/**
+ * Find the first address of the requested type in the answers of a DNS
+ * response.
+ *
+ * @param p pbuf containing the response
+ * @param res_idx offset of the first answer
+ * @param nanswers number of answers
+ * @param is_ipv6 look for an AAAA instead of an A record
+ * @param addr where to store the address
+ * @param ttl where to store the TTL of the answer, at most DNS_MAX_TTL
+ * @return 1 if found, 0 otherwise
+ */
+static int
+dns_parse_answers(struct pbuf *p, u16_t res_idx, u16_t nanswers, u8_t is_ipv6,
+                  ip_addr_t *addr, u32_t *ttl)
+{
+  struct dns_answer ans;
+
+  LWIP_UNUSED_ARG(is_ipv6);
+
+  while ((nanswers > 0) && (res_idx < p->tot_len)) {
+    /* skip answer resource record's host name */
+    res_idx = dns_parse_name(p, res_idx);
+
+    /* Check for IP address type and Internet class. Others are discarded. */
+    pbuf_copy_partial(p, &ans, SIZEOF_DNS_ANSWER, res_idx);
+    if (ans.cls == PP_HTONS(DNS_RRCLASS_IN)) {
+#if LWIP_IPV4
+      if ((ans.type == PP_HTONS(DNS_RRTYPE_A)) && (ans.len == PP_HTONS(sizeof(ip4_addr_t)))) {
+#if LWIP_IPV4 && LWIP_IPV6
+        if (!is_ipv6)
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+        {
+          ip4_addr_t ip4addr;
+          res_idx += SIZEOF_DNS_ANSWER;
+          /* read the answer resource record's TTL, and maximize it if needed */
+          *ttl = LWIP_MIN(ntohl(ans.ttl), DNS_MAX_TTL);
+          /* read the IP address after answer resource record's header */
+          pbuf_copy_partial(p, &ip4addr, sizeof(ip4_addr_t), res_idx);
+          ip_addr_copy_from_ip4(*addr, ip4addr);
+          return 1;
+        }
+      }
+#endif /* LWIP_IPV4 */
+#if LWIP_IPV6
+      if ((ans.type == PP_HTONS(DNS_RRTYPE_AAAA)) && (ans.len == PP_HTONS(sizeof(ip6_addr_t)))) {
+#if LWIP_IPV4 && LWIP_IPV6
+        if (is_ipv6)
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+        {
+          ip6_addr_t ip6addr;
+          res_idx += SIZEOF_DNS_ANSWER;
+          /* read the answer resource record's TTL, and maximize it if needed */
+          *ttl = LWIP_MIN(ntohl(ans.ttl), DNS_MAX_TTL);
+          /* read the IP address after answer resource record's header */
+          pbuf_copy_partial(p, &ip6addr, sizeof(ip6_addr_t), res_idx);
+          ip_addr_copy_from_ip6(*addr, ip6addr);
+          return 1;
+        }
+      }
+#endif /* LWIP_IPV6 */
+    }
+    /* skip this answer */
+    res_idx += SIZEOF_DNS_ANSWER + htons(ans.len);
+    --nanswers;
+  }
+  return 0;
+}
+
 /**
  * Receive input function for DNS response packets arriving for the dns UDP pcb.
  *
@@ -1064,9 +1495,12 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
   u16_t txid;
   u16_t res_idx;
   struct dns_hdr hdr;
-  struct dns_answer ans;
   struct dns_query qry;
   u16_t nquestions, nanswers;
+  u8_t is_ipv6;
+  ip_addr_t ipaddr;
+  u32_t ttl;
+  int found;
 
   LWIP_UNUSED_ARG(arg);
   LWIP_UNUSED_ARG(pcb);
@@ -1085,9 +1519,15 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
     txid = htons(hdr.id);
     for (i = 0; i < DNS_TABLE_SIZE; i++) {
       struct dns_table_entry *entry = &dns_table[i];
+      u8_t fallback = 0;
       entry_idx = i;
+#if DNS_PARALLEL_FALLBACK
+      /* answer to the query for the fallback address type? */
+      fallback = (entry->state == DNS_STATE_ASKING) && DNS_FALLBACK_PENDING(entry) &&
+                 (entry->txid2 == txid);
+#endif /* DNS_PARALLEL_FALLBACK */
       if ((entry->state == DNS_STATE_ASKING) &&
-          (entry->txid == txid)) {
+          ((entry->txid == txid) || fallback)) {
         u8_t dns_err;
         /* This entry is now completed. */
         
@@ -1104,6 +1544,16 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
         /* Check for error. If so, call callback to inform. */
         if (((hdr.flags1 & DNS_FLAG1_RESPONSE) == 0) || (dns_err != 0) || (nquestions != 1)) {
           LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": error in flags\n", entry->name));
+#if DNS_CACHE_SIZE && DNS_NEGATIVE_TTL
+          if (((hdr.flags1 & DNS_FLAG1_RESPONSE) != 0) && (dns_err == DNS_FLAG2_ERR_NAME) &&
+              (nquestions == 1) && dns_is_server(entry, addr) &&
+              (dns_compare_name(entry->name, p, SIZEOF_DNS_HDR) != 0xFFFF)) {
+            /* the name doesn't exist (for any address type): remember that,
+               and fail now instead of after all retries */
+            dns_cache_add(entry->name, NULL, DNS_NEGATIVE_TTL);
+            goto responseerr;
+          }
+#endif /* DNS_CACHE_SIZE && DNS_NEGATIVE_TTL */
           /* call callback to indicate error, clean up memory and return */
 #ifndef LWIP_ESP8266
                 goto responseerr;
@@ -1117,7 +1567,7 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
 
         /* Check whether response comes from the same network address to which the
            question was sent. (RFC 5452) */
-        if (!ip_addr_cmp(addr, &dns_servers[entry->server_idx])) {
+        if (!dns_is_server(entry, addr)) {
           /* call callback to indicate error, clean up memory and return */
           goto responseerr;
         }
@@ -1132,10 +1582,14 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
         }
 
         /* check if "question" part matches the request */
+        is_ipv6 = LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype);
+        if (fallback) {
+          is_ipv6 = !is_ipv6;
+        }
         pbuf_copy_partial(p, &qry, SIZEOF_DNS_QUERY, res_idx);
         if ((qry.cls != PP_HTONS(DNS_RRCLASS_IN)) ||
-          (LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype) && (qry.type != PP_HTONS(DNS_RRTYPE_AAAA))) ||
-          (!LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype) && (qry.type != PP_HTONS(DNS_RRTYPE_A)))) {
+          (is_ipv6 && (qry.type != PP_HTONS(DNS_RRTYPE_AAAA))) ||
+          (!is_ipv6 && (qry.type != PP_HTONS(DNS_RRTYPE_A)))) {
           LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response not match to query\n", entry->name));
           /* call callback to indicate error, clean up memory and return */
           goto responseerr;
@@ -1143,87 +1597,67 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
         /* skip the rest of the "question" part */
         res_idx += SIZEOF_DNS_QUERY;
 
-        while ((nanswers > 0) && (res_idx < p->tot_len)) {
-          /* skip answer resource record's host name */
-          res_idx = dns_parse_name(p, res_idx);
-
-          /* Check for IP address type and Internet class. Others are discarded. */
-          pbuf_copy_partial(p, &ans, SIZEOF_DNS_ANSWER, res_idx);
-          if (ans.cls == PP_HTONS(DNS_RRCLASS_IN)) {
-#if LWIP_IPV4
-            if ((ans.type == PP_HTONS(DNS_RRTYPE_A)) && (ans.len == PP_HTONS(sizeof(ip4_addr_t)))) {
-#if LWIP_IPV4 && LWIP_IPV6
-              if (!LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype))
-#endif /* LWIP_IPV4 && LWIP_IPV6 */
-              {
-                ip4_addr_t ip4addr;
-                res_idx += SIZEOF_DNS_ANSWER;
-                /* read the answer resource record's TTL, and maximize it if needed */
-                entry->ttl = ntohl(ans.ttl);
-                if (entry->ttl > DNS_MAX_TTL) {
-                  entry->ttl = DNS_MAX_TTL;
-                }
-                /* read the IP address after answer resource record's header */
-                pbuf_copy_partial(p, &ip4addr, sizeof(ip4_addr_t), res_idx);
-                ip_addr_copy_from_ip4(entry->ipaddr, ip4addr);
-                LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", entry->name));
-                ip_addr_debug_print(DNS_DEBUG, (&(entry->ipaddr)));
-                LWIP_DEBUGF(DNS_DEBUG, ("\n"));
-                /* call specified callback function if provided */
-                dns_call_found(entry_idx, &entry->ipaddr);
-                if (entry->ttl == 0) {
-                  /* RFC 883, page 29: "Zero values are
-                     interpreted to mean that the RR can only be used for the
-                     transaction in progress, and should not be cached."
-                     -> flush this entry now */
-                  goto flushentry;
-                }
-                /* deallocate memory and return */
-                goto memerr;
-              }
-            }
-#endif /* LWIP_IPV4 */
-#if LWIP_IPV6
-            if ((ans.type == PP_HTONS(DNS_RRTYPE_AAAA)) && (ans.len == PP_HTONS(sizeof(ip6_addr_t)))) {
-#if LWIP_IPV4 && LWIP_IPV6
-              if (LWIP_DNS_ADDRTYPE_IS_IPV6(entry->reqaddrtype))
-#endif /* LWIP_IPV4 && LWIP_IPV6 */
-              {
-                ip6_addr_t ip6addr;
-                res_idx += SIZEOF_DNS_ANSWER;
-                /* read the answer resource record's TTL, and maximize it if needed */
-                entry->ttl = ntohl(ans.ttl);
-                if (entry->ttl > DNS_MAX_TTL) {
-                  entry->ttl = DNS_MAX_TTL;
-                }
-                /* read the IP address after answer resource record's header */
-                pbuf_copy_partial(p, &ip6addr, sizeof(ip6_addr_t), res_idx);
-                ip_addr_copy_from_ip6(entry->ipaddr, ip6addr);
-                LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", entry->name));
-                ip_addr_debug_print(DNS_DEBUG, (&(entry->ipaddr)));
-                LWIP_DEBUGF(DNS_DEBUG, (" AAAA\n"));
-                /* call specified callback function if provided */
-                dns_call_found(entry_idx, &entry->ipaddr);
-                if (entry->ttl == 0) {
-                  /* RFC 883, page 29: "Zero values are
-                     interpreted to mean that the RR can only be used for the
-                     transaction in progress, and should not be cached."
-                     -> flush this entry now */
-                  goto flushentry;
-                }
-                /* deallocate memory and return */
-                goto memerr;
-              }
-            }
-#endif /* LWIP_IPV6 */
+        found = dns_parse_answers(p, res_idx, nanswers, is_ipv6, &ipaddr, &ttl);
+#if DNS_PARALLEL_FALLBACK
+        if (fallback) {
+          /* keep the answer until the one for the preferred address type is in */
+          if (found) {
+            entry->fallback_state = DNS_FALLBACK_FOUND;
+            ip_addr_copy(entry->fallback_addr, ipaddr);
+            entry->fallback_ttl = ttl;
+          } else {
+            entry->fallback_state = DNS_FALLBACK_FAILED;
+          }
+          entry->state = DNS_STATE_ASKING;
+          goto memerr;
+        }
+        if (!found && (entry->fallback_state == DNS_FALLBACK_FOUND) &&
+            ((entry->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV4_IPV6) ||
+             (entry->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV6_IPV4))) {
+          /* no address of the preferred type, use the other one */
+          entry->reqaddrtype = DNS_FALLBACK_ADDRTYPE(entry->reqaddrtype);
+          ip_addr_copy(ipaddr, entry->fallback_addr);
+          ttl = entry->fallback_ttl;
+          found = 1;
+        }
+#endif /* DNS_PARALLEL_FALLBACK */
+        if (found) {
+          entry->expires = dns_now() + ttl;
+          ip_addr_copy(entry->ipaddr, ipaddr);
+          LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", entry->name));
+          ip_addr_debug_print(DNS_DEBUG, (&(entry->ipaddr)));
+          LWIP_DEBUGF(DNS_DEBUG, ("\n"));
+#if DNS_CACHE_SIZE
+          dns_cache_add(entry->name, &entry->ipaddr, ttl);
+#endif /* DNS_CACHE_SIZE */
+          /* call specified callback function if provided */
+          dns_call_found(entry_idx, &entry->ipaddr);
+          if (ttl == 0) {
+            /* RFC 883, page 29: "Zero values are
+               interpreted to mean that the RR can only be used for the
+               transaction in progress, and should not be cached."
+               -> flush this entry now */
+            goto flushentry;
           }
-          /* skip this answer */
-          res_idx += SIZEOF_DNS_ANSWER + htons(ans.len);
-          --nanswers;
+          /* deallocate memory and return */
+          goto memerr;
         }
 #if LWIP_IPV4 && LWIP_IPV6
         if ((entry->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV4_IPV6) ||
             (entry->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV6_IPV4)) {
+#if DNS_PARALLEL_FALLBACK
+          if (entry->fallback_state == DNS_FALLBACK_ASKING) {
+            /* the query for the other type is out already: wait for its answer */
+            entry->reqaddrtype = DNS_FALLBACK_ADDRTYPE(entry->reqaddrtype);
+            entry->txid = entry->txid2;
+            entry->state = DNS_STATE_ASKING;
+            goto memerr;
+          }
+          if (entry->fallback_state == DNS_FALLBACK_FAILED) {
+            LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": no address of either type\n", entry->name));
+            goto responseerr;
+          }
+#endif /* DNS_PARALLEL_FALLBACK */
           if (entry->reqaddrtype == LWIP_DNS_ADDRTYPE_IPV4_IPV6) {
             /* IPv4 failed, try IPv6 */
             entry->reqaddrtype = LWIP_DNS_ADDRTYPE_IPV6;
@@ -1390,6 +1824,7 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
 
   /* force to send query without waiting timer */
   dns_check_entry(i);
+  dns_timer_needed();
 
   /* dns query is enqueued */
   return ERR_INPROGRESS;
@@ -1405,6 +1840,8 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
  * - ERR_INPROGRESS enqueue a request to be sent to the DNS server
  *   for resolution if no errors are present.
  * - ERR_ARG: dns client not initialized or invalid hostname
+ * - ERR_VAL: no DNS server set, or the DNS cache knows that the name
+ *   doesn't exist
  *
  * @param hostname the hostname that is to be queried
  * @param addr pointer to a ip_addr_t where to store the address if it is already
@@ -1432,6 +1869,7 @@ dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *addr, dns_found_call
                            void *callback_arg, u8_t dns_addrtype)
 {
   size_t hostnamelen;
+  err_t err;
   /* not initialized or no valid server yet, or invalid addr pointer
    * or invalid hostname or invalid hostname length */
   if ((addr == NULL) ||
@@ -1468,7 +1906,8 @@ dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *addr, dns_found_call
     }
   }
   /* already have this address cached? */
-  if (dns_lookup(hostname, addr LWIP_DNS_ADDRTYPE_ARG(dns_addrtype)) == ERR_OK) {
+  err = dns_lookup(hostname, addr LWIP_DNS_ADDRTYPE_ARG(dns_addrtype));
+  if (err == ERR_OK) {
     return ERR_OK;
   }
 #if LWIP_IPV4 && LWIP_IPV6
@@ -1487,6 +1926,10 @@ dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *addr, dns_found_call
 #else /* LWIP_IPV4 && LWIP_IPV6 */
   LWIP_UNUSED_ARG(dns_addrtype);
 #endif /* LWIP_IPV4 && LWIP_IPV6 */
+  if (err == ERR_VAL) {
+    /* negative cache entry: the name doesn't exist */
+    return ERR_VAL;
+  }
 
   /* prevent calling found callback if no server is set, return error instead */
   if (ip_addr_isany_val(dns_servers[0])) {
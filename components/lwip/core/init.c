@@ -228,6 +228,9 @@
 #if NETCONN_MORE != TCP_WRITE_FLAG_MORE
   #error "NETCONN_MORE != TCP_WRITE_FLAG_MORE"
 #endif
+#if NETCONN_REF != TCP_WRITE_FLAG_REF
+  #error "NETCONN_REF != TCP_WRITE_FLAG_REF"
+#endif
 #endif /* LWIP_NETCONN && LWIP_TCP */
 #if LWIP_SOCKET
 /* Check that the SO_* socket options and SOF_* lwIP-internal flags match */
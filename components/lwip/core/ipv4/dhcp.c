@@ -310,6 +310,7 @@ dhcp_check(struct netif *netif)
   }
   msecs = 500;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_check(): set request timeout %"U16_F" msecs\n", msecs));
 }
 #endif /* DHCP_DOES_ARP_CHECK */
@@ -399,6 +400,7 @@ dhcp_select(struct netif *netif)
   }
   msecs = (dhcp->tries < 6 ? 1 << dhcp->tries : 60) * 1000;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_STATE, ("dhcp_select(): set request timeout %"U16_F" msecs\n", msecs));
   return result;
 }
@@ -485,6 +487,25 @@ dhcp_fine_tmr(void)
   }
 }
 
+/**
+ * Check whether a DHCP client waits for a response, for which dhcp_fine_tmr
+ * has to be called.
+ *
+ * @return 1 if a request timeout is running, 0 otherwise
+ */
+u8_t
+dhcp_fine_pending(void)
+{
+  struct netif *netif;
+
+  for (netif = netif_list; netif != NULL; netif = netif->next) {
+    if ((netif->dhcp != NULL) && (netif->dhcp->request_timeout > 0)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /**
  * A DHCP negotiation transaction, or ARP request, has timed out.
  *
@@ -726,6 +747,47 @@ void dhcp_set_cb(struct netif *netif, void (*cb)(void))
   }
 }
 
+/** Get the lease the interface is bound to, so that it can be saved and
+ * passed to dhcp_start_with_lease() later, e.g. after a reset.
+ *
+ * @param netif the netif under DHCP control
+ * @param lease filled with the address, server and lease time
+ * @return ERR_OK, or ERR_VAL if the interface has no DHCP supplied address
+ */
+err_t
+dhcp_get_lease(struct netif *netif, struct dhcp_lease_info *lease)
+{
+  struct dhcp *dhcp;
+#if LWIP_DNS
+  u8_t n;
+#endif /* LWIP_DNS */
+
+  LWIP_ERROR("netif != NULL", (netif != NULL), return ERR_ARG;);
+  LWIP_ERROR("lease != NULL", (lease != NULL), return ERR_ARG;);
+  dhcp = netif->dhcp;
+  if ((dhcp == NULL) || ((dhcp->state != DHCP_STATE_BOUND) &&
+      (dhcp->state != DHCP_STATE_RENEWING) && (dhcp->state != DHCP_STATE_REBINDING))) {
+    return ERR_VAL;
+  }
+
+  memset(lease, 0, sizeof(struct dhcp_lease_info));
+  ip4_addr_copy(lease->ip_addr, *netif_ip4_addr(netif));
+  ip4_addr_copy(lease->netmask, *netif_ip4_netmask(netif));
+  ip4_addr_copy(lease->gw, *netif_ip4_gw(netif));
+  ip4_addr_copy(lease->server, *ip_2_ip4(&dhcp->server_ip_addr));
+  lease->lease_time = dhcp->offered_t0_lease;
+  lease->lease_used = (u32_t)dhcp->lease_used * DHCP_COARSE_TIMER_SECS;
+#if LWIP_DNS
+  for (n = 0; n < DNS_MAX_SERVERS; n++) {
+    ip_addr_t dns_addr = dns_getserver(n);
+    if (!IP_IS_V6_VAL(dns_addr)) {
+      ip4_addr_copy(lease->dns_server[n], *ip_2_ip4(&dns_addr));
+    }
+  }
+#endif /* LWIP_DNS */
+  return ERR_OK;
+}
+
 /* Espressif add end. */
 
 /**
@@ -742,6 +804,31 @@ void dhcp_set_cb(struct netif *netif, void (*cb)(void))
  */
 err_t
 dhcp_start(struct netif *netif)
+{
+  return dhcp_start_with_lease(netif, NULL, 0);
+}
+
+/**
+ * Start DHCP negotiation for a network interface, asking the server to
+ * confirm a lease obtained earlier (INIT-REBOOT, RFC2131 3.2) instead of
+ * discovering a server. This takes a single REQUEST/ACK exchange. If the
+ * server refuses the lease, or doesn't answer, a new lease is negotiated
+ * as by dhcp_start().
+ *
+ * The lease is ignored if it expired, according to its lease_used field;
+ * add the time spent since dhcp_get_lease() to it if it is known.
+ *
+ * @param netif The lwIP network interface
+ * @param lease lease returned by dhcp_get_lease(), or NULL for dhcp_start()
+ * @param use_now set the address of the lease on the interface immediately
+ *                rather than once the server acknowledged it. The DHCP
+ *                callback is only called on the acknowledgement.
+ * @return lwIP error code
+ * - ERR_OK - No error
+ * - ERR_MEM - Out of memory
+ */
+err_t
+dhcp_start_with_lease(struct netif *netif, const struct dhcp_lease_info *lease, u8_t use_now)
 {
   struct dhcp *dhcp;
   err_t result;
@@ -798,14 +885,57 @@ dhcp_start(struct netif *netif)
   }
   dhcp->pcb_allocated = 1;
 
+  if ((lease != NULL) && (ip4_addr_isany_val(lease->ip_addr) ||
+      ((lease->lease_time != 0xffffffffUL) && (lease->lease_used >= lease->lease_time)))) {
+    LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("dhcp_start(): lease expired\n"));
+    lease = NULL;
+  }
+
+  if (lease != NULL) {
+    ip4_addr_copy(dhcp->offered_ip_addr, lease->ip_addr);
+    ip4_addr_copy(dhcp->offered_sn_mask, lease->netmask);
+    dhcp->subnet_mask_given = !ip4_addr_isany_val(lease->netmask);
+    ip4_addr_copy(dhcp->offered_gw_addr, lease->gw);
+    ip_addr_copy_from_ip4(dhcp->server_ip_addr, lease->server);
+    /* replaced by the times of the ACK */
+    dhcp->offered_t0_lease = lease->lease_time;
+    dhcp->offered_t1_renew = lease->lease_time / 2;
+    dhcp->offered_t2_rebind = (lease->lease_time * 7U) / 8U;
+  }
+
 #if LWIP_DHCP_CHECK_LINK_UP
   if (!netif_is_link_up(netif)) {
+    if (lease != NULL) {
+      /* wait for dhcp_network_changed() to call dhcp_reboot() */
+      dhcp_set_state(dhcp, DHCP_STATE_REBOOTING);
+      return ERR_OK;
+    }
     /* set state INIT and wait for dhcp_network_changed() to call dhcp_discover() */
     dhcp_set_state(dhcp, DHCP_STATE_INIT);
     return ERR_OK;
   }
 #endif /* LWIP_DHCP_CHECK_LINK_UP */
 
+  if (lease != NULL) {
+#if LWIP_DNS
+    u8_t n;
+#endif /* LWIP_DNS */
+    LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_start(): requesting previous lease\n"));
+    if (use_now) {
+      netif_set_addr(netif, &lease->ip_addr, &lease->netmask, &lease->gw);
+#if LWIP_DNS
+      for (n = 0; n < DNS_MAX_SERVERS; n++) {
+        if (!ip4_addr_isany_val(lease->dns_server[n])) {
+          ip_addr_t dns_addr;
+          ip_addr_copy_from_ip4(dns_addr, lease->dns_server[n]);
+          dns_setserver(n, &dns_addr);
+        }
+      }
+#endif /* LWIP_DNS */
+    }
+    dhcp_reboot(netif);
+    return ERR_OK;
+  }
 
   /* (re)start the DHCP negotiation */
   result = dhcp_discover(netif);
@@ -968,6 +1098,7 @@ dhcp_decline(struct netif *netif)
   }
   msecs = 10*1000;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("dhcp_decline(): set request timeout %"U16_F" msecs\n", msecs));
   return result;
 }
@@ -1031,6 +1162,7 @@ dhcp_discover(struct netif *netif)
 #endif /* LWIP_DHCP_AUTOIP_COOP */
   msecs = (dhcp->tries < 6 ? 1 << dhcp->tries : 60) * 1000;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_discover(): set request timeout %"U16_F" msecs\n", msecs));
   return result;
 }
@@ -1192,6 +1324,7 @@ dhcp_renew(struct netif *netif)
   /* back-off on retries, but to a maximum of 20 seconds */
   msecs = dhcp->tries < 10 ? dhcp->tries * 2000 : 20 * 1000;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_renew(): set request timeout %"U16_F" msecs\n", msecs));
   return result;
 }
@@ -1236,6 +1369,7 @@ dhcp_rebind(struct netif *netif)
   }
   msecs = dhcp->tries < 10 ? dhcp->tries * 1000 : 10 * 1000;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_rebind(): set request timeout %"U16_F" msecs\n", msecs));
   return result;
 }
@@ -1251,6 +1385,7 @@ dhcp_reboot(struct netif *netif)
   struct dhcp *dhcp = netif->dhcp;
   err_t result;
   u16_t msecs;
+  u8_t i;
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_reboot()\n"));
   dhcp_set_state(dhcp, DHCP_STATE_REBOOTING);
 
@@ -1263,12 +1398,22 @@ dhcp_reboot(struct netif *netif)
     dhcp_option(dhcp, DHCP_OPTION_REQUESTED_IP, 4);
     dhcp_option_long(dhcp, ntohl(ip4_addr_get_u32(&dhcp->offered_ip_addr)));
 
+    /* the ACK has to carry the router and DNS servers as well */
+    dhcp_option(dhcp, DHCP_OPTION_PARAMETER_REQUEST_LIST, sizeof(dhcp_discover_select_options));
+    for (i = 0; i < sizeof(dhcp_discover_select_options); i++) {
+      dhcp_option_byte(dhcp, dhcp_discover_select_options[i]);
+    }
+
+#if LWIP_NETIF_HOSTNAME
+    dhcp_option_hostname(dhcp, netif);
+#endif /* LWIP_NETIF_HOSTNAME */
+
     dhcp_option_trailer(dhcp);
 
     pbuf_realloc(dhcp->p_out, sizeof(struct dhcp_msg) - DHCP_OPTIONS_LEN + dhcp->options_out_len);
 
-    /* broadcast to server */
-    udp_sendto_if(dhcp_pcb, dhcp->p_out, IP_ADDR_BROADCAST, DHCP_SERVER_PORT, netif);
+    /* broadcast to server, from 0.0.0.0 even if the address is already in use */
+    udp_sendto_if_src(dhcp_pcb, dhcp->p_out, IP_ADDR_BROADCAST, DHCP_SERVER_PORT, netif, IP_ADDR_ANY);
     dhcp_delete_msg(dhcp);
     LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_reboot: REBOOTING\n"));
   } else {
@@ -1279,6 +1424,7 @@ dhcp_reboot(struct netif *netif)
   }
   msecs = dhcp->tries < 10 ? dhcp->tries * 1000 : 10 * 1000;
   dhcp->request_timeout = (msecs + DHCP_FINE_TIMER_MSECS - 1) / DHCP_FINE_TIMER_MSECS;
+  dhcp_fine_timer_needed();
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_reboot(): set request timeout %"U16_F" msecs\n", msecs));
   return result;
 }
@@ -1763,6 +1909,7 @@ dhcp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
     /* already bound to the given lease address? */
     else if ((dhcp->state == DHCP_STATE_REBOOTING) || (dhcp->state == DHCP_STATE_REBINDING) ||
              (dhcp->state == DHCP_STATE_RENEWING)) {
+      dhcp_handle_ack(netif);
       dhcp_bind(netif);
     }
   }
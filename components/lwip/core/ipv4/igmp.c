@@ -144,9 +144,16 @@ static void   igmp_start_timer(struct igmp_group *group, u8_t max_time);
 static void   igmp_delaying_member(struct igmp_group *group, u8_t maxresp);
 static err_t  igmp_ip_output_if(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *dest, struct netif *netif);
 static void   igmp_send(struct igmp_group *group, u8_t type);
+#if IGMP_GROUP_HASH_SIZE
+static void   igmp_group_hash_remove(struct igmp_group *group);
+#endif /* IGMP_GROUP_HASH_SIZE */
 
 
 static struct igmp_group* igmp_group_list;
+#if IGMP_GROUP_HASH_SIZE
+/* The groups of igmp_group_list by their address, chained through hash_next */
+static struct igmp_group* igmp_group_hash[IGMP_GROUP_HASH_SIZE];
+#endif /* IGMP_GROUP_HASH_SIZE */
 static ip4_addr_t     allsystems;
 static ip4_addr_t     allrouters;
 
@@ -223,6 +230,9 @@ igmp_stop(struct netif *netif)
         LWIP_DEBUGF(IGMP_DEBUG, (") on if %p\n", (void*)netif));
         netif->igmp_mac_filter(netif, &(group->group_address), IGMP_DEL_MAC_FILTER);
       }
+#if IGMP_GROUP_HASH_SIZE
+      igmp_group_hash_remove(group);
+#endif /* IGMP_GROUP_HASH_SIZE */
       /* free group */
       memp_free(MEMP_IGMP_GROUP, group);
     } else {
@@ -255,6 +265,35 @@ igmp_report_groups(struct netif *netif)
   }
 }
 
+#if IGMP_GROUP_HASH_SIZE
+/**
+ * The bucket of igmp_group_hash for a group address
+ */
+static struct igmp_group **
+igmp_group_chain(const ip4_addr_t *addr)
+{
+  u32_t h = ip4_addr_get_u32(addr);
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return &igmp_group_hash[(h & 0xff) % IGMP_GROUP_HASH_SIZE];
+}
+
+/**
+ * Unlink a group from its bucket of igmp_group_hash
+ */
+static void
+igmp_group_hash_remove(struct igmp_group *group)
+{
+  struct igmp_group **link;
+  for (link = igmp_group_chain(&group->group_address); *link != NULL; link = &(*link)->hash_next) {
+    if (*link == group) {
+      *link = group->hash_next;
+      break;
+    }
+  }
+}
+#endif /* IGMP_GROUP_HASH_SIZE */
+
 /**
  * Search for a group in the global igmp_group_list
  *
@@ -266,6 +305,16 @@ igmp_report_groups(struct netif *netif)
 struct igmp_group *
 igmp_lookfor_group(struct netif *ifp, const ip4_addr_t *addr)
 {
+#if IGMP_GROUP_HASH_SIZE
+  struct igmp_group *group = *igmp_group_chain(addr);
+
+  while (group != NULL) {
+    if ((group->netif == ifp) && (ip4_addr_cmp(&(group->group_address), addr))) {
+      return group;
+    }
+    group = group->hash_next;
+  }
+#else /* IGMP_GROUP_HASH_SIZE */
   struct igmp_group *group = igmp_group_list;
 
   while (group != NULL) {
@@ -274,6 +323,7 @@ igmp_lookfor_group(struct netif *ifp, const ip4_addr_t *addr)
     }
     group = group->next;
   }
+#endif /* IGMP_GROUP_HASH_SIZE */
 
   /* to be clearer, we return NULL here instead of
    * 'group' (which is also NULL at this point).
@@ -313,6 +363,10 @@ igmp_lookup_group(struct netif *ifp, const ip4_addr_t *addr)
     group->next               = igmp_group_list;
 
     igmp_group_list = group;
+#if IGMP_GROUP_HASH_SIZE
+    group->hash_next = *igmp_group_chain(addr);
+    *igmp_group_chain(addr) = group;
+#endif /* IGMP_GROUP_HASH_SIZE */
   }
 
   LWIP_DEBUGF(IGMP_DEBUG, ("igmp_lookup_group: %sallocated a new group with address ", (group?"":"impossible to ")));
@@ -350,6 +404,9 @@ igmp_remove_group(struct igmp_group *group)
       err = ERR_ARG;
     }
   }
+#if IGMP_GROUP_HASH_SIZE
+  igmp_group_hash_remove(group);
+#endif /* IGMP_GROUP_HASH_SIZE */
   /* free group */
   memp_free(MEMP_IGMP_GROUP, group);
 
@@ -688,6 +745,25 @@ igmp_tmr(void)
   }
 }
 
+/**
+ * Check whether a group has a report scheduled, for which igmp_tmr has to
+ * be called.
+ *
+ * @return 1 if a group timer is running, 0 otherwise
+ */
+u8_t
+igmp_pending(void)
+{
+  struct igmp_group *group;
+
+  for (group = igmp_group_list; group != NULL; group = group->next) {
+    if (group->timer > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /**
  * Called if a timeout for one group is reached.
  * Sends a report for this group.
@@ -730,6 +806,7 @@ igmp_start_timer(struct igmp_group *group, u8_t max_time)
   if (group->timer == 0) {
     group->timer = 1;
   }
+  igmp_timer_needed();
 }
 
 /**
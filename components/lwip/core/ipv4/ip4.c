@@ -56,6 +56,7 @@
 #include "lwip/dhcp.h"
 #include "lwip/autoip.h"
 #include "lwip/stats.h"
+#include "lwip/ip4_napt.h"
 
 #include <string.h>
 
@@ -328,6 +329,13 @@ ip4_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
     return;
   }
 
+#if IP_NAPT
+  if (ip_napt_forward(p, iphdr, inp, netif) != ERR_OK) {
+    LWIP_DEBUGF(IP_DEBUG, ("ip4_forward: packet can't be translated.\n"));
+    goto return_noroute;
+  }
+#endif /* IP_NAPT */
+
   /* Incrementally update the IP checksum. */
   if (IPH_CHKSUM(iphdr) >= PP_HTONS(0xffffU - 0x100)) {
     IPH_CHKSUM_SET(iphdr, IPH_CHKSUM(iphdr) + PP_HTONS(0x100) + 1);
@@ -632,6 +640,16 @@ ip4_input(struct pbuf *p, struct netif *inp)
 #endif /* IP_REASSEMBLY */
   }
 
+#if IP_NAPT
+  /* reply to a translated connection? forward it to the inside host */
+  if (ip_napt_recv(p, iphdr, inp)) {
+    ip_addr_copy_from_ip4(ip_data.current_iphdr_dest, iphdr->dest);
+    ip4_forward(p, iphdr, inp);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+#endif /* IP_NAPT */
+
 #if IP_OPTIONS_ALLOWED == 0 /* no support for IP options in the IP header? */
 
 #if LWIP_IGMP
@@ -0,0 +1,542 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * IPv4 network address and port translation (NAPT) between interfaces,
+ * e.g. to give the clients of the soft-AP access to the network the
+ * station is connected to.
+ *
+ * Packets forwarded from an interface with NAPT enabled get the address of
+ * the interface they leave on as source, and a port (ICMP echo identifier)
+ * of the range IP_NAPT_PORT_RANGE_START..IP_NAPT_PORT_RANGE_END. Packets
+ * received for such a port are translated back and forwarded to the host
+ * which opened the connection. Only TCP, UDP and ICMP echo are translated;
+ * other packets, and fragments, aren't forwarded from NAPT interfaces.
+ *
+ * Connections are kept in a table of IP_NAPT_MAX entries, with two hash
+ * tables on it: one on the inside address and ports, for packets going
+ * out, one on the mapped port, for packets coming back. The entries are
+ * also on a list in order of last use, the least recently used entry is
+ * reused for a new connection when the table is full. Entries time out
+ * after IP_NAPT_TIMEOUT_MS_xxx without traffic.
+ *
+ * Everything runs in the tcpip thread, from ip4_input.
+ */
+
+#include "lwip/opt.h"
+
+#if IP_NAPT
+
+#include "lwip/ip4_napt.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/sys.h"
+#include "lwip/icmp.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcp_priv.h"
+
+#include <string.h>
+
+#if !IP_FORWARD
+#error "IP_NAPT needs IP_FORWARD"
+#endif
+
+#define IP_NAPT_HASH_SIZE   IP_NAPT_MAX
+#define IP_NAPT_PORT_NUM    (IP_NAPT_PORT_RANGE_END - IP_NAPT_PORT_RANGE_START + 1)
+
+#if IP_NAPT_PORT_NUM < IP_NAPT_MAX
+#error "IP_NAPT_PORT_RANGE_START..IP_NAPT_PORT_RANGE_END must have a port for each IP_NAPT_MAX entry"
+#endif
+
+/* TCP connection state of an entry */
+#define IP_NAPT_FIN_OUT     0x01U
+#define IP_NAPT_FIN_IN      0x02U
+#define IP_NAPT_RST         0x04U
+
+struct ip_napt_entry {
+  u32_t last;       /* sys_now() of the last packet */
+  ip4_addr_t src;   /* inside host */
+  ip4_addr_t dest;  /* remote host */
+  u16_t sport;      /* port (or ICMP echo identifier) of the inside host */
+  u16_t dport;      /* port of the remote host, 0 for ICMP */
+  u16_t mport;      /* port used on the outside interface */
+  u8_t proto;       /* 0 if the entry is free */
+  u8_t state;       /* IP_NAPT_FIN_OUT... for TCP */
+  s16_t out_next;   /* next entry in the ip_napt_out_hash bucket */
+  s16_t in_next;    /* next entry in the ip_napt_in_hash bucket */
+  s16_t lru_prev;   /* more recently used entry */
+  s16_t lru_next;   /* less recently used entry, or next free entry */
+};
+
+static struct ip_napt_entry ip_napt_table[IP_NAPT_MAX];
+static s16_t ip_napt_out_hash[IP_NAPT_HASH_SIZE];
+static s16_t ip_napt_in_hash[IP_NAPT_HASH_SIZE];
+static s16_t ip_napt_lru_head = -1;
+static s16_t ip_napt_lru_tail = -1;
+static s16_t ip_napt_free = -1;
+static u16_t ip_napt_next_port = IP_NAPT_PORT_RANGE_START;
+static u8_t ip_napt_inited;
+
+/** Adjust a checksum over a 16-bit word which changes from old_val to
+ * new_val (RFC 1624). Works on values in network or host byte order, as
+ * long as the checksum is in the same one. */
+static u16_t
+ip_napt_chksum_adjust(u16_t chksum, u16_t old_val, u16_t new_val)
+{
+  u32_t sum = (u32_t)(u16_t)~chksum + (u16_t)~old_val + new_val;
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+  return (u16_t)~sum;
+}
+
+static u16_t
+ip_napt_chksum_adjust32(u16_t chksum, u32_t old_val, u32_t new_val)
+{
+  chksum = ip_napt_chksum_adjust(chksum, (u16_t)old_val, (u16_t)new_val);
+  return ip_napt_chksum_adjust(chksum, (u16_t)(old_val >> 16), (u16_t)(new_val >> 16));
+}
+
+static u16_t
+ip_napt_out_bucket(u32_t src, u16_t sport, u32_t dest, u16_t dport, u8_t proto)
+{
+  u32_t h = src ^ (dest * 2654435761UL) ^ ((u32_t)sport << 16 | dport) ^ proto;
+  h ^= h >> 15;
+  h *= 2246822519UL;
+  h ^= h >> 13;
+  return (u16_t)(h % IP_NAPT_HASH_SIZE);
+}
+
+static u16_t
+ip_napt_in_bucket(u16_t mport, u8_t proto)
+{
+  return (u16_t)(((u32_t)mport * 31 + proto) % IP_NAPT_HASH_SIZE);
+}
+
+static void
+ip_napt_init(void)
+{
+  s16_t i;
+
+  for (i = 0; i < IP_NAPT_HASH_SIZE; i++) {
+    ip_napt_out_hash[i] = -1;
+    ip_napt_in_hash[i] = -1;
+  }
+  memset(ip_napt_table, 0, sizeof(ip_napt_table));
+  for (i = 0; i < IP_NAPT_MAX; i++) {
+    ip_napt_table[i].lru_next = (i + 1 < IP_NAPT_MAX) ? i + 1 : -1;
+  }
+  ip_napt_free = 0;
+  ip_napt_lru_head = ip_napt_lru_tail = -1;
+  ip_napt_inited = 1;
+}
+
+static u8_t
+ip_napt_expired(const struct ip_napt_entry *e, u32_t now)
+{
+  u32_t timeout;
+
+  switch (e->proto) {
+  case IP_PROTO_TCP:
+    if ((e->state & IP_NAPT_RST) ||
+        ((e->state & (IP_NAPT_FIN_OUT | IP_NAPT_FIN_IN)) == (IP_NAPT_FIN_OUT | IP_NAPT_FIN_IN))) {
+      timeout = IP_NAPT_TIMEOUT_MS_TCP_DISCON;
+    } else {
+      timeout = IP_NAPT_TIMEOUT_MS_TCP;
+    }
+    break;
+  case IP_PROTO_UDP:
+    timeout = IP_NAPT_TIMEOUT_MS_UDP;
+    break;
+  default:
+    timeout = IP_NAPT_TIMEOUT_MS_ICMP;
+    break;
+  }
+  return (u32_t)(now - e->last) >= timeout;
+}
+
+static void
+ip_napt_lru_unlink(s16_t idx)
+{
+  struct ip_napt_entry *e = &ip_napt_table[idx];
+
+  if (e->lru_prev >= 0) {
+    ip_napt_table[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    ip_napt_lru_head = e->lru_next;
+  }
+  if (e->lru_next >= 0) {
+    ip_napt_table[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    ip_napt_lru_tail = e->lru_prev;
+  }
+}
+
+/* Mark an entry as used now: move it to the head of the LRU list */
+static void
+ip_napt_touch(s16_t idx, u32_t now)
+{
+  struct ip_napt_entry *e = &ip_napt_table[idx];
+
+  e->last = now;
+  if (ip_napt_lru_head == idx) {
+    return;
+  }
+  ip_napt_lru_unlink(idx);
+  e->lru_prev = -1;
+  e->lru_next = ip_napt_lru_head;
+  if (ip_napt_lru_head >= 0) {
+    ip_napt_table[ip_napt_lru_head].lru_prev = idx;
+  } else {
+    ip_napt_lru_tail = idx;
+  }
+  ip_napt_lru_head = idx;
+}
+
+static void
+ip_napt_remove(s16_t idx)
+{
+  struct ip_napt_entry *e = &ip_napt_table[idx];
+  s16_t *pnext;
+
+  pnext = &ip_napt_out_hash[ip_napt_out_bucket(ip4_addr_get_u32(&e->src), e->sport,
+                                               ip4_addr_get_u32(&e->dest), e->dport, e->proto)];
+  while (*pnext != idx) {
+    pnext = &ip_napt_table[*pnext].out_next;
+  }
+  *pnext = e->out_next;
+
+  pnext = &ip_napt_in_hash[ip_napt_in_bucket(e->mport, e->proto)];
+  while (*pnext != idx) {
+    pnext = &ip_napt_table[*pnext].in_next;
+  }
+  *pnext = e->in_next;
+
+  ip_napt_lru_unlink(idx);
+  e->proto = 0;
+  e->lru_next = ip_napt_free;
+  ip_napt_free = idx;
+}
+
+static s16_t
+ip_napt_find_out(const struct ip_hdr *iphdr, u16_t sport, u16_t dport, u8_t proto)
+{
+  s16_t idx = ip_napt_out_hash[ip_napt_out_bucket(ip4_addr_get_u32(&iphdr->src), sport,
+                                                  ip4_addr_get_u32(&iphdr->dest), dport, proto)];
+
+  for (; idx >= 0; idx = ip_napt_table[idx].out_next) {
+    const struct ip_napt_entry *e = &ip_napt_table[idx];
+    if ((e->sport == sport) && (e->dport == dport) && (e->proto == proto) &&
+        ip4_addr_cmp(&e->src, &iphdr->src) && ip4_addr_cmp(&e->dest, &iphdr->dest)) {
+      break;
+    }
+  }
+  return idx;
+}
+
+static s16_t
+ip_napt_find_in(u16_t mport, u8_t proto)
+{
+  s16_t idx = ip_napt_in_hash[ip_napt_in_bucket(mport, proto)];
+
+  for (; idx >= 0; idx = ip_napt_table[idx].in_next) {
+    if ((ip_napt_table[idx].mport == mport) && (ip_napt_table[idx].proto == proto)) {
+      break;
+    }
+  }
+  return idx;
+}
+
+/* Pick the next port of the range which no live entry of proto uses. There
+ * are at least as many ports as entries, so one is found before the range
+ * is through. */
+static u16_t
+ip_napt_alloc_port(u8_t proto, u32_t now)
+{
+  u16_t i;
+
+  for (i = 0; i < IP_NAPT_PORT_NUM; i++) {
+    u16_t port = ip_napt_next_port;
+    s16_t idx;
+
+    ip_napt_next_port = (port == IP_NAPT_PORT_RANGE_END) ? IP_NAPT_PORT_RANGE_START : port + 1;
+    idx = ip_napt_find_in(htons(port), proto);
+    if (idx < 0) {
+      return htons(port);
+    }
+    if (ip_napt_expired(&ip_napt_table[idx], now)) {
+      ip_napt_remove(idx);
+      return htons(port);
+    }
+  }
+  return 0;
+}
+
+static s16_t
+ip_napt_add(const struct ip_hdr *iphdr, u16_t sport, u16_t dport, u8_t proto, u32_t now)
+{
+  struct ip_napt_entry *e;
+  u16_t bucket;
+  u16_t mport;
+  s16_t idx;
+
+  if (ip_napt_free < 0) {
+    /* table full, reuse the least recently used connection */
+    ip_napt_remove(ip_napt_lru_tail);
+  }
+  idx = ip_napt_free;
+  e = &ip_napt_table[idx];
+  ip_napt_free = e->lru_next;
+
+  mport = ip_napt_alloc_port(proto, now);
+  if (mport == 0) {
+    e->lru_next = ip_napt_free;
+    ip_napt_free = idx;
+    return -1;
+  }
+
+  ip4_addr_copy(e->src, iphdr->src);
+  ip4_addr_copy(e->dest, iphdr->dest);
+  e->sport = sport;
+  e->dport = dport;
+  e->mport = mport;
+  e->proto = proto;
+  e->state = 0;
+
+  bucket = ip_napt_out_bucket(ip4_addr_get_u32(&e->src), sport, ip4_addr_get_u32(&e->dest), dport, proto);
+  e->out_next = ip_napt_out_hash[bucket];
+  ip_napt_out_hash[bucket] = idx;
+  bucket = ip_napt_in_bucket(mport, proto);
+  e->in_next = ip_napt_in_hash[bucket];
+  ip_napt_in_hash[bucket] = idx;
+
+  /* link at the tail, ip_napt_touch moves it to the head */
+  e->lru_next = -1;
+  e->lru_prev = ip_napt_lru_tail;
+  if (ip_napt_lru_tail >= 0) {
+    ip_napt_table[ip_napt_lru_tail].lru_next = idx;
+  } else {
+    ip_napt_lru_head = idx;
+  }
+  ip_napt_lru_tail = idx;
+  ip_napt_touch(idx, now);
+  return idx;
+}
+
+void
+ip_napt_enable_netif(struct netif *netif, u8_t enable)
+{
+  LWIP_ASSERT("netif != NULL", netif != NULL);
+
+  if (enable && !ip_napt_inited) {
+    ip_napt_init();
+  }
+  netif->napt = enable ? 1 : 0;
+}
+
+/**
+ * Translate a packet received for the address of inp back to the inside
+ * host of its connection. The caller forwards it if it was translated.
+ *
+ * @return 1 if the packet belongs to a translated connection
+ */
+u8_t
+ip_napt_recv(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
+{
+  u16_t hlen = IPH_HL(iphdr) * 4;
+  u8_t *l4 = (u8_t *)iphdr + hlen;
+  u8_t proto = IPH_PROTO(iphdr);
+  u16_t *pchksum;
+  u16_t *pport;
+  u16_t dport;
+  s16_t idx;
+  struct ip_napt_entry *e;
+  u32_t now;
+
+  if (!ip_napt_inited || inp->napt || !ip4_addr_cmp(&iphdr->dest, netif_ip4_addr(inp))) {
+    return 0;
+  }
+
+  switch (proto) {
+  case IP_PROTO_TCP:
+    if (p->len < hlen + TCP_HLEN) {
+      return 0;
+    }
+    pport = &((struct tcp_hdr *)l4)->dest;
+    dport = ((struct tcp_hdr *)l4)->src;
+    pchksum = &((struct tcp_hdr *)l4)->chksum;
+    break;
+  case IP_PROTO_UDP:
+    if (p->len < hlen + UDP_HLEN) {
+      return 0;
+    }
+    pport = &((struct udp_hdr *)l4)->dest;
+    dport = ((struct udp_hdr *)l4)->src;
+    pchksum = &((struct udp_hdr *)l4)->chksum;
+    break;
+  case IP_PROTO_ICMP:
+    if ((p->len < hlen + sizeof(struct icmp_echo_hdr)) ||
+        (ICMPH_TYPE((struct icmp_echo_hdr *)l4) != ICMP_ER)) {
+      return 0;
+    }
+    pport = &((struct icmp_echo_hdr *)l4)->id;
+    dport = 0;
+    pchksum = &((struct icmp_echo_hdr *)l4)->chksum;
+    break;
+  default:
+    return 0;
+  }
+
+  if ((ntohs(*pport) < IP_NAPT_PORT_RANGE_START) || (ntohs(*pport) > IP_NAPT_PORT_RANGE_END)) {
+    return 0;
+  }
+  idx = ip_napt_find_in(*pport, proto);
+  if (idx < 0) {
+    return 0;
+  }
+  e = &ip_napt_table[idx];
+  now = sys_now();
+  if ((e->dport != dport) || !ip4_addr_cmp(&e->dest, &iphdr->src) || ip_napt_expired(e, now)) {
+    return 0;
+  }
+
+  if (proto == IP_PROTO_TCP) {
+    u16_t flags = TCPH_FLAGS((struct tcp_hdr *)l4);
+    if (flags & TCP_RST) {
+      e->state |= IP_NAPT_RST;
+    }
+    if (flags & TCP_FIN) {
+      e->state |= IP_NAPT_FIN_IN;
+    }
+  }
+  ip_napt_touch(idx, now);
+
+  /* the ICMP checksum doesn't cover the IP addresses, and a UDP checksum of 0 means none */
+  if ((proto != IP_PROTO_UDP) || (*pchksum != 0)) {
+    if (proto != IP_PROTO_ICMP) {
+      *pchksum = ip_napt_chksum_adjust32(*pchksum, ip4_addr_get_u32(&iphdr->dest), ip4_addr_get_u32(&e->src));
+    }
+    *pchksum = ip_napt_chksum_adjust(*pchksum, *pport, e->sport);
+    if ((proto == IP_PROTO_UDP) && (*pchksum == 0)) {
+      *pchksum = 0xffff;
+    }
+  }
+  *pport = e->sport;
+  IPH_CHKSUM_SET(iphdr, ip_napt_chksum_adjust32(IPH_CHKSUM(iphdr), ip4_addr_get_u32(&iphdr->dest), ip4_addr_get_u32(&e->src)));
+  ip4_addr_copy(iphdr->dest, e->src);
+  return 1;
+}
+
+/**
+ * Translate a packet forwarded from inp to outp, if NAPT is enabled on
+ * inp and not on outp.
+ *
+ * @return ERR_OK if the packet can be sent, an error if it has to be dropped
+ */
+err_t
+ip_napt_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp, struct netif *outp)
+{
+  u16_t hlen = IPH_HL(iphdr) * 4;
+  u8_t *l4 = (u8_t *)iphdr + hlen;
+  u8_t proto = IPH_PROTO(iphdr);
+  u16_t *pchksum;
+  u16_t *pport;
+  u16_t dport;
+  s16_t idx;
+  struct ip_napt_entry *e;
+  u32_t now;
+
+  if (!inp->napt || outp->napt) {
+    return ERR_OK;
+  }
+  if (ip4_addr_isany_val(*netif_ip4_addr(outp)) ||
+      ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0)) {
+    return ERR_RTE;
+  }
+
+  switch (proto) {
+  case IP_PROTO_TCP:
+    if (p->len < hlen + TCP_HLEN) {
+      return ERR_VAL;
+    }
+    pport = &((struct tcp_hdr *)l4)->src;
+    dport = ((struct tcp_hdr *)l4)->dest;
+    pchksum = &((struct tcp_hdr *)l4)->chksum;
+    break;
+  case IP_PROTO_UDP:
+    if (p->len < hlen + UDP_HLEN) {
+      return ERR_VAL;
+    }
+    pport = &((struct udp_hdr *)l4)->src;
+    dport = ((struct udp_hdr *)l4)->dest;
+    pchksum = &((struct udp_hdr *)l4)->chksum;
+    break;
+  case IP_PROTO_ICMP:
+    if ((p->len < hlen + sizeof(struct icmp_echo_hdr)) ||
+        (ICMPH_TYPE((struct icmp_echo_hdr *)l4) != ICMP_ECHO)) {
+      return ERR_VAL;
+    }
+    pport = &((struct icmp_echo_hdr *)l4)->id;
+    dport = 0;
+    pchksum = &((struct icmp_echo_hdr *)l4)->chksum;
+    break;
+  default:
+    return ERR_VAL;
+  }
+
+  now = sys_now();
+  idx = ip_napt_find_out(iphdr, *pport, dport, proto);
+  if ((idx >= 0) && ip_napt_expired(&ip_napt_table[idx], now)) {
+    ip_napt_remove(idx);
+    idx = -1;
+  }
+  if (idx < 0) {
+    /* only a SYN opens a TCP connection */
+    if ((proto == IP_PROTO_TCP) &&
+        ((TCPH_FLAGS((struct tcp_hdr *)l4) & (TCP_SYN | TCP_ACK)) != TCP_SYN)) {
+      return ERR_VAL;
+    }
+    idx = ip_napt_add(iphdr, *pport, dport, proto, now);
+    if (idx < 0) {
+      return ERR_MEM;
+    }
+  }
+  e = &ip_napt_table[idx];
+
+  if (proto == IP_PROTO_TCP) {
+    u16_t flags = TCPH_FLAGS((struct tcp_hdr *)l4);
+    if (flags & TCP_RST) {
+      e->state |= IP_NAPT_RST;
+    }
+    if (flags & TCP_FIN) {
+      e->state |= IP_NAPT_FIN_OUT;
+    }
+  }
+  ip_napt_touch(idx, now);
+
+  if ((proto != IP_PROTO_UDP) || (*pchksum != 0)) {
+    if (proto != IP_PROTO_ICMP) {
+      *pchksum = ip_napt_chksum_adjust32(*pchksum, ip4_addr_get_u32(&iphdr->src), ip4_addr_get_u32(netif_ip4_addr(outp)));
+    }
+    *pchksum = ip_napt_chksum_adjust(*pchksum, *pport, e->mport);
+    if ((proto == IP_PROTO_UDP) && (*pchksum == 0)) {
+      *pchksum = 0xffff;
+    }
+  }
+  *pport = e->mport;
+  IPH_CHKSUM_SET(iphdr, ip_napt_chksum_adjust32(IPH_CHKSUM(iphdr), ip4_addr_get_u32(&iphdr->src), ip4_addr_get_u32(netif_ip4_addr(outp))));
+  ip4_addr_copy(iphdr->src, *netif_ip4_addr(outp));
+  return ERR_OK;
+}
+
+#endif /* IP_NAPT */
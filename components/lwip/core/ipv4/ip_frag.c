@@ -152,6 +152,43 @@ ip_reass_tmr(void)
    }
 }
 
+/**
+ * Check if any datagrams are waiting for fragments, i.e. if the
+ * reassembly timer is still needed.
+ *
+ * @return 1 if datagrams are queued, 0 otherwise
+ */
+u8_t
+ip_reass_pending(void)
+{
+  return reassdatagrams != NULL;
+}
+
+#if IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS
+/**
+ * Count the pbufs enqueued for all datagrams sent by the source of 'fraghdr'.
+ *
+ * @param fraghdr IP header of the current fragment
+ * @return the number of pbufs enqueued from the same source address
+ */
+static u16_t
+ip_reass_src_pbufcount(struct ip_hdr *fraghdr)
+{
+  struct ip_reassdata *r;
+  struct pbuf *p;
+  u16_t count = 0;
+
+  for (r = reassdatagrams; r != NULL; r = r->next) {
+    if (ip4_addr_cmp(&r->iphdr.src, &fraghdr->src)) {
+      for (p = r->p; p != NULL; p = ((struct ip_reass_helper *)p->payload)->next_pbuf) {
+        count += pbuf_clen(p);
+      }
+    }
+  }
+  return count;
+}
+#endif /* IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS */
+
 /**
  * Free a datagram (struct ip_reassdata) and all its pbufs.
  * Updates the total count of enqueued pbufs (ip_reass_pbufcount),
@@ -304,6 +341,8 @@ ip_reass_enqueue_new_datagram(struct ip_hdr *fraghdr, int clen)
   /* enqueue the new structure to the front of the list */
   ipr->next = reassdatagrams;
   reassdatagrams = ipr;
+  /* the timer only runs while datagrams are queued */
+  ip_reass_timer_needed();
   /* copy the ip header for later tests and input */
   /* @todo: no ip options supported? */
   SMEMCPY(&(ipr->iphdr), fraghdr, IP_HLEN);
@@ -509,8 +548,19 @@ ip4_reass(struct pbuf *p)
   offset = (ntohs(IPH_OFFSET(fraghdr)) & IP_OFFMASK) * 8;
   len = ntohs(IPH_LEN(fraghdr)) - IPH_HL(fraghdr) * 4;
 
-  /* Check if we are allowed to enqueue more datagrams. */
   clen = pbuf_clen(p);
+#if IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS
+  /* Don't let a single host fill the queue (checked first so that other
+     hosts' datagrams aren't freed for a fragment that is dropped anyway). */
+  if ((ip_reass_src_pbufcount(fraghdr) + clen) > IP_REASS_MAX_PBUFS_PER_SRC) {
+    LWIP_DEBUGF(IP_REASS_DEBUG,("ip4_reass: Per-source overflow: clen=%d, MAX=%d\n",
+      clen, IP_REASS_MAX_PBUFS_PER_SRC));
+    IPFRAG_STATS_INC(ip_frag.memerr);
+    goto nullreturn;
+  }
+#endif /* IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS */
+
+  /* Check if we are allowed to enqueue more datagrams. */
   if ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) {
 #if IP_REASS_FREE_OLDEST
     if (!ip_reass_remove_oldest_datagram(fraghdr, clen) ||
@@ -77,6 +77,10 @@ static const char mem_debug_file[] ICACHE_RODATA_ATTR STORE_ATTR = __FILE__;
 
 /* The list of joined groups. */
 static struct mld_group* mld_group_list;
+#if MLD6_GROUP_HASH_SIZE
+/* The groups of mld_group_list by their address, chained through hash_next */
+static struct mld_group* mld_group_hash[MLD6_GROUP_HASH_SIZE];
+#endif /* MLD6_GROUP_HASH_SIZE */
 
 
 /* Forward declarations. */
@@ -84,6 +88,9 @@ static struct mld_group * mld6_new_group(struct netif *ifp, const ip6_addr_t *ad
 static err_t mld6_free_group(struct mld_group *group);
 static void mld6_delayed_report(struct mld_group *group, u16_t maxresp);
 static void mld6_send(struct mld_group *group, u8_t type);
+#if MLD6_GROUP_HASH_SIZE
+static void mld6_group_hash_remove(struct mld_group *group);
+#endif /* MLD6_GROUP_HASH_SIZE */
 
 
 /**
@@ -115,6 +122,9 @@ mld6_stop(struct netif *netif)
       if (netif->mld_mac_filter != NULL) {
         netif->mld_mac_filter(netif, &(group->group_address), MLD6_DEL_MAC_FILTER);
       }
+#if MLD6_GROUP_HASH_SIZE
+      mld6_group_hash_remove(group);
+#endif /* MLD6_GROUP_HASH_SIZE */
       /* free group */
       memp_free(MEMP_MLD6_GROUP, group);
     } else {
@@ -145,6 +155,35 @@ mld6_report_groups(struct netif *netif)
   }
 }
 
+#if MLD6_GROUP_HASH_SIZE
+/**
+ * The bucket of mld_group_hash for a group address
+ */
+static struct mld_group **
+mld6_group_chain(const ip6_addr_t *addr)
+{
+  u32_t h = addr->addr[0] ^ addr->addr[3];
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return &mld_group_hash[(h & 0xff) % MLD6_GROUP_HASH_SIZE];
+}
+
+/**
+ * Unlink a group from its bucket of mld_group_hash
+ */
+static void
+mld6_group_hash_remove(struct mld_group *group)
+{
+  struct mld_group **link;
+  for (link = mld6_group_chain(&group->group_address); *link != NULL; link = &(*link)->hash_next) {
+    if (*link == group) {
+      *link = group->hash_next;
+      break;
+    }
+  }
+}
+#endif /* MLD6_GROUP_HASH_SIZE */
+
 /**
  * Search for a group that is joined on a netif
  *
@@ -156,6 +195,16 @@ mld6_report_groups(struct netif *netif)
 struct mld_group *
 mld6_lookfor_group(struct netif *ifp, const ip6_addr_t *addr)
 {
+#if MLD6_GROUP_HASH_SIZE
+  struct mld_group *group = *mld6_group_chain(addr);
+
+  while (group != NULL) {
+    if ((group->netif == ifp) && (ip6_addr_cmp(&(group->group_address), addr))) {
+      return group;
+    }
+    group = group->hash_next;
+  }
+#else /* MLD6_GROUP_HASH_SIZE */
   struct mld_group *group = mld_group_list;
 
   while (group != NULL) {
@@ -164,6 +213,7 @@ mld6_lookfor_group(struct netif *ifp, const ip6_addr_t *addr)
     }
     group = group->next;
   }
+#endif /* MLD6_GROUP_HASH_SIZE */
 
   return NULL;
 }
@@ -193,6 +243,10 @@ mld6_new_group(struct netif *ifp, const ip6_addr_t *addr)
     group->next               = mld_group_list;
 
     mld_group_list = group;
+#if MLD6_GROUP_HASH_SIZE
+    group->hash_next = *mld6_group_chain(addr);
+    *mld6_group_chain(addr) = group;
+#endif /* MLD6_GROUP_HASH_SIZE */
   }
 
   return group;
@@ -226,6 +280,9 @@ mld6_free_group(struct mld_group *group)
       err = ERR_ARG;
     }
   }
+#if MLD6_GROUP_HASH_SIZE
+  mld6_group_hash_remove(group);
+#endif /* MLD6_GROUP_HASH_SIZE */
   /* free group */
   memp_free(MEMP_MLD6_GROUP, group);
 
@@ -489,6 +546,25 @@ mld6_tmr(void)
   }
 }
 
+/**
+ * Check whether a group has a report scheduled, for which mld6_tmr has to
+ * be called.
+ *
+ * @return 1 if a group timer is running, 0 otherwise
+ */
+u8_t
+mld6_pending(void)
+{
+  struct mld_group *group;
+
+  for (group = mld_group_list; group != NULL; group = group->next) {
+    if (group->timer > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /**
  * Schedule a delayed membership report for a group
  *
@@ -519,6 +595,7 @@ mld6_delayed_report(struct mld_group *group, u16_t maxresp)
       ((group->timer == 0) || (maxresp < group->timer)))) {
     group->timer = maxresp;
     group->group_state = MLD6_GROUP_DELAYING_MEMBER;
+    mld6_timer_needed();
   }
 }
 
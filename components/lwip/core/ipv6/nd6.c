@@ -79,6 +79,17 @@ u32_t retrans_timer = LWIP_ND6_RETRANS_TIMER; /* TODO implement this value in ti
 static u8_t nd6_cached_neighbor_index;
 static u8_t nd6_cached_destination_index;
 
+#if LWIP_ND6_NEIGHBOR_HASH_SIZE
+/* Chains of the neighbor cache entries, hashed by next hop address. Both
+ * hold index + 1 of an entry, 0 ends a chain. */
+static u8_t nd6_neighbor_hash[LWIP_ND6_NEIGHBOR_HASH_SIZE];
+static u8_t nd6_neighbor_hash_next[LWIP_ND6_NUM_NEIGHBORS];
+#endif /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
+
+#if LWIP_ND6_NUM_NEIGHBORS > 0x7f
+#error "LWIP_ND6_NUM_NEIGHBORS must fit in an s8_t, you have to reduce it in your lwipopts.h"
+#endif
+
 /* Multicast address holder. */
 static ip6_addr_t multicast_address;
 
@@ -88,6 +99,7 @@ static u8_t nd6_ra_buffer[sizeof(struct prefix_option)];
 /* Forward declarations. */
 static s8_t nd6_find_neighbor_cache_entry(const ip6_addr_t * ip6addr);
 static s8_t nd6_new_neighbor_cache_entry(void);
+static void nd6_set_neighbor_address(s8_t i, const ip6_addr_t * ip6addr);
 static void nd6_free_neighbor_cache_entry(s8_t i);
 static s8_t nd6_find_destination_cache_entry(const ip6_addr_t * ip6addr);
 static s8_t nd6_new_destination_cache_entry(void);
@@ -359,7 +371,7 @@ nd6_input(struct pbuf *p, struct netif *inp)
         }
         neighbor_cache[i].netif = inp;
         MEMCPY(neighbor_cache[i].lladdr, lladdr_opt->addr, inp->hwaddr_len);
-        ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6_current_src_addr());
+        nd6_set_neighbor_address(i, ip6_current_src_addr());
 
         /* Receiving a message does not prove reachability: only in one direction.
          * Delay probe in case we get confirmation of reachability from upper layer (TCP). */
@@ -571,7 +583,7 @@ nd6_input(struct pbuf *p, struct netif *inp)
           if (i >= 0) {
             neighbor_cache[i].netif = inp;
             MEMCPY(neighbor_cache[i].lladdr, lladdr_opt->addr, inp->hwaddr_len);
-            ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6_current_src_addr());
+            nd6_set_neighbor_address(i, ip6_current_src_addr());
 
             /* Receiving a message does not prove reachability: only in one direction.
              * Delay probe in case we get confirmation of reachability from upper layer (TCP). */
@@ -1042,6 +1054,33 @@ nd6_send_rs(struct netif * netif)
 }
 #endif /* LWIP_IPV6_SEND_ROUTER_SOLICIT */
 
+#if LWIP_ND6_NEIGHBOR_HASH_SIZE
+static u8_t *
+nd6_neighbor_chain(const ip6_addr_t * ip6addr)
+{
+  /* the interface identifier differs between neighbors */
+  u32_t h = ip6addr->addr[2] ^ ip6addr->addr[3];
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return &nd6_neighbor_hash[h % LWIP_ND6_NEIGHBOR_HASH_SIZE];
+}
+
+/* Remove entry i from the chain of its next hop address, if it is on it */
+static void
+nd6_neighbor_hash_remove(s8_t i)
+{
+  u8_t *link = nd6_neighbor_chain(&(neighbor_cache[i].next_hop_address));
+  while (*link != 0) {
+    if (*link == i + 1) {
+      *link = nd6_neighbor_hash_next[i];
+      nd6_neighbor_hash_next[i] = 0;
+      return;
+    }
+    link = &nd6_neighbor_hash_next[*link - 1];
+  }
+}
+#endif /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
+
 /**
  * Search for a neighbor cache entry
  *
@@ -1052,15 +1091,46 @@ nd6_send_rs(struct netif * netif)
 static s8_t
 nd6_find_neighbor_cache_entry(const ip6_addr_t * ip6addr)
 {
+#if LWIP_ND6_NEIGHBOR_HASH_SIZE
+  u8_t n;
+  for (n = *nd6_neighbor_chain(ip6addr); n != 0; n = nd6_neighbor_hash_next[n - 1]) {
+    if (ip6_addr_cmp(ip6addr, &(neighbor_cache[n - 1].next_hop_address))) {
+      return (s8_t)(n - 1);
+    }
+  }
+#else /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
   s8_t i;
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if (ip6_addr_cmp(ip6addr, &(neighbor_cache[i].next_hop_address))) {
       return i;
     }
   }
+#endif /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
   return -1;
 }
 
+/**
+ * Set the next hop address of a neighbor cache entry, under which
+ * nd6_find_neighbor_cache_entry finds it.
+ *
+ * @param i the neighbor cache entry index
+ * @param ip6addr the IPv6 address of the neighbor
+ */
+static void
+nd6_set_neighbor_address(s8_t i, const ip6_addr_t * ip6addr)
+{
+#if LWIP_ND6_NEIGHBOR_HASH_SIZE
+  u8_t *chain;
+  nd6_neighbor_hash_remove(i);
+#endif /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
+  ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6addr);
+#if LWIP_ND6_NEIGHBOR_HASH_SIZE
+  chain = nd6_neighbor_chain(ip6addr);
+  nd6_neighbor_hash_next[i] = *chain;
+  *chain = (u8_t)(i + 1);
+#endif /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
+}
+
 /**
  * Create a new neighbor cache entry.
  *
@@ -1198,6 +1268,9 @@ nd6_free_neighbor_cache_entry(s8_t i)
   neighbor_cache[i].isrouter = 0;
   neighbor_cache[i].netif = NULL;
   neighbor_cache[i].counter.reachable_time = 0;
+#if LWIP_ND6_NEIGHBOR_HASH_SIZE
+  nd6_neighbor_hash_remove(i);
+#endif /* LWIP_ND6_NEIGHBOR_HASH_SIZE */
   ip6_addr_set_zero(&(neighbor_cache[i].next_hop_address));
 }
 
@@ -1386,7 +1459,7 @@ nd6_new_router(const ip6_addr_t * router_addr, struct netif * netif)
       /* Could not create neighbor entry for this router. */
       return -1;
     }
-    ip6_addr_set(&(neighbor_cache[neighbor_index].next_hop_address), router_addr);
+    nd6_set_neighbor_address(neighbor_index, router_addr);
     neighbor_cache[neighbor_index].netif = netif;
     neighbor_cache[neighbor_index].q = NULL;
     neighbor_cache[neighbor_index].state = ND6_INCOMPLETE;
@@ -1546,11 +1619,13 @@ nd6_get_next_hop_entry(const ip6_addr_t * ip6addr, struct netif * netif)
   }
 #endif /* LWIP_NETIF_HWADDRHINT */
 
-  /* Look in neighbor cache for the next-hop address. */
-  if (ip6_addr_cmp(&(destination_cache[nd6_cached_destination_index].next_hop_addr),
-                   &(neighbor_cache[nd6_cached_neighbor_index].next_hop_address))) {
+  /* Look in neighbor cache for the next-hop address, starting with the
+   * last next hop of this netif. */
+  if ((netif->nd6_hint < LWIP_ND6_NUM_NEIGHBORS) &&
+      ip6_addr_cmp(&(destination_cache[nd6_cached_destination_index].next_hop_addr),
+                   &(neighbor_cache[netif->nd6_hint].next_hop_address))) {
     /* Cache hit. */
-    /* Do nothing. */
+    nd6_cached_neighbor_index = netif->nd6_hint;
     ND6_STATS_INC(nd6.cachehit);
   } else {
     i = nd6_find_neighbor_cache_entry(&(destination_cache[nd6_cached_destination_index].next_hop_addr));
@@ -1569,8 +1644,7 @@ nd6_get_next_hop_entry(const ip6_addr_t * ip6addr, struct netif * netif)
       }
 
       /* Initialize fields. */
-      ip6_addr_copy(neighbor_cache[i].next_hop_address,
-                   destination_cache[nd6_cached_destination_index].next_hop_addr);
+      nd6_set_neighbor_address(i, &(destination_cache[nd6_cached_destination_index].next_hop_addr));
       neighbor_cache[i].isrouter = 0;
       neighbor_cache[i].netif = netif;
       neighbor_cache[i].state = ND6_INCOMPLETE;
@@ -1581,6 +1655,7 @@ nd6_get_next_hop_entry(const ip6_addr_t * ip6addr, struct netif * netif)
   /* Reset this destination's age. */
   destination_cache[nd6_cached_destination_index].age = 0;
 
+  netif->nd6_hint = nd6_cached_neighbor_index;
   return nd6_cached_neighbor_index;
 }
 
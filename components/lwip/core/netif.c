@@ -215,6 +215,12 @@ netif_add(struct netif *netif,
 
   NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
   netif->flags = 0;
+#if LWIP_IPV4 && LWIP_ARP && !LWIP_NETIF_HWADDRHINT
+  netif->etharp_hint = 0;
+#endif /* LWIP_IPV4 && LWIP_ARP && !LWIP_NETIF_HWADDRHINT */
+#if LWIP_IPV6
+  netif->nd6_hint = 0;
+#endif /* LWIP_IPV6 */
   
 #if LWIP_DHCP
   /* netif not under DHCP control by default */
@@ -231,6 +237,9 @@ netif_add(struct netif *netif,
   /* netif not under AutoIP control by default */
   netif->autoip = NULL;
 #endif /* LWIP_AUTOIP */
+#if IP_NAPT
+  netif->napt = 0;
+#endif /* IP_NAPT */
 #if LWIP_IPV6_AUTOCONFIG
 
 #ifdef LWIP_ESP8266
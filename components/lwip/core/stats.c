@@ -158,6 +158,17 @@ stats_display_sys(struct stats_sys *sys)
 }
 #endif /* SYS_STATS */
 
+#if TCP_STATS
+void
+stats_display_tcp_ext(struct stats_tcp_ext *tcp_ext)
+{
+  LWIP_PLATFORM_DIAG(("\nTCP_EXT\n\t"));
+  LWIP_PLATFORM_DIAG(("rto_rexmit: %"STAT_COUNTER_F"\n\t", tcp_ext->rto_rexmit));
+  LWIP_PLATFORM_DIAG(("fast_rexmit: %"STAT_COUNTER_F"\n\t", tcp_ext->fast_rexmit));
+  LWIP_PLATFORM_DIAG(("zerownd: %"STAT_COUNTER_F"\n", tcp_ext->zerownd));
+}
+#endif /* TCP_STATS */
+
 void
 stats_display(void)
 {
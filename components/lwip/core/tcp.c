@@ -151,6 +151,13 @@ struct tcp_pcb ** const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcb
 
 u8_t tcp_active_pcbs_changed;
 
+#if TCP_PCB_HASH_SIZE
+/** Active and TIME-WAIT pcbs, hashed by remote address and both ports */
+static struct tcp_pcb *tcp_conn_hash[TCP_PCB_HASH_SIZE];
+/** Listening pcbs, indexed by the local port */
+static struct tcp_pcb_listen *tcp_listen_hash[TCP_PCB_HASH_SIZE];
+#endif /* TCP_PCB_HASH_SIZE */
+
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
@@ -204,6 +211,11 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
 {
   err_t err;
 
+#if TCP_TMR_IDLE_SLEEP
+  /* the pcb gets closing timeouts */
+  tcp_timer_needed();
+#endif /* TCP_TMR_IDLE_SLEEP */
+
   if (rst_on_unacked_data && ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
     if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND_MAX(pcb))) {
       /* Not all data received by application, send RST to tell the remote
@@ -351,6 +363,10 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
   if (shut_rx) {
     /* shut down the receive side: set a flag not to receive any more data... */
     pcb->flags |= TF_RXCLOSED;
+#if TCP_TMR_IDLE_SLEEP
+    /* a pcb in FIN-WAIT-2 now times out */
+    tcp_timer_needed();
+#endif /* TCP_TMR_IDLE_SLEEP */
     if (shut_tx) {
       /* shutting down the tx AND rx side is the same as closing for the raw API */
       return tcp_close_shutdown(pcb, 1);
@@ -824,6 +840,9 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   pcb->rcv_nxt = 0;
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
+#if LWIP_TCP_SACK
+  pcb->sack_high = pcb->lastack;
+#endif /* LWIP_TCP_SACK */
   pcb->snd_lbb = iss - 1;
   /* Start with a window that does not need scaling. When window scaling is
      enabled and used, the window is enlarged when both sides agree on scaling. */
@@ -1054,6 +1073,7 @@ tcp_slowtmr_start:
       void *err_arg;
       tcp_pcb_purge(pcb);
       /* Remove PCB from tcp_active_pcbs list. */
+      TCP_HASH_RMV(&tcp_active_pcbs, pcb);
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_active_pcbs", pcb != tcp_active_pcbs);
         prev->next = pcb->next;
@@ -1120,6 +1140,7 @@ tcp_slowtmr_start:
       struct tcp_pcb *pcb2;
       tcp_pcb_purge(pcb);
       /* Remove PCB from tcp_tw_pcbs list. */
+      TCP_HASH_RMV(&tcp_tw_pcbs, pcb);
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_tw_pcbs", pcb != tcp_tw_pcbs);
         prev->next = pcb->next;
@@ -1165,6 +1186,13 @@ tcp_fasttmr_start:
         tcp_output(pcb);
         pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
       }
+      /* send data held back by TCP_CORK or MSG_MORE for up to one period */
+      if ((pcb->flags & (TF_CORK | TF_MORE)) && (pcb->unsent != NULL)) {
+        tcpflags_t cork = pcb->flags & TF_CORK;
+        pcb->flags &= ~(TF_CORK | TF_MORE);
+        tcp_output(pcb);
+        pcb->flags |= cork;
+      }
 
       next = pcb->next;
 
@@ -1197,6 +1225,91 @@ tcp_txnow(void)
   }
 }
 
+#if TCP_TMR_IDLE_SLEEP
+/** Slow timer ticks from now until tcp_slowtmr finds (tcp_ticks - tmr) > limit */
+static u32_t
+tcp_ticks_until(u32_t tmr, u32_t limit)
+{
+  u32_t idle = tcp_ticks - tmr;
+  return (idle >= limit) ? 1 : limit - idle + 1;
+}
+
+/**
+ * Checks whether the TCP timer can skip ticks. Retransmissions, persist and
+ * delayed ACKs, queued or refused data and the states of opening and closing
+ * connections need every tick. Otherwise, the pcbs only have deadlines:
+ * the next poll, keepalive, FIN-WAIT-2 or TIME-WAIT timeout.
+ *
+ * @return 0 if some pcb needs the next tick, otherwise the number of slow
+ *         timer ticks until the first deadline (at most TCP_TMR_IDLE_MAX_TICKS)
+ */
+u32_t
+tcp_tmr_idle_ticks(void)
+{
+  struct tcp_pcb *pcb;
+  u32_t ticks = TCP_TMR_IDLE_MAX_TICKS;
+  u32_t t;
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if ((pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT && pcb->state != FIN_WAIT_2) ||
+        pcb->unsent != NULL || pcb->unacked != NULL ||
+#if TCP_QUEUE_OOSEQ
+        pcb->ooseq != NULL ||
+#endif /* TCP_QUEUE_OOSEQ */
+        pcb->refused_data != NULL || pcb->persist_backoff > 0 ||
+        (pcb->flags & (TF_ACK_DELAY | TF_ACK_NOW | TF_NAGLEMEMERR))) {
+      return 0;
+    }
+#if LWIP_CALLBACK_API
+    if (pcb->poll != NULL)
+#endif /* LWIP_CALLBACK_API */
+    {
+      t = (pcb->polltmr < pcb->pollinterval) ? (u32_t)(pcb->pollinterval - pcb->polltmr) : 1;
+      ticks = LWIP_MIN(ticks, t);
+    }
+    if (ip_get_option(pcb, SOF_KEEPALIVE) && pcb->state != FIN_WAIT_2) {
+      t = tcp_ticks_until(pcb->tmr, (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+                          / TCP_SLOW_INTERVAL);
+      ticks = LWIP_MIN(ticks, t);
+    }
+    if (pcb->state == FIN_WAIT_2 && (pcb->flags & TF_RXCLOSED)) {
+      t = tcp_ticks_until(pcb->tmr, TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL);
+      ticks = LWIP_MIN(ticks, t);
+    }
+  }
+  for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+    t = tcp_ticks_until(pcb->tmr, 2 * TCP_MSL / TCP_SLOW_INTERVAL);
+    ticks = LWIP_MIN(ticks, t);
+  }
+  return (ticks > 1) ? ticks : 0;
+}
+
+/**
+ * Accounts for slow timer ticks skipped while the TCP timer slept, before
+ * tcp_tmr is called again. The next tcp_tmr call runs tcp_slowtmr, which
+ * counts one more tick.
+ *
+ * @param ticks the number of slow timer ticks skipped
+ */
+void
+tcp_tmr_resume(u32_t ticks)
+{
+  struct tcp_pcb *pcb;
+
+  tcp_ticks += ticks;
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    /* woken up early, the poll is not due yet */
+    u32_t polltmr = pcb->polltmr + ticks;
+    if (pcb->pollinterval > 0 && polltmr >= pcb->pollinterval) {
+      polltmr = pcb->pollinterval - 1;
+    }
+    pcb->polltmr = (u8_t)LWIP_MIN(polltmr, 0xff);
+  }
+  /* make the next tcp_tmr call run tcp_slowtmr */
+  tcp_timer = 0;
+}
+#endif /* TCP_TMR_IDLE_SLEEP */
+
 /** Pass pcb->refused_data to the recv callback */
 err_t
 tcp_process_refused_data(struct tcp_pcb *pcb)
@@ -1605,6 +1718,9 @@ tcp_alloc(u8_t prio)
     pcb->snd_wl2 = iss;
     pcb->snd_nxt = iss;
     pcb->lastack = iss;
+#if LWIP_TCP_SACK
+    pcb->sack_high = iss;
+#endif /* LWIP_TCP_SACK */
     pcb->snd_lbb = iss;
     pcb->tmr = tcp_ticks;
     pcb->last_timer = tcp_timer_ctr;
@@ -1763,6 +1879,9 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
   pcb->pollinterval = interval;
+#if TCP_TMR_IDLE_SLEEP
+  tcp_timer_needed();
+#endif /* TCP_TMR_IDLE_SLEEP */
 }
 
 /**
@@ -1834,6 +1953,176 @@ tcp_pcb_purge(struct tcp_pcb *pcb)
   }
 }
 
+#if TCP_PCB_HASH_SIZE
+static u32_t
+tcp_hash_ip(const ip_addr_t *ipaddr)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(ipaddr)) {
+    const u32_t *addr = ip_2_ip6(ipaddr)->addr;
+    return addr[0] ^ addr[1] ^ addr[2] ^ addr[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  return ip4_addr_get_u32(ip_2_ip4(ipaddr));
+#else /* LWIP_IPV4 */
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/** Bucket of a connection in tcp_conn_hash. The local address is left out,
+ * as a device only has a few of them. */
+static u16_t
+tcp_conn_bucket(const ip_addr_t *remote_ip, u16_t remote_port, u16_t local_port)
+{
+  u32_t h = tcp_hash_ip(remote_ip) ^ (((u32_t)remote_port << 16) | local_port);
+  h ^= h >> 16;
+  h *= 0x45d9f3bU;
+  h ^= h >> 16;
+  return (u16_t)(h % TCP_PCB_HASH_SIZE);
+}
+
+#define tcp_listen_bucket(local_port)  ((local_port) % TCP_PCB_HASH_SIZE)
+
+/**
+ * Adds a pcb which was just put into one of the pcb lists to the hash table
+ * of that list. Only tcp_active_pcbs, tcp_tw_pcbs and tcp_listen_pcbs have
+ * one; nothing is done for the other lists.
+ *
+ * @param pcblist the list the pcb was put into
+ * @param pcb the pcb
+ */
+void
+tcp_pcb_hash_add(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if (pcblist == &tcp_listen_pcbs.pcbs) {
+    struct tcp_pcb_listen *lpcb = (struct tcp_pcb_listen *)pcb;
+    struct tcp_pcb_listen **bucket = &tcp_listen_hash[tcp_listen_bucket(lpcb->local_port)];
+    lpcb->hash_next = *bucket;
+    *bucket = lpcb;
+  } else if (pcblist == &tcp_active_pcbs || pcblist == &tcp_tw_pcbs) {
+    struct tcp_pcb **bucket = &tcp_conn_hash[tcp_conn_bucket(&pcb->remote_ip,
+                                             pcb->remote_port, pcb->local_port)];
+    pcb->hash_next = *bucket;
+    *bucket = pcb;
+  }
+}
+
+/**
+ * Removes a pcb from the hash table of the pcb list it is taken out of.
+ * Called before the pcb is unlinked from the list, while its addresses
+ * and ports are still those it was added with.
+ *
+ * @param pcblist the list the pcb is taken out of
+ * @param pcb the pcb
+ */
+void
+tcp_pcb_hash_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if (pcblist == &tcp_listen_pcbs.pcbs) {
+    struct tcp_pcb_listen *lpcb = (struct tcp_pcb_listen *)pcb;
+    struct tcp_pcb_listen **link = &tcp_listen_hash[tcp_listen_bucket(lpcb->local_port)];
+    while (*link != NULL && *link != lpcb) {
+      link = &(*link)->hash_next;
+    }
+    LWIP_ASSERT("tcp_pcb_hash_remove: listen pcb not in its bucket", *link == lpcb);
+    if (*link != NULL) {
+      *link = lpcb->hash_next;
+    }
+    lpcb->hash_next = NULL;
+  } else if (pcblist == &tcp_active_pcbs || pcblist == &tcp_tw_pcbs) {
+    struct tcp_pcb **link = &tcp_conn_hash[tcp_conn_bucket(&pcb->remote_ip,
+                                           pcb->remote_port, pcb->local_port)];
+    while (*link != NULL && *link != pcb) {
+      link = &(*link)->hash_next;
+    }
+    LWIP_ASSERT("tcp_pcb_hash_remove: pcb not in its bucket", *link == pcb);
+    if (*link != NULL) {
+      *link = pcb->hash_next;
+    }
+    pcb->hash_next = NULL;
+  }
+}
+
+/**
+ * Finds the active or TIME-WAIT pcb of a connection, as tcp_input searched
+ * tcp_active_pcbs and then tcp_tw_pcbs for it.
+ *
+ * @return the pcb (in TIME_WAIT state if it is in tcp_tw_pcbs), or NULL
+ */
+struct tcp_pcb *
+tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  struct tcp_pcb *pcb;
+  struct tcp_pcb *tw_pcb = NULL;
+
+  for (pcb = tcp_conn_hash[tcp_conn_bucket(remote_ip, remote_port, local_port)];
+       pcb != NULL; pcb = pcb->hash_next) {
+    LWIP_ASSERT("tcp_pcb_hash_lookup: pcb->state != CLOSED", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_pcb_hash_lookup: pcb->state != LISTEN", pcb->state != LISTEN);
+    if (pcb->remote_port == remote_port &&
+        pcb->local_port == local_port &&
+        ip_addr_cmp(&pcb->remote_ip, remote_ip) &&
+        ip_addr_cmp(&pcb->local_ip, local_ip)) {
+      if (pcb->state != TIME_WAIT) {
+        return pcb;
+      }
+      if (tw_pcb == NULL) {
+        tw_pcb = pcb;
+      }
+    }
+  }
+  return tw_pcb;
+}
+
+/**
+ * Finds the listening pcb for a connection to local_ip:local_port. As in
+ * the search of tcp_listen_pcbs, a pcb listening on local_ip is preferred
+ * to one listening on any address if SO_REUSE is enabled.
+ *
+ * @return the listening pcb, or NULL
+ */
+struct tcp_pcb_listen *
+tcp_pcb_hash_lookup_listen(const ip_addr_t *local_ip, u16_t local_port)
+{
+  struct tcp_pcb_listen *lpcb;
+#if SO_REUSE
+  struct tcp_pcb_listen *lpcb_any = NULL;
+#endif /* SO_REUSE */
+
+  for (lpcb = tcp_listen_hash[tcp_listen_bucket(local_port)]; lpcb != NULL; lpcb = lpcb->hash_next) {
+    if (lpcb->local_port == local_port) {
+      if (IP_IS_ANY_TYPE_VAL(lpcb->local_ip)) {
+        /* found an ANY TYPE (IPv4/IPv6) match */
+#if SO_REUSE
+        lpcb_any = lpcb;
+#else /* SO_REUSE */
+        return lpcb;
+#endif /* SO_REUSE */
+      } else if (IP_ADDR_PCB_VERSION_MATCH_EXACT(lpcb, local_ip)) {
+        if (ip_addr_cmp(&lpcb->local_ip, local_ip)) {
+          /* found an exact match */
+          return lpcb;
+        } else if (ip_addr_isany(&lpcb->local_ip)) {
+          /* found an ANY-match */
+#if SO_REUSE
+          lpcb_any = lpcb;
+#else /* SO_REUSE */
+          return lpcb;
+#endif /* SO_REUSE */
+        }
+      }
+    }
+  }
+#if SO_REUSE
+  return lpcb_any;
+#else /* SO_REUSE */
+  return NULL;
+#endif /* SO_REUSE */
+}
+#endif /* TCP_PCB_HASH_SIZE */
+
 /**
  * Purges the PCB and removes it from a PCB list. Any delayed ACKs are sent first.
  *
@@ -86,6 +86,12 @@ static u16_t tcplen;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_SACK
+/* Edges of the blocks of the SACK option of the incoming segment */
+static u32_t tcp_sack_blocks[2 * LWIP_TCP_MAX_SACK_NUM];
+static u8_t tcp_sack_num;
+#endif /* LWIP_TCP_SACK */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
@@ -108,12 +114,15 @@ static err_t tcp_timewait_input(struct tcp_pcb *pcb);
 void
 tcp_input(struct pbuf *p, struct netif *inp)
 {
-  struct tcp_pcb *pcb, *prev;
+  struct tcp_pcb *pcb;
   struct tcp_pcb_listen *lpcb;
+#if !TCP_PCB_HASH_SIZE
+  struct tcp_pcb *prev;
 #if SO_REUSE
   struct tcp_pcb *lpcb_prev = NULL;
   struct tcp_pcb_listen *lpcb_any = NULL;
 #endif /* SO_REUSE */
+#endif /* !TCP_PCB_HASH_SIZE */
   u8_t hdrlen;
   err_t err;
 
@@ -214,6 +223,32 @@ tcp_input(struct pbuf *p, struct netif *inp)
   flags = TCPH_FLAGS(tcphdr);
   tcplen = p->tot_len + ((flags & (TCP_FIN | TCP_SYN)) ? 1 : 0);
 
+#if TCP_TMR_IDLE_SLEEP
+  /* the segment may leave a delayed ACK or data to process */
+  tcp_timer_needed();
+#endif /* TCP_TMR_IDLE_SLEEP */
+
+#if TCP_PCB_HASH_SIZE
+  /* Demultiplex an incoming segment: look up its connection, active or in
+     TIME-WAIT, and if there is none, a pcb listening on its port. */
+  pcb = tcp_pcb_hash_lookup(ip_current_dest_addr(), tcphdr->dest,
+                            ip_current_src_addr(), tcphdr->src);
+  if (pcb != NULL && pcb->state == TIME_WAIT) {
+    LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection.\n"));
+    tcp_timewait_input(pcb);
+    pbuf_free(p);
+    return;
+  }
+  if (pcb == NULL) {
+    lpcb = tcp_pcb_hash_lookup_listen(ip_current_dest_addr(), tcphdr->dest);
+    if (lpcb != NULL) {
+      LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
+      tcp_listen_input(lpcb);
+      pbuf_free(p);
+      return;
+    }
+  }
+#else /* TCP_PCB_HASH_SIZE */
   /* Demultiplex an incoming segment. First, we check if it is destined
      for an active connection. */
   prev = NULL;
@@ -320,6 +355,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
       return;
     }
   }
+#endif /* TCP_PCB_HASH_SIZE */
 
 #if TCP_INPUT_DEBUG
   LWIP_DEBUGF(TCP_INPUT_DEBUG, ("+-+-+-+-+-+-+-+-+-+-+-+-+-+- tcp_input: flags "));
@@ -749,6 +785,9 @@ tcp_process(struct tcp_pcb *pcb)
       pcb->rcv_nxt = seqno + 1;
       pcb->rcv_ann_right_edge = pcb->rcv_nxt;
       pcb->lastack = ackno;
+#if LWIP_TCP_SACK
+      pcb->sack_high = ackno;
+#endif /* LWIP_TCP_SACK */
       pcb->snd_wnd = SND_WND_SCALE(pcb, tcphdr->wnd);
       pcb->snd_wnd_max = pcb->snd_wnd;
       pcb->snd_wl1 = seqno - 1; /* initialise to seqno - 1 to force window update */
@@ -952,6 +991,42 @@ tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
 }
 #endif /* TCP_QUEUE_OOSEQ */
 
+#if LWIP_TCP_SACK
+/**
+ * Marks the unacked segments covered by a block of the SACK option of the
+ * incoming segment as selectively acknowledged. Blocks which don't lie
+ * between the acknowledgement number and snd_nxt are ignored.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ */
+static void
+tcp_sack_mark(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u8_t i;
+
+  for (i = 0; i < tcp_sack_num; i++) {
+    u32_t left = tcp_sack_blocks[2 * i];
+    u32_t right = tcp_sack_blocks[2 * i + 1];
+    if (!TCP_SEQ_LT(left, right) || TCP_SEQ_LT(left, ackno) || TCP_SEQ_GT(right, pcb->snd_nxt)) {
+      continue;
+    }
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      u32_t seg_seqno = ntohl(seg->tcphdr->seqno);
+      if (TCP_SEQ_GEQ(seg_seqno, right)) {
+        break;
+      }
+      if (TCP_SEQ_GEQ(seg_seqno, left) && TCP_SEQ_LEQ(seg_seqno + TCP_TCPLEN(seg), right)) {
+        seg->flags |= TF_SEG_SACKED;
+      }
+    }
+    if (TCP_SEQ_GT(right, pcb->sack_high)) {
+      pcb->sack_high = right;
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 /**
  * Called by tcp_process. Checks if the given segment is an ACK for outstanding
  * data, and if so frees the memory of the buffered data. Next, it places the
@@ -1004,6 +1079,10 @@ tcp_receive(struct tcp_pcb *pcb)
           /* start persist timer */
           pcb->persist_cnt = 0;
           pcb->persist_backoff = 1;
+          TCP_STATS_INC(tcp_ext.zerownd);
+#if TCP_STATS
+          ++pcb->zerownd_total;
+#endif /* TCP_STATS */
         }
       } else if (pcb->persist_backoff > 0) {
         /* stop persist timer */
@@ -1021,6 +1100,12 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* TCP_WND_DEBUG */
     }
 
+#if LWIP_TCP_SACK
+    if ((pcb->flags & TF_SACK) && (tcp_sack_num != 0)) {
+      tcp_sack_mark(pcb);
+    }
+#endif /* LWIP_TCP_SACK */
+
     /* (From Stevens TCP/IP Illustrated Vol II, p970.) Its only a
      * duplicate ack if:
      * 1) It doesn't ACK new data
@@ -1062,6 +1147,12 @@ tcp_receive(struct tcp_pcb *pcb)
                 if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
                   pcb->cwnd += pcb->mss;
                 }
+#if LWIP_TCP_SACK
+                if ((pcb->flags & (TF_SACK | TF_INFR)) == (TF_SACK | TF_INFR)) {
+                  /* retransmit the next segment reported missing */
+                  tcp_rexmit_sack(pcb);
+                }
+#endif /* LWIP_TCP_SACK */
               } else if (pcb->dupacks == 3) {
                 /* Do fast retransmit */
                 tcp_rexmit_fast(pcb);
@@ -1082,8 +1173,16 @@ tcp_receive(struct tcp_pcb *pcb)
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
       if (pcb->flags & TF_INFR) {
-        pcb->flags &= ~TF_INFR;
-        pcb->cwnd = pcb->ssthresh;
+#if LWIP_TCP_SACK
+        if ((pcb->flags & TF_SACK) && TCP_SEQ_LT(ackno, pcb->sack_recover)) {
+          /* A partial ACK: more data sent before the recovery started is
+             missing, stay in fast recovery (handled below). */
+        } else
+#endif /* LWIP_TCP_SACK */
+        {
+          pcb->flags &= ~TF_INFR;
+          pcb->cwnd = pcb->ssthresh;
+        }
       }
 
       /* Reset the number of retransmissions. */
@@ -1101,10 +1200,15 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Reset the fast retransmit variables. */
       pcb->dupacks = 0;
       pcb->lastack = ackno;
+#if LWIP_TCP_SACK
+      if (TCP_SEQ_LT(pcb->sack_high, ackno)) {
+        pcb->sack_high = ackno;
+      }
+#endif /* LWIP_TCP_SACK */
 
       /* Update the congestion control variables (cwnd and
          ssthresh). */
-      if (pcb->state >= ESTABLISHED) {
+      if ((pcb->state >= ESTABLISHED) && !(pcb->flags & TF_INFR)) {
         if (pcb->cwnd < pcb->ssthresh) {
           if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
             pcb->cwnd += pcb->mss;
@@ -1163,6 +1267,28 @@ tcp_receive(struct tcp_pcb *pcb)
         pcb->rtime = 0;
       }
 
+#if LWIP_TCP_SACK
+      if (pcb->flags & TF_INFR) {
+        /* Partial ACK in fast recovery: deflate the congestion window by
+           the data acknowledged (RFC 6582) and retransmit the next missing
+           segment, or the first unacked one if the remote host reported
+           nothing beyond it. */
+        pcb->cwnd = (pcb->cwnd > pcb->acked) ? (tcpwnd_size_t)(pcb->cwnd - pcb->acked) : 0;
+        if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+          pcb->cwnd += pcb->mss;
+        }
+        if (TCP_SEQ_LT(pcb->sack_rexmit, ackno)) {
+          pcb->sack_rexmit = ackno;
+        }
+        if (!tcp_rexmit_sack(pcb) && (pcb->unacked != NULL) &&
+            !(pcb->unacked->flags & TF_SEG_SACKED) &&
+            TCP_SEQ_GEQ(ntohl(pcb->unacked->tcphdr->seqno), pcb->sack_rexmit)) {
+          pcb->sack_rexmit = ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked);
+          tcp_rexmit(pcb);
+        }
+      }
+#endif /* LWIP_TCP_SACK */
+
       pcb->polltmr = 0;
 
 #if LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS
@@ -1508,8 +1634,13 @@ tcp_receive(struct tcp_pcb *pcb)
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
+#if !LWIP_TCP_SACK || !TCP_QUEUE_OOSEQ
         tcp_send_empty_ack(pcb);
+#endif /* !LWIP_TCP_SACK || !TCP_QUEUE_OOSEQ */
 #if TCP_QUEUE_OOSEQ
+#if LWIP_TCP_SACK
+        pcb->rcv_sack_recent = seqno;
+#endif /* LWIP_TCP_SACK */
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
           pcb->ooseq = tcp_seg_copy(&inseg);
@@ -1640,8 +1771,8 @@ tcp_receive(struct tcp_pcb *pcb)
           struct pbuf *p = next->p;
           ooseq_blen += p->tot_len;
           ooseq_qlen += pbuf_clen(p);
-          if ((ooseq_blen > TCP_OOSEQ_MAX_BYTES) ||
-              (ooseq_qlen > TCP_OOSEQ_MAX_PBUFS)) {
+          if (((TCP_OOSEQ_MAX_BYTES != 0) && (ooseq_blen > TCP_OOSEQ_MAX_BYTES)) ||
+              ((TCP_OOSEQ_MAX_PBUFS != 0) && (ooseq_qlen > TCP_OOSEQ_MAX_PBUFS))) {
              /* too much ooseq data, dump this and everything after it */
              tcp_segs_free(next);
              if (prev == NULL) {
@@ -1655,6 +1786,10 @@ tcp_receive(struct tcp_pcb *pcb)
           }
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+#if LWIP_TCP_SACK
+        /* the ACK reports the segments now on ooseq */
+        tcp_send_empty_ack(pcb);
+#endif /* LWIP_TCP_SACK */
 #endif /* TCP_QUEUE_OOSEQ */
       }
     } else {
@@ -1698,6 +1833,12 @@ tcp_parseopt(struct tcp_pcb *pcb)
 #if LWIP_TCP_TIMESTAMPS
   u32_t tsval;
 #endif
+#if LWIP_TCP_SACK
+  u32_t edge;
+  u8_t i;
+
+  tcp_sack_num = 0;
+#endif /* LWIP_TCP_SACK */
 
   /* Parse the TCP MSS option, if present. */
   if (tcphdr_optlen != 0) {
@@ -1776,6 +1917,46 @@ tcp_parseopt(struct tcp_pcb *pcb)
         tcp_optidx += LWIP_TCP_OPT_LEN_TS - 6;
         break;
 #endif
+#if LWIP_TCP_SACK
+      case LWIP_TCP_OPT_SACK_PERM:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (tcp_getoptbyte() != LWIP_TCP_OPT_LEN_SACK_PERM || (tcp_optidx - 2 + LWIP_TCP_OPT_LEN_SACK_PERM) > tcphdr_optlen) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (flags & TCP_SYN) {
+          /* The remote host accepts SACK blocks in our ACKs. */
+          pcb->flags |= TF_SACK;
+        }
+        break;
+      case LWIP_TCP_OPT_SACK:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+        data = tcp_getoptbyte();
+        if (data < 2 || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Read the blocks, skipping those beyond LWIP_TCP_MAX_SACK_NUM
+           and a partial one. */
+        for (data -= 2; data >= 8; data -= 8) {
+          for (i = 0; i < 2; i++) {
+            edge = (u32_t)tcp_getoptbyte() << 24;
+            edge |= (u32_t)tcp_getoptbyte() << 16;
+            edge |= (u32_t)tcp_getoptbyte() << 8;
+            edge |= tcp_getoptbyte();
+            if (tcp_sack_num < LWIP_TCP_MAX_SACK_NUM) {
+              tcp_sack_blocks[2 * tcp_sack_num + i] = edge;
+            }
+          }
+          if (tcp_sack_num < LWIP_TCP_MAX_SACK_NUM) {
+            tcp_sack_num++;
+          }
+        }
+        tcp_optidx += data;
+        break;
+#endif /* LWIP_TCP_SACK */
       default:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
         data = tcp_getoptbyte();
@@ -59,6 +59,10 @@
 
 #include <string.h>
 
+#if ESP_TCP_SND_BUF_SPIRAM
+#include "heap_alloc_caps.h"
+#endif
+
 #ifdef MEMLEAK_DEBUG
 static const char mem_debug_file[] ICACHE_RODATA_ATTR STORE_ATTR = __FILE__;
 #endif
@@ -233,6 +237,93 @@ tcp_create_segment(struct tcp_pcb *pcb, struct pbuf *p, u8_t flags, u32_t seqno,
  * @param apiflags API flags given to tcp_write.
  * @param first_seg true when this pbuf will be used in the first enqueued segment.
  */
+#if ESP_TCP_SND_BUF_SPIRAM
+/** Free a pbuf allocated by tcp_pbuf_alloc_spiram */
+static void
+tcp_pbuf_free_spiram(struct pbuf *p)
+{
+  vPortFree(p);
+}
+
+/**
+ * Allocate a PBUF_RAM-like pbuf for segment data in SPI RAM, so that the
+ * data waiting to be sent or acknowledged doesn't take internal RAM.
+ * The pbuf is custom pbuf with its payload in the same allocation.
+ *
+ * @return the pbuf or NULL if SPI RAM is full
+ */
+static struct pbuf *
+tcp_pbuf_alloc_spiram(pbuf_layer layer, u16_t length)
+{
+  /* room for the largest layer offset pbuf_alloced_custom() may use */
+  u16_t payload_mem_len = LWIP_MEM_ALIGN_SIZE(PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN +
+                                              PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN) + length;
+  struct pbuf_custom *pc;
+  struct pbuf *p;
+
+  pc = (struct pbuf_custom *)pvPortMallocCaps(LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf_custom)) +
+                                              payload_mem_len, MALLOC_CAP_SPISRAM);
+  if (pc == NULL) {
+    return NULL;
+  }
+  pc->custom_free_function = tcp_pbuf_free_spiram;
+  p = pbuf_alloced_custom(layer, length, PBUF_RAM, pc,
+                          (u8_t *)pc + LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf_custom)),
+                          payload_mem_len);
+  if (p == NULL) {
+    vPortFree(pc);
+    return NULL;
+  }
+#ifdef LWIP_ESP8266
+  p->eb = NULL;
+#endif
+  return p;
+}
+#endif /* ESP_TCP_SND_BUF_SPIRAM */
+
+#if ESP_TCP_SND_PBUF_POOL_SIZE
+/** Return a pbuf allocated by tcp_pbuf_alloc_pool to its pool */
+static void
+tcp_pbuf_free_pool(struct pbuf *p)
+{
+  memp_free(MEMP_TCP_SND_PBUF, p);
+}
+
+/**
+ * Allocate a PBUF_RAM-like pbuf for segment data from the MEMP_TCP_SND_PBUF
+ * pool of MSS-sized buffers, so that segments reuse the same buffers instead
+ * of allocating from and fragmenting the heap.
+ *
+ * @return the pbuf or NULL if length doesn't fit or the pool is empty
+ */
+static struct pbuf *
+tcp_pbuf_alloc_pool(pbuf_layer layer, u16_t length)
+{
+  struct pbuf_custom *pc;
+  struct pbuf *p;
+
+  if (length > TCP_MSS) {
+    return NULL;
+  }
+  pc = (struct pbuf_custom *)memp_malloc(MEMP_TCP_SND_PBUF);
+  if (pc == NULL) {
+    return NULL;
+  }
+  pc->custom_free_function = tcp_pbuf_free_pool;
+  p = pbuf_alloced_custom(layer, length, PBUF_RAM, pc,
+                          (u8_t *)pc + LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf_custom)),
+                          TCP_SND_PBUF_ELEM_SIZE - LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf_custom)));
+  if (p == NULL) {
+    memp_free(MEMP_TCP_SND_PBUF, pc);
+    return NULL;
+  }
+#ifdef LWIP_ESP8266
+  p->eb = NULL;
+#endif
+  return p;
+}
+#endif /* ESP_TCP_SND_PBUF_POOL_SIZE */
+
 #if TCP_OVERSIZE
 static struct pbuf *
 tcp_pbuf_prealloc(pbuf_layer layer, u16_t length, u16_t max_length,
@@ -263,6 +354,7 @@ tcp_pbuf_prealloc(pbuf_layer layer, u16_t length, u16_t max_length,
      * Will the Nagle algorithm defer transmission of this segment?
      */
     if ((apiflags & TCP_WRITE_FLAG_MORE) ||
+        (pcb->flags & (TF_CORK | TF_MORE)) ||
         (!(pcb->flags & TF_NODELAY) &&
          (!first_seg ||
           pcb->unsent != NULL ||
@@ -271,7 +363,20 @@ tcp_pbuf_prealloc(pbuf_layer layer, u16_t length, u16_t max_length,
     }
   }
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
-  p = pbuf_alloc(layer, alloc, PBUF_RAM);
+  p = NULL;
+#if ESP_TCP_SND_PBUF_POOL_SIZE
+  /* the pool is reserved anyway, so use it before SPI RAM or the heap */
+  p = tcp_pbuf_alloc_pool(layer, alloc);
+#endif /* ESP_TCP_SND_PBUF_POOL_SIZE */
+#if ESP_TCP_SND_BUF_SPIRAM
+  if (p == NULL) {
+    p = tcp_pbuf_alloc_spiram(layer, alloc);
+  }
+#endif /* ESP_TCP_SND_BUF_SPIRAM */
+  if (p == NULL) {
+    /* internal RAM, also when SPI RAM is full */
+    p = pbuf_alloc(layer, alloc, PBUF_RAM);
+  }
   if (p == NULL) {
     return NULL;
   }
@@ -393,8 +498,12 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
   mss_local = mss_local ? mss_local : pcb->mss;
 
 #if LWIP_NETIF_TX_SINGLE_PBUF
-  /* Always copy to try to create single pbufs for TX */
-  apiflags |= TCP_WRITE_FLAG_COPY;
+  /* Always copy to try to create single pbufs for TX, unless the caller
+     keeps the data until it is acknowledged (the netif then flattens the
+     chain when sending it) */
+  if ((apiflags & TCP_WRITE_FLAG_REF) == 0) {
+    apiflags |= TCP_WRITE_FLAG_COPY;
+  }
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
   LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_write(pcb=%p, data=%p, len=%"U16_F", apiflags=%"U16_F")\n",
@@ -784,6 +893,13 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       optflags |= TF_SEG_OPTS_WND_SCALE;
     }
 #endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      /* Like window scaling, SACK is only permitted in a <SYN,ACK> if the
+         remote host permitted it in its SYN. */
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -891,6 +1007,47 @@ tcp_build_wnd_scale_option(u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+/**
+ * Collect the blocks of the SACK option from the ooseq queue. Contiguous
+ * segments form one block. The block holding the segment received last
+ * comes first, as RFC 2018 asks, followed by the others in sequence order.
+ *
+ * @param pcb tcp_pcb with segments on ooseq
+ * @param blocks left and right edge of each block
+ * @param max most blocks to collect
+ * @return the number of blocks
+ */
+static u8_t
+tcp_get_sack_blocks(struct tcp_pcb *pcb, u32_t *blocks, u8_t max)
+{
+  struct tcp_seg *seg = pcb->ooseq;
+  u8_t num = 0;
+  while (seg != NULL) {
+    u32_t left = seg->tcphdr->seqno;
+    u32_t right = left + TCP_TCPLEN(seg);
+    for (seg = seg->next; (seg != NULL) && TCP_SEQ_LEQ(seg->tcphdr->seqno, right); seg = seg->next) {
+      if (TCP_SEQ_GT(seg->tcphdr->seqno + TCP_TCPLEN(seg), right)) {
+        right = seg->tcphdr->seqno + TCP_TCPLEN(seg);
+      }
+    }
+    if (TCP_SEQ_GEQ(pcb->rcv_sack_recent, left) && TCP_SEQ_LT(pcb->rcv_sack_recent, right)) {
+      /* most recent block first, dropping the last one if there's no room */
+      num = LWIP_MIN(num, (u8_t)(max - 1));
+      memmove(&blocks[2], &blocks[0], num * 2 * sizeof(u32_t));
+      blocks[0] = left;
+      blocks[1] = right;
+      num++;
+    } else if (num < max) {
+      blocks[2 * num] = left;
+      blocks[2 * num + 1] = right;
+      num++;
+    }
+  }
+  return num;
+}
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -902,15 +1059,28 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   u8_t optlen = 0;
   struct netif *netif;
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK
   struct tcp_hdr *tcphdr;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK */
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  u32_t sack_blocks[2 * LWIP_TCP_MAX_SACK_NUM];
+  u8_t num_sacks = 0;
+  u8_t i;
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    /* the options have room for 3 blocks next to a timestamp, 4 without */
+    num_sacks = tcp_get_sack_blocks(pcb, sack_blocks,
+      (u8_t)((optlen != 0) ? LWIP_TCP_MAX_SACK_NUM - 1 : LWIP_TCP_MAX_SACK_NUM));
+    optlen += LWIP_TCP_OPT_LEN_SACK_OUT(num_sacks);
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -919,9 +1089,9 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK
   tcphdr = (struct tcp_hdr *)p->payload;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK */
   LWIP_DEBUGF(TCP_OUTPUT_DEBUG,
               ("tcp_output: sending ACK for %"U32_F"\n", pcb->rcv_nxt));
 
@@ -933,6 +1103,15 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
   }
 #endif
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if (num_sacks != 0) {
+    u32_t *opts = (u32_t *)(void *)((u8_t *)(tcphdr + 1) + optlen - LWIP_TCP_OPT_LEN_SACK_OUT(num_sacks));
+    *opts++ = htonl(0x01010000 | (LWIP_TCP_OPT_SACK << 8) | (2 + 8 * num_sacks));
+    for (i = 0; i < 2 * num_sacks; i++) {
+      *opts++ = htonl(sack_blocks[i]);
+    }
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
   netif = ip_route(&pcb->local_ip, &pcb->remote_ip);
   if (netif == NULL) {
@@ -984,6 +1163,11 @@ tcp_output(struct tcp_pcb *pcb)
   LWIP_ASSERT("don't call tcp_output for listen-pcbs",
     pcb->state != LISTEN);
 
+#if TCP_TMR_IDLE_SLEEP
+  /* sending starts the retransmission timer */
+  tcp_timer_needed();
+#endif /* TCP_TMR_IDLE_SLEEP */
+
   /* First, check if we are invoked by the TCP input processing
      code. If so, we do not output anything. Instead, we rely on the
      input processing code to call us when input processing is done
@@ -1123,6 +1307,10 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* TCP_OVERSIZE */
 
   pcb->flags &= ~TF_NAGLEMEMERR;
+  if (pcb->flags & TF_ACK_NOW) {
+    /* the data was held back by Nagle or TCP_CORK: send the ACK on its own */
+    return tcp_send_empty_ack(pcb);
+  }
   return ERR_OK;
 }
 
@@ -1188,6 +1376,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     opts += 1;
   }
 #endif
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* NOP, NOP, SACK permitted */
+    *opts = PP_HTONL(0x01010000 | (LWIP_TCP_OPT_SACK_PERM << 8) | LWIP_TCP_OPT_LEN_SACK_PERM);
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK */
 
   /* Set retransmission timer running if it is not currently enabled
      This must be set before checking the route. */
@@ -1357,6 +1552,15 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
     return;
   }
 
+#if LWIP_TCP_SACK
+  /* The remote host may have dropped data it selectively acknowledged, so
+     forget what it reported and retransmit everything (RFC 2018, section 8). */
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    seg->flags &= ~TF_SEG_SACKED;
+  }
+  pcb->sack_high = pcb->lastack;
+#endif /* LWIP_TCP_SACK */
+
   /* Move all unacked segments to the head of the unsent queue */
   for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
   /* concatenate unsent queue after unacked queue */
@@ -1374,6 +1578,11 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 
   /* increment number of retransmissions */
   ++pcb->nrtx;
+#if TCP_STATS
+  ++pcb->rexmit_total;
+#endif /* TCP_STATS */
+  TCP_STATS_INC(tcp_ext.rto_rexmit);
+  MIB2_STATS_INC(mib2.tcpretranssegs);
 
   /* Don't take any RTT measurements after retransmitting. */
   pcb->rttest = 0;
@@ -1383,27 +1592,17 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 }
 
 /**
- * Requeue the first unacked segment for retransmission
+ * Requeue a segment taken off the unacked queue for retransmission
  *
- * Called by tcp_receive() for fast retramsmit.
- *
- * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the segment to retransmit
  */
 void
-tcp_rexmit(struct tcp_pcb *pcb)
+tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg)
 {
-  struct tcp_seg *seg;
   struct tcp_seg **cur_seg;
 
-  if (pcb->unacked == NULL) {
-    return;
-  }
-
-  /* Move the first unacked segment to the unsent queue */
   /* Keep the unsent queue sorted. */
-  seg = pcb->unacked;
-  pcb->unacked = seg->next;
-
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
     TCP_SEQ_LT(ntohl((*cur_seg)->tcphdr->seqno), ntohl(seg->tcphdr->seqno))) {
@@ -1418,7 +1617,9 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 #endif /* TCP_OVERSIZE */
 
-  ++pcb->nrtx;
+#if TCP_STATS
+  ++pcb->rexmit_total;
+#endif /* TCP_STATS */
 
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
@@ -1429,6 +1630,65 @@ tcp_rexmit(struct tcp_pcb *pcb)
      and thus tcp_output directly returns. */
 }
 
+/**
+ * Requeue the first unacked segment for retransmission
+ *
+ * Called by tcp_receive() for fast retramsmit.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ */
+void
+tcp_rexmit(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+
+  if (pcb->unacked == NULL) {
+    return;
+  }
+
+  /* Move the first unacked segment to the unsent queue */
+  seg = pcb->unacked;
+  pcb->unacked = seg->next;
+  tcp_rexmit_seg(pcb, seg);
+
+  ++pcb->nrtx;
+}
+
+#if LWIP_TCP_SACK
+/**
+ * Requeue the next segment the remote host reported as missing for
+ * retransmission: the first unacked segment after the data retransmitted
+ * in this recovery which isn't selectively acknowledged, but lies below
+ * the highest selectively acknowledged sequence number.
+ *
+ * Called by tcp_receive() for duplicate and partial ACKs in fast recovery.
+ *
+ * @param pcb the tcp_pcb in fast recovery
+ * @return 1 if a segment was requeued, 0 if no segment is missing
+ */
+u8_t
+tcp_rexmit_sack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg **link;
+
+  for (link = &pcb->unacked; *link != NULL; link = &((*link)->next)) {
+    struct tcp_seg *seg = *link;
+    u32_t seg_seqno = ntohl(seg->tcphdr->seqno);
+    if (!TCP_SEQ_LT(seg_seqno, pcb->sack_high)) {
+      break;
+    }
+    if (!(seg->flags & TF_SEG_SACKED) && TCP_SEQ_GEQ(seg_seqno, pcb->sack_rexmit)) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack: retransmit %"U32_F"\n", seg_seqno));
+      *link = seg->next;
+      pcb->sack_rexmit = seg_seqno + TCP_TCPLEN(seg);
+      tcp_rexmit_seg(pcb, seg);
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1445,7 +1705,13 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  ntohl(pcb->unacked->tcphdr->seqno)));
+#if LWIP_TCP_SACK
+    /* the holes up to snd_nxt are retransmitted during this recovery */
+    pcb->sack_rexmit = ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked);
+    pcb->sack_recover = pcb->snd_nxt;
+#endif /* LWIP_TCP_SACK */
     tcp_rexmit(pcb);
+    TCP_STATS_INC(tcp_ext.fast_rexmit);
 
     /* Set ssthresh to half of the minimum of the current
      * cwnd and the advertised window */
@@ -76,6 +76,24 @@ static u32_t timeouts_last_time;
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
 static int tcpip_tcp_timer_active;
+#if TCP_TMR_IDLE_SLEEP
+/** the tcp timer is scheduled for the first deadline of the idle pcbs
+    instead of the next tick */
+static int tcpip_tcp_timer_sleeping;
+/** sys_now() when the tcp timer started to sleep */
+static u32_t tcpip_tcp_timer_slept;
+
+/**
+ * Ends the sleep of the tcp timer: tells TCP how many ticks it skipped.
+ */
+static void
+tcpip_tcp_timer_wakeup(void)
+{
+  u32_t ticks = (sys_now() - tcpip_tcp_timer_slept) / TCP_SLOW_INTERVAL;
+  tcpip_tcp_timer_sleeping = 0;
+  tcp_tmr_resume((ticks > 0) ? ticks - 1 : 0);
+}
+#endif /* TCP_TMR_IDLE_SLEEP */
 
 /**
  * Timer callback function that calls tcp_tmr() and reschedules itself.
@@ -85,12 +103,30 @@ static int tcpip_tcp_timer_active;
 static void
 tcpip_tcp_timer(void *arg)
 {
+#if TCP_TMR_IDLE_SLEEP
+  u32_t idle_ticks;
+#endif /* TCP_TMR_IDLE_SLEEP */
   LWIP_UNUSED_ARG(arg);
 
+#if TCP_TMR_IDLE_SLEEP
+  if (tcpip_tcp_timer_sleeping) {
+    tcpip_tcp_timer_wakeup();
+  }
+#endif /* TCP_TMR_IDLE_SLEEP */
   /* call TCP timer handler */
   tcp_tmr();
   /* timer still needed? */
   if (tcp_active_pcbs || tcp_tw_pcbs) {
+#if TCP_TMR_IDLE_SLEEP
+    idle_ticks = tcp_tmr_idle_ticks();
+    if (idle_ticks > 0) {
+      /* nothing to do before the first deadline of a pcb: sleep until then */
+      tcpip_tcp_timer_sleeping = 1;
+      tcpip_tcp_timer_slept = sys_now();
+      sys_timeout(idle_ticks * TCP_SLOW_INTERVAL, tcpip_tcp_timer, NULL);
+      return;
+    }
+#endif /* TCP_TMR_IDLE_SLEEP */
     /* restart timer */
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   } else {
@@ -103,6 +139,9 @@ tcpip_tcp_timer(void *arg)
  * Called from TCP_REG when registering a new PCB:
  * the reason is to have the TCP timer only running when
  * there are active (or time-wait) PCBs.
+ * With TCP_TMR_IDLE_SLEEP, also called when a pcb may get work to do on
+ * the next ticks (a segment is received or sent, a pcb is closed...), to
+ * wake the timer up if it sleeps.
  */
 void
 tcp_timer_needed(void)
@@ -113,13 +152,24 @@ tcp_timer_needed(void)
     tcpip_tcp_timer_active = 1;
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   }
+#if TCP_TMR_IDLE_SLEEP
+  else if (tcpip_tcp_timer_sleeping) {
+    sys_untimeout(tcpip_tcp_timer, NULL);
+    tcpip_tcp_timer_wakeup();
+    sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
+  }
+#endif /* TCP_TMR_IDLE_SLEEP */
 }
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV4
 #if IP_REASSEMBLY
+/** global variable that shows if the reassembly timer is currently scheduled or not */
+static int ip_reass_timer_active;
+
 /**
- * Timer callback function that calls ip_reass_tmr() and reschedules itself.
+ * Timer callback function that calls ip_reass_tmr() and reschedules itself
+ * as long as datagrams are waiting for fragments.
  *
  * @param arg unused argument
  */
@@ -129,13 +179,34 @@ ip_reass_timer(void *arg)
   LWIP_UNUSED_ARG(arg);
   LWIP_DEBUGF(TIMERS_DEBUG, ("tcpip: ip_reass_tmr()\n"));
   ip_reass_tmr();
-  sys_timeout(IP_TMR_INTERVAL, ip_reass_timer, NULL);
+  if (ip_reass_pending()) {
+    sys_timeout(IP_TMR_INTERVAL, ip_reass_timer, NULL);
+  } else {
+    ip_reass_timer_active = 0;
+  }
+}
+
+/**
+ * Called when a datagram is enqueued for reassembly: the reason is to
+ * have the reassembly timer only running while fragments are queued.
+ */
+void
+ip_reass_timer_needed(void)
+{
+  if (!ip_reass_timer_active && ip_reass_pending()) {
+    ip_reass_timer_active = 1;
+    sys_timeout(IP_TMR_INTERVAL, ip_reass_timer, NULL);
+  }
 }
 #endif /* IP_REASSEMBLY */
 
 #if LWIP_ARP
+/** global variable that shows if the arp timer is currently scheduled or not */
+static int arp_timer_active;
+
 /**
- * Timer callback function that calls etharp_tmr() and reschedules itself.
+ * Timer callback function that calls etharp_tmr() and reschedules itself
+ * as long as the ARP table has entries which age.
  *
  * @param arg unused argument
  */
@@ -145,7 +216,24 @@ arp_timer(void *arg)
   LWIP_UNUSED_ARG(arg);
   LWIP_DEBUGF(TIMERS_DEBUG, ("tcpip: etharp_tmr()\n"));
   etharp_tmr();
-  sys_timeout(ARP_TMR_INTERVAL, arp_timer, NULL);
+  if (etharp_pending()) {
+    sys_timeout(ARP_TMR_INTERVAL, arp_timer, NULL);
+  } else {
+    arp_timer_active = 0;
+  }
+}
+
+/**
+ * Called when the ARP table has entries which age: the reason is to have the
+ * timer only running while it has something to do.
+ */
+void
+etharp_timer_needed(void)
+{
+  if (!arp_timer_active && etharp_pending()) {
+    arp_timer_active = 1;
+    sys_timeout(ARP_TMR_INTERVAL, arp_timer, NULL);
+  }
 }
 #endif /* LWIP_ARP */
 
@@ -170,18 +258,39 @@ dhcp_timer_coarse(void *arg)
   sys_timeout(DHCP_COARSE_TIMER_MSECS, dhcp_timer_coarse, NULL);
 }
 
+/** global variable that shows if the dhcp_fine timer is currently scheduled or not */
+static int dhcp_fine_timer_active;
+
 /**
- * Timer callback function that calls dhcp_fine_tmr() and reschedules itself.
+ * Timer callback function that calls dhcp_fine_tmr() and reschedules itself
+ * as long as a DHCP client waits for a response.
  *
  * @param arg unused argument
  */
 static void
-dhcp_timer_fine(void *arg)
+dhcp_fine_timer(void *arg)
 {
   LWIP_UNUSED_ARG(arg);
   LWIP_DEBUGF(TIMERS_DEBUG, ("tcpip: dhcp_fine_tmr()\n"));
   dhcp_fine_tmr();
-  sys_timeout(DHCP_FINE_TIMER_MSECS, dhcp_timer_fine, NULL);
+  if (dhcp_fine_pending()) {
+    sys_timeout(DHCP_FINE_TIMER_MSECS, dhcp_fine_timer, NULL);
+  } else {
+    dhcp_fine_timer_active = 0;
+  }
+}
+
+/**
+ * Called when a DHCP client waits for a response: the reason is to have the
+ * timer only running while it has something to do.
+ */
+void
+dhcp_fine_timer_needed(void)
+{
+  if (!dhcp_fine_timer_active && dhcp_fine_pending()) {
+    dhcp_fine_timer_active = 1;
+    sys_timeout(DHCP_FINE_TIMER_MSECS, dhcp_fine_timer, NULL);
+  }
 }
 #endif /* LWIP_DHCP */
 
@@ -202,8 +311,12 @@ autoip_timer(void *arg)
 #endif /* LWIP_AUTOIP */
 
 #if LWIP_IGMP
+/** global variable that shows if the igmp timer is currently scheduled or not */
+static int igmp_timer_active;
+
 /**
- * Timer callback function that calls igmp_tmr() and reschedules itself.
+ * Timer callback function that calls igmp_tmr() and reschedules itself
+ * as long as a group has a report scheduled.
  *
  * @param arg unused argument
  */
@@ -213,14 +326,35 @@ igmp_timer(void *arg)
   LWIP_UNUSED_ARG(arg);
   LWIP_DEBUGF(TIMERS_DEBUG, ("tcpip: igmp_tmr()\n"));
   igmp_tmr();
-  sys_timeout(IGMP_TMR_INTERVAL, igmp_timer, NULL);
+  if (igmp_pending()) {
+    sys_timeout(IGMP_TMR_INTERVAL, igmp_timer, NULL);
+  } else {
+    igmp_timer_active = 0;
+  }
+}
+
+/**
+ * Called when a group has a report scheduled: the reason is to have the
+ * timer only running while it has something to do.
+ */
+void
+igmp_timer_needed(void)
+{
+  if (!igmp_timer_active && igmp_pending()) {
+    igmp_timer_active = 1;
+    sys_timeout(IGMP_TMR_INTERVAL, igmp_timer, NULL);
+  }
 }
 #endif /* LWIP_IGMP */
 #endif /* LWIP_IPV4 */
 
 #if LWIP_DNS
+/** global variable that shows if the dns timer is currently scheduled or not */
+static int dns_timer_active;
+
 /**
- * Timer callback function that calls dns_tmr() and reschedules itself.
+ * Timer callback function that calls dns_tmr() and reschedules itself
+ * as long as DNS queries are pending.
  *
  * @param arg unused argument
  */
@@ -230,7 +364,24 @@ dns_timer(void *arg)
   LWIP_UNUSED_ARG(arg);
   LWIP_DEBUGF(TIMERS_DEBUG, ("tcpip: dns_tmr()\n"));
   dns_tmr();
-  sys_timeout(DNS_TMR_INTERVAL, dns_timer, NULL);
+  if (dns_pending()) {
+    sys_timeout(DNS_TMR_INTERVAL, dns_timer, NULL);
+  } else {
+    dns_timer_active = 0;
+  }
+}
+
+/**
+ * Called when DNS queries are pending: the reason is to have the timer only
+ * running while it has something to do.
+ */
+void
+dns_timer_needed(void)
+{
+  if (!dns_timer_active && dns_pending()) {
+    dns_timer_active = 1;
+    sys_timeout(DNS_TMR_INTERVAL, dns_timer, NULL);
+  }
 }
 #endif /* LWIP_DNS */
 
@@ -266,8 +417,12 @@ ip6_reass_timer(void *arg)
 #endif /* LWIP_IPV6_REASS */
 
 #if LWIP_IPV6_MLD
+/** global variable that shows if the mld6 timer is currently scheduled or not */
+static int mld6_timer_active;
+
 /**
- * Timer callback function that calls mld6_tmr() and reschedules itself.
+ * Timer callback function that calls mld6_tmr() and reschedules itself
+ * as long as a group has a report scheduled.
  *
  * @param arg unused argument
  */
@@ -277,7 +432,24 @@ mld6_timer(void *arg)
   LWIP_UNUSED_ARG(arg);
   LWIP_DEBUGF(TIMERS_DEBUG, ("tcpip: mld6_tmr()\n"));
   mld6_tmr();
-  sys_timeout(MLD6_TMR_INTERVAL, mld6_timer, NULL);
+  if (mld6_pending()) {
+    sys_timeout(MLD6_TMR_INTERVAL, mld6_timer, NULL);
+  } else {
+    mld6_timer_active = 0;
+  }
+}
+
+/**
+ * Called when a group has a report scheduled: the reason is to have the
+ * timer only running while it has something to do.
+ */
+void
+mld6_timer_needed(void)
+{
+  if (!mld6_timer_active && mld6_pending()) {
+    mld6_timer_active = 1;
+    sys_timeout(MLD6_TMR_INTERVAL, mld6_timer, NULL);
+  }
 }
 #endif /* LWIP_IPV6_MLD */
 #endif /* LWIP_IPV6 */
@@ -285,13 +457,9 @@ mld6_timer(void *arg)
 /** Initialize this module */
 void sys_timeouts_init(void)
 {
+  /* The ARP, DHCP fine, IGMP, DNS and MLD timers are started on demand, see
+     etharp_timer_needed() etc. */
 #if LWIP_IPV4
-#if IP_REASSEMBLY
-  sys_timeout(IP_TMR_INTERVAL, ip_reass_timer, NULL);
-#endif /* IP_REASSEMBLY */
-#if LWIP_ARP
-  sys_timeout(ARP_TMR_INTERVAL, arp_timer, NULL);
-#endif /* LWIP_ARP */
 #if LWIP_DHCP
 
 #ifdef LWIP_ESP8266
@@ -301,28 +469,17 @@ void sys_timeouts_init(void)
 
 
   sys_timeout(DHCP_COARSE_TIMER_MSECS, dhcp_timer_coarse, NULL);
-  sys_timeout(DHCP_FINE_TIMER_MSECS, dhcp_timer_fine, NULL);
 #endif /* LWIP_DHCP */
 #if LWIP_AUTOIP
   sys_timeout(AUTOIP_TMR_INTERVAL, autoip_timer, NULL);
 #endif /* LWIP_AUTOIP */
-#if LWIP_IGMP
-  sys_timeout(IGMP_TMR_INTERVAL, igmp_timer, NULL);
-#endif /* LWIP_IGMP */
 #endif /* LWIP_IPV4 */
 
-#if LWIP_DNS
-  sys_timeout(DNS_TMR_INTERVAL, dns_timer, NULL);
-#endif /* LWIP_DNS */
-
 #if LWIP_IPV6
   sys_timeout(ND6_TMR_INTERVAL, nd6_timer, NULL);
 #if LWIP_IPV6_REASS
   sys_timeout(IP6_REASS_TMR_INTERVAL, ip6_reass_timer, NULL);
 #endif /* LWIP_IPV6_REASS */
-#if LWIP_IPV6_MLD
-  sys_timeout(MLD6_TMR_INTERVAL, mld6_timer, NULL);
-#endif /* LWIP_IPV6_MLD */
 #endif /* LWIP_IPV6 */
 
 #if NO_SYS
@@ -611,4 +768,45 @@ void
 tcp_timer_needed(void)
 {
 }
+
+#if LWIP_IPV4 && IP_REASSEMBLY
+/* Satisfy the reassembly code which calls this function */
+void
+ip_reass_timer_needed(void)
+{
+}
+#endif /* LWIP_IPV4 && IP_REASSEMBLY */
+
+/* Satisfy the code calling these functions; without LWIP_TIMERS, the
+   application calls etharp_tmr() etc. itself */
+#if LWIP_IPV4 && LWIP_ARP
+void
+etharp_timer_needed(void)
+{
+}
+#endif /* LWIP_IPV4 && LWIP_ARP */
+#if LWIP_IPV4 && LWIP_DHCP
+void
+dhcp_fine_timer_needed(void)
+{
+}
+#endif /* LWIP_IPV4 && LWIP_DHCP */
+#if LWIP_IPV4 && LWIP_IGMP
+void
+igmp_timer_needed(void)
+{
+}
+#endif /* LWIP_IPV4 && LWIP_IGMP */
+#if LWIP_DNS
+void
+dns_timer_needed(void)
+{
+}
+#endif /* LWIP_DNS */
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+void
+mld6_timer_needed(void)
+{
+}
+#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
 #endif /* LWIP_TIMERS */
@@ -175,11 +175,6 @@ struct dhcps_pool{
 	u32_t lease_timer;
 };
 
-typedef struct _list_node{
-	void *pnode;
-	struct _list_node *pnext;
-}list_node;
-
 typedef u32_t dhcps_time_t;
 typedef u8_t dhcps_offer_t;
 
@@ -195,6 +190,7 @@ void dhcps_start(struct netif *netif, ip4_addr_t ip);
 void dhcps_stop(struct netif *netif);
 void *dhcps_option_info(u8_t op_id, u32_t opt_len);
 bool dhcp_search_ip_on_mac(u8_t *mac, ip4_addr_t *ip);
+u16_t dhcps_get_leases(struct dhcps_pool *pools, u16_t max);
 
 #endif
 
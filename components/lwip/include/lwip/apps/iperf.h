@@ -0,0 +1,143 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __IPERF_H__
+#define __IPERF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Network throughput and latency benchmark
+ *
+ * Measures TCP and UDP throughput against iperf 2 on a host ("iperf -s",
+ * "iperf -s -u", "iperf -c <device>" and "iperf -c <device> -u"), or between
+ * two devices, and the round trip time of small messages against an echo
+ * server, such as another device running IPERF_ECHO.
+ *
+ * Besides the throughput, every report carries the CPU load of each core
+ * (with FREERTOS_GENERATE_RUN_TIME_STATS), the lowest free heap seen and
+ * the number of pbuf allocation failures of the WiFi interface, so that the
+ * effect of a stack or driver change can be seen in one run.
+ *
+ * Reports are logged every interval_s seconds and at the end of a test. The
+ * final report of the last test can be read with iperf_wait. Only one
+ * benchmark runs at a time.
+ */
+
+/** Most parallel streams of a client */
+#define IPERF_MAX_STREAMS       4
+
+/** Longest UDP datagram sent or received */
+#define IPERF_UDP_LEN_MAX       1472
+
+typedef enum {
+    IPERF_CLIENT,               ///< Send to an iperf server for time_s seconds
+    IPERF_SERVER,               ///< Receive from iperf clients until stopped
+    IPERF_PING,                 ///< Send messages to an echo server and time the replies
+    IPERF_ECHO,                 ///< Send back what is received, for IPERF_PING
+} iperf_mode_t;
+
+typedef struct {
+    iperf_mode_t mode;
+    bool     udp;               ///< UDP instead of TCP
+    uint32_t addr;              ///< IPv4 address of the server, in network byte order (client and ping)
+    uint16_t port;              ///< Port of the server, or to listen on
+    uint16_t len;               ///< Bytes per send or receive call, datagram or message size
+    uint8_t  streams;           ///< Parallel connections of a client, 1 to IPERF_MAX_STREAMS
+    uint32_t time_s;            ///< Duration of a client or ping test; servers stop after it unless 0
+    uint32_t interval_s;        ///< Report interval, 0 for final reports only
+    uint32_t udp_kbps;          ///< Send rate of a UDP client over all streams, 0 for as fast as possible
+} iperf_config_t;
+
+#define IPERF_CONFIG_DEFAULT(mode_, addr_) { \
+    .mode = (mode_), \
+    .udp = false, \
+    .addr = (addr_), \
+    .port = 5001, \
+    .len = 1460, \
+    .streams = 1, \
+    .time_s = 10, \
+    .interval_s = 1, \
+    .udp_kbps = 1000, \
+}
+
+typedef struct {
+    uint32_t duration_ms;       ///< Length of the reported interval or test
+    uint64_t bytes;             ///< Payload bytes sent or received
+    uint32_t kbps;              ///< Throughput in kilobits per second
+    uint32_t datagrams;         ///< UDP datagrams sent or received
+    uint32_t lost;              ///< UDP datagrams missing in the sequence, or ping replies not received
+    uint32_t out_of_order;      ///< UDP datagrams received after a later one
+    uint32_t send_errors;       ///< Sends which failed, mostly for lack of buffers
+    uint32_t rtt_samples;       ///< Ping replies received
+    uint32_t rtt_min_us;
+    uint32_t rtt_avg_us;
+    uint32_t rtt_max_us;
+    uint8_t  cpu_load[portNUM_PROCESSORS]; ///< Percentage of time each core wasn't idle, 0xff if unknown
+    uint32_t heap_min_free;     ///< Lowest free heap seen during the interval
+    uint32_t heap_min_ever;     ///< Lowest free heap since boot
+    uint32_t pbuf_failures;     ///< pbuf allocation failures of the interface during the interval
+} iperf_report_t;
+
+/**
+ * @brief Start a benchmark
+ *
+ * Runs in the background. A client or ping test ends after time_s seconds,
+ * a server keeps serving one test after the other until iperf_stop is called
+ * or time_s has passed. A TCP server test lasts from the first connection
+ * until all connections are closed, a UDP server test until the client
+ * sends its final datagram.
+ *
+ * @param config configuration, copied
+ *
+ * @return
+ *         - ESP_OK on success
+ *         - ESP_ERR_INVALID_STATE if a benchmark is running
+ *         - ESP_ERR_INVALID_ARG if the configuration is invalid
+ *         - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t iperf_start(const iperf_config_t* config);
+
+/**
+ * @brief Stop the running benchmark and wait for it to end
+ *
+ * Open connections are closed. Also releases a benchmark which has ended.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if no benchmark was started
+ */
+esp_err_t iperf_stop();
+
+/**
+ * @brief Wait for the end of the next test and get its final report
+ *
+ * @param report filled in with the final report
+ * @param timeout ticks to wait
+ *
+ * @return ESP_OK, ESP_ERR_TIMEOUT, or ESP_ERR_INVALID_STATE if no benchmark
+ *         was started
+ */
+esp_err_t iperf_wait(iperf_report_t* report, TickType_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IPERF_H__ */
@@ -0,0 +1,90 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __NETLOG_H__
+#define __NETLOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Network log sink
+ *
+ * Sends log output over UDP, to a host which runs for example
+ * "nc -klu 5140". Log lines are appended to a bounded queue by the function
+ * installed with esp_log_set_vprintf, which never touches the network. A
+ * task takes lines from the queue and sends them in datagrams of up to
+ * NETLOG_DATAGRAM_MAX bytes, so that one datagram carries many lines.
+ *
+ * When the queue is full, the oldest lines are dropped to make room for new
+ * ones. A line telling how many lines have been dropped is sent once there
+ * is room again.
+ *
+ * Combined with esp_log_async_start, logging tasks only format their lines
+ * and the log task appends them to the queue.
+ */
+
+/** UDP payload which fits into one Ethernet or WiFi frame without fragmentation */
+#define NETLOG_DATAGRAM_MAX     1472
+
+typedef struct {
+    uint32_t addr;              ///< IPv4 address of the log host, in network byte order
+    uint16_t port;              ///< UDP port of the log host
+    uint32_t queue_size;        ///< Bytes of log lines queued while they wait to be sent
+    uint32_t flush_ms;          ///< Time after which a datagram is sent even if not full
+    uint32_t max_datagrams_per_sec; ///< Rate limit, 0 for no limit
+    bool     echo;              ///< Also pass log lines to the previous output function
+} netlog_config_t;
+
+#define NETLOG_CONFIG_DEFAULT(host_addr) { \
+    .addr = (host_addr), \
+    .port = 5140, \
+    .queue_size = 4096, \
+    .flush_ms = 200, \
+    .max_datagrams_per_sec = 20, \
+    .echo = false, \
+}
+
+/**
+ * @brief Start sending log output to a log host
+ *
+ * Creates the queue and the sender task, and installs the log output function.
+ * Lines logged before an IP address has been obtained are kept in the queue,
+ * as long as it has room.
+ *
+ * @param config configuration, copied
+ *
+ * @return
+ *         - ESP_OK on success
+ *         - ESP_ERR_INVALID_STATE if already started
+ *         - ESP_ERR_NO_MEM if out of memory
+ *         - ESP_FAIL if the socket can't be created
+ */
+esp_err_t netlog_start(const netlog_config_t* config);
+
+/**
+ * @brief Get the number of lines dropped because the queue was full
+ */
+uint32_t netlog_get_dropped();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __NETLOG_H__ */
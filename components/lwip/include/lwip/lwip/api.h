@@ -59,6 +59,7 @@ extern "C" {
 #define NETCONN_COPY      0x01
 #define NETCONN_MORE      0x02
 #define NETCONN_DONTBLOCK 0x04
+#define NETCONN_REF       0x08 /* Reference the data even with LWIP_NETIF_TX_SINGLE_PBUF */
 
 /* Flags for struct netconn.flags (u8_t) */
 /** Should this netconn avoid blocking? */
@@ -134,7 +135,9 @@ enum netconn_evt {
   NETCONN_EVT_RCVMINUS,
   NETCONN_EVT_SENDPLUS,
   NETCONN_EVT_SENDMINUS,
-  NETCONN_EVT_ERROR
+  NETCONN_EVT_ERROR,
+  /** data was acknowledged (TCP, only with LWIP_SOCKET_ZEROCOPY) */
+  NETCONN_EVT_SENT
 };
 
 #if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
@@ -282,6 +285,7 @@ void    netconn_recved(struct netconn *conn, u32_t length);
 err_t   netconn_sendto(struct netconn *conn, struct netbuf *buf,
                              const ip_addr_t *addr, u16_t port);
 err_t   netconn_send(struct netconn *conn, struct netbuf *buf);
+err_t   netconn_send_multi(struct netconn *conn, struct netbuf *bufs, u16_t num, u16_t *sent);
 err_t   netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
                              u8_t apiflags, size_t *bytes_written);
 #define netconn_write(conn, dataptr, size, apiflags) \
@@ -147,6 +147,25 @@ void dhcp_cleanup(struct netif *netif);
 /* Espressif add start. */
 /** set callback for DHCP */
 void dhcp_set_cb(struct netif *netif, void (*cb)(void));
+
+/** A lease obtained by the DHCP client, as returned by dhcp_get_lease() */
+struct dhcp_lease_info
+{
+  ip4_addr_t ip_addr;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+  ip4_addr_t server;   /* dhcp server which granted the lease */
+  u32_t lease_time;    /* lease period (in seconds), 0xffffffff if infinite */
+  u32_t lease_used;    /* seconds of the lease period already used up */
+#if LWIP_DNS
+  ip4_addr_t dns_server[DNS_MAX_SERVERS];
+#endif /* LWIP_DNS */
+};
+
+/** get the lease the interface is bound to */
+err_t dhcp_get_lease(struct netif *netif, struct dhcp_lease_info *lease);
+/** start DHCP configuration by asking to keep a previous lease (INIT-REBOOT) */
+err_t dhcp_start_with_lease(struct netif *netif, const struct dhcp_lease_info *lease, u8_t use_now);
 /* Espressif add end. */
 /** start DHCP configuration */
 err_t dhcp_start(struct netif *netif);
@@ -171,8 +190,10 @@ u8_t dhcp_supplied_address(struct netif *netif);
 
 /** to be called every minute */
 void dhcp_coarse_tmr(void);
-/** to be called every half second */
+/** to be called every half second while dhcp_fine_pending() */
 void dhcp_fine_tmr(void);
+u8_t dhcp_fine_pending(void);
+void dhcp_fine_timer_needed(void);
 
 /** DHCP message item offsets and length */
 #define DHCP_OP_OFS       0
@@ -95,6 +95,8 @@ typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, vo
 
 void           dns_init(void);
 void           dns_tmr(void);
+u8_t           dns_pending(void);
+void           dns_timer_needed(void);
 void           dns_setserver(u8_t numdns, const ip_addr_t *dnsserver);
 ip_addr_t      dns_getserver(u8_t numdns);
 err_t          dns_gethostbyname(const char *hostname, ip_addr_t *addr,
@@ -104,6 +106,27 @@ err_t          dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *addr,
                                  u8_t dns_addrtype);
 
 
+#if DNS_CACHE_SIZE
+/** Names of at most this length (including the terminating 0) are cached */
+#ifndef DNS_CACHE_NAME_LENGTH
+#define DNS_CACHE_NAME_LENGTH     64
+#endif
+
+/** DNS cache entry as saved by dns_cache_export. Only valid for the same
+ * build of lwIP, check the size when reading saved records. */
+struct dns_cache_record {
+  /** seconds until the entry expires, at the time of export */
+  u32_t ttl;
+  ip_addr_t ipaddr;
+  u8_t hits;
+  char name[DNS_CACHE_NAME_LENGTH];
+};
+
+void           dns_cache_clear(void);
+u16_t          dns_cache_export(struct dns_cache_record *records, u16_t max_records);
+void           dns_cache_import(const struct dns_cache_record *records, u16_t count, u32_t elapsed_s);
+#endif /* DNS_CACHE_SIZE */
+
 #if DNS_LOCAL_HOSTLIST && DNS_LOCAL_HOSTLIST_IS_DYNAMIC
 int            dns_local_removehost(const char *hostname, const ip_addr_t *addr);
 err_t          dns_local_addhost(const char *hostname, const ip_addr_t *addr);
@@ -72,6 +72,10 @@ extern "C" {
 struct igmp_group {
     /** next link */
   struct igmp_group *next;
+#if IGMP_GROUP_HASH_SIZE
+  /** next group in the same bucket of the hash table */
+  struct igmp_group *hash_next;
+#endif /* IGMP_GROUP_HASH_SIZE */
   /** interface on which the group is active */
   struct netif      *netif;
   /** multicast address */
@@ -98,6 +102,8 @@ err_t  igmp_joingroup_netif(struct netif *netif, const ip4_addr_t *groupaddr);
 err_t  igmp_leavegroup(const ip4_addr_t *ifaddr, const ip4_addr_t *groupaddr);
 err_t  igmp_leavegroup_netif(struct netif *netif, const ip4_addr_t *groupaddr);
 void   igmp_tmr(void);
+u8_t   igmp_pending(void);
+void   igmp_timer_needed(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,44 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LWIP_HDR_IP4_NAPT_H
+#define LWIP_HDR_IP4_NAPT_H
+
+#include "lwip/opt.h"
+
+#if IP_NAPT
+
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "lwip/ip4.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Translate the packets forwarded from netif (e.g. the soft-AP) to the
+ * address of the interface they leave on, or stop doing so. */
+void ip_napt_enable_netif(struct netif *netif, u8_t enable);
+
+/* Called by ip4_input and ip4_forward, not for use by applications */
+u8_t ip_napt_recv(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp);
+err_t ip_napt_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp, struct netif *outp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IP_NAPT */
+
+#endif /* LWIP_HDR_IP4_NAPT_H */
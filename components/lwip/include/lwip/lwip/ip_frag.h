@@ -64,6 +64,8 @@ struct ip_reassdata {
 
 void ip_reass_init(void);
 void ip_reass_tmr(void);
+u8_t ip_reass_pending(void);
+void ip_reass_timer_needed(void);
 struct pbuf * ip4_reass(struct pbuf *p);
 #endif /* IP_REASSEMBLY */
 
@@ -70,9 +70,16 @@ extern const struct memp_desc* const memp_pools[MEMP_MAX];
 
 #include "lwip/mem.h"
 
+#if ESP_MEMP_POOLS
+/* Implemented in port/memp_pools.c on top of esp_mempool */
+void  memp_init(void);
+void *memp_malloc(memp_t type);
+void  memp_free(memp_t type, void *mem);
+#else
 #define memp_init()
 #define memp_malloc(type)     mem_malloc(memp_pools[type]->size)
 #define memp_free(type, mem)  mem_free(mem)
+#endif /* ESP_MEMP_POOLS */
 
 #define LWIP_MEMPOOL_DECLARE(name,num,size,desc) \
   const struct memp_desc memp_ ## name = { \
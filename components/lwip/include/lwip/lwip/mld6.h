@@ -58,6 +58,10 @@ extern "C" {
 struct mld_group {
   /** next link */
   struct mld_group *next;
+#if MLD6_GROUP_HASH_SIZE
+  /** next group in the same bucket of the hash table */
+  struct mld_group *hash_next;
+#endif /* MLD6_GROUP_HASH_SIZE */
   /** interface on which the group is active */
   struct netif      *netif;
   /** multicast address */
@@ -102,6 +106,8 @@ PACK_STRUCT_END
 err_t  mld6_stop(struct netif *netif);
 void   mld6_report_groups(struct netif *netif);
 void   mld6_tmr(void);
+u8_t   mld6_pending(void);
+void   mld6_timer_needed(void);
 struct mld_group *mld6_lookfor_group(struct netif *ifp, const ip6_addr_t *addr);
 void   mld6_input(struct pbuf *p, struct netif *inp);
 err_t  mld6_joingroup(const ip6_addr_t *srcaddr, const ip6_addr_t *groupaddr);
@@ -322,7 +322,20 @@ struct netif {
 
 #if LWIP_NETIF_HWADDRHINT
   u8_t *addr_hint;
+#else /* LWIP_NETIF_HWADDRHINT */
+#if LWIP_IPV4 && LWIP_ARP
+  /** ARP table index of the last unicast destination of this netif */
+  u8_t etharp_hint;
+#endif /* LWIP_IPV4 && LWIP_ARP */
 #endif /* LWIP_NETIF_HWADDRHINT */
+#if LWIP_IPV6
+  /** neighbor cache index of the last next hop of this netif */
+  u8_t nd6_hint;
+#endif /* LWIP_IPV6 */
+#if IP_NAPT
+  /** translate packets forwarded from this netif, see ip_napt_enable_netif() */
+  u8_t napt;
+#endif /* IP_NAPT */
 #if ENABLE_LOOPBACK
   /* List of packets to be queued for ourselves. */
   struct pbuf *loop_first;
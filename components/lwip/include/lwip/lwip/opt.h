@@ -451,6 +451,15 @@
 #define ARP_TABLE_SIZE                  10
 #endif
 
+/**
+ * ARP_TABLE_HASH_SIZE: Number of chains of the hash index of the ARP table,
+ * by which address resolution finds an entry without searching the table.
+ * 0 searches the table.
+ */
+#ifndef ARP_TABLE_HASH_SIZE
+#define ARP_TABLE_HASH_SIZE             0
+#endif
+
 /** the time an ARP entry stays valid after its last update,
  *  for ARP_TMR_INTERVAL = 1000, this is
  *  (60 * 5) seconds = 5 minutes.
@@ -580,6 +589,8 @@
 /* disable IPv4 extensions when IPv4 is disabled */
 #undef IP_FORWARD
 #define IP_FORWARD                      0
+#undef IP_NAPT
+#define IP_NAPT                         0
 #undef IP_REASSEMBLY
 #define IP_REASSEMBLY                   0
 #undef IP_FRAG
@@ -614,6 +625,16 @@
 #define IP_REASS_MAX_PBUFS              10
 #endif
 
+/**
+ * IP_REASS_MAX_PBUFS_PER_SRC: Maximum amount of pbufs waiting to be
+ * reassembled which were sent by the same source address. Fragments above
+ * this limit are dropped, so a single host can't use up IP_REASS_MAX_PBUFS.
+ * Set to IP_REASS_MAX_PBUFS to disable the per-source limit.
+ */
+#ifndef IP_REASS_MAX_PBUFS_PER_SRC
+#define IP_REASS_MAX_PBUFS_PER_SRC      IP_REASS_MAX_PBUFS
+#endif
+
 /**
  * IP_FRAG_USES_STATIC_BUF==1: Use a static MTU-sized buffer for IP
  * fragmentation. Otherwise pbufs are allocated and reference the original
@@ -668,6 +689,51 @@
 #define IP_FORWARD_ALLOW_TX_ON_RX_NETIF 0
 #endif
 
+/**
+ * IP_NAPT==1: Translate the source address and port of packets forwarded
+ * from interfaces with NAPT enabled (see ip_napt_enable_netif) to those of
+ * the outgoing interface. Requires IP_FORWARD.
+ */
+#ifndef IP_NAPT
+#define IP_NAPT                         0
+#endif
+
+/**
+ * IP_NAPT_MAX: Number of connections translated at the same time.
+ */
+#ifndef IP_NAPT_MAX
+#define IP_NAPT_MAX                     128
+#endif
+
+/**
+ * IP_NAPT_PORT_RANGE_START, IP_NAPT_PORT_RANGE_END: Ports used for the
+ * translated connections on the outgoing interface. Local pcbs must not be
+ * bound to them.
+ */
+#ifndef IP_NAPT_PORT_RANGE_START
+#define IP_NAPT_PORT_RANGE_START        0x6400
+#endif
+#ifndef IP_NAPT_PORT_RANGE_END
+#define IP_NAPT_PORT_RANGE_END          0x67ff
+#endif
+
+/**
+ * IP_NAPT_TIMEOUT_MS_xxx: Time without traffic after which a translated
+ * connection is forgotten.
+ */
+#ifndef IP_NAPT_TIMEOUT_MS_TCP
+#define IP_NAPT_TIMEOUT_MS_TCP          (30*60*1000)
+#endif
+#ifndef IP_NAPT_TIMEOUT_MS_TCP_DISCON
+#define IP_NAPT_TIMEOUT_MS_TCP_DISCON   (10*1000)
+#endif
+#ifndef IP_NAPT_TIMEOUT_MS_UDP
+#define IP_NAPT_TIMEOUT_MS_UDP          (60*1000)
+#endif
+#ifndef IP_NAPT_TIMEOUT_MS_ICMP
+#define IP_NAPT_TIMEOUT_MS_ICMP         (10*1000)
+#endif
+
 /**
  * LWIP_RANDOMIZE_INITIAL_LOCAL_PORTS==1: randomize the local port for the first
  * local TCP/UDP pcb (default==0). This can prevent creating predictable port
@@ -861,6 +927,15 @@
 #define LWIP_MULTICAST_TX_OPTIONS       LWIP_IGMP
 #endif
 
+/**
+ * IGMP_GROUP_HASH_SIZE: Number of buckets of a hash table of the joined
+ * groups by their address, searched by igmp_lookfor_group for each received
+ * multicast datagram instead of the list of all groups. 0 disables the table.
+ */
+#ifndef IGMP_GROUP_HASH_SIZE
+#define IGMP_GROUP_HASH_SIZE            0
+#endif
+
 /*
    ----------------------------------
    ---------- DNS options -----------
@@ -929,6 +1004,26 @@
 #define DNS_LOCAL_HOSTLIST_IS_DYNAMIC   0
 #endif /* DNS_LOCAL_HOSTLIST_IS_DYNAMIC */
 
+/** DNS_CACHE_SIZE: Number of entries of the DNS cache, a hash table which keeps
+ * the results of queries for their TTL, in addition to the DNS table (which
+ * only keeps them until its entry is needed for another query). 0 disables it. */
+#ifndef DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE                  0
+#endif
+
+/** DNS_NEGATIVE_TTL: Seconds for which the DNS cache remembers that a name
+ * doesn't exist (NXDOMAIN). 0 disables negative caching. */
+#ifndef DNS_NEGATIVE_TTL
+#define DNS_NEGATIVE_TTL                0
+#endif
+
+/** DNS_PARALLEL_QUERIES==1: Send each query to all DNS servers at once and use
+ * the first answer, and ask for the A and AAAA records at the same time when
+ * either address type may be used. */
+#ifndef DNS_PARALLEL_QUERIES
+#define DNS_PARALLEL_QUERIES            0
+#endif
+
 /*
    ---------------------------------
    ---------- UDP options ----------
@@ -1071,7 +1166,7 @@
 
 /**
  * TCP_OOSEQ_MAX_BYTES: The maximum number of bytes queued on ooseq per pcb.
- * Default is 0 (no limit). Only valid for TCP_QUEUE_OOSEQ==0.
+ * Default is 0 (no limit). Only valid for TCP_QUEUE_OOSEQ==1.
  */
 #ifndef TCP_OOSEQ_MAX_BYTES
 #define TCP_OOSEQ_MAX_BYTES             0
@@ -1079,7 +1174,7 @@
 
 /**
  * TCP_OOSEQ_MAX_PBUFS: The maximum number of pbufs queued on ooseq per pcb.
- * Default is 0 (no limit). Only valid for TCP_QUEUE_OOSEQ==0.
+ * Default is 0 (no limit). Only valid for TCP_QUEUE_OOSEQ==1.
  */
 #ifndef TCP_OOSEQ_MAX_PBUFS
 #define TCP_OOSEQ_MAX_PBUFS             0
@@ -1092,6 +1187,34 @@
 #define TCP_LISTEN_BACKLOG              0
 #endif
 
+/**
+ * TCP_PCB_HASH_SIZE: Number of buckets of the hash tables tcp_input uses to
+ * find the pcb of an incoming segment: one of active and TIME-WAIT pcbs,
+ * hashed by remote address and both ports, and one of listening pcbs, indexed
+ * by the local port. 0 searches the pcb lists instead.
+ */
+#ifndef TCP_PCB_HASH_SIZE
+#define TCP_PCB_HASH_SIZE               0
+#endif
+
+/**
+ * TCP_TMR_IDLE_SLEEP==1: While no pcb has a retransmission, delayed ACK or
+ * other per-tick work pending, the TCP timer sleeps until the first deadline
+ * of a pcb (poll, keepalive, FIN-WAIT-2 or TIME-WAIT timeout) instead of
+ * running every TCP_TMR_INTERVAL. Needs sys_now().
+ */
+#ifndef TCP_TMR_IDLE_SLEEP
+#define TCP_TMR_IDLE_SLEEP              0
+#endif
+
+/**
+ * TCP_TMR_IDLE_MAX_TICKS: Longest sleep of the TCP timer, in slow timer
+ * ticks (TCP_SLOW_INTERVAL).
+ */
+#ifndef TCP_TMR_IDLE_MAX_TICKS
+#define TCP_TMR_IDLE_MAX_TICKS          (3600 * 1000 / TCP_SLOW_INTERVAL)
+#endif
+
 /**
  * The maximum allowed backlog for TCP listen netconns.
  * This backlog is used unless another is explicitly specified.
@@ -1129,6 +1252,18 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_TCP_SACK==1: support selective acknowledgements (RFC 2018), when the
+ * remote host agrees to them in the SYN. ACKs sent while segments are on
+ * ooseq report them, so that the remote host only retransmits what is
+ * missing. For data sent, fast recovery retransmits each segment which the
+ * remote host reported as missing once per duplicate or partial ACK,
+ * instead of only the first unacknowledged segment.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
@@ -1567,6 +1702,46 @@
 #define LWIP_SOCKET_OFFSET              0
 #endif
 
+/**
+ * LWIP_SOCKET_SELECT_HOOKS==1: Enable lwip_select_start() and lwip_select_end(),
+ * with which a select() implemented outside of lwIP can wait for sockets and
+ * other file descriptors at the same time. select() is not defined to
+ * lwip_select() then, it has to be provided by that implementation.
+ * Requires LWIP_NETCONN_SEM_PER_THREAD. (only used if you use sockets.c)
+ */
+#ifndef LWIP_SOCKET_SELECT_HOOKS
+#define LWIP_SOCKET_SELECT_HOOKS        0
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL_NUM==n: The number of epoll instances which can be created
+ * with lwip_epoll_create() at the same time. 0 leaves out the epoll functions.
+ * (only used if you use sockets.c)
+ */
+#ifndef LWIP_SOCKET_EPOLL_NUM
+#define LWIP_SOCKET_EPOLL_NUM           0
+#endif
+
+/**
+ * LWIP_SOCKET_ZEROCOPY==1: Enable lwip_recv_pbuf(), which returns the received
+ * pbufs instead of copying them, and lwip_send_nocopy(), which sends from
+ * a buffer owned by the caller until the data is acknowledged.
+ * (only used if you use sockets.c)
+ */
+#ifndef LWIP_SOCKET_ZEROCOPY
+#define LWIP_SOCKET_ZEROCOPY            0
+#endif
+
+/**
+ * LWIP_SOCKET_MMSG_BATCH==n: The number of datagrams lwip_sendmmsg() passes
+ * to tcpip_thread with one message. The netbufs of a batch are kept on the
+ * stack of the calling thread.
+ * (only used if you use sockets.c)
+ */
+#ifndef LWIP_SOCKET_MMSG_BATCH
+#define LWIP_SOCKET_MMSG_BATCH          8
+#endif
+
 /**
  * LWIP_TCP_KEEPALIVE==1: Enable TCP_KEEPIDLE, TCP_KEEPINTVL and TCP_KEEPCNT
  * options processing. Note that TCP_KEEPIDLE and TCP_KEEPINTVL have to be set
@@ -2490,6 +2665,15 @@
 #define MEMP_NUM_MLD6_GROUP             4
 #endif
 
+/**
+ * MLD6_GROUP_HASH_SIZE: Number of buckets of a hash table of the joined
+ * groups by their address, searched by mld6_lookfor_group for each received
+ * multicast packet instead of the list of all groups. 0 disables the table.
+ */
+#ifndef MLD6_GROUP_HASH_SIZE
+#define MLD6_GROUP_HASH_SIZE            0
+#endif
+
 /**
  * LWIP_IPV6_FRAG==1: Fragment outgoing IPv6 packets that are too big.
  */
@@ -2526,6 +2710,14 @@
 #define LWIP_ND6_NUM_NEIGHBORS          10
 #endif
 
+/**
+ * LWIP_ND6_NEIGHBOR_HASH_SIZE: Number of chains of the hash index of the
+ * IPv6 neighbor cache, 0 to search the cache.
+ */
+#ifndef LWIP_ND6_NEIGHBOR_HASH_SIZE
+#define LWIP_ND6_NEIGHBOR_HASH_SIZE     0
+#endif
+
 /**
  * LWIP_ND6_NUM_DESTINATIONS: number of entries in IPv6 destination cache
  */
@@ -42,6 +42,9 @@ LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,         sizeof(struct udp_pcb),
 LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,         sizeof(struct tcp_pcb),        "TCP_PCB")
 LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN,  sizeof(struct tcp_pcb_listen), "TCP_PCB_LISTEN")
 LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),        "TCP_SEG")
+#if ESP_TCP_SND_PBUF_POOL_SIZE
+LWIP_MEMPOOL(TCP_SND_PBUF,   ESP_TCP_SND_PBUF_POOL_SIZE, TCP_SND_PBUF_ELEM_SIZE,      "TCP_SND_PBUF")
+#endif /* ESP_TCP_SND_PBUF_POOL_SIZE */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV4 && IP_REASSEMBLY
@@ -130,6 +133,9 @@ LWIP_MEMPOOL(MLD6_GROUP,     MEMP_NUM_MLD6_GROUP,      sizeof(struct mld_group),
  */
 LWIP_PBUF_MEMPOOL(PBUF,      MEMP_NUM_PBUF,            0,                             "PBUF_REF/ROM")
 LWIP_PBUF_MEMPOOL(PBUF_POOL, PBUF_POOL_SIZE,           PBUF_POOL_BUFSIZE,             "PBUF_POOL")
+#if ESP_RX_PBUF_POOL_SIZE
+LWIP_MEMPOOL(RX_PBUF,        ESP_RX_PBUF_POOL_SIZE,    sizeof(struct pbuf_custom),    "RX_PBUF")
+#endif /* ESP_RX_PBUF_POOL_SIZE */
 
 
 /*
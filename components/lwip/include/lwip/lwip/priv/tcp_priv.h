@@ -60,6 +60,11 @@ void             tcp_tmr     (void);  /* Must be called every
    intervals (instead of calling tcp_tmr()). */
 void             tcp_slowtmr (void);
 void             tcp_fasttmr (void);
+#if TCP_TMR_IDLE_SLEEP
+/* Used by the TCP timer to sleep while all pcbs are idle. */
+u32_t            tcp_tmr_idle_ticks(void);
+void             tcp_tmr_resume(u32_t ticks);
+#endif /* TCP_TMR_IDLE_SLEEP */
 
 /* Call this from a netif driver (watch out for threading issues!) that has
    returned a memory error on transmit and now has free buffers to send more.
@@ -76,6 +81,9 @@ err_t            tcp_send_empty_ack(struct tcp_pcb *pcb);
 void             tcp_rexmit  (struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+u8_t             tcp_rexmit_sack (struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -87,15 +95,27 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
  * - the only unsent segment is at least pcb->mss bytes long (or there is more
  *   than one unsent segment - with lwIP, this can happen although unsent->len < mss)
  * - or if we are in fast-retransmit (TF_INFR)
+ * The first two don't apply while the pcb is corked (TF_CORK) or the last write
+ * had MSG_MORE (TF_MORE): then only full segments are sent, until tcp_fasttmr
+ * flushes the rest.
  */
-#define tcp_do_output_nagle(tpcb) ((((tpcb)->unacked == NULL) || \
-                            ((tpcb)->flags & (TF_NODELAY | TF_INFR)) || \
+#define tcp_do_output_nagle(tpcb) ((((((tpcb)->unacked == NULL) || ((tpcb)->flags & TF_NODELAY)) && \
+                              (((tpcb)->flags & (TF_CORK | TF_MORE)) == 0)) || \
+                            ((tpcb)->flags & TF_INFR) || \
                             (((tpcb)->unsent != NULL) && (((tpcb)->unsent->next != NULL) || \
                               ((tpcb)->unsent->len >= (tpcb)->mss))) || \
                             ((tcp_sndbuf(tpcb) == 0) || (tcp_sndqueuelen(tpcb) >= TCP_SND_QUEUELEN)) \
                             ) ? 1 : 0)
 #define tcp_output_nagle(tpcb) (tcp_do_output_nagle(tpcb) ? tcp_output(tpcb) : ERR_OK)
 
+#if ESP_TCP_SND_PBUF_POOL_SIZE
+/** Size of the MEMP_TCP_SND_PBUF elements: a custom pbuf with room for the
+ * headers and TCP_MSS bytes of data */
+#define TCP_SND_PBUF_ELEM_SIZE (LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf_custom)) + \
+                                LWIP_MEM_ALIGN_SIZE(PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN + \
+                                                    PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN) + TCP_MSS)
+#endif /* ESP_TCP_SND_PBUF_POOL_SIZE */
+
 
 #define TCP_SEQ_LT(a,b)     ((s32_t)((u32_t)(a) - (u32_t)(b)) < 0)
 #define TCP_SEQ_LEQ(a,b)    ((s32_t)((u32_t)(a) - (u32_t)(b)) <= 0)
@@ -300,6 +320,9 @@ struct tcp_seg {
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK permitted option */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Selectively acknowledged by the
+                                               remote host */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
@@ -308,6 +331,8 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
 #define LWIP_TCP_OPT_TS         8
+#define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 
 #define LWIP_TCP_OPT_LEN_MSS    4
 #if LWIP_TCP_TIMESTAMPS
@@ -322,11 +347,22 @@ struct tcp_seg {
 #else
 #define LWIP_TCP_OPT_LEN_WS_OUT 0
 #endif
+#if LWIP_TCP_SACK
+#define LWIP_TCP_OPT_LEN_SACK_PERM     2
+#define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 4 /* aligned for output (includes NOP padding) */
+/* SACK option with n blocks, aligned for output (includes NOP padding) */
+#define LWIP_TCP_OPT_LEN_SACK_OUT(n)   (4 + 8 * (n))
+/* Most blocks of a received SACK option which are processed */
+#define LWIP_TCP_MAX_SACK_NUM          4
+#else
+#define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 0
+#endif
 
 #define LWIP_TCP_OPT_LENGTH(flags) \
   (flags & TF_SEG_OPTS_MSS       ? LWIP_TCP_OPT_LEN_MSS    : 0) + \
   (flags & TF_SEG_OPTS_TS        ? LWIP_TCP_OPT_LEN_TS_OUT : 0) + \
-  (flags & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT : 0)
+  (flags & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT : 0) + \
+  (flags & TF_SEG_OPTS_SACK_PERM ? LWIP_TCP_OPT_LEN_SACK_PERM_OUT : 0)
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) htonl(0x02040000 | ((mss) & 0xFFFF))
@@ -364,6 +400,22 @@ extern struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. *
 #define NUM_TCP_PCB_LISTS               4
 extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
+#if TCP_PCB_HASH_SIZE
+/* The pcbs of tcp_active_pcbs and tcp_tw_pcbs are in a hash table as well,
+   and those of tcp_listen_pcbs in a table indexed by the local port. TCP_REG
+   and TCP_RMV keep the tables in sync with the lists. */
+void tcp_pcb_hash_add(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+void tcp_pcb_hash_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+struct tcp_pcb *tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                                    const ip_addr_t *remote_ip, u16_t remote_port);
+struct tcp_pcb_listen *tcp_pcb_hash_lookup_listen(const ip_addr_t *local_ip, u16_t local_port);
+#define TCP_HASH_ADD(pcbs, npcb)  tcp_pcb_hash_add(pcbs, npcb)
+#define TCP_HASH_RMV(pcbs, npcb)  tcp_pcb_hash_remove(pcbs, npcb)
+#else /* TCP_PCB_HASH_SIZE */
+#define TCP_HASH_ADD(pcbs, npcb)
+#define TCP_HASH_RMV(pcbs, npcb)
+#endif /* TCP_PCB_HASH_SIZE */
+
 /* Axioms about the above lists:
    1) Every TCP PCB that is not CLOSED is in one of the lists.
    2) A PCB is only in one of the lists.
@@ -388,6 +440,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_HASH_ADD(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
@@ -395,6 +448,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             struct tcp_pcb *tcp_tmp_pcb; \
                             LWIP_ASSERT("TCP_RMV: pcbs != NULL", *(pcbs) != NULL); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removing %p from %p\n", (npcb), *(pcbs))); \
+                            TCP_HASH_RMV(pcbs, npcb); \
                             if(*(pcbs) == (npcb)) { \
                                *(pcbs) = (*pcbs)->next; \
                             } else for (tcp_tmp_pcb = *(pcbs); tcp_tmp_pcb != NULL; tcp_tmp_pcb = tcp_tmp_pcb->next) { \
@@ -414,11 +468,13 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
+    TCP_HASH_ADD(pcbs, npcb);                      \
     tcp_timer_needed();                            \
   } while (0)
 
 #define TCP_RMV(pcbs, npcb)                        \
   do {                                             \
+    TCP_HASH_RMV(pcbs, npcb);                      \
     if(*(pcbs) == (npcb)) {                        \
       (*(pcbs)) = (*pcbs)->next;                   \
     }                                              \
@@ -43,6 +43,9 @@
 #include "lwip/ip_addr.h"
 #include "lwip/err.h"
 #include "lwip/inet.h"
+#if LWIP_SOCKET_SELECT_HOOKS
+#include "lwip/sys.h"
+#endif /* LWIP_SOCKET_SELECT_HOOKS */
 
 #ifdef __cplusplus
 extern "C" {
@@ -155,6 +158,12 @@ struct msghdr {
   int           msg_flags;
 };
 
+/* A message for lwip_sendmmsg and lwip_recvmmsg */
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int  msg_len;
+};
+
 /* Socket protocol types (TCP/UDP/RAW) */
 #define SOCK_STREAM     1
 #define SOCK_DGRAM      2
@@ -233,6 +242,7 @@ struct linger {
 #define MSG_OOB        0x04    /* Unimplemented: Requests out-of-band data. The significance and semantics of out-of-band data are protocol-specific */
 #define MSG_DONTWAIT   0x08    /* Nonblocking i/o for this operation only */
 #define MSG_MORE       0x10    /* Sender will send more */
+#define MSG_TRUNC      0x20    /* Returned in msg_flags: the datagram was larger than the buffer */
 
 
 /*
@@ -250,6 +260,29 @@ struct linger {
 #define TCP_KEEPIDLE   0x03    /* set pcb->keep_idle  - Same as TCP_KEEPALIVE, but use seconds for get/setsockopt */
 #define TCP_KEEPINTVL  0x04    /* set pcb->keep_intvl - Use seconds for get/setsockopt */
 #define TCP_KEEPCNT    0x05    /* set pcb->keep_cnt   - Use number of probes sent for get/setsockopt */
+#define TCP_INFO       0x06    /* get struct tcp_info - only for getsockopt */
+#define TCP_CORK       0x07    /* only send full segments until uncorked (partial ones after 250 ms) */
+
+/** State of a TCP connection, returned by getsockopt(s, IPPROTO_TCP, TCP_INFO).
+ * Times are in milliseconds, windows and queues in bytes unless noted. */
+struct tcp_info {
+  u8_t  tcpi_state;          /* enum tcp_state */
+  u8_t  tcpi_retransmits;    /* retransmissions of the oldest unacked segment */
+  u16_t tcpi_snd_mss;
+  u32_t tcpi_rto;
+  u32_t tcpi_rtt;            /* smoothed round trip time */
+  u32_t tcpi_rttvar;
+  u32_t tcpi_snd_cwnd;
+  u32_t tcpi_snd_ssthresh;
+  u32_t tcpi_snd_wnd;        /* window announced by the peer */
+  u32_t tcpi_rcv_wnd;        /* window announced to the peer */
+  u32_t tcpi_unacked;        /* sent, not yet acknowledged */
+  u32_t tcpi_unsent;         /* written, not yet sent */
+  u32_t tcpi_snd_queuelen;   /* pbufs in the send queues */
+  u32_t tcpi_rcv_queuelen;   /* received packets not yet read by the application */
+  u32_t tcpi_total_retrans;  /* retransmissions since the connection was opened (TCP_STATS) */
+  u32_t tcpi_zerownd;        /* times the peer closed its window (TCP_STATS) */
+};
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV6
@@ -420,8 +453,8 @@ typedef struct fd_set
   unsigned char fd_bits [(FD_SETSIZE+7)/8];
 } fd_set;
 
-#elif LWIP_SOCKET_OFFSET
-#error LWIP_SOCKET_OFFSET does not work with external FD_SET!
+#elif (LWIP_SOCKET_OFFSET + MEMP_NUM_NETCONN + LWIP_SOCKET_EPOLL_NUM) > FD_SETSIZE
+#error LWIP_SOCKET_OFFSET is too large for the external FD_SET!
 #endif /* FD_SET */
 
 /** LWIP_TIMEVAL_PRIVATE: if you want to use the struct timeval provided
@@ -437,6 +470,58 @@ struct timeval {
 };
 #endif /* LWIP_TIMEVAL_PRIVATE */
 
+/* poll() events, used for lwip_poll */
+#ifndef POLLIN
+#define POLLIN     0x1
+#define POLLOUT    0x2
+#define POLLERR    0x4
+#define POLLNVAL   0x8
+
+typedef unsigned int nfds_t;
+
+struct pollfd
+{
+  int fd;
+  short events;
+  short revents;
+};
+#endif /* POLLIN */
+
+#if LWIP_SOCKET_EPOLL_NUM
+/* epoll events and operations, used for lwip_epoll_ctl and lwip_epoll_wait */
+#ifndef EPOLLIN
+#define EPOLLIN       0x001U
+#define EPOLLOUT      0x004U
+#define EPOLLERR      0x008U
+#define EPOLLONESHOT  (1U << 30)
+#define EPOLLET       (1U << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+typedef union epoll_data
+{
+  void *ptr;
+  int fd;
+  u32_t u32;
+} epoll_data_t;
+
+struct epoll_event
+{
+  u32_t events;
+  epoll_data_t data;
+};
+#endif /* EPOLLIN */
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+
+#if LWIP_SOCKET_ZEROCOPY
+struct pbuf;
+/** Called by lwip_send_nocopy() once the data is no longer referenced,
+    err is 0 if it was acknowledged or an errno if the connection failed */
+typedef void (*lwip_sent_fn)(int s, void *arg, int err);
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
 #define lwip_socket_init() /* Compatibility define, no init needed. */
 void lwip_socket_thread_init(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: initialize thread-local semaphore */
 void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destroy thread-local semaphore */
@@ -459,9 +544,17 @@ void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destro
 #define lwip_recvfrom     recvfrom
 #define lwip_send         send
 #define lwip_sendmsg      sendmsg
+#define lwip_sendmmsg     sendmmsg
+#define lwip_recvmmsg     recvmmsg
 #define lwip_sendto       sendto
 #define lwip_socket       socket
 #define lwip_select       select
+#define lwip_poll         poll
+#if LWIP_SOCKET_EPOLL_NUM
+#define lwip_epoll_create epoll_create
+#define lwip_epoll_ctl    epoll_ctl
+#define lwip_epoll_wait   epoll_wait
+#endif /* LWIP_SOCKET_EPOLL_NUM */
 #define lwip_ioctlsocket  ioctl
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
@@ -492,6 +585,9 @@ int lwip_recvfrom(int s, void *mem, size_t len, int flags,
       struct sockaddr *from, socklen_t *fromlen);
 int lwip_send(int s, const void *dataptr, size_t size, int flags);
 int lwip_sendmsg(int s, const struct msghdr *message, int flags);
+int lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+int lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+      struct timeval *timeout);
 int lwip_sendto(int s, const void *dataptr, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 int lwip_socket(int domain, int type, int protocol);
@@ -499,8 +595,27 @@ int lwip_write(int s, const void *dataptr, size_t size);
 int lwip_writev(int s, const struct iovec *iov, int iovcnt);
 int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
                 struct timeval *timeout);
+int lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+#if LWIP_SOCKET_EPOLL_NUM
+int lwip_epoll_create(int size);
+int lwip_epoll_close(int epfd);
+int lwip_epoll_ctl(int epfd, int op, int s, struct epoll_event *event);
+int lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+#endif /* LWIP_SOCKET_EPOLL_NUM */
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
+#if LWIP_SOCKET_SELECT_HOOKS
+void *lwip_select_start(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
+                        sys_sem_t *sem);
+void lwip_select_end(void *handle);
+#endif /* LWIP_SOCKET_SELECT_HOOKS */
+#if LWIP_SOCKET_ZEROCOPY
+int lwip_recv_pbuf(int s, struct pbuf **p, int flags,
+      struct sockaddr *from, socklen_t *fromlen);
+int lwip_recv_pbuf_free(int s, struct pbuf *p);
+int lwip_send_nocopy(int s, const void *dataptr, size_t size, int flags,
+      lwip_sent_fn sent, void *arg);
+#endif /* LWIP_SOCKET_ZEROCOPY */
 
 #if LWIP_COMPAT_SOCKETS
 #if LWIP_COMPAT_SOCKETS != 2
@@ -523,6 +638,9 @@ int lwip_recvfrom_r(int s, void *mem, size_t len, int flags,
       struct sockaddr *from, socklen_t *fromlen);
 int lwip_send_r(int s, const void *dataptr, size_t size, int flags);
 int lwip_sendmsg_r(int s, const struct msghdr *message, int flags);
+int lwip_sendmmsg_r(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+int lwip_recvmmsg_r(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+      struct timeval *timeout);
 int lwip_sendto_r(int s, const void *dataptr, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 int lwip_socket(int domain, int type, int protocol);
@@ -547,9 +665,19 @@ int lwip_fcntl_r(int s, int cmd, int val);
 #define recvfrom(s,mem,len,flags,from,fromlen)    lwip_recvfrom_r(s,mem,len,flags,from,fromlen)
 #define send(s,dataptr,size,flags)                lwip_send_r(s,dataptr,size,flags)
 #define sendmsg(s,message,flags)                  lwip_sendmsg_r(s,message,flags)
+#define sendmmsg(s,msgvec,vlen,flags)             lwip_sendmmsg_r(s,msgvec,vlen,flags)
+#define recvmmsg(s,msgvec,vlen,flags,timeout)     lwip_recvmmsg_r(s,msgvec,vlen,flags,timeout)
 #define sendto(s,dataptr,size,flags,to,tolen)     lwip_sendto_r(s,dataptr,size,flags,to,tolen)
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
+#if !LWIP_SOCKET_SELECT_HOOKS
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
+#endif /* !LWIP_SOCKET_SELECT_HOOKS */
+#define poll(fds,nfds,timeout)                    lwip_poll(fds,nfds,timeout)
+#if LWIP_SOCKET_EPOLL_NUM
+#define epoll_create(size)                        lwip_epoll_create(size)
+#define epoll_ctl(epfd,op,s,event)                lwip_epoll_ctl(epfd,op,s,event)
+#define epoll_wait(epfd,events,maxevents,timeout) lwip_epoll_wait(epfd,events,maxevents,timeout)
+#endif /* LWIP_SOCKET_EPOLL_NUM */
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl_r(s,cmd,argp)
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
@@ -577,9 +705,19 @@ int lwip_fcntl_r(int s, int cmd, int val);
 #define recvfrom(s,mem,len,flags,from,fromlen)    lwip_recvfrom(s,mem,len,flags,from,fromlen)
 #define send(s,dataptr,size,flags)                lwip_send(s,dataptr,size,flags)
 #define sendmsg(s,message,flags)                  lwip_sendmsg(s,message,flags)
+#define sendmmsg(s,msgvec,vlen,flags)             lwip_sendmmsg(s,msgvec,vlen,flags)
+#define recvmmsg(s,msgvec,vlen,flags,timeout)     lwip_recvmmsg(s,msgvec,vlen,flags,timeout)
 #define sendto(s,dataptr,size,flags,to,tolen)     lwip_sendto(s,dataptr,size,flags,to,tolen)
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
+#if !LWIP_SOCKET_SELECT_HOOKS
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
+#endif /* !LWIP_SOCKET_SELECT_HOOKS */
+#define poll(fds,nfds,timeout)                    lwip_poll(fds,nfds,timeout)
+#if LWIP_SOCKET_EPOLL_NUM
+#define epoll_create(size)                        lwip_epoll_create(size)
+#define epoll_ctl(epfd,op,s,event)                lwip_epoll_ctl(epfd,op,s,event)
+#define epoll_wait(epfd,events,maxevents,timeout) lwip_epoll_wait(epfd,events,maxevents,timeout)
+#endif /* LWIP_SOCKET_EPOLL_NUM */
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl(s,cmd,argp)
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
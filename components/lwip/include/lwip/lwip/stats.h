@@ -87,6 +87,12 @@ struct stats_igmp {
   STAT_COUNTER tx_report;        /* Sent reports. */
 };
 
+struct stats_tcp_ext {
+  STAT_COUNTER rto_rexmit;       /* Retransmissions after a timeout. */
+  STAT_COUNTER fast_rexmit;      /* Fast retransmissions. */
+  STAT_COUNTER zerownd;          /* Times the peer closed its window. */
+};
+
 struct stats_mem {
 #ifdef LWIP_DEBUG
   const char *name;
@@ -237,6 +243,7 @@ struct stats_ {
 #endif
 #if TCP_STATS
   struct stats_proto tcp;
+  struct stats_tcp_ext tcp_ext;
 #endif
 #if MEM_STATS
   struct stats_mem mem;
@@ -288,7 +295,8 @@ void stats_init(void);
 
 #if TCP_STATS
 #define TCP_STATS_INC(x) STATS_INC(x)
-#define TCP_STATS_DISPLAY() stats_display_proto(&lwip_stats.tcp, "TCP")
+#define TCP_STATS_DISPLAY() do { stats_display_proto(&lwip_stats.tcp, "TCP"); \
+                                 stats_display_tcp_ext(&lwip_stats.tcp_ext); } while(0)
 #else
 #define TCP_STATS_INC(x)
 #define TCP_STATS_DISPLAY()
@@ -446,6 +454,7 @@ void stats_display_igmp(struct stats_igmp *igmp, const char *name);
 void stats_display_mem(struct stats_mem *mem, const char *name);
 void stats_display_memp(struct stats_mem *mem, int index);
 void stats_display_sys(struct stats_sys *sys);
+void stats_display_tcp_ext(struct stats_tcp_ext *tcp_ext);
 #else /* LWIP_STATS_DISPLAY */
 #define stats_display()
 #define stats_display_proto(proto, name)
@@ -453,6 +462,7 @@ void stats_display_sys(struct stats_sys *sys);
 #define stats_display_mem(mem, name)
 #define stats_display_memp(mem, index)
 #define stats_display_sys(sys)
+#define stats_display_tcp_ext(tcp_ext)
 #endif /* LWIP_STATS_DISPLAY */
 
 #ifdef __cplusplus
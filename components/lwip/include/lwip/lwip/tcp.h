@@ -138,7 +138,7 @@ typedef u16_t tcpflags_t;
 #define TCPWND16(x)             (x)
 #define TCP_WND_MAX(pcb)        TCP_WND
 typedef u16_t tcpwnd_size_t;
-typedef u8_t tcpflags_t;
+typedef u16_t tcpflags_t;
 #endif
 
 enum tcp_state {
@@ -168,11 +168,19 @@ enum tcp_state {
 #define DEF_ACCEPT_CALLBACK
 #endif /* LWIP_CALLBACK_API */
 
+#if TCP_PCB_HASH_SIZE
+/* next pcb in the same bucket of the pcb hash tables */
+#define DEF_HASH_NEXT(type)  type *hash_next;
+#else /* TCP_PCB_HASH_SIZE */
+#define DEF_HASH_NEXT(type)
+#endif /* TCP_PCB_HASH_SIZE */
+
 /**
  * members common to struct tcp_pcb and struct tcp_listen_pcb
  */
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  DEF_HASH_NEXT(type) \
   void *callback_arg; \
   /* the accept callback for listen- and normal pcbs, if LWIP_CALLBACK_API */ \
   DEF_ACCEPT_CALLBACK \
@@ -204,6 +212,11 @@ struct tcp_pcb {
 #if LWIP_WND_SCALE
 #define TF_WND_SCALE   0x0100U /* Window Scale option enabled */
 #endif
+#define TF_CORK        0x0200U /* TCP_CORK: only send full segments */
+#define TF_MORE        0x0400U /* last write had MSG_MORE: only send full segments */
+#if LWIP_TCP_SACK
+#define TF_SACK        0x0800U /* Selective acknowledgements enabled */
+#endif /* LWIP_TCP_SACK */
 
   /* the rest of the fields are in host byte order
      as we have to do some math with them */
@@ -235,6 +248,14 @@ struct tcp_pcb {
   /* fast retransmit/recovery */
   u8_t dupacks;
   u32_t lastack; /* Highest acknowledged seqno. */
+#if LWIP_TCP_SACK
+  u32_t sack_high;    /* Highest seqno selectively acknowledged. */
+  u32_t sack_rexmit;  /* End of the data retransmitted in this recovery. */
+  u32_t sack_recover; /* snd_nxt when fast recovery started. */
+#if TCP_QUEUE_OOSEQ
+  u32_t rcv_sack_recent; /* seqno of the segment last put on ooseq. */
+#endif /* TCP_QUEUE_OOSEQ */
+#endif /* LWIP_TCP_SACK */
 
   /* congestion avoidance/control variables */
   tcpwnd_size_t cwnd;
@@ -301,6 +322,12 @@ struct tcp_pcb {
   /* KEEPALIVE counter */
   u8_t keep_cnt_sent;
 
+#if TCP_STATS
+  /* retransmissions and zero window stalls since the connection was opened */
+  u32_t rexmit_total;
+  u32_t zerownd_total;
+#endif /* TCP_STATS */
+
 #if LWIP_WND_SCALE
   u8_t snd_scale;
   u8_t rcv_scale;
@@ -355,6 +382,7 @@ void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 #define          tcp_nagle_disable(pcb)   ((pcb)->flags |= TF_NODELAY)
 #define          tcp_nagle_enable(pcb)    ((pcb)->flags = (tcpflags_t)((pcb)->flags & ~TF_NODELAY))
 #define          tcp_nagle_disabled(pcb)  (((pcb)->flags & TF_NODELAY) != 0)
+#define          tcp_corked(pcb)          (((pcb)->flags & TF_CORK) != 0)
 
 #if TCP_LISTEN_BACKLOG
 #define          tcp_accepted(pcb) do { \
@@ -384,6 +412,8 @@ err_t            tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx);
 /* Flags for "apiflags" parameter in tcp_write */
 #define TCP_WRITE_FLAG_COPY 0x01
 #define TCP_WRITE_FLAG_MORE 0x02
+/** Reference the data even if LWIP_NETIF_TX_SINGLE_PBUF would copy it */
+#define TCP_WRITE_FLAG_REF  0x08
 
 err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
                               u8_t apiflags);
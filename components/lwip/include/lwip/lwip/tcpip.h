@@ -67,6 +67,20 @@ struct tcpip_callback_msg* tcpip_callbackmsg_new(tcpip_callback_fn function, voi
 void   tcpip_callbackmsg_delete(struct tcpip_callback_msg* msg);
 err_t  tcpip_trycallback(struct tcpip_callback_msg* msg);
 
+#ifdef LWIP_ESP8266
+/** Counters of the tcpip thread input path */
+struct tcpip_stats {
+  u32_t rx_frames;        /* frames queued in the RX ring */
+  u32_t rx_dropped;       /* frames dropped because the RX ring was full */
+  u32_t rx_batches;       /* RX ring drains by the tcpip thread */
+  u32_t rx_ring_high_water;
+  u32_t mbox_post_failed; /* frames or RX ring wakeups which didn't fit in the mailbox */
+  u32_t mbox_high_water;  /* most messages seen in the mailbox */
+};
+
+void   tcpip_get_stats(struct tcpip_stats *stats);
+#endif /* LWIP_ESP8266 */
+
 /* free pbufs or heap memory from another context without blocking */
 err_t  pbuf_free_callback(struct pbuf *p);
 err_t  mem_free_callback(void *m);
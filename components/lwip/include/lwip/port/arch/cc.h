@@ -65,6 +65,8 @@ typedef int sys_prot_t;
 #define PACK_STRUCT_END
 
 #include <stdio.h>
+/* F_GETFL, O_NONBLOCK etc. have to match those of the fcntl() of the VFS */
+#include <fcntl.h>
 
 #define LWIP_PLATFORM_DIAG(x)   do {printf x;} while(0)
 #define LWIP_PLATFORM_ASSERT(x) do {printf(x); sys_arch_assert(__FILE__, __LINE__);} while(0)
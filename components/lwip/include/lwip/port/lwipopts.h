@@ -84,6 +84,13 @@ extern unsigned long os_random(void);
 */
 #define MEMP_MEM_MALLOC                 1
 
+/**
+ * ESP_MEMP_POOLS==1: With MEMP_MEM_MALLOC, serve memp_malloc()/memp_free() from
+ * fixed-size pools holding MEMP_NUM_xxx elements each (see esp_mempool.h), and
+ * only fall back to mem_malloc() once a pool runs out.
+ */
+#define ESP_MEMP_POOLS                  CONFIG_LWIP_MEMP_POOLS
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> #define MEM_ALIGNMENT 4
@@ -99,14 +106,17 @@ extern unsigned long os_random(void);
 /**
  * MEMP_NUM_TCP_PCB: the number of simulatenously active TCP connections.
  * (requires the LWIP_TCP option)
+ * This option is set via menuconfig.
  */
-#define MEMP_NUM_TCP_PCB                5
+#define MEMP_NUM_TCP_PCB                CONFIG_LWIP_MAX_ACTIVE_TCP
 
 /**
- * MEMP_NUM_NETCONN: the number of struct netconns.
+ * MEMP_NUM_NETCONN: the number of struct netconns, which is also the number
+ * of sockets.
  * (only needed if you use the sequential API, like api_lib.c)
+ * This option is set via menuconfig.
  */
-#define MEMP_NUM_NETCONN                10
+#define MEMP_NUM_NETCONN                CONFIG_LWIP_MAX_SOCKETS
 
 /*
    --------------------------------
@@ -122,6 +132,17 @@ extern unsigned long os_random(void);
  */
 #define ARP_QUEUEING                    1
 
+/**
+ * ARP_TABLE_SIZE: Number of active MAC-IP address pairs cached.
+ * This option is set via menuconfig.
+ */
+#define ARP_TABLE_SIZE                  CONFIG_LWIP_ARP_TABLE_SIZE
+
+/**
+ * ARP_TABLE_HASH_SIZE: Number of chains of the hash index of the ARP table.
+ */
+#define ARP_TABLE_HASH_SIZE             16
+
 /*
    --------------------------------
    ---------- IP options ----------
@@ -131,15 +152,38 @@ extern unsigned long os_random(void);
  * IP_REASSEMBLY==1: Reassemble incoming fragmented IP packets. Note that
  * this option does not affect outgoing packet sizes, which can be controlled
  * via IP_FRAG.
+ * This option is set via menuconfig.
  */
+#ifdef CONFIG_LWIP_IP_REASSEMBLY
+#define IP_REASSEMBLY                   1
+#else
 #define IP_REASSEMBLY                   0
+#endif
 
 /**
  * IP_FRAG==1: Fragment outgoing IP packets if their size exceeds MTU. Note
  * that this option does not affect incoming packet sizes, which can be
  * controlled via IP_REASSEMBLY.
+ * This option is set via menuconfig.
  */
+#ifdef CONFIG_LWIP_IP_FRAG
+#define IP_FRAG                         1
+#else
 #define IP_FRAG                         0
+#endif
+
+/**
+ * IP_NAPT==1: Forward packets between the interfaces, and translate those
+ * from the interfaces tcpip_adapter_napt_enable was called for.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_IP_NAPT
+#define IP_FORWARD                      1
+#define IP_NAPT                         1
+#define IP_NAPT_MAX                     CONFIG_LWIP_IP_NAPT_MAX
+#else
+#define IP_NAPT                         0
+#endif
 
 /**
  * IP_REASS_MAXAGE: Maximum time (in multiples of IP_TMR_INTERVAL - so seconds, normally)
@@ -153,8 +197,18 @@ extern unsigned long os_random(void);
  * Since the received pbufs are enqueued, be sure to configure
  * PBUF_POOL_SIZE > IP_REASS_MAX_PBUFS so that the stack is still able to receive
  * packets even if the maximum amount of fragments is enqueued for reassembly!
+ * This option is set via menuconfig.
+ */
+#if IP_REASSEMBLY
+#define IP_REASS_MAX_PBUFS              CONFIG_LWIP_IP_REASS_MAX_PBUFS
+
+/**
+ * IP_REASS_MAX_PBUFS_PER_SRC: Maximum amount of pbufs waiting to be
+ * reassembled which were sent by the same host.
+ * This option is set via menuconfig.
  */
-#define IP_REASS_MAX_PBUFS              10
+#define IP_REASS_MAX_PBUFS_PER_SRC      CONFIG_LWIP_IP_REASS_MAX_PBUFS_PER_SRC
+#endif
 
 /*
    ----------------------------------
@@ -180,6 +234,14 @@ extern unsigned long os_random(void);
 
 
 #define DHCP_MAXRTX						0   //(*(volatile uint32*)0x600011E0)
+
+/**
+ * DHCPS_MAX_STATION_NUM: Number of leases kept by the DHCP server of the
+ * soft-AP. The lease which expires first is dropped for a new client when
+ * all are in use.
+ * This option is set via menuconfig.
+ */
+#define DHCPS_MAX_STATION_NUM           CONFIG_LWIP_DHCPS_MAX_STATION_NUM
 /*
    ------------------------------------
    ---------- AUTOIP options ----------
@@ -200,6 +262,12 @@ extern unsigned long os_random(void);
  */
 #define LWIP_IGMP                       1
 
+/**
+ * IGMP_GROUP_HASH_SIZE: Number of buckets of the hash table of joined IGMP
+ * groups, searched for each received multicast datagram.
+ */
+#define IGMP_GROUP_HASH_SIZE            8
+
 /*
    ----------------------------------
    ---------- DNS options -----------
@@ -211,6 +279,82 @@ extern unsigned long os_random(void);
  */
 #define LWIP_DNS                        1
 
+/**
+ * DNS_CACHE_SIZE: Number of entries of the DNS cache, 0 to disable it.
+ * This option is set via menuconfig.
+ */
+#define DNS_CACHE_SIZE                  CONFIG_LWIP_DNS_CACHE_SIZE
+
+/**
+ * DNS_NEGATIVE_TTL: Seconds for which names which don't exist are cached.
+ * This option is set via menuconfig.
+ */
+#define DNS_NEGATIVE_TTL                CONFIG_LWIP_DNS_NEGATIVE_TTL
+
+/**
+ * DNS_PARALLEL_QUERIES==1: Ask all DNS servers, and for both address types,
+ * at once.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_DNS_PARALLEL_QUERIES
+#define DNS_PARALLEL_QUERIES            1
+#else
+#define DNS_PARALLEL_QUERIES            0
+#endif
+
+/*
+   ----------------------------------
+   ---------- SNTP options ----------
+   ----------------------------------
+*/
+/**
+ * SNTP_MAX_SERVERS: Number of servers which can be set with
+ * sntp_setserver/sntp_setservername.
+ * This option is set via menuconfig.
+ */
+#define SNTP_MAX_SERVERS                CONFIG_LWIP_SNTP_MAX_SERVERS
+
+/**
+ * SNTP_PARALLEL_REQUESTS==1: Send each request to all servers at once and
+ * use the first valid response.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_SNTP_PARALLEL_REQUESTS
+#define SNTP_PARALLEL_REQUESTS          1
+#else
+#define SNTP_PARALLEL_REQUESTS          0
+#endif
+
+/**
+ * SNTP_SKIP_SYNC_AGE: sntp_init sends the first request only once the time
+ * of day, which may have been kept over a deep sleep or reset in RTC memory
+ * (see esp_time.h), was set this many seconds ago. 0 to always send it
+ * right away.
+ * This option is set via menuconfig.
+ */
+#define SNTP_SKIP_SYNC_AGE              CONFIG_LWIP_SNTP_SKIP_SYNC_AGE
+#if SNTP_SKIP_SYNC_AGE
+#define SNTP_STARTUP_DELAY              1
+#define SNTP_STARTUP_DELAY_FUNC         sntp_startup_delay()
+#endif
+
+/**
+ * SNTP_SET_SYSTEM_TIME_US, SNTP_GET_SYSTEM_TIME: The SNTP client sets and
+ * reads the time of day with settimeofday and gettimeofday.
+ */
+#define SNTP_SET_SYSTEM_TIME_US(sec, us) \
+  do { \
+    struct timeval tv = { .tv_sec = (sec), .tv_usec = (us) }; \
+    settimeofday(&tv, NULL); \
+  } while (0)
+#define SNTP_GET_SYSTEM_TIME(sec, us) \
+  do { \
+    struct timeval tv; \
+    gettimeofday(&tv, NULL); \
+    (sec) = tv.tv_sec; \
+    (us) = tv.tv_usec; \
+  } while (0)
+
 /*
    ---------------------------------
    ---------- UDP options ----------
@@ -221,12 +365,22 @@ extern unsigned long os_random(void);
    ---------- TCP options ----------
    ---------------------------------
 */
+/*
+ *     LWIP_EVENT_API==1: The user defines lwip_tcp_event() to receive all
+ *         events (accept, sent, etc) that happen in the system.
+ *     LWIP_CALLBACK_API==1: The PCB callback function is called directly
+ *         for the event. This is the default.
+*/
+#define TCP_MSS                         1460
+
 /**
  * TCP_WND: The size of a TCP window.  This must be at least
  * (2 * TCP_MSS) for things to work well
+ * With the default TCP profile, the window and the send buffer are set by the
+ * WiFi library, otherwise via menuconfig.
  */
 #define PERF 1
-#ifdef PERF
+#ifndef CONFIG_LWIP_TCP_WND_MSS
 extern unsigned char misc_prof_get_tcpw(void);
 extern unsigned char misc_prof_get_tcp_snd_buf(void);
 #define TCP_WND                         (misc_prof_get_tcpw()*TCP_MSS)
@@ -234,11 +388,77 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
 
 #else
 
-#define TCP_WND                         (4 * TCP_MSS)
-#define TCP_SND_BUF                     (2 * TCP_MSS)
+#define TCP_WND                         (CONFIG_LWIP_TCP_WND_MSS * TCP_MSS)
+#define TCP_SND_BUF                     (CONFIG_LWIP_TCP_SND_BUF_MSS * TCP_MSS)
 
+/**
+ * LWIP_WND_SCALE==1: Announce windows larger than 64 kB, scaled down by
+ * 2^TCP_RCV_SCALE.
+ */
+#if (CONFIG_LWIP_TCP_WND_MSS * TCP_MSS) > 0xffff
+#define LWIP_WND_SCALE                  1
+#define TCP_RCV_SCALE                   2
 #endif
 
+#endif
+
+/**
+ * ESP_TCP_SND_BUF_SPIRAM==1: Allocate the pbufs of TCP segment data in SPI RAM,
+ * so that large send buffers don't take internal RAM.
+ * This option is set via menuconfig.
+ */
+#define ESP_TCP_SND_BUF_SPIRAM          CONFIG_LWIP_TCP_SND_BUF_SPIRAM
+
+/**
+ * ESP_TCP_SND_PBUF_POOL_SIZE: Number of MSS-sized buffers for TCP segment data
+ * in their own memp pool, which are reused instead of allocated from the heap
+ * for each segment.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_TCP_SND_PBUF_POOL_SIZE
+#define ESP_TCP_SND_PBUF_POOL_SIZE      CONFIG_LWIP_TCP_SND_PBUF_POOL_SIZE
+#else
+#define ESP_TCP_SND_PBUF_POOL_SIZE      0
+#endif
+
+/**
+ * ESP_RX_PBUF_POOL_SIZE: Number of pbufs in their own memp pool which
+ * reference frames received by the WiFi driver. At most this many frames
+ * are held by the stack, further ones are dropped in wlanif_input.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_RX_PBUF_POOL_SIZE
+#define ESP_RX_PBUF_POOL_SIZE           CONFIG_LWIP_RX_PBUF_POOL_SIZE
+#else
+#define ESP_RX_PBUF_POOL_SIZE           0
+#endif
+
+/**
+ * ESP_MCAST_FILTER==1: Drop the IPv4 and IPv6 multicast frames of groups which
+ * weren't joined in wlanif_input, with a filter kept up to date by the
+ * igmp_mac_filter and mld_mac_filter callbacks of the WiFi interfaces.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_MULTICAST_FILTER
+#define ESP_MCAST_FILTER                1
+#else
+#define ESP_MCAST_FILTER                0
+#endif
+
+/**
+ * ESP_UDP_FAST_PORTS: Number of UDP ports whose datagrams can be delivered to
+ * a callback from wlanif_input, see wlanif_udp_fast_register. 0 disables the
+ * fast path. This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_UDP_FAST_PORTS
+#define ESP_UDP_FAST_PORTS              CONFIG_LWIP_UDP_FAST_PORTS
+#else
+#define ESP_UDP_FAST_PORTS              0
+#endif
+
+#if ESP_TCP_SND_BUF_SPIRAM || ESP_TCP_SND_PBUF_POOL_SIZE || ESP_RX_PBUF_POOL_SIZE
+#define LWIP_SUPPORT_CUSTOM_PBUF        1
+#endif
 
 /**
  * TCP_QUEUE_OOSEQ==1: TCP will queue segments that arrive out of order.
@@ -246,13 +466,24 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
  */
 #define TCP_QUEUE_OOSEQ                 1
 
-/*
- *     LWIP_EVENT_API==1: The user defines lwip_tcp_event() to receive all
- *         events (accept, sent, etc) that happen in the system.
- *     LWIP_CALLBACK_API==1: The PCB callback function is called directly
- *         for the event. This is the default.
-*/
-#define TCP_MSS                         1460
+/**
+ * TCP_OOSEQ_MAX_PBUFS: The maximum number of pbufs queued on ooseq per pcb,
+ * and TCP_OOSEQ_MAX_BYTES as many maximum segments. 0 means no limit.
+ * This option is set via menuconfig.
+ */
+#define TCP_OOSEQ_MAX_PBUFS             CONFIG_LWIP_TCP_OOSEQ_MAX_PBUFS
+#define TCP_OOSEQ_MAX_BYTES             (CONFIG_LWIP_TCP_OOSEQ_MAX_PBUFS * TCP_MSS)
+
+/**
+ * LWIP_TCP_SACK==1: Negotiate selective acknowledgements (RFC 2018), report
+ * the segments queued out of order and retransmit only the missing ones.
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   1
+#else
+#define LWIP_TCP_SACK                   0
+#endif
 
 /**
  * TCP_MAXRTX: Maximum number of retransmissions of data segments.
@@ -269,6 +500,19 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
  */
 #define TCP_LISTEN_BACKLOG              1
 
+/**
+ * TCP_PCB_HASH_SIZE: Number of buckets of the hash tables in which tcp_input
+ * looks up connections and listening pcbs, 0 to search the pcb lists.
+ * This option is set via menuconfig.
+ */
+#define TCP_PCB_HASH_SIZE               CONFIG_LWIP_TCP_PCB_HASH_SIZE
+
+/**
+ * TCP_TMR_IDLE_SLEEP==1: Let the TCP timer sleep until the next deadline of a
+ * connection while no connection is sending or has a delayed ACK pending.
+ */
+#define TCP_TMR_IDLE_SLEEP              1
+
 /*
    ----------------------------------
    ---------- Pbuf options ----------
@@ -334,6 +578,16 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
  */
 #define TCPIP_THREAD_PRIO               ESP_TASK_TCPIP_PRIO
 
+/**
+ * TCPIP_THREAD_CORE: The CPU the tcpip thread, and any other thread started
+ * with sys_thread_new(), is pinned to.
+ */
+#if CONFIG_LWIP_TCPIP_TASK_AFFINITY_NO_AFFINITY
+#define TCPIP_THREAD_CORE               tskNO_AFFINITY
+#else
+#define TCPIP_THREAD_CORE               ESP_TASK_PROTOCOL_CORE
+#endif
+
 /**
  * TCPIP_MBOX_SIZE: The mailbox size for the tcpip thread messages
  * The queue size value itself is platform-dependent, but is passed to
@@ -341,6 +595,14 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
  */
 #define TCPIP_MBOX_SIZE                 16
 
+/**
+ * ESP_RX_RING_SIZE: Number of received frames which can wait for the tcpip
+ * thread in the RX ring, a power of two. tcpip_inpkt() queues frames there
+ * instead of posting a message per frame, and the tcpip thread drains all
+ * of them per wakeup. 0 posts each frame to the mailbox.
+ */
+#define ESP_RX_RING_SIZE                CONFIG_LWIP_RX_RING_SIZE
+
 /**
  * DEFAULT_UDP_RECVMBOX_SIZE: The mailbox size for the incoming packets on a
  * NETCONN_UDP. The queue size value itself is platform-dependent, but is passed
@@ -369,10 +631,11 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
    ----------------------------------------------
 */
 /**
- * LWIP_TCPIP_CORE_LOCKING: (EXPERIMENTAL!)
- * Don't use it if you're not an active lwIP project member
+ * LWIP_TCPIP_CORE_LOCKING: socket and netconn calls run in the calling task
+ * with the core mutex held, instead of being passed to the tcpip thread.
+ * Input packets and timers still go through the tcpip thread.
  */
-#define LWIP_TCPIP_CORE_LOCKING         0
+#define LWIP_TCPIP_CORE_LOCKING         CONFIG_LWIP_TCPIP_CORE_LOCKING
 
 /*
    ------------------------------------
@@ -409,6 +672,27 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
  */
 #define SO_REUSE                        CONFIG_LWIP_SO_REUSE
 
+/**
+ * LWIP_SOCKET_EPOLL_NUM: the number of epoll instances, 0 to leave out the
+ * epoll functions. This option is set via menuconfig.
+ */
+#define LWIP_SOCKET_EPOLL_NUM           CONFIG_LWIP_EPOLL_INSTANCES
+
+/**
+ * LWIP_SOCKET_ZEROCOPY==1: Enable lwip_recv_pbuf() and lwip_send_nocopy().
+ * This option is set via menuconfig.
+ */
+#define LWIP_SOCKET_ZEROCOPY            CONFIG_LWIP_SOCKET_ZEROCOPY
+
+/**
+ * LWIP_SOCKET_OFFSET: socket file descriptors follow the file descriptors of
+ * the VFS (esp_vfs.h), which passes read, write, close, fcntl, ioctl and
+ * select for them to lwIP.
+ */
+#define LWIP_SOCKET_OFFSET              CONFIG_VFS_MAX_FILES
+#define LWIP_POSIX_SOCKETS_IO_NAMES     0
+#define LWIP_SOCKET_SELECT_HOOKS        1
+
 /*
    ----------------------------------------
    ---------- Statistics options ----------
@@ -416,14 +700,51 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
 */
 /**
  * LWIP_STATS==1: Enable statistics collection in lwip_stats.
+ * This option is set via menuconfig.
  */
+#ifdef CONFIG_LWIP_STATS
+#define LWIP_STATS                      1
+#else
 #define LWIP_STATS                      0
+#endif
+
+#if LWIP_STATS
+/**
+ * LWIP_STATS_LARGE==1: Use 32 bit counters, 16 bit ones wrap within
+ * seconds at WiFi packet rates.
+ */
+#define LWIP_STATS_LARGE                1
+
+/**
+ * LWIP_STATS_DISPLAY==1: Compile in stats_display().
+ */
+#define LWIP_STATS_DISPLAY              1
+
+/**
+ * MIB2_STATS==1: Also count the MIB2 counters (e.g. tcpretranssegs).
+ */
+#define MIB2_STATS                      1
+#endif /* LWIP_STATS */
 
 /*
    ---------------------------------
    ---------- PPP options ----------
    ---------------------------------
 */
+/**
+ * PPP_SUPPORT==1: Enable PPP over serial (PPPoS), with PAP and CHAP
+ * authentication. pppos_input is called in the task which reads the UART,
+ * decodes the characters right from its buffer and only passes complete
+ * packets to the tcpip thread (PPP_INPROC_IRQ_SAFE).
+ * This option is set via menuconfig.
+ */
+#ifdef CONFIG_LWIP_PPP_SUPPORT
+#define PPP_SUPPORT                     1
+#define PPPOS_SUPPORT                   1
+#define PPP_INPROC_IRQ_SAFE             1
+#define PAP_SUPPORT                     1
+#define CHAP_SUPPORT                    1
+#endif
 
 /*
    --------------------------------------
@@ -441,6 +762,24 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
  */
 #define LWIP_IPV6                       1
 
+/**
+ * MLD6_GROUP_HASH_SIZE: Number of buckets of the hash table of joined MLD
+ * groups, searched for each received multicast packet.
+ */
+#define MLD6_GROUP_HASH_SIZE            8
+
+/**
+ * LWIP_ND6_NUM_NEIGHBORS: Number of entries in IPv6 neighbor cache.
+ * This option is set via menuconfig.
+ */
+#define LWIP_ND6_NUM_NEIGHBORS          CONFIG_LWIP_ND6_NUM_NEIGHBORS
+
+/**
+ * LWIP_ND6_NEIGHBOR_HASH_SIZE: Number of chains of the hash index of the
+ * IPv6 neighbor cache.
+ */
+#define LWIP_ND6_NEIGHBOR_HASH_SIZE     16
+
 /*
    ---------------------------------------
    ---------- Hook options ---------------
@@ -519,6 +858,19 @@ extern unsigned char misc_prof_get_tcp_snd_buf(void);
 #define CHECKSUM_CHECK_UDP              0
 #define CHECKSUM_CHECK_IP               0
 
+/**
+ * LWIP_CHKSUM: the Internet checksum routine. esp_chksum adds up 32-bit
+ * words instead of halfwords (see port/chksum.c).
+ * LWIP_CHECKSUM_ON_COPY==1: Compute the checksum of TCP and UDP data while it
+ * is copied into pbufs by tcp_write and lwip_sendto, with esp_chksum_copy.
+ */
+#include <stdint.h>
+uint16_t esp_chksum(const void *dataptr, int len);
+uint16_t esp_chksum_copy(void *dst, const void *src, uint16_t len);
+#define LWIP_CHKSUM                     esp_chksum
+#define LWIP_CHECKSUM_ON_COPY           1
+#define LWIP_CHKSUM_COPY(dst, src, len) esp_chksum_copy(dst, src, len)
+
 #define HEAP_HIGHWAT                    20*1024
 
 #define LWIP_NETCONN_FULLDUPLEX         1
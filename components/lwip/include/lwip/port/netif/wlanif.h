@@ -9,10 +9,12 @@
 #include "esp_wifi.h"
 
 #include "lwip/err.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip4_addr.h"
 
 err_t wlanif_init(struct netif *netif);
 
-void wlanif_input(struct netif *netif, void *buffer, u16_t len, void* eb);
+err_t wlanif_input(struct netif *netif, void *buffer, u16_t len, void* eb);
 
 bool ieee80211_output(wifi_interface_t wifi_if, void *buffer, u16_t len);
 
@@ -20,4 +22,35 @@ wifi_interface_t wifi_get_interface(void *dev);
 
 void netif_reg_addr_change_cb(void* cb);
 
+#if ESP_UDP_FAST_PORTS && LWIP_IPV4
+/**
+ * Receive callback of a port registered with wlanif_udp_fast_register.
+ * Called in the WiFi task for each valid IPv4 datagram to the port, with
+ * the payload in p, which the callback has to free with pbuf_free. The
+ * callback should only copy or queue the data: the WiFi driver doesn't
+ * receive further frames until it returns, and it must not call lwIP
+ * functions which need the tcpip thread.
+ */
+typedef void (*wlanif_udp_fast_fn)(void *arg, struct pbuf *p, const ip4_addr_t *src,
+                                   u16_t src_port, struct netif *netif);
+
+/**
+ * Deliver IPv4 datagrams to a UDP port straight from wlanif_input, without
+ * passing them through the tcpip thread. The IP and UDP headers are checked
+ * as the stack would; fragments, multicast datagrams and frames the fast
+ * path can't check are still passed to the stack. Sockets bound to the port
+ * don't receive the datagrams taken by the callback.
+ *
+ * Returns ERR_USE if the port is registered already, and ERR_MEM if
+ * ESP_UDP_FAST_PORTS ports are registered.
+ */
+err_t wlanif_udp_fast_register(u16_t port, wlanif_udp_fast_fn fn, void *arg);
+
+/**
+ * Stop delivering datagrams of a port to its callback. Returns once the
+ * callback is no longer running, so its argument can then be released.
+ */
+err_t wlanif_udp_fast_unregister(u16_t port);
+#endif /* ESP_UDP_FAST_PORTS && LWIP_IPV4 */
+
 #endif /*  _WLAN_LWIP_IF_H_ */
@@ -101,13 +101,19 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if ARP_TABLE_HASH_SIZE
+  /** Index + 1 of the next entry of the hash chain, 0 ends the chain. */
+  u8_t hash_next;
+#endif /* ARP_TABLE_HASH_SIZE */
 };
 
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
 
-#if !LWIP_NETIF_HWADDRHINT
-static u8_t etharp_cached_entry;
-#endif /* !LWIP_NETIF_HWADDRHINT */
+#if ARP_TABLE_HASH_SIZE
+/** Chains of the entries of arp_table with an IP address, hashed by the
+ * address. Holds index + 1 of the first entry, 0 for an empty chain. */
+static u8_t arp_hash[ARP_TABLE_HASH_SIZE];
+#endif /* ARP_TABLE_HASH_SIZE */
 
 /** Try hard to create a new entry - we want the IP address to appear in
     the cache (even if this means removing an active entry or so). */
@@ -121,13 +127,13 @@ static u8_t etharp_cached_entry;
 #define ETHARP_SET_HINT(netif, hint)  if (((netif) != NULL) && ((netif)->addr_hint != NULL))  \
                                       *((netif)->addr_hint) = (hint);
 #else /* LWIP_NETIF_HWADDRHINT */
-#define ETHARP_SET_HINT(netif, hint)  (etharp_cached_entry = (hint))
+#define ETHARP_SET_HINT(netif, hint)  ((netif)->etharp_hint = (hint))
 #endif /* LWIP_NETIF_HWADDRHINT */
 
 
 /* Some checks, instead of etharp_init(): */
-#if (LWIP_ARP && (ARP_TABLE_SIZE > 0x7f))
-  #error "ARP_TABLE_SIZE must fit in an s8_t, you have to reduce it in your lwipopts.h"
+#if (LWIP_ARP && (ARP_TABLE_SIZE > 0xff))
+  #error "ARP_TABLE_SIZE must fit in an u8_t, you have to reduce it in your lwipopts.h"
 #endif
 
 
@@ -161,10 +167,72 @@ free_etharp_q(struct etharp_q_entry *q)
 
 #endif /* ARP_QUEUEING */
 
+#if ARP_TABLE_HASH_SIZE
+static u8_t *
+etharp_hash_chain(const ip4_addr_t *ipaddr)
+{
+  u32_t h = ip4_addr_get_u32(ipaddr);
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return &arp_hash[h % ARP_TABLE_HASH_SIZE];
+}
+
+/** Add entry i to the chain of its IP address */
+static void
+etharp_hash_add(u8_t i)
+{
+  u8_t *chain = etharp_hash_chain(&arp_table[i].ipaddr);
+  arp_table[i].hash_next = *chain;
+  *chain = i + 1;
+}
+
+/** Remove entry i from the chain of its IP address, if it is on it */
+static void
+etharp_hash_remove(u8_t i)
+{
+  u8_t *link = etharp_hash_chain(&arp_table[i].ipaddr);
+  while (*link != 0) {
+    if (*link == i + 1) {
+      *link = arp_table[i].hash_next;
+      arp_table[i].hash_next = 0;
+      return;
+    }
+    link = &arp_table[*link - 1].hash_next;
+  }
+}
+
+/**
+ * Find the pending or stable entry of an IP address in its hash chain.
+ *
+ * @return the entry index, ARP_TABLE_SIZE if there is no such entry
+ */
+static u8_t
+etharp_hash_find(const ip4_addr_t *ipaddr, struct netif *netif)
+{
+  u8_t n;
+
+  LWIP_UNUSED_ARG(netif);
+  for (n = *etharp_hash_chain(ipaddr); n != 0; n = arp_table[n - 1].hash_next) {
+    struct etharp_entry *entry = &arp_table[n - 1];
+    if ((entry->state != ETHARP_STATE_EMPTY) && ip4_addr_cmp(ipaddr, &entry->ipaddr)
+#if ETHARP_TABLE_MATCH_NETIF
+        && ((netif == NULL) || (netif == entry->netif))
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+      ) {
+      return n - 1;
+    }
+  }
+  return ARP_TABLE_SIZE;
+}
+#endif /* ARP_TABLE_HASH_SIZE */
+
 /** Clean up ARP table entries */
 static void
 etharp_free_entry(int i)
 {
+#if ARP_TABLE_HASH_SIZE
+  etharp_hash_remove(i);
+#endif /* ARP_TABLE_HASH_SIZE */
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
   /* and empty packet queue */
@@ -229,6 +297,29 @@ etharp_tmr(void)
   }
 }
 
+/**
+ * Check whether the ARP table has entries which age, for which etharp_tmr
+ * has to be called.
+ *
+ * @return 1 if a pending or stable (not static) entry exists, 0 otherwise
+ */
+u8_t
+etharp_pending(void)
+{
+  u8_t i;
+
+  for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+    if ((arp_table[i].state != ETHARP_STATE_EMPTY)
+#if ETHARP_SUPPORT_STATIC_ENTRIES
+      && (arp_table[i].state != ETHARP_STATE_STATIC)
+#endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
+      ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /**
  * Search the ARP table for a matching or new entry.
  *
@@ -250,14 +341,14 @@ etharp_tmr(void)
  * @return The ARP entry index that matched or is created, ERR_MEM if no
  * entry is found or could be recycled.
  */
-static s8_t
+static s16_t
 etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
 {
-  s8_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
-  s8_t empty = ARP_TABLE_SIZE;
+  s16_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
+  s16_t empty = ARP_TABLE_SIZE;
   u8_t i = 0;
   /* oldest entry with packets on queue */
-  s8_t old_queue = ARP_TABLE_SIZE;
+  s16_t old_queue = ARP_TABLE_SIZE;
   /* its age */
   u16_t age_queue = 0, age_pending = 0, age_stable = 0;
 
@@ -276,7 +367,23 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
    * 4) remember the oldest pending entry with queued packets (if any)
    * 5) search for a matching IP entry, either pending or stable
    *    until 5 matches, or all entries are searched for.
+   *
+   * With ARP_TABLE_HASH_SIZE, 5) is done before through the hash chain
+   * of the address, and the sweep is only needed to create an entry.
    */
+#if ARP_TABLE_HASH_SIZE
+  if (ipaddr != NULL) {
+    i = etharp_hash_find(ipaddr, netif);
+    if (i < ARP_TABLE_SIZE) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %"U16_F"\n", (u16_t)i));
+      return i;
+    }
+  }
+  if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no matching entry found\n"));
+    return (s16_t)ERR_MEM;
+  }
+#endif /* ARP_TABLE_HASH_SIZE */
 
   for (i = 0; i < ARP_TABLE_SIZE; ++i) {
     u8_t state = arp_table[i].state;
@@ -288,6 +395,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
     } else if (state != ETHARP_STATE_EMPTY) {
       LWIP_ASSERT("state == ETHARP_STATE_PENDING || state >= ETHARP_STATE_STABLE",
         state == ETHARP_STATE_PENDING || state >= ETHARP_STATE_STABLE);
+#if !ARP_TABLE_HASH_SIZE
       /* if given, does IP address match IP address in ARP entry? */
       if (ipaddr && ip4_addr_cmp(ipaddr, &arp_table[i].ipaddr)
 #if ETHARP_TABLE_MATCH_NETIF
@@ -298,6 +406,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
         /* found exact IP address match, simply bail out */
         return i;
       }
+#endif /* !ARP_TABLE_HASH_SIZE */
       /* pending entry? */
       if (state == ETHARP_STATE_PENDING) {
         /* pending with queued packets? */
@@ -337,7 +446,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
       /* or no empty entry found and not allowed to recycle? */
       ((empty == ARP_TABLE_SIZE) && ((flags & ETHARP_FLAG_TRY_HARD) == 0))) {
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty entry found and not allowed to recycle\n"));
-    return (s8_t)ERR_MEM;
+    return (s16_t)ERR_MEM;
   }
 
   /* b) choose the least destructive entry to recycle:
@@ -374,7 +483,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
       /* no empty or recyclable entries found */
     } else {
       LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty or recyclable entries found\n"));
-      return (s8_t)ERR_MEM;
+      return (s16_t)ERR_MEM;
     }
 
     /* { empty or recyclable entry found } */
@@ -386,16 +495,23 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
   LWIP_ASSERT("arp_table[i].state == ETHARP_STATE_EMPTY",
     arp_table[i].state == ETHARP_STATE_EMPTY);
 
+#if ARP_TABLE_HASH_SIZE
+  /* an entry a caller left empty is still on the chain of its address */
+  etharp_hash_remove(i);
+#endif /* ARP_TABLE_HASH_SIZE */
   /* IP address given? */
   if (ipaddr != NULL) {
     /* set IP address */
     ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
+#if ARP_TABLE_HASH_SIZE
+    etharp_hash_add(i);
+#endif /* ARP_TABLE_HASH_SIZE */
   }
   arp_table[i].ctime = 0;
 #if ETHARP_TABLE_MATCH_NETIF
   arp_table[i].netif = netif;
 #endif /* ETHARP_TABLE_MATCH_NETIF*/
-  return (err_t)i;
+  return (s16_t)i;
 }
 
 /**
@@ -460,7 +576,7 @@ etharp_send_ip(struct netif *netif, struct pbuf *p, struct eth_addr *src, const
 static err_t
 etharp_update_arp_entry(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr *ethaddr, u8_t flags)
 {
-  s8_t i;
+  s16_t i;
   LWIP_ASSERT("netif->hwaddr_len == ETH_HWADDR_LEN", netif->hwaddr_len == ETH_HWADDR_LEN);
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_update_arp_entry: %"U16_F".%"U16_F".%"U16_F".%"U16_F" - %02"X16_F":%02"X16_F":%02"X16_F":%02"X16_F":%02"X16_F":%02"X16_F"\n",
     ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr),
@@ -489,6 +605,7 @@ etharp_update_arp_entry(struct netif *netif, const ip4_addr_t *ipaddr, struct et
   {
     /* mark it stable */
     arp_table[i].state = ETHARP_STATE_STABLE;
+    etharp_timer_needed();
   }
 
   /* record network interface */
@@ -563,7 +680,7 @@ etharp_add_static_entry(const ip4_addr_t *ipaddr, struct eth_addr *ethaddr)
 err_t
 etharp_remove_static_entry(const ip4_addr_t *ipaddr)
 {
-  s8_t i;
+  s16_t i;
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_remove_static_entry: %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
     ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr)));
 
@@ -612,11 +729,11 @@ void etharp_cleanup_netif(struct netif *netif)
  * @param ip_ret points to return pointer
  * @return table index if found, -1 otherwise
  */
-s8_t
+s16_t
 etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr,
          struct eth_addr **eth_ret, const ip4_addr_t **ip_ret)
 {
-  s8_t i;
+  s16_t i;
 
   LWIP_ASSERT("eth_ret != NULL && ip_ret != NULL",
     eth_ret != NULL && ip_ret != NULL);
@@ -965,7 +1082,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     dest = &mcastaddr;
   /* unicast destination IP address? */
   } else {
-    s8_t i;
+    s16_t i;
     /* outside local network? if so, this can neither be a global broadcast nor
        a subnet broadcast. */
     if (!ip4_addr_netcmp(ipaddr, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
@@ -1006,19 +1123,29 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     if (netif->addr_hint != NULL) {
       /* per-pcb cached entry was given */
       u8_t etharp_cached_entry = *(netif->addr_hint);
-      if (etharp_cached_entry < ARP_TABLE_SIZE) {
+#else /* LWIP_NETIF_HWADDRHINT */
+    {
+      /* entry this netif sent the last packet to */
+      u8_t etharp_cached_entry = netif->etharp_hint;
 #endif /* LWIP_NETIF_HWADDRHINT */
+      if (etharp_cached_entry < ARP_TABLE_SIZE) {
         if ((arp_table[etharp_cached_entry].state >= ETHARP_STATE_STABLE) &&
             (ip4_addr_cmp(dst_addr, &arp_table[etharp_cached_entry].ipaddr))) {
           /* the per-pcb-cached entry is stable and the right one! */
           ETHARP_STATS_INC(etharp.cachehit);
           return etharp_output_to_arp_index(netif, q, etharp_cached_entry);
         }
-#if LWIP_NETIF_HWADDRHINT
       }
     }
-#endif /* LWIP_NETIF_HWADDRHINT */
 
+#if ARP_TABLE_HASH_SIZE
+    i = etharp_hash_find(dst_addr, netif);
+    if ((i < ARP_TABLE_SIZE) && (arp_table[i].state >= ETHARP_STATE_STABLE)) {
+      /* found an existing, stable entry */
+      ETHARP_SET_HINT(netif, (u8_t)i);
+      return etharp_output_to_arp_index(netif, q, (u8_t)i);
+    }
+#else /* ARP_TABLE_HASH_SIZE */
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
@@ -1029,6 +1156,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         return etharp_output_to_arp_index(netif, q, i);
       }
     }
+#endif /* ARP_TABLE_HASH_SIZE */
     /* no stable entry found, use the (slower) query function:
        queue on destination Ethernet address belonging to ipaddr */
     return etharp_query(netif, dst_addr, q);
@@ -1079,7 +1207,7 @@ etharp_query(struct netif *netif, const ip4_addr_t *ipaddr, struct pbuf *q)
   struct eth_addr * srcaddr = (struct eth_addr *)netif->hwaddr;
   err_t result = ERR_MEM;
   int is_new_entry = 0;
-  s8_t i; /* ARP entry index */
+  s16_t i; /* ARP entry index */
 
   /* non-unicast address? */
   if (ip4_addr_isbroadcast(ipaddr, netif) ||
@@ -1108,6 +1236,7 @@ etharp_query(struct netif *netif, const ip4_addr_t *ipaddr, struct pbuf *q)
     arp_table[i].state = ETHARP_STATE_PENDING;
     /* record network interface for re-sending arp request in etharp_tmr */
     arp_table[i].netif = netif;
+    etharp_timer_needed();
   }
 
   /* { i is either a STABLE or (new or existing) PENDING entry } */
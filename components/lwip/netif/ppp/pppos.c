@@ -70,6 +70,9 @@ static void pppos_input_free_current_packet(pppos_pcb *pppos);
 static void pppos_input_drop(pppos_pcb *pppos);
 static err_t pppos_output_append(pppos_pcb *pppos, err_t err, struct pbuf *nb, u8_t c, u8_t accm, u16_t *fcs);
 static err_t pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs);
+static struct pbuf *pppos_output_alloc(u16_t len);
+static err_t pppos_output_flush(pppos_pcb *pppos, struct pbuf *nb);
+static err_t pppos_output_encode(pppos_pcb *pppos, err_t err, struct pbuf *nb, const u8_t *s, u16_t n, u16_t *fcs);
 
 /* Callbacks structure for PPP core */
 static const struct link_callbacks pppos_callbacks = {
@@ -195,15 +198,13 @@ static err_t
 pppos_write(ppp_pcb *ppp, void *ctx, struct pbuf *p)
 {
   pppos_pcb *pppos = (pppos_pcb *)ctx;
-  u8_t *s;
   struct pbuf *nb;
-  u16_t n;
   u16_t fcs_out;
   err_t err;
   LWIP_UNUSED_ARG(ppp);
 
   /* Grab an output buffer. */
-  nb = pbuf_alloc(PBUF_RAW, 0, PBUF_POOL);
+  nb = pppos_output_alloc(p->len);
   if (nb == NULL) {
     PPPDEBUG(LOG_WARNING, ("pppos_write[%d]: alloc fail\n", ppp->netif->num));
     LINK_STATS_INC(link.memerr);
@@ -222,11 +223,7 @@ pppos_write(ppp_pcb *ppp, void *ctx, struct pbuf *p)
 
   /* Load output buffer. */
   fcs_out = PPP_INITFCS;
-  s = (u8_t*)p->payload;
-  n = p->len;
-  while (n-- > 0) {
-    err = pppos_output_append(pppos, err,  nb, *s++, 1, &fcs_out);
-  }
+  err = pppos_output_encode(pppos, err, nb, (u8_t*)p->payload, p->len, &fcs_out);
 
   err = pppos_output_last(pppos, err, nb, &fcs_out);
   if (err == ERR_OK) {
@@ -249,7 +246,7 @@ pppos_netif_output(ppp_pcb *ppp, void *ctx, struct pbuf *pb, u16_t protocol)
   LWIP_UNUSED_ARG(ppp);
 
   /* Grab an output buffer. */
-  nb = pbuf_alloc(PBUF_RAW, 0, PBUF_POOL);
+  nb = pppos_output_alloc(pb->tot_len);
   if (nb == NULL) {
     PPPDEBUG(LOG_WARNING, ("pppos_netif_output[%d]: alloc fail\n", ppp->netif->num));
     LINK_STATS_INC(link.memerr);
@@ -277,12 +274,7 @@ pppos_netif_output(ppp_pcb *ppp, void *ctx, struct pbuf *pb, u16_t protocol)
 
   /* Load packet. */
   for(p = pb; p; p = p->next) {
-    u16_t n = p->len;
-    u8_t *s = (u8_t*)p->payload;
-
-    while (n-- > 0) {
-      err = pppos_output_append(pppos, err,  nb, *s++, 1, &fcs_out);
-    }
+    err = pppos_output_encode(pppos, err, nb, (u8_t*)p->payload, p->len, &fcs_out);
   }
 
   err = pppos_output_last(pppos, err, nb, &fcs_out);
@@ -503,8 +495,34 @@ pppos_input(ppp_pcb *ppp, u8_t *s, int l)
   PPPOS_UNPROTECT(lev);
 
   PPPDEBUG(LOG_DEBUG, ("pppos_input[%d]: got %d bytes\n", ppp->netif->num, l));
-  while (l-- > 0) {
+  while (l > 0) {
+    /* Within the data of a packet, copy the run of characters which need
+     * no unescaping straight into the input pbuf, as far as it has room,
+     * instead of going through the state machine for each. */
+    if (pppos->in_state == PDDATA && !pppos->in_escaped &&
+        pppos->in_tail != NULL && pppos->in_tail->len < PBUF_POOL_BUFSIZE) {
+      u8_t *d = (u8_t*)pppos->in_tail->payload + pppos->in_tail->len;
+      u16_t fcs = pppos->in_fcs;
+      int run = LWIP_MIN(l, PBUF_POOL_BUFSIZE - pppos->in_tail->len);
+      int i;
+
+      PPPOS_PROTECT(lev);
+      for (i = 0; i < run && !ESCAPE_P(pppos->in_accm, s[i]); i++) {
+        d[i] = s[i];
+        fcs = PPP_FCS(fcs, s[i]);
+      }
+      PPPOS_UNPROTECT(lev);
+      pppos->in_tail->len += i;
+      pppos->in_fcs = fcs;
+      s += i;
+      l -= i;
+      if (l == 0) {
+        break;
+      }
+    }
+
     cur_char = *s++;
+    l--;
 
     PPPOS_PROTECT(lev);
     escaped = ESCAPE_P(pppos->in_accm, cur_char);
@@ -711,7 +729,7 @@ pppos_input(ppp_pcb *ppp, u8_t *s, int l)
       /* update the frame check sequence number. */
       pppos->in_fcs = PPP_FCS(pppos->in_fcs, cur_char);
     }
-  } /* while (l-- > 0), all bytes processed */
+  } /* while (l > 0), all bytes processed */
 }
 
 #if PPP_INPROC_IRQ_SAFE
@@ -833,12 +851,11 @@ pppos_output_append(pppos_pcb *pppos, err_t err, struct pbuf *nb, u8_t c, u8_t a
   /* Make sure there is room for the character and an escape code.
    * Sure we don't quite fill the buffer if the character doesn't
    * get escaped but is one character worth complicating this? */
-  if ((PBUF_POOL_BUFSIZE - nb->len) < 2) {
-    u32_t l = pppos->output_cb(pppos->ppp, (u8_t*)nb->payload, nb->len, pppos->ppp->ctx_cb);
-    if (l != nb->len) {
-      return ERR_IF;
+  if ((nb->tot_len - nb->len) < 2) {
+    err = pppos_output_flush(pppos, nb);
+    if (err != ERR_OK) {
+      return err;
     }
-    nb->len = 0;
   }
 
   /* Update FCS before checking for special characters. */
@@ -861,6 +878,7 @@ static err_t
 pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs)
 {
   ppp_pcb *ppp = pppos->ppp;
+  LWIP_UNUSED_ARG(ppp);
 
   /* Add FCS and trailing flag. */
   err = pppos_output_append(pppos, err,  nb, ~(*fcs) & 0xFF, 1, NULL);
@@ -873,15 +891,13 @@ pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs)
 
   /* Send remaining buffer if not empty */
   if (nb->len > 0) {
-    u32_t l = pppos->output_cb(ppp, (u8_t*)nb->payload, nb->len, ppp->ctx_cb);
-    if (l != nb->len) {
-      err = ERR_IF;
+    err = pppos_output_flush(pppos, nb);
+    if (err != ERR_OK) {
       goto failed;
     }
   }
 
   pppos->last_xmit = sys_now();
-  MIB2_STATS_NETIF_ADD(ppp->netif, ifoutoctets, nb->tot_len);
   MIB2_STATS_NETIF_INC(ppp->netif, ifoutucastpkts);
   LINK_STATS_INC(link.xmit);
   pbuf_free(nb);
@@ -896,4 +912,81 @@ failed:
   return err;
 }
 
+/*
+ * pppos_output_alloc - allocate the output buffer for a packet of len bytes.
+ * It is sized for the whole encoded frame with room for a few escaped
+ * characters, so that the frame usually goes to output_cb in one call. If
+ * the heap can't provide it, a pool pbuf is used, which is sent each time
+ * it fills up. The room of the buffer is its tot_len, nb->len the encoded
+ * characters it holds.
+ */
+static struct pbuf *
+pppos_output_alloc(u16_t len)
+{
+  struct pbuf *nb;
+  /* flags, address, control, protocol and FCS, all escaped */
+  u32_t size = (u32_t)len + (len >> 3) + 16;
+
+  nb = pbuf_alloc(PBUF_RAW, (u16_t)LWIP_MIN(size, 0xffff), PBUF_RAM);
+  if (nb == NULL) {
+    nb = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
+  }
+  if (nb != NULL) {
+    nb->len = 0;
+  }
+  return nb;
+}
+
+/*
+ * pppos_output_flush - pass the characters of the output buffer to output_cb
+ * and empty it.
+ */
+static err_t
+pppos_output_flush(pppos_pcb *pppos, struct pbuf *nb)
+{
+  u32_t l = pppos->output_cb(pppos->ppp, (u8_t*)nb->payload, nb->len, pppos->ppp->ctx_cb);
+  if (l != nb->len) {
+    return ERR_IF;
+  }
+  MIB2_STATS_NETIF_ADD(pppos->ppp->netif, ifoutoctets, nb->len);
+  nb->len = 0;
+  return ERR_OK;
+}
+
+/*
+ * pppos_output_encode - append n characters of packet data to the output
+ * buffer, escaping them per out_accm and updating the FCS. Does the work of
+ * pppos_output_append for each character in one loop, flushing the buffer
+ * when it is full.
+ */
+static err_t
+pppos_output_encode(pppos_pcb *pppos, err_t err, struct pbuf *nb, const u8_t *s, u16_t n, u16_t *fcs)
+{
+  u16_t f = *fcs;
+
+  while (err == ERR_OK && n > 0) {
+    u8_t *d = (u8_t*)nb->payload + nb->len;
+    /* keep room for the escape code of the last character */
+    u8_t *end = (u8_t*)nb->payload + nb->tot_len - 1;
+
+    while (n > 0 && d < end) {
+      u8_t c = *s++;
+      n--;
+      f = PPP_FCS(f, c);
+      if (ESCAPE_P(pppos->out_accm, c)) {
+        *d++ = PPP_ESCAPE;
+        *d++ = c ^ PPP_TRANS;
+      } else {
+        *d++ = c;
+      }
+    }
+    nb->len = (u16_t)(d - (u8_t*)nb->payload);
+    if (n > 0) {
+      err = pppos_output_flush(pppos, nb);
+    }
+  }
+  *fcs = f;
+  return err;
+}
+
 #endif /* PPP_SUPPORT && PPPOS_SUPPORT */
@@ -0,0 +1,193 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Internet checksum routines for the ESP32, used as LWIP_CHKSUM and
+ * LWIP_CHKSUM_COPY (see lwipopts.h).
+ *
+ * The generic lwip_standard_chksum adds up the data 16 bits at a time. These
+ * read it with aligned 32-bit loads, eight words per loop iteration, and add
+ * the two halves of each word to a 32-bit accumulator: on Xtensa that's one
+ * load, an extui, a srli and two adds per word, without the carry handling
+ * a 32-bit one's complement sum would need. The accumulator can't overflow
+ * for the buffer lengths lwIP passes (below 64 kB).
+ *
+ * Xtensa doesn't do unaligned 32-bit loads, so leading and trailing bytes
+ * and halfwords are handled separately. As in lwip_standard_chksum, data
+ * which starts on an odd address is summed with the bytes of each halfword
+ * swapped, and the result is swapped back.
+ */
+
+#include "lwip/opt.h"
+
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+
+#include <string.h>
+
+#define CHKSUM_ADD_WORD(sum, w) do { \
+  u32_t w_ = (w);                    \
+  (sum) += w_ & 0xffff;              \
+  (sum) += w_ >> 16;                 \
+} while (0)
+
+#define CHKSUM_COPY_WORD(sum, pd, ps, i) do { \
+  u32_t cw_ = ((const u32_t *)(ps))[i];         \
+  ((u32_t *)(pd))[i] = cw_;                   \
+  CHKSUM_ADD_WORD(sum, cw_);                  \
+} while (0)
+
+static inline u16_t
+chksum_finish(u32_t sum, u16_t t, int odd)
+{
+  sum += t;
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+  if (odd) {
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+  return (u16_t)sum;
+}
+
+/**
+ * Compute the one's complement sum of the data (not inverted), like
+ * lwip_standard_chksum.
+ */
+u16_t
+esp_chksum(const void *dataptr, int len)
+{
+  const u8_t *pb = (const u8_t *)dataptr;
+  const u32_t *pw;
+  u32_t sum = 0;
+  u16_t t = 0;
+  int odd = ((mem_ptr_t)pb & 1);
+
+  /* Get aligned to u16_t */
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pb++;
+    len--;
+  }
+  /* Get aligned to u32_t */
+  if (((mem_ptr_t)pb & 2) && len > 1) {
+    sum += *(const u16_t *)(const void *)pb;
+    pb += 2;
+    len -= 2;
+  }
+
+  /* Add the bulk of the data */
+  pw = (const u32_t *)(const void *)pb;
+  while (len >= 32) {
+    CHKSUM_ADD_WORD(sum, pw[0]);
+    CHKSUM_ADD_WORD(sum, pw[1]);
+    CHKSUM_ADD_WORD(sum, pw[2]);
+    CHKSUM_ADD_WORD(sum, pw[3]);
+    CHKSUM_ADD_WORD(sum, pw[4]);
+    CHKSUM_ADD_WORD(sum, pw[5]);
+    CHKSUM_ADD_WORD(sum, pw[6]);
+    CHKSUM_ADD_WORD(sum, pw[7]);
+    pw += 8;
+    len -= 32;
+  }
+  while (len >= 4) {
+    CHKSUM_ADD_WORD(sum, *pw++);
+    len -= 4;
+  }
+
+  /* Consume left-over halfword and byte, if any */
+  pb = (const u8_t *)pw;
+  if (len > 1) {
+    sum += *(const u16_t *)(const void *)pb;
+    pb += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    ((u8_t *)&t)[0] = *pb;
+  }
+
+  return chksum_finish(sum, t, odd);
+}
+
+/**
+ * Copy the data like MEMCPY and return its one's complement sum, reading
+ * every word only once.
+ *
+ * If dst and src are differently aligned, aligned loads and stores of the
+ * same words are not possible, and this copies first, then sums up dst.
+ */
+u16_t
+esp_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u8_t *pd = (u8_t *)dst;
+  const u8_t *ps = (const u8_t *)src;
+  u32_t sum = 0;
+  u16_t t = 0;
+  int odd;
+
+  if ((((mem_ptr_t)pd ^ (mem_ptr_t)ps) & 3) != 0) {
+    MEMCPY(dst, src, len);
+    return esp_chksum(dst, len);
+  }
+
+  odd = ((mem_ptr_t)ps & 1);
+  /* Get aligned to u16_t */
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pd++ = *ps++;
+    len--;
+  }
+  /* Get aligned to u32_t */
+  if (((mem_ptr_t)ps & 2) && len > 1) {
+    u16_t h = *(const u16_t *)(const void *)ps;
+    *(u16_t *)(void *)pd = h;
+    sum += h;
+    pd += 2;
+    ps += 2;
+    len -= 2;
+  }
+
+  /* Copy and add the bulk of the data */
+  while (len >= 32) {
+    CHKSUM_COPY_WORD(sum, pd, ps, 0);
+    CHKSUM_COPY_WORD(sum, pd, ps, 1);
+    CHKSUM_COPY_WORD(sum, pd, ps, 2);
+    CHKSUM_COPY_WORD(sum, pd, ps, 3);
+    CHKSUM_COPY_WORD(sum, pd, ps, 4);
+    CHKSUM_COPY_WORD(sum, pd, ps, 5);
+    CHKSUM_COPY_WORD(sum, pd, ps, 6);
+    CHKSUM_COPY_WORD(sum, pd, ps, 7);
+    pd += 32;
+    ps += 32;
+    len -= 32;
+  }
+  while (len >= 4) {
+    CHKSUM_COPY_WORD(sum, pd, ps, 0);
+    pd += 4;
+    ps += 4;
+    len -= 4;
+  }
+
+  /* Copy left-over halfword and byte, if any */
+  if (len > 1) {
+    u16_t h = *(const u16_t *)(const void *)ps;
+    *(u16_t *)(void *)pd = h;
+    sum += h;
+    pd += 2;
+    ps += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    ((u8_t *)&t)[0] = *pd = *ps;
+  }
+
+  return chksum_finish(sum, t, odd);
+}
@@ -36,6 +36,7 @@
 #include "lwip/def.h"
 #include "lwip/sys.h"
 #include "lwip/mem.h"
+#include "lwip/stats.h"
 #include "arch/sys_arch.h"
 
 /* This is the number of threads that can be started with sys_thread_new() */
@@ -94,6 +95,30 @@ sys_mutex_free(sys_mutex_t *pxMutex)
 }
 #endif
 
+/*-----------------------------------------------------------------------------------*/
+//  Per-thread semaphores can be implemented with the task notification of
+//  the owning thread. Such a sys_sem_t holds the task handle with the low bit
+//  set; TCBs are word aligned, so it can't be mistaken for a semaphore.
+#if CONFIG_LWIP_THREAD_SEM_TASK_NOTIFY
+#define SYS_SEM_NOTIFY_TAG 1
+#define sys_sem_is_notify(sem) (((uint32_t)(sem) & SYS_SEM_NOTIFY_TAG) != 0)
+#define sys_sem_notify_task(sem) ((xTaskHandle)((uint32_t)(sem) & ~SYS_SEM_NOTIFY_TAG))
+#else
+#define sys_sem_is_notify(sem) 0
+#endif
+
+static portBASE_TYPE
+sys_sem_take(sys_sem_t *sem, portTickType ticks)
+{
+#if CONFIG_LWIP_THREAD_SEM_TASK_NOTIFY
+  if (sys_sem_is_notify(*sem)) {
+    LWIP_ASSERT("thread sem taken by other thread", sys_sem_notify_task(*sem) == xTaskGetCurrentTaskHandle());
+    return (ulTaskNotifyTake(pdTRUE, ticks) != 0) ? pdTRUE : pdFALSE;
+  }
+#endif
+  return xSemaphoreTake(*sem, ticks);
+}
+
 /*-----------------------------------------------------------------------------------*/
 //  Creates and returns a new semaphore. The "count" argument specifies
 //  the initial state of the semaphore. TBD finish and test
@@ -121,6 +146,12 @@ sys_sem_new(sys_sem_t *sem, u8_t count)
 void
 sys_sem_signal(sys_sem_t *sem)
 {
+#if CONFIG_LWIP_THREAD_SEM_TASK_NOTIFY
+  if (sys_sem_is_notify(*sem)) {
+    xTaskNotifyGive(sys_sem_notify_task(*sem));
+    return;
+  }
+#endif
   xSemaphoreGive(*sem);
 }
 
@@ -149,7 +180,7 @@ sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
   StartTime = xTaskGetTickCount();
 
   if (timeout != 0) {
-    if (xSemaphoreTake(*sem, timeout / portTICK_RATE_MS) == pdTRUE) {
+    if (sys_sem_take(sem, timeout / portTICK_RATE_MS) == pdTRUE) {
       EndTime = xTaskGetTickCount();
       Elapsed = (EndTime - StartTime) * portTICK_RATE_MS;
 
@@ -162,7 +193,7 @@ sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
       ulReturn = SYS_ARCH_TIMEOUT;
     }
   } else { // must block without a timeout
-    while (xSemaphoreTake(*sem, portMAX_DELAY) != pdTRUE);
+    while (sys_sem_take(sem, portMAX_DELAY) != pdTRUE);
 
     EndTime = xTaskGetTickCount();
     Elapsed = (EndTime - StartTime) * portTICK_RATE_MS;
@@ -182,38 +213,137 @@ sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
 void
 sys_sem_free(sys_sem_t *sem)
 {
-  vSemaphoreDelete(*sem);
+  if (!sys_sem_is_notify(*sem)) {
+    vSemaphoreDelete(*sem);
+  }
 }
 
 /*-----------------------------------------------------------------------------------*/
+/*
+  Mailboxes are bounded rings of message pointers (Vyukov's bounded queue):
+  every slot carries a sequence number which tells posters and fetchers
+  whether the slot is free or holds a message for the current lap. Posting
+  and fetching claim a slot with one compare-and-set on the write or read
+  position, so neither takes a lock or copies the message through a
+  FreeRTOS queue, and any number of tasks can post and fetch at once.
+
+  A fetcher which finds the mailbox empty raises "waiting" and sleeps on the
+  "wake" semaphore. Posters only give the semaphore while someone waits, so
+  posting to a mailbox whose owner is busy (the usual case for the tcpip
+  thread) costs no kernel call at all.
+*/
+
+/* Take a slot for msg, return false if the mailbox is full. */
+static bool
+sys_mbox_ring_put(struct sys_mbox_s *mb, void *msg)
+{
+  struct sys_mbox_slot_s *slot;
+  uint32_t pos = __atomic_load_n(&mb->enq_pos, __ATOMIC_RELAXED);
+  int32_t dif;
+
+  for (;;) {
+    slot = &mb->slots[pos & mb->mask];
+    dif = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&mb->enq_pos, &pos, pos + 1, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&mb->enq_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  slot->msg = msg;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Take the oldest message, return false if the mailbox is empty. */
+static bool
+sys_mbox_ring_get(struct sys_mbox_s *mb, void **msg)
+{
+  struct sys_mbox_slot_s *slot;
+  uint32_t pos = __atomic_load_n(&mb->deq_pos, __ATOMIC_RELAXED);
+  int32_t dif;
+
+  for (;;) {
+    slot = &mb->slots[pos & mb->mask];
+    dif = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&mb->deq_pos, &pos, pos + 1, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&mb->deq_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  *msg = slot->msg;
+  /* free the slot for the poster of the next lap */
+  __atomic_store_n(&slot->seq, pos + mb->mask + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Wake a fetcher after a post, if one sleeps. */
+static void
+sys_mbox_ring_wake(struct sys_mbox_s *mb)
+{
+  /* Order the post before reading "waiting"; pairs with the increment of
+     the fetcher, which checks the ring again after it. Either the fetcher
+     sees the message or we see the fetcher. */
+  __sync_synchronize();
+  if (__atomic_load_n(&mb->waiting, __ATOMIC_RELAXED) != 0) {
+    xSemaphoreGive(mb->wake);
+  }
+}
+
 //  Creates an empty mailbox.
 err_t
 sys_mbox_new(sys_mbox_t *mbox, int size)
 {
-  *mbox = malloc(sizeof(struct sys_mbox_s));
+  uint32_t capacity = 1;
+  uint32_t i;
+
+  /* the ring needs a power of two number of slots */
+  while (capacity < (uint32_t)size) {
+    capacity <<= 1;
+  }
+
+  *mbox = malloc(sizeof(struct sys_mbox_s) + capacity * sizeof(struct sys_mbox_slot_s));
   if (*mbox == NULL){
     LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("fail to new *mbox\n"));
+    SYS_STATS_INC(mbox.err);
     return ERR_MEM;
   }
 
-  (*mbox)->os_mbox = xQueueCreate(size, sizeof(void *));
-
-  if ((*mbox)->os_mbox == NULL) {
-    LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("fail to new *mbox->os_mbox\n"));
+  /* A give while the count is at its maximum is lost, but then a fetcher
+     which goes to sleep wakes up at once anyway. */
+  (*mbox)->wake = xSemaphoreCreateCounting(capacity, 0);
+  if ((*mbox)->wake == NULL) {
+    LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("fail to new *mbox->wake\n"));
     free(*mbox);
+    SYS_STATS_INC(mbox.err);
     return ERR_MEM;
   }
 
-  if (sys_mutex_new(&((*mbox)->lock)) != ERR_OK){
-    LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("fail to new *mbox->lock\n"));
-    vQueueDelete((*mbox)->os_mbox);
-    free(*mbox);
-    return ERR_MEM;
+  for (i = 0; i < capacity; i++) {
+    (*mbox)->slots[i].seq = i;
+    (*mbox)->slots[i].msg = NULL;
   }
-
+  (*mbox)->mask = capacity - 1;
+  (*mbox)->enq_pos = 0;
+  (*mbox)->deq_pos = 0;
+  (*mbox)->waiting = 0;
   (*mbox)->alive = true;
+  SYS_STATS_INC_USED(mbox);
 
-  LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("new *mbox ok mbox=%p os_mbox=%p mbox_lock=%p\n", *mbox, (*mbox)->os_mbox, (*mbox)->lock));
+  LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("new *mbox ok mbox=%p slots=%u\n", *mbox, capacity));
   return ERR_OK;
 }
 
@@ -222,23 +352,36 @@ sys_mbox_new(sys_mbox_t *mbox, int size)
 void
 sys_mbox_post(sys_mbox_t *mbox, void *msg)
 {
-  while (xQueueSendToBack((*mbox)->os_mbox, &msg, portMAX_DELAY) != pdTRUE);
+  /* A full mailbox is rare: poll for room rather than keeping a second
+     semaphore for posters. */
+  while (!sys_mbox_ring_put(*mbox, msg)) {
+    vTaskDelay(1);
+  }
+  sys_mbox_ring_wake(*mbox);
 }
 
 /*-----------------------------------------------------------------------------------*/
 err_t
 sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
 {
-  err_t xReturn;
-
-  if (xQueueSend((*mbox)->os_mbox, &msg, (portTickType)0) == pdPASS) {
-    xReturn = ERR_OK;
-  } else {
-    LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("trypost mbox=%p fail\n", (*mbox)->os_mbox));
-    xReturn = ERR_MEM;
+  if (!sys_mbox_ring_put(*mbox, msg)) {
+    LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("trypost mbox=%p fail\n", *mbox));
+    /* the message is dropped by the caller: count it as a mailbox overflow */
+    SYS_STATS_INC(mbox.err);
+    return ERR_MEM;
   }
 
-  return xReturn;
+  sys_mbox_ring_wake(*mbox);
+  return ERR_OK;
+}
+
+/*-----------------------------------------------------------------------------------*/
+/* Number of messages waiting in the mailbox */
+u32_t
+sys_mbox_waiting(sys_mbox_t *mbox)
+{
+  return __atomic_load_n(&(*mbox)->enq_pos, __ATOMIC_RELAXED) -
+         __atomic_load_n(&(*mbox)->deq_pos, __ATOMIC_RELAXED);
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -261,8 +404,8 @@ u32_t
 sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
 {
   void *dummyptr;
-  portTickType StartTime, EndTime, Elapsed;
-  unsigned long ulReturn;
+  struct sys_mbox_s *mb;
+  portTickType StartTime, Elapsed, Ticks, Wait;
 
   StartTime = xTaskGetTickCount();
   if (msg == NULL) {
@@ -275,51 +418,42 @@ sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
     return -1;
   }
 
-  sys_mutex_lock(&(*mbox)->lock);
-
-  if (timeout != 0) {
-    if (pdTRUE == xQueueReceive((*mbox)->os_mbox, &(*msg), timeout / portTICK_RATE_MS)) {
-      EndTime = xTaskGetTickCount();
-      Elapsed = (EndTime - StartTime) * portTICK_RATE_MS;
-
-      if (Elapsed == 0) {
-        Elapsed = 1;
-      }
-
-      ulReturn = Elapsed;
-    } else { // timed out blocking for message
-      *msg = NULL;
-      ulReturn = SYS_ARCH_TIMEOUT;
-    }
-  } else { // block forever for a message.
-    
-    while (1){
-      LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_arch_mbox_fetch: fetch mbox=%p os_mbox=%p lock=%p\n", mbox, (*mbox)->os_mbox, (*mbox)->lock));
-      if (pdTRUE == xQueueReceive((*mbox)->os_mbox, &(*msg), portMAX_DELAY)){
-        LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_arch_mbox_fetch:mbox rx msg=%p\n", (*msg)));
-        break;
-      }
+  mb = *mbox;
+  Ticks = timeout / portTICK_RATE_MS;
 
-      if ((*mbox)->alive == false){
-        LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_arch_mbox_fetch:mbox not alive\n"));
+  while (!sys_mbox_ring_get(mb, msg)) {
+    Wait = portMAX_DELAY;
+    if (timeout != 0) {
+      Elapsed = xTaskGetTickCount() - StartTime;
+      if (Elapsed >= Ticks) {
         *msg = NULL;
-        break;
+        return SYS_ARCH_TIMEOUT;
       }
+      Wait = Ticks - Elapsed;
     }
 
-    EndTime = xTaskGetTickCount();
-    Elapsed = (EndTime - StartTime) * portTICK_RATE_MS;
-
-    if (Elapsed == 0) {
-      Elapsed = 1;
+    __atomic_add_fetch(&mb->waiting, 1, __ATOMIC_SEQ_CST);
+    /* check again: a post before the increment didn't wake us */
+    if (sys_mbox_ring_get(mb, msg)) {
+      __atomic_sub_fetch(&mb->waiting, 1, __ATOMIC_SEQ_CST);
+      break;
     }
-
-    ulReturn = Elapsed;
+    if (mb->alive == false) {
+      LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_arch_mbox_fetch:mbox not alive\n"));
+      __atomic_sub_fetch(&mb->waiting, 1, __ATOMIC_SEQ_CST);
+      *msg = NULL;
+      break;
+    }
+    xSemaphoreTake(mb->wake, Wait);
+    __atomic_sub_fetch(&mb->waiting, 1, __ATOMIC_SEQ_CST);
   }
 
-  sys_mutex_unlock(&(*mbox)->lock);
+  Elapsed = (xTaskGetTickCount() - StartTime) * portTICK_RATE_MS;
+  if (Elapsed == 0) {
+    Elapsed = 1;
+  }
 
-  return ulReturn ; // return time blocked TBD test
+  return Elapsed; // return time blocked TBD test
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -327,19 +461,16 @@ u32_t
 sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
 {
   void *pvDummy;
-  unsigned long ulReturn;
 
   if (msg == NULL) {
     msg = &pvDummy;
   }
 
-  if (pdTRUE == xQueueReceive((*mbox)->os_mbox, &(*msg), 0)) {
-    ulReturn = ERR_OK;
-  } else {
-    ulReturn = SYS_MBOX_EMPTY;
+  if (sys_mbox_ring_get(*mbox, msg)) {
+    return ERR_OK;
   }
 
-  return ulReturn;
+  return SYS_MBOX_EMPTY;
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -354,47 +485,37 @@ sys_mbox_free(sys_mbox_t *mbox)
 #define MAX_POLL_CNT 100
 #define PER_POLL_DELAY 20
   uint16_t count = 0;
-  bool post_null = true;
 
   LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free: set alive false\n"));
   (*mbox)->alive = false;
+  __sync_synchronize();
 
+  /* wake fetchers still sleeping on the mailbox, they return with no message */
   while ( count++ < MAX_POLL_CNT ){ //ESP32_WORKAROUND
-    LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free:try lock=%d\n", count));
-    if (!sys_mutex_trylock( &(*mbox)->lock )){
-      LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free:get lock ok %d\n", count));
-      sys_mutex_unlock( &(*mbox)->lock );
+    if (__atomic_load_n(&(*mbox)->waiting, __ATOMIC_SEQ_CST) == 0) {
+      LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free: no waiter %d\n", count));
       break;
     }
 
-    if (post_null){
-      LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free: post null to mbox\n"));
-      if (sys_mbox_trypost( mbox, NULL) != ERR_OK){
-        LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free: post null mbox fail\n"));
-      } else {
-        post_null = false;
-        LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free: post null mbox ok\n"));
-      }
-    }
+    xSemaphoreGive((*mbox)->wake);
 
     if (count == (MAX_POLL_CNT-1)){
-      printf("WARNING: mbox %p had a consumer who never unblocked. Leaking!\n", (*mbox)->os_mbox);
+      printf("WARNING: mbox %p had a consumer who never unblocked. Leaking!\n", *mbox);
     }
     sys_delay_ms(PER_POLL_DELAY);
   }
 
   LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sys_mbox_free:free mbox\n"));
 
-  if (uxQueueMessagesWaiting((*mbox)->os_mbox)) {
-    xQueueReset((*mbox)->os_mbox);
+  if (sys_mbox_waiting(mbox)) {
     /* Line for breakpoint.  Should never break here! */
     __asm__ volatile ("nop");
   }
 
-  vQueueDelete((*mbox)->os_mbox);
-  sys_mutex_free(&(*mbox)->lock);
+  vSemaphoreDelete((*mbox)->wake);
   free(*mbox);
   *mbox = NULL;
+  SYS_STATS_DEC(mbox.used);
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -410,7 +531,7 @@ sys_thread_new(const char *name, lwip_thread_fn thread, void *arg, int stacksize
   xTaskHandle CreatedTask;
   portBASE_TYPE result;
 
-  result = xTaskCreate(thread, name, stacksize, arg, prio, &CreatedTask);
+  result = xTaskCreatePinnedToCore(thread, name, stacksize, arg, prio, &CreatedTask, TCPIP_THREAD_CORE);
 
   if (result == pdPASS) {
     return CreatedTask;
@@ -433,6 +554,13 @@ sys_now(void)
   return xTaskGetTickCount();
 }
 
+/*-----------------------------------------------------------------------------------*/
+u32_t
+sys_jiffies(void)
+{
+  return xTaskGetTickCount();
+}
+
 static portMUX_TYPE g_lwip_mux = portMUX_INITIALIZER_UNLOCKED;
 /*
   This optional function does a "fast" critical region protection and returns
@@ -499,7 +627,7 @@ static void sys_thread_tls_free(int index, void* data)
 {
   sys_sem_t *sem = (sys_sem_t*)(data);
 
-  if (sem && *sem){
+  if (sem && *sem && !sys_sem_is_notify(*sem)){
     LWIP_DEBUGF(THREAD_SAFE_DEBUG, ("sem del, i=%d sem=%p\n", index, *sem));
     vSemaphoreDelete(*sem);
   }
@@ -519,7 +647,11 @@ sys_sem_t* sys_thread_sem_init(void)
     return 0;
   }
 
+#if CONFIG_LWIP_THREAD_SEM_TASK_NOTIFY
+  *sem = (sys_sem_t)((uint32_t)xTaskGetCurrentTaskHandle() | SYS_SEM_NOTIFY_TAG);
+#else
   *sem = xSemaphoreCreateBinary();
+#endif
   if (!(*sem)){
     free(sem);
     printf("sem f2\n");
@@ -0,0 +1,89 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * memp_malloc()/memp_free() on top of esp_mempool, used when MEMP_MEM_MALLOC
+ * and ESP_MEMP_POOLS are both enabled. Each memp type gets a pool of
+ * MEMP_NUM_xxx elements; allocations fall back to mem_malloc() when the pool
+ * of their type is empty or couldn't be created.
+ */
+
+#include "lwip/opt.h"
+
+#if MEMP_MEM_MALLOC && ESP_MEMP_POOLS
+
+#include "lwip/memp.h"
+#include "lwip/mem.h"
+#include "lwip/debug.h"
+
+#include "esp_mempool.h"
+#include "heap_alloc_caps.h"
+
+/* Number of elements of each memp type */
+static const u16_t memp_num[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc) (num),
+#include "lwip/priv/memp_std.h"
+};
+
+static esp_mempool_handle_t memp_pool_handles[MEMP_MAX];
+
+void
+memp_init(void)
+{
+  u16_t i;
+
+  for (i = 0; i < MEMP_MAX; i++) {
+    memp_pool_handles[i] = NULL;
+    if (memp_num[i] == 0) {
+      continue;
+    }
+    if (esp_mempool_create(memp_pools[i]->size, memp_num[i], MALLOC_CAP_8BIT, &memp_pool_handles[i]) != ESP_OK) {
+      LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_WARNING, ("memp_init: no memory for pool %"U16_F", using heap\n", i));
+      memp_pool_handles[i] = NULL;
+    }
+  }
+}
+
+void *
+memp_malloc(memp_t type)
+{
+  void *mem = NULL;
+
+  LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
+
+  if (memp_pool_handles[type] != NULL) {
+    mem = esp_mempool_alloc(memp_pool_handles[type]);
+  }
+  if (mem == NULL) {
+    mem = mem_malloc(memp_pools[type]->size);
+  }
+  return mem;
+}
+
+void
+memp_free(memp_t type, void *mem)
+{
+  LWIP_ERROR("memp_free: type < MEMP_MAX", (type < MEMP_MAX), return;);
+
+  if (mem == NULL) {
+    return;
+  }
+  if (memp_pool_handles[type] != NULL && esp_mempool_contains(memp_pool_handles[type], mem)) {
+    esp_mempool_free(memp_pool_handles[type], mem);
+  } else {
+    mem_free(mem);
+  }
+}
+
+#endif /* MEMP_MEM_MALLOC && ESP_MEMP_POOLS */
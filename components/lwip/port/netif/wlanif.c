@@ -41,9 +41,16 @@
 #include "lwip/def.h"
 #include "lwip/mem.h"
 #include "lwip/pbuf.h"
+#include "lwip/memp.h"
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
 #include "lwip/ethip6.h"
+#include "lwip/igmp.h"
+#include "lwip/mld6.h"
+#include "lwip/ip4.h"
+#include "lwip/udp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/sys.h"
 #include "netif/etharp.h"
 #include "netif/wlanif.h"
 
@@ -69,6 +76,355 @@ static char hostname[16];
 uint32_t g_rx_alloc_pbuf_fail_cnt = 0;
 #endif
 
+#ifdef LWIP_ESP8266
+extern void system_pp_recycle_rx_pkt(void*);
+#endif
+
+#if ESP_RX_PBUF_POOL_SIZE
+/* Number of MEMP_RX_PBUF pbufs held by the stack. memp_malloc falls back to
+   the heap when a pool is empty, so the limit is kept here. Updated with
+   atomics, as frames are received in the WiFi task and mostly freed in the
+   tcpip thread. */
+static u32_t wlanif_rx_pbuf_used;
+
+/* custom_free_function of the received frames: return the driver buffer and
+   the pbuf to their pools */
+static void
+wlanif_rx_pbuf_free(struct pbuf *p)
+{
+  if (p->eb != NULL) {
+    system_pp_recycle_rx_pkt(p->eb);
+  }
+  memp_free(MEMP_RX_PBUF, p);
+  __atomic_sub_fetch(&wlanif_rx_pbuf_used, 1, __ATOMIC_RELAXED);
+}
+
+/* Reference a received frame from a MEMP_RX_PBUF pbuf, or return NULL if the
+   stack holds ESP_RX_PBUF_POOL_SIZE frames already */
+static struct pbuf *
+wlanif_rx_pbuf_alloc(void *buffer, u16_t len, void *eb)
+{
+  struct pbuf_custom *pc;
+  struct pbuf *p;
+
+  if (__atomic_add_fetch(&wlanif_rx_pbuf_used, 1, __ATOMIC_RELAXED) > ESP_RX_PBUF_POOL_SIZE) {
+    __atomic_sub_fetch(&wlanif_rx_pbuf_used, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  pc = (struct pbuf_custom *)memp_malloc(MEMP_RX_PBUF);
+  if (pc == NULL) {
+    __atomic_sub_fetch(&wlanif_rx_pbuf_used, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  pc->custom_free_function = wlanif_rx_pbuf_free;
+  p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, pc, buffer, len);
+  p->eb = eb;
+  return p;
+}
+#endif /* ESP_RX_PBUF_POOL_SIZE */
+
+#if ESP_MCAST_FILTER
+/* Multicast filter of each interface, like the hash filter of an Ethernet
+   MAC: the number of joined groups whose MAC address falls into each bucket.
+   wlanif_input drops IPv4 and IPv6 multicast frames of an empty bucket,
+   ip4_input and ip6_input still check the group of the others. The counts
+   are changed in the tcpip thread and read in the WiFi task; a frame
+   received while its group is joined or left may pass or be dropped. */
+#define WLANIF_MCAST_FILTER_SIZE        64
+
+static u8_t wlanif_mcast_filter[WIFI_IF_MAX][WLANIF_MCAST_FILTER_SIZE];
+
+static u8_t
+wlanif_mcast_hash(const u8_t *mac)
+{
+  return (u8_t)((mac[2] ^ mac[3] ^ mac[4] ^ mac[5]) % WLANIF_MCAST_FILTER_SIZE);
+}
+
+static err_t
+wlanif_mcast_filter_update(struct netif *netif, const u8_t *mac, u8_t action)
+{
+  wifi_interface_t wifi_if = tcpip_adapter_get_wifi_if(netif);
+  u8_t *count;
+
+  if (wifi_if >= WIFI_IF_MAX) {
+    return ERR_IF;
+  }
+  count = &wlanif_mcast_filter[wifi_if][wlanif_mcast_hash(mac)];
+  if (action) {
+    if (*count == 0xff) {
+      return ERR_MEM;
+    }
+    (*count)++;
+  } else if (*count != 0) {
+    (*count)--;
+  }
+  return ERR_OK;
+}
+
+#if LWIP_IGMP
+/* igmp_mac_filter callback: 01:00:5e and the low 23 bits of the group */
+static err_t
+wlanif_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, u8_t action)
+{
+  u8_t mac[ETHARP_HWADDR_LEN];
+
+  mac[0] = 0x01;
+  mac[1] = 0x00;
+  mac[2] = 0x5e;
+  mac[3] = ip4_addr2(group) & 0x7f;
+  mac[4] = ip4_addr3(group);
+  mac[5] = ip4_addr4(group);
+  return wlanif_mcast_filter_update(netif, mac, action == IGMP_ADD_MAC_FILTER);
+}
+#endif /* LWIP_IGMP */
+
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+/* mld_mac_filter callback: 33:33 and the low 32 bits of the group */
+static err_t
+wlanif_mld_mac_filter(struct netif *netif, const ip6_addr_t *group, u8_t action)
+{
+  u32_t low = ntohl(group->addr[3]);
+  u8_t mac[ETHARP_HWADDR_LEN];
+
+  mac[0] = 0x33;
+  mac[1] = 0x33;
+  mac[2] = (u8_t)(low >> 24);
+  mac[3] = (u8_t)(low >> 16);
+  mac[4] = (u8_t)(low >> 8);
+  mac[5] = (u8_t)low;
+  return wlanif_mcast_filter_update(netif, mac, action == MLD6_ADD_MAC_FILTER);
+}
+#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
+
+/* Empty the filter of an interface being added and install the callbacks
+   which keep it up to date */
+static void
+wlanif_mcast_filter_init(struct netif *netif)
+{
+  wifi_interface_t wifi_if = tcpip_adapter_get_wifi_if(netif);
+
+  if (wifi_if >= WIFI_IF_MAX) {
+    return;
+  }
+  memset(wlanif_mcast_filter[wifi_if], 0, sizeof(wlanif_mcast_filter[wifi_if]));
+#if LWIP_IGMP
+  netif->igmp_mac_filter = wlanif_igmp_mac_filter;
+#endif /* LWIP_IGMP */
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+  netif->mld_mac_filter = wlanif_mld_mac_filter;
+  {
+    /* ip6_input always accepts the all-nodes group, which isn't joined */
+    static const u8_t allnodes[ETHARP_HWADDR_LEN] = {0x33, 0x33, 0x00, 0x00, 0x00, 0x01};
+    wlanif_mcast_filter_update(netif, allnodes, MLD6_ADD_MAC_FILTER);
+  }
+#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
+}
+
+/* Whether a received frame passes the multicast filter of its interface */
+static u8_t
+wlanif_mcast_accept(struct netif *netif, const u8_t *dst)
+{
+  wifi_interface_t wifi_if;
+  u8_t filtered = 0;
+
+  if (!(dst[0] & 0x01)) {
+    /* unicast */
+    return 1;
+  }
+#if LWIP_IGMP
+  if ((dst[0] == 0x01) && (dst[1] == 0x00) && (dst[2] == 0x5e) && !(dst[3] & 0x80) &&
+      (netif->flags & NETIF_FLAG_IGMP)) {
+    filtered = 1;
+  }
+#endif /* LWIP_IGMP */
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+  if ((dst[0] == 0x33) && (dst[1] == 0x33)) {
+    filtered = 1;
+  }
+#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
+  if (!filtered) {
+    /* broadcast and multicast of other protocols */
+    return 1;
+  }
+  wifi_if = tcpip_adapter_get_wifi_if(netif);
+  if (wifi_if >= WIFI_IF_MAX) {
+    return 1;
+  }
+  return wlanif_mcast_filter[wifi_if][wlanif_mcast_hash(dst)] != 0;
+}
+#endif /* ESP_MCAST_FILTER */
+
+#if ESP_UDP_FAST_PORTS && LWIP_IPV4
+/* Ports whose UDP datagrams are handed to a callback in wlanif_input, in the
+   WiFi task, instead of going through the tcpip thread and a netconn. The
+   table is read by the WiFi task and changed by the application, both under
+   SYS_ARCH_PROTECT; wlanif_udp_fast_busy counts callbacks being run, so that
+   unregistering can wait for them to return. */
+struct wlanif_udp_fast {
+  u16_t port;
+  wlanif_udp_fast_fn fn;
+  void *arg;
+};
+
+static struct wlanif_udp_fast wlanif_udp_fast_ports[ESP_UDP_FAST_PORTS];
+static u32_t wlanif_udp_fast_busy;
+
+err_t
+wlanif_udp_fast_register(u16_t port, wlanif_udp_fast_fn fn, void *arg)
+{
+  struct wlanif_udp_fast *free_slot = NULL;
+  err_t err = ERR_MEM;
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (port == 0 || fn == NULL) {
+    return ERR_ARG;
+  }
+  SYS_ARCH_PROTECT(lev);
+  for (i = 0; i < ESP_UDP_FAST_PORTS; i++) {
+    if (wlanif_udp_fast_ports[i].port == port) {
+      free_slot = NULL;
+      err = ERR_USE;
+      break;
+    }
+    if (wlanif_udp_fast_ports[i].port == 0 && free_slot == NULL) {
+      free_slot = &wlanif_udp_fast_ports[i];
+    }
+  }
+  if (free_slot != NULL) {
+    free_slot->fn = fn;
+    free_slot->arg = arg;
+    free_slot->port = port;
+    err = ERR_OK;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  return err;
+}
+
+err_t
+wlanif_udp_fast_unregister(u16_t port)
+{
+  err_t err = ERR_VAL;
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  for (i = 0; i < ESP_UDP_FAST_PORTS; i++) {
+    if (port != 0 && wlanif_udp_fast_ports[i].port == port) {
+      wlanif_udp_fast_ports[i].port = 0;
+      err = ERR_OK;
+      break;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  /* the callback may still be running with the old argument */
+  while (__atomic_load_n(&wlanif_udp_fast_busy, __ATOMIC_ACQUIRE) != 0) {
+    sys_msleep(1);
+  }
+  return err;
+}
+
+/* Deliver a frame holding an IPv4 UDP datagram for a registered port to its
+   callback. The checks are those ip4_input and udp_input would make for a
+   datagram to this interface; anything else (fragments, multicast, several
+   pbufs, bad checksums, an interface without an address) is left to the
+   stack. Returns 1 if the frame was taken. */
+static u8_t
+wlanif_udp_fast_input(struct pbuf *p, struct netif *netif)
+{
+  const struct eth_hdr *ethhdr;
+  const struct ip_hdr *iphdr;
+  const struct udp_hdr *udphdr;
+  ip4_addr_t src, dest;
+  u16_t iphdr_hlen, iphdr_len, udp_len, port, src_port;
+  wlanif_udp_fast_fn fn = NULL;
+  void *arg = NULL;
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (p->len < SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN || p->len != p->tot_len) {
+    return 0;
+  }
+  ethhdr = (const struct eth_hdr *)p->payload;
+  if (ethhdr->type != PP_HTONS(ETHTYPE_IP)) {
+    return 0;
+  }
+  iphdr = (const struct ip_hdr *)((const u8_t *)p->payload + SIZEOF_ETH_HDR);
+  if (IPH_V(iphdr) != 4 || IPH_PROTO(iphdr) != IP_PROTO_UDP ||
+      (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0) {
+    return 0;
+  }
+  iphdr_hlen = IPH_HL(iphdr) * 4;
+  iphdr_len = lwip_ntohs(IPH_LEN(iphdr));
+  if (iphdr_hlen < IP_HLEN || iphdr_len < iphdr_hlen + UDP_HLEN ||
+      SIZEOF_ETH_HDR + iphdr_len > p->len) {
+    return 0;
+  }
+  udphdr = (const struct udp_hdr *)((const u8_t *)iphdr + iphdr_hlen);
+  port = lwip_ntohs(udphdr->dest);
+
+  /* cheap test first: is the port registered at all */
+  for (i = 0; i < ESP_UDP_FAST_PORTS; i++) {
+    if (wlanif_udp_fast_ports[i].port == port) {
+      break;
+    }
+  }
+  if (i == ESP_UDP_FAST_PORTS) {
+    return 0;
+  }
+
+  ip4_addr_copy(src, iphdr->src);
+  ip4_addr_copy(dest, iphdr->dest);
+  if (!netif_is_up(netif) || ip4_addr_isany_val(*netif_ip4_addr(netif)) ||
+      (!ip4_addr_cmp(&dest, netif_ip4_addr(netif)) && !ip4_addr_isbroadcast(&dest, netif)) ||
+      ip4_addr_isbroadcast(&src, netif) || ip4_addr_ismulticast(&src)) {
+    return 0;
+  }
+  udp_len = lwip_ntohs(udphdr->len);
+  if (udp_len < UDP_HLEN || udp_len > iphdr_len - iphdr_hlen) {
+    return 0;
+  }
+#if CHECKSUM_CHECK_IP
+  if (inet_chksum(iphdr, iphdr_hlen) != 0) {
+    return 0;
+  }
+#endif /* CHECKSUM_CHECK_IP */
+
+  SYS_ARCH_PROTECT(lev);
+  for (i = 0; i < ESP_UDP_FAST_PORTS; i++) {
+    if (wlanif_udp_fast_ports[i].port == port) {
+      fn = wlanif_udp_fast_ports[i].fn;
+      arg = wlanif_udp_fast_ports[i].arg;
+      __atomic_add_fetch(&wlanif_udp_fast_busy, 1, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  if (fn == NULL) {
+    /* unregistered in the meantime */
+    return 0;
+  }
+
+  /* from here on, the frame is not passed to the stack. Leave the datagram
+     in the pbuf, without Ethernet padding. */
+  pbuf_header(p, -(s16_t)(SIZEOF_ETH_HDR + iphdr_hlen));
+  pbuf_realloc(p, udp_len);
+#if CHECKSUM_CHECK_UDP
+  if (udphdr->chksum != 0 && inet_chksum_pseudo(p, IP_PROTO_UDP, udp_len, &src, &dest) != 0) {
+    /* udp_input would drop it as well */
+    pbuf_free(p);
+    __atomic_sub_fetch(&wlanif_udp_fast_busy, 1, __ATOMIC_RELEASE);
+    return 1;
+  }
+#endif /* CHECKSUM_CHECK_UDP */
+  src_port = lwip_ntohs(udphdr->src);
+  pbuf_header(p, -UDP_HLEN);
+  fn(arg, p, &src, src_port, netif);
+  __atomic_sub_fetch(&wlanif_udp_fast_busy, 1, __ATOMIC_RELEASE);
+  return 1;
+}
+#endif /* ESP_UDP_FAST_PORTS && LWIP_IPV4 */
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -134,25 +490,28 @@ low_level_output(struct netif *netif, struct pbuf *p)
   } 
   
 #ifdef LWIP_ESP8266
-    q = p;
-    u16_t pbuf_x_len = 0;
-    pbuf_x_len = q->len;
-    if(q->next !=NULL)
-    {
-        //char cnt = 0;
-        struct pbuf *tmp = q->next;
-        while(tmp != NULL)
-        {
-            memcpy( (u8_t *)( (u8_t *)(q->payload) + pbuf_x_len), (u8_t *)tmp->payload , tmp->len );
-            pbuf_x_len += tmp->len;
-            //cnt++;
-            tmp = tmp->next;
-        }
+    /* ieee80211_output takes one contiguous frame and copies it. A frame in
+       a single pbuf is passed as is; only a chain (e.g. TCP header + data
+       pbufs) is flattened, into a buffer of its own: the first pbuf of a
+       chain has no room for the rest of it. */
+    if (p->next == NULL) {
+        ieee80211_output(wifi_if, p->payload, p->len);
+        LINK_STATS_INC(link.xmit);
+        return ERR_OK;
+    }
+
+    q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (q == NULL) {
+        LINK_STATS_INC(link.memerr);
+        LINK_STATS_INC(link.drop);
+        return ERR_MEM;
     }
-    
-    ieee80211_output(wifi_if, q->payload, pbuf_x_len);
+    pbuf_copy(q, p);
+    ieee80211_output(wifi_if, q->payload, q->len);
+    pbuf_free(q);
+    LINK_STATS_INC(link.xmit);
     return ERR_OK;
-    
+
 #else
     for(q = p; q != NULL; q = q->next) {
         ieee80211_output(wifi_if, q->payload, q->len);
@@ -170,8 +529,11 @@ low_level_output(struct netif *netif, struct pbuf *p)
  * the appropriate input function is called.
  *
  * @param netif the lwip network interface structure for this ethernetif
+ * @return ERR_OK if the frame was passed to the stack, ERR_MEM if it was
+ *         dropped because the stack holds too many frames. The driver buffer
+ *         is released in both cases.
  */
-void
+err_t
 #ifdef LWIP_ESP8266
 wlanif_input(struct netif *netif, void *buffer, u16_t len, void* eb)
 #else
@@ -183,37 +545,73 @@ wlanif_input(struct netif *netif, void *buffer, uint16 len)
 #ifdef LWIP_ESP8266
     if(buffer== NULL)
     	goto _exit;
-    if(netif == NULL)
+    if(netif == NULL) {
+    	system_pp_recycle_rx_pkt(eb);
     	goto _exit;
+    }
 #endif
 
+#if ESP_MCAST_FILTER
+  if (!wlanif_mcast_accept(netif, (const u8_t *)buffer)) {
+    /* a group not joined on this interface: drop the frame before it takes
+       a pbuf and a trip through the tcpip thread */
 #ifdef LWIP_ESP8266
+    system_pp_recycle_rx_pkt(eb);
+#endif
+    return ERR_OK;
+  }
+#endif /* ESP_MCAST_FILTER */
+
+#ifdef LWIP_ESP8266
+#if ESP_RX_PBUF_POOL_SIZE
+  p = wlanif_rx_pbuf_alloc(buffer, len, eb);
+#else
   p = pbuf_alloc(PBUF_RAW, len, PBUF_REF);
+  if (p != NULL) {
+    p->payload = buffer;
+    p->eb = eb;
+  }
+#endif
   if (p == NULL){
 #ifdef PERF
       g_rx_alloc_pbuf_fail_cnt++;
 #endif
-      return;
+      /* drop the frame here rather than deep in the stack, and let the
+         driver have its buffer back right away */
+      system_pp_recycle_rx_pkt(eb);
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      return ERR_MEM;
   }
-  p->payload = buffer;
-  p->eb = eb;
 #else
   p = pbuf_alloc(PBUF_IP, len, PBUF_POOL);
   if (p == NULL) {
-    return;
+    LINK_STATS_INC(link.memerr);
+    LINK_STATS_INC(link.drop);
+    return ERR_MEM;
   }
   memcpy(p->payload, buffer, len);
 #endif
 
 
+  LINK_STATS_INC(link.recv);
+
+#if ESP_UDP_FAST_PORTS && LWIP_IPV4
+  if (wlanif_udp_fast_input(p, netif)) {
+    return ERR_OK;
+  }
+#endif /* ESP_UDP_FAST_PORTS && LWIP_IPV4 */
+
   /* full packet send to tcpip_thread to process */
   if (netif->input(p, netif) != ERR_OK) {
     LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
+    LINK_STATS_INC(link.drop);
     pbuf_free(p);
+    return ERR_MEM;
   }
   
 _exit:
-;	  
+  return ERR_OK;
 }
 
 /**
@@ -260,10 +658,10 @@ wlanif_init(struct netif *netif)
 
   /*
    * Initialize the snmp variables and counters inside the struct netif.
-   * The last argument should be replaced with your link speed, in units
-   * of bits per second.
+   * The link speed (bits per second) is the highest 802.11n rate of the
+   * ESP32 (HT40, short guard interval).
    */
-  NETIF_INIT_SNMP(netif, snmp_ifType_ethernet_csmacd, LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
+  NETIF_INIT_SNMP(netif, snmp_ifType_ethernet_csmacd, 150000000);
 
   netif->name[0] = IFNAME0;
   netif->name[1] = IFNAME1;
@@ -279,6 +677,9 @@ wlanif_init(struct netif *netif)
   
   /* initialize the hardware */
   low_level_init(netif);
+#if ESP_MCAST_FILTER
+  wlanif_mcast_filter_init(netif);
+#endif /* ESP_MCAST_FILTER */
 
   return ERR_OK;
 }
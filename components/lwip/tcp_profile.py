@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+#
+# Prints the RAM / throughput trade-off of the lwIP TCP options.
+#
+# For an sdkconfig, or for each of the TCP profiles of menuconfig, this
+# prints the worst case RAM taken by the sockets and TCP connections, with
+# every connection having a full receive window and send buffer, and the
+# throughput limit of one connection for a few round trip times: a
+# connection can't have more than a window of data in flight.
+#
+# The object sizes are approximations for the ESP32 build of lwIP.
+import argparse
+import sys
+
+__version__ = '1.0'
+
+TCP_MSS = 1460
+
+# struct lwip_sock, struct netconn and its receive mailbox
+SOCKET_SIZE = 32 + 48 + 16 * 4 + 80
+# struct tcp_pcb with IPv6
+TCP_PCB_SIZE = 200
+# struct tcp_seg, struct pbuf and the link, IP and TCP header room of a segment
+SEGMENT_OVERHEAD = 20 + 20 + 14 + 40 + 20
+
+RTTS_MS = [2, 10, 50]
+
+PROFILES = [
+    # name, sockets, active TCP connections, window and send buffer (segments), send buffer in SPI RAM
+    ('default', 10, 5, 4, 2, False),
+    ('throughput', 10, 5, 48, 32, True),
+    ('connections', 16, 16, 4, 2, False),
+]
+
+
+def read_sdkconfig(path):
+    config = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('CONFIG_') and '=' in line:
+                key, value = line.split('=', 1)
+                config[key[len('CONFIG_'):]] = value.strip('"')
+    return config
+
+
+def profile_from_sdkconfig(path, default_wnd, default_snd_buf):
+    config = read_sdkconfig(path)
+    return (path,
+            int(config.get('LWIP_MAX_SOCKETS', 10)),
+            int(config.get('LWIP_MAX_ACTIVE_TCP', 5)),
+            int(config.get('LWIP_TCP_WND_MSS', default_wnd)),
+            int(config.get('LWIP_TCP_SND_BUF_MSS', default_snd_buf)),
+            config.get('LWIP_TCP_SND_BUF_SPIRAM') == 'y')
+
+
+def print_profile(name, sockets, connections, wnd, snd_buf, snd_buf_spiram):
+    static = sockets * SOCKET_SIZE + connections * TCP_PCB_SIZE
+    rcv = wnd * TCP_MSS
+    snd = snd_buf * (TCP_MSS + SEGMENT_OVERHEAD)
+    internal = static + connections * (rcv + (0 if snd_buf_spiram else snd))
+    spiram = connections * snd if snd_buf_spiram else 0
+
+    print('%s: %d sockets, %d TCP connections, window %d B, send buffer %d B%s' %
+          (name, sockets, connections, rcv, snd_buf * TCP_MSS, ' (SPI RAM)' if snd_buf_spiram else ''))
+    print('  worst case RAM: %d kB internal, %d kB SPI RAM (%d kB per connection)' %
+          (internal // 1024, spiram // 1024, (rcv + snd) // 1024))
+    for rtt in RTTS_MS:
+        # bytes per millisecond to Mbit/s
+        print('  RTT %2d ms: receive <= %6.1f Mbit/s, send <= %6.1f Mbit/s' %
+              (rtt, rcv * 8.0 / rtt / 1000, snd_buf * TCP_MSS * 8.0 / rtt / 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='tcp_profile.py v%s - RAM and throughput of the lwIP TCP options' % __version__)
+    parser.add_argument('sdkconfig', nargs='?', help='sdkconfig to evaluate, instead of the menuconfig profiles')
+    parser.add_argument('--default-wnd', type=int, default=4,
+                        help='window (segments) assumed when the WiFi library chooses it (default profile)')
+    parser.add_argument('--default-snd-buf', type=int, default=2,
+                        help='send buffer (segments) assumed when the WiFi library chooses it (default profile)')
+    args = parser.parse_args()
+
+    if args.sdkconfig:
+        profiles = [profile_from_sdkconfig(args.sdkconfig, args.default_wnd, args.default_snd_buf)]
+    else:
+        profiles = [(p[0], p[1], p[2], args.default_wnd, args.default_snd_buf, p[5]) if p[0] == 'default' else p
+                    for p in PROFILES]
+    for p in profiles:
+        print_profile(*p)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
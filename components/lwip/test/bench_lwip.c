@@ -0,0 +1,404 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Replay benchmark of the host build of lwIP.
+ *
+ * Each trace is replayed through pcapif a number of times, on the clock of
+ * the trace, after one run to warm up. Only the work of the stack is
+ * measured: the input of each frame, as wlanif_input() does it, and the
+ * timers. The cost per frame is reported as the best and the mean of the
+ * runs, next to the allocations per frame, which don't depend on the host
+ * and so can be compared between builds as they are.
+ *
+ * Without -r the synthetic traces of trace_gen.c are replayed, and the
+ * data received by the stack is checked against what they carry: the
+ * program fails if it isn't all there.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/init.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/ip_frag.h"
+#include "netif/etharp.h"
+
+#include "pcap.h"
+#include "pcapif.h"
+#include "trace_gen.h"
+
+#define BENCH_MAX_TRACES    16
+#define BENCH_DRAIN_MS      2000
+
+struct bench_mem_stats {
+  uint64_t allocs;
+  uint64_t bytes;
+  size_t in_use;
+  size_t peak;
+};
+
+struct bench_result {
+  uint64_t best_ns;
+  uint64_t total_ns;
+  uint64_t allocs;
+  uint64_t alloc_bytes;
+  size_t peak;
+  struct pcapif_stats stats;
+};
+
+static struct bench_mem_stats s_mem;
+static struct netif s_netif;
+static u32_t s_now = 1000;
+static u32_t s_tcp_next, s_reass_next, s_arp_next;
+
+/* lwIP allocates through these (see port/lwipopts.h); a header in front of
+   each block keeps its size for the bytes in use */
+#define BENCH_MEM_HDR       MEM_ALIGNMENT
+
+void *
+bench_mem_malloc(size_t size)
+{
+  unsigned char *p = (unsigned char *)malloc(BENCH_MEM_HDR + size);
+
+  if (p == NULL) {
+    return NULL;
+  }
+  *(size_t *)p = size;
+  s_mem.allocs++;
+  s_mem.bytes += size;
+  s_mem.in_use += size;
+  if (s_mem.in_use > s_mem.peak) {
+    s_mem.peak = s_mem.in_use;
+  }
+  return p + BENCH_MEM_HDR;
+}
+
+void *
+bench_mem_calloc(size_t count, size_t size)
+{
+  void *p = bench_mem_malloc(count * size);
+
+  if (p != NULL) {
+    memset(p, 0, count * size);
+  }
+  return p;
+}
+
+void
+bench_mem_free(void *mem)
+{
+  unsigned char *p = (unsigned char *)mem - BENCH_MEM_HDR;
+
+  if (mem == NULL) {
+    return;
+  }
+  s_mem.in_use -= *(size_t *)p;
+  free(p);
+}
+
+static uint64_t
+bench_clock_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* run the timers which are due by now, each at its own time */
+static void
+bench_timers(u32_t now)
+{
+  while ((s32_t)(now - s_tcp_next) >= 0) {
+    sys_arch_set_now(s_tcp_next);
+    tcp_tmr();
+    s_tcp_next += TCP_TMR_INTERVAL;
+  }
+  while ((s32_t)(now - s_reass_next) >= 0) {
+    sys_arch_set_now(s_reass_next);
+    ip_reass_tmr();
+    s_reass_next += IP_TMR_INTERVAL;
+  }
+  while ((s32_t)(now - s_arp_next) >= 0) {
+    sys_arch_set_now(s_arp_next);
+    etharp_tmr();
+    s_arp_next += ARP_TMR_INTERVAL;
+  }
+  sys_arch_set_now(now);
+  s_now = now;
+}
+
+/* replay trace once; frames sent by the stack go to capture unless it is NULL */
+static void
+bench_replay(const struct pcap_trace *trace, struct pcap_trace *capture, struct bench_result *res)
+{
+  uint64_t ts0 = trace->count ? trace->frames[0].ts_us : 0;
+  uint64_t ns = 0, allocs = 0, bytes = 0, start;
+  u32_t base = s_now + 1000;
+  size_t i;
+
+  pcapif_reset(&s_netif);
+  pcapif_set_capture(&s_netif, capture);
+  s_mem.peak = s_mem.in_use;
+
+  for (i = 0; i < trace->count; i++) {
+    const struct pcap_frame *frame = &trace->frames[i];
+    u32_t now = base + (u32_t)((frame->ts_us - ts0) / 1000);
+    u16_t len;
+    void *buf;
+
+    buf = pcapif_prepare(&s_netif, frame, &len);
+    allocs -= s_mem.allocs;
+    bytes -= s_mem.bytes;
+    start = bench_clock_ns();
+    bench_timers(now);
+    if (buf != NULL) {
+      pcapif_input(&s_netif, buf, len);
+    }
+    ns += bench_clock_ns() - start;
+    allocs += s_mem.allocs;
+    bytes += s_mem.bytes;
+  }
+
+  /* let the retransmissions and delayed ACKs of the end of the trace out */
+  allocs -= s_mem.allocs;
+  bytes -= s_mem.bytes;
+  start = bench_clock_ns();
+  bench_timers(s_now + BENCH_DRAIN_MS);
+  ns += bench_clock_ns() - start;
+  allocs += s_mem.allocs;
+  bytes += s_mem.bytes;
+
+  pcapif_set_capture(&s_netif, NULL);
+  if (res->best_ns == 0 || ns < res->best_ns) {
+    res->best_ns = ns;
+  }
+  res->total_ns += ns;
+  res->allocs = allocs;
+  res->alloc_bytes = bytes;
+  res->peak = s_mem.peak - s_mem.in_use;
+  res->stats = *pcapif_get_stats(&s_netif);
+}
+
+static void
+bench_print_header(void)
+{
+  printf("%-16s %7s %7s %7s %10s %10s %8s %8s %8s\n", "trace", "frames", "input", "output",
+         "ns/frame", "(mean)", "allocs", "bytes", "peak");
+  printf("%-16s %7s %7s %7s %10s %10s %8s %8s %8s\n", "", "", "", "",
+         "best", "", "/frame", "/frame", "");
+}
+
+static void
+bench_print(const char *name, const struct bench_result *res, int iterations)
+{
+  unsigned frames = res->stats.frames_in ? res->stats.frames_in : 1;
+
+  printf("%-16s %7u %7u %7u %10.0f %10.0f %8.2f %8.0f %8u\n", name,
+         (unsigned)(res->stats.frames_in + res->stats.frames_skipped),
+         (unsigned)res->stats.frames_in, (unsigned)res->stats.frames_out,
+         (double)res->best_ns / frames, (double)res->total_ns / iterations / frames,
+         (double)res->allocs / frames, (double)res->alloc_bytes / frames, (unsigned)res->peak);
+}
+
+/*
+ * Replay trace iterations times and print the figures; if out_path isn't
+ * NULL, the frames the stack sent in the first run are saved there.
+ */
+static void
+bench_trace(const char *name, const struct pcap_trace *trace, int iterations,
+            const char *out_path, struct bench_result *res)
+{
+  struct pcap_trace capture;
+  int i;
+
+  pcap_trace_init(&capture);
+  memset(res, 0, sizeof(*res));
+  bench_replay(trace, NULL, res);
+  memset(res, 0, sizeof(*res));
+  for (i = 0; i < iterations; i++) {
+    bench_replay(trace, (i == 0 && out_path != NULL) ? &capture : NULL, res);
+  }
+  if (out_path != NULL) {
+    pcap_trace_save(&capture, out_path);
+  }
+  pcap_trace_free(&capture);
+  bench_print(name, res, iterations);
+  if (res->stats.tcp_flows_skipped != 0) {
+    printf("%-16s %u TCP connections not opened by a peer in the trace, skipped\n", "",
+           (unsigned)res->stats.tcp_flows_skipped);
+  }
+}
+
+static int
+bench_parse_mac(const char *s, struct eth_addr *mac)
+{
+  unsigned b[ETH_HWADDR_LEN];
+  int i;
+
+  if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETH_HWADDR_LEN) {
+    return -1;
+  }
+  for (i = 0; i < ETH_HWADDR_LEN; i++) {
+    mac->addr[i] = (u8_t)b[i];
+  }
+  return 0;
+}
+
+static void
+bench_usage(const char *prog)
+{
+  const struct trace_gen *gen;
+
+  fprintf(stderr,
+          "usage: %s [-n iterations] [-t trace] [-w dir]\n"
+          "       %s [-n iterations] [-w dir] -a ip [-m mac] -r file.pcap...\n"
+          "  -n  runs of each trace after a warm-up run (default 10)\n"
+          "  -t  only replay this synthetic trace\n"
+          "  -w  write the traces and the frames sent by the stack to dir\n"
+          "  -a  address of the DUT in the pcap files\n"
+          "  -m  MAC address of the DUT, else that of the first frame to -a\n"
+          "  -r  replay a pcap file (ethernet frames) instead of the synthetic traces\n"
+          "synthetic traces:\n", prog, prog);
+  for (gen = trace_gens; gen->name != NULL; gen++) {
+    fprintf(stderr, "  %-12s %s\n", gen->name, gen->description);
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *files[BENCH_MAX_TRACES];
+  const char *only = NULL, *dir = NULL, *addr = NULL, *mac_str = NULL;
+  char path[512];
+  struct eth_addr mac;
+  ip4_addr_t ip;
+  struct bench_result res;
+  int iterations = 10, nfiles = 0, failed = 0, opt;
+
+  while ((opt = getopt(argc, argv, "n:t:w:a:m:r:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    case 't':
+      only = optarg;
+      break;
+    case 'w':
+      dir = optarg;
+      break;
+    case 'a':
+      addr = optarg;
+      break;
+    case 'm':
+      mac_str = optarg;
+      break;
+    case 'r':
+      if (nfiles < BENCH_MAX_TRACES) {
+        files[nfiles++] = optarg;
+      }
+      break;
+    default:
+      bench_usage(argv[0]);
+      return 2;
+    }
+  }
+  if (iterations < 1 || (nfiles != 0 && addr == NULL) || optind != argc) {
+    bench_usage(argv[0]);
+    return 2;
+  }
+
+  if (nfiles == 0) {
+    memcpy(&ip, trace_dut_ip, sizeof(ip));
+    memcpy(mac.addr, trace_dut_mac, ETH_HWADDR_LEN);
+    mac_str = "";
+  } else if (!ip4addr_aton(addr, &ip) || (mac_str != NULL && bench_parse_mac(mac_str, &mac) != 0)) {
+    bench_usage(argv[0]);
+    return 2;
+  }
+  lwip_init();
+  pcapif_setup(&s_netif, &ip, mac_str != NULL ? &mac : NULL);
+  sys_arch_set_now(s_now);
+  s_tcp_next = s_now + TCP_TMR_INTERVAL;
+  s_reass_next = s_now + IP_TMR_INTERVAL;
+  s_arp_next = s_now + ARP_TMR_INTERVAL;
+
+  printf("TCP_WND %u, TCP_SND_BUF %u, TCP_OOSEQ_MAX_PBUFS %u, TCP_PCB_HASH_SIZE %u, %d runs\n",
+         (unsigned)TCP_WND, (unsigned)TCP_SND_BUF, (unsigned)TCP_OOSEQ_MAX_PBUFS,
+         (unsigned)TCP_PCB_HASH_SIZE, iterations);
+  bench_print_header();
+
+  if (nfiles == 0) {
+    const struct trace_gen *gen;
+    for (gen = trace_gens; gen->name != NULL; gen++) {
+      struct pcap_trace trace;
+      struct trace_expect expect;
+
+      if (only != NULL && strcmp(only, gen->name) != 0) {
+        continue;
+      }
+      pcap_trace_init(&trace);
+      if (gen->generate(&trace, &expect) != 0) {
+        fprintf(stderr, "%s: out of memory\n", gen->name);
+        return 1;
+      }
+      if (dir != NULL) {
+        snprintf(path, sizeof(path), "%s/%s.pcap", dir, gen->name);
+        pcap_trace_save(&trace, path);
+        snprintf(path, sizeof(path), "%s/%s_out.pcap", dir, gen->name);
+      }
+      bench_trace(gen->name, &trace, iterations, dir != NULL ? path : NULL, &res);
+      if (res.stats.tcp_bytes != expect.tcp_bytes || res.stats.udp_bytes != expect.udp_bytes) {
+        printf("%-16s FAILED: received %llu TCP and %llu UDP bytes, expected %llu and %llu\n", "",
+               (unsigned long long)res.stats.tcp_bytes, (unsigned long long)res.stats.udp_bytes,
+               (unsigned long long)expect.tcp_bytes, (unsigned long long)expect.udp_bytes);
+        failed = 1;
+      }
+      pcap_trace_free(&trace);
+    }
+  } else {
+    int i;
+    for (i = 0; i < nfiles; i++) {
+      struct pcap_trace trace;
+      const char *name = strrchr(files[i], '/') ? strrchr(files[i], '/') + 1 : files[i];
+
+      if (pcap_trace_load(&trace, files[i]) != 0) {
+        failed = 1;
+        continue;
+      }
+      if (trace.linktype != PCAP_LINKTYPE_ETHERNET) {
+        fprintf(stderr, "%s: link type %u, only ethernet frames can be replayed\n",
+                files[i], (unsigned)trace.linktype);
+        pcap_trace_free(&trace);
+        failed = 1;
+        continue;
+      }
+      if (dir != NULL) {
+        snprintf(path, sizeof(path), "%s/%s_out.pcap", dir, name);
+      }
+      bench_trace(name, &trace, iterations, dir != NULL ? path : NULL, &res);
+      printf("%-16s received %llu TCP bytes on %u connections, %llu UDP bytes\n", "",
+             (unsigned long long)res.stats.tcp_bytes, (unsigned)res.stats.tcp_flows,
+             (unsigned long long)res.stats.udp_bytes);
+      pcap_trace_free(&trace);
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,186 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcap.h"
+
+#define PCAP_MAGIC_US       0xa1b2c3d4
+#define PCAP_MAGIC_NS       0xa1b23c4d
+#define PCAP_SNAPLEN        65535
+
+struct pcap_file_header {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct pcap_record_header {
+  uint32_t ts_sec;
+  uint32_t ts_frac;
+  uint32_t incl_len;
+  uint32_t orig_len;
+};
+
+static uint32_t
+pcap_swap32(uint32_t x)
+{
+  return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+void
+pcap_trace_init(struct pcap_trace *trace)
+{
+  memset(trace, 0, sizeof(*trace));
+  trace->linktype = PCAP_LINKTYPE_ETHERNET;
+}
+
+void
+pcap_trace_free(struct pcap_trace *trace)
+{
+  size_t i;
+
+  for (i = 0; i < trace->count; i++) {
+    free(trace->frames[i].data);
+  }
+  free(trace->frames);
+  pcap_trace_init(trace);
+}
+
+int
+pcap_trace_append(struct pcap_trace *trace, uint64_t ts_us, const void *data, uint32_t len)
+{
+  struct pcap_frame *frame;
+
+  if (trace->count == trace->capacity) {
+    size_t capacity = trace->capacity ? trace->capacity * 2 : 256;
+    struct pcap_frame *frames = (struct pcap_frame *)realloc(trace->frames, capacity * sizeof(*frames));
+    if (frames == NULL) {
+      return -1;
+    }
+    trace->frames = frames;
+    trace->capacity = capacity;
+  }
+  frame = &trace->frames[trace->count];
+  frame->data = (uint8_t *)malloc(len ? len : 1);
+  if (frame->data == NULL) {
+    return -1;
+  }
+  memcpy(frame->data, data, len);
+  frame->len = len;
+  frame->ts_us = ts_us;
+  trace->count++;
+  return 0;
+}
+
+int
+pcap_trace_load(struct pcap_trace *trace, const char *path)
+{
+  struct pcap_file_header fh;
+  struct pcap_record_header rh;
+  uint8_t *buf = NULL;
+  int swap = 0, ns = 0, ret = -1;
+  FILE *f;
+
+  pcap_trace_init(trace);
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  if (fread(&fh, sizeof(fh), 1, f) != 1) {
+    fprintf(stderr, "%s: not a pcap file\n", path);
+    goto out;
+  }
+  if (fh.magic == pcap_swap32(PCAP_MAGIC_US) || fh.magic == pcap_swap32(PCAP_MAGIC_NS)) {
+    swap = 1;
+    fh.magic = pcap_swap32(fh.magic);
+    fh.linktype = pcap_swap32(fh.linktype);
+  }
+  if (fh.magic == PCAP_MAGIC_NS) {
+    ns = 1;
+  } else if (fh.magic != PCAP_MAGIC_US) {
+    fprintf(stderr, "%s: not a pcap file (pcapng files need converting with editcap -F pcap)\n", path);
+    goto out;
+  }
+  trace->linktype = fh.linktype;
+  buf = (uint8_t *)malloc(PCAP_SNAPLEN);
+  if (buf == NULL) {
+    goto out;
+  }
+  while (fread(&rh, sizeof(rh), 1, f) == 1) {
+    uint64_t ts_us;
+    if (swap) {
+      rh.ts_sec = pcap_swap32(rh.ts_sec);
+      rh.ts_frac = pcap_swap32(rh.ts_frac);
+      rh.incl_len = pcap_swap32(rh.incl_len);
+    }
+    if (rh.incl_len > PCAP_SNAPLEN || fread(buf, 1, rh.incl_len, f) != rh.incl_len) {
+      fprintf(stderr, "%s: truncated record %u\n", path, (unsigned)trace->count);
+      goto out;
+    }
+    ts_us = (uint64_t)rh.ts_sec * 1000000 + (ns ? rh.ts_frac / 1000 : rh.ts_frac);
+    if (pcap_trace_append(trace, ts_us, buf, rh.incl_len) != 0) {
+      fprintf(stderr, "%s: out of memory\n", path);
+      goto out;
+    }
+  }
+  ret = 0;
+out:
+  if (ret != 0) {
+    pcap_trace_free(trace);
+  }
+  free(buf);
+  fclose(f);
+  return ret;
+}
+
+int
+pcap_trace_save(const struct pcap_trace *trace, const char *path)
+{
+  struct pcap_file_header fh = {
+    PCAP_MAGIC_US, 2, 4, 0, 0, PCAP_SNAPLEN, trace->linktype
+  };
+  size_t i;
+  FILE *f;
+
+  f = fopen(path, "wb");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  fwrite(&fh, sizeof(fh), 1, f);
+  for (i = 0; i < trace->count; i++) {
+    const struct pcap_frame *frame = &trace->frames[i];
+    struct pcap_record_header rh;
+    rh.ts_sec = (uint32_t)(frame->ts_us / 1000000);
+    rh.ts_frac = (uint32_t)(frame->ts_us % 1000000);
+    rh.incl_len = frame->len;
+    rh.orig_len = frame->len;
+    fwrite(&rh, sizeof(rh), 1, f);
+    fwrite(frame->data, 1, frame->len, f);
+  }
+  if (fclose(f) != 0) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Minimal reader and writer of pcap files (the classic format of tcpdump,
+ * not pcapng). A trace is held in memory as a list of frames with their
+ * timestamps in microseconds.
+ */
+#ifndef PCAP_H
+#define PCAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCAP_LINKTYPE_ETHERNET  1
+
+struct pcap_frame {
+  uint64_t ts_us;       /* capture time */
+  uint32_t len;         /* bytes in data (frames cut by the snap length stay cut) */
+  uint8_t *data;
+};
+
+struct pcap_trace {
+  struct pcap_frame *frames;
+  size_t count;
+  size_t capacity;
+  uint32_t linktype;
+};
+
+void pcap_trace_init(struct pcap_trace *trace);
+void pcap_trace_free(struct pcap_trace *trace);
+
+/** Append a copy of len bytes of data; returns 0, or -1 if out of memory */
+int pcap_trace_append(struct pcap_trace *trace, uint64_t ts_us, const void *data, uint32_t len);
+
+/**
+ * Read a pcap file, in either byte order and with micro- or nanosecond
+ * timestamps. Returns 0, or -1 with a message on stderr.
+ */
+int pcap_trace_load(struct pcap_trace *trace, const char *path);
+
+/** Write the trace as a pcap file with microsecond timestamps */
+int pcap_trace_save(const struct pcap_trace *trace, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PCAP_H */
@@ -0,0 +1,580 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "netif/etharp.h"
+#include "netif/ethernet.h"
+
+#include "pcapif.h"
+
+#define PCAPIF_MAX_FLOWS    64
+#define PCAPIF_MAX_PORTS    16
+#define PCAPIF_MAX_PEERS    ARP_TABLE_SIZE
+
+#define PCAPIF_ETH_HLEN     14
+#define PCAPIF_ETH_ARP      0x0806
+#define PCAPIF_ETH_IP       0x0800
+#define PCAPIF_IP_TCP       6
+#define PCAPIF_IP_UDP       17
+#define PCAPIF_TCP_FIN      0x01
+#define PCAPIF_TCP_SYN      0x02
+#define PCAPIF_TCP_ACK      0x10
+#define PCAPIF_TCPOPT_SACK  5
+
+enum pcapif_flow_state {
+  PCAPIF_FLOW_UNUSED = 0,
+  PCAPIF_FLOW_SYN,      /* SYN replayed, waiting for the SYN-ACK of the stack */
+  PCAPIF_FLOW_REPLAY,   /* ISN difference known */
+  PCAPIF_FLOW_SKIP,     /* not replayed */
+};
+
+/* one TCP connection of the trace; addresses and ports as in the frames */
+struct pcapif_flow {
+  u8_t state;
+  u8_t have_iss;
+  u8_t counted;         /* a skipped flow has been counted */
+  u8_t peer_ip[4];
+  u16_t peer_port;
+  u16_t dut_port;
+  u32_t syn_seq;        /* ISN of the peer, to tell a new connection from a retransmitted SYN */
+  u32_t iss;            /* ISN of the stack */
+  u32_t delta;          /* ISN of the stack - ISN of the DUT in the capture */
+};
+
+struct pcapif {
+  ip4_addr_t ip;
+  u8_t have_mac;
+  uint64_t ts_us;
+  struct pcap_trace *capture;
+  struct pcapif_stats stats;
+  struct pcapif_flow flows[PCAPIF_MAX_FLOWS];
+  u16_t tcp_ports[PCAPIF_MAX_PORTS];
+  u8_t tcp_port_count;
+  u16_t udp_ports[PCAPIF_MAX_PORTS];
+  u8_t udp_port_count;
+  u8_t peers[PCAPIF_MAX_PEERS][4];
+  u8_t peer_count;
+};
+
+static struct pcapif s_pcapif;
+
+static u16_t
+pcapif_get16(const u8_t *p)
+{
+  return (u16_t)((p[0] << 8) | p[1]);
+}
+
+static u32_t
+pcapif_get32(const u8_t *p)
+{
+  return ((u32_t)p[0] << 24) | ((u32_t)p[1] << 16) | ((u32_t)p[2] << 8) | p[3];
+}
+
+static void
+pcapif_put16(u8_t *p, u16_t x)
+{
+  p[0] = (u8_t)(x >> 8);
+  p[1] = (u8_t)x;
+}
+
+static void
+pcapif_put32(u8_t *p, u32_t x)
+{
+  p[0] = (u8_t)(x >> 24);
+  p[1] = (u8_t)(x >> 16);
+  p[2] = (u8_t)(x >> 8);
+  p[3] = (u8_t)x;
+}
+
+static u32_t
+pcapif_sum(const u8_t *data, size_t len, u32_t sum)
+{
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    sum += pcapif_get16(data + i);
+  }
+  if (len & 1) {
+    sum += (u32_t)data[len - 1] << 8;
+  }
+  return sum;
+}
+
+/* TCP checksum of tcp_len bytes at tcp, with the pseudo header from ip */
+static u16_t
+pcapif_tcp_chksum(const u8_t *ip, const u8_t *tcp, u16_t tcp_len)
+{
+  u32_t sum = pcapif_sum(ip + 12, 8, PCAPIF_IP_TCP + tcp_len);
+
+  sum = pcapif_sum(tcp, tcp_len, sum);
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (u16_t)~sum;
+}
+
+static struct pcapif_flow *
+pcapif_find_flow(struct pcapif *pif, const u8_t *peer_ip, u16_t peer_port, u16_t dut_port, int create)
+{
+  struct pcapif_flow *unused = NULL;
+  int i;
+
+  for (i = 0; i < PCAPIF_MAX_FLOWS; i++) {
+    struct pcapif_flow *flow = &pif->flows[i];
+    if (flow->state == PCAPIF_FLOW_UNUSED) {
+      if (unused == NULL) {
+        unused = flow;
+      }
+    } else if (flow->peer_port == peer_port && flow->dut_port == dut_port &&
+               memcmp(flow->peer_ip, peer_ip, 4) == 0) {
+      return flow;
+    }
+  }
+  if (!create || unused == NULL) {
+    return NULL;
+  }
+  memcpy(unused->peer_ip, peer_ip, 4);
+  unused->peer_port = peer_port;
+  unused->dut_port = dut_port;
+  unused->state = PCAPIF_FLOW_SKIP;
+  unused->have_iss = 0;
+  unused->counted = 0;
+  return unused;
+}
+
+static err_t
+pcapif_tcp_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct pcapif *pif = (struct pcapif *)arg;
+
+  LWIP_UNUSED_ARG(err);
+  if (p == NULL) {
+    tcp_close(pcb);
+    return ERR_OK;
+  }
+  pif->stats.tcp_bytes += p->tot_len;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static err_t
+pcapif_tcp_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
+{
+  struct tcp_pcb *lpcb = (struct tcp_pcb *)arg;
+
+  if (err != ERR_OK || newpcb == NULL) {
+    return ERR_VAL;
+  }
+  tcp_accepted(lpcb);
+  tcp_arg(newpcb, &s_pcapif);
+  tcp_recv(newpcb, pcapif_tcp_recv);
+  return ERR_OK;
+}
+
+/* make sure there is a pcb listening on port */
+static void
+pcapif_tcp_listen(struct pcapif *pif, u16_t port)
+{
+  struct tcp_pcb *pcb, *lpcb;
+  int i;
+
+  for (i = 0; i < pif->tcp_port_count; i++) {
+    if (pif->tcp_ports[i] == port) {
+      return;
+    }
+  }
+  if (pif->tcp_port_count == PCAPIF_MAX_PORTS || (pcb = tcp_new()) == NULL) {
+    return;
+  }
+  if (tcp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK || (lpcb = tcp_listen(pcb)) == NULL) {
+    tcp_close(pcb);
+    return;
+  }
+  tcp_arg(lpcb, lpcb);
+  tcp_accept(lpcb, pcapif_tcp_accept);
+  pif->tcp_ports[pif->tcp_port_count++] = port;
+}
+
+static void
+pcapif_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+  struct pcapif *pif = (struct pcapif *)arg;
+
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+  pif->stats.udp_bytes += p->tot_len;
+  pbuf_free(p);
+}
+
+/* make sure there is a pcb bound to port */
+static void
+pcapif_udp_bind(struct pcapif *pif, u16_t port)
+{
+  struct udp_pcb *pcb;
+  int i;
+
+  for (i = 0; i < pif->udp_port_count; i++) {
+    if (pif->udp_ports[i] == port) {
+      return;
+    }
+  }
+  if (pif->udp_port_count == PCAPIF_MAX_PORTS || (pcb = udp_new()) == NULL) {
+    return;
+  }
+  if (udp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK) {
+    udp_remove(pcb);
+    return;
+  }
+  udp_recv(pcb, pcapif_udp_recv, pif);
+  pif->udp_ports[pif->udp_port_count++] = port;
+}
+
+/* give the sender of a frame a static ARP entry, so that replies don't
+   wait for an ARP reply which isn't in the trace */
+static void
+pcapif_add_peer(struct pcapif *pif, const u8_t *ip, const u8_t *mac)
+{
+  ip4_addr_t addr;
+  struct eth_addr ethaddr;
+  int i;
+
+  if (ip[0] == 0 || (mac[0] & 1)) {
+    return;
+  }
+  for (i = 0; i < pif->peer_count; i++) {
+    if (memcmp(pif->peers[i], ip, 4) == 0) {
+      return;
+    }
+  }
+  if (pif->peer_count == PCAPIF_MAX_PEERS) {
+    return;
+  }
+  memcpy(&addr, ip, 4);
+  memcpy(ethaddr.addr, mac, ETH_HWADDR_LEN);
+  if (etharp_add_static_entry(&addr, &ethaddr) == ERR_OK) {
+    memcpy(pif->peers[pif->peer_count++], ip, 4);
+  }
+}
+
+/*
+ * Rewrite a TCP segment sent to the DUT for the connection the stack has.
+ * Returns 0 if the segment is to be replayed.
+ */
+static int
+pcapif_tcp_rewrite(struct pcapif *pif, u8_t *ip, u16_t ip_hlen, u16_t ip_len)
+{
+  u8_t *tcp = ip + ip_hlen;
+  u16_t tcp_len = ip_len - ip_hlen;
+  u16_t hlen, sport, dport;
+  u8_t flags;
+  u32_t ack;
+  struct pcapif_flow *flow;
+  int i;
+
+  if (tcp_len < 20 || (hlen = (u16_t)((tcp[12] >> 4) * 4)) < 20 || hlen > tcp_len) {
+    return -1;
+  }
+  flags = tcp[13];
+  sport = pcapif_get16(tcp);
+  dport = pcapif_get16(tcp + 2);
+  flow = pcapif_find_flow(pif, ip + 12, sport, dport, 1);
+  if (flow == NULL) {
+    pif->stats.tcp_flows_skipped++;
+    return -1;
+  }
+
+  if ((flags & (PCAPIF_TCP_SYN | PCAPIF_TCP_ACK)) == PCAPIF_TCP_SYN) {
+    u32_t seq = pcapif_get32(tcp + 4);
+    if (flow->state == PCAPIF_FLOW_SKIP || flow->syn_seq != seq) {
+      /* a new connection, not a retransmitted SYN */
+      pif->stats.tcp_flows++;
+      flow->state = PCAPIF_FLOW_SYN;
+      flow->have_iss = 0;
+      flow->syn_seq = seq;
+      pcapif_tcp_listen(pif, dport);
+    }
+    return 0;
+  }
+  if (flow->state == PCAPIF_FLOW_SKIP) {
+    if (!flow->counted) {
+      /* opened by the DUT, or before the trace started */
+      pif->stats.tcp_flows_skipped++;
+      flow->counted = 1;
+    }
+    return -1;
+  }
+  if (flow->state == PCAPIF_FLOW_SYN) {
+    if (!(flags & PCAPIF_TCP_ACK) || !flow->have_iss) {
+      /* the stack hasn't answered the SYN, so nothing can be acked yet */
+      return -1;
+    }
+    /* the first ACK of the peer acks the captured SYN-ACK */
+    flow->delta = flow->iss + 1 - pcapif_get32(tcp + 8);
+    flow->state = PCAPIF_FLOW_REPLAY;
+  }
+  if (!(flags & PCAPIF_TCP_ACK) || flow->delta == 0) {
+    return 0;
+  }
+
+  ack = pcapif_get32(tcp + 8);
+  pcapif_put32(tcp + 8, ack + flow->delta);
+  for (i = 20; i < hlen; ) {
+    u8_t kind = tcp[i], len;
+    if (kind == 0) {
+      break;
+    }
+    if (kind == 1) {
+      i++;
+      continue;
+    }
+    if (i + 1 >= hlen || (len = tcp[i + 1]) < 2 || i + len > hlen) {
+      break;
+    }
+    if (kind == PCAPIF_TCPOPT_SACK) {
+      int j;
+      for (j = i + 2; j + 4 <= i + len; j += 4) {
+        pcapif_put32(tcp + j, pcapif_get32(tcp + j) + flow->delta);
+      }
+    }
+    i += len;
+  }
+  pcapif_put16(tcp + 16, 0);
+  pcapif_put16(tcp + 16, pcapif_tcp_chksum(ip, tcp, tcp_len));
+  return 0;
+}
+
+/* note the ISN of the stack from the SYN-ACKs it sends */
+static void
+pcapif_tcp_output(struct pcapif *pif, const u8_t *frame, u16_t len)
+{
+  const u8_t *ip = frame + PCAPIF_ETH_HLEN;
+  const u8_t *tcp;
+  struct pcapif_flow *flow;
+  u16_t ip_hlen;
+
+  if (len < PCAPIF_ETH_HLEN + 20 || pcapif_get16(frame + 12) != PCAPIF_ETH_IP ||
+      ip[9] != PCAPIF_IP_TCP) {
+    return;
+  }
+  ip_hlen = (u16_t)((ip[0] & 0xf) * 4);
+  if (len < PCAPIF_ETH_HLEN + ip_hlen + 20) {
+    return;
+  }
+  tcp = ip + ip_hlen;
+  if ((tcp[13] & (PCAPIF_TCP_SYN | PCAPIF_TCP_ACK)) != (PCAPIF_TCP_SYN | PCAPIF_TCP_ACK)) {
+    return;
+  }
+  flow = pcapif_find_flow(pif, ip + 16, pcapif_get16(tcp + 2), pcapif_get16(tcp), 0);
+  if (flow != NULL && flow->state == PCAPIF_FLOW_SYN) {
+    flow->iss = pcapif_get32(tcp + 4);
+    flow->have_iss = 1;
+  }
+}
+
+/* the wifi driver takes one contiguous frame, see low_level_output() in wlanif.c */
+static err_t
+pcapif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct pcapif *pif = (struct pcapif *)netif->state;
+  struct pbuf *q = NULL;
+
+  if (p->next != NULL) {
+    q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (q == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      return ERR_MEM;
+    }
+    pbuf_copy(q, p);
+    p = q;
+  }
+  pcapif_tcp_output(pif, (const u8_t *)p->payload, p->len);
+  if (pif->capture != NULL) {
+    pcap_trace_append(pif->capture, pif->ts_us, p->payload, p->len);
+  }
+  if (q != NULL) {
+    pbuf_free(q);
+  }
+  pif->stats.frames_out++;
+  LINK_STATS_INC(link.xmit);
+  return ERR_OK;
+}
+
+static err_t
+pcapif_init(struct netif *netif)
+{
+  netif->name[0] = 'p';
+  netif->name[1] = 'c';
+  netif->output = etharp_output;
+  netif->linkoutput = pcapif_linkoutput;
+  netif->hwaddr_len = ETH_HWADDR_LEN;
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+  return ERR_OK;
+}
+
+void
+pcapif_setup(struct netif *netif, const ip4_addr_t *ip4addr, const struct eth_addr *mac)
+{
+  /* with an all zero netmask every peer is on the link, so that they all
+     get along with a static ARP entry and no gateway */
+  ip4_addr_t netmask, gw;
+
+  memset(&s_pcapif, 0, sizeof(s_pcapif));
+  ip4_addr_copy(s_pcapif.ip, *ip4addr);
+  ip4_addr_set_zero(&netmask);
+  ip4_addr_set_zero(&gw);
+  netif_add(netif, ip4addr, &netmask, &gw, &s_pcapif, pcapif_init, ethernet_input);
+  if (mac != NULL) {
+    memcpy(netif->hwaddr, mac->addr, ETH_HWADDR_LEN);
+    s_pcapif.have_mac = 1;
+  }
+  netif_set_default(netif);
+  netif_set_up(netif);
+}
+
+void *
+pcapif_prepare(struct netif *netif, const struct pcap_frame *frame, u16_t *len)
+{
+  struct pcapif *pif = (struct pcapif *)netif->state;
+  const u8_t *eth = frame->data;
+  const u8_t *ip = eth + PCAPIF_ETH_HLEN;
+  u8_t *buf;
+  u16_t type, ip_hlen = 0, ip_len = 0;
+
+  pif->ts_us = frame->ts_us;
+  if (frame->len < PCAPIF_ETH_HLEN || frame->len > 0xffff) {
+    goto skip;
+  }
+  type = pcapif_get16(eth + 12);
+  if (type == PCAPIF_ETH_IP) {
+    ip_hlen = (u16_t)((ip[0] & 0xf) * 4);
+    if (frame->len < PCAPIF_ETH_HLEN + 20 || ip_hlen < 20 ||
+        (ip_len = pcapif_get16(ip + 2)) < ip_hlen || PCAPIF_ETH_HLEN + ip_len > (int)frame->len) {
+      goto skip;
+    }
+    if (!pif->have_mac && !(eth[0] & 1) && memcmp(ip + 16, &pif->ip, 4) == 0) {
+      memcpy(netif->hwaddr, eth, ETH_HWADDR_LEN);
+      pif->have_mac = 1;
+    }
+  } else if (type != PCAPIF_ETH_ARP) {
+    goto skip;
+  }
+  /* frames sent by the DUT, or to another station */
+  if (!pif->have_mac || memcmp(eth + 6, netif->hwaddr, ETH_HWADDR_LEN) == 0 ||
+      (!(eth[0] & 1) && memcmp(eth, netif->hwaddr, ETH_HWADDR_LEN) != 0)) {
+    goto skip;
+  }
+  if (type == PCAPIF_ETH_IP) {
+    if (!(ip[16] >= 0xe0 || memcmp(ip + 16, &pif->ip, 4) == 0)) {
+      goto skip;
+    }
+    pcapif_add_peer(pif, ip + 12, eth + 6);
+  }
+
+  buf = (u8_t *)malloc(frame->len);
+  if (buf == NULL) {
+    goto skip;
+  }
+  memcpy(buf, frame->data, frame->len);
+  /* only whole datagrams, not fragments, carry a header to look at */
+  if (type == PCAPIF_ETH_IP && (pcapif_get16(ip + 6) & 0x3fff) == 0) {
+    u8_t *bip = buf + PCAPIF_ETH_HLEN;
+    if (bip[9] == PCAPIF_IP_TCP) {
+      if (pcapif_tcp_rewrite(pif, bip, ip_hlen, ip_len) != 0) {
+        free(buf);
+        goto skip;
+      }
+    } else if (bip[9] == PCAPIF_IP_UDP && ip_len >= ip_hlen + 8) {
+      pcapif_udp_bind(pif, pcapif_get16(bip + ip_hlen + 2));
+    }
+  }
+  *len = (u16_t)frame->len;
+  return buf;
+
+skip:
+  pif->stats.frames_skipped++;
+  return NULL;
+}
+
+err_t
+pcapif_input(struct netif *netif, void *buffer, u16_t len)
+{
+  struct pcapif *pif = (struct pcapif *)netif->state;
+  struct pbuf *p;
+
+  pif->stats.frames_in++;
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_REF);
+  if (p == NULL) {
+    free(buffer);
+    LINK_STATS_INC(link.memerr);
+    LINK_STATS_INC(link.drop);
+    return ERR_MEM;
+  }
+  p->payload = buffer;
+  p->eb = buffer;
+  LINK_STATS_INC(link.recv);
+  if (netif->input(p, netif) != ERR_OK) {
+    LINK_STATS_INC(link.drop);
+    pbuf_free(p);
+    return ERR_MEM;
+  }
+  return ERR_OK;
+}
+
+/* the driver buffer of a PBUF_REF pbuf of pcapif_input() is freed with it */
+void
+system_pp_recycle_rx_pkt(void *eb)
+{
+  free(eb);
+}
+
+void
+pcapif_set_capture(struct netif *netif, struct pcap_trace *capture)
+{
+  ((struct pcapif *)netif->state)->capture = capture;
+}
+
+void
+pcapif_reset(struct netif *netif)
+{
+  struct pcapif *pif = (struct pcapif *)netif->state;
+
+  while (tcp_active_pcbs != NULL) {
+    tcp_abort(tcp_active_pcbs);
+  }
+  while (tcp_tw_pcbs != NULL) {
+    tcp_abort(tcp_tw_pcbs);
+  }
+  memset(pif->flows, 0, sizeof(pif->flows));
+  memset(&pif->stats, 0, sizeof(pif->stats));
+}
+
+const struct pcapif_stats *
+pcapif_get_stats(struct netif *netif)
+{
+  return &((struct pcapif *)netif->state)->stats;
+}
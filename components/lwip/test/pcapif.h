@@ -0,0 +1,89 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Replay netif of the host benchmark. It plays the wifi driver for a trace
+ * captured next to an ESP32 (the "device under test", DUT): the frames sent
+ * to the DUT are handed to the stack as wlanif_input() does, and the frames
+ * the stack sends go through the same path as wlanif's low_level_output(),
+ * optionally into a capture.
+ *
+ * Only the peer side of each TCP connection is in the trace; the DUT side
+ * is the stack's own. So that the recorded segments still make sense to
+ * it, connections opened by peers get a listening pcb on their port, which
+ * takes and drops all data, and the acknowledgement numbers and SACK
+ * blocks of the segments sent to the DUT are moved by the difference
+ * between the ISN of the stack and the ISN the DUT had in the capture.
+ * Connections opened by the DUT are not replayed. UDP ports get a pcb
+ * which drops the datagrams, and senders get a static ARP entry.
+ */
+#ifndef PCAPIF_H
+#define PCAPIF_H
+
+#include "lwip/netif.h"
+#include "lwip/ip4_addr.h"
+#include "netif/etharp.h"
+
+#include "pcap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pcapif_stats {
+  u32_t frames_in;      /* frames handed to the stack */
+  u32_t frames_skipped; /* frames of the trace not for the DUT, or not replayed */
+  u32_t frames_out;     /* frames sent by the stack */
+  uint64_t tcp_bytes;      /* data received on the TCP connections */
+  uint64_t udp_bytes;      /* data received on the UDP ports */
+  u32_t tcp_flows;      /* TCP connections opened by peers */
+  u32_t tcp_flows_skipped; /* connections opened by the DUT, or by a SYN not in the trace */
+};
+
+/**
+ * Set up the interface for a DUT at ip4addr, and mac unless it is NULL.
+ * Without a MAC address, the destination of the first unicast frame to
+ * ip4addr is taken.
+ */
+void pcapif_setup(struct netif *netif, const ip4_addr_t *ip4addr, const struct eth_addr *mac);
+
+/**
+ * Copy the next frame of the trace into a receive buffer and rewrite it for
+ * the stack, as the driver would have it ready. Returns NULL if the frame
+ * isn't to be replayed. The capture time of the frame stamps the frames the
+ * stack sends until the next one.
+ */
+void *pcapif_prepare(struct netif *netif, const struct pcap_frame *frame, u16_t *len);
+
+/**
+ * Hand a buffer from pcapif_prepare() to the stack, in a PBUF_REF pbuf
+ * like wlanif_input(); the buffer is freed with the pbuf.
+ */
+err_t pcapif_input(struct netif *netif, void *buffer, u16_t len);
+
+/** Copy the frames sent by the stack into capture from here on; NULL to stop */
+void pcapif_set_capture(struct netif *netif, struct pcap_trace *capture);
+
+/** Abort all connections and forget the flows, to replay the trace again */
+void pcapif_reset(struct netif *netif);
+
+/** Counters since the last pcapif_reset() */
+const struct pcapif_stats *pcapif_get_stats(struct netif *netif);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PCAPIF_H */
@@ -0,0 +1,50 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * sys_arch types of the host build of lwIP, on POSIX threads.
+ */
+#ifndef __SYS_ARCH_H__
+#define __SYS_ARCH_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef struct sys_sem_s *sys_sem_t;
+typedef pthread_mutex_t *sys_mutex_t;
+typedef struct sys_mbox_s *sys_mbox_t;
+typedef pthread_t sys_thread_t;
+
+#define LWIP_COMPAT_MUTEX 0
+
+#define sys_mutex_valid(x)          (*(x) != NULL)
+#define sys_mutex_set_invalid(x)    (*(x) = NULL)
+#define sys_mbox_valid(x)           (*(x) != NULL)
+#define sys_mbox_set_invalid(x)     (*(x) = NULL)
+#define sys_sem_valid(x)            (*(x) != NULL)
+#define sys_sem_set_invalid(x)      (*(x) = NULL)
+
+void sys_arch_assert(const char *file, int line);
+uint32_t sys_arch_rand(void);
+uint32_t system_get_time(void);
+
+/**
+ * Make sys_now return ms from here on, instead of the time of the host
+ * clock. The replay benchmark runs the stack on the timestamps of the
+ * trace, so that timers fire at the same points on every run.
+ */
+void sys_arch_set_now(uint32_t ms);
+
+#endif /* __SYS_ARCH_H__ */
@@ -0,0 +1,119 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * lwIP options of the host build used by the replay benchmark. The features
+ * and sizes of the TCP code follow components/lwip/include/lwip/port/lwipopts.h
+ * with the default menuconfig values; CONFIG_LWIP_* options can be defined on
+ * the make command line to try others, for example
+ * "make benchmark CONFIG="-DCONFIG_LWIP_TCP_WND_MSS=48"".
+ *
+ * The stack is driven directly from the benchmark thread through the raw API,
+ * so netconn and sockets are left out. Memory comes from the C library, and
+ * memp objects from mem_malloc, so that every allocation goes through the
+ * counters of bench_mem_malloc.
+ */
+#ifndef __LWIPOPTS_H__
+#define __LWIPOPTS_H__
+
+#include <stdlib.h>
+
+#ifndef CONFIG_LWIP_TCP_WND_MSS
+#define CONFIG_LWIP_TCP_WND_MSS         4
+#endif
+#ifndef CONFIG_LWIP_TCP_SND_BUF_MSS
+#define CONFIG_LWIP_TCP_SND_BUF_MSS     2
+#endif
+#ifndef CONFIG_LWIP_TCP_OOSEQ_MAX_PBUFS
+#define CONFIG_LWIP_TCP_OOSEQ_MAX_PBUFS 6
+#endif
+#ifndef CONFIG_LWIP_TCP_PCB_HASH_SIZE
+#define CONFIG_LWIP_TCP_PCB_HASH_SIZE   8
+#endif
+#ifndef CONFIG_LWIP_MAX_ACTIVE_TCP
+#define CONFIG_LWIP_MAX_ACTIVE_TCP      16
+#endif
+#ifndef CONFIG_LWIP_TCP_SACK
+#define CONFIG_LWIP_TCP_SACK            1
+#endif
+
+/* the ESP changes to the core are built as on the chip */
+#define LWIP_ESP8266
+
+#define NO_SYS                          0
+#define SYS_LIGHTWEIGHT_PROT            1
+#define LWIP_NETCONN                    0
+#define LWIP_SOCKET                     0
+
+#define MEM_LIBC_MALLOC                 1
+#define MEMP_MEM_MALLOC                 1
+#define MEM_ALIGNMENT                   8
+void *bench_mem_malloc(size_t size);
+void *bench_mem_calloc(size_t count, size_t size);
+void bench_mem_free(void *mem);
+#define mem_malloc                      bench_mem_malloc
+#define mem_calloc                      bench_mem_calloc
+#define mem_free                        bench_mem_free
+
+#define LWIP_IPV4                       1
+#define LWIP_IPV6                       0
+#define LWIP_ARP                        1
+#define ETHARP_SUPPORT_STATIC_ENTRIES   1
+#define LWIP_ICMP                       1
+#define LWIP_RAW                        0
+#define LWIP_DHCP                       0
+#define LWIP_AUTOIP                     0
+#define LWIP_IGMP                       0
+#define LWIP_DNS                        0
+#define IP_REASSEMBLY                   1
+#define IP_FRAG                         1
+#define LWIP_UDP                        1
+#define LWIP_TCP                        1
+#define LWIP_STATS                      1
+#define LWIP_STATS_DISPLAY              0
+
+#define MEMP_NUM_TCP_PCB                CONFIG_LWIP_MAX_ACTIVE_TCP
+#define MEMP_NUM_TCP_PCB_LISTEN         16
+#define MEMP_NUM_UDP_PCB                16
+#define MEMP_NUM_TCP_SEG                (8 * CONFIG_LWIP_TCP_SND_BUF_MSS + 16)
+#define PBUF_POOL_SIZE                  64
+
+#define TCP_MSS                         1460
+#define TCP_WND                         (CONFIG_LWIP_TCP_WND_MSS * TCP_MSS)
+#define TCP_SND_BUF                     (CONFIG_LWIP_TCP_SND_BUF_MSS * TCP_MSS)
+#if TCP_WND > 0xffff
+#define LWIP_WND_SCALE                  1
+#define TCP_RCV_SCALE                   2
+#endif
+#define TCP_QUEUE_OOSEQ                 1
+#define TCP_OOSEQ_MAX_PBUFS             CONFIG_LWIP_TCP_OOSEQ_MAX_PBUFS
+#define TCP_OOSEQ_MAX_BYTES             (CONFIG_LWIP_TCP_OOSEQ_MAX_PBUFS * TCP_MSS)
+#define LWIP_TCP_SACK                   CONFIG_LWIP_TCP_SACK
+#define TCP_MAXRTX                      12
+#define TCP_SYNMAXRTX                   6
+#define TCP_LISTEN_BACKLOG              1
+#define TCP_PCB_HASH_SIZE               CONFIG_LWIP_TCP_PCB_HASH_SIZE
+#define LWIP_TCP_KEEPALIVE              1
+
+/* the replayed frames have valid checksums, so the cost of checking them
+   is counted as it would be on the chip with checks enabled */
+#define CHECKSUM_CHECK_IP               1
+#define CHECKSUM_CHECK_UDP              1
+#define CHECKSUM_CHECK_TCP              1
+
+#define LWIP_NETIF_STATUS_CALLBACK      0
+#define LWIP_NETIF_LINK_CALLBACK        0
+
+#endif /* __LWIPOPTS_H__ */
@@ -0,0 +1,424 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * sys_arch of the host build of lwIP, on POSIX threads: semaphores and
+ * mailboxes are built from a mutex and a condition variable each, and
+ * SYS_ARCH_PROTECT takes one recursive mutex, as the single global critical
+ * section of the FreeRTOS port does.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "arch/sys_arch.h"
+
+struct sys_sem_s {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned count;
+};
+
+struct sys_mbox_s {
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  unsigned size;
+  unsigned head;    /* next message to fetch */
+  unsigned count;
+  void *msgs[];
+};
+
+static pthread_mutex_t sys_arch_prot_mutex;
+static int sys_arch_now_fixed;
+static u32_t sys_arch_now_ms;
+static u32_t sys_arch_rand_state = 0x2545f491;
+
+static u32_t
+sys_arch_monotonic_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/* absolute deadline timeout ms from now, for pthread_cond_timedwait */
+static void
+sys_arch_deadline(struct timespec *ts, u32_t timeout)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += timeout / 1000;
+  ts->tv_nsec += (long)(timeout % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+/* wait on cond until woken, or until the deadline if timeout isn't 0;
+   returns 0 on timeout */
+static int
+sys_arch_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, u32_t timeout, const struct timespec *deadline)
+{
+  if (timeout == 0) {
+    pthread_cond_wait(cond, mutex);
+    return 1;
+  }
+  return pthread_cond_timedwait(cond, mutex, deadline) == 0;
+}
+
+void
+sys_init(void)
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&sys_arch_prot_mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+sys_prot_t
+sys_arch_protect(void)
+{
+  pthread_mutex_lock(&sys_arch_prot_mutex);
+  return 1;
+}
+
+void
+sys_arch_unprotect(sys_prot_t pval)
+{
+  LWIP_UNUSED_ARG(pval);
+  pthread_mutex_unlock(&sys_arch_prot_mutex);
+}
+
+u32_t
+sys_now(void)
+{
+  if (sys_arch_now_fixed) {
+    return sys_arch_now_ms;
+  }
+  return sys_arch_monotonic_ms();
+}
+
+u32_t
+sys_jiffies(void)
+{
+  return sys_now();
+}
+
+/* microseconds, like the ROM function of the same name; follows the
+   virtual clock so that the first ephemeral port is the same on every run */
+uint32_t
+system_get_time(void)
+{
+  return sys_now() * 1000;
+}
+
+void
+sys_arch_set_now(uint32_t ms)
+{
+  sys_arch_now_ms = ms;
+  sys_arch_now_fixed = 1;
+}
+
+uint32_t
+sys_arch_rand(void)
+{
+  /* xorshift32 */
+  u32_t x = sys_arch_rand_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sys_arch_rand_state = x;
+  return x;
+}
+
+/* the host build has no tcpip thread: the stack is only ever driven from
+   the thread of the benchmark, so deferred calls can run right away */
+err_t
+tcpip_callback_with_block(tcpip_callback_fn function, void *ctx, u8_t block)
+{
+  LWIP_UNUSED_ARG(block);
+  function(ctx);
+  return ERR_OK;
+}
+
+void
+sys_arch_assert(const char *file, int line)
+{
+  fprintf(stderr, "lwIP assertion failed at %s:%d\n", file, line);
+  abort();
+}
+
+err_t
+sys_sem_new(sys_sem_t *sem, u8_t count)
+{
+  struct sys_sem_s *s = (struct sys_sem_s *)calloc(1, sizeof(*s));
+
+  if (s == NULL) {
+    *sem = NULL;
+    return ERR_MEM;
+  }
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  s->count = count;
+  *sem = s;
+  return ERR_OK;
+}
+
+void
+sys_sem_signal(sys_sem_t *sem)
+{
+  struct sys_sem_s *s = *sem;
+
+  pthread_mutex_lock(&s->mutex);
+  s->count++;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->mutex);
+}
+
+u32_t
+sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
+{
+  struct sys_sem_s *s = *sem;
+  u32_t start = sys_arch_monotonic_ms();
+  struct timespec deadline;
+
+  sys_arch_deadline(&deadline, timeout);
+  pthread_mutex_lock(&s->mutex);
+  while (s->count == 0) {
+    if (!sys_arch_cond_wait(&s->cond, &s->mutex, timeout, &deadline)) {
+      pthread_mutex_unlock(&s->mutex);
+      return SYS_ARCH_TIMEOUT;
+    }
+  }
+  s->count--;
+  pthread_mutex_unlock(&s->mutex);
+  return sys_arch_monotonic_ms() - start;
+}
+
+void
+sys_sem_free(sys_sem_t *sem)
+{
+  struct sys_sem_s *s = *sem;
+
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mutex);
+  free(s);
+  *sem = NULL;
+}
+
+err_t
+sys_mutex_new(sys_mutex_t *mutex)
+{
+  pthread_mutex_t *m = (pthread_mutex_t *)malloc(sizeof(*m));
+
+  if (m == NULL) {
+    *mutex = NULL;
+    return ERR_MEM;
+  }
+  pthread_mutex_init(m, NULL);
+  *mutex = m;
+  return ERR_OK;
+}
+
+void
+sys_mutex_lock(sys_mutex_t *mutex)
+{
+  pthread_mutex_lock(*mutex);
+}
+
+void
+sys_mutex_unlock(sys_mutex_t *mutex)
+{
+  pthread_mutex_unlock(*mutex);
+}
+
+void
+sys_mutex_free(sys_mutex_t *mutex)
+{
+  pthread_mutex_destroy(*mutex);
+  free(*mutex);
+  *mutex = NULL;
+}
+
+err_t
+sys_mbox_new(sys_mbox_t *mbox, int size)
+{
+  struct sys_mbox_s *m;
+
+  if (size <= 0) {
+    size = 16;
+  }
+  m = (struct sys_mbox_s *)calloc(1, sizeof(*m) + size * sizeof(void *));
+  if (m == NULL) {
+    *mbox = NULL;
+    return ERR_MEM;
+  }
+  pthread_mutex_init(&m->mutex, NULL);
+  pthread_cond_init(&m->not_empty, NULL);
+  pthread_cond_init(&m->not_full, NULL);
+  m->size = (unsigned)size;
+  *mbox = m;
+  return ERR_OK;
+}
+
+static void
+sys_mbox_put(struct sys_mbox_s *m, void *msg)
+{
+  m->msgs[(m->head + m->count) % m->size] = msg;
+  m->count++;
+  pthread_cond_signal(&m->not_empty);
+}
+
+void
+sys_mbox_post(sys_mbox_t *mbox, void *msg)
+{
+  struct sys_mbox_s *m = *mbox;
+
+  pthread_mutex_lock(&m->mutex);
+  while (m->count == m->size) {
+    pthread_cond_wait(&m->not_full, &m->mutex);
+  }
+  sys_mbox_put(m, msg);
+  pthread_mutex_unlock(&m->mutex);
+}
+
+err_t
+sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
+{
+  struct sys_mbox_s *m = *mbox;
+  err_t err = ERR_MEM;
+
+  pthread_mutex_lock(&m->mutex);
+  if (m->count < m->size) {
+    sys_mbox_put(m, msg);
+    err = ERR_OK;
+  }
+  pthread_mutex_unlock(&m->mutex);
+  return err;
+}
+
+static void *
+sys_mbox_take(struct sys_mbox_s *m)
+{
+  void *msg = m->msgs[m->head];
+
+  m->head = (m->head + 1) % m->size;
+  m->count--;
+  pthread_cond_signal(&m->not_full);
+  return msg;
+}
+
+u32_t
+sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
+{
+  struct sys_mbox_s *m = *mbox;
+  u32_t start = sys_arch_monotonic_ms();
+  struct timespec deadline;
+  void *got;
+
+  sys_arch_deadline(&deadline, timeout);
+  pthread_mutex_lock(&m->mutex);
+  while (m->count == 0) {
+    if (!sys_arch_cond_wait(&m->not_empty, &m->mutex, timeout, &deadline)) {
+      pthread_mutex_unlock(&m->mutex);
+      if (msg != NULL) {
+        *msg = NULL;
+      }
+      return SYS_ARCH_TIMEOUT;
+    }
+  }
+  got = sys_mbox_take(m);
+  pthread_mutex_unlock(&m->mutex);
+  if (msg != NULL) {
+    *msg = got;
+  }
+  return sys_arch_monotonic_ms() - start;
+}
+
+u32_t
+sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
+{
+  struct sys_mbox_s *m = *mbox;
+  void *got;
+
+  pthread_mutex_lock(&m->mutex);
+  if (m->count == 0) {
+    pthread_mutex_unlock(&m->mutex);
+    return SYS_MBOX_EMPTY;
+  }
+  got = sys_mbox_take(m);
+  pthread_mutex_unlock(&m->mutex);
+  if (msg != NULL) {
+    *msg = got;
+  }
+  return 0;
+}
+
+void
+sys_mbox_free(sys_mbox_t *mbox)
+{
+  struct sys_mbox_s *m = *mbox;
+
+  pthread_cond_destroy(&m->not_full);
+  pthread_cond_destroy(&m->not_empty);
+  pthread_mutex_destroy(&m->mutex);
+  free(m);
+  *mbox = NULL;
+}
+
+struct sys_thread_start {
+  lwip_thread_fn fn;
+  void *arg;
+};
+
+static void *
+sys_thread_entry(void *p)
+{
+  struct sys_thread_start start = *(struct sys_thread_start *)p;
+
+  free(p);
+  start.fn(start.arg);
+  return NULL;
+}
+
+sys_thread_t
+sys_thread_new(const char *name, lwip_thread_fn thread, void *arg, int stacksize, int prio)
+{
+  struct sys_thread_start *start = (struct sys_thread_start *)malloc(sizeof(*start));
+  pthread_t id;
+
+  LWIP_UNUSED_ARG(name);
+  LWIP_UNUSED_ARG(stacksize);
+  LWIP_UNUSED_ARG(prio);
+  LWIP_ASSERT("sys_thread_new: out of memory", start != NULL);
+  start->fn = thread;
+  start->arg = arg;
+  if (pthread_create(&id, NULL, sys_thread_entry, start) != 0) {
+    LWIP_ASSERT("sys_thread_new: pthread_create failed", 0);
+  }
+  pthread_detach(id);
+  return id;
+}
@@ -0,0 +1,312 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+
+#include "trace_gen.h"
+
+#define TRACE_ETH_HLEN      14
+#define TRACE_IP_HLEN       20
+#define TRACE_TCP_HLEN      20
+#define TRACE_MSS           1460
+#define TRACE_START_US      1000000
+
+#define TRACE_TCP_FIN       0x01
+#define TRACE_TCP_SYN       0x02
+#define TRACE_TCP_PSH       0x08
+#define TRACE_TCP_ACK       0x10
+
+/* ISN of the DUT in the "capture"; the replay moves it to the ISN of the stack */
+#define TRACE_DUT_ISN       0x6b8b4567
+
+const uint8_t trace_dut_ip[4] = { 192, 168, 4, 1 };
+const uint8_t trace_dut_mac[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+
+struct trace_peer {
+  uint8_t ip[4];
+  uint8_t mac[6];
+  uint16_t ip_id;
+};
+
+static void
+trace_peer_init(struct trace_peer *peer, int n)
+{
+  static const uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+  memcpy(peer->ip, trace_dut_ip, 3);
+  peer->ip[3] = (uint8_t)(2 + n);
+  memcpy(peer->mac, mac, 6);
+  peer->mac[5] = (uint8_t)(2 + n);
+  peer->ip_id = (uint16_t)(n << 12);
+}
+
+/* deterministic, so that every run replays the same trace */
+static uint32_t
+trace_rand(uint32_t *state)
+{
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static void
+trace_put16(uint8_t *p, uint16_t x)
+{
+  p[0] = (uint8_t)(x >> 8);
+  p[1] = (uint8_t)x;
+}
+
+static void
+trace_put32(uint8_t *p, uint32_t x)
+{
+  p[0] = (uint8_t)(x >> 24);
+  p[1] = (uint8_t)(x >> 16);
+  p[2] = (uint8_t)(x >> 8);
+  p[3] = (uint8_t)x;
+}
+
+static uint32_t
+trace_sum(const uint8_t *data, size_t len, uint32_t sum)
+{
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    sum += (uint32_t)(data[i] << 8 | data[i + 1]);
+  }
+  if (len & 1) {
+    sum += (uint32_t)data[len - 1] << 8;
+  }
+  return sum;
+}
+
+static uint16_t
+trace_fold(uint32_t sum)
+{
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)~sum;
+}
+
+/*
+ * Finish the frame in buf, whose l4_len bytes of transport header and data
+ * are already in place after the IP header, and append it to the trace.
+ */
+static int
+trace_ip_frame(struct pcap_trace *trace, uint64_t ts_us, struct trace_peer *peer,
+               uint8_t *buf, uint8_t proto, size_t l4_len, int l4_chksum_offset)
+{
+  uint8_t *ip = buf + TRACE_ETH_HLEN;
+  uint8_t *l4 = ip + TRACE_IP_HLEN;
+  uint32_t sum;
+
+  memcpy(buf, trace_dut_mac, 6);
+  memcpy(buf + 6, peer->mac, 6);
+  trace_put16(buf + 12, 0x0800);
+
+  ip[0] = 0x45;
+  ip[1] = 0;
+  trace_put16(ip + 2, (uint16_t)(TRACE_IP_HLEN + l4_len));
+  trace_put16(ip + 4, peer->ip_id++);
+  trace_put16(ip + 6, 0x4000);  /* DF */
+  ip[8] = 64;
+  ip[9] = proto;
+  trace_put16(ip + 10, 0);
+  memcpy(ip + 12, peer->ip, 4);
+  memcpy(ip + 16, trace_dut_ip, 4);
+  trace_put16(ip + 10, trace_fold(trace_sum(ip, TRACE_IP_HLEN, 0)));
+
+  trace_put16(l4 + l4_chksum_offset, 0);
+  sum = trace_sum(ip + 12, 8, proto + (uint32_t)l4_len);
+  trace_put16(l4 + l4_chksum_offset, trace_fold(trace_sum(l4, l4_len, sum)));
+
+  return pcap_trace_append(trace, ts_us, buf, (uint32_t)(TRACE_ETH_HLEN + TRACE_IP_HLEN + l4_len));
+}
+
+/* a segment of the peer, with data of len bytes if it isn't a SYN */
+static int
+trace_tcp(struct pcap_trace *trace, uint64_t ts_us, struct trace_peer *peer,
+          uint16_t sport, uint16_t dport, uint32_t seq, uint32_t ack, uint8_t flags, size_t len)
+{
+  /* MSS, NOP, NOP, SACK permitted */
+  static const uint8_t syn_options[] = { 2, 4, TRACE_MSS >> 8, TRACE_MSS & 0xff, 1, 1, 4, 2 };
+  uint8_t buf[TRACE_ETH_HLEN + TRACE_IP_HLEN + TRACE_TCP_HLEN + TRACE_MSS];
+  uint8_t *tcp = buf + TRACE_ETH_HLEN + TRACE_IP_HLEN;
+  size_t hlen = TRACE_TCP_HLEN, i;
+
+  if (flags & TRACE_TCP_SYN) {
+    memcpy(tcp + TRACE_TCP_HLEN, syn_options, sizeof(syn_options));
+    hlen += sizeof(syn_options);
+    len = 0;
+  }
+  trace_put16(tcp, sport);
+  trace_put16(tcp + 2, dport);
+  trace_put32(tcp + 4, seq);
+  trace_put32(tcp + 8, (flags & TRACE_TCP_ACK) ? ack : 0);
+  tcp[12] = (uint8_t)((hlen / 4) << 4);
+  tcp[13] = flags;
+  trace_put16(tcp + 14, 0xffff);
+  trace_put16(tcp + 18, 0);
+  for (i = 0; i < len; i++) {
+    tcp[hlen + i] = (uint8_t)(seq + i);
+  }
+  return trace_ip_frame(trace, ts_us, peer, buf, 6, hlen + len, 16);
+}
+
+static int
+trace_udp(struct pcap_trace *trace, uint64_t ts_us, struct trace_peer *peer,
+          uint16_t sport, uint16_t dport, size_t len)
+{
+  uint8_t buf[TRACE_ETH_HLEN + TRACE_IP_HLEN + 8 + 1472];
+  uint8_t *udp = buf + TRACE_ETH_HLEN + TRACE_IP_HLEN;
+  size_t i;
+
+  trace_put16(udp, sport);
+  trace_put16(udp + 2, dport);
+  trace_put16(udp + 4, (uint16_t)(8 + len));
+  for (i = 0; i < len; i++) {
+    udp[8 + i] = (uint8_t)(peer->ip_id + i);
+  }
+  return trace_ip_frame(trace, ts_us, peer, buf, 17, 8 + len, 6);
+}
+
+/* "who has the DUT", broadcast */
+static int
+trace_arp_request(struct pcap_trace *trace, uint64_t ts_us, const struct trace_peer *peer)
+{
+  uint8_t buf[42];
+
+  memset(buf, 0xff, 6);
+  memcpy(buf + 6, peer->mac, 6);
+  trace_put16(buf + 12, 0x0806);
+  trace_put16(buf + 14, 1);         /* ethernet */
+  trace_put16(buf + 16, 0x0800);
+  buf[18] = 6;
+  buf[19] = 4;
+  trace_put16(buf + 20, 1);         /* request */
+  memcpy(buf + 22, peer->mac, 6);
+  memcpy(buf + 28, peer->ip, 4);
+  memset(buf + 32, 0, 6);
+  memcpy(buf + 38, trace_dut_ip, 4);
+  return pcap_trace_append(trace, ts_us, buf, sizeof(buf));
+}
+
+/*
+ * One connection from a peer to port 5001 of the DUT and count segments of
+ * data. With loss_pct, that many percent of the segments are lost and sent
+ * again two segments later, and dup_pct percent are received twice, as
+ * retries on a poor wifi link deliver them; the gaps between segments vary
+ * as well. The peer doesn't wait for the ACKs of the DUT: the data is taken
+ * as it arrives, and with one segment missing at a time the rest stays
+ * inside the receive window.
+ */
+static int
+trace_tcp_transfer(struct pcap_trace *trace, struct trace_expect *expect,
+                   unsigned count, unsigned loss_pct, unsigned dup_pct)
+{
+  const uint16_t sport = 49152, dport = 5001;
+  const uint32_t isn = 0x01000000, ack = TRACE_DUT_ISN + 1;
+  struct trace_peer peer;
+  uint32_t rng = 0x9e3779b9, seq = isn + 1, lost_seq = 0;
+  uint64_t ts = TRACE_START_US;
+  unsigned i, resend_in = 0;
+  int err;
+
+  trace_peer_init(&peer, 0);
+  err = trace_tcp(trace, ts, &peer, sport, dport, isn, 0, TRACE_TCP_SYN, 0);
+  ts += 1500;
+  err |= trace_tcp(trace, ts, &peer, sport, dport, seq, ack, TRACE_TCP_ACK, 0);
+
+  for (i = 0; i < count && err == 0; i++) {
+    unsigned r = trace_rand(&rng) % 100;
+    ts += loss_pct ? 300 + trace_rand(&rng) % 900 : 600;
+    if (resend_in == 0 && r < loss_pct) {
+      lost_seq = seq;
+      resend_in = 2;
+    } else {
+      err |= trace_tcp(trace, ts, &peer, sport, dport, seq, ack, TRACE_TCP_ACK, TRACE_MSS);
+      if (r >= loss_pct && r < loss_pct + dup_pct) {
+        err |= trace_tcp(trace, ts + 200, &peer, sport, dport, seq, ack, TRACE_TCP_ACK, TRACE_MSS);
+      }
+      if (resend_in != 0 && --resend_in == 0) {
+        err |= trace_tcp(trace, ts + 100, &peer, sport, dport, lost_seq, ack, TRACE_TCP_ACK, TRACE_MSS);
+      }
+    }
+    seq += TRACE_MSS;
+  }
+  if (resend_in != 0) {
+    ts += 600;
+    err |= trace_tcp(trace, ts, &peer, sport, dport, lost_seq, ack, TRACE_TCP_ACK, TRACE_MSS);
+  }
+
+  ts += 600;
+  err |= trace_tcp(trace, ts, &peer, sport, dport, seq, ack, TRACE_TCP_FIN | TRACE_TCP_ACK, 0);
+  /* after the FIN of the DUT */
+  ts += 3000;
+  err |= trace_tcp(trace, ts, &peer, sport, dport, seq + 1, ack + 1, TRACE_TCP_ACK, 0);
+
+  expect->tcp_bytes = (uint64_t)count * TRACE_MSS;
+  expect->udp_bytes = 0;
+  return err ? -1 : 0;
+}
+
+static int
+trace_gen_tcp_bulk(struct pcap_trace *trace, struct trace_expect *expect)
+{
+  return trace_tcp_transfer(trace, expect, 2000, 0, 0);
+}
+
+static int
+trace_gen_tcp_lossy(struct pcap_trace *trace, struct trace_expect *expect)
+{
+  return trace_tcp_transfer(trace, expect, 2000, 3, 2);
+}
+
+/* datagrams of 16 to 200 bytes from four peers to four ports, every 200 us */
+static int
+trace_gen_udp_small(struct pcap_trace *trace, struct trace_expect *expect)
+{
+  struct trace_peer peers[4];
+  uint32_t rng = 0x2545f491;
+  uint64_t ts = TRACE_START_US;
+  unsigned i;
+  int err = 0;
+
+  expect->tcp_bytes = 0;
+  expect->udp_bytes = 0;
+  for (i = 0; i < 4; i++) {
+    trace_peer_init(&peers[i], (int)i);
+  }
+  err |= trace_arp_request(trace, ts, &peers[0]);
+  for (i = 0; i < 5000 && err == 0; i++) {
+    uint32_t r = trace_rand(&rng);
+    size_t len = 16 + r % 185;
+    ts += 200;
+    err |= trace_udp(trace, ts, &peers[(r >> 8) & 3], 50000, (uint16_t)(5000 + ((r >> 10) & 3)), len);
+    expect->udp_bytes += len;
+  }
+  return err ? -1 : 0;
+}
+
+const struct trace_gen trace_gens[] = {
+  { "tcp_bulk", "one TCP connection, 2000 full segments in order", trace_gen_tcp_bulk },
+  { "udp_small", "5000 UDP datagrams of 16-200 bytes to 4 ports", trace_gen_udp_small },
+  { "tcp_lossy", "tcp_bulk with 3% loss and 2% duplicates", trace_gen_tcp_lossy },
+  { NULL, NULL, NULL }
+};
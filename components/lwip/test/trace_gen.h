@@ -0,0 +1,57 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Synthetic traces for the replay benchmark, in the shape of a capture
+ * taken next to an ESP32 station: frames of peers on the same network to
+ * the DUT. They are generated rather than stored so that they can be sized
+ * and varied without binary files in the tree; "bench_lwip -w" writes them
+ * out as pcap files.
+ */
+#ifndef TRACE_GEN_H
+#define TRACE_GEN_H
+
+#include <stdint.h>
+
+#include "pcap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Address of the DUT in the synthetic traces */
+extern const uint8_t trace_dut_ip[4];
+extern const uint8_t trace_dut_mac[6];
+
+/** What the DUT must have received after the replay of a trace */
+struct trace_expect {
+  uint64_t tcp_bytes;
+  uint64_t udp_bytes;
+};
+
+struct trace_gen {
+  const char *name;
+  const char *description;
+  int (*generate)(struct pcap_trace *trace, struct trace_expect *expect);
+};
+
+/** The synthetic traces, up to an entry with a NULL name */
+extern const struct trace_gen trace_gens[];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_GEN_H */
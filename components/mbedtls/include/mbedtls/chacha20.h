@@ -0,0 +1,139 @@
+/**
+ * \file chacha20.h
+ *
+ * \brief ChaCha20 stream cipher (RFC 7539)
+ *
+ *  Copyright (C) 2006-2016, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_CHACHA20_H
+#define MBEDTLS_CHACHA20_H
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MBEDTLS_ERR_CHACHA20_BAD_INPUT_DATA         -0x0051 /**< Invalid input parameter(s). */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          ChaCha20 context structure
+ */
+typedef struct
+{
+    uint32_t state[16];             /*!< key, block counter and nonce */
+    uint8_t  keystream8[64];        /*!< keystream of the current block */
+    size_t   keystream_bytes_used;  /*!< bytes of keystream8 already used */
+}
+mbedtls_chacha20_context;
+
+/**
+ * \brief          Initialize ChaCha20 context
+ *
+ * \param ctx      ChaCha20 context to be initialized
+ */
+void mbedtls_chacha20_init( mbedtls_chacha20_context *ctx );
+
+/**
+ * \brief          Clear ChaCha20 context
+ *
+ * \param ctx      ChaCha20 context to be cleared
+ */
+void mbedtls_chacha20_free( mbedtls_chacha20_context *ctx );
+
+/**
+ * \brief          ChaCha20 key schedule
+ *
+ * \param ctx      ChaCha20 context to be set up
+ * \param key      256-bit encryption key
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_CHACHA20_BAD_INPUT_DATA
+ */
+int mbedtls_chacha20_setkey( mbedtls_chacha20_context *ctx,
+                             const unsigned char key[32] );
+
+/**
+ * \brief          Set the nonce and the initial block counter, and start a
+ *                 new keystream
+ *
+ * \param ctx      ChaCha20 context, with the key set
+ * \param nonce    96-bit nonce, which must not be used twice with a key
+ * \param counter  counter of the first block (usually 0 or 1)
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_CHACHA20_BAD_INPUT_DATA
+ */
+int mbedtls_chacha20_starts( mbedtls_chacha20_context *ctx,
+                             const unsigned char nonce[12],
+                             uint32_t counter );
+
+/**
+ * \brief          Encrypt or decrypt data: XOR it with the next bytes of the
+ *                 keystream
+ *
+ * \param ctx      ChaCha20 context, started with mbedtls_chacha20_starts()
+ * \param size     length of the data in bytes
+ * \param input    buffer holding the input data
+ * \param output   buffer for the output data, may be equal to input
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_CHACHA20_BAD_INPUT_DATA
+ */
+int mbedtls_chacha20_update( mbedtls_chacha20_context *ctx,
+                             size_t size,
+                             const unsigned char *input,
+                             unsigned char *output );
+
+/**
+ * \brief          ChaCha20 encryption or decryption of a buffer in one pass
+ *
+ * \param key      256-bit encryption key
+ * \param nonce    96-bit nonce
+ * \param counter  counter of the first block
+ * \param size     length of the data in bytes
+ * \param input    buffer holding the input data
+ * \param output   buffer for the output data, may be equal to input
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_CHACHA20_BAD_INPUT_DATA
+ */
+int mbedtls_chacha20_crypt( const unsigned char key[32],
+                            const unsigned char nonce[12],
+                            uint32_t counter,
+                            size_t size,
+                            const unsigned char *input,
+                            unsigned char *output );
+
+#if defined(MBEDTLS_SELF_TEST)
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int mbedtls_chacha20_self_test( int verbose );
+#endif /* MBEDTLS_SELF_TEST */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBEDTLS_CHACHA20_H */
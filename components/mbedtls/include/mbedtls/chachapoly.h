@@ -0,0 +1,211 @@
+/**
+ * \file chachapoly.h
+ *
+ * \brief ChaCha20-Poly1305 AEAD construction (RFC 7539)
+ *
+ *  Copyright (C) 2006-2016, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_CHACHAPOLY_H
+#define MBEDTLS_CHACHAPOLY_H
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "chacha20.h"
+#include "poly1305.h"
+
+#define MBEDTLS_ERR_CHACHAPOLY_BAD_STATE            -0x0054 /**< The requested operation is not permitted in the current state. */
+#define MBEDTLS_ERR_CHACHAPOLY_AUTH_FAILED          -0x0056 /**< Authenticated decryption failed: data was not authentic. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    MBEDTLS_CHACHAPOLY_ENCRYPT,     /**< The mode value for performing encryption. */
+    MBEDTLS_CHACHAPOLY_DECRYPT      /**< The mode value for performing decryption. */
+}
+mbedtls_chachapoly_mode_t;
+
+/**
+ * \brief          ChaCha20-Poly1305 context structure
+ */
+typedef struct
+{
+    mbedtls_chacha20_context chacha20_ctx;  /*!< the ChaCha20 context */
+    mbedtls_poly1305_context poly1305_ctx;  /*!< the Poly1305 context */
+    uint64_t aad_len;                       /*!< additional data bytes so far */
+    uint64_t ciphertext_len;                /*!< ciphertext bytes so far */
+    int state;                              /*!< step of the operation */
+    mbedtls_chachapoly_mode_t mode;         /*!< encryption or decryption */
+}
+mbedtls_chachapoly_context;
+
+/**
+ * \brief          Initialize ChaCha20-Poly1305 context
+ *
+ * \param ctx      context to be initialized
+ */
+void mbedtls_chachapoly_init( mbedtls_chachapoly_context *ctx );
+
+/**
+ * \brief          Clear ChaCha20-Poly1305 context
+ *
+ * \param ctx      context to be cleared
+ */
+void mbedtls_chachapoly_free( mbedtls_chachapoly_context *ctx );
+
+/**
+ * \brief          Set the key
+ *
+ * \param ctx      ChaCha20-Poly1305 context
+ * \param key      256-bit key
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_CHACHA20_BAD_INPUT_DATA
+ */
+int mbedtls_chachapoly_setkey( mbedtls_chachapoly_context *ctx,
+                               const unsigned char key[32] );
+
+/**
+ * \brief          Start an encryption or decryption
+ *
+ *                 The operation continues with any number of calls to
+ *                 mbedtls_chachapoly_update_aad(), then any number of
+ *                 calls to mbedtls_chachapoly_update(), and ends with
+ *                 mbedtls_chachapoly_finish().
+ *
+ * \param ctx      ChaCha20-Poly1305 context, with the key set
+ * \param nonce    96-bit nonce, which must not be used twice with a key
+ * \param mode     MBEDTLS_CHACHAPOLY_ENCRYPT or MBEDTLS_CHACHAPOLY_DECRYPT
+ *
+ * \return         0 if successful, or a ChaCha20 or Poly1305 error code
+ */
+int mbedtls_chachapoly_starts( mbedtls_chachapoly_context *ctx,
+                               const unsigned char nonce[12],
+                               mbedtls_chachapoly_mode_t mode );
+
+/**
+ * \brief          Feed additional (authenticated, not encrypted) data
+ *
+ * \param ctx      ChaCha20-Poly1305 context
+ * \param aad      buffer holding the additional data
+ * \param aad_len  length of the additional data in bytes
+ *
+ * \return         0 if successful, MBEDTLS_ERR_CHACHAPOLY_BAD_STATE if
+ *                 called outside of an operation or after
+ *                 mbedtls_chachapoly_update()
+ */
+int mbedtls_chachapoly_update_aad( mbedtls_chachapoly_context *ctx,
+                                   const unsigned char *aad,
+                                   size_t aad_len );
+
+/**
+ * \brief          Encrypt or decrypt data
+ *
+ * \param ctx      ChaCha20-Poly1305 context
+ * \param len      length of the data in bytes
+ * \param input    buffer holding the input data
+ * \param output   buffer for the output data, may be equal to input
+ *
+ * \return         0 if successful, MBEDTLS_ERR_CHACHAPOLY_BAD_STATE if
+ *                 called outside of an operation
+ */
+int mbedtls_chachapoly_update( mbedtls_chachapoly_context *ctx,
+                               size_t len,
+                               const unsigned char *input,
+                               unsigned char *output );
+
+/**
+ * \brief          Finish the operation and compute the tag
+ *
+ * \param ctx      ChaCha20-Poly1305 context
+ * \param mac      buffer for the 128-bit tag
+ *
+ * \return         0 if successful, MBEDTLS_ERR_CHACHAPOLY_BAD_STATE if
+ *                 called outside of an operation
+ */
+int mbedtls_chachapoly_finish( mbedtls_chachapoly_context *ctx,
+                               unsigned char mac[16] );
+
+/**
+ * \brief          Encrypt a buffer and compute its tag in one pass
+ *
+ * \param ctx      ChaCha20-Poly1305 context, with the key set
+ * \param length   length of the data in bytes
+ * \param nonce    96-bit nonce
+ * \param aad      buffer holding the additional data
+ * \param aad_len  length of the additional data in bytes
+ * \param input    buffer holding the plaintext
+ * \param output   buffer for the ciphertext, may be equal to input
+ * \param tag      buffer for the 128-bit tag
+ *
+ * \return         0 if successful, or a ChaCha20 or Poly1305 error code
+ */
+int mbedtls_chachapoly_encrypt_and_tag( mbedtls_chachapoly_context *ctx,
+                                        size_t length,
+                                        const unsigned char nonce[12],
+                                        const unsigned char *aad,
+                                        size_t aad_len,
+                                        const unsigned char *input,
+                                        unsigned char *output,
+                                        unsigned char tag[16] );
+
+/**
+ * \brief          Check the tag of a buffer and decrypt it in one pass
+ *
+ * \param ctx      ChaCha20-Poly1305 context, with the key set
+ * \param length   length of the data in bytes
+ * \param nonce    96-bit nonce
+ * \param aad      buffer holding the additional data
+ * \param aad_len  length of the additional data in bytes
+ * \param tag      buffer holding the 128-bit tag
+ * \param input    buffer holding the ciphertext
+ * \param output   buffer for the plaintext, may be equal to input
+ *
+ * \return         0 if successful and authenticated,
+ *                 MBEDTLS_ERR_CHACHAPOLY_AUTH_FAILED if the tag does not
+ *                 match (output is then zeroed), or a ChaCha20 or Poly1305
+ *                 error code
+ */
+int mbedtls_chachapoly_auth_decrypt( mbedtls_chachapoly_context *ctx,
+                                     size_t length,
+                                     const unsigned char nonce[12],
+                                     const unsigned char *aad,
+                                     size_t aad_len,
+                                     const unsigned char tag[16],
+                                     const unsigned char *input,
+                                     unsigned char *output );
+
+#if defined(MBEDTLS_SELF_TEST)
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int mbedtls_chachapoly_self_test( int verbose );
+#endif /* MBEDTLS_SELF_TEST */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBEDTLS_CHACHAPOLY_H */
@@ -145,6 +145,15 @@
 #error "MBEDTLS_GCM_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_CHACHAPOLY_C) && \
+    ( !defined(MBEDTLS_CHACHA20_C) || !defined(MBEDTLS_POLY1305_C) )
+#error "MBEDTLS_CHACHAPOLY_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CHACHAPOLY_PREFERRED) && !defined(MBEDTLS_CHACHAPOLY_C)
+#error "MBEDTLS_SSL_CHACHAPOLY_PREFERRED defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_HAVEGE_C) && !defined(MBEDTLS_TIMING_C)
 #error "MBEDTLS_HAVEGE_C defined, but not all prerequisites"
 #endif
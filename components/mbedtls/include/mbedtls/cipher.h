@@ -34,7 +34,7 @@
 
 #include <stddef.h>
 
-#if defined(MBEDTLS_GCM_C) || defined(MBEDTLS_CCM_C)
+#if defined(MBEDTLS_GCM_C) || defined(MBEDTLS_CCM_C) || defined(MBEDTLS_CHACHAPOLY_C)
 #define MBEDTLS_CIPHER_MODE_AEAD
 #endif
 
@@ -75,6 +75,7 @@ typedef enum {
     MBEDTLS_CIPHER_ID_CAMELLIA,
     MBEDTLS_CIPHER_ID_BLOWFISH,
     MBEDTLS_CIPHER_ID_ARC4,
+    MBEDTLS_CIPHER_ID_CHACHA20,
 } mbedtls_cipher_id_t;
 
 typedef enum {
@@ -127,6 +128,7 @@ typedef enum {
     MBEDTLS_CIPHER_CAMELLIA_128_CCM,
     MBEDTLS_CIPHER_CAMELLIA_192_CCM,
     MBEDTLS_CIPHER_CAMELLIA_256_CCM,
+    MBEDTLS_CIPHER_CHACHA20_POLY1305,
 } mbedtls_cipher_type_t;
 
 typedef enum {
@@ -139,6 +141,7 @@ typedef enum {
     MBEDTLS_MODE_GCM,
     MBEDTLS_MODE_STREAM,
     MBEDTLS_MODE_CCM,
+    MBEDTLS_MODE_CHACHAPOLY,
 } mbedtls_cipher_mode_t;
 
 typedef enum {
@@ -946,6 +946,20 @@
  */
 //#define MBEDTLS_SSL_AEAD_RANDOM_IV
 
+/**
+ * \def MBEDTLS_SSL_CHACHAPOLY_PREFERRED
+ *
+ * Offer the ChaCha20-Poly1305 ciphersuites before all other ephemeral
+ * suites, instead of after AES-256-GCM. ChaCha20-Poly1305 runs fast in
+ * software on 32-bit cores, where AES-GCM without dedicated hardware is slow
+ * and needs large tables.
+ *
+ * Requires: MBEDTLS_CHACHAPOLY_C
+ *
+ * Uncomment this macro to prefer the ChaCha20-Poly1305 ciphersuites.
+ */
+//#define MBEDTLS_SSL_CHACHAPOLY_PREFERRED
+
 /**
  * \def MBEDTLS_SSL_ALL_ALERT_MESSAGES
  *
@@ -1653,6 +1667,29 @@
  */
 #define MBEDTLS_CERTS_C
 
+/**
+ * \def MBEDTLS_CHACHA20_C
+ *
+ * Enable the ChaCha20 stream cipher.
+ *
+ * Module:  library/chacha20.c
+ */
+#define MBEDTLS_CHACHA20_C
+
+/**
+ * \def MBEDTLS_CHACHAPOLY_C
+ *
+ * Enable the ChaCha20-Poly1305 AEAD algorithm.
+ *
+ * Module:  library/chachapoly.c
+ *
+ * Requires: MBEDTLS_CHACHA20_C, MBEDTLS_POLY1305_C
+ *
+ * This module enables the ChaCha20-Poly1305 ciphersuites (RFC 7905), if
+ * other requisites are enabled as well.
+ */
+#define MBEDTLS_CHACHAPOLY_C
+
 /**
  * \def MBEDTLS_CIPHER_C
  *
@@ -2140,6 +2177,16 @@
  */
 #define MBEDTLS_PLATFORM_C
 
+/**
+ * \def MBEDTLS_POLY1305_C
+ *
+ * Enable the Poly1305 MAC algorithm.
+ *
+ * Module:  library/poly1305.c
+ * Caller:  library/chachapoly.c
+ */
+#define MBEDTLS_POLY1305_C
+
 /**
  * \def MBEDTLS_RIPEMD160_C
  *
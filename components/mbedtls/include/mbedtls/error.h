@@ -62,6 +62,9 @@
  * CTR_DBRG  4  0x0034-0x003A
  * ENTROPY   3  0x003C-0x0040   0x003D-0x003F
  * NET      11  0x0042-0x0052   0x0043-0x0045
+ * CHACHA20  1                  0x0051-0x0051
+ * CHACHAPOLY 2  0x0054-0x0056
+ * POLY1305  1                  0x0057-0x0057
  * ASN1      7  0x0060-0x006C
  * PBKDF2    1  0x007C-0x007C
  * HMAC_DRBG 4  0x0003-0x0009
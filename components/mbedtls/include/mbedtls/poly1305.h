@@ -0,0 +1,135 @@
+/**
+ * \file poly1305.h
+ *
+ * \brief Poly1305 one-time authenticator (RFC 7539)
+ *
+ *  Copyright (C) 2006-2016, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_POLY1305_H
+#define MBEDTLS_POLY1305_H
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA         -0x0057 /**< Invalid input parameter(s). */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Poly1305 context structure
+ *
+ * The 130-bit numbers are kept in five 26-bit limbs, so that products fit
+ * in 64 bits and the carries can be delayed to the end of each block.
+ */
+typedef struct
+{
+    uint32_t r[5];          /*!< first half of the key, clamped */
+    uint32_t s[4];          /*!< second half of the key */
+    uint32_t acc[5];        /*!< accumulator */
+    uint8_t  queue[16];     /*!< input not yet processed */
+    size_t   queue_len;     /*!< bytes in queue */
+}
+mbedtls_poly1305_context;
+
+/**
+ * \brief          Initialize Poly1305 context
+ *
+ * \param ctx      Poly1305 context to be initialized
+ */
+void mbedtls_poly1305_init( mbedtls_poly1305_context *ctx );
+
+/**
+ * \brief          Clear Poly1305 context
+ *
+ * \param ctx      Poly1305 context to be cleared
+ */
+void mbedtls_poly1305_free( mbedtls_poly1305_context *ctx );
+
+/**
+ * \brief          Start a MAC computation
+ *
+ * \param ctx      Poly1305 context
+ * \param key      256-bit one-time key, which must not be used for more
+ *                 than one message
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA
+ */
+int mbedtls_poly1305_starts( mbedtls_poly1305_context *ctx,
+                             const unsigned char key[32] );
+
+/**
+ * \brief          Feed data to the MAC computation
+ *
+ * \param ctx      Poly1305 context, started with mbedtls_poly1305_starts()
+ * \param input    buffer holding the data
+ * \param ilen     length of the data in bytes
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA
+ */
+int mbedtls_poly1305_update( mbedtls_poly1305_context *ctx,
+                             const unsigned char *input,
+                             size_t ilen );
+
+/**
+ * \brief          Finish the MAC computation
+ *
+ * \param ctx      Poly1305 context
+ * \param mac      buffer for the 128-bit MAC
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA
+ */
+int mbedtls_poly1305_finish( mbedtls_poly1305_context *ctx,
+                             unsigned char mac[16] );
+
+/**
+ * \brief          Poly1305 MAC of a buffer in one pass
+ *
+ * \param key      256-bit one-time key
+ * \param input    buffer holding the data
+ * \param ilen     length of the data in bytes
+ * \param mac      buffer for the 128-bit MAC
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA
+ */
+int mbedtls_poly1305_mac( const unsigned char key[32],
+                          const unsigned char *input,
+                          size_t ilen,
+                          unsigned char mac[16] );
+
+#if defined(MBEDTLS_SELF_TEST)
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int mbedtls_poly1305_self_test( int verbose );
+#endif /* MBEDTLS_SELF_TEST */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBEDTLS_POLY1305_H */
@@ -107,6 +107,22 @@ int mbedtls_ssl_ticket_setup( mbedtls_ssl_ticket_context *ctx,
     mbedtls_cipher_type_t cipher,
     uint32_t lifetime );
 
+/**
+ * \brief           Retire the older of the two keys and replace it with a
+ *                  fresh one, which becomes the active key
+ *
+ * \param ctx       Context set up with mbedtls_ssl_ticket_setup()
+ *
+ * \note            Tickets protected with the previously active key are
+ *                  still accepted until the next rotation. Without
+ *                  MBEDTLS_HAVE_TIME, the keys are only rotated by this
+ *                  function. It doesn't allocate memory.
+ *
+ * \return          0 if successful,
+ *                  or a specific MBEDTLS_ERR_XXX error code
+ */
+int mbedtls_ssl_ticket_rotate( mbedtls_ssl_ticket_context *ctx );
+
 /**
  * \brief           Implementation of the ticket write callback
  *
@@ -51,6 +51,7 @@ extern "C" {
  */
 typedef struct mbedtls_x509_crt
 {
+    int own_buffer;                     /**< Whether \c raw was allocated for the certificate, or references the buffer it was parsed from. */
     mbedtls_x509_buf raw;               /**< The raw certificate data (DER). */
     mbedtls_x509_buf tbs;               /**< The raw certificate body (DER). The part that is To Be Signed. */
 
@@ -169,6 +170,21 @@ extern const mbedtls_x509_crt_profile mbedtls_x509_crt_profile_suiteb;
 int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *buf,
                         size_t buflen );
 
+/**
+ * \brief          Parse a single DER formatted certificate and add it
+ *                 to the chained list, without copying it: the certificate
+ *                 references the buffer, such as memory-mapped flash.
+ *
+ * \param chain    points to the start of the chain
+ * \param buf      buffer holding the certificate DER data, which has to
+ *                 stay valid and unchanged until the chain is freed
+ * \param buflen   size of the buffer
+ *
+ * \return         0 if successful, or a specific X509 or PEM error code
+ */
+int mbedtls_x509_crt_parse_der_nocopy( mbedtls_x509_crt *chain, const unsigned char *buf,
+                        size_t buflen );
+
 /**
  * \brief          Parse one or more certificates and add them
  *                 to the chained list. Parses permissively. If some
@@ -1164,7 +1164,13 @@ void mpi_mul_hlp( size_t i, mbedtls_mpi_uint *s, mbedtls_mpi_uint *d, mbedtls_mp
     while( c != 0 );
 }
 
-#if !defined(MBEDTLS_MPI_MUL_MPI_ALT)
+/* Espressif add start. */
+#if defined(MBEDTLS_MPI_MUL_MPI_ALT)
+/* Software version, used by the hardware one for operands too large for
+   the unit and while the unit is busy */
+#define mbedtls_mpi_mul_mpi mbedtls_mpi_mul_mpi_software
+#endif
+/* Espressif add end. */
 /*
  * Baseline multiplication: X = A * B  (HAC 14.12)
  */
@@ -1201,7 +1207,7 @@ cleanup:
 
     return( ret );
 }
-#endif
+#undef mbedtls_mpi_mul_mpi
 
 /*
  * Baseline multiplication: X = A * b
@@ -41,6 +41,10 @@
 #include "mbedtls/gcm.h"
 #endif
 
+#if defined(MBEDTLS_CHACHAPOLY_C)
+#include "mbedtls/chachapoly.h"
+#endif
+
 #if defined(MBEDTLS_CCM_C)
 #include "mbedtls/ccm.h"
 #endif
@@ -844,6 +848,19 @@ int mbedtls_cipher_auth_encrypt( mbedtls_cipher_context_t *ctx,
                                      tag, tag_len ) );
     }
 #endif /* MBEDTLS_CCM_C */
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    if( MBEDTLS_MODE_CHACHAPOLY == ctx->cipher_info->mode )
+    {
+        /* The nonce and the tag have a fixed length */
+        if( iv_len != ctx->cipher_info->iv_size || tag_len != 16 )
+            return( MBEDTLS_ERR_CIPHER_BAD_INPUT_DATA );
+
+        *olen = ilen;
+        return( mbedtls_chachapoly_encrypt_and_tag( ctx->cipher_ctx, ilen,
+                                            iv, ad, ad_len, input, output,
+                                            tag ) );
+    }
+#endif /* MBEDTLS_CHACHAPOLY_C */
 
     return( MBEDTLS_ERR_CIPHER_FEATURE_UNAVAILABLE );
 }
@@ -890,6 +907,25 @@ int mbedtls_cipher_auth_decrypt( mbedtls_cipher_context_t *ctx,
         return( ret );
     }
 #endif /* MBEDTLS_CCM_C */
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    if( MBEDTLS_MODE_CHACHAPOLY == ctx->cipher_info->mode )
+    {
+        int ret;
+
+        /* The nonce and the tag have a fixed length */
+        if( iv_len != ctx->cipher_info->iv_size || tag_len != 16 )
+            return( MBEDTLS_ERR_CIPHER_BAD_INPUT_DATA );
+
+        *olen = ilen;
+        ret = mbedtls_chachapoly_auth_decrypt( ctx->cipher_ctx, ilen,
+                                iv, ad, ad_len, tag, input, output );
+
+        if( ret == MBEDTLS_ERR_CHACHAPOLY_AUTH_FAILED )
+            ret = MBEDTLS_ERR_CIPHER_AUTH_FAILED;
+
+        return( ret );
+    }
+#endif /* MBEDTLS_CHACHAPOLY_C */
 
     return( MBEDTLS_ERR_CIPHER_FEATURE_UNAVAILABLE );
 }
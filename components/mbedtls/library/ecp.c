@@ -1306,6 +1306,11 @@ cleanup:
  * Multiplication using the comb method,
  * for curves in short Weierstrass form
  */
+/* Espressif add start. */
+/* ecp_curves.c */
+const mbedtls_ecp_point *mbedtls_ecp_precomputed_comb( mbedtls_ecp_group_id id, unsigned char w );
+/* Espressif add end. */
+
 static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
                          const mbedtls_mpi *m, const mbedtls_ecp_point *P,
                          int (*f_rng)(void *, unsigned char *, size_t),
@@ -1365,6 +1370,12 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
      */
     T = p_eq_g ? grp->T : NULL;
 
+/* Espressif add start. */
+    /* Table of the generator built into ecp_curves.c, never freed */
+    if( T == NULL && p_eq_g )
+        T = (mbedtls_ecp_point *) mbedtls_ecp_precomputed_comb( grp->id, w );
+/* Espressif add end. */
+
     if( T == NULL )
     {
         T = mbedtls_calloc( pre_len, sizeof( mbedtls_ecp_point ) );
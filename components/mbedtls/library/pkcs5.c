@@ -44,6 +44,12 @@
 
 #include <string.h>
 
+/* Espressif add start. */
+#if defined(MBEDTLS_PKCS5_PBKDF2_SHA1_ALT)
+#include "hwcrypto/sha.h"
+#endif
+/* Espressif add end. */
+
 #if defined(MBEDTLS_PLATFORM_C)
 #include "mbedtls/platform.h"
 #else
@@ -234,6 +240,16 @@ int mbedtls_pkcs5_pbkdf2_hmac( mbedtls_md_context_t *ctx, const unsigned char *p
     if( iteration_count > 0xFFFFFFFF )
         return( MBEDTLS_ERR_PKCS5_BAD_INPUT_DATA );
 
+/* Espressif add start. */
+#if defined(MBEDTLS_PKCS5_PBKDF2_SHA1_ALT)
+    /* Falls through to the generic code while the engine is in use */
+    if( mbedtls_md_get_type( ctx->md_info ) == MBEDTLS_MD_SHA1 &&
+        esp_sha1_pbkdf2( password, plen, salt, slen, iteration_count,
+                         key_length, output ) == 0 )
+        return( 0 );
+#endif
+/* Espressif add end. */
+
     while( key_length )
     {
         // U1 ends up in work
@@ -256,8 +272,11 @@ int mbedtls_pkcs5_pbkdf2_hmac( mbedtls_md_context_t *ctx, const unsigned char *p
         {
             // U2 ends up in md1
             //
-            if( ( ret = mbedtls_md_hmac_starts( ctx, password, plen ) ) != 0 )
+/* Espressif add start. */
+            /* Reuse the pads of mbedtls_md_hmac_starts() above */
+            if( ( ret = mbedtls_md_hmac_reset( ctx ) ) != 0 )
                 return( ret );
+/* Espressif add end. */
 
             if( ( ret = mbedtls_md_hmac_update( ctx, md1, md_size ) ) != 0 )
                 return( ret );
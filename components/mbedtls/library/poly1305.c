@@ -0,0 +1,499 @@
+/*
+ *  Poly1305 implementation (RFC 7539)
+ *
+ *  Copyright (C) 2006-2016, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+
+/*
+ * Definition of Poly1305:
+ * RFC 7539 "ChaCha20 and Poly1305 for IETF Protocols"
+ *
+ * The arithmetic follows the 32-bit variant of poly1305-donna by Andrew
+ * Moon: numbers modulo 2^130 - 5 are kept in five 26-bit limbs, so every
+ * partial product of a block multiplication is a 32x32->64-bit multiply
+ * (MULL and MULUH on Xtensa), the five sums of products fit in 64 bits
+ * without intermediate carries, and a single carry pass per block is
+ * enough.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_POLY1305_C)
+
+#include "mbedtls/poly1305.h"
+
+#include <string.h>
+
+#if defined(MBEDTLS_SELF_TEST)
+#if defined(MBEDTLS_PLATFORM_C)
+#include "mbedtls/platform.h"
+#else
+#include <stdio.h>
+#define mbedtls_printf printf
+#endif /* MBEDTLS_PLATFORM_C */
+#endif /* MBEDTLS_SELF_TEST */
+
+/* Implementation that should never be optimized out by the compiler */
+static void mbedtls_zeroize( void *v, size_t n ) {
+    volatile unsigned char *p = (unsigned char*)v; while( n-- ) *p++ = 0;
+}
+
+/*
+ * 32-bit integer manipulation macros (little endian)
+ */
+#ifndef GET_UINT32_LE
+#define GET_UINT32_LE(n,b,i)                            \
+{                                                       \
+    (n) = ( (uint32_t) (b)[(i)    ]       )             \
+        | ( (uint32_t) (b)[(i) + 1] <<  8 )             \
+        | ( (uint32_t) (b)[(i) + 2] << 16 )             \
+        | ( (uint32_t) (b)[(i) + 3] << 24 );            \
+}
+#endif
+
+#ifndef PUT_UINT32_LE
+#define PUT_UINT32_LE(n,b,i)                                    \
+{                                                               \
+    (b)[(i)    ] = (unsigned char) ( ( (n)       ) & 0xFF );    \
+    (b)[(i) + 1] = (unsigned char) ( ( (n) >>  8 ) & 0xFF );    \
+    (b)[(i) + 2] = (unsigned char) ( ( (n) >> 16 ) & 0xFF );    \
+    (b)[(i) + 3] = (unsigned char) ( ( (n) >> 24 ) & 0xFF );    \
+}
+#endif
+
+#define POLY1305_BLOCK_SIZE_BYTES ( 16U )
+
+#define LIMB_MASK 0x3ffffffU
+
+/*
+ * Process nblocks 16-byte blocks of input.
+ *
+ * hibit is 2^128 in the top limb, the bit appended to every full block;
+ * the last, padded block of a message has it set by the caller instead.
+ */
+static void poly1305_process( mbedtls_poly1305_context *ctx,
+                              size_t nblocks,
+                              const unsigned char *input,
+                              uint32_t hibit )
+{
+    const uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2],
+                   r3 = ctx->r[3], r4 = ctx->r[4];
+    /* r * 5 for the limbs which wrap around 2^130 */
+    const uint32_t s1 = r1 * 5U, s2 = r2 * 5U, s3 = r3 * 5U, s4 = r4 * 5U;
+    uint32_t h0 = ctx->acc[0], h1 = ctx->acc[1], h2 = ctx->acc[2],
+             h3 = ctx->acc[3], h4 = ctx->acc[4];
+    uint64_t d0, d1, d2, d3, d4;
+    uint32_t c, w;
+
+    while( nblocks-- > 0U )
+    {
+        /* h += m[i] */
+        GET_UINT32_LE( w, input,  0 ); h0 += ( w      ) & LIMB_MASK;
+        GET_UINT32_LE( w, input,  3 ); h1 += ( w >> 2 ) & LIMB_MASK;
+        GET_UINT32_LE( w, input,  6 ); h2 += ( w >> 4 ) & LIMB_MASK;
+        GET_UINT32_LE( w, input,  9 ); h3 += ( w >> 6 ) & LIMB_MASK;
+        GET_UINT32_LE( w, input, 12 ); h4 += ( w >> 8 ) | hibit;
+
+        /* h *= r */
+        d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 +
+             (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+        d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 +
+             (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+        d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 +
+             (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+        d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 +
+             (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+        d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 +
+             (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+
+        /* (partial) h %= p */
+                      c = (uint32_t) ( d0 >> 26 ); h0 = (uint32_t) d0 & LIMB_MASK;
+        d1 += c;      c = (uint32_t) ( d1 >> 26 ); h1 = (uint32_t) d1 & LIMB_MASK;
+        d2 += c;      c = (uint32_t) ( d2 >> 26 ); h2 = (uint32_t) d2 & LIMB_MASK;
+        d3 += c;      c = (uint32_t) ( d3 >> 26 ); h3 = (uint32_t) d3 & LIMB_MASK;
+        d4 += c;      c = (uint32_t) ( d4 >> 26 ); h4 = (uint32_t) d4 & LIMB_MASK;
+        h0 += c * 5U; c = h0 >> 26;                h0 = h0 & LIMB_MASK;
+        h1 += c;
+
+        input += POLY1305_BLOCK_SIZE_BYTES;
+    }
+
+    ctx->acc[0] = h0;
+    ctx->acc[1] = h1;
+    ctx->acc[2] = h2;
+    ctx->acc[3] = h3;
+    ctx->acc[4] = h4;
+}
+
+/*
+ * h = (h + s) mod 2^128, written to mac
+ */
+static void poly1305_compute_mac( mbedtls_poly1305_context *ctx,
+                                  unsigned char mac[16] )
+{
+    uint32_t h0 = ctx->acc[0], h1 = ctx->acc[1], h2 = ctx->acc[2],
+             h3 = ctx->acc[3], h4 = ctx->acc[4];
+    uint32_t g0, g1, g2, g3, g4;
+    uint32_t c, mask;
+    uint64_t f;
+
+    /* Fully carry h */
+                  c = h1 >> 26; h1 &= LIMB_MASK;
+    h2 += c;      c = h2 >> 26; h2 &= LIMB_MASK;
+    h3 += c;      c = h3 >> 26; h3 &= LIMB_MASK;
+    h4 += c;      c = h4 >> 26; h4 &= LIMB_MASK;
+    h0 += c * 5U; c = h0 >> 26; h0 &= LIMB_MASK;
+    h1 += c;
+
+    /* g = h + -p = h - ( 2^130 - 5 ) */
+    g0 = h0 + 5U; c = g0 >> 26; g0 &= LIMB_MASK;
+    g1 = h1 + c;  c = g1 >> 26; g1 &= LIMB_MASK;
+    g2 = h2 + c;  c = g2 >> 26; g2 &= LIMB_MASK;
+    g3 = h3 + c;  c = g3 >> 26; g3 &= LIMB_MASK;
+    g4 = h4 + c - ( 1U << 26 );
+
+    /* Select h if h < p, or g if h >= p, in constant time */
+    mask = ( g4 >> 31 ) - 1U;
+    g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+    mask = ~mask;
+    h0 = ( h0 & mask ) | g0;
+    h1 = ( h1 & mask ) | g1;
+    h2 = ( h2 & mask ) | g2;
+    h3 = ( h3 & mask ) | g3;
+    h4 = ( h4 & mask ) | g4;
+
+    /* h = h mod 2^128, in 32-bit words */
+    h0 = ( ( h0       ) | ( h1 << 26 ) );
+    h1 = ( ( h1 >>  6 ) | ( h2 << 20 ) );
+    h2 = ( ( h2 >> 12 ) | ( h3 << 14 ) );
+    h3 = ( ( h3 >> 18 ) | ( h4 <<  8 ) );
+
+    /* mac = ( h + s ) mod 2^128 */
+    f = (uint64_t) h0 + ctx->s[0];                h0 = (uint32_t) f;
+    f = (uint64_t) h1 + ctx->s[1] + ( f >> 32 );  h1 = (uint32_t) f;
+    f = (uint64_t) h2 + ctx->s[2] + ( f >> 32 );  h2 = (uint32_t) f;
+    f = (uint64_t) h3 + ctx->s[3] + ( f >> 32 );  h3 = (uint32_t) f;
+
+    PUT_UINT32_LE( h0, mac,  0 );
+    PUT_UINT32_LE( h1, mac,  4 );
+    PUT_UINT32_LE( h2, mac,  8 );
+    PUT_UINT32_LE( h3, mac, 12 );
+}
+
+void mbedtls_poly1305_init( mbedtls_poly1305_context *ctx )
+{
+    memset( ctx, 0, sizeof( mbedtls_poly1305_context ) );
+}
+
+void mbedtls_poly1305_free( mbedtls_poly1305_context *ctx )
+{
+    if( ctx != NULL )
+        mbedtls_zeroize( ctx, sizeof( mbedtls_poly1305_context ) );
+}
+
+int mbedtls_poly1305_starts( mbedtls_poly1305_context *ctx,
+                             const unsigned char key[32] )
+{
+    uint32_t w;
+
+    if( ctx == NULL || key == NULL )
+        return( MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA );
+
+    /* r &= 0x0ffffffc0ffffffc0ffffffc0fffffff, split in 26-bit limbs */
+    GET_UINT32_LE( w, key,  0 ); ctx->r[0] = ( w      ) & 0x3ffffffU;
+    GET_UINT32_LE( w, key,  3 ); ctx->r[1] = ( w >> 2 ) & 0x3ffff03U;
+    GET_UINT32_LE( w, key,  6 ); ctx->r[2] = ( w >> 4 ) & 0x3ffc0ffU;
+    GET_UINT32_LE( w, key,  9 ); ctx->r[3] = ( w >> 6 ) & 0x3f03fffU;
+    GET_UINT32_LE( w, key, 12 ); ctx->r[4] = ( w >> 8 ) & 0x00fffffU;
+
+    GET_UINT32_LE( ctx->s[0], key, 16 );
+    GET_UINT32_LE( ctx->s[1], key, 20 );
+    GET_UINT32_LE( ctx->s[2], key, 24 );
+    GET_UINT32_LE( ctx->s[3], key, 28 );
+
+    /* Initial accumulator state */
+    memset( ctx->acc, 0, sizeof( ctx->acc ) );
+
+    /* Queue is empty */
+    mbedtls_zeroize( ctx->queue, sizeof( ctx->queue ) );
+    ctx->queue_len = 0U;
+
+    return( 0 );
+}
+
+int mbedtls_poly1305_update( mbedtls_poly1305_context *ctx,
+                             const unsigned char *input,
+                             size_t ilen )
+{
+    size_t offset    = 0U;
+    size_t remaining = ilen;
+    size_t queue_free_len;
+    size_t nblocks;
+
+    if( ctx == NULL )
+        return( MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA );
+    else if( ilen > 0U && input == NULL )
+        return( MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA );
+
+    if( remaining > 0U && ctx->queue_len > 0U )
+    {
+        queue_free_len = ( POLY1305_BLOCK_SIZE_BYTES - ctx->queue_len );
+
+        if( ilen < queue_free_len )
+        {
+            /* Not enough data to complete the block.
+             * Store this data with the other leftovers.
+             */
+            memcpy( &ctx->queue[ctx->queue_len],
+                    input,
+                    ilen );
+
+            ctx->queue_len += ilen;
+
+            remaining = 0U;
+        }
+        else
+        {
+            /* Enough data to produce a complete block */
+            memcpy( &ctx->queue[ctx->queue_len],
+                    input,
+                    queue_free_len );
+
+            ctx->queue_len = 0U;
+
+            poly1305_process( ctx, 1U, ctx->queue, 1U << 24 );
+
+            offset    += queue_free_len;
+            remaining -= queue_free_len;
+        }
+    }
+
+    if( remaining >= POLY1305_BLOCK_SIZE_BYTES )
+    {
+        nblocks = remaining / POLY1305_BLOCK_SIZE_BYTES;
+
+        poly1305_process( ctx, nblocks, &input[offset], 1U << 24 );
+
+        offset += nblocks * POLY1305_BLOCK_SIZE_BYTES;
+        remaining %= POLY1305_BLOCK_SIZE_BYTES;
+    }
+
+    if( remaining > 0U )
+    {
+        /* Store partial block */
+        ctx->queue_len = remaining;
+        memcpy( ctx->queue, &input[offset], remaining );
+    }
+
+    return( 0 );
+}
+
+int mbedtls_poly1305_finish( mbedtls_poly1305_context *ctx,
+                             unsigned char mac[16] )
+{
+    if( ctx == NULL || mac == NULL )
+        return( MBEDTLS_ERR_POLY1305_BAD_INPUT_DATA );
+
+    /* Process any leftover data */
+    if( ctx->queue_len > 0U )
+    {
+        /* Add padding bit */
+        ctx->queue[ctx->queue_len] = 1U;
+        ctx->queue_len++;
+
+        /* Pad with zeroes */
+        memset( &ctx->queue[ctx->queue_len],
+                0,
+                POLY1305_BLOCK_SIZE_BYTES - ctx->queue_len );
+
+        poly1305_process( ctx, 1U,          /* Process 1 block */
+                          ctx->queue, 0U ); /* Already padded above */
+    }
+
+    poly1305_compute_mac( ctx, mac );
+
+    return( 0 );
+}
+
+int mbedtls_poly1305_mac( const unsigned char key[32],
+                          const unsigned char *input,
+                          size_t ilen,
+                          unsigned char mac[16] )
+{
+    mbedtls_poly1305_context ctx;
+    int ret;
+
+    mbedtls_poly1305_init( &ctx );
+
+    ret = mbedtls_poly1305_starts( &ctx, key );
+    if( ret != 0 )
+        goto cleanup;
+
+    ret = mbedtls_poly1305_update( &ctx, input, ilen );
+    if( ret != 0 )
+        goto cleanup;
+
+    ret = mbedtls_poly1305_finish( &ctx, mac );
+
+cleanup:
+    mbedtls_poly1305_free( &ctx );
+    return( ret );
+}
+
+#if defined(MBEDTLS_SELF_TEST)
+/*
+ * Test vectors from RFC 7539, section 2.5.2 and appendix A.3
+ */
+#define NB_TESTS 2
+
+static const unsigned char test_keys[NB_TESTS][32] =
+{
+    {
+        0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+    },
+    {
+        0x36, 0xe5, 0xf6, 0xb5, 0xc5, 0xe0, 0x60, 0x70,
+        0xf0, 0xef, 0xca, 0x96, 0x22, 0x7a, 0x86, 0x3e,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    }
+};
+
+static const unsigned char test_data[NB_TESTS][375] =
+{
+    {
+        0x43, 0x72, 0x79, 0x70, 0x74, 0x6f, 0x67, 0x72,
+        0x61, 0x70, 0x68, 0x69, 0x63, 0x20, 0x46, 0x6f,
+        0x72, 0x75, 0x6d, 0x20, 0x52, 0x65, 0x73, 0x65,
+        0x61, 0x72, 0x63, 0x68, 0x20, 0x47, 0x72, 0x6f,
+        0x75, 0x70
+    },
+    {
+        0x41, 0x6e, 0x79, 0x20, 0x73, 0x75, 0x62, 0x6d,
+        0x69, 0x73, 0x73, 0x69, 0x6f, 0x6e, 0x20, 0x74,
+        0x6f, 0x20, 0x74, 0x68, 0x65, 0x20, 0x49, 0x45,
+        0x54, 0x46, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x6e,
+        0x64, 0x65, 0x64, 0x20, 0x62, 0x79, 0x20, 0x74,
+        0x68, 0x65, 0x20, 0x43, 0x6f, 0x6e, 0x74, 0x72,
+        0x69, 0x62, 0x75, 0x74, 0x6f, 0x72, 0x20, 0x66,
+        0x6f, 0x72, 0x20, 0x70, 0x75, 0x62, 0x6c, 0x69,
+        0x63, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x61,
+        0x73, 0x20, 0x61, 0x6c, 0x6c, 0x20, 0x6f, 0x72,
+        0x20, 0x70, 0x61, 0x72, 0x74, 0x20, 0x6f, 0x66,
+        0x20, 0x61, 0x6e, 0x20, 0x49, 0x45, 0x54, 0x46,
+        0x20, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x6e, 0x65,
+        0x74, 0x2d, 0x44, 0x72, 0x61, 0x66, 0x74, 0x20,
+        0x6f, 0x72, 0x20, 0x52, 0x46, 0x43, 0x20, 0x61,
+        0x6e, 0x64, 0x20, 0x61, 0x6e, 0x79, 0x20, 0x73,
+        0x74, 0x61, 0x74, 0x65, 0x6d, 0x65, 0x6e, 0x74,
+        0x20, 0x6d, 0x61, 0x64, 0x65, 0x20, 0x77, 0x69,
+        0x74, 0x68, 0x69, 0x6e, 0x20, 0x74, 0x68, 0x65,
+        0x20, 0x63, 0x6f, 0x6e, 0x74, 0x65, 0x78, 0x74,
+        0x20, 0x6f, 0x66, 0x20, 0x61, 0x6e, 0x20, 0x49,
+        0x45, 0x54, 0x46, 0x20, 0x61, 0x63, 0x74, 0x69,
+        0x76, 0x69, 0x74, 0x79, 0x20, 0x69, 0x73, 0x20,
+        0x63, 0x6f, 0x6e, 0x73, 0x69, 0x64, 0x65, 0x72,
+        0x65, 0x64, 0x20, 0x61, 0x6e, 0x20, 0x22, 0x49,
+        0x45, 0x54, 0x46, 0x20, 0x43, 0x6f, 0x6e, 0x74,
+        0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e,
+        0x22, 0x2e, 0x20, 0x53, 0x75, 0x63, 0x68, 0x20,
+        0x73, 0x74, 0x61, 0x74, 0x65, 0x6d, 0x65, 0x6e,
+        0x74, 0x73, 0x20, 0x69, 0x6e, 0x63, 0x6c, 0x75,
+        0x64, 0x65, 0x20, 0x6f, 0x72, 0x61, 0x6c, 0x20,
+        0x73, 0x74, 0x61, 0x74, 0x65, 0x6d, 0x65, 0x6e,
+        0x74, 0x73, 0x20, 0x69, 0x6e, 0x20, 0x49, 0x45,
+        0x54, 0x46, 0x20, 0x73, 0x65, 0x73, 0x73, 0x69,
+        0x6f, 0x6e, 0x73, 0x2c, 0x20, 0x61, 0x73, 0x20,
+        0x77, 0x65, 0x6c, 0x6c, 0x20, 0x61, 0x73, 0x20,
+        0x77, 0x72, 0x69, 0x74, 0x74, 0x65, 0x6e, 0x20,
+        0x61, 0x6e, 0x64, 0x20, 0x65, 0x6c, 0x65, 0x63,
+        0x74, 0x72, 0x6f, 0x6e, 0x69, 0x63, 0x20, 0x63,
+        0x6f, 0x6d, 0x6d, 0x75, 0x6e, 0x69, 0x63, 0x61,
+        0x74, 0x69, 0x6f, 0x6e, 0x73, 0x20, 0x6d, 0x61,
+        0x64, 0x65, 0x20, 0x61, 0x74, 0x20, 0x61, 0x6e,
+        0x79, 0x20, 0x74, 0x69, 0x6d, 0x65, 0x20, 0x6f,
+        0x72, 0x20, 0x70, 0x6c, 0x61, 0x63, 0x65, 0x2c,
+        0x20, 0x77, 0x68, 0x69, 0x63, 0x68, 0x20, 0x61,
+        0x72, 0x65, 0x20, 0x61, 0x64, 0x64, 0x72, 0x65,
+        0x73, 0x73, 0x65, 0x64, 0x20, 0x74, 0x6f
+    }
+};
+
+static const size_t test_data_len[NB_TESTS] =
+{
+    34U,
+    375U
+};
+
+static const unsigned char test_mac[NB_TESTS][16] =
+{
+    {
+        0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+        0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+    },
+    {
+        0xf3, 0x47, 0x7e, 0x7c, 0xd9, 0x54, 0x17, 0xaf,
+        0x89, 0xa6, 0xb8, 0x79, 0x4c, 0x31, 0x0c, 0xf0
+    }
+};
+
+int mbedtls_poly1305_self_test( int verbose )
+{
+    unsigned char mac[16];
+    unsigned i;
+    int ret;
+
+    for( i = 0U; i < NB_TESTS; i++ )
+    {
+        if( verbose != 0 )
+            mbedtls_printf( "  Poly1305 test %u ", i );
+
+        ret = mbedtls_poly1305_mac( test_keys[i],
+                                    test_data[i],
+                                    test_data_len[i],
+                                    mac );
+
+        if( ret != 0 ||
+            memcmp( mac, test_mac[i], 16U ) != 0 )
+        {
+            if( verbose != 0 )
+                mbedtls_printf( "failed\n" );
+
+            return( 1 );
+        }
+
+        if( verbose != 0 )
+            mbedtls_printf( "passed\n" );
+    }
+
+    if( verbose != 0 )
+        mbedtls_printf( "\n" );
+
+    return( 0 );
+}
+
+#endif /* MBEDTLS_SELF_TEST */
+
+#endif /* MBEDTLS_POLY1305_C */
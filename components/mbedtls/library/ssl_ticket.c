@@ -162,6 +162,33 @@ int mbedtls_ssl_ticket_setup( mbedtls_ssl_ticket_context *ctx,
     return( 0 );
 }
 
+/*
+ * Rotate keys on demand
+ */
+int mbedtls_ssl_ticket_rotate( mbedtls_ssl_ticket_context *ctx )
+{
+    int ret;
+
+    if( ctx == NULL || ctx->f_rng == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( ret );
+#endif
+
+    ctx->active = 1 - ctx->active;
+
+    ret = ssl_ticket_gen_key( ctx, ctx->active );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( ret );
+}
+
 /*
  * Serialize a session in the following format:
  *  0   .   n-1     session structure, n = sizeof(mbedtls_ssl_session)
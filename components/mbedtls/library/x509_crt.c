@@ -660,7 +660,7 @@ static int x509_get_crt_ext( unsigned char **p,
  * Parse and fill a single X.509 certificate in DER format
  */
 static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *buf,
-                                    size_t buflen )
+                                    size_t buflen, int make_copy )
 {
     int ret;
     size_t len;
@@ -703,13 +703,22 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *
     }
     crt_end = p + len;
 
-    // Create and populate a new buffer for the raw field
     crt->raw.len = crt_end - buf;
-    crt->raw.p = p = mbedtls_calloc( 1, crt->raw.len );
-    if( p == NULL )
-        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+    if( make_copy != 0 )
+    {
+        // Create and populate a new buffer for the raw field
+        crt->raw.p = p = mbedtls_calloc( 1, crt->raw.len );
+        if( p == NULL )
+            return( MBEDTLS_ERR_X509_ALLOC_FAILED );
 
-    memcpy( p, buf, crt->raw.len );
+        memcpy( p, buf, crt->raw.len );
+        crt->own_buffer = 1;
+    }
+    else
+    {
+        crt->raw.p = p = (unsigned char*) buf;
+        crt->own_buffer = 0;
+    }
 
     // Direct pointers to the new buffer 
     p += crt->raw.len - len;
@@ -914,10 +923,10 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *
 
 /*
  * Parse one X.509 certificate in DER format from a buffer and add them to a
- * chained list
+ * chained list, copying the buffer or not
  */
-int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *buf,
-                        size_t buflen )
+static int x509_crt_parse_der_internal( mbedtls_x509_crt *chain, const unsigned char *buf,
+                                        size_t buflen, int make_copy )
 {
     int ret;
     mbedtls_x509_crt *crt = chain, *prev = NULL;
@@ -949,7 +958,7 @@ int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *bu
         crt = crt->next;
     }
 
-    if( ( ret = x509_crt_parse_der_core( crt, buf, buflen ) ) != 0 )
+    if( ( ret = x509_crt_parse_der_core( crt, buf, buflen, make_copy ) ) != 0 )
     {
         if( prev )
             prev->next = NULL;
@@ -963,6 +972,26 @@ int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *bu
     return( 0 );
 }
 
+/*
+ * Parse one X.509 certificate in DER format from a buffer and add them to a
+ * chained list
+ */
+int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *buf,
+                        size_t buflen )
+{
+    return( x509_crt_parse_der_internal( chain, buf, buflen, 1 ) );
+}
+
+/*
+ * Parse one X.509 certificate in DER format from a buffer, which it keeps
+ * referencing, and add them to a chained list
+ */
+int mbedtls_x509_crt_parse_der_nocopy( mbedtls_x509_crt *chain, const unsigned char *buf,
+                        size_t buflen )
+{
+    return( x509_crt_parse_der_internal( chain, buf, buflen, 0 ) );
+}
+
 /*
  * Parse one or more PEM certificates from a buffer and add them to the chained
  * list
@@ -2361,7 +2390,7 @@ void mbedtls_x509_crt_free( mbedtls_x509_crt *crt )
             mbedtls_free( seq_prv );
         }
 
-        if( cert_cur->raw.p != NULL )
+        if( cert_cur->raw.p != NULL && cert_cur->own_buffer )
         {
             mbedtls_zeroize( cert_cur->raw.p, cert_cur->raw.len );
             mbedtls_free( cert_cur->raw.p );
@@ -0,0 +1,134 @@
+/**
+ * \brief  Software AES for hwcrypto/aes.c, used while the AES unit is busy
+ *
+ *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+ *  Additions Copyright (C) 2016, Espressif Systems (Shanghai) PTE Ltd
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_AES_C) && defined(MBEDTLS_AES_ALT) && defined(MBEDTLS_HARDWARE_FALLBACK)
+
+/* Build the software implementation of library/aes.c under other names,
+   as MBEDTLS_AES_ALT maps the mbedtls_aes_xxx names to the hardware */
+#undef MBEDTLS_AES_ALT
+#undef MBEDTLS_SELF_TEST
+
+#define mbedtls_aes_context         esp_aes_sw_context
+#define mbedtls_aes_init            esp_aes_sw_init
+#define mbedtls_aes_free            esp_aes_sw_free
+#define mbedtls_aes_setkey_enc      esp_aes_sw_setkey_enc
+#define mbedtls_aes_setkey_dec      esp_aes_sw_setkey_dec
+#define mbedtls_aes_crypt_ecb       esp_aes_sw_crypt_ecb
+#define mbedtls_aes_crypt_cbc       esp_aes_sw_crypt_cbc
+#define mbedtls_aes_crypt_cfb128    esp_aes_sw_crypt_cfb128
+#define mbedtls_aes_crypt_cfb8      esp_aes_sw_crypt_cfb8
+#define mbedtls_aes_crypt_ctr       esp_aes_sw_crypt_ctr
+#define mbedtls_aes_encrypt         esp_aes_sw_encrypt
+#define mbedtls_aes_decrypt         esp_aes_sw_decrypt
+
+#include "../library/aes.c"
+
+static int esp_aes_software_setkey( mbedtls_aes_context *ctx, int mode,
+                                    const unsigned char *key, unsigned int keybits )
+{
+    mbedtls_aes_init( ctx );
+    if( mode == MBEDTLS_AES_ENCRYPT )
+        return( mbedtls_aes_setkey_enc( ctx, key, keybits ) );
+    return( mbedtls_aes_setkey_dec( ctx, key, keybits ) );
+}
+
+int esp_aes_software_crypt_ecb_blocks( const unsigned char *key, unsigned int keybits, int mode,
+                                       size_t blocks, const unsigned char *input, unsigned char *output )
+{
+    mbedtls_aes_context ctx;
+    int ret;
+
+    if( ( ret = esp_aes_software_setkey( &ctx, mode, key, keybits ) ) == 0 )
+    {
+        while( blocks-- > 0 )
+        {
+            mbedtls_aes_crypt_ecb( &ctx, mode, input, output );
+            input  += 16;
+            output += 16;
+        }
+    }
+    mbedtls_aes_free( &ctx );
+    return( ret );
+}
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+int esp_aes_software_crypt_cbc( const unsigned char *key, unsigned int keybits, int mode, size_t length,
+                                unsigned char iv[16], const unsigned char *input, unsigned char *output )
+{
+    mbedtls_aes_context ctx;
+    int ret;
+
+    if( ( ret = esp_aes_software_setkey( &ctx, mode, key, keybits ) ) == 0 )
+        ret = mbedtls_aes_crypt_cbc( &ctx, mode, length, iv, input, output );
+    mbedtls_aes_free( &ctx );
+    return( ret );
+}
+#endif /* MBEDTLS_CIPHER_MODE_CBC */
+
+#if defined(MBEDTLS_CIPHER_MODE_CFB)
+int esp_aes_software_crypt_cfb128( const unsigned char *key, unsigned int keybits, int mode, size_t length,
+                                   size_t *iv_off, unsigned char iv[16],
+                                   const unsigned char *input, unsigned char *output )
+{
+    mbedtls_aes_context ctx;
+    int ret;
+
+    /* CFB uses the forward cipher in both directions */
+    if( ( ret = esp_aes_software_setkey( &ctx, MBEDTLS_AES_ENCRYPT, key, keybits ) ) == 0 )
+        ret = mbedtls_aes_crypt_cfb128( &ctx, mode, length, iv_off, iv, input, output );
+    mbedtls_aes_free( &ctx );
+    return( ret );
+}
+
+int esp_aes_software_crypt_cfb8( const unsigned char *key, unsigned int keybits, int mode, size_t length,
+                                 unsigned char iv[16], const unsigned char *input, unsigned char *output )
+{
+    mbedtls_aes_context ctx;
+    int ret;
+
+    if( ( ret = esp_aes_software_setkey( &ctx, MBEDTLS_AES_ENCRYPT, key, keybits ) ) == 0 )
+        ret = mbedtls_aes_crypt_cfb8( &ctx, mode, length, iv, input, output );
+    mbedtls_aes_free( &ctx );
+    return( ret );
+}
+#endif /* MBEDTLS_CIPHER_MODE_CFB */
+
+#if defined(MBEDTLS_CIPHER_MODE_CTR)
+int esp_aes_software_crypt_ctr( const unsigned char *key, unsigned int keybits, size_t length,
+                                size_t *nc_off, unsigned char nonce_counter[16], unsigned char stream_block[16],
+                                const unsigned char *input, unsigned char *output )
+{
+    mbedtls_aes_context ctx;
+    int ret;
+
+    if( ( ret = esp_aes_software_setkey( &ctx, MBEDTLS_AES_ENCRYPT, key, keybits ) ) == 0 )
+        ret = mbedtls_aes_crypt_ctr( &ctx, length, nc_off, nonce_counter, stream_block, input, output );
+    mbedtls_aes_free( &ctx );
+    return( ret );
+}
+#endif /* MBEDTLS_CIPHER_MODE_CTR */
+
+#endif /* MBEDTLS_AES_C && MBEDTLS_AES_ALT && MBEDTLS_HARDWARE_FALLBACK */
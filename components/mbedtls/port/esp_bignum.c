@@ -23,9 +23,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <malloc.h>
+#include <sys/lock.h>
 #include "mbedtls/bignum.h"
 #include "mbedtls/bn_mul.h"
 #include "rom/bigint.h"
+#include "soc/hwcrypto_reg.h"
+#include "hwcrypto/fallback.h"
+#include "esp_pm.h"
 
 #if defined(MBEDTLS_MPI_MUL_MPI_ALT) || defined(MBEDTLS_MPI_EXP_MOD_ALT)
 
@@ -33,25 +37,121 @@
 #define ciL    (sizeof(mbedtls_mpi_uint))         /* chars in limb  */
 #define biL    (ciL << 3)               /* bits  in limb  */
 
+/* The RSA unit works on operands of 512 to 4096 bits, in steps of 512
+   bits. Plain multiplication is limited to a 4096 bit product. The limbs
+   of mbedtls_mpi are 32 bits on the ESP32, the size of the unit's words. */
+#define RSA_BLOCK_WORDS         16
+#define RSA_MAX_WORDS           128
+#define RSA_MAX_MULT_WORDS      64
+
+/* Limbs of the field elements of the largest elliptic curve (521 bits) */
+#define ECP_FIELD_LIMBS         ((521 + biL - 1) / biL)
+
 static _lock_t mpi_lock;
+/* Keeps the CPU at full speed while the unit is locked */
+static esp_pm_lock_t mpi_pm_lock = ESP_PM_LOCK_INITIALIZER(ESP_PM_CPU_FREQ_MAX, "mpi");
+#if defined(MBEDTLS_HARDWARE_KEEP_ENABLED)
+/* Protected by mpi_lock */
+static bool mpi_enabled;
+#endif
 
 /* At the moment these hardware locking functions aren't exposed publically
    for MPI. If you want to use the ROM bigint functions and co-exist with mbedTLS,
    please raise a feature request.
 */
-static void esp_mpi_acquire_hardware( void )
+/* Software multiplication of bignum.c */
+int mbedtls_mpi_mul_mpi_software( mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B );
+
+/* With MBEDTLS_HARDWARE_FALLBACK, returns false instead of waiting if
+   another task uses the unit, and the caller falls back to software */
+static bool esp_mpi_try_acquire_hardware( void )
 {
     /* newlib locks lazy initialize on ESP-IDF */
+#if defined(MBEDTLS_HARDWARE_FALLBACK)
+    if (esp_crypto_software_only(ESP_CRYPTO_MPI) || _lock_try_acquire(&mpi_lock) != 0) {
+        esp_crypto_fallback_count(ESP_CRYPTO_MPI, true);
+        return false;
+    }
+#else
     _lock_acquire(&mpi_lock);
+#endif
+    esp_crypto_fallback_count(ESP_CRYPTO_MPI, false);
+    esp_pm_lock_acquire(&mpi_pm_lock);
+#if defined(MBEDTLS_HARDWARE_KEEP_ENABLED)
+    if (mpi_enabled) {
+        return true;
+    }
+    mpi_enabled = true;
+#endif
     ets_bigint_enable();
+    /* Wait for the unit to clear its memory blocks */
+    while (REG_READ(RSA_CLEAN_REG) != 1) {
+    }
+    return true;
 }
 
 static void esp_mpi_release_hardware( void )
 {
+#if !defined(MBEDTLS_HARDWARE_KEEP_ENABLED)
     ets_bigint_disable();
+#endif
+    esp_pm_lock_release(&mpi_pm_lock);
     _lock_release(&mpi_lock);
 }
 
+/* Number of non-zero limbs of X */
+static size_t mpi_limbs( const mbedtls_mpi *X )
+{
+    size_t n;
+
+    for (n = X->n; n > 0; n--) {
+        if (X->p[n - 1] != 0) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* Operand size of the unit for operands of up to limbs words */
+static size_t hardware_words( size_t limbs )
+{
+    return (limbs + RSA_BLOCK_WORDS - 1) & ~(RSA_BLOCK_WORDS - 1);
+}
+
+/* Copy words to a memory block, zero extended to num_words */
+static void words_to_mem_block( uint32_t mem_base, const mbedtls_mpi_uint *p, size_t n, size_t num_words )
+{
+    size_t i;
+
+    for (i = 0; i < n && i < num_words; i++) {
+        REG_WRITE(mem_base + i * 4, p[i]);
+    }
+    for (; i < num_words; i++) {
+        REG_WRITE(mem_base + i * 4, 0);
+    }
+}
+
+static void mpi_to_mem_block( uint32_t mem_base, const mbedtls_mpi *X, size_t num_words )
+{
+    words_to_mem_block(mem_base, X->p, X->n, num_words);
+}
+
+static void mem_block_to_words( mbedtls_mpi_uint *p, uint32_t mem_base, size_t num_words )
+{
+    for (size_t i = 0; i < num_words; i++) {
+        p[i] = REG_READ(mem_base + i * 4);
+    }
+}
+
+/* Start an operation and wait for it to finish */
+static void esp_mpi_execute( uint32_t start_reg )
+{
+    REG_WRITE(start_reg, 1);
+    while (REG_READ(RSA_INTERRUPT_REG) != 1) {
+    }
+    REG_WRITE(RSA_INTERRUPT_REG, 1);
+}
+
 /*
  * Helper for mbedtls_mpi multiplication
  * copied/trimmed from mbedtls bignum.c
@@ -208,113 +308,57 @@ static int mpi_montred( mbedtls_mpi *A, const mbedtls_mpi *N, mbedtls_mpi_uint m
 }
 
 
-/* Allocate parameters used by hardware MPI multiply,
- and copy mbedtls_mpi structures into them */
-static int mul_pram_alloc(const mbedtls_mpi *A, const mbedtls_mpi *B, char **pA, char **pB, char **pX, size_t *bites)
-{
-    char *sa, *sb, *sx;
-//	int algn;
-	int words, bytes;
-	int abytes, bbytes;
-
-	if (A->n > B->n)
-		words = A->n;
-	else
-		words = B->n;
-
-	bytes = (words / 16 + ((words % 16) ? 1 : 0 )) * 16 * 4 * 2;
-
-	abytes = A->n * 4;	
-	bbytes = B->n * 4;
-
-	sa = malloc(bytes);
-	if (!sa) {
-       return -1;
-	}
-
-	sb = malloc(bytes);
-	if (!sb) {
-	   free(sa);
-       return -1;
-	}
-
-	sx = malloc(bytes);
-	if (!sx) {
-	   free(sa);
-	   free(sb);
-       return -1;
-	}
-
-	memcpy(sa, A->p, abytes);
-	memset(sa + abytes, 0, bytes - abytes);
-
-	memcpy(sb, B->p, bbytes);
-	memset(sb + bbytes, 0, bytes - bbytes);
-
-	*pA = sa;
-	*pB = sb;
-
-	*pX = sx;
-
-	*bites = bytes * 4;
-
-	return 0;
-}
-
 #if defined(MBEDTLS_MPI_MUL_MPI_ALT)
 
+/*
+ * Multiplication X = A * B on the RSA unit, without temporary copies of
+ * the operands: they are loaded into the unit before X is written.
+ */
 int mbedtls_mpi_mul_mpi( mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B )
 {
-    int ret = -1;
-    size_t i, j;
-	char *s1 = NULL, *s2 = NULL, *dest = NULL;
-	size_t bites;
-
-    mbedtls_mpi TA, TB;
-
-    mbedtls_mpi_init( &TA ); mbedtls_mpi_init( &TB );
+    int ret = 0;
+    size_t i = mpi_limbs( A ), j = mpi_limbs( B );
+    size_t num_words = hardware_words( ( i > j ) ? i : j );
+    int s = A->s * B->s;
+
+    /* Single limb factors, as from mbedtls_mpi_mul_int, are quicker in
+       software, and larger operands don't fit the unit */
+    if (i <= 1 || j <= 1 || num_words > RSA_MAX_MULT_WORDS) {
+        return mbedtls_mpi_mul_mpi_software( X, A, B );
+    }
+#if !defined(MBEDTLS_ECP_HARDWARE_MPI)
+    /* Elliptic curve field elements, software unless configured otherwise */
+    if (i <= ECP_FIELD_LIMBS && j <= ECP_FIELD_LIMBS) {
+        return mbedtls_mpi_mul_mpi_software( X, A, B );
+    }
+#endif
 
-    if( X == A ) { MBEDTLS_MPI_CHK( mbedtls_mpi_copy( &TA, A ) ); A = &TA; }
-    if( X == B ) { MBEDTLS_MPI_CHK( mbedtls_mpi_copy( &TB, B ) ); B = &TB; }
+#if defined(MBEDTLS_HARDWARE_FALLBACK)
+    if (!esp_mpi_try_acquire_hardware()) {
+        return mbedtls_mpi_mul_mpi_software( X, A, B );
+    }
+#else
+    esp_mpi_try_acquire_hardware();
+#endif
 
-    for( i = A->n; i > 0; i-- )
-        if( A->p[i - 1] != 0 )
-            break;
+    /* A in the X block, B in the upper half of the Z block */
+    mpi_to_mem_block(RSA_MEM_X_BLOCK_BASE, A, num_words);
+    words_to_mem_block(RSA_MEM_Z_BLOCK_BASE, NULL, 0, num_words);
+    mpi_to_mem_block(RSA_MEM_Z_BLOCK_BASE + num_words * 4, B, num_words);
+    REG_WRITE(RSA_M_DASH_REG, 0);
 
-    for( j = B->n; j > 0; j-- )
-        if( B->p[j - 1] != 0 )
-            break;
+    /* Number of 512 bit blocks of the product, plus 7 */
+    REG_WRITE(RSA_MULT_MODE_REG, (num_words * 2) / RSA_BLOCK_WORDS + 7);
+    esp_mpi_execute(RSA_MULT_START_REG);
 
     MBEDTLS_MPI_CHK( mbedtls_mpi_grow( X, i + j ) );
-    MBEDTLS_MPI_CHK( mbedtls_mpi_lset( X, 0 ) );
-
-	if (mul_pram_alloc(A, B, &s1, &s2, &dest, &bites)) {
-       goto cleanup;
-	}
-
-    esp_mpi_acquire_hardware();
-	if (ets_bigint_mult_prepare((uint32_t *)s1, (uint32_t *)s2, bites)){
-		ets_bigint_wait_finish();
-		if (ets_bigint_mult_getz((uint32_t *)dest, bites) == true) {
-			memcpy(X->p, dest, (i + j) * 4);
-			ret = 0;
-		} else {
-            printf("ets_bigint_mult_getz failed\n");
-		}
-	} else{
-		printf("Baseline multiplication failed\n");
-	}
-    esp_mpi_release_hardware();
-
-    X->s = A->s * B->s;
-
-    free(s1);
-    free(s2);
-    free(dest);
+    mem_block_to_words(X->p, RSA_MEM_Z_BLOCK_BASE, i + j);
+    memset(X->p + i + j, 0, (X->n - i - j) * ciL);
+    X->s = s;
 
 cleanup:
 
-    mbedtls_mpi_free( &TB ); mbedtls_mpi_free( &TA );
+    esp_mpi_release_hardware();
 
     return( ret );
 }
@@ -324,8 +368,10 @@ cleanup:
 #if defined(MBEDTLS_MPI_EXP_MOD_ALT)
 /*
  * Sliding-window exponentiation: X = A^E mod N  (HAC 14.85)
+ *
+ * Software version, for moduli beyond 4096 bits and while the unit is busy
  */
-int mbedtls_mpi_exp_mod( mbedtls_mpi* X, const mbedtls_mpi* A, const mbedtls_mpi* E, const mbedtls_mpi* N, mbedtls_mpi* _RR )
+static int mpi_exp_mod_software( mbedtls_mpi* X, const mbedtls_mpi* A, const mbedtls_mpi* E, const mbedtls_mpi* N, mbedtls_mpi* _RR )
 {
     int ret;
     size_t wbits, wsize, one = 1;
@@ -530,6 +576,199 @@ cleanup:
     return( ret );
 }
 
+/* Bits pos to pos + wsize - 1 of E */
+static size_t mpi_window( const mbedtls_mpi *E, size_t pos, size_t wsize )
+{
+    size_t w = 0;
+
+    while (wsize-- > 0) {
+        w = (w << 1) | mbedtls_mpi_get_bit( E, pos + wsize );
+    }
+    return w;
+}
+
+/*
+ * Montgomery multiplication Z = X * Z * R^-1 mod M on the RSA unit, with
+ * M, M' and the mode loaded, X the contents of the X block and Z those of
+ * the Z block (R is 2 ^ (32 * num_words)).
+ */
+static void esp_mpi_montmul( void )
+{
+    esp_mpi_execute(RSA_MULT_START_REG);
+}
+
+/* Copy the Z block to the X block, for squaring Z */
+static void esp_mpi_z_to_x( size_t num_words )
+{
+    for (size_t i = 0; i < num_words; i++) {
+        REG_WRITE(RSA_MEM_X_BLOCK_BASE + i * 4, REG_READ(RSA_MEM_Z_BLOCK_BASE + i * 4));
+    }
+}
+
+/*
+ * Fixed-window exponentiation: X = A^E mod N
+ *
+ * Every window of the exponent takes wsize squarings and a multiplication
+ * by a table entry, whatever its bits. The operands stay in the RSA unit
+ * from one Montgomery multiplication to the next, in one pass of the unit
+ * for moduli of up to 4096 bits.
+ */
+int mbedtls_mpi_exp_mod( mbedtls_mpi* X, const mbedtls_mpi* A, const mbedtls_mpi* E, const mbedtls_mpi* N, mbedtls_mpi* _RR )
+{
+    int ret = 0;
+    size_t num_words = hardware_words( mpi_limbs( N ) );
+    size_t wsize, bits, pos, i;
+    mbedtls_mpi_uint mm, one = 1;
+    mbedtls_mpi RR, Apos;
+    const mbedtls_mpi *A_in = A;
+    mbedtls_mpi_uint *table = NULL;
+    bool shared_rr;
+    int neg;
+
+    if( mbedtls_mpi_cmp_int( N, 0 ) < 0 || ( N->p[0] & 1 ) == 0 )
+        return( MBEDTLS_ERR_MPI_BAD_INPUT_DATA );
+
+    if( mbedtls_mpi_cmp_int( E, 0 ) < 0 )
+        return( MBEDTLS_ERR_MPI_BAD_INPUT_DATA );
+
+    if (num_words > RSA_MAX_WORDS) {
+        return mpi_exp_mod_software( X, A, E, N, _RR );
+    }
+
+    bits = mbedtls_mpi_bitlen( E );
+    wsize = ( bits > 671 ) ? 6 : ( bits > 239 ) ? 5 :
+            ( bits >  79 ) ? 4 : ( bits >  23 ) ? 3 : 1;
+    if( wsize > MBEDTLS_MPI_WINDOW_SIZE )
+        wsize = MBEDTLS_MPI_WINDOW_SIZE;
+
+    mpi_montg_init( &mm, N );
+    mbedtls_mpi_init( &RR ); mbedtls_mpi_init( &Apos );
+
+    /*
+     * R^2 mod N, with _RR as in bignum.c when R is the same (N->n limbs)
+     */
+    shared_rr = ( _RR != NULL && N->n == num_words );
+    if( shared_rr && _RR->p != NULL )
+        memcpy( &RR, _RR, sizeof( mbedtls_mpi ) );
+    else
+    {
+        MBEDTLS_MPI_CHK( mbedtls_mpi_lset( &RR, 1 ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_shift_l( &RR, num_words * 2 * biL ) );
+        MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &RR, &RR, N ) );
+
+        if( shared_rr )
+            memcpy( _RR, &RR, sizeof( mbedtls_mpi ) );
+    }
+
+    /*
+     * Compensate for negative A (and correct at the end), reduce A mod N
+     */
+    neg = ( A->s == -1 );
+    if( neg || mbedtls_mpi_cmp_mpi( A, N ) >= 0 )
+    {
+        MBEDTLS_MPI_CHK( mbedtls_mpi_copy( &Apos, A ) );
+        Apos.s = 1;
+        if( mbedtls_mpi_cmp_mpi( &Apos, N ) >= 0 )
+            MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &Apos, &Apos, N ) );
+        A = &Apos;
+    }
+
+    MBEDTLS_MPI_CHK( mbedtls_mpi_grow( X, num_words ) );
+
+    table = calloc( (size_t) 1 << wsize, num_words * ciL );
+    if( table == NULL )
+    {
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+        goto cleanup;
+    }
+
+#if defined(MBEDTLS_HARDWARE_FALLBACK)
+    if (!esp_mpi_try_acquire_hardware()) {
+        ret = mpi_exp_mod_software( X, A_in, E, N, shared_rr ? _RR : NULL );
+        goto cleanup;
+    }
+#else
+    esp_mpi_try_acquire_hardware();
+#endif
+
+    mpi_to_mem_block(RSA_MEM_M_BLOCK_BASE, N, num_words);
+    REG_WRITE(RSA_M_DASH_REG, (uint32_t) mm);
+    REG_WRITE(RSA_MULT_MODE_REG, num_words / RSA_BLOCK_WORDS - 1);
+
+    /*
+     * table[0] = R mod N, table[i] = A^i * R mod N
+     */
+    mpi_to_mem_block(RSA_MEM_RB_BLOCK_BASE, &RR, num_words);
+    words_to_mem_block(RSA_MEM_X_BLOCK_BASE, &one, 1, num_words);
+    esp_mpi_montmul();
+    mem_block_to_words(table, RSA_MEM_Z_BLOCK_BASE, num_words);
+
+    mpi_to_mem_block(RSA_MEM_RB_BLOCK_BASE, &RR, num_words);
+    mpi_to_mem_block(RSA_MEM_X_BLOCK_BASE, A, num_words);
+    esp_mpi_montmul();
+    mem_block_to_words(table + num_words, RSA_MEM_Z_BLOCK_BASE, num_words);
+
+    words_to_mem_block(RSA_MEM_X_BLOCK_BASE, table + num_words, num_words, num_words);
+    for (i = 2; i < ((size_t) 1 << wsize); i++) {
+        esp_mpi_montmul();
+        mem_block_to_words(table + i * num_words, RSA_MEM_Z_BLOCK_BASE, num_words);
+    }
+
+    /*
+     * Z = table[top window], then for each further window
+     * Z = Z^(2^wsize) * table[window]
+     */
+    pos = ( ( bits + wsize - 1 ) / wsize ) * wsize;
+    if (pos == 0) {
+        words_to_mem_block(RSA_MEM_Z_BLOCK_BASE, table, num_words, num_words);
+    } else {
+        pos -= wsize;
+        words_to_mem_block(RSA_MEM_Z_BLOCK_BASE, table + mpi_window( E, pos, wsize ) * num_words,
+                           num_words, num_words);
+    }
+    while (pos > 0) {
+        pos -= wsize;
+        for (i = 0; i < wsize; i++) {
+            esp_mpi_z_to_x(num_words);
+            esp_mpi_montmul();
+        }
+        words_to_mem_block(RSA_MEM_X_BLOCK_BASE, table + mpi_window( E, pos, wsize ) * num_words,
+                           num_words, num_words);
+        esp_mpi_montmul();
+    }
+
+    /*
+     * X = A^E * R * R^-1 mod N = A^E mod N
+     */
+    words_to_mem_block(RSA_MEM_X_BLOCK_BASE, &one, 1, num_words);
+    esp_mpi_montmul();
+    mem_block_to_words(X->p, RSA_MEM_Z_BLOCK_BASE, num_words);
+    memset(X->p + num_words, 0, (X->n - num_words) * ciL);
+    X->s = 1;
+
+    esp_mpi_release_hardware();
+
+    if( neg )
+    {
+        X->s = -1;
+        MBEDTLS_MPI_CHK( mbedtls_mpi_add_mpi( X, N, X ) );
+    }
+
+cleanup:
+
+    if( table != NULL )
+    {
+        memset( table, 0, ( (size_t) 1 << wsize ) * num_words * ciL );
+        free( table );
+    }
+    mbedtls_mpi_free( &Apos );
+
+    if( !shared_rr || _RR->p == NULL )
+        mbedtls_mpi_free( &RR );
+
+    return( ret );
+}
+
 #endif /* MBEDTLS_MPI_EXP_MOD_ALT */
 
 #endif /* MBEDTLS_MPI_MUL_MPI_ALT || MBEDTLS_MPI_EXP_MOD_ALT */
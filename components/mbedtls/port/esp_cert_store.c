@@ -0,0 +1,210 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "mbedtls/asn1.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/rsa.h"
+#include "mbedtls/ecp.h"
+
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "esp_entropy.h"
+#include "esp_log.h"
+#include "esp_cert_store.h"
+
+static const char *TAG = "cert_store";
+
+struct esp_cert_store {
+    int refs;
+    size_t count;
+    bool mapped;                    /* chain references the mapped partition */
+    spi_flash_mmap_handle_t mmap;
+    mbedtls_x509_crt chain;
+};
+
+/*
+ * mbedTLS computes some values needed to verify signatures with a public key
+ * the first time they are needed, and stores them in the key: the Montgomery
+ * constant of an RSA modulus, the precomputed multiples of an EC generator.
+ * Compute them now, so verifying against the chain never writes to it and
+ * connections don't need to lock the store.
+ */
+static void esp_cert_store_prewarm(mbedtls_x509_crt *crt)
+{
+#if defined(MBEDTLS_RSA_C)
+    if (mbedtls_pk_can_do(&crt->pk, MBEDTLS_PK_RSA)) {
+        mbedtls_rsa_context *rsa = mbedtls_pk_rsa(crt->pk);
+        unsigned char *buf = calloc(2, rsa->len);
+        if (buf != NULL) {
+            buf[rsa->len - 1] = 1;
+            mbedtls_rsa_public(rsa, buf, buf + rsa->len);
+            free(buf);
+        }
+        return;
+    }
+#endif
+#if defined(MBEDTLS_ECP_C)
+    if (mbedtls_pk_can_do(&crt->pk, MBEDTLS_PK_ECKEY)) {
+        mbedtls_ecp_keypair *ec = mbedtls_pk_ec(crt->pk);
+        mbedtls_ecp_point r;
+        mbedtls_mpi one;
+        mbedtls_ecp_point_init(&r);
+        mbedtls_mpi_init(&one);
+        if (mbedtls_mpi_lset(&one, 1) == 0) {
+            mbedtls_ecp_mul(&ec->grp, &r, &one, &ec->grp.G, esp_entropy_random, NULL);
+        }
+        mbedtls_mpi_free(&one);
+        mbedtls_ecp_point_free(&r);
+    }
+#endif
+}
+
+static esp_cert_store_t *esp_cert_store_alloc(void)
+{
+    esp_cert_store_t *store = calloc(1, sizeof(esp_cert_store_t));
+    if (store == NULL) {
+        return NULL;
+    }
+    store->refs = 1;
+    mbedtls_x509_crt_init(&store->chain);
+    return store;
+}
+
+static void esp_cert_store_free(esp_cert_store_t *store)
+{
+    mbedtls_x509_crt_free(&store->chain);
+    if (store->mapped) {
+        spi_flash_munmap(store->mmap);
+    }
+    free(store);
+}
+
+static void esp_cert_store_finish(esp_cert_store_t *store)
+{
+    for (mbedtls_x509_crt *crt = &store->chain; crt != NULL && crt->version != 0; crt = crt->next) {
+        esp_cert_store_prewarm(crt);
+        ++store->count;
+    }
+}
+
+esp_err_t esp_cert_store_create_pem(const unsigned char *pem, size_t len, esp_cert_store_t **out)
+{
+    if (pem == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_cert_store_t *store = esp_cert_store_alloc();
+    if (store == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    int ret = mbedtls_x509_crt_parse(&store->chain, pem, len);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "can't parse CA certificates: -0x%x", -ret);
+        esp_cert_store_free(store);
+        return ret == MBEDTLS_ERR_X509_ALLOC_FAILED ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_ARG;
+    }
+    if (ret > 0) {
+        ESP_LOGW(TAG, "%d certificate(s) skipped", ret);
+    }
+    esp_cert_store_finish(store);
+    *out = store;
+    return ESP_OK;
+}
+
+esp_err_t esp_cert_store_create_partition(const char *label, esp_cert_store_t **out)
+{
+    if (label == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_cert_store_t *store = esp_cert_store_alloc();
+    if (store == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    const void *ptr;
+    esp_err_t err = esp_partition_mmap(part, 0, part->size, &ptr, &store->mmap);
+    if (err != ESP_OK) {
+        free(store);
+        return err;
+    }
+    store->mapped = true;
+
+    const unsigned char *p = ptr;
+    const unsigned char *end = p + part->size;
+    while (p < end && *p == (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE)) {
+        const unsigned char *next = p + 1;
+        size_t len;
+        if (mbedtls_asn1_get_len((unsigned char **) &next, end, &len) != 0) {
+            ESP_LOGW(TAG, "truncated certificate at offset 0x%x", (int) (p - (const unsigned char *) ptr));
+            break;
+        }
+        next += len;
+        int ret = mbedtls_x509_crt_parse_der_nocopy(&store->chain, p, next - p);
+        if (ret == MBEDTLS_ERR_X509_ALLOC_FAILED) {
+            esp_cert_store_free(store);
+            return ESP_ERR_NO_MEM;
+        }
+        if (ret != 0) {
+            ESP_LOGW(TAG, "skipping certificate at offset 0x%x: -0x%x",
+                     (int) (p - (const unsigned char *) ptr), -ret);
+        }
+        p = next;
+    }
+
+    esp_cert_store_finish(store);
+    if (store->count == 0) {
+        esp_cert_store_free(store);
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGD(TAG, "%d certificate(s) in partition %s", (int) store->count, label);
+    *out = store;
+    return ESP_OK;
+}
+
+esp_cert_store_t *esp_cert_store_ref(esp_cert_store_t *store)
+{
+    __atomic_add_fetch(&store->refs, 1, __ATOMIC_RELAXED);
+    return store;
+}
+
+void esp_cert_store_unref(esp_cert_store_t *store)
+{
+    if (store != NULL && __atomic_sub_fetch(&store->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        esp_cert_store_free(store);
+    }
+}
+
+mbedtls_x509_crt *esp_cert_store_chain(esp_cert_store_t *store)
+{
+    return &store->chain;
+}
+
+size_t esp_cert_store_count(const esp_cert_store_t *store)
+{
+    return store->count;
+}
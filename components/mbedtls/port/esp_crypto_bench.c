@@ -0,0 +1,593 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "mbedtls/aes.h"
+#include "mbedtls/gcm.h"
+#include "mbedtls/chachapoly.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/sha512.h"
+#include "mbedtls/bignum.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/certs.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "xtensa/hal.h"
+
+#include "hwcrypto/fallback.h"
+#include "esp_task.h"
+#include "esp_entropy.h"
+#include "esp_crypto_bench.h"
+
+#if defined(MBEDTLS_SSL_CLI_C) && defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_CERTS_C) && \
+    defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PK_PARSE_C)
+#define BENCH_TLS   1
+#endif
+
+#define BENCH_MAX_MSG           4096
+#define BENCH_PIPE_SIZE         4096
+#define BENCH_DEFAULT_MS        10
+#define BENCH_TLS_MAX_ROUNDS    32
+
+static const unsigned char s_key[16] = "esp32 crypto key";
+
+typedef struct {
+    unsigned char data[BENCH_PIPE_SIZE];
+    size_t len;
+} bench_pipe_t;
+
+typedef struct {
+    bench_pipe_t *tx;
+    bench_pipe_t *rx;
+} bench_bio_t;
+
+typedef struct {
+    uint32_t min_cycles;
+    unsigned char *in;          /* BENCH_MAX_MSG bytes each */
+    unsigned char *out;
+    mbedtls_aes_context aes;
+    mbedtls_gcm_context gcm;
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    mbedtls_chachapoly_context chachapoly;
+#endif
+    mbedtls_mpi A, B, N, X, RR;
+    bool ecc_ready;
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point Q, Q2;
+    mbedtls_mpi d, d2, r, s;
+#if BENCH_TLS
+    bool tls_ready;
+    mbedtls_x509_crt crt;
+    mbedtls_pk_context key;
+    mbedtls_ssl_config cli_conf;
+    mbedtls_ssl_config srv_conf;
+    bench_pipe_t *to_srv;
+    bench_pipe_t *to_cli;
+    bench_bio_t cli_bio;
+    bench_bio_t srv_bio;
+#endif
+} bench_t;
+
+typedef struct {
+    const char *name;
+    uint32_t group;
+    bool per_byte;              /* sizes are message bytes, otherwise key bits */
+    const uint16_t *sizes;
+    size_t count;
+    int (*setup)(bench_t *b, size_t size);
+    int (*run)(bench_t *b, size_t size);
+} bench_test_t;
+
+static const uint16_t s_msg_sizes[] = { 16, 64, 256, 1024, 4096 };
+static const uint16_t s_mul_bits[] = { 256, 512, 1024, 2048, 4096 };
+static const uint16_t s_exp_bits[] = { 1024, 2048 };
+static const uint16_t s_ecc_bits[] = { 256 };
+static const uint16_t s_tls_bits[] = { 2048 };
+
+#define BENCH_SIZES(a)  a, sizeof(a) / sizeof(a[0])
+
+static int bench_aes_setup(bench_t *b, size_t size)
+{
+    return mbedtls_aes_setkey_enc(&b->aes, s_key, 128);
+}
+
+static int bench_aes_ecb(bench_t *b, size_t size)
+{
+    for (size_t off = 0; off < size; off += 16) {
+        int ret = mbedtls_aes_crypt_ecb(&b->aes, MBEDTLS_AES_ENCRYPT, b->in + off, b->out + off);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int bench_aes_cbc(bench_t *b, size_t size)
+{
+    unsigned char iv[16] = { 0 };
+    return mbedtls_aes_crypt_cbc(&b->aes, MBEDTLS_AES_ENCRYPT, size, iv, b->in, b->out);
+}
+
+static int bench_aes_ctr(bench_t *b, size_t size)
+{
+    unsigned char nonce[16] = { 0 };
+    unsigned char stream[16];
+    size_t nc_off = 0;
+    return mbedtls_aes_crypt_ctr(&b->aes, size, &nc_off, nonce, stream, b->in, b->out);
+}
+
+static int bench_gcm_setup(bench_t *b, size_t size)
+{
+    return mbedtls_gcm_setkey(&b->gcm, MBEDTLS_CIPHER_ID_AES, s_key, 128);
+}
+
+static int bench_gcm(bench_t *b, size_t size)
+{
+    unsigned char iv[12] = { 0 };
+    unsigned char tag[16];
+    return mbedtls_gcm_crypt_and_tag(&b->gcm, MBEDTLS_GCM_ENCRYPT, size, iv, sizeof(iv),
+                                     NULL, 0, b->in, b->out, sizeof(tag), tag);
+}
+
+#if defined(MBEDTLS_CHACHAPOLY_C)
+static int bench_chachapoly_setup(bench_t *b, size_t size)
+{
+    static const unsigned char key[32] = "esp32 crypto key, 256 bits long";
+    return mbedtls_chachapoly_setkey(&b->chachapoly, key);
+}
+
+static int bench_chachapoly(bench_t *b, size_t size)
+{
+    unsigned char nonce[12] = { 0 };
+    unsigned char tag[16];
+    return mbedtls_chachapoly_encrypt_and_tag(&b->chachapoly, size, nonce, NULL, 0,
+                                              b->in, b->out, tag);
+}
+#endif
+
+static int bench_sha1(bench_t *b, size_t size)
+{
+    mbedtls_sha1(b->in, size, b->out);
+    return 0;
+}
+
+static int bench_sha256(bench_t *b, size_t size)
+{
+    mbedtls_sha256(b->in, size, b->out, 0);
+    return 0;
+}
+
+static int bench_sha512(bench_t *b, size_t size)
+{
+    mbedtls_sha512(b->in, size, b->out, 0);
+    return 0;
+}
+
+static int bench_mul_setup(bench_t *b, size_t bits)
+{
+    int ret = mbedtls_mpi_fill_random(&b->A, bits / 8, esp_entropy_random, NULL);
+    if (ret == 0) {
+        ret = mbedtls_mpi_fill_random(&b->B, bits / 8, esp_entropy_random, NULL);
+    }
+    return ret;
+}
+
+static int bench_mul(bench_t *b, size_t bits)
+{
+    return mbedtls_mpi_mul_mpi(&b->X, &b->A, &b->B);
+}
+
+/* Odd modulus with the top bit set, base below it and an exponent of the
+ * same size, like an RSA private key operation without CRT */
+static int bench_exp_setup(bench_t *b, size_t bits)
+{
+    int ret;
+
+    mbedtls_mpi_free(&b->RR);
+    mbedtls_mpi_init(&b->RR);
+    if ((ret = mbedtls_mpi_fill_random(&b->N, bits / 8, esp_entropy_random, NULL)) != 0 ||
+            (ret = mbedtls_mpi_set_bit(&b->N, 0, 1)) != 0 ||
+            (ret = mbedtls_mpi_set_bit(&b->N, bits - 1, 1)) != 0 ||
+            (ret = mbedtls_mpi_fill_random(&b->A, bits / 8, esp_entropy_random, NULL)) != 0 ||
+            (ret = mbedtls_mpi_mod_mpi(&b->A, &b->A, &b->N)) != 0 ||
+            (ret = mbedtls_mpi_fill_random(&b->B, bits / 8, esp_entropy_random, NULL)) != 0) {
+        return ret;
+    }
+    return 0;
+}
+
+static int bench_exp(bench_t *b, size_t bits)
+{
+    return mbedtls_mpi_exp_mod(&b->X, &b->A, &b->B, &b->N, &b->RR);
+}
+
+static int bench_ecc_setup(bench_t *b, size_t bits)
+{
+    int ret;
+
+    if (b->ecc_ready) {
+        return 0;
+    }
+    memset(b->in, 0x5a, 32);    /* message hash */
+    if ((ret = mbedtls_ecp_group_load(&b->grp, MBEDTLS_ECP_DP_SECP256R1)) != 0 ||
+            (ret = mbedtls_ecp_gen_keypair(&b->grp, &b->d, &b->Q, esp_entropy_random, NULL)) != 0 ||
+            (ret = mbedtls_ecdsa_sign(&b->grp, &b->r, &b->s, &b->d, b->in, 32, esp_entropy_random, NULL)) != 0) {
+        return ret;
+    }
+    b->ecc_ready = true;
+    return 0;
+}
+
+static int bench_ecdsa_sign(bench_t *b, size_t bits)
+{
+    return mbedtls_ecdsa_sign(&b->grp, &b->A, &b->B, &b->d, b->in, 32, esp_entropy_random, NULL);
+}
+
+static int bench_ecdsa_verify(bench_t *b, size_t bits)
+{
+    return mbedtls_ecdsa_verify(&b->grp, b->in, 32, &b->Q, &b->r, &b->s);
+}
+
+/* One side of an exchange: new key pair, then the shared secret */
+static int bench_ecdh(bench_t *b, size_t bits)
+{
+    int ret = mbedtls_ecdh_gen_public(&b->grp, &b->d2, &b->Q2, esp_entropy_random, NULL);
+    if (ret == 0) {
+        ret = mbedtls_ecdh_compute_shared(&b->grp, &b->X, &b->Q, &b->d2, esp_entropy_random, NULL);
+    }
+    return ret;
+}
+
+#if BENCH_TLS
+
+static int bench_pipe_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    bench_pipe_t *p = ((bench_bio_t *) ctx)->tx;
+    size_t n = BENCH_PIPE_SIZE - p->len;
+
+    if (n == 0) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+    if (n > len) {
+        n = len;
+    }
+    memcpy(p->data + p->len, buf, n);
+    p->len += n;
+    return n;
+}
+
+static int bench_pipe_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    bench_pipe_t *p = ((bench_bio_t *) ctx)->rx;
+    size_t n = p->len;
+
+    if (n == 0) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    if (n > len) {
+        n = len;
+    }
+    memcpy(buf, p->data, n);
+    memmove(p->data, p->data + n, p->len - n);
+    p->len -= n;
+    return n;
+}
+
+static int bench_tls_setup(bench_t *b, size_t bits)
+{
+    int ret;
+
+    if (b->tls_ready) {
+        return 0;
+    }
+    b->to_srv = calloc(1, sizeof(bench_pipe_t));
+    b->to_cli = calloc(1, sizeof(bench_pipe_t));
+    if (b->to_srv == NULL || b->to_cli == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    b->cli_bio.tx = b->to_srv;
+    b->cli_bio.rx = b->to_cli;
+    b->srv_bio.tx = b->to_cli;
+    b->srv_bio.rx = b->to_srv;
+    if ((ret = mbedtls_x509_crt_parse(&b->crt, (const unsigned char *) mbedtls_test_srv_crt,
+                                      mbedtls_test_srv_crt_len)) != 0 ||
+            (ret = mbedtls_pk_parse_key(&b->key, (const unsigned char *) mbedtls_test_srv_key,
+                                        mbedtls_test_srv_key_len, NULL, 0)) != 0 ||
+            (ret = mbedtls_ssl_config_defaults(&b->cli_conf, MBEDTLS_SSL_IS_CLIENT,
+                    MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0 ||
+            (ret = mbedtls_ssl_config_defaults(&b->srv_conf, MBEDTLS_SSL_IS_SERVER,
+                    MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0 ||
+            (ret = mbedtls_ssl_conf_own_cert(&b->srv_conf, &b->crt, &b->key)) != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_rng(&b->cli_conf, esp_entropy_random, NULL);
+    mbedtls_ssl_conf_rng(&b->srv_conf, esp_entropy_random, NULL);
+    mbedtls_ssl_conf_authmode(&b->cli_conf, MBEDTLS_SSL_VERIFY_NONE);
+    b->tls_ready = true;
+    return 0;
+}
+
+static bool bench_tls_pending(int ret)
+{
+    return ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+/* Full handshake, client and server side, with the default cipher suites */
+static int bench_tls(bench_t *b, size_t bits)
+{
+    mbedtls_ssl_context cli, srv;
+    int ret;
+
+    mbedtls_ssl_init(&cli);
+    mbedtls_ssl_init(&srv);
+    b->to_srv->len = 0;
+    b->to_cli->len = 0;
+    if ((ret = mbedtls_ssl_setup(&cli, &b->cli_conf)) != 0 ||
+            (ret = mbedtls_ssl_setup(&srv, &b->srv_conf)) != 0) {
+        goto out;
+    }
+    mbedtls_ssl_set_bio(&cli, &b->cli_bio, bench_pipe_send, bench_pipe_recv, NULL);
+    mbedtls_ssl_set_bio(&srv, &b->srv_bio, bench_pipe_send, bench_pipe_recv, NULL);
+
+    ret = MBEDTLS_ERR_SSL_WANT_READ;
+    for (int round = 0; round < BENCH_TLS_MAX_ROUNDS && bench_tls_pending(ret); round++) {
+        int rc = mbedtls_ssl_handshake(&cli);
+        int rs = mbedtls_ssl_handshake(&srv);
+        if (rc != 0 && !bench_tls_pending(rc)) {
+            ret = rc;
+        } else if (rs != 0 && !bench_tls_pending(rs)) {
+            ret = rs;
+        } else {
+            ret = (rc != 0) ? rc : rs;
+        }
+    }
+    if (bench_tls_pending(ret)) {
+        ret = MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+out:
+    mbedtls_ssl_free(&cli);
+    mbedtls_ssl_free(&srv);
+    return ret;
+}
+
+#endif // BENCH_TLS
+
+static const bench_test_t s_tests[] = {
+    { "aes128-ecb", ESP_CRYPTO_BENCH_AES, true, BENCH_SIZES(s_msg_sizes), bench_aes_setup, bench_aes_ecb },
+    { "aes128-cbc", ESP_CRYPTO_BENCH_AES, true, BENCH_SIZES(s_msg_sizes), bench_aes_setup, bench_aes_cbc },
+    { "aes128-ctr", ESP_CRYPTO_BENCH_AES, true, BENCH_SIZES(s_msg_sizes), bench_aes_setup, bench_aes_ctr },
+    { "aes128-gcm", ESP_CRYPTO_BENCH_AES, true, BENCH_SIZES(s_msg_sizes), bench_gcm_setup, bench_gcm },
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    { "chacha20-poly", ESP_CRYPTO_BENCH_AES, true, BENCH_SIZES(s_msg_sizes), bench_chachapoly_setup, bench_chachapoly },
+#endif
+    { "sha1", ESP_CRYPTO_BENCH_SHA, true, BENCH_SIZES(s_msg_sizes), NULL, bench_sha1 },
+    { "sha256", ESP_CRYPTO_BENCH_SHA, true, BENCH_SIZES(s_msg_sizes), NULL, bench_sha256 },
+    { "sha512", ESP_CRYPTO_BENCH_SHA, true, BENCH_SIZES(s_msg_sizes), NULL, bench_sha512 },
+    { "mpi-mul", ESP_CRYPTO_BENCH_MPI, false, BENCH_SIZES(s_mul_bits), bench_mul_setup, bench_mul },
+    { "mpi-exp-mod", ESP_CRYPTO_BENCH_MPI, false, BENCH_SIZES(s_exp_bits), bench_exp_setup, bench_exp },
+    { "ecdsa-sign", ESP_CRYPTO_BENCH_ECC, false, BENCH_SIZES(s_ecc_bits), bench_ecc_setup, bench_ecdsa_sign },
+    { "ecdsa-verify", ESP_CRYPTO_BENCH_ECC, false, BENCH_SIZES(s_ecc_bits), bench_ecc_setup, bench_ecdsa_verify },
+    { "ecdh", ESP_CRYPTO_BENCH_ECC, false, BENCH_SIZES(s_ecc_bits), bench_ecc_setup, bench_ecdh },
+#if BENCH_TLS
+    { "tls-handshake", ESP_CRYPTO_BENCH_TLS, false, BENCH_SIZES(s_tls_bits), bench_tls_setup, bench_tls },
+#endif
+};
+
+static void bench_software_only(bool software_only)
+{
+    esp_crypto_set_software_only(ESP_CRYPTO_AES, software_only);
+    esp_crypto_set_software_only(ESP_CRYPTO_SHA, software_only);
+    esp_crypto_set_software_only(ESP_CRYPTO_MPI, software_only);
+}
+
+/* Repeat the operation for at least min_cycles, returns the cycles and the
+ * number of runs */
+static int bench_measure(bench_t *b, const bench_test_t *t, size_t size, uint64_t *cycles, uint32_t *runs)
+{
+    *cycles = 0;
+    *runs = 0;
+    do {
+        uint32_t start = xthal_get_ccount();
+        int ret = t->run(b, size);
+        *cycles += (uint32_t) (xthal_get_ccount() - start);
+        if (ret != 0) {
+            return ret;
+        }
+        ++*runs;
+    } while (*cycles < b->min_cycles);
+    return 0;
+}
+
+static void bench_format(char *buf, size_t len, const bench_test_t *t, size_t size, uint64_t cycles, uint32_t runs)
+{
+    if (t->per_byte) {
+        uint32_t tenths = (uint32_t) (cycles * 10 / ((uint64_t) runs * size));
+        snprintf(buf, len, "%u.%u c/B", tenths / 10, tenths % 10);
+    } else {
+        snprintf(buf, len, "%u kc", (uint32_t) (cycles / ((uint64_t) runs * 1000)));
+    }
+}
+
+static esp_err_t bench_test(bench_t *b, const bench_test_t *t)
+{
+    char hw[16], sw[16];
+    uint64_t cycles;
+    uint32_t runs;
+    int ret;
+
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+    bool has_software = true;
+#else
+    bool has_software = t->group == ESP_CRYPTO_BENCH_SHA;
+#endif
+
+    for (size_t i = 0; i < t->count; i++) {
+        size_t size = t->sizes[i];
+        if (t->setup != NULL && (ret = t->setup(b, size)) != 0) {
+            goto fail;
+        }
+        if ((ret = bench_measure(b, t, size, &cycles, &runs)) != 0) {
+            goto fail;
+        }
+        bench_format(hw, sizeof(hw), t, size, cycles, runs);
+        strcpy(sw, "-");
+        if (has_software) {
+            bench_software_only(true);
+            ret = bench_measure(b, t, size, &cycles, &runs);
+            bench_software_only(false);
+            if (ret != 0) {
+                goto fail;
+            }
+            bench_format(sw, sizeof(sw), t, size, cycles, runs);
+        }
+        printf("%-14s %6u %14s %14s\n", t->name, (unsigned) size, hw, sw);
+    }
+    return ESP_OK;
+
+fail:
+    printf("%-14s failed: -0x%x\n", t->name, -ret);
+    return (ret == MBEDTLS_ERR_MPI_ALLOC_FAILED || ret == MBEDTLS_ERR_ECP_ALLOC_FAILED ||
+            ret == MBEDTLS_ERR_SSL_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_FAIL;
+}
+
+static esp_err_t bench_run_all(const esp_crypto_bench_cfg_t *cfg)
+{
+    esp_err_t err = ESP_OK;
+    uint32_t tests = (cfg != NULL && cfg->tests != 0) ? cfg->tests : ESP_CRYPTO_BENCH_ALL;
+
+    bench_t *b = calloc(1, sizeof(bench_t));
+    if (b == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    b->min_cycles = (cfg != NULL && cfg->min_cycles != 0) ? cfg->min_cycles :
+                    BENCH_DEFAULT_MS * 1000 * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    b->in = malloc(BENCH_MAX_MSG);
+    b->out = malloc(BENCH_MAX_MSG);
+    mbedtls_aes_init(&b->aes);
+    mbedtls_gcm_init(&b->gcm);
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    mbedtls_chachapoly_init(&b->chachapoly);
+#endif
+    mbedtls_mpi_init(&b->A);
+    mbedtls_mpi_init(&b->B);
+    mbedtls_mpi_init(&b->N);
+    mbedtls_mpi_init(&b->X);
+    mbedtls_mpi_init(&b->RR);
+    mbedtls_ecp_group_init(&b->grp);
+    mbedtls_ecp_point_init(&b->Q);
+    mbedtls_ecp_point_init(&b->Q2);
+    mbedtls_mpi_init(&b->d);
+    mbedtls_mpi_init(&b->d2);
+    mbedtls_mpi_init(&b->r);
+    mbedtls_mpi_init(&b->s);
+#if BENCH_TLS
+    mbedtls_x509_crt_init(&b->crt);
+    mbedtls_pk_init(&b->key);
+    mbedtls_ssl_config_init(&b->cli_conf);
+    mbedtls_ssl_config_init(&b->srv_conf);
+#endif
+    if (b->in == NULL || b->out == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    esp_entropy_random(NULL, b->in, BENCH_MAX_MSG);
+
+    printf("%-14s %6s %14s %14s\n", "test", "size", "hardware", "software");
+    for (size_t i = 0; i < sizeof(s_tests) / sizeof(s_tests[0]) && err == ESP_OK; i++) {
+        if (s_tests[i].group & tests) {
+            err = bench_test(b, &s_tests[i]);
+        }
+    }
+
+out:
+    mbedtls_aes_free(&b->aes);
+    mbedtls_gcm_free(&b->gcm);
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    mbedtls_chachapoly_free(&b->chachapoly);
+#endif
+    mbedtls_mpi_free(&b->A);
+    mbedtls_mpi_free(&b->B);
+    mbedtls_mpi_free(&b->N);
+    mbedtls_mpi_free(&b->X);
+    mbedtls_mpi_free(&b->RR);
+    mbedtls_ecp_group_free(&b->grp);
+    mbedtls_ecp_point_free(&b->Q);
+    mbedtls_ecp_point_free(&b->Q2);
+    mbedtls_mpi_free(&b->d);
+    mbedtls_mpi_free(&b->d2);
+    mbedtls_mpi_free(&b->r);
+    mbedtls_mpi_free(&b->s);
+#if BENCH_TLS
+    mbedtls_x509_crt_free(&b->crt);
+    mbedtls_pk_free(&b->key);
+    mbedtls_ssl_config_free(&b->cli_conf);
+    mbedtls_ssl_config_free(&b->srv_conf);
+    free(b->to_srv);
+    free(b->to_cli);
+#endif
+    free(b->in);
+    free(b->out);
+    free(b);
+    return err;
+}
+
+typedef struct {
+    const esp_crypto_bench_cfg_t *cfg;
+    esp_err_t err;
+    SemaphoreHandle_t done;
+} bench_job_t;
+
+/* CCOUNT is per CPU, so measure in a task which stays on one */
+static void bench_task(void *arg)
+{
+    bench_job_t *job = (bench_job_t *) arg;
+
+    job->err = bench_run_all(job->cfg);
+    xSemaphoreGive(job->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_crypto_bench_run(const esp_crypto_bench_cfg_t *cfg)
+{
+    bench_job_t job = { .cfg = cfg, .err = ESP_OK };
+
+    job.done = xSemaphoreCreateBinary();
+    if (job.done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(bench_task, "crypto_bench", ESP_TASK_CRYPTO_BENCH_STACK, &job,
+                                uxTaskPriorityGet(NULL), NULL, xPortGetCoreID()) != pdPASS) {
+        vSemaphoreDelete(job.done);
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(job.done, portMAX_DELAY);
+    vSemaphoreDelete(job.done);
+    return job.err;
+}
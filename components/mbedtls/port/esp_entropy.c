@@ -0,0 +1,197 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "sdkconfig.h"
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_task.h"
+#include "esp_entropy.h"
+
+static const char *TAG = "esp_entropy";
+
+extern int os_get_random(unsigned char *buf, size_t len);
+
+/* Bytes added to the pool per tick, so that the RNG has time to produce
+ * new bits between reads */
+#define ESP_ENTROPY_FILL_CHUNK      32
+
+/* mbedTLS reseeds by itself, in the caller, only if the entropy task falls
+ * this many intervals behind */
+#define ESP_ENTROPY_BACKSTOP        4
+
+static const unsigned char s_personalization[] = "esp_entropy";
+
+static unsigned char s_pool[CONFIG_MBEDTLS_ENTROPY_POOL_SIZE];
+static size_t s_pool_len;
+static portMUX_TYPE s_pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static mbedtls_entropy_context s_entropy;
+static mbedtls_ctr_drbg_context s_drbg;
+static uint32_t s_drbg_requests;            /* since the last reseed */
+static bool s_drbg_seeded;
+static SemaphoreHandle_t s_drbg_lock;
+static portMUX_TYPE s_drbg_lock_init_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_task;
+
+size_t esp_entropy_pool_read(unsigned char *output, size_t len)
+{
+    portENTER_CRITICAL(&s_pool_mux);
+    if (len > s_pool_len) {
+        len = s_pool_len;
+    }
+    s_pool_len -= len;
+    memcpy(output, &s_pool[s_pool_len], len);
+    memset(&s_pool[s_pool_len], 0, len);
+    portEXIT_CRITICAL(&s_pool_mux);
+    return len;
+}
+
+/* Add a chunk to the pool, returns true once it is full */
+static bool esp_entropy_pool_fill(void)
+{
+    unsigned char chunk[ESP_ENTROPY_FILL_CHUNK];
+
+    os_get_random(chunk, sizeof(chunk));
+    portENTER_CRITICAL(&s_pool_mux);
+    size_t n = sizeof(s_pool) - s_pool_len;
+    if (n > sizeof(chunk)) {
+        n = sizeof(chunk);
+    }
+    memcpy(&s_pool[s_pool_len], chunk, n);
+    s_pool_len += n;
+    bool full = s_pool_len == sizeof(s_pool);
+    portEXIT_CRITICAL(&s_pool_mux);
+    memset(chunk, 0, sizeof(chunk));
+    return full;
+}
+
+static bool esp_entropy_lock(void)
+{
+    if (s_drbg_lock == NULL) {
+        SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+        if (lock == NULL) {
+            return false;
+        }
+        taskENTER_CRITICAL(&s_drbg_lock_init_mux);
+        if (s_drbg_lock == NULL) {
+            s_drbg_lock = lock;
+            lock = NULL;
+        }
+        taskEXIT_CRITICAL(&s_drbg_lock_init_mux);
+        if (lock != NULL) {
+            vSemaphoreDelete(lock);
+        }
+    }
+    xSemaphoreTake(s_drbg_lock, portMAX_DELAY);
+    return true;
+}
+
+static void esp_entropy_unlock(void)
+{
+    xSemaphoreGive(s_drbg_lock);
+}
+
+static void esp_entropy_task(void *arg)
+{
+    for (;;) {
+        /* Refill the pool a chunk per tick, then sleep until a reseed is due */
+        bool full = esp_entropy_pool_fill();
+        if (ulTaskNotifyTake(pdTRUE, full ? portMAX_DELAY : 1) == 0) {
+            continue;
+        }
+        esp_entropy_lock();
+        int ret = mbedtls_ctr_drbg_reseed(&s_drbg, NULL, 0);
+        if (ret == 0) {
+            s_drbg_requests = 0;
+        }
+        esp_entropy_unlock();
+        if (ret != 0) {
+            ESP_LOGW(TAG, "reseed failed: -0x%x", -ret);
+        }
+    }
+}
+
+/* Called with the lock held */
+static esp_err_t esp_entropy_seed(void)
+{
+    if (s_drbg_seeded) {
+        return ESP_OK;
+    }
+    mbedtls_entropy_init(&s_entropy);
+    mbedtls_ctr_drbg_init(&s_drbg);
+    int ret = mbedtls_ctr_drbg_seed(&s_drbg, mbedtls_entropy_func, &s_entropy,
+                                    s_personalization, sizeof(s_personalization));
+    if (ret != 0) {
+        ESP_LOGE(TAG, "DRBG seeding failed: -0x%x", -ret);
+        mbedtls_ctr_drbg_free(&s_drbg);
+        mbedtls_entropy_free(&s_entropy);
+        return ESP_FAIL;
+    }
+    mbedtls_ctr_drbg_set_reseed_interval(&s_drbg, CONFIG_MBEDTLS_DRBG_RESEED_INTERVAL * ESP_ENTROPY_BACKSTOP);
+    if (xTaskCreatePinnedToCore(esp_entropy_task, "entropy", ESP_TASKD_ENTROPY_STACK, NULL,
+                                ESP_TASKD_ENTROPY_PRIO, &s_task, ESP_TASK_PROTOCOL_CORE) != pdPASS) {
+        mbedtls_ctr_drbg_free(&s_drbg);
+        mbedtls_entropy_free(&s_entropy);
+        return ESP_ERR_NO_MEM;
+    }
+    s_drbg_seeded = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_entropy_init(void)
+{
+    if (!esp_entropy_lock()) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = esp_entropy_seed();
+    esp_entropy_unlock();
+    return err;
+}
+
+int esp_entropy_random(void *ctx, unsigned char *output, size_t len)
+{
+    int ret = 0;
+
+    if (!esp_entropy_lock()) {
+        return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+    }
+    if (esp_entropy_seed() != ESP_OK) {
+        esp_entropy_unlock();
+        return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+    }
+    while (len > 0 && ret == 0) {
+        size_t n = (len > MBEDTLS_CTR_DRBG_MAX_REQUEST) ? MBEDTLS_CTR_DRBG_MAX_REQUEST : len;
+        ret = mbedtls_ctr_drbg_random(&s_drbg, output, n);
+        output += n;
+        len -= n;
+        if (++s_drbg_requests >= CONFIG_MBEDTLS_DRBG_RESEED_INTERVAL) {
+            xTaskNotifyGive(s_task);
+        }
+    }
+    esp_entropy_unlock();
+    return ret;
+}
@@ -10,11 +10,17 @@
 
 #if defined(MBEDTLS_ENTROPY_HARDWARE_ALT)
 
+#include "esp_entropy.h"
+
 extern int os_get_random(unsigned char *buf, size_t len);
 int mbedtls_hardware_poll( void *data,
                            unsigned char *output, size_t len, size_t *olen )
 {
-    os_get_random(output, len);
+    /* Collected ahead of time by the entropy task, if it runs */
+    size_t n = esp_entropy_pool_read(output, len);
+    if (n < len) {
+        os_get_random(output + n, len - n);
+    }
     *olen = len;
 
     return 0;
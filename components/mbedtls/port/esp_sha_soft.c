@@ -0,0 +1,253 @@
+/**
+ * \brief  Software SHA for hwcrypto/sha.c, used for SHA-224, for
+ *         clones of hardware contexts and while a SHA engine is busy
+ *
+ *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+ *  Additions Copyright (C) 2016, Espressif Systems (Shanghai) PTE Ltd
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_SHA1_C) && defined(MBEDTLS_SHA256_C) && defined(MBEDTLS_SHA512_C)
+
+#include <stdlib.h>
+#include <string.h>
+#include "rom/sha.h"
+
+/* MBEDTLS_SHAx_ALT maps the mbedtls_shaX_xxx names to the hardware, build
+   the software implementations of library/shaX.c under other names then */
+#undef MBEDTLS_SELF_TEST
+
+#if defined(MBEDTLS_SHA1_ALT)
+#undef MBEDTLS_SHA1_ALT
+#define mbedtls_sha1_context        esp_sha1_sw_context
+#define mbedtls_sha1_init           esp_sha1_sw_init
+#define mbedtls_sha1_free           esp_sha1_sw_free
+#define mbedtls_sha1_clone          esp_sha1_sw_clone
+#define mbedtls_sha1_starts         esp_sha1_sw_starts
+#define mbedtls_sha1_update         esp_sha1_sw_update
+#define mbedtls_sha1_finish         esp_sha1_sw_finish
+#define mbedtls_sha1_process        esp_sha1_sw_process
+#define mbedtls_sha1                esp_sha1_sw
+#define mbedtls_zeroize             esp_sha1_sw_zeroize
+#include "../library/sha1.c"
+#undef mbedtls_zeroize
+#undef S
+#undef R
+#undef P
+#else
+#include "mbedtls/sha1.h"
+#endif
+
+#if defined(MBEDTLS_SHA256_ALT)
+#undef MBEDTLS_SHA256_ALT
+#define mbedtls_sha256_context      esp_sha256_sw_context
+#define mbedtls_sha256_init         esp_sha256_sw_init
+#define mbedtls_sha256_free         esp_sha256_sw_free
+#define mbedtls_sha256_clone        esp_sha256_sw_clone
+#define mbedtls_sha256_starts       esp_sha256_sw_starts
+#define mbedtls_sha256_update       esp_sha256_sw_update
+#define mbedtls_sha256_finish       esp_sha256_sw_finish
+#define mbedtls_sha256_process      esp_sha256_sw_process
+#define mbedtls_sha256              esp_sha256_sw
+#define mbedtls_zeroize             esp_sha256_sw_zeroize
+#define K                           esp_sha256_sw_K
+#include "../library/sha256.c"
+#undef mbedtls_zeroize
+#undef K
+#undef SHR
+#undef ROTR
+#undef S0
+#undef S1
+#undef S2
+#undef S3
+#undef F0
+#undef F1
+#undef R
+#undef P
+#else
+#include "mbedtls/sha256.h"
+#endif
+
+#if defined(MBEDTLS_SHA512_ALT)
+#undef MBEDTLS_SHA512_ALT
+#define mbedtls_sha512_context      esp_sha512_sw_context
+#define mbedtls_sha512_init         esp_sha512_sw_init
+#define mbedtls_sha512_free         esp_sha512_sw_free
+#define mbedtls_sha512_clone        esp_sha512_sw_clone
+#define mbedtls_sha512_starts       esp_sha512_sw_starts
+#define mbedtls_sha512_update       esp_sha512_sw_update
+#define mbedtls_sha512_finish       esp_sha512_sw_finish
+#define mbedtls_sha512_process      esp_sha512_sw_process
+#define mbedtls_sha512              esp_sha512_sw
+#define mbedtls_zeroize             esp_sha512_sw_zeroize
+#define K                           esp_sha512_sw_K
+#include "../library/sha512.c"
+#undef mbedtls_zeroize
+#undef K
+#else
+#include "mbedtls/sha512.h"
+#endif
+
+void *esp_sha_software_start( enum SHA_TYPE type, int is224 )
+{
+    void *ctx;
+
+    switch( type )
+    {
+    case SHA1:
+        if( ( ctx = malloc( sizeof( mbedtls_sha1_context ) ) ) != NULL )
+        {
+            mbedtls_sha1_init( ctx );
+            mbedtls_sha1_starts( ctx );
+        }
+        return( ctx );
+    case SHA2_256:
+        if( ( ctx = malloc( sizeof( mbedtls_sha256_context ) ) ) != NULL )
+        {
+            mbedtls_sha256_init( ctx );
+            mbedtls_sha256_starts( ctx, is224 );
+        }
+        return( ctx );
+    case SHA2_384:
+    case SHA2_512:
+        if( ( ctx = malloc( sizeof( mbedtls_sha512_context ) ) ) != NULL )
+        {
+            mbedtls_sha512_init( ctx );
+            mbedtls_sha512_starts( ctx, type == SHA2_384 );
+        }
+        return( ctx );
+    default:
+        return( NULL );
+    }
+}
+
+void esp_sha_software_update( void *ctx, enum SHA_TYPE type, const unsigned char *input, size_t ilen )
+{
+    if( type == SHA1 )
+        mbedtls_sha1_update( ctx, input, ilen );
+    else if( type == SHA2_256 )
+        mbedtls_sha256_update( ctx, input, ilen );
+    else
+        mbedtls_sha512_update( ctx, input, ilen );
+}
+
+#ifndef GET_UINT32_BE
+#define GET_UINT32_BE(n,b,i)                            \
+{                                                       \
+    (n) = ( (uint32_t) (b)[(i)    ] << 24 )             \
+        | ( (uint32_t) (b)[(i) + 1] << 16 )             \
+        | ( (uint32_t) (b)[(i) + 2] <<  8 )             \
+        | ( (uint32_t) (b)[(i) + 3]       );            \
+}
+#endif
+
+#ifndef GET_UINT64_BE
+#define GET_UINT64_BE(n,b,i)                            \
+{                                                       \
+    (n) = ( (uint64_t) (b)[(i)    ] << 56 )       \
+        | ( (uint64_t) (b)[(i) + 1] << 48 )       \
+        | ( (uint64_t) (b)[(i) + 2] << 40 )       \
+        | ( (uint64_t) (b)[(i) + 3] << 32 )       \
+        | ( (uint64_t) (b)[(i) + 4] << 24 )       \
+        | ( (uint64_t) (b)[(i) + 5] << 16 )       \
+        | ( (uint64_t) (b)[(i) + 6] <<  8 )       \
+        | ( (uint64_t) (b)[(i) + 7]       );      \
+}
+#endif
+
+/*
+ * Continue a hash of the hardware in software: state is the digest state
+ * read from the SHA engine (big endian, 8 words for SHA-384), processed
+ * the number of bytes it covers and input the bytes of the partial block.
+ */
+void *esp_sha_software_resume( enum SHA_TYPE type, const unsigned char *state, uint64_t processed,
+                               const unsigned char *input, size_t ilen )
+{
+    void *ctx = esp_sha_software_start( type, 0 );
+    int i;
+
+    if( ctx == NULL )
+        return( NULL );
+
+    if( type == SHA1 )
+    {
+        mbedtls_sha1_context *sha1 = ctx;
+        for( i = 0; i < 5; i++ )
+            GET_UINT32_BE( sha1->state[i], state, 4 * i );
+        sha1->total[0] = (uint32_t) processed;
+        sha1->total[1] = (uint32_t) ( processed >> 32 );
+    }
+    else if( type == SHA2_256 )
+    {
+        mbedtls_sha256_context *sha256 = ctx;
+        for( i = 0; i < 8; i++ )
+            GET_UINT32_BE( sha256->state[i], state, 4 * i );
+        sha256->total[0] = (uint32_t) processed;
+        sha256->total[1] = (uint32_t) ( processed >> 32 );
+    }
+    else
+    {
+        mbedtls_sha512_context *sha512 = ctx;
+        for( i = 0; i < 8; i++ )
+            GET_UINT64_BE( sha512->state[i], state, 8 * i );
+        sha512->total[0] = processed;
+        sha512->total[1] = 0;
+    }
+
+    esp_sha_software_update( ctx, type, input, ilen );
+    return( ctx );
+}
+
+void esp_sha_software_free( void *ctx, enum SHA_TYPE type )
+{
+    if( type == SHA1 )
+        mbedtls_sha1_free( ctx );
+    else if( type == SHA2_256 )
+        mbedtls_sha256_free( ctx );
+    else
+        mbedtls_sha512_free( ctx );
+    free( ctx );
+}
+
+void esp_sha_software_finish( void *ctx, enum SHA_TYPE type, unsigned char *output )
+{
+    if( type == SHA1 )
+        mbedtls_sha1_finish( ctx, output );
+    else if( type == SHA2_256 )
+        mbedtls_sha256_finish( ctx, output );
+    else
+        mbedtls_sha512_finish( ctx, output );
+    esp_sha_software_free( ctx, type );
+}
+
+void *esp_sha_software_clone( const void *ctx, enum SHA_TYPE type )
+{
+    size_t size = ( type == SHA1 ) ? sizeof( mbedtls_sha1_context ) :
+                  ( type == SHA2_256 ) ? sizeof( mbedtls_sha256_context ) :
+                  sizeof( mbedtls_sha512_context );
+    void *dst = malloc( size );
+
+    if( dst != NULL )
+        memcpy( dst, ctx, size );
+    return( dst );
+}
+
+#endif /* MBEDTLS_SHA1_C && MBEDTLS_SHA256_C && MBEDTLS_SHA512_C */
@@ -0,0 +1,1319 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_internal.h"
+#include "mbedtls/net.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/platform.h"
+
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_entropy.h"
+#include "esp_log.h"
+#include "heap_alloc_caps.h"
+#include "esp_tls.h"
+
+static const char *TAG = "esp_tls";
+
+struct esp_tls {
+    struct netconn *conn;
+    struct pbuf *rx_pbuf;       /* segment(s) received, not yet fully passed to mbedTLS */
+    u16_t rx_offset;            /* bytes of rx_pbuf already passed to mbedTLS */
+    bool resumed;
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+    size_t in_buf_len;          /* current sizes of ssl.in_buf and ssl.out_buf */
+    size_t out_buf_len;
+#endif
+    esp_tls_server_t *server;   /* server which accepted the connection, NULL for clients */
+    esp_tls_alloc_stats_t handshake_mem;
+    mbedtls_ssl_context ssl;
+    /* Client connections only: server connections use the configuration of
+     * their server and are allocated without these members */
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt cacert;
+    esp_cert_store_t *store;    /* shared CA certificates, used instead of cacert */
+};
+
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS || defined(MBEDTLS_SSL_SRV_C)
+static void esp_tls_zeroize(void *buf, size_t len)
+{
+    volatile unsigned char *p = buf;
+    while (len--) {
+        *p++ = 0;
+    }
+}
+#endif
+
+#if CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE > 0
+
+typedef struct {
+    char *host;                 /* NULL if the entry is unused */
+    uint16_t port;
+    uint32_t last_used;
+    mbedtls_ssl_session session;
+} esp_tls_session_t;
+
+static esp_tls_session_t s_sessions[CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE];
+static uint32_t s_session_clock;
+static SemaphoreHandle_t s_session_lock;
+static portMUX_TYPE s_session_lock_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#if CONFIG_MBEDTLS_TLS_SESSION_RTC
+
+#define ESP_TLS_SESSION_RTC_HOST_LEN    64
+#define ESP_TLS_SESSION_RTC_TICKET_LEN  ((CONFIG_MBEDTLS_TLS_SESSION_RTC_TICKET_LEN + 3) & ~3)
+#define ESP_TLS_SESSION_RTC_MAGIC       0x53534c54  // "TLSS"
+#define ESP_TLS_SESSION_RTC_MAX_SIZE    4096
+
+#define ESP_TLS_SESSION_RTC_TRUNC_HMAC  0x01
+#define ESP_TLS_SESSION_RTC_ETM         0x02
+
+/* Copy of s_sessions[i] in RTC slow memory, which survives deep sleep and
+ * resets other than power-on. Restored when the cache is first used. */
+typedef struct {
+    uint32_t magic;             /* ESP_TLS_SESSION_RTC_MAGIC ^ size of the record if used */
+    int32_t ciphersuite;
+    uint32_t verify_result;
+    uint32_t ticket_lifetime;
+    uint16_t port;
+    uint16_t ticket_len;
+    uint8_t compression;
+    uint8_t id_len;
+    uint8_t mfl_code;
+    uint8_t flags;
+    char host[ESP_TLS_SESSION_RTC_HOST_LEN];
+    unsigned char id[32];
+    unsigned char master[48];
+    unsigned char ticket[ESP_TLS_SESSION_RTC_TICKET_LEN];
+    uint32_t checksum;
+} esp_tls_session_rtc_t;
+
+/* Kept below the app layout the bootloader caches for waking from deep sleep
+ * (which is below the esp_time record), and above the RTC_DATA_ATTR variables,
+ * which fill at most the first 3 kB (rtc_slow_seg in esp32.ld) */
+#define ESP_TLS_SESSION_RTC_END 0x50001c00
+#define ESP_TLS_SESSION_RTC     ((esp_tls_session_rtc_t *) (ESP_TLS_SESSION_RTC_END - \
+                                 sizeof(esp_tls_session_rtc_t) * CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE))
+
+/* Doesn't compile if the records don't fit, see CONFIG_MBEDTLS_TLS_SESSION_RTC_TICKET_LEN */
+typedef char esp_tls_session_rtc_fits[(sizeof(esp_tls_session_rtc_t) * CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE
+                                      <= ESP_TLS_SESSION_RTC_MAX_SIZE) ? 1 : -1];
+
+static bool s_sessions_restored;
+
+static uint32_t esp_tls_session_rtc_checksum(const esp_tls_session_rtc_t *rec)
+{
+    const uint32_t *p = (const uint32_t *) rec;
+    const uint32_t *end = (const uint32_t *) &rec->checksum;
+    uint32_t sum = 0;
+    while (p < end) {
+        sum = ((sum << 5) | (sum >> 27)) ^ *p++;
+    }
+    return sum;
+}
+
+/* Update the RTC copy of an entry, or invalidate it if the entry is unused
+ * or the session doesn't fit */
+static void esp_tls_session_rtc_save(const esp_tls_session_t *entry)
+{
+    esp_tls_session_rtc_t *rec = &ESP_TLS_SESSION_RTC[entry - s_sessions];
+    const mbedtls_ssl_session *session = &entry->session;
+
+    memset(rec, 0, sizeof(*rec));
+    if (entry->host == NULL || strlen(entry->host) >= ESP_TLS_SESSION_RTC_HOST_LEN) {
+        return;
+    }
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session->ticket_len > CONFIG_MBEDTLS_TLS_SESSION_RTC_TICKET_LEN) {
+        return;
+    }
+    rec->ticket_len = session->ticket_len;
+    rec->ticket_lifetime = session->ticket_lifetime;
+    if (session->ticket_len > 0) {
+        memcpy(rec->ticket, session->ticket, session->ticket_len);
+    }
+#endif
+    strcpy(rec->host, entry->host);
+    rec->port = entry->port;
+    rec->ciphersuite = session->ciphersuite;
+    rec->compression = session->compression;
+    rec->id_len = session->id_len;
+    memcpy(rec->id, session->id, sizeof(rec->id));
+    memcpy(rec->master, session->master, sizeof(rec->master));
+    rec->verify_result = session->verify_result;
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    rec->mfl_code = session->mfl_code;
+#endif
+#if defined(MBEDTLS_SSL_TRUNCATED_HMAC)
+    rec->flags |= session->trunc_hmac ? ESP_TLS_SESSION_RTC_TRUNC_HMAC : 0;
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+    rec->flags |= session->encrypt_then_mac ? ESP_TLS_SESSION_RTC_ETM : 0;
+#endif
+    rec->magic = ESP_TLS_SESSION_RTC_MAGIC ^ sizeof(*rec);
+    rec->checksum = esp_tls_session_rtc_checksum(rec);
+}
+
+/* Fill the cache from the RTC copies left by the previous run */
+static void esp_tls_session_rtc_restore(void)
+{
+    if (s_sessions_restored) {
+        return;
+    }
+    s_sessions_restored = true;
+    for (int i = 0; i < CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE; i++) {
+        const esp_tls_session_rtc_t *rec = &ESP_TLS_SESSION_RTC[i];
+        esp_tls_session_t *entry = &s_sessions[i];
+        mbedtls_ssl_session *session = &entry->session;
+
+        if (rec->magic != (ESP_TLS_SESSION_RTC_MAGIC ^ sizeof(*rec)) ||
+                rec->checksum != esp_tls_session_rtc_checksum(rec) ||
+                rec->host[ESP_TLS_SESSION_RTC_HOST_LEN - 1] != 0 ||
+                rec->id_len > sizeof(rec->id) || rec->ticket_len > CONFIG_MBEDTLS_TLS_SESSION_RTC_TICKET_LEN) {
+            continue;
+        }
+        entry->host = strdup(rec->host);
+        if (entry->host == NULL) {
+            continue;
+        }
+        entry->port = rec->port;
+        entry->last_used = 0;
+        session->ciphersuite = rec->ciphersuite;
+        session->compression = rec->compression;
+        session->id_len = rec->id_len;
+        memcpy(session->id, rec->id, sizeof(session->id));
+        memcpy(session->master, rec->master, sizeof(session->master));
+        session->verify_result = rec->verify_result;
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        if (rec->ticket_len > 0) {
+            session->ticket = mbedtls_calloc(1, rec->ticket_len);
+            if (session->ticket == NULL) {
+                free(entry->host);
+                entry->host = NULL;
+                continue;
+            }
+            memcpy(session->ticket, rec->ticket, rec->ticket_len);
+            session->ticket_len = rec->ticket_len;
+        }
+        session->ticket_lifetime = rec->ticket_lifetime;
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        session->mfl_code = rec->mfl_code;
+#endif
+#if defined(MBEDTLS_SSL_TRUNCATED_HMAC)
+        session->trunc_hmac = (rec->flags & ESP_TLS_SESSION_RTC_TRUNC_HMAC) != 0;
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+        session->encrypt_then_mac = (rec->flags & ESP_TLS_SESSION_RTC_ETM) != 0;
+#endif
+    }
+}
+
+#else // CONFIG_MBEDTLS_TLS_SESSION_RTC
+
+#define esp_tls_session_rtc_save(entry)
+#define esp_tls_session_rtc_restore()
+
+#endif // CONFIG_MBEDTLS_TLS_SESSION_RTC
+
+static bool esp_tls_session_lock(void)
+{
+    if (s_session_lock == NULL) {
+        SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+        if (lock == NULL) {
+            return false;
+        }
+        taskENTER_CRITICAL(&s_session_lock_init_mux);
+        if (s_session_lock == NULL) {
+            s_session_lock = lock;
+            lock = NULL;
+        }
+        taskEXIT_CRITICAL(&s_session_lock_init_mux);
+        if (lock != NULL) {
+            vSemaphoreDelete(lock);
+        }
+    }
+    xSemaphoreTake(s_session_lock, portMAX_DELAY);
+    esp_tls_session_rtc_restore();
+    return true;
+}
+
+static void esp_tls_session_unlock(void)
+{
+    xSemaphoreGive(s_session_lock);
+}
+
+static esp_tls_session_t *esp_tls_session_find(const char *host, uint16_t port)
+{
+    for (int i = 0; i < CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE; i++) {
+        esp_tls_session_t *entry = &s_sessions[i];
+        if (entry->host != NULL && entry->port == port && strcmp(entry->host, host) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void esp_tls_session_clear(esp_tls_session_t *entry)
+{
+    free(entry->host);
+    entry->host = NULL;
+    mbedtls_ssl_session_free(&entry->session);
+    esp_tls_session_rtc_save(entry);
+}
+
+/* Offer the session of the last connection to host:port to the server */
+static void esp_tls_session_load(esp_tls_t *tls, const char *host, uint16_t port)
+{
+    if (!esp_tls_session_lock()) {
+        return;
+    }
+    esp_tls_session_t *entry = esp_tls_session_find(host, port);
+    if (entry != NULL) {
+        entry->last_used = ++s_session_clock;
+        mbedtls_ssl_set_session(&tls->ssl, &entry->session);
+    }
+    esp_tls_session_unlock();
+}
+
+/* Remember the session of a completed handshake, replacing the entry used least recently */
+static void esp_tls_session_store(esp_tls_t *tls, const char *host, uint16_t port)
+{
+    if (!esp_tls_session_lock()) {
+        return;
+    }
+    esp_tls_session_t *entry = esp_tls_session_find(host, port);
+    if (entry == NULL) {
+        entry = &s_sessions[0];
+        for (int i = 0; i < CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE && entry->host != NULL; i++) {
+            if (s_sessions[i].host == NULL || s_sessions[i].last_used < entry->last_used) {
+                entry = &s_sessions[i];
+            }
+        }
+        esp_tls_session_clear(entry);
+        entry->host = strdup(host);
+        if (entry->host == NULL) {
+            goto out;
+        }
+        entry->port = port;
+    } else {
+        mbedtls_ssl_session_free(&entry->session);
+    }
+    entry->last_used = ++s_session_clock;
+    if (mbedtls_ssl_get_session(&tls->ssl, &entry->session) != 0) {
+        esp_tls_session_clear(entry);
+        goto out;
+    }
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    /* The certificate was verified already and isn't needed for resumption */
+    if (entry->session.peer_cert != NULL) {
+        mbedtls_x509_crt_free(entry->session.peer_cert);
+        mbedtls_free(entry->session.peer_cert);
+        entry->session.peer_cert = NULL;
+    }
+#endif
+    esp_tls_session_rtc_save(entry);
+out:
+    esp_tls_session_unlock();
+}
+
+/* Forget a session the server doesn't accept any more */
+static void esp_tls_session_drop(const char *host, uint16_t port)
+{
+    if (!esp_tls_session_lock()) {
+        return;
+    }
+    esp_tls_session_t *entry = esp_tls_session_find(host, port);
+    if (entry != NULL) {
+        esp_tls_session_clear(entry);
+    }
+    esp_tls_session_unlock();
+}
+
+void esp_tls_clear_sessions(void)
+{
+    if (!esp_tls_session_lock()) {
+        return;
+    }
+    for (int i = 0; i < CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE; i++) {
+        if (s_sessions[i].host != NULL) {
+            esp_tls_session_clear(&s_sessions[i]);
+        }
+    }
+    esp_tls_session_unlock();
+}
+
+#else // CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE > 0
+
+#define esp_tls_session_load(tls, host, port)
+#define esp_tls_session_store(tls, host, port)
+#define esp_tls_session_drop(host, port)
+
+void esp_tls_clear_sessions(void)
+{
+}
+
+#endif // CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE > 0
+
+/* Wait for a received TCP segment, if none is pending.
+ * Returns 1 if there is one, 0 if the connection was closed, or an mbedTLS error. */
+static int esp_tls_rx_wait(esp_tls_t *tls)
+{
+    if (tls->rx_pbuf != NULL) {
+        return 1;
+    }
+    err_t err = netconn_recv_tcp_pbuf(tls->conn, &tls->rx_pbuf);
+    if (err == ERR_TIMEOUT) {
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+    if (err == ERR_CLSD) {
+        return 0;
+    }
+    if (err != ERR_OK) {
+        return (err == ERR_RST) ? MBEDTLS_ERR_NET_CONN_RESET : MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    tls->rx_offset = 0;
+    return 1;
+}
+
+/* Pass received data to mbedTLS straight from the pbufs of the TCP segments */
+static int esp_tls_bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    esp_tls_t *tls = (esp_tls_t *) ctx;
+
+    int ret = esp_tls_rx_wait(tls);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    u16_t copied = pbuf_copy_partial(tls->rx_pbuf, buf, len > 0xffff ? 0xffff : len, tls->rx_offset);
+    tls->rx_offset += copied;
+    if (tls->rx_offset >= tls->rx_pbuf->tot_len) {
+        pbuf_free(tls->rx_pbuf);
+        tls->rx_pbuf = NULL;
+    }
+    return copied;
+}
+
+/* Copy the records produced by mbedTLS into the TX pbufs of the connection */
+static int esp_tls_bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    esp_tls_t *tls = (esp_tls_t *) ctx;
+    size_t written = 0;
+
+    err_t err = netconn_write_partly(tls->conn, buf, len, NETCONN_COPY, &written);
+    if (written > 0) {
+        return written;
+    }
+    if (err == ERR_WOULDBLOCK || err == ERR_TIMEOUT) {
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+    return (err == ERR_RST) ? MBEDTLS_ERR_NET_CONN_RESET : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+
+#define ESP_TLS_BUF_PTRS    5
+
+static unsigned char *esp_tls_buffer_alloc(size_t len)
+{
+#if CONFIG_MBEDTLS_TLS_BUFFERS_SPIRAM
+    unsigned char *buf = pvPortMallocCaps(len, MALLOC_CAP_SPISRAM | MALLOC_CAP_8BIT);
+    if (buf != NULL) {
+        return buf;
+    }
+#endif
+    return malloc(len);
+}
+
+/* Move a record buffer to a new allocation of len bytes. Only the part up
+ * to the last of ptrs (the record counter and header) is kept; the pointers
+ * into the buffer follow it. */
+static bool esp_tls_buffer_resize(unsigned char **buf, size_t *buf_len, unsigned char **ptrs[ESP_TLS_BUF_PTRS], size_t len)
+{
+    size_t offsets[ESP_TLS_BUF_PTRS];
+    size_t keep = 0;
+
+    for (int i = 0; i < ESP_TLS_BUF_PTRS; i++) {
+        offsets[i] = *ptrs[i] - *buf;
+        if (offsets[i] > keep) {
+            keep = offsets[i];
+        }
+    }
+    unsigned char *new_buf = esp_tls_buffer_alloc(len);
+    if (new_buf == NULL) {
+        return false;
+    }
+    memcpy(new_buf, *buf, keep);
+    esp_tls_zeroize(*buf, *buf_len);
+    free(*buf);
+    *buf = new_buf;
+    *buf_len = len;
+    for (int i = 0; i < ESP_TLS_BUF_PTRS; i++) {
+        *ptrs[i] = new_buf + offsets[i];
+    }
+    return true;
+}
+
+static bool esp_tls_buffers_resize(esp_tls_t *tls, bool full)
+{
+    mbedtls_ssl_context *ssl = &tls->ssl;
+    unsigned char **in_ptrs[ESP_TLS_BUF_PTRS] = { &ssl->in_ctr, &ssl->in_hdr, &ssl->in_len, &ssl->in_iv, &ssl->in_msg };
+    unsigned char **out_ptrs[ESP_TLS_BUF_PTRS] = { &ssl->out_ctr, &ssl->out_hdr, &ssl->out_len, &ssl->out_iv, &ssl->out_msg };
+    size_t in_len = full ? MBEDTLS_SSL_BUFFER_LEN : (size_t) (ssl->in_msg - ssl->in_buf);
+    size_t out_len = full ? MBEDTLS_SSL_BUFFER_LEN : (size_t) (ssl->out_msg - ssl->out_buf);
+
+    if (tls->in_buf_len != in_len &&
+            !esp_tls_buffer_resize(&ssl->in_buf, &tls->in_buf_len, in_ptrs, in_len)) {
+        return false;
+    }
+    if (tls->out_buf_len != out_len &&
+            !esp_tls_buffer_resize(&ssl->out_buf, &tls->out_buf_len, out_ptrs, out_len)) {
+        return false;
+    }
+    return true;
+}
+
+/* Full size record buffers, for any call into mbedTLS */
+static bool esp_tls_buffers_acquire(esp_tls_t *tls)
+{
+    return esp_tls_buffers_resize(tls, true);
+}
+
+/* Nothing to be sent or received: mbedTLS needs no more than the record
+ * counters and headers until the next record */
+static bool esp_tls_idle(esp_tls_t *tls)
+{
+    const mbedtls_ssl_context *ssl = &tls->ssl;
+    return ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER && ssl->handshake == NULL &&
+           ssl->in_offt == NULL && ssl->in_left == 0 && ssl->record_read == 0 &&
+           ssl->out_left == 0;
+}
+
+static void esp_tls_buffers_release(esp_tls_t *tls)
+{
+    if (esp_tls_idle(tls)) {
+        esp_tls_buffers_resize(tls, false);
+    }
+}
+
+/* mbedtls_ssl_free assumes full size buffers */
+static void esp_tls_buffers_free(esp_tls_t *tls)
+{
+    mbedtls_ssl_context *ssl = &tls->ssl;
+
+    if (ssl->in_buf != NULL && tls->in_buf_len != MBEDTLS_SSL_BUFFER_LEN) {
+        esp_tls_zeroize(ssl->in_buf, tls->in_buf_len);
+        free(ssl->in_buf);
+        ssl->in_buf = NULL;
+    }
+    if (ssl->out_buf != NULL && tls->out_buf_len != MBEDTLS_SSL_BUFFER_LEN) {
+        esp_tls_zeroize(ssl->out_buf, tls->out_buf_len);
+        free(ssl->out_buf);
+        ssl->out_buf = NULL;
+    }
+}
+
+#else // CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+
+#define esp_tls_buffers_acquire(tls)    true
+#define esp_tls_idle(tls)               false
+#define esp_tls_buffers_release(tls)
+#define esp_tls_buffers_free(tls)
+
+#endif // CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+/* Largest maximum fragment length which fits the record buffers */
+static unsigned char esp_tls_mfl_code(void)
+{
+    if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 16384) {
+        return MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+    } else if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 4096) {
+        return MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+    } else if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 2048) {
+        return MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+    } else if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 1024) {
+        return MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+    }
+    return MBEDTLS_SSL_MAX_FRAG_LEN_512;
+}
+#endif
+
+static int esp_tls_handshake(esp_tls_t *tls)
+{
+    int ret = 0;
+
+    /* Same loop as mbedtls_ssl_handshake, but look whether the session was
+     * resumed before the handshake state is freed */
+    esp_tls_alloc_scope_begin(&tls->handshake_mem);
+    while (tls->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        if (tls->ssl.state == MBEDTLS_SSL_HANDSHAKE_WRAPUP && tls->ssl.handshake != NULL) {
+            tls->resumed = tls->ssl.handshake->resume != 0;
+        }
+        ret = mbedtls_ssl_handshake_step(&tls->ssl);
+        if (ret != 0) {
+            break;
+        }
+    }
+    esp_tls_alloc_scope_end();
+    ESP_LOGD(TAG, "handshake allocated up to %d bytes in %d allocations, %d from the heap",
+             (int) tls->handshake_mem.peak, (int) tls->handshake_mem.allocs,
+             (int) tls->handshake_mem.heap_allocs);
+    return ret;
+}
+
+static esp_err_t esp_tls_setup(esp_tls_t *tls, const char *hostname, const esp_tls_cfg_t *cfg)
+{
+    int ret;
+
+    ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        goto fail;
+    }
+    if (cfg->cacert_store != NULL) {
+        tls->store = esp_cert_store_ref(cfg->cacert_store);
+        mbedtls_ssl_conf_ca_chain(&tls->conf, esp_cert_store_chain(tls->store), NULL);
+        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else if (cfg->cacert_pem_buf != NULL) {
+        ret = mbedtls_x509_crt_parse(&tls->cacert, cfg->cacert_pem_buf, cfg->cacert_pem_bytes);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "can't parse CA certificate: -0x%x", -ret);
+            return ESP_ERR_INVALID_ARG;
+        }
+        mbedtls_ssl_conf_ca_chain(&tls->conf, &tls->cacert, NULL);
+        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_NONE);
+    }
+    mbedtls_ssl_conf_rng(&tls->conf, esp_entropy_random, NULL);
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    /* Ask the server for records small enough for our buffers */
+    if (esp_tls_mfl_code() != MBEDTLS_SSL_MAX_FRAG_LEN_NONE) {
+        mbedtls_ssl_conf_max_frag_len(&tls->conf, esp_tls_mfl_code());
+    }
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&tls->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    if (ret != 0) {
+        goto fail;
+    }
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+    tls->in_buf_len = MBEDTLS_SSL_BUFFER_LEN;
+    tls->out_buf_len = MBEDTLS_SSL_BUFFER_LEN;
+#endif
+    ret = mbedtls_ssl_set_hostname(&tls->ssl, hostname);
+    if (ret != 0) {
+        goto fail;
+    }
+    mbedtls_ssl_set_bio(&tls->ssl, tls, esp_tls_bio_send, esp_tls_bio_recv, NULL);
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+    /* The buffers are still empty: keep them small while connecting */
+    esp_tls_buffers_resize(tls, false);
+#endif
+    return ESP_OK;
+
+fail:
+    ESP_LOGE(TAG, "TLS setup failed: -0x%x", -ret);
+    return (ret == MBEDTLS_ERR_SSL_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_FAIL;
+}
+
+static esp_err_t esp_tls_connect(esp_tls_t *tls, const char *hostname, uint16_t port, int timeout_ms)
+{
+    ip_addr_t addr;
+
+    if (netconn_gethostbyname(hostname, &addr) != ERR_OK) {
+        ESP_LOGE(TAG, "can't resolve %s", hostname);
+        return ESP_ERR_NOT_FOUND;
+    }
+    tls->conn = netconn_new(NETCONN_TCP);
+    if (tls->conn == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    netconn_set_recvtimeout(tls->conn, timeout_ms);
+    netconn_set_sendtimeout(tls->conn, timeout_ms);
+
+    err_t err = netconn_connect(tls->conn, &addr, port);
+    if (err != ERR_OK) {
+        ESP_LOGE(TAG, "can't connect to %s:%d: %d", hostname, port, err);
+        return (err == ERR_TIMEOUT) ? ESP_ERR_TIMEOUT : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_tls_conn_new(const char *hostname, uint16_t port, const esp_tls_cfg_t *cfg, esp_tls_t **out)
+{
+    if (hostname == NULL || cfg == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_tls_t *tls = calloc(1, sizeof(esp_tls_t));
+    if (tls == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    mbedtls_ssl_init(&tls->ssl);
+    mbedtls_ssl_config_init(&tls->conf);
+    mbedtls_x509_crt_init(&tls->cacert);
+
+    esp_err_t err = esp_tls_setup(tls, hostname, cfg);
+    if (err != ESP_OK) {
+        goto fail;
+    }
+    err = esp_tls_connect(tls, hostname, port, cfg->timeout_ms);
+    if (err != ESP_OK) {
+        goto fail;
+    }
+
+    esp_tls_session_load(tls, hostname, port);
+    int ret = esp_tls_buffers_acquire(tls) ? esp_tls_handshake(tls) : MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    if (ret != 0) {
+        ESP_LOGE(TAG, "handshake with %s failed: -0x%x", hostname, -ret);
+        esp_tls_session_drop(hostname, port);
+        err = (ret == MBEDTLS_ERR_SSL_TIMEOUT) ? ESP_ERR_TIMEOUT :
+              (ret == MBEDTLS_ERR_SSL_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_FAIL;
+        goto fail;
+    }
+    /* Also after resumption, the server may have issued a new ticket */
+    esp_tls_session_store(tls, hostname, port);
+    ESP_LOGD(TAG, "connected to %s:%d, %s, session %s", hostname, port,
+             mbedtls_ssl_get_ciphersuite(&tls->ssl), tls->resumed ? "resumed" : "new");
+    esp_tls_buffers_release(tls);
+    *out = tls;
+    return ESP_OK;
+
+fail:
+    esp_tls_conn_delete(tls);
+    return err;
+}
+
+#if defined(MBEDTLS_SSL_SRV_C)
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_GCM_C)
+#define ESP_TLS_SERVER_TICKETS  1
+#endif
+
+#define ESP_TLS_SERVER_DEFAULT_LIFETIME 86400
+#define ESP_TLS_SERVER_MAX_LIFETIME     (0x7fffffff / configTICK_RATE_HZ)
+
+#if CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+
+/* The cache is a table of sets of ESP_TLS_SERVER_CACHE_WAYS entries. The
+ * session ID selects the set, and a new session replaces the entry of its set
+ * used least recently. */
+#define ESP_TLS_SERVER_CACHE_WAYS   4
+#define ESP_TLS_SERVER_CACHE_SETS   ((CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE + ESP_TLS_SERVER_CACHE_WAYS - 1) / \
+                                     ESP_TLS_SERVER_CACHE_WAYS)
+
+typedef struct {
+    uint32_t last_used;         /* 0 if the entry is unused */
+    TickType_t stored;
+    int ciphersuite;
+    uint32_t verify_result;
+    uint8_t compression;
+    uint8_t id_len;
+    unsigned char id[32];
+    unsigned char master[48];
+} esp_tls_server_session_t;
+
+#endif // CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+
+struct esp_tls_server {
+    int refs;
+    int timeout_ms;
+    TickType_t lifetime;        /* of cached sessions and ticket keys */
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt cert;
+    mbedtls_pk_context key;
+#if defined(MBEDTLS_PK_RSA_ALT_SUPPORT)
+    mbedtls_pk_context rsa_key; /* key, with the private key operations under key_lock */
+#endif
+    esp_cert_store_t *clientca;
+    SemaphoreHandle_t key_lock;
+    SemaphoreHandle_t handshakes;   /* one count for each handshake which may run */
+#if CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+    portMUX_TYPE cache_lock;
+    uint32_t cache_clock;
+    esp_tls_server_session_t cache[ESP_TLS_SERVER_CACHE_SETS * ESP_TLS_SERVER_CACHE_WAYS];
+#endif
+#if ESP_TLS_SERVER_TICKETS
+    SemaphoreHandle_t ticket_lock;
+    TickType_t ticket_rotated;
+    mbedtls_ssl_ticket_context ticket;
+#endif
+};
+
+#if defined(MBEDTLS_ECP_DP_SECP256R1_ENABLED) || defined(MBEDTLS_ECP_DP_SECP384R1_ENABLED)
+/* Suites and curves of esp_tls_server_cfg_t::ecdhe_only */
+static const int s_ecdhe_ciphersuites[] = {
+#if defined(MBEDTLS_SSL_CHACHAPOLY_PREFERRED) && defined(MBEDTLS_CHACHAPOLY_C) && defined(MBEDTLS_SHA256_C)
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+#endif
+#if defined(MBEDTLS_AES_C) && defined(MBEDTLS_GCM_C) && defined(MBEDTLS_SHA256_C)
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+#endif
+#if defined(MBEDTLS_AES_C) && defined(MBEDTLS_GCM_C) && defined(MBEDTLS_SHA512_C)
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+#endif
+#if !defined(MBEDTLS_SSL_CHACHAPOLY_PREFERRED) && defined(MBEDTLS_CHACHAPOLY_C) && defined(MBEDTLS_SHA256_C)
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+#endif
+    0
+};
+
+static const mbedtls_ecp_group_id s_ecdhe_curves[] = {
+#if defined(MBEDTLS_ECP_DP_SECP256R1_ENABLED)
+    MBEDTLS_ECP_DP_SECP256R1,
+#endif
+#if defined(MBEDTLS_ECP_DP_SECP384R1_ENABLED)
+    MBEDTLS_ECP_DP_SECP384R1,
+#endif
+    MBEDTLS_ECP_DP_NONE
+};
+#endif
+
+#if CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+
+static esp_tls_server_session_t *esp_tls_server_cache_set(esp_tls_server_t *server, const unsigned char *id)
+{
+    /* Session IDs are random numbers picked by the server, so their first
+     * bytes are as good as a hash */
+    uint32_t hash = id[0] | (id[1] << 8) | (id[2] << 16) | ((uint32_t) id[3] << 24);
+    return &server->cache[(hash % ESP_TLS_SERVER_CACHE_SETS) * ESP_TLS_SERVER_CACHE_WAYS];
+}
+
+/* Session cache callbacks. The table doesn't grow, and the lock is only held
+ * to look through one set. */
+static int esp_tls_server_cache_get(void *ctx, mbedtls_ssl_session *session)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+    int ret = 1;
+
+    if (session->id_len < 4) {
+        return 1;
+    }
+    esp_tls_server_session_t *set = esp_tls_server_cache_set(server, session->id);
+    TickType_t now = xTaskGetTickCount();
+
+    taskENTER_CRITICAL(&server->cache_lock);
+    for (int i = 0; i < ESP_TLS_SERVER_CACHE_WAYS; i++) {
+        esp_tls_server_session_t *entry = &set[i];
+        if (entry->last_used == 0 || entry->id_len != session->id_len ||
+                entry->ciphersuite != session->ciphersuite || entry->compression != session->compression ||
+                memcmp(entry->id, session->id, entry->id_len) != 0) {
+            continue;
+        }
+        if (now - entry->stored > server->lifetime) {
+            esp_tls_zeroize(entry, sizeof(*entry));
+            break;
+        }
+        entry->last_used = ++server->cache_clock;
+        memcpy(session->master, entry->master, sizeof(session->master));
+        session->verify_result = entry->verify_result;
+        ret = 0;
+        break;
+    }
+    taskEXIT_CRITICAL(&server->cache_lock);
+    return ret;
+}
+
+static int esp_tls_server_cache_put(void *ctx, const mbedtls_ssl_session *session)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+
+    if (session->id_len < 4 || session->id_len > sizeof(session->id)) {
+        return 1;
+    }
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    /* Resumption would have to restore the client certificate as well:
+     * leave these sessions to tickets, which carry it */
+    if (session->peer_cert != NULL) {
+        return 1;
+    }
+#endif
+    esp_tls_server_session_t *set = esp_tls_server_cache_set(server, session->id);
+    TickType_t now = xTaskGetTickCount();
+
+    taskENTER_CRITICAL(&server->cache_lock);
+    esp_tls_server_session_t *entry = &set[0];
+    for (int i = 0; i < ESP_TLS_SERVER_CACHE_WAYS; i++) {
+        esp_tls_server_session_t *cur = &set[i];
+        if (cur->last_used != 0 && now - cur->stored > server->lifetime) {
+            cur->last_used = 0;
+        }
+        if (cur->last_used < entry->last_used) {
+            entry = cur;
+        }
+    }
+    entry->last_used = ++server->cache_clock;
+    entry->stored = now;
+    entry->ciphersuite = session->ciphersuite;
+    entry->verify_result = session->verify_result;
+    entry->compression = session->compression;
+    entry->id_len = session->id_len;
+    memcpy(entry->id, session->id, session->id_len);
+    memcpy(entry->master, session->master, sizeof(entry->master));
+    taskEXIT_CRITICAL(&server->cache_lock);
+    return 0;
+}
+
+#endif // CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+
+#if ESP_TLS_SERVER_TICKETS
+
+/* Ticket callbacks. The keys are rotated every lifetime (mbedTLS can't
+ * without MBEDTLS_HAVE_TIME), so a ticket is accepted for one to two
+ * lifetimes. Rotation sets a new key in the cipher contexts allocated at
+ * setup. */
+static void esp_tls_server_ticket_rotate(esp_tls_server_t *server)
+{
+    TickType_t now = xTaskGetTickCount();
+    if (now - server->ticket_rotated >= server->lifetime &&
+            mbedtls_ssl_ticket_rotate(&server->ticket) == 0) {
+        server->ticket_rotated = now;
+    }
+}
+
+static int esp_tls_server_ticket_write(void *ctx, const mbedtls_ssl_session *session,
+                                       unsigned char *start, const unsigned char *end,
+                                       size_t *tlen, uint32_t *lifetime)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+
+    xSemaphoreTake(server->ticket_lock, portMAX_DELAY);
+    esp_tls_server_ticket_rotate(server);
+    int ret = mbedtls_ssl_ticket_write(&server->ticket, session, start, end, tlen, lifetime);
+    xSemaphoreGive(server->ticket_lock);
+    return ret;
+}
+
+static int esp_tls_server_ticket_parse(void *ctx, mbedtls_ssl_session *session,
+                                       unsigned char *buf, size_t len)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+
+    xSemaphoreTake(server->ticket_lock, portMAX_DELAY);
+    esp_tls_server_ticket_rotate(server);
+    int ret = mbedtls_ssl_ticket_parse(&server->ticket, session, buf, len);
+    xSemaphoreGive(server->ticket_lock);
+    return ret;
+}
+
+#endif // ESP_TLS_SERVER_TICKETS
+
+#if defined(MBEDTLS_PK_RSA_ALT_SUPPORT)
+
+/* RSA private key operations update the blinding values stored in the key,
+ * so handshakes in different tasks take turns with it */
+static int esp_tls_server_rsa_decrypt(void *ctx, int mode, size_t *olen,
+                                      const unsigned char *input, unsigned char *output,
+                                      size_t output_max_len)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+
+    xSemaphoreTake(server->key_lock, portMAX_DELAY);
+    int ret = mbedtls_rsa_pkcs1_decrypt(mbedtls_pk_rsa(server->key), esp_entropy_random, NULL,
+                                        mode, olen, input, output, output_max_len);
+    xSemaphoreGive(server->key_lock);
+    return ret;
+}
+
+static int esp_tls_server_rsa_sign(void *ctx, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng,
+                                   int mode, mbedtls_md_type_t md_alg, unsigned int hashlen,
+                                   const unsigned char *hash, unsigned char *sig)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+
+    xSemaphoreTake(server->key_lock, portMAX_DELAY);
+    int ret = mbedtls_rsa_pkcs1_sign(mbedtls_pk_rsa(server->key), f_rng, p_rng,
+                                     mode, md_alg, hashlen, hash, sig);
+    xSemaphoreGive(server->key_lock);
+    return ret;
+}
+
+static size_t esp_tls_server_rsa_key_len(void *ctx)
+{
+    esp_tls_server_t *server = (esp_tls_server_t *) ctx;
+    return mbedtls_pk_rsa(server->key)->len;
+}
+
+#endif // MBEDTLS_PK_RSA_ALT_SUPPORT
+
+/* Signing with an EC key computes the multiples of the generator the first
+ * time and stores them in the key. Compute them now, so that handshakes only
+ * read the key. */
+static void esp_tls_server_prewarm(esp_tls_server_t *server)
+{
+#if defined(MBEDTLS_ECP_C)
+    if (mbedtls_pk_can_do(&server->key, MBEDTLS_PK_ECKEY)) {
+        mbedtls_ecp_keypair *ec = mbedtls_pk_ec(server->key);
+        mbedtls_ecp_point r;
+        mbedtls_mpi one;
+        mbedtls_ecp_point_init(&r);
+        mbedtls_mpi_init(&one);
+        if (mbedtls_mpi_lset(&one, 1) == 0) {
+            mbedtls_ecp_mul(&ec->grp, &r, &one, &ec->grp.G, esp_entropy_random, NULL);
+        }
+        mbedtls_mpi_free(&one);
+        mbedtls_ecp_point_free(&r);
+    }
+#endif
+}
+
+static void esp_tls_server_free(esp_tls_server_t *server)
+{
+    mbedtls_ssl_config_free(&server->conf);
+#if defined(MBEDTLS_PK_RSA_ALT_SUPPORT)
+    mbedtls_pk_free(&server->rsa_key);
+#endif
+    mbedtls_pk_free(&server->key);
+    mbedtls_x509_crt_free(&server->cert);
+    esp_cert_store_unref(server->clientca);
+#if ESP_TLS_SERVER_TICKETS
+    mbedtls_ssl_ticket_free(&server->ticket);
+    if (server->ticket_lock != NULL) {
+        vSemaphoreDelete(server->ticket_lock);
+    }
+#endif
+#if CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+    esp_tls_zeroize(server->cache, sizeof(server->cache));
+#endif
+    if (server->key_lock != NULL) {
+        vSemaphoreDelete(server->key_lock);
+    }
+    if (server->handshakes != NULL) {
+        vSemaphoreDelete(server->handshakes);
+    }
+    free(server);
+}
+
+static esp_err_t esp_tls_server_setup(esp_tls_server_t *server, const esp_tls_server_cfg_t *cfg)
+{
+    int ret;
+    uint32_t lifetime = cfg->session_lifetime_s ? cfg->session_lifetime_s : ESP_TLS_SERVER_DEFAULT_LIFETIME;
+
+    if (lifetime > ESP_TLS_SERVER_MAX_LIFETIME) {
+        lifetime = ESP_TLS_SERVER_MAX_LIFETIME;
+    }
+    server->lifetime = lifetime * configTICK_RATE_HZ;
+    server->timeout_ms = cfg->timeout_ms;
+
+    server->key_lock = xSemaphoreCreateMutex();
+    server->handshakes = xSemaphoreCreateCounting(CONFIG_MBEDTLS_TLS_SERVER_HANDSHAKES,
+                                                  CONFIG_MBEDTLS_TLS_SERVER_HANDSHAKES);
+#if ESP_TLS_SERVER_TICKETS
+    server->ticket_lock = xSemaphoreCreateMutex();
+    if (server->ticket_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    if (server->key_lock == NULL || server->handshakes == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = mbedtls_x509_crt_parse(&server->cert, cfg->servercert_pem_buf, cfg->servercert_pem_bytes);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "can't parse server certificate: -0x%x", -ret);
+        return (ret == MBEDTLS_ERR_X509_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_ARG;
+    }
+    ret = mbedtls_pk_parse_key(&server->key, cfg->serverkey_pem_buf, cfg->serverkey_pem_bytes, NULL, 0);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "can't parse server key: -0x%x", -ret);
+        return (ret == MBEDTLS_ERR_PK_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_ARG;
+    }
+    mbedtls_pk_context *own_key = &server->key;
+#if defined(MBEDTLS_PK_RSA_ALT_SUPPORT)
+    if (mbedtls_pk_get_type(&server->key) == MBEDTLS_PK_RSA) {
+        ret = mbedtls_pk_setup_rsa_alt(&server->rsa_key, server, esp_tls_server_rsa_decrypt,
+                                       esp_tls_server_rsa_sign, esp_tls_server_rsa_key_len);
+        if (ret != 0) {
+            goto fail;
+        }
+        own_key = &server->rsa_key;
+    }
+#endif
+    esp_tls_server_prewarm(server);
+
+    ret = mbedtls_ssl_config_defaults(&server->conf, MBEDTLS_SSL_IS_SERVER,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        goto fail;
+    }
+    mbedtls_ssl_conf_rng(&server->conf, esp_entropy_random, NULL);
+    ret = mbedtls_ssl_conf_own_cert(&server->conf, &server->cert, own_key);
+    if (ret != 0) {
+        goto fail;
+    }
+    if (cfg->clientca_store != NULL) {
+        server->clientca = esp_cert_store_ref(cfg->clientca_store);
+        mbedtls_ssl_conf_ca_chain(&server->conf, esp_cert_store_chain(server->clientca), NULL);
+        mbedtls_ssl_conf_authmode(&server->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+        mbedtls_ssl_conf_authmode(&server->conf, MBEDTLS_SSL_VERIFY_NONE);
+    }
+#if defined(MBEDTLS_ECP_DP_SECP256R1_ENABLED) || defined(MBEDTLS_ECP_DP_SECP384R1_ENABLED)
+    if (cfg->ecdhe_only) {
+        mbedtls_ssl_conf_ciphersuites(&server->conf, s_ecdhe_ciphersuites);
+        mbedtls_ssl_conf_curves(&server->conf, s_ecdhe_curves);
+    }
+#endif
+#if CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE > 0
+    vPortCPUInitializeMutex(&server->cache_lock);
+    mbedtls_ssl_conf_session_cache(&server->conf, server,
+                                   esp_tls_server_cache_get, esp_tls_server_cache_put);
+#endif
+#if ESP_TLS_SERVER_TICKETS
+    ret = mbedtls_ssl_ticket_setup(&server->ticket, esp_entropy_random, NULL,
+                                   MBEDTLS_CIPHER_AES_256_GCM, lifetime);
+    if (ret != 0) {
+        goto fail;
+    }
+    server->ticket_rotated = xTaskGetTickCount();
+    mbedtls_ssl_conf_session_tickets_cb(&server->conf, esp_tls_server_ticket_write,
+                                        esp_tls_server_ticket_parse, server);
+#endif
+    return ESP_OK;
+
+fail:
+    ESP_LOGE(TAG, "TLS server setup failed: -0x%x", -ret);
+    return (ret == MBEDTLS_ERR_SSL_ALLOC_FAILED || ret == MBEDTLS_ERR_PK_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_FAIL;
+}
+
+esp_err_t esp_tls_server_new(const esp_tls_server_cfg_t *cfg, esp_tls_server_t **out)
+{
+    if (cfg == NULL || cfg->servercert_pem_buf == NULL || cfg->serverkey_pem_buf == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_tls_server_t *server = calloc(1, sizeof(esp_tls_server_t));
+    if (server == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    server->refs = 1;
+    mbedtls_ssl_config_init(&server->conf);
+    mbedtls_x509_crt_init(&server->cert);
+    mbedtls_pk_init(&server->key);
+#if defined(MBEDTLS_PK_RSA_ALT_SUPPORT)
+    mbedtls_pk_init(&server->rsa_key);
+#endif
+#if ESP_TLS_SERVER_TICKETS
+    mbedtls_ssl_ticket_init(&server->ticket);
+#endif
+
+    esp_err_t err = esp_tls_server_setup(server, cfg);
+    if (err != ESP_OK) {
+        esp_tls_server_free(server);
+        return err;
+    }
+    *out = server;
+    return ESP_OK;
+}
+
+static esp_tls_server_t *esp_tls_server_ref(esp_tls_server_t *server)
+{
+    __atomic_add_fetch(&server->refs, 1, __ATOMIC_RELAXED);
+    return server;
+}
+
+static void esp_tls_server_unref(esp_tls_server_t *server)
+{
+    if (__atomic_sub_fetch(&server->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        esp_tls_server_free(server);
+    }
+}
+
+void esp_tls_server_delete(esp_tls_server_t *server)
+{
+    if (server != NULL) {
+        esp_tls_server_unref(server);
+    }
+}
+
+esp_err_t esp_tls_server_accept(esp_tls_server_t *server, struct netconn *conn, esp_tls_t **out)
+{
+    if (conn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (server == NULL || out == NULL) {
+        netconn_close(conn);
+        netconn_delete(conn);
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* Server connections end before the client-only members */
+    esp_tls_t *tls = calloc(1, offsetof(esp_tls_t, conf));
+    if (tls == NULL) {
+        netconn_close(conn);
+        netconn_delete(conn);
+        return ESP_ERR_NO_MEM;
+    }
+    tls->conn = conn;
+    tls->server = esp_tls_server_ref(server);
+    mbedtls_ssl_init(&tls->ssl);
+    netconn_set_recvtimeout(conn, server->timeout_ms);
+    netconn_set_sendtimeout(conn, server->timeout_ms);
+
+    esp_err_t err;
+    int ret = mbedtls_ssl_setup(&tls->ssl, &server->conf);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "TLS setup failed: -0x%x", -ret);
+        err = (ret == MBEDTLS_ERR_SSL_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_FAIL;
+        goto fail;
+    }
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+    tls->in_buf_len = MBEDTLS_SSL_BUFFER_LEN;
+    tls->out_buf_len = MBEDTLS_SSL_BUFFER_LEN;
+#endif
+    mbedtls_ssl_set_bio(&tls->ssl, tls, esp_tls_bio_send, esp_tls_bio_recv, NULL);
+#if CONFIG_MBEDTLS_TLS_IDLE_BUFFERS
+    /* Connections waiting for their turn only hold small buffers */
+    esp_tls_buffers_resize(tls, false);
+#endif
+
+    /* Limit the handshakes running at the same time, so that each of them
+     * gets its share of the CPU and completes in bounded time */
+    TickType_t wait = (server->timeout_ms > 0) ? pdMS_TO_TICKS(server->timeout_ms) : portMAX_DELAY;
+    if (xSemaphoreTake(server->handshakes, wait) != pdTRUE) {
+        ESP_LOGW(TAG, "no handshake slot");
+        err = ESP_ERR_TIMEOUT;
+        goto fail;
+    }
+    ret = esp_tls_buffers_acquire(tls) ? esp_tls_handshake(tls) : MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    xSemaphoreGive(server->handshakes);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "handshake with client failed: -0x%x", -ret);
+        err = (ret == MBEDTLS_ERR_SSL_TIMEOUT) ? ESP_ERR_TIMEOUT :
+              (ret == MBEDTLS_ERR_SSL_ALLOC_FAILED) ? ESP_ERR_NO_MEM : ESP_FAIL;
+        goto fail;
+    }
+    ESP_LOGD(TAG, "accepted client, %s, session %s",
+             mbedtls_ssl_get_ciphersuite(&tls->ssl), tls->resumed ? "resumed" : "new");
+    esp_tls_buffers_release(tls);
+    *out = tls;
+    return ESP_OK;
+
+fail:
+    esp_tls_conn_delete(tls);
+    return err;
+}
+
+#else // MBEDTLS_SSL_SRV_C
+
+#define esp_tls_server_unref(server)
+
+#endif // MBEDTLS_SSL_SRV_C
+
+int esp_tls_conn_read(esp_tls_t *tls, void *data, size_t len)
+{
+    int ret;
+
+    if (esp_tls_idle(tls)) {
+        /* Wait for the next record without holding the record buffers */
+        esp_tls_buffers_release(tls);
+        ret = esp_tls_rx_wait(tls);
+        if (ret <= 0) {
+            return (ret == 0) ? MBEDTLS_ERR_SSL_CONN_EOF : ret;
+        }
+    }
+    if (!esp_tls_buffers_acquire(tls)) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    do {
+        ret = mbedtls_ssl_read(&tls->ssl, (unsigned char *) data, len);
+    } while (ret == MBEDTLS_ERR_SSL_WANT_READ);
+    esp_tls_buffers_release(tls);
+    if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        return 0;
+    }
+    return ret;
+}
+
+int esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    size_t sent = 0;
+
+    if (!esp_tls_buffers_acquire(tls)) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    while (sent < len) {
+        int ret = mbedtls_ssl_write(&tls->ssl, p + sent, len - sent);
+        if (ret < 0) {
+            esp_tls_buffers_release(tls);
+            return (sent > 0) ? sent : ret;
+        }
+        sent += ret;
+    }
+    esp_tls_buffers_release(tls);
+    return sent;
+}
+
+bool esp_tls_conn_session_reused(esp_tls_t *tls)
+{
+    return tls->resumed;
+}
+
+void esp_tls_conn_get_handshake_mem(esp_tls_t *tls, esp_tls_alloc_stats_t *stats)
+{
+    *stats = tls->handshake_mem;
+}
+
+void esp_tls_conn_delete(esp_tls_t *tls)
+{
+    if (tls == NULL) {
+        return;
+    }
+    if (tls->conn != NULL) {
+        if (tls->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER && esp_tls_buffers_acquire(tls)) {
+            mbedtls_ssl_close_notify(&tls->ssl);
+        }
+        netconn_close(tls->conn);
+        netconn_delete(tls->conn);
+    }
+    if (tls->rx_pbuf != NULL) {
+        pbuf_free(tls->rx_pbuf);
+    }
+    esp_tls_buffers_free(tls);
+    mbedtls_ssl_free(&tls->ssl);
+    if (tls->server != NULL) {
+        esp_tls_server_unref(tls->server);
+    } else {
+        mbedtls_ssl_config_free(&tls->conf);
+        mbedtls_x509_crt_free(&tls->cacert);
+        esp_cert_store_unref(tls->store);
+    }
+    free(tls);
+}
@@ -0,0 +1,176 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "mbedtls/platform.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/heap_regions.h"
+
+#include "esp_mempool.h"
+#include "heap_alloc_caps.h"
+#include "esp_log.h"
+#include "esp_tls_alloc.h"
+
+static const char *TAG = "tls_alloc";
+
+#define POOL_CLASS_COUNT    6
+
+/* Block sizes of the pools: 2^k + 2 limbs. An mbedtls_mpi grows its limbs to
+ * what an operation needs, which is the size of the modulus (a power of two
+ * limbs for the usual curves and RSA keys, one more for P-521), twice that
+ * for products, and a limb or two for carries. */
+static const uint16_t s_class_size[POOL_CLASS_COUNT] = { 40, 72, 136, 264, 520, 1032 };
+
+static esp_mempool_handle_t s_pools[POOL_CLASS_COUNT];
+
+#define SCOPE_SUPPORTED (CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS > CONFIG_MBEDTLS_POOL_ALLOC_TLS_INDEX)
+
+static inline esp_tls_alloc_stats_t *scope_get(void)
+{
+#if SCOPE_SUPPORTED
+    return (esp_tls_alloc_stats_t *) pvTaskGetThreadLocalStoragePointer(NULL, CONFIG_MBEDTLS_POOL_ALLOC_TLS_INDEX);
+#else
+    return NULL;
+#endif
+}
+
+static int pool_class(size_t len)
+{
+    int c = 0;
+    while (c < POOL_CLASS_COUNT && len > s_class_size[c]) {
+        c++;
+    }
+    return c;
+}
+
+static void *esp_tls_alloc_calloc(size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    size_t len = n * size;
+    size_t used = 0;
+    void *ptr = NULL;
+
+    int c = pool_class(len);
+    if (c < POOL_CLASS_COUNT) {
+        ptr = esp_mempool_alloc(s_pools[c]);
+        if (ptr != NULL) {
+            memset(ptr, 0, len);
+            used = s_class_size[c];
+        }
+    }
+    esp_tls_alloc_stats_t *stats = scope_get();
+    if (ptr == NULL) {
+        ptr = calloc(n, size);
+        if (ptr == NULL) {
+            return NULL;
+        }
+        if (stats != NULL) {
+            stats->heap_allocs++;
+            used = xPortGetAllocatedSize(ptr);
+        }
+    }
+    if (stats != NULL) {
+        stats->allocs++;
+        stats->in_use += used;
+        if (stats->in_use > stats->peak) {
+            stats->peak = stats->in_use;
+        }
+    }
+    return ptr;
+}
+
+static void esp_tls_alloc_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    esp_tls_alloc_stats_t *stats = scope_get();
+    size_t used = 0;
+
+    for (int c = 0; c < POOL_CLASS_COUNT; c++) {
+        if (esp_mempool_contains(s_pools[c], ptr)) {
+            esp_mempool_free(s_pools[c], ptr);
+            used = s_class_size[c];
+            goto out;
+        }
+    }
+    if (stats != NULL) {
+        used = xPortGetAllocatedSize(ptr);
+    }
+    free(ptr);
+out:
+    /* Memory allocated before the scope may be freed in it */
+    if (stats != NULL) {
+        stats->in_use = (used < stats->in_use) ? stats->in_use - used : 0;
+    }
+}
+
+esp_err_t esp_tls_alloc_init(void)
+{
+    if (s_pools[0] != NULL) {
+        return ESP_OK;
+    }
+    /* Each class gets the same share of the memory */
+    size_t class_bytes = CONFIG_MBEDTLS_POOL_ALLOC_KB * 1024 / POOL_CLASS_COUNT;
+    for (int c = 0; c < POOL_CLASS_COUNT; c++) {
+        size_t count = class_bytes / s_class_size[c];
+        esp_err_t err = esp_mempool_create(s_class_size[c], count > 0 ? count : 1,
+                                           MALLOC_CAP_8BIT, &s_pools[c]);
+        if (err != ESP_OK) {
+            while (c-- > 0) {
+                esp_mempool_delete(s_pools[c]);
+                s_pools[c] = NULL;
+            }
+            return err;
+        }
+    }
+    /* Free first: other tasks may allocate in between, and blocks of the
+     * pools must not reach free() */
+    mbedtls_platform_set_calloc_free(mbedtls_calloc, esp_tls_alloc_free);
+    mbedtls_platform_set_calloc_free(esp_tls_alloc_calloc, esp_tls_alloc_free);
+    ESP_LOGD(TAG, "%d kB of pools", CONFIG_MBEDTLS_POOL_ALLOC_KB);
+    return ESP_OK;
+}
+
+esp_err_t esp_tls_alloc_scope_begin(esp_tls_alloc_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+#if SCOPE_SUPPORTED
+    vTaskSetThreadLocalStoragePointer(NULL, CONFIG_MBEDTLS_POOL_ALLOC_TLS_INDEX, stats);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void esp_tls_alloc_scope_end(void)
+{
+#if SCOPE_SUPPORTED
+    vTaskSetThreadLocalStoragePointer(NULL, CONFIG_MBEDTLS_POOL_ALLOC_TLS_INDEX, NULL);
+#endif
+}
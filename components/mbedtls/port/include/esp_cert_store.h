@@ -0,0 +1,96 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_CERT_STORE_H__
+#define __ESP_CERT_STORE_H__
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "mbedtls/x509_crt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Parsed CA certificates shared by TLS connections.
+ *
+ * A store is parsed once and is then read-only, so any number of
+ * connections, in any tasks, can verify servers against it at the same time
+ * (see esp_tls_cfg_t::cacert_store). It is reference counted and freed when
+ * the last reference is dropped.
+ *
+ * A store created from a partition parses the certificates in place in
+ * memory-mapped flash, so only the parsed structures take RAM, not the DER
+ * data.
+ */
+typedef struct esp_cert_store esp_cert_store_t;
+
+/**
+ * @brief  Create a store from CA certificates in PEM format
+ *
+ * @param  pem  certificate(s), NUL terminated
+ * @param  len  size of pem, including the terminating NUL
+ * @param  out  set to the new store, holding one reference
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if no certificate can be parsed,
+ *         ESP_ERR_NO_MEM
+ */
+esp_err_t esp_cert_store_create_pem(const unsigned char *pem, size_t len, esp_cert_store_t **out);
+
+/**
+ * @brief  Create a store from the DER certificates in a data partition
+ *
+ * The partition holds the certificates back to back, the first unused
+ * byte of the partition is left erased (0xff). The partition stays mapped
+ * while the store exists.
+ *
+ * @param  label  label of the partition
+ * @param  out    set to the new store, holding one reference
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no such partition or it
+ *         holds no valid certificate, ESP_ERR_NO_MEM, or an error of
+ *         esp_partition_mmap
+ */
+esp_err_t esp_cert_store_create_partition(const char *label, esp_cert_store_t **out);
+
+/**
+ * @brief  Take another reference to a store
+ *
+ * @return store
+ */
+esp_cert_store_t *esp_cert_store_ref(esp_cert_store_t *store);
+
+/**
+ * @brief  Drop a reference, freeing the store with the last one
+ */
+void esp_cert_store_unref(esp_cert_store_t *store);
+
+/**
+ * @brief  Certificate chain of the store, for mbedtls_ssl_conf_ca_chain
+ *
+ * The chain must not be modified.
+ */
+mbedtls_x509_crt *esp_cert_store_chain(esp_cert_store_t *store);
+
+/**
+ * @brief  Number of certificates in the store
+ */
+size_t esp_cert_store_count(const esp_cert_store_t *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_CERT_STORE_H__ */
@@ -0,0 +1,73 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_CRYPTO_BENCH_H__
+#define __ESP_CRYPTO_BENCH_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Benchmark of the mbedTLS primitives, each measured once with the hardware
+ * units (hwcrypto and esp_bignum.c) and once with all of them forced to
+ * their software path (see esp_crypto_set_software_only), to find the input
+ * sizes at which the hardware starts to pay off.
+ *
+ * Times are taken from CCOUNT in a task pinned to the CPU of the caller.
+ * Ciphers and hashes are swept over message sizes and reported in cycles
+ * per byte; bignum, elliptic curve and TLS operations in kilocycles per
+ * operation. Without CONFIG_MBEDTLS_HARDWARE_FALLBACK only SHA has a
+ * software path, the other software columns are left empty.
+ *
+ * Other tasks using mbedTLS while the benchmark runs take the software path
+ * during its software runs, and disturb the measurements.
+ */
+
+typedef enum {
+    ESP_CRYPTO_BENCH_AES = 1 << 0,  /*!< AES-128 ECB, CBC, CTR and GCM, and ChaCha20-Poly1305 to compare */
+    ESP_CRYPTO_BENCH_SHA = 1 << 1,  /*!< SHA-1, SHA-256, SHA-512 */
+    ESP_CRYPTO_BENCH_MPI = 1 << 2,  /*!< bignum multiplication and modular exponentiation */
+    ESP_CRYPTO_BENCH_ECC = 1 << 3,  /*!< ECDSA sign and verify, ECDH, on secp256r1 */
+    ESP_CRYPTO_BENCH_TLS = 1 << 4,  /*!< full TLS handshake, client and server in memory */
+    ESP_CRYPTO_BENCH_ALL = 0x1f,
+} esp_crypto_bench_test_t;
+
+typedef struct {
+    uint32_t tests;         /*!< ESP_CRYPTO_BENCH_xxx to run, 0 for all */
+    uint32_t min_cycles;    /*!< Each measurement repeats the operation for at
+                                 least this many cycles, 0 for 10 ms worth */
+} esp_crypto_bench_cfg_t;
+
+/**
+ * @brief  Run the benchmark and print the results
+ *
+ * Blocks until all tests are done; the TLS handshake and 2048-bit
+ * exponentiation in software take a few seconds each.
+ *
+ * @param  cfg  tests to run, NULL for all with the default duration
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NO_MEM if memory for the buffers or the task can't be allocated
+ *         ESP_FAIL if an operation fails
+ */
+esp_err_t esp_crypto_bench_run(const esp_crypto_bench_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_CRYPTO_BENCH_H__ */
@@ -0,0 +1,74 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_ENTROPY_H__
+#define __ESP_ENTROPY_H__
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Entropy for mbedTLS, gathered ahead of time.
+ *
+ * A background task keeps a pool of CONFIG_MBEDTLS_ENTROPY_POOL_SIZE bytes
+ * read from the hardware RNG. mbedtls_hardware_poll, the entropy source of
+ * every mbedtls_entropy_context, takes its output from the pool, and only
+ * reads the RNG itself when the pool runs out.
+ *
+ * esp_entropy_random is a random number generator for mbedtls_ssl_conf_rng
+ * and the other mbedTLS functions taking an f_rng, based on a CTR_DRBG
+ * shared by all users. The same task reseeds it every
+ * CONFIG_MBEDTLS_DRBG_RESEED_INTERVAL requests, so callers such as TLS
+ * handshakes don't gather entropy themselves.
+ */
+
+/**
+ * @brief  Seed the shared DRBG and start the entropy task
+ *
+ * Done by the first call to esp_entropy_random otherwise. Call it early,
+ * e.g. from app_main, to keep the initial seeding out of the first TLS
+ * handshake. Calling it again does nothing.
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NO_MEM if the lock or the task can't be created
+ *         ESP_FAIL if the DRBG can't be seeded
+ */
+esp_err_t esp_entropy_init(void);
+
+/**
+ * @brief  Random number generator for mbedTLS, from the shared DRBG
+ *
+ * Thread safe, ctx is not used.
+ *
+ * @return 0 on success, or an mbedTLS CTR_DRBG error code
+ */
+int esp_entropy_random(void *ctx, unsigned char *output, size_t len);
+
+/**
+ * @brief  Take up to len bytes from the entropy pool
+ *
+ * Used by mbedtls_hardware_poll. Never waits for the pool to be refilled.
+ *
+ * @return number of bytes taken
+ */
+size_t esp_entropy_pool_read(unsigned char *output, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_ENTROPY_H__ */
@@ -0,0 +1,202 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_TLS_H__
+#define __ESP_TLS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_cert_store.h"
+#include "esp_tls_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * TLS client connections running mbedTLS directly on top of an lwIP netconn.
+ *
+ * Received TCP segments are handed to mbedTLS from the pbufs they arrived
+ * in, and the records mbedTLS produces are copied once into the TX pbufs of
+ * the connection, so neither direction goes through the socket layer.
+ *
+ * Sessions of completed handshakes are remembered per host and port (see
+ * CONFIG_MBEDTLS_TLS_SESSION_CACHE_SIZE), and the next connection to the
+ * same server offers them for resumption, which saves the key exchange and
+ * the certificate chain. With CONFIG_MBEDTLS_TLS_SESSION_RTC, the cache
+ * is also kept in RTC slow memory, so it survives deep sleep.
+ *
+ * With CONFIG_MBEDTLS_TLS_IDLE_BUFFERS, the record buffers of a connection
+ * are only allocated while a record is sent or received; a connection
+ * waiting in esp_tls_conn_read doesn't hold them.
+ *
+ * Connections to servers verified against the same CA certificates should
+ * share an esp_cert_store_t, so the certificates are parsed and kept in RAM
+ * once instead of by every connection.
+ *
+ * An esp_tls_server_t accepts connections from clients. Its configuration,
+ * certificate and key are shared by all of its connections, which only hold
+ * their own TLS state. Sessions are resumed from a fixed-size cache (see
+ * CONFIG_MBEDTLS_TLS_SERVER_SESSION_CACHE_SIZE) and from session tickets,
+ * and at most CONFIG_MBEDTLS_TLS_SERVER_HANDSHAKES handshakes run at the
+ * same time. The esp_tls_conn_xxx functions work on both kinds of
+ * connections.
+ */
+
+struct netconn;
+
+typedef struct esp_tls esp_tls_t;
+typedef struct esp_tls_server esp_tls_server_t;
+
+typedef struct {
+    const unsigned char *cacert_pem_buf;  /**< CA certificate(s) in PEM format, NUL terminated.
+                                               NULL to skip verification of the server. */
+    size_t cacert_pem_bytes;              /**< Size of cacert_pem_buf, including the terminating NUL */
+    esp_cert_store_t *cacert_store;       /**< Shared CA certificates, used instead of cacert_pem_buf
+                                               if not NULL. The connection holds a reference. */
+    int timeout_ms;                       /**< Timeout of each receive and send, 0 to block */
+} esp_tls_cfg_t;
+
+typedef struct {
+    const unsigned char *servercert_pem_buf;  /**< Certificate chain of the server in PEM format, NUL terminated */
+    size_t servercert_pem_bytes;              /**< Size of servercert_pem_buf, including the terminating NUL */
+    const unsigned char *serverkey_pem_buf;   /**< Private key of the server in PEM format, NUL terminated */
+    size_t serverkey_pem_bytes;               /**< Size of serverkey_pem_buf, including the terminating NUL */
+    esp_cert_store_t *clientca_store;         /**< CA certificates to verify client certificates against,
+                                                   NULL to not ask clients for one. The server holds a reference. */
+    bool ecdhe_only;                          /**< Only accept ECDHE key exchanges with AEAD ciphers, on the
+                                                   P-256 and P-384 curves. Clients which support none of
+                                                   them can't connect. */
+    uint32_t session_lifetime_s;              /**< Time for which sessions can be resumed, 0 for one day.
+                                                   Also the lifetime of the ticket keys. */
+    int timeout_ms;                           /**< Timeout of each receive and send, and of the wait for
+                                                   a handshake to start, 0 to block */
+} esp_tls_server_cfg_t;
+
+/**
+ * @brief  Connect to a TLS server
+ *
+ * Resolves the host name, opens a TCP connection to it and performs the TLS
+ * handshake, resuming the session of a previous connection to the same host
+ * and port if there is one.
+ *
+ * @param  hostname  Name of the server, also used for SNI and verification
+ * @param  port      TCP port of the server
+ * @param  cfg       Connection settings
+ * @param  out       Set to the new connection on success
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if an argument is NULL or the CA certificate can't be parsed
+ *         ESP_ERR_NO_MEM if memory for the connection can't be allocated
+ *         ESP_ERR_NOT_FOUND if the host name can't be resolved
+ *         ESP_ERR_TIMEOUT if the server doesn't respond in time
+ *         ESP_FAIL if the connection or the handshake fails
+ */
+esp_err_t esp_tls_conn_new(const char *hostname, uint16_t port, const esp_tls_cfg_t *cfg, esp_tls_t **out);
+
+/**
+ * @brief  Create a TLS server
+ *
+ * Parses the certificate chain and the key, and sets up the configuration
+ * shared by the connections of the server. The PEM buffers aren't needed
+ * afterwards.
+ *
+ * @param  cfg  Server settings
+ * @param  out  Set to the new server on success
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if an argument is NULL or the certificate or key can't be parsed
+ *         ESP_ERR_NO_MEM if memory for the server can't be allocated
+ *         ESP_FAIL if the configuration can't be set up
+ */
+esp_err_t esp_tls_server_new(const esp_tls_server_cfg_t *cfg, esp_tls_server_t **out);
+
+/**
+ * @brief  Perform the TLS handshake with a client
+ *
+ * Waits until fewer than CONFIG_MBEDTLS_TLS_SERVER_HANDSHAKES handshakes of
+ * the server are running, then performs the handshake, resuming the session
+ * of the client if it offers one the server remembers.
+ *
+ * @param  server  Server the client connected to
+ * @param  conn    TCP connection from netconn_accept. The TLS connection
+ *                 takes it over, it is closed if the handshake fails.
+ * @param  out     Set to the new connection on success
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_ARG if an argument is NULL
+ *         ESP_ERR_NO_MEM if memory for the connection can't be allocated
+ *         ESP_ERR_TIMEOUT if the handshake can't start or the client doesn't respond in time
+ *         ESP_FAIL if the handshake fails
+ */
+esp_err_t esp_tls_server_accept(esp_tls_server_t *server, struct netconn *conn, esp_tls_t **out);
+
+/**
+ * @brief  Delete a server
+ *
+ * Connections accepted by the server remain usable; the server is freed
+ * with the last of them.
+ */
+void esp_tls_server_delete(esp_tls_server_t *server);
+
+/**
+ * @brief  Read decrypted application data
+ *
+ * @return number of bytes read, 0 if the server closed the connection, or a
+ *         negative mbedTLS error code (MBEDTLS_ERR_SSL_TIMEOUT on timeout)
+ */
+int esp_tls_conn_read(esp_tls_t *tls, void *data, size_t len);
+
+/**
+ * @brief  Encrypt and send application data
+ *
+ * Data larger than CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN is sent in several
+ * records.
+ *
+ * @return number of bytes sent, or a negative mbedTLS error code
+ */
+int esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t len);
+
+/**
+ * @brief  Whether the handshake of the connection resumed a cached session or a ticket
+ */
+bool esp_tls_conn_session_reused(esp_tls_t *tls);
+
+/**
+ * @brief  Memory mbedTLS allocated during the handshake of the connection
+ *
+ * Only counted with the pool allocator of esp_tls_alloc.h installed, all
+ * zero otherwise. in_use is what the connection kept after the handshake.
+ */
+void esp_tls_conn_get_handshake_mem(esp_tls_t *tls, esp_tls_alloc_stats_t *stats);
+
+/**
+ * @brief  Close the connection and free it
+ *
+ * Sends a close_notify alert to the peer first. The session is kept in
+ * the cache.
+ */
+void esp_tls_conn_delete(esp_tls_t *tls);
+
+/**
+ * @brief  Forget all cached sessions
+ */
+void esp_tls_clear_sessions(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_TLS_H__ */
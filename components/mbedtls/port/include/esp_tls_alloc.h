@@ -0,0 +1,86 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_TLS_ALLOC_H__
+#define __ESP_TLS_ALLOC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocator for mbedTLS, with pools of fixed-size blocks for the small
+ * allocations a handshake makes by the thousand, mostly limb buffers of
+ * bignums.
+ *
+ * The pools are sized for the limb buffers of the curves and RSA key sizes
+ * in use, and together take CONFIG_MBEDTLS_POOL_ALLOC_KB. The pools keep a
+ * list of free blocks for each CPU (see esp_mempool.h), so most allocations
+ * and frees take no lock, and don't take the heap lock either. Allocations
+ * which fit no pool, or whose pool is empty, go to the heap.
+ *
+ * A task can count the memory mbedTLS allocates in a scope, such as a
+ * handshake; esp_tls does this for each of its handshakes.
+ */
+
+typedef struct {
+    size_t in_use;          /**< Bytes allocated in the scope and not freed yet */
+    size_t peak;            /**< Largest value of in_use */
+    uint32_t allocs;        /**< Number of allocations */
+    uint32_t heap_allocs;   /**< Allocations which went to the heap: too large
+                                 for the pools, or their pool was empty */
+} esp_tls_alloc_stats_t;
+
+/**
+ * @brief  Create the pools and make mbedTLS allocate from them
+ *
+ * Call once, before TLS connections are made, e.g. from app_main. Memory
+ * mbedTLS allocated from the heap before can still be freed. Replaces an
+ * allocator set with mbedtls_platform_set_calloc_free before.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the pools can't be allocated
+ */
+esp_err_t esp_tls_alloc_init(void);
+
+/**
+ * @brief  Start counting the allocations of mbedTLS in the calling task
+ *
+ * Until esp_tls_alloc_scope_end, allocations and frees of the calling task
+ * are counted in stats, which is cleared first. Scopes don't nest.
+ *
+ * The scope is remembered in the thread local storage pointer
+ * CONFIG_MBEDTLS_POOL_ALLOC_TLS_INDEX of the task.
+ *
+ * @param  stats  counters of the scope, must stay valid until the scope ends
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED if
+ *         FREERTOS_THREAD_LOCAL_STORAGE_POINTERS isn't larger than
+ *         MBEDTLS_POOL_ALLOC_TLS_INDEX
+ */
+esp_err_t esp_tls_alloc_scope_begin(esp_tls_alloc_stats_t *stats);
+
+/**
+ * @brief  Stop counting the allocations of the calling task
+ */
+void esp_tls_alloc_scope_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_TLS_ALLOC_H__ */
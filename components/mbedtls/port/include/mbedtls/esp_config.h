@@ -27,6 +27,8 @@
 #ifndef MBEDTLS_CONFIG_H
 #define MBEDTLS_CONFIG_H
 
+#include "sdkconfig.h"
+
 #if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_DEPRECATE)
 #define _CRT_SECURE_NO_DEPRECATE 1
 #endif
@@ -108,7 +110,7 @@
  *
  * Enable this layer to allow use of alternative memory allocators.
  */
-//#define MBEDTLS_PLATFORM_MEMORY
+#define MBEDTLS_PLATFORM_MEMORY
 
 /**
  * \def MBEDTLS_PLATFORM_NO_STD_FUNCTIONS
@@ -238,21 +240,46 @@
    uncommenting each _ALT macro will use the
    hardware-accelerated implementation. */
 #define MBEDTLS_AES_ALT
+#define MBEDTLS_GCM_ALT
+
+/* Concurrent hashes of the TLS handshake use the engine of each SHA
+   algorithm in turn and go on in software while it is in use, see
+   hwcrypto/sha.h */
+#define MBEDTLS_SHA1_ALT
+#define MBEDTLS_SHA256_ALT
+#define MBEDTLS_SHA512_ALT
 
-/* Currently hardware SHA does not work with TLS handshake,
-   due to concurrency issue. Internal TW#7111. */
-//#define MBEDTLS_SHA1_ALT
-//#define MBEDTLS_SHA256_ALT
-//#define MBEDTLS_SHA512_ALT
+/* PBKDF2-HMAC-SHA1 (WPA2 PMK derivation) holds the SHA-1 engine for all
+   iterations, see esp_sha1_pbkdf2 in hwcrypto/sha.h */
+#define MBEDTLS_PKCS5_PBKDF2_SHA1_ALT
 
 /* The following MPI (bignum) functions have ESP32 hardware support,
-   Uncommenting these macros will use the hardware-accelerated
-   implementations.
+   Commenting out these macros will use the software implementations.
 
-   Disabled as number of limbs limited by bug. Internal TW#7112.
+   Moduli of up to 4096 bits and products of up to 4096 bits go to the
+   RSA unit, larger operands are calculated in software.
 */
-//#define MBEDTLS_MPI_EXP_MOD_ALT
-//#define MBEDTLS_MPI_MUL_MPI_ALT
+#define MBEDTLS_MPI_EXP_MOD_ALT
+#define MBEDTLS_MPI_MUL_MPI_ALT
+
+/* Elliptic curve field multiplications on the RSA unit as well. Set via
+   menuconfig. */
+#if CONFIG_MBEDTLS_ECP_HARDWARE_MPI
+#define MBEDTLS_ECP_HARDWARE_MPI
+#endif
+
+/* Keep the software implementations of the hardware accelerated functions,
+   to use them while another task uses the hardware unit (see
+   hwcrypto/fallback.h). Set via menuconfig. */
+#if CONFIG_MBEDTLS_HARDWARE_FALLBACK
+#define MBEDTLS_HARDWARE_FALLBACK
+#endif
+
+/* Leave the SHA and RSA units enabled between operations. Set via
+   menuconfig. */
+#if CONFIG_MBEDTLS_HARDWARE_KEEP_ENABLED
+#define MBEDTLS_HARDWARE_KEEP_ENABLED
+#endif
 
 /**
  * \def MBEDTLS_MD2_PROCESS_ALT
@@ -914,6 +941,22 @@
  */
 //#define MBEDTLS_SSL_AEAD_RANDOM_IV
 
+/**
+ * \def MBEDTLS_SSL_CHACHAPOLY_PREFERRED
+ *
+ * Offer the ChaCha20-Poly1305 ciphersuites before all other ephemeral
+ * suites, instead of after AES-256-GCM. ChaCha20-Poly1305 runs fast in
+ * software on 32-bit cores, where AES-GCM without dedicated hardware is slow
+ * and needs large tables.
+ *
+ * Requires: MBEDTLS_CHACHAPOLY_C
+ *
+ * Set via menuconfig.
+ */
+#if CONFIG_MBEDTLS_CHACHAPOLY_PREFERRED
+#define MBEDTLS_SSL_CHACHAPOLY_PREFERRED
+#endif
+
 /**
  * \def MBEDTLS_SSL_ALL_ALERT_MESSAGES
  *
@@ -1621,6 +1664,33 @@
  */
 #define MBEDTLS_CERTS_C
 
+/**
+ * \def MBEDTLS_CHACHA20_C
+ *
+ * Enable the ChaCha20 stream cipher.
+ *
+ * Module:  library/chacha20.c
+ */
+#if CONFIG_MBEDTLS_CHACHAPOLY
+#define MBEDTLS_CHACHA20_C
+#endif
+
+/**
+ * \def MBEDTLS_CHACHAPOLY_C
+ *
+ * Enable the ChaCha20-Poly1305 AEAD algorithm.
+ *
+ * Module:  library/chachapoly.c
+ *
+ * Requires: MBEDTLS_CHACHA20_C, MBEDTLS_POLY1305_C
+ *
+ * This module enables the ChaCha20-Poly1305 ciphersuites (RFC 7905), if
+ * other requisites are enabled as well.
+ */
+#if CONFIG_MBEDTLS_CHACHAPOLY
+#define MBEDTLS_CHACHAPOLY_C
+#endif
+
 /**
  * \def MBEDTLS_CIPHER_C
  *
@@ -2100,6 +2170,18 @@
  */
 #define MBEDTLS_PLATFORM_C
 
+/**
+ * \def MBEDTLS_POLY1305_C
+ *
+ * Enable the Poly1305 MAC algorithm.
+ *
+ * Module:  library/poly1305.c
+ * Caller:  library/chachapoly.c
+ */
+#if CONFIG_MBEDTLS_CHACHAPOLY
+#define MBEDTLS_POLY1305_C
+#endif
+
 /**
  * \def MBEDTLS_RIPEMD160_C
  *
@@ -2481,7 +2563,7 @@
 
 /* SSL options */
 
-#define MBEDTLS_SSL_MAX_CONTENT_LEN             5120 /**< Maxium fragment length in bytes, determines the size of each of the two internal I/O buffers */
+#define MBEDTLS_SSL_MAX_CONTENT_LEN             CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN /**< Maxium fragment length in bytes, determines the size of each of the two internal I/O buffers */
 //#define MBEDTLS_SSL_DEFAULT_TICKET_LIFETIME     86400 /**< Lifetime of session tickets (if enabled) */
 //#define MBEDTLS_PSK_MAX_LEN               32 /**< Max size of TLS pre-shared keys, in bytes (default 256 bits) */
 //#define MBEDTLS_SSL_COOKIE_TIMEOUT        60 /**< Default expiration delay of DTLS cookies, in seconds if HAVE_TIME, or in number of cookies issued */
@@ -35,6 +35,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
 #include <netdb.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -0,0 +1,241 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef __ESP_METRICS_H__
+#define __ESP_METRICS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Metrics registry
+ *
+ * Counters, gauges and histograms are defined with the ESP_METRIC_xxx_DEFINE
+ * macros, next to the code which updates them. The definition places a
+ * descriptor in the .esp_metrics section, so the registry is complete at
+ * link time: there is no registration call, and nothing is allocated.
+ *
+ * Counters and histograms have one slot per CPU. An update masks
+ * interrupts on the current CPU for a few instructions and changes the
+ * slot of that CPU, so it takes no lock and the CPUs never write to the
+ * same word. Reading a metric sums the slots.
+ *
+ * Functions of a subsystem which keeps statistics of its own, such as the
+ * heap or lwIP, can be defined as sources: they are called when a snapshot
+ * is taken, and report their values under the name of the source.
+ *
+ * The snapshot can be printed to the log (esp_metrics_log), converted to
+ * JSON (esp_metrics_write_json), or sent as the HTTP response to a
+ * request on a socket (esp_metrics_http_respond).
+ */
+
+typedef enum {
+    ESP_METRIC_COUNTER,     ///< monotonic count, e.g. of packets or bytes
+    ESP_METRIC_GAUGE,       ///< value which goes up and down, e.g. a queue length
+    ESP_METRIC_HISTOGRAM,   ///< distribution of values over fixed buckets
+    ESP_METRIC_SOURCE,      ///< function reporting counters and gauges of a subsystem
+} esp_metric_type_t;
+
+typedef struct {
+    volatile uint64_t cpu[portNUM_PROCESSORS];
+} esp_metric_counter_t;
+
+typedef struct {
+    volatile int32_t value;
+} esp_metric_gauge_t;
+
+/**
+ * Bucket i counts the values up to bounds[i], those above bounds[i - 1];
+ * the last bucket, bound_count, counts the values above all bounds.
+ */
+typedef struct {
+    const uint32_t* bounds;     ///< upper bounds of the buckets, ascending
+    uint32_t bound_count;
+    volatile uint32_t* counts;  ///< (bound_count + 1) counts per CPU
+    volatile uint64_t sum[portNUM_PROCESSORS];  ///< sum of the values, per CPU
+} esp_metric_histogram_t;
+
+/**
+ * Called by a source for each of its values. name is relative to the name
+ * of the source; type is ESP_METRIC_COUNTER or ESP_METRIC_GAUGE.
+ */
+typedef void (*esp_metric_emit_t)(void* ctx, const char* name, esp_metric_type_t type, int64_t value);
+
+/** A source reports its values by calling emit(ctx, ...) */
+typedef void (*esp_metric_source_t)(esp_metric_emit_t emit, void* ctx);
+
+/** Descriptor of a metric, placed in the .esp_metrics section */
+typedef struct {
+    const char* name;
+    const char* help;
+    esp_metric_type_t type;
+    union {
+        esp_metric_counter_t* counter;
+        esp_metric_gauge_t* gauge;
+        esp_metric_histogram_t* histogram;
+        esp_metric_source_t source;
+    };
+} esp_metric_t;
+
+#define ESP_METRIC_REGISTER_(var_, name_, help_, type_, field_, ptr_) \
+    static const esp_metric_t __attribute__((used, section(".esp_metrics"), aligned(4))) \
+        var_ ## _metric_desc = { .name = name_, .help = help_, .type = type_, .field_ = ptr_ }
+
+/**
+ * Define counter var, named name ("subsystem.what" by convention) in the
+ * snapshots. Put static in front for a counter used in one file only;
+ * other files can use ESP_METRIC_COUNTER_DECLARE(var).
+ */
+#define ESP_METRIC_COUNTER_DEFINE(var, name, help) \
+    esp_metric_counter_t var; \
+    ESP_METRIC_REGISTER_(var, name, help, ESP_METRIC_COUNTER, counter, &var)
+
+#define ESP_METRIC_COUNTER_DECLARE(var)     extern esp_metric_counter_t var
+
+/** Define gauge var, see ESP_METRIC_COUNTER_DEFINE */
+#define ESP_METRIC_GAUGE_DEFINE(var, name, help) \
+    esp_metric_gauge_t var; \
+    ESP_METRIC_REGISTER_(var, name, help, ESP_METRIC_GAUGE, gauge, &var)
+
+#define ESP_METRIC_GAUGE_DECLARE(var)       extern esp_metric_gauge_t var
+
+/**
+ * Define histogram var with buckets up to each of the bounds given after
+ * help, in ascending order, and one above them:
+ *
+ *     ESP_METRIC_HISTOGRAM_DEFINE(s_write_us, "nvs.write_us", "time of nvs_set_*", 100, 1000, 10000);
+ */
+#define ESP_METRIC_HISTOGRAM_DEFINE(var, name, help, ...) \
+    static const uint32_t var ## _metric_bounds[] = { __VA_ARGS__ }; \
+    static volatile uint32_t var ## _metric_counts[portNUM_PROCESSORS] \
+        [sizeof(var ## _metric_bounds) / sizeof(uint32_t) + 1]; \
+    esp_metric_histogram_t var = { \
+        .bounds = var ## _metric_bounds, \
+        .bound_count = sizeof(var ## _metric_bounds) / sizeof(uint32_t), \
+        .counts = &var ## _metric_counts[0][0], \
+    }; \
+    ESP_METRIC_REGISTER_(var, name, help, ESP_METRIC_HISTOGRAM, histogram, &var)
+
+#define ESP_METRIC_HISTOGRAM_DECLARE(var)   extern esp_metric_histogram_t var
+
+/** Register function fn as a source whose values are named "name.<value>" */
+#define ESP_METRIC_SOURCE_DEFINE(fn, name, help) \
+    ESP_METRIC_REGISTER_(fn, name, help, ESP_METRIC_SOURCE, source, fn)
+
+/**
+ * @brief Add n to a counter; can be called from tasks and interrupts
+ */
+static inline void esp_metric_counter_add(esp_metric_counter_t* counter, uint32_t n)
+{
+    unsigned state = portENTER_CRITICAL_NESTED();
+    counter->cpu[xPortGetCoreID()] += n;
+    portEXIT_CRITICAL_NESTED(state);
+}
+
+static inline void esp_metric_counter_inc(esp_metric_counter_t* counter)
+{
+    esp_metric_counter_add(counter, 1);
+}
+
+static inline void esp_metric_gauge_set(esp_metric_gauge_t* gauge, int32_t value)
+{
+    gauge->value = value;
+}
+
+/**
+ * @brief Count value in its bucket of a histogram; can be called from tasks
+ *        and interrupts
+ */
+static inline void esp_metric_histogram_observe(esp_metric_histogram_t* histogram, uint32_t value)
+{
+    uint32_t bucket = 0;
+    while (bucket < histogram->bound_count && value > histogram->bounds[bucket]) {
+        ++bucket;
+    }
+    unsigned state = portENTER_CRITICAL_NESTED();
+    int cpu = xPortGetCoreID();
+    histogram->counts[cpu * (histogram->bound_count + 1) + bucket]++;
+    histogram->sum[cpu] += value;
+    portEXIT_CRITICAL_NESTED(state);
+}
+
+/** @brief Value of a counter, summed over the CPUs */
+uint64_t esp_metric_counter_read(const esp_metric_counter_t* counter);
+
+/** @brief Values counted in bucket of a histogram, over the CPUs */
+uint64_t esp_metric_histogram_bucket(const esp_metric_histogram_t* histogram, uint32_t bucket);
+
+/** @brief Sum of the values counted by a histogram */
+uint64_t esp_metric_histogram_sum(const esp_metric_histogram_t* histogram);
+
+/** @brief Number of metrics linked into the application, sources included */
+size_t esp_metrics_count();
+
+/** @brief Metric index, from 0 to esp_metrics_count() - 1 */
+const esp_metric_t* esp_metrics_get(size_t index);
+
+/** @brief Metric with the given name, or NULL */
+const esp_metric_t* esp_metrics_find(const char* name);
+
+/**
+ * @brief Print all metrics to the log, one line each, at info level
+ *
+ * Histograms are printed as their count, sum, and the count of each
+ * bucket ("le_<bound>", and "inf" for the last one).
+ */
+void esp_metrics_log();
+
+/**
+ * Called with each chunk of JSON text. Return 0 to go on, anything else to
+ * stop.
+ */
+typedef int (*esp_metrics_writer_t)(void* arg, const char* data, size_t len);
+
+/**
+ * @brief Write a snapshot of all metrics as one JSON object
+ *
+ * Counters, gauges and source values are members whose value is a number,
+ * histograms are objects with "count", "sum" and "buckets", an array of
+ * [bound, count] pairs whose last bound is null. The text is written
+ * through buffer, size bytes at a time, whatever the number of metrics.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the snapshot couldn't be built, or
+ *         ESP_FAIL if writer stopped
+ */
+esp_err_t esp_metrics_write_json(char* buffer, size_t size, esp_metrics_writer_t writer, void* arg);
+
+/**
+ * @brief Send the JSON snapshot as an HTTP response on a connected socket
+ *
+ * Writes a "200 OK" response with a chunked body, each chunk holding one
+ * buffer of esp_metrics_write_json. The request itself isn't read; a
+ * server calls this for the URL it serves metrics at, and closes sock
+ * afterwards.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM, or ESP_FAIL if sending failed
+ */
+esp_err_t esp_metrics_http_respond(int sock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_METRICS_H__ */
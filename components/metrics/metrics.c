@@ -0,0 +1,393 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_metrics.h"
+#include "esp_event.h"
+#include "esp_spi_flash.h"
+#include "heap_alloc_caps.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "cJSON_Stream.h"
+#include "lwip/sockets.h"
+#if CONFIG_LWIP_STATS
+#include "lwip/stats.h"
+#endif
+#include "sdkconfig.h"
+
+/* Chunk size of esp_metrics_http_respond, on the stack of the caller */
+#define METRICS_HTTP_CHUNK      512
+/* Longest "source.value" name */
+#define METRICS_NAME_MAX        64
+
+static const char* TAG = "metrics";
+
+/* Start and end of the .esp_metrics section, see esp32.common.ld */
+extern const esp_metric_t _esp_metrics_start;
+extern const esp_metric_t _esp_metrics_end;
+
+/* Read a 64 bit slot which the other CPU may be writing: the high word is
+   read again to catch a carry between the two halves */
+static uint64_t read_u64(const volatile uint64_t* p)
+{
+    const volatile uint32_t* w = (const volatile uint32_t*) p;
+    uint32_t hi, lo;
+    do {
+        hi = w[1];
+        lo = w[0];
+    } while (hi != w[1]);
+    return ((uint64_t) hi << 32) | lo;
+}
+
+uint64_t esp_metric_counter_read(const esp_metric_counter_t* counter)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        sum += read_u64(&counter->cpu[i]);
+    }
+    return sum;
+}
+
+uint64_t esp_metric_histogram_bucket(const esp_metric_histogram_t* histogram, uint32_t bucket)
+{
+    uint64_t sum = 0;
+    if (bucket > histogram->bound_count) {
+        return 0;
+    }
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        sum += histogram->counts[i * (histogram->bound_count + 1) + bucket];
+    }
+    return sum;
+}
+
+uint64_t esp_metric_histogram_sum(const esp_metric_histogram_t* histogram)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        sum += read_u64(&histogram->sum[i]);
+    }
+    return sum;
+}
+
+static uint64_t histogram_count(const esp_metric_histogram_t* histogram)
+{
+    uint64_t count = 0;
+    for (uint32_t b = 0; b <= histogram->bound_count; ++b) {
+        count += esp_metric_histogram_bucket(histogram, b);
+    }
+    return count;
+}
+
+size_t esp_metrics_count()
+{
+    return &_esp_metrics_end - &_esp_metrics_start;
+}
+
+const esp_metric_t* esp_metrics_get(size_t index)
+{
+    if (index >= esp_metrics_count()) {
+        return NULL;
+    }
+    return &_esp_metrics_start + index;
+}
+
+const esp_metric_t* esp_metrics_find(const char* name)
+{
+    for (const esp_metric_t* m = &_esp_metrics_start; m < &_esp_metrics_end; ++m) {
+        if (strcmp(m->name, name) == 0) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+
+/* Sources of the system components */
+
+#if CONFIG_METRICS_SYSTEM_SOURCES
+
+static void heap_source(esp_metric_emit_t emit, void* ctx)
+{
+    HeapStats_t stats;
+    vPortGetHeapStatsCaps(MALLOC_CAP_8BIT, &stats);
+    emit(ctx, "free_bytes", ESP_METRIC_GAUGE, stats.xFreeBytes);
+    emit(ctx, "largest_free_block", ESP_METRIC_GAUGE, stats.xLargestFreeBlock);
+    emit(ctx, "free_blocks", ESP_METRIC_GAUGE, stats.xFreeBlocks);
+    emit(ctx, "allocations", ESP_METRIC_COUNTER, stats.ulAllocations);
+    emit(ctx, "frees", ESP_METRIC_COUNTER, stats.ulFrees);
+    emit(ctx, "failures", ESP_METRIC_COUNTER, stats.ulFailures);
+}
+ESP_METRIC_SOURCE_DEFINE(heap_source, "heap", "byte addressable heap");
+
+static void event_source(esp_metric_emit_t emit, void* ctx)
+{
+    esp_event_stats_t stats;
+    esp_event_get_stats(&stats);
+    emit(ctx, "dropped", ESP_METRIC_COUNTER, stats.dropped);
+    emit(ctx, "coalesced", ESP_METRIC_COUNTER, stats.coalesced);
+    emit(ctx, "queue_high_water", ESP_METRIC_GAUGE, stats.queue_high_water);
+    emit(ctx, "prio_queue_high_water", ESP_METRIC_GAUGE, stats.prio_queue_high_water);
+    emit(ctx, "pool_high_water", ESP_METRIC_GAUGE, stats.pool_high_water);
+    emit(ctx, "pool_exhausted", ESP_METRIC_COUNTER, stats.pool_exhausted);
+}
+ESP_METRIC_SOURCE_DEFINE(event_source, "event", "system event queue");
+
+static void nvs_source(esp_metric_emit_t emit, void* ctx)
+{
+    nvs_stats_t stats;
+    if (nvs_get_stats(&stats) != ESP_OK) {
+        return;
+    }
+    emit(ctx, "used_entries", ESP_METRIC_GAUGE, stats.used_entries);
+    emit(ctx, "erased_entries", ESP_METRIC_GAUGE, stats.erased_entries);
+    emit(ctx, "free_entries", ESP_METRIC_GAUGE, stats.free_entries);
+    emit(ctx, "free_pages", ESP_METRIC_GAUGE, stats.free_pages);
+    emit(ctx, "reclaimed_pages", ESP_METRIC_COUNTER, stats.reclaimed_pages);
+    emit(ctx, "inline_reclaims", ESP_METRIC_COUNTER, stats.inline_reclaims);
+}
+ESP_METRIC_SOURCE_DEFINE(nvs_source, "nvs", "default NVS partition");
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+static void emit_flash_op(esp_metric_emit_t emit, void* ctx, const char* op, const spi_flash_counter_t* c)
+{
+    char name[METRICS_NAME_MAX];
+    snprintf(name, sizeof(name), "%s_count", op);
+    emit(ctx, name, ESP_METRIC_COUNTER, c->count);
+    snprintf(name, sizeof(name), "%s_bytes", op);
+    emit(ctx, name, ESP_METRIC_COUNTER, c->bytes);
+    snprintf(name, sizeof(name), "%s_time_us", op);
+    emit(ctx, name, ESP_METRIC_COUNTER, c->time);
+}
+
+static void flash_source(esp_metric_emit_t emit, void* ctx)
+{
+    const spi_flash_counters_t* counters = spi_flash_get_counters();
+    emit_flash_op(emit, ctx, "read", &counters->read);
+    emit_flash_op(emit, ctx, "write", &counters->write);
+    emit_flash_op(emit, ctx, "erase", &counters->erase);
+    emit(ctx, "mutex_wait_us", ESP_METRIC_COUNTER, counters->mutex_wait_time);
+}
+ESP_METRIC_SOURCE_DEFINE(flash_source, "flash", "SPI flash driver");
+#endif // CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
+#if CONFIG_LWIP_STATS
+static void emit_proto(esp_metric_emit_t emit, void* ctx, const char* proto, const struct stats_proto* s)
+{
+    char name[METRICS_NAME_MAX];
+    snprintf(name, sizeof(name), "%s_xmit", proto);
+    emit(ctx, name, ESP_METRIC_COUNTER, s->xmit);
+    snprintf(name, sizeof(name), "%s_recv", proto);
+    emit(ctx, name, ESP_METRIC_COUNTER, s->recv);
+    snprintf(name, sizeof(name), "%s_drop", proto);
+    emit(ctx, name, ESP_METRIC_COUNTER, s->drop);
+    snprintf(name, sizeof(name), "%s_memerr", proto);
+    emit(ctx, name, ESP_METRIC_COUNTER, s->memerr);
+}
+
+static void lwip_source(esp_metric_emit_t emit, void* ctx)
+{
+    emit_proto(emit, ctx, "link", &lwip_stats.link);
+    emit_proto(emit, ctx, "ip", &lwip_stats.ip);
+    emit_proto(emit, ctx, "udp", &lwip_stats.udp);
+    emit_proto(emit, ctx, "tcp", &lwip_stats.tcp);
+    emit(ctx, "tcp_rto_rexmit", ESP_METRIC_COUNTER, lwip_stats.tcp_ext.rto_rexmit);
+    emit(ctx, "tcp_fast_rexmit", ESP_METRIC_COUNTER, lwip_stats.tcp_ext.fast_rexmit);
+    emit(ctx, "tcp_zerownd", ESP_METRIC_COUNTER, lwip_stats.tcp_ext.zerownd);
+}
+ESP_METRIC_SOURCE_DEFINE(lwip_source, "lwip", "TCP/IP stack");
+#endif // CONFIG_LWIP_STATS
+
+#endif // CONFIG_METRICS_SYSTEM_SOURCES
+
+
+/* Log output */
+
+typedef struct {
+    const char* prefix;
+} log_ctx_t;
+
+static void log_emit(void* arg, const char* name, esp_metric_type_t type, int64_t value)
+{
+    const log_ctx_t* ctx = (const log_ctx_t*) arg;
+    ESP_LOGI(TAG, "%s.%s %lld", ctx->prefix, name, (long long) value);
+}
+
+static void log_histogram(const esp_metric_t* m)
+{
+    const esp_metric_histogram_t* h = m->histogram;
+    char line[256];
+    int len = snprintf(line, sizeof(line), "count=%llu sum=%llu",
+            (unsigned long long) histogram_count(h), (unsigned long long) esp_metric_histogram_sum(h));
+    for (uint32_t b = 0; b <= h->bound_count && len < (int) sizeof(line); ++b) {
+        unsigned long long count = esp_metric_histogram_bucket(h, b);
+        if (b < h->bound_count) {
+            len += snprintf(line + len, sizeof(line) - len, " le_%u=%llu", h->bounds[b], count);
+        } else {
+            len += snprintf(line + len, sizeof(line) - len, " inf=%llu", count);
+        }
+    }
+    ESP_LOGI(TAG, "%s %s", m->name, line);
+}
+
+void esp_metrics_log()
+{
+    for (const esp_metric_t* m = &_esp_metrics_start; m < &_esp_metrics_end; ++m) {
+        switch (m->type) {
+        case ESP_METRIC_COUNTER:
+            ESP_LOGI(TAG, "%s %llu", m->name, (unsigned long long) esp_metric_counter_read(m->counter));
+            break;
+        case ESP_METRIC_GAUGE:
+            ESP_LOGI(TAG, "%s %d", m->name, m->gauge->value);
+            break;
+        case ESP_METRIC_HISTOGRAM:
+            log_histogram(m);
+            break;
+        case ESP_METRIC_SOURCE: {
+            log_ctx_t ctx = { .prefix = m->name };
+            m->source(log_emit, &ctx);
+            break;
+        }
+        }
+    }
+}
+
+
+/* JSON output */
+
+typedef struct {
+    cJSON* root;
+    const char* prefix;
+} json_ctx_t;
+
+static void json_emit(void* arg, const char* name, esp_metric_type_t type, int64_t value)
+{
+    json_ctx_t* ctx = (json_ctx_t*) arg;
+    char full_name[METRICS_NAME_MAX];
+    snprintf(full_name, sizeof(full_name), "%s.%s", ctx->prefix, name);
+    cJSON_AddNumberToObject(ctx->root, full_name, (double) value);
+}
+
+static cJSON* json_histogram(const esp_metric_histogram_t* h)
+{
+    cJSON* obj = cJSON_CreateObject();
+    cJSON* buckets = cJSON_CreateArray();
+    if (obj == NULL || buckets == NULL) {
+        cJSON_Delete(obj);
+        cJSON_Delete(buckets);
+        return NULL;
+    }
+    cJSON_AddNumberToObject(obj, "count", (double) histogram_count(h));
+    cJSON_AddNumberToObject(obj, "sum", (double) esp_metric_histogram_sum(h));
+    cJSON_AddItemToObject(obj, "buckets", buckets);
+    for (uint32_t b = 0; b <= h->bound_count; ++b) {
+        cJSON* pair = cJSON_CreateArray();
+        if (pair == NULL) {
+            break;
+        }
+        cJSON_AddItemToArray(pair, b < h->bound_count ? cJSON_CreateNumber(h->bounds[b]) : cJSON_CreateNull());
+        cJSON_AddItemToArray(pair, cJSON_CreateNumber((double) esp_metric_histogram_bucket(h, b)));
+        cJSON_AddItemToArray(buckets, pair);
+    }
+    return obj;
+}
+
+esp_err_t esp_metrics_write_json(char* buffer, size_t size, esp_metrics_writer_t writer, void* arg)
+{
+    json_ctx_t ctx = { .root = cJSON_CreateObject() };
+    if (ctx.root == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (const esp_metric_t* m = &_esp_metrics_start; m < &_esp_metrics_end; ++m) {
+        switch (m->type) {
+        case ESP_METRIC_COUNTER:
+            cJSON_AddNumberToObject(ctx.root, m->name, (double) esp_metric_counter_read(m->counter));
+            break;
+        case ESP_METRIC_GAUGE:
+            cJSON_AddNumberToObject(ctx.root, m->name, m->gauge->value);
+            break;
+        case ESP_METRIC_HISTOGRAM:
+            cJSON_AddItemToObject(ctx.root, m->name, json_histogram(m->histogram));
+            break;
+        case ESP_METRIC_SOURCE:
+            ctx.prefix = m->name;
+            m->source(json_emit, &ctx);
+            break;
+        }
+    }
+    int ret = cJSONStream_Print(ctx.root, 0, buffer, size, writer, arg);
+    cJSON_Delete(ctx.root);
+    return ret == cJSONStream_Ok ? ESP_OK : ESP_FAIL;
+}
+
+
+/* HTTP output */
+
+static int send_all(int sock, const char* data, size_t len)
+{
+    while (len > 0) {
+        int sent = send(sock, data, len, 0);
+        if (sent <= 0) {
+            return -1;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+static int http_chunk_writer(void* arg, const char* data, size_t len)
+{
+    int sock = *(int*) arg;
+    char size_line[12];
+    int size_len = snprintf(size_line, sizeof(size_line), "%x\r\n", (unsigned) len);
+    if (len == 0) {
+        /* a zero size chunk would end the body */
+        return 0;
+    }
+    if (send_all(sock, size_line, size_len) != 0 ||
+            send_all(sock, data, len) != 0 ||
+            send_all(sock, "\r\n", 2) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+esp_err_t esp_metrics_http_respond(int sock)
+{
+    static const char header[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    static const char trailer[] = "0\r\n\r\n";
+    char buffer[METRICS_HTTP_CHUNK];
+
+    if (send_all(sock, header, sizeof(header) - 1) != 0) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = esp_metrics_write_json(buffer, sizeof(buffer), http_chunk_writer, &sock);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (send_all(sock, trailer, sizeof(trailer) - 1) != 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -1,8 +1,8 @@
-COMPONENT_ADD_LDFLAGS := $(abspath lib/libc.a) $(abspath lib/libm.a)
+COMPONENT_ADD_LDFLAGS := -lnewlib $(abspath lib/libc.a) $(abspath lib/libm.a)
 
-
-define COMPONENT_BUILDRECIPE
-	#Nothing to do; this does not generate a library.
-endef
+# fast_string.c replaces the ROM memcpy & co, keep it optimized in -Og
+# builds, and don't let gcc turn its loops back into calls of the
+# functions themselves.
+CFLAGS += -O2 -fno-tree-loop-distribute-patterns
 
 include $(IDF_PATH)/make/component_common.mk
@@ -0,0 +1,234 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*
+ * memcpy, memmove, memset, memcmp, strlen, strcmp and strcpy, replacing the
+ * size-optimized newlib versions in ROM, which work a byte at a time. The
+ * ROM versions are only PROVIDEd by esp32.rom.ld, and libc_discard.list
+ * removes the newlib ones from libc.a.
+ *
+ * Bulk data is moved in 32-bit words, four per loop iteration so that the
+ * loop overhead is spread over 16 bytes. Copies from a source which isn't
+ * word aligned still use aligned loads, and shift the words into place.
+ * Counted loops turn into zero-overhead loops. Loads may read the bytes up
+ * to the end of the aligned word holding the last byte, which never crosses
+ * into another memory region.
+ *
+ * The functions are in IRAM, as the ROM versions are usable while the
+ * flash cache is disabled, and code running then (spi_flash, interrupt
+ * handlers) uses them.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "sdkconfig.h"
+
+#if CONFIG_NEWLIB_FAST_STRING_FUNCTIONS
+
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+#define WORD_ALIGNED(p)     (((uintptr_t) (p) & 3) == 0)
+/* non-zero if one of the bytes of x is zero */
+#define HAS_ZERO(x)         (((x) - 0x01010101u) & ~(x) & 0x80808080u)
+
+IRAM_ATTR void *memcpy(void *restrict dst, const void *restrict src, size_t n)
+{
+    uint8_t *d = (uint8_t *) dst;
+    const uint8_t *s = (const uint8_t *) src;
+    if (n >= 16) {
+        while (!WORD_ALIGNED(d)) {
+            *d++ = *s++;
+            --n;
+        }
+        word_t *dw = (word_t *) d;
+        if (WORD_ALIGNED(s)) {
+            const word_t *sw = (const word_t *) s;
+            for (size_t i = n / 16; i > 0; --i) {
+                word_t a = sw[0];
+                word_t b = sw[1];
+                word_t c = sw[2];
+                word_t e = sw[3];
+                dw[0] = a;
+                dw[1] = b;
+                dw[2] = c;
+                dw[3] = e;
+                sw += 4;
+                dw += 4;
+            }
+            for (size_t i = (n & 15) / 4; i > 0; --i) {
+                *dw++ = *sw++;
+            }
+        } else {
+            unsigned shift = ((uintptr_t) s & 3) * 8;
+            const word_t *sw = (const word_t *) ((uintptr_t) s & ~3);
+            word_t cur = *sw++;
+            for (size_t i = n / 4; i > 0; --i) {
+                word_t next = *sw++;
+                *dw++ = (cur >> shift) | (next << (32 - shift));
+                cur = next;
+            }
+        }
+        d = (uint8_t *) dw;
+        s += n & ~3;
+        n &= 3;
+    }
+    for (; n > 0; --n) {
+        *d++ = *s++;
+    }
+    return dst;
+}
+
+IRAM_ATTR void *memmove(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = (uint8_t *) dst;
+    const uint8_t *s = (const uint8_t *) src;
+    /* memcpy loads ahead of its stores, so it can copy downwards */
+    if (d <= s || d >= s + n) {
+        return memcpy(dst, src, n);
+    }
+    d += n;
+    s += n;
+    if (n >= 16 && WORD_ALIGNED((uintptr_t) d ^ (uintptr_t) s)) {
+        while (!WORD_ALIGNED(d)) {
+            *--d = *--s;
+            --n;
+        }
+        word_t *dw = (word_t *) d;
+        const word_t *sw = (const word_t *) s;
+        for (size_t i = n / 4; i > 0; --i) {
+            *--dw = *--sw;
+        }
+        d = (uint8_t *) dw;
+        s = (const uint8_t *) sw;
+        n &= 3;
+    }
+    for (; n > 0; --n) {
+        *--d = *--s;
+    }
+    return dst;
+}
+
+IRAM_ATTR void *memset(void *dst, int c, size_t n)
+{
+    uint8_t *d = (uint8_t *) dst;
+    if (n >= 16) {
+        word_t w = (uint8_t) c;
+        w |= w << 8;
+        w |= w << 16;
+        while (!WORD_ALIGNED(d)) {
+            *d++ = (uint8_t) c;
+            --n;
+        }
+        word_t *dw = (word_t *) d;
+        for (size_t i = n / 16; i > 0; --i) {
+            dw[0] = w;
+            dw[1] = w;
+            dw[2] = w;
+            dw[3] = w;
+            dw += 4;
+        }
+        for (size_t i = (n & 15) / 4; i > 0; --i) {
+            *dw++ = w;
+        }
+        d = (uint8_t *) dw;
+        n &= 3;
+    }
+    for (; n > 0; --n) {
+        *d++ = (uint8_t) c;
+    }
+    return dst;
+}
+
+IRAM_ATTR int memcmp(const void *a, const void *b, size_t n)
+{
+    const uint8_t *p = (const uint8_t *) a;
+    const uint8_t *q = (const uint8_t *) b;
+    if (n >= 8 && WORD_ALIGNED((uintptr_t) p ^ (uintptr_t) q)) {
+        for (; !WORD_ALIGNED(p); --n, ++p, ++q) {
+            if (*p != *q) {
+                return *p - *q;
+            }
+        }
+        const word_t *pw = (const word_t *) p;
+        const word_t *qw = (const word_t *) q;
+        /* the bytes of the first differing word are compared below */
+        for (; n >= 4 && *pw == *qw; n -= 4) {
+            ++pw;
+            ++qw;
+        }
+        p = (const uint8_t *) pw;
+        q = (const uint8_t *) qw;
+    }
+    for (; n > 0; --n, ++p, ++q) {
+        if (*p != *q) {
+            return *p - *q;
+        }
+    }
+    return 0;
+}
+
+IRAM_ATTR size_t strlen(const char *str)
+{
+    const char *s = str;
+    for (; !WORD_ALIGNED(s); ++s) {
+        if (*s == '\0') {
+            return s - str;
+        }
+    }
+    const word_t *w = (const word_t *) s;
+    while (!HAS_ZERO(*w)) {
+        ++w;
+    }
+    for (s = (const char *) w; *s != '\0'; ++s) {
+    }
+    return s - str;
+}
+
+IRAM_ATTR int strcmp(const char *a, const char *b)
+{
+    if (WORD_ALIGNED((uintptr_t) a | (uintptr_t) b)) {
+        const word_t *p = (const word_t *) a;
+        const word_t *q = (const word_t *) b;
+        while (*p == *q && !HAS_ZERO(*p)) {
+            ++p;
+            ++q;
+        }
+        a = (const char *) p;
+        b = (const char *) q;
+    }
+    while (*a != '\0' && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return (uint8_t) *a - (uint8_t) *b;
+}
+
+IRAM_ATTR char *strcpy(char *dst, const char *src)
+{
+    char *d = dst;
+    if (WORD_ALIGNED((uintptr_t) d | (uintptr_t) src)) {
+        word_t *dw = (word_t *) d;
+        const word_t *sw = (const word_t *) src;
+        while (!HAS_ZERO(*sw)) {
+            *dw++ = *sw++;
+        }
+        d = (char *) dw;
+        src = (const char *) sw;
+    }
+    while ((*d++ = *src++) != '\0') {
+    }
+    return dst;
+}
+
+#endif /* CONFIG_NEWLIB_FAST_STRING_FUNCTIONS */
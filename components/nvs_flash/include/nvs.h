@@ -41,12 +41,50 @@ typedef uint32_t nvs_handle;
 #define ESP_ERR_NVS_PAGE_FULL           (ESP_ERR_NVS_BASE + 0x0a)
 #define ESP_ERR_NVS_INVALID_STATE       (ESP_ERR_NVS_BASE + 0x0b)
 #define ESP_ERR_NVS_INVALID_LENGTH      (ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_CORRUPT_KEY_PART    (ESP_ERR_NVS_BASE + 0x0d)
+
+#define NVS_DEFAULT_PART_NAME           "nvs"   /*!< Label of the partition used by nvs_open */
+#define NVS_PART_NAME_MAX_SIZE          16      /*!< Maximal length of a partition label */
 
 typedef enum {
 	NVS_READONLY,
-	NVS_READWRITE
+	NVS_READWRITE,
+	NVS_READWRITE_TRANSACTION
 } nvs_open_mode;
 
+/**
+ * Types of values, as reported by nvs_entry_info
+ */
+typedef enum {
+	NVS_TYPE_U8   = 0x01,
+	NVS_TYPE_I8   = 0x11,
+	NVS_TYPE_U16  = 0x02,
+	NVS_TYPE_I16  = 0x12,
+	NVS_TYPE_U32  = 0x04,
+	NVS_TYPE_I32  = 0x14,
+	NVS_TYPE_U64  = 0x08,
+	NVS_TYPE_I64  = 0x18,
+	NVS_TYPE_STR  = 0x21,
+	NVS_TYPE_BLOB = 0x41,
+	NVS_TYPE_ARRAY = 0x58,      /*!< Array of integers, see nvs_set_array */
+	NVS_TYPE_COUNTER = 0x64,    /*!< Counter, see nvs_increment_counter */
+	NVS_TYPE_ANY  = 0xff
+} nvs_type_t;
+
+/**
+ * Information about an entry, filled in by nvs_entry_info
+ */
+typedef struct {
+	char namespace_name[16];    /*!< Namespace of the entry, zero terminated */
+	char key[16];               /*!< Key of the entry, zero terminated */
+	nvs_type_t type;            /*!< Type of the value */
+} nvs_entry_info_t;
+
+/**
+ * Opaque pointer type representing an iterator over entries
+ */
+typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
+
 /**
  * @brief      Open non-volatile storage with a given namespace
  *
@@ -57,9 +95,13 @@ typedef enum {
  * @param[in]  name        Namespace name. Maximal length is determined by the
  *                         underlying implementation, but is guaranteed to be
  *                         at least 16 characters. Shouldn't be empty.
- * @param[in]  open_mode   NVS_READWRITE or NVS_READONLY. If NVS_READONLY, will 
- *						   open a handle for reading only. All write requests will 
- *						   be rejected for this handle.
+ * @param[in]  open_mode   NVS_READWRITE, NVS_READWRITE_TRANSACTION or NVS_READONLY.
+ *                         If NVS_READONLY, will open a handle for reading only.
+ *                         All write requests will be rejected for this handle.
+ *                         If NVS_READWRITE_TRANSACTION, values set through this
+ *                         handle are kept in RAM and written together by
+ *                         nvs_commit. Reads through the same handle return
+ *                         the staged values.
  * @param[out] out_handle  If successful (return code is zero), handle will be
  *                         returned in this argument.
  *
@@ -72,6 +114,34 @@ typedef enum {
  */
 esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_handle);
 
+/**
+ * @brief      Open a namespace in the NVS partition with the given label
+ *
+ * Each partition has its own storage, lock and handles, so that a partition
+ * which is written often doesn't hold up readers of another one. The handle
+ * stays bound to the partition it was opened in, and is used with the same
+ * functions as handles returned by nvs_open, which opens namespaces in
+ * NVS_DEFAULT_PART_NAME.
+ *
+ * On the chip, a partition which was not initialized with
+ * nvs_flash_init_partition yet is mounted by the first call which opens
+ * a namespace in it.
+ *
+ * @param[in]  part_name   Label of the partition, at most NVS_PART_NAME_MAX_SIZE
+ *                         characters.
+ * @param[in]  name        Namespace name, see nvs_open.
+ * @param[in]  open_mode   Open mode, see nvs_open.
+ * @param[out] out_handle  If successful (return code is zero), handle will be
+ *                         returned in this argument.
+ *
+ * @return     - ESP_OK if storage handle was opened successfully
+ *             - ESP_ERR_NOT_FOUND if there is no data partition with this label
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the partition is not initialized
+ *             - other error codes from nvs_open, and from nvs_flash_init_partition
+ *               when the partition is mounted
+ */
+esp_err_t nvs_open_from_partition(const char* part_name, const char* name, nvs_open_mode open_mode, nvs_handle *out_handle);
+
 /**
  * @brief      nvs_set_X - set value for given key
  *
@@ -86,6 +156,10 @@ esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_ha
  *                     16 characters. Shouldn't be empty.
  * @param[in]  value   The value to set.
  * @param[in]  length  For nvs_set_blob: length of binary value to set, in bytes.
+ *                     Blobs which don't fit into one page are stored in chunks
+ *                     spread over several pages. Handles opened with
+ *                     NVS_READWRITE_TRANSACTION only accept blobs which fit
+ *                     into one page.
  *
  * @return     - ESP_OK if value was set successfully
  *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
@@ -97,6 +171,8 @@ esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_ha
  *               write operation has failed. The value was written however, and
  *               update will be finished after re-initialization of nvs, provided that
  *               flash operation doesn't fail again.
+ *             - ESP_ERR_NO_MEM if the handle was opened with NVS_READWRITE_TRANSACTION
+ *               and there is not enough memory to stage the value
  */
 esp_err_t nvs_set_i8  (nvs_handle handle, const char* key, int8_t value);
 esp_err_t nvs_set_u8  (nvs_handle handle, const char* key, uint8_t value);
@@ -180,6 +256,194 @@ esp_err_t nvs_get_u64 (nvs_handle handle, const char* key, uint64_t* out_value);
 esp_err_t nvs_get_str (nvs_handle handle, const char* key, char* out_value, size_t* length);
 esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length);
 
+/**
+ * @brief      nvs_blob_X - read or write a blob in parts
+ *
+ * These functions give access to a blob without holding the whole value in
+ * one buffer. Each handle can have one blob open at a time.
+ *
+ * nvs_blob_open opens an existing blob for reading, and returns its length.
+ * nvs_blob_read then reads any part of it. If the blob is read in order
+ * up to the end, CRC of the data is checked along the way, at the end of
+ * the value or of each of its chunks.
+ *
+ * nvs_blob_create starts writing a new value of the given length for the key.
+ * Data is passed to nvs_blob_write in parts of any size, in order. The new
+ * value replaces the old one when nvs_blob_close is called after all of the
+ * data has been written. Writing or erasing other values before that aborts
+ * the write, and subsequent nvs_blob_write calls fail with
+ * ESP_ERR_NVS_INVALID_STATE. Blobs which don't fit into one page are
+ * written in chunks, and if there is no space left for the next chunk,
+ * nvs_blob_write fails with ESP_ERR_NVS_NOT_ENOUGH_SPACE and the write is
+ * aborted.
+ *
+ * Example (without error checking) of reading a certificate in parts:
+ *
+ * size_t size;
+ * nvs_blob_open(my_handle, "cert", &size);
+ * for (size_t offset = 0; offset < size; offset += sizeof(chunk)) {
+ *     size_t count = (size - offset < sizeof(chunk)) ? size - offset : sizeof(chunk);
+ *     nvs_blob_read(my_handle, offset, chunk, count);
+ *     ...
+ * }
+ * nvs_blob_close(my_handle);
+ *
+ * @param[in]  handle     Handle obtained from nvs_open function.
+ * @param[in]  key        Key name.
+ * @param[out] length     For nvs_blob_open: length of the blob.
+ * @param[in]  length     For nvs_blob_create: length of the blob which will be written.
+ *                        For nvs_blob_read and nvs_blob_write: number of bytes to read or write.
+ * @param[in]  offset     For nvs_blob_read: offset of the first byte to read.
+ *
+ * @return     - ESP_OK if the operation was successful
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY for nvs_blob_create on a read only handle
+ *             - ESP_ERR_NVS_INVALID_STATE if another blob is already open on the
+ *               handle, if no blob is open, if the write was aborted, or if the
+ *               value being read was changed since nvs_blob_open, or for
+ *               nvs_blob_create on a handle opened with NVS_READWRITE_TRANSACTION
+ *             - ESP_ERR_NVS_INVALID_LENGTH if a read or write goes past the end of
+ *               the blob, or if nvs_blob_close is called before all data was written;
+ *               in the latter case the new value is discarded
+ *             - ESP_ERR_NVS_NOT_FOUND if key doesn't exist, or if CRC of the data
+ *               read doesn't match
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space left for
+ *               the blob
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_open  (nvs_handle handle, const char* key, size_t* length);
+esp_err_t nvs_blob_create(nvs_handle handle, const char* key, size_t length);
+esp_err_t nvs_blob_read  (nvs_handle handle, size_t offset, void* out_value, size_t length);
+esp_err_t nvs_blob_write (nvs_handle handle, const void* value, size_t length);
+esp_err_t nvs_blob_close (nvs_handle handle);
+
+/**
+ * @brief      nvs_X_array - store an array of integers of which single
+ *             elements or ranges can be replaced
+ *
+ * Unlike a blob, an array is kept in segments of 32 bytes, each of them
+ * taking two entries of a page. nvs_set_array_range writes only the
+ * segments holding elements which change, two entries each, and leaves
+ * the rest of the array in place. This suits tables of which single
+ * values are tuned often.
+ *
+ * nvs_set_array writes a new array of count elements of the given integer
+ * type, replacing the current value of the key. An array holds at most
+ * 8192 bytes. nvs_set_array_range and nvs_get_array_range replace or read
+ * count elements starting at element first, which have to be within the
+ * array, using the type the array was written with.
+ *
+ * nvs_get_array reads the whole array. If out_values is NULL, count is
+ * set to the number of elements. Otherwise, count holds the number of
+ * elements out_values has room for, and is set to the number of elements
+ * read.
+ *
+ * A range of elements in more than one segment is not replaced
+ * atomically: if power goes out during nvs_set_array_range, each segment
+ * holds either the old or the new elements. Replacing elements of one
+ * segment is atomic.
+ *
+ * Example (without error checking) of tuning one value of a table:
+ *
+ * uint16_t table[64];
+ * nvs_set_array(my_handle, "calib", NVS_TYPE_U16, table, 64);
+ * ...
+ * uint16_t value = 1234;
+ * nvs_set_array_range(my_handle, "calib", NVS_TYPE_U16, 17, &value, 1);
+ *
+ * @param[in]     handle      Handle obtained from nvs_open function.
+ * @param[in]     key         Key name.
+ * @param[in]     type        Type of the elements, one of the integer types
+ *                            NVS_TYPE_U8 to NVS_TYPE_I64.
+ * @param[in]     first       Index of the first element to replace or read.
+ * @param[in]     count       Number of elements.
+ * @param[inout]  count       For nvs_get_array, see above.
+ *
+ * @return     - ESP_OK if the operation was successful
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY for nvs_set_array and nvs_set_array_range
+ *               on a read only handle
+ *             - ESP_ERR_NVS_INVALID_STATE for nvs_set_array and
+ *               nvs_set_array_range on a handle opened with
+ *               NVS_READWRITE_TRANSACTION, arrays are written immediately
+ *             - ESP_ERR_NVS_TYPE_MISMATCH if type is not an integer type, if the
+ *               array has elements of another type, or if the key holds a
+ *               value which is not an array
+ *             - ESP_ERR_NVS_INVALID_LENGTH if count is 0 or the array is too
+ *               large, if the elements are not within the array, or if
+ *               out_values of nvs_get_array has room for fewer elements than
+ *               the array has
+ *             - ESP_ERR_NVS_NOT_FOUND if the key doesn't exist
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space left
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_set_array      (nvs_handle handle, const char* key, nvs_type_t type, const void* values, size_t count);
+esp_err_t nvs_set_array_range(nvs_handle handle, const char* key, nvs_type_t type, size_t first, const void* values, size_t count);
+esp_err_t nvs_get_array      (nvs_handle handle, const char* key, nvs_type_t type, void* out_values, size_t* count);
+esp_err_t nvs_get_array_range(nvs_handle handle, const char* key, nvs_type_t type, size_t first, void* out_values, size_t count);
+
+/**
+ * @brief      nvs_X_counter - keep a 32-bit counter which is incremented often
+ *
+ * A counter is kept in an item of three entries. The first holds the value
+ * the counter was set to, and each increment clears one bit of the other
+ * two, which is a single write of a word to flash. Only every 512th
+ * increment writes a new item and erases the old one, so that counters of
+ * boots or events don't use up pages the way nvs_set_u32 does. With
+ * CONFIG_NVS_ENCRYPTION, bits of the encrypted entries can't be cleared,
+ * and each increment writes a new item of one entry.
+ *
+ * nvs_set_counter sets the counter to value. nvs_increment_counter adds
+ * one to it, and returns the new value in out_value unless it is NULL; a
+ * counter which doesn't exist is created with value 1. The value wraps
+ * around to 0 after 0xffffffff.
+ *
+ * Counters are written immediately, also on handles opened with
+ * NVS_READWRITE_TRANSACTION, for which the set and increment functions
+ * return ESP_ERR_NVS_INVALID_STATE.
+ *
+ * @param[in]   handle     Handle obtained from nvs_open function.
+ * @param[in]   key        Key name.
+ * @param[in]   value      For nvs_set_counter: new value of the counter.
+ * @param[out]  out_value  Value of the counter.
+ *
+ * @return     - ESP_OK if the operation was successful
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY for nvs_set_counter and nvs_increment_counter
+ *               on a read only handle
+ *             - ESP_ERR_NVS_INVALID_STATE for nvs_set_counter and
+ *               nvs_increment_counter on a handle opened with
+ *               NVS_READWRITE_TRANSACTION
+ *             - ESP_ERR_NVS_NOT_FOUND for nvs_get_counter if the counter doesn't exist
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space left
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_set_counter      (nvs_handle handle, const char* key, uint32_t value);
+esp_err_t nvs_increment_counter(nvs_handle handle, const char* key, uint32_t* out_value);
+esp_err_t nvs_get_counter      (nvs_handle handle, const char* key, uint32_t* out_value);
+
+/**
+ * @brief      Erase all key-value pairs in the namespace of the handle
+ *
+ * Items are erased in one pass over all pages, rather than looked up key by
+ * key. Pages which only hold items of this namespace are erased as a whole
+ * and can be reused at once. The namespace itself remains, so the handle
+ * and other handles opened for it stay valid.
+ *
+ * The change takes effect immediately, also for handles opened with
+ * NVS_READWRITE_TRANSACTION; values staged on the handle are discarded.
+ * A blob being written in parts is aborted.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open. Handles opened
+ *                     as read only fail with ESP_ERR_NVS_READ_ONLY.
+ *
+ * @return     - ESP_OK if all items of the namespace were erased
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_erase_all(nvs_handle handle);
+
 /**
  * @brief      Write any pending changes to non-volatile storage
  *
@@ -187,11 +451,21 @@ esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size
  * to non-volatile storage. Individual implementations may write to storage at other times,
  * but this is not guaranteed.
  *
+ * For handles opened with NVS_READWRITE_TRANSACTION, all values set since the
+ * previous commit are written as consecutive entries, and the entries they
+ * replace are erased afterwards. This takes fewer flash operations than
+ * setting the values one by one on an NVS_READWRITE handle. The commit is
+ * atomic: if power is lost or the commit fails, either all of the values
+ * are stored, or none of them. All values of a commit have to fit into one
+ * page.
+ *
  * @param[in]  handle  Storage handle obtained with nvs_open. If handle has to be
  *                     opened as not read only for this call to succeed.
  *
  * @return     - ESP_OK if the changes have been written successfully
  *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if the staged values don't fit
+ *               into one page, or there is not enough free space for them
  *             - other error codes from the underlying storage driver
  */
 esp_err_t nvs_commit(nvs_handle handle);
@@ -209,6 +483,139 @@ esp_err_t nvs_commit(nvs_handle handle);
  */
 void nvs_close(nvs_handle handle);
 
+/**
+ * Usage of the storage, filled in by nvs_get_stats. Counts are in entries
+ * of 32 bytes; a page holds 126 entries.
+ */
+typedef struct {
+	size_t used_entries;    /*!< Entries holding current values */
+	size_t erased_entries;  /*!< Entries holding old or erased values, which can be reclaimed */
+	size_t free_entries;    /*!< Entries which can be written without reclaiming a page */
+	size_t total_entries;   /*!< Entries in all pages of the partition */
+	size_t free_pages;      /*!< Pages which are erased and unused; one is kept for reclaiming */
+	size_t namespace_count; /*!< Number of namespaces */
+	uint32_t reclaimed_pages; /*!< Pages reclaimed since nvs_flash_init */
+	uint32_t inline_reclaims; /*!< Of those, pages which a write had to reclaim before it could continue */
+} nvs_stats_t;
+
+/**
+ * @brief      Get statistics about how full the storage is
+ *
+ * Entries counted as erased take space until the page they are in is
+ * reclaimed, which happens when a write needs a new page and no more than
+ * one free page is left. A large number of erased entries next to few free
+ * entries means that such writes are about to become slow, or that the
+ * partition is too small for the data it holds. inline_reclaims tells how
+ * often this happened in the foreground; with CONFIG_NVS_GC_TASK, most
+ * pages are reclaimed by the background task instead.
+ *
+ * @param[out] out_stats  Storage statistics.
+ *
+ * @return     - ESP_OK if statistics were retrieved
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the storage driver is not initialized
+ */
+esp_err_t nvs_get_stats(nvs_stats_t* out_stats);
+
+/**
+ * @brief      Get statistics of the NVS partition with the given label
+ *
+ * Same as nvs_get_stats, for a partition other than NVS_DEFAULT_PART_NAME.
+ *
+ * @param[in]  part_name  Label of the partition.
+ * @param[out] out_stats  Storage statistics.
+ *
+ * @return     - ESP_OK if statistics were retrieved
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the partition is not initialized
+ */
+esp_err_t nvs_get_partition_stats(const char* part_name, nvs_stats_t* out_stats);
+
+/**
+ * Counters of the cache of integer values, filled in by nvs_get_cache_stats
+ */
+typedef struct {
+	uint32_t hits;          /*!< Number of nvs_get_* calls answered from the cache */
+	uint32_t misses;        /*!< Number of nvs_get_* calls which had to read flash */
+	size_t used;            /*!< Number of values currently cached */
+	size_t capacity;        /*!< Number of values the cache can hold */
+} nvs_cache_stats_t;
+
+/**
+ * @brief      Get statistics of the cache of integer values
+ *
+ * Values read with nvs_get_i8 ... nvs_get_u64 are kept in a small cache,
+ * see CONFIG_NVS_ITEM_CACHE_SIZE, so that reading them again doesn't go to
+ * flash. Counters are reset by nvs_flash_init.
+ *
+ * @param[out] out_stats  Cache statistics.
+ *
+ * @return     - ESP_OK if statistics were retrieved
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the storage driver is not initialized
+ */
+esp_err_t nvs_get_cache_stats(nvs_cache_stats_t* out_stats);
+
+/**
+ * @brief      nvs_entry_X - enumerate entries stored in NVS
+ *
+ * nvs_entry_find creates an iterator positioned on the first entry of the
+ * given type in a namespace, or in all namespaces if namespace_name is
+ * NULL. nvs_entry_next moves it to the following entry. Each step
+ * continues scanning flash from the position of the previous entry, so
+ * enumerating all entries reads each of them about once. Values staged in
+ * handles opened with NVS_READWRITE_TRANSACTION are not visited.
+ *
+ * If values are set or erased while iterating, entries which were changed
+ * in the meantime may be visited twice or not at all.
+ *
+ * nvs_entry_find enumerates entries in NVS_DEFAULT_PART_NAME, and
+ * nvs_entry_find_in_partition those of the partition with the given label.
+ * The iterator keeps the partition it was created for.
+ *
+ * Once the end is reached, or if a step fails, nvs_entry_next releases the
+ * iterator and sets it to NULL. Iterators which are not used up have to be released with
+ * nvs_release_iterator.
+ *
+ * Example (without error checking) of listing keys in a namespace:
+ *
+ * nvs_iterator_t it;
+ * esp_err_t err = nvs_entry_find("config", NVS_TYPE_ANY, &it);
+ * while (err == ESP_OK) {
+ *     nvs_entry_info_t info;
+ *     nvs_entry_info(it, &info);
+ *     printf("%s type=%d\n", info.key, info.type);
+ *     err = nvs_entry_next(&it);
+ * }
+ *
+ * @param[in]    part_name       For nvs_entry_find_in_partition: label of the partition.
+ * @param[in]    namespace_name  Namespace to enumerate, or NULL for all namespaces.
+ * @param[in]    type            Type of entries to visit, NVS_TYPE_ANY for all types.
+ * @param[out]   out_iterator    For nvs_entry_find: new iterator, or NULL if
+ *                               there are no matching entries.
+ * @param[inout] iterator        For nvs_entry_next: iterator to advance. Set to
+ *                               NULL, and released, once the end is reached.
+ * @param[out]   out_info        For nvs_entry_info: information about the entry.
+ *
+ * @return     - ESP_OK if the iterator is positioned on an entry, or if the
+ *               information was retrieved
+ *             - ESP_ERR_NVS_NOT_FOUND if there are no more matching entries,
+ *               or if the namespace doesn't exist
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the storage driver, or the
+ *               partition, is not initialized
+ *             - ESP_ERR_NVS_INVALID_HANDLE if iterator is NULL
+ *             - ESP_ERR_NO_MEM if there is not enough memory for the iterator
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_entry_find(const char* namespace_name, nvs_type_t type, nvs_iterator_t* out_iterator);
+esp_err_t nvs_entry_find_in_partition(const char* part_name, const char* namespace_name, nvs_type_t type, nvs_iterator_t* out_iterator);
+esp_err_t nvs_entry_next(nvs_iterator_t* iterator);
+esp_err_t nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t* out_info);
+
+/**
+ * @brief      Release an iterator obtained with nvs_entry_find
+ *
+ * @param[in]  iterator  Iterator to release. May be NULL.
+ */
+void nvs_release_iterator(nvs_iterator_t iterator);
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -18,8 +18,28 @@
 extern "C" {
 #endif
 
+/**
+ * Initialize the default NVS instance, NVS_DEFAULT_PART_NAME, in the given
+ * range of flash sectors. Handles opened before are closed.
+ */
 esp_err_t nvs_flash_init(uint32_t baseSector, uint32_t sectorCount);
 
+/**
+ * Initialize the NVS instance of a partition in the given range of flash
+ * sectors. Each instance has its own storage, lock and handles, see
+ * nvs_open_from_partition. An instance which exists already is loaded again,
+ * and handles opened in it are closed. At most 16 instances can be created.
+ */
+esp_err_t nvs_flash_init_custom(const char* partName, uint32_t baseSector, uint32_t sectorCount);
+
+/**
+ * Initialize NVS in the data partition with the given label, see
+ * esp_partition.h. Returns ESP_ERR_NOT_FOUND if there is no such partition.
+ * Partitions which are not initialized with this function are mounted on
+ * first use by nvs_open_from_partition.
+ */
+esp_err_t nvs_flash_init_partition(const char* label);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,297 @@
+#!/usr/bin/env python
+#
+# NVS partition image generator
+#
+# Writes an image of an NVS partition holding the keys of a CSV file, in the
+# page and entry layout of nvs_page.hpp and nvs_types.hpp, to be flashed at
+# the offset of the partition. NVS mounts it like a partition which was
+# written by nvs_set_*, with the keys packed into as few pages as possible.
+#
+# CSV format, one key per line, # starts a comment:
+#
+#   key,type,encoding,value
+#   my_namespace,namespace,,
+#   serial,data,string,SN-000123
+#   calibration,file,binary,calib.bin
+#   mac,data,hex2bin,24:0a:c4:00:00:01
+#
+# A "namespace" line opens the namespace of the keys which follow. The
+# encoding of "data" lines is one of u8, i8, u16, i16, u32, i32, u64, i64,
+# string, hex2bin (hex digits, separators ignored) and base64; strings are
+# stored like nvs_set_str, the others like nvs_set_blob. For "file" lines,
+# the value is the path of a file (relative to the CSV file) whose contents
+# are stored as a string ("string" encoding) or as a blob ("binary",
+# "hex2bin" or "base64" encoding).
+import argparse
+import base64
+import binascii
+import os
+import struct
+import sys
+import zlib
+
+__version__ = '1.0'
+
+SECTOR_SIZE = 4096
+ENTRY_SIZE = 32
+ENTRY_COUNT = 126
+ENTRY_TABLE_OFFSET = 32
+ENTRY_DATA_OFFSET = 64
+# largest string or blob chunk which fits into a page, Page::CHUNK_MAX_SIZE
+CHUNK_MAX_SIZE = (ENTRY_COUNT - 1) * ENTRY_SIZE
+MAX_KEY_LENGTH = 15
+MAX_CHUNKS = 128
+MAX_NAMESPACES = 254
+
+PAGE_STATE_ACTIVE = 0xfffffffe
+PAGE_STATE_FULL = 0xfffffffc
+ENTRY_STATE_WRITTEN = 0x2
+CHUNK_ANY = 0xffff
+
+TYPES = {
+    'u8': (0x01, '<B'),
+    'i8': (0x11, '<b'),
+    'u16': (0x02, '<H'),
+    'i16': (0x12, '<h'),
+    'u32': (0x04, '<I'),
+    'i32': (0x14, '<i'),
+    'u64': (0x08, '<Q'),
+    'i64': (0x18, '<q'),
+}
+TYPE_SZ = 0x21
+TYPE_BLOB = 0x41
+TYPE_BLOB_DATA = 0x42
+TYPE_BLOB_IDX = 0x48
+
+quiet = False
+
+
+def status(msg):
+    """ Print status message to stderr """
+    if not quiet:
+        sys.stderr.write(msg)
+        sys.stderr.write('\n')
+
+
+class InputError(RuntimeError):
+    def __init__(self, e):
+        super(InputError, self).__init__(e)
+
+
+def crc32(data):
+    """ crc32_le(0xffffffff, data) of the ROM """
+    return zlib.crc32(bytes(data), 0xffffffff) & 0xffffffff
+
+
+def make_item(ns_index, datatype, span, key, data):
+    """ Item of nvs_types.hpp, with 8 bytes of data """
+    item = bytearray(struct.pack('<BBBBI', ns_index, datatype, span, 0xff, 0))
+    item += bytearray(key.encode('ascii')).ljust(16, b'\0')
+    item += bytearray(data).ljust(8, b'\xff')
+    struct.pack_into('<I', item, 4, crc32(item[0:4] + item[8:32]))
+    return item
+
+
+class Page(object):
+    def __init__(self, seq):
+        self.seq = seq
+        self.entries = []
+
+    def free_entries(self):
+        return ENTRY_COUNT - len(self.entries)
+
+    def var_data_tailroom(self):
+        """ Data bytes of the largest variable length item which still fits """
+        return max(self.free_entries() - 1, 0) * ENTRY_SIZE
+
+    def to_binary(self, state):
+        header = bytearray(struct.pack('<III', state, self.seq, 0))
+        header += b'\xff' * 16
+        header += struct.pack('<I', crc32(header[4:28]))
+        table = bytearray(b'\xff' * 32)
+        for i in range(len(self.entries)):
+            word, bit = divmod(i * 2, 32)
+            value = struct.unpack_from('<I', table, word * 4)[0]
+            value &= ~(0x3 << bit) & 0xffffffff
+            value |= ENTRY_STATE_WRITTEN << bit
+            struct.pack_into('<I', table, word * 4, value)
+        data = header + table
+        for entry in self.entries:
+            data += entry
+        return bytes(data.ljust(SECTOR_SIZE, b'\xff'))
+
+
+class Image(object):
+    def __init__(self, size):
+        if size % SECTOR_SIZE != 0 or size < 2 * SECTOR_SIZE:
+            raise InputError('Partition size 0x%x must be a multiple of 0x%x of at least two sectors' % (size, SECTOR_SIZE))
+        self.size = size
+        self.pages = [Page(0)]
+        self.namespaces = {}
+
+    def page_for(self, entry_count):
+        page = self.pages[-1]
+        if page.free_entries() < entry_count:
+            page = Page(page.seq + 1)
+            self.pages.append(page)
+        return page
+
+    def add_namespace(self, name):
+        check_key(name)
+        if name not in self.namespaces:
+            if len(self.namespaces) == MAX_NAMESPACES:
+                raise InputError('Too many namespaces')
+            index = len(self.namespaces) + 1
+            self.namespaces[name] = index
+            self.page_for(1).entries.append(make_item(0, 0x01, 1, name, [index]))
+        return self.namespaces[name]
+
+    def add_primitive(self, ns_index, key, encoding, value):
+        datatype, fmt = TYPES[encoding]
+        try:
+            data = struct.pack(fmt, int(value, 0))
+        except (ValueError, struct.error):
+            raise InputError('Value %r of key %s is not a valid %s' % (value, key, encoding))
+        self.page_for(1).entries.append(make_item(ns_index, datatype, 1, key, data))
+
+    def add_var_item(self, page, ns_index, datatype, key, data, chunk_index):
+        data = bytearray(data)
+        span = 1 + (len(data) + ENTRY_SIZE - 1) // ENTRY_SIZE
+        header = struct.pack('<HHI', len(data), chunk_index, crc32(data))
+        page.entries.append(make_item(ns_index, datatype, span, key, header))
+        for offset in range(0, len(data), ENTRY_SIZE):
+            page.entries.append(data[offset:offset + ENTRY_SIZE].ljust(ENTRY_SIZE, b'\xff'))
+
+    def add_string(self, ns_index, key, value):
+        data = bytearray(value) + b'\0'
+        if len(data) > CHUNK_MAX_SIZE:
+            raise InputError('String of key %s is longer than %d bytes' % (key, CHUNK_MAX_SIZE - 1))
+        span = 1 + (len(data) + ENTRY_SIZE - 1) // ENTRY_SIZE
+        self.add_var_item(self.page_for(span), ns_index, TYPE_SZ, key, data, CHUNK_ANY)
+
+    def add_blob(self, ns_index, key, data):
+        data = bytearray(data)
+        if len(data) <= CHUNK_MAX_SIZE:
+            span = 1 + (len(data) + ENTRY_SIZE - 1) // ENTRY_SIZE
+            self.add_var_item(self.page_for(span), ns_index, TYPE_BLOB, key, data, CHUNK_ANY)
+            return
+        # chunks fill the rest of each page, followed by the index, as
+        # Storage::writeMultiPageBlob writes them
+        offset = 0
+        chunk_count = 0
+        while offset < len(data):
+            if chunk_count == MAX_CHUNKS:
+                raise InputError('Blob of key %s has more than %d chunks' % (key, MAX_CHUNKS))
+            page = self.pages[-1]
+            tailroom = page.var_data_tailroom()
+            if tailroom == 0:
+                self.page_for(ENTRY_COUNT)
+                continue
+            chunk = data[offset:offset + tailroom]
+            self.add_var_item(page, ns_index, TYPE_BLOB_DATA, key, chunk, chunk_count)
+            chunk_count += 1
+            offset += len(chunk)
+        index = struct.pack('<IBBH', len(data), chunk_count, 0, 0xffff)
+        self.page_for(1).entries.append(make_item(ns_index, TYPE_BLOB_IDX, 1, key, index))
+
+    def to_binary(self):
+        # NVS needs a free page to move items to when it reclaims a page
+        if (len(self.pages) + 1) * SECTOR_SIZE > self.size:
+            raise InputError('Keys take %d pages, the partition of 0x%x bytes only has room for %d '
+                             '(one page is kept free)' % (len(self.pages), self.size, self.size // SECTOR_SIZE - 1))
+        data = b''
+        for page in self.pages:
+            state = PAGE_STATE_ACTIVE if page is self.pages[-1] else PAGE_STATE_FULL
+            data += page.to_binary(state)
+        return data + b'\xff' * (self.size - len(data))
+
+
+def check_key(key):
+    if len(key) == 0 or len(key) > MAX_KEY_LENGTH:
+        raise InputError('Key %r must have 1 to %d characters' % (key, MAX_KEY_LENGTH))
+
+
+def decode(key, encoding, value):
+    try:
+        if encoding == 'hex2bin':
+            digits = ''.join(c for c in value if c in '0123456789abcdefABCDEF')
+            return bytearray(binascii.unhexlify(digits))
+        if encoding == 'base64':
+            return bytearray(base64.b64decode(value))
+    except (TypeError, ValueError, binascii.Error):
+        raise InputError('Value of key %s is not valid %s' % (key, encoding))
+    return bytearray(value.encode('utf-8'))
+
+
+def generate(csv_contents, size, base_dir='.'):
+    image = Image(size)
+    ns_index = None
+    lines = csv_contents.splitlines()
+    for line_no, line in enumerate(lines, 1):
+        line = line.strip()
+        if len(line) == 0 or line.startswith('#'):
+            continue
+        fields = [f.strip() for f in line.split(',', 3)]
+        fields += [''] * (4 - len(fields))
+        key, kind, encoding, value = fields
+        try:
+            if key == 'key' and kind == 'type' and line_no == 1:
+                continue
+            if kind == 'namespace':
+                ns_index = image.add_namespace(key)
+                continue
+            if kind not in ('data', 'file'):
+                raise InputError('Unknown type %r, expected namespace, data or file' % kind)
+            if ns_index is None:
+                raise InputError('Key %s is not in a namespace' % key)
+            check_key(key)
+            if kind == 'file':
+                with open(os.path.join(base_dir, value), 'rb') as f:
+                    contents = bytearray(f.read())
+                if encoding == 'string':
+                    image.add_string(ns_index, key, contents)
+                elif encoding in ('binary', 'hex2bin', 'base64'):
+                    if encoding != 'binary':
+                        contents = decode(key, encoding, contents.decode('ascii'))
+                    image.add_blob(ns_index, key, contents)
+                else:
+                    raise InputError('Encoding %r of file %s must be string, binary, hex2bin or base64' % (encoding, value))
+            elif encoding in TYPES:
+                image.add_primitive(ns_index, key, encoding, value)
+            elif encoding == 'string':
+                image.add_string(ns_index, key, decode(key, encoding, value))
+            elif encoding in ('hex2bin', 'base64'):
+                image.add_blob(ns_index, key, decode(key, encoding, value))
+            else:
+                raise InputError('Unknown encoding %r' % encoding)
+        except (InputError, IOError) as e:
+            raise InputError('Error at line %d: %s' % (line_no, e))
+    return image
+
+
+def main():
+    global quiet
+    parser = argparse.ArgumentParser(description='nvs_partition_gen.py v%s - write an NVS partition image '
+                                     'from a CSV file' % __version__)
+    parser.add_argument('--quiet', '-q', help="Don't print status messages to stderr", action='store_true')
+    parser.add_argument('input', help='CSV file of the keys')
+    parser.add_argument('size', help='Size of the NVS partition, e.g. 0x6000', type=lambda s: int(s, 0))
+    parser.add_argument('output', help='Path of the partition image to write')
+    args = parser.parse_args()
+
+    quiet = args.quiet
+    with open(args.input, 'r') as f:
+        csv_contents = f.read()
+    image = generate(csv_contents, args.size, os.path.dirname(os.path.abspath(args.input)))
+    data = image.to_binary()
+    with open(args.output, 'wb') as f:
+        f.write(data)
+    status('%d namespaces, %d of %d pages used' % (len(image.namespaces), len(image.pages), args.size // SECTOR_SIZE))
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except InputError as e:
+        print(e)
+        sys.exit(2)
@@ -52,6 +52,55 @@ public:
         mData[wordIndex] = (mData[wordIndex] & ~(VALUE_MASK << offset)) | v;
     }
 
+    /**
+     * Index of the first item in [begin, end) which is equal to val, or end
+     * if there is none. A word of items is checked at a time.
+     */
+    size_t find(Tenum val, size_t begin = 0, size_t end = Nitems) const
+    {
+        assert(begin <= end && end <= Nitems);
+        if (begin >= end) {
+            return end;
+        }
+        size_t wordIndex = begin / ITEMS_PER_WORD;
+        uint32_t matches = matchMask(mData[wordIndex], val) & (0xffffffff << ((begin % ITEMS_PER_WORD) * Nbits));
+        while (matches == 0) {
+            ++wordIndex;
+            if (wordIndex * ITEMS_PER_WORD >= end) {
+                return end;
+            }
+            matches = matchMask(mData[wordIndex], val);
+        }
+        size_t index = wordIndex * ITEMS_PER_WORD + __builtin_ctz(matches) / Nbits;
+        return (index < end) ? index : end;
+    }
+
+    /**
+     * Number of items in [begin, end) which are equal to val.
+     */
+    size_t countEqual(Tenum val, size_t begin = 0, size_t end = Nitems) const
+    {
+        assert(begin <= end && end <= Nitems);
+        if (begin >= end) {
+            return 0;
+        }
+        size_t firstWord = begin / ITEMS_PER_WORD;
+        size_t lastWord = (end - 1) / ITEMS_PER_WORD;
+        size_t result = 0;
+        for (size_t i = firstWord; i <= lastWord; ++i) {
+            uint32_t matches = matchMask(mData[i], val);
+            if (i == firstWord) {
+                matches &= 0xffffffff << ((begin % ITEMS_PER_WORD) * Nbits);
+            }
+            size_t endOffset = (end - i * ITEMS_PER_WORD) * Nbits;
+            if (endOffset < 32) {
+                matches &= ~(0xffffffff << endOffset);
+            }
+            result += __builtin_popcount(matches);
+        }
+        return result;
+    }
+
     static constexpr size_t getWordIndex(size_t index)
     {
         return index / ITEMS_PER_WORD;
@@ -73,6 +122,20 @@ protected:
     static const size_t ITEMS_PER_WORD = 32 / Nbits;
     static const size_t WORD_COUNT = ( Nbits * Nitems + 31 ) / 32;
     static const uint32_t VALUE_MASK = (1 << Nbits) - 1;
+    // lowest bit of each item set
+    static const uint32_t LOW_BITS = 0xffffffff / VALUE_MASK;
+
+    // lowest bit of each item of word which is equal to val set
+    static uint32_t matchMask(uint32_t word, Tenum val)
+    {
+        uint32_t diff = word ^ (static_cast<uint32_t>(val) * LOW_BITS);
+        uint32_t differs = 0;
+        for (size_t i = 0; i < Nbits; ++i) {
+            differs |= diff >> i;
+        }
+        return ~differs & LOW_BITS;
+    }
+
     uint32_t mData[WORD_COUNT];
 };
 
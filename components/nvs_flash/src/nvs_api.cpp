@@ -14,109 +14,402 @@
 #include "nvs.hpp"
 #include "nvs_flash.h"
 #include "nvs_storage.hpp"
-#include "intrusive_list.h"
+#include "nvs_handle_table.hpp"
 #include "nvs_platform.hpp"
+#include "nvs_encryption.hpp"
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#endif
 
-class HandleEntry : public intrusive_list_node<HandleEntry>
+class HandleEntry
 {
 public:
-    HandleEntry(){}
-    
-    HandleEntry(nvs_handle handle, bool readOnly, uint8_t nsIndex) :
-    mHandle(handle),
+    HandleEntry(bool readOnly, uint8_t nsIndex, nvs::WriteBatch* batch = nullptr) :
     mReadOnly(readOnly),
-    mNsIndex(nsIndex)
+    mNsIndex(nsIndex),
+    mBatch(batch),
+    mBlob(nullptr)
+    {
+    }
+
+    ~HandleEntry()
     {
+        delete mBatch;
+        delete mBlob;
     }
-    
-    nvs_handle mHandle;
+
     uint8_t mReadOnly;
     uint8_t mNsIndex;
+    // changes staged until nvs_commit, for handles opened with NVS_READWRITE_TRANSACTION
+    nvs::WriteBatch* mBatch;
+    // blob opened with nvs_blob_open or nvs_blob_create, allocated on first use
+    nvs::BlobStream* mBlob;
+};
+
+// storage instance of one partition, with its own lock and handles
+struct NvsPartition
+{
+    char mLabel[NVS_PART_NAME_MAX_SIZE + 1];
+    uint8_t mIndex;
+    nvs::RwLock mLock;
+    nvs::Storage mStorage;
+    nvs::HandleTable<HandleEntry> mHandles;
+    // time taken by the last init to load pages, for nvs_dump
+    uint32_t mMountTime = 0;
+};
+
+// iterator returned by nvs_entry_find
+struct nvs_opaque_iterator_t : public nvs::EntryIterator
+{
+    NvsPartition* mPartition;
 };
 
 #ifdef ESP_PLATFORM
-SemaphoreHandle_t nvs::Lock::mSemaphore = NULL;
+portMUX_TYPE nvs::CacheLock::mMux = portMUX_INITIALIZER_UNLOCKED;
 #endif
 
 using namespace std;
 using namespace nvs;
 
-static intrusive_list<HandleEntry> s_nvs_handles;
-static uint32_t s_nvs_next_handle = 1;
-static nvs::Storage s_nvs_storage;
+// Instances are created by the first init of their partition and are
+// never deleted, so a pointer read from the table can be used without
+// holding any lock. Slot 0 is kept for the default partition. The slot
+// index is stored in the top bits of handles, which HandleTable leaves
+// clear, so that a handle leads to its instance in one step.
+static const size_t NVS_MAX_PARTITIONS = 16;
+static const uint32_t NVS_HANDLE_PARTITION_SHIFT = 28;
+static const uint32_t NVS_HANDLE_INDEX_MASK = (1 << NVS_HANDLE_PARTITION_SHIFT) - 1;
+static NvsPartition* s_nvs_partitions[NVS_MAX_PARTITIONS];
+#ifdef ESP_PLATFORM
+static portMUX_TYPE s_nvs_partitions_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+static NvsPartition* nvs_find_partition(const char* label)
+{
+    for (size_t i = 0; i < NVS_MAX_PARTITIONS; ++i) {
+        NvsPartition* part = __atomic_load_n(&s_nvs_partitions[i], __ATOMIC_ACQUIRE);
+        if (part && strcmp(part->mLabel, label) == 0) {
+            return part;
+        }
+    }
+    return nullptr;
+}
+
+static NvsPartition* nvs_handle_partition(nvs_handle handle)
+{
+    return __atomic_load_n(&s_nvs_partitions[handle >> NVS_HANDLE_PARTITION_SHIFT], __ATOMIC_ACQUIRE);
+}
+
+static esp_err_t nvs_create_partition(const char* label, NvsPartition*& out_part)
+{
+    out_part = nvs_find_partition(label);
+    if (out_part) {
+        return ESP_OK;
+    }
+    if (strlen(label) > NVS_PART_NAME_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    NvsPartition* part = new (std::nothrow) NvsPartition;
+    if (!part) {
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(part->mLabel, label);
+    auto err = part->mLock.init();
+    if (err != ESP_OK) {
+        delete part;
+        return err;
+    }
+    part->mStorage.setLock(&part->mLock);
+
+    // another task may have created the same instance in the meantime
+#ifdef ESP_PLATFORM
+    portENTER_CRITICAL(&s_nvs_partitions_mux);
+#endif
+    NvsPartition* existing = nullptr;
+    size_t freeSlot = NVS_MAX_PARTITIONS;
+    const bool isDefault = strcmp(label, NVS_DEFAULT_PART_NAME) == 0;
+    for (size_t i = 0; i < NVS_MAX_PARTITIONS; ++i) {
+        if (!s_nvs_partitions[i]) {
+            if (freeSlot == NVS_MAX_PARTITIONS && (i == 0) == isDefault) {
+                freeSlot = i;
+            }
+        } else if (strcmp(s_nvs_partitions[i]->mLabel, label) == 0) {
+            existing = s_nvs_partitions[i];
+        }
+    }
+    if (!existing && freeSlot != NVS_MAX_PARTITIONS) {
+        part->mIndex = static_cast<uint8_t>(freeSlot);
+        __atomic_store_n(&s_nvs_partitions[freeSlot], part, __ATOMIC_RELEASE);
+    }
+#ifdef ESP_PLATFORM
+    portEXIT_CRITICAL(&s_nvs_partitions_mux);
+#endif
+
+    if (existing || freeSlot == NVS_MAX_PARTITIONS) {
+        part->mLock.uninit();
+        delete part;
+        out_part = existing;
+        return existing ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+    out_part = part;
+    return ESP_OK;
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_NVS_GC_TASK
+static TaskHandle_t s_nvs_gc_task = NULL;
+
+static void nvs_gc_task(void* arg)
+{
+    while (true) {
+        vTaskDelay(CONFIG_NVS_GC_TASK_INTERVAL / portTICK_PERIOD_MS);
+        // each instance is locked on its own, so reclaiming pages of one
+        // partition doesn't hold up users of the others
+        for (size_t i = 0; i < NVS_MAX_PARTITIONS; ++i) {
+            NvsPartition* part = nvs_handle_partition(i << NVS_HANDLE_PARTITION_SHIFT);
+            if (!part) {
+                continue;
+            }
+            Lock lock(part->mLock);
+            part->mStorage.collectGarbage(CONFIG_NVS_GC_ITEMS_PER_STEP, CONFIG_NVS_GC_MIN_ERASED_ENTRIES);
+        }
+    }
+}
+#endif
 
 extern "C" void nvs_dump()
 {
-    Lock lock;
-    s_nvs_storage.debugDump();
+    for (size_t i = 0; i < NVS_MAX_PARTITIONS; ++i) {
+        NvsPartition* part = nvs_handle_partition(i << NVS_HANDLE_PARTITION_SHIFT);
+        if (!part) {
+            continue;
+        }
+        Lock lock(part->mLock);
+        Storage& storage = part->mStorage;
+        printf("partition %s: mount time=%uus\n", part->mLabel, static_cast<unsigned>(part->mMountTime));
+        const ItemCache& cache = storage.getItemCache();
+        printf("item cache: %u/%u used, %u hits, %u misses\n", static_cast<unsigned>(cache.size()),
+               static_cast<unsigned>(cache.capacity()), static_cast<unsigned>(cache.hits()), static_cast<unsigned>(cache.misses()));
+        if (storage.isInitialized()) {
+            nvs_stats_t stats;
+            storage.getStats(stats);
+            printf("entries: %u used, %u erased, %u free of %u; %u free pages, %u namespaces, %u pages reclaimed (%u inline)\n",
+                   static_cast<unsigned>(stats.used_entries), static_cast<unsigned>(stats.erased_entries),
+                   static_cast<unsigned>(stats.free_entries), static_cast<unsigned>(stats.total_entries),
+                   static_cast<unsigned>(stats.free_pages), static_cast<unsigned>(stats.namespace_count),
+                   static_cast<unsigned>(stats.reclaimed_pages), static_cast<unsigned>(stats.inline_reclaims));
+        }
+        storage.debugDump();
+    }
+}
+
+/**
+ * Load storage of a partition, creating its instance if needed. With
+ * remount false, an instance which is already initialized is left alone,
+ * so that handles opened by concurrent users of a lazily mounted
+ * partition stay valid.
+ */
+static esp_err_t nvs_init_partition(const char* partName, uint32_t baseSector, uint32_t sectorCount, bool remount)
+{
+    NvsPartition* part;
+    auto err = nvs_create_partition(partName, part);
+    if (err != ESP_OK) {
+        return err;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d %d\r\n", __func__, partName, baseSector, sectorCount);
+    if (!remount && part->mStorage.isInitialized()) {
+        return ESP_OK;
+    }
+#if CONFIG_NVS_ENCRYPTION
+    auto keyErr = EntryCipher::loadKey();
+    if (keyErr != ESP_OK) {
+        return keyErr;
+    }
+#endif
+    uint32_t mountStart = getTimeUs();
+    err = part->mStorage.init(baseSector, sectorCount);
+    part->mMountTime = getTimeUs() - mountStart;
+    // init has closed the blob being written, if any, so the streams can go
+    part->mHandles.clear();
+    if (err != ESP_OK) {
+        return err;
+    }
+#if defined(ESP_PLATFORM) && CONFIG_NVS_GC_TASK
+    if (!s_nvs_gc_task) {
+        xTaskCreatePinnedToCore(nvs_gc_task, "nvsGc", ESP_TASKD_NVS_GC_STACK, NULL, ESP_TASKD_NVS_GC_PRIO, &s_nvs_gc_task, 0);
+    }
+#endif
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_flash_init_custom(const char* partName, uint32_t baseSector, uint32_t sectorCount)
+{
+    return nvs_init_partition(partName, baseSector, sectorCount, true);
 }
 
 extern "C" esp_err_t nvs_flash_init(uint32_t baseSector, uint32_t sectorCount)
 {
-    Lock::init();
-    Lock lock;
-    NVS_DEBUGV("%s %d %d\r\n", __func__, baseSector, sectorCount);
-    s_nvs_handles.clear();
-    return s_nvs_storage.init(baseSector, sectorCount);
+    return nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, baseSector, sectorCount);
+}
+
+#ifdef ESP_PLATFORM
+static esp_err_t nvs_mount_partition(const char* label, bool remount)
+{
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (part->address % SPI_FLASH_SEC_SIZE != 0 || part->size < SPI_FLASH_SEC_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return nvs_init_partition(label, part->address / SPI_FLASH_SEC_SIZE, part->size / SPI_FLASH_SEC_SIZE, remount);
+}
+
+extern "C" esp_err_t nvs_flash_init_partition(const char* label)
+{
+    return nvs_mount_partition(label, true);
+}
+#endif
+
+extern "C" esp_err_t nvs_get_cache_stats(nvs_cache_stats_t* out_stats)
+{
+    NvsPartition* part = nvs_find_partition(NVS_DEFAULT_PART_NAME);
+    if (!part) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    Lock lock(part->mLock);
+    if (!part->mStorage.isInitialized()) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    const ItemCache& cache = part->mStorage.getItemCache();
+    out_stats->hits = cache.hits();
+    out_stats->misses = cache.misses();
+    out_stats->used = cache.size();
+    out_stats->capacity = cache.capacity();
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_get_partition_stats(const char* part_name, nvs_stats_t* out_stats)
+{
+    NvsPartition* part = nvs_find_partition(part_name);
+    if (!part) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    SharedLock lock(part->mLock);
+    if (!part->mStorage.isInitialized()) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    part->mStorage.getStats(*out_stats);
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_get_stats(nvs_stats_t* out_stats)
+{
+    return nvs_get_partition_stats(NVS_DEFAULT_PART_NAME, out_stats);
 }
 
-static esp_err_t nvs_find_ns_handle(nvs_handle handle, HandleEntry& entry)
+static esp_err_t nvs_find_ns_handle(NvsPartition& part, nvs_handle handle, HandleEntry*& entry)
 {
-    auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
-        return e.mHandle == handle;
-    });
-    if (it == end(s_nvs_handles)) {
+    entry = part.mHandles.find(handle & NVS_HANDLE_INDEX_MASK);
+    if (!entry) {
         return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    entry = *it;
     return ESP_OK;
 }
 
-extern "C" esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
+extern "C" esp_err_t nvs_open_from_partition(const char* part_name, const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
 {
-    Lock lock;
-    NVS_DEBUGV("%s %s %d\r\n", __func__, name, open_mode);
+    NvsPartition* part = nvs_find_partition(part_name);
+#ifdef ESP_PLATFORM
+    if (!part) {
+        // partitions are mounted when they are first used
+        auto err = nvs_mount_partition(part_name, false);
+        if (err != ESP_OK) {
+            return err;
+        }
+        part = nvs_find_partition(part_name);
+    }
+#endif
+    if (!part) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s %s %d\r\n", __func__, part_name, name, open_mode);
     uint8_t nsIndex;
-    esp_err_t err = s_nvs_storage.createOrOpenNamespace(name, open_mode == NVS_READWRITE, nsIndex);
+    esp_err_t err = part->mStorage.createOrOpenNamespace(name, open_mode != NVS_READONLY, nsIndex);
     if (err != ESP_OK) {
         return err;
     }
 
-    uint32_t handle = s_nvs_next_handle;
-    ++s_nvs_next_handle;
-    *out_handle = handle;
+    WriteBatch* batch = nullptr;
+    if (open_mode == NVS_READWRITE_TRANSACTION) {
+        batch = new (std::nothrow) WriteBatch;
+        if (!batch) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
 
-    s_nvs_handles.push_back(new HandleEntry(handle, open_mode==NVS_READONLY, nsIndex));
+    HandleEntry* entry = new (std::nothrow) HandleEntry(open_mode==NVS_READONLY, nsIndex, batch);
+    if (!entry) {
+        delete batch;
+        return ESP_ERR_NO_MEM;
+    }
+    nvs_handle handle;
+    err = part->mHandles.add(entry, handle);
+    if (err != ESP_OK) {
+        delete entry;
+        return err;
+    }
+    *out_handle = handle | (static_cast<uint32_t>(part->mIndex) << NVS_HANDLE_PARTITION_SHIFT);
     return ESP_OK;
 }
 
+extern "C" esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    return nvs_open_from_partition(NVS_DEFAULT_PART_NAME, name, open_mode, out_handle);
+}
+
 extern "C" void nvs_close(nvs_handle handle)
 {
-    Lock lock;
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return;
+    }
+    Lock lock(part->mLock);
     NVS_DEBUGV("%s %d\r\n", __func__, handle);
-    auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
-        return e.mHandle == handle;
-    });
-    if (it == end(s_nvs_handles)) {
+    HandleEntry* entry = part->mHandles.find(handle & NVS_HANDLE_INDEX_MASK);
+    if (!entry) {
         return;
     }
-    s_nvs_handles.erase(it);
+    // uncommitted changes are discarded
+    if (entry->mBlob) {
+        part->mStorage.closeBlob(*entry->mBlob);
+    }
+    part->mHandles.remove(handle & NVS_HANDLE_INDEX_MASK);
 }
 
 template<typename T>
 static esp_err_t nvs_set(nvs_handle handle, const char* key, T value)
 {
-    Lock lock;
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
     NVS_DEBUGV("%s %s %d %d\r\n", __func__, key, sizeof(T), (uint32_t) value);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
     if (err != ESP_OK) {
         return err;
     }
-    if (entry.mReadOnly) {
+    if (entry->mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
-    return s_nvs_storage.writeItem(entry.mNsIndex, key, value);
+    if (entry->mBatch) {
+        return entry->mBatch->set(entry->mNsIndex, itemTypeOf(value), key, &value, sizeof(value));
+    }
+    return part->mStorage.writeItem(entry->mNsIndex, key, value);
 }
 
 extern "C" esp_err_t nvs_set_i8  (nvs_handle handle, const char* key, int8_t value)
@@ -161,48 +454,107 @@ extern "C" esp_err_t nvs_set_u64 (nvs_handle handle, const char* key, uint64_t v
 
 extern "C" esp_err_t nvs_commit(nvs_handle handle)
 {
-    Lock lock;
-    // no-op for now, to be used when intermediate cache is added
-    HandleEntry entry;
-    return nvs_find_ns_handle(handle, entry);
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %d\r\n", __func__, handle);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // handles without a batch write through on every set, nothing to do
+    if (!entry->mBatch || entry->mBatch->empty()) {
+        return ESP_OK;
+    }
+    return part->mStorage.writeBatch(*entry->mBatch);
+}
+
+extern "C" esp_err_t nvs_erase_all(nvs_handle handle)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %d\r\n", __func__, handle);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (entry->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (entry->mBatch) {
+        entry->mBatch->clear();
+    }
+    return part->mStorage.eraseNamespace(entry->mNsIndex);
 }
 
 extern "C" esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value)
 {
-    Lock lock;
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
     NVS_DEBUGV("%s %s %s\r\n", __func__, key, value);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
     if (err != ESP_OK) {
         return err;
     }
-    return s_nvs_storage.writeItem(entry.mNsIndex, nvs::ItemType::SZ, key, value, strlen(value) + 1);
+    if (entry->mBatch) {
+        return entry->mBatch->set(entry->mNsIndex, nvs::ItemType::SZ, key, value, strlen(value) + 1);
+    }
+    return part->mStorage.writeItem(entry->mNsIndex, nvs::ItemType::SZ, key, value, strlen(value) + 1);
 }
 
 extern "C" esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length)
 {
-    Lock lock;
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
     NVS_DEBUGV("%s %s %d\r\n", __func__, key, length);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
     if (err != ESP_OK) {
         return err;
     }
-    return s_nvs_storage.writeItem(entry.mNsIndex, nvs::ItemType::BLOB, key, value, length);
+    if (entry->mBatch) {
+        return entry->mBatch->set(entry->mNsIndex, nvs::ItemType::BLOB, key, value, length);
+    }
+    return part->mStorage.writeItem(entry->mNsIndex, nvs::ItemType::BLOB, key, value, length);
 }
 
 
 template<typename T>
 static esp_err_t nvs_get(nvs_handle handle, const char* key, T* out_value)
 {
-    Lock lock;
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    SharedLock lock(part->mLock);
     NVS_DEBUGV("%s %s %d\r\n", __func__, key, sizeof(T));
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
     if (err != ESP_OK) {
         return err;
     }
-    return s_nvs_storage.readItem(entry.mNsIndex, key, *out_value);
+    if (entry->mBatch) {
+        // staged values take precedence over the ones in storage
+        err = entry->mBatch->get(entry->mNsIndex, itemTypeOf(*out_value), key, out_value, sizeof(T));
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return part->mStorage.readItem(entry->mNsIndex, key, *out_value);
 }
 
 extern "C" esp_err_t nvs_get_i8  (nvs_handle handle, const char* key, int8_t* out_value)
@@ -247,16 +599,29 @@ extern "C" esp_err_t nvs_get_u64 (nvs_handle handle, const char* key, uint64_t*
 
 static esp_err_t nvs_get_str_or_blob(nvs_handle handle, nvs::ItemType type, const char* key, void* out_value, size_t* length)
 {
-    Lock lock;
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    SharedLock lock(part->mLock);
     NVS_DEBUGV("%s %s\r\n", __func__, key);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
     if (err != ESP_OK) {
         return err;
     }
 
     size_t dataSize;
-    err = s_nvs_storage.getItemDataSize(entry.mNsIndex, type, key, dataSize);
+    WriteBatch* batch = entry->mBatch;
+    err = ESP_ERR_NVS_NOT_FOUND;
+    if (batch) {
+        err = batch->getDataSize(entry->mNsIndex, type, key, dataSize);
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // not staged, read from storage
+        batch = nullptr;
+        err = part->mStorage.getItemDataSize(entry->mNsIndex, type, key, dataSize);
+    }
     if (err != ESP_OK) {
         return err;
     }
@@ -273,7 +638,10 @@ static esp_err_t nvs_get_str_or_blob(nvs_handle handle, nvs::ItemType type, cons
         return ESP_ERR_NVS_INVALID_LENGTH;
     }
 
-    return s_nvs_storage.readItem(entry.mNsIndex, type, key, out_value, dataSize);
+    if (batch) {
+        return batch->get(entry->mNsIndex, type, key, out_value, dataSize);
+    }
+    return part->mStorage.readItem(entry->mNsIndex, type, key, out_value, dataSize);
 }
 
 extern "C" esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length)
@@ -286,3 +654,337 @@ extern "C" esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_
     return nvs_get_str_or_blob(handle, nvs::ItemType::BLOB, key, out_value, length);
 }
 
+static esp_err_t nvs_find_in_place_handle(NvsPartition& part, nvs_handle handle, HandleEntry*& entry)
+{
+    auto err = nvs_find_ns_handle(part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (entry->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    // arrays and counters are written in place, they can't be staged in a batch
+    if (entry->mBatch) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_set_array(nvs_handle handle, const char* key, nvs_type_t type, const void* values, size_t count)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d %d\r\n", __func__, key, type, count);
+    HandleEntry* entry;
+    auto err = nvs_find_in_place_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.writeArray(entry->mNsIndex, static_cast<nvs::ItemType>(type), key, values, count);
+}
+
+extern "C" esp_err_t nvs_set_array_range(nvs_handle handle, const char* key, nvs_type_t type, size_t first, const void* values, size_t count)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d %d %d\r\n", __func__, key, type, first, count);
+    HandleEntry* entry;
+    auto err = nvs_find_in_place_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.writeArrayRange(entry->mNsIndex, static_cast<nvs::ItemType>(type), key, first, values, count);
+}
+
+extern "C" esp_err_t nvs_get_array(nvs_handle handle, const char* key, nvs_type_t type, void* out_values, size_t* count)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    SharedLock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d\r\n", __func__, key, type);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (count == nullptr) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    size_t arrayCount;
+    err = part->mStorage.getArrayCount(entry->mNsIndex, static_cast<nvs::ItemType>(type), key, arrayCount);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (out_values == nullptr) {
+        *count = arrayCount;
+        return ESP_OK;
+    }
+    if (*count < arrayCount) {
+        *count = arrayCount;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    err = part->mStorage.readArray(entry->mNsIndex, static_cast<nvs::ItemType>(type), key, 0, out_values, arrayCount);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *count = arrayCount;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_get_array_range(nvs_handle handle, const char* key, nvs_type_t type, size_t first, void* out_values, size_t count)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    SharedLock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d %d %d\r\n", __func__, key, type, first, count);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.readArray(entry->mNsIndex, static_cast<nvs::ItemType>(type), key, first, out_values, count);
+}
+
+extern "C" esp_err_t nvs_set_counter(nvs_handle handle, const char* key, uint32_t value)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d\r\n", __func__, key, value);
+    HandleEntry* entry;
+    auto err = nvs_find_in_place_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.writeCounter(entry->mNsIndex, key, value);
+}
+
+extern "C" esp_err_t nvs_increment_counter(nvs_handle handle, const char* key, uint32_t* out_value)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s\r\n", __func__, key);
+    HandleEntry* entry;
+    auto err = nvs_find_in_place_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint32_t value;
+    err = part->mStorage.incrementCounter(entry->mNsIndex, key, value);
+    if (err == ESP_OK && out_value) {
+        *out_value = value;
+    }
+    return err;
+}
+
+extern "C" esp_err_t nvs_get_counter(nvs_handle handle, const char* key, uint32_t* out_value)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    SharedLock lock(part->mLock);
+    NVS_DEBUGV("%s %s\r\n", __func__, key);
+    HandleEntry* entry;
+    auto err = nvs_find_ns_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.readCounter(entry->mNsIndex, key, *out_value);
+}
+
+static esp_err_t nvs_find_blob_handle(NvsPartition& part, nvs_handle handle, HandleEntry*& entry)
+{
+    auto err = nvs_find_ns_handle(part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (!entry->mBlob) {
+        entry->mBlob = new (std::nothrow) BlobStream;
+        if (!entry->mBlob) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_blob_open(nvs_handle handle, const char* key, size_t* length)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s\r\n", __func__, key);
+    HandleEntry* entry;
+    auto err = nvs_find_blob_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = part->mStorage.openBlob(entry->mNsIndex, key, *entry->mBlob);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *length = entry->mBlob->size();
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_blob_create(nvs_handle handle, const char* key, size_t length)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %s %d\r\n", __func__, key, length);
+    HandleEntry* entry;
+    auto err = nvs_find_blob_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (entry->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (entry->mBatch) {
+        // data goes to flash as it is written, it can't be part of a transaction
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    return part->mStorage.createBlob(entry->mNsIndex, key, length, *entry->mBlob);
+}
+
+extern "C" esp_err_t nvs_blob_read(nvs_handle handle, size_t offset, void* out_value, size_t length)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %d %d\r\n", __func__, offset, length);
+    HandleEntry* entry;
+    auto err = nvs_find_blob_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.readBlob(*entry->mBlob, offset, out_value, length);
+}
+
+extern "C" esp_err_t nvs_blob_write(nvs_handle handle, const void* value, size_t length)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %d\r\n", __func__, length);
+    HandleEntry* entry;
+    auto err = nvs_find_blob_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.writeBlob(*entry->mBlob, value, length);
+}
+
+extern "C" esp_err_t nvs_blob_close(nvs_handle handle)
+{
+    NvsPartition* part = nvs_handle_partition(handle);
+    if (!part) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    Lock lock(part->mLock);
+    NVS_DEBUGV("%s %d\r\n", __func__, handle);
+    HandleEntry* entry;
+    auto err = nvs_find_blob_handle(*part, handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return part->mStorage.closeBlob(*entry->mBlob);
+}
+
+extern "C" esp_err_t nvs_entry_find_in_partition(const char* part_name, const char* namespace_name, nvs_type_t type, nvs_iterator_t* out_iterator)
+{
+    *out_iterator = nullptr;
+    NvsPartition* part = nvs_find_partition(part_name);
+    if (!part) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    SharedLock lock(part->mLock);
+    NVS_DEBUGV("%s %s %s %d\r\n", __func__, part_name, namespace_name, type);
+    uint8_t nsIndex = Page::NS_ANY;
+    if (namespace_name) {
+        auto err = part->mStorage.createOrOpenNamespace(namespace_name, false, nsIndex);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    auto it = new (std::nothrow) nvs_opaque_iterator_t;
+    if (!it) {
+        return ESP_ERR_NO_MEM;
+    }
+    it->mPartition = part;
+    auto err = part->mStorage.findEntry(nsIndex, static_cast<ItemType>(type), *it);
+    if (err != ESP_OK) {
+        delete it;
+        return err;
+    }
+    *out_iterator = it;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_entry_find(const char* namespace_name, nvs_type_t type, nvs_iterator_t* out_iterator)
+{
+    return nvs_entry_find_in_partition(NVS_DEFAULT_PART_NAME, namespace_name, type, out_iterator);
+}
+
+extern "C" esp_err_t nvs_entry_next(nvs_iterator_t* iterator)
+{
+    if (!iterator || !*iterator) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    NvsPartition* part = (*iterator)->mPartition;
+    SharedLock lock(part->mLock);
+    auto err = part->mStorage.nextEntry(**iterator);
+    if (err != ESP_OK) {
+        delete *iterator;
+        *iterator = nullptr;
+    }
+    return err;
+}
+
+extern "C" esp_err_t nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t* out_info)
+{
+    if (!iterator) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    NvsPartition* part = iterator->mPartition;
+    SharedLock lock(part->mLock);
+    const char* nsName = part->mStorage.getNamespaceName(iterator->nsIndex());
+    if (!nsName) {
+        nsName = "";
+    }
+    strncpy(out_info->namespace_name, nsName, sizeof(out_info->namespace_name) - 1);
+    out_info->namespace_name[sizeof(out_info->namespace_name) - 1] = 0;
+    strncpy(out_info->key, iterator->key(), sizeof(out_info->key) - 1);
+    out_info->key[sizeof(out_info->key) - 1] = 0;
+    out_info->type = static_cast<nvs_type_t>(iterator->datatype());
+    return ESP_OK;
+}
+
+extern "C" void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
@@ -0,0 +1,116 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_blob_stream_hpp
+#define nvs_blob_stream_hpp
+
+#include "nvs.h"
+#include "nvs_types.hpp"
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * State of a blob opened for reading or writing in parts, see
+ * Storage::openBlob and Storage::createBlob.
+ *
+ * A stream opened for reading remembers where the item is, or where all
+ * chunks of a multi-page blob are, so that reads don't have to look up
+ * the key again, unless storage was modified in the meantime.
+ *
+ * A stream opened for writing owns the entries following the next free
+ * entry of the active page until it is closed. Data is written to flash
+ * as it comes, and only the data which doesn't fill a whole entry is
+ * kept in RAM. The item becomes visible when the stream is closed.
+ * Blobs which don't fit into one page are written one chunk at a time.
+ */
+class BlobStream
+{
+public:
+    enum class Mode : uint8_t {
+        CLOSED,
+        READ,
+        WRITE,
+    };
+
+    BlobStream()
+    {
+    }
+
+    ~BlobStream()
+    {
+        delete[] mChunks;
+    }
+
+    Mode mode() const
+    {
+        return mMode;
+    }
+
+    /**
+     * Size of the blob, or the size it will have once all data is written.
+     */
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    /**
+     * Number of bytes written so far.
+     */
+    size_t written() const
+    {
+        return mWritten;
+    }
+
+protected:
+    friend class Storage;
+
+    BlobStream(const BlobStream&) = delete;
+    BlobStream& operator=(const BlobStream&) = delete;
+
+    struct Chunk {
+        Page* mPage;
+        uint16_t mIndex;
+        uint16_t mDataSize;
+        uint32_t mDataCrc32;
+    };
+
+    Mode mMode = Mode::CLOSED;
+    uint32_t mGeneration = 0;
+    size_t mSize = 0;
+    size_t mWritten = 0;
+    uint32_t mDataCrc32 = 0;
+
+    // header of the blob item, or of the chunk being written
+    Item mHeader;
+    Page* mPage = nullptr;
+    size_t mIndex = 0;
+    // data which doesn't fill a whole entry yet
+    Item mPending;
+
+    // chunks of a multi-page blob. a blob kept in one item has a single
+    // chunk, which is mSingleChunk
+    bool mMultiPage = false;
+    uint8_t mChunkStart = 0;
+    uint8_t mChunkCount = 0;
+    size_t mChunkOffset = 0;   // offset of the chunk being written
+    Chunk mSingleChunk;
+    Chunk* mChunks = nullptr;
+}; // class BlobStream
+
+} // namespace nvs
+
+#endif /* nvs_blob_stream_hpp */
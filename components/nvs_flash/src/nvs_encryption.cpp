@@ -0,0 +1,259 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_encryption.hpp"
+#include "nvs.h"
+
+#if CONFIG_NVS_ENCRYPTION
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "nvs_platform.hpp"
+#include "rom/aes.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#include "hwcrypto/aes.h"
+#include "rom/crc.h"
+
+extern "C" int os_get_random(unsigned char* buf, size_t len);
+#else
+// the host runs a single task, and the tests provide the ROM AES functions
+typedef void* TaskHandle_t;
+
+static TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return nullptr;
+}
+
+static void esp_aes_acquire_hardware()
+{
+}
+
+static void esp_aes_release_hardware()
+{
+}
+#endif
+
+namespace nvs
+{
+
+// number of entries whose tweaks are computed before the key is switched
+// to decryption
+static const size_t TWEAK_BATCH = 4;
+static const size_t BLOCK_SIZE = 16;
+static const size_t ENTRY_SIZE = 32;
+
+enum class KeyMode {
+    NONE,
+    ENCRYPT,
+    DECRYPT,
+};
+
+static uint8_t s_key[EntryCipher::KEY_SIZE];
+// task holding the AES unit, valid while s_held is set
+static TaskHandle_t s_owner;
+static volatile bool s_held = false;
+// the key registers only hold the key for one direction
+static KeyMode s_mode = KeyMode::NONE;
+
+#ifdef ESP_PLATFORM
+// layout of the key at the start of the nvs_keys partition
+struct KeyRecord {
+    uint8_t key[EntryCipher::KEY_SIZE];
+    uint32_t crc32;     // crc32_le(0xffffffff, key)
+};
+
+esp_err_t EntryCipher::loadKey()
+{
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS, NULL);
+    if (part == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // mapped reads are decrypted by the flash cache if flash encryption is on
+    KeyRecord record;
+    const void* ptr;
+    spi_flash_mmap_handle_t handle;
+    auto err = esp_partition_mmap(part, 0, sizeof(record), &ptr, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memcpy(&record, ptr, sizeof(record));
+    spi_flash_munmap(handle);
+
+    const uint8_t* raw = reinterpret_cast<const uint8_t*>(&record);
+    bool blank = std::all_of(raw, raw + sizeof(record), [](uint8_t b) { return b == 0xff; });
+    if (blank) {
+        os_get_random(record.key, sizeof(record.key));
+        record.crc32 = crc32_le(0xffffffff, record.key, sizeof(record.key));
+        err = esp_partition_write(part, 0, &record, sizeof(record));
+        if (err != ESP_OK) {
+            return err;
+        }
+        // read back, a key written in plaintext to an encrypted flash is useless
+        err = esp_partition_mmap(part, 0, sizeof(record), &ptr, &handle);
+        if (err != ESP_OK) {
+            return err;
+        }
+        memcpy(&record, ptr, sizeof(record));
+        spi_flash_munmap(handle);
+    }
+
+    if (record.crc32 != crc32_le(0xffffffff, record.key, sizeof(record.key))) {
+        memset(&record, 0, sizeof(record));
+        return ESP_ERR_NVS_CORRUPT_KEY_PART;
+    }
+    setKey(record.key);
+    memset(&record, 0, sizeof(record));
+    return ESP_OK;
+}
+#else // ESP_PLATFORM
+esp_err_t EntryCipher::loadKey()
+{
+    // host tests set the key with setKey
+    return ESP_OK;
+}
+#endif // ESP_PLATFORM
+
+void EntryCipher::setKey(const uint8_t* key)
+{
+    memcpy(s_key, key, sizeof(s_key));
+    // the key registers are loaded again by the next session
+    s_mode = KeyMode::NONE;
+}
+
+EntryCipher::Session::Session()
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    mOwner = !(s_held && s_owner == self);
+    if (mOwner) {
+        esp_aes_acquire_hardware();
+        s_owner = self;
+        s_held = true;
+        s_mode = KeyMode::NONE;
+    }
+}
+
+EntryCipher::Session::~Session()
+{
+    if (mOwner) {
+        s_held = false;
+        esp_aes_release_hardware();
+    }
+}
+
+static void setMode(KeyMode mode)
+{
+    if (s_mode != mode) {
+        if (mode == KeyMode::ENCRYPT) {
+            ets_aes_setkey_enc(s_key, AES256);
+        } else {
+            ets_aes_setkey_dec(s_key, AES256);
+        }
+        s_mode = mode;
+    }
+}
+
+static void xorBlock(uint8_t* dst, const uint8_t* src, const uint8_t* tweak)
+{
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        dst[i] = src[i] ^ tweak[i];
+    }
+}
+
+// tweaks of both blocks of count entries at address, with the encryption key
+static void makeTweaks(uint32_t address, uint8_t (*tweaks)[2][BLOCK_SIZE], size_t count)
+{
+    setMode(KeyMode::ENCRYPT);
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t input[BLOCK_SIZE] = { 0 };
+        uint32_t entryAddress = address + static_cast<uint32_t>(i * ENTRY_SIZE);
+        memcpy(input, &entryAddress, sizeof(entryAddress));
+        ets_aes_crypt(input, tweaks[i][0]);
+        // multiply by x, with the little endian convention of XTS
+        uint8_t carry = 0;
+        for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+            uint8_t b = tweaks[i][0][j];
+            tweaks[i][1][j] = static_cast<uint8_t>((b << 1) | carry);
+            carry = b >> 7;
+        }
+        if (carry) {
+            tweaks[i][1][0] ^= 0x87;
+        }
+    }
+}
+
+void EntryCipher::encrypt(uint32_t address, const void* src, void* dst, size_t count)
+{
+    assert(s_held && s_owner == xTaskGetCurrentTaskHandle());
+    const uint8_t* in = static_cast<const uint8_t*>(src);
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    uint8_t tweaks[1][2][BLOCK_SIZE];
+    for (size_t i = 0; i < count; ++i) {
+        // the key stays loaded for encryption, one entry at a time will do
+        makeTweaks(address, tweaks, 1);
+        for (size_t j = 0; j < 2; ++j) {
+            uint8_t block[BLOCK_SIZE];
+            uint8_t result[BLOCK_SIZE];
+            xorBlock(block, in + j * BLOCK_SIZE, tweaks[0][j]);
+            ets_aes_crypt(block, result);
+            xorBlock(out + j * BLOCK_SIZE, result, tweaks[0][j]);
+        }
+        address += ENTRY_SIZE;
+        in += ENTRY_SIZE;
+        out += ENTRY_SIZE;
+    }
+}
+
+void EntryCipher::decrypt(uint32_t address, const void* src, void* dst, size_t count)
+{
+    assert(s_held && s_owner == xTaskGetCurrentTaskHandle());
+    const uint8_t* in = static_cast<const uint8_t*>(src);
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    uint8_t tweaks[TWEAK_BATCH][2][BLOCK_SIZE];
+    while (count != 0) {
+        // decryption needs the tweaks, which are encrypted, so they are made
+        // for a few entries at a time to switch the key less often
+        size_t batch = (count < TWEAK_BATCH) ? count : TWEAK_BATCH;
+        makeTweaks(address, tweaks, batch);
+        setMode(KeyMode::DECRYPT);
+        for (size_t i = 0; i < batch; ++i) {
+            const uint8_t* entryIn = in + i * ENTRY_SIZE;
+            uint8_t* entryOut = out + i * ENTRY_SIZE;
+            // erased entries aren't encrypted
+            if (std::all_of(entryIn, entryIn + ENTRY_SIZE, [](uint8_t b) { return b == 0xff; })) {
+                if (entryOut != entryIn) {
+                    memset(entryOut, 0xff, ENTRY_SIZE);
+                }
+                continue;
+            }
+            for (size_t j = 0; j < 2; ++j) {
+                uint8_t block[BLOCK_SIZE];
+                uint8_t result[BLOCK_SIZE];
+                xorBlock(block, entryIn + j * BLOCK_SIZE, tweaks[i][j]);
+                ets_aes_crypt(block, result);
+                xorBlock(entryOut + j * BLOCK_SIZE, result, tweaks[i][j]);
+            }
+        }
+        address += static_cast<uint32_t>(batch * ENTRY_SIZE);
+        in += batch * ENTRY_SIZE;
+        out += batch * ENTRY_SIZE;
+        count -= batch;
+    }
+}
+
+} // namespace nvs
+
+#endif // CONFIG_NVS_ENCRYPTION
@@ -0,0 +1,97 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_encryption_hpp
+#define nvs_encryption_hpp
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+namespace nvs
+{
+
+#if CONFIG_NVS_ENCRYPTION
+/**
+ * Encryption of entry data with the AES unit (CONFIG_NVS_ENCRYPTION).
+ *
+ * Each 32-byte entry is encrypted as two AES-256 blocks in XEX mode, the
+ * single key variant of XTS: the flash address of the entry, encrypted
+ * with the key, is the tweak of the first block, and the tweak multiplied
+ * by x in GF(2^128) that of the second. Every entry is encrypted on its
+ * own, so entries are still written and read one at a time, and the same
+ * value stored at another address looks different. Page headers and
+ * entry state tables stay in plaintext, as their bits are cleared one by
+ * one, and entries which are still erased (all 0xff) read as such.
+ *
+ * The key is read from the nvs_keys data partition by loadKey. It is only
+ * protected if flash encryption is enabled, the bootloader then encrypts
+ * the partition along with the app.
+ */
+class EntryCipher
+{
+public:
+    static const size_t KEY_SIZE = 32;
+
+    /**
+     * Read the key from the nvs_keys partition. A blank partition gets
+     * a new random key, which only works before flash encryption is
+     * enabled.
+     */
+    static esp_err_t loadKey();
+
+    /**
+     * Use the given KEY_SIZE bytes as key. Used by loadKey, and by the
+     * host tests, where loadKey doesn't do anything.
+     */
+    static void setKey(const uint8_t* key);
+
+    /**
+     * Keeps the AES unit locked for the calling task while it exists, so
+     * that scanning a page doesn't take the lock, load the key and release
+     * the unit for every entry. Sessions of the same task nest, the inner
+     * ones don't do anything.
+     */
+    class Session
+    {
+    public:
+        Session();
+        ~Session();
+
+    protected:
+        bool mOwner;
+    };
+
+    // src and dst may be the same, the caller holds a Session
+    static void encrypt(uint32_t address, const void* src, void* dst, size_t count);
+
+    static void decrypt(uint32_t address, const void* src, void* dst, size_t count);
+}; // class EntryCipher
+#else
+class EntryCipher
+{
+public:
+    class Session
+    {
+    public:
+        Session()
+        {
+        }
+    };
+}; // class EntryCipher
+#endif
+
+} // namespace nvs
+
+#endif /* nvs_encryption_hpp */
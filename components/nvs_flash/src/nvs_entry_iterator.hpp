@@ -0,0 +1,77 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_entry_iterator_hpp
+#define nvs_entry_iterator_hpp
+
+#include "nvs.h"
+#include "nvs_types.hpp"
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Position of an iteration over the items in storage, see
+ * Storage::findEntry and Storage::nextEntry.
+ *
+ * The iterator remembers the page and entry index of the current item, so
+ * that the next step continues the scan from there. If storage is
+ * modified between steps, items which were written or moved in the
+ * meantime may be visited twice or not at all.
+ */
+class EntryIterator
+{
+public:
+    EntryIterator()
+    {
+    }
+
+    uint8_t nsIndex() const
+    {
+        return mItem.nsIndex;
+    }
+
+    /**
+     * Type of the current item. Multi-page blobs are reported as BLOB.
+     */
+    ItemType datatype() const
+    {
+        if (mItem.datatype == ItemType::BLOB_IDX) {
+            return ItemType::BLOB;
+        }
+        return mItem.datatype;
+    }
+
+    const char* key() const
+    {
+        return mItem.key;
+    }
+
+protected:
+    friend class Storage;
+
+    uint8_t mNsIndex = 0;
+    ItemType mType = ItemType::ANY;
+    uint32_t mGeneration = 0;
+    // page of the current item, nullptr once the end is reached
+    Page* mPage = nullptr;
+    uint32_t mSeqNumber = 0;
+    size_t mItemIndex = 0;
+    Item mItem;
+}; // class EntryIterator
+
+} // namespace nvs
+
+#endif /* nvs_entry_iterator_hpp */
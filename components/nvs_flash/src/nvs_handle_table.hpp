@@ -0,0 +1,189 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_handle_table_hpp
+#define nvs_handle_table_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include "esp_err.h"
+
+namespace nvs
+{
+
+/**
+ * Table of objects referred to by 32-bit handles.
+ *
+ * A handle is made of a slot index in the lower 16 bits and the
+ * generation of the slot in the next 12 bits. The generation is
+ * incremented when an object is removed, so a handle which was closed
+ * doesn't find an object added to the same slot later. The top 4 bits
+ * of a handle are always zero, callers may use them to tell tables
+ * apart, and have to clear them before calling find or remove. Lookup is a
+ * single array access, and free slots are kept in a list, so that they
+ * are reused before the table grows.
+ *
+ * Objects added to the table are owned by it, and are deleted by remove
+ * and clear. Handle 0 is never returned.
+ */
+template<typename T>
+class HandleTable
+{
+public:
+    HandleTable()
+    {
+    }
+
+    ~HandleTable()
+    {
+        clear();
+        delete[] mSlots;
+    }
+
+    esp_err_t add(T* object, uint32_t& handle)
+    {
+        if (mFreeSlot == NO_SLOT) {
+            auto err = grow();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        uint16_t index = mFreeSlot;
+        Slot& slot = mSlots[index];
+        mFreeSlot = slot.mNextFree;
+        slot.mObject = object;
+        ++mCount;
+        handle = makeHandle(index, slot.mGeneration);
+        return ESP_OK;
+    }
+
+    /**
+     * Object the handle refers to, or nullptr if the handle is not valid.
+     */
+    T* find(uint32_t handle) const
+    {
+        uint16_t index = (handle & 0xffff) - 1;
+        if (index >= mSize) {
+            return nullptr;
+        }
+        const Slot& slot = mSlots[index];
+        if (slot.mGeneration != (handle >> 16)) {
+            return nullptr;
+        }
+        return slot.mObject;
+    }
+
+    /**
+     * Delete the object the handle refers to, and free its slot.
+     * Returns false if the handle is not valid.
+     */
+    bool remove(uint32_t handle)
+    {
+        T* object = find(handle);
+        if (!object) {
+            return false;
+        }
+        release((handle & 0xffff) - 1);
+        delete object;
+        return true;
+    }
+
+    void clear()
+    {
+        for (uint16_t i = 0; i < mSize; ++i) {
+            if (mSlots[i].mObject) {
+                T* object = mSlots[i].mObject;
+                release(i);
+                delete object;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return mCount;
+    }
+
+protected:
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    static const uint16_t NO_SLOT = 0xffff;
+    static const size_t MAX_SLOTS = 0xfffe;
+    static const size_t INITIAL_SLOTS = 4;
+    static const uint16_t GENERATION_MASK = 0x0fff;
+
+    struct Slot {
+        T* mObject;
+        uint16_t mGeneration;
+        uint16_t mNextFree;
+    };
+
+    static uint32_t makeHandle(uint16_t index, uint16_t generation)
+    {
+        return (static_cast<uint32_t>(generation) << 16) | (index + 1);
+    }
+
+    void release(uint16_t index)
+    {
+        Slot& slot = mSlots[index];
+        slot.mObject = nullptr;
+        slot.mGeneration = (slot.mGeneration + 1) & GENERATION_MASK;
+        slot.mNextFree = mFreeSlot;
+        mFreeSlot = index;
+        --mCount;
+    }
+
+    esp_err_t grow()
+    {
+        size_t newSize = mSize * 2;
+        if (newSize < INITIAL_SLOTS) {
+            newSize = INITIAL_SLOTS;
+        }
+        if (newSize > MAX_SLOTS) {
+            newSize = MAX_SLOTS;
+        }
+        if (newSize == mSize) {
+            return ESP_ERR_NO_MEM;
+        }
+        Slot* slots = new (std::nothrow) Slot[newSize];
+        if (!slots) {
+            return ESP_ERR_NO_MEM;
+        }
+        if (mSlots) {
+            memcpy(slots, mSlots, mSize * sizeof(Slot));
+        }
+        // new slots are added to the free list in order of index
+        for (size_t i = newSize; i > mSize; --i) {
+            Slot& slot = slots[i - 1];
+            slot.mObject = nullptr;
+            slot.mGeneration = 0;
+            slot.mNextFree = mFreeSlot;
+            mFreeSlot = static_cast<uint16_t>(i - 1);
+        }
+        delete[] mSlots;
+        mSlots = slots;
+        mSize = static_cast<uint16_t>(newSize);
+        return ESP_OK;
+    }
+
+    Slot* mSlots = nullptr;
+    uint16_t mSize = 0;
+    uint16_t mCount = 0;
+    uint16_t mFreeSlot = NO_SLOT;
+}; // class HandleTable
+
+} // namespace nvs
+
+#endif /* nvs_handle_table_hpp */
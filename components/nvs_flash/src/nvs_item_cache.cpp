@@ -0,0 +1,131 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_item_cache.hpp"
+#include "nvs_item_hash_list.hpp"
+#include "nvs_platform.hpp"
+#include <new>
+
+namespace nvs
+{
+
+void ItemCache::init(size_t capacity)
+{
+    // called with storage locked exclusively, so there are no readers
+    mEntries.reset();
+    mCapacity = 0;
+    if (capacity > 0) {
+        mEntries.reset(new (std::nothrow) Entry[capacity]);
+        if (mEntries) {
+            mCapacity = capacity;
+        }
+    }
+    for (size_t i = 0; i < mCapacity; ++i) {
+        mEntries[i].mUsed = false;
+    }
+    mClock = 0;
+    mHits = 0;
+    mMisses = 0;
+}
+
+ItemCache::Entry* ItemCache::find(uint32_t hash, uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    for (size_t i = 0; i < mCapacity; ++i) {
+        Entry& entry = mEntries[i];
+        if (entry.mUsed && entry.mHash == hash && entry.mNsIndex == nsIndex &&
+            (datatype == ItemType::ANY || entry.mType == datatype) &&
+            strncmp(entry.mKey, key, Item::MAX_KEY_LENGTH) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool ItemCache::get(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
+{
+    if (mCapacity == 0) {
+        return false;
+    }
+    uint32_t hash = HashList::getHash(nsIndex, key);
+    CacheLock lock;
+    Entry* entry = find(hash, nsIndex, datatype, key);
+    if (!entry) {
+        ++mMisses;
+        return false;
+    }
+    ++mHits;
+    entry->mLastUse = ++mClock;
+    memcpy(data, entry->mData, dataSize);
+    return true;
+}
+
+void ItemCache::put(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (mCapacity == 0) {
+        return;
+    }
+    uint32_t hash = HashList::getHash(nsIndex, key);
+    CacheLock lock;
+    Entry* entry = find(hash, nsIndex, datatype, key);
+    if (!entry) {
+        // take a free entry, or the least recently used one
+        entry = &mEntries[0];
+        for (size_t i = 0; i < mCapacity && entry->mUsed; ++i) {
+            if (!mEntries[i].mUsed || mEntries[i].mLastUse < entry->mLastUse) {
+                entry = &mEntries[i];
+            }
+        }
+    }
+    entry->mHash = hash;
+    entry->mNsIndex = nsIndex;
+    entry->mType = datatype;
+    entry->mUsed = true;
+    strncpy(entry->mKey, key, sizeof(entry->mKey) - 1);
+    entry->mKey[sizeof(entry->mKey) - 1] = 0;
+    memcpy(entry->mData, data, dataSize);
+    entry->mLastUse = ++mClock;
+}
+
+void ItemCache::invalidate(uint8_t nsIndex, const char* key)
+{
+    if (mCapacity == 0) {
+        return;
+    }
+    uint32_t hash = HashList::getHash(nsIndex, key);
+    CacheLock lock;
+    Entry* entry;
+    while ((entry = find(hash, nsIndex, ItemType::ANY, key)) != nullptr) {
+        entry->mUsed = false;
+    }
+}
+
+void ItemCache::clear()
+{
+    CacheLock lock;
+    for (size_t i = 0; i < mCapacity; ++i) {
+        mEntries[i].mUsed = false;
+    }
+}
+
+size_t ItemCache::size() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < mCapacity; ++i) {
+        if (mEntries[i].mUsed) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+} // namespace nvs
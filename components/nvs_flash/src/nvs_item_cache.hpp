@@ -0,0 +1,111 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_item_cache_hpp
+#define nvs_item_cache_hpp
+
+#include <cstdint>
+#include <memory>
+#include "nvs.h"
+#include "nvs_types.hpp"
+
+namespace nvs
+{
+
+/**
+ * Values of integer items which were read recently, kept in RAM.
+ *
+ * Entries are identified by (namespace index, key, type) and hold the
+ * decoded value. When the cache is full, the least recently used entry is
+ * replaced. The cache is small, so entries are kept in an array and found
+ * by comparing a hash of namespace and key first, and the key itself only
+ * if the hash matches.
+ *
+ * Storage forgets the values of a key before changing it. Lookups may run
+ * in parallel under a SharedLock, so all methods take CacheLock.
+ */
+class ItemCache
+{
+public:
+    /**
+     * Allocate room for capacity values. If capacity is 0, or allocation
+     * fails, nothing is cached.
+     */
+    void init(size_t capacity);
+
+    /**
+     * Copy the cached value of the item into data. Returns false, and
+     * counts a miss, if the value is not cached.
+     */
+    bool get(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
+
+    void put(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    /**
+     * Forget the values of the key, of any type.
+     */
+    void invalidate(uint8_t nsIndex, const char* key);
+
+    void clear();
+
+    /**
+     * Only integer items are cached, strings and blobs are always read
+     * from flash.
+     */
+    static bool isCacheable(ItemType datatype, size_t dataSize)
+    {
+        // integer types are 0x0n and 0x1n, with n being the size of the value
+        const uint8_t type = static_cast<uint8_t>(datatype);
+        return (type & 0xe0) == 0 && dataSize == (type & 0x0f);
+    }
+
+    size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+    size_t size() const;
+
+    uint32_t hits() const
+    {
+        return mHits;
+    }
+
+    uint32_t misses() const
+    {
+        return mMisses;
+    }
+
+protected:
+    struct Entry {
+        uint32_t mHash;
+        uint32_t mLastUse;
+        uint8_t mNsIndex;
+        ItemType mType;
+        bool mUsed;
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        uint8_t mData[sizeof(Item::data)];
+    };
+
+    Entry* find(uint32_t hash, uint8_t nsIndex, ItemType datatype, const char* key);
+
+    std::unique_ptr<Entry[]> mEntries;
+    size_t mCapacity = 0;
+    uint32_t mClock = 0;
+    uint32_t mHits = 0;
+    uint32_t mMisses = 0;
+}; // class ItemCache
+
+} // namespace nvs
+
+#endif /* nvs_item_cache_hpp */
@@ -0,0 +1,124 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_item_hash_list.hpp"
+#include <new>
+#if defined(ESP_PLATFORM)
+#include <rom/crc.h>
+#else
+#include "crc.h"
+#endif
+
+namespace nvs
+{
+
+HashList::HashList()
+{
+}
+
+HashList::~HashList()
+{
+    clear();
+}
+
+HashList::HashListBlock::HashListBlock()
+{
+    static_assert(sizeof(HashListBlock) == HashListBlock::BYTE_SIZE,
+                  "cache block size calculation incorrect");
+}
+
+uint32_t HashList::getHash(uint8_t nsIndex, const char* key)
+{
+    uint32_t result = crc32_le(0xffffffff, &nsIndex, sizeof(nsIndex));
+    result = crc32_le(result, reinterpret_cast<const uint8_t*>(key), strnlen(key, Item::MAX_KEY_LENGTH));
+    return result & 0xffffff;
+}
+
+void HashList::clear()
+{
+    for (auto it = mBlockList.begin(); it != mBlockList.end();) {
+        auto tmp = it;
+        ++it;
+        mBlockList.erase(tmp);
+        delete static_cast<HashListBlock*>(tmp);
+    }
+    mItemCount = 0;
+    mValid = true;
+}
+
+void HashList::insert(const Item& item, size_t index)
+{
+    if (!mValid) {
+        return;
+    }
+    // items are appended to a page in the order of increasing entry index,
+    // so keeping the list sorted only requires appending to the last block
+    assert(mBlockList.empty() || mBlockList.back().mNodes[mBlockList.back().mCount - 1].mIndex < index);
+
+    if (mBlockList.empty() || mBlockList.back().mCount == HashListBlock::ENTRY_COUNT) {
+        auto block = new (std::nothrow) HashListBlock;
+        if (!block) {
+            // keep going without the index rather than failing the write
+            clear();
+            mValid = false;
+            return;
+        }
+        mBlockList.push_back(block);
+    }
+    HashListBlock& block = mBlockList.back();
+    block.mNodes[block.mCount++] = HashListNode(getHash(item.nsIndex, item.key), index);
+    ++mItemCount;
+}
+
+void HashList::erase(size_t index)
+{
+    for (auto it = mBlockList.begin(); it != mBlockList.end(); ++it) {
+        auto& block = *it;
+        if (block.mNodes[block.mCount - 1].mIndex < index) {
+            continue;
+        }
+        for (size_t i = 0; i < block.mCount; ++i) {
+            if (block.mNodes[i].mIndex != index) {
+                continue;
+            }
+            std::copy(block.mNodes + i + 1, block.mNodes + block.mCount, block.mNodes + i);
+            --block.mCount;
+            --mItemCount;
+            if (block.mCount == 0) {
+                mBlockList.erase(it);
+                delete static_cast<HashListBlock*>(it);
+            }
+            return;
+        }
+        return;
+    }
+}
+
+size_t HashList::find(size_t start, uint8_t nsIndex, const char* key)
+{
+    uint32_t hash = getHash(nsIndex, key);
+    for (auto it = mBlockList.begin(); it != mBlockList.end(); ++it) {
+        auto& block = *it;
+        if (block.mNodes[block.mCount - 1].mIndex < start) {
+            continue;
+        }
+        for (size_t i = 0; i < block.mCount; ++i) {
+            if (block.mNodes[i].mIndex >= start && block.mNodes[i].mHash == hash) {
+                return block.mNodes[i].mIndex;
+            }
+        }
+    }
+    return SIZE_MAX;
+}
+
+} // namespace nvs
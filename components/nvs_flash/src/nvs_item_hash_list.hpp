@@ -0,0 +1,108 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_item_hash_list_h
+#define nvs_item_hash_list_h
+
+#include "nvs.h"
+#include "nvs_types.hpp"
+#include "intrusive_list.h"
+
+namespace nvs
+{
+
+/**
+ * In-RAM index of items stored in a page.
+ *
+ * For every item header written into a page, the list keeps a 24-bit hash of
+ * (namespace index, key) together with the index of the entry. Nodes are kept
+ * sorted by entry index, so that the candidates for a given key can be
+ * enumerated in the same order as a linear scan of the page would visit them.
+ *
+ * Data type is deliberately not part of the hash: a lookup with a wrong type
+ * still needs to find the item in order to report a type mismatch.
+ */
+class HashList
+{
+public:
+    HashList();
+    ~HashList();
+
+    void insert(const Item& item, size_t index);
+    void erase(size_t index);
+
+    /**
+     * Return the smallest entry index >= start for which the hash of
+     * (nsIndex, key) matches, or SIZE_MAX if there is no such entry.
+     * Matching entries still have to be read and compared by the caller.
+     */
+    size_t find(size_t start, uint8_t nsIndex, const char* key);
+
+    void clear();
+
+    /**
+     * False if an allocation failed at some point since the last clear().
+     * In that case the index is missing some items and can't be relied upon.
+     */
+    bool isValid() const
+    {
+        return mValid;
+    }
+
+    size_t getItemCount() const
+    {
+        return mItemCount;
+    }
+
+    static uint32_t getHash(uint8_t nsIndex, const char* key);
+
+protected:
+
+    HashList(const HashList& other);
+    const HashList& operator= (const HashList& rhs);
+
+    struct HashListNode {
+        HashListNode() :
+            mIndex(0xff), mHash(0)
+        {
+        }
+
+        HashListNode(uint32_t hash, size_t index) :
+            mIndex((uint32_t) index), mHash(hash)
+        {
+        }
+
+        uint32_t mIndex : 8;
+        uint32_t mHash  : 24;
+    };
+
+    struct HashListBlock : public intrusive_list_node<HashListBlock> {
+        HashListBlock();
+
+        static const size_t BYTE_SIZE = 128;
+        static const size_t ENTRY_COUNT = (BYTE_SIZE - sizeof(intrusive_list_node<HashListBlock>) - sizeof(size_t)) / 4;
+
+        size_t mCount = 0;
+        HashListNode mNodes[ENTRY_COUNT];
+    };
+
+    typedef intrusive_list<HashListBlock> TBlockList;
+    TBlockList mBlockList;
+    size_t mItemCount = 0;
+    bool mValid = true;
+}; // class HashList
+
+} // namespace nvs
+
+
+#endif /* nvs_item_hash_list_h */
@@ -0,0 +1,88 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_key_filter_h
+#define nvs_key_filter_h
+
+#include <cstdint>
+#include <cstring>
+#include "nvs_item_hash_list.hpp"
+
+namespace nvs
+{
+
+/**
+ * Bloom filter of (namespace index, key) pairs stored in a page.
+ *
+ * If mayContain() returns false, the page definitely doesn't hold the key,
+ * and can be skipped without reading anything from flash.
+ *
+ * Bits can not be cleared when a single item is erased, so erased keys keep
+ * producing false positives until the filter is reset. This happens when the
+ * page is erased or loaded again, or when the last item on the page is erased.
+ */
+template<size_t Nbytes>
+class KeyFilter
+{
+public:
+    KeyFilter()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(mBits, 0, sizeof(mBits));
+    }
+
+    void insert(uint8_t nsIndex, const char* key)
+    {
+        uint32_t hash = HashList::getHash(nsIndex, key);
+        setBit(hash);
+        setBit(hash >> 12);
+    }
+
+    bool mayContain(uint8_t nsIndex, const char* key) const
+    {
+        uint32_t hash = HashList::getHash(nsIndex, key);
+        return getBit(hash) && getBit(hash >> 12);
+    }
+
+    static constexpr size_t byteSize()
+    {
+        return Nbytes;
+    }
+
+protected:
+    static const size_t BIT_COUNT = Nbytes * 8;
+    static_assert((BIT_COUNT & (BIT_COUNT - 1)) == 0, "filter size must be a power of two");
+    static_assert(BIT_COUNT <= 4096, "two 12-bit halves of the hash are used as bit indices");
+
+    void setBit(uint32_t hash)
+    {
+        size_t bit = hash & (BIT_COUNT - 1);
+        mBits[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+    }
+
+    bool getBit(uint32_t hash) const
+    {
+        size_t bit = hash & (BIT_COUNT - 1);
+        return (mBits[bit / 8] & (1 << (bit % 8))) != 0;
+    }
+
+    uint8_t mBits[Nbytes];
+}; // class KeyFilter
+
+} // namespace nvs
+
+#endif /* nvs_key_filter_h */
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_page.hpp"
+#include "nvs_platform.hpp"
+#include "nvs_encryption.hpp"
 #if defined(ESP_PLATFORM)
 #include <rom/crc.h>
 #else
@@ -35,25 +37,34 @@ esp_err_t Page::load(uint32_t sectorNumber)
     mBaseAddress = sectorNumber * SEC_SIZE;
     mUsedEntryCount = 0;
     mErasedEntryCount = 0;
-
-    Header header;
-    auto rc = spi_flash_read(mBaseAddress, reinterpret_cast<uint32_t*>(&header), sizeof(header));
+    mDeferStateWrites = false;
+    mFirstDeferredWord = SIZE_MAX;
+    mLastDeferredWord = 0;
+    clearIndex();
+
+    // header and entry state table are adjacent, read both at once
+    uint32_t line[(ENTRY_DATA_OFFSET - HEADER_OFFSET) / sizeof(uint32_t)];
+    auto rc = readFlash(mBaseAddress + HEADER_OFFSET, line, sizeof(line));
     if (rc != ESP_OK) {
         mState = PageState::INVALID;
         return rc;
     }
+    Header header;
+    memcpy(&header, line, sizeof(header));
+    memcpy(mEntryTable.data(), reinterpret_cast<uint8_t*>(line) + (ENTRY_TABLE_OFFSET - HEADER_OFFSET), mEntryTable.byteSize());
     if (header.mState == PageState::UNINITIALIZED) {
         mState = header.mState;
         // check if the whole page is really empty
         // reading the whole page takes ~40 times less than erasing it
-        uint32_t line[8];
         for (uint32_t i = 0; i < SPI_FLASH_SEC_SIZE; i += sizeof(line)) {
-            rc = spi_flash_read(mBaseAddress + i, line, sizeof(line));
-            if (rc != ESP_OK) {
-                mState = PageState::INVALID;
-                return rc;
+            if (i != HEADER_OFFSET) {
+                rc = readFlash(mBaseAddress + i, line, sizeof(line));
+                if (rc != ESP_OK) {
+                    mState = PageState::INVALID;
+                    return rc;
+                }
             }
-            if (std::any_of(line, line + 4, [](uint32_t val) -> bool { return val != 0xffffffff; })) {
+            if (std::any_of(line, line + sizeof(line) / sizeof(line[0]), [](uint32_t val) -> bool { return val != 0xffffffff; })) {
                 // page isn't as empty after all, mark it as corrupted
                 mState = PageState::CORRUPT;
                 break;
@@ -66,6 +77,9 @@ esp_err_t Page::load(uint32_t sectorNumber)
     else {
         mState = header.mState;
         mSeqNumber = header.mSeqNumber;
+        if (header.mEraseCount != UNKNOWN_ERASE_COUNT) {
+            mEraseCount = header.mEraseCount;
+        }
     }
     
     switch (mState) {
@@ -88,7 +102,7 @@ esp_err_t Page::load(uint32_t sectorNumber)
 
 esp_err_t Page::writeEntry(const Item& item)
 {
-    auto rc = spi_flash_write(getEntryAddress(mNextFreeEntry), reinterpret_cast<const uint32_t*>(&item), sizeof(item));
+    auto rc = writeEntries(mNextFreeEntry, &item, 1);
     if (rc != ESP_OK) {
         mState = PageState::INVALID;
         return rc;
@@ -109,7 +123,7 @@ esp_err_t Page::writeEntry(const Item& item)
     return ESP_OK;
 }
 
-esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint16_t chunkIdx)
 {
     Item item;
 
@@ -132,14 +146,14 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
 
     size_t totalSize = ENTRY_SIZE;
     size_t entriesCount = 1;
-    if (datatype == ItemType::SZ || datatype == ItemType::BLOB) {
+    if (isVariableLengthType(datatype)) {
         size_t roundedSize = (dataSize + ENTRY_SIZE - 1) & ~(ENTRY_SIZE - 1);
         totalSize += roundedSize;
         entriesCount += roundedSize / ENTRY_SIZE;
     }
 
     // primitive types should fit into one entry
-    assert(totalSize == ENTRY_SIZE || datatype == ItemType::BLOB || datatype == ItemType::SZ);
+    assert(totalSize == ENTRY_SIZE || isVariableLengthType(datatype));
 
     if (mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + entriesCount > ENTRY_COUNT) {
         // page will not fit this amount of data
@@ -159,23 +173,27 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     strncpy(item.key, key, sizeof(item.key) - 1);
     item.key[sizeof(item.key) - 1] = 0;
 
-    if (datatype != ItemType::SZ && datatype != ItemType::BLOB) {
+    const size_t headerIndex = mNextFreeEntry;
+
+    if (!isVariableLengthType(datatype)) {
         memcpy(item.data, data, dataSize);
         item.crc32 = item.calculateCrc32();
         err = writeEntry(item);
         if (err != ESP_OK) {
             return err;
         }
+        addToIndex(item, headerIndex);
     } else {
         const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
         item.varLength.dataCrc32 = Item::calculateCrc32(src, dataSize);
         item.varLength.dataSize = dataSize;
-        item.varLength.reserved2 = 0xffff;
+        item.varLength.chunkIndex = chunkIdx;
         item.crc32 = item.calculateCrc32();
         err = writeEntry(item);
         if (err != ESP_OK) {
             return err;
         }
+        addToIndex(item, headerIndex);
 
         size_t left = dataSize;
         while (left != 0) {
@@ -193,16 +211,338 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     return ESP_OK;
 }
 
-esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
+esp_err_t Page::beginItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t dataSize, Item& header, size_t& index)
+{
+    assert(isVariableLengthType(datatype));
+
+    esp_err_t err;
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    const size_t keySize = strlen(key);
+    if (keySize > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    size_t span = 1 + (dataSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
+    if (mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + span > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    std::fill_n(reinterpret_cast<uint32_t*>(header.rawData), sizeof(header.rawData) / 4, 0xffffffff);
+    header.nsIndex = nsIndex;
+    header.datatype = datatype;
+    header.span = static_cast<uint8_t>(span);
+    strncpy(header.key, key, sizeof(header.key) - 1);
+    header.key[sizeof(header.key) - 1] = 0;
+    header.varLength.dataSize = static_cast<uint16_t>(dataSize);
+
+    index = mNextFreeEntry;
+#if CONFIG_NVS_ENCRYPTION
+    // an encrypted entry can only be written once, the header is written by
+    // commitItem. mLoadEntryTable discards written entries after a blank one.
+    return ESP_OK;
+#else
+    // mLoadEntryTable uses the span of an unfinished item left by a power
+    // failure to discard its data entries as well
+    auto rc = spi_flash_write(getEntryAddress(index), reinterpret_cast<const uint32_t*>(&header), sizeof(header));
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+#endif
+}
+
+esp_err_t Page::writeEntryData(size_t index, const uint32_t* data, size_t count)
+{
+    assert(index + count <= ENTRY_COUNT);
+    auto rc = writeEntries(index, data, count);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::commitItem(size_t index, const Item& header)
+{
+    assert(index == mNextFreeEntry && index + header.span <= ENTRY_COUNT);
+    // bits of the header which were left unwritten by beginItem are written now
+    auto rc = writeEntries(index, &header, 1);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+
+    auto err = alterEntryRangeState(index, index + header.span, EntryState::WRITTEN);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    addToIndex(header, index);
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        mFirstUsedEntry = index;
+    }
+    mUsedEntryCount += header.span;
+    mNextFreeEntry = index + header.span;
+    return ESP_OK;
+}
+
+esp_err_t Page::writeCounter(uint8_t nsIndex, const char* key, uint32_t value)
+{
+    esp_err_t err;
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    const size_t span = 1 + COUNTER_BITMAP_ENTRIES;
+    if (mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + span > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    Item item;
+    std::fill_n(reinterpret_cast<uint32_t*>(item.rawData), sizeof(item.rawData) / 4, 0xffffffff);
+    item.nsIndex = nsIndex;
+    item.datatype = ItemType::COUNTER;
+    item.span = static_cast<uint8_t>(span);
+    strncpy(item.key, key, sizeof(item.key) - 1);
+    item.key[sizeof(item.key) - 1] = 0;
+    item.counter.bitmapSize = static_cast<uint16_t>(COUNTER_BITMAP_ENTRIES * ENTRY_SIZE);
+    item.counter.chunkIndex = Item::CHUNK_ANY;
+    item.counter.base = value;
+    item.crc32 = item.calculateCrc32();
+
+    // the bitmap entries are free, so they are still blank and only the
+    // header is written. mLoadEntryTable discards the whole span if power
+    // goes out before the entry states are written
+    const size_t index = mNextFreeEntry;
+    auto rc = writeEntries(index, &item, 1);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    err = alterEntryRangeState(index, index + span, EntryState::WRITTEN);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    addToIndex(item, index);
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        mFirstUsedEntry = index;
+    }
+    mUsedEntryCount += span;
+    mNextFreeEntry = index + span;
+    return ESP_OK;
+}
+
+esp_err_t Page::readCounter(uint8_t nsIndex, const char* key, uint32_t& value, size_t& itemIndex, size_t& increments, size_t& capacity)
+{
+    itemIndex = 0;
+    Item item;
+    auto rc = findItem(nsIndex, ItemType::COUNTER, key, itemIndex, item);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    capacity = 0;
+    increments = 0;
+    if (item.span > 1 && item.counter.bitmapSize == (item.span - 1) * ENTRY_SIZE) {
+        uint32_t bitmap[COUNTER_BITMAP_ENTRIES * ENTRY_SIZE / sizeof(uint32_t) + 1];
+        const size_t words = item.counter.bitmapSize / sizeof(uint32_t);
+        if (words >= sizeof(bitmap) / sizeof(bitmap[0])) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        rc = readFlash(getEntryAddress(itemIndex + 1), bitmap, words * sizeof(uint32_t));
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        // each cleared bit is one increment
+        for (size_t i = 0; i < words; ++i) {
+            increments += __builtin_popcount(~bitmap[i]);
+        }
+        capacity = words * 32;
+    }
+    value = item.counter.base + static_cast<uint32_t>(increments);
+    return ESP_OK;
+}
+
+esp_err_t Page::incrementCounter(size_t itemIndex, size_t increments)
+{
+    assert(itemIndex + 1 + increments / (ENTRY_SIZE * 8) < ENTRY_COUNT);
+    // all bits up to and including the new one are cleared
+    const size_t bit = increments % 32;
+    const uint32_t word = (bit == 31) ? 0 : (0xffffffff << (bit + 1));
+    const uint32_t address = getEntryAddress(itemIndex + 1) + static_cast<uint32_t>(increments / 32) * 4;
+    auto rc = spi_flash_write(address, &word, 4);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::discardItem(size_t index, size_t span)
+{
+    assert(index == mNextFreeEntry && index + span <= ENTRY_COUNT);
+    auto err = alterEntryRangeState(index, index + span, EntryState::ERASED);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mErasedEntryCount += span;
+    mNextFreeEntry = index + span;
+    updateHeap();
+    return ESP_OK;
+}
+
+esp_err_t Page::writeItems(const Item* const* items, size_t count, size_t& itemsWritten)
+{
+    itemsWritten = 0;
+
+    esp_err_t err;
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL || mNextFreeEntry == INVALID_ENTRY) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    // entry data is written first and the state table is updated once for
+    // the whole run. if power fails in between, mLoadEntryTable finds the
+    // entries which were written but not marked, and erases them.
+    const size_t firstEntry = mNextFreeEntry;
+    size_t end = firstEntry;
+    EntryCipher::Session session;
+    for (; itemsWritten < count; ++itemsWritten) {
+        const Item* entries = items[itemsWritten];
+        size_t span = entries[0].span;
+        if (end + span > ENTRY_COUNT) {
+            break;
+        }
+        auto rc = writeEntries(end, entries, span);
+        if (rc != ESP_OK) {
+            mState = PageState::INVALID;
+            return rc;
+        }
+        end += span;
+    }
+
+    if (end != firstEntry) {
+        err = alterEntryRangeState(firstEntry, end, EntryState::WRITTEN);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        size_t index = firstEntry;
+        for (size_t i = 0; i < itemsWritten; ++i) {
+            addToIndex(items[i][0], index);
+            index += items[i][0].span;
+        }
+
+        if (mFirstUsedEntry == INVALID_ENTRY) {
+            mFirstUsedEntry = firstEntry;
+        }
+        mUsedEntryCount += end - firstEntry;
+        mNextFreeEntry = end;
+    }
+
+    return (itemsWritten == count) ? ESP_OK : ESP_ERR_NVS_PAGE_FULL;
+}
+
+esp_err_t Page::beginBatch(size_t entryCount, size_t& index)
+{
+    esp_err_t err;
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL || mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + entryCount + 1 > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    // only the state of the marker is written, its data is left erased
+    err = alterEntryState(mNextFreeEntry, EntryState::BATCH);
+    if (err != ESP_OK) {
+        return err;
+    }
+    index = mNextFreeEntry;
+    ++mNextFreeEntry;
+    return ESP_OK;
+}
+
+esp_err_t Page::commitBatch(size_t index)
+{
+    assert(mEntryTable.get(index) == EntryState::BATCH);
+    auto err = alterEntryState(index, EntryState::ERASED);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mErasedEntryCount;
+    updateHeap();
+    return ESP_OK;
+}
+
+esp_err_t Page::abortBatch(size_t index)
+{
+    assert(mEntryTable.get(index) == EntryState::BATCH);
+    // entries after the marker have to be erased first, otherwise the batch
+    // would look committed if power went out in between. if writeItems
+    // failed to write the entry state table, the entries are only marked
+    // as written in RAM, and not counted as used.
+    size_t end = mEntryTable.find(EntryState::EMPTY, index + 1, ENTRY_COUNT);
+    if (end > index + 1) {
+        for (size_t i = index + 1; i < end; ++i) {
+            if (i < mNextFreeEntry && mEntryTable.get(i) == EntryState::WRITTEN) {
+                removeFromIndex(i);
+                --mUsedEntryCount;
+            }
+        }
+        auto err = alterEntryRangeState(index + 1, end, EntryState::ERASED);
+        if (err != ESP_OK) {
+            return err;
+        }
+        mErasedEntryCount += end - index - 1;
+        updateAfterErase(index + 1, end - index - 1);
+    }
+    return commitBatch(index);
+}
+
+esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint16_t chunkIdx)
 {
     size_t index = 0;
     Item item;
-    esp_err_t rc = findItem(nsIndex, datatype, key, index, item);
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
     if (rc != ESP_OK) {
         return rc;
     }
 
-    if (datatype != ItemType::SZ && datatype != ItemType::BLOB) {
+    if (!isVariableLengthType(datatype)) {
         if (dataSize != getAlignmentForType(datatype)) {
             return ESP_ERR_NVS_TYPE_MISMATCH;
         }
@@ -230,29 +570,71 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
         dst += willCopy;
     }
     if (Item::calculateCrc32(reinterpret_cast<uint8_t*>(data), item.varLength.dataSize) != item.varLength.dataCrc32) {
-        rc = eraseEntryAndSpan(index);
-        if (rc != ESP_OK) {
-            return rc;
+        if (!isShared()) {
+            rc = eraseEntryAndSpan(index);
+            if (rc != ESP_OK) {
+                return rc;
+            }
         }
         return ESP_ERR_NVS_NOT_FOUND;
     }
     return ESP_OK;
 }
 
-esp_err_t Page::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
+esp_err_t Page::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint16_t chunkIdx)
 {
     size_t index = 0;
     Item item;
-    esp_err_t rc = findItem(nsIndex, datatype, key, index, item);
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
     if (rc != ESP_OK) {
         return rc;
     }
-    if (CachedFindInfo(nsIndex, datatype, key) == mFindInfo) {
+    if (CachedFindInfo(nsIndex, datatype, key, chunkIdx) == mFindInfo) {
         invalidateCache();
     }
     return eraseEntryAndSpan(index);
 }
 
+esp_err_t Page::eraseItems(uint8_t nsIndex, bool* allMatched)
+{
+    // entry index and span of each matching item
+    uint8_t indices[ENTRY_COUNT];
+    uint8_t spans[ENTRY_COUNT];
+    size_t count = 0;
+    bool othersFound = false;
+    auto rc = forEachItem([&](size_t index, const Item& item) -> esp_err_t {
+        if (nsIndex != NS_ANY && item.nsIndex != nsIndex) {
+            othersFound = true;
+            return ESP_OK;
+        }
+        indices[count] = static_cast<uint8_t>(index);
+        spans[count] = isVariableLengthType(item.datatype) ? item.span : 1;
+        ++count;
+        return ESP_OK;
+    });
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    if (allMatched) {
+        *allMatched = (count > 0 && !othersFound);
+        if (*allMatched) {
+            return ESP_OK;
+        }
+    }
+
+    if (count > 0) {
+        invalidateCache();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        rc = eraseEntryAndSpan(indices[i], spans[i]);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key)
 {
     size_t index = 0;
@@ -278,37 +660,46 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
     auto state = mEntryTable.get(index);
     assert(state == EntryState::WRITTEN || state == EntryState::EMPTY);
 
-    size_t span = 1;
     if (state == EntryState::WRITTEN) {
         Item item;
         auto rc = readEntry(index, item);
         if (rc != ESP_OK) {
             return rc;
         }
-        if (item.calculateCrc32() != item.crc32) {
-            rc = alterEntryState(index, EntryState::ERASED);
-            if (rc != ESP_OK) {
-                return rc;
-            }
-        } else {
-            span = item.span;
-            for (ptrdiff_t i = index + span - 1; i >= static_cast<ptrdiff_t>(index); --i) {
-                if (mEntryTable.get(i) == EntryState::WRITTEN) {
-                    --mUsedEntryCount;
-                }
-                rc = alterEntryState(i, EntryState::ERASED);
-                if (rc != ESP_OK) {
-                    return rc;
-                }
-                ++mErasedEntryCount;
-            }
-        }
+        // the span of a corrupted item can't be trusted, only erase its header
+        size_t span = (item.calculateCrc32() == item.crc32) ? item.span : 1;
+        return eraseEntryAndSpan(index, span);
     }
-    else {
-        auto rc = alterEntryState(index, EntryState::ERASED);
+
+    auto rc = alterEntryState(index, EntryState::ERASED);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+    updateAfterErase(index, 1);
+    return ESP_OK;
+}
+
+esp_err_t Page::eraseEntryAndSpan(size_t index, size_t span)
+{
+    removeFromIndex(index);
+    for (ptrdiff_t i = index + span - 1; i >= static_cast<ptrdiff_t>(index); --i) {
+        if (mEntryTable.get(i) == EntryState::WRITTEN) {
+            --mUsedEntryCount;
+        }
+        auto rc = alterEntryState(i, EntryState::ERASED);
         if (rc != ESP_OK) {
             return rc;
         }
+        ++mErasedEntryCount;
+    }
+    updateAfterErase(index, span);
+    return ESP_OK;
+}
+
+void Page::updateAfterErase(size_t index, size_t span)
+{
+    if (mUsedEntryCount == 0) {
+        clearIndex();
     }
 
     if (index == mFirstUsedEntry) {
@@ -319,7 +710,7 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
         mNextFreeEntry = index + span;
     }
 
-    return ESP_OK;
+    updateHeap();
 }
 
 void Page::updateFirstUsedEntry(size_t index, size_t span)
@@ -330,10 +721,10 @@ void Page::updateFirstUsedEntry(size_t index, size_t span)
     if (end > ENTRY_COUNT) {
         end = ENTRY_COUNT;
     }
-    for (size_t i = index + span; i < end; ++i) {
-        if (mEntryTable.get(i) == EntryState::WRITTEN) {
+    if (index + span < end) {
+        size_t i = mEntryTable.find(EntryState::WRITTEN, index + span, end);
+        if (i < end) {
             mFirstUsedEntry = i;
-            break;
         }
     }
 }
@@ -356,14 +747,24 @@ esp_err_t Page::moveItem(Page& other)
     }
 
     Item entry;
+    EntryCipher::Session session;
     auto err = readEntry(mFirstUsedEntry, entry);
     if (err != ESP_OK) {
         return err;
     }
+
+    if (other.mState != PageState::ACTIVE || other.mNextFreeEntry == INVALID_ENTRY ||
+        other.mNextFreeEntry + entry.span > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    removeFromIndex(mFirstUsedEntry);
+    const size_t otherIndex = other.mNextFreeEntry;
     err = other.writeEntry(entry);
     if (err != ESP_OK) {
         return err;
     }
+    other.addToIndex(entry, otherIndex);
 
     size_t span = entry.span;
     size_t end = mFirstUsedEntry + span;
@@ -386,72 +787,111 @@ esp_err_t Page::moveItem(Page& other)
     updateFirstUsedEntry(mFirstUsedEntry, span);
     mErasedEntryCount += span;
     mUsedEntryCount -= span;
+    updateHeap();
     
     return ESP_OK;
 }
 
 esp_err_t Page::mLoadEntryTable()
 {
-    // for states where we actually care about data in the page, read entry state table
-    if (mState == PageState::ACTIVE ||
-            mState == PageState::FULL ||
-            mState == PageState::FREEING) {
-        auto rc = spi_flash_read(mBaseAddress + ENTRY_TABLE_OFFSET, mEntryTable.data(),
-                                 static_cast<uint32_t>(mEntryTable.byteSize()));
-        if (rc != ESP_OK) {
+    // entry state table has been read by load, together with the header
+    EntryCipher::Session session;
+
+    // a batch which wasn't committed when power went out is rolled back.
+    // its items are the ones written after the marker, the marker itself
+    // is erased last, like in abortBatch
+    size_t batchIndex = mEntryTable.find(EntryState::BATCH, 0, ENTRY_COUNT);
+    if (batchIndex < ENTRY_COUNT) {
+        size_t batchEnd = mEntryTable.find(EntryState::EMPTY, batchIndex, ENTRY_COUNT);
+        if (batchEnd > batchIndex + 1) {
+            auto err = alterEntryRangeState(batchIndex + 1, batchEnd, EntryState::ERASED);
+            if (err != ESP_OK) {
+                mState = PageState::INVALID;
+                return err;
+            }
+        }
+        auto err = alterEntryState(batchIndex, EntryState::ERASED);
+        if (err != ESP_OK) {
             mState = PageState::INVALID;
-            return rc;
+            return err;
         }
     }
-
-    mErasedEntryCount = 0;
-    mUsedEntryCount = 0;
-    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
-        auto s = mEntryTable.get(i);
-        if (s == EntryState::WRITTEN) {
-            if (mFirstUsedEntry == INVALID_ENTRY) {
-                mFirstUsedEntry = i;
-            }
-            ++mUsedEntryCount;
-        } else if (s == EntryState::ERASED) {
-            ++mErasedEntryCount;
-        }
+    mErasedEntryCount = mEntryTable.countEqual(EntryState::ERASED, 0, ENTRY_COUNT);
+    mUsedEntryCount = mEntryTable.countEqual(EntryState::WRITTEN, 0, ENTRY_COUNT);
+    size_t firstUsed = mEntryTable.find(EntryState::WRITTEN, 0, ENTRY_COUNT);
+    if (mFirstUsedEntry == INVALID_ENTRY && firstUsed < ENTRY_COUNT) {
+        mFirstUsedEntry = firstUsed;
     }
 
     // for PageState::ACTIVE, we may have more data written to this page
     // as such, we need to figure out where the first unused entry is
     if (mState == PageState::ACTIVE) {
-        for (size_t i = 0; i < ENTRY_COUNT; ++i) {
-            if (mEntryTable.get(i) == EntryState::EMPTY) {
-                mNextFreeEntry = i;
-                break;
-            }
+        size_t firstEmpty = mEntryTable.find(EntryState::EMPTY, 0, ENTRY_COUNT);
+        if (firstEmpty < ENTRY_COUNT) {
+            mNextFreeEntry = firstEmpty;
         }
 
         // however, if power failed after some data was written into the entry.
         // but before the entry state table was altered, the entry locacted via
         // entry state table may actually be half-written.
-        // this is easy to check by reading EntryHeader (i.e. first word)
-        if (mNextFreeEntry != INVALID_ENTRY) {
-            uint32_t entryAddress = getEntryAddress(mNextFreeEntry);
-            uint32_t header;
-            auto rc = spi_flash_read(entryAddress, &header, sizeof(header));
+        // this is easy to check by reading EntryHeader (i.e. first word).
+        // writeItems may leave a whole run of such entries, so keep going
+        // until an unused one is found, skipping over complete items.
+        while (mNextFreeEntry < ENTRY_COUNT) {
+            Item item;
+            auto rc = readEntry(mNextFreeEntry, item);
             if (rc != ESP_OK) {
                 mState = PageState::INVALID;
                 return rc;
             }
-            if (header != 0xffffffff) {
-                auto err = alterEntryState(mNextFreeEntry, EntryState::ERASED);
-                if (err != ESP_OK) {
-                    mState = PageState::INVALID;
-                    return err;
-                }
-                ++mNextFreeEntry;
+            if (*reinterpret_cast<uint32_t*>(item.rawData) == 0xffffffff) {
+                break;
+            }
+            // the header of an item being written by beginItem has no CRC yet
+            size_t span = 1;
+            bool unfinished = item.crc32 == 0xffffffff && isVariableLengthType(item.datatype);
+            if ((unfinished || item.crc32 == item.calculateCrc32()) && item.span > 1 && mNextFreeEntry + item.span <= ENTRY_COUNT) {
+                span = item.span;
             }
+            auto err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + span, EntryState::ERASED);
+            if (err != ESP_OK) {
+                mState = PageState::INVALID;
+                return err;
+            }
+            mErasedEntryCount += span;
+            mNextFreeEntry += span;
+        }
+
+#if CONFIG_NVS_ENCRYPTION
+        // commitItem writes the header of a string or blob after its data, so
+        // data of an unfinished item may follow the first blank entry
+        size_t lastWritten = mNextFreeEntry;
+        for (size_t i = mNextFreeEntry; i < ENTRY_COUNT; ++i) {
+            uint32_t raw[ENTRY_SIZE / sizeof(uint32_t)];
+            auto rc = readFlash(getEntryAddress(i), raw, sizeof(raw));
+            if (rc != ESP_OK) {
+                mState = PageState::INVALID;
+                return rc;
+            }
+            if (std::any_of(raw, raw + sizeof(raw) / sizeof(raw[0]), [](uint32_t val) -> bool { return val != 0xffffffff; })) {
+                lastWritten = i + 1;
+            }
+        }
+        if (lastWritten > mNextFreeEntry) {
+            auto err = alterEntryRangeState(mNextFreeEntry, lastWritten, EntryState::ERASED);
+            if (err != ESP_OK) {
+                mState = PageState::INVALID;
+                return err;
+            }
+            mErasedEntryCount += lastWritten - mNextFreeEntry;
+            mNextFreeEntry = lastWritten;
         }
+#endif
 
         // check that all variable-length items are written or erased fully
         Item item;
+        Item buffer[LOAD_BUFFER_ENTRIES];
+        size_t bufferStart = INVALID_ENTRY;
         size_t lastItemIndex = INVALID_ENTRY;
         size_t end = mNextFreeEntry;
         if (end > ENTRY_COUNT) {
@@ -465,7 +905,7 @@ esp_err_t Page::mLoadEntryTable()
             
             lastItemIndex = i;
 
-            auto err = readEntry(i, item);
+            auto err = readEntryBuffered(i, item, buffer, LOAD_BUFFER_ENTRIES, bufferStart);
             if (err != ESP_OK) {
                 mState = PageState::INVALID;
                 return err;
@@ -480,21 +920,19 @@ esp_err_t Page::mLoadEntryTable()
                 continue;
             }
 
-            if (item.datatype != ItemType::BLOB && item.datatype != ItemType::SZ) {
+            if (!isVariableLengthType(item.datatype)) {
+                addToIndex(item, i);
                 continue;
             }
 
             size_t span = item.span;
-            bool needErase = false;
-            for (size_t j = i; j < i + span; ++j) {
-                if (mEntryTable.get(j) != EntryState::WRITTEN) {
-                    needErase = true;
-                    lastItemIndex = INVALID_ENTRY;
-                    break;
-                }
-            }
+            bool needErase = i + span > ENTRY_COUNT ||
+                             mEntryTable.countEqual(EntryState::WRITTEN, i, i + span) != span;
             if (needErase) {
+                lastItemIndex = INVALID_ENTRY;
                 eraseEntryAndSpan(i);
+            } else {
+                addToIndex(item, i);
             }
             i += span - 1;
         }
@@ -503,7 +941,7 @@ esp_err_t Page::mLoadEntryTable()
         if (lastItemIndex != INVALID_ENTRY) {
             size_t findItemIndex = 0;
             Item dupItem;
-            if (findItem(item.nsIndex, item.datatype, item.key, findItemIndex, dupItem) == ESP_OK) {
+            if (findItem(item.nsIndex, item.datatype, item.key, findItemIndex, dupItem, item.getChunkIndex()) == ESP_OK) {
                 if (findItemIndex < lastItemIndex) {
                     auto err = eraseEntryAndSpan(findItemIndex);
                     if (err != ESP_OK) {
@@ -514,6 +952,50 @@ esp_err_t Page::mLoadEntryTable()
             }
         }
     }
+#if CONFIG_NVS_HASH_INDEX || CONFIG_NVS_BLOOM_FILTER
+    else if (mState == PageState::FULL || mState == PageState::FREEING) {
+        // entries of full pages are not checked above, but they have to be
+        // read once anyway to build the index
+        Item item;
+        Item buffer[LOAD_BUFFER_ENTRIES];
+        size_t bufferStart = INVALID_ENTRY;
+        for (size_t i = mFirstUsedEntry; i < ENTRY_COUNT; ++i) {
+            i = mEntryTable.find(EntryState::WRITTEN, i, ENTRY_COUNT);
+            if (i == ENTRY_COUNT) {
+                break;
+            }
+
+            auto err = readEntryBuffered(i, item, buffer, LOAD_BUFFER_ENTRIES, bufferStart);
+            if (err != ESP_OK) {
+                mState = PageState::INVALID;
+                return err;
+            }
+
+#if CONFIG_NVS_LAZY_CRC_CHECK
+            // single entry items are checked by findItem when they are
+            // looked up, only the span of variable length items has to be
+            // trusted here
+            bool checkCrc = isVariableLengthType(item.datatype);
+#else
+            bool checkCrc = true;
+#endif
+            if (checkCrc && item.crc32 != item.calculateCrc32()) {
+                err = eraseEntryAndSpan(i);
+                if (err != ESP_OK) {
+                    mState = PageState::INVALID;
+                    return err;
+                }
+                continue;
+            }
+
+            addToIndex(item, i);
+
+            if (isVariableLengthType(item.datatype)) {
+                i += item.span - 1;
+            }
+        }
+    }
+#endif
 
     return ESP_OK;
 }
@@ -526,6 +1008,7 @@ esp_err_t Page::initialize()
     Header header;
     header.mState = mState;
     header.mSeqNumber = mSeqNumber;
+    header.mEraseCount = mEraseCount;
     header.mCrc32 = header.calculateCrc32();
     
     auto rc = spi_flash_write(mBaseAddress, reinterpret_cast<uint32_t*>(&header), sizeof(header));
@@ -537,6 +1020,7 @@ esp_err_t Page::initialize()
     mNextFreeEntry = 0;
     std::fill_n(mEntryTable.data(), mEntryTable.byteSize() / sizeof(uint32_t), 0xffffffff);
     invalidateCache();
+    clearIndex();
     return ESP_OK;
 }
 
@@ -545,6 +1029,11 @@ esp_err_t Page::alterEntryState(size_t index, EntryState state)
     assert(index < ENTRY_COUNT);
     mEntryTable.set(index, state);
     size_t wordToWrite = mEntryTable.getWordIndex(index);
+    if (mDeferStateWrites) {
+        mFirstDeferredWord = std::min(mFirstDeferredWord, wordToWrite);
+        mLastDeferredWord = std::max(mLastDeferredWord, wordToWrite);
+        return ESP_OK;
+    }
     uint32_t word = mEntryTable.data()[wordToWrite];
     auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordToWrite) * 4, &word, 4);
     if (rc != ESP_OK) {
@@ -554,6 +1043,43 @@ esp_err_t Page::alterEntryState(size_t index, EntryState state)
     return ESP_OK;
 }
 
+esp_err_t Page::alterEntryRangeState(size_t begin, size_t end, EntryState state)
+{
+    assert(begin < end && end <= ENTRY_COUNT);
+    for (size_t i = begin; i < end; ++i) {
+        mEntryTable.set(i, state);
+    }
+    // words of the table are adjacent, so all of them go in one flash write
+    size_t firstWord = mEntryTable.getWordIndex(begin);
+    size_t lastWord = mEntryTable.getWordIndex(end - 1);
+    auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(firstWord) * 4,
+                              mEntryTable.data() + firstWord, static_cast<uint32_t>(lastWord - firstWord + 1) * 4);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::writeDeferredEntryStates()
+{
+    mDeferStateWrites = false;
+    if (mFirstDeferredWord > mLastDeferredWord) {
+        return ESP_OK;
+    }
+    size_t firstWord = mFirstDeferredWord;
+    size_t wordCount = mLastDeferredWord - mFirstDeferredWord + 1;
+    mFirstDeferredWord = SIZE_MAX;
+    mLastDeferredWord = 0;
+    auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(firstWord) * 4,
+                              mEntryTable.data() + firstWord, static_cast<uint32_t>(wordCount) * 4);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::alterPageState(PageState state)
 {
     auto rc = spi_flash_write(mBaseAddress, reinterpret_cast<uint32_t*>(&state), sizeof(state));
@@ -565,78 +1091,193 @@ esp_err_t Page::alterPageState(PageState state)
     return ESP_OK;
 }
 
+esp_err_t Page::readFlash(uint32_t address, void* dst, size_t size) const
+{
+#if CONFIG_NVS_MMAP_READS
+    if (mMappedData) {
+        memcpy(dst, mMappedData + (address - mBaseAddress), size);
+        return ESP_OK;
+    }
+#endif
+    return spi_flash_read(address, reinterpret_cast<uint32_t*>(dst), static_cast<uint32_t>(size));
+}
+
 esp_err_t Page::readEntry(size_t index, Item& dst) const
 {
-    auto rc = spi_flash_read(getEntryAddress(index), reinterpret_cast<uint32_t*>(&dst), sizeof(dst));
+    auto rc = readEntries(index, &dst, 1);
     if (rc != ESP_OK) {
         return rc;
     }
     return ESP_OK;
 }
 
-esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item)
+esp_err_t Page::readEntries(size_t index, void* dst, size_t count) const
+{
+    auto rc = readFlash(getEntryAddress(index), dst, count * ENTRY_SIZE);
+#if CONFIG_NVS_ENCRYPTION
+    if (rc == ESP_OK) {
+        EntryCipher::Session session;
+        EntryCipher::decrypt(getEntryAddress(index), dst, dst, count);
+    }
+#endif
+    return rc;
+}
+
+esp_err_t Page::writeEntries(size_t index, const void* data, size_t count)
+{
+    assert(index + count <= ENTRY_COUNT);
+#if CONFIG_NVS_ENCRYPTION
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    uint32_t buffer[WRITE_BUFFER_ENTRIES * ENTRY_SIZE / sizeof(uint32_t)];
+    EntryCipher::Session session;
+    while (count != 0) {
+        size_t chunk = (count < WRITE_BUFFER_ENTRIES) ? count : WRITE_BUFFER_ENTRIES;
+        EntryCipher::encrypt(getEntryAddress(index), src, buffer, chunk);
+        auto rc = spi_flash_write(getEntryAddress(index), buffer, static_cast<uint32_t>(chunk * ENTRY_SIZE));
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        index += chunk;
+        src += chunk * ENTRY_SIZE;
+        count -= chunk;
+    }
+    return ESP_OK;
+#else
+    return spi_flash_write(getEntryAddress(index), static_cast<const uint32_t*>(data), static_cast<uint32_t>(count * ENTRY_SIZE));
+#endif
+}
+
+esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item, uint16_t chunkIdx)
 {
     if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
         return ESP_ERR_NVS_NOT_FOUND;
     }
+
+#if CONFIG_NVS_BLOOM_FILTER
+    if (nsIndex != NS_ANY && key != nullptr && !mKeyFilter.mayContain(nsIndex, key)) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+#endif
     
     if (itemIndex >= ENTRY_COUNT) {
         return ESP_ERR_NVS_NOT_FOUND;
     }
 
-    CachedFindInfo findInfo(nsIndex, datatype, key);
-    if (mFindInfo == findInfo) {
-        itemIndex = mFindInfo.itemIndex();
-    }
+#if CONFIG_NVS_HASH_INDEX
+    // with a known namespace and key, only visit entries whose hash matches
+    const bool useIndex = nsIndex != NS_ANY && key != nullptr && mHashList.isValid();
+#else
+    const bool useIndex = false;
+#endif
 
+    // concurrent readers may use the cached location, but leave it alone
+    const bool shared = isShared();
     size_t start = mFirstUsedEntry;
     if (itemIndex > mFirstUsedEntry && itemIndex < ENTRY_COUNT) {
         start = itemIndex;
     }
+
+    // the cached location is the first match in the page, so it can only
+    // be used by lookups which would get there anyway, and only lookups
+    // which start from the first entry can update it
+    CachedFindInfo findInfo(nsIndex, datatype, key, chunkIdx);
+    bool firstMatch = start == mFirstUsedEntry;
+    if (!useIndex && mFindInfo == findInfo && start <= mFindInfo.itemIndex()) {
+        start = mFindInfo.itemIndex();
+        firstMatch = true;
+    }
     
     size_t end = mNextFreeEntry;
     if (end > ENTRY_COUNT) {
         end = ENTRY_COUNT;
     }
 
+#if CONFIG_NVS_HASH_INDEX
+    if (useIndex) {
+        start = mHashList.find(start, nsIndex, key);
+    }
+#endif
+
+    // without an index entries are visited in order, read a few at a time,
+    // unless any entry is a match
+    const bool useBuffer = !useIndex && (nsIndex != NS_ANY || key != nullptr);
+    // the AES unit is taken once for the whole scan
+    EntryCipher::Session session;
+    Item buffer[FIND_BUFFER_ENTRIES];
+    size_t bufferStart = INVALID_ENTRY;
     size_t next;
     for (size_t i = start; i < end; i = next) {
+#if CONFIG_NVS_HASH_INDEX
+        next = (useIndex) ? mHashList.find(i + 1, nsIndex, key) : i + 1;
+#else
         next = i + 1;
-        if (mEntryTable.get(i) != EntryState::WRITTEN) {
+#endif
+        if (!useIndex) {
+            // skip runs of empty and erased entries a word at a time
+            i = mEntryTable.find(EntryState::WRITTEN, i, end);
+            if (i == end) {
+                break;
+            }
+            next = i + 1;
+        } else if (mEntryTable.get(i) != EntryState::WRITTEN) {
             continue;
         }
 
-        auto rc = readEntry(i, item);
+        auto rc = (useBuffer) ? readEntryBuffered(i, item, buffer, FIND_BUFFER_ENTRIES, bufferStart) : readEntry(i, item);
         if (rc != ESP_OK) {
-            mState = PageState::INVALID;
+            if (!shared) {
+                mState = PageState::INVALID;
+            }
             return rc;
         }
 
+        // CRC is only checked for items which are a match, and for items
+        // whose span is needed to get to the next one; a corrupted entry
+        // which doesn't look like a match is skipped either way
+        const bool needSpan = !useIndex && isVariableLengthType(item.datatype);
+        const bool isMatch = (nsIndex == NS_ANY || item.nsIndex == nsIndex) &&
+                             (key == nullptr || strncmp(key, item.key, Item::MAX_KEY_LENGTH) == 0);
+        if (!isMatch && !needSpan) {
+            continue;
+        }
+
         auto crc32 = item.calculateCrc32();
         if (item.crc32 != crc32) {
-            eraseEntryAndSpan(i);
+            // readers skip the entry, it is erased by the next writer to find it
+            if (!shared) {
+                eraseEntryAndSpan(i);
+            }
             continue;
         }
 
-        if (item.datatype == ItemType::BLOB || item.datatype == ItemType::SZ) {
+        if (needSpan) {
             next = i + item.span;
         }
 
-        if (nsIndex != NS_ANY && item.nsIndex != nsIndex) {
-            continue;
-        }
-
-        if (key != nullptr && strncmp(key, item.key, Item::MAX_KEY_LENGTH) != 0) {
+        if (!isMatch) {
             continue;
         }
 
         if (datatype != ItemType::ANY && item.datatype != datatype) {
+            // chunks and the index of a blob or array share its key. without
+            // a key, items of other types are simply not a match
+            if (key == nullptr || (isBlobType(datatype) && isBlobType(item.datatype)) ||
+                (isArrayType(datatype) && isArrayType(item.datatype))) {
+                continue;
+            }
             return ESP_ERR_NVS_TYPE_MISMATCH;
         }
 
+        if (chunkIdx != Item::CHUNK_ANY && isChunkType(item.datatype) &&
+            item.varLength.chunkIndex != chunkIdx) {
+            continue;
+        }
+
         itemIndex = i;
-        findInfo.setItemIndex(static_cast<uint32_t>(itemIndex));
-        mFindInfo = findInfo;
+        if (!shared && firstMatch) {
+            findInfo.setItemIndex(static_cast<uint32_t>(itemIndex));
+            mFindInfo = findInfo;
+        }
 
         return ESP_OK;
     }
@@ -644,6 +1285,75 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
     return ESP_ERR_NVS_NOT_FOUND;
 }
 
+esp_err_t Page::readItemData(size_t index, size_t dataSize, size_t offset, void* data, size_t size)
+{
+    if (offset > dataSize || size > dataSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    size_t entry = index + 1 + offset / ENTRY_SIZE;
+    size_t skip = offset % ENTRY_SIZE;
+    EntryCipher::Session session;
+    while (size != 0) {
+        if (skip == 0 && size >= ENTRY_SIZE && reinterpret_cast<uintptr_t>(dst) % 4 == 0) {
+            // whole entries go straight into the caller's buffer
+            size_t count = size / ENTRY_SIZE;
+            auto rc = readEntries(entry, dst, count);
+            if (rc != ESP_OK) {
+                return rc;
+            }
+            entry += count;
+            dst += count * ENTRY_SIZE;
+            size -= count * ENTRY_SIZE;
+            continue;
+        }
+        Item ditem;
+        auto rc = readEntry(entry, ditem);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        size_t willCopy = ENTRY_SIZE - skip;
+        willCopy = (size < willCopy) ? size : willCopy;
+        memcpy(dst, ditem.rawData + skip, willCopy);
+        dst += willCopy;
+        size -= willCopy;
+        skip = 0;
+        ++entry;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::readEntryBuffered(size_t index, Item& dst, Item* buffer, size_t bufferSize, size_t& bufferStart) const
+{
+    if (bufferStart == INVALID_ENTRY || index < bufferStart || index >= bufferStart + bufferSize) {
+        size_t count = (ENTRY_COUNT - index < bufferSize) ? ENTRY_COUNT - index : bufferSize;
+        // don't read erased or empty entries at the end of the range
+        while (count > 1 && mEntryTable.get(index + count - 1) != EntryState::WRITTEN) {
+            --count;
+        }
+        auto rc = readEntries(index, buffer, count);
+        if (rc != ESP_OK) {
+            bufferStart = INVALID_ENTRY;
+            return rc;
+        }
+        bufferStart = index;
+    }
+    dst = buffer[index - bufferStart];
+    return ESP_OK;
+}
+
+size_t Page::getVarDataTailroom() const
+{
+    if (mState == PageState::UNINITIALIZED) {
+        return CHUNK_MAX_SIZE;
+    }
+    if (mState != PageState::ACTIVE || mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + 1 >= ENTRY_COUNT) {
+        return 0;
+    }
+    return (ENTRY_COUNT - mNextFreeEntry - 1) * ENTRY_SIZE;
+}
+
 esp_err_t Page::getSeqNumber(uint32_t& seqNumber) const
 {
     if (mState != PageState::UNINITIALIZED && mState != PageState::INVALID && mState != PageState::CORRUPT) {
@@ -671,6 +1381,9 @@ esp_err_t Page::erase()
         mState = PageState::INVALID;
         return rc;
     }
+    if (mEraseCount != UNKNOWN_ERASE_COUNT) {
+        ++mEraseCount;
+    }
     return load(sector);
 }
 
@@ -691,6 +1404,33 @@ esp_err_t Page::markFull()
 }
 
 
+void Page::addToIndex(const Item& item, size_t index)
+{
+#if CONFIG_NVS_HASH_INDEX
+    mHashList.insert(item, index);
+#elif CONFIG_NVS_BLOOM_FILTER
+    mKeyFilter.insert(item.nsIndex, item.key);
+#endif
+}
+
+void Page::removeFromIndex(size_t index)
+{
+#if CONFIG_NVS_HASH_INDEX
+    mHashList.erase(index);
+#endif
+    // bits can't be removed from the bloom filter, it is reset by
+    // eraseEntryAndSpan once the page holds no items
+}
+
+void Page::clearIndex()
+{
+#if CONFIG_NVS_HASH_INDEX
+    mHashList.clear();
+#elif CONFIG_NVS_BLOOM_FILTER
+    mKeyFilter.clear();
+#endif
+}
+
 void Page::invalidateCache()
 {
     mFindInfo = CachedFindInfo();
@@ -709,6 +1449,9 @@ void Page::debugDump() const
         else if (state == EntryState::ERASED) {
             printf("X\n");
         }
+        else if (state == EntryState::BATCH) {
+            printf("B\n");
+        }
         else if (state == EntryState::WRITTEN) {
             Item item;
             readEntry(i, item);
@@ -20,27 +20,43 @@
 #include <type_traits>
 #include <cstring>
 #include <algorithm>
+#include "sdkconfig.h"
 #include "esp_spi_flash.h"
 #include "compressed_enum_table.hpp"
 #include "intrusive_list.h"
+#include "nvs_item_hash_list.hpp"
+#include "nvs_key_filter.hpp"
+#include "nvs_page_heap.hpp"
+#include "nvs_platform.hpp"
 
 namespace nvs
 {
 
+/**
+ * Location of the last item found in a page, together with the arguments
+ * of the lookup. The key is copied, so that lookups with keys built at
+ * runtime in a different buffer can use the location too.
+ */
 class CachedFindInfo
 {
 public:
     CachedFindInfo() { }
-    CachedFindInfo(uint8_t nsIndex, ItemType type, const char* key) :
-        mKeyPtr(key),
+    CachedFindInfo(uint8_t nsIndex, ItemType type, const char* key, uint16_t chunkIdx = Item::CHUNK_ANY) :
         mNsIndex(nsIndex),
-        mType(type)
+        mType(type),
+        mChunkIndex(chunkIdx)
     {
+        if (key) {
+            strncpy(mKey, key, sizeof(mKey) - 1);
+            mKey[sizeof(mKey) - 1] = 0;
+            mHasKey = true;
+        }
     }
 
     bool operator==(const CachedFindInfo& other) const
     {
-        return mKeyPtr != nullptr && mKeyPtr == other.mKeyPtr && mType == other.mType && mNsIndex == other.mNsIndex;
+        return mHasKey && other.mHasKey && mType == other.mType && mNsIndex == other.mNsIndex &&
+               mChunkIndex == other.mChunkIndex && strncmp(mKey, other.mKey, sizeof(mKey)) == 0;
     }
 
     void setItemIndex(uint32_t index)
@@ -54,10 +70,11 @@ public:
 
 protected:
     uint32_t mItemIndex = 0;
-    const char* mKeyPtr = nullptr;
     uint8_t mNsIndex = 0;
     ItemType mType;
-
+    uint16_t mChunkIndex = Item::CHUNK_ANY;
+    bool mHasKey = false;
+    char mKey[Item::MAX_KEY_LENGTH + 1];
 };
 
 class Page : public intrusive_list_node<Page>
@@ -77,9 +94,23 @@ public:
     static const size_t ENTRY_COUNT = 126;
     static const uint32_t INVALID_ENTRY = 0xffffffff;
 
+    // largest variable length item which fits into an empty page
+    static const size_t CHUNK_MAX_SIZE = (ENTRY_COUNT - 1) * ENTRY_SIZE;
+
+#if CONFIG_NVS_ENCRYPTION
+    // bits of an encrypted entry can't be cleared one at a time, so each
+    // increment of a counter writes a new item
+    static const size_t COUNTER_BITMAP_ENTRIES = 0;
+#else
+    // data entries of a COUNTER item, one bit of which is cleared per increment
+    static const size_t COUNTER_BITMAP_ENTRIES = 2;
+#endif
+
     static const uint8_t NS_INDEX = 0;
     static const uint8_t NS_ANY = 255;
 
+    static const uint32_t UNKNOWN_ERASE_COUNT = UINT32_MAX;
+
     enum class PageState : uint32_t {
         // All bits set, default state after flash erase. Page has not been initialized yet.
         UNINITIALIZED = 0xffffffff,
@@ -113,15 +144,112 @@ public:
 
     esp_err_t setSeqNumber(uint32_t seqNumber);
 
-    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
-
-    esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
-
-    esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key);
+    /**
+     * Write an item into the next free entries. chunkIdx is only used
+     * for BLOB_DATA items.
+     */
+    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint16_t chunkIdx = Item::CHUNK_ANY);
+
+    /**
+     * Write a run of prepared items, each given as a header entry followed
+     * by its data entries. As many items as fit are written and their number
+     * is returned in itemsWritten; ESP_ERR_NVS_PAGE_FULL is returned if that
+     * is less than count.
+     */
+    esp_err_t writeItems(const Item* const* items, size_t count, size_t& itemsWritten);
+
+    esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint16_t chunkIdx = Item::CHUNK_ANY);
+
+    /**
+     * Read size bytes of the data of a variable length item, starting at
+     * offset. The item is found at index and holds dataSize bytes.
+     * Data CRC is not checked.
+     */
+    esp_err_t readItemData(size_t index, size_t dataSize, size_t offset, void* data, size_t size);
+
+    /**
+     * Write the header of a string or blob item into the next free entry,
+     * without marking it as written. CRC fields are left unwritten.
+     * Data is then written using writeEntryData, and the item is finished
+     * with commitItem or dropped with discardItem. No other items may be
+     * written into the page in the meantime.
+     */
+    esp_err_t beginItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t dataSize, Item& header, size_t& index);
+
+    esp_err_t writeEntryData(size_t index, const uint32_t* data, size_t count);
+
+    esp_err_t commitItem(size_t index, const Item& header);
+
+    esp_err_t discardItem(size_t index, size_t span);
+
+    /**
+     * Write a COUNTER item with the given value, followed by
+     * COUNTER_BITMAP_ENTRIES blank entries which record increments.
+     */
+    esp_err_t writeCounter(uint8_t nsIndex, const char* key, uint32_t value);
+
+    /**
+     * Find a COUNTER item and return its value. itemIndex is set to the
+     * index of the item, increments to the number of increments recorded
+     * in its bitmap, and capacity to the number of increments it can hold.
+     */
+    esp_err_t readCounter(uint8_t nsIndex, const char* key, uint32_t& value, size_t& itemIndex, size_t& increments, size_t& capacity);
+
+    /**
+     * Record one more increment in the bitmap of the COUNTER item at
+     * itemIndex, which holds the given number of increments, by clearing
+     * the next bit. This is a single word write, no entry is used or erased.
+     */
+    esp_err_t incrementCounter(size_t itemIndex, size_t increments);
+
+    /**
+     * Start writing a batch of items which take entryCount entries.
+     * A marker entry is put into EntryState::BATCH in front of them, and
+     * the items are then written with writeItems. commitBatch erases the
+     * marker, after which the items stay. Until then, they are erased by
+     * abortBatch, or by load if power goes out. No other items may be
+     * written into the page in the meantime.
+     * Returns ESP_ERR_NVS_PAGE_FULL if the marker and the items don't fit.
+     */
+    esp_err_t beginBatch(size_t entryCount, size_t& index);
+
+    esp_err_t commitBatch(size_t index);
+
+    esp_err_t abortBatch(size_t index);
+
+    esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint16_t chunkIdx = Item::CHUNK_ANY);
+
+    /**
+     * Erase all items of the given namespace (NS_ANY erases everything)
+     * in a single pass over the entry table.
+     *
+     * If allMatched is not nullptr and every item in the page belongs to the
+     * namespace, nothing is erased and *allMatched is set to true, so that
+     * the caller can erase the whole sector instead.
+     */
+    esp_err_t eraseItems(uint8_t nsIndex, bool* allMatched = nullptr);
 
     esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key);
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item);
+    /**
+     * Find the first item at or after itemIndex which matches the given
+     * namespace, type and key; NS_ANY, ItemType::ANY and nullptr match
+     * anything. For BLOB_DATA items, chunkIdx selects the chunk.
+     *
+     * ESP_ERR_NVS_TYPE_MISMATCH is returned if the key is found with a type
+     * other than datatype, unless both are among the types used for blobs.
+     * If key is nullptr, items of other types are skipped.
+     */
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item, uint16_t chunkIdx = Item::CHUNK_ANY);
+
+    /**
+     * Call func(itemIndex, item) for each item in the page, in order of
+     * entry index. Entries are read a few at a time, which is cheaper than
+     * calling findItem for every item. func may erase the item it is given.
+     * Stops at the first error returned by func.
+     */
+    template<typename TFunc>
+    esp_err_t forEachItem(TFunc func);
 
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
@@ -151,6 +279,39 @@ public:
         return mErasedEntryCount;
     }
 
+    /**
+     * Number of data bytes of the largest variable length item which can
+     * still be written into the page.
+     */
+    size_t getVarDataTailroom() const;
+
+    /**
+     * Number of times the sector was erased, as recorded in the page header.
+     * UNKNOWN_ERASE_COUNT for sectors which are empty or were written by
+     * a version of the library which didn't record it.
+     */
+    uint32_t getEraseCount() const
+    {
+        return mEraseCount;
+    }
+
+    void setEraseCount(uint32_t eraseCount)
+    {
+        mEraseCount = eraseCount;
+    }
+
+
+    /**
+     * Until writeDeferredEntryStates is called, changes of entry states are
+     * only made in RAM. The state table is then written with a single flash
+     * write, instead of one write per changed entry.
+     */
+    void deferEntryStateWrites()
+    {
+        mDeferStateWrites = true;
+    }
+
+    esp_err_t writeDeferredEntryStates();
 
     esp_err_t markFull();
 
@@ -164,8 +325,31 @@ public:
     
     void debugDump() const;
 
+#if CONFIG_NVS_MMAP_READS
+    /**
+     * Read the sector through the flash cache, at the address it is mapped
+     * to. Writes still go through spi_flash_write, which takes care of
+     * invalidating the cached data. nullptr switches back to spi_flash_read.
+     */
+    void setMappedData(const uint8_t* data)
+    {
+        mMappedData = data;
+    }
+#endif
+
+    /**
+     * Lock of the storage instance the page belongs to, which tells if
+     * lookups run in shared mode. Pages without one are never shared.
+     */
+    void setLock(const RwLock* lock)
+    {
+        mLock = lock;
+    }
+
 protected:
 
+    friend class PageHeap;
+
     class Header {
     public:
         Header() {
@@ -174,7 +358,8 @@ protected:
         
         PageState mState;       // page state
         uint32_t mSeqNumber;    // sequence number of this page
-        uint32_t mReserved[5];  // unused, must be 0xffffffff
+        uint32_t mEraseCount = UNKNOWN_ERASE_COUNT;  // times the sector was erased before this header was written
+        uint32_t mReserved[4];  // unused, must be 0xffffffff
         uint32_t mCrc32;        // crc of everything except mState
         
         uint32_t calculateCrc32();
@@ -184,6 +369,7 @@ protected:
         EMPTY   = 0x3, // 0b11, default state after flash erase
         WRITTEN = EMPTY & ~ESB_WRITTEN, // entry was written
         ERASED  = WRITTEN & ~ESB_ERASED, // entry was written and then erased
+        BATCH   = EMPTY & ~ESB_ERASED, // marker of a batch which is being written, see beginBatch
         INVALID = 0x4 // entry is in inconsistent state (write started but ESB_WRITTEN has not been set yet)
     };
 
@@ -193,18 +379,48 @@ protected:
 
     esp_err_t alterEntryState(size_t index, EntryState state);
 
+    esp_err_t alterEntryRangeState(size_t begin, size_t end, EntryState state);
+
     esp_err_t alterPageState(PageState state);
 
+    // read from the cache mapping of the sector if there is one
+    esp_err_t readFlash(uint32_t address, void* dst, size_t size) const;
+
     esp_err_t readEntry(size_t index, Item& dst) const;
 
+    esp_err_t readEntryBuffered(size_t index, Item& dst, Item* buffer, size_t bufferSize, size_t& bufferStart) const;
+
+    // all entry data goes through these two, which encrypt it with CONFIG_NVS_ENCRYPTION
+    esp_err_t readEntries(size_t index, void* dst, size_t count) const;
+
+    esp_err_t writeEntries(size_t index, const void* data, size_t count);
+
     esp_err_t writeEntry(const Item& item);
 
     esp_err_t eraseEntry(size_t index);
     
     esp_err_t eraseEntryAndSpan(size_t index);
+
+    // same as above, for an item which was already read and checked
+    esp_err_t eraseEntryAndSpan(size_t index, size_t span);
+
+    void updateAfterErase(size_t index, size_t span);
     
     void updateFirstUsedEntry(size_t index, size_t span);
 
+    void addToIndex(const Item& item, size_t index);
+
+    void removeFromIndex(size_t index);
+
+    void clearIndex();
+
+    void updateHeap()
+    {
+        if (mHeap) {
+            mHeap->update(this);
+        }
+    }
+
     static constexpr size_t getAlignmentForType(ItemType type)
     {
         return static_cast<uint8_t>(type) & 0x0f;
@@ -216,6 +432,11 @@ protected:
         return mBaseAddress + ENTRY_DATA_OFFSET + static_cast<uint32_t>(entry) * ENTRY_SIZE;
     }
 
+    bool isShared() const
+    {
+        return mLock != nullptr && mLock->isShared();
+    }
+
 
 protected:
     uint32_t mBaseAddress = 0;
@@ -227,8 +448,33 @@ protected:
     size_t mFirstUsedEntry = INVALID_ENTRY;
     uint16_t mUsedEntryCount = 0;
     uint16_t mErasedEntryCount = 0;
+    uint32_t mEraseCount = UNKNOWN_ERASE_COUNT;
+    // victim selection heap of the PageManager, while the page is in it
+    PageHeap* mHeap = nullptr;
+    size_t mHeapIndex = 0;
+    bool mDeferStateWrites = false;
+    size_t mFirstDeferredWord = SIZE_MAX;
+    size_t mLastDeferredWord = 0;
+
+#if CONFIG_NVS_MMAP_READS
+    const uint8_t* mMappedData = nullptr;
+#endif
+
+    const RwLock* mLock = nullptr;
 
     CachedFindInfo mFindInfo;
+#if CONFIG_NVS_HASH_INDEX
+    HashList mHashList;
+#elif CONFIG_NVS_BLOOM_FILTER
+    KeyFilter<CONFIG_NVS_BLOOM_FILTER_SIZE> mKeyFilter;
+#endif
+
+    // number of entries read from flash at once while loading a page,
+    // and while scanning a page without the help of an index
+    static const size_t LOAD_BUFFER_ENTRIES = 8;
+    static const size_t FIND_BUFFER_ENTRIES = 4;
+    // entries encrypted at once before they are written
+    static const size_t WRITE_BUFFER_ENTRIES = 4;
 
     static const uint32_t HEADER_OFFSET = 0;
     static const uint32_t ENTRY_TABLE_OFFSET = HEADER_OFFSET + 32;
@@ -240,6 +486,49 @@ protected:
 
 }; // class Page
 
+template<typename TFunc>
+esp_err_t Page::forEachItem(TFunc func)
+{
+    if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
+        return ESP_OK;
+    }
+
+    size_t end = mNextFreeEntry;
+    if (end > ENTRY_COUNT) {
+        end = ENTRY_COUNT;
+    }
+
+    Item item;
+    Item buffer[LOAD_BUFFER_ENTRIES];
+    size_t bufferStart = INVALID_ENTRY;
+    for (size_t i = mFirstUsedEntry; i < end; ) {
+        i = mEntryTable.find(EntryState::WRITTEN, i, end);
+        if (i == end) {
+            break;
+        }
+
+        auto rc = readEntryBuffered(i, item, buffer, LOAD_BUFFER_ENTRIES, bufferStart);
+        if (rc != ESP_OK) {
+            mState = PageState::INVALID;
+            return rc;
+        }
+
+        if (item.crc32 != item.calculateCrc32()) {
+            eraseEntryAndSpan(i);
+            ++i;
+            continue;
+        }
+
+        size_t span = (isVariableLengthType(item.datatype)) ? item.span : 1;
+        rc = func(i, item);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        i += span;
+    }
+    return ESP_OK;
+}
+
 } // namespace nvs
 
 
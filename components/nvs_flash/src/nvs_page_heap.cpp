@@ -0,0 +1,147 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_page_heap.hpp"
+#include "nvs_page.hpp"
+
+namespace nvs
+{
+
+void PageHeap::init(size_t capacity)
+{
+    for (size_t i = 0; i < mSize; ++i) {
+        mPages[i]->mHeap = nullptr;
+    }
+    mPages.reset(new Page*[capacity]);
+    mCapacity = capacity;
+    mSize = 0;
+}
+
+void PageHeap::setPolicy(VictimPolicy policy, size_t minErasedEntries)
+{
+    mPolicy = policy;
+    mMinErasedEntries = minErasedEntries;
+    for (size_t i = mSize / 2; i > 0; --i) {
+        siftDown(i - 1);
+    }
+}
+
+uint32_t PageHeap::score(const Page* page) const
+{
+    uint32_t erased = static_cast<uint32_t>(page->getErasedEntryCount());
+    uint32_t eraseCount = page->getEraseCount();
+    uint32_t wear = (eraseCount < 0xffff) ? eraseCount : 0xffff;
+    if (mPolicy == VictimPolicy::WEAR_LEVELLING && erased >= mMinErasedEntries) {
+        // any page above the threshold wins over the ones below it,
+        // and the one erased the least number of times wins among them
+        return 0x80000000 | ((0xffff - wear) << 8) | erased;
+    }
+    // more erased entries first, then less worn sectors
+    return (erased << 16) | (0xffff - wear);
+}
+
+Page* PageHeap::topExcept(const Page* page) const
+{
+    if (mSize == 0 || mPages[0] != page) {
+        return top();
+    }
+    if (mSize == 1) {
+        return nullptr;
+    }
+    if (mSize == 2 || score(mPages[1]) >= score(mPages[2])) {
+        return mPages[1];
+    }
+    return mPages[2];
+}
+
+void PageHeap::place(size_t index, Page* page)
+{
+    mPages[index] = page;
+    page->mHeapIndex = index;
+}
+
+void PageHeap::siftUp(size_t index)
+{
+    Page* page = mPages[index];
+    uint32_t pageScore = score(page);
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (score(mPages[parent]) >= pageScore) {
+            break;
+        }
+        place(index, mPages[parent]);
+        index = parent;
+    }
+    place(index, page);
+}
+
+void PageHeap::siftDown(size_t index)
+{
+    Page* page = mPages[index];
+    uint32_t pageScore = score(page);
+    while (true) {
+        size_t child = 2 * index + 1;
+        if (child >= mSize) {
+            break;
+        }
+        uint32_t childScore = score(mPages[child]);
+        if (child + 1 < mSize) {
+            uint32_t rightScore = score(mPages[child + 1]);
+            if (rightScore > childScore) {
+                ++child;
+                childScore = rightScore;
+            }
+        }
+        if (childScore <= pageScore) {
+            break;
+        }
+        place(index, mPages[child]);
+        index = child;
+    }
+    place(index, page);
+}
+
+void PageHeap::insert(Page* page)
+{
+    assert(page->mHeap == nullptr && mSize < mCapacity);
+    page->mHeap = this;
+    place(mSize, page);
+    ++mSize;
+    siftUp(mSize - 1);
+}
+
+void PageHeap::remove(Page* page)
+{
+    if (page->mHeap != this) {
+        return;
+    }
+    size_t index = page->mHeapIndex;
+    page->mHeap = nullptr;
+    --mSize;
+    if (index != mSize) {
+        Page* moved = mPages[mSize];
+        place(index, moved);
+        siftUp(index);
+        siftDown(moved->mHeapIndex);
+    }
+}
+
+void PageHeap::update(Page* page)
+{
+    assert(page->mHeap == this);
+    size_t index = page->mHeapIndex;
+    siftUp(index);
+    siftDown(page->mHeapIndex);
+}
+
+} // namespace nvs
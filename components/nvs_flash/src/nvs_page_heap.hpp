@@ -0,0 +1,93 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_page_heap_hpp
+#define nvs_page_heap_hpp
+
+#include <cstdint>
+#include <memory>
+
+namespace nvs
+{
+
+class Page;
+
+enum class VictimPolicy : uint8_t {
+    // reclaim the page with the most erased entries, moving as few items as possible
+    GREEDY,
+    // among pages with enough erased entries, reclaim the least erased sector
+    WEAR_LEVELLING,
+};
+
+/**
+ * Binary max-heap of pages, ordered by how good a victim for reclaiming
+ * each page is under the selected VictimPolicy.
+ *
+ * Pages in the heap notify it when their erased entry count changes
+ * (see Page::mHeap), so the best victim is always at the top, and
+ * maintaining the heap costs O(log n) per change.
+ */
+class PageHeap
+{
+public:
+    void init(size_t capacity);
+
+    void setPolicy(VictimPolicy policy, size_t minErasedEntries);
+
+    VictimPolicy policy() const
+    {
+        return mPolicy;
+    }
+
+    void insert(Page* page);
+
+    void remove(Page* page);
+
+    void update(Page* page);
+
+    Page* top() const
+    {
+        return (mSize == 0) ? nullptr : mPages[0];
+    }
+
+    /**
+     * Best page other than the given one, which is usually the active page.
+     * If that page isn't at the top, this is the top, otherwise it is the
+     * better one of its children.
+     */
+    Page* topExcept(const Page* page) const;
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+protected:
+    uint32_t score(const Page* page) const;
+
+    void place(size_t index, Page* page);
+
+    void siftUp(size_t index);
+
+    void siftDown(size_t index);
+
+    std::unique_ptr<Page*[]> mPages;
+    size_t mSize = 0;
+    size_t mCapacity = 0;
+    VictimPolicy mPolicy = VictimPolicy::GREEDY;
+    size_t mMinErasedEntries = 0;
+}; // class PageHeap
+
+} // namespace nvs
+
+#endif /* nvs_page_heap_hpp */
@@ -15,15 +15,48 @@
 
 namespace nvs
 {
+PageManager::~PageManager()
+{
+    unmapPages();
+}
+
+void PageManager::unmapPages()
+{
+#if CONFIG_NVS_MMAP_READS
+    if (mMappedData) {
+        spi_flash_munmap(mMmapHandle);
+        mMappedData = nullptr;
+    }
+#endif
+}
+
 esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
 {
     mBaseSector = baseSector;
     mPageCount = sectorCount;
     mPageList.clear();
     mFreePageList.clear();
+    mReclaimPage = nullptr;
+    mReclaimCount = 0;
+    mInlineReclaimCount = 0;
+    mHeap.init(sectorCount);
+    mHeap.setPolicy(mVictimPolicy, mMinErasedEntries);
     mPages.reset(new Page[sectorCount]);
 
+#if CONFIG_NVS_MMAP_READS
+    // if there are no MMU entries left, pages are read with spi_flash_read
+    unmapPages();
+    const void* mapped;
+    if (spi_flash_mmap(baseSector * Page::SEC_SIZE, sectorCount * Page::SEC_SIZE, &mapped, &mMmapHandle) == ESP_OK) {
+        mMappedData = static_cast<const uint8_t*>(mapped);
+        for (uint32_t i = 0; i < sectorCount; ++i) {
+            mPages[i].setMappedData(mMappedData + i * Page::SEC_SIZE);
+        }
+    }
+#endif
+
     for (uint32_t i = 0; i < sectorCount; ++i) {
+        mPages[i].setLock(mLock);
         auto err = mPages[i].load(baseSector + i);
         if (err != ESP_OK) {
             return err;
@@ -44,6 +77,27 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
         }
     }
 
+    // erased sectors don't have a header to keep their erase count,
+    // assume they were erased as many times as the others on average
+    uint64_t eraseCountSum = 0;
+    uint32_t knownCount = 0;
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        if (mPages[i].getEraseCount() != Page::UNKNOWN_ERASE_COUNT) {
+            eraseCountSum += mPages[i].getEraseCount();
+            ++knownCount;
+        }
+    }
+    uint32_t averageEraseCount = (knownCount == 0) ? 0 : static_cast<uint32_t>(eraseCountSum / knownCount);
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        if (mPages[i].getEraseCount() == Page::UNKNOWN_ERASE_COUNT) {
+            mPages[i].setEraseCount(averageEraseCount);
+        }
+    }
+
+    for (auto it = begin(); it != end(); ++it) {
+        mHeap.insert(it);
+    }
+
     if (mPageList.empty()) {
         mSeqNumber = 0;
         return activatePage();
@@ -58,50 +112,69 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     // but before the old one was erased, we end up with a duplicate item
     Page& lastPage = back();
     size_t lastItemIndex = SIZE_MAX;
+    // FLAG_BATCH can't be cleared from an item once its batch is done, but
+    // any item written after a batch means that the batch was done, so only
+    // the batch items which are last in the page need to be checked below
+    size_t batchIndex = 0;
     Item item;
     size_t itemIndex = 0;
     while (lastPage.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
         itemIndex += item.span;
         lastItemIndex = itemIndex;
+        if (!item.hasFlag(Item::FLAG_BATCH)) {
+            batchIndex = itemIndex;
+        }
     }
     
     if (lastItemIndex != SIZE_MAX) {
         auto last = PageManager::TPageListIterator(&lastPage);
         for (auto it = begin(); it != last; ++it) {
-            if (it->eraseItem(item.nsIndex, item.datatype, item.key) == ESP_OK) {
+            if (it->eraseItem(item.nsIndex, item.datatype, item.key, item.getChunkIndex()) == ESP_OK) {
                 break;
             }
         }
     }
 
+    // items of a batch are all written before the copies they replace are
+    // erased, so any of them may have a duplicate, either in one of the
+    // older pages or earlier in the last page
+    itemIndex = batchIndex;
+    while (lastPage.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+        if (item.hasFlag(Item::FLAG_BATCH)) {
+            auto last = PageManager::TPageListIterator(&lastPage);
+            for (auto it = begin(); it != last; ++it) {
+                if (it->eraseItem(item.nsIndex, item.datatype, item.key, item.getChunkIndex()) == ESP_OK) {
+                    break;
+                }
+            }
+            size_t dupIndex = 0;
+            Item dupItem;
+            lastPage.invalidateCache();
+            if (lastPage.findItem(item.nsIndex, item.datatype, item.key, dupIndex, dupItem) == ESP_OK &&
+                dupIndex < itemIndex) {
+                auto err = lastPage.eraseItem(item.nsIndex, item.datatype, item.key);
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+        }
+        itemIndex += item.span;
+    }
+
     // check if power went out while page was being freed
     for (auto it = begin(); it!= end(); ++it) {
         if (it->state() == Page::PageState::FREEING) {
-            Page* newPage = &mPageList.back();
-            if(newPage->state() != Page::PageState::ACTIVE) {
+            if (back().state() != Page::PageState::ACTIVE) {
                 auto err = activatePage();
                 if (err != ESP_OK) {
                     return err;
                 }
-                newPage = &mPageList.back();
-            }
-            while (true) {
-                auto err = it->moveItem(*newPage);
-                if (err == ESP_ERR_NVS_NOT_FOUND) {
-                    break;
-                } else if (err != ESP_OK) {
-                    return err;
-                }
             }
-            
-            auto err = it->erase();
+            mReclaimPage = it;
+            auto err = finishReclaim();
             if (err != ESP_OK) {
                 return err;
             }
-            
-            Page* p = static_cast<Page*>(it);
-            mPageList.erase(it);
-            mFreePageList.push_back(p);
             break;
         }
     }
@@ -120,70 +193,202 @@ esp_err_t PageManager::requestNewPage()
         return activatePage();
     }
 
-    // find the page with the higest number of erased items
-    TPageListIterator maxErasedItemsPageIt;
-    size_t maxErasedItems = 0;
-    for (auto it = begin(); it != end(); ++it) {
-        auto erased = it->getErasedEntryCount();
-        if (erased > maxErasedItems) {
-            maxErasedItemsPageIt = it;
-            maxErasedItems = erased;
+    // if collectGarbage has started freeing a page, finish that one
+    if (!mReclaimPage) {
+        Page* victim = mHeap.top();
+        if (!victim || victim->getErasedEntryCount() == 0) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
         }
-    }
 
-    if (maxErasedItems == 0) {
-        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        auto err = startReclaim(victim);
+        if (err != ESP_OK) {
+            return err;
+        }
     }
 
     esp_err_t err = activatePage();
     if (err != ESP_OK) {
         return err;
     }
-    
-    Page* newPage = &mPageList.back();
 
-    Page* erasedPage = maxErasedItemsPageIt;
-    size_t usedEntries = erasedPage->getUsedEntryCount();
-    err = erasedPage->markFreeing();
+    // all remaining items of the page fit into the new one
+    err = finishReclaim();
     if (err != ESP_OK) {
         return err;
     }
+    ++mInlineReclaimCount;
+    return ESP_OK;
+}
+
+esp_err_t PageManager::collectGarbage(size_t maxMoves, size_t minErasedEntries)
+{
+    if (!mReclaimPage) {
+        if (mFreePageList.size() > 2) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        // the active page is left alone, it still accepts writes, so it
+        // mustn't keep the full pages behind it from being reclaimed
+        const Page* active = (back().state() == Page::PageState::ACTIVE) ? &back() : nullptr;
+        Page* candidate = mHeap.topExcept(active);
+        if (!candidate || candidate->state() != Page::PageState::FULL ||
+            candidate->getErasedEntryCount() < minErasedEntries) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        auto err = startReclaim(candidate);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    for (size_t i = 0; i < maxMoves; ++i) {
+        auto err = mReclaimPage->moveItem(back());
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            return finishReclaim();
+        }
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            // with a single free page left, the remaining items have to be
+            // moved in one go, same as requestNewPage would do
+            bool lastFreePage = mFreePageList.size() < 2;
+            err = switchToNewPage();
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (lastFreePage) {
+                return finishReclaim();
+            }
+            continue;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t PageManager::startReclaim(Page* page)
+{
+    auto err = page->markFreeing();
+    if (err != ESP_OK) {
+        return err;
+    }
+    mHeap.remove(page);
+    mReclaimPage = page;
+    return ESP_OK;
+}
+
+void PageManager::setVictimPolicy(VictimPolicy policy, size_t minErasedEntries)
+{
+    mVictimPolicy = policy;
+    mMinErasedEntries = minErasedEntries;
+    mHeap.setPolicy(policy, minErasedEntries);
+}
+
+esp_err_t PageManager::switchToNewPage()
+{
+    if (back().state() == Page::PageState::ACTIVE) {
+        auto err = back().markFull();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return activatePage();
+}
+
+esp_err_t PageManager::finishReclaim()
+{
+    assert(mReclaimPage);
     while (true) {
-        err = erasedPage->moveItem(*newPage);
+        auto err = mReclaimPage->moveItem(back());
         if (err == ESP_ERR_NVS_NOT_FOUND) {
             break;
+        } else if (err == ESP_ERR_NVS_PAGE_FULL) {
+            err = switchToNewPage();
+            if (err != ESP_OK) {
+                return err;
+            }
         } else if (err != ESP_OK) {
             return err;
         }
     }
 
-    err = erasedPage->erase();
+    Page* erasedPage = mReclaimPage;
+    mReclaimPage = nullptr;
+    auto err = releasePage(erasedPage);
     if (err != ESP_OK) {
         return err;
     }
-    
-    assert(usedEntries == newPage->getUsedEntryCount());
+    ++mReclaimCount;
+    return ESP_OK;
+}
 
-    mPageList.erase(maxErasedItemsPageIt);
-    mFreePageList.push_back(erasedPage);
+esp_err_t PageManager::releasePage(Page* page)
+{
+    auto err = page->erase();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    mHeap.remove(page);
+    mPageList.erase(PageManager::TPageListIterator(page));
+    mFreePageList.push_back(page);
 
     return ESP_OK;
 }
 
+esp_err_t PageManager::eraseItems(uint8_t nsIndex)
+{
+    for (auto it = begin(); it != end(); ) {
+        Page* page = it;
+        ++it;
+        // the active page keeps taking writes, and a page being freed by
+        // collectGarbage is erased once its items are moved
+        if (page->state() != Page::PageState::FULL) {
+            auto err = page->eraseItems(nsIndex);
+            if (err != ESP_OK) {
+                return err;
+            }
+            continue;
+        }
+        bool allMatched = false;
+        auto err = page->eraseItems(nsIndex, &allMatched);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (allMatched) {
+            err = releasePage(page);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
 esp_err_t PageManager::activatePage()
 {
     if (mFreePageList.empty()) {
         return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
     }
     Page* p = &mFreePageList.front();
+    if (mVictimPolicy == VictimPolicy::WEAR_LEVELLING) {
+        // use the least erased of the free sectors
+        for (auto it = mFreePageList.begin(); it != mFreePageList.end(); ++it) {
+            if (it->getEraseCount() < p->getEraseCount()) {
+                p = it;
+            }
+        }
+    }
     if (p->state() == Page::PageState::CORRUPT) {
         auto err = p->erase();
         if (err != ESP_OK) {
             return err;
         }
     }
-    mFreePageList.pop_front();
+    mFreePageList.erase(TPageListIterator(p));
     mPageList.push_back(p);
+    mHeap.insert(p);
     p->setSeqNumber(mSeqNumber);
     ++mSeqNumber;
     return ESP_OK;
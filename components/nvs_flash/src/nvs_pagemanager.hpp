@@ -20,6 +20,7 @@
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
 #include "intrusive_list.h"
+#include "nvs_page_heap.hpp"
 
 namespace nvs
 {
@@ -31,6 +32,8 @@ public:
 
     PageManager() {}
 
+    ~PageManager();
+
     esp_err_t load(uint32_t baseSector, uint32_t sectorCount);
 
     TPageListIterator begin()
@@ -50,17 +53,111 @@ public:
 
     esp_err_t requestNewPage();
 
+    /**
+     * Do a bounded amount of page reclaiming work, so that requestNewPage
+     * doesn't have to compact a whole page inline.
+     *
+     * Once the number of free pages drops to two, the full page with the
+     * most erased entries (at least minErasedEntries) is marked as freeing.
+     * Each call then moves up to maxMoves of its items to the active page.
+     * When the page is empty, it is erased and returned to the free list.
+     *
+     * @return ESP_OK if some work was done, ESP_ERR_NVS_NOT_FOUND if there
+     *         was nothing to reclaim, or an error from the flash driver.
+     */
+    esp_err_t collectGarbage(size_t maxMoves, size_t minErasedEntries);
+
+    /**
+     * Select how requestNewPage and collectGarbage pick the page to reclaim.
+     * For VictimPolicy::WEAR_LEVELLING, pages with at least minErasedEntries
+     * erased entries are preferred if they have been erased fewer times.
+     */
+    void setVictimPolicy(VictimPolicy policy, size_t minErasedEntries);
+
+    /**
+     * Lock of the storage instance, handed to pages by load, see
+     * Page::setLock.
+     */
+    void setLock(const RwLock* lock)
+    {
+        mLock = lock;
+    }
+
+    /**
+     * Erase all items of a namespace. Full pages which hold nothing else
+     * are erased as a whole and returned to the free list, other pages have
+     * the items marked as erased in their entry state bitmap.
+     */
+    esp_err_t eraseItems(uint8_t nsIndex);
+
+    size_t getPageCount() const
+    {
+        return mPageCount;
+    }
+
+    size_t getFreePageCount() const
+    {
+        return mFreePageList.size();
+    }
+
+    /**
+     * Number of pages reclaimed since load, by requestNewPage or by
+     * collectGarbage.
+     */
+    uint32_t getReclaimCount() const
+    {
+        return mReclaimCount;
+    }
+
+    /**
+     * Number of times requestNewPage had to move the items of a page before
+     * it could return, counted since load.
+     */
+    uint32_t getInlineReclaimCount() const
+    {
+        return mInlineReclaimCount;
+    }
+
 protected:
     friend class Iterator;
     
     esp_err_t activatePage();
 
+    esp_err_t startReclaim(Page* page);
+
+    esp_err_t switchToNewPage();
+
+    esp_err_t finishReclaim();
+
+    esp_err_t releasePage(Page* page);
+
+    void unmapPages();
+
     TPageList mPageList;
     TPageList mFreePageList;
     std::unique_ptr<Page[]> mPages;
     uint32_t mBaseSector;
     uint32_t mPageCount;
     uint32_t mSeqNumber;
+    // page which is being freed by collectGarbage, if any
+    Page* mReclaimPage = nullptr;
+    // pages in mPageList, best victim for reclaiming first
+    PageHeap mHeap;
+    uint32_t mReclaimCount = 0;
+    uint32_t mInlineReclaimCount = 0;
+    const RwLock* mLock = nullptr;
+#if CONFIG_NVS_MMAP_READS
+    // pages are read through the flash cache if the partition could be mapped
+    const uint8_t* mMappedData = nullptr;
+    spi_flash_mmap_handle_t mMmapHandle;
+#endif
+#if CONFIG_NVS_VICTIM_WEAR_LEVELLING
+    VictimPolicy mVictimPolicy = VictimPolicy::WEAR_LEVELLING;
+    size_t mMinErasedEntries = CONFIG_NVS_WEAR_LEVELLING_MIN_ERASED;
+#else
+    VictimPolicy mVictimPolicy = VictimPolicy::GREEDY;
+    size_t mMinErasedEntries = 0;
+#endif
 }; // class PageManager
 
 
@@ -14,6 +14,7 @@
 #ifndef nvs_platform_h
 #define nvs_platform_h
 
+#include "esp_err.h"
 
 #ifdef ESP_PLATFORM
 #define NVS_DEBUGV(...) ets_printf(__VA_ARGS__)
@@ -21,60 +22,246 @@
 #include "rom/ets_sys.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_task.h"
+#include "esp_system.h"
 
 namespace nvs
 {
 
-class Lock
+inline uint32_t getTimeUs()
+{
+    return system_get_time();
+}
+
+/**
+ * Readers-writer lock protecting one storage instance.
+ *
+ * Lock gives exclusive access, and is taken by everything which may
+ * modify storage. SharedLock is taken by lookups, which then run in
+ * parallel with each other, but not with writers. A writer waiting for
+ * readers to finish blocks new readers, so writers don't starve.
+ *
+ * The lock is built from FreeRTOS semaphores, which tasks can block on
+ * while another task runs a flash operation with the cache disabled.
+ * A spinlock can't be used here, since lookups call spi_flash_read.
+ */
+class RwLock
 {
 public:
-    Lock()
+    esp_err_t init()
+    {
+        if (mSemaphore) {
+            return ESP_OK;
+        }
+        // taken by the first reader and given by the last one, which may be
+        // another task, so this can't be a mutex
+        mSemaphore = xSemaphoreCreateBinary();
+        mTurnstile = xSemaphoreCreateMutex();
+        mReaderMutex = xSemaphoreCreateMutex();
+        if (!mSemaphore || !mTurnstile || !mReaderMutex) {
+            uninit();
+            return ESP_ERR_NO_MEM;
+        }
+        xSemaphoreGive(mSemaphore);
+        return ESP_OK;
+    }
+
+    void uninit()
+    {
+        if (mSemaphore) {
+            vSemaphoreDelete(mSemaphore);
+        }
+        if (mTurnstile) {
+            vSemaphoreDelete(mTurnstile);
+        }
+        if (mReaderMutex) {
+            vSemaphoreDelete(mReaderMutex);
+        }
+        mSemaphore = nullptr;
+        mTurnstile = nullptr;
+        mReaderMutex = nullptr;
+    }
+
+    void lock()
     {
         assert(mSemaphore);
+        // holding the turnstile keeps new readers out until the writer is done
+        xSemaphoreTake(mTurnstile, portMAX_DELAY);
         xSemaphoreTake(mSemaphore, portMAX_DELAY);
     }
 
-    ~Lock()
+    void unlock()
     {
-        assert(mSemaphore);
         xSemaphoreGive(mSemaphore);
+        xSemaphoreGive(mTurnstile);
     }
 
-    static esp_err_t init()
+    void lockShared()
     {
-        assert(mSemaphore == nullptr);
-        mSemaphore = xSemaphoreCreateMutex();
-        if (!mSemaphore) {
-            return ESP_ERR_NO_MEM;
+        assert(mSemaphore);
+        // wait for a writer which is already queued
+        xSemaphoreTake(mTurnstile, portMAX_DELAY);
+        xSemaphoreGive(mTurnstile);
+        xSemaphoreTake(mReaderMutex, portMAX_DELAY);
+        if (mReaderCount++ == 0) {
+            xSemaphoreTake(mSemaphore, portMAX_DELAY);
+            mShared = true;
         }
-        return ESP_OK;
+        xSemaphoreGive(mReaderMutex);
     }
 
-    static void uninit()
+    void unlockShared()
     {
-        vSemaphoreDelete(mSemaphore);
-        mSemaphore = nullptr;
+        xSemaphoreTake(mReaderMutex, portMAX_DELAY);
+        if (--mReaderCount == 0) {
+            mShared = false;
+            xSemaphoreGive(mSemaphore);
+        }
+        xSemaphoreGive(mReaderMutex);
+    }
+
+    /**
+     * True while storage is held by readers. Code running under a
+     * SharedLock must not change any state other readers may look at.
+     */
+    bool isShared() const
+    {
+        return mShared;
+    }
+
+protected:
+    SemaphoreHandle_t mSemaphore = nullptr;
+    SemaphoreHandle_t mTurnstile = nullptr;
+    SemaphoreHandle_t mReaderMutex = nullptr;
+    size_t mReaderCount = 0;
+    bool mShared = false;
+};
+
+/**
+ * Critical section for the few bits of state which readers holding a
+ * SharedLock update, such as the item cache. It is held for a few
+ * instructions at a time, and never over a flash operation.
+ */
+class CacheLock
+{
+public:
+    CacheLock()
+    {
+        portENTER_CRITICAL(&mMux);
+    }
+
+    ~CacheLock()
+    {
+        portEXIT_CRITICAL(&mMux);
     }
 
-    static SemaphoreHandle_t mSemaphore;
+    static portMUX_TYPE mMux;
 };
 } // namespace nvs
 
 #else // ESP_PLATFORM
 #define NVS_DEBUGV(...) printf(__VA_ARGS__)
+#include <chrono>
 namespace nvs
 {
-class Lock
+inline uint32_t getTimeUs()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+// there are no other tasks on the host, but lookups still run in shared
+// mode, so that tests see the same behavior as on the chip
+class RwLock
+{
+public:
+    esp_err_t init()
+    {
+        return ESP_OK;
+    }
+
+    void uninit() { }
+    void lock() { }
+    void unlock() { }
+
+    void lockShared()
+    {
+        ++mReaderCount;
+    }
+
+    void unlockShared()
+    {
+        --mReaderCount;
+    }
+
+    bool isShared() const
+    {
+        return mReaderCount != 0;
+    }
+
+protected:
+    size_t mReaderCount = 0;
+};
+
+class CacheLock
 {
 public:
-    Lock() { }
-    ~Lock() { }
-    static void init() {}
-    static void uninit() {}
+    CacheLock() { }
+    ~CacheLock() { }
 };
 } // namespace nvs
 #endif // ESP_PLATFORM
 
+namespace nvs
+{
+
+/**
+ * Exclusive access to the storage instance protected by the lock,
+ * for the lifetime of the object.
+ */
+class Lock
+{
+public:
+    explicit Lock(RwLock& lock) : mLock(lock)
+    {
+        mLock.lock();
+    }
+
+    ~Lock()
+    {
+        mLock.unlock();
+    }
+
+protected:
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+
+    RwLock& mLock;
+};
+
+class SharedLock
+{
+public:
+    explicit SharedLock(RwLock& lock) : mLock(lock)
+    {
+        mLock.lockShared();
+    }
+
+    ~SharedLock()
+    {
+        mLock.unlockShared();
+    }
+
+protected:
+    SharedLock(const SharedLock&) = delete;
+    SharedLock& operator=(const SharedLock&) = delete;
+
+    RwLock& mLock;
+};
+
+} // namespace nvs
+
 #ifndef CONFIG_NVS_DEBUG
 #undef NVS_DEBUGV
 #define NVS_DEBUGV(...)
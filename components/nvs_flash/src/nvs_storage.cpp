@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_storage.hpp"
+#include <new>
 
 #ifndef ESP_PLATFORM
 #include <map>
@@ -34,59 +35,1153 @@ void Storage::clearNamespaces()
         mNamespaces.erase(tmp);
         delete static_cast<NamespaceEntry*>(tmp);
     }
+    std::fill_n(mNamespaceBuckets, NAMESPACE_BUCKETS, nullptr);
+}
+
+Storage::NamespaceEntry* Storage::findNamespace(const char* nsName)
+{
+    uint32_t hash = HashList::getHash(Page::NS_INDEX, nsName);
+    for (auto entry = mNamespaceBuckets[hash % NAMESPACE_BUCKETS]; entry; entry = entry->mNextInBucket) {
+        if (entry->mHash == hash && strncmp(nsName, entry->mName, sizeof(entry->mName) - 1) == 0) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+void Storage::addNamespace(NamespaceEntry* entry)
+{
+    entry->mHash = HashList::getHash(Page::NS_INDEX, entry->mName);
+    NamespaceEntry*& bucket = mNamespaceBuckets[entry->mHash % NAMESPACE_BUCKETS];
+    entry->mNextInBucket = bucket;
+    bucket = entry;
+    mNamespaces.push_back(entry);
+    mNamespaceUsage.set(entry->mIndex, true);
 }
 
 esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
 {
+    if (mBlobWriter) {
+        mBlobWriter->mMode = BlobStream::Mode::CLOSED;
+        mBlobWriter = nullptr;
+    }
+    ++mGeneration;
+    mItemCache.init(CONFIG_NVS_ITEM_CACHE_SIZE);
     auto err = mPageManager.load(baseSector, sectorCount);
     if (err != ESP_OK) {
-        mState = StorageState::INVALID;
+        mState = StorageState::INVALID;
+        return err;
+    }
+
+    // load namespaces list, and clean up after writes of multi-page blobs
+    // which were interrupted by a power failure
+    clearNamespaces();
+    std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
+    bool hasArrays = false;
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        Page& p = *it;
+        err = p.forEachItem([this, &p, &hasArrays](size_t itemIndex, Item& item) -> esp_err_t {
+            if (item.nsIndex == Page::NS_INDEX) {
+                if (item.datatype == ItemType::U8) {
+                    NamespaceEntry* entry = new NamespaceEntry;
+                    item.getKey(entry->mName, sizeof(entry->mName) - 1);
+                    item.getValue(entry->mIndex);
+                    addNamespace(entry);
+                }
+                return ESP_OK;
+            }
+            if (item.datatype == ItemType::BLOB_IDX || item.datatype == ItemType::BLOB_DATA) {
+                return checkBlobItem(p, itemIndex, item);
+            }
+            if (item.datatype == ItemType::ARRAY_IDX) {
+                hasArrays = true;
+                return checkArrayIndex(p, itemIndex, item);
+            }
+            hasArrays = hasArrays || item.datatype == ItemType::ARRAY_DATA;
+            return ESP_OK;
+        });
+        if (err != ESP_OK) {
+            mState = StorageState::INVALID;
+            return err;
+        }
+    }
+    // segments are checked once each key is down to one index
+    for (auto it = mPageManager.begin(); hasArrays && it != mPageManager.end(); ++it) {
+        Page& p = *it;
+        err = p.forEachItem([this, &p](size_t itemIndex, Item& item) -> esp_err_t {
+            if (item.datatype == ItemType::ARRAY_DATA) {
+                return checkArraySegment(p, itemIndex, item);
+            }
+            return ESP_OK;
+        });
+        if (err != ESP_OK) {
+            mState = StorageState::INVALID;
+            return err;
+        }
+    }
+    mNamespaceUsage.set(0, true);
+    mNamespaceUsage.set(255, true);
+    mState = StorageState::ACTIVE;
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+    mItemCache.invalidate(nsIndex, key);
+
+    Page* findPage = nullptr;
+    Item item;
+    err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    bool hasOldIndex = false;
+    if (datatype == ItemType::BLOB) {
+        uint8_t chunkStart = getNextChunkStart(nsIndex, key, hasOldIndex);
+        if (dataSize > Page::CHUNK_MAX_SIZE) {
+            err = writeMultiPageBlob(nsIndex, key, data, dataSize, chunkStart);
+        } else {
+            err = appendItem(nsIndex, datatype, key, data, dataSize);
+        }
+    } else {
+        err = appendItem(nsIndex, datatype, key, data, dataSize);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = eraseReplacedItem(nsIndex, datatype, key, findPage, hasOldIndex);
+    if (err != ESP_OK) {
+        return err;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::appendItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint16_t chunkIdx)
+{
+    Page& page = getCurrentPage();
+    auto err = page.writeItem(nsIndex, datatype, key, data, dataSize, chunkIdx);
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = mPageManager.requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        err = getCurrentPage().writeItem(nsIndex, datatype, key, data, dataSize, chunkIdx);
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+    return err;
+}
+
+esp_err_t Storage::appendCounter(uint8_t nsIndex, const char* key, uint32_t value)
+{
+    Page& page = getCurrentPage();
+    auto err = page.writeCounter(nsIndex, key, value);
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = mPageManager.requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        err = getCurrentPage().writeCounter(nsIndex, key, value);
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+    return err;
+}
+
+esp_err_t Storage::eraseReplacedItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* oldPage, bool oldMultiPage, uint16_t chunkIdx)
+{
+    if (oldPage) {
+        if (oldPage->state() == Page::PageState::UNINITIALIZED ||
+            oldPage->state() == Page::PageState::INVALID) {
+            Item item;
+            auto err = findItem(nsIndex, datatype, key, oldPage, item, chunkIdx);
+            assert(err == ESP_OK);
+        }
+        auto err = oldPage->eraseItem(nsIndex, datatype, key, chunkIdx);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    if (oldMultiPage) {
+        // if the new value is also kept in multiple pages, its index comes
+        // after the old one
+        auto err = eraseMultiPageBlob(nsIndex, key);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+uint8_t Storage::getNextChunkStart(uint8_t nsIndex, const char* key, bool& hasOldIndex)
+{
+    Page* page = nullptr;
+    Item item;
+    hasOldIndex = findItem(nsIndex, ItemType::BLOB_IDX, key, page, item) == ESP_OK;
+    uint8_t chunkStart = 0;
+    if (hasOldIndex && item.blobIndex.chunkStart == 0) {
+        chunkStart = MAX_CHUNKS;
+    }
+    return chunkStart;
+}
+
+esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize, uint8_t chunkStart)
+{
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    size_t offset = 0;
+    uint8_t chunkCount = 0;
+    esp_err_t err = ESP_OK;
+    bool pageRequested = false;
+    while (offset < dataSize) {
+        if (chunkCount == MAX_CHUNKS) {
+            err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            break;
+        }
+        Page& page = getCurrentPage();
+        size_t tailroom = page.getVarDataTailroom();
+        if (tailroom == 0) {
+            if (pageRequested) {
+                err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+                break;
+            }
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+                if (err != ESP_OK) {
+                    break;
+                }
+            }
+            err = mPageManager.requestNewPage();
+            if (err != ESP_OK) {
+                break;
+            }
+            pageRequested = true;
+            continue;
+        }
+        pageRequested = false;
+
+        size_t chunkSize = (dataSize - offset < tailroom) ? dataSize - offset : tailroom;
+        err = page.writeItem(nsIndex, ItemType::BLOB_DATA, key, src + offset, chunkSize, chunkStart + chunkCount);
+        if (err != ESP_OK) {
+            break;
+        }
+        ++chunkCount;
+        offset += chunkSize;
+    }
+
+    if (err == ESP_OK) {
+        Item index;
+        std::fill_n(index.data, sizeof(index.data), 0xff);
+        index.blobIndex.dataSize = static_cast<uint32_t>(dataSize);
+        index.blobIndex.chunkCount = chunkCount;
+        index.blobIndex.chunkStart = chunkStart;
+        err = appendItem(nsIndex, ItemType::BLOB_IDX, key, index.data, sizeof(index.data));
+    }
+
+    if (err != ESP_OK) {
+        // chunks which were written are not part of any value yet
+        eraseChunks(nsIndex, ItemType::BLOB_DATA, key, chunkStart, chunkCount);
+        return err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::readMultiPageBlob(uint8_t nsIndex, const char* key, void* data, size_t dataSize)
+{
+    Page* findPage = nullptr;
+    Item item;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (dataSize < item.blobIndex.dataSize) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    size_t left = item.blobIndex.dataSize;
+    for (size_t i = 0; i < item.blobIndex.chunkCount; ++i) {
+        const uint16_t chunkIdx = static_cast<uint16_t>(item.blobIndex.chunkStart + i);
+        Item chunk;
+        err = findItem(nsIndex, ItemType::BLOB_DATA, key, findPage, chunk, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (chunk.varLength.dataSize > left) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        err = findPage->readItem(nsIndex, ItemType::BLOB_DATA, key, dst, left, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        dst += chunk.varLength.dataSize;
+        left -= chunk.varLength.dataSize;
+    }
+    if (left != 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key)
+{
+    Page* findPage = nullptr;
+    Item item;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // if power goes out after the index is erased, init erases the chunks
+    err = findPage->eraseItem(nsIndex, ItemType::BLOB_IDX, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return eraseChunks(nsIndex, ItemType::BLOB_DATA, key, item.blobIndex.chunkStart, item.blobIndex.chunkCount);
+}
+
+esp_err_t Storage::eraseChunks(uint8_t nsIndex, ItemType datatype, const char* key, uint16_t chunkStart, uint16_t chunkCount)
+{
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const uint16_t chunkIdx = static_cast<uint16_t>(chunkStart + i);
+        Page* findPage = nullptr;
+        Item item;
+        auto err = findItem(nsIndex, datatype, key, findPage, item, chunkIdx);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            continue;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = findPage->eraseItem(nsIndex, datatype, key, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::checkBlobItem(Page& page, size_t itemIndex, Item& item)
+{
+    Page* findPage = nullptr;
+    Item other;
+    if (item.datatype == ItemType::BLOB_DATA) {
+        auto err = findItem(item.nsIndex, ItemType::BLOB_IDX, item.key, findPage, other);
+        if (err == ESP_OK && item.varLength.chunkIndex >= other.blobIndex.chunkStart &&
+            item.varLength.chunkIndex < other.blobIndex.chunkStart + other.blobIndex.chunkCount) {
+            return ESP_OK;
+        }
+        return page.eraseItem(item.nsIndex, ItemType::BLOB_DATA, item.key, item.varLength.chunkIndex);
+    }
+
+    // items are written in order of page sequence numbers and entry indices,
+    // so the one which comes first is the old value
+    size_t otherIndex;
+    auto err = findItem(item.nsIndex, ItemType::BLOB, item.key, findPage, other, otherIndex);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint32_t seqNumber;
+    uint32_t otherSeqNumber;
+    page.getSeqNumber(seqNumber);
+    findPage->getSeqNumber(otherSeqNumber);
+    if (otherSeqNumber < seqNumber || (otherSeqNumber == seqNumber && otherIndex < itemIndex)) {
+        return findPage->eraseItem(item.nsIndex, ItemType::BLOB, item.key);
+    }
+    return eraseMultiPageBlob(item.nsIndex, item.key);
+}
+
+esp_err_t Storage::writeArray(uint8_t nsIndex, ItemType elementType, const char* key, const void* data, size_t count)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    const size_t elementSize = getArrayElementSize(elementType);
+    if (elementSize == 0) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if (count == 0 || count > UINT16_MAX || count * elementSize > MAX_ARRAY_SEGMENTS * Item::ARRAY_SEGMENT_SIZE) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+    mItemCache.invalidate(nsIndex, key);
+
+    Page* findPage = nullptr;
+    Item oldIndex;
+    err = findItem(nsIndex, ItemType::ARRAY_IDX, key, findPage, oldIndex);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    const bool hasOldIndex = (err == ESP_OK);
+    const uint16_t chunkStart = (hasOldIndex && oldIndex.arrayIndex.chunkStart == 0) ? MAX_ARRAY_SEGMENTS : 0;
+
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    const size_t dataSize = count * elementSize;
+    uint16_t segmentCount = 0;
+    err = ESP_OK;
+    for (size_t offset = 0; offset < dataSize; offset += Item::ARRAY_SEGMENT_SIZE) {
+        const size_t size = (dataSize - offset < Item::ARRAY_SEGMENT_SIZE) ? dataSize - offset : Item::ARRAY_SEGMENT_SIZE;
+        err = appendItem(nsIndex, ItemType::ARRAY_DATA, key, src + offset, size, chunkStart + segmentCount);
+        if (err != ESP_OK) {
+            break;
+        }
+        ++segmentCount;
+    }
+
+    if (err == ESP_OK) {
+        Item index;
+        std::fill_n(index.data, sizeof(index.data), 0xff);
+        index.arrayIndex.count = static_cast<uint16_t>(count);
+        index.arrayIndex.elementType = elementType;
+        index.arrayIndex.chunkStart = chunkStart;
+        err = appendItem(nsIndex, ItemType::ARRAY_IDX, key, index.data, sizeof(index.data));
+    }
+
+    if (err != ESP_OK) {
+        // segments which were written are not part of any value yet
+        eraseChunks(nsIndex, ItemType::ARRAY_DATA, key, chunkStart, segmentCount);
+        return err;
+    }
+
+    if (hasOldIndex) {
+        // the old index comes before the new one, so eraseArray finds it first
+        err = eraseArray(nsIndex, key);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeArrayRange(uint8_t nsIndex, ItemType elementType, const char* key, size_t first, const void* data, size_t count)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+    mItemCache.invalidate(nsIndex, key);
+
+    Item index;
+    err = findArray(nsIndex, elementType, key, first, count, index);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    const size_t elementSize = getArrayElementSize(elementType);
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    const size_t end = (first + count) * elementSize;
+    for (size_t offset = first * elementSize; offset < end; ) {
+        const size_t segmentIndex = offset / Item::ARRAY_SEGMENT_SIZE;
+        const size_t segmentOffset = offset % Item::ARRAY_SEGMENT_SIZE;
+        uint8_t segment[Item::ARRAY_SEGMENT_SIZE];
+        size_t size;
+        Page* oldPage = nullptr;
+        err = readArraySegment(index, segmentIndex, segment, size, oldPage);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        const size_t willCopy = (size - segmentOffset < end - offset) ? size - segmentOffset : end - offset;
+        offset += willCopy;
+        if (memcmp(segment + segmentOffset, src, willCopy) == 0) {
+            src += willCopy;
+            continue;
+        }
+        memcpy(segment + segmentOffset, src, willCopy);
+        src += willCopy;
+
+        const uint16_t chunkIdx = static_cast<uint16_t>(index.arrayIndex.chunkStart + segmentIndex);
+        err = appendItem(nsIndex, ItemType::ARRAY_DATA, key, segment, size, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        // if the old copy is in the current page, it comes before the new one
+        err = eraseReplacedItem(nsIndex, ItemType::ARRAY_DATA, key, oldPage, false, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::readArray(uint8_t nsIndex, ItemType elementType, const char* key, size_t first, void* data, size_t count)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    Item index;
+    auto err = findArray(nsIndex, elementType, key, first, count, index);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    const size_t elementSize = getArrayElementSize(elementType);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    const size_t end = (first + count) * elementSize;
+    for (size_t offset = first * elementSize; offset < end; ) {
+        const size_t segmentOffset = offset % Item::ARRAY_SEGMENT_SIZE;
+        uint8_t segment[Item::ARRAY_SEGMENT_SIZE];
+        size_t size;
+        Page* findPage = nullptr;
+        err = readArraySegment(index, offset / Item::ARRAY_SEGMENT_SIZE, segment, size, findPage);
+        if (err != ESP_OK) {
+            return err;
+        }
+        const size_t willCopy = (size - segmentOffset < end - offset) ? size - segmentOffset : end - offset;
+        memcpy(dst, segment + segmentOffset, willCopy);
+        dst += willCopy;
+        offset += willCopy;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::getArrayCount(uint8_t nsIndex, ItemType elementType, const char* key, size_t& count)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    Item index;
+    auto err = findArray(nsIndex, elementType, key, 0, 0, index);
+    if (err != ESP_OK) {
+        return err;
+    }
+    count = index.arrayIndex.count;
+    return ESP_OK;
+}
+
+esp_err_t Storage::findArray(uint8_t nsIndex, ItemType elementType, const char* key, size_t first, size_t count, Item& index)
+{
+    Page* findPage = nullptr;
+    auto err = findItem(nsIndex, ItemType::ARRAY_IDX, key, findPage, index);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (index.arrayIndex.elementType != elementType) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if (first > index.arrayIndex.count || count > index.arrayIndex.count - first) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::readArraySegment(const Item& index, size_t segmentIndex, uint8_t* data, size_t& size, Page*& page)
+{
+    const size_t dataSize = index.arrayIndex.count * getArrayElementSize(index.arrayIndex.elementType);
+    const size_t offset = segmentIndex * Item::ARRAY_SEGMENT_SIZE;
+    const uint16_t chunkIdx = static_cast<uint16_t>(index.arrayIndex.chunkStart + segmentIndex);
+    Item segment;
+    auto err = findItem(index.nsIndex, ItemType::ARRAY_DATA, index.key, page, segment, chunkIdx);
+    if (err != ESP_OK) {
+        return err;
+    }
+    size = (dataSize - offset < Item::ARRAY_SEGMENT_SIZE) ? dataSize - offset : Item::ARRAY_SEGMENT_SIZE;
+    if (segment.varLength.dataSize != size) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return page->readItem(index.nsIndex, ItemType::ARRAY_DATA, index.key, data, size, chunkIdx);
+}
+
+esp_err_t Storage::eraseArray(uint8_t nsIndex, const char* key)
+{
+    Page* findPage = nullptr;
+    Item item;
+    auto err = findItem(nsIndex, ItemType::ARRAY_IDX, key, findPage, item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // if power goes out after the index is erased, init erases the segments
+    err = findPage->eraseItem(nsIndex, ItemType::ARRAY_IDX, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return eraseChunks(nsIndex, ItemType::ARRAY_DATA, key, item.arrayIndex.chunkStart,
+                       static_cast<uint16_t>(getArraySegmentCount(item)));
+}
+
+esp_err_t Storage::checkArrayIndex(Page& page, size_t itemIndex, Item& item)
+{
+    // items are written in order of page sequence numbers and entry indices,
+    // so the index which is found first is the old one. its segments are
+    // erased by checkArraySegment
+    Page* findPage = nullptr;
+    Item other;
+    size_t otherIndex;
+    auto err = findItem(item.nsIndex, ItemType::ARRAY_IDX, item.key, findPage, other, otherIndex);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (findPage == &page && otherIndex == itemIndex) {
+        return ESP_OK;
+    }
+    return findPage->eraseItem(item.nsIndex, ItemType::ARRAY_IDX, item.key);
+}
+
+esp_err_t Storage::checkArraySegment(Page& page, size_t itemIndex, Item& item)
+{
+    const uint16_t chunkIdx = item.varLength.chunkIndex;
+    Page* findPage = nullptr;
+    Item other;
+    auto err = findItem(item.nsIndex, ItemType::ARRAY_IDX, item.key, findPage, other);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND || chunkIdx < other.arrayIndex.chunkStart ||
+        chunkIdx >= other.arrayIndex.chunkStart + getArraySegmentCount(other)) {
+        return page.eraseItem(item.nsIndex, ItemType::ARRAY_DATA, item.key, chunkIdx);
+    }
+
+    // as for indices, the copy of a segment which is found first is the old one
+    size_t otherIndex;
+    err = findItem(item.nsIndex, ItemType::ARRAY_DATA, item.key, findPage, other, otherIndex, chunkIdx);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (findPage == &page && otherIndex == itemIndex) {
+        return ESP_OK;
+    }
+    return findPage->eraseItem(item.nsIndex, ItemType::ARRAY_DATA, item.key, chunkIdx);
+}
+
+esp_err_t Storage::writeCounter(uint8_t nsIndex, const char* key, uint32_t value)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+
+    Page* findPage = nullptr;
+    Item item;
+    err = findItem(nsIndex, ItemType::COUNTER, key, findPage, item);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    return replaceCounter(nsIndex, key, value, findPage);
+}
+
+esp_err_t Storage::incrementCounter(uint8_t nsIndex, const char* key, uint32_t& value)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+
+    for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+        uint32_t current;
+        size_t itemIndex;
+        size_t increments;
+        size_t capacity;
+        if (it->readCounter(nsIndex, key, current, itemIndex, increments, capacity) != ESP_OK) {
+            continue;
+        }
+        if (increments < capacity) {
+            err = it->incrementCounter(itemIndex, increments);
+        } else {
+            // the bitmap is used up, a new item starts with an empty one
+            err = replaceCounter(nsIndex, key, current + 1, it);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        value = current + 1;
+        return ESP_OK;
+    }
+
+    err = replaceCounter(nsIndex, key, 1, nullptr);
+    if (err != ESP_OK) {
+        return err;
+    }
+    value = 1;
+    return ESP_OK;
+}
+
+esp_err_t Storage::readCounter(uint8_t nsIndex, const char* key, uint32_t& value)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+        size_t itemIndex;
+        size_t increments;
+        size_t capacity;
+        if (it->readCounter(nsIndex, key, value, itemIndex, increments, capacity) == ESP_OK) {
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t Storage::replaceCounter(uint8_t nsIndex, const char* key, uint32_t value, Page* oldPage)
+{
+    auto err = appendCounter(nsIndex, key, value);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = eraseReplacedItem(nsIndex, ItemType::COUNTER, key, oldPage, false);
+    if (err != ESP_OK) {
+        return err;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::findOldItems(WriteBatch::iterator begin, WriteBatch::iterator end)
+{
+    for (auto it = begin; it != end; ++it) {
+        const Item& header = it->header();
+        Item item;
+        it->mOldPage = nullptr;
+        auto err = findItem(header.nsIndex, header.datatype, header.key, it->mOldPage, item);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::eraseOldItems(WriteBatch::iterator begin, WriteBatch::iterator end)
+{
+    esp_err_t err = ESP_OK;
+    for (auto it = begin; it != end; ++it) {
+        if (!it->mOldPage) {
+            continue;
+        }
+        // if the old copy is in the current page, it comes before the new one,
+        // so eraseItem will find it first
+        const Item& header = it->header();
+        it->mOldPage->deferEntryStateWrites();
+        err = it->mOldPage->eraseItem(header.nsIndex, header.datatype, header.key);
+        if (err != ESP_OK) {
+            break;
+        }
+        it->mOldPage = nullptr;
+    }
+
+    // write the entry state tables of all pages touched above
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        auto rc = it->writeDeferredEntryStates();
+        if (err == ESP_OK) {
+            err = rc;
+        }
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    return err;
+}
+
+esp_err_t Storage::writeBatch(WriteBatch& batch)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        mItemCache.invalidate(it->entries()->nsIndex, it->entries()->key);
+    }
+
+    // all items go into one page, after a marker which is erased once they
+    // are written. until then, power loss rolls the whole batch back.
+    size_t entryCount = 0;
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        entryCount += it->entryCount();
+    }
+    if (entryCount + 1 > Page::ENTRY_COUNT) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    size_t markerIndex;
+    size_t pagesRequested = 0;
+    while (true) {
+        Page& page = getCurrentPage();
+        err = page.beginBatch(entryCount, markerIndex);
+        if (err != ESP_ERR_NVS_PAGE_FULL) {
+            break;
+        }
+        // items moved by a reclaim may leave too little space in the new
+        // page as well, but only try each page once
+        if (pagesRequested == mPageManager.getPageCount()) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = mPageManager.requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+        ++pagesRequested;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    Page& page = getCurrentPage();
+    err = findOldItems(batch.begin(), batch.end());
+    if (err == ESP_OK) {
+        const size_t MAX_RUN = 16;
+        const Item* run[MAX_RUN];
+        for (auto it = batch.begin(); it != batch.end() && err == ESP_OK; ) {
+            size_t count = 0;
+            for (; it != batch.end() && count < MAX_RUN; ++it) {
+                run[count++] = it->entries();
+            }
+            size_t written;
+            err = page.writeItems(run, count, written);
+        }
+    }
+    if (err != ESP_OK) {
+        page.abortBatch(markerIndex);
+        return err;
+    }
+    err = page.commitBatch(markerIndex);
+    if (err != ESP_OK) {
         return err;
     }
 
-    // load namespaces list
-    clearNamespaces();
-    std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
-    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
-        Page& p = *it;
-        size_t itemIndex = 0;
-        Item item;
-        while(p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
-            NamespaceEntry* entry = new NamespaceEntry;
-            item.getKey(entry->mName, sizeof(entry->mName) - 1);
-            item.getValue(entry->mIndex);
-            mNamespaces.push_back(entry);
-            mNamespaceUsage.set(entry->mIndex, true);
-            itemIndex += item.span;
+    err = eraseOldItems(batch.begin(), batch.end());
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // blobs in a batch fit into one page, but they may replace multi-page ones
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        const Item& header = it->header();
+        if (header.datatype != ItemType::BLOB) {
+            continue;
+        }
+        err = eraseMultiPageBlob(header.nsIndex, header.key);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
         }
     }
-    mNamespaceUsage.set(0, true);
-    mNamespaceUsage.set(255, true);
-    mState = StorageState::ACTIVE;
+    batch.clear();
 #ifndef ESP_PLATFORM
     debugCheck();
 #endif
     return ESP_OK;
 }
 
-esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+esp_err_t Storage::collectGarbage(size_t maxMoves, size_t minErasedEntries)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    // items would be moved into the entries owned by the blob being written
+    if (mBlobWriter) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    ++mGeneration;
+    return mPageManager.collectGarbage(maxMoves, minErasedEntries);
+}
+
+esp_err_t Storage::openBlob(uint8_t nsIndex, const char* key, BlobStream& stream)
 {
     if (mState != StorageState::ACTIVE) {
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
+    if (stream.mMode != BlobStream::Mode::CLOSED) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    auto err = findBlob(nsIndex, key, stream, false);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    std::fill_n(stream.mHeader.rawData, sizeof(stream.mHeader.rawData), 0xff);
+    stream.mHeader.nsIndex = nsIndex;
+    strncpy(stream.mHeader.key, key, sizeof(stream.mHeader.key) - 1);
+    stream.mHeader.key[sizeof(stream.mHeader.key) - 1] = 0;
+    stream.mMode = BlobStream::Mode::READ;
+    stream.mGeneration = mGeneration;
+    stream.mWritten = 0;
+    stream.mDataCrc32 = 0xffffffff;
+    return ESP_OK;
+}
 
+esp_err_t Storage::findBlob(uint8_t nsIndex, const char* key, BlobStream& stream, bool check)
+{
     Page* findPage = nullptr;
     Item item;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+    size_t index;
+    auto err = findItem(nsIndex, ItemType::BLOB, key, findPage, item, index);
+    if (err == ESP_OK) {
+        if (check && (stream.mMultiPage ||
+                      item.varLength.dataSize != stream.mSingleChunk.mDataSize ||
+                      item.varLength.dataCrc32 != stream.mSingleChunk.mDataCrc32)) {
+            return ESP_ERR_NVS_INVALID_STATE;
+        }
+        stream.mMultiPage = false;
+        stream.mSize = item.varLength.dataSize;
+        stream.mSingleChunk.mPage = findPage;
+        stream.mSingleChunk.mIndex = static_cast<uint16_t>(index);
+        stream.mSingleChunk.mDataSize = item.varLength.dataSize;
+        stream.mSingleChunk.mDataCrc32 = item.varLength.dataCrc32;
+        return ESP_OK;
+    }
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
         return err;
     }
 
-    Page& page = getCurrentPage();
-    err = page.writeItem(nsIndex, datatype, key, data, dataSize);
+    err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const uint8_t chunkStart = item.blobIndex.chunkStart;
+    const uint8_t chunkCount = item.blobIndex.chunkCount;
+    if (check) {
+        if (!stream.mMultiPage || item.blobIndex.dataSize != stream.mSize ||
+            chunkStart != stream.mChunkStart || chunkCount != stream.mChunkCount) {
+            return ESP_ERR_NVS_INVALID_STATE;
+        }
+    } else {
+        delete[] stream.mChunks;
+        stream.mChunks = new (std::nothrow) BlobStream::Chunk[chunkCount];
+        if (!stream.mChunks) {
+            return ESP_ERR_NO_MEM;
+        }
+        stream.mMultiPage = true;
+        stream.mSize = item.blobIndex.dataSize;
+        stream.mChunkStart = chunkStart;
+        stream.mChunkCount = chunkCount;
+    }
+
+    size_t totalSize = 0;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        Item chunk;
+        err = findItem(nsIndex, ItemType::BLOB_DATA, key, findPage, chunk, index, static_cast<uint16_t>(chunkStart + i));
+        if (err != ESP_OK) {
+            return err;
+        }
+        BlobStream::Chunk& location = stream.mChunks[i];
+        if (check && (chunk.varLength.dataSize != location.mDataSize ||
+                      chunk.varLength.dataCrc32 != location.mDataCrc32)) {
+            return ESP_ERR_NVS_INVALID_STATE;
+        }
+        location.mPage = findPage;
+        location.mIndex = static_cast<uint16_t>(index);
+        location.mDataSize = chunk.varLength.dataSize;
+        location.mDataCrc32 = chunk.varLength.dataCrc32;
+        totalSize += chunk.varLength.dataSize;
+    }
+    if (totalSize != stream.mSize) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::readBlob(BlobStream& stream, size_t offset, void* data, size_t size)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (stream.mMode != BlobStream::Mode::READ) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (stream.mGeneration != mGeneration) {
+        // items may have been moved, look them up again
+        auto err = findBlob(stream.mHeader.nsIndex, stream.mHeader.key, stream, true);
+        if (err != ESP_OK) {
+            return err;
+        }
+        stream.mGeneration = mGeneration;
+    }
+
+    if (offset > stream.mSize || size > stream.mSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    const BlobStream::Chunk* chunks = (stream.mMultiPage) ? stream.mChunks : &stream.mSingleChunk;
+    const size_t chunkCount = (stream.mMultiPage) ? stream.mChunkCount : 1;
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    size_t chunkOffset = 0;
+    for (size_t i = 0; i < chunkCount && size != 0; ++i) {
+        const BlobStream::Chunk& chunk = chunks[i];
+        if (offset >= chunkOffset + chunk.mDataSize) {
+            chunkOffset += chunk.mDataSize;
+            continue;
+        }
+        size_t start = offset - chunkOffset;
+        size_t willRead = chunk.mDataSize - start;
+        willRead = (size < willRead) ? size : willRead;
+        auto err = chunk.mPage->readItemData(chunk.mIndex, chunk.mDataSize, start, dst, willRead);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        // mWritten counts the bytes read in order from the start. data CRC
+        // of each chunk is checked once it has been read completely.
+        if (offset == stream.mWritten) {
+            stream.mDataCrc32 = Item::calculateCrc32(dst, willRead, stream.mDataCrc32);
+            stream.mWritten += willRead;
+            if (stream.mWritten == chunkOffset + chunk.mDataSize) {
+                if (stream.mDataCrc32 != chunk.mDataCrc32) {
+                    return ESP_ERR_NVS_NOT_FOUND;
+                }
+                stream.mDataCrc32 = 0xffffffff;
+            }
+        }
+        dst += willRead;
+        offset += willRead;
+        size -= willRead;
+        chunkOffset += chunk.mDataSize;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::createBlob(uint8_t nsIndex, const char* key, size_t dataSize, BlobStream& stream)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (stream.mMode != BlobStream::Mode::CLOSED) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (dataSize > MAX_CHUNKS * Page::CHUNK_MAX_SIZE) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+
+    bool hasOldIndex;
+    stream.mMultiPage = dataSize > Page::CHUNK_MAX_SIZE;
+    stream.mChunkStart = getNextChunkStart(nsIndex, key, hasOldIndex);
+    stream.mChunkCount = 0;
+    stream.mChunkOffset = 0;
+    stream.mSize = dataSize;
+    err = beginChunk(nsIndex, key, stream);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    stream.mMode = BlobStream::Mode::WRITE;
+    stream.mGeneration = mGeneration;
+    stream.mWritten = 0;
+    stream.mDataCrc32 = 0xffffffff;
+    std::fill_n(stream.mPending.rawData, sizeof(stream.mPending.rawData), 0xff);
+    mBlobWriter = &stream;
+    return ESP_OK;
+}
+
+esp_err_t Storage::beginChunk(uint8_t nsIndex, const char* key, BlobStream& stream)
+{
+    const ItemType datatype = (stream.mMultiPage) ? ItemType::BLOB_DATA : ItemType::BLOB;
+    const size_t left = stream.mSize - stream.mChunkOffset;
+    if (stream.mMultiPage && stream.mChunkCount == MAX_CHUNKS) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    // chunks of a multi-page blob fill up the rest of the current page
+    Page* page = &getCurrentPage();
+    size_t chunkSize = left;
+    if (stream.mMultiPage) {
+        size_t tailroom = page->getVarDataTailroom();
+        chunkSize = (left < tailroom) ? left : tailroom;
+    }
+    esp_err_t err = ESP_ERR_NVS_PAGE_FULL;
+    if (chunkSize != 0 || !stream.mMultiPage) {
+        err = page->beginItem(nsIndex, datatype, key, chunkSize, stream.mHeader, stream.mIndex);
+    }
     if (err == ESP_ERR_NVS_PAGE_FULL) {
-        if (page.state() != Page::PageState::FULL) {
-            err = page.markFull();
+        if (page->state() != Page::PageState::FULL) {
+            err = page->markFull();
             if (err != ESP_OK) {
                 return err;
             }
@@ -96,47 +1191,210 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
             return err;
         }
 
-        err = getCurrentPage().writeItem(nsIndex, datatype, key, data, dataSize);
+        page = &getCurrentPage();
+        if (stream.mMultiPage) {
+            size_t tailroom = page->getVarDataTailroom();
+            chunkSize = (left < tailroom) ? left : tailroom;
+            if (chunkSize == 0) {
+                return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            }
+        }
+        err = page->beginItem(nsIndex, datatype, key, chunkSize, stream.mHeader, stream.mIndex);
         if (err == ESP_ERR_NVS_PAGE_FULL) {
             return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
         }
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (stream.mMultiPage) {
+        // beginItem left this field unwritten, it is written by commitItem
+        stream.mHeader.varLength.chunkIndex = static_cast<uint16_t>(stream.mChunkStart + stream.mChunkCount);
+    }
+    stream.mPage = page;
+    return ESP_OK;
+}
+
+esp_err_t Storage::commitChunk(BlobStream& stream)
+{
+    Item& header = stream.mHeader;
+    header.varLength.dataCrc32 = stream.mDataCrc32;
+    header.crc32 = header.calculateCrc32();
+    auto err = stream.mPage->commitItem(stream.mIndex, header);
+    if (err != ESP_OK) {
+        return err;
+    }
+    stream.mPage = nullptr;
+    stream.mChunkOffset += header.varLength.dataSize;
+    stream.mDataCrc32 = 0xffffffff;
+    if (stream.mMultiPage) {
+        ++stream.mChunkCount;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlob(BlobStream& stream, const void* data, size_t size)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (stream.mMode != BlobStream::Mode::WRITE || mBlobWriter != &stream) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (size > stream.mSize - stream.mWritten) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    while (size != 0) {
+        size_t chunkWritten = stream.mWritten - stream.mChunkOffset;
+        size_t chunkLeft = stream.mHeader.varLength.dataSize - chunkWritten;
+        if (chunkLeft == 0) {
+            // current chunk is complete, the rest goes into the next one.
+            // the header is reused for it, so keep a copy of the key
+            char key[Item::MAX_KEY_LENGTH + 1];
+            strncpy(key, stream.mHeader.key, sizeof(key));
+            auto err = commitChunk(stream);
+            if (err == ESP_OK) {
+                err = beginChunk(stream.mHeader.nsIndex, key, stream);
+            }
+            if (err != ESP_OK) {
+                abortBlobWrite();
+                return err;
+            }
+            continue;
+        }
+
+        // chunks other than the last one end at entry boundaries
+        size_t entry = stream.mIndex + 1 + chunkWritten / Page::ENTRY_SIZE;
+        size_t used = chunkWritten % Page::ENTRY_SIZE;
+        size_t part = (size < chunkLeft) ? size : chunkLeft;
+        if (used == 0 && part >= Page::ENTRY_SIZE && reinterpret_cast<uintptr_t>(src) % 4 == 0) {
+            // whole entries are written straight from the caller's buffer
+            size_t count = part / Page::ENTRY_SIZE;
+            auto err = stream.mPage->writeEntryData(entry, reinterpret_cast<const uint32_t*>(src), count);
+            if (err != ESP_OK) {
+                return err;
+            }
+            stream.mDataCrc32 = Item::calculateCrc32(src, count * Page::ENTRY_SIZE, stream.mDataCrc32);
+            src += count * Page::ENTRY_SIZE;
+            size -= count * Page::ENTRY_SIZE;
+            stream.mWritten += count * Page::ENTRY_SIZE;
+            continue;
+        }
+        size_t willCopy = Page::ENTRY_SIZE - used;
+        willCopy = (part < willCopy) ? part : willCopy;
+        memcpy(stream.mPending.rawData + used, src, willCopy);
+        stream.mDataCrc32 = Item::calculateCrc32(src, willCopy, stream.mDataCrc32);
+        src += willCopy;
+        size -= willCopy;
+        stream.mWritten += willCopy;
+        if (used + willCopy == Page::ENTRY_SIZE || willCopy == chunkLeft) {
+            auto err = stream.mPage->writeEntryData(entry, reinterpret_cast<const uint32_t*>(stream.mPending.rawData), 1);
+            if (err != ESP_OK) {
+                return err;
+            }
+            std::fill_n(stream.mPending.rawData, sizeof(stream.mPending.rawData), 0xff);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::closeBlob(BlobStream& stream)
+{
+    if (stream.mMode == BlobStream::Mode::READ) {
+        stream.mMode = BlobStream::Mode::CLOSED;
+        delete[] stream.mChunks;
+        stream.mChunks = nullptr;
+        return ESP_OK;
+    }
+    if (stream.mMode != BlobStream::Mode::WRITE) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (mBlobWriter != &stream) {
+        // aborted by another write
+        stream.mMode = BlobStream::Mode::CLOSED;
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (stream.mWritten != stream.mSize) {
+        auto err = abortBlobWrite();
         if (err != ESP_OK) {
             return err;
         }
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    Item& header = stream.mHeader;
+    Page* findPage = nullptr;
+    Item item;
+    auto err = findItem(header.nsIndex, ItemType::BLOB, header.key, findPage, item);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
     }
-    else if (err != ESP_OK) {
+    bool hasOldIndex;
+    getNextChunkStart(header.nsIndex, header.key, hasOldIndex);
+
+    err = commitChunk(stream);
+    if (err != ESP_OK) {
         return err;
     }
+    mBlobWriter = nullptr;
+    stream.mMode = BlobStream::Mode::CLOSED;
+    ++mGeneration;
 
-    if (findPage) {
-        if (findPage->state() == Page::PageState::UNINITIALIZED ||
-            findPage->state() == Page::PageState::INVALID) {
-            auto err = findItem(nsIndex, datatype, key, findPage, item);
-            assert(err == ESP_OK);
-        }
-        err = findPage->eraseItem(nsIndex, datatype, key);
-        if (err == ESP_ERR_FLASH_OP_FAIL) {
-            return ESP_ERR_NVS_REMOVE_FAILED;
-        }
+    if (stream.mMultiPage) {
+        Item index;
+        std::fill_n(index.data, sizeof(index.data), 0xff);
+        index.blobIndex.dataSize = static_cast<uint32_t>(stream.mSize);
+        index.blobIndex.chunkCount = stream.mChunkCount;
+        index.blobIndex.chunkStart = stream.mChunkStart;
+        err = appendItem(header.nsIndex, ItemType::BLOB_IDX, header.key, index.data, sizeof(index.data));
         if (err != ESP_OK) {
+            eraseChunks(header.nsIndex, ItemType::BLOB_DATA, header.key, stream.mChunkStart, stream.mChunkCount);
             return err;
         }
     }
+
+    err = eraseReplacedItem(header.nsIndex, ItemType::BLOB, header.key, findPage, hasOldIndex);
+    if (err != ESP_OK) {
+        return err;
+    }
 #ifndef ESP_PLATFORM
     debugCheck();
 #endif
     return ESP_OK;
 }
 
+esp_err_t Storage::abortBlobWrite()
+{
+    if (!mBlobWriter) {
+        return ESP_OK;
+    }
+    BlobStream& stream = *mBlobWriter;
+    mBlobWriter = nullptr;
+    stream.mMode = BlobStream::Mode::CLOSED;
+    ++mGeneration;
+    if (stream.mPage) {
+        auto err = stream.mPage->discardItem(stream.mIndex, stream.mHeader.span);
+        if (err != ESP_OK) {
+            return err;
+        }
+        stream.mPage = nullptr;
+    }
+    if (stream.mMultiPage) {
+        return eraseChunks(stream.mHeader.nsIndex, ItemType::BLOB_DATA, stream.mHeader.key, stream.mChunkStart, stream.mChunkCount);
+    }
+    return ESP_OK;
+}
+
 esp_err_t Storage::createOrOpenNamespace(const char* nsName, bool canCreate, uint8_t& nsIndex)
 {
     if (mState != StorageState::ACTIVE) {
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
-    auto it = std::find_if(mNamespaces.begin(), mNamespaces.end(), [=] (const NamespaceEntry& e) -> bool {
-        return strncmp(nsName, e.mName, sizeof(e.mName) - 1) == 0;
-    });
-    if (it == std::end(mNamespaces)) {
+    NamespaceEntry* found = findNamespace(nsName);
+    if (!found) {
         if (!canCreate) {
             return ESP_ERR_NVS_NOT_FOUND;
         }
@@ -156,17 +1414,16 @@ esp_err_t Storage::createOrOpenNamespace(const char* nsName, bool canCreate, uin
         if (err != ESP_OK) {
             return err;
         }
-        mNamespaceUsage.set(ns, true);
         nsIndex = ns;
         
         NamespaceEntry* entry = new NamespaceEntry;
         entry->mIndex = ns;
         strncpy(entry->mName, nsName, sizeof(entry->mName) - 1);
         entry->mName[sizeof(entry->mName) - 1] = 0;
-        mNamespaces.push_back(entry);
+        addNamespace(entry);
 
     } else {
-        nsIndex = it->mIndex;
+        nsIndex = found->mIndex;
     }
     return ESP_OK;
 }
@@ -177,14 +1434,26 @@ esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key,
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    const bool cacheable = ItemCache::isCacheable(datatype, dataSize);
+    if (cacheable && mItemCache.get(nsIndex, datatype, key, data, dataSize)) {
+        return ESP_OK;
+    }
+
     Item item;
     Page* findPage = nullptr;
     auto err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        return readMultiPageBlob(nsIndex, key, data, dataSize);
+    }
     if (err != ESP_OK) {
         return err;
     }
 
-    return findPage->readItem(nsIndex, datatype, key, data, dataSize);
+    err = findPage->readItem(nsIndex, datatype, key, data, dataSize);
+    if (err == ESP_OK && cacheable) {
+        mItemCache.put(nsIndex, datatype, key, data, dataSize);
+    }
+    return err;
 }
 
 esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
@@ -193,9 +1462,22 @@ esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+    mItemCache.invalidate(nsIndex, key);
+
     Item item;
     Page* findPage = nullptr;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
+    if (datatype == ItemType::ARRAY_IDX) {
+        return eraseArray(nsIndex, key);
+    }
+    err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        return eraseMultiPageBlob(nsIndex, key);
+    }
     if (err != ESP_OK) {
         return err;
     }
@@ -212,6 +1494,14 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
     Item item;
     Page* findPage = nullptr;
     auto err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+        if (err != ESP_OK) {
+            return err;
+        }
+        dataSize = item.blobIndex.dataSize;
+        return ESP_OK;
+    }
     if (err != ESP_OK) {
         return err;
     }
@@ -220,6 +1510,128 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
     return ESP_OK;
 }
 
+esp_err_t Storage::findEntry(uint8_t nsIndex, ItemType datatype, EntryIterator& it)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    it.mNsIndex = nsIndex;
+    it.mType = datatype;
+    return findEntryFrom(it, mPageManager.begin(), 0);
+}
+
+esp_err_t Storage::nextEntry(EntryIterator& it)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (!it.mPage) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    auto page = intrusive_list<Page>::iterator(it.mPage);
+    size_t itemIndex = it.mItemIndex + it.mItem.span;
+    if (it.mGeneration != mGeneration) {
+        // the page may have been reclaimed, and its items moved to newer pages.
+        // pages are kept in order of sequence numbers, so continue with the
+        // same page if it is still there, or with the first newer one
+        page = mPageManager.begin();
+        for (; page != mPageManager.end(); ++page) {
+            uint32_t seqNumber;
+            if (page->getSeqNumber(seqNumber) == ESP_OK && seqNumber >= it.mSeqNumber) {
+                if (seqNumber != it.mSeqNumber) {
+                    itemIndex = 0;
+                }
+                break;
+            }
+        }
+    }
+    return findEntryFrom(it, page, itemIndex);
+}
+
+esp_err_t Storage::findEntryFrom(EntryIterator& it, intrusive_list<Page>::iterator page, size_t itemIndex)
+{
+    // BLOB_IDX items of multi-page blobs are reported as blobs too
+    ItemType findType = it.mType;
+    if (findType == ItemType::BLOB) {
+        findType = ItemType::ANY;
+    }
+    it.mGeneration = mGeneration;
+    for (; page != mPageManager.end(); ++page, itemIndex = 0) {
+        Item item;
+        esp_err_t err;
+        while ((err = page->findItem(it.mNsIndex, findType, nullptr, itemIndex, item)) == ESP_OK) {
+            bool match = item.nsIndex != Page::NS_INDEX && !isChunkType(item.datatype);
+            if (it.mType == ItemType::BLOB) {
+                match = match && (item.datatype == ItemType::BLOB || item.datatype == ItemType::BLOB_IDX);
+            }
+            if (match) {
+                it.mPage = page;
+                page->getSeqNumber(it.mSeqNumber);
+                it.mItemIndex = itemIndex;
+                it.mItem = item;
+                return ESP_OK;
+            }
+            itemIndex += item.span;
+        }
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            it.mPage = nullptr;
+            return err;
+        }
+    }
+    it.mPage = nullptr;
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+const char* Storage::getNamespaceName(uint8_t nsIndex)
+{
+    auto it = std::find_if(mNamespaces.begin(), mNamespaces.end(), [=] (const NamespaceEntry& e) -> bool {
+        return e.mIndex == nsIndex;
+    });
+    if (it == std::end(mNamespaces)) {
+        return nullptr;
+    }
+    return it->mName;
+}
+
+esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    // indices 0 and 255 are reserved and never belong to a namespace
+    if (nsIndex == Page::NS_INDEX || nsIndex == Page::NS_ANY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    auto err = abortBlobWrite();
+    if (err != ESP_OK) {
+        return err;
+    }
+    ++mGeneration;
+    mItemCache.clear();
+
+    return mPageManager.eraseItems(nsIndex);
+}
+
+void Storage::getStats(nvs_stats_t& stats)
+{
+    stats.used_entries = 0;
+    stats.erased_entries = 0;
+    stats.free_entries = mPageManager.getFreePageCount() * Page::ENTRY_COUNT;
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        stats.used_entries += it->getUsedEntryCount();
+        stats.erased_entries += it->getErasedEntryCount();
+        if (it->state() == Page::PageState::ACTIVE) {
+            stats.free_entries += Page::ENTRY_COUNT - it->getUsedEntryCount() - it->getErasedEntryCount();
+        }
+    }
+    stats.total_entries = mPageManager.getPageCount() * Page::ENTRY_COUNT;
+    stats.free_pages = mPageManager.getFreePageCount();
+    stats.namespace_count = mNamespaces.size();
+    stats.reclaimed_pages = mPageManager.getReclaimCount();
+    stats.inline_reclaims = mPageManager.getInlineReclaimCount();
+}
+
 void Storage::debugDump()
 {
     for (auto p = mPageManager.begin(); p != mPageManager.end(); ++p) {
@@ -238,6 +1650,9 @@ void Storage::debugCheck()
         while (p->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
             std::stringstream keyrepr;
             keyrepr << static_cast<unsigned>(item.nsIndex) << "_" << static_cast<unsigned>(item.datatype) << "_" << item.key;
+            if (isChunkType(item.datatype)) {
+                keyrepr << "_" << item.varLength.chunkIndex;
+            }
             std::string keystr = keyrepr.str();
             if (keys.find(keystr) != std::end(keys)) {
                 printf("Duplicate key: %s\n", keystr.c_str());
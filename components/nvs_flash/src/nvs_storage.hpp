@@ -21,6 +21,10 @@
 #include "nvs_types.hpp"
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
+#include "nvs_write_batch.hpp"
+#include "nvs_blob_stream.hpp"
+#include "nvs_entry_iterator.hpp"
+#include "nvs_item_cache.hpp"
 
 //extern void dumpBytes(const uint8_t* data, size_t count);
 
@@ -38,6 +42,9 @@ class Storage
     public:
         char mName[Item::MAX_KEY_LENGTH + 1];
         uint8_t mIndex;
+        uint32_t mHash;
+        // next entry in the same bucket of mNamespaceBuckets
+        NamespaceEntry* mNextInBucket;
     };
 
     typedef intrusive_list<NamespaceEntry> TNamespaces;
@@ -47,8 +54,18 @@ public:
 
     esp_err_t init(uint32_t baseSector, uint32_t sectorCount);
 
+    bool isInitialized() const
+    {
+        return mState == StorageState::ACTIVE;
+    }
+
     esp_err_t createOrOpenNamespace(const char* nsName, bool canCreate, uint8_t& nsIndex);
 
+    /**
+     * Write an item, replacing the current value of the key. Blobs larger
+     * than Page::CHUNK_MAX_SIZE are split into chunks kept in several pages,
+     * see writeMultiPageBlob.
+     */
     esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
 
     esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
@@ -57,6 +74,142 @@ public:
 
     esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key);
 
+    /**
+     * Write an array of count integers of elementType, replacing the current
+     * value of the key. The elements are kept in ARRAY_DATA segments of
+     * Item::ARRAY_SEGMENT_SIZE bytes, so that writeArrayRange can replace
+     * some of them by rewriting only the segments which hold them. Like
+     * blob chunks, segments of the new value have different chunk indices
+     * than those of the old one, which is erased once the ARRAY_IDX item of
+     * the new value is written.
+     */
+    esp_err_t writeArray(uint8_t nsIndex, ItemType elementType, const char* key, const void* data, size_t count);
+
+    /**
+     * Replace count elements of an array, starting at element first. Each
+     * segment which changes is written again, then its old copy is erased.
+     * If power goes out in between, init keeps the new copy. A range which
+     * spans several segments is not replaced atomically: after a power
+     * failure, some of its segments may still hold the old elements.
+     */
+    esp_err_t writeArrayRange(uint8_t nsIndex, ItemType elementType, const char* key, size_t first, const void* data, size_t count);
+
+    /**
+     * Read count elements of an array, starting at element first.
+     */
+    esp_err_t readArray(uint8_t nsIndex, ItemType elementType, const char* key, size_t first, void* data, size_t count);
+
+    esp_err_t getArrayCount(uint8_t nsIndex, ItemType elementType, const char* key, size_t& count);
+
+    /**
+     * Set a counter, replacing its current value. A counter is a COUNTER
+     * item with a few data entries, one bit of which incrementCounter
+     * clears for each increment. Only once all bits are used, a new item
+     * is written and the old one erased.
+     */
+    esp_err_t writeCounter(uint8_t nsIndex, const char* key, uint32_t value);
+
+    /**
+     * Add one to a counter and return the new value. A counter which
+     * doesn't exist yet is created with value 1.
+     */
+    esp_err_t incrementCounter(uint8_t nsIndex, const char* key, uint32_t& value);
+
+    esp_err_t readCounter(uint8_t nsIndex, const char* key, uint32_t& value);
+
+    /**
+     * Write all items staged in the batch and erase the copies they replace.
+     * The batch is cleared if this succeeds.
+     */
+    esp_err_t writeBatch(WriteBatch& batch);
+
+    /**
+     * Move up to maxMoves items out of a page with at least minErasedEntries
+     * erased entries, see PageManager::collectGarbage.
+     */
+    esp_err_t collectGarbage(size_t maxMoves, size_t minErasedEntries);
+
+    /**
+     * Open an existing blob for reading in parts with readBlob.
+     */
+    esp_err_t openBlob(uint8_t nsIndex, const char* key, BlobStream& stream);
+
+    /**
+     * Start writing a blob of the given size, which replaces the current
+     * value of the key once the stream is closed. Data is passed to
+     * writeBlob in parts of any size.
+     *
+     * Only one blob can be written at a time. Writing or erasing other
+     * items before the stream is closed aborts the stream. Blobs larger
+     * than Page::CHUNK_MAX_SIZE are written one chunk at a time, and the
+     * stream is aborted if there is no space for the next chunk.
+     */
+    esp_err_t createBlob(uint8_t nsIndex, const char* key, size_t dataSize, BlobStream& stream);
+
+    /**
+     * Read size bytes of a blob opened with openBlob, starting at offset.
+     * If the blob is read in order, data CRC of the blob, or of each of
+     * its chunks, is checked by the read which reaches its end, and
+     * ESP_ERR_NVS_NOT_FOUND is returned on mismatch.
+     */
+    esp_err_t readBlob(BlobStream& stream, size_t offset, void* data, size_t size);
+
+    esp_err_t writeBlob(BlobStream& stream, const void* data, size_t size);
+
+    /**
+     * Close a stream. For a stream opened with createBlob, the blob is
+     * committed if all of its data was written. Otherwise, the data is
+     * discarded and ESP_ERR_NVS_INVALID_LENGTH is returned.
+     */
+    esp_err_t closeBlob(BlobStream& stream);
+
+    /**
+     * Position the iterator on the first item of the given type in a
+     * namespace, or in any namespace if nsIndex is Page::NS_ANY. ItemType::ANY
+     * matches all types. Namespace entries, chunks of multi-page blobs and
+     * array segments are skipped. Returns ESP_ERR_NVS_NOT_FOUND if there is no such item.
+     */
+    esp_err_t findEntry(uint8_t nsIndex, ItemType datatype, EntryIterator& it);
+
+    /**
+     * Move the iterator to the next matching item. The scan continues from
+     * the entry following the current item, unless storage was modified
+     * since the previous step, in which case the page is looked up again by
+     * its sequence number. Returns ESP_ERR_NVS_NOT_FOUND at the end.
+     */
+    esp_err_t nextEntry(EntryIterator& it);
+
+    /**
+     * Name of the namespace with the given index, or nullptr if there is none.
+     */
+    const char* getNamespaceName(uint8_t nsIndex);
+
+    /**
+     * Erase all items of a namespace in one pass over the pages, instead of
+     * looking up each key. Pages which only hold items of the namespace are
+     * erased as a whole. The namespace itself is kept.
+     */
+    esp_err_t eraseNamespace(uint8_t nsIndex);
+
+    /**
+     * Select how pages to reclaim are picked, see PageManager::setVictimPolicy.
+     * Can be called before init.
+     */
+    void setVictimPolicy(VictimPolicy policy, size_t minErasedEntries)
+    {
+        mPageManager.setVictimPolicy(policy, minErasedEntries);
+    }
+
+    /**
+     * Lock which API calls take before using this instance. Pages only
+     * look at it to tell if they are used in shared mode. Must be set
+     * before init.
+     */
+    void setLock(const RwLock* lock)
+    {
+        mPageManager.setLock(lock);
+    }
+
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
     {
@@ -75,6 +228,19 @@ public:
         return eraseItem(nsIndex, itemTypeOf<T>(), key);
     }
     
+    /**
+     * Cache of integer values read recently, with its hit and miss counters.
+     */
+    const ItemCache& getItemCache() const
+    {
+        return mItemCache;
+    }
+
+    /**
+     * Fill in entry counts of all pages, namespace count and reclaim counters.
+     */
+    void getStats(nvs_stats_t& stats);
+
     void debugDump();
     void debugCheck();
 
@@ -88,11 +254,116 @@ protected:
 
     void clearNamespaces();
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item)
+    NamespaceEntry* findNamespace(const char* nsName);
+
+    void addNamespace(NamespaceEntry* entry);
+
+    esp_err_t appendItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint16_t chunkIdx = Item::CHUNK_ANY);
+
+    esp_err_t appendCounter(uint8_t nsIndex, const char* key, uint32_t value);
+
+    /**
+     * Write a new COUNTER item, then erase the one in oldPage, if any.
+     */
+    esp_err_t replaceCounter(uint8_t nsIndex, const char* key, uint32_t value, Page* oldPage);
+
+    esp_err_t eraseReplacedItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* oldPage, bool oldMultiPage, uint16_t chunkIdx = Item::CHUNK_ANY);
+
+    /**
+     * Write the data of a blob as chunks, filling up the current page
+     * before moving on to new pages, and then write the BLOB_IDX item which
+     * makes the chunks part of the value. Chunks are numbered from
+     * chunkStart, which alternates between 0 and MAX_CHUNKS, so that chunks
+     * of the new value never have the same index as those of the old one.
+     */
+    esp_err_t writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize, uint8_t chunkStart);
+
+    esp_err_t readMultiPageBlob(uint8_t nsIndex, const char* key, void* data, size_t dataSize);
+
+    /**
+     * Erase the first BLOB_IDX item of the key, then the chunks it refers to.
+     */
+    esp_err_t eraseMultiPageBlob(uint8_t nsIndex, const char* key);
+
+    esp_err_t eraseChunks(uint8_t nsIndex, ItemType datatype, const char* key, uint16_t chunkStart, uint16_t chunkCount);
+
+    /**
+     * Called by init for BLOB_IDX and BLOB_DATA items. Erases chunks which
+     * no index refers to, and the older of a BLOB_IDX and a BLOB item with
+     * the same key, which are left if power goes out during a write.
+     */
+    esp_err_t checkBlobItem(Page& page, size_t itemIndex, Item& item);
+
+    uint8_t getNextChunkStart(uint8_t nsIndex, const char* key, bool& hasOldIndex);
+
+    /**
+     * Erase the first ARRAY_IDX item of the key, then the segments it refers to.
+     */
+    esp_err_t eraseArray(uint8_t nsIndex, const char* key);
+
+    /**
+     * Find the ARRAY_IDX item of the key and check that its elements are of
+     * elementType, and that the range of elements is part of the array.
+     */
+    esp_err_t findArray(uint8_t nsIndex, ItemType elementType, const char* key, size_t first, size_t count, Item& index);
+
+    /**
+     * Read segment segmentIndex of the array described by index. size is
+     * set to the number of bytes of the segment.
+     */
+    esp_err_t readArraySegment(const Item& index, size_t segmentIndex, uint8_t* data, size_t& size, Page*& page);
+
+    /**
+     * Called by init for ARRAY_IDX items, before any ARRAY_DATA item is
+     * checked. Erases the older of two indices of the key, which is left if
+     * power goes out during writeArray.
+     */
+    esp_err_t checkArrayIndex(Page& page, size_t itemIndex, Item& item);
+
+    /**
+     * Called by init for ARRAY_DATA items. Erases segments which no index
+     * refers to, and the older of two copies of a segment, which is left
+     * if power goes out during writeArrayRange.
+     */
+    esp_err_t checkArraySegment(Page& page, size_t itemIndex, Item& item);
+
+    static size_t getArrayElementSize(ItemType elementType)
+    {
+        // integer types are 0x0n and 0x1n, with n being the size of the value
+        return isIntegerType(elementType) ? (static_cast<uint8_t>(elementType) & 0x0f) : 0;
+    }
+
+    static size_t getArraySegmentCount(const Item& index)
+    {
+        const size_t dataSize = index.arrayIndex.count * getArrayElementSize(index.arrayIndex.elementType);
+        return (dataSize + Item::ARRAY_SEGMENT_SIZE - 1) / Item::ARRAY_SEGMENT_SIZE;
+    }
+
+    /**
+     * Find where the item of a blob, or all chunks of a multi-page blob,
+     * are and remember it in the stream. If check is set, the locations
+     * are updated, and ESP_ERR_NVS_INVALID_STATE is returned if the value
+     * is no longer the one the stream was opened for.
+     */
+    esp_err_t findBlob(uint8_t nsIndex, const char* key, BlobStream& stream, bool check);
+
+    esp_err_t beginChunk(uint8_t nsIndex, const char* key, BlobStream& stream);
+
+    esp_err_t commitChunk(BlobStream& stream);
+
+    esp_err_t abortBlobWrite();
+
+    esp_err_t findEntryFrom(EntryIterator& it, intrusive_list<Page>::iterator page, size_t itemIndex);
+
+    esp_err_t findOldItems(WriteBatch::iterator begin, WriteBatch::iterator end);
+
+    esp_err_t eraseOldItems(WriteBatch::iterator begin, WriteBatch::iterator end);
+
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, size_t& itemIndex, uint16_t chunkIdx = Item::CHUNK_ANY)
     {
-        size_t itemIndex = 0;
         for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
-            auto err = it->findItem(nsIndex, datatype, key, itemIndex, item);
+            itemIndex = 0;
+            auto err = it->findItem(nsIndex, datatype, key, itemIndex, item, chunkIdx);
             if (err == ESP_OK) {
                 page = it;
                 return ESP_OK;
@@ -101,13 +372,34 @@ protected:
         return ESP_ERR_NVS_NOT_FOUND;
     }
 
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint16_t chunkIdx = Item::CHUNK_ANY)
+    {
+        size_t itemIndex;
+        return findItem(nsIndex, datatype, key, page, item, itemIndex, chunkIdx);
+    }
+
 
 protected:
+    // number of chunk indices available to each of the two versions of a blob
+    static const uint8_t MAX_CHUNKS = 128;
+
+    // number of chunk indices available to each of the two versions of an array
+    static const uint16_t MAX_ARRAY_SEGMENTS = 256;
+
+    // namespaces are found by hash of the name, in a table of this size
+    static const size_t NAMESPACE_BUCKETS = 16;
+
     size_t mPageCount;
     PageManager mPageManager;
     TNamespaces mNamespaces;
+    NamespaceEntry* mNamespaceBuckets[NAMESPACE_BUCKETS] = {};
     CompressedEnumTable<bool, 1, 256> mNamespaceUsage;
     StorageState mState = StorageState::INVALID;
+    // incremented on every change, so that open blob streams can tell
+    // if the location of their item is still valid
+    uint32_t mGeneration = 0;
+    BlobStream* mBlobWriter = nullptr;
+    ItemCache mItemCache;
 };
 
 } // namespace nvs
@@ -23,20 +23,21 @@ namespace nvs
 {
 uint32_t Item::calculateCrc32()
 {
+    // key and data are next to each other, so everything after the crc32
+    // field goes in one call
+    static_assert(offsetof(Item, data) == offsetof(Item, key) + sizeof(key), "data must follow key");
     uint32_t result = 0xffffffff;
     const uint8_t* p = reinterpret_cast<const uint8_t*>(this);
     result = crc32_le(result, p + offsetof(Item, nsIndex),
                       offsetof(Item, crc32) - offsetof(Item, nsIndex));
-    result = crc32_le(result, p + offsetof(Item, key), sizeof(key));
-    result = crc32_le(result, p + offsetof(Item, data), sizeof(data));
+    result = crc32_le(result, p + offsetof(Item, key), sizeof(key) + sizeof(data));
     return result;
 }
 
-uint32_t Item::calculateCrc32(const uint8_t* data, size_t size)
+uint32_t Item::calculateCrc32(const uint8_t* data, size_t size, uint32_t crc)
 {
-    uint32_t result = 0xffffffff;
-    result = crc32_le(result, data, size);
-    return result;
+    // passing the result of a previous call as crc continues the calculation
+    return crc32_le(crc, data, size);
 }
 
 } // namespace nvs
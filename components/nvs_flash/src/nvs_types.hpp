@@ -37,9 +37,71 @@ enum class ItemType : uint8_t {
     I64  = 0x18,
     SZ   = 0x21,
     BLOB = 0x41,
+    BLOB_DATA = 0x42,
+    BLOB_IDX  = 0x48,
+    ARRAY_DATA = 0x52,
+    ARRAY_IDX  = 0x58,
+    COUNTER    = 0x64,
     ANY  = 0xff
 };
 
+/**
+ * Types of items which are followed by data entries.
+ */
+inline bool isVariableLengthType(ItemType type)
+{
+    return type == ItemType::SZ || type == ItemType::BLOB || type == ItemType::BLOB_DATA ||
+           type == ItemType::ARRAY_DATA || type == ItemType::COUNTER;
+}
+
+/**
+ * Types of items of which a key has several, told apart by chunk index.
+ */
+inline bool isChunkType(ItemType type)
+{
+    return type == ItemType::BLOB_DATA || type == ItemType::ARRAY_DATA;
+}
+
+/**
+ * Blobs are kept either as a single BLOB item, or as a BLOB_IDX item
+ * describing a set of BLOB_DATA chunks with the same key.
+ */
+inline bool isBlobType(ItemType type)
+{
+    return type == ItemType::BLOB || type == ItemType::BLOB_DATA || type == ItemType::BLOB_IDX;
+}
+
+/**
+ * Arrays of integers are kept as an ARRAY_IDX item describing the array,
+ * and ARRAY_DATA segments of Item::ARRAY_SEGMENT_SIZE bytes with the same
+ * key, so that some of the elements can be replaced without rewriting
+ * the others.
+ */
+inline bool isArrayType(ItemType type)
+{
+    return type == ItemType::ARRAY_DATA || type == ItemType::ARRAY_IDX;
+}
+
+/**
+ * Integer types, which are also the types of array elements.
+ */
+inline bool isIntegerType(ItemType type)
+{
+    switch (type) {
+    case ItemType::U8:
+    case ItemType::I8:
+    case ItemType::U16:
+    case ItemType::I16:
+    case ItemType::U32:
+    case ItemType::I32:
+    case ItemType::U64:
+    case ItemType::I64:
+        return true;
+    default:
+        return false;
+    }
+}
+
 template<typename T, typename std::enable_if<std::is_integral<T>::value, void*>::type = nullptr>
 constexpr ItemType itemTypeOf()
 {
@@ -66,9 +128,27 @@ public:
             union {
                 struct {
                     uint16_t dataSize;
-                    uint16_t reserved2;
+                    uint16_t chunkIndex;    // CHUNK_ANY unless datatype is BLOB_DATA or ARRAY_DATA
                     uint32_t dataCrc32;
                 } varLength;
+                struct {
+                    uint32_t dataSize;      // size of the whole blob
+                    uint8_t  chunkCount;
+                    uint8_t  chunkStart;    // index of the first chunk
+                    uint16_t reserved;
+                } blobIndex;
+                struct {
+                    uint16_t count;         // number of elements
+                    ItemType elementType;
+                    uint8_t  reserved;
+                    uint16_t chunkStart;    // chunk index of the first segment
+                    uint16_t reserved2;
+                } arrayIndex;
+                struct {
+                    uint16_t bitmapSize;    // bytes of the data entries which record increments
+                    uint16_t chunkIndex;    // CHUNK_ANY
+                    uint32_t base;          // value before the increments recorded in the bitmap
+                } counter;
                 uint8_t data[8];
             };
         };
@@ -77,8 +157,30 @@ public:
 
     static const size_t MAX_KEY_LENGTH = sizeof(key) - 1;
 
+    static const uint16_t CHUNK_ANY = 0xffff;
+
+    // bytes of array elements kept in each ARRAY_DATA item, one data entry
+    static const size_t ARRAY_SEGMENT_SIZE = 32;
+
+    // flag bits live in the reserved field and are set by clearing them,
+    // so that items written without any flags keep it at 0xff
+    static const uint8_t FLAG_BATCH = 0x01;   // item was written as part of a batch
+
+    bool hasFlag(uint8_t flag) const
+    {
+        return (reserved & flag) == 0;
+    }
+
+    uint16_t getChunkIndex() const
+    {
+        if (isChunkType(datatype)) {
+            return varLength.chunkIndex;
+        }
+        return CHUNK_ANY;
+    }
+
     uint32_t calculateCrc32();
-    static uint32_t calculateCrc32(const uint8_t* data, size_t size);
+    static uint32_t calculateCrc32(const uint8_t* data, size_t size, uint32_t crc = 0xffffffff);
 
     void getKey(char* dst, size_t dstSize)
     {
@@ -0,0 +1,159 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_write_batch.hpp"
+#include "nvs_page.hpp"
+#include <new>
+
+namespace nvs
+{
+
+WriteBatch::~WriteBatch()
+{
+    clear();
+}
+
+void WriteBatch::clear()
+{
+    for (auto it = mItems.begin(); it != mItems.end();) {
+        auto tmp = it;
+        ++it;
+        mItems.erase(tmp);
+        delete static_cast<BatchItem*>(tmp);
+    }
+}
+
+esp_err_t WriteBatch::find(uint8_t nsIndex, ItemType datatype, const char* key, BatchItem* &item)
+{
+    for (auto it = mItems.begin(); it != mItems.end(); ++it) {
+        const Item& header = it->header();
+        // like in Storage, values of different types are separate items
+        if (header.nsIndex != nsIndex || header.datatype != datatype ||
+            strncmp(key, header.key, Item::MAX_KEY_LENGTH) != 0) {
+            continue;
+        }
+        item = it;
+        return ESP_OK;
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t WriteBatch::set(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    const bool isVarLength = isVariableLengthType(datatype);
+    size_t entriesCount = 1;
+    if (isVarLength) {
+        entriesCount += (dataSize + Page::ENTRY_SIZE - 1) / Page::ENTRY_SIZE;
+    }
+    if (entriesCount + 1 > Page::ENTRY_COUNT) {
+        // wouldn't fit into any page, together with the batch marker
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    BatchItem* oldItem = nullptr;
+    find(nsIndex, datatype, key, oldItem);
+
+    std::unique_ptr<Item[]> entries(new (std::nothrow) Item[entriesCount]);
+    if (!entries) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    Item& item = entries[0];
+    item.nsIndex = nsIndex;
+    item.datatype = datatype;
+    item.span = static_cast<uint8_t>(entriesCount);
+    item.reserved = 0xff & ~Item::FLAG_BATCH;
+
+    std::fill_n(reinterpret_cast<uint32_t*>(item.key),  sizeof(item.key)  / 4, 0xffffffff);
+    std::fill_n(reinterpret_cast<uint32_t*>(item.data), sizeof(item.data) / 4, 0xffffffff);
+
+    strncpy(item.key, key, sizeof(item.key) - 1);
+    item.key[sizeof(item.key) - 1] = 0;
+
+    if (!isVarLength) {
+        memcpy(item.data, data, dataSize);
+    } else {
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+        item.varLength.dataCrc32 = Item::calculateCrc32(src, dataSize);
+        item.varLength.dataSize = static_cast<uint16_t>(dataSize);
+        item.varLength.chunkIndex = Item::CHUNK_ANY;
+        for (size_t i = 1; i < entriesCount; ++i) {
+            size_t offset = (i - 1) * Page::ENTRY_SIZE;
+            size_t willCopy = Page::ENTRY_SIZE;
+            willCopy = (dataSize - offset < willCopy)?dataSize - offset:willCopy;
+            std::fill_n(entries[i].rawData, sizeof(entries[i].rawData), 0xff);
+            memcpy(entries[i].rawData, src + offset, willCopy);
+        }
+    }
+    item.crc32 = item.calculateCrc32();
+
+    if (oldItem) {
+        oldItem->mEntries.swap(entries);
+        return ESP_OK;
+    }
+
+    auto batchItem = new (std::nothrow) BatchItem;
+    if (!batchItem) {
+        return ESP_ERR_NO_MEM;
+    }
+    batchItem->mEntries.swap(entries);
+    mItems.push_back(batchItem);
+    return ESP_OK;
+}
+
+esp_err_t WriteBatch::get(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
+{
+    BatchItem* batchItem;
+    auto err = find(nsIndex, datatype, key, batchItem);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    const Item& item = batchItem->header();
+    if (!isVariableLengthType(datatype)) {
+        memcpy(data, item.data, dataSize);
+        return ESP_OK;
+    }
+
+    if (dataSize < static_cast<size_t>(item.varLength.dataSize)) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    size_t left = item.varLength.dataSize;
+    for (size_t i = 1; i < batchItem->entryCount(); ++i) {
+        size_t willCopy = Page::ENTRY_SIZE;
+        willCopy = (left < willCopy)?left:willCopy;
+        memcpy(dst, batchItem->entries()[i].rawData, willCopy);
+        left -= willCopy;
+        dst += willCopy;
+    }
+    return ESP_OK;
+}
+
+esp_err_t WriteBatch::getDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize)
+{
+    BatchItem* batchItem;
+    auto err = find(nsIndex, datatype, key, batchItem);
+    if (err != ESP_OK) {
+        return err;
+    }
+    dataSize = batchItem->header().varLength.dataSize;
+    return ESP_OK;
+}
+
+} // namespace nvs
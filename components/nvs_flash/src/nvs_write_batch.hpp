@@ -0,0 +1,113 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_write_batch_hpp
+#define nvs_write_batch_hpp
+
+#include <memory>
+#include "nvs.h"
+#include "nvs_types.hpp"
+#include "intrusive_list.h"
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Set of item writes staged in RAM until they are committed to storage.
+ *
+ * Each staged item is kept in its on-flash form: a header entry followed by
+ * data entries for strings and blobs, with the CRCs already computed. This
+ * lets Storage::writeBatch copy consecutive items into a page without
+ * building them again, and update the entry state table once for the
+ * whole run.
+ *
+ * Setting the same key twice only keeps the last value.
+ */
+class WriteBatch
+{
+public:
+    class BatchItem : public intrusive_list_node<BatchItem>
+    {
+    public:
+        const Item& header() const
+        {
+            return mEntries[0];
+        }
+
+        const Item* entries() const
+        {
+            return mEntries.get();
+        }
+
+        size_t entryCount() const
+        {
+            return mEntries[0].span;
+        }
+
+        // page holding the copy of this item which is replaced on commit
+        Page* mOldPage = nullptr;
+        std::unique_ptr<Item[]> mEntries;
+    };
+
+    typedef intrusive_list<BatchItem> TItemList;
+    typedef TItemList::iterator iterator;
+
+    WriteBatch() { }
+    ~WriteBatch();
+
+    esp_err_t set(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    /**
+     * Read a staged value. Returns ESP_ERR_NVS_NOT_FOUND if the key is not
+     * part of the batch, in which case the caller should read it from storage.
+     */
+    esp_err_t get(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
+
+    esp_err_t getDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize);
+
+    void clear();
+
+    bool empty() const
+    {
+        return mItems.size() == 0;
+    }
+
+    size_t size() const
+    {
+        return mItems.size();
+    }
+
+    iterator begin()
+    {
+        return mItems.begin();
+    }
+
+    iterator end()
+    {
+        return mItems.end();
+    }
+
+protected:
+    WriteBatch(const WriteBatch& other);
+    const WriteBatch& operator= (const WriteBatch& rhs);
+
+    esp_err_t find(uint8_t nsIndex, ItemType datatype, const char* key, BatchItem* &item);
+
+    TItemList mItems;
+}; // class WriteBatch
+
+} // namespace nvs
+
+#endif /* nvs_write_batch_hpp */
@@ -0,0 +1,401 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Workloads replayed against the flash emulator, to compare flash operations,
+// simulated time, wear and heap usage of NVS between changes.
+// Run with "make benchmark"; results are printed to stdout.
+
+#include "catch.hpp"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "spi_flash_emulation.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+
+// heap usage is tracked by replacing the global allocation functions;
+// each block is prefixed with its size
+static size_t s_heapInUse = 0;
+static size_t s_heapPeak = 0;
+static const size_t HEAP_HEADER_SIZE = 16;
+
+static void* trackedAlloc(size_t size)
+{
+    uint8_t* block = static_cast<uint8_t*>(malloc(size + HEAP_HEADER_SIZE));
+    if (!block) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    s_heapInUse += size;
+    if (s_heapInUse > s_heapPeak) {
+        s_heapPeak = s_heapInUse;
+    }
+    return block + HEAP_HEADER_SIZE;
+}
+
+static void trackedFree(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    uint8_t* block = static_cast<uint8_t*>(ptr) - HEAP_HEADER_SIZE;
+    s_heapInUse -= *reinterpret_cast<size_t*>(block);
+    free(block);
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = trackedAlloc(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return trackedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return trackedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    trackedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    trackedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    trackedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    trackedFree(ptr);
+}
+
+static const uint32_t NVS_FLASH_SECTOR = 4;
+static const uint32_t NVS_FLASH_SECTOR_COUNT = 8;
+
+/**
+ * Collects flash statistics and heap usage of the operations passed to run,
+ * and prints them as one row of the report.
+ */
+class Measurement
+{
+public:
+    Measurement(const SpiFlashEmulator& emu, const char* name) : mEmu(emu), mName(name)
+    {
+    }
+
+    template<typename TFunc>
+    esp_err_t run(TFunc func)
+    {
+        size_t readOps = mEmu.getReadOps();
+        size_t writeOps = mEmu.getWriteOps();
+        size_t eraseOps = mEmu.getEraseOps();
+        size_t readBytes = mEmu.getReadBytes();
+        size_t writeBytes = mEmu.getWriteBytes();
+        size_t time = mEmu.getTotalTime();
+        size_t heapBefore = s_heapInUse;
+        s_heapPeak = s_heapInUse;
+
+        esp_err_t err = func();
+
+        mReadOps += mEmu.getReadOps() - readOps;
+        mWriteOps += mEmu.getWriteOps() - writeOps;
+        mEraseOps += mEmu.getEraseOps() - eraseOps;
+        mReadBytes += mEmu.getReadBytes() - readBytes;
+        mWriteBytes += mEmu.getWriteBytes() - writeBytes;
+        mTime += mEmu.getTotalTime() - time;
+        mHeapPeak = std::max(mHeapPeak, s_heapPeak - heapBefore);
+        ++mOps;
+        return err;
+    }
+
+    void report() const
+    {
+        double ops = (mOps == 0) ? 1 : mOps;
+        printf("%-28s %6u %9.1f %9.1f %8.3f %9.1f %9.1f %10.1f %8u\n", mName.c_str(),
+               static_cast<unsigned>(mOps), mReadOps / ops, mWriteOps / ops, mEraseOps / ops,
+               mReadBytes / ops, mWriteBytes / ops, mTime / ops, static_cast<unsigned>(mHeapPeak));
+    }
+
+    static void printHeader()
+    {
+        printf("%-28s %6s %9s %9s %8s %9s %9s %10s %8s\n", "workload", "ops",
+               "reads/op", "writes/op", "erase/op", "rd B/op", "wr B/op", "us/op", "heap pk");
+    }
+
+protected:
+    const SpiFlashEmulator& mEmu;
+    std::string mName;
+    size_t mOps = 0;
+    size_t mReadOps = 0;
+    size_t mWriteOps = 0;
+    size_t mEraseOps = 0;
+    size_t mReadBytes = 0;
+    size_t mWriteBytes = 0;
+    size_t mTime = 0;
+    // largest growth of the heap during a single operation
+    size_t mHeapPeak = 0;
+};
+
+// heap in use is relative to heapBase, taken before storage was initialized
+static void reportWear(const SpiFlashEmulator& emu, size_t heapBase)
+{
+    size_t minCount = SIZE_MAX;
+    size_t maxCount = 0;
+    printf("    erases per sector:");
+    for (uint32_t i = NVS_FLASH_SECTOR; i < NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT; ++i) {
+        size_t count = emu.getSectorEraseCount(i);
+        minCount = std::min(minCount, count);
+        maxCount = std::max(maxCount, count);
+        printf(" %u", static_cast<unsigned>(count));
+    }
+    printf(" (min %u, max %u), heap in use %d bytes\n", static_cast<unsigned>(minCount),
+           static_cast<unsigned>(maxCount), static_cast<int>(s_heapInUse - heapBase));
+}
+
+static void printTitle(const char* title)
+{
+    static bool headerPrinted = false;
+    if (!headerPrinted) {
+        printf("\n");
+        Measurement::printHeader();
+        headerPrinted = true;
+    }
+    printf("-- %s\n", title);
+}
+
+/**
+ * A set of configuration values of different types and sizes, updated in
+ * random order, as an application saving its settings would do.
+ */
+class ConfigChurn
+{
+public:
+    static const size_t KEY_COUNT = 24;
+
+    ConfigChurn(uint32_t seed) : mGen(seed)
+    {
+    }
+
+    esp_err_t update(nvs_handle handle)
+    {
+        size_t index = mGen() % KEY_COUNT;
+        char key[16];
+        snprintf(key, sizeof(key), "config%u", static_cast<unsigned>(index));
+        esp_err_t err;
+        switch (index % 4) {
+        case 0:
+            err = nvs_set_u8(handle, key, static_cast<uint8_t>(mGen()));
+            break;
+        case 1:
+            err = nvs_set_i32(handle, key, static_cast<int32_t>(mGen()));
+            break;
+        case 2: {
+            char str[48];
+            size_t len = 8 + mGen() % (sizeof(str) - 9);
+            memset(str, 'a' + index, len);
+            str[len] = 0;
+            err = nvs_set_str(handle, key, str);
+            break;
+        }
+        default: {
+            uint8_t blob[64];
+            std::generate_n(blob, sizeof(blob), std::ref(mGen));
+            err = nvs_set_blob(handle, key, blob, sizeof(blob));
+            break;
+        }
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        return nvs_commit(handle);
+    }
+
+protected:
+    std::mt19937 mGen;
+};
+
+TEST_CASE("benchmark config churn", "[benchmark]")
+{
+    SpiFlashEmulator emu(NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    size_t heapBase = s_heapInUse;
+    printTitle("config churn, 24 keys of mixed types");
+
+    Measurement mount(emu, "mount empty");
+    REQUIRE(mount.run([]() {
+        return nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT);
+    }) == ESP_OK);
+    mount.report();
+
+    nvs_handle handle;
+    REQUIRE(nvs_open("config", NVS_READWRITE, &handle) == ESP_OK);
+    ConfigChurn churn(1);
+    Measurement update(emu, "set + commit");
+    for (size_t i = 0; i < 5000; ++i) {
+        REQUIRE(update.run([&]() {
+            return churn.update(handle);
+        }) == ESP_OK);
+    }
+    update.report();
+
+    Measurement read(emu, "get i32");
+    for (size_t i = 0; i < 1000; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "config%u", static_cast<unsigned>((i * 4 + 1) % ConfigChurn::KEY_COUNT));
+        int32_t value;
+        REQUIRE(read.run([&]() {
+            return nvs_get_i32(handle, key, &value);
+        }) == ESP_OK);
+    }
+    read.report();
+    nvs_close(handle);
+
+    Measurement remount(emu, "mount after churn");
+    REQUIRE(remount.run([]() {
+        return nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT);
+    }) == ESP_OK);
+    remount.report();
+    reportWear(emu, heapBase);
+}
+
+TEST_CASE("benchmark counter increments", "[benchmark]")
+{
+    SpiFlashEmulator emu(NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    size_t heapBase = s_heapInUse;
+    printTitle("counter increments, one u32 value");
+    REQUIRE(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT) == ESP_OK);
+
+    nvs_handle handle;
+    REQUIRE(nvs_open("counter", NVS_READWRITE, &handle) == ESP_OK);
+    REQUIRE(nvs_set_u32(handle, "boot_count", 0) == ESP_OK);
+    Measurement increment(emu, "get + set + commit");
+    for (uint32_t i = 0; i < 10000; ++i) {
+        REQUIRE(increment.run([&]() {
+            uint32_t value;
+            esp_err_t err = nvs_get_u32(handle, "boot_count", &value);
+            if (err != ESP_OK) {
+                return err;
+            }
+            err = nvs_set_u32(handle, "boot_count", value + 1);
+            if (err != ESP_OK) {
+                return err;
+            }
+            return nvs_commit(handle);
+        }) == ESP_OK);
+    }
+    increment.report();
+    uint32_t value;
+    REQUIRE(nvs_get_u32(handle, "boot_count", &value) == ESP_OK);
+    CHECK(value == 10000);
+    nvs_close(handle);
+    reportWear(emu, heapBase);
+}
+
+TEST_CASE("benchmark large blobs", "[benchmark]")
+{
+    SpiFlashEmulator emu(NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    size_t heapBase = s_heapInUse;
+    printTitle("large blobs, 10000 bytes, spread over pages");
+    REQUIRE(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT) == ESP_OK);
+
+    nvs_handle handle;
+    REQUIRE(nvs_open("blobs", NVS_READWRITE, &handle) == ESP_OK);
+    const size_t size = 10000;
+    static uint8_t data[size];
+    static uint8_t readBack[size];
+    std::mt19937 gen(2);
+
+    Measurement write(emu, "set_blob + commit");
+    Measurement read(emu, "get_blob");
+    for (size_t i = 0; i < 100; ++i) {
+        std::generate_n(data, size, std::ref(gen));
+        REQUIRE(write.run([&]() {
+            esp_err_t err = nvs_set_blob(handle, "image", data, size);
+            if (err != ESP_OK) {
+                return err;
+            }
+            return nvs_commit(handle);
+        }) == ESP_OK);
+    }
+    write.report();
+
+    for (size_t i = 0; i < 100; ++i) {
+        size_t length = size;
+        REQUIRE(read.run([&]() {
+            return nvs_get_blob(handle, "image", readBack, &length);
+        }) == ESP_OK);
+    }
+    read.report();
+    CHECK(memcmp(data, readBack, size) == 0);
+    nvs_close(handle);
+    reportWear(emu, heapBase);
+}
+
+TEST_CASE("benchmark mount after power loss", "[benchmark]")
+{
+    SpiFlashEmulator emu(NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT);
+    size_t heapBase = s_heapInUse;
+    printTitle("mount after power loss during config churn");
+    REQUIRE(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT) == ESP_OK);
+
+    ConfigChurn churn(3);
+    nvs_handle handle;
+    REQUIRE(nvs_open("config", NVS_READWRITE, &handle) == ESP_OK);
+    for (size_t i = 0; i < 2000; ++i) {
+        REQUIRE(churn.update(handle) == ESP_OK);
+    }
+    nvs_close(handle);
+
+    Measurement mount(emu, "mount");
+    std::mt19937 gen(4);
+    for (size_t trial = 0; trial < 50; ++trial) {
+        REQUIRE(nvs_open("config", NVS_READWRITE, &handle) == ESP_OK);
+        emu.failAfter(gen() % 200);
+        while (churn.update(handle) == ESP_OK) {
+        }
+        emu.clearFailure();
+        nvs_close(handle);
+
+        REQUIRE(mount.run([]() {
+            return nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT);
+        }) == ESP_OK);
+    }
+    mount.report();
+    reportWear(emu, heapBase);
+}
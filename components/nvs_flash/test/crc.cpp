@@ -12,27 +12,31 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <stdint.h>
-#include <stdbool.h>
+
+// stands in for crc32_le from ROM; bytes are processed with a lookup table
+// instead of bit by bit, with the same results
+static uint32_t s_crcTable[256];
+
+static void initCrcTable()
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i << 24;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+        s_crcTable[i] = crc;
+    }
+}
 
 extern "C" unsigned long crc32_le(unsigned long crc_in, unsigned char const* data, unsigned int length)
 {
-    uint32_t i;
-    bool bit;
-    uint8_t c;
+    if (s_crcTable[1] == 0) {
+        initCrcTable();
+    }
     uint32_t crc = (uint32_t) crc_in;
 
     while (length--) {
-        c = *data++;
-        for (i = 0x80; i > 0; i >>= 1) {
-            bit = crc & 0x80000000;
-            if (c & i) {
-                bit = !bit;
-            }
-            crc <<= 1;
-            if (bit) {
-                crc ^= 0x04c11db7;
-            }
-        }
+        crc = (crc << 8) ^ s_crcTable[((crc >> 24) ^ *data++) & 0xff];
     }
     return crc;
 }
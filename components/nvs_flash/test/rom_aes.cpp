@@ -0,0 +1,52 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "rom/aes.h"
+#include "mbedtls/aes.h"
+
+// stands in for the ROM functions driving the AES unit. Like the unit, the
+// context holds the key for one direction, set by the last setkey call.
+static mbedtls_aes_context s_aes;
+static int s_mode = MBEDTLS_AES_ENCRYPT;
+
+static unsigned keyBits(enum AES_BITS bits)
+{
+    return (bits == AES128) ? 128 : (bits == AES192) ? 192 : 256;
+}
+
+extern "C" void ets_aes_enable(void)
+{
+    mbedtls_aes_init(&s_aes);
+}
+
+extern "C" void ets_aes_disable(void)
+{
+    mbedtls_aes_free(&s_aes);
+}
+
+extern "C" bool ets_aes_setkey_enc(const uint8_t *key, enum AES_BITS bits)
+{
+    s_mode = MBEDTLS_AES_ENCRYPT;
+    return mbedtls_aes_setkey_enc(&s_aes, key, keyBits(bits)) == 0;
+}
+
+extern "C" bool ets_aes_setkey_dec(const uint8_t *key, enum AES_BITS bits)
+{
+    s_mode = MBEDTLS_AES_DECRYPT;
+    return mbedtls_aes_setkey_dec(&s_aes, key, keyBits(bits)) == 0;
+}
+
+extern "C" void ets_aes_crypt(const uint8_t input[16], uint8_t output[16])
+{
+    mbedtls_aes_crypt_ecb(&s_aes, s_mode, input, output);
+}
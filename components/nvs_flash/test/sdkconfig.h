@@ -0,0 +1,31 @@
+/*
+ * Configuration used for building NVS on the host.
+ * On the target, sdkconfig.h is generated from Kconfig options.
+ * Other lookup methods can be tested by defining CONFIG_NVS_BLOOM_FILTER
+ * or CONFIG_NVS_LOOKUP_LINEAR on the compiler command line.
+ */
+#ifndef sdkconfig_h
+#define sdkconfig_h
+
+#if !defined(CONFIG_NVS_BLOOM_FILTER) && !defined(CONFIG_NVS_LOOKUP_LINEAR)
+#define CONFIG_NVS_HASH_INDEX 1
+#endif
+
+#if !defined(CONFIG_NVS_LOOKUP_LINEAR) && !defined(CONFIG_NVS_LAZY_CRC_CHECK)
+#define CONFIG_NVS_LAZY_CRC_CHECK 1
+#endif
+
+#ifndef CONFIG_NVS_BLOOM_FILTER_SIZE
+#define CONFIG_NVS_BLOOM_FILTER_SIZE 32
+#endif
+
+#ifndef CONFIG_NVS_ITEM_CACHE_SIZE
+#define CONFIG_NVS_ITEM_CACHE_SIZE 16
+#endif
+
+// SpiFlashEmulator only lets flash be mapped if a test enables it
+#ifndef CONFIG_NVS_MMAP_READS
+#define CONFIG_NVS_MMAP_READS 1
+#endif
+
+#endif /* sdkconfig_h */
@@ -53,4 +53,68 @@ TEST_CASE("test if CompressedEnumTable works as expected", "[enumtable]")
 
     CHECK(table.data()[0] == 0x93909249);
 
-}
\ No newline at end of file
+}
+TEST_CASE("CompressedEnumTable finds and counts items a word at a time", "[enumtable]")
+{
+    enum class TEnum2 : uint32_t {
+        ZERO = 0,
+        ONE  = 1,
+        TWO  = 2,
+        THREE = 3,
+    };
+    // last word is only partially used, as in the entry state table of a page
+    CompressedEnumTable<TEnum2, 2, 126> table;
+    memset(table.data(), 0xff, table.byteSize());
+    CHECK(table.find(TEnum2::THREE) == 0);
+    CHECK(table.find(TEnum2::ZERO) == table.count());
+    CHECK(table.countEqual(TEnum2::THREE) == table.count());
+    CHECK(table.countEqual(TEnum2::ZERO) == 0);
+
+    table.set(17, TEnum2::TWO);
+    table.set(40, TEnum2::TWO);
+    table.set(125, TEnum2::ZERO);
+    CHECK(table.find(TEnum2::TWO) == 17);
+    CHECK(table.find(TEnum2::TWO, 17) == 17);
+    CHECK(table.find(TEnum2::TWO, 18) == 40);
+    CHECK(table.find(TEnum2::TWO, 18, 40) == 40);
+    CHECK(table.find(TEnum2::TWO, 41) == table.count());
+    CHECK(table.find(TEnum2::ZERO) == 125);
+    CHECK(table.countEqual(TEnum2::TWO, 17, 41) == 2);
+    CHECK(table.countEqual(TEnum2::TWO, 18, 40) == 0);
+
+    unsigned seed = 1;
+    for (int round = 0; round < 100; ++round) {
+        for (size_t i = 0; i < table.count(); ++i) {
+            seed = seed * 1103515245 + 12345;
+            table.set(i, static_cast<TEnum2>((seed >> 16) % 4));
+        }
+        for (size_t begin = 0; begin < table.count(); begin += 7) {
+            for (size_t end = begin; end <= table.count(); end += 11) {
+                for (uint32_t v = 0; v < 4; ++v) {
+                    TEnum2 val = static_cast<TEnum2>(v);
+                    size_t expectedIndex = end;
+                    size_t expectedCount = 0;
+                    for (size_t i = begin; i < end; ++i) {
+                        if (table.get(i) == val) {
+                            if (expectedIndex == end) {
+                                expectedIndex = i;
+                            }
+                            ++expectedCount;
+                        }
+                    }
+                    REQUIRE(table.find(val, begin, end) == expectedIndex);
+                    REQUIRE(table.countEqual(val, begin, end) == expectedCount);
+                }
+            }
+        }
+    }
+
+    CompressedEnumTable<bool, 1, 256> bits;
+    memset(bits.data(), 0, bits.byteSize());
+    bits.set(0, true);
+    bits.set(255, true);
+    CHECK(bits.find(false) == 1);
+    CHECK(bits.find(true, 1) == 255);
+    CHECK(bits.countEqual(true) == 2);
+    CHECK(bits.countEqual(false, 1, 255) == 254);
+}
@@ -13,10 +13,14 @@
 // limitations under the License.
 #include "catch.hpp"
 #include "nvs.hpp"
+#include "nvs_handle_table.hpp"
+#include "nvs_platform.hpp"
+#include "nvs_encryption.hpp"
 #include "nvs_flash.h"
 #include "spi_flash_emulation.h"
 #include <sstream>
 #include <iostream>
+#include <set>
 
 using namespace std;
 using namespace nvs;
@@ -790,6 +794,2199 @@ TEST_CASE("test recovery from sudden poweroff", "[.][long][nvs][recovery][monkey
     }
 }
 
+TEST_CASE("HashList returns candidates in order of entry index", "[nvs][hashlist]")
+{
+    HashList hashList;
+    Item item;
+    std::fill_n(item.key, sizeof(item.key), 0);
+    for (size_t i = 0; i < 100; ++i) {
+        item.nsIndex = static_cast<uint8_t>(1 + i % 2);
+        snprintf(item.key, sizeof(item.key), "key%d", static_cast<int>(i % 10));
+        hashList.insert(item, i);
+    }
+    CHECK(hashList.getItemCount() == 100);
+    CHECK(hashList.find(0, 1, "key4") == 4);
+    CHECK(hashList.find(5, 1, "key4") == 14);
+    CHECK(hashList.find(0, 2, "key4") == SIZE_MAX);
+    CHECK(hashList.find(0, 2, "key5") == 5);
+    CHECK(hashList.find(96, 1, "key4") == SIZE_MAX);
+
+    hashList.erase(4);
+    CHECK(hashList.find(0, 1, "key4") == 14);
+    for (size_t i = 0; i < 100; ++i) {
+        hashList.erase(i);
+    }
+    CHECK(hashList.getItemCount() == 0);
+    CHECK(hashList.find(0, 1, "key4") == SIZE_MAX);
+}
+
+#if CONFIG_NVS_HASH_INDEX
+TEST_CASE("lookup with index reads only matching entries", "[nvs][hashlist]")
+{
+    SpiFlashEmulator emu(1);
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "i%d", static_cast<int>(i));
+        REQUIRE(page.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    emu.clearStats();
+    uint32_t value;
+    CHECK(page.readItem(1, "i100", value) == ESP_OK);
+    CHECK(value == 100);
+    CHECK(emu.getReadOps() == 1);
+    CHECK(page.findItem(1, ItemType::U32, "nonexistent") == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(page.readItem(1, "i100", reinterpret_cast<int32_t&>(value)) == ESP_ERR_NVS_TYPE_MISMATCH);
+    CHECK(emu.getReadOps() <= 2);
+}
+#endif //CONFIG_NVS_HASH_INDEX
+
+#if CONFIG_NVS_BLOOM_FILTER
+TEST_CASE("lookup with bloom filter skips pages without the key", "[nvs][filter]")
+{
+    SpiFlashEmulator emu(1);
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    for (size_t i = 0; i < 16; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "i%d", static_cast<int>(i));
+        REQUIRE(page.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    emu.clearStats();
+    CHECK(page.findItem(2, ItemType::U32, "i1") == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(page.findItem(1, ItemType::U32, "i1") == ESP_OK);
+    CHECK(emu.getReadOps() < 16);
+}
+#endif //CONFIG_NVS_BLOOM_FILTER
+
+TEST_CASE("index is rebuilt when storage is loaded from flash", "[nvs][hashlist]")
+{
+    SpiFlashEmulator emu(8);
+    emu.setBounds(4, 8);
+    {
+        Storage storage;
+        CHECK(storage.init(4, 4) == ESP_OK);
+        for (size_t i = 0; i < Page::ENTRY_COUNT * 2; ++i) {
+            char name[Item::MAX_KEY_LENGTH + 1];
+            snprintf(name, sizeof(name), "key%05d", static_cast<int>(i));
+            REQUIRE(storage.writeItem(1, name, static_cast<int>(i)) == ESP_OK);
+        }
+        // overwrite some keys, so that data is also moved between pages
+        for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+            REQUIRE(storage.writeItem(1, "key00001", static_cast<int>(i)) == ESP_OK);
+        }
+    }
+    Storage storage;
+    CHECK(storage.init(4, 4) == ESP_OK);
+    for (size_t i = 0; i < Page::ENTRY_COUNT * 2; ++i) {
+        char name[Item::MAX_KEY_LENGTH + 1];
+        snprintf(name, sizeof(name), "key%05d", static_cast<int>(i));
+        int value;
+        CAPTURE(i);
+        REQUIRE(storage.readItem(1, name, value) == ESP_OK);
+        CHECK(value == ((i == 1) ? static_cast<int>(Page::ENTRY_COUNT - 1) : static_cast<int>(i)));
+    }
+    emu.clearStats();
+    int value;
+    CHECK(storage.readItem(1, "key00200", value) == ESP_OK);
+    s_perf << "Reads to find one key among " << Page::ENTRY_COUNT * 2 << ": " << emu.getReadOps() << std::endl;
+}
+
+TEST_CASE("KeyFilter has no false negatives", "[nvs][filter]")
+{
+    KeyFilter<32> filter;
+    CHECK_FALSE(filter.mayContain(1, "foo"));
+    char name[Item::MAX_KEY_LENGTH + 1];
+    for (int i = 0; i < 64; ++i) {
+        snprintf(name, sizeof(name), "key%d", i);
+        filter.insert(1, name);
+    }
+    size_t falsePositives = 0;
+    for (int i = 0; i < 64; ++i) {
+        snprintf(name, sizeof(name), "key%d", i);
+        CHECK(filter.mayContain(1, name));
+        if (filter.mayContain(2, name)) {
+            ++falsePositives;
+        }
+    }
+    CHECK(falsePositives < 32);
+    filter.clear();
+    CHECK_FALSE(filter.mayContain(1, "key0"));
+}
+
+TEST_CASE("WriteBatch keeps the last value set for a key", "[nvs][batch]")
+{
+    WriteBatch batch;
+    uint32_t value = 1;
+    CHECK(batch.set(1, ItemType::U32, "foo", &value, sizeof(value)) == ESP_OK);
+    value = 2;
+    CHECK(batch.set(1, ItemType::U32, "foo", &value, sizeof(value)) == ESP_OK);
+    CHECK(batch.set(2, ItemType::U32, "foo", &value, sizeof(value)) == ESP_OK);
+    CHECK(batch.size() == 2);
+    CHECK(batch.set(1, ItemType::U8, "a_very_long_key_name", &value, 1) == ESP_ERR_NVS_KEY_TOO_LONG);
+
+    value = 0;
+    CHECK(batch.get(1, ItemType::U32, "foo", &value, sizeof(value)) == ESP_OK);
+    CHECK(value == 2);
+    CHECK(batch.get(1, ItemType::U32, "bar", &value, sizeof(value)) == ESP_ERR_NVS_NOT_FOUND);
+
+    const char str[] = "value 0123456789abcdef0123456789abcdef";
+    CHECK(batch.set(1, ItemType::SZ, "str", str, sizeof(str)) == ESP_OK);
+    size_t size;
+    CHECK(batch.getDataSize(1, ItemType::SZ, "str", size) == ESP_OK);
+    CHECK(size == sizeof(str));
+    char buf[sizeof(str)];
+    CHECK(batch.get(1, ItemType::SZ, "str", buf, sizeof(buf)) == ESP_OK);
+    CHECK(strcmp(buf, str) == 0);
+
+    batch.clear();
+    CHECK(batch.empty());
+}
+
+TEST_CASE("batch commit writes items and erases replaced ones", "[nvs][batch]")
+{
+    const size_t itemCount = 40;
+    const char str[] = "value 0123456789abcdef0123456789abcdef";
+    size_t writeOps[2];
+    for (int useBatch = 0; useBatch < 2; ++useBatch) {
+        SpiFlashEmulator emu(4);
+        Storage storage;
+        CHECK(storage.init(0, 4) == ESP_OK);
+        for (size_t i = 0; i < itemCount / 2; ++i) {
+            char name[Item::MAX_KEY_LENGTH + 1];
+            snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+            REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+        }
+
+        emu.clearStats();
+        WriteBatch batch;
+        for (size_t i = 0; i < itemCount; ++i) {
+            char name[Item::MAX_KEY_LENGTH + 1];
+            snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+            uint32_t value = static_cast<uint32_t>(i + 1000);
+            if (useBatch) {
+                REQUIRE(batch.set(1, ItemType::U32, name, &value, sizeof(value)) == ESP_OK);
+            } else {
+                REQUIRE(storage.writeItem(1, name, value) == ESP_OK);
+            }
+        }
+        if (useBatch) {
+            REQUIRE(batch.set(1, ItemType::SZ, "str", str, sizeof(str)) == ESP_OK);
+            REQUIRE(storage.writeBatch(batch) == ESP_OK);
+            CHECK(batch.empty());
+        } else {
+            REQUIRE(storage.writeItem(1, ItemType::SZ, "str", str, sizeof(str)) == ESP_OK);
+        }
+        writeOps[useBatch] = emu.getWriteOps();
+
+        Storage storage2;
+        CHECK(storage2.init(0, 4) == ESP_OK);
+        for (size_t i = 0; i < itemCount; ++i) {
+            char name[Item::MAX_KEY_LENGTH + 1];
+            snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+            uint32_t value;
+            REQUIRE(storage2.readItem(1, name, value) == ESP_OK);
+            CHECK(value == i + 1000);
+        }
+        char buf[sizeof(str)];
+        CHECK(storage2.readItem(1, ItemType::SZ, "str", buf, sizeof(buf)) == ESP_OK);
+        CHECK(strcmp(buf, str) == 0);
+    }
+    CHECK(writeOps[1] < writeOps[0] / 2);
+    s_perf << "Write ops to set " << itemCount << " keys: " << writeOps[0] << " one by one, " << writeOps[1] << " in a batch" << std::endl;
+}
+
+TEST_CASE("completed batch isn't checked for duplicates on every load", "[nvs][batch]")
+{
+    const size_t itemCount = 40;
+    size_t readOps[2];
+    for (int useBatch = 0; useBatch < 2; ++useBatch) {
+        SpiFlashEmulator emu(4);
+        {
+            Storage storage;
+            CHECK(storage.init(0, 4) == ESP_OK);
+            WriteBatch batch;
+            for (size_t i = 0; i < itemCount; ++i) {
+                char name[Item::MAX_KEY_LENGTH + 1];
+                snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+                uint32_t value = static_cast<uint32_t>(i);
+                if (useBatch) {
+                    REQUIRE(batch.set(1, ItemType::U32, name, &value, sizeof(value)) == ESP_OK);
+                } else {
+                    REQUIRE(storage.writeItem(1, name, value) == ESP_OK);
+                }
+            }
+            if (useBatch) {
+                REQUIRE(storage.writeBatch(batch) == ESP_OK);
+            }
+            // this write can only happen once the batch is done
+            REQUIRE(storage.writeItem(1, "after", 1u) == ESP_OK);
+        }
+        emu.clearStats();
+        PageManager pm;
+        CHECK(pm.load(0, 4) == ESP_OK);
+        readOps[useBatch] = emu.getReadOps();
+    }
+    CHECK(readOps[1] == readOps[0]);
+}
+
+TEST_CASE("batch commit works while pages are being reclaimed", "[nvs][batch]")
+{
+    SpiFlashEmulator emu(3);
+    {
+        Storage storage;
+        CHECK(storage.init(0, 3) == ESP_OK);
+        for (uint32_t n = 0; n < 20; ++n) {
+            WriteBatch batch;
+            for (size_t i = 0; i < 50; ++i) {
+                char name[Item::MAX_KEY_LENGTH + 1];
+                snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+                uint32_t value = n * 100 + static_cast<uint32_t>(i);
+                REQUIRE(batch.set(1, ItemType::U32, name, &value, sizeof(value)) == ESP_OK);
+            }
+            REQUIRE(storage.writeBatch(batch) == ESP_OK);
+        }
+    }
+    Storage storage;
+    CHECK(storage.init(0, 3) == ESP_OK);
+    for (size_t i = 0; i < 50; ++i) {
+        char name[Item::MAX_KEY_LENGTH + 1];
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        uint32_t value;
+        REQUIRE(storage.readItem(1, name, value) == ESP_OK);
+        CHECK(value == 1900 + i);
+    }
+}
+
+TEST_CASE("batch commit interrupted by power loss leaves all old or all new values", "[nvs][batch]")
+{
+    const size_t oldCount = 40;
+    const size_t newCount = 80;
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(4);
+        {
+            Storage storage;
+            REQUIRE(storage.init(0, 4) == ESP_OK);
+            for (size_t i = 0; i < oldCount; ++i) {
+                char name[Item::MAX_KEY_LENGTH + 1];
+                snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+                REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+            }
+            WriteBatch batch;
+            for (size_t i = 0; i < newCount; ++i) {
+                char name[Item::MAX_KEY_LENGTH + 1];
+                snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+                uint32_t value = static_cast<uint32_t>(i + 1000);
+                REQUIRE(batch.set(1, ItemType::U32, name, &value, sizeof(value)) == ESP_OK);
+            }
+            emu.failAfter(errDelay);
+            if (storage.writeBatch(batch) == ESP_OK) {
+                break;
+            }
+        }
+        Storage storage;
+        REQUIRE(storage.init(0, 4) == ESP_OK);
+        uint32_t first;
+        REQUIRE(storage.readItem(1, "key0", first) == ESP_OK);
+        const bool committed = first == 1000;
+        // separate buffer for each key, page lookup cache compares key pointers
+        char names[newCount][Item::MAX_KEY_LENGTH + 1];
+        for (size_t i = 0; i < newCount; ++i) {
+            snprintf(names[i], sizeof(names[i]), "key%d", static_cast<int>(i));
+            uint32_t value;
+            auto err = storage.readItem(1, names[i], value);
+            if (committed) {
+                REQUIRE(err == ESP_OK);
+                CHECK(value == i + 1000);
+            } else if (i < oldCount) {
+                REQUIRE(err == ESP_OK);
+                CHECK(value == i);
+            } else {
+                CHECK(err == ESP_ERR_NVS_NOT_FOUND);
+            }
+        }
+        CHECK(storage.writeItem(1, "key0", 1u) == ESP_OK);
+    }
+}
+
+TEST_CASE("batch which wasn't committed is rolled back when page is loaded", "[nvs][batch]")
+{
+    SpiFlashEmulator emu(1);
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    CHECK(page.writeItem(1, "key0", 1u) == ESP_OK);
+
+    WriteBatch batch;
+    const char str[] = "value 0123456789abcdef0123456789abcdef";
+    uint32_t value = 2;
+    CHECK(batch.set(1, ItemType::U32, "key0", &value, sizeof(value)) == ESP_OK);
+    CHECK(batch.set(1, ItemType::SZ, "key1", str, sizeof(str)) == ESP_OK);
+    const Item* run[2];
+    size_t entryCount = 0;
+    size_t count = 0;
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        run[count++] = it->entries();
+        entryCount += it->entryCount();
+    }
+    size_t markerIndex;
+    CHECK(page.beginBatch(entryCount, markerIndex) == ESP_OK);
+    CHECK(markerIndex == 1);
+    size_t written;
+    CHECK(page.writeItems(run, count, written) == ESP_OK);
+    CHECK(written == 2);
+
+    Page page2;
+    CHECK(page2.load(0) == ESP_OK);
+    CHECK(page2.getUsedEntryCount() == 1);
+    CHECK(page2.getErasedEntryCount() == entryCount + 1);
+    CHECK(page2.readItem(1, "key0", value) == ESP_OK);
+    CHECK(value == 1);
+    CHECK(page2.findItem(1, ItemType::SZ, "key1") == ESP_ERR_NVS_NOT_FOUND);
+
+    // the same happens if the batch is aborted
+    CHECK(page2.beginBatch(entryCount, markerIndex) == ESP_OK);
+    CHECK(page2.writeItems(run, count, written) == ESP_OK);
+    CHECK(page2.abortBatch(markerIndex) == ESP_OK);
+    CHECK(page2.getUsedEntryCount() == 1);
+    CHECK(page2.findItem(1, ItemType::SZ, "key1") == ESP_ERR_NVS_NOT_FOUND);
+
+    CHECK(page2.beginBatch(entryCount, markerIndex) == ESP_OK);
+    CHECK(page2.writeItems(run, count, written) == ESP_OK);
+    CHECK(page2.commitBatch(markerIndex) == ESP_OK);
+    Page page3;
+    CHECK(page3.load(0) == ESP_OK);
+    CHECK(page3.getUsedEntryCount() == entryCount + 1);
+    CHECK(page3.findItem(1, ItemType::SZ, "key1") == ESP_OK);
+}
+
+TEST_CASE("batch commit which doesn't fit into one page is rejected", "[nvs][batch]")
+{
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    CHECK(storage.writeItem(1, "key0", 1u) == ESP_OK);
+
+    WriteBatch batch;
+    for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+        char name[Item::MAX_KEY_LENGTH + 1];
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        uint32_t value = static_cast<uint32_t>(i + 1000);
+        REQUIRE(batch.set(1, ItemType::U32, name, &value, sizeof(value)) == ESP_OK);
+    }
+    CHECK(storage.writeBatch(batch) == ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    uint32_t value;
+    CHECK(storage.readItem(1, "key0", value) == ESP_OK);
+    CHECK(value == 1);
+    CHECK(storage.readItem(1, "key1", value) == ESP_ERR_NVS_NOT_FOUND);
+
+    // one entry is taken by the batch marker
+    batch.clear();
+    for (size_t i = 0; i < Page::ENTRY_COUNT - 1; ++i) {
+        char name[Item::MAX_KEY_LENGTH + 1];
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        uint32_t value = static_cast<uint32_t>(i + 1000);
+        REQUIRE(batch.set(1, ItemType::U32, name, &value, sizeof(value)) == ESP_OK);
+    }
+    CHECK(storage.writeBatch(batch) == ESP_OK);
+    CHECK(storage.readItem(1, "key124", value) == ESP_OK);
+    CHECK(value == 1124);
+}
+
+TEST_CASE("nvs api transaction handle stages values until commit", "[nvs][batch]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle_1, handle_2;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE_TRANSACTION, &handle_1));
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READONLY, &handle_2));
+
+    TEST_ESP_OK(nvs_set_i32(handle_1, "foo", 0x12345678));
+    TEST_ESP_OK(nvs_set_i32(handle_1, "foo", 0x23456789));
+    const char* str = "value 0123456789abcdef0123456789abcdef";
+    TEST_ESP_OK(nvs_set_str(handle_1, "key", str));
+
+    int32_t v;
+    TEST_ESP_OK(nvs_get_i32(handle_1, "foo", &v));
+    CHECK(v == 0x23456789);
+    TEST_ESP_ERR(nvs_get_i32(handle_2, "foo", &v), ESP_ERR_NVS_NOT_FOUND);
+
+    char buf[strlen(str) + 1];
+    size_t buf_len = sizeof(buf);
+    TEST_ESP_OK(nvs_get_str(handle_1, "key", buf, &buf_len));
+    CHECK(0 == strcmp(buf, str));
+
+    TEST_ESP_OK(nvs_commit(handle_1));
+    TEST_ESP_OK(nvs_get_i32(handle_2, "foo", &v));
+    CHECK(v == 0x23456789);
+    buf_len = sizeof(buf);
+    TEST_ESP_OK(nvs_get_str(handle_2, "key", buf, &buf_len));
+    CHECK(0 == strcmp(buf, str));
+
+    // changes which are not committed are lost when the handle is closed
+    TEST_ESP_OK(nvs_set_i32(handle_1, "foo", 1));
+    nvs_close(handle_1);
+    TEST_ESP_OK(nvs_get_i32(handle_2, "foo", &v));
+    CHECK(v == 0x23456789);
+    nvs_close(handle_2);
+}
+
+TEST_CASE("collectGarbage reclaims pages ahead of writes", "[nvs][gc]")
+{
+    const size_t keyCount = 60;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<size_t> keyDist(0, keyCount - 1);
+    uint32_t values[keyCount];
+    char names[keyCount][Item::MAX_KEY_LENGTH + 1];
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(names[i], sizeof(names[i]), "key%d", static_cast<int>(i));
+        values[i] = static_cast<uint32_t>(i);
+    }
+
+    SpiFlashEmulator emu(5);
+    {
+        Storage storage;
+        CHECK(storage.init(0, 5) == ESP_OK);
+        size_t stalledWrites = 0;
+        size_t gcSteps = 0;
+        for (size_t i = 0; i < keyCount; ++i) {
+            REQUIRE(storage.writeItem(1, names[i], values[i]) == ESP_OK);
+        }
+        for (uint32_t n = 0; n < 3000; ++n) {
+            size_t key = keyDist(gen);
+            values[key] = n;
+            auto eraseOps = emu.getEraseOps();
+            REQUIRE(storage.writeItem(1, names[key], values[key]) == ESP_OK);
+            if (emu.getEraseOps() != eraseOps) {
+                ++stalledWrites;
+            }
+            auto err = storage.collectGarbage(4, 32);
+            if (err == ESP_OK) {
+                ++gcSteps;
+            } else {
+                REQUIRE(err == ESP_ERR_NVS_NOT_FOUND);
+            }
+        }
+        CHECK(gcSteps > 0);
+        CHECK(stalledWrites == 0);
+        s_perf << "Background reclaim: " << gcSteps << " steps for 3000 writes, " << stalledWrites << " writes had to erase a page" << std::endl;
+    }
+    Storage storage;
+    CHECK(storage.init(0, 5) == ESP_OK);
+    for (size_t i = 0; i < keyCount; ++i) {
+        uint32_t value;
+        REQUIRE(storage.readItem(1, names[i], value) == ESP_OK);
+        CHECK(value == values[i]);
+    }
+}
+
+TEST_CASE("page being reclaimed in steps is finished after power loss", "[nvs][gc]")
+{
+    SpiFlashEmulator emu(4);
+    const size_t keyCount = 40;
+    char names[keyCount][Item::MAX_KEY_LENGTH + 1];
+    {
+        Storage storage;
+        CHECK(storage.init(0, 4) == ESP_OK);
+        for (size_t i = 0; i < keyCount; ++i) {
+            snprintf(names[i], sizeof(names[i]), "key%d", static_cast<int>(i));
+            REQUIRE(storage.writeItem(1, names[i], static_cast<uint32_t>(i)) == ESP_OK);
+        }
+        // fill two pages, leaving the first one mostly erased
+        for (size_t i = 0; i < Page::ENTRY_COUNT * 2; ++i) {
+            REQUIRE(storage.writeItem(1, names[i % 10], static_cast<uint32_t>(i % 10)) == ESP_OK);
+        }
+        REQUIRE(storage.collectGarbage(5, 32) == ESP_OK);
+    }
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    for (size_t i = 0; i < keyCount; ++i) {
+        uint32_t value;
+        REQUIRE(storage.readItem(1, names[i], value) == ESP_OK);
+        CHECK(value == i);
+    }
+}
+
+TEST_CASE("collectGarbage skips the active page when it has the most erased entries", "[nvs][gc]")
+{
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    // first page full, with 40 erased entries
+    const size_t distinctKeys = Page::ENTRY_COUNT - 40;
+    char name[Item::MAX_KEY_LENGTH + 1];
+    for (size_t i = 0; i < distinctKeys; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    for (size_t i = 0; i < 40; ++i) {
+        REQUIRE(storage.writeItem(1, "key0", static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    // the active page gets even more erased entries
+    for (size_t i = 0; i < 100; ++i) {
+        REQUIRE(storage.writeItem(1, "x", static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    Page first;
+    first.load(0);
+    REQUIRE(first.state() == Page::PageState::FULL);
+    REQUIRE(first.getErasedEntryCount() == 40);
+
+    auto eraseOps = emu.getEraseOps();
+    esp_err_t err;
+    while ((err = storage.collectGarbage(16, 32)) == ESP_OK && emu.getEraseOps() == eraseOps) {
+    }
+    CHECK(err == ESP_OK);
+    CHECK(emu.getEraseOps() == eraseOps + 1);
+    uint32_t value;
+    CHECK(storage.readItem(1, "key0", value) == ESP_OK);
+    CHECK(value == 39);
+    snprintf(name, sizeof(name), "key%d", static_cast<int>(distinctKeys - 1));
+    CHECK(storage.readItem(1, name, value) == ESP_OK);
+    CHECK(value == distinctKeys - 1);
+}
+
+TEST_CASE("page headers keep the number of times sectors were erased", "[nvs][wear]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(sectorCount);
+    char names[20][Item::MAX_KEY_LENGTH + 1];
+    for (size_t i = 0; i < 20; ++i) {
+        snprintf(names[i], sizeof(names[i]), "key%d", static_cast<int>(i));
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        Storage storage;
+        CHECK(storage.init(0, sectorCount) == ESP_OK);
+        for (uint32_t n = 0; n < 2000; ++n) {
+            REQUIRE(storage.writeItem(1, names[n % 20], n) == ESP_OK);
+        }
+    }
+    size_t pagesChecked = 0;
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        Page page;
+        CHECK(page.load(i) == ESP_OK);
+        if (page.state() == Page::PageState::ACTIVE || page.state() == Page::PageState::FULL) {
+            bool eraseCountKnown = page.getEraseCount() != Page::UNKNOWN_ERASE_COUNT;
+            CHECK(eraseCountKnown);
+            CHECK(page.getEraseCount() <= emu.getSectorEraseCount(i));
+            CHECK(page.getEraseCount() + 1 >= emu.getSectorEraseCount(i));
+            ++pagesChecked;
+        }
+    }
+    CHECK(pagesChecked > 0);
+}
+
+static void runWearTest(VictimPolicy policy, size_t& minErases, size_t& maxErases, size_t& totalErases)
+{
+    const size_t sectorCount = 8;
+    const size_t keyCount = 250;
+    const size_t hotCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    storage.setVictimPolicy(policy, 16);
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    char names[keyCount][Item::MAX_KEY_LENGTH + 1];
+    uint32_t values[keyCount];
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(names[i], sizeof(names[i]), "key%d", static_cast<int>(i));
+        values[i] = static_cast<uint32_t>(i);
+        REQUIRE(storage.writeItem(1, names[i], values[i]) == ESP_OK);
+    }
+    // most writes go to a few keys, the rest are changed once in a while
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<size_t> hotDist(0, hotCount - 1);
+    std::uniform_int_distribution<size_t> coldDist(hotCount, keyCount - 1);
+    for (uint32_t n = 0; n < 10000; ++n) {
+        size_t key = (n % 10 == 0) ? coldDist(gen) : hotDist(gen);
+        values[key] = n;
+        REQUIRE(storage.writeItem(1, names[key], values[key]) == ESP_OK);
+    }
+    minErases = SIZE_MAX;
+    maxErases = 0;
+    totalErases = emu.getEraseOps();
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        minErases = std::min(minErases, emu.getSectorEraseCount(i));
+        maxErases = std::max(maxErases, emu.getSectorEraseCount(i));
+    }
+    for (size_t i = 0; i < keyCount; ++i) {
+        uint32_t value;
+        REQUIRE(storage.readItem(1, names[i], value) == ESP_OK);
+        CHECK(value == values[i]);
+    }
+}
+
+TEST_CASE("wear levelling policy spreads erases over sectors", "[nvs][wear]")
+{
+    size_t greedyMin, greedyMax, greedyTotal;
+    runWearTest(VictimPolicy::GREEDY, greedyMin, greedyMax, greedyTotal);
+    size_t wearMin, wearMax, wearTotal;
+    runWearTest(VictimPolicy::WEAR_LEVELLING, wearMin, wearMax, wearTotal);
+    s_perf << "Sector erases, greedy: " << greedyMin << " to " << greedyMax << ", " << greedyTotal << " total" << std::endl;
+    s_perf << "Sector erases, wear levelling: " << wearMin << " to " << wearMax << ", " << wearTotal << " total" << std::endl;
+    CHECK(wearMax - wearMin < greedyMax - greedyMin);
+}
+
+TEST_CASE("mount reads page entries a few at a time", "[nvs][mount]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(sectorCount);
+    char name[Item::MAX_KEY_LENGTH + 1];
+    const size_t itemCount = Page::ENTRY_COUNT * 2 + 10;
+    {
+        Storage storage;
+        CHECK(storage.init(0, sectorCount) == ESP_OK);
+        for (size_t i = 0; i < itemCount; ++i) {
+            snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+            REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+        }
+    }
+    emu.clearStats();
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    s_perf << "Mount with " << itemCount << " items: " << emu.getReadOps() << " reads, " << emu.getReadBytes() << " bytes, " << emu.getTotalTime() << " us" << std::endl;
+    // on the host, Storage::init also reads each item once in debugCheck
+    CHECK(emu.getReadOps() < itemCount * 2);
+    for (size_t i = 0; i < itemCount; ++i) {
+        uint32_t value;
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.readItem(1, name, value) == ESP_OK);
+        CHECK(value == i);
+    }
+}
+
+static void fillBlob(uint8_t* data, size_t size, uint32_t seed)
+{
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(gen());
+    }
+}
+
+static esp_err_t writeBlobInParts(Storage& storage, const char* key, const uint8_t* data, size_t size)
+{
+    BlobStream stream;
+    auto err = storage.createBlob(1, key, size, stream);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // odd part sizes, so that parts start and end in the middle of entries
+    const size_t partSizes[] = {7, 33, 1, 64, 100, 19};
+    size_t offset = 0;
+    for (size_t i = 0; offset < size; ++i) {
+        size_t part = partSizes[i % (sizeof(partSizes) / sizeof(partSizes[0]))];
+        part = (size - offset < part) ? size - offset : part;
+        err = storage.writeBlob(stream, data + offset, part);
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += part;
+    }
+    return storage.closeBlob(stream);
+}
+
+TEST_CASE("blob can be written and read in parts", "[nvs][blob]")
+{
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    const size_t size = 2000;
+    uint8_t data[size];
+    fillBlob(data, size, 1);
+    CHECK(storage.writeItem(1, ItemType::BLOB, "cert", data, 100) == ESP_OK);
+    CHECK(writeBlobInParts(storage, "cert", data, size) == ESP_OK);
+
+    size_t dataSize;
+    CHECK(storage.getItemDataSize(1, ItemType::BLOB, "cert", dataSize) == ESP_OK);
+    CHECK(dataSize == size);
+    uint8_t readBack[size];
+    CHECK(storage.readItem(1, ItemType::BLOB, "cert", readBack, size) == ESP_OK);
+    CHECK(memcmp(data, readBack, size) == 0);
+
+    BlobStream stream;
+    CHECK(storage.openBlob(1, "cert", stream) == ESP_OK);
+    CHECK(stream.size() == size);
+    std::mt19937 gen(2);
+    for (int i = 0; i < 50; ++i) {
+        size_t offset = gen() % size;
+        size_t part = gen() % (size - offset + 1);
+        memset(readBack, 0, size);
+        REQUIRE(storage.readBlob(stream, offset, readBack, part) == ESP_OK);
+        CHECK(memcmp(data + offset, readBack, part) == 0);
+    }
+    CHECK(storage.readBlob(stream, size - 10, readBack, 11) == ESP_ERR_NVS_INVALID_LENGTH);
+
+    // values written in the meantime don't invalidate the stream
+    CHECK(storage.writeItem(1, "other", 1u) == ESP_OK);
+    for (size_t offset = 0; offset < size; offset += 300) {
+        size_t part = (size - offset < 300) ? size - offset : 300;
+        REQUIRE(storage.readBlob(stream, offset, readBack + offset, part) == ESP_OK);
+    }
+    CHECK(memcmp(data, readBack, size) == 0);
+    CHECK(storage.closeBlob(stream) == ESP_OK);
+
+    // but replacing the value does
+    CHECK(storage.openBlob(1, "cert", stream) == ESP_OK);
+    CHECK(storage.writeItem(1, ItemType::BLOB, "cert", data, 10) == ESP_OK);
+    CHECK(storage.readBlob(stream, 0, readBack, 10) == ESP_ERR_NVS_INVALID_STATE);
+    CHECK(storage.closeBlob(stream) == ESP_OK);
+}
+
+TEST_CASE("blob write in parts is aborted by other writes", "[nvs][blob]")
+{
+    SpiFlashEmulator emu(3);
+    Storage storage;
+    CHECK(storage.init(0, 3) == ESP_OK);
+    uint8_t data[500];
+    fillBlob(data, sizeof(data), 3);
+    CHECK(storage.writeItem(1, ItemType::BLOB, "blob", data, 50) == ESP_OK);
+
+    BlobStream stream;
+    CHECK(storage.createBlob(1, "blob", sizeof(data), stream) == ESP_OK);
+    CHECK(storage.writeBlob(stream, data, 200) == ESP_OK);
+    CHECK(storage.collectGarbage(4, 1) == ESP_ERR_NVS_INVALID_STATE);
+    CHECK(storage.writeItem(1, "key", 5u) == ESP_OK);
+    CHECK(storage.writeBlob(stream, data + 200, 300) == ESP_ERR_NVS_INVALID_STATE);
+    CHECK(storage.closeBlob(stream) == ESP_ERR_NVS_INVALID_STATE);
+
+    CHECK(storage.createBlob(1, "blob", sizeof(data), stream) == ESP_OK);
+    CHECK(storage.writeBlob(stream, data, 100) == ESP_OK);
+    CHECK(storage.writeBlob(stream, data, 401) == ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(storage.closeBlob(stream) == ESP_ERR_NVS_INVALID_LENGTH);
+
+    uint8_t readBack[50];
+    CHECK(storage.readItem(1, ItemType::BLOB, "blob", readBack, sizeof(readBack)) == ESP_OK);
+    CHECK(memcmp(data, readBack, sizeof(readBack)) == 0);
+
+    // discarded entries don't get in the way of later writes
+    for (uint32_t i = 0; i < 300; ++i) {
+        REQUIRE(storage.writeItem(1, "key", i) == ESP_OK);
+    }
+    Storage storage2;
+    CHECK(storage2.init(0, 3) == ESP_OK);
+    uint32_t value;
+    CHECK(storage2.readItem(1, "key", value) == ESP_OK);
+    CHECK(value == 299);
+}
+
+TEST_CASE("blob write in parts interrupted by power loss leaves old or new value", "[nvs][blob]")
+{
+    const size_t oldSize = 100;
+    const size_t newSize = 1000;
+    uint8_t data[newSize];
+    fillBlob(data, newSize, 4);
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(3);
+        {
+            Storage storage;
+            REQUIRE(storage.init(0, 3) == ESP_OK);
+            REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", data + 1, oldSize) == ESP_OK);
+            emu.failAfter(errDelay);
+            if (writeBlobInParts(storage, "blob", data, newSize) == ESP_OK) {
+                break;
+            }
+        }
+        Storage storage;
+        REQUIRE(storage.init(0, 3) == ESP_OK);
+        size_t dataSize;
+        REQUIRE(storage.getItemDataSize(1, ItemType::BLOB, "blob", dataSize) == ESP_OK);
+        uint8_t readBack[newSize];
+        REQUIRE(storage.readItem(1, ItemType::BLOB, "blob", readBack, dataSize) == ESP_OK);
+        if (dataSize == oldSize) {
+            CHECK(memcmp(data + 1, readBack, oldSize) == 0);
+        } else {
+            REQUIRE(dataSize == newSize);
+            CHECK(memcmp(data, readBack, newSize) == 0);
+        }
+        // entries left by the interrupted write can't be in the way
+        for (uint32_t i = 0; i < 200; ++i) {
+            REQUIRE(storage.writeItem(1, "key", i) == ESP_OK);
+        }
+    }
+}
+
+TEST_CASE("nvs api can read and write blobs in parts", "[nvs][blob]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle));
+    uint8_t data[1500];
+    fillBlob(data, sizeof(data), 5);
+    TEST_ESP_OK(nvs_blob_create(handle, "table", sizeof(data)));
+    TEST_ESP_ERR(nvs_blob_create(handle, "table", sizeof(data)), ESP_ERR_NVS_INVALID_STATE);
+    for (size_t offset = 0; offset < sizeof(data); offset += 250) {
+        TEST_ESP_OK(nvs_blob_write(handle, data + offset, 250));
+    }
+    TEST_ESP_ERR(nvs_blob_write(handle, data, 1), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_OK(nvs_blob_close(handle));
+    TEST_ESP_ERR(nvs_blob_close(handle), ESP_ERR_NVS_INVALID_STATE);
+
+    size_t size;
+    TEST_ESP_ERR(nvs_blob_open(handle, "nope", &size), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_blob_open(handle, "table", &size));
+    CHECK(size == sizeof(data));
+    uint8_t part[64];
+    for (size_t offset = 0; offset < size; offset += sizeof(part)) {
+        size_t count = (size - offset < sizeof(part)) ? size - offset : sizeof(part);
+        TEST_ESP_OK(nvs_blob_read(handle, offset, part, count));
+        CHECK(memcmp(data + offset, part, count) == 0);
+    }
+    TEST_ESP_OK(nvs_blob_close(handle));
+
+    nvs_handle handle_ro;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READONLY, &handle_ro));
+    TEST_ESP_ERR(nvs_blob_create(handle_ro, "table", 10), ESP_ERR_NVS_READ_ONLY);
+    nvs_close(handle_ro);
+    nvs_close(handle);
+}
+
+TEST_CASE("blob larger than a page is kept in chunks in multiple pages", "[nvs][blob]")
+{
+    const size_t sectorCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    const size_t size = Page::CHUNK_MAX_SIZE * 2 + 500;
+    uint8_t data[size];
+    uint8_t readBack[size];
+    fillBlob(data, size, 6);
+    CHECK(storage.writeItem(1, "before", 1u) == ESP_OK);
+    CHECK(storage.writeItem(1, ItemType::BLOB, "model", data, size) == ESP_OK);
+    CHECK(storage.writeItem(1, "after", 2u) == ESP_OK);
+
+    size_t dataSize;
+    CHECK(storage.getItemDataSize(1, ItemType::BLOB, "model", dataSize) == ESP_OK);
+    CHECK(dataSize == size);
+    CHECK(storage.readItem(1, ItemType::BLOB, "model", readBack, size - 1) == ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(storage.readItem(1, ItemType::BLOB, "model", readBack, size) == ESP_OK);
+    CHECK(memcmp(data, readBack, size) == 0);
+
+    // switch between multi-page and single page values
+    size_t lastSize = size;
+    for (int i = 0; i < 20; ++i) {
+        INFO(i);
+        lastSize = (i % 3 == 2) ? 300 : size - i * 100;
+        fillBlob(data, lastSize, 7 + i);
+        REQUIRE(storage.writeItem(1, ItemType::BLOB, "model", data, lastSize) == ESP_OK);
+        REQUIRE(storage.getItemDataSize(1, ItemType::BLOB, "model", dataSize) == ESP_OK);
+        REQUIRE(dataSize == lastSize);
+        REQUIRE(storage.readItem(1, ItemType::BLOB, "model", readBack, size) == ESP_OK);
+        CHECK(memcmp(data, readBack, lastSize) == 0);
+    }
+
+    Storage storage2;
+    CHECK(storage2.init(0, sectorCount) == ESP_OK);
+    CHECK(storage2.readItem(1, ItemType::BLOB, "model", readBack, size) == ESP_OK);
+    CHECK(memcmp(data, readBack, lastSize) == 0);
+    uint32_t value;
+    CHECK(storage2.readItem(1, "before", value) == ESP_OK);
+    CHECK(value == 1);
+    CHECK(storage2.eraseItem(1, ItemType::BLOB, "model") == ESP_OK);
+    CHECK(storage2.readItem(1, ItemType::BLOB, "model", readBack, size) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(storage2.getItemDataSize(1, ItemType::BLOB, "model", dataSize) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(storage2.eraseItem(1, ItemType::BLOB, "model") == ESP_ERR_NVS_NOT_FOUND);
+
+    // more than fits into the storage
+    std::vector<uint8_t> huge(Page::CHUNK_MAX_SIZE * sectorCount);
+    CHECK(storage2.writeItem(1, ItemType::BLOB, "huge", huge.data(), huge.size()) == ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    CHECK(storage2.writeItem(1, ItemType::BLOB, "model", data, size) == ESP_OK);
+}
+
+TEST_CASE("multi-page blob can be written and read in parts", "[nvs][blob]")
+{
+    const size_t sectorCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    const size_t size = Page::CHUNK_MAX_SIZE * 3 + 123;
+    uint8_t data[size];
+    uint32_t readBack[(size + 3) / 4];
+    uint8_t* readBytes = reinterpret_cast<uint8_t*>(readBack);
+    fillBlob(data, size, 8);
+    CHECK(storage.writeItem(1, "other", 1u) == ESP_OK);
+    CHECK(writeBlobInParts(storage, "model", data, size) == ESP_OK);
+    CHECK(storage.readItem(1, ItemType::BLOB, "model", readBack, size) == ESP_OK);
+    CHECK(memcmp(data, readBack, size) == 0);
+
+    BlobStream stream;
+    CHECK(storage.openBlob(1, "model", stream) == ESP_OK);
+    CHECK(stream.size() == size);
+    emu.clearStats();
+    memset(readBack, 0, size);
+    CHECK(storage.readBlob(stream, 0, readBack, size) == ESP_OK);
+    CHECK(memcmp(data, readBack, size) == 0);
+    // locations of the chunks are known, each is read with one or two reads
+    CHECK(emu.getReadOps() <= 2 * (size / Page::CHUNK_MAX_SIZE + 2));
+
+    std::mt19937 gen(9);
+    for (int i = 0; i < 50; ++i) {
+        size_t offset = gen() % size;
+        size_t part = gen() % (size - offset + 1);
+        memset(readBack, 0, size);
+        REQUIRE(storage.readBlob(stream, offset, readBytes, part) == ESP_OK);
+        CHECK(memcmp(data + offset, readBytes, part) == 0);
+    }
+
+    // chunks moved by other writes are found again
+    for (uint32_t i = 0; i < 500; ++i) {
+        REQUIRE(storage.writeItem(1, "other", i) == ESP_OK);
+    }
+    memset(readBack, 0, size);
+    for (size_t offset = 0; offset < size; offset += 1000) {
+        size_t part = (size - offset < 1000) ? size - offset : 1000;
+        REQUIRE(storage.readBlob(stream, offset, readBytes + offset, part) == ESP_OK);
+    }
+    CHECK(memcmp(data, readBack, size) == 0);
+    CHECK(storage.closeBlob(stream) == ESP_OK);
+
+    // writing a multi-page blob in parts is aborted like any other
+    CHECK(storage.createBlob(1, "model", size, stream) == ESP_OK);
+    CHECK(storage.writeBlob(stream, data + 1, Page::CHUNK_MAX_SIZE + 10) == ESP_OK);
+    CHECK(storage.writeItem(1, "other", 1u) == ESP_OK);
+    CHECK(storage.closeBlob(stream) == ESP_ERR_NVS_INVALID_STATE);
+
+    Storage storage2;
+    CHECK(storage2.init(0, sectorCount) == ESP_OK);
+    CHECK(storage2.readItem(1, ItemType::BLOB, "model", readBack, size) == ESP_OK);
+    CHECK(memcmp(data, readBack, size) == 0);
+}
+
+TEST_CASE("multi-page blob write interrupted by power loss leaves old or new value", "[nvs][blob]")
+{
+    const size_t sectorCount = 7;
+    const size_t newSize = Page::CHUNK_MAX_SIZE * 2 + 100;
+    const size_t oldSizes[] = {300, Page::CHUNK_MAX_SIZE + 700};
+    uint8_t data[newSize];
+    uint8_t readBack[newSize];
+    fillBlob(data, newSize, 10);
+    for (size_t oldSize : oldSizes) {
+        for (uint32_t errDelay = 0; ; errDelay += 3) {
+            INFO(oldSize << " " << errDelay);
+            SpiFlashEmulator emu(sectorCount);
+            {
+                Storage storage;
+                REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+                REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", data + 1, oldSize) == ESP_OK);
+                emu.failAfter(errDelay);
+                if (storage.writeItem(1, ItemType::BLOB, "blob", data, newSize) == ESP_OK) {
+                    break;
+                }
+            }
+            Storage storage;
+            REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+            size_t dataSize;
+            REQUIRE(storage.getItemDataSize(1, ItemType::BLOB, "blob", dataSize) == ESP_OK);
+            REQUIRE(storage.readItem(1, ItemType::BLOB, "blob", readBack, dataSize) == ESP_OK);
+            if (dataSize == oldSize) {
+                CHECK(memcmp(data + 1, readBack, oldSize) == 0);
+            } else {
+                REQUIRE(dataSize == newSize);
+                CHECK(memcmp(data, readBack, newSize) == 0);
+            }
+            // chunks left by the interrupted write don't take up space
+            for (int i = 0; i < 3; ++i) {
+                REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", data, newSize) == ESP_OK);
+            }
+        }
+    }
+}
+
+TEST_CASE("array elements can be replaced without rewriting the whole array", "[nvs][array]")
+{
+    const size_t sectorCount = 6;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    uint16_t table[100];
+    uint16_t readBack[100];
+    for (size_t i = 0; i < 100; ++i) {
+        table[i] = static_cast<uint16_t>(i * 7);
+    }
+    CHECK(storage.writeItem(1, "before", 1u) == ESP_OK);
+    CHECK(storage.writeArray(1, ItemType::U16, "table", table, 100) == ESP_OK);
+    CHECK(storage.writeItem(1, "after", 2u) == ESP_OK);
+
+    size_t count;
+    CHECK(storage.getArrayCount(1, ItemType::U16, "table", count) == ESP_OK);
+    CHECK(count == 100);
+    CHECK(storage.readArray(1, ItemType::U16, "table", 0, readBack, 100) == ESP_OK);
+    CHECK(memcmp(table, readBack, sizeof(table)) == 0);
+    CHECK(storage.readArray(1, ItemType::U32, "table", 0, readBack, 1) == ESP_ERR_NVS_TYPE_MISMATCH);
+    CHECK(storage.readArray(1, ItemType::U16, "table", 99, readBack, 2) == ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(storage.readItem(1, ItemType::BLOB, "table", readBack, sizeof(readBack)) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(storage.writeArray(1, ItemType::BLOB, "other", table, 1) == ESP_ERR_NVS_TYPE_MISMATCH);
+
+    // one element only rewrites the segment which holds it
+    uint16_t value = 1234;
+    emu.clearStats();
+    CHECK(storage.writeArrayRange(1, ItemType::U16, "table", 42, &value, 1) == ESP_OK);
+    CHECK(emu.getWriteBytes() < 3 * Page::ENTRY_SIZE);
+    table[42] = value;
+    // unchanged elements aren't written at all
+    emu.clearStats();
+    CHECK(storage.writeArrayRange(1, ItemType::U16, "table", 40, table + 40, 5) == ESP_OK);
+    CHECK(emu.getWriteOps() == 0);
+
+    std::mt19937 gen(11);
+    for (int i = 0; i < 300; ++i) {
+        size_t first = gen() % 100;
+        size_t part = 1 + gen() % (100 - first);
+        for (size_t j = first; j < first + part; ++j) {
+            table[j] = static_cast<uint16_t>(gen());
+        }
+        REQUIRE(storage.writeArrayRange(1, ItemType::U16, "table", first, table + first, part) == ESP_OK);
+        REQUIRE(storage.readArray(1, ItemType::U16, "table", first, readBack, part) == ESP_OK);
+        CHECK(memcmp(table + first, readBack, part * sizeof(uint16_t)) == 0);
+    }
+
+    Storage storage2;
+    CHECK(storage2.init(0, sectorCount) == ESP_OK);
+    CHECK(storage2.readArray(1, ItemType::U16, "table", 0, readBack, 100) == ESP_OK);
+    CHECK(memcmp(table, readBack, sizeof(table)) == 0);
+    uint32_t before;
+    CHECK(storage2.readItem(1, "before", before) == ESP_OK);
+    CHECK(before == 1);
+
+    // a shorter array replaces the old one with all of its segments
+    CHECK(storage2.writeArray(1, ItemType::U16, "table", table + 1, 10) == ESP_OK);
+    CHECK(storage2.getArrayCount(1, ItemType::U16, "table", count) == ESP_OK);
+    CHECK(count == 10);
+    CHECK(storage2.readArray(1, ItemType::U16, "table", 0, readBack, 10) == ESP_OK);
+    CHECK(memcmp(table + 1, readBack, 10 * sizeof(uint16_t)) == 0);
+    CHECK(storage2.eraseItem(1, ItemType::ARRAY_IDX, "table") == ESP_OK);
+    CHECK(storage2.getArrayCount(1, ItemType::U16, "table", count) == ESP_ERR_NVS_NOT_FOUND);
+
+    // largest array
+    std::vector<uint8_t> bytes(8193);
+    CHECK(storage2.writeArray(1, ItemType::U8, "bytes", bytes.data(), bytes.size()) == ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(storage2.writeArray(1, ItemType::U8, "bytes", bytes.data(), bytes.size() - 1) == ESP_OK);
+}
+
+TEST_CASE("array update interrupted by power loss leaves old or new elements", "[nvs][array]")
+{
+    const size_t sectorCount = 4;
+    uint32_t oldValues[40];
+    uint32_t newValues[40];
+    uint32_t readBack[40];
+    for (size_t i = 0; i < 40; ++i) {
+        oldValues[i] = i;
+        newValues[i] = 1000 + i;
+    }
+    for (int whole = 0; whole < 2; ++whole) {
+        for (uint32_t errDelay = 0; ; ++errDelay) {
+            INFO(whole << " " << errDelay);
+            SpiFlashEmulator emu(sectorCount);
+            {
+                Storage storage;
+                REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+                REQUIRE(storage.writeArray(1, ItemType::U32, "arr", oldValues, 40) == ESP_OK);
+                for (uint32_t i = 0; i < 50; ++i) {
+                    REQUIRE(storage.writeItem(1, "other", i) == ESP_OK);
+                }
+                emu.failAfter(errDelay);
+                esp_err_t err = (whole) ?
+                                storage.writeArray(1, ItemType::U32, "arr", newValues, 40) :
+                                storage.writeArrayRange(1, ItemType::U32, "arr", 5, newValues + 5, 30);
+                if (err == ESP_OK) {
+                    break;
+                }
+            }
+            Storage storage;
+            REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+            REQUIRE(storage.readArray(1, ItemType::U32, "arr", 0, readBack, 40) == ESP_OK);
+            // each segment of 8 elements holds either the old or the new ones
+            for (size_t i = 0; i < 40; i += 8) {
+                bool isOld = memcmp(oldValues + i, readBack + i, 8 * sizeof(uint32_t)) == 0;
+                if (whole) {
+                    isOld = memcmp(oldValues, readBack, sizeof(readBack)) == 0;
+                    CHECK((isOld || memcmp(newValues, readBack, sizeof(readBack)) == 0));
+                    break;
+                }
+                if (!isOld) {
+                    for (size_t j = i; j < i + 8; ++j) {
+                        CHECK(readBack[j] == ((j >= 5 && j < 35) ? newValues[j] : oldValues[j]));
+                    }
+                }
+            }
+            // segments left by the interrupted write don't take up space
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(storage.writeArray(1, ItemType::U32, "arr", newValues, 40) == ESP_OK);
+                REQUIRE(storage.writeArrayRange(1, ItemType::U32, "arr", 0, oldValues, 40) == ESP_OK);
+            }
+        }
+    }
+}
+
+TEST_CASE("nvs api can read and write arrays", "[nvs][array]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle));
+    int16_t table[64];
+    for (size_t i = 0; i < 64; ++i) {
+        table[i] = static_cast<int16_t>(100 - i * 3);
+    }
+    TEST_ESP_ERR(nvs_set_array(handle, "calib", NVS_TYPE_STR, table, 64), ESP_ERR_NVS_TYPE_MISMATCH);
+    TEST_ESP_ERR(nvs_set_array(handle, "calib", NVS_TYPE_I16, table, 0), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_OK(nvs_set_array(handle, "calib", NVS_TYPE_I16, table, 64));
+    int16_t value = -5;
+    TEST_ESP_OK(nvs_set_array_range(handle, "calib", NVS_TYPE_I16, 17, &value, 1));
+    table[17] = value;
+    TEST_ESP_ERR(nvs_set_array_range(handle, "calib", NVS_TYPE_I16, 64, &value, 1), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_ERR(nvs_set_array_range(handle, "calib", NVS_TYPE_U16, 17, &value, 1), ESP_ERR_NVS_TYPE_MISMATCH);
+
+    size_t count;
+    TEST_ESP_OK(nvs_get_array(handle, "calib", NVS_TYPE_I16, NULL, &count));
+    CHECK(count == 64);
+    int16_t readBack[64];
+    count = 63;
+    TEST_ESP_ERR(nvs_get_array(handle, "calib", NVS_TYPE_I16, readBack, &count), ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(count == 64);
+    TEST_ESP_OK(nvs_get_array(handle, "calib", NVS_TYPE_I16, readBack, &count));
+    CHECK(memcmp(table, readBack, sizeof(table)) == 0);
+    TEST_ESP_OK(nvs_get_array_range(handle, "calib", NVS_TYPE_I16, 16, readBack, 2));
+    CHECK(readBack[0] == table[16]);
+    CHECK(readBack[1] == -5);
+    TEST_ESP_ERR(nvs_get_array(handle, "nope", NVS_TYPE_I16, NULL, &count), ESP_ERR_NVS_NOT_FOUND);
+
+    nvs_handle handle_ro;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READONLY, &handle_ro));
+    TEST_ESP_ERR(nvs_set_array_range(handle_ro, "calib", NVS_TYPE_I16, 17, &value, 1), ESP_ERR_NVS_READ_ONLY);
+    TEST_ESP_OK(nvs_get_array_range(handle_ro, "calib", NVS_TYPE_I16, 17, readBack, 1));
+    CHECK(readBack[0] == -5);
+    nvs_close(handle_ro);
+
+    nvs_handle handle_tx;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE_TRANSACTION, &handle_tx));
+    TEST_ESP_ERR(nvs_set_array(handle_tx, "calib", NVS_TYPE_I16, table, 64), ESP_ERR_NVS_INVALID_STATE);
+    nvs_close(handle_tx);
+    nvs_close(handle);
+}
+
+TEST_CASE("counter increments clear bits instead of writing new entries", "[nvs][counter]")
+{
+    const size_t sectorCount = 3;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    uint32_t value;
+    CHECK(storage.readCounter(1, "boots", value) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(storage.incrementCounter(1, "boots", value) == ESP_OK);
+    CHECK(value == 1);
+    CHECK(storage.writeItem(1, "other", 5u) == ESP_OK);
+
+    const size_t capacity = Page::COUNTER_BITMAP_ENTRIES * Page::ENTRY_SIZE * 8;
+    emu.clearStats();
+    for (uint32_t i = 2; i <= capacity; ++i) {
+        REQUIRE(storage.incrementCounter(1, "boots", value) == ESP_OK);
+        REQUIRE(value == i);
+    }
+    // one word written per increment, and no erase
+    CHECK(emu.getWriteOps() == capacity - 1);
+    CHECK(emu.getWriteBytes() == 4 * (capacity - 1));
+    CHECK(emu.getEraseOps() == 0);
+
+    // the bitmap is used up, a new item is written
+    nvs_stats_t stats;
+    storage.getStats(stats);
+    const size_t usedBefore = stats.used_entries;
+    CHECK(storage.incrementCounter(1, "boots", value) == ESP_OK);
+    CHECK(value == capacity + 1);
+    storage.getStats(stats);
+    CHECK(stats.used_entries == usedBefore);
+    CHECK(storage.readCounter(1, "boots", value) == ESP_OK);
+    CHECK(value == capacity + 1);
+
+    // many more increments than flash has entries for nvs_set_u32
+    for (uint32_t i = 0; i < 20000; ++i) {
+        REQUIRE(storage.incrementCounter(1, "boots", value) == ESP_OK);
+    }
+    CHECK(value == capacity + 20001);
+
+    Storage storage2;
+    CHECK(storage2.init(0, sectorCount) == ESP_OK);
+    CHECK(storage2.readCounter(1, "boots", value) == ESP_OK);
+    CHECK(value == capacity + 20001);
+    CHECK(storage2.writeCounter(1, "boots", 0xfffffffe) == ESP_OK);
+    CHECK(storage2.incrementCounter(1, "boots", value) == ESP_OK);
+    CHECK(value == 0xffffffff);
+    CHECK(storage2.incrementCounter(1, "boots", value) == ESP_OK);
+    CHECK(value == 0);
+    uint32_t other;
+    CHECK(storage2.readItem(1, "other", other) == ESP_OK);
+    CHECK(other == 5);
+    CHECK(storage2.eraseItem(1, ItemType::COUNTER, "boots") == ESP_OK);
+    CHECK(storage2.readCounter(1, "boots", value) == ESP_ERR_NVS_NOT_FOUND);
+}
+
+TEST_CASE("counter increment interrupted by power loss counts or not", "[nvs][counter]")
+{
+    const size_t sectorCount = 3;
+    const size_t capacity = Page::COUNTER_BITMAP_ENTRIES * Page::ENTRY_SIZE * 8;
+    // interrupt increments which clear a bit, and ones which write a new item
+    const uint32_t starts[] = {10, static_cast<uint32_t>(capacity - 1), static_cast<uint32_t>(capacity)};
+    for (uint32_t start : starts) {
+        for (uint32_t errDelay = 0; ; ++errDelay) {
+            INFO(start << " " << errDelay);
+            SpiFlashEmulator emu(sectorCount);
+            uint32_t value;
+            {
+                Storage storage;
+                REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+                REQUIRE(storage.incrementCounter(1, "cnt", value) == ESP_OK);
+                for (uint32_t i = 1; i < start; ++i) {
+                    REQUIRE(storage.incrementCounter(1, "cnt", value) == ESP_OK);
+                }
+                REQUIRE(value == start);
+                emu.failAfter(errDelay);
+                if (storage.incrementCounter(1, "cnt", value) == ESP_OK) {
+                    break;
+                }
+            }
+            Storage storage;
+            REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+            REQUIRE(storage.readCounter(1, "cnt", value) == ESP_OK);
+            CHECK((value == start || value == start + 1));
+            REQUIRE(storage.incrementCounter(1, "cnt", value) == ESP_OK);
+        }
+    }
+}
+
+TEST_CASE("nvs api can increment counters", "[nvs][counter]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle));
+    uint32_t value;
+    TEST_ESP_ERR(nvs_get_counter(handle, "events", &value), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_increment_counter(handle, "events", NULL));
+    TEST_ESP_OK(nvs_increment_counter(handle, "events", &value));
+    CHECK(value == 2);
+    TEST_ESP_OK(nvs_set_counter(handle, "events", 100));
+    TEST_ESP_OK(nvs_increment_counter(handle, "events", &value));
+    CHECK(value == 101);
+    TEST_ESP_OK(nvs_get_counter(handle, "events", &value));
+    CHECK(value == 101);
+
+    nvs_handle handle_ro;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READONLY, &handle_ro));
+    TEST_ESP_ERR(nvs_increment_counter(handle_ro, "events", &value), ESP_ERR_NVS_READ_ONLY);
+    TEST_ESP_OK(nvs_get_counter(handle_ro, "events", &value));
+    CHECK(value == 101);
+    nvs_close(handle_ro);
+
+    nvs_handle handle_tx;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE_TRANSACTION, &handle_tx));
+    TEST_ESP_ERR(nvs_increment_counter(handle_tx, "events", &value), ESP_ERR_NVS_INVALID_STATE);
+    nvs_close(handle_tx);
+    nvs_close(handle);
+}
+
+TEST_CASE("iterator visits each entry of a namespace once", "[nvs][iterator]")
+{
+    const size_t sectorCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    char name[Item::MAX_KEY_LENGTH + 1];
+    const size_t itemCount = Page::ENTRY_COUNT + 20;
+    for (size_t i = 0; i < itemCount; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+        REQUIRE(storage.writeItem(2, name, static_cast<uint8_t>(i)) == ESP_OK);
+    }
+    CHECK(storage.writeItem(1, ItemType::SZ, "str", "value", 6) == ESP_OK);
+    const size_t size = Page::CHUNK_MAX_SIZE + 500;
+    uint8_t data[size];
+    fillBlob(data, size, 7);
+    CHECK(storage.writeItem(1, ItemType::BLOB, "model", data, size) == ESP_OK);
+    CHECK(storage.writeItem(1, ItemType::BLOB, "small", data, 100) == ESP_OK);
+
+    emu.clearStats();
+    std::set<std::string> keys;
+    EntryIterator it;
+    esp_err_t err = storage.findEntry(1, ItemType::ANY, it);
+    while (err == ESP_OK) {
+        CHECK(it.nsIndex() == 1);
+        CHECK(keys.insert(it.key()).second);
+        if (strcmp(it.key(), "model") == 0) {
+            CHECK(it.datatype() == ItemType::BLOB);
+        }
+        err = storage.nextEntry(it);
+    }
+    CHECK(err == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(keys.size() == itemCount + 3);
+    s_perf << "Reads to enumerate " << keys.size() << " entries: " << emu.getReadOps() << std::endl;
+    // each step reads the entries following the previous item, about once
+    CHECK(emu.getReadOps() <= keys.size() + sectorCount);
+    CHECK(storage.nextEntry(it) == ESP_ERR_NVS_NOT_FOUND);
+
+    keys.clear();
+    err = storage.findEntry(1, ItemType::BLOB, it);
+    while (err == ESP_OK) {
+        CHECK(it.datatype() == ItemType::BLOB);
+        keys.insert(it.key());
+        err = storage.nextEntry(it);
+    }
+    CHECK(keys == std::set<std::string>({"model", "small"}));
+
+    size_t count = 0;
+    err = storage.findEntry(Page::NS_ANY, ItemType::ANY, it);
+    while (err == ESP_OK) {
+        ++count;
+        err = storage.nextEntry(it);
+    }
+    CHECK(count == 2 * itemCount + 3);
+
+    CHECK(storage.findEntry(3, ItemType::ANY, it) == ESP_ERR_NVS_NOT_FOUND);
+}
+
+TEST_CASE("iterator continues after storage is modified", "[nvs][iterator]")
+{
+    const size_t sectorCount = 3;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    char name[Item::MAX_KEY_LENGTH + 1];
+    const size_t itemCount = 40;
+    for (size_t i = 0; i < itemCount; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    // rewriting another key forces pages holding the listed keys to be reclaimed
+    std::set<std::string> keys;
+    EntryIterator it;
+    esp_err_t err = storage.findEntry(1, ItemType::ANY, it);
+    size_t steps = 0;
+    while (err == ESP_OK) {
+        keys.insert(it.key());
+        for (uint32_t i = 0; i < 10; ++i) {
+            REQUIRE(storage.writeItem(2, "counter", i) == ESP_OK);
+        }
+        err = storage.nextEntry(it);
+        REQUIRE(++steps < itemCount * 2);
+    }
+    CHECK(err == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(keys.size() == itemCount);
+}
+
+TEST_CASE("nvs api can enumerate entries", "[nvs][iterator]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle_1, handle_2;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle_1));
+    TEST_ESP_OK(nvs_open("namespace2", NVS_READWRITE, &handle_2));
+    TEST_ESP_OK(nvs_set_i32(handle_1, "foo", 0x12345678));
+    TEST_ESP_OK(nvs_set_str(handle_1, "name", "value"));
+    TEST_ESP_OK(nvs_set_u8(handle_2, "foo", 1));
+    TEST_ESP_OK(nvs_set_blob(handle_2, "blob", "data", 4));
+
+    nvs_iterator_t it;
+    nvs_entry_info_t info;
+    TEST_ESP_OK(nvs_entry_find("namespace1", NVS_TYPE_STR, &it));
+    TEST_ESP_OK(nvs_entry_info(it, &info));
+    CHECK(std::string(info.namespace_name) == "namespace1");
+    CHECK(std::string(info.key) == "name");
+    CHECK(info.type == NVS_TYPE_STR);
+    TEST_ESP_ERR(nvs_entry_next(&it), ESP_ERR_NVS_NOT_FOUND);
+    CHECK(it == nullptr);
+    TEST_ESP_ERR(nvs_entry_next(&it), ESP_ERR_NVS_INVALID_HANDLE);
+
+    std::set<std::string> entries;
+    esp_err_t err = nvs_entry_find(NULL, NVS_TYPE_ANY, &it);
+    while (err == ESP_OK) {
+        TEST_ESP_OK(nvs_entry_info(it, &info));
+        entries.insert(std::string(info.namespace_name) + ":" + info.key + ":" + std::to_string(info.type));
+        err = nvs_entry_next(&it);
+    }
+    TEST_ESP_ERR(err, ESP_ERR_NVS_NOT_FOUND);
+    CHECK(entries == std::set<std::string>({"namespace1:foo:20", "namespace1:name:33", "namespace2:foo:1", "namespace2:blob:65"}));
+
+    TEST_ESP_OK(nvs_entry_find("namespace2", NVS_TYPE_ANY, &it));
+    nvs_release_iterator(it);
+    TEST_ESP_ERR(nvs_entry_find("namespace3", NVS_TYPE_ANY, &it), ESP_ERR_NVS_NOT_FOUND);
+    CHECK(it == nullptr);
+    TEST_ESP_ERR(nvs_entry_find("namespace1", NVS_TYPE_BLOB, &it), ESP_ERR_NVS_NOT_FOUND);
+
+    nvs_close(handle_1);
+    nvs_close(handle_2);
+}
+
+struct HandleTableTestObject
+{
+    HandleTableTestObject(int& liveCount) : mLiveCount(liveCount)
+    {
+        ++mLiveCount;
+    }
+
+    ~HandleTableTestObject()
+    {
+        --mLiveCount;
+    }
+
+    int& mLiveCount;
+};
+
+TEST_CASE("HandleTable finds objects by handle and reuses slots", "[nvs][handles]")
+{
+    int liveCount = 0;
+    uint32_t handles[20];
+    {
+        HandleTable<HandleTableTestObject> table;
+        CHECK(table.find(0) == nullptr);
+        HandleTableTestObject* objects[20];
+        for (size_t i = 0; i < 20; ++i) {
+            objects[i] = new HandleTableTestObject(liveCount);
+            REQUIRE(table.add(objects[i], handles[i]) == ESP_OK);
+            CHECK(handles[i] != 0);
+        }
+        CHECK(table.size() == 20);
+        for (size_t i = 0; i < 20; ++i) {
+            CHECK(table.find(handles[i]) == objects[i]);
+        }
+
+        CHECK(table.remove(handles[3]));
+        CHECK(liveCount == 19);
+        CHECK(table.find(handles[3]) == nullptr);
+        CHECK_FALSE(table.remove(handles[3]));
+
+        // the slot is reused, but the old handle stays invalid
+        uint32_t handle;
+        auto object = new HandleTableTestObject(liveCount);
+        REQUIRE(table.add(object, handle) == ESP_OK);
+        CHECK((handle & 0xffff) == (handles[3] & 0xffff));
+        CHECK(handle != handles[3]);
+        CHECK(table.find(handles[3]) == nullptr);
+        CHECK(table.find(handle) == object);
+
+        for (size_t i = 0; i < 1000; ++i) {
+            REQUIRE(table.remove(handle));
+            REQUIRE(table.add(new HandleTableTestObject(liveCount), handle) == ESP_OK);
+        }
+        CHECK(table.size() == 20);
+        CHECK(liveCount == 20);
+
+        table.clear();
+        CHECK(liveCount == 0);
+        CHECK(table.size() == 0);
+        CHECK(table.find(handles[0]) == nullptr);
+        REQUIRE(table.add(new HandleTableTestObject(liveCount), handle) == ESP_OK);
+    }
+    CHECK(liveCount == 0);
+}
+
+TEST_CASE("nvs api handles are invalid once closed", "[nvs][handles]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handles[40];
+    for (size_t i = 0; i < 40; ++i) {
+        TEST_ESP_OK(nvs_open("namespace1", (i % 2) ? NVS_READWRITE : NVS_READWRITE_TRANSACTION, &handles[i]));
+    }
+    TEST_ESP_OK(nvs_set_u32(handles[1], "counter", 1));
+    TEST_ESP_OK(nvs_set_u32(handles[2], "staged", 1));
+    TEST_ESP_OK(nvs_blob_create(handles[3], "blob", 100));
+    for (size_t i = 0; i < 40; i += 2) {
+        nvs_close(handles[i]);
+    }
+    uint32_t value;
+    TEST_ESP_ERR(nvs_get_u32(handles[2], "counter", &value), ESP_ERR_NVS_INVALID_HANDLE);
+    TEST_ESP_OK(nvs_get_u32(handles[3], "counter", &value));
+    CHECK(value == 1);
+
+    // closing and opening handles again doesn't give back the closed ones
+    for (size_t i = 0; i < 1000; ++i) {
+        nvs_handle handle;
+        TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle));
+        for (size_t j = 0; j < 40; j += 2) {
+            REQUIRE(handle != handles[j]);
+        }
+        TEST_ESP_OK(nvs_set_u32(handle, "counter", i));
+        nvs_close(handle);
+        TEST_ESP_ERR(nvs_set_u32(handle, "counter", i), ESP_ERR_NVS_INVALID_HANDLE);
+    }
+    nvs_close(handles[0]);
+    for (size_t i = 1; i < 40; i += 2) {
+        nvs_close(handles[i]);
+    }
+    TEST_ESP_ERR(nvs_commit(handles[1]), ESP_ERR_NVS_INVALID_HANDLE);
+}
+
+TEST_CASE("nvs api keeps partitions apart", "[nvs][partition]")
+{
+    SpiFlashEmulator emu(10);
+    emu.setBounds(2, 8);
+    TEST_ESP_OK(nvs_flash_init(2, 3));
+    TEST_ESP_OK(nvs_flash_init_custom("calib", 5, 3));
+
+    nvs_handle def, calib;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &def));
+    TEST_ESP_OK(nvs_open_from_partition("calib", "namespace1", NVS_READWRITE, &calib));
+    CHECK(def != calib);
+    TEST_ESP_OK(nvs_set_u32(def, "value", 1));
+    TEST_ESP_OK(nvs_set_u32(calib, "value", 2));
+    TEST_ESP_OK(nvs_set_u8(calib, "only", 3));
+    uint32_t value;
+    TEST_ESP_OK(nvs_get_u32(def, "value", &value));
+    CHECK(value == 1);
+    TEST_ESP_OK(nvs_get_u32(calib, "value", &value));
+    CHECK(value == 2);
+    uint8_t u8;
+    TEST_ESP_ERR(nvs_get_u8(def, "only", &u8), ESP_ERR_NVS_NOT_FOUND);
+
+    // loading one partition again only closes its own handles
+    TEST_ESP_OK(nvs_flash_init(2, 3));
+    TEST_ESP_ERR(nvs_get_u32(def, "value", &value), ESP_ERR_NVS_INVALID_HANDLE);
+    TEST_ESP_OK(nvs_get_u32(calib, "value", &value));
+    CHECK(value == 2);
+
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_partition_stats("calib", &stats));
+    CHECK(stats.namespace_count == 1);
+    CHECK(stats.used_entries == 3);
+    TEST_ESP_OK(nvs_get_stats(&stats));
+    CHECK(stats.used_entries == 2);
+
+    nvs_iterator_t it;
+    size_t count = 0;
+    esp_err_t err = nvs_entry_find_in_partition("calib", "namespace1", NVS_TYPE_ANY, &it);
+    while (err == ESP_OK) {
+        ++count;
+        err = nvs_entry_next(&it);
+    }
+    CHECK(count == 2);
+
+    nvs_handle handle;
+    TEST_ESP_ERR(nvs_open_from_partition("missing", "namespace1", NVS_READWRITE, &handle), ESP_ERR_NVS_NOT_INITIALIZED);
+    TEST_ESP_ERR(nvs_get_partition_stats("missing", &stats), ESP_ERR_NVS_NOT_INITIALIZED);
+    TEST_ESP_ERR(nvs_flash_init_custom("longer_than_16_chars", 5, 3), ESP_ERR_INVALID_ARG);
+
+    // handles keep leading to their partition once the generation of
+    // their slot wraps around
+    for (size_t i = 0; i < 5000; ++i) {
+        TEST_ESP_OK(nvs_open_from_partition("calib", "namespace1", NVS_READONLY, &handle));
+        REQUIRE(nvs_get_u32(handle, "value", &value) == ESP_OK);
+        REQUIRE(value == 2);
+        nvs_close(handle);
+    }
+    nvs_close(calib);
+    TEST_ESP_ERR(nvs_get_u32(calib, "value", &value), ESP_ERR_NVS_INVALID_HANDLE);
+}
+
+TEST_CASE("lookups under a shared lock leave corrupted items for writers to erase", "[nvs][lock]")
+{
+    SpiFlashEmulator emu(1);
+    RwLock rwLock;
+    CHECK(rwLock.init() == ESP_OK);
+    Page page;
+    page.setLock(&rwLock);
+    CHECK(page.load(0) == ESP_OK);
+    uint8_t data[64];
+    fillBlob(data, sizeof(data), 8);
+    CHECK(page.writeItem(1, ItemType::BLOB, "blob", data, sizeof(data)) == ESP_OK);
+    CHECK(page.writeItem(1, "value", 1u) == ESP_OK);
+    // clear a word of the first data entry, which follows the page header,
+    // entry state bitmap and blob header, so that data CRC doesn't match
+    uint32_t zero = 0;
+    CHECK(emu.write(32 + 32 + Page::ENTRY_SIZE, &zero, sizeof(zero)));
+
+    uint8_t readBack[sizeof(data)];
+    {
+        SharedLock lock(rwLock);
+        CHECK(rwLock.isShared());
+        CHECK(page.readItem(1, ItemType::BLOB, "blob", readBack, sizeof(readBack)) == ESP_ERR_NVS_NOT_FOUND);
+        CHECK(page.getErasedEntryCount() == 0);
+        uint32_t value;
+        CHECK(page.readItem(1, "value", value) == ESP_OK);
+        CHECK(value == 1);
+    }
+    CHECK_FALSE(rwLock.isShared());
+    CHECK(page.readItem(1, ItemType::BLOB, "blob", readBack, sizeof(readBack)) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(page.getErasedEntryCount() == 3);
+}
+
+TEST_CASE("corrupted items are erased by lookups for their key", "[nvs]")
+{
+    SpiFlashEmulator emu(1);
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    CHECK(page.writeItem(1, "first", 1u) == ESP_OK);
+    CHECK(page.writeItem(1, "second", 2u) == ESP_OK);
+    CHECK(page.writeItem(1, "third", 3u) == ESP_OK);
+    // clear the value of "second", which is in the second entry
+    uint32_t zero = 0;
+    CHECK(emu.write(32 + 32 + Page::ENTRY_SIZE + offsetof(Item, data), &zero, sizeof(zero)));
+
+    uint32_t value;
+    CHECK(page.readItem(1, "third", value) == ESP_OK);
+    CHECK(value == 3);
+    CHECK(page.getErasedEntryCount() == 0);
+    CHECK(page.readItem(1, "second", value) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(page.getErasedEntryCount() == 1);
+    CHECK(page.readItem(1, "first", value) == ESP_OK);
+    CHECK(value == 1);
+}
+
+TEST_CASE("ItemCache keeps the most recently used values", "[nvs][cache]")
+{
+    ItemCache cache;
+    cache.init(4);
+    uint32_t value = 0;
+    char name[Item::MAX_KEY_LENGTH + 1];
+    CHECK_FALSE(cache.get(1, ItemType::U32, "key0", &value, sizeof(value)));
+    CHECK(cache.misses() == 1);
+    for (uint32_t i = 0; i < 4; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        cache.put(1, ItemType::U32, name, &i, sizeof(i));
+    }
+    CHECK(cache.size() == 4);
+    // key0 becomes the most recently used one, so key1 is replaced
+    CHECK(cache.get(1, ItemType::U32, "key0", &value, sizeof(value)));
+    CHECK(value == 0);
+    uint32_t newValue = 100;
+    cache.put(1, ItemType::U32, "key4", &newValue, sizeof(newValue));
+    CHECK(cache.size() == 4);
+    CHECK_FALSE(cache.get(1, ItemType::U32, "key1", &value, sizeof(value)));
+    CHECK(cache.get(1, ItemType::U32, "key4", &value, sizeof(value)));
+    CHECK(value == 100);
+    CHECK(cache.hits() == 2);
+
+    // the key is compared by value, and type and namespace are part of it
+    strcpy(name, "key2");
+    CHECK(cache.get(1, ItemType::U32, name, &value, sizeof(value)));
+    CHECK(value == 2);
+    CHECK_FALSE(cache.get(1, ItemType::I32, "key2", &value, sizeof(value)));
+    CHECK_FALSE(cache.get(2, ItemType::U32, "key2", &value, sizeof(value)));
+
+    cache.invalidate(1, "key2");
+    CHECK_FALSE(cache.get(1, ItemType::U32, "key2", &value, sizeof(value)));
+    CHECK(cache.size() == 3);
+    cache.clear();
+    CHECK(cache.size() == 0);
+
+    CHECK(ItemCache::isCacheable(ItemType::I64, 8));
+    CHECK_FALSE(ItemCache::isCacheable(ItemType::U32, 2));
+    CHECK_FALSE(ItemCache::isCacheable(ItemType::SZ, 1));
+    CHECK_FALSE(ItemCache::isCacheable(ItemType::BLOB, 1));
+
+    ItemCache disabled;
+    disabled.init(0);
+    disabled.put(1, ItemType::U32, "key", &value, sizeof(value));
+    CHECK_FALSE(disabled.get(1, ItemType::U32, "key", &value, sizeof(value)));
+}
+
+#if CONFIG_NVS_ITEM_CACHE_SIZE
+TEST_CASE("integer values read again come from the cache until changed", "[nvs][cache]")
+{
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    CHECK(storage.writeItem(1, "counter", 1u) == ESP_OK);
+    uint32_t value;
+    CHECK(storage.readItem(1, "counter", value) == ESP_OK);
+    emu.clearStats();
+    for (int i = 0; i < 10; ++i) {
+        CHECK(storage.readItem(1, "counter", value) == ESP_OK);
+        CHECK(value == 1);
+    }
+    CHECK(emu.getReadOps() == 0);
+    CHECK(storage.getItemCache().hits() == 10);
+
+    CHECK(storage.writeItem(1, "counter", 2u) == ESP_OK);
+    CHECK(storage.readItem(1, "counter", value) == ESP_OK);
+    CHECK(value == 2);
+    CHECK(storage.eraseItem<uint32_t>(1, "counter") == ESP_OK);
+    CHECK(storage.readItem(1, "counter", value) == ESP_ERR_NVS_NOT_FOUND);
+
+    WriteBatch batch;
+    uint32_t batchValue = 3;
+    CHECK(storage.writeItem(1, "counter", 2u) == ESP_OK);
+    CHECK(storage.readItem(1, "counter", value) == ESP_OK);
+    CHECK(batch.set(1, ItemType::U32, "counter", &batchValue, sizeof(batchValue)) == ESP_OK);
+    CHECK(storage.writeBatch(batch) == ESP_OK);
+    CHECK(storage.readItem(1, "counter", value) == ESP_OK);
+    CHECK(value == 3);
+
+    // a lookup with another type doesn't get the cached value
+    int32_t wrongType;
+    CHECK(storage.readItem(1, "counter", wrongType) != ESP_OK);
+}
+#endif //CONFIG_NVS_ITEM_CACHE_SIZE
+
+TEST_CASE("namespaces are found by name among many", "[nvs][namespace]")
+{
+    SpiFlashEmulator emu(8);
+    Storage storage;
+    CHECK(storage.init(0, 8) == ESP_OK);
+    char name[Item::MAX_KEY_LENGTH + 1];
+    uint8_t nsIndex;
+    const int nsCount = 100;
+    for (int i = 0; i < nsCount; ++i) {
+        snprintf(name, sizeof(name), "namespace%d", i);
+        REQUIRE(storage.createOrOpenNamespace(name, true, nsIndex) == ESP_OK);
+        CHECK(nsIndex == i + 1);
+    }
+    CHECK(storage.createOrOpenNamespace("namespace100", false, nsIndex) == ESP_ERR_NVS_NOT_FOUND);
+
+    Storage reloaded;
+    CHECK(reloaded.init(0, 8) == ESP_OK);
+    emu.clearStats();
+    for (int i = nsCount - 1; i >= 0; --i) {
+        snprintf(name, sizeof(name), "namespace%d", i);
+        REQUIRE(reloaded.createOrOpenNamespace(name, false, nsIndex) == ESP_OK);
+        CHECK(nsIndex == i + 1);
+        CHECK(strcmp(reloaded.getNamespaceName(nsIndex), name) == 0);
+    }
+    CHECK(emu.getReadOps() == 0);
+}
+
+TEST_CASE("all items of a namespace can be erased in one pass", "[nvs][namespace]")
+{
+    const size_t sectorCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    uint8_t ns1, ns2;
+    CHECK(storage.createOrOpenNamespace("first", true, ns1) == ESP_OK);
+    CHECK(storage.createOrOpenNamespace("second", true, ns2) == ESP_OK);
+    char name[Item::MAX_KEY_LENGTH + 1];
+    const size_t itemCount = Page::ENTRY_COUNT + 20;
+    for (size_t i = 0; i < itemCount; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(ns1, name, static_cast<uint32_t>(i)) == ESP_OK);
+        REQUIRE(storage.writeItem(ns2, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    const size_t size = Page::CHUNK_MAX_SIZE + 500;
+    uint8_t data[size];
+    fillBlob(data, size, 3);
+    CHECK(storage.writeItem(ns1, ItemType::BLOB, "blob", data, size) == ESP_OK);
+    uint32_t value;
+    CHECK(storage.readItem(ns1, "key0", value) == ESP_OK);
+
+    emu.clearStats();
+    CHECK(storage.eraseNamespace(ns1) == ESP_OK);
+    s_perf << "Reads to erase a namespace of " << itemCount + 1 << " items: " << emu.getReadOps() << std::endl;
+    // entries are read in groups, not once per key
+    CHECK(emu.getReadOps() < itemCount);
+
+    CHECK(storage.readItem(ns1, "key0", value) == ESP_ERR_NVS_NOT_FOUND);
+    EntryIterator it;
+    CHECK(storage.findEntry(ns1, ItemType::ANY, it) == ESP_ERR_NVS_NOT_FOUND);
+    for (size_t i = 0; i < itemCount; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.readItem(ns2, name, value) == ESP_OK);
+        CHECK(value == i);
+    }
+
+    uint8_t nsIndex;
+    CHECK(storage.createOrOpenNamespace("first", false, nsIndex) == ESP_OK);
+    CHECK(nsIndex == ns1);
+    CHECK(storage.writeItem(ns1, "key0", 5u) == ESP_OK);
+
+    Storage reloaded;
+    CHECK(reloaded.init(0, sectorCount) == ESP_OK);
+    CHECK(reloaded.readItem(ns1, "key0", value) == ESP_OK);
+    CHECK(value == 5);
+    CHECK(reloaded.readItem(ns1, "key1", value) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(reloaded.eraseNamespace(Page::NS_INDEX) == ESP_ERR_NVS_NOT_FOUND);
+}
+
+TEST_CASE("pages holding only items of an erased namespace are erased as a whole", "[nvs][namespace]")
+{
+    const size_t sectorCount = 6;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    CHECK(storage.writeItem(2, "other", 1u) == ESP_OK);
+    char name[Item::MAX_KEY_LENGTH + 1];
+    const size_t itemCount = 3 * Page::ENTRY_COUNT;
+    for (size_t i = 0; i < itemCount; ++i) {
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+
+    // the first page also holds "other", the next two are full and only
+    // hold namespace 1, the last one is active
+    emu.clearStats();
+    CHECK(storage.eraseNamespace(1) == ESP_OK);
+    s_perf << "Erasing " << itemCount << " items: " << emu.getEraseOps() << " sector erases, "
+           << emu.getWriteOps() << " writes" << std::endl;
+    CHECK(emu.getEraseOps() == 2);
+    CHECK(emu.getWriteOps() < itemCount / 2);
+
+    uint32_t value;
+    CHECK(storage.readItem(2, "other", value) == ESP_OK);
+    CHECK(storage.readItem(1, "key0", value) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(storage.readItem(1, "key200", value) == ESP_ERR_NVS_NOT_FOUND);
+
+    // released pages are available for new items straight away
+    for (size_t i = 0; i < itemCount; ++i) {
+        snprintf(name, sizeof(name), "new%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(3, name, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+
+    Storage reloaded;
+    CHECK(reloaded.init(0, sectorCount) == ESP_OK);
+    CHECK(reloaded.readItem(2, "other", value) == ESP_OK);
+    CHECK(value == 1);
+    CHECK(reloaded.readItem(3, "new0", value) == ESP_OK);
+    EntryIterator it;
+    CHECK(reloaded.findEntry(1, ItemType::ANY, it) == ESP_ERR_NVS_NOT_FOUND);
+}
+
+TEST_CASE("nvs api can erase all keys of a namespace", "[nvs][namespace]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle, other, readOnly, transaction;
+    TEST_ESP_OK(nvs_open("config", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("keep", NVS_READWRITE, &other));
+    TEST_ESP_OK(nvs_open("config", NVS_READONLY, &readOnly));
+    TEST_ESP_OK(nvs_open("config", NVS_READWRITE_TRANSACTION, &transaction));
+    TEST_ESP_OK(nvs_set_i32(handle, "a", 1));
+    TEST_ESP_OK(nvs_set_str(handle, "b", "value"));
+    TEST_ESP_OK(nvs_set_i32(other, "a", 2));
+    TEST_ESP_OK(nvs_set_i32(transaction, "staged", 3));
+
+    TEST_ESP_ERR(nvs_erase_all(readOnly), ESP_ERR_NVS_READ_ONLY);
+    TEST_ESP_OK(nvs_erase_all(transaction));
+    TEST_ESP_OK(nvs_commit(transaction));
+
+    int32_t value;
+    TEST_ESP_ERR(nvs_get_i32(handle, "a", &value), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_get_i32(handle, "staged", &value), ESP_ERR_NVS_NOT_FOUND);
+    size_t length;
+    TEST_ESP_ERR(nvs_get_str(readOnly, "b", NULL, &length), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_get_i32(other, "a", &value));
+    CHECK(value == 2);
+
+    // handles of the namespace keep working
+    TEST_ESP_OK(nvs_set_i32(handle, "a", 4));
+    TEST_ESP_OK(nvs_get_i32(readOnly, "a", &value));
+    CHECK(value == 4);
+
+    nvs_close(handle);
+    nvs_close(other);
+    nvs_close(readOnly);
+    nvs_close(transaction);
+    TEST_ESP_ERR(nvs_erase_all(handle), ESP_ERR_NVS_INVALID_HANDLE);
+}
+
+TEST_CASE("storage statistics count entries and reclaimed pages", "[nvs][stats]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    uint8_t nsIndex;
+    CHECK(storage.createOrOpenNamespace("stats", true, nsIndex) == ESP_OK);
+
+    nvs_stats_t stats;
+    storage.getStats(stats);
+    CHECK(stats.used_entries == 1);
+    CHECK(stats.erased_entries == 0);
+    CHECK(stats.free_entries == sectorCount * Page::ENTRY_COUNT - 1);
+    CHECK(stats.total_entries == sectorCount * Page::ENTRY_COUNT);
+    CHECK(stats.free_pages == sectorCount - 1);
+    CHECK(stats.namespace_count == 1);
+    CHECK(stats.reclaimed_pages == 0);
+
+    CHECK(storage.writeItem(nsIndex, "value", 1u) == ESP_OK);
+    CHECK(storage.writeItem(nsIndex, "value", 2u) == ESP_OK);
+    CHECK(storage.writeItem(nsIndex, ItemType::SZ, "str", "text", 5) == ESP_OK);
+    storage.getStats(stats);
+    CHECK(stats.used_entries == 1 + 1 + 2);
+    CHECK(stats.erased_entries == 1);
+    CHECK(stats.free_entries == sectorCount * Page::ENTRY_COUNT - 5);
+
+    // overwriting one value fills all pages and then has to reclaim them
+    for (uint32_t i = 0; i < 3 * Page::ENTRY_COUNT; ++i) {
+        REQUIRE(storage.writeItem(nsIndex, "value", i) == ESP_OK);
+    }
+    storage.getStats(stats);
+    CHECK(stats.used_entries == 1 + 1 + 2);
+    CHECK(stats.inline_reclaims > 0);
+    CHECK(stats.reclaimed_pages == stats.inline_reclaims);
+    CHECK(stats.used_entries + stats.erased_entries + stats.free_entries <= stats.total_entries);
+
+    Storage reloaded;
+    CHECK(reloaded.init(0, sectorCount) == ESP_OK);
+    nvs_stats_t reloadedStats;
+    reloaded.getStats(reloadedStats);
+    CHECK(reloadedStats.used_entries == stats.used_entries);
+    CHECK(reloadedStats.free_pages == stats.free_pages);
+    CHECK(reloadedStats.namespace_count == 1);
+    CHECK(reloadedStats.reclaimed_pages == 0);
+}
+
+TEST_CASE("nvs api returns storage statistics", "[nvs][stats]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 3;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("first", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_i32(handle, "a", 1));
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_open("second", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_str(handle, "b", "value"));
+    nvs_close(handle);
+
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(&stats));
+    CHECK(stats.namespace_count == 2);
+    CHECK(stats.used_entries == 2 + 1 + 2);
+    CHECK(stats.total_entries == NVS_FLASH_SECTOR_COUNT_MIN * Page::ENTRY_COUNT);
+}
+
+#if CONFIG_NVS_MMAP_READS
+TEST_CASE("storage reads mapped flash instead of calling spi_flash_read", "[nvs][mmap]")
+{
+    SpiFlashEmulator emu(4);
+    emu.setMmapEnabled(true);
+    const char str[] = "value 0123456789abcdef0123456789abcdef";
+    {
+        Storage storage;
+        CHECK(storage.init(0, 4) == ESP_OK);
+        CHECK(emu.getMappingCount() == 1);
+        for (uint32_t n = 0; n < 10; ++n) {
+            for (size_t i = 0; i < 20; ++i) {
+                char name[Item::MAX_KEY_LENGTH + 1];
+                snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+                REQUIRE(storage.writeItem(1, name, n * 100 + static_cast<uint32_t>(i)) == ESP_OK);
+            }
+            REQUIRE(storage.writeItem(1, ItemType::SZ, "str", str, sizeof(str)) == ESP_OK);
+        }
+        // data written since the page was mapped is read back
+        uint32_t value;
+        CHECK(storage.readItem(1, "key3", value) == ESP_OK);
+        CHECK(value == 903);
+
+        CHECK(storage.init(0, 4) == ESP_OK);
+        CHECK(emu.getMappingCount() == 1);
+        for (size_t i = 0; i < 20; ++i) {
+            char name[Item::MAX_KEY_LENGTH + 1];
+            snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+            REQUIRE(storage.readItem(1, name, value) == ESP_OK);
+            CHECK(value == 900 + i);
+        }
+        char buf[sizeof(str)];
+        CHECK(storage.readItem(1, ItemType::SZ, "str", buf, sizeof(buf)) == ESP_OK);
+        CHECK(strcmp(buf, str) == 0);
+        CHECK(emu.getReadOps() == 0);
+    }
+    CHECK(emu.getMappingCount() == 0);
+
+    // without a mapping, spi_flash_read is used
+    emu.setMmapEnabled(false);
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    CHECK(emu.getMappingCount() == 0);
+    uint32_t value;
+    CHECK(storage.readItem(1, "key3", value) == ESP_OK);
+    CHECK(value == 903);
+    CHECK(emu.getReadOps() > 0);
+}
+#endif //CONFIG_NVS_MMAP_READS
+
+#if CONFIG_NVS_ENCRYPTION
+static void setTestKey(uint8_t seed)
+{
+    uint8_t key[EntryCipher::KEY_SIZE];
+    for (size_t i = 0; i < sizeof(key); ++i) {
+        key[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+    EntryCipher::setKey(key);
+}
+
+TEST_CASE("entry cipher round trip depends on the address", "[nvs][encryption]")
+{
+    setTestKey(1);
+    const size_t count = 6;
+    uint8_t plain[count * Page::ENTRY_SIZE];
+    for (size_t i = 0; i < sizeof(plain); ++i) {
+        plain[i] = static_cast<uint8_t>(i / Page::ENTRY_SIZE);
+    }
+    uint8_t cipher[sizeof(plain)];
+    uint8_t moved[sizeof(plain)];
+    uint8_t decrypted[sizeof(plain)];
+    EntryCipher::Session session;
+    EntryCipher::encrypt(0x1000, plain, cipher, count);
+    EntryCipher::encrypt(0x2000, plain, moved, count);
+    CHECK(memcmp(cipher, plain, sizeof(plain)) != 0);
+    CHECK(memcmp(cipher, moved, sizeof(plain)) != 0);
+    // entries with the same data at other addresses differ as well
+    CHECK(memcmp(cipher, cipher + Page::ENTRY_SIZE, Page::ENTRY_SIZE) != 0);
+
+    EntryCipher::decrypt(0x1000, cipher, decrypted, count);
+    CHECK(memcmp(decrypted, plain, sizeof(plain)) == 0);
+    EntryCipher::decrypt(0x2000, moved, decrypted, count);
+    CHECK(memcmp(decrypted, plain, sizeof(plain)) == 0);
+    // in place, as Page does it
+    EntryCipher::decrypt(0x1000, cipher, cipher, count);
+    CHECK(memcmp(cipher, plain, sizeof(plain)) == 0);
+}
+
+TEST_CASE("encrypted storage reads back items spanning entries and pages", "[nvs][encryption]")
+{
+    setTestKey(1);
+    SpiFlashEmulator emu(4);
+    const char str[] = "plaintext which mustn't be found in flash";
+    uint8_t blob[300];
+    for (size_t i = 0; i < sizeof(blob); ++i) {
+        blob[i] = static_cast<uint8_t>(i * 3);
+    }
+    {
+        Storage storage;
+        CHECK(storage.init(0, 4) == ESP_OK);
+        for (size_t i = 0; i < 200; ++i) {
+            char name[Item::MAX_KEY_LENGTH + 1];
+            snprintf(name, sizeof(name), "key%d", static_cast<int>(i % 50));
+            REQUIRE(storage.writeItem(1, name, static_cast<uint32_t>(i)) == ESP_OK);
+        }
+        REQUIRE(storage.writeItem(1, ItemType::SZ, "str", str, sizeof(str)) == ESP_OK);
+        REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", blob, sizeof(blob)) == ESP_OK);
+    }
+    const uint8_t* raw = emu.bytes();
+    CHECK(std::search(raw, raw + emu.size(), str, str + 9) == raw + emu.size());
+
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    for (size_t i = 0; i < 50; ++i) {
+        char name[Item::MAX_KEY_LENGTH + 1];
+        snprintf(name, sizeof(name), "key%d", static_cast<int>(i));
+        uint32_t value;
+        REQUIRE(storage.readItem(1, name, value) == ESP_OK);
+        CHECK(value == 150 + i);
+    }
+    char buf[sizeof(str)];
+    CHECK(storage.readItem(1, ItemType::SZ, "str", buf, sizeof(buf)) == ESP_OK);
+    CHECK(strcmp(buf, str) == 0);
+    uint8_t blobBuf[sizeof(blob)];
+    CHECK(storage.readItem(1, ItemType::BLOB, "blob", blobBuf, sizeof(blobBuf)) == ESP_OK);
+    CHECK(memcmp(blobBuf, blob, sizeof(blob)) == 0);
+}
+
+TEST_CASE("erased entries of encrypted pages stay blank", "[nvs][encryption]")
+{
+    setTestKey(1);
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    CHECK(storage.init(0, 4) == ESP_OK);
+    CHECK(storage.writeItem(1, "a", 1u) == ESP_OK);
+    CHECK(storage.writeItem(1, "b", 2u) == ESP_OK);
+
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    CHECK(page.getUsedEntryCount() == 2);
+    // entries after the written ones are still erased flash, and read as such
+    const size_t firstEntry = 64 / Page::ENTRY_SIZE;
+    const uint8_t* entries = emu.bytes() + firstEntry * Page::ENTRY_SIZE;
+    for (size_t i = 2; i < Page::ENTRY_COUNT; ++i) {
+        const uint8_t* entry = entries + i * Page::ENTRY_SIZE;
+        REQUIRE(std::all_of(entry, entry + Page::ENTRY_SIZE, [](uint8_t b) { return b == 0xff; }));
+    }
+    uint8_t blank[Page::ENTRY_SIZE];
+    memset(blank, 0xff, sizeof(blank));
+    EntryCipher::Session session;
+    EntryCipher::decrypt(firstEntry * Page::ENTRY_SIZE, blank, blank, 1);
+    CHECK(std::all_of(blank, blank + sizeof(blank), [](uint8_t b) { return b == 0xff; }));
+}
+
+TEST_CASE("encrypted items read with another key fail the CRC check", "[nvs][encryption]")
+{
+    setTestKey(1);
+    SpiFlashEmulator emu(4);
+    {
+        Storage storage;
+        CHECK(storage.init(0, 4) == ESP_OK);
+        CHECK(storage.writeItem(1, "value", 0x12345678u) == ESP_OK);
+    }
+    {
+        Page page;
+        CHECK(page.load(0) == ESP_OK);
+        uint32_t value;
+        CHECK(page.readItem(1, "value", value) == ESP_OK);
+        CHECK(value == 0x12345678);
+    }
+    setTestKey(2);
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    uint32_t value;
+    CHECK(page.readItem(1, "value", value) == ESP_ERR_NVS_NOT_FOUND);
+    setTestKey(1);
+}
+
+TEST_CASE("power cut during an encrypted write leaves the old or the new value", "[nvs][encryption]")
+{
+    setTestKey(1);
+    const char oldStr[] = "old value of the string, which spans several entries";
+    const char newStr[] = "new value of the string, which spans several entries";
+    for (uint32_t cutAfter = 0; ; ++cutAfter) {
+        for (size_t wordsDone = 0; wordsDone < 8; wordsDone += 3) {
+            INFO(cutAfter << " " << wordsDone);
+            SpiFlashEmulator emu(4);
+            bool done;
+            {
+                Storage storage;
+                REQUIRE(storage.init(0, 4) == ESP_OK);
+                REQUIRE(storage.writeItem(1, ItemType::SZ, "str", oldStr, sizeof(oldStr)) == ESP_OK);
+                emu.powerCutAfter(cutAfter, wordsDone);
+                done = storage.writeItem(1, ItemType::SZ, "str", newStr, sizeof(newStr)) == ESP_OK;
+            }
+            emu.clearFailure();
+            Storage storage;
+            REQUIRE(storage.init(0, 4) == ESP_OK);
+            char buf[sizeof(oldStr)];
+            REQUIRE(storage.readItem(1, ItemType::SZ, "str", buf, sizeof(buf)) == ESP_OK);
+            if (done) {
+                CHECK(strcmp(buf, newStr) == 0);
+                return;
+            }
+            CHECK((strcmp(buf, oldStr) == 0 || strcmp(buf, newStr) == 0));
+            REQUIRE(storage.writeItem(1, ItemType::SZ, "str", newStr, sizeof(newStr)) == ESP_OK);
+            REQUIRE(storage.readItem(1, ItemType::SZ, "str", buf, sizeof(buf)) == ESP_OK);
+            CHECK(strcmp(buf, newStr) == 0);
+        }
+    }
+}
+#endif //CONFIG_NVS_ENCRYPTION
+
 TEST_CASE("dump all performance data", "[nvs]")
 {
     std::cout << "====================" << std::endl << "Dumping benchmarks" << std::endl;
@@ -152,3 +152,75 @@ TEST_CASE("data is randomized predicatbly", "[spi_flash_emu]")
     CHECK(std::equal(emu1.bytes(), emu1.bytes() + emu1.size(), emu2.bytes()));
 }
 
+
+TEST_CASE("power cut interrupts a write and fails operations until cleared", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(1);
+    uint32_t vals[4] = {0, 0, 0, 0};
+    emu.powerCutAfter(1, 2);
+    CHECK(spi_flash_write(0, vals, sizeof(vals)) == ESP_OK);
+    CHECK(spi_flash_write(16, vals, sizeof(vals)) == ESP_ERR_FLASH_OP_FAIL);
+    CHECK(emu.isPoweredOff());
+    CHECK(emu.words()[4] == 0);
+    CHECK(emu.words()[5] == 0);
+    CHECK(range_empty_n(emu.words() + 6, 4096 / 4 - 6));
+    CHECK(spi_flash_read(0, vals, sizeof(vals)) == ESP_ERR_FLASH_OP_FAIL);
+    CHECK(spi_flash_erase_sector(0) == ESP_ERR_FLASH_OP_FAIL);
+    emu.clearFailure();
+    CHECK(spi_flash_erase_sector(0) == ESP_OK);
+    CHECK(range_empty_n(emu.words(), 4096 / 4));
+}
+
+TEST_CASE("power cut during erase leaves sector partially erased", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(1);
+    std::vector<uint32_t> zeroes(4096 / 4, 0);
+    CHECK(spi_flash_write(0, zeroes.data(), 4096) == ESP_OK);
+    emu.powerCutAfter(0, 100);
+    CHECK(spi_flash_erase_sector(0) == ESP_ERR_FLASH_OP_FAIL);
+    CHECK(range_empty_n(emu.words(), 100));
+    CHECK(emu.words()[100] == 0);
+}
+
+TEST_CASE("bits can be flipped", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(1);
+    emu.flipBit(5, 3);
+    CHECK(emu.bytes()[5] == 0xf7);
+    emu.flipBit(5, 3);
+    CHECK(range_empty_n(emu.words(), 4096 / 4));
+    emu.flipRandomBits(64, 32, 1, 1);
+    CHECK(range_empty_n(emu.words(), 64 / 4));
+    CHECK(!range_empty_n(emu.words() + 64 / 4, 32 / 4));
+}
+
+TEST_CASE("timing model can be replaced", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(2);
+    SpiFlashTiming timing = SpiFlashTiming::esp8266();
+    timing.sectorEraseTime = 1000;
+    timing.readTimes[0] = 1;
+    emu.setTiming(timing);
+    uint32_t val;
+    spi_flash_read(0, &val, 4);
+    spi_flash_erase_sector(1);
+    CHECK(emu.getTotalTime() == 1001);
+    emu.clearStats();
+    std::vector<uint32_t> data(8192 / 4);
+    spi_flash_read(0, data.data(), 8192);
+    CHECK(emu.getTotalTime() == 2 * 459);
+}
+
+TEST_CASE("byte granular writes pad with 0xff", "[spi_flash_emu]")
+{
+    SpiFlashEmulator emu(1);
+    const uint8_t data[] = {1, 2, 3, 4, 5};
+    CHECK(spi_flash_write_bytes(3, data, sizeof(data)) == ESP_OK);
+    CHECK(emu.words()[0] == 0x01ffffff);
+    CHECK(emu.words()[1] == 0x05040302);
+    uint8_t out[5];
+    CHECK(spi_flash_read_bytes(3, out, sizeof(out)) == ESP_OK);
+    CHECK(std::equal(data, data + sizeof(data), out));
+    CHECK(spi_flash_write_bytes(2, data, 1) == ESP_OK);
+    CHECK(emu.words()[0] == 0x0101ffff);
+}
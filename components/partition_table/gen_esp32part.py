@@ -117,6 +117,8 @@ class PartitionDefinition(object):
             "ota" : 0x00,
             "rf" : 0x01,
             "wifi" : 0x02,
+            "coredump" : 0x03,
+            "nvs_keys" : 0x04,
             },
     }
 
@@ -68,6 +68,8 @@ myota_1, 0, 0x11,, 0x100000
 myota_15, 0, 0x1f,, 0x100000
 mytest, 0, 0x20,, 0x100000
 myota_status, 1, 0,, 0x100000
+mycoredump, 1, 3,, 0x10000
+mynvskeys, 1, 4,, 0x1000
         """
         csv_nomagicnumbers = """
 # Name, Type, SubType, Offset, Size
@@ -77,6 +79,8 @@ myota_1, app, ota_1,, 0x100000
 myota_15, app, ota_15,, 0x100000
 mytest, app, test,, 0x100000
 myota_status, data, ota,, 0x100000
+mycoredump, data, coredump,, 0x10000
+mynvskeys, data, nvs_keys,, 0x1000
 """
         # make two equivalent partition tables, one using
         # magic numbers and one using shortcuts. Ensure they match
@@ -94,6 +98,10 @@ myota_status, data, ota,, 0x100000
         self.assertEqual(nomagic["myota_15"], magic["myota_15"])
         self.assertEqual(nomagic["mytest"], magic["mytest"])
         self.assertEqual(nomagic["myota_status"], magic["myota_status"])
+        self.assertEqual(nomagic["mycoredump"].subtype, 0x03)
+        self.assertEqual(nomagic["mycoredump"], magic["mycoredump"])
+        self.assertEqual(nomagic["mynvskeys"].subtype, 0x04)
+        self.assertEqual(nomagic["mynvskeys"], magic["mynvskeys"])
 
         #self.assertEqual(nomagic.to_binary(), magic.to_binary())
 
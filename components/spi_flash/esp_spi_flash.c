@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -21,10 +23,14 @@
 #include <rom/cache.h>
 #include <soc/soc.h>
 #include <soc/dport_reg.h>
+#include <soc/cpu.h>
 #include "sdkconfig.h"
 #include "esp_ipc.h"
+#include "esp_intr_alloc.h"
 #include "esp_attr.h"
+#include "esp_pm.h"
 #include "esp_spi_flash.h"
+#include "esp_log.h"
 
 
 /*
@@ -45,8 +51,19 @@
     Then the task on CPU A disables cache as well, and proceeds to execute flash
     operation.
 
-    While flash operation is running, interrupts can still run on CPU B.
-    We assume that all interrupt code is placed into RAM.
+    While flash operation is running, interrupts allocated with
+    ESP_INTR_FLAG_IRAM can still run on both CPUs. Other interrupts allocated
+    with esp_intr_alloc are masked on each CPU before its cache is disabled.
+    We assume that handlers installed directly with xt_set_interrupt_handler
+    are placed into RAM.
+
+    With CONFIG_SPI_FLASH_IRAM_SAFE_TASKS, spi_flash_op_block_func doesn't
+    suspend the scheduler on CPU B. It switches the scheduler of CPU B into
+    a mode where only tasks marked with vTaskSetIramSafe are switched in, and
+    drops its own priority so that such tasks keep running while the flash
+    operation is in progress. It does this only after the task on CPU A has
+    suspended its own scheduler (s_flash_op_started), so that the task doing
+    the flash operation can't migrate to CPU B.
 
     Once flash operation is complete, function on CPU A sets another flag,
     s_flash_op_complete, to let the task on CPU B know that it can re-enable
@@ -62,24 +79,129 @@
 static esp_err_t spi_flash_translate_rc(SpiFlashOpResult rc);
 static void IRAM_ATTR spi_flash_disable_cache(uint32_t cpuid, uint32_t* saved_state);
 static void IRAM_ATTR spi_flash_restore_cache(uint32_t cpuid, uint32_t saved_state);
+static void IRAM_ATTR spi_flash_flush_mapped_cache();
 
 static uint32_t s_flash_op_cache_state[2];
 
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+// defined in spi_flash_write_buffer.c
+void spi_flash_write_buffer_init();
+#endif
+
+/*
+    Flash MMU tables of both CPUs. Each entry maps a 64KB page of virtual
+    address space to a page of flash. spi_flash_mmap uses the entries of the
+    DROM0 region (0x3F400000 - 0x3F7FFFFF) which are not used to map the
+    application's read-only data.
+*/
+#define FLASH_MMU_TABLE_PRO     ((volatile uint32_t*) 0x3FF10000)
+#define FLASH_MMU_TABLE_APP     ((volatile uint32_t*) 0x3FF12000)
+#define FLASH_MMU_INVALID_VAL   0x100
+#define FLASH_MMU_PAGE_SIZE     0x10000
+// size of the buffer used by spi_flash_read_bytes and spi_flash_write_bytes
+// for unaligned parts, in words
+#define SPI_FLASH_BOUNCE_WORDS  16
+#define FLASH_MMU_DROM0_VADDR   0x3F400000
+#define FLASH_MMU_DROM0_PAGES   64
+
+// reference counts of DROM0 MMU entries set up by spi_flash_mmap. entries
+// with a count of zero are either unused, or were set up by the bootloader
+// and are left alone.
+static uint8_t s_mmap_page_refcnt[FLASH_MMU_DROM0_PAGES];
+
+// number of MMU entries currently mapped by spi_flash_mmap
+static uint32_t s_mmap_page_count = 0;
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+static const char* TAG = "spi_flash";
+static spi_flash_counters_t s_flash_counters;
+static portMUX_TYPE s_flash_counters_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_flash_cache_disable_ccount[2];
+
+static inline uint32_t IRAM_ATTR spi_flash_ccount()
+{
+    uint32_t ccount;
+    RSR(CCOUNT, ccount);
+    return ccount;
+}
+
+static inline uint32_t IRAM_ATTR spi_flash_us_since(uint32_t start_ccount)
+{
+    return (spi_flash_ccount() - start_ccount) / esp_pm_get_cpu_freq_mhz();
+}
+
+// return address with the window increment bits of the Xtensa call replaced
+#define SPI_FLASH_CALLER() \
+    ((const void*) (((uint32_t) __builtin_return_address(0) & 0x3fffffff) | 0x40000000))
+
+static void IRAM_ATTR spi_flash_counter_add(spi_flash_counter_t* counter, const void* caller,
+                                            uint32_t bytes, uint32_t start_ccount)
+{
+    const uint32_t time = spi_flash_us_since(start_ccount);
+    size_t bucket = 0;
+    while (bucket < SPI_FLASH_COUNTER_BUCKETS - 1 && time >= (32u << bucket)) {
+        ++bucket;
+    }
+    portENTER_CRITICAL(&s_flash_counters_mux);
+    counter->count++;
+    counter->bytes += bytes;
+    counter->time += time;
+    if (time > counter->max_time) {
+        counter->max_time = time;
+    }
+    counter->histogram[bucket]++;
+    spi_flash_caller_counter_t* entry = NULL;
+    for (size_t i = 0; i < SPI_FLASH_COUNTER_CALLERS; ++i) {
+        spi_flash_caller_counter_t* it = &s_flash_counters.callers[i];
+        if (it->caller == caller || it->caller == NULL) {
+            it->caller = caller;
+            entry = it;
+            break;
+        }
+    }
+    if (entry == NULL) {
+        entry = &s_flash_counters.other_callers;
+    }
+    entry->count++;
+    entry->time += time;
+    portEXIT_CRITICAL(&s_flash_counters_mux);
+}
+
+#define SPI_FLASH_COUNTER_START()   const uint32_t counter_start = spi_flash_ccount()
+#define SPI_FLASH_COUNTER_ADD(op, bytes) \
+    spi_flash_counter_add(&s_flash_counters.op, SPI_FLASH_CALLER(), (bytes), counter_start)
+#else
+#define SPI_FLASH_COUNTER_START()
+#define SPI_FLASH_COUNTER_ADD(op, bytes)
+#endif // CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
+// Held during flash operations
+static esp_pm_lock_t s_flash_pm_lock = ESP_PM_LOCK_INITIALIZER(ESP_PM_CPU_FREQ_MAX, "flash");
+
 #ifndef CONFIG_FREERTOS_UNICORE
 static SemaphoreHandle_t s_flash_op_mutex;
 static bool s_flash_op_can_start = false;
 static bool s_flash_op_complete = false;
+#ifdef CONFIG_SPI_FLASH_IRAM_SAFE_TASKS
+static bool s_flash_op_started = false;
+#endif
 #endif //CONFIG_FREERTOS_UNICORE
 
 
 #ifndef CONFIG_FREERTOS_UNICORE
 
+#ifndef CONFIG_SPI_FLASH_IRAM_SAFE_TASKS
+
 static void IRAM_ATTR spi_flash_op_block_func(void* arg)
 {
     // Disable scheduler on this CPU
     vTaskSuspendAll();
     uint32_t cpuid = (uint32_t) arg;
+    // Cleared here rather than by the caller on the other CPU, see the
+    // CONFIG_SPI_FLASH_IRAM_SAFE_TASKS version of this function
+    s_flash_op_complete = false;
     // Disable cache so that flash operation can start
+    esp_intr_noniram_disable();
     spi_flash_disable_cache(cpuid, &s_flash_op_cache_state[cpuid]);
     s_flash_op_can_start = true;
     while (!s_flash_op_complete) {
@@ -88,19 +210,65 @@ static void IRAM_ATTR spi_flash_op_block_func(void* arg)
     }
     // Flash operation is complete, re-enable cache
     spi_flash_restore_cache(cpuid, s_flash_op_cache_state[cpuid]);
+    esp_intr_noniram_enable();
     // Re-enable scheduler
     xTaskResumeAll();
 }
 
+#else // CONFIG_SPI_FLASH_IRAM_SAFE_TASKS
+
+static void IRAM_ATTR spi_flash_op_block_func(void* arg)
+{
+    uint32_t cpuid = (uint32_t) arg;
+    // May still be set by the previous operation: this function can be
+    // preempted after the flag is set, so the caller on the other CPU doesn't
+    // clear it, otherwise a delayed instance of this function would never
+    // finish. esp_ipc_call doesn't start this function before the previous
+    // call has returned.
+    s_flash_op_complete = false;
+    // From now on, only IRAM-safe tasks may be switched in on this CPU
+    vTaskSetIramOnlyScheduling(pdTRUE);
+    // Disable cache so that flash operation can start
+    esp_intr_noniram_disable();
+    spi_flash_disable_cache(cpuid, &s_flash_op_cache_state[cpuid]);
+    s_flash_op_can_start = true;
+    while (!s_flash_op_started) {
+        // wait until the other CPU has suspended its scheduler
+    }
+    // Let IRAM-safe tasks of higher priority preempt this task
+    vTaskPrioritySet(NULL, tskIDLE_PRIORITY + 1);
+    while (!s_flash_op_complete) {
+        // busy loop and wait for the other CPU to finish flash operation
+    }
+    vTaskPrioritySet(NULL, configMAX_PRIORITIES - 1);
+    // Flash operation is complete, re-enable cache
+    spi_flash_restore_cache(cpuid, s_flash_op_cache_state[cpuid]);
+    esp_intr_noniram_enable();
+    vTaskSetIramOnlyScheduling(pdFALSE);
+}
+
+#endif // CONFIG_SPI_FLASH_IRAM_SAFE_TASKS
+
 void spi_flash_init()
 {
     s_flash_op_mutex = xSemaphoreCreateMutex();
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+    spi_flash_write_buffer_init();
+#endif
 }
 
 static void IRAM_ATTR spi_flash_disable_interrupts_caches_and_other_cpu()
 {
     // Take the API lock
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    const uint32_t wait_start = spi_flash_ccount();
     xSemaphoreTake(s_flash_op_mutex, portMAX_DELAY);
+    s_flash_counters.mutex_wait_time += spi_flash_us_since(wait_start);
+#else
+    xSemaphoreTake(s_flash_op_mutex, portMAX_DELAY);
+#endif
+    // Run at full speed while the cache is disabled and the other CPU waits
+    esp_pm_lock_acquire(&s_flash_pm_lock);
 
     const uint32_t cpuid = xPortGetCoreID();
     const uint32_t other_cpuid = (cpuid == 0) ? 1 : 0;
@@ -116,7 +284,9 @@ static void IRAM_ATTR spi_flash_disable_interrupts_caches_and_other_cpu()
         // Signal to the spi_flash_op_block_task on the other CPU that we need it to
         // disable cache there and block other tasks from executing.
         s_flash_op_can_start = false;
-        s_flash_op_complete = false;
+#ifdef CONFIG_SPI_FLASH_IRAM_SAFE_TASKS
+        s_flash_op_started = false;
+#endif
         esp_ipc_call(other_cpuid, &spi_flash_op_block_func, (void*) other_cpuid);
         while (!s_flash_op_can_start) {
             // Busy loop and wait for spi_flash_op_block_func to disable cache
@@ -124,11 +294,16 @@ static void IRAM_ATTR spi_flash_disable_interrupts_caches_and_other_cpu()
         }
         // Disable scheduler on CPU cpuid
         vTaskSuspendAll();
+#ifdef CONFIG_SPI_FLASH_IRAM_SAFE_TASKS
+        // Let spi_flash_op_block_func run IRAM-safe tasks on the other CPU
+        s_flash_op_started = true;
+#endif
         // This is guaranteed to run on CPU <cpuid> because the other CPU is now
         // occupied by highest priority task
         assert(xPortGetCoreID() == cpuid);
     }
     // Disable cache on this CPU as well
+    esp_intr_noniram_disable();
     spi_flash_disable_cache(cpuid, &s_flash_op_cache_state[cpuid]);
 }
 
@@ -139,6 +314,7 @@ static void IRAM_ATTR spi_flash_enable_interrupts_caches_and_other_cpu()
 
     // Re-enable cache on this CPU
     spi_flash_restore_cache(cpuid, s_flash_op_cache_state[cpuid]);
+    esp_intr_noniram_enable();
 
     if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
         // Scheduler is not running yet — this means we are running on PRO CPU.
@@ -152,6 +328,7 @@ static void IRAM_ATTR spi_flash_enable_interrupts_caches_and_other_cpu()
         // Resume tasks on the current CPU
         xTaskResumeAll();
     }
+    esp_pm_lock_release(&s_flash_pm_lock);
     // Release API lock
     xSemaphoreGive(s_flash_op_mutex);
 }
@@ -160,19 +337,25 @@ static void IRAM_ATTR spi_flash_enable_interrupts_caches_and_other_cpu()
 
 void spi_flash_init()
 {
-    // No-op in single core mode
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+    spi_flash_write_buffer_init();
+#endif
 }
 
 static void IRAM_ATTR spi_flash_disable_interrupts_caches_and_other_cpu()
 {
+    esp_pm_lock_acquire(&s_flash_pm_lock);
     vTaskSuspendAll();
+    esp_intr_noniram_disable();
     spi_flash_disable_cache(0, &s_flash_op_cache_state[0]);
 }
 
 static void IRAM_ATTR spi_flash_enable_interrupts_caches_and_other_cpu()
 {
     spi_flash_restore_cache(0, s_flash_op_cache_state[0]);
+    esp_intr_noniram_enable();
     xTaskResumeAll();
+    esp_pm_lock_release(&s_flash_pm_lock);
 }
 
 #endif // CONFIG_FREERTOS_UNICORE
@@ -193,37 +376,285 @@ SpiFlashOpResult IRAM_ATTR spi_flash_unlock()
 
 esp_err_t IRAM_ATTR spi_flash_erase_sector(uint16_t sec)
 {
+    SPI_FLASH_COUNTER_START();
     spi_flash_disable_interrupts_caches_and_other_cpu();
     SpiFlashOpResult rc;
     rc = spi_flash_unlock();
     if (rc == SPI_FLASH_RESULT_OK) {
         rc = SPIEraseSector(sec);
     }
+    spi_flash_flush_mapped_cache();
     spi_flash_enable_interrupts_caches_and_other_cpu();
+    SPI_FLASH_COUNTER_ADD(erase, SPI_FLASH_SEC_SIZE);
     return spi_flash_translate_rc(rc);
 }
 
 esp_err_t IRAM_ATTR spi_flash_write(uint32_t dest_addr, const uint32_t *src, uint32_t size)
 {
-    spi_flash_disable_interrupts_caches_and_other_cpu();
-    SpiFlashOpResult rc;
-    rc = spi_flash_unlock();
+    // Program one flash page at a time, and let the scheduler and the other
+    // CPU run between pages, so that long writes don't keep the caches
+    // disabled for the whole duration of the write
+    SPI_FLASH_COUNTER_START();
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    const uint32_t total_size = size;
+#endif
+    SpiFlashOpResult rc = SPI_FLASH_RESULT_OK;
+    while (size > 0 && rc == SPI_FLASH_RESULT_OK) {
+        uint32_t chunk = SPI_FLASH_PAGE_SIZE - (dest_addr % SPI_FLASH_PAGE_SIZE);
+        if (chunk > size) {
+            chunk = size;
+        }
+        spi_flash_disable_interrupts_caches_and_other_cpu();
+        rc = spi_flash_unlock();
+        if (rc == SPI_FLASH_RESULT_OK) {
+            rc = SPIWrite(dest_addr, src, (int32_t) chunk);
+        }
+        spi_flash_flush_mapped_cache();
+        spi_flash_enable_interrupts_caches_and_other_cpu();
+        dest_addr += chunk;
+        src += chunk / sizeof(uint32_t);
+        size -= chunk;
+    }
+    SPI_FLASH_COUNTER_ADD(write, total_size);
+    return spi_flash_translate_rc(rc);
+}
+
+esp_err_t IRAM_ATTR spi_flash_write_panic(uint32_t dest_addr, const uint32_t *src, uint32_t size)
+{
+    uint32_t saved_state[portNUM_PROCESSORS];
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        spi_flash_disable_cache(cpu, &saved_state[cpu]);
+    }
+    SpiFlashOpResult rc = spi_flash_unlock();
     if (rc == SPI_FLASH_RESULT_OK) {
         rc = SPIWrite(dest_addr, src, (int32_t) size);
     }
-    spi_flash_enable_interrupts_caches_and_other_cpu();
-    return spi_flash_translate_rc(rc);
+    spi_flash_flush_mapped_cache();
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        spi_flash_restore_cache(cpu, saved_state[cpu]);
+    }
+    // spi_flash_translate_rc is in flash, which may be unusable in a panic
+    return (rc == SPI_FLASH_RESULT_OK) ? ESP_OK : ESP_ERR_FLASH_OP_FAIL;
 }
 
 esp_err_t IRAM_ATTR spi_flash_read(uint32_t src_addr, uint32_t *dest, uint32_t size)
 {
+    SPI_FLASH_COUNTER_START();
     spi_flash_disable_interrupts_caches_and_other_cpu();
     SpiFlashOpResult rc;
     rc = SPIRead(src_addr, dest, (int32_t) size);
     spi_flash_enable_interrupts_caches_and_other_cpu();
+    SPI_FLASH_COUNTER_ADD(read, size);
     return spi_flash_translate_rc(rc);
 }
 
+esp_err_t spi_flash_read_bytes(uint32_t src_addr, void* dest, size_t size)
+{
+    uint32_t bounce[SPI_FLASH_BOUNCE_WORDS];
+    uint8_t* dst = (uint8_t*) dest;
+    while (size > 0) {
+        const uint32_t offset = src_addr % sizeof(uint32_t);
+        if (offset == 0 && size >= sizeof(uint32_t) && (uintptr_t) dst % sizeof(uint32_t) == 0) {
+            // aligned part goes straight into the caller's buffer
+            const uint32_t len = size & ~(sizeof(uint32_t) - 1);
+            esp_err_t err = spi_flash_read(src_addr, (uint32_t*) dst, len);
+            if (err != ESP_OK) {
+                return err;
+            }
+            src_addr += len;
+            dst += len;
+            size -= len;
+            continue;
+        }
+        uint32_t len = sizeof(bounce) - offset;
+        if (len > size) {
+            len = size;
+        }
+        const uint32_t read_len = (offset + len + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+        esp_err_t err = spi_flash_read(src_addr - offset, bounce, read_len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        memcpy(dst, (const uint8_t*) bounce + offset, len);
+        src_addr += len;
+        dst += len;
+        size -= len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_write_bytes(uint32_t dest_addr, const void* src, size_t size)
+{
+    uint32_t bounce[SPI_FLASH_BOUNCE_WORDS];
+    const uint8_t* from = (const uint8_t*) src;
+    while (size > 0) {
+        const uint32_t offset = dest_addr % sizeof(uint32_t);
+        if (offset == 0 && size >= sizeof(uint32_t) && (uintptr_t) from % sizeof(uint32_t) == 0) {
+            const uint32_t len = size & ~(sizeof(uint32_t) - 1);
+            esp_err_t err = spi_flash_write(dest_addr, (const uint32_t*) from, len);
+            if (err != ESP_OK) {
+                return err;
+            }
+            dest_addr += len;
+            from += len;
+            size -= len;
+            continue;
+        }
+        uint32_t len = sizeof(bounce) - offset;
+        if (len > size) {
+            len = size;
+        }
+        const uint32_t write_len = (offset + len + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+        // programming only clears bits, so padding with 0xff leaves the
+        // neighbouring bytes in flash unchanged
+        memset(bounce, 0xff, write_len);
+        memcpy((uint8_t*) bounce + offset, from, len);
+        esp_err_t err = spi_flash_write(dest_addr - offset, bounce, write_len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        dest_addr += len;
+        from += len;
+        size -= len;
+    }
+    return ESP_OK;
+}
+
+static bool IRAM_ATTR spi_flash_mmap_can_reuse(uint32_t start, uint32_t first_page, uint32_t page_count)
+{
+    for (uint32_t i = 0; i < page_count; ++i) {
+        if (s_mmap_page_refcnt[start + i] == 0 || s_mmap_page_refcnt[start + i] == UINT8_MAX ||
+            FLASH_MMU_TABLE_PRO[start + i] != first_page + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool IRAM_ATTR spi_flash_mmap_is_free(uint32_t start, uint32_t page_count)
+{
+    for (uint32_t i = 0; i < page_count; ++i) {
+        if (s_mmap_page_refcnt[start + i] != 0 || FLASH_MMU_TABLE_PRO[start + i] != FLASH_MMU_INVALID_VAL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t IRAM_ATTR spi_flash_mmap(uint32_t src_addr, size_t size, const void** out_ptr, spi_flash_mmap_handle_t* out_handle)
+{
+    if (size == 0 || out_ptr == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint32_t first_page = src_addr / FLASH_MMU_PAGE_SIZE;
+    const uint32_t page_count = (src_addr + size + FLASH_MMU_PAGE_SIZE - 1) / FLASH_MMU_PAGE_SIZE - first_page;
+    if (page_count > FLASH_MMU_DROM0_PAGES) {
+        return ESP_ERR_NO_MEM;
+    }
+    const uint32_t last_start = FLASH_MMU_DROM0_PAGES - page_count;
+
+    spi_flash_disable_interrupts_caches_and_other_cpu();
+    // pages which are already mapped in the same order are shared,
+    // otherwise a run of unused entries is set up
+    uint32_t start;
+    bool reuse = false;
+    for (start = 0; start <= last_start; ++start) {
+        if (spi_flash_mmap_can_reuse(start, first_page, page_count)) {
+            reuse = true;
+            break;
+        }
+    }
+    if (!reuse) {
+        for (start = 0; start <= last_start; ++start) {
+            if (spi_flash_mmap_is_free(start, page_count)) {
+                break;
+            }
+        }
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (start <= last_start) {
+        for (uint32_t i = 0; i < page_count; ++i) {
+            if (s_mmap_page_refcnt[start + i]++ == 0) {
+                FLASH_MMU_TABLE_PRO[start + i] = first_page + i;
+                FLASH_MMU_TABLE_APP[start + i] = first_page + i;
+                ++s_mmap_page_count;
+            }
+        }
+        if (!reuse) {
+            // cache may still hold data of whatever was mapped there before
+            spi_flash_flush_mapped_cache();
+        }
+        *out_ptr = (const void*) (FLASH_MMU_DROM0_VADDR + start * FLASH_MMU_PAGE_SIZE +
+                                  (src_addr - first_page * FLASH_MMU_PAGE_SIZE));
+        *out_handle = (start << 16) | page_count;
+        err = ESP_OK;
+    }
+    spi_flash_enable_interrupts_caches_and_other_cpu();
+    return err;
+}
+
+void IRAM_ATTR spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+    const uint32_t start = handle >> 16;
+    const uint32_t page_count = handle & 0xffff;
+    assert(start + page_count <= FLASH_MMU_DROM0_PAGES);
+
+    spi_flash_disable_interrupts_caches_and_other_cpu();
+    for (uint32_t i = 0; i < page_count; ++i) {
+        assert(s_mmap_page_refcnt[start + i] > 0);
+        if (--s_mmap_page_refcnt[start + i] == 0) {
+            FLASH_MMU_TABLE_PRO[start + i] = FLASH_MMU_INVALID_VAL;
+            FLASH_MMU_TABLE_APP[start + i] = FLASH_MMU_INVALID_VAL;
+            --s_mmap_page_count;
+        }
+    }
+    spi_flash_enable_interrupts_caches_and_other_cpu();
+}
+
+esp_err_t spi_flash_read_mmap(uint32_t src_addr, void* dest, size_t size)
+{
+    // Copy through the flash cache: the cache reads flash in the configured
+    // (dual/quad) mode, and the other CPU keeps running while data is copied.
+    const void* ptr;
+    spi_flash_mmap_handle_t handle;
+    esp_err_t err = spi_flash_mmap(src_addr, size, &ptr, &handle);
+    if (err == ESP_ERR_NO_MEM) {
+        return spi_flash_read_bytes(src_addr, dest, size);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    memcpy(dest, ptr, size);
+    spi_flash_munmap(handle);
+    return ESP_OK;
+}
+
+void spi_flash_mmap_dump()
+{
+    for (uint32_t i = 0; i < FLASH_MMU_DROM0_PAGES; ++i) {
+        if (s_mmap_page_refcnt[i] != 0) {
+            printf("page %d: refcnt=%d vaddr=0x%08x paddr=0x%08x\n",
+                   (int) i, (int) s_mmap_page_refcnt[i],
+                   (unsigned) (FLASH_MMU_DROM0_VADDR + i * FLASH_MMU_PAGE_SIZE),
+                   (unsigned) (FLASH_MMU_TABLE_PRO[i] * FLASH_MMU_PAGE_SIZE));
+        }
+    }
+}
+
+static void IRAM_ATTR spi_flash_flush_mapped_cache()
+{
+    // called with caches disabled, after flash contents have changed.
+    // stale lines of mapped regions can't be told apart from others, so the
+    // whole cache is flushed, but only if anything is mapped
+    if (s_mmap_page_count == 0) {
+        return;
+    }
+    Cache_Flush(0);
+#ifndef CONFIG_FREERTOS_UNICORE
+    Cache_Flush(1);
+#endif
+}
+
 static esp_err_t spi_flash_translate_rc(SpiFlashOpResult rc)
 {
     switch (rc) {
@@ -243,6 +674,9 @@ static const uint32_t cache_mask  = DPORT_APP_CACHE_MASK_OPSDRAM | DPORT_APP_CAC
 
 static void IRAM_ATTR spi_flash_disable_cache(uint32_t cpuid, uint32_t* saved_state)
 {
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    s_flash_cache_disable_ccount[cpuid] = spi_flash_ccount();
+#endif
     uint32_t ret = 0;
     if (cpuid == 0) {
         ret |= GET_PERI_REG_BITS2(DPORT_PRO_CACHE_CTRL1_REG, cache_mask, 0);
@@ -269,4 +703,59 @@ static void IRAM_ATTR spi_flash_restore_cache(uint32_t cpuid, uint32_t saved_sta
         SET_PERI_REG_BITS(DPORT_APP_CACHE_CTRL_REG, 1, 1, DPORT_APP_CACHE_ENABLE_S);
         SET_PERI_REG_BITS(DPORT_APP_CACHE_CTRL1_REG, cache_mask, saved_state, 0);
     }
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    s_flash_counters.cache_disabled_time[cpuid] += spi_flash_us_since(s_flash_cache_disable_ccount[cpuid]);
+#endif
+}
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
+void spi_flash_reset_counters()
+{
+    portENTER_CRITICAL(&s_flash_counters_mux);
+    memset(&s_flash_counters, 0, sizeof(s_flash_counters));
+    portEXIT_CRITICAL(&s_flash_counters_mux);
 }
+
+const spi_flash_counters_t* spi_flash_get_counters()
+{
+    return &s_flash_counters;
+}
+
+static void spi_flash_dump_counter(const char* name, const spi_flash_counter_t* counter)
+{
+    ESP_LOGI(TAG, "%s: count=%u bytes=%u time=%uus max=%uus", name, counter->count,
+             counter->bytes, counter->time, counter->max_time);
+    for (size_t i = 0; i < SPI_FLASH_COUNTER_BUCKETS; ++i) {
+        if (counter->histogram[i] == 0) {
+            continue;
+        }
+        if (i < SPI_FLASH_COUNTER_BUCKETS - 1) {
+            ESP_LOGI(TAG, "  <%uus: %u", 32u << i, counter->histogram[i]);
+        } else {
+            ESP_LOGI(TAG, "  >=%uus: %u", 32u << (i - 1), counter->histogram[i]);
+        }
+    }
+}
+
+void spi_flash_dump_counters()
+{
+    spi_flash_dump_counter("read", &s_flash_counters.read);
+    spi_flash_dump_counter("write", &s_flash_counters.write);
+    spi_flash_dump_counter("erase", &s_flash_counters.erase);
+    ESP_LOGI(TAG, "cache disabled: PRO=%uus APP=%uus, mutex wait=%uus",
+             s_flash_counters.cache_disabled_time[0], s_flash_counters.cache_disabled_time[1],
+             s_flash_counters.mutex_wait_time);
+    for (size_t i = 0; i < SPI_FLASH_COUNTER_CALLERS; ++i) {
+        const spi_flash_caller_counter_t* it = &s_flash_counters.callers[i];
+        if (it->caller != NULL) {
+            ESP_LOGI(TAG, "caller %p: count=%u time=%uus", it->caller, it->count, it->time);
+        }
+    }
+    if (s_flash_counters.other_callers.count != 0) {
+        ESP_LOGI(TAG, "other callers: count=%u time=%uus",
+                 s_flash_counters.other_callers.count, s_flash_counters.other_callers.time);
+    }
+}
+
+#endif // CONFIG_SPI_FLASH_ENABLE_COUNTERS
@@ -0,0 +1,168 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_spi_flash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Partition table of the application.
+ *
+ * esp_partition_init reads the partition table, written by gen_esp32part.py
+ * at 0x4000 (see bootloader_config.h), once at startup into RAM. Lookups
+ * by type, subtype or label then don't access the flash, and the
+ * partition-relative read, write, erase and mmap functions check that the
+ * access stays inside the partition.
+ */
+
+#define ESP_ERR_PARTITION_BASE          0x1700
+#define ESP_ERR_PARTITION_OUT_OF_RANGE  (ESP_ERR_PARTITION_BASE + 0x01) /**< Access outside of the partition */
+#define ESP_ERR_PARTITION_NOT_ALIGNED   (ESP_ERR_PARTITION_BASE + 0x02) /**< Erase range not sector aligned */
+
+#define ESP_PARTITION_LABEL_SIZE        16
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+    ESP_PARTITION_TYPE_ANY = 0xff,      /**< Matches any type in esp_partition_find_* */
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_APP_FACTORY = 0x00,
+    ESP_PARTITION_SUBTYPE_APP_OTA_MIN = 0x10,   /**< ota_0, ota_N is ESP_PARTITION_SUBTYPE_APP_OTA_MIN + N */
+    ESP_PARTITION_SUBTYPE_APP_OTA_MAX = 0x1f,
+    ESP_PARTITION_SUBTYPE_APP_TEST = 0x20,
+
+    ESP_PARTITION_SUBTYPE_DATA_OTA = 0x00,
+    ESP_PARTITION_SUBTYPE_DATA_RF = 0x01,
+    ESP_PARTITION_SUBTYPE_DATA_WIFI = 0x02,
+    ESP_PARTITION_SUBTYPE_DATA_COREDUMP = 0x03,
+    ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS = 0x04, /**< Key of the NVS encryption, see CONFIG_NVS_ENCRYPTION */
+
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,   /**< Matches any subtype in esp_partition_find_* */
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;                   /**< in flash */
+    uint32_t size;
+    char label[ESP_PARTITION_LABEL_SIZE + 1];   /**< zero terminated */
+} esp_partition_t;
+
+/**
+ * @brief  Read the partition table into RAM.
+ *
+ * Called at startup once spi_flash_init has been called. The table isn't
+ * read again; esp_partition_find_* return NULL if it couldn't be read.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM, or an error of spi_flash_read
+ */
+esp_err_t esp_partition_init(void);
+
+/**
+ * @brief  Find the first partition, in the order of the partition table,
+ *         which matches type, subtype and label.
+ *
+ * @param  type    : partition type, or ESP_PARTITION_TYPE_ANY
+ * @param  subtype : partition subtype, or ESP_PARTITION_SUBTYPE_ANY
+ * @param  label   : partition label, or NULL for any label
+ *
+ * @return the partition, valid until reset, or NULL if none matches
+ */
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char* label);
+
+/**
+ * @brief  Find the next partition after prev which matches type, subtype
+ *         and label, see esp_partition_find_first.
+ *
+ * @param  prev : partition returned by esp_partition_find_first or
+ *                esp_partition_find_next
+ *
+ * @return the partition, or NULL if no other one matches
+ */
+const esp_partition_t* esp_partition_find_next(const esp_partition_t* prev,
+        esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label);
+
+/**
+ * @brief  Read data from a partition, without alignment requirements.
+ *
+ * @param  part       : partition
+ * @param  src_offset : offset of the data in the partition
+ * @param  dst        : destination buffer
+ * @param  size       : length of data, in bytes
+ *
+ * @return ESP_OK, ESP_ERR_PARTITION_OUT_OF_RANGE, or an error of
+ *         spi_flash_read_bytes
+ */
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t src_offset, void* dst, size_t size);
+
+/**
+ * @brief  Write data to a partition, without alignment requirements.
+ *
+ * The range has to be erased before, see esp_partition_erase_range.
+ *
+ * @param  part       : partition
+ * @param  dst_offset : offset of the data in the partition
+ * @param  src        : source data, must not be located in Flash
+ * @param  size       : length of data, in bytes
+ *
+ * @return ESP_OK, ESP_ERR_PARTITION_OUT_OF_RANGE, or an error of
+ *         spi_flash_write_bytes
+ */
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t dst_offset, const void* src, size_t size);
+
+/**
+ * @brief  Erase a range of a partition.
+ *
+ * @param  part  : partition
+ * @param  start : offset of the range in the partition, a multiple of
+ *                 SPI_FLASH_SEC_SIZE
+ * @param  size  : length of the range, a multiple of SPI_FLASH_SEC_SIZE
+ *
+ * @return ESP_OK, ESP_ERR_PARTITION_OUT_OF_RANGE,
+ *         ESP_ERR_PARTITION_NOT_ALIGNED, or an error of spi_flash_erase_sector
+ */
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t start, size_t size);
+
+/**
+ * @brief  Map a range of a partition into the data address space, see
+ *         spi_flash_mmap.
+ *
+ * @param  part       : partition
+ * @param  offset     : offset of the range in the partition
+ * @param  size       : length of the range, in bytes
+ * @param  out_ptr    : set to the address of the range
+ * @param  out_handle : set to the handle to pass to spi_flash_munmap
+ *
+ * @return ESP_OK, ESP_ERR_PARTITION_OUT_OF_RANGE, or an error of
+ *         spi_flash_mmap
+ */
+esp_err_t esp_partition_mmap(const esp_partition_t* part, size_t offset, size_t size,
+                             const void** out_ptr, spi_flash_mmap_handle_t* out_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESP_PARTITION_H */
@@ -16,7 +16,9 @@
 #define ESP_SPI_FLASH_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,6 +29,7 @@ extern "C" {
 #define ESP_ERR_FLASH_OP_TIMEOUT (ESP_ERR_FLASH_BASE + 2)
 
 #define SPI_FLASH_SEC_SIZE  4096    /**< SPI Flash sector size */
+#define SPI_FLASH_PAGE_SIZE 256     /**< SPI Flash program page size */
 
 /**
  * @brief  Initialize SPI flash access driver
@@ -49,6 +52,10 @@ esp_err_t spi_flash_erase_sector(uint16_t sec);
 /**
  * @brief  Write data to Flash.
  *
+ * Data is programmed one page (SPI_FLASH_PAGE_SIZE bytes) at a time. Other
+ * tasks and the other CPU may run between pages, so a concurrent reader
+ * may observe a partially written region.
+ *
  * @param  uint32 des_addr  : destination address in Flash.
  * @param  uint32 *src_addr : source address of the data.
  * @param  uint32 size      : length of data
@@ -57,9 +64,29 @@ esp_err_t spi_flash_erase_sector(uint16_t sec);
  */
 esp_err_t spi_flash_write(uint32_t des_addr, const uint32_t *src_addr, uint32_t size);
 
+/**
+ * @brief  Write data to Flash from the panic handler.
+ *
+ * Unlike spi_flash_write, doesn't take locks or call the other CPU, and
+ * disables the caches of both CPUs directly. Only for use once the other
+ * CPU has been stalled, with the scheduler no longer running, such as by
+ * the core dump written on panic. The region has to be erased already.
+ *
+ * @param  uint32 des_addr  : destination address in Flash.
+ * @param  uint32 *src_addr : source address of the data, in internal RAM.
+ * @param  uint32 size      : length of data, multiple of 4
+ *
+ * @return ESP_OK on success, ESP_ERR_FLASH_OP_FAIL if the write fails
+ */
+esp_err_t spi_flash_write_panic(uint32_t des_addr, const uint32_t *src_addr, uint32_t size);
+
 /**
  * @brief  Read data from Flash.
  *
+ * Uses the ROM SPIRead routine with the caches of both CPUs disabled, so it
+ * can be called while the cache is disabled. Data is returned as stored in
+ * Flash. For large reads from task context, spi_flash_read_mmap is faster.
+ *
  * @param  uint32 src_addr  : source address of the data in Flash.
  * @param  uint32 *des_addr : destination address.
  * @param  uint32 size      : length of data
@@ -68,6 +95,190 @@ esp_err_t spi_flash_write(uint32_t des_addr, const uint32_t *src_addr, uint32_t
  */
 esp_err_t spi_flash_read(uint32_t src_addr, uint32_t *des_addr, uint32_t size);
 
+/**
+ * @brief  Read data from Flash, without alignment requirements.
+ *
+ * Parts which are 4-byte aligned both in Flash and in the buffer are read
+ * directly into dest; the rest is read through a small internal buffer.
+ *
+ * @param  uint32 src_addr : source address of the data in Flash.
+ * @param  dest            : destination buffer.
+ * @param  size_t size     : length of data, in bytes
+ *
+ * @return esp_err_t
+ */
+esp_err_t spi_flash_read_bytes(uint32_t src_addr, void* dest, size_t size);
+
+/**
+ * @brief  Write data to Flash, without alignment requirements.
+ *
+ * Parts which are 4-byte aligned both in Flash and in the buffer are written
+ * directly from src. Unaligned head and tail are copied into an internal
+ * buffer and padded with 0xff, so bytes next to the written range are not
+ * modified.
+ *
+ * @param  uint32 des_addr : destination address in Flash.
+ * @param  src             : source data, must not be located in Flash.
+ * @param  size_t size     : length of data, in bytes
+ *
+ * @return esp_err_t
+ */
+esp_err_t spi_flash_write_bytes(uint32_t des_addr, const void* src, size_t size);
+
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+
+/**
+ * @brief  Write data to Flash through the write combining buffer.
+ *
+ * Sequential writes within one Flash page are collected in RAM and
+ * programmed with a single operation once the page is filled, when
+ * spi_flash_write_buffer_flush is called, or when no buffered write was
+ * made for CONFIG_SPI_FLASH_WRITE_BUFFER_TIMEOUT milliseconds. Buffered
+ * data is not visible to spi_flash_read, and must be flushed before the
+ * range it belongs to is read or erased.
+ *
+ * @param  uint32 des_addr : destination address in Flash.
+ * @param  src             : source data, must not be located in Flash.
+ * @param  size_t size     : length of data, in bytes
+ *
+ * @return ESP_OK, or the error of a Flash operation. If writing the buffer
+ *         on timeout failed, the error is returned by the next call to this
+ *         function or spi_flash_write_buffer_flush, and no data is written
+ *         by that call.
+ */
+esp_err_t spi_flash_write_buffered(uint32_t des_addr, const void* src, size_t size);
+
+/**
+ * @brief  Write buffered data to Flash, see spi_flash_write_buffered.
+ *
+ * @return esp_err_t
+ */
+esp_err_t spi_flash_write_buffer_flush();
+
+#endif // CONFIG_SPI_FLASH_WRITE_BUFFER
+
+/**
+ * @brief  Opaque handle of a region mapped by spi_flash_mmap
+ */
+typedef uint32_t spi_flash_mmap_handle_t;
+
+/**
+ * @brief  Map a region of Flash into the data address space.
+ *
+ * The region can then be read with plain loads through the Flash cache,
+ * which is much cheaper than spi_flash_read and doesn't stop the other CPU.
+ * Regions are mapped in 64KB pages into the DROM0 window
+ * (0x3F400000 - 0x3F7FFFFF), and the returned pointer is only valid for
+ * reads. spi_flash_write and spi_flash_erase_sector invalidate cached
+ * data of mapped regions, so reads always return the current contents.
+ *
+ * MMU pages are reference counted. Mapping a range whose pages are already
+ * mapped by an earlier call shares these pages, and they stay mapped until
+ * every handle referring to them is passed to spi_flash_munmap.
+ *
+ * @param  uint32 src_addr  : address of the region in Flash.
+ * @param  size_t size      : size of the region.
+ * @param  out_ptr          : pointer to the start of the region is returned here.
+ * @param  out_handle       : handle to be passed to spi_flash_munmap.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if size is 0 or
+ *         ESP_ERR_NO_MEM if there are not enough unused MMU entries
+ */
+esp_err_t spi_flash_mmap(uint32_t src_addr, size_t size, const void** out_ptr, spi_flash_mmap_handle_t* out_handle);
+
+/**
+ * @brief  Release a region mapped by spi_flash_mmap.
+ *
+ * @param  handle : handle returned by spi_flash_mmap.
+ */
+void spi_flash_munmap(spi_flash_mmap_handle_t handle);
+
+/**
+ * @brief  Read a large region of Flash through a temporary mapping.
+ *
+ * The region is mapped with spi_flash_mmap and copied with memcpy, so Flash
+ * is read by the cache in the configured (dual/quad) mode and the other CPU
+ * keeps running. Unlike spi_flash_read this takes locks, and must not be
+ * called from an ISR or while the cache is disabled. Data is read as seen
+ * through the cache, i.e. decrypted if the region is flash encrypted. Falls
+ * back to spi_flash_read_bytes if there are not enough unused MMU entries.
+ * There are no alignment requirements.
+ *
+ * @param  uint32 src_addr : source address of the data in Flash.
+ * @param  dest            : destination buffer.
+ * @param  size_t size     : length of data, in bytes
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if size is 0, or the error of
+ *         spi_flash_read_bytes
+ */
+esp_err_t spi_flash_read_mmap(uint32_t src_addr, void* dest, size_t size);
+
+/**
+ * @brief  Print the MMU pages set up by spi_flash_mmap, with their reference
+ *         counts and addresses. For debugging.
+ */
+void spi_flash_mmap_dump();
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
+#define SPI_FLASH_COUNTER_BUCKETS   10  /**< number of latency histogram buckets */
+#define SPI_FLASH_COUNTER_CALLERS   8   /**< number of callers tracked separately */
+
+/**
+ * @brief  Statistics of one type of flash operation
+ *
+ * Times are in microseconds and include waiting for the flash API lock.
+ * Bucket i of the histogram counts operations which took less than
+ * (32 << i) us; the last bucket counts all longer operations.
+ */
+typedef struct {
+    uint32_t count;         /**< number of operations */
+    uint32_t bytes;         /**< number of bytes read, written or erased */
+    uint32_t time;          /**< total time */
+    uint32_t max_time;      /**< longest operation */
+    uint32_t histogram[SPI_FLASH_COUNTER_BUCKETS];
+} spi_flash_counter_t;
+
+/**
+ * @brief  Operations issued from one call site
+ */
+typedef struct {
+    const void* caller;     /**< return address of the spi_flash_* call */
+    uint32_t count;         /**< number of operations of all types */
+    uint32_t time;          /**< total time of these operations, in microseconds */
+} spi_flash_caller_counter_t;
+
+/**
+ * @brief  Flash driver statistics, see spi_flash_get_counters
+ */
+typedef struct {
+    spi_flash_counter_t read;
+    spi_flash_counter_t write;
+    spi_flash_counter_t erase;
+    uint32_t cache_disabled_time[2];    /**< time with cache disabled, per CPU, in microseconds */
+    uint32_t mutex_wait_time;           /**< time spent waiting for the flash API lock, in microseconds */
+    spi_flash_caller_counter_t callers[SPI_FLASH_COUNTER_CALLERS];
+    spi_flash_caller_counter_t other_callers;   /**< callers which didn't fit into 'callers' */
+} spi_flash_counters_t;
+
+/**
+ * @brief  Reset all flash driver statistics to zero
+ */
+void spi_flash_reset_counters();
+
+/**
+ * @brief  Get flash driver statistics collected since start or the last
+ *         spi_flash_reset_counters call
+ */
+const spi_flash_counters_t* spi_flash_get_counters();
+
+/**
+ * @brief  Print flash driver statistics using esp_log
+ */
+void spi_flash_dump_counters();
+
+#endif // CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,93 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ESP_SPI_FLASH_ASYNC_H
+#define ESP_SPI_FLASH_ASYNC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  Type of an asynchronous flash request
+ */
+typedef enum {
+    SPI_FLASH_ASYNC_READ,       /**< read into buf, like spi_flash_read */
+    SPI_FLASH_ASYNC_WRITE,      /**< write buf, like spi_flash_write */
+    SPI_FLASH_ASYNC_ERASE,      /**< erase sectors; addr and size must be multiples of SPI_FLASH_SEC_SIZE */
+} spi_flash_async_op_t;
+
+struct spi_flash_async_req_t;
+
+/**
+ * @brief  Called by the flash task once a request has been completed
+ */
+typedef void (*spi_flash_async_cb_t)(struct spi_flash_async_req_t* req, esp_err_t result);
+
+/**
+ * @brief  Asynchronous flash request
+ *
+ * The request is owned by the caller, and must stay valid, together with
+ * the buffer, until it has completed. Fields after 'done' are used by the
+ * driver.
+ */
+typedef struct spi_flash_async_req_t {
+    spi_flash_async_op_t op;        /**< type of request */
+    uint32_t addr;                  /**< address in flash */
+    uint32_t* buf;                  /**< data to write or buffer to read into, unused for erase */
+    uint32_t size;                  /**< size in bytes */
+    spi_flash_async_cb_t callback;  /**< called on completion, can be NULL */
+    void* arg;                      /**< for use by the callback */
+    SemaphoreHandle_t done;         /**< given on completion, can be NULL */
+    esp_err_t result;               /**< result of the request, set before completion is signalled */
+    struct spi_flash_async_req_t* next;
+} spi_flash_async_req_t;
+
+/**
+ * @brief  Start the task which executes asynchronous flash requests
+ *
+ * @param  priority : priority of the flash task
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started or
+ *         ESP_ERR_NO_MEM if the task can't be created
+ */
+esp_err_t spi_flash_async_init(UBaseType_t priority);
+
+/**
+ * @brief  Queue a flash request
+ *
+ * Requests are executed in the order they were submitted. Reads, writes
+ * and erases of adjacent flash ranges which are queued one after another
+ * are combined into one operation; for reads and writes, their buffers
+ * must be adjacent as well. Callbacks are invoked in submission order,
+ * from the flash task.
+ *
+ * @param  req : request, see spi_flash_async_req_t
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if spi_flash_async_init wasn't
+ *         called or ESP_ERR_INVALID_ARG if the request has invalid size
+ *         or alignment
+ */
+esp_err_t spi_flash_async_submit(spi_flash_async_req_t* req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESP_SPI_FLASH_ASYNC_H */
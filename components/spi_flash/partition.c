@@ -0,0 +1,165 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_spi_flash.h"
+#include "esp_partition.h"
+
+/* Partition table layout, see bootloader_config.h and gen_esp32part.py */
+#define PARTITION_TABLE_ADDR    0x4000
+#define PARTITION_TABLE_SIZE    SPI_FLASH_SEC_SIZE
+#define PARTITION_MAGIC         0x50AA
+
+typedef struct {
+    uint16_t magic;
+    uint8_t  type;
+    uint8_t  subtype;
+    uint32_t offset;
+    uint32_t size;
+    uint8_t  label[ESP_PARTITION_LABEL_SIZE];
+    uint8_t  reserved[4];
+} partition_info_t;
+
+static const char* TAG = "partition";
+
+/* Set once by esp_partition_init, in the order of the partition table.
+   A table has a few entries at most, so lookups scan the array. */
+static esp_partition_t* s_partitions;
+static size_t s_partition_count;
+
+esp_err_t esp_partition_init(void)
+{
+    if (s_partitions != NULL) {
+        return ESP_OK;
+    }
+    partition_info_t* table = malloc(PARTITION_TABLE_SIZE);
+    if (table == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = spi_flash_read(PARTITION_TABLE_ADDR, (uint32_t*) table, PARTITION_TABLE_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "failed to read partition table (0x%x)", err);
+        free(table);
+        return err;
+    }
+    size_t count = 0;
+    while (count < PARTITION_TABLE_SIZE / sizeof(partition_info_t)
+            && table[count].magic == PARTITION_MAGIC) {
+        ++count;
+    }
+    esp_partition_t* parts = calloc(count ? count : 1, sizeof(esp_partition_t));
+    if (parts == NULL) {
+        free(table);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        parts[i].type = (esp_partition_type_t) table[i].type;
+        parts[i].subtype = (esp_partition_subtype_t) table[i].subtype;
+        parts[i].address = table[i].offset;
+        parts[i].size = table[i].size;
+        memcpy(parts[i].label, table[i].label, ESP_PARTITION_LABEL_SIZE);
+        ESP_LOGD(TAG, "%-16s type %02x subtype %02x at 0x%08x, 0x%x bytes", parts[i].label,
+                 parts[i].type, parts[i].subtype, parts[i].address, parts[i].size);
+    }
+    free(table);
+    s_partition_count = count;
+    s_partitions = parts;
+    return ESP_OK;
+}
+
+static bool partition_matches(const esp_partition_t* part, esp_partition_type_t type,
+                              esp_partition_subtype_t subtype, const char* label)
+{
+    return (type == ESP_PARTITION_TYPE_ANY || part->type == type)
+           && (subtype == ESP_PARTITION_SUBTYPE_ANY || part->subtype == subtype)
+           && (label == NULL || strncmp(part->label, label, sizeof(part->label)) == 0);
+}
+
+static const esp_partition_t* partition_find_from(size_t index, esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char* label)
+{
+    for (; index < s_partition_count; ++index) {
+        if (partition_matches(&s_partitions[index], type, subtype, label)) {
+            return &s_partitions[index];
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char* label)
+{
+    return partition_find_from(0, type, subtype, label);
+}
+
+const esp_partition_t* esp_partition_find_next(const esp_partition_t* prev,
+        esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+{
+    if (prev < s_partitions || prev >= s_partitions + s_partition_count) {
+        return NULL;
+    }
+    return partition_find_from(prev - s_partitions + 1, type, subtype, label);
+}
+
+static bool partition_in_range(const esp_partition_t* part, size_t offset, size_t size)
+{
+    return offset <= part->size && size <= part->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t src_offset, void* dst, size_t size)
+{
+    if (!partition_in_range(part, src_offset, size)) {
+        return ESP_ERR_PARTITION_OUT_OF_RANGE;
+    }
+    return spi_flash_read_bytes(part->address + src_offset, dst, size);
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t dst_offset, const void* src, size_t size)
+{
+    if (!partition_in_range(part, dst_offset, size)) {
+        return ESP_ERR_PARTITION_OUT_OF_RANGE;
+    }
+    return spi_flash_write_bytes(part->address + dst_offset, src, size);
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t start, size_t size)
+{
+    if (!partition_in_range(part, start, size)) {
+        return ESP_ERR_PARTITION_OUT_OF_RANGE;
+    }
+    uint32_t addr = part->address + start;
+    if (addr % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_PARTITION_NOT_ALIGNED;
+    }
+    for (uint32_t end = addr + size; addr < end; addr += SPI_FLASH_SEC_SIZE) {
+        esp_err_t err = spi_flash_erase_sector(addr / SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* part, size_t offset, size_t size,
+                             const void** out_ptr, spi_flash_mmap_handle_t* out_handle)
+{
+    if (!partition_in_range(part, offset, size)) {
+        return ESP_ERR_PARTITION_OUT_OF_RANGE;
+    }
+    return spi_flash_mmap(part->address + offset, size, out_ptr, out_handle);
+}
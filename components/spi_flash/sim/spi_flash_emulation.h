@@ -0,0 +1,406 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef spi_flash_emulation_h
+#define spi_flash_emulation_h
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include "esp_spi_flash.h"
+
+using std::copy;
+using std::begin;
+using std::end;
+using std::fill_n;
+
+/*
+ * Host implementation of the spi_flash API, backed by a RAM buffer.
+ *
+ * Creating a SpiFlashEmulator makes spi_flash_* functions operate on it,
+ * until it is destroyed. Like a real NOR flash, writes can only clear bits.
+ * Operation times are accumulated from a per-chip timing model. Operations can
+ * be made to fail, power cuts can interrupt a write or erase part way through,
+ * and bits can be flipped to emulate data corruption.
+ */
+
+class SpiFlashEmulator;
+
+void spi_flash_emulator_set(SpiFlashEmulator*);
+
+/**
+ * Operation times of a flash chip, in microseconds. readTimes and writeTimes
+ * are for block sizes from 4 to 4096 bytes, doubling at each step; times for
+ * other sizes are interpolated linearly.
+ */
+struct SpiFlashTiming
+{
+    static const size_t BLOCK_SIZE_COUNT = 11;
+
+    size_t readTimes[BLOCK_SIZE_COUNT];
+    size_t writeTimes[BLOCK_SIZE_COUNT];
+    size_t sectorEraseTime;
+
+    /** ESP8266, 160MHz CPU frequency, 80MHz flash frequency */
+    static const SpiFlashTiming& esp8266();
+};
+
+class SpiFlashEmulator
+{
+public:
+    SpiFlashEmulator(size_t sectorCount) : mUpperSectorBound(sectorCount), mTiming(SpiFlashTiming::esp8266())
+    {
+        mData.resize(sectorCount * SPI_FLASH_SEC_SIZE / 4, 0xffffffff);
+        mSectorEraseCounts.resize(sectorCount, 0);
+        spi_flash_emulator_set(this);
+    }
+
+    ~SpiFlashEmulator()
+    {
+        spi_flash_emulator_set(nullptr);
+    }
+
+    bool read(uint32_t* dest, uint32_t srcAddr, size_t size) const
+    {
+        if (srcAddr % 4 != 0 ||
+                size % 4 != 0 ||
+                srcAddr + size > mData.size() * 4) {
+            return false;
+        }
+
+        if (mPoweredOff) {
+            return false;
+        }
+
+        copy(begin(mData) + srcAddr / 4, begin(mData) + (srcAddr + size) / 4, dest);
+
+        ++mReadOps;
+        mReadBytes += size;
+        mTotalTime += getReadOpTime(static_cast<uint32_t>(size));
+        return true;
+    }
+
+    /**
+     * Data can be read straight from mData, like from flash mapped into
+     * the address space. Not counted in the read stats.
+     */
+    const void* mmap(uint32_t srcAddr, size_t size)
+    {
+        if (!mMmapEnabled || srcAddr + size > mData.size() * 4) {
+            return nullptr;
+        }
+        ++mMappingCount;
+        return bytes() + srcAddr;
+    }
+
+    void munmap()
+    {
+        // mapping may have been made by a Storage which outlived another emulator
+        if (mMappingCount > 0) {
+            --mMappingCount;
+        }
+    }
+
+    bool write(uint32_t dstAddr, const uint32_t* src, size_t size)
+    {
+        uint32_t sectorNumber = dstAddr/SPI_FLASH_SEC_SIZE;
+        if (sectorNumber < mLowerSectorBound || sectorNumber >= mUpperSectorBound) {
+            warn() << "invalid flash operation detected: write sector=" << sectorNumber << std::endl;
+            return false;
+        }
+        
+        if (dstAddr % 4 != 0 ||
+                size % 4 != 0 ||
+                dstAddr + size > mData.size() * 4) {
+            return false;
+        }
+        
+        if (mFailCountdown != SIZE_MAX && mFailCountdown-- == 0) {
+            return false;
+        }
+
+        size_t wordCount = size / 4;
+        if (!checkPower(wordCount)) {
+            // words which made it to flash before the power cut
+            for (size_t i = 0; i < wordCount; ++i) {
+                mData[dstAddr / 4 + i] &= src[i];
+            }
+            return false;
+        }
+
+        for (size_t i = 0; i < size / 4; ++i) {
+            uint32_t sv = src[i];
+            size_t pos = dstAddr / 4 + i;
+            uint32_t& dv = mData[pos];
+
+            if (((~dv) & sv) != 0) {   // are we trying to set some 0 bits to 1?
+                warn() << "invalid flash operation detected: dst=" << dstAddr << " size=" << size << " i=" << i << std::endl;
+                return false;
+            }
+
+            dv = sv;
+        }
+        ++mWriteOps;
+        mWriteBytes += size;
+        mTotalTime += getWriteOpTime(static_cast<uint32_t>(size));
+        return true;
+    }
+
+    /**
+     * Write with byte granularity. spi_flash_write_bytes pads the unaligned
+     * head and tail with 0xff, which leaves these bytes unchanged on a real
+     * chip. Here they are padded with their current contents instead, so that
+     * write() doesn't report padding as an attempt to set bits.
+     */
+    bool writeBytes(uint32_t dstAddr, const void* src, size_t size)
+    {
+        uint32_t first = dstAddr & ~3u;
+        uint32_t last = (dstAddr + static_cast<uint32_t>(size) + 3) & ~3u;
+        if (last > mData.size() * 4) {
+            return false;
+        }
+        std::vector<uint32_t> buf(begin(mData) + first / 4, begin(mData) + last / 4);
+        std::copy_n(static_cast<const uint8_t*>(src), size, reinterpret_cast<uint8_t*>(buf.data()) + (dstAddr - first));
+        return write(first, buf.data(), last - first);
+    }
+
+    bool readBytes(void* dest, uint32_t srcAddr, size_t size) const
+    {
+        uint32_t first = srcAddr & ~3u;
+        uint32_t last = (srcAddr + static_cast<uint32_t>(size) + 3) & ~3u;
+        std::vector<uint32_t> buf((last - first) / 4);
+        if (!read(buf.data(), first, last - first)) {
+            return false;
+        }
+        std::copy_n(reinterpret_cast<const uint8_t*>(buf.data()) + (srcAddr - first), size, static_cast<uint8_t*>(dest));
+        return true;
+    }
+
+    bool erase(uint32_t sectorNumber)
+    {
+        size_t offset = sectorNumber * SPI_FLASH_SEC_SIZE / 4;
+        if (offset > mData.size()) {
+            return false;
+        }
+        
+        if (sectorNumber < mLowerSectorBound || sectorNumber >= mUpperSectorBound) {
+            warn() << "invalid flash operation detected: erase sector=" << sectorNumber << std::endl;
+            return false;
+        }
+        
+        if (mFailCountdown != SIZE_MAX && mFailCountdown-- == 0) {
+            return false;
+        }
+
+        size_t wordCount = SPI_FLASH_SEC_SIZE / 4;
+        if (!checkPower(wordCount)) {
+            // erase was interrupted, part of the sector is erased
+            std::fill_n(begin(mData) + offset, wordCount, 0xffffffff);
+            return false;
+        }
+
+        std::fill_n(begin(mData) + offset, SPI_FLASH_SEC_SIZE / 4, 0xffffffff);
+
+        ++mEraseOps;
+        ++mSectorEraseCounts[sectorNumber];
+        mTotalTime += getEraseOpTime();
+        return true;
+    }
+    
+    /**
+     * Invert one bit of flash contents, bypassing the rules of flash writes.
+     */
+    void flipBit(uint32_t addr, unsigned bit)
+    {
+        assert(addr < size() && bit < 8);
+        reinterpret_cast<uint8_t*>(mData.data())[addr] ^= static_cast<uint8_t>(1 << bit);
+    }
+
+    /**
+     * Invert count randomly chosen bits in the range [addr, addr + len).
+     */
+    void flipRandomBits(uint32_t addr, size_t len, size_t count, uint32_t seed)
+    {
+        std::mt19937 gen(seed);
+        for (size_t i = 0; i < count; ++i) {
+            flipBit(addr + static_cast<uint32_t>(gen() % len), gen() % 8);
+        }
+    }
+
+    void randomize(uint32_t seed)
+    {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        gen.seed(seed);
+        std::generate_n(mData.data(), mData.size(), gen);
+    }
+
+    size_t size() const
+    {
+        return mData.size() * 4;
+    }
+
+    const uint32_t* words() const
+    {
+        return mData.data();
+    }
+
+    const uint8_t* bytes() const
+    {
+        return reinterpret_cast<const uint8_t*>(mData.data());
+    }
+
+    void clearStats()
+    {
+        mReadBytes = 0;
+        mWriteBytes = 0;
+        mEraseOps = 0;
+        mReadOps = 0;
+        mWriteOps = 0;
+        mTotalTime = 0;
+    }
+
+    size_t getReadOps() const
+    {
+        return mReadOps;
+    }
+    size_t getWriteOps() const
+    {
+        return mWriteOps;
+    }
+    size_t getEraseOps() const
+    {
+        return mEraseOps;
+    }
+    size_t getReadBytes() const
+    {
+        return mReadBytes;
+    }
+    size_t getWriteBytes() const
+    {
+        return mWriteBytes;
+    }
+    size_t getTotalTime() const
+    {
+        return mTotalTime;
+    }
+
+    size_t getSectorEraseCount(uint32_t sectorNumber) const
+    {
+        return mSectorEraseCounts[sectorNumber];
+    }
+    
+    void setBounds(uint32_t lowerSector, uint32_t upperSector) {
+        mLowerSectorBound = lowerSector;
+        mUpperSectorBound = upperSector;
+    }
+    
+    void setMmapEnabled(bool enabled) {
+        mMmapEnabled = enabled;
+    }
+
+    size_t getMappingCount() const {
+        return mMappingCount;
+    }
+
+    void setTiming(const SpiFlashTiming& timing) {
+        mTiming = timing;
+    }
+
+    /**
+     * Make the write or erase operation after the next 'count' ones fail,
+     * without changing flash contents. Later operations succeed.
+     */
+    void failAfter(uint32_t count) {
+        mFailCountdown = count;
+    }
+
+    /**
+     * Cut power during the write or erase operation after the next 'count'
+     * ones. Only the first 'wordsDone' words of that operation reach flash
+     * (for an erase, get erased). All operations fail until clearFailure is
+     * called.
+     */
+    void powerCutAfter(uint32_t count, size_t wordsDone = 0) {
+        mPowerCutCountdown = count;
+        mPowerCutWords = wordsDone;
+    }
+
+    bool isPoweredOff() const {
+        return mPoweredOff;
+    }
+
+    void clearFailure() {
+        mFailCountdown = SIZE_MAX;
+        mPowerCutCountdown = SIZE_MAX;
+        mPoweredOff = false;
+    }
+
+protected:
+    size_t getReadOpTime(uint32_t bytes) const;
+    size_t getWriteOpTime(uint32_t bytes) const;
+    size_t getEraseOpTime() const;
+
+    /**
+     * Returns false if power is (or is being) cut; wordCount is then set to
+     * the number of words the interrupted operation gets to change.
+     */
+    bool checkPower(size_t& wordCount)
+    {
+        if (mPoweredOff) {
+            wordCount = 0;
+            return false;
+        }
+        if (mPowerCutCountdown != SIZE_MAX && mPowerCutCountdown-- == 0) {
+            mPoweredOff = true;
+            wordCount = std::min(wordCount, mPowerCutWords);
+            return false;
+        }
+        return true;
+    }
+
+    static std::ostream& warn()
+    {
+        return std::cerr << "spi_flash_emulation: ";
+    }
+
+
+    std::vector<uint32_t> mData;
+    std::vector<size_t> mSectorEraseCounts;
+
+    mutable size_t mReadOps = 0;
+    mutable size_t mWriteOps = 0;
+    mutable size_t mReadBytes = 0;
+    mutable size_t mWriteBytes = 0;
+    mutable size_t mEraseOps = 0;
+    mutable size_t mTotalTime = 0;
+    size_t mLowerSectorBound = 0;
+    size_t mUpperSectorBound = 0;
+    
+    size_t mFailCountdown = SIZE_MAX;
+    size_t mPowerCutCountdown = SIZE_MAX;
+    size_t mPowerCutWords = 0;
+    bool mPoweredOff = false;
+    SpiFlashTiming mTiming;
+
+    bool mMmapEnabled = false;
+    size_t mMappingCount = 0;
+
+};
+
+
+
+#endif /* spi_flash_emulation_h */
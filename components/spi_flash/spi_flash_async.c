@@ -0,0 +1,164 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "esp_spi_flash.h"
+#include "esp_spi_flash_async.h"
+
+/*
+    Asynchronous flash requests
+
+    Requests are kept in a singly linked list (s_queue_head, s_queue_tail),
+    protected by s_queue_mux. The flash task takes the whole list at once,
+    then walks it, merging each request with the following ones as long as
+    they are of the same type and continue the same flash range (and, for
+    reads and writes, the same buffer). Every merged run is executed with a
+    single spi_flash_* call, and the result is reported to all requests of
+    the run.
+
+    Requests are never reordered. Executing an erase ahead of an earlier
+    write to the same sector would change the outcome, and unrelated
+    requests don't gain anything from being reordered.
+*/
+
+// largest run merged into one operation, bounds the latency of later requests
+#define SPI_FLASH_ASYNC_MAX_RUN     (16 * SPI_FLASH_SEC_SIZE)
+#define SPI_FLASH_ASYNC_STACK_SIZE  2048
+
+static portMUX_TYPE s_queue_mux = portMUX_INITIALIZER_UNLOCKED;
+static spi_flash_async_req_t* s_queue_head = NULL;
+static spi_flash_async_req_t* s_queue_tail = NULL;
+static SemaphoreHandle_t s_queue_sem = NULL;
+
+static bool spi_flash_async_can_merge(const spi_flash_async_req_t* run, uint32_t run_size,
+                                      const spi_flash_async_req_t* req)
+{
+    if (req->op != run->op || req->addr != run->addr + run_size ||
+        run_size + req->size > SPI_FLASH_ASYNC_MAX_RUN) {
+        return false;
+    }
+    return run->op == SPI_FLASH_ASYNC_ERASE ||
+           req->buf == run->buf + run_size / sizeof(uint32_t);
+}
+
+static esp_err_t spi_flash_async_execute(const spi_flash_async_req_t* run, uint32_t size)
+{
+    switch (run->op) {
+    case SPI_FLASH_ASYNC_READ:
+        return spi_flash_read(run->addr, run->buf, size);
+    case SPI_FLASH_ASYNC_WRITE:
+        return spi_flash_write(run->addr, run->buf, size);
+    case SPI_FLASH_ASYNC_ERASE:
+        for (uint32_t offset = 0; offset < size; offset += SPI_FLASH_SEC_SIZE) {
+            esp_err_t err = spi_flash_erase_sector((run->addr + offset) / SPI_FLASH_SEC_SIZE);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+static void spi_flash_async_complete(spi_flash_async_req_t* req, esp_err_t result)
+{
+    // callback and semaphore are read before either is signalled,
+    // the owner may reuse the request as soon as it is notified
+    spi_flash_async_cb_t callback = req->callback;
+    SemaphoreHandle_t done = req->done;
+    req->result = result;
+    if (callback) {
+        callback(req, result);
+    }
+    if (done) {
+        xSemaphoreGive(done);
+    }
+}
+
+static void spi_flash_async_task(void* arg)
+{
+    while (true) {
+        xSemaphoreTake(s_queue_sem, portMAX_DELAY);
+        portENTER_CRITICAL(&s_queue_mux);
+        spi_flash_async_req_t* req = s_queue_head;
+        s_queue_head = NULL;
+        s_queue_tail = NULL;
+        portEXIT_CRITICAL(&s_queue_mux);
+
+        while (req) {
+            spi_flash_async_req_t* end = req->next;
+            uint32_t size = req->size;
+            while (end && spi_flash_async_can_merge(req, size, end)) {
+                size += end->size;
+                end = end->next;
+            }
+            esp_err_t err = spi_flash_async_execute(req, size);
+            while (req != end) {
+                spi_flash_async_req_t* next = req->next;
+                spi_flash_async_complete(req, err);
+                req = next;
+            }
+        }
+    }
+}
+
+esp_err_t spi_flash_async_init(UBaseType_t priority)
+{
+    if (s_queue_sem) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_queue_sem = xSemaphoreCreateBinary();
+    if (!s_queue_sem) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(spi_flash_async_task, "flash", SPI_FLASH_ASYNC_STACK_SIZE,
+                    NULL, priority, NULL) != pdPASS) {
+        vSemaphoreDelete(s_queue_sem);
+        s_queue_sem = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_async_submit(spi_flash_async_req_t* req)
+{
+    if (!s_queue_sem) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (req->size == 0 || req->addr % sizeof(uint32_t) != 0 || req->size % sizeof(uint32_t) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (req->op == SPI_FLASH_ASYNC_ERASE) {
+        if (req->addr % SPI_FLASH_SEC_SIZE != 0 || req->size % SPI_FLASH_SEC_SIZE != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    } else if (req->buf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req->next = NULL;
+    portENTER_CRITICAL(&s_queue_mux);
+    if (s_queue_tail) {
+        s_queue_tail->next = req;
+    } else {
+        s_queue_head = req;
+    }
+    s_queue_tail = req;
+    portEXIT_CRITICAL(&s_queue_mux);
+    xSemaphoreGive(s_queue_sem);
+    return ESP_OK;
+}
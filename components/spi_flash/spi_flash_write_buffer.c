@@ -0,0 +1,139 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include "sdkconfig.h"
+#include "esp_spi_flash.h"
+
+#if CONFIG_SPI_FLASH_WRITE_BUFFER
+
+/*
+    Write combining for small sequential writes
+
+    One flash page (SPI_FLASH_PAGE_SIZE bytes) is buffered in RAM. A write
+    which continues the buffered range of the same page is appended to it;
+    any other write flushes the buffer first. The buffer is flushed with a
+    single spi_flash_write once the page is filled, on
+    spi_flash_write_buffer_flush, or by s_wb_timer when no write has been
+    made for CONFIG_SPI_FLASH_WRITE_BUFFER_TIMEOUT milliseconds.
+
+    Bytes of the page outside of the buffered range stay 0xff in s_wb_data,
+    so the buffered range can be written rounded to whole words without
+    modifying its neighbours.
+*/
+
+#define WB_EMPTY    UINT32_MAX
+
+static SemaphoreHandle_t s_wb_mutex;
+static TimerHandle_t s_wb_timer;
+static uint32_t s_wb_page = WB_EMPTY;   // flash address of the buffered page
+static uint32_t s_wb_start;             // buffered range within the page
+static uint32_t s_wb_end;
+static uint32_t s_wb_data[SPI_FLASH_PAGE_SIZE / sizeof(uint32_t)];
+static esp_err_t s_wb_error = ESP_OK;   // result of the last flush on timeout
+
+static esp_err_t spi_flash_write_buffer_flush_locked()
+{
+    if (s_wb_page == WB_EMPTY) {
+        return ESP_OK;
+    }
+    const uint32_t start = s_wb_start & ~(sizeof(uint32_t) - 1);
+    const uint32_t end = (s_wb_end + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    esp_err_t err = spi_flash_write(s_wb_page + start, s_wb_data + start / sizeof(uint32_t), end - start);
+    s_wb_page = WB_EMPTY;
+    return err;
+}
+
+static void spi_flash_write_buffer_timeout(TimerHandle_t timer)
+{
+    xSemaphoreTake(s_wb_mutex, portMAX_DELAY);
+    esp_err_t err = spi_flash_write_buffer_flush_locked();
+    if (err != ESP_OK) {
+        s_wb_error = err;
+    }
+    xSemaphoreGive(s_wb_mutex);
+}
+
+void spi_flash_write_buffer_init()
+{
+    s_wb_mutex = xSemaphoreCreateMutex();
+    s_wb_timer = xTimerCreate("flash_wb", pdMS_TO_TICKS(CONFIG_SPI_FLASH_WRITE_BUFFER_TIMEOUT),
+                              pdFALSE, NULL, &spi_flash_write_buffer_timeout);
+}
+
+esp_err_t spi_flash_write_buffered(uint32_t dest_addr, const void* src, size_t size)
+{
+    const uint8_t* from = (const uint8_t*) src;
+    xSemaphoreTake(s_wb_mutex, portMAX_DELAY);
+    esp_err_t err = s_wb_error;
+    s_wb_error = ESP_OK;
+    while (err == ESP_OK && size > 0) {
+        const uint32_t page = dest_addr & ~(SPI_FLASH_PAGE_SIZE - 1);
+        const uint32_t offset = dest_addr - page;
+        uint32_t len = SPI_FLASH_PAGE_SIZE - offset;
+        if (len > size) {
+            len = size;
+        }
+        if (s_wb_page != page || s_wb_end != offset) {
+            err = spi_flash_write_buffer_flush_locked();
+            if (err != ESP_OK) {
+                break;
+            }
+            if (len == SPI_FLASH_PAGE_SIZE) {
+                // whole pages don't need to be combined
+                err = spi_flash_write_bytes(dest_addr, from, len);
+                dest_addr += len;
+                from += len;
+                size -= len;
+                continue;
+            }
+            memset(s_wb_data, 0xff, sizeof(s_wb_data));
+            s_wb_page = page;
+            s_wb_start = offset;
+            s_wb_end = offset;
+        }
+        memcpy((uint8_t*) s_wb_data + offset, from, len);
+        s_wb_end += len;
+        dest_addr += len;
+        from += len;
+        size -= len;
+        if (s_wb_end == SPI_FLASH_PAGE_SIZE) {
+            err = spi_flash_write_buffer_flush_locked();
+        }
+    }
+    if (s_wb_page != WB_EMPTY) {
+        xTimerReset(s_wb_timer, 0);
+    }
+    xSemaphoreGive(s_wb_mutex);
+    return err;
+}
+
+esp_err_t spi_flash_write_buffer_flush()
+{
+    xSemaphoreTake(s_wb_mutex, portMAX_DELAY);
+    esp_err_t err = s_wb_error;
+    s_wb_error = ESP_OK;
+    if (err == ESP_OK) {
+        err = spi_flash_write_buffer_flush_locked();
+    }
+    xSemaphoreGive(s_wb_mutex);
+    return err;
+}
+
+#endif // CONFIG_SPI_FLASH_WRITE_BUFFER
@@ -49,6 +49,15 @@ struct station_list {
     uint8_t mac[6];
     ip4_addr_t ip;
 };
+
+/* One entry of tcpip_adapter_get_sta_snapshot() */
+typedef struct {
+    uint8_t mac[6];
+    ip4_addr_t ip;              /* leased address, 0.0.0.0 if the station has no lease */
+} tcpip_adapter_sta_info_t;
+
+/* One entry of tcpip_adapter_dhcps_get_leases(); lease_timer is the time left in minutes */
+typedef struct dhcps_pool tcpip_adapter_dhcps_pool_t;
 #endif
 
 #endif
@@ -121,6 +130,15 @@ esp_err_t tcpip_adapter_dhcpc_option(tcpip_adapter_option_mode_t opt_op, tcpip_a
 esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if);
 esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if);
 
+/* Forget the lease saved with CONFIG_LWIP_DHCP_RESTORE_LEASE, e.g. before
+ * connecting to a different network, whose DHCP server wouldn't know it. */
+esp_err_t tcpip_adapter_dhcpc_clear_lease(tcpip_adapter_if_t tcpip_if);
+
+/* Translate the packets the clients of this interface send to other networks
+ * (CONFIG_LWIP_IP_NAPT), normally for the ap, whose clients then reach the
+ * network of the station. The station becomes the default interface. */
+esp_err_t tcpip_adapter_napt_enable(tcpip_adapter_if_t tcpip_if, bool enable);
+
 esp_err_t tcpip_adapter_sta_input(void *buffer, uint16_t len, void *eb);
 esp_err_t tcpip_adapter_ap_input(void *buffer, uint16_t len, void *eb);
 
@@ -129,5 +147,16 @@ wifi_interface_t tcpip_adapter_get_wifi_if(void *dev);
 esp_err_t tcpip_adapter_get_sta_list(struct station_info *sta_info, struct station_list **sta_list);
 esp_err_t tcpip_adapter_free_sta_list(struct station_list *sta_list);
 
+/* Like tcpip_adapter_get_sta_list(), but fills the caller's array of up to
+ * max_num entries instead of allocating a list, so it can be polled often.
+ * *num is set to the number of entries filled. Returns
+ * ESP_ERR_TCPIP_ADAPTER_NO_MEM if there were more stations than max_num;
+ * the first max_num are filled in that case. */
+esp_err_t tcpip_adapter_get_sta_snapshot(const struct station_info *sta_info, tcpip_adapter_sta_info_t *stations, int max_num, int *num);
+
+/* Copy the active DHCP server leases, soonest expiring first, into the
+ * caller's array of up to max_num entries. *num is set to the number copied. */
+esp_err_t tcpip_adapter_dhcps_get_leases(tcpip_adapter_dhcps_pool_t *leases, int max_num, int *num);
+
 #endif /*  _TCPIP_ADAPTER_H_ */
 
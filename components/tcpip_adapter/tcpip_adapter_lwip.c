@@ -23,6 +23,7 @@
 #include "lwip/tcpip.h"
 #include "lwip/dhcp.h"
 #include "lwip/ip_addr.h"
+#include "lwip/ip4_napt.h"
 
 #include "netif/wlanif.h"
 
@@ -30,12 +31,35 @@
 
 #include "esp_event.h"
 
+#if CONFIG_LWIP_DHCP_RESTORE_LEASE
+#include "nvs.h"
+#endif
+
 static struct netif *esp_netif[TCPIP_ADAPTER_IF_MAX];
 static tcpip_adapter_ip_info_t esp_ip[TCPIP_ADAPTER_IF_MAX];
 
 static tcpip_adapter_dhcp_status_t dhcps_status = TCPIP_ADAPTER_DHCP_INIT;
 static tcpip_adapter_dhcp_status_t dhcpc_status = TCPIP_ADAPTER_DHCP_INIT;
 
+#if IP_NAPT
+static bool napt_enabled[TCPIP_ADAPTER_IF_MAX];
+#endif
+
+#if CONFIG_LWIP_DHCP_RESTORE_LEASE
+#define TCPIP_ADAPTER_NVS_NAMESPACE     "tcpip_adapter"
+#define TCPIP_ADAPTER_DHCPC_LEASE_KEY   "dhcpc_lease"
+
+#if CONFIG_LWIP_DHCP_USE_LEASE_IMMEDIATELY
+#define TCPIP_ADAPTER_DHCPC_LEASE_USE_NOW   1
+#else
+#define TCPIP_ADAPTER_DHCPC_LEASE_USE_NOW   0
+#endif
+
+/* copy of the station lease saved in NVS */
+static struct dhcp_lease_info dhcpc_lease;
+static bool dhcpc_lease_loaded = false;
+#endif
+
 #define TCPIP_ADAPTER_DEBUG(...)
 
 void tcpip_adapter_init(void)
@@ -53,6 +77,25 @@ void tcpip_adapter_init(void)
     }
 }
 
+static void tcpip_adapter_choose_default(void)
+{
+    bool ap_default = esp_netif[TCPIP_ADAPTER_IF_AP] != NULL;
+
+#if IP_NAPT
+    /* the clients of a translating ap reach other networks through the station */
+    if (napt_enabled[TCPIP_ADAPTER_IF_AP] && esp_netif[TCPIP_ADAPTER_IF_STA]) {
+        ap_default = false;
+    }
+#endif
+
+    /* if ap is on, choose ap as default if */
+    if (ap_default) {
+        netif_set_default(esp_netif[TCPIP_ADAPTER_IF_AP]);
+    } else if (esp_netif[TCPIP_ADAPTER_IF_STA]) {
+        netif_set_default(esp_netif[TCPIP_ADAPTER_IF_STA]);
+    }
+}
+
 esp_err_t tcpip_adapter_start(tcpip_adapter_if_t tcpip_if, uint8_t *mac, tcpip_adapter_ip_info_t *ip_info)
 {
     if (tcpip_if >= TCPIP_ADAPTER_IF_MAX || mac == NULL || ip_info == NULL) {
@@ -66,6 +109,11 @@ esp_err_t tcpip_adapter_start(tcpip_adapter_if_t tcpip_if, uint8_t *mac, tcpip_a
         }
         memcpy(esp_netif[tcpip_if]->hwaddr, mac, NETIF_MAX_HWADDR_LEN);
         netif_add(esp_netif[tcpip_if], &ip_info->ip, &ip_info->netmask, &ip_info->gw, NULL, wlanif_init, tcpip_input);
+#if IP_NAPT
+        if (napt_enabled[tcpip_if]) {
+            ip_napt_enable_netif(esp_netif[tcpip_if], 1);
+        }
+#endif
     }
 
     if (tcpip_if == TCPIP_ADAPTER_IF_AP) {
@@ -81,12 +129,7 @@ esp_err_t tcpip_adapter_start(tcpip_adapter_if_t tcpip_if, uint8_t *mac, tcpip_a
         }
     }
 
-    /* if ap is on, choose ap as default if */
-    if (esp_netif[TCPIP_ADAPTER_IF_AP]) {
-        netif_set_default(esp_netif[TCPIP_ADAPTER_IF_AP]);
-    } else if (esp_netif[TCPIP_ADAPTER_IF_STA]) {
-        netif_set_default(esp_netif[TCPIP_ADAPTER_IF_STA]);
-    }
+    tcpip_adapter_choose_default();
 
     return ESP_OK;
 }
@@ -431,6 +474,108 @@ esp_err_t tcpip_adapter_dhcpc_option(tcpip_adapter_option_mode_t opt_op, tcpip_a
     return ESP_OK;
 }
 
+#if CONFIG_LWIP_DHCP_RESTORE_LEASE
+static void tcpip_adapter_dhcpc_load_lease(void)
+{
+    nvs_handle handle;
+    size_t len = sizeof(dhcpc_lease);
+
+    if (dhcpc_lease_loaded) {
+        return;
+    }
+    dhcpc_lease_loaded = true;
+
+    if (nvs_open(TCPIP_ADAPTER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(handle, TCPIP_ADAPTER_DHCPC_LEASE_KEY, &dhcpc_lease, &len) != ESP_OK ||
+            len != sizeof(dhcpc_lease)) {
+        TCPIP_ADAPTER_DEBUG("no dhcp client lease saved\n");
+        memset(&dhcpc_lease, 0, sizeof(dhcpc_lease));
+    }
+    nvs_close(handle);
+}
+
+static esp_err_t tcpip_adapter_dhcpc_write_lease(const struct dhcp_lease_info *lease)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    err = nvs_open(TCPIP_ADAPTER_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, TCPIP_ADAPTER_DHCPC_LEASE_KEY, lease, sizeof(*lease));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (err == ESP_OK) {
+        memcpy(&dhcpc_lease, lease, sizeof(dhcpc_lease));
+        dhcpc_lease_loaded = true;
+    }
+    return err;
+}
+
+/* Called on every ACK, renewals included. Only writes to flash if the lease changed. */
+static void tcpip_adapter_dhcpc_save_lease(struct netif *netif)
+{
+    struct dhcp_lease_info lease;
+
+    if (dhcp_get_lease(netif, &lease) != ERR_OK) {
+        return;
+    }
+    /* the lease is saved right after it was granted or renewed */
+    lease.lease_used = 0;
+    if (memcmp(&lease, &dhcpc_lease, sizeof(lease)) == 0) {
+        TCPIP_ADAPTER_DEBUG("dhcp client lease unchanged\n");
+        return;
+    }
+    if (tcpip_adapter_dhcpc_write_lease(&lease) != ESP_OK) {
+        TCPIP_ADAPTER_DEBUG("dhcp client lease save failed\n");
+    }
+}
+#endif
+
+esp_err_t tcpip_adapter_napt_enable(tcpip_adapter_if_t tcpip_if, bool enable)
+{
+    if (tcpip_if >= TCPIP_ADAPTER_IF_MAX) {
+        return ESP_ERR_TCPIP_ADAPTER_INVALID_PARAMS;
+    }
+
+#if IP_NAPT
+    napt_enabled[tcpip_if] = enable;
+    if (esp_netif[tcpip_if]) {
+        ip_napt_enable_netif(esp_netif[tcpip_if], enable ? 1 : 0);
+    }
+    tcpip_adapter_choose_default();
+
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t tcpip_adapter_dhcpc_clear_lease(tcpip_adapter_if_t tcpip_if)
+{
+    if (tcpip_if != TCPIP_ADAPTER_IF_STA) {
+        return ESP_ERR_TCPIP_ADAPTER_INVALID_PARAMS;
+    }
+
+#if CONFIG_LWIP_DHCP_RESTORE_LEASE
+    struct dhcp_lease_info lease;
+
+    tcpip_adapter_dhcpc_load_lease();
+    memset(&lease, 0, sizeof(lease));
+    if (memcmp(&lease, &dhcpc_lease, sizeof(lease)) == 0) {
+        return ESP_OK;
+    }
+    return tcpip_adapter_dhcpc_write_lease(&lease);
+#else
+    return ESP_OK;
+#endif
+}
+
 static void tcpip_adapter_dhcpc_cb(void)
 {
     struct netif *netif = esp_netif[TCPIP_ADAPTER_IF_STA];
@@ -440,6 +585,10 @@ static void tcpip_adapter_dhcpc_cb(void)
         return;
     }
 
+#if CONFIG_LWIP_DHCP_RESTORE_LEASE
+    tcpip_adapter_dhcpc_save_lease(netif);
+#endif
+
     if ( !ip4_addr_cmp(ip_2_ip4(&netif->ip_addr), IP4_ADDR_ANY) ) {
         tcpip_adapter_ip_info_t *ip_info = &esp_ip[TCPIP_ADAPTER_IF_STA];
 
@@ -500,12 +649,28 @@ esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if)
                 return ESP_OK;
             }
 
+#if CONFIG_LWIP_DHCP_RESTORE_LEASE
+            tcpip_adapter_dhcpc_load_lease();
+
+            if (dhcp_start_with_lease(p_netif, &dhcpc_lease, TCPIP_ADAPTER_DHCPC_LEASE_USE_NOW) != ERR_OK) {
+                TCPIP_ADAPTER_DEBUG("dhcp client start failed\n");
+                return ESP_ERR_TCPIP_ADAPTER_DHCPC_START_FAILED;
+            }
+
+            dhcp_set_cb(p_netif, tcpip_adapter_dhcpc_cb);
+
+            if (TCPIP_ADAPTER_DHCPC_LEASE_USE_NOW) {
+                /* the previous address is in use already, report it now */
+                tcpip_adapter_dhcpc_cb();
+            }
+#else
             if (dhcp_start(p_netif) != ERR_OK) {
                 TCPIP_ADAPTER_DEBUG("dhcp client start failed\n");
                 return ESP_ERR_TCPIP_ADAPTER_DHCPC_START_FAILED;
             }
 
             dhcp_set_cb(p_netif, tcpip_adapter_dhcpc_cb);
+#endif
 
             TCPIP_ADAPTER_DEBUG("dhcp client start successfully\n");
             dhcpc_status = TCPIP_ADAPTER_DHCP_STARTED;
@@ -554,13 +719,17 @@ esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if)
 
 esp_err_t tcpip_adapter_sta_input(void *buffer, uint16_t len, void *eb)
 {
-    wlanif_input(esp_netif[TCPIP_ADAPTER_IF_STA], buffer, len, eb);
+    if (wlanif_input(esp_netif[TCPIP_ADAPTER_IF_STA], buffer, len, eb) != ERR_OK) {
+        return ESP_ERR_NO_MEM;
+    }
     return ESP_OK;
 }
 
 esp_err_t tcpip_adapter_ap_input(void *buffer, uint16_t len, void *eb)
 {
-    wlanif_input(esp_netif[TCPIP_ADAPTER_IF_AP], buffer, len, eb);
+    if (wlanif_input(esp_netif[TCPIP_ADAPTER_IF_AP], buffer, len, eb) != ERR_OK) {
+        return ESP_ERR_NO_MEM;
+    }
     return ESP_OK;
 }
 
@@ -629,4 +798,40 @@ esp_err_t tcpip_adapter_free_sta_list(struct station_list *sta_list)
     return ESP_OK;
 }
 
+esp_err_t tcpip_adapter_get_sta_snapshot(const struct station_info *sta_info, tcpip_adapter_sta_info_t *stations, int max_num, int *num)
+{
+    const struct station_info *info;
+    int n = 0;
+
+    if (num == NULL || (stations == NULL && max_num > 0)) {
+        return ESP_ERR_TCPIP_ADAPTER_INVALID_PARAMS;
+    }
+
+    for (info = sta_info; info != NULL; info = STAILQ_NEXT(info, next)) {
+        if (n == max_num) {
+            *num = n;
+            return ESP_ERR_TCPIP_ADAPTER_NO_MEM;
+        }
+
+        memcpy(stations[n].mac, info->bssid, 6);
+        if (!dhcp_search_ip_on_mac(stations[n].mac, &stations[n].ip)) {
+            ip4_addr_set_zero(&stations[n].ip);
+        }
+        n++;
+    }
+
+    *num = n;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_dhcps_get_leases(tcpip_adapter_dhcps_pool_t *leases, int max_num, int *num)
+{
+    if (num == NULL || (leases == NULL && max_num > 0) || max_num < 0) {
+        return ESP_ERR_TCPIP_ADAPTER_INVALID_PARAMS;
+    }
+
+    *num = dhcps_get_leases(leases, max_num > UINT16_MAX ? UINT16_MAX : max_num);
+    return ESP_OK;
+}
+
 #endif
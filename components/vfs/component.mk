@@ -0,0 +1,11 @@
+#
+# Component Makefile
+#
+# This Makefile should, at the very least, just include $(IDF_PATH)/make/component_common.mk. By default, 
+# this will take the sources in this directory, compile them and link them into 
+# lib(subdirectory_name).a in the build directory. This behaviour is entirely configurable,
+# please read the esp-idf build system document if you need to do this.
+#
+COMPONENT_ADD_INCLUDEDIRS := include
+
+include $(IDF_PATH)/make/component_common.mk
@@ -0,0 +1,198 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_VFS_H__
+#define __ESP_VFS_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/reent.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Virtual file system
+ *
+ * open, read, write, lseek, close, fstat, stat, unlink, rename, fcntl, ioctl
+ * and select of newlib are passed to drivers registered here. A driver is
+ * registered either for a path prefix, such as "/dev/uart", and then gets the
+ * open calls for paths below it, or for a fixed range of file descriptors,
+ * such as the lwIP sockets.
+ *
+ * Each file descriptor refers to its driver and the driver's own (local)
+ * descriptor in a table, so calls on descriptors are dispatched without a
+ * search. Descriptors of a fixed range are the same for the driver and the
+ * application.
+ *
+ * Driver functions return -1 and set errno on errors, like the functions
+ * they implement. Functions a driver doesn't implement are NULL, and fail
+ * with errno ENOSYS (or EBADF, for read and write).
+ */
+
+/** Maximum length of the path prefix of a driver */
+#define ESP_VFS_PATH_MAX 15
+
+/**
+ * @brief Called once the buffer passed to esp_vfs_write_zc isn't used anymore
+ *
+ * @param arg   argument passed to esp_vfs_write_zc
+ * @param err   0 if the data has been written, an errno value otherwise
+ */
+typedef void (*esp_vfs_write_done_t)(void *arg, int err);
+
+/**
+ * Driver functions. 'ctx' is the pointer passed on registration, 'fd' is the
+ * driver's descriptor, paths are relative to the path prefix ("" or
+ * starting with '/').
+ */
+typedef struct {
+    int     (*open)(void *ctx, const char *path, int flags, int mode);
+    ssize_t (*read)(void *ctx, int fd, void *dst, size_t size);
+    ssize_t (*write)(void *ctx, int fd, const void *data, size_t size);
+    off_t   (*lseek)(void *ctx, int fd, off_t offset, int whence);
+    int     (*close)(void *ctx, int fd);
+    int     (*fstat)(void *ctx, int fd, struct stat *st);
+    int     (*stat)(void *ctx, const char *path, struct stat *st);
+    int     (*unlink)(void *ctx, const char *path);
+    int     (*rename)(void *ctx, const char *src, const char *dst);
+    int     (*fcntl)(void *ctx, int fd, int cmd, int arg);
+    int     (*ioctl)(void *ctx, int fd, int cmd, va_list args);
+
+    /**
+     * select() on the driver's descriptors, with the semantics of select().
+     * Called directly when all descriptors passed to select() belong to this
+     * driver, otherwise with a zero timeout to check which are ready.
+     * Without it, all descriptors of the driver are always ready for reading
+     * and writing, like regular files.
+     */
+    int     (*select)(void *ctx, int nfds, fd_set *readfds, fd_set *writefds,
+                      fd_set *exceptfds, struct timeval *timeout);
+    /**
+     * Start waiting for the descriptors in the sets, for a select() on
+     * descriptors of several drivers: give 'sem' once one of them may have
+     * become ready, until end_select is called. Without it, select() checks
+     * the descriptors of the driver every tick while it waits.
+     */
+    int     (*start_select)(void *ctx, int nfds, fd_set *readfds, fd_set *writefds,
+                            fd_set *exceptfds, SemaphoreHandle_t *sem, void **handle);
+    void    (*end_select)(void *ctx, void *handle);
+
+    /**
+     * Zero-copy read: return a pointer to up to 'size' bytes of the next data
+     * in *data, and the number of bytes, which are consumed. The data stays
+     * valid until read_zc_release is called.
+     */
+    ssize_t (*read_zc)(void *ctx, int fd, const void **data, size_t size);
+    int     (*read_zc_release)(void *ctx, int fd);
+    /**
+     * Zero-copy write: write from the caller's buffer, which the driver may
+     * keep using until it calls 'done'. 'done' is only called if the return
+     * value is >= 0.
+     */
+    ssize_t (*write_zc)(void *ctx, int fd, const void *data, size_t size,
+                        esp_vfs_write_done_t done, void *arg);
+} esp_vfs_t;
+
+/**
+ * @brief Register a driver for the paths starting with base_path
+ *
+ * @param base_path  path prefix, e.g. "/dev/uart", at most ESP_VFS_PATH_MAX
+ *                   characters, starting with '/' and not ending with it.
+ *                   Paths are matched against the longest prefix.
+ * @param vfs        driver functions, copied
+ * @param ctx        pointer passed to the driver functions
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if base_path is invalid or
+ *         registered already, ESP_ERR_NO_MEM if CONFIG_VFS_MAX_DRIVERS
+ *         drivers are registered
+ */
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs, void *ctx);
+
+/**
+ * @brief Register a driver for the descriptors min_fd to max_fd - 1
+ *
+ * The descriptors stay assigned to the driver when they are closed. The
+ * driver's descriptors are the same as the application's.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the range is invalid or one of
+ *         the descriptors is in use, ESP_ERR_NO_MEM if CONFIG_VFS_MAX_DRIVERS
+ *         drivers are registered
+ */
+esp_err_t esp_vfs_register_fd_range(const esp_vfs_t *vfs, void *ctx, int min_fd, int max_fd);
+
+/**
+ * @brief Unregister the driver registered for base_path
+ *
+ * The descriptors which are still open for the driver are closed.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if there is no such driver
+ */
+esp_err_t esp_vfs_unregister(const char *base_path);
+
+/**
+ * @brief Read without copying
+ *
+ * Return a pointer to up to 'size' bytes of the next data in *data. The
+ * data is consumed, and stays valid until esp_vfs_read_zc_release is called,
+ * which has to be done before the next read from the descriptor.
+ *
+ * @return number of bytes, 0 at the end of the file, -1 on error (errno
+ *         ENOTSUP if the driver can't read without copying)
+ */
+ssize_t esp_vfs_read_zc(int fd, const void **data, size_t size);
+
+/**
+ * @brief Give back the data returned by esp_vfs_read_zc
+ */
+int esp_vfs_read_zc_release(int fd);
+
+/**
+ * @brief Write without copying
+ *
+ * The data must not be changed until 'done' is called, which can happen
+ * before this returns, and from another task. 'done' must not block. For
+ * drivers which can't write without copying, the data is written with
+ * write() and 'done' is called before this returns.
+ *
+ * @return number of bytes written or queued, -1 on error ('done' isn't
+ *         called then)
+ */
+ssize_t esp_vfs_write_zc(int fd, const void *data, size_t size,
+                         esp_vfs_write_done_t done, void *arg);
+
+/**
+ * Implementations of the newlib syscalls, called by the _xxx_r functions.
+ */
+int esp_vfs_open(struct _reent *r, const char *path, int flags, int mode);
+ssize_t esp_vfs_read(struct _reent *r, int fd, void *dst, size_t size);
+ssize_t esp_vfs_write(struct _reent *r, int fd, const void *data, size_t size);
+off_t esp_vfs_lseek(struct _reent *r, int fd, off_t offset, int whence);
+int esp_vfs_close(struct _reent *r, int fd);
+int esp_vfs_fstat(struct _reent *r, int fd, struct stat *st);
+int esp_vfs_stat(struct _reent *r, const char *path, struct stat *st);
+int esp_vfs_unlink(struct _reent *r, const char *path);
+int esp_vfs_rename(struct _reent *r, const char *src, const char *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_VFS_H__ */
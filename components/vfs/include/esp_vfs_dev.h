@@ -0,0 +1,81 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_VFS_DEV_H__
+#define __ESP_VFS_DEV_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register the UART driver and the console
+ *
+ * UARTs are opened as "/dev/uart/N". Reads return the bytes in the receive
+ * FIFO, and wait for the first one unless O_NONBLOCK is set. stdin, stdout
+ * and stderr (descriptors 0 to 2) are assigned to UART0 permanently, output
+ * to them goes through the buffered console (esp_console.h) if it is
+ * enabled. Called at startup.
+ *
+ * @return ESP_OK or an error of esp_vfs_register
+ */
+esp_err_t esp_vfs_dev_uart_register(void);
+
+/**
+ * @brief Register the lwIP sockets and epoll instances with the VFS
+ *
+ * read, write, close, fcntl, ioctl and select on their descriptors are
+ * passed to lwIP. esp_vfs_read_zc and esp_vfs_write_zc use lwip_recv_pbuf
+ * and lwip_send_nocopy if CONFIG_LWIP_SOCKET_ZEROCOPY is set. Called at
+ * startup.
+ *
+ * @return ESP_OK or an error of esp_vfs_register_fd_range
+ */
+esp_err_t esp_vfs_lwip_sockets_register(void);
+
+/**
+ * @brief Make a flash partition available as a file
+ *
+ * The partition with the given label in the partition table is opened as
+ * base_path. Its data can be read, written and seeked like a file of the
+ * size of the partition, which can't change. Data has to be erased before it
+ * is written: opening with O_TRUNC erases the whole partition. esp_vfs_read_zc
+ * returns pointers into the partition mapped with spi_flash_mmap.
+ *
+ * @param base_path  path, e.g. "/dev/storage"
+ * @param label      label of the partition
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no such partition,
+ *         ESP_ERR_NO_MEM, or an error of esp_vfs_register or spi_flash_read
+ */
+esp_err_t esp_vfs_flash_register(const char *base_path, const char *label);
+
+/**
+ * @brief Find a partition in the partition table
+ *
+ * @param label       label of the partition
+ * @param out_offset  receives the offset of the partition in flash
+ * @param out_size    receives the size of the partition
+ *
+ * @return ESP_OK or ESP_ERR_NOT_FOUND, see esp_partition_find_first
+ */
+esp_err_t esp_vfs_flash_find_partition(const char *label, uint32_t *out_offset, uint32_t *out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_VFS_DEV_H__ */
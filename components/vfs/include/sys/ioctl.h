@@ -0,0 +1,30 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef __ESP_SYS_IOCTL_H__
+#define __ESP_SYS_IOCTL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * ioctl() of the VFS (esp_vfs.h)
+ */
+int ioctl(int fd, int request, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_SYS_IOCTL_H__ */
@@ -0,0 +1,640 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/lock.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
+#include "sdkconfig.h"
+#include "esp_vfs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/* All descriptors select() can handle are in the table */
+#define VFS_MAX_FDS     FD_SETSIZE
+
+#if CONFIG_VFS_MAX_FILES > VFS_MAX_FDS
+#error CONFIG_VFS_MAX_FILES is larger than FD_SETSIZE
+#endif
+
+typedef struct {
+    bool used;
+    char path_prefix[ESP_VFS_PATH_MAX + 1];
+    size_t path_prefix_len;     // 0 if registered for a range of descriptors
+    esp_vfs_t vfs;
+    void *ctx;
+} vfs_entry_t;
+
+typedef struct {
+    uint8_t vfs_id;             // index in s_vfs + 1, 0 if the descriptor is free
+    bool permanent;             // stays assigned when closed
+    int16_t local_fd;
+} fd_entry_t;
+
+/* Drivers and descriptors are only changed with s_lock held. Lookups don't
+   take it, an entry doesn't change while its descriptor is being used. */
+static vfs_entry_t s_vfs[CONFIG_VFS_MAX_DRIVERS];
+static fd_entry_t s_fds[VFS_MAX_FDS];
+static _lock_t s_lock;
+
+static vfs_entry_t* vfs_alloc_entry(const esp_vfs_t *vfs, void *ctx)
+{
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        if (!s_vfs[i].used) {
+            s_vfs[i].used = true;
+            s_vfs[i].vfs = *vfs;
+            s_vfs[i].ctx = ctx;
+            return &s_vfs[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs, void *ctx)
+{
+    size_t len = strlen(base_path);
+    if (len < 2 || len > ESP_VFS_PATH_MAX || base_path[0] != '/' || base_path[len - 1] == '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    _lock_acquire(&s_lock);
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        if (s_vfs[i].used && strcmp(s_vfs[i].path_prefix, base_path) == 0) {
+            err = ESP_ERR_INVALID_ARG;
+            goto out;
+        }
+    }
+    vfs_entry_t *entry = vfs_alloc_entry(vfs, ctx);
+    if (entry == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    memcpy(entry->path_prefix, base_path, len + 1);
+    entry->path_prefix_len = len;
+out:
+    _lock_release(&s_lock);
+    return err;
+}
+
+esp_err_t esp_vfs_register_fd_range(const esp_vfs_t *vfs, void *ctx, int min_fd, int max_fd)
+{
+    if (min_fd < 0 || max_fd > VFS_MAX_FDS || min_fd >= max_fd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    _lock_acquire(&s_lock);
+    for (int fd = min_fd; fd < max_fd; ++fd) {
+        if (s_fds[fd].vfs_id != 0) {
+            err = ESP_ERR_INVALID_ARG;
+            goto out;
+        }
+    }
+    vfs_entry_t *entry = vfs_alloc_entry(vfs, ctx);
+    if (entry == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    entry->path_prefix[0] = '\0';
+    entry->path_prefix_len = 0;
+    for (int fd = min_fd; fd < max_fd; ++fd) {
+        s_fds[fd].vfs_id = entry - s_vfs + 1;
+        s_fds[fd].permanent = true;
+        s_fds[fd].local_fd = fd;
+    }
+out:
+    _lock_release(&s_lock);
+    return err;
+}
+
+esp_err_t esp_vfs_unregister(const char *base_path)
+{
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    _lock_acquire(&s_lock);
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        vfs_entry_t *entry = &s_vfs[i];
+        if (!entry->used || entry->path_prefix_len == 0 || strcmp(entry->path_prefix, base_path) != 0) {
+            continue;
+        }
+        for (int fd = 0; fd < VFS_MAX_FDS; ++fd) {
+            if (s_fds[fd].vfs_id == i + 1) {
+                if (entry->vfs.close) {
+                    entry->vfs.close(entry->ctx, s_fds[fd].local_fd);
+                }
+                s_fds[fd].vfs_id = 0;
+            }
+        }
+        entry->used = false;
+        err = ESP_OK;
+        break;
+    }
+    _lock_release(&s_lock);
+    return err;
+}
+
+static const vfs_entry_t* get_vfs_for_fd(int fd, int *local_fd)
+{
+    if (fd < 0 || fd >= VFS_MAX_FDS) {
+        return NULL;
+    }
+    fd_entry_t entry = s_fds[fd];
+    if (entry.vfs_id == 0) {
+        return NULL;
+    }
+    *local_fd = entry.local_fd;
+    return &s_vfs[entry.vfs_id - 1];
+}
+
+/* Driver with the longest prefix of path, followed by '/' or the end of the path */
+static const vfs_entry_t* get_vfs_for_path(const char *path)
+{
+    const vfs_entry_t *best = NULL;
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        const vfs_entry_t *entry = &s_vfs[i];
+        size_t len = entry->path_prefix_len;
+        if (!entry->used || len == 0 || (best && len <= best->path_prefix_len)) {
+            continue;
+        }
+        if (strncmp(path, entry->path_prefix, len) == 0 &&
+                (path[len] == '\0' || path[len] == '/')) {
+            best = entry;
+        }
+    }
+    return best;
+}
+
+int esp_vfs_open(struct _reent *r, const char *path, int flags, int mode)
+{
+    const vfs_entry_t *vfs = get_vfs_for_path(path);
+    if (vfs == NULL) {
+        __errno_r(r) = ENOENT;
+        return -1;
+    }
+    if (vfs->vfs.open == NULL) {
+        __errno_r(r) = ENOSYS;
+        return -1;
+    }
+    int local_fd = vfs->vfs.open(vfs->ctx, path + vfs->path_prefix_len, flags, mode);
+    if (local_fd < 0) {
+        return -1;
+    }
+    _lock_acquire(&s_lock);
+    for (int fd = 0; fd < CONFIG_VFS_MAX_FILES; ++fd) {
+        if (s_fds[fd].vfs_id == 0) {
+            s_fds[fd].vfs_id = vfs - s_vfs + 1;
+            s_fds[fd].permanent = false;
+            s_fds[fd].local_fd = local_fd;
+            _lock_release(&s_lock);
+            return fd;
+        }
+    }
+    _lock_release(&s_lock);
+    if (vfs->vfs.close) {
+        vfs->vfs.close(vfs->ctx, local_fd);
+    }
+    __errno_r(r) = ENFILE;
+    return -1;
+}
+
+ssize_t esp_vfs_read(struct _reent *r, int fd, void *dst, size_t size)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL || vfs->vfs.read == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    return vfs->vfs.read(vfs->ctx, local_fd, dst, size);
+}
+
+ssize_t esp_vfs_write(struct _reent *r, int fd, const void *data, size_t size)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL || vfs->vfs.write == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    return vfs->vfs.write(vfs->ctx, local_fd, data, size);
+}
+
+off_t esp_vfs_lseek(struct _reent *r, int fd, off_t offset, int whence)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.lseek == NULL) {
+        __errno_r(r) = ESPIPE;
+        return -1;
+    }
+    return vfs->vfs.lseek(vfs->ctx, local_fd, offset, whence);
+}
+
+int esp_vfs_close(struct _reent *r, int fd)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    int ret = 0;
+    if (vfs->vfs.close) {
+        ret = vfs->vfs.close(vfs->ctx, local_fd);
+    }
+    if (!s_fds[fd].permanent) {
+        _lock_acquire(&s_lock);
+        s_fds[fd].vfs_id = 0;
+        _lock_release(&s_lock);
+    }
+    return ret;
+}
+
+int esp_vfs_fstat(struct _reent *r, int fd, struct stat *st)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.fstat == NULL) {
+        __errno_r(r) = ENOSYS;
+        return -1;
+    }
+    return vfs->vfs.fstat(vfs->ctx, local_fd, st);
+}
+
+int esp_vfs_stat(struct _reent *r, const char *path, struct stat *st)
+{
+    const vfs_entry_t *vfs = get_vfs_for_path(path);
+    if (vfs == NULL) {
+        __errno_r(r) = ENOENT;
+        return -1;
+    }
+    if (vfs->vfs.stat == NULL) {
+        __errno_r(r) = ENOSYS;
+        return -1;
+    }
+    return vfs->vfs.stat(vfs->ctx, path + vfs->path_prefix_len, st);
+}
+
+int esp_vfs_unlink(struct _reent *r, const char *path)
+{
+    const vfs_entry_t *vfs = get_vfs_for_path(path);
+    if (vfs == NULL) {
+        __errno_r(r) = ENOENT;
+        return -1;
+    }
+    if (vfs->vfs.unlink == NULL) {
+        __errno_r(r) = ENOSYS;
+        return -1;
+    }
+    return vfs->vfs.unlink(vfs->ctx, path + vfs->path_prefix_len);
+}
+
+int esp_vfs_rename(struct _reent *r, const char *src, const char *dst)
+{
+    const vfs_entry_t *vfs = get_vfs_for_path(src);
+    if (vfs == NULL) {
+        __errno_r(r) = ENOENT;
+        return -1;
+    }
+    if (get_vfs_for_path(dst) != vfs) {
+        __errno_r(r) = EXDEV;
+        return -1;
+    }
+    if (vfs->vfs.rename == NULL) {
+        __errno_r(r) = ENOSYS;
+        return -1;
+    }
+    return vfs->vfs.rename(vfs->ctx, src + vfs->path_prefix_len, dst + vfs->path_prefix_len);
+}
+
+int fcntl(int fd, int cmd, ...)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.fcntl == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    va_list args;
+    va_start(args, cmd);
+    int arg = va_arg(args, int);
+    va_end(args);
+    return vfs->vfs.fcntl(vfs->ctx, local_fd, cmd, arg);
+}
+
+int ioctl(int fd, int request, ...)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.ioctl == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    va_list args;
+    va_start(args, request);
+    int ret = vfs->vfs.ioctl(vfs->ctx, local_fd, request, args);
+    va_end(args);
+    return ret;
+}
+
+ssize_t esp_vfs_read_zc(int fd, const void **data, size_t size)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.read_zc == NULL) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    return vfs->vfs.read_zc(vfs->ctx, local_fd, data, size);
+}
+
+int esp_vfs_read_zc_release(int fd)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.read_zc_release == NULL) {
+        return 0;
+    }
+    return vfs->vfs.read_zc_release(vfs->ctx, local_fd);
+}
+
+ssize_t esp_vfs_write_zc(int fd, const void *data, size_t size,
+                         esp_vfs_write_done_t done, void *arg)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL || (vfs->vfs.write_zc == NULL && vfs->vfs.write == NULL)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (vfs->vfs.write_zc) {
+        return vfs->vfs.write_zc(vfs->ctx, local_fd, data, size, done, arg);
+    }
+    ssize_t ret = vfs->vfs.write(vfs->ctx, local_fd, data, size);
+    if (ret >= 0) {
+        done(arg, 0);
+    }
+    return ret;
+}
+
+/* The descriptors of one driver passed to select(), in its own numbers */
+typedef struct {
+    int nfds;                   // 0 if select() has no descriptors of the driver
+    fd_set readfds;
+    fd_set writefds;
+    fd_set exceptfds;
+    fd_set readfds_out;
+    fd_set writefds_out;
+    fd_set exceptfds_out;
+    void *handle;               // of start_select, NULL if not started
+} vfs_select_t;
+
+/* Check the descriptors of each driver, the ones which are ready are set in
+   the out sets of the driver. Returns the number of ready descriptors. */
+static int vfs_select_check(vfs_select_t *sel, struct timeval *timeout)
+{
+    int count = 0;
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        vfs_select_t *s = &sel[i];
+        const vfs_entry_t *vfs = &s_vfs[i];
+        if (s->nfds == 0) {
+            continue;
+        }
+        s->readfds_out = s->readfds;
+        s->writefds_out = s->writefds;
+        if (vfs->vfs.select == NULL) {
+            // always ready, like a regular file
+            FD_ZERO(&s->exceptfds_out);
+            count++;
+            continue;
+        }
+        s->exceptfds_out = s->exceptfds;
+        int ret = vfs->vfs.select(vfs->ctx, s->nfds, &s->readfds_out, &s->writefds_out,
+                                  &s->exceptfds_out, timeout);
+        if (ret < 0) {
+            return -1;
+        }
+        count += ret;
+    }
+    return count;
+}
+
+static void vfs_select_end(vfs_select_t *sel)
+{
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        if (sel[i].handle) {
+            s_vfs[i].vfs.end_select(s_vfs[i].ctx, sel[i].handle);
+            sel[i].handle = NULL;
+        }
+    }
+}
+
+static int vfs_select_start(vfs_select_t *sel, SemaphoreHandle_t *sem, bool *poll)
+{
+    *poll = false;
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        vfs_select_t *s = &sel[i];
+        const vfs_entry_t *vfs = &s_vfs[i];
+        if (s->nfds == 0) {
+            continue;
+        }
+        if (vfs->vfs.start_select == NULL) {
+            *poll = true;
+            continue;
+        }
+        if (vfs->vfs.start_select(vfs->ctx, s->nfds, &s->readfds, &s->writefds,
+                                  &s->exceptfds, sem, &s->handle) < 0) {
+            s->handle = NULL;
+            vfs_select_end(sel);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    if (nfds < 0 || nfds > VFS_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    TickType_t ticks = portMAX_DELAY;
+    if (timeout) {
+        ticks = timeout->tv_sec * configTICK_RATE_HZ +
+                ((uint64_t) timeout->tv_usec * configTICK_RATE_HZ + 999999) / 1000000;
+    }
+
+    // sort the descriptors by driver
+    vfs_select_t sel[CONFIG_VFS_MAX_DRIVERS];
+    for (size_t i = 0; i < CONFIG_VFS_MAX_DRIVERS; ++i) {
+        sel[i].nfds = 0;
+        sel[i].handle = NULL;
+        FD_ZERO(&sel[i].readfds);
+        FD_ZERO(&sel[i].writefds);
+        FD_ZERO(&sel[i].exceptfds);
+    }
+    int drivers = 0;
+    int last = 0;
+    for (int fd = 0; fd < nfds; ++fd) {
+        bool r = readfds && FD_ISSET(fd, readfds);
+        bool w = writefds && FD_ISSET(fd, writefds);
+        bool e = exceptfds && FD_ISSET(fd, exceptfds);
+        if (!r && !w && !e) {
+            continue;
+        }
+        int local_fd;
+        const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+        if (vfs == NULL) {
+            errno = EBADF;
+            return -1;
+        }
+        vfs_select_t *s = &sel[vfs - s_vfs];
+        if (s->nfds == 0) {
+            drivers++;
+            last = vfs - s_vfs;
+        }
+        if (r) {
+            FD_SET(local_fd, &s->readfds);
+        }
+        if (w) {
+            FD_SET(local_fd, &s->writefds);
+        }
+        if (e) {
+            FD_SET(local_fd, &s->exceptfds);
+        }
+        if (local_fd >= s->nfds) {
+            s->nfds = local_fd + 1;
+        }
+    }
+
+    int ret;
+    if (drivers == 0) {
+        // select() without descriptors is used to sleep
+        do {
+            vTaskDelay(ticks);
+        } while (timeout == NULL);
+        ret = 0;
+    } else if (drivers == 1 && s_vfs[last].vfs.select) {
+        // all descriptors belong to one driver, it can wait itself
+        ret = vfs_select_check(sel, timeout);
+    } else {
+        struct timeval zero = { 0, 0 };
+        SemaphoreHandle_t sem = NULL;
+        bool started = false;
+        bool poll = false;
+        TickType_t start = xTaskGetTickCount();
+        for (;;) {
+            ret = vfs_select_check(sel, &zero);
+            if (ret != 0 || ticks == 0) {
+                break;
+            }
+            if (sem == NULL) {
+                sem = xSemaphoreCreateBinary();
+                if (sem == NULL) {
+                    errno = ENOMEM;
+                    ret = -1;
+                    break;
+                }
+            }
+            if (!started) {
+                if (vfs_select_start(sel, &sem, &poll) < 0) {
+                    ret = -1;
+                    break;
+                }
+                // check again, descriptors may have become ready before
+                started = true;
+                continue;
+            }
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (ticks != portMAX_DELAY && elapsed >= ticks) {
+                break;
+            }
+            TickType_t wait = (ticks == portMAX_DELAY) ? portMAX_DELAY : ticks - elapsed;
+            if (poll) {
+                wait = 1;
+            }
+            if (xSemaphoreTake(sem, wait) == pdTRUE) {
+                // drivers give the semaphore once per start_select
+                vfs_select_end(sel);
+                started = false;
+            }
+        }
+        if (started) {
+            vfs_select_end(sel);
+        }
+        if (sem) {
+            vSemaphoreDelete(sem);
+        }
+    }
+    if (ret < 0) {
+        return -1;
+    }
+
+    // return the ready descriptors in the application's numbers
+    ret = 0;
+    for (int fd = 0; fd < nfds; ++fd) {
+        int local_fd;
+        const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+        vfs_select_t *s = vfs ? &sel[vfs - s_vfs] : NULL;
+        if (readfds && FD_ISSET(fd, readfds)) {
+            if (s && FD_ISSET(local_fd, &s->readfds) && FD_ISSET(local_fd, &s->readfds_out)) {
+                ret++;
+            } else {
+                FD_CLR(fd, readfds);
+            }
+        }
+        if (writefds && FD_ISSET(fd, writefds)) {
+            if (s && FD_ISSET(local_fd, &s->writefds) && FD_ISSET(local_fd, &s->writefds_out)) {
+                ret++;
+            } else {
+                FD_CLR(fd, writefds);
+            }
+        }
+        if (exceptfds && FD_ISSET(fd, exceptfds)) {
+            if (s && FD_ISSET(local_fd, &s->exceptfds) && FD_ISSET(local_fd, &s->exceptfds_out)) {
+                ret++;
+            } else {
+                FD_CLR(fd, exceptfds);
+            }
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,275 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/lock.h>
+#include "esp_vfs.h"
+#include "esp_vfs_dev.h"
+#include "esp_spi_flash.h"
+#include "esp_partition.h"
+
+#define FLASH_MAX_OPEN_FILES    4
+/* esp_vfs_read_zc maps this much of a partition at a time */
+#define FLASH_MAP_SIZE          0x10000
+
+typedef struct {
+    const esp_partition_t *part;    // NULL if the entry is free
+    uint32_t pos;
+    const uint8_t *map;             // mapped window for esp_vfs_read_zc, or NULL
+    uint32_t map_start;             // of the window in the partition
+    uint32_t map_size;
+    spi_flash_mmap_handle_t map_handle;
+} flash_file_t;
+
+static flash_file_t s_files[FLASH_MAX_OPEN_FILES];
+static _lock_t s_files_lock;
+
+static flash_file_t* get_file(int fd)
+{
+    if (fd < 0 || fd >= FLASH_MAX_OPEN_FILES || s_files[fd].part == NULL) {
+        return NULL;
+    }
+    return &s_files[fd];
+}
+
+static int flash_erase(const esp_partition_t *part)
+{
+    uint32_t first = part->address / SPI_FLASH_SEC_SIZE;
+    uint32_t end = (part->address + part->size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+    for (uint32_t sec = first; sec < end; ++sec) {
+        if (spi_flash_erase_sector(sec) != ESP_OK) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int flash_open(void *ctx, const char *path, int flags, int mode)
+{
+    const esp_partition_t *part = (const esp_partition_t *) ctx;
+    if (path[0] != '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+    if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY && flash_erase(part) != 0) {
+        errno = EIO;
+        return -1;
+    }
+    int fd = -1;
+    _lock_acquire(&s_files_lock);
+    for (int i = 0; i < FLASH_MAX_OPEN_FILES; ++i) {
+        if (s_files[i].part == NULL) {
+            memset(&s_files[i], 0, sizeof(s_files[i]));
+            s_files[i].part = part;
+            fd = i;
+            break;
+        }
+    }
+    _lock_release(&s_files_lock);
+    if (fd < 0) {
+        errno = ENFILE;
+    }
+    return fd;
+}
+
+static ssize_t flash_read(void *ctx, int fd, void *dst, size_t size)
+{
+    flash_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    size_t n = f->part->size - f->pos;
+    if (n > size) {
+        n = size;
+    }
+    if (n > 0 && esp_partition_read(f->part, f->pos, dst, n) != ESP_OK) {
+        errno = EIO;
+        return -1;
+    }
+    f->pos += n;
+    return n;
+}
+
+static ssize_t flash_write(void *ctx, int fd, const void *data, size_t size)
+{
+    flash_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    size_t n = f->part->size - f->pos;
+    if (n > size) {
+        n = size;
+    }
+    if (n == 0 && size > 0) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (esp_partition_write(f->part, f->pos, data, n) != ESP_OK) {
+        errno = EIO;
+        return -1;
+    }
+    f->pos += n;
+    return n;
+}
+
+static off_t flash_lseek(void *ctx, int fd, off_t offset, int whence)
+{
+    flash_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    off_t pos;
+    switch (whence) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = f->pos + offset;
+        break;
+    case SEEK_END:
+        pos = f->part->size + offset;
+        break;
+    default:
+        pos = -1;
+        break;
+    }
+    if (pos < 0 || pos > f->part->size) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->pos = pos;
+    return pos;
+}
+
+static int flash_close(void *ctx, int fd)
+{
+    flash_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (f->map) {
+        spi_flash_munmap(f->map_handle);
+    }
+    _lock_acquire(&s_files_lock);
+    f->part = NULL;
+    _lock_release(&s_files_lock);
+    return 0;
+}
+
+static int flash_stat_part(const esp_partition_t *part, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFREG;
+    st->st_size = part->size;
+    st->st_blksize = SPI_FLASH_SEC_SIZE;
+    return 0;
+}
+
+static int flash_fstat(void *ctx, int fd, struct stat *st)
+{
+    flash_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    return flash_stat_part(f->part, st);
+}
+
+static int flash_stat(void *ctx, const char *path, struct stat *st)
+{
+    if (path[0] != '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+    return flash_stat_part((const esp_partition_t *) ctx, st);
+}
+
+/* Return data of the partition mapped into the address space, the window
+   is moved along as the file is read */
+static ssize_t flash_read_zc(void *ctx, int fd, const void **data, size_t size)
+{
+    flash_file_t *f = get_file(fd);
+    if (f == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (f->pos >= f->part->size) {
+        return 0;
+    }
+    if (f->map == NULL || f->pos < f->map_start || f->pos >= f->map_start + f->map_size) {
+        if (f->map) {
+            spi_flash_munmap(f->map_handle);
+            f->map = NULL;
+        }
+        uint32_t start = f->pos & ~(FLASH_MAP_SIZE - 1);
+        uint32_t map_size = f->part->size - start;
+        if (map_size > FLASH_MAP_SIZE) {
+            map_size = FLASH_MAP_SIZE;
+        }
+        const void *ptr;
+        if (esp_partition_mmap(f->part, start, map_size, &ptr, &f->map_handle) != ESP_OK) {
+            errno = ENOMEM;
+            return -1;
+        }
+        f->map = (const uint8_t *) ptr;
+        f->map_start = start;
+        f->map_size = map_size;
+    }
+    size_t n = f->map_start + f->map_size - f->pos;
+    if (n > size) {
+        n = size;
+    }
+    *data = f->map + (f->pos - f->map_start);
+    f->pos += n;
+    return n;
+}
+
+esp_err_t esp_vfs_flash_find_partition(const char *label, uint32_t *out_offset, uint32_t *out_size)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_ANY,
+                                  ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *out_offset = part->address;
+    *out_size = part->size;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_flash_register(const char *base_path, const char *label)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_ANY,
+                                  ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const esp_vfs_t vfs = {
+        .open = &flash_open,
+        .read = &flash_read,
+        .write = &flash_write,
+        .lseek = &flash_lseek,
+        .close = &flash_close,
+        .fstat = &flash_fstat,
+        .stat = &flash_stat,
+        .read_zc = &flash_read_zc,
+    };
+    return esp_vfs_register(base_path, &vfs, (void *) part);
+}
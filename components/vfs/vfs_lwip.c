@@ -0,0 +1,246 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "sdkconfig.h"
+#include "esp_vfs.h"
+#include "esp_vfs_dev.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+#include "lwip/pbuf.h"
+
+/* Sockets and epoll instances keep the descriptors lwIP gives them, they
+   follow the CONFIG_VFS_MAX_FILES descriptors of files and devices */
+#define LWIP_SOCKET_FDS     MEMP_NUM_NETCONN
+#define LWIP_EPOLL_FD_MIN   (LWIP_SOCKET_OFFSET + LWIP_SOCKET_FDS)
+#define LWIP_FD_MAX         (LWIP_EPOLL_FD_MIN + LWIP_SOCKET_EPOLL_NUM)
+
+#if LWIP_SOCKET_OFFSET != CONFIG_VFS_MAX_FILES
+#error lwIP sockets have to follow the file descriptors of the VFS
+#endif
+#if LWIP_FD_MAX > FD_SETSIZE
+#error Too many file descriptors for an fd_set, reduce CONFIG_VFS_MAX_FILES
+#endif
+
+#if LWIP_SOCKET_ZEROCOPY
+/* pbuf chain received by lwip_vfs_read_zc, which is handed out in pieces */
+typedef struct {
+    struct pbuf *p;             // the chain, NULL if none is held
+    struct pbuf *q;             // pbuf of the next piece
+    u16_t offset;               // of the next piece in q
+    u16_t pending;              // length of the piece handed out, 0 if released
+} lwip_rx_chain_t;
+
+typedef struct {
+    esp_vfs_write_done_t done;
+    void *arg;
+} lwip_write_zc_t;
+
+static lwip_rx_chain_t s_rx[LWIP_SOCKET_FDS];
+
+static lwip_rx_chain_t* get_rx_chain(int fd)
+{
+    if (fd < LWIP_SOCKET_OFFSET || fd >= LWIP_EPOLL_FD_MIN) {
+        return NULL;
+    }
+    return &s_rx[fd - LWIP_SOCKET_OFFSET];
+}
+
+/* Skip 'len' bytes of the chain, give it back to lwIP when all are consumed */
+static void rx_chain_consume(int fd, lwip_rx_chain_t *rx, size_t len)
+{
+    rx->offset += len;
+    while (rx->q && rx->offset >= rx->q->len) {
+        rx->offset -= rx->q->len;
+        rx->q = rx->q->next;
+    }
+    if (rx->q == NULL) {
+        lwip_recv_pbuf_free(fd, rx->p);
+        rx->p = NULL;
+        rx->offset = 0;
+    }
+}
+
+static void rx_chain_drop(int fd)
+{
+    lwip_rx_chain_t *rx = get_rx_chain(fd);
+    if (rx && rx->p) {
+        lwip_recv_pbuf_free(fd, rx->p);
+        memset(rx, 0, sizeof(*rx));
+    }
+}
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
+static ssize_t lwip_vfs_read(void *ctx, int fd, void *dst, size_t size)
+{
+#if LWIP_SOCKET_ZEROCOPY
+    // data left from esp_vfs_read_zc comes first
+    lwip_rx_chain_t *rx = get_rx_chain(fd);
+    if (rx && rx->p) {
+        if (rx->pending != 0) {
+            errno = EBUSY;
+            return -1;
+        }
+        u16_t pos = rx->offset;
+        for (struct pbuf *q = rx->p; q != rx->q; q = q->next) {
+            pos += q->len;
+        }
+        u16_t n = pbuf_copy_partial(rx->p, dst, size > 0xffff ? 0xffff : size, pos);
+        rx_chain_consume(fd, rx, n);
+        return n;
+    }
+#endif /* LWIP_SOCKET_ZEROCOPY */
+    return lwip_read(fd, dst, size);
+}
+
+static ssize_t lwip_vfs_write(void *ctx, int fd, const void *data, size_t size)
+{
+    return lwip_write(fd, data, size);
+}
+
+static int lwip_vfs_close(void *ctx, int fd)
+{
+#if LWIP_SOCKET_EPOLL_NUM
+    if (fd >= LWIP_EPOLL_FD_MIN) {
+        return lwip_epoll_close(fd);
+    }
+#endif /* LWIP_SOCKET_EPOLL_NUM */
+#if LWIP_SOCKET_ZEROCOPY
+    rx_chain_drop(fd);
+#endif /* LWIP_SOCKET_ZEROCOPY */
+    return lwip_close(fd);
+}
+
+static int lwip_vfs_fstat(void *ctx, int fd, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFSOCK;
+    return 0;
+}
+
+static int lwip_vfs_fcntl(void *ctx, int fd, int cmd, int arg)
+{
+    return lwip_fcntl(fd, cmd, arg);
+}
+
+static int lwip_vfs_ioctl(void *ctx, int fd, int cmd, va_list args)
+{
+    return lwip_ioctl(fd, cmd, va_arg(args, void *));
+}
+
+static int lwip_vfs_select(void *ctx, int nfds, fd_set *readfds, fd_set *writefds,
+                           fd_set *exceptfds, struct timeval *timeout)
+{
+    return lwip_select(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+static int lwip_vfs_start_select(void *ctx, int nfds, fd_set *readfds, fd_set *writefds,
+                                 fd_set *exceptfds, SemaphoreHandle_t *sem, void **handle)
+{
+    *handle = lwip_select_start(nfds, readfds, writefds, exceptfds, sem);
+    return (*handle != NULL) ? 0 : -1;
+}
+
+static void lwip_vfs_end_select(void *ctx, void *handle)
+{
+    lwip_select_end(handle);
+}
+
+#if LWIP_SOCKET_ZEROCOPY
+static ssize_t lwip_vfs_read_zc(void *ctx, int fd, const void **data, size_t size)
+{
+    lwip_rx_chain_t *rx = get_rx_chain(fd);
+    if (rx == NULL || rx->pending != 0) {
+        errno = (rx == NULL) ? EBADF : EBUSY;
+        return -1;
+    }
+    if (rx->p == NULL) {
+        int n = lwip_recv_pbuf(fd, &rx->p, 0, NULL, NULL);
+        if (n <= 0) {
+            rx->p = NULL;
+            return n;
+        }
+        rx->q = rx->p;
+        rx->offset = 0;
+        // skip empty pbufs at the start
+        rx_chain_consume(fd, rx, 0);
+    }
+    size_t len = rx->q->len - rx->offset;
+    if (len > size) {
+        len = size;
+    }
+    *data = (const uint8_t *) rx->q->payload + rx->offset;
+    rx->pending = len;
+    return len;
+}
+
+static int lwip_vfs_read_zc_release(void *ctx, int fd)
+{
+    lwip_rx_chain_t *rx = get_rx_chain(fd);
+    if (rx == NULL || rx->p == NULL || rx->pending == 0) {
+        return 0;
+    }
+    size_t len = rx->pending;
+    rx->pending = 0;
+    rx_chain_consume(fd, rx, len);
+    return 0;
+}
+
+static void lwip_vfs_sent(int s, void *arg, int err)
+{
+    lwip_write_zc_t *w = (lwip_write_zc_t *) arg;
+    w->done(w->arg, err);
+    free(w);
+}
+
+static ssize_t lwip_vfs_write_zc(void *ctx, int fd, const void *data, size_t size,
+                                 esp_vfs_write_done_t done, void *arg)
+{
+    lwip_write_zc_t *w = malloc(sizeof(lwip_write_zc_t));
+    if (w == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    w->done = done;
+    w->arg = arg;
+    int n = lwip_send_nocopy(fd, data, size, 0, &lwip_vfs_sent, w);
+    if (n < 0) {
+        free(w);
+    }
+    return n;
+}
+#endif /* LWIP_SOCKET_ZEROCOPY */
+
+esp_err_t esp_vfs_lwip_sockets_register(void)
+{
+    const esp_vfs_t vfs = {
+        .read = &lwip_vfs_read,
+        .write = &lwip_vfs_write,
+        .close = &lwip_vfs_close,
+        .fstat = &lwip_vfs_fstat,
+        .fcntl = &lwip_vfs_fcntl,
+        .ioctl = &lwip_vfs_ioctl,
+        .select = &lwip_vfs_select,
+        .start_select = &lwip_vfs_start_select,
+        .end_select = &lwip_vfs_end_select,
+#if LWIP_SOCKET_ZEROCOPY
+        .read_zc = &lwip_vfs_read_zc,
+        .read_zc_release = &lwip_vfs_read_zc_release,
+        .write_zc = &lwip_vfs_write_zc,
+#endif /* LWIP_SOCKET_ZEROCOPY */
+    };
+    return esp_vfs_register_fd_range(&vfs, NULL, LWIP_SOCKET_OFFSET, LWIP_FD_MAX);
+}
@@ -0,0 +1,254 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/lock.h>
+#include "sdkconfig.h"
+#include "esp_vfs.h"
+#include "esp_vfs_dev.h"
+#include "esp_console.h"
+#include "soc/soc.h"
+#include "soc/uart_reg.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* The driver's descriptor of a UART is its number. The console descriptors
+   0 to 2 all refer to UART0. There are no receive interrupts, reads and
+   select poll the receive FIFO every tick. */
+
+#define UART_NUM            3
+#define CONSOLE_UART        0
+#define CONSOLE_FDS         3
+#define UART_FIFO_SIZE      128
+
+static int s_flags[UART_NUM];
+static _lock_t s_write_lock[UART_NUM];
+
+static inline size_t rx_count(int uart)
+{
+    return (READ_PERI_REG(UART_STATUS_REG(uart)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT;
+}
+
+static inline size_t tx_count(int uart)
+{
+    return (READ_PERI_REG(UART_STATUS_REG(uart)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+}
+
+static void tx_char(int uart, char c)
+{
+    while (tx_count(uart) >= UART_FIFO_SIZE) {
+        ;
+    }
+    WRITE_PERI_REG(UART_FIFO_REG(uart), c);
+}
+
+static ssize_t uart_write_chars(int uart, const char *data, size_t size, bool console)
+{
+    /* Even though newlib does stream locking on stdout, we need
+       a dedicated stdout UART lock...
+
+       This is because each task has its own _reent structure with
+       unique FILEs for stdin/stdout/stderr, so these are
+       per-thread (lazily initialised by __sinit the first time a
+       stdio function is used, see findfp.c:235.
+
+       It seems like overkill to allocate a FILE-per-task and lock
+       a thread-local stream, but I see no easy way to fix this
+       (pre-__sinit_, tasks have "fake" FILEs ie __sf_fake_stdout
+       which aren't fully valid.)
+    */
+    _lock_acquire_recursive(&s_write_lock[uart]);
+#if CONFIG_CONSOLE_UART_BUFFERED
+    if (!console || esp_console_write(data, size) != ESP_OK)
+#endif
+    {
+        for (size_t i = 0; i < size; i++) {
+#if CONFIG_NEWLIB_STDOUT_ADDCR
+            if (console && data[i] == '\n') {
+                tx_char(uart, '\r');
+            }
+#endif
+            tx_char(uart, data[i]);
+        }
+    }
+    _lock_release_recursive(&s_write_lock[uart]);
+    return size;
+}
+
+static ssize_t uart_read_chars(int uart, char *dst, size_t size)
+{
+    size_t n = 0;
+    for (;;) {
+        while (n < size && rx_count(uart) > 0) {
+            dst[n++] = READ_PERI_REG(UART_FIFO_REG(uart));
+        }
+        if (n > 0 || size == 0) {
+            return n;
+        }
+        if (s_flags[uart] & O_NONBLOCK) {
+            errno = EAGAIN;
+            return -1;
+        }
+        vTaskDelay(1);
+    }
+}
+
+static int uart_select_fds(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+                           struct timeval *timeout, bool console)
+{
+    TickType_t ticks = portMAX_DELAY;
+    if (timeout) {
+        ticks = timeout->tv_sec * configTICK_RATE_HZ +
+                ((uint64_t) timeout->tv_usec * configTICK_RATE_HZ + 999999) / 1000000;
+    }
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        int count = 0;
+        fd_set ready;
+        FD_ZERO(&ready);
+        for (int fd = 0; fd < nfds; ++fd) {
+            int uart = console ? CONSOLE_UART : fd;
+            if (readfds && FD_ISSET(fd, readfds) && rx_count(uart) > 0) {
+                FD_SET(fd, &ready);
+                count++;
+            }
+            // writes wait for room in the FIFO or console buffer, they don't fail
+            if (writefds && FD_ISSET(fd, writefds)) {
+                count++;
+            }
+        }
+        if (count > 0 || (ticks != portMAX_DELAY && xTaskGetTickCount() - start >= ticks)) {
+            if (readfds) {
+                *readfds = ready;
+            }
+            if (exceptfds) {
+                FD_ZERO(exceptfds);
+            }
+            return count;
+        }
+        vTaskDelay(1);
+    }
+}
+
+static int uart_fcntl_flags(int uart, int cmd, int arg)
+{
+    if (cmd == F_GETFL) {
+        return O_RDWR | s_flags[uart];
+    } else if (cmd == F_SETFL) {
+        s_flags[uart] = arg & O_NONBLOCK;
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static int uart_fstat_chr(struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFCHR;
+    return 0;
+}
+
+static int uart_open(void *ctx, const char *path, int flags, int mode)
+{
+    if (path[0] != '/' || path[1] < '0' || path[1] >= '0' + UART_NUM || path[2] != '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+    int uart = path[1] - '0';
+    s_flags[uart] = flags & O_NONBLOCK;
+    return uart;
+}
+
+static ssize_t uart_write(void *ctx, int fd, const void *data, size_t size)
+{
+    return uart_write_chars(fd, data, size, false);
+}
+
+static ssize_t uart_read(void *ctx, int fd, void *dst, size_t size)
+{
+    return uart_read_chars(fd, dst, size);
+}
+
+static int uart_close(void *ctx, int fd)
+{
+    return 0;
+}
+
+static int uart_fstat(void *ctx, int fd, struct stat *st)
+{
+    return uart_fstat_chr(st);
+}
+
+static int uart_fcntl(void *ctx, int fd, int cmd, int arg)
+{
+    return uart_fcntl_flags(fd, cmd, arg);
+}
+
+static int uart_select(void *ctx, int nfds, fd_set *readfds, fd_set *writefds,
+                       fd_set *exceptfds, struct timeval *timeout)
+{
+    return uart_select_fds(nfds, readfds, writefds, exceptfds, timeout, false);
+}
+
+static ssize_t console_write(void *ctx, int fd, const void *data, size_t size)
+{
+    return uart_write_chars(CONSOLE_UART, data, size, true);
+}
+
+static ssize_t console_read(void *ctx, int fd, void *dst, size_t size)
+{
+    return uart_read_chars(CONSOLE_UART, dst, size);
+}
+
+static int console_fcntl(void *ctx, int fd, int cmd, int arg)
+{
+    return uart_fcntl_flags(CONSOLE_UART, cmd, arg);
+}
+
+static int console_select(void *ctx, int nfds, fd_set *readfds, fd_set *writefds,
+                          fd_set *exceptfds, struct timeval *timeout)
+{
+    return uart_select_fds(nfds, readfds, writefds, exceptfds, timeout, true);
+}
+
+esp_err_t esp_vfs_dev_uart_register(void)
+{
+    const esp_vfs_t uart_vfs = {
+        .open = &uart_open,
+        .read = &uart_read,
+        .write = &uart_write,
+        .close = &uart_close,
+        .fstat = &uart_fstat,
+        .fcntl = &uart_fcntl,
+        .select = &uart_select,
+    };
+    /* stdin, stdout and stderr can't be closed: newlib closes them
+       whenever a task is deleted (see _extra_cleanup_r) */
+    const esp_vfs_t console_vfs = {
+        .read = &console_read,
+        .write = &console_write,
+        .close = &uart_close,
+        .fstat = &uart_fstat,
+        .fcntl = &console_fcntl,
+        .select = &console_select,
+    };
+    esp_err_t err = esp_vfs_register_fd_range(&console_vfs, NULL, 0, CONSOLE_FDS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_vfs_register("/dev/uart", &uart_vfs, NULL);
+}
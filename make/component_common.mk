@@ -30,6 +30,41 @@ include $(IDF_PATH)/make/common.mk
 #Name of the component
 COMPONENT_NAME ?= $(lastword $(subst /, ,$(realpath $(COMPONENT_PATH))))
 
+#Compile time log level of this component, if set in CONFIG_LOG_COMPONENT_LEVELS
+#as a "component:level" item, with level a number or one of the letters N, E, W, I, D, V.
+LOG_LEVEL_NUMBER_N := 0
+LOG_LEVEL_NUMBER_E := 1
+LOG_LEVEL_NUMBER_W := 2
+LOG_LEVEL_NUMBER_I := 3
+LOG_LEVEL_NUMBER_D := 4
+LOG_LEVEL_NUMBER_V := 5
+$(foreach level,0 1 2 3 4 5,$(eval LOG_LEVEL_NUMBER_$(level) := $(level)))
+COMPONENT_LOG_LEVEL := $(patsubst $(COMPONENT_NAME):%,%,$(filter $(COMPONENT_NAME):%,$(subst ",,$(CONFIG_LOG_COMPONENT_LEVELS))))
+ifneq ("$(COMPONENT_LOG_LEVEL)","")
+ifeq ("$(LOG_LEVEL_NUMBER_$(COMPONENT_LOG_LEVEL))","")
+$(error Invalid log level "$(COMPONENT_LOG_LEVEL)" for component $(COMPONENT_NAME) in CONFIG_LOG_COMPONENT_LEVELS)
+endif
+CFLAGS += -DLOG_COMPONENT_LEVEL=$(LOG_LEVEL_NUMBER_$(COMPONENT_LOG_LEVEL))
+CXXFLAGS += -DLOG_COMPONENT_LEVEL=$(LOG_LEVEL_NUMBER_$(COMPONENT_LOG_LEVEL))
+endif
+
+#Optimization level of this component, if set in CONFIG_OPTIMIZATION_COMPONENT_LEVELS
+#as a "component:level" item. Its -O option comes after the global one, so it takes precedence.
+COMPONENT_OPTIMIZATION := $(patsubst $(COMPONENT_NAME):%,%,$(filter $(COMPONENT_NAME):%,$(subst ",,$(CONFIG_OPTIMIZATION_COMPONENT_LEVELS))))
+ifneq ("$(COMPONENT_OPTIMIZATION)","")
+ifeq ("$(filter 0 1 2 3 s g,$(COMPONENT_OPTIMIZATION))","")
+$(error Invalid optimization level "$(COMPONENT_OPTIMIZATION)" for component $(COMPONENT_NAME) in CONFIG_OPTIMIZATION_COMPONENT_LEVELS)
+endif
+CFLAGS += -O$(COMPONENT_OPTIMIZATION)
+CXXFLAGS += -O$(COMPONENT_OPTIMIZATION)
+endif
+
+#Components placed by archive name in the linker script can't take part in link time optimization
+ifneq ("$(filter $(COMPONENT_NAME),$(subst ",,$(CONFIG_OPTIMIZATION_LTO_EXCLUDE)))","")
+CFLAGS += -fno-lto
+CXXFLAGS += -fno-lto
+endif
+
 #Absolute path of the .a file
 COMPONENT_LIBRARY := lib$(COMPONENT_NAME).a
 
@@ -33,6 +33,8 @@ help:
 	@echo "make app-flash - Flash just the app"
 	@echo "make app-clean - Clean just the app"
 	@echo ""
+	@echo "make pipeline-flash, make pipeline-app-flash - Flash with the faster pipelined flasher"
+	@echo ""
 	@echo "See also 'make bootloader', 'make bootloader-flash', 'make bootloader-clean', "
 	@echo "'make partition_table', etc, etc."
 
@@ -133,6 +135,21 @@ export PROJECT_PATH
 #Include functionality common to both project & component
 -include $(IDF_PATH)/make/common.mk
 
+# Optimization: -Og for debug builds, -Os for release builds. Components
+# listed in CONFIG_OPTIMIZATION_COMPONENT_LEVELS add their own -O option,
+# see component_common.mk
+ifdef CONFIG_OPTIMIZATION_LEVEL_RELEASE
+OPTIMIZATION_FLAGS = -Os
+else
+OPTIMIZATION_FLAGS = -Og
+endif
+
+# Link time optimization, the link step optimizes again with -Os
+ifdef CONFIG_OPTIMIZATION_LTO
+OPTIMIZATION_FLAGS += -flto
+LTO_LDFLAGS = -flto -Os
+endif
+
 # Set default LDFLAGS
 
 LDFLAGS ?= -nostdlib \
@@ -141,6 +158,7 @@ LDFLAGS ?= -nostdlib \
 	$(addprefix -L$(BUILD_DIR_BASE)/,$(COMPONENTS) $(SRCDIRS)) \
 	-u call_user_start_cpu0	\
 	-Wl,--gc-sections	\
+	$(LTO_LDFLAGS) \
 	-Wl,-static	\
 	-Wl,--start-group	\
 	$(COMPONENT_LDFLAGS) \
@@ -158,14 +176,14 @@ LDFLAGS ?= -nostdlib \
 # files, set CFLAGS += in your component's Makefile.projbuild
 
 # CPPFLAGS used by an compile pass that uses the C preprocessor
-CPPFLAGS = -DESP_PLATFORM -Og -g3 -Wpointer-arith -Werror -Wno-error=unused-function -Wno-error=unused-but-set-variable \
+CPPFLAGS = -DESP_PLATFORM $(OPTIMIZATION_FLAGS) -g3 -Wpointer-arith -Werror -Wno-error=unused-function -Wno-error=unused-but-set-variable \
 		-Wno-error=unused-variable -Wall -ffunction-sections -fdata-sections -mlongcalls -nostdlib -MMD -MP
 
 # C flags use by C only
 CFLAGS = $(CPPFLAGS) -std=gnu99 -g3 -fstrict-volatile-bitfields
 
 # CXXFLAGS uses by C++ only
-CXXFLAGS = $(CPPFLAGS) -Og -std=gnu++11 -g3 -fno-exceptions -fstrict-volatile-bitfields
+CXXFLAGS = $(CPPFLAGS) -std=gnu++11 -g3 -fno-exceptions -fstrict-volatile-bitfields
 
 export CFLAGS CPPFLAGS CXXFLAGS
 
@@ -180,7 +198,8 @@ HOSTOBJCOPY := $(OBJCOPY)
 CC := $(call dequote,$(CONFIG_TOOLPREFIX))gcc
 CXX := $(call dequote,$(CONFIG_TOOLPREFIX))c++
 LD := $(call dequote,$(CONFIG_TOOLPREFIX))ld
-AR := $(call dequote,$(CONFIG_TOOLPREFIX))ar
+# archives of LTO objects need the symbol index which gcc-ar adds
+AR := $(call dequote,$(CONFIG_TOOLPREFIX))$(if $(CONFIG_OPTIMIZATION_LTO),gcc-ar,ar)
 OBJCOPY := $(call dequote,$(CONFIG_TOOLPREFIX))objcopy
 export CC CXX LD AR OBJCOPY
 